@@ -21,9 +21,12 @@
 
 #include "dosbox.h"
 
+#include <list>
 #include <memory>
 #include <stdio.h>
 #include <array>
+#include <unordered_map>
+#include <vector>
 
 #include "bios.h"
 #include "dos_inc.h"
@@ -49,20 +52,27 @@ public:
 	uint8_t Read_AbsoluteSector(uint32_t sectnum, void * data);
 	uint8_t Write_AbsoluteSector(uint32_t sectnum, void * data);
 
+	// Transfer runs of sectors, a block at a time through the cache
+	uint8_t Read_Sectors(uint32_t head, uint32_t cylinder, uint32_t sector,
+	                     uint32_t count, void *data);
+	uint8_t Write_Sectors(uint32_t head, uint32_t cylinder, uint32_t sector,
+	                      uint32_t count, const void *data);
+	uint8_t Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void *data);
+	uint8_t Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void *data);
+
 	void Set_Geometry(uint32_t setHeads, uint32_t setCyl, uint32_t setSect, uint32_t setSectSize);
 	void Get_Geometry(uint32_t * getHeads, uint32_t *getCyl, uint32_t *getSect, uint32_t *getSectSize);
 	uint8_t GetBiosType(void);
 	uint32_t getSectSize(void);
 
+	// Writes the sectors held back by the block cache to the image
+	void Flush();
+
 	imageDisk(FILE *img_file, const char *img_name, uint32_t img_size_k, bool is_hdd);
 	imageDisk(const imageDisk&) = delete; // prevent copy
 	imageDisk& operator=(const imageDisk&) = delete; // prevent assignment
 
-	virtual ~imageDisk()
-	{
-		if (diskimg != nullptr)
-			fclose(diskimg);
-	}
+	virtual ~imageDisk();
 
 	bool hardDrive;
 	bool active;
@@ -72,9 +82,32 @@ public:
 
 	uint32_t sector_size;
 	uint32_t heads,cylinders,sectors;
+
+	// Counts the sectors written, so the drives caching what they read
+	// can tell when someone else wrote to the disk
+	uint32_t write_count = 0;
 private:
-	uint32_t current_fpos;
-	enum { NONE,READ,WRITE } last_action;
+	// Block cache
+	// ~~~~~~~~~~~
+	// Keeps the most recently used runs of sectors, reading them in
+	// blocks and further ahead on sequential access. Written sectors are
+	// held back and written in coalesced runs when flushed, which happens
+	// once a second, when their block is evicted, and when unmounting.
+	struct CachedBlock {
+		uint32_t index = 0;
+		uint32_t dirty_sectors = 0; // bit mask
+		std::vector<uint8_t> data = {};
+	};
+	int64_t ReadImage(uint64_t offset, void *data, size_t bytes);
+	bool WriteImage(uint64_t offset, const void *data, size_t bytes);
+	CachedBlock *GetBlock(uint32_t index);
+	void WriteBack(const std::vector<CachedBlock *> &blocks);
+	void ClearCache();
+
+	std::list<CachedBlock> cache = {}; // the most recent first
+	std::unordered_map<uint32_t, std::list<CachedBlock>::iterator> cache_index = {};
+	size_t cache_max_blocks = 0; // zero if the cache is disabled
+	uint32_t last_block = UINT32_MAX;
 };
 
 void updateDPT(void);
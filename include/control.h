@@ -25,6 +25,7 @@
 #include <deque>
 #include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "programs.h"
@@ -44,6 +45,9 @@ public:
 	CommandLine * cmdline = nullptr;
 private:
 	std::deque<Section*> sectionlist = {};
+	// Lower-cased section name -> section, for constant-time lookups
+	std::unordered_map<std::string, Section *> section_index = {};
+	void AddSection(Section *section);
 	Section_line overwritten_autoexec_section = {};
 	std::string overwritten_autoexec_conf = {};
 	void (*_start_function)(void) = nullptr;
@@ -57,6 +57,10 @@ extern int32_t CPU_CycleLimit;
 extern int64_t CPU_IODelayRemoved;
 extern bool CPU_CycleAutoAdjust;
 extern bool CPU_SkipCycleAutoAdjust;
+extern bool CPU_IdleSleep;
+
+enum class CyclesController { Reactive, Predictive };
+extern CyclesController CPU_CyclesController;
 extern Bitu CPU_AutoDetermineMode;
 
 extern Bitu CPU_ArchitectureType;
@@ -75,6 +79,8 @@ constexpr bool CPU_UseRwxMemProtect = true;
 
 Bits CPU_Core_Normal_Run(void);
 Bits CPU_Core_Normal_Trap_Run(void);
+// Whether a page fault can rewind the normal core's current instruction
+bool CPU_Core_Normal_CanRestart();
 Bits CPU_Core_Simple_Run(void);
 Bits CPU_Core_Simple_Trap_Run(void);
 Bits CPU_Core_Full_Run(void);
@@ -89,6 +95,9 @@ void CPU_Enable_SkipAutoAdjust(void);
 void CPU_Disable_SkipAutoAdjust(void);
 void CPU_Reset_AutoAdjust(void);
 
+// The guest sits in HLT with interrupts enabled, waiting for an IRQ
+bool CPU_IsWaitingForInterrupt();
+
 
 //CPU Stuff
 
@@ -402,6 +411,14 @@ public:
 	} saved;
 };
 
+// Descriptor cache
+// ~~~~~~~~~~~~~~~~
+// Loads the descriptor at the linear address in the GDT or LDT, from the
+// cache if it was read before. The cache is flushed by LGDT, LLDT, paging
+// changes and writes to the pages the cached descriptors came from.
+void CPU_LoadDescriptor(PhysPt address, Descriptor &desc);
+void CPU_FlushDescriptorCache();
+
 class DescriptorTable {
 public:
 	PhysPt	GetBase			(void)			{ return table_base;	}
@@ -428,11 +445,11 @@ public:
 		const auto nonbitu_address = check_cast<PhysPt>(address);
 		if (selector & 4) {
 			if (address>=ldt_limit) return false;
-			desc.Load(ldt_base + nonbitu_address);
+			CPU_LoadDescriptor(ldt_base + nonbitu_address, desc);
 			return true;
 		} else {
 			if (address>=table_limit) return false;
-			desc.Load(table_base + nonbitu_address);
+			CPU_LoadDescriptor(table_base + nonbitu_address, desc);
 			return true;
 		}
 	}
@@ -457,6 +474,7 @@ public:
 			ldt_value=0;
 			ldt_base=0;
 			ldt_limit=0;
+			CPU_FlushDescriptorCache();
 			return true;
 		}
 		Descriptor desc;
@@ -466,6 +484,7 @@ public:
 		ldt_base=desc.GetBase();
 		ldt_limit=desc.GetLimit();
 		ldt_value=value;
+		CPU_FlushDescriptorCache();
 		return true;
 	}
 private:
@@ -128,6 +128,18 @@ void close_directory(dir_information* dirp);
 FILE *fopen_wrap(const char *path, const char *mode);
 FILE *fopen_wrap_ro_fallback(const std::string &filename, bool &is_readonly);
 
+// Reads from the given position in a file, without going through the
+// stream's buffer. Returns the number of bytes read, or -1 on failure.
+int64_t read_file_at(FILE *fp, void *data, size_t size, int64_t pos);
+
+// Writes all of the data at the given position in a file, without going
+// through the stream's buffer. Returns false on failure.
+bool write_file_at(FILE *fp, const void *data, size_t size, int64_t pos);
+
+// Hints that a file will be read sequentially, so the host can read further
+// ahead; does nothing where the host takes no such hints
+void advise_sequential_reads(FILE *fp);
+
 bool wild_match(const char *haystack, const char *needle);
 bool WildFileCmp(const char *file, const char *wild, bool long_compare = false);
 
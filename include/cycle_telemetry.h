@@ -0,0 +1,125 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_CYCLE_TELEMETRY_H
+#define DOSBOX_CYCLE_TELEMETRY_H
+
+#include "dosbox.h"
+
+#include <array>
+#include <string>
+
+/*
+Cycle Telemetry
+~~~~~~~~~~~~~~~
+Accounts, per emulated millisecond (tick), how many guest cycles ran and how
+much host time the emulation thread spent in each part of the main loop, along
+with the decisions taken by the automatic cycle adjustment.
+
+The results are plotted in Tracy (when built with it and a profiler is
+connected) and written as CSV rows to the [cpu] cycle_telemetry_file.
+
+Usage:
+ 1. Wrap the code to account for in a TelemetryScope. Scopes can be nested;
+    time is charged to the innermost scope only.
+ 2. Report the cycles consumed by the core with TELEMETRY_AddCycles().
+ 3. Call TELEMETRY_EndTick() right before the next tick starts.
+*/
+
+enum class TelemetryBucket : uint8_t {
+	Other, // main loop, host events and anything not wrapped in a scope
+	Cpu,   // CPU core and callback handlers
+	Pic,   // PIC event queue and timer tick handlers
+	Render,
+	Mixer,
+	Idle, // sleeping while waiting for the next tick
+	NumBuckets,
+};
+
+struct CycleAdjustDecision {
+	const char *action = "";
+	int32_t old_cycle_max = 0;
+	int32_t new_cycle_max = 0;
+	int32_t ratio = 0;
+	int ticks_done = 0;
+	int ticks_scheduled = 0;
+	int ticks_added = 0;
+	double io_delay_ratio = 0.0;
+};
+
+// Sums over the ticks ended since the previous TELEMETRY_TakeTotals() call
+struct TelemetryTotals {
+	int ticks = 0;
+	int64_t cycles = 0;
+	int64_t cpu_ns = 0;
+	int64_t busy_ns = 0; // everything but Idle
+};
+
+// Sums over all the ticks ended since TELEMETRY_StartRun()
+struct TelemetryRun {
+	int64_t ticks = 0;
+	int64_t cycles = 0;
+	std::array<int64_t, static_cast<size_t>(TelemetryBucket::NumBuckets)> ns = {};
+};
+
+extern bool telemetry_active;
+
+void TELEMETRY_Open(const std::string &csv_path);
+void TELEMETRY_Close();
+
+TelemetryBucket TELEMETRY_Switch(const TelemetryBucket bucket);
+void TELEMETRY_AddCycles(const int64_t cycles);
+void TELEMETRY_EndTick();
+void TELEMETRY_LogAdjust(const CycleAdjustDecision &decision);
+
+// Keeps the accounting running without a CSV file or profiler, for users
+// of TELEMETRY_TakeTotals()
+void TELEMETRY_SetRequired(const bool required);
+TelemetryTotals TELEMETRY_TakeTotals();
+
+// Keeps the accounting running from now on and restarts the run's sums, for
+// reports covering a whole session such as the --benchmark mode's
+void TELEMETRY_StartRun();
+TelemetryRun TELEMETRY_GetRun();
+
+class TelemetryScope {
+public:
+	explicit TelemetryScope(const TelemetryBucket bucket)
+	        : engaged(telemetry_active)
+	{
+		if (engaged)
+			previous = TELEMETRY_Switch(bucket);
+	}
+
+	~TelemetryScope()
+	{
+		if (engaged)
+			TELEMETRY_Switch(previous);
+	}
+
+	TelemetryScope(const TelemetryScope &) = delete;
+	TelemetryScope &operator=(const TelemetryScope &) = delete;
+
+private:
+	const bool engaged;
+	TelemetryBucket previous = TelemetryBucket::Other;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_DIR_WATCHER_H
+#define DOSBOX_DIR_WATCHER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*  Directory Watcher
+ *  -----------------
+ *  Reports the entries added to and removed from host directories, so the
+ *  drive cache can update what changed instead of re-reading directories.
+ *
+ *  Each directory is watched on its own, not recursively, using inotify on
+ *  Linux, kqueue on macOS and the BSDs, and ReadDirectoryChangesW on
+ *  Windows. The changes are polled by the caller, so no thread is needed.
+ *  Elsewhere, or when the host runs out of watches, nothing is reported.
+ */
+
+// A change in a watched directory
+struct DirChange {
+	void *tag = nullptr;       // as given to Watch
+	std::string dir_path = {}; // as given to Watch
+	std::string name = {};     // empty if the whole directory may differ
+};
+
+class DirWatcher {
+public:
+	DirWatcher();
+	~DirWatcher();
+
+	// Watching a tag again replaces its previous directory
+	bool Watch(const std::string &dir_path, void *tag);
+	void Unwatch(void *tag);
+	bool IsWatching(void *tag) const;
+
+	// The changes since the last call, possibly including changes that
+	// were made before the directory was watched
+	std::vector<DirChange> TakeChanges();
+
+private:
+	DirWatcher(const DirWatcher &)            = delete;
+	DirWatcher &operator=(const DirWatcher &) = delete;
+
+	struct Platform;
+	std::unique_ptr<Platform> platform;
+};
+
+#endif
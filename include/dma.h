@@ -38,6 +38,9 @@ enum DMAEvent {
 class DmaChannel;
 using DMA_CallBack = std::function<void(DmaChannel *chan, DMAEvent event)>;
 
+// Receives guest memory taking part in a transfer, valid during the call
+using DmaSpanConsumer = std::function<void(const uint8_t *data, size_t bytes)>;
+
 class DmaChannel {
 public:
 	uint32_t pagebase;
@@ -95,8 +98,16 @@ public:
 		return ReadOrWrite(DMA_DIRECTION::WRITE, words, src_buffer);
 	}
 
+	// Reads like Read, but passes the guest memory holding the words to
+	// the consumer instead of copying it, one contiguous span at a time.
+	// Pages and wrapping around the buffer split the words into spans.
+	size_t ReadSpans(size_t words, const DmaSpanConsumer &consumer);
+
 private:
+	using DmaWordsFunction = std::function<void(uint32_t address, uint16_t words)>;
+
 	size_t ReadOrWrite(DMA_DIRECTION direction, size_t words, uint8_t *buffer);
+	size_t Transfer(size_t words, const DmaWordsFunction &words_function);
 };
 
 class DmaController {
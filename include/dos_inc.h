@@ -114,6 +114,8 @@ enum { HAND_NONE=0,HAND_FILE,HAND_DEVICE};
 void DOS_SetupFiles (void);
 bool DOS_ReadFile(uint16_t handle,uint8_t * data,uint16_t * amount, bool fcb = false);
 bool DOS_WriteFile(uint16_t handle,uint8_t * data,uint16_t * amount,bool fcb = false);
+bool DOS_ReadFileToMem(uint16_t handle, PhysPt pt, uint16_t *amount);
+bool DOS_WriteFileFromMem(uint16_t handle, PhysPt pt, uint16_t *amount);
 bool DOS_SeekFile(uint16_t handle,uint32_t * pos,uint32_t type,bool fcb = false);
 bool DOS_CloseFile(uint16_t handle,bool fcb = false,uint8_t * refcnt = NULL);
 bool DOS_FlushFile(uint16_t handle);
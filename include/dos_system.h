@@ -21,10 +21,13 @@
 
 #include "dosbox.h"
 
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "cross.h"
+#include "dir_watcher.h"
 #include "mem.h"
 #include "support.h"
 
@@ -92,6 +95,11 @@ public:
 	virtual bool	Close()=0;
 	virtual uint16_t	GetInformation(void)=0;
 
+	// Read into and write from guest memory, by default through the copy
+	// buffer; files on the host override these to skip the copy
+	virtual bool ReadToMem(PhysPt pt, uint16_t *size);
+	virtual bool WriteFromMem(PhysPt pt, uint16_t *size);
+
 	virtual bool IsOpen() { return open; }
 	virtual void AddRef() { refCtr++; }
 	virtual Bits RemoveRef() { return --refCtr; }
@@ -152,6 +160,8 @@ public:
 	localFile &operator=(const localFile &) = delete; // prevent assignment
 	bool Read(uint8_t *data, uint16_t *size);
 	bool Write(uint8_t *data, uint16_t *size);
+	bool ReadToMem(PhysPt pt, uint16_t *size);
+	bool WriteFromMem(PhysPt pt, uint16_t *size);
 	bool Seek(uint32_t *pos, uint32_t type);
 	bool Close();
 	uint16_t GetInformation();
@@ -159,15 +169,34 @@ public:
 	void Flush();
 	void SetFlagReadOnlyMedium() { read_only_medium = true; }
 	const char *GetBaseDir() const { return basedir; }
+	void KeepHandleOnClose(const std::string &host_path);
+	void EnableWriteBehind() { write_behind = true; }
 	FILE *fhandle = nullptr; // todo handle this properly
 private:
 	const char *basedir;
+	FILE *kept_handle = nullptr; // kept open after closing, if still fhandle
+	std::string kept_host_path = {};
 	long stream_pos = 0;
 	bool ftell_and_check();
 	void fseek_and_check(int whence);
 	bool fseek_to_and_check(long pos, int whence);
+	uint16_t read_buffered(uint8_t *data, uint16_t requested);
+	void wait_for_queued_writes();
 	bool read_only_medium;
 	enum { NONE,READ,WRITE } last_action;
+
+	// While reading, stream_pos is the file position and the stream's
+	// own position is left behind
+	std::vector<uint8_t> read_ahead = {};
+	long read_ahead_pos = 0;
+	size_t read_ahead_bytes = 0;
+	uint32_t read_ahead_writes = 0; // local file writes when it was read
+	long next_read_pos = 0;         // where a sequential read starts
+
+	// Writes handed to the background thread, which leave the stream
+	// behind like reads do
+	bool write_behind = false;
+	uint64_t last_queued_write = 0; // 0 once the writes are done
 };
 
 /* The following variable can be lowered to free up some memory.
@@ -195,7 +224,8 @@ public:
 	char* GetExpandName        (const char* path);
 	bool  GetShortName         (const char* fullname, char* shortname);
 
-	bool  FindFirst            (char* path, uint16_t& id);
+	// Only the entries whose short names match the pattern are found
+	bool  FindFirst            (char* path, const char* pattern, uint16_t& id);
 	bool  FindNext             (uint16_t id, char* &result);
 
 	void  CacheOut             (const char* path, bool ignoreLastDir = false);
@@ -205,6 +235,23 @@ public:
 	void  DeleteEntry          (const char* path, bool ignoreLastDir = false);
 	void  EmptyCache           (void);
 
+	// Brings the entry of the path up to date with the host, after the
+	// drive created, removed, or renamed it
+	void  UpdateEntry          (const char* path);
+
+	// Removes only the entry of the path, leaving the rest of its
+	// directory cached in
+	void  RemoveEntry          (const char* path);
+
+	// The cached host directories are watched, and the entries the host
+	// adds or removes are updated as they change. Drives whose entries
+	// don't all come from the host, like overlays, turn that off.
+	void  SetWatchHost         (bool watch);
+
+	// Lists the host directories below the base directory on a worker
+	// thread, ahead of the guest opening them
+	void  PrefetchDirs         (void);
+
 	void SetLabel(const char *name, bool cdrom, bool allowupdate);
 	const char *GetLabel() const { return label; }
 
@@ -218,8 +265,7 @@ public:
 		          id(MAX_OPENDIRS),
 		          nextEntry(0),
 		          shortNr(0),
-		          fileList(0),
-		          longNameList(0)
+		          fileList(0)
 		{}
 
 		virtual ~CFileInfo()
@@ -228,7 +274,6 @@ public:
 				delete p;
 			}
 			fileList.clear();
-			longNameList.clear();
 		}
 
 		char        orgname[CROSS_LEN];
@@ -238,9 +283,27 @@ public:
 		uint16_t      id;
 		Bitu        nextEntry;
 		unsigned    shortNr;
-		// contents
+		// contents, sorted by short name
 		std::vector<CFileInfo*> fileList;
-		std::vector<CFileInfo*> longNameList;
+
+		// Looks up the contents by short name and by host name, and
+		// keeps the next ~N for the short names starting alike
+		struct Index {
+			std::unordered_map<std::string, CFileInfo*> shortNames = {};
+			std::unordered_map<std::string, CFileInfo*> longNames = {};
+			std::unordered_map<std::string, unsigned> nextShortNr = {};
+		};
+		std::unique_ptr<Index> index = {};
+
+		// Changes whenever the contents do, so the matches found for
+		// the searches can be reused until then
+		uint32_t generation = 0;
+		struct Matches {
+			uint32_t generation = 0;
+			TDirSort sort = NOSORT;
+			std::shared_ptr<const std::vector<std::string>> names = {};
+		};
+		std::unordered_map<std::string, Matches> matches = {}; // by pattern
 	};
 
 private:
@@ -250,15 +313,21 @@ private:
 	bool		RemoveTrailingDot	(char* shortname);
 	Bits		GetLongName		(CFileInfo* info, char* shortname, const size_t shortname_len);
 	void		CreateShortName		(CFileInfo* dir, CFileInfo* info);
-	unsigned        CreateShortNameID       (CFileInfo* dir, const char* name);
-	int		CompareShortname	(const char* compareName, const char* shortName);
+	unsigned        CreateShortNameID       (CFileInfo* dir, const std::string& prefix);
+	CFileInfo*	FindShortName		(CFileInfo* dir, const char* shortname);
+	CFileInfo*	FindLongName		(CFileInfo* dir, const char* name);
+	Bits		GetEntryIndex		(CFileInfo* dir, CFileInfo* info);
 	bool		SetResult		(CFileInfo* dir, char * &result, Bitu entryNr);
 	bool		IsCachedIn		(CFileInfo* dir);
 	CFileInfo*	FindDirInfo		(const char* path, char* expandedPath);
 	bool		RemoveSpaces		(char* str);
 	bool		OpenDir			(CFileInfo* dir, const char* path, uint16_t& id);
-	void		CreateEntry		(CFileInfo* dir, const char* name, bool is_directory);
-	void		CopyEntry		(CFileInfo* dir, CFileInfo* from);
+	CFileInfo*	CreateEntry		(CFileInfo* dir, const char* name, bool is_directory, bool keepSorted = true);
+	void		RemoveEntry		(CFileInfo* dir, size_t index);
+	void		UpdateHostEntry		(CFileInfo* dir, const char* dir_path, const char* name);
+	void		UpdateHostDir		(CFileInfo* dir, const char* dir_path);
+	void		ProcessHostChanges	(void);
+	std::shared_ptr<const std::vector<std::string>> GetMatches(CFileInfo* dir, const char* pattern);
 	uint16_t		GetFreeID		(CFileInfo* dir);
 	void		Clear			(void);
 
@@ -272,11 +341,24 @@ private:
 
 	uint16_t		srchNr;
 	CFileInfo*	dirSearch			[MAX_OPENDIRS];
-	CFileInfo*	dirFindFirst		[MAX_OPENDIRS];
+
+	// The short names a search has left to return, shared by the
+	// searches of the same directory and pattern
+	struct FindSearch {
+		std::shared_ptr<const std::vector<std::string>> names = {};
+		size_t next = 0;
+	};
+	FindSearch	findSearches		[MAX_OPENDIRS];
 	uint16_t		nextFreeFindFirst;
 
 	char		label				[CROSS_LEN];
 	bool		updatelabel;
+
+	std::unique_ptr<DirWatcher> watcher = {};
+	bool		watchHost = true;
+
+	struct Prefetcher;
+	std::unique_ptr<Prefetcher> prefetcher;
 };
 
 enum class DosDriveType : uint16_t {
@@ -286,6 +368,8 @@ enum class DosDriveType : uint16_t {
 	Fat     = 3,
 	Iso     = 4,
 	Virtual = 5,
+	Zip     = 6,
+	Memory  = 7,
 };
 
 class DOS_Drive {
@@ -334,6 +418,10 @@ public:
 			return MSG_Get("MOUNT_TYPE_FAT") + std::string(" ") + info;
 		case DosDriveType::Iso:
 			return MSG_Get("MOUNT_TYPE_ISO") + std::string(" ") + info;
+		case DosDriveType::Zip:
+			return MSG_Get("MOUNT_TYPE_ZIP") + std::string(" ") + info;
+		case DosDriveType::Memory:
+			return MSG_Get("MOUNT_TYPE_MEMORY") + std::string(" ") + info;
 		case DosDriveType::Virtual: return MSG_Get("MOUNT_TYPE_VIRTUAL");
 		default: return MSG_Get("MOUNT_TYPE_UNKNOWN");
 		}
@@ -376,4 +464,7 @@ void VFILE_Register(const char *name,
                     const char *dir = "");
 
 void VFILE_Register(const char *name, const std::vector<uint8_t> &blob, const char *dir);
+
+// Changes whenever files are added to or removed from the Z: drive
+uint32_t VFILE_GetGeneration();
 #endif
@@ -49,6 +49,7 @@ const char *DOSBOX_GetDetailedVersion() noexcept;
 double DOSBOX_GetUptime();
 
 void DOSBOX_RunMachine();
+int DOSBOX_GetRunDepth(); // how many DOSBOX_RunMachine calls are active
 void DOSBOX_SetLoop(LoopHandler * handler);
 void DOSBOX_SetNormalLoop();
 
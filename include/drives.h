@@ -21,7 +21,11 @@
 
 #include "dosbox.h"
 
+#include <list>
+#include <map>
 #include <memory>
+#include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <string>
 #include <vector>
@@ -34,6 +38,9 @@ std::string To_Label(const char* name);
 std::string generate_8x3(const char *lfn, const unsigned int num, const bool start = false);
 bool filename_not_8x3(const char *n);
 bool filename_not_strict_8x3(const char *n);
+// DOS names for the entries of a directory, unique among them; names
+// that are already 8.3 keep theirs
+std::vector<std::string> generate_unique_8x3_names(const std::vector<std::string> &names);
 char *VFILE_Generate_8x3(const char *name, const unsigned int onpos);
 void VFILE_Register(const char *name,
                     const uint8_t *data,
@@ -95,6 +102,7 @@ protected:
 private:
 	bool IsFirstEncounter(const std::string& filename);
 	std::unordered_set<std::string> write_protected_files;
+	bool write_behind = false;
 	struct {
 		uint16_t bytes_sector;
 		uint8_t sectors_cluster;
@@ -167,6 +175,7 @@ public:
 	fatDrive(const char * sysFilename, uint32_t bytesector, uint32_t cylsector, uint32_t headscyl, uint32_t cylinders, uint32_t startSector, bool roflag);
 	fatDrive(const fatDrive&) = delete; // prevent copying
 	fatDrive& operator= (const fatDrive&) = delete; // prevent assignment
+	~fatDrive();
 	virtual bool FileOpen(DOS_File * * file,char * name,uint32_t flags);
 	virtual bool FileCreate(DOS_File * * file,char * name,uint16_t attributes);
 	virtual bool FileUnlink(char * name);
@@ -207,11 +216,19 @@ public:
 private:
 	uint32_t getClusterValue(uint32_t clustNum);
 	void setClusterValue(uint32_t clustNum, uint32_t clustValue);
+	uint32_t getFatEntryOffset(uint32_t clustNum) const;
+	void loadFat();
+	void flushFat();
+	void checkDiskWrites();
 	uint32_t getClustFirstSect(uint32_t clustNum);
 	bool FindNextInternal(uint32_t dirClustNumber, DOS_DTA & dta, direntry *foundEntry);
 	bool getDirClustNum(char * dir, uint32_t * clustNum, bool parDir);
 	bool getFileDirEntry(char const * const filename, direntry * useEntry, uint32_t * dirClust, uint32_t * subEntry, const bool dir_ok = false);
 	bool addDirectoryEntry(uint32_t dirClustNumber, direntry useEntry);
+	struct CachedDir;
+	CachedDir *getCachedDir(uint32_t dirClustNumber);
+	void dropCachedDir(uint32_t dirClustNumber);
+	void clearDirCache();
 	void zeroOutCluster(uint32_t clustNumber);
 	bool getEntryName(char *fullname, char *entname);
 	
@@ -225,8 +242,29 @@ private:
 
 	uint32_t cwdDirCluster;
 
-	uint8_t fatSectBuffer[1024];
-	uint32_t curFatSect;
+	// The first FAT, as it is on the disk and decoded into the values of
+	// the clusters. Changes are made to both and the changed sectors are
+	// written to all the FAT copies at the end of the operation.
+	std::vector<uint8_t> fatImage = {};
+	std::vector<uint32_t> fatTable = {};
+	std::vector<bool> fatDirtySectors = {};
+	bool fatDirty = false;
+
+	// The entries of the directories read so far, keyed by their first
+	// cluster, with 0 for the root directory. Writes to their sectors
+	// update them and changes to their cluster chains drop them.
+	struct CachedDir {
+		std::vector<uint32_t> sectors = {};
+		std::vector<direntry> entries = {}; // 16 for each sector
+		size_t numEntries = 0;              // in use
+	};
+	std::unordered_map<uint32_t, CachedDir> dirEntryCache = {};
+	std::unordered_map<uint32_t, uint32_t> dirSectorOwners = {};
+	std::unordered_map<uint32_t, uint32_t> dirClusterOwners = {};
+
+	// The sector writes to the disk as of this drive's last one; others
+	// from outside, through INT 13h, make it drop what it has cached
+	uint32_t diskWrites = 0;
 };
 
 class cdromDrive final : public localDrive
@@ -325,7 +363,7 @@ struct isoDirEntry {
 #define IS_ASSOC(fileFlags)	(fileFlags & ISO_ASSOCIATED)
 #define IS_DIR(fileFlags)	(fileFlags & ISO_DIRECTORY)
 #define IS_HIDDEN(fileFlags)	(fileFlags & ISO_HIDDEN)
-#define ISO_MAX_HASH_TABLE_SIZE 	100
+#define ISO_READAHEAD_SECTORS	16
 
 class isoDrive final : public DOS_Drive {
 public:
@@ -350,7 +388,7 @@ public:
 	virtual bool isRemote(void);
 	virtual bool isRemovable(void);
 	virtual Bits UnMount(void);
-	bool readSector(uint8_t *buffer, uint32_t sector);
+	bool readSector(uint8_t *buffer, uint32_t sector, uint32_t readahead = 1);
 	virtual const char *GetLabel() { return discLabel; }
 	virtual void Activate(void);
 private:
@@ -358,11 +396,14 @@ private:
 	bool loadImage();
 	bool lookupSingle(isoDirEntry *de, const char *name, uint32_t sectorStart, uint32_t length);
 	bool lookup(isoDirEntry *de, const char *path);
+	void IndexDir(const std::string &dir_path, const isoDirEntry &dir_entry);
 	int  UpdateMscdex(char driveLetter, const char* physicalPath, uint8_t& subUnit);
 	int  GetDirIterator(const isoDirEntry* de);
 	bool GetNextDirEntry(const int dirIterator, isoDirEntry* de);
 	void FreeDirIterator(const int dirIterator);
-	bool ReadCachedSector(uint8_t** buffer, const uint32_t sector);
+	bool ReadCachedSector(uint8_t** buffer, const uint32_t sector,
+	                      const uint32_t readahead = 1);
+	uint8_t *CacheSector(const uint32_t sector);
 	
 	struct DirIterator {
 		bool valid;
@@ -374,11 +415,22 @@ private:
 	
 	int nextFreeDirIterator;
 	
-	struct SectorHashEntry {
-		bool valid;
-		uint32_t sector;
-		uint8_t data[ISO_FRAMESIZE];
-	} sectorHashEntries[ISO_MAX_HASH_TABLE_SIZE];
+	// The most recently used sectors, directory and file sectors alike,
+	// the most recent first
+	struct CachedSector {
+		uint32_t sector = 0;
+		uint8_t data[ISO_FRAMESIZE] = {};
+	};
+	std::list<CachedSector> sectorCache = {};
+	std::unordered_map<uint32_t, std::list<CachedSector>::iterator> sectorCacheIndex = {};
+	size_t sectorCacheSize = 0; // maximum number of sectors
+	uint64_t sectorCacheHits = 0;
+	uint64_t sectorCacheMisses = 0;
+
+	// The entries of the directories looked up so far, keyed by their
+	// uppercase path from the root, like "/GAME/DATA.DAT"
+	std::unordered_map<std::string, isoDirEntry> dirIndex = {};
+	std::unordered_set<std::string> indexedDirs = {};
 
 	bool iso;
 	bool dataCD;
@@ -390,6 +442,121 @@ private:
 	char discLabel[32];
 };
 
+// ZIP archive drive
+// ~~~~~~~~~~~~~~~~~
+// Mounts a ZIP archive in place of a directory. The central directory is
+// indexed in memory when the drive is mounted, with 8.3 names generated
+// for the long ones, and the files are decompressed as they're read, in
+// blocks kept in a cache of the recently read ones. Stored and deflated
+// files are supported. The archive itself is never written; with an
+// overlay directory, the files that are created or written go there.
+constexpr uint32_t ZIP_BLOCK_SIZE = 32 * 1024;
+
+class zipDrive final : public DOS_Drive {
+public:
+	zipDrive(const char *archive_path, uint8_t mediaid, bool &success);
+	zipDrive(const zipDrive &) = delete; // prevent copying
+	zipDrive &operator=(const zipDrive &) = delete; // prevent assignment
+	~zipDrive();
+	bool FileOpen(DOS_File **file, char *name, uint32_t flags);
+	bool FileCreate(DOS_File **file, char *name, uint16_t attributes);
+	bool FileUnlink(char *name);
+	bool RemoveDir(char *dir);
+	bool MakeDir(char *dir);
+	bool TestDir(char *dir);
+	bool FindFirst(char *_dir, DOS_DTA &dta, bool fcb_findfirst);
+	bool FindNext(DOS_DTA &dta);
+	bool GetFileAttr(char *name, uint16_t *attr);
+	bool SetFileAttr(const char *name, const uint16_t attr);
+	bool Rename(char *oldname, char *newname);
+	bool AllocationInfo(uint16_t *bytes_sector, uint8_t *sectors_cluster,
+	                    uint16_t *total_clusters, uint16_t *free_clusters);
+	bool FileExists(const char *name);
+	bool FileStat(const char *name, FileStat_Block *const stat_block);
+	uint8_t GetMediaByte();
+	void EmptyCache();
+	bool isRemote();
+	bool isRemovable();
+	Bits UnMount();
+
+	// Sends the files that are created or written to the directory,
+	// leaving the archive as it is
+	void SetOverlay(const char *dir, uint16_t bytes_sector, uint8_t sectors_cluster,
+	                uint16_t total_clusters, uint16_t free_clusters);
+	bool HasOverlay() const { return overlay != nullptr; }
+
+	// For the files opened from the archive
+	bool ReadFileData(size_t index, uint32_t pos, uint8_t *data, uint16_t *size);
+	DOS_File *CopyToOverlay(size_t index, const char *name);
+
+private:
+	struct Entry {
+		std::string name = {};      // the DOS name, like "README.TXT"
+		std::string long_name = {}; // as in the archive
+		std::vector<size_t> children = {};
+		uint64_t header_offset = 0; // of the local file header
+		uint64_t data_offset = 0;   // found on the first read
+		uint64_t compressed_size = 0;
+		uint32_t size = 0;
+		uint32_t crc = 0;
+		uint16_t method = 0;
+		uint16_t date = 0;
+		uint16_t time = 0;
+		uint8_t attr = 0;
+		bool is_dir = false;
+	};
+
+	// A search's results, found in full by FindFirst
+	struct SearchResult {
+		std::string name = {};
+		uint32_t size = 0;
+		uint16_t date = 0;
+		uint16_t time = 0;
+		uint8_t attr = 0;
+	};
+	struct Search {
+		std::vector<SearchResult> results = {};
+		size_t next = 0;
+	};
+
+	struct Inflater;
+	struct InflaterPool;
+
+	bool LoadArchive();
+	size_t AddEntry(size_t parent, const std::string &long_name, bool is_dir);
+	void AssignShortNames(size_t dir);
+	void IndexPaths(size_t dir, const std::string &path);
+	bool Lookup(const char *name, size_t &index) const;
+	bool FindData(Entry &entry);
+	const std::vector<uint8_t> *ReadBlock(size_t index, uint32_t block);
+	std::vector<uint8_t> &CacheBlock(uint64_t key);
+	bool Inflate(Inflater &inflater, Entry &entry, uint8_t *data, uint32_t size);
+	bool InOverlay(const char *name) const;
+	void MakeOverlayDirs(const char *name);
+
+	FILE *archive = nullptr;
+	std::vector<Entry> entries = {}; // the root directory first
+	std::unordered_map<std::string, size_t> paths = {}; // by DOS path
+	uint64_t total_size = 0;
+
+	// The most recently read blocks of the files, the most recent first,
+	// keyed by the file's index and the block's number
+	struct CachedBlock {
+		uint64_t key = 0;
+		std::vector<uint8_t> data = {};
+	};
+	std::list<CachedBlock> blockCache = {};
+	std::unordered_map<uint64_t, std::list<CachedBlock>::iterator> blockCacheIndex = {};
+	size_t blockCacheSize = 0; // maximum number of blocks
+	std::unique_ptr<InflaterPool> inflaters;
+
+	std::unordered_map<uint16_t, Search> searches = {}; // by DTA dir ID
+	uint16_t nextSearchId = 0;
+
+	std::unique_ptr<localDrive> overlay = {};
+	uint8_t mediaid = 0;
+};
+
 struct VFILE_Block;
 
 class Virtual_Drive final : public DOS_Drive {
@@ -421,6 +588,99 @@ private:
 	VFILE_Block * search_file;
 };
 
+// RAM drive
+// ~~~~~~~~~
+// Serves a copy of a host directory that's read into memory when the drive
+// is mounted, so file access doesn't wait on the host disk. The changes are
+// made to the copy only, or with write-through to the host directory as
+// well, where files are written back as they're closed.
+struct MemoryFileData;
+
+class Memory_Drive final : public DOS_Drive {
+public:
+	Memory_Drive(const char *host_dir,
+	             bool write_through,
+	             uint16_t bytes_sector,
+	             uint8_t sectors_cluster,
+	             uint16_t total_clusters,
+	             uint16_t free_clusters,
+	             uint8_t mediaid,
+	             bool &success);
+	~Memory_Drive();
+	Memory_Drive(const Memory_Drive &) = delete; // prevent copying
+	Memory_Drive &operator=(const Memory_Drive &) = delete; // prevent assignment
+
+	bool FileOpen(DOS_File **file, char *name, uint32_t flags);
+	bool FileCreate(DOS_File **file, char *name, uint16_t attributes);
+	bool FileUnlink(char *name);
+	bool RemoveDir(char *dir);
+	bool MakeDir(char *dir);
+	bool TestDir(char *dir);
+	bool FindFirst(char *_dir, DOS_DTA &dta, bool fcb_findfirst);
+	bool FindNext(DOS_DTA &dta);
+	bool GetFileAttr(char *name, uint16_t *attr);
+	bool SetFileAttr(const char *name, const uint16_t attr);
+	bool Rename(char *oldname, char *newname);
+	bool AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster,
+	                    uint16_t *_total_clusters, uint16_t *_free_clusters);
+	bool FileExists(const char *name);
+	bool FileStat(const char *name, FileStat_Block *const stat_block);
+	uint8_t GetMediaByte();
+	void EmptyCache();
+	bool isRemote();
+	bool isRemovable();
+	Bits UnMount();
+
+private:
+	struct Node {
+		std::string name = {};      // the DOS name
+		std::string host_name = {}; // in the host directory
+		Node *parent = nullptr;
+		bool is_dir = false;
+		uint8_t attr = 0;
+		uint16_t date = 0; // of directories; files keep theirs in data
+		uint16_t time = 0;
+		std::shared_ptr<MemoryFileData> data = {}; // shared with open files
+		std::map<std::string, std::unique_ptr<Node>> children = {};
+	};
+
+	// A search's results, found in full by FindFirst
+	struct SearchResult {
+		std::string name = {};
+		uint32_t size = 0;
+		uint16_t date = 0;
+		uint16_t time = 0;
+		uint8_t attr = 0;
+	};
+	struct Search {
+		std::vector<SearchResult> results = {};
+		size_t next = 0;
+	};
+
+	bool LoadDir(Node &dir, const std::string &host_path);
+	Node *Lookup(const char *path) const;
+	Node *LookupParent(const char *path, std::string &name) const;
+	std::string HostPath(const Node &node) const;
+	void UpdateHostPaths(Node &node);
+	void WriteBackAll(Node &dir);
+
+	std::unique_ptr<Node> root = {};
+	std::string host_dir = {};
+	bool write_through = false;
+	uint64_t loaded_bytes = 0;
+
+	std::unordered_map<uint16_t, Search> searches = {}; // by DTA dir ID
+	uint16_t nextSearchId = 0;
+
+	struct {
+		uint16_t bytes_sector;
+		uint8_t sectors_cluster;
+		uint16_t total_clusters;
+		uint16_t free_clusters;
+		uint8_t mediaid;
+	} allocation = {};
+};
+
 class Overlay_Drive final : public localDrive {
 public:
 	Overlay_Drive(const char *startdir,
@@ -457,10 +717,14 @@ private:
 	void remove_DOSname_from_cache(const char* name);
 	void add_DOSdir_to_cache(const char* name);
 	void remove_DOSdir_from_cache(const char* name);
-	void update_cache(bool read_directory_contents = false);
-
-	std::vector<std::string> deleted_files_in_base; //Set is probably better, or some other solution (involving the disk).
-	std::vector<std::string> deleted_paths_in_base; //Currently only used to hide the overlay folder.
+	void update_cache();
+	void add_overlay_entry_to_cache(const char* name);
+	void remove_overlay_entry_from_cache(const char* name);
+
+	// The markers of the DBOVERLAY special files, read once by
+	// update_cache and kept in step with the disk afterwards
+	std::unordered_set<std::string> deleted_files_in_base;
+	std::unordered_set<std::string> deleted_paths_in_base;
 	std::string overlap_folder;
 	void add_deleted_file(const char* name, bool create_on_disk);
 	void remove_deleted_file(const char* name, bool create_on_disk);
@@ -478,8 +742,8 @@ private:
 	std::string create_filename_of_special_operation(const char* dosname, const char* operation);
 	void convert_overlay_to_DOSname_in_base(char* dirname );
 	//For caching the update_cache routine.
-	std::vector<std::string> DOSnames_cache; //Also set is probably better.
-	std::vector<std::string> DOSdirs_cache; //Can not blindly change its type. it is important that subdirs come after the parent directory.
+	std::unordered_set<std::string> DOSnames_cache;
+	std::set<std::string> DOSdirs_cache; //Ordered, so subdirs come after the parent directory.
 	const std::string special_prefix;
 };
 
@@ -40,8 +40,9 @@
  *     the desired expiration period in seconds (reasonable values are <60s).
  *
  *  2. Call Process(..), passing it samples in their natural 16-bit signed
- *     form. Note: when the envelope is fully expanded or has expired, this
- *     function becomes the a null-call, eliminating further overhead.
+ *     form, either one frame or a block of interleaved stereo frames at a
+ *     time. Note: when the envelope is fully expanded or has expired, this
+ *     function returns right away, eliminating further overhead.
  *     To be clear - there are no runtime checks you need to perform to
  *     determine if you should use the envelope or not.  It simply goes
  *     dormant when done.
@@ -57,7 +58,6 @@
 #include "dosbox.h"
 
 #include <cstdint>
-#include <functional>
 
 
 typedef struct AudioFrame AudioFrame_;
@@ -66,7 +66,15 @@ class Envelope {
 public:
 	Envelope(const char* name);
 
-	void Process(const bool is_stereo, AudioFrame &frame);
+	void Process(const bool is_stereo, AudioFrame &frame)
+	{
+		if (!is_done)
+			Apply(is_stereo, frame);
+	}
+
+	// Envelopes interleaved stereo frames in place. Mono frames carry the
+	// same sample in both channels, which is kept that way.
+	void Process(const bool is_stereo, float *frames, const int num_frames);
 
 	void Update(const int frame_rate, const int peak_amplitude,
 	            const uint8_t expansion_phase_ms,
@@ -74,6 +82,12 @@ public:
 
 	void Reactivate();
 
+	// Once done, Process() leaves the frames as they are
+	bool IsDone() const
+	{
+		return is_done;
+	}
+
 private:
 	Envelope(const Envelope &) = delete;            // prevent copying
 	Envelope &operator=(const Envelope &) = delete; // prevent assignment
@@ -82,12 +96,6 @@ private:
 
 	void Apply(const bool is_stereo, AudioFrame &frame);
 
-	void Skip([[maybe_unused]] bool is_stereo, [[maybe_unused]] AudioFrame &frame)
-	{}
-
-	using process_f = std::function<void(Envelope &, const bool, AudioFrame &)>;
-	process_f process = &Envelope::Apply;
-
 	const char *channel_name = nullptr;
 
 	int expire_after_frames = 0; // Stop enveloping when this many
@@ -95,6 +103,8 @@ private:
 
 	int frames_done = 0; // A tally of processed frames.
 
+	bool is_done = false;
+
 	float edge = 0.0f;           // The current edge of the envelope, which
 	                             // increments outward when samples press
 	                             // against it.
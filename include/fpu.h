@@ -28,6 +28,8 @@
 #include "mem.h"
 #endif
 
+#include "softfloat80.h"
+
 void FPU_ESC0_Normal(Bitu rm);
 void FPU_ESC0_EA(Bitu func,PhysPt ea);
 void FPU_ESC1_Normal(Bitu rm);
@@ -88,11 +90,13 @@ enum FPU_Round {
 typedef struct FPU_rec {
 	FPU_Reg		regs[9];
 	FPU_P_Reg	p_regs[9];
+	Ext80		ext[9];		// full registers in accurate mode, see FPU_SetReg
 	FPU_Tag		tags[9];
 	uint16_t		cw,cw_mask_all;
 	uint16_t		sw;
 	uint32_t		top;
 	FPU_Round	round;
+	bool		accurate;
 } FPU_rec;
 
 #define L2E		1.4426950408889634
@@ -60,6 +60,15 @@ void CAPTURE_AddImage(int width,
                       uint8_t *data,
                       uint8_t *pal);
 
+// With 'capture_source = display', images and video are captured from the
+// output's presented frames, such as after the OpenGL shader, instead of
+// the emulated image. The renderer counts each emulated frame and its rate
+// with CAPTURE_TickDisplayFrame(), and the output passes the 32-bit frames
+// it reads back to CAPTURE_AddDisplayImage().
+bool CAPTURE_WantsDisplayImage();
+void CAPTURE_TickDisplayFrame(float fps);
+void CAPTURE_AddDisplayImage(int width, int height, int pitch, const uint8_t *data);
+
 void CAPTURE_AddMidi(bool sysex, Bitu len, uint8_t * data);
 void CAPTURE_VideoStart();
 void CAPTURE_VideoStop();
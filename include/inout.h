@@ -25,6 +25,7 @@
 #include "dosbox.h"
 
 #include <functional>
+#include <limits>
 
 using io_port_t = uint16_t; // DOS only supports 16-bit port addresses
 using io_val_t = uint32_t; // Handling exists up to a dword (or less)
@@ -72,6 +73,34 @@ void IO_FreeWriteHandler(io_port_t port,
                          io_width_t max_width,
                          io_port_t range = 1);
 
+// Releases the handlers of all ports, when the IO bus shuts down
+void IO_FreeAllHandlers();
+
+// Polling fast-forward
+// ~~~~~~~~~~~~~~~~~~~~
+// Devices can tell how long a port will keep returning the same value, so
+// a program spinning on it can skip ahead. The hint returns the emulated
+// time (as PIC_FullIndex) up to which reads return the same value, or
+// io_poll_until_event if only a PIC event or a port write can change it.
+//
+// Ports that programs time by counting their reads, like the joystick's
+// one-shots, register for counting loops instead: loops that step a counter
+// register by the same amount on every read. Those are skipped by advancing
+// the counter as if the skipped reads had been made.
+using io_poll_f = std::function<double(io_port_t port)>;
+constexpr double io_poll_until_event = std::numeric_limits<double>::infinity();
+
+enum class io_poll_loop_t : uint8_t {
+	waiting,  // nothing changes between reads
+	counting, // counter registers step by the same amount between reads
+};
+
+void IO_RegisterPollHint(io_port_t port, io_poll_f hint,
+                         io_poll_loop_t loop = io_poll_loop_t::waiting);
+void IO_FreePollHint(io_port_t port);
+
+void IO_SetPollFastForward(bool enabled);
+
 /* Classes to manage the IO objects created by the various devices.
  * The io objects will remove itself on destruction.*/
 class IO_Base{
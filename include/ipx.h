@@ -71,6 +71,12 @@
 // For Uint8 type
 #include <SDL_net.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "rwqueue.h"
+
 struct PackedIP {
 	Uint32 host;
 	Uint16 port;
@@ -159,4 +165,34 @@ void PackIP(IPaddress ipAddr, PackedIP *ipPack);
 #pragma pack()
 #endif
 
+// A datagram as received from a UDP socket
+struct IpxDatagram {
+	IPaddress address = {};
+	std::vector<uint8_t> data = {};
+};
+
+// Receives the datagrams of a UDP socket on a thread of its own, which
+// sleeps until the socket has data. The emulation only checks the inbox at
+// tick time instead of polling the socket.
+class IpxReceiver {
+public:
+	IpxReceiver(UDPsocket udp_socket);
+	~IpxReceiver();
+
+	// Takes the oldest received datagram, if any
+	bool Take(IpxDatagram &datagram);
+
+private:
+	IpxReceiver(const IpxReceiver &)            = delete;
+	IpxReceiver &operator=(const IpxReceiver &) = delete;
+
+	void Run();
+
+	UDPsocket socket                = nullptr;
+	SDLNet_SocketSet socket_set     = nullptr;
+	SpscQueue<IpxDatagram> inbox;
+	std::atomic<bool> is_stopping   = false;
+	std::thread thread              = {};
+};
+
 #endif
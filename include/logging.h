@@ -19,6 +19,8 @@
 #ifndef DOSBOX_LOGGING_H
 #define DOSBOX_LOGGING_H
 
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
 
 #include "compiler.h"
@@ -44,14 +46,70 @@ enum LOG_SEVERITIES {
 	LOG_ERROR
 };
 
+// LOG() calls below the minimum severity or for a category outside the mask
+// are removed at compile time, so neither their message nor their arguments
+// are evaluated. Both can be set when building, for example
+// -DC_LOG_MIN_SEVERITY=LOG_WARN or -DC_LOG_TYPES_MASK="(1ull << LOG_VGA)".
+// Without the debugger (C_DEBUG) all LOG() calls are removed.
+#ifndef C_LOG_MIN_SEVERITY
+#define C_LOG_MIN_SEVERITY LOG_NORMAL
+#endif
+
+#ifndef C_LOG_TYPES_MASK
+#define C_LOG_TYPES_MASK (~0ull)
+#endif
+
+constexpr bool LOG_IsCompiledIn([[maybe_unused]] const LOG_TYPES type,
+                                [[maybe_unused]] const LOG_SEVERITIES severity)
+{
+#if C_DEBUG
+	// Errors are shown regardless of the enabled categories
+	return severity >= C_LOG_MIN_SEVERITY &&
+	       (severity == LOG_ERROR ||
+	        ((static_cast<uint64_t>(C_LOG_TYPES_MASK) >> type) & 1));
+#else
+	return false;
+#endif
+}
+
+#define LOG(type, severity) \
+	!LOG_IsCompiledIn(type, severity) ? (void)0 : LogMessage(type, severity)
+
+// Lets through up to 'burst' messages per interval and counts the rest, for
+// warnings that guest code can trigger in a tight loop. The number of
+// suppressed messages is reported when the next interval lets one through.
+//
+//   static LogRateLimiter limiter(10, 1000);
+//   if (limiter.Allow())
+//           LOG_MSG("...");
+//
+class LogRateLimiter {
+public:
+	LogRateLimiter(const int burst, const int interval_ms)
+	        : burst(burst),
+	          interval(interval_ms)
+	{}
+
+	bool Allow();
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	clock::time_point window_start = {};
+	const int burst = 0;
+	const std::chrono::milliseconds interval = {};
+	int count = 0;
+	int suppressed = 0;
+};
+
 #if C_DEBUG
-class LOG 
+class LogMessage
 { 
 	LOG_TYPES       d_type;
 	LOG_SEVERITIES  d_severity;
 public:
 
-	LOG (LOG_TYPES type , LOG_SEVERITIES severity):
+	LogMessage (LOG_TYPES type , LOG_SEVERITIES severity):
 		d_type(type),
 		d_severity(severity)
 		{}
@@ -68,9 +126,10 @@ void DEBUG_ShowMsg(char const* format,...) GCC_ATTRIBUTE(__format__(__printf__,
 
 #else // C_DEBUG
 
-struct LOG
+// Only type-checks the LOG() calls, which are never evaluated
+struct LogMessage
 {
-	LOG(LOG_TYPES , LOG_SEVERITIES )										{ }
+	LogMessage(LOG_TYPES , LOG_SEVERITIES )										{ }
 	void operator()(char const* )													{ }
 	void operator()(char const* , double )											{ }
 	void operator()(char const* , double , double )								{ }
@@ -104,6 +163,24 @@ void GFX_ShowMsg(char const* format,...) GCC_ATTRIBUTE(__format__(__printf__, 1,
 
 #endif // C_DEBUG
 
+inline bool LogRateLimiter::Allow()
+{
+	const auto now = clock::now();
+	if (now - window_start >= interval) {
+		if (suppressed)
+			LOG_MSG("LOG: Suppressed %d similar messages", suppressed);
+		window_start = now;
+		count = 0;
+		suppressed = 0;
+	}
+	if (count < burst) {
+		++count;
+		return true;
+	}
+	++suppressed;
+	return false;
+}
+
 #ifdef NDEBUG
 // DEBUG_LOG_MSG exists only for messages useful during development, and not to
 // be redirected into internal DOSBox debugger for DOS programs (C_DEBUG feature).
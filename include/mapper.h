@@ -79,7 +79,8 @@ bool MAPPER_IsUsingJoysticks();
 std::vector<std::string> MAPPER_GetEventNames(const std::string &prefix);
 void MAPPER_AutoType(std::vector<std::string> &sequence,
                      const uint32_t wait_ms,
-                     const uint32_t pacing_ms);
+                     const uint32_t pacing_ms,
+                     const bool wait_for_empty_buffer);
 void MAPPER_CheckEvent(SDL_Event *event);
 
 #endif
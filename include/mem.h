@@ -24,6 +24,8 @@
 
 #include "dosbox.h"
 
+#include <vector>
+
 #include "mem_host.h"
 #include "mem_unaligned.h"
 #include "types.h"
@@ -33,7 +35,7 @@ typedef uint8_t *HostPt;
 typedef uint32_t RealPt;
 typedef int32_t MemHandle;
 
-extern uint8_t MemBase[];
+extern HostPt MemBase;
 HostPt GetMemBase();
 
 bool MEM_A20_Enabled();
@@ -56,6 +58,28 @@ void MEM_PreparePCJRCartRom();
 MemHandle MEM_NextHandle(MemHandle handle);
 MemHandle MEM_NextHandleAt(MemHandle handle, Bitu where);
 
+/* Dirty page tracking, for incremental snapshots of the RAM. Writes through
+ * the TLB are caught by write-protecting the clean pages; writes by the host
+ * straight into MemBase must call MEM_MarkDirty. */
+extern bool mem_tracking_dirty_pages;
+void MEM_TrackDirtyPages(bool enabled);
+void MEM_MarkDirty(PhysPt addr, size_t bytes);
+// Returns the pages written since the previous call, or since tracking
+// started, and write-protects them again
+std::vector<uint32_t> MEM_TakeDirtyPages();
+
+/* Write watches, for host-side caches of guest memory. A watched RAM page is
+ * write-protected like a clean page during dirty page tracking; the first
+ * write to it, or any change of its page handler, ends the watch and calls
+ * the watch handlers. Host writes reach it through MEM_MarkDirty. The pages
+ * are shared by all of the handlers, which are each called for every page,
+ * so they ignore the pages they don't watch. */
+extern bool mem_watching_writes;
+using mem_write_watch_f = void (*)(Bitu phys_page);
+void MEM_AddWriteWatchHandler(mem_write_watch_f handler);
+// Returns false if the page isn't plain RAM, so it can't be watched
+bool MEM_WatchWrites(Bitu phys_page);
+
 static inline void var_write(uint8_t *var, uint8_t val)
 {
 	host_writeb(var, val);
@@ -94,16 +118,22 @@ void mem_writed(PhysPt pt, uint32_t val);
 
 static inline void phys_writeb(PhysPt addr, uint8_t val)
 {
+	if (GCC_UNLIKELY(mem_tracking_dirty_pages || mem_watching_writes))
+		MEM_MarkDirty(addr, sizeof(val));
 	host_writeb(MemBase + addr, val);
 }
 
 static inline void phys_writew(PhysPt addr, uint16_t val)
 {
+	if (GCC_UNLIKELY(mem_tracking_dirty_pages || mem_watching_writes))
+		MEM_MarkDirty(addr, sizeof(val));
 	host_writew(MemBase + addr, val);
 }
 
 static inline void phys_writed(PhysPt addr, uint32_t val)
 {
+	if (GCC_UNLIKELY(mem_tracking_dirty_pages || mem_watching_writes))
+		MEM_MarkDirty(addr, sizeof(val));
 	host_writed(MemBase + addr, val);
 }
 
@@ -129,6 +159,12 @@ void MEM_BlockRead(PhysPt pt, void *data, Bitu size);
 void MEM_BlockCopy(PhysPt dest, PhysPt src, Bitu size);
 void MEM_StrCopy(PhysPt pt, char *data, Bitu size);
 
+// Returns the host memory behind a block of guest memory, for the host to
+// read or write it in one go, or nullptr unless the whole block is directly
+// mapped and contiguous on the host, as conventional and extended RAM are
+// without paging. Blocks returned for writing are marked dirty.
+HostPt MEM_GetHostBlock(PhysPt pt, size_t size, bool for_write);
+
 void mem_memcpy(PhysPt dest, PhysPt src, Bitu size);
 Bitu mem_strlen(PhysPt pt);
 void mem_strcpy(PhysPt dest, PhysPt src);
@@ -0,0 +1,56 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_MEMORY_REPORT_H
+#define DOSBOX_MEMORY_REPORT_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+
+/*
+Memory Report
+~~~~~~~~~~~~~
+Accounts the host memory held by the subsystems with large buffers. Most of
+them allocate their buffers when a program first uses the device, so an
+instance whose guest never touches, say, the GUS doesn't pay for its RAM.
+
+The report is logged once the machine is set up, on shutdown, and whenever
+the 'Mem. Report' mapper key is pressed, along with the resident set size of
+the process where the host tells it.
+*/
+
+enum class MemoryUser : uint8_t {
+	GuestRam,
+	GusRam,
+	DynamicCoreCache,
+	MixerBuffers,
+	CdAudioBuffer,
+	IsoSectorCache,
+	NumUsers,
+};
+
+// Adds to the bytes held by the subsystem; negative to release them
+void MEMREPORT_Add(MemoryUser user, int64_t bytes);
+
+// Logs the bytes held by each subsystem, labelled with when it's taken
+void MEMREPORT_Log(const char *when);
+
+#endif
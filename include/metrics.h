@@ -0,0 +1,93 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_METRICS_H
+#define DOSBOX_METRICS_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+#include <string>
+
+/*
+Metrics Endpoint
+~~~~~~~~~~~~~~~~
+Exports a handful of counters and gauges in the Prometheus text format, so
+long unattended runs can be watched and graphed from outside.
+
+The endpoint is set by [dosbox] metrics_endpoint: a TCP port, which is only
+bound on the loopback interface, or 'unix:<path>' for a Unix domain socket.
+A background thread answers each connection with the current values, so the
+emulation thread never waits on a scraper.
+
+Updating a metric is a relaxed atomic add or store, and is skipped entirely
+while the endpoint is disabled.
+*/
+
+enum class Metric : uint8_t {
+	// Counters
+	Cycles,
+	FramesPresented,
+	FramesDropped, // new frames replaced before they were presented
+	FramesSkipped, // frames the render pacer didn't present
+	AudioUnderruns,
+	DynrecCachePurges,
+	DiskBytesRead,
+	CdromBytesRead,
+	Ne2000PacketsSent,
+	Ne2000PacketsReceived,
+	IpxPacketsSent,
+	IpxPacketsReceived,
+	PageFaults,
+	PageFaultsNested, // handled by running the guest's handler in a nested loop
+	PageDirCacheHits,
+	VgaBankSwitches,
+
+	// Gauges
+	CyclesPerSecond,
+	CycleMax,
+	VgaBankSwitchesPerFrame, // in the last frame
+
+	NumMetrics,
+};
+
+extern bool metrics_active;
+
+// Starts serving the metrics on the endpoint; an empty one disables them
+void METRICS_Start(const std::string &endpoint);
+void METRICS_Stop();
+
+void METRICS_AddValue(Metric metric, int64_t amount);
+void METRICS_SetValue(Metric metric, int64_t value);
+int64_t METRICS_Get(Metric metric);
+
+static inline void METRICS_Add(const Metric metric, const int64_t amount = 1)
+{
+	if (metrics_active)
+		METRICS_AddValue(metric, amount);
+}
+
+static inline void METRICS_Set(const Metric metric, const int64_t value)
+{
+	if (metrics_active)
+		METRICS_SetValue(metric, value);
+}
+
+#endif
@@ -29,8 +29,12 @@
 #include <functional>
 #include <memory>
 #include <set>
+#include <vector>
 
 #include "envelope.h"
+#include "inout.h"
+#include "polyphase_resampler.h"
+#include "ring_buffer.h"
 #include "../src/hardware/compressor.h"
 
 // Disable effc++ for Iir until its release.
@@ -52,6 +56,100 @@ typedef void (*MIXER_MixHandler)(uint8_t *sampdate, uint32_t len);
 // 48000 Hz, that's 48 frames.
 using MIXER_Handler = std::function<void(uint16_t frames)>;
 
+// Queues the frames a device renders as its ports are written, until the
+// mixer calls back for them; holds well over a callback's worth of frames
+// at any device rate
+template <typename T>
+using DeviceFrameQueue = RingBuffer<T, 4096>;
+
+// Queues the writes to a device's ports along with their times, so the
+// device can render in its mixer callback instead of on every write: the
+// callback applies each write once it has rendered up to the write's time,
+// which puts the write at the exact frame it was made in.
+class DeviceWriteQueue {
+public:
+	// Queues the write. If the queue's full, the oldest write is applied
+	// early through apply(port, value) to make room.
+	template <typename Apply>
+	void Enqueue(const double timestamp_ms, const io_port_t port,
+	             const uint8_t value, Apply &&apply)
+	{
+		if (writes.IsFull()) {
+			const auto oldest = writes.Dequeue();
+			apply(oldest.port, oldest.value);
+		}
+		writes.Enqueue({timestamp_ms, port, value});
+	}
+
+	// Applies the writes made up to and including the given time, oldest
+	// first, through apply(port, value)
+	template <typename Apply>
+	void ApplyUpTo(const double timestamp_ms, Apply &&apply)
+	{
+		while (!writes.IsEmpty() && writes.Front().timestamp_ms <= timestamp_ms) {
+			const auto write = writes.Dequeue();
+			apply(write.port, write.value);
+		}
+	}
+
+	// Returns the time of the oldest queued write, or false if there are
+	// none, so devices can render in runs up to the next write
+	bool GetNextTimestamp(double &timestamp_ms) const
+	{
+		if (writes.IsEmpty())
+			return false;
+		timestamp_ms = writes.Front().timestamp_ms;
+		return true;
+	}
+
+	void Clear()
+	{
+		writes.Clear();
+	}
+
+private:
+	struct Write {
+		double timestamp_ms = 0.0;
+		io_port_t port      = 0;
+		uint8_t value       = 0;
+	};
+	RingBuffer<Write, 4096> writes = {};
+};
+
+// Decimates a device's samples by an integer factor with a windowed-sinc FIR
+// low-pass at the decimated rate's Nyquist frequency. The FIR is only
+// evaluated for the samples that are kept, which makes it a cheap first
+// stage for chips rendering at hundreds of kHz before resampling to the
+// mixer's rate.
+class DecimatingFir {
+public:
+	explicit DecimatingFir(int decimation_factor);
+
+	// Takes the next sample; returns true when an output sample is ready
+	bool Input(float sample)
+	{
+		history[pos] = sample;
+		history[pos + taps.size()] = sample;
+		if (++pos == taps.size())
+			pos = 0;
+		if (++phase < factor)
+			return false;
+		phase = 0;
+		return true;
+	}
+
+	float Output() const;
+
+private:
+	std::vector<float> taps = {};
+	// The history is kept twice in a row, so the taps always cover a
+	// contiguous window of it
+	std::vector<float> history = {};
+	size_t pos = 0;
+	int factor = 1;
+	int phase = 0;
+};
+
 enum class MixerState {
 	Uninitialized,
 	NoSound,
@@ -127,6 +225,9 @@ enum LINE_INDEX : uint8_t {
 enum class ChannelFeature {
 	ChorusSend,
 	DigitalAudio,
+	// The channel's handler only touches its own device's state, so it can
+	// render on a worker thread alongside the other channels
+	ParallelRender,
 	ReverbSend,
 	Sleep,
 	Stereo,
@@ -134,6 +235,18 @@ enum class ChannelFeature {
 };
 using channel_features_t = std::set<ChannelFeature>;
 
+struct mix_buffers_t;
+
+// Host time spent on a channel, for the MIXER /STATS view
+struct MixerChannelStats {
+	int64_t handler_ns  = 0; // rendering in the device's handler
+	int64_t resample_ns = 0; // converting and resampling the frames
+	int64_t filter_ns   = 0; // the channel's high- and low-pass filters
+	int64_t effects_ns  = 0; // crossfeed, effect sends, and mixing
+	int64_t asleep_ms   = 0; // wall-clock time the sleeper had it disabled
+	int wake_ups        = 0;
+};
+
 enum class FilterState { Off, On, ForcedOn };
 
 enum class ResampleMethod {
@@ -184,6 +297,15 @@ public:
 	void Mix(const int frames_requested);
 	void AddSilence(); // Fill up until needed
 
+	// Points the channel at its own work buffers so it can be mixed on a
+	// worker thread, then adds them back into the mixer's buffers
+	void PrepareParallelMix();
+	void MergeParallelMix();
+	bool IsMixingInParallel() const;
+
+	// Returns the stats accumulated since they were last taken
+	MixerChannelStats TakeStats();
+
 	void SetHighPassFilter(const FilterState state);
 	void SetLowPassFilter(const FilterState state);
 	void ConfigureHighPassFilter(const uint8_t order, const uint16_t cutoff_freq);
@@ -255,7 +377,8 @@ private:
 	void InitZohUpsamplerState();
 	void InitLerpUpsamplerState();
 
-	AudioFrame ApplyCrossfeed(const AudioFrame &frame) const;
+	void LockMixer();
+	void UnlockMixer();
 
 	std::string name = {};
 	Envelope envelope;
@@ -323,6 +446,9 @@ private:
 		SpeexResamplerState *state = nullptr;
 	} speex_resampler = {};
 
+	// Replaces Speex for the rates it supports, when enabled
+	std::unique_ptr<PolyphaseResampler> polyphase_resampler = {};
+
 	struct {
 		struct {
 			std::array<Iir::Butterworth::HighPass<max_filter_order>, 2> hpf = {};
@@ -365,14 +491,30 @@ private:
 		void Listen(const AudioFrame &frame);
 		void MaybeSleep();
 		bool WakeUp();
+		void ChargeAsleepTime();
 
 	private:
 		MixerChannel &channel;
-		int64_t woken_at_ms = 0;
-		bool had_noise      = false;
+		int64_t woken_at_ms       = 0;
+		int64_t fell_asleep_at_ms = 0;
+		bool had_noise            = false;
+		bool is_asleep            = false;
 	};
 	Sleeper sleeper;
 	const bool do_sleep = false;
+
+	// The buffers the channel mixes into: the mixer's, or its own while
+	// it's mixed in parallel
+	mix_buffers_t *mix_buffers = nullptr;
+	std::unique_ptr<mix_buffers_t> own_buffers;
+	int parallel_mix_start = 0;
+
+	MixerChannelStats stats = {};
+
+	// Per-channel scratch buffers, so channels can convert and resample
+	// concurrently
+	std::vector<float> resample_temp = {};
+	std::vector<float> resample_out  = {};
 };
 
 using mixer_channel_t = std::shared_ptr<MixerChannel>;
@@ -383,8 +525,16 @@ mixer_channel_t MIXER_AddChannel(MIXER_Handler handler, const int freq,
 
 mixer_channel_t MIXER_FindChannel(const char *name);
 
+// Receives the frames mixed each tick as little-endian 16-bit stereo pairs,
+// the same as written to wave captures; pass nullptr to remove it
+using MIXER_OutputTap = std::function<void(const int16_t *frames, const int num_frames)>;
+void MIXER_SetOutputTap(MIXER_OutputTap tap);
+
 // Mixer configuration and initialization
 void MIXER_AddConfigSection(const config_ptr_t &conf);
+int MIXER_GetSampleRate();
+// The frames mixed since startup, including those muted or not played
+int64_t MIXER_GetFramesMixed();
 bool MIXER_IsManuallyMuted();
 void MIXER_SetState(const MixerState requested);
 
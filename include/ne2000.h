@@ -234,7 +234,8 @@ public:
 
   //static void rx_handler(void *arg, const void *buf, unsigned len);
   BX_NE2K_SMF unsigned mcast_index(const void *dst);
-  BX_NE2K_SMF int rx_frame(const void *buf, unsigned bytes);
+  BX_NE2K_SMF bool rx_has_room(unsigned bytes);
+  BX_NE2K_SMF int rx_frame(const void *buf, unsigned bytes, bool raise_irq = true);
 
   static uint32_t read_handler(void *this_ptr, io_port_t address, io_width_t io_len);
   static void   write_handler(void *this_ptr, io_port_t address, io_val_t value, io_width_t io_len);
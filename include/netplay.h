@@ -0,0 +1,72 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_NETPLAY_H
+#define DOSBOX_NETPLAY_H
+
+#include "dosbox.h"
+
+#include <ctime>
+#include <vector>
+
+/*
+Netplay
+~~~~~~~
+Two players share one emulated machine: both peers run the whole session
+from the same configuration and exchange only their keyboard and mouse
+input over UDP, each event stamped with the emulated millisecond (tick) it
+takes effect at. Both peers apply the same inputs at the same ticks in the
+same order, so the sessions stay identical, the same way an input replay
+(see replay.h) repeats a recording.
+
+The local input takes effect [dosbox] netplay_delay ms after it's pressed,
+which gives it that long to reach the peer. The peers run in lockstep: a
+peer stalls before any tick whose input from the other peer it doesn't
+have yet.
+
+The rollback code (restoring an in-memory snapshot taken before a late
+input's tick and running the ticks since again) is kept, but disabled: the
+snapshots don't cover the keyboard controller, DMA, mouse, sound devices
+or the PIC's event queue, so a rolled back tick would deliver its input
+twice, and the peers don't exchange state checksums that would notice
+them drifting apart. [dosbox] netplay_rollback is ignored until both are
+in place.
+
+The host's cycle setting and start time are used by both peers. Network
+cards, IPX, and the serial port aren't part of the exchanged input.
+*/
+
+bool NETPLAY_IsActive();
+
+// Takes a local input from the replay code's input hooks, to be applied
+// when it's due on both peers
+void NETPLAY_AddInput(uint8_t type, const std::vector<uint8_t> &payload);
+
+// The wall-clock time both peers' real-time clocks start at
+time_t NETPLAY_StartTime();
+
+// Exchanges the input, rolls back or stalls when needed, and applies the
+// input due at this tick; called by the main loop between ticks. Returns the
+// number of ticks rolled back, which the main loop runs again.
+int NETPLAY_ServiceTick();
+
+void NETPLAY_Init(Section *sec);
+
+#endif
@@ -49,6 +49,7 @@ class PageDirectory;
 #define PFLAG_INIT			0x20			//No dynamic code can be generated here
 #define PFLAG_HASCODE16		0x40			//Page contains 16-bit dynamic code
 #define PFLAG_HASCODE		(PFLAG_HASCODE32|PFLAG_HASCODE16)
+#define PFLAG_WRITESPAN		0x80			//Handler implements write_span
 
 #define LINK_START	((1024+64)/4)			//Start right after the HMA
 
@@ -74,6 +75,12 @@ public:
 	virtual bool writew_checked(PhysPt addr, uint16_t val);
 	virtual bool writed_checked(PhysPt addr, uint32_t val);
 
+	// Writes 'bytes' bytes to the ascending span at 'addr', which lies
+	// within one page. The bytes may be written in any order, so it's
+	// only offered (with PFLAG_WRITESPAN) by handlers where that does
+	// not matter.
+	virtual void write_span(PhysPt addr, const uint8_t *data, uint32_t bytes);
+
 	uint_fast8_t flags = 0x0;
 };
 
@@ -89,11 +96,27 @@ void PAGING_ClearTLB(void);
 void PAGING_LinkPage(uint32_t lin_page,uint32_t phys_page);
 void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page);
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages);
+// Updates the host pointers of the linked pages in the range, for page
+// handlers that have moved the memory behind their pages
+void PAGING_RelinkPages(Bitu lin_page,Bitu pages);
 /* This maps the page directly, only use when paging is disabled */
 void PAGING_MapPage(Bitu lin_page,Bitu phys_page);
 bool PAGING_MakePhysPage(Bitu & page);
 bool PAGING_ForcePageInit(Bitu lin_addr);
 
+/* A guest page fault is normally handled by running the guest's handler in a
+   nested loop until it returns to the faulting instruction, which then goes
+   on where it left off. While a guest keeps faulting, the normal core keeps
+   the state each instruction starts from instead; a fault in one of its
+   instructions is then thrown as a GuestPageFault, which the core catches to
+   rewind the instruction and raise the fault like any other exception. */
+struct GuestPageFault {
+	uint32_t error_code = 0;
+};
+
+// Whether the guest took a page fault in the last emulated second
+bool PAGING_HadRecentFaults();
+
 void MEM_SetLFB(Bitu page, Bitu pages, PageHandler *handler, PageHandler *mmiohandler);
 void MEM_SetPageHandler(Bitu phys_page, Bitu pages, PageHandler * handler);
 void MEM_ResetPageHandler(Bitu phys_page, Bitu pages);
@@ -139,7 +162,16 @@ union X86PageEntry {
 	X86_PageEntryBlock block;
 };
 
-#if !defined(USE_FULL_TLB)
+#if defined(USE_FULL_TLB)
+// What a TLB miss and an address translation need is kept in one entry, so
+// they share a cache line. The host pointers stay in arrays of their own,
+// the dynamic cores index them directly.
+struct tlb_page {
+	PageHandler *readhandler;
+	PageHandler *writehandler;
+	uint32_t phys_page;
+};
+#else
 typedef struct {
 	HostPt read;
 	HostPt write;
@@ -160,9 +192,7 @@ struct PagingBlock {
 	struct {
 		HostPt read[TLB_SIZE];
 		HostPt write[TLB_SIZE];
-		PageHandler * readhandler[TLB_SIZE];
-		PageHandler * writehandler[TLB_SIZE];
-		uint32_t	phys_page[TLB_SIZE];
+		tlb_page page[TLB_SIZE];
 	} tlb;
 #else
 	tlb_entry tlbh[TLB_SIZE];
@@ -203,19 +233,19 @@ static inline HostPt get_tlb_write(PhysPt address) {
 	return paging.tlb.write[address>>12];
 }
 static inline PageHandler* get_tlb_readhandler(PhysPt address) {
-	return paging.tlb.readhandler[address>>12];
+	return paging.tlb.page[address>>12].readhandler;
 }
 static inline PageHandler* get_tlb_writehandler(PhysPt address) {
-	return paging.tlb.writehandler[address>>12];
+	return paging.tlb.page[address>>12].writehandler;
 }
 
 /* Use these helper functions to access linear addresses in readX/writeX functions */
 static inline PhysPt PAGING_GetPhysicalPage(PhysPt linePage) {
-	return (paging.tlb.phys_page[linePage>>12]<<12);
+	return (paging.tlb.page[linePage>>12].phys_page<<12);
 }
 
 static inline PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
-	return (paging.tlb.phys_page[linAddr>>12]<<12)|(linAddr&0xfff);
+	return (paging.tlb.page[linAddr>>12].phys_page<<12)|(linAddr&0xfff);
 }
 
 #else
@@ -73,5 +73,17 @@ void PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val = 0);
 void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, uint32_t val);
 
+#if C_TRACY
+// Profiling builds name each event after its handler, for the event zones
+void PIC_AddNamedEvent(const char *name, PIC_EventHandler handler,
+                       double delay, uint32_t val = 0);
+#define PIC_AddEvent(handler, ...) \
+	PIC_AddNamedEvent(#handler, handler, __VA_ARGS__)
+#endif
+
 void PIC_SetIRQMask(uint32_t irq, bool masked);
+
+// The number of whole ticks from the start of the current one until the
+// next event is due, up to the given limit
+int PIC_TicksUntilNextEvent(int limit);
 #endif
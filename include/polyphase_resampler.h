@@ -0,0 +1,85 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_POLYPHASE_RESAMPLER_H
+#define DOSBOX_POLYPHASE_RESAMPLER_H
+
+#include "dosbox.h"
+
+#include <memory>
+#include <vector>
+
+/*  Polyphase Resampler
+ *  -------------------
+ *  Resamples interleaved stereo frames by the fixed rational ratio between
+ *  two rates, such as 22050 to 48000 Hz (147:320), with a windowed-sinc FIR
+ *  low-pass filter that cuts everything above the lower rate's Nyquist
+ *  frequency.
+ *
+ *  The filter is precomputed as one bank of taps per output phase, so each
+ *  output frame costs a single dot product over the input history instead of
+ *  interpolating between filter tables. The banks are shared between the
+ *  resamplers that use the same ratio.
+ *
+ *  Use
+ *  ---
+ *  1. Check the rates with SupportsRates(): ratios that reduce to too many
+ *     phases would need an overly large filter bank.
+ *  2. Call Process() with each block of input frames; the output frames are
+ *     appended to the given vector.
+ *  3. Call Reset() to clear the filter's history, such as after a pause.
+ */
+
+class PolyphaseResampler {
+public:
+	static bool SupportsRates(const int in_rate, const int out_rate);
+
+	PolyphaseResampler(const int in_rate, const int out_rate);
+
+	int GetInputRate() const;
+	int GetOutputRate() const;
+
+	void Reset();
+
+	void Process(const float *in, const int num_frames, std::vector<float> &out);
+
+	struct FilterBank;
+
+private:
+	PolyphaseResampler()                                      = delete;
+	PolyphaseResampler(const PolyphaseResampler &)            = delete;
+	PolyphaseResampler &operator=(const PolyphaseResampler &) = delete;
+
+	const int in_rate  = 0;
+	const int out_rate = 0;
+
+	std::shared_ptr<const FilterBank> bank = {};
+
+	// The input history the filter runs over, one stream per side
+	std::vector<float> history_left  = {};
+	std::vector<float> history_right = {};
+
+	// The next output frame's phase, and the index of the newest input
+	// frame it needs relative to the next block
+	int phase      = 0;
+	int next_input = 0;
+};
+
+#endif
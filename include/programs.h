@@ -93,6 +93,7 @@ public:
 	virtual void WriteOut(const char *format, ...);	// printf to DOS stdout
 	void WriteOut_NoParsing(const char *str); // write string to DOS stdout
 	bool SuppressWriteOut(const char *format); // prevent writing to DOS stdout
+	void BufferOutput(bool enabled); // collect WriteOut* text into large writes
 	void InjectMissingNewline();
 	void ChangeToLongCmd();
 	bool HelpRequested();
@@ -103,6 +104,13 @@ public:
 
 protected:
 	HELP_Detail help_detail {};
+
+private:
+	void WriteToStdout(const char *text, size_t size);
+	void FlushOutput();
+
+	std::string output_buffer = {};
+	bool is_output_buffered = false;
 };
 
 using PROGRAMS_Creator = std::function<std::unique_ptr<Program>()>;
@@ -32,7 +32,7 @@
 
 #define RENDER_SKIP_CACHE 16
 // Enable this for scalers to support 0 input for empty lines
-//#define RENDER_NULL_INPUT
+#define RENDER_NULL_INPUT
 
 struct RenderPal_t {
 	struct {
@@ -86,6 +86,9 @@ struct Render_t {
 		ScalerLineHandler_t lineHandler       = nullptr;
 		ScalerLineHandler_t linePalHandler    = nullptr;
 		ScalerComplexHandler_t complexHandler = nullptr;
+		// Scales bands of the frame at its end instead, when threaded
+		ScalerComplexBandHandler_t complexBandHandler = nullptr;
+		int threads = 0;
 
 		uint32_t blocks     = 0;
 		uint32_t lastBlock  = 0;
@@ -128,6 +131,22 @@ void RENDER_EndUpdate(bool abort);
 void RENDER_InitShaderSource([[maybe_unused]] Section *sec);
 void RENDER_SetPal(uint8_t entry, uint8_t red, uint8_t green, uint8_t blue);
 
+// Whether the output can take the hdots of CGA composite modes as is and
+// decode them itself
+bool RENDER_CanDecodeComposite();
+void RENDER_SetCompositeDecoder(const GFX_CompositeDecoder *decoder);
+
+// Switches the 32-bit frame started by RENDER_StartUpdate to being handed to
+// the output straight from video memory, if it needs no scaling or conversion.
+// Returns whether it did, in which case no lines are drawn.
+bool RENDER_StartDirectUpdate();
+// Ends the direct frame with the lines at pixels, pitch bytes apart
+void RENDER_EndDirectUpdate(const uint8_t *pixels, int pitch);
+
+// Draws generated frame sequences through each scaler and the output, and
+// prints the frame rate, CPU time and bytes uploaded per frame
+void RENDER_Benchmark();
+
 #if C_OPENGL
 bool RENDER_UseSRGBTexture();
 bool RENDER_UseSRGBFramebuffer();
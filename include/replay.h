@@ -0,0 +1,84 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_REPLAY_H
+#define DOSBOX_REPLAY_H
+
+#include "dosbox.h"
+
+#include <ctime>
+#include <functional>
+#include <vector>
+
+#include "keyboard.h"
+
+/*
+Input Recording and Replay
+~~~~~~~~~~~~~~~~~~~~~~~~~~
+Records everything that makes a session depend on the host into the [dosbox]
+input_record file, stamped with the emulated millisecond it arrived in: the
+keyboard and mouse input, the received network packets, and the automatic
+cycle adjustments. Replaying the file with [dosbox] input_replay feeds the
+same inputs back at the same ticks while ignoring the host's, so the session
+runs the same way every time, as a "timedemo" of any program.
+
+While recording or replaying, the real-time clock runs on emulated time from
+the moment the recording started, and a checksum of every rendered frame is
+recorded or compared. A replay runs as fast as the host allows and reports
+its host time, frame rate, and any frames that came out differently, such as
+after a change to the emulation, then quits.
+
+The host inputs arrive between ticks and are replayed at the same point, so
+replays match each other exactly; inputs the emulation generates itself
+mid-tick, such as the autotype command's keys, are replayed at the end of
+their tick instead and so can differ from the recording.
+*/
+
+bool REPLAY_IsActive();
+bool REPLAY_IsPlaying();
+
+// Each returns whether the caller should go on to handle the host's input:
+// it's recorded when recording and ignored when replaying
+bool REPLAY_PassKey(KBD_KEYS key, bool pressed);
+bool REPLAY_PassMouseMoved(float x_rel, float y_rel, uint16_t x_abs, uint16_t y_abs);
+bool REPLAY_PassMouseButton(uint8_t idx, bool pressed);
+bool REPLAY_PassMouseWheel(int16_t w_rel);
+
+// Records a network packet received from the host
+void REPLAY_AddPacket(const uint8_t *packet, int len);
+// Passes the packets recorded as received this tick to the receiver
+void REPLAY_ReplayPackets(const std::function<int(const uint8_t *, int)> &receive);
+
+// Applies an input as it was recorded, for netplay to apply its inputs
+void REPLAY_ApplyInput(uint8_t type, const std::vector<uint8_t> &payload);
+
+// The wall-clock time the real-time clock shows
+time_t REPLAY_Time();
+
+// Records or checks the checksum of a rendered frame
+void REPLAY_AddFrame(uint64_t checksum);
+
+// Records or replays the inputs due before the next tick; called by the
+// main loop between ticks
+void REPLAY_ServiceTick();
+
+void REPLAY_Init(Section *sec);
+
+#endif
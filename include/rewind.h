@@ -0,0 +1,52 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_REWIND_H
+#define DOSBOX_REWIND_H
+
+#include "dosbox.h"
+
+/*
+Rewind
+~~~~~~
+Keeps the last seconds of a program started by the shell as a series of
+in-memory snapshots, taken up to [dosbox] rewind_rate times per emulated
+second, and steps back through them while the 'Rewind' mapper key is held.
+
+Each point keeps what's needed to step back from it to the one before: the
+RAM pages written in between, as dirty page tracking reports them, and the
+parts of the other components' state that changed, both as they were before
+and compressed. So a point costs about as much as the program changed, and
+the oldest points are dropped once they exceed [dosbox] rewind_buffer.
+
+The points have the fast boot snapshots' limits (see snapshot.h): they can
+only be taken and restored while the emulation is in the program's own loop,
+and the sound devices, the mouse driver, and files the program wrote aren't
+rolled back. Stepping back is refused if the program has opened or closed
+files since the point was taken.
+*/
+
+// Takes a point when one is due, or steps back while rewinding; called by
+// the main loop between ticks
+void REWIND_ServiceTick();
+
+void REWIND_Init(Section *sec);
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_RING_BUFFER_H
+#define DOSBOX_RING_BUFFER_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+
+/*
+Fixed-Capacity Ring Buffer
+~~~~~~~~~~~~~~~~~~~~~~~~~~
+A first-in, first-out queue held in a single array, so it never allocates and
+its items stay contiguous in memory.
+
+The sound devices use it to queue the frames they render on each port write
+until the mixer calls back for them. DequeueBulk() hands over the queued items
+in (at most two) contiguous runs, so they can be passed to a channel's
+AddSamples_* call in one go rather than frame by frame.
+
+It's not thread-safe: the producer and consumer must run on the same thread.
+*/
+
+template <typename T, size_t Capacity>
+class RingBuffer {
+public:
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+	              "the capacity is a power of two");
+
+	bool IsEmpty() const
+	{
+		return count == 0;
+	}
+
+	bool IsFull() const
+	{
+		return count == Capacity;
+	}
+
+	size_t Size() const
+	{
+		return count;
+	}
+
+	static constexpr size_t MaxCapacity()
+	{
+		return Capacity;
+	}
+
+	// Adds the item to the back, unless the buffer is full
+	bool Enqueue(const T &item)
+	{
+		if (IsFull())
+			return false;
+		items[(head + count) & mask] = item;
+		++count;
+		return true;
+	}
+
+	// The oldest item
+	const T &Front() const
+	{
+		assert(!IsEmpty());
+		return items[head];
+	}
+
+	T Dequeue()
+	{
+		assert(!IsEmpty());
+		const auto item = items[head];
+		head = (head + 1) & mask;
+		--count;
+		return item;
+	}
+
+	// Removes up to max_items of the oldest items, passing them to
+	// consume(const T *items, size_t num_items) in contiguous runs.
+	// Returns the number of items removed.
+	template <typename Consumer>
+	size_t DequeueBulk(const size_t max_items, Consumer &&consume)
+	{
+		const auto num_items = std::min(max_items, count);
+
+		auto remaining = num_items;
+		while (remaining) {
+			const auto run = std::min(remaining, Capacity - head);
+			consume(&items[head], run);
+
+			head = (head + run) & mask;
+			count -= run;
+			remaining -= run;
+		}
+		return num_items;
+	}
+
+	void Clear()
+	{
+		head  = 0;
+		count = 0;
+	}
+
+private:
+	static constexpr size_t mask = Capacity - 1;
+
+	std::array<T, Capacity> items = {};
+	size_t head  = 0; // index of the oldest item
+	size_t count = 0;
+};
+
+#endif
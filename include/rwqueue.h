@@ -1,7 +1,7 @@
 /*
  *  SPDX-License-Identifier: GPL-2.0-or-later
  *
- *  Copyright (C) 2021-2021  The DOSBox Staging Team
+ *  Copyright (C) 2021-2022  The DOSBox Staging Team
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -23,9 +23,11 @@
 
 #include "dosbox.h"
 
+#include <atomic>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
+#include <vector>
 
 template <typename T>
 class RWQueue {
@@ -50,6 +52,59 @@ public:
 	void Enqueue(const T &item);
 	void Enqueue(T &&item); // item will be empty (moved-out) after call
 	T Dequeue();
+
+	// Moves all of the items in, waiting for room as needed. The items
+	// will be empty (moved-out) after the call.
+	void BulkEnqueue(T *items, const size_t num_items);
+
+	// Waits for at least one item, then moves out as many as are queued, up
+	// to the maximum; returns the number of items moved out.
+	size_t BulkDequeue(T *items, const size_t max_items);
+};
+
+// A bounded queue with the same interface as RWQueue, for a single producer
+// thread and a single consumer thread. Items pass through a ring without
+// locking; a thread only takes the mutex to sleep once it's spun a while on
+// a full or empty ring, and the other thread only to wake it.
+template <typename T>
+class SpscQueue {
+private:
+	std::vector<T> ring{};
+	const size_t capacity = 0;
+
+	// Running totals of items written and read, each kept on its own
+	// cache line as they're only stored by one thread
+	alignas(64) std::atomic<size_t> num_written = {0};
+	alignas(64) std::atomic<size_t> num_read    = {0};
+
+	// Only used by a thread that's waiting for room or items
+	alignas(64) std::atomic<int> num_sleepers = {0};
+	std::mutex mutex                           = {};
+	std::condition_variable wakeup             = {};
+
+	template <typename Pred>
+	void WaitUntil(Pred is_ready);
+	void WakeSleepers();
+
+public:
+	SpscQueue() = delete;
+	SpscQueue(const SpscQueue<T> &other) = delete;
+	SpscQueue<T> &operator=(const SpscQueue<T> &other) = delete;
+
+	SpscQueue(size_t queue_capacity);
+
+	bool IsEmpty();
+	size_t Size();
+	size_t MaxCapacity() const;
+
+	// Producer thread only
+	void Enqueue(const T &item);
+	void Enqueue(T &&item); // item will be empty (moved-out) after call
+	void BulkEnqueue(T *items, const size_t num_items);
+
+	// Consumer thread only
+	T Dequeue();
+	size_t BulkDequeue(T *items, const size_t max_items);
 };
 
 #endif
@@ -21,12 +21,17 @@
 #ifndef DOSBOX_SDLMAIN_H
 #define DOSBOX_SDLMAIN_H
  
+#include <array>
 #include <string>
 #include <string_view>
+#include <vector>
 #include <string.h>
 #include "SDL.h"
 #if C_OPENGL
 #include <SDL_opengl.h>
+#ifndef GL_ARB_sync
+typedef struct __GLsync *GLsync;
+#endif
 #endif
 #include "video.h"
 
@@ -37,12 +42,17 @@
 // Texture buffer and presentation functions and type-defines
 using update_frame_buffer_f = void(const uint16_t *);
 using present_frame_f = bool();
-static void update_frame_texture([[maybe_unused]] const uint16_t *changedLines);
+static void update_frame_texture(const uint16_t *changedLines);
 static bool present_frame_texture();
 #if C_OPENGL
 static void update_frame_gl_pbo([[maybe_unused]] const uint16_t *changedLines);
+static void update_frame_gl_pbo_ring(const uint16_t *changedLines);
+static void update_frame_gl_indexed(const uint16_t *changedLines);
 static void update_frame_gl_fb(const uint16_t *changedLines);
 static bool present_frame_gl();
+static void stop_gl_presenter();
+#else
+static inline void stop_gl_presenter() { /* no-op */ }
 #endif
 static void update_frame_surface(const uint16_t *changedLines);
 constexpr void update_frame_noop([[maybe_unused]] const uint16_t *) { /* no-op */ }
@@ -59,8 +69,9 @@ enum SCREEN_TYPES	{
 	SCREEN_SURFACE,
 	SCREEN_TEXTURE,
 #if C_OPENGL
-	SCREEN_OPENGL
+	SCREEN_OPENGL,
 #endif
+	SCREEN_HEADLESS
 };
 
 enum class FRAME_MODE {
@@ -69,6 +80,7 @@ enum class FRAME_MODE {
 	VFR,        // variable frame rate, as defined by the emulated system
 	SYNCED_CFR, // constant frame rate, synced with the display's refresh rate
 	THROTTLED_VFR, // variable frame rate, throttled to the display's rate
+	VRR, // every frame presented when completed, for variable refresh rates
 };
 
 enum class HOST_RATE_MODE {
@@ -161,6 +173,7 @@ struct SDL_Block {
 		// See FinalizeWindowState function for details.
 		bool lazy_init_window_size = false;
 		HOST_RATE_MODE host_rate_mode = HOST_RATE_MODE::AUTO;
+		bool host_rate_is_vrr = false; // the display has a variable rate
 		double preferred_host_rate = 0.0;
 		bool want_resizable_window = false;
 		SDL_WindowEventID last_size_event = {};
@@ -184,7 +197,11 @@ struct SDL_Block {
 		GLint max_texsize;
 		bool bilinear;
 		bool pixel_buffer_object = false;
+		bool persistent_pbo = false;
+		bool threaded_presentation = false;
+		bool gpu_palette = false;
 		bool npot_textures_supported = false;
+		bool program_binaries = false;
 		bool use_shader;
 		bool framebuffer_is_srgb_encoded;
 		GLuint program_object;
@@ -197,6 +214,53 @@ struct SDL_Block {
 		} ruby = {};
 		GLuint actual_frame_count;
 		GLfloat vertex_data[2*3];
+		GLint position = -1;
+		// Frames drawn into a persistently mapped pixel buffer
+		struct {
+			uint8_t *pixels = nullptr;
+			size_t frame_bytes = 0;
+			size_t index = 0;
+			std::array<GLsync, 3> fences = {};
+		} pbo_ring = {};
+		// Presented frames the GPU hasn't finished drawing
+		struct {
+			int limit = 0;
+			int index = 0;
+			std::array<GLsync, 3> fences = {};
+		} frame_queue = {};
+		// Presented frames read back for capturing the shader output,
+		// each mapped a frame or two after it's read
+		struct {
+			bool supported = false;
+			std::array<GLuint, 3> buffers = {};
+			std::array<GLsync, 3> fences = {};
+			int width = 0;  // of the frames in the buffers
+			int height = 0;
+			size_t next = 0;    // the buffer the next frame is read into
+			size_t pending = 0; // frames read but not passed on yet
+		} readback = {};
+		// 8-bit frames uploaded as is and expanded into the texture
+		struct {
+			bool active = false;
+			GLuint program = 0;
+			GLuint framebuffer = 0;
+			GLuint index_texture = 0;
+			GLuint palette_texture = 0;
+			GLint position = -1;
+			uint32_t colours[256] = {};
+			bool colours_changed = false;
+			// Decoding CGA composite hdots instead of the lookup
+			struct {
+				bool active = false;
+				bool changed = false;
+				GLuint program = 0;
+				GLint position = -1;
+				GLuint levels_texture = 0;
+				GFX_CompositeDecoder decoder = {};
+				// The levels, biased by 32768, in two bytes each
+				uint8_t levels[1024 * 4] = {};
+			} composite = {};
+		} indexed = {};
 	} opengl = {};
 #endif // C_OPENGL
 	struct {
@@ -227,7 +291,52 @@ struct SDL_Block {
 		int period_us = 0;      // same but in us, for use with chrono
 		int period_us_early = 0;
 		int period_us_late = 0;
+		uint64_t uploaded_bytes = 0; // handed to the output since start
+		// Frames not presented between each one that is while
+		// fast-forwarding
+		int fast_forward_skip = 0;
 	} frame = {};
+	// Frames are only drawn into memory, without the SDL video subsystem
+	struct {
+		bool enabled = false;
+		bool fast_forward = false;
+		std::vector<uint8_t> framebuf = {};
+	} headless = {};
+	// A frame uploaded from the emulated video memory by GFX_EndUpdateDirect
+	struct {
+		const uint8_t *pixels = nullptr;
+		int pitch = 0;
+	} direct = {};
+	// The S3 hardware cursor, drawn over the presented frame
+	struct {
+		bool visible = false;
+		bool changed = false; // the frame needs presenting again
+		float x = 0.0f;       // in fractions of the frame
+		float y = 0.0f;
+		float w = 0.0f;
+		float h = 0.0f;
+		uint32_t colours[64 * 64] = {};
+		uint32_t inverted[64 * 64] = {};
+		// Bumped with each new image, for the textures to catch up
+		uint32_t image_version = 1;
+		// Made on first use, and reset along with the renderer or context
+		struct {
+			bool unsupported = false;
+			SDL_Texture *colours = nullptr;
+			SDL_Texture *inverted = nullptr;
+			uint32_t image_version = 0;
+		} texture = {};
+#if C_OPENGL
+		struct {
+			bool unsupported = false;
+			GLuint program = 0;
+			GLuint texture = 0;
+			GLint position = -1;
+			GLint texcoord = -1;
+			uint32_t image_version = 0;
+		} gl = {};
+#endif
+	} cursor = {};
 	struct {
 		float xsensitivity = 0.3f;
 		float ysensitivity = 0.3f;
@@ -30,6 +30,7 @@
 #include <memory>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 using parse_environ_result_t = std::list<std::tuple<std::string, std::string>>;
@@ -347,6 +348,13 @@ private:
 	typedef std::deque<Property*>::iterator it;
 	typedef std::deque<Property*>::const_iterator const_it;
 
+	// Lower-cased property name -> property, for constant-time lookups
+	std::unordered_map<std::string, Property *> property_index = {};
+
+	void AddProperty(Property *prop);
+	Property *FindProperty(const std::string &propname) const;
+	Property *FindExactProperty(const std::string &propname) const;
+
 public:
 	Section_prop(const std::string &name) : Section(name) {}
 
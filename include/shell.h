@@ -25,6 +25,8 @@
 #include <list>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #ifndef DOSBOX_PROGRAMS_H
 #include "programs.h"
@@ -59,6 +61,24 @@ public:
 	std::shared_ptr<BatchFile> prev = {}; // shared with Shell.bf
 	std::unique_ptr<CommandLine> cmd = {};
 	std::string filename{};
+
+private:
+	bool Refresh();
+	void NextLine(char *line, bool full_charset);
+	void IndexLabels();
+
+	// In-memory copy of the batch file, revalidated against the file's
+	// size and date before each use so self-modifying batch files still
+	// see their edits.
+	std::vector<uint8_t> content = {};
+	uint32_t content_size = 0;
+	uint16_t content_time = 0;
+	uint16_t content_date = 0;
+	bool is_loaded = false;
+
+	// Label name (upper-case) -> offset of the line following it
+	std::unordered_map<std::string, uint32_t> labels = {};
+	bool is_indexed = false;
 };
 
 class AutoexecEditor;
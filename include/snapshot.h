@@ -0,0 +1,149 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SNAPSHOT_H
+#define DOSBOX_SNAPSHOT_H
+
+#include "dosbox.h"
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+Fast Boot Snapshots
+~~~~~~~~~~~~~~~~~~~
+Freezes the machine while a program started by the shell is running (usually
+the last line of [autoexec]) and writes it to the [dosbox] fast_boot_snapshot
+file. When the shell starts the same program in a later session, the machine
+is restored from the snapshot instead, skipping the program's own start-up.
+
+The DOSBox shell runs on the host and calls into the emulated machine, so a
+snapshot can only be taken and restored at the point where the shell waits for
+the program to finish. The host state at that point (mounted drives, the
+shell, device configuration) comes from the configuration and is the same in
+every session. Only the emulated state is saved: the CPU and FPU, memory and
+paging, the PIC and PIT, the VGA, and the DOS, EMS, and XMS tables. Sound
+devices and the mouse driver are not saved.
+
+With [dosbox] fast_boot_shared_memory, the guest RAM is kept uncompressed in
+a file next to the snapshot and mapped copy-on-write when restoring. Instances
+resuming the same snapshot then share the pages none of them has changed.
+
+Each module registers a component with a function that passes its state
+through a SnapshotStream, which either saves or restores it. Components are
+written in registration order.
+*/
+
+class SnapshotStream {
+public:
+	// Saving into data
+	SnapshotStream() = default;
+
+	// Restoring from saved data
+	explicit SnapshotStream(std::vector<uint8_t> &&saved_data)
+	        : data(std::move(saved_data)),
+	          is_loading(true)
+	{}
+
+	bool IsLoading() const
+	{
+		return is_loading;
+	}
+
+	// Incremental snapshots keep the guest RAM themselves, as the pages
+	// written since the previous snapshot
+	void ExcludeRam()
+	{
+		excludes_ram = true;
+	}
+
+	bool ExcludesRam() const
+	{
+		return excludes_ram;
+	}
+
+	// Saves or restores a region of memory
+	void Bytes(void *region, size_t size);
+
+	// Saves or restores a variable holding no host pointers
+	template <typename T>
+	void Pod(T &value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>,
+		              "snapshots copy the bytes of the value");
+		Bytes(&value, sizeof(value));
+	}
+
+	// Rejects saved data that doesn't fit this configuration
+	void Fail()
+	{
+		failed = true;
+	}
+
+	// A restore didn't consume exactly the saved data, or was rejected
+	bool Failed() const
+	{
+		return failed || (is_loading && pos != data.size());
+	}
+
+	std::vector<uint8_t> data = {};
+
+private:
+	size_t pos = 0;
+	bool is_loading = false;
+	bool excludes_ram = false;
+	bool failed = false;
+};
+
+using SnapshotHandler = void (*)(SnapshotStream &stream);
+
+// Adds or replaces the component with the given name
+void SNAPSHOT_AddComponent(const char *name, SnapshotHandler handler);
+
+// Runs the program the shell prepared for INT 21h/4Bh and waits for it to
+// finish, resuming it from the snapshot if one was taken while running the
+// same command
+void SNAPSHOT_ExecuteProgram(const std::string &command);
+
+// Takes a requested snapshot if the machine is in a state that can be saved;
+// called by the main loop between ticks
+void SNAPSHOT_ServiceRequest();
+
+extern bool snapshot_requested;
+
+// Whether the emulation is back in the loop of a program started by the
+// shell, the only point a snapshot can be taken and restored at
+bool SNAPSHOT_CanCapture();
+
+// Saves the state of every component but the guest RAM into the data, for
+// snapshots kept in memory during the session
+bool SNAPSHOT_CaptureState(std::vector<uint8_t> &data);
+
+// Restores the state saved by SNAPSHOT_CaptureState
+void SNAPSHOT_RestoreState(const std::vector<uint8_t> &data);
+
+// The file the guest RAM of a snapshot is kept in when it's shared between
+// instances, or empty if the RAM is saved in the snapshot itself
+std::string SNAPSHOT_SharedMemoryPath();
+
+void SNAPSHOT_Init(Section *sec);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SOFTFLOAT80_H
+#define DOSBOX_SOFTFLOAT80_H
+
+#include <cstdint>
+
+/*
+80-bit Extended Precision Arithmetic
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+A software implementation of the x87 extended real format, used by the
+accurate FPU mode on hosts without an x87 FPU.
+
+Values are kept in the memory layout of the format: a 64-bit significand with
+an explicit integer bit, and a 16-bit word holding the sign and the exponent
+(biased by 16383). Results are rounded as instructed by the precision and
+rounding control fields of the FPU control word.
+
+Exceptions are not raised; invalid operations return the indefinite NaN.
+*/
+
+struct Ext80 {
+	uint64_t mant = 0;
+	uint16_t sign_exp = 0;
+
+	bool operator==(const Ext80 &other) const
+	{
+		return mant == other.mant && sign_exp == other.sign_exp;
+	}
+};
+
+struct Ext80Control {
+	uint8_t rounding  = 0;  // the x87 rounding control: nearest, down, up, chop
+	uint8_t precision = 64; // significand bits to round to: 24, 53 or 64
+};
+
+// Takes the rounding and precision control from an x87 control word
+Ext80Control ext80_control(uint16_t cw);
+
+Ext80 ext80_add(Ext80 a, Ext80 b, Ext80Control ctrl);
+Ext80 ext80_sub(Ext80 a, Ext80 b, Ext80Control ctrl);
+Ext80 ext80_mul(Ext80 a, Ext80 b, Ext80Control ctrl);
+Ext80 ext80_div(Ext80 a, Ext80 b, Ext80Control ctrl);
+
+// Returns -1, 0 or 1 as a is less than, equal to or greater than b, or 2
+// if they are unordered (either is a NaN)
+int ext80_compare(Ext80 a, Ext80 b);
+
+// Conversions from other formats are exact
+Ext80 ext80_from_double(double d);
+Ext80 ext80_from_int64(int64_t i);
+
+double ext80_to_double(Ext80 x, uint8_t rounding);
+float ext80_to_float(Ext80 x, uint8_t rounding);
+
+// Rounds to an integer; returns false for NaNs and values that don't fit
+bool ext80_to_int64(Ext80 x, uint8_t rounding, int64_t &result);
+
+// Rounds to an integral value, keeping the format
+Ext80 ext80_round_to_int(Ext80 x, uint8_t rounding);
+
+constexpr Ext80 ext80_negate(Ext80 x)
+{
+	return {x.mant, static_cast<uint16_t>(x.sign_exp ^ 0x8000)};
+}
+
+constexpr Ext80 ext80_abs(Ext80 x)
+{
+	return {x.mant, static_cast<uint16_t>(x.sign_exp & 0x7fff)};
+}
+
+constexpr bool ext80_is_zero(Ext80 x)
+{
+	return x.mant == 0 && (x.sign_exp & 0x7fff) == 0;
+}
+
+constexpr bool ext80_is_negative(Ext80 x)
+{
+	return (x.sign_exp & 0x8000) != 0;
+}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SPSC_QUEUE_IMPL_H
+#define DOSBOX_SPSC_QUEUE_IMPL_H
+
+// The member definitions of SpscQueue, for the translation units that
+// instantiate it for their own item types
+
+#include "rwqueue.h"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+// Yields this many times for the other thread before going to sleep
+constexpr int spins_before_sleeping = 64;
+
+template <typename T>
+SpscQueue<T>::SpscQueue(size_t queue_capacity)
+        : ring(queue_capacity),
+          capacity(queue_capacity)
+{
+	assert(capacity > 0);
+}
+
+template <typename T>
+size_t SpscQueue<T>::Size()
+{
+	// read the reads first, so the writes can only have moved ahead
+	const auto read = num_read.load(std::memory_order_acquire);
+	return num_written.load(std::memory_order_acquire) - read;
+}
+
+template <typename T>
+size_t SpscQueue<T>::MaxCapacity() const
+{
+	return capacity;
+}
+
+template <typename T>
+bool SpscQueue<T>::IsEmpty()
+{
+	return Size() == 0;
+}
+
+template <typename T>
+template <typename Pred>
+void SpscQueue<T>::WaitUntil(Pred is_ready)
+{
+	for (auto i = 0; i < spins_before_sleeping; ++i) {
+		if (is_ready())
+			return;
+		std::this_thread::yield();
+	}
+
+	// Sign up as a sleeper before the last check. Paired with the fence
+	// in WakeSleepers(), either the other thread sees us or we see its
+	// update.
+	std::unique_lock<std::mutex> lock(mutex);
+	num_sleepers.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	while (!is_ready())
+		wakeup.wait(lock);
+	num_sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+void SpscQueue<T>::WakeSleepers()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (num_sleepers.load(std::memory_order_relaxed) == 0)
+		return;
+
+	// A sleeper holds the mutex until it's waiting, so once we get it the
+	// notification can't be missed
+	{ const std::lock_guard<std::mutex> lock(mutex); }
+	wakeup.notify_all();
+}
+
+template <typename T>
+void SpscQueue<T>::Enqueue(const T &item)
+{
+	const auto written = num_written.load(std::memory_order_relaxed);
+	WaitUntil([&] {
+		return written - num_read.load(std::memory_order_acquire) < capacity;
+	});
+
+	ring[written % capacity] = item;
+	num_written.store(written + 1, std::memory_order_release);
+	WakeSleepers();
+}
+
+template <typename T>
+void SpscQueue<T>::Enqueue(T &&item)
+{
+	const auto written = num_written.load(std::memory_order_relaxed);
+	WaitUntil([&] {
+		return written - num_read.load(std::memory_order_acquire) < capacity;
+	});
+
+	ring[written % capacity] = std::move(item);
+	num_written.store(written + 1, std::memory_order_release);
+	WakeSleepers();
+}
+
+template <typename T>
+void SpscQueue<T>::BulkEnqueue(T *items, const size_t num_items)
+{
+	size_t num_queued = 0;
+	while (num_queued < num_items) {
+		const auto written = num_written.load(std::memory_order_relaxed);
+		size_t room = 0;
+		WaitUntil([&] {
+			room = capacity - (written -
+			                   num_read.load(std::memory_order_acquire));
+			return room > 0;
+		});
+
+		// publish as many as fit at once
+		const auto num_to_queue = std::min(room, num_items - num_queued);
+		for (size_t i = 0; i < num_to_queue; ++i)
+			ring[(written + i) % capacity] = std::move(items[num_queued++]);
+		num_written.store(written + num_to_queue, std::memory_order_release);
+		WakeSleepers();
+	}
+}
+
+template <typename T>
+T SpscQueue<T>::Dequeue()
+{
+	const auto read = num_read.load(std::memory_order_relaxed);
+	WaitUntil([&] {
+		return num_written.load(std::memory_order_acquire) != read;
+	});
+
+	T item = std::move(ring[read % capacity]);
+	num_read.store(read + 1, std::memory_order_release);
+	WakeSleepers();
+	return item;
+}
+
+template <typename T>
+size_t SpscQueue<T>::BulkDequeue(T *items, const size_t max_items)
+{
+	assert(max_items > 0);
+
+	const auto read = num_read.load(std::memory_order_relaxed);
+	size_t available = 0;
+	WaitUntil([&] {
+		available = num_written.load(std::memory_order_acquire) - read;
+		return available > 0;
+	});
+
+	// release as many slots as we take at once
+	const auto num_items = std::min(available, max_items);
+	for (size_t i = 0; i < num_items; ++i)
+		items[i] = std::move(ring[(read + i) % capacity]);
+	num_read.store(read + num_items, std::memory_order_release);
+	WakeSleepers();
+	return num_items;
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_STARTUP_H
+#define DOSBOX_STARTUP_H
+
+#include "dosbox.h"
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <utility>
+
+/*
+Startup Tracing
+~~~~~~~~~~~~~~~
+When enabled with --trace-startup, each StartupStage logs how long it was
+alive, which lets the time spent in config parsing and in each section's init
+functions be read straight out of the log. The time DOS takes to load each
+program it executes is logged the same way.
+
+Heavy initialization steps that don't depend on the rest of the emulator, such
+as loading a SoundFont or MT-32 ROMs, can be started early in a worker task
+with STARTUP_RunTask() and joined (via the returned future) right before their
+results are first used.
+*/
+
+void STARTUP_EnableTrace(const bool enabled);
+bool STARTUP_IsTracing();
+
+class StartupStage {
+public:
+	StartupStage(std::string name);
+	~StartupStage();
+
+	StartupStage(const StartupStage &)            = delete;
+	StartupStage &operator=(const StartupStage &) = delete;
+
+private:
+	const std::string stage_name;
+	const std::chrono::steady_clock::time_point start_time;
+};
+
+template <typename Task>
+auto STARTUP_RunTask(const char *name, Task &&task)
+{
+	return std::async(std::launch::async,
+	                  [name, task = std::forward<Task>(task)]() mutable {
+		                  const StartupStage stage(name);
+		                  return task();
+	                  });
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_THREAD_CONTROL_H
+#define DOSBOX_THREAD_CONTROL_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+#include <string>
+
+/*
+Thread Affinity and Priority
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+The time-critical threads can be pinned to host cores and run at a raised
+priority, so a busy host preempts them less often:
+
+  - Emulation: the main thread running the CPU core.
+  - Audio: SDL's audio callback thread.
+  - Render: the threaded OpenGL presenter.
+  - Midi: the render-ahead threads of the MT-32 and FluidSynth synths.
+
+Each thread applies the settings to itself when it starts, as macOS and
+Windows only offer some of the controls for the calling thread.
+
+The 'realtime' priority uses SCHED_FIFO on Linux and MMCSS on Windows for the
+audio and MIDI threads, and the user-interactive QoS class on macOS. The
+emulation thread never runs in a real-time class, as it would starve the
+rest of the system while running flat out.
+*/
+
+enum class ThreadClass : uint8_t {
+	Emulation,
+	Audio,
+	Render,
+	Midi,
+	NumClasses,
+};
+
+// Takes the [dosbox] thread_affinity and thread_priority settings
+void THREAD_Configure(const std::string &affinity, const std::string &priority);
+
+// Applies the affinity and priority set for the class to the calling thread
+void THREAD_ApplyToCurrent(ThreadClass thread_class);
+
+#endif
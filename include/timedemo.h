@@ -0,0 +1,58 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef DOSBOX_TIMEDEMO_H
+#define DOSBOX_TIMEDEMO_H
+
+#include "dosbox.h"
+
+class CommandLine;
+
+/*
+Benchmark Mode
+~~~~~~~~~~~~~~
+'dosbox --benchmark PROGRAM --frames N' boots the configuration and runs the
+program as it would without the option, but as fast as the host allows: with
+cycles=max, fast-forwarding, no audio device, and no frame skipping. From the
+first rendered frame on, it counts N frames and then reports the emulated
+cycles per host second, the frames rendered and audio frames mixed, and the
+host time each subsystem took according to the cycle telemetry, then quits.
+
+Running the same title on two builds, cores, outputs, or hosts gives one
+comparable figure for each.
+*/
+
+// Removes the --benchmark and --frames options from the command line and
+// returns whether the benchmark mode was asked for
+bool TIMEDEMO_ParseCommandLine(CommandLine &cmdline);
+
+bool TIMEDEMO_IsActive();
+
+// Overrides the configuration's settings that affect the measurement
+void TIMEDEMO_ApplySettings();
+
+// Counts a rendered frame; quits once enough were counted
+void TIMEDEMO_AddFrame();
+
+// Reports a benchmark that was stopped before counting all of its frames
+void TIMEDEMO_Finish();
+
+#endif
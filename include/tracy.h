@@ -134,5 +134,20 @@
 #	include <Tracy.hpp>
 #endif
 
+// Zones for subsystems that run many times per frame, such as device event
+// handlers and mixer channels. The "profzones" hotkey switches them off while
+// profiling when their overhead distorts the capture, keeping the coarser
+// zones and plots.
+#if C_TRACY
+extern bool tracy_subsystem_zones;
+#	define ZoneScopedSubsystem(name) \
+	ZoneNamedN(tracy_subsystem_zone, name, tracy_subsystem_zones)
+#	define ZoneTransientSubsystem(name) \
+	ZoneTransientN(tracy_subsystem_zone, name, tracy_subsystem_zones)
+#else
+#	define ZoneScopedSubsystem(name)
+#	define ZoneTransientSubsystem(name)
+#endif
+
 // close the header
 #endif
@@ -28,7 +28,6 @@
 
 //Don't enable keeping changes and mapping lfb probably...
 #define VGA_LFB_MAPPED
-//#define VGA_KEEP_CHANGES
 #define VGA_CHANGE_SHIFT	9
 
 class PageHandler;
@@ -193,6 +192,14 @@ struct VGA_Draw {
 	bool double_scan = false;
 	bool doublewidth = false;
 	bool doubleheight = false;
+	// Composite modes pass on their hdots for the output to decode
+	bool composite_on_gpu = false;
+	// Frames in a row displayed without any of their colours or panning
+	// changing; past a few, the frames are drawn in a single event
+	uint32_t quiet_frames = 0;
+	// The frame being displayed, when it's handed to the output straight
+	// from video memory instead of line by line
+	const uint8_t *direct_frame = nullptr;
 	uint8_t font[64 * 1024] = {};
 	uint8_t *font_tables[2] = {nullptr, nullptr};
 	Bitu blinking = 0;
@@ -421,16 +428,24 @@ struct VGA_Memory {
 	alignas(vga_memalign) uint8_t linear[vga_maxmemsize];
 };
 
+// Video memory is tracked in blocks of (1 << VGA_CHANGE_SHIFT) bytes, covering
+// the largest buffer the draw functions read from (fastmem) in a power of two
+constexpr uint32_t vga_changes_blocks = (16 * 1024 * 1024) >> VGA_CHANGE_SHIFT;
+static_assert((vga_changes_blocks << VGA_CHANGE_SHIFT) >= 2 * 8 * 1024 * 1024);
+
 struct VGA_Changes {
-	//Add a few more just to be safe
-	uint8_t *map = nullptr; /* allocated dynamically: [(VGA_MEMORY >> VGA_CHANGE_SHIFT) + 32] */
-	uint8_t checkMask = 0;
+	// The number of the frame each block was last written in, addressed
+	// as the draw functions read video memory
+	uint8_t map[vga_changes_blocks] = {};
+	// The number of the frame being drawn
 	uint8_t frame = 0;
-	uint8_t writeMask = 0;
-	bool active = 0;
-	uint32_t clearMask = 0;
-	uint32_t start = 0, last = 0;
-	uint32_t lastAddress = 0;
+	// The installed page handler marks every write it makes
+	bool tracked = false;
+	// Lines made only of unwritten blocks may be skipped in this frame
+	bool skipping = false;
+	// Something besides the tracked writes changed the display, so the
+	// next frame has to be drawn in full
+	bool full = true;
 };
 
 struct VGA_LFB {
@@ -465,9 +480,7 @@ struct VGA_Type {
 	 // always twice as big as vmemsize
 	alignas(vga_memalign) uint8_t fastmem[vga_maxmemsize*2];
 	uint32_t vmemsize = 0;
-#ifdef VGA_KEEP_CHANGES
 	VGA_Changes changes = {};
-#endif
 	VGA_LFB lfb = {};
 	// Composite video mode parameters
 	int ri = 0, rq = 0, gi = 0, gq = 0, bi = 0, bq = 0;
@@ -490,6 +503,8 @@ void VGA_StartResize(Bitu delay=50);
 void VGA_SetupDrawing(uint32_t val);
 void VGA_CheckScanLength(void);
 void VGA_ChangedBank(void);
+// Publishes the bank switches since the previous frame's start
+void VGA_EndFrameBankSwitches();
 
 /* Some DAC/Attribute functions */
 void VGA_DAC_CombineColor(uint8_t attr,uint8_t pal);
@@ -507,9 +522,14 @@ void VGA_SetupDAC(void);
 void VGA_SetupCRTC(void);
 void VGA_SetupMisc(void);
 void VGA_SetupGFX(void);
+// Writes a graphics controller register as port 3CFh would, for the BIOS
+// drawing services
+void VGA_WriteGfxRegister(uint8_t index, uint8_t val);
 void VGA_SetupSEQ(void);
 void VGA_SetupOther(void);
 void VGA_SetupXGA(void);
+// Plots the S3 accelerator commands run during the frame in Tracy
+void XGA_EndFrame();
 void VGA_AddCompositeSettings(Config &conf);
 
 /* Some Support Functions */
@@ -531,6 +551,15 @@ void VGA_SetCGA4Table(uint8_t val0,uint8_t val1,uint8_t val2,uint8_t val3);
 void VGA_ActivateHardwareCursor(void);
 void VGA_KillDrawing(void);
 
+// Makes the next frames be drawn in full, after video memory or the display
+// state changed in a way the page handlers don't track
+void VGA_MarkAllChanged();
+
+// Notes a change to the colours or the panning the lines are drawn with. If
+// it comes while the frame is displayed, the next frames are drawn line by
+// line again to show it where it was made.
+void VGA_NoteDisplayChange();
+
 void VGA_LogInitialization(const char *adapter_name,
                            const char *ram_type,
                            const size_t num_modes);
@@ -58,12 +58,40 @@ typedef void (*GFX_CallBack_t)( GFX_CallBackFunctions_t function );
 // - false means event loop wants to quit.
 bool GFX_Events();
 
+// Sleeps up to the timeout, but wakes up as soon as host input arrives, so
+// the next GFX_Events() call passes it on without waiting out the sleep
+void GFX_WaitForEvents(int timeout_ms);
+
 // Let the presentation layer safely call no-op functions.
 // Useful during output initialization or transitions.
 void GFX_DisengageRendering();
 
 Bitu GFX_GetBestMode(Bitu flags);
 Bitu GFX_GetRGB(uint8_t red,uint8_t green,uint8_t blue);
+
+// Passes the 256 colours, as returned by GFX_GetRGB, an 8-bit output frame
+// is to be shown with
+void GFX_SetPalette(const uint32_t *colours);
+
+// What's needed to decode 8-bit frames holding the RGBI colour of each hdot
+// of a CGA composite signal, as Composite_Process in vga_draw.cpp does
+struct GFX_CompositeDecoder {
+	// The composite level of each pair of adjacent hdots and carrier phase
+	const int *levels = nullptr;
+	int hdots = 0;
+	int sharpness = 0;
+	int ri = 0, rq = 0, gi = 0, gq = 0, bi = 0, bq = 0;
+	uint8_t border = 0;
+	bool monochrome = false;
+};
+
+// Whether 8-bit frames can be decoded as composite hdots
+bool GFX_CanDecodeComposite();
+
+// Decodes the 8-bit frames that follow as composite hdots, or looks their
+// colours up in the palette again if the decoder is null. Returns whether
+// that changes how the frame looks.
+bool GFX_SetCompositeDecoder(const GFX_CompositeDecoder *decoder);
 void GFX_SetShader(const std::string &source);
 Bitu GFX_SetSize(int width, int height, Bitu flags,
                  double scalex, double scaley,
@@ -77,11 +105,32 @@ void GFX_Stop(void);
 void GFX_SwitchFullScreen(void);
 bool GFX_StartUpdate(uint8_t * &pixels, int &pitch);
 void GFX_EndUpdate( const uint16_t *changedLines );
+
+// Whether the output can read back the frames it presents for capturing,
+// which the OpenGL output can unless presenting on its own thread
+bool GFX_CanCaptureDisplay();
+
+// Whether the output can upload a 32-bit frame from the caller's memory
+// instead of the pixels returned by GFX_StartUpdate
+bool GFX_CanUploadDirect();
+// Ends the update with the whole frame taken from pixels, pitch bytes apart
+void GFX_EndUpdateDirect(const uint8_t *pixels, int pitch);
+// Bytes of frame data handed to the output since start, for benchmarking
+uint64_t GFX_GetUploadedBytes();
+// Whether the output can draw the S3 hardware cursor over the frame itself
+bool GFX_CanOverlayCursor();
+// Sets the 64x64 cursor image: colours are ARGB with straight alpha, and the
+// frame is inverted beneath the set pixels of the inverted mask
+void GFX_SetCursorImage(const uint32_t *colours, const uint32_t *inverted);
+// Places the cursor image, in fractions of the frame's width and height
+void GFX_SetCursorPosition(bool visible, float x, float y, float w, float h);
 void GFX_GetSize(int &width, int &height, bool &fullscreen);
 void GFX_UpdateMouseState();
 void GFX_LosingFocus();
 void GFX_RegenerateWindow(Section *sec);
 bool GFX_MouseIsAvailable();
+// Whether a headless run is set to go as fast as possible
+bool GFX_WantsFastForward();
 
 #if defined (REDUCE_JOYSTICK_POLLING)
 void MAPPER_UpdateJoysticks(void);
@@ -0,0 +1,93 @@
+#!/usr/bin/python3
+
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Copyright (C) 2022-2022  The DOSBox Staging Team
+
+# pylint: disable=invalid-name
+# pylint: disable=missing-docstring
+
+"""
+Decode a binary cpu trace written by the heavy debugger's LOGB command.
+
+Prints one line per instruction with CS:EIP, the code bytes read at that
+address and the registers that changed since the previous instruction
+(all of them on the first line). Use --full to print every register on
+every line, similar to the LOGL text log.
+
+The layout matches CpuTraceHeader and CpuTraceRecord in src/debug/cpu_trace.h.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b'DBXTRACE'
+VERSION = 1
+
+REGS = ['EAX', 'EBX', 'ECX', 'EDX', 'ESI', 'EDI', 'EBP', 'ESP']
+SEGS = ['CS', 'DS', 'ES', 'FS', 'GS', 'SS']
+FLAGS_BIT = 8
+FIRST_SEG_BIT = 9
+
+
+def read_header(trace):
+    header = trace.read(16)
+    if len(header) != 16 or header[:8] != MAGIC:
+        sys.exit('not a cpu trace file')
+    for order in ('<', '>'):
+        version, record_size, byte_order = struct.unpack(order + 'HHI',
+                                                         header[8:])
+        if byte_order == 0x01020304:
+            break
+    else:
+        sys.exit('unknown byte order')
+    if version != VERSION:
+        sys.exit(f'unsupported trace version {version}')
+    return order, record_size
+
+
+def format_record(record, full):
+    (eip, regs, flags, segs, changed, code_big, code) = record
+    width = 8 if code_big else 4
+    line = f'{segs[0]:04X}:{eip:0{width}X}  {code.hex(" ").upper():<45}'
+    for i, name in enumerate(REGS):
+        if full or changed & (1 << i):
+            line += f' {name}:{regs[i]:08X}'
+    for i, name in enumerate(SEGS):
+        if full or changed & (1 << (FIRST_SEG_BIT + i)):
+            line += f' {name}:{segs[i]:04X}'
+    if full or changed & (1 << FLAGS_BIT):
+        line += f' FLG:{flags:08X}'
+    return line
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[1])
+    parser.add_argument('trace', help='path to LOGCPU.BIN')
+    parser.add_argument('--full', action='store_true',
+                        help='print all registers on every line')
+    args = parser.parse_args()
+
+    with open(args.trace, 'rb') as trace:
+        order, record_size = read_header(trace)
+        layout = struct.Struct(order + 'I8II6HHBB16s')
+        if record_size != layout.size:
+            sys.exit(f'unexpected record size {record_size}')
+        while True:
+            data = trace.read(record_size)
+            if len(data) < record_size:
+                break
+            fields = layout.unpack(data)
+            eip = fields[0]
+            regs = fields[1:9]
+            flags = fields[9]
+            segs = fields[10:16]
+            changed, code_big, code_len, code = fields[16:20]
+            record = (eip, regs, flags, segs, changed, code_big,
+                      code[:code_len])
+            print(format_record(record, args.full))
+
+
+if __name__ == '__main__':
+    main()
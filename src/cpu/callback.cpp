@@ -85,6 +85,46 @@ static Bitu stop_handler(void) {
 
 
 
+#if C_DEBUG
+// The core checks the debugger's interrupt breakpoints when it does an INT
+constexpr bool can_do_int = false;
+#else
+constexpr bool can_do_int = true;
+#endif
+
+/* When the code at cs:eip is a native handler that returns straight after its
+   callback with the given instruction (an IRET or a RETF), calls the handler
+   and does the return here, sparing the nested core loop. Returns whether it
+   got back to stop_at; otherwise the core has to carry on from cs:eip. */
+static bool run_native_handler(const uint8_t return_opcode, const RealPt stop_at)
+{
+	// The core takes care of trapping and of protected mode
+	if (cpu.pmode || GETFLAG(TF) || SegValue(cs) != CB_SEG)
+		return false;
+	const auto offset = reg_eip - CB_SOFFSET;
+	if (reg_eip < CB_SOFFSET || offset % CB_SIZE || offset / CB_SIZE >= CB_MAX)
+		return false;
+	const auto callback = offset / CB_SIZE;
+	const auto code = CALLBACK_PhysPointer(callback);
+	if (phys_readb(code) != 0xFE || phys_readb(code + 1) != 0x38 ||
+	    phys_readw(code + 2) != callback || phys_readb(code + 4) != return_opcode)
+		return false;
+
+	// Past the callback instruction, as the core leaves it for the handler
+	reg_eip += 4;
+	if (CallBack_Handlers[callback]() != CBRET_NONE)
+		return true;
+	// The handler jumped elsewhere, like DOS starting a program does
+	if (SegValue(cs) != CB_SEG || reg_eip != CB_SOFFSET + offset + 4)
+		return false;
+
+	if (return_opcode == 0xCF)
+		CPU_IRET(false, reg_eip);
+	else
+		CPU_RET(false, 0, reg_eip);
+	return SegValue(cs) == RealSeg(stop_at) && reg_eip == RealOff(stop_at);
+}
+
 void CALLBACK_RunRealFar(uint16_t seg,uint16_t off) {
 	reg_sp-=4;
 	real_writew(SegValue(ss),reg_sp+0,RealOff(CALLBACK_RealPointer(call_stop)));
@@ -93,7 +133,8 @@ void CALLBACK_RunRealFar(uint16_t seg,uint16_t off) {
 	auto oldcs=SegValue(cs);
 	reg_eip=off;
 	SegSet16(cs,seg);
-	DOSBOX_RunMachine();
+	if (!run_native_handler(0xCB, CALLBACK_RealPointer(call_stop)))
+		DOSBOX_RunMachine();
 	reg_eip=oldeip;
 	SegSet16(cs,oldcs);
 }
@@ -103,7 +144,16 @@ void CALLBACK_RunRealInt(uint8_t intnum) {
 	uint16_t oldcs=SegValue(cs);
 	reg_eip=CB_SOFFSET+(CB_MAX*CB_SIZE)+(intnum*6);
 	SegSet16(cs,CB_SEG);
-	DOSBOX_RunMachine();
+	if (cpu.pmode || !can_do_int) {
+		DOSBOX_RunMachine();
+	} else {
+		/* Do the INT of the block here, returning to the stop callback
+		   after it, so a native handler can be called straight away */
+		const auto stop_at = RealMake(CB_SEG, static_cast<uint16_t>(reg_eip + 2));
+		CPU_Interrupt(intnum, CPU_INT_SOFTWARE, reg_eip + 2);
+		if (!run_native_handler(0xCF, stop_at))
+			DOSBOX_RunMachine();
+	}
 	reg_eip=oldeip;
 	SegSet16(cs,oldcs);
 }
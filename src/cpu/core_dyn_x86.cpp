@@ -46,6 +46,7 @@
 #include "fpu.h"
 #include "inout.h"
 #include "mem.h"
+#include "metrics.h"
 #include "paging.h"
 #include "regs.h"
 #include "tracy.h"
@@ -250,6 +251,9 @@ static void dyn_restoreregister(DynReg * src_reg, DynReg * dst_reg) {
 
 Bits CPU_Core_Dyn_X86_Run(void) {
 	ZoneScoped
+	if (GCC_UNLIKELY(!cache_initialized))
+		cache_init();
+
 	// helper class to auto-save DH_FPU state on function exit
 	class auto_dh_fpu {
 	public:
@@ -271,6 +275,12 @@ restart_core:
 		if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
 #endif
 #endif
+	// code that isn't hot yet is left to the normal core, as is a page
+	// that keeps modifying itself, before a code page handler gets
+	// installed for it
+	if (GCC_UNLIKELY(cache_hot_is_cold(ip_point) || cache_smc_is_demoted(ip_point))) {
+		return CPU_Core_Normal_Run();
+	}
 	CodePageHandler * chandler=0;
 	if (GCC_UNLIKELY(MakeCodePage(ip_point,chandler))) {
 		CPU_Exception(cpu.exception.which,cpu.exception.error);
@@ -283,8 +293,13 @@ restart_core:
 	CacheBlock * block=chandler->FindCacheBlock(ip_point&4095);
 	if (!block) {
 		if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
-			block=CreateCacheBlock(chandler,ip_point,32);
-		} else {
+			cache_profile_restore(chandler, ip_point);
+			block = chandler->FindCacheBlock(ip_point & 4095);
+			if (!block && chandler->CountExecution(ip_point & 4095, cache_translate_threshold))
+				block = CreateCacheBlock(chandler, ip_point, 32);
+		}
+		if (!block) {
+			// run code that is modified or not yet hot enough in the normal core
 			int32_t old_cycles=CPU_Cycles;
 			CPU_Cycles=1;
 			// manually save
@@ -453,15 +468,40 @@ void CPU_Core_Dyn_X86_Init(void) {
 	return;
 }
 
-void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache) {
-	/* Initialize code cache and dynamic blocks */
-	cache_init(enable_cache);
-}
-
 void CPU_Core_Dyn_X86_Cache_Close(void) {
 	cache_close();
 }
 
+void CPU_Core_Dyn_X86_SetCacheFile(const std::string &filename)
+{
+	cache_profile_load(filename);
+}
+
+void CPU_Core_Dyn_X86_SetTranslateThreshold(const int threshold)
+{
+	cache_translate_threshold = check_cast<uint8_t>(threshold);
+}
+
+void CPU_Core_Dyn_X86_SetSmcThreshold(const int threshold)
+{
+	cache_smc_set_threshold(threshold);
+}
+
+void CPU_Core_Dyn_X86_SetAdaptive(const bool enabled)
+{
+	cache_hot_set_enabled(enabled);
+}
+
+void CPU_Core_Dyn_X86_FlushCache()
+{
+	cache_release_pages();
+}
+
+void CPU_Core_Dyn_X86_SetCacheSize(const int size_mb)
+{
+	cache_set_size(size_mb);
+}
+
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu) {
 #if defined(X86_DYNFPU_DH_ENABLED)
 	dyn_dh_fpu.dh_fpu_enabled=dh_fpu;
@@ -20,6 +20,67 @@
 
 #include <cassert>
 
+/* Runs the leading part of a REP MOVS/STOS that lies in host RAM as bulk
+ * copies or fills, within the cycles left. The element loop generated by
+ * dyn_string() continues with the registers as they are left behind.
+ */
+static void dyn_string_bulk(uint32_t op_and_size, PhysPt si_base,
+                            PhysPt di_base, uint32_t value)
+{
+	// Packed into one argument to stay within four register arguments
+	const auto op = op_and_size & 0xff;
+	const uint32_t add_mask = (op_and_size & 0x100) ? 0xffffffff : 0xffff;
+	auto si_index = reg_esi & add_mask;
+	auto di_index = reg_edi & add_mask;
+	auto count = reg_ecx & add_mask;
+
+	// Leave at least one cycle so the element loop still checks for the end
+	// of the time slice
+	if (CPU_Cycles <= 1)
+		return;
+	count = std::min(count, static_cast<uint32_t>(CPU_Cycles - 1));
+
+	const auto size = 1 << (op & 3);
+	const auto add_index = static_cast<int32_t>(cpu.direction * size);
+	uint32_t done = 0;
+	while (done < count) {
+		StringRun run;
+		switch (op) {
+		case R_MOVSB: case R_MOVSW: case R_MOVSD:
+			run = string_movs_run(si_base, si_index, di_base, di_index,
+			                      add_mask, add_index, count - done);
+			break;
+		case R_STOSB:
+			run = string_stos_run<uint8_t>(di_base, di_index, add_mask, add_index,
+			                               count - done, static_cast<uint8_t>(value));
+			break;
+		case R_STOSW:
+			run = string_stos_run<uint16_t>(di_base, di_index, add_mask, add_index,
+			                                count - done, static_cast<uint16_t>(value));
+			break;
+		case R_STOSD:
+			run = string_stos_run<uint32_t>(di_base, di_index, add_mask, add_index,
+			                                count - done, value);
+			break;
+		default:
+			return;
+		}
+		if (!run.bulk)
+			break;
+		si_index = (si_index + run.elements * add_index) & add_mask;
+		di_index = (di_index + run.elements * add_index) & add_mask;
+		done += run.elements;
+	}
+	if (!done)
+		return;
+
+	if (op < R_STOSB)
+		reg_esi = (reg_esi & ~add_mask) | si_index;
+	reg_edi = (reg_edi & ~add_mask) | di_index;
+	reg_ecx = (reg_ecx & ~add_mask) | ((reg_ecx - done) & add_mask);
+	CPU_Cycles -= static_cast<int32_t>(done);
+}
+
 static void dyn_string(STRING_OP op) {
 	DynReg * si_base=decode.segprefix ? decode.segprefix : DREG(DS);
 	DynReg * di_base=DREG(ES);
@@ -29,6 +90,17 @@ static void dyn_string(STRING_OP op) {
 		gen_dop_word_imm(DOP_SUB,true,DREG(CYCLES),decode.cycles);
 		gen_releasereg(DREG(CYCLES));
 		decode.cycles=0;
+
+		/* Let the bulk helper do what it can before the element loop, it
+		   works on the registers in memory */
+		if ((op >= R_MOVSB && op <= R_MOVSD) || (op >= R_STOSB && op <= R_STOSD)) {
+			gen_releasereg(DREG(ESI));
+			gen_releasereg(DREG(EDI));
+			gen_releasereg(DREG(ECX));
+			const uint32_t op_and_size = op | (decode.big_addr ? 0x100 : 0);
+			gen_call_function((void *)&dyn_string_bulk, "%Id%Dd%Dd%Dd",
+			                  op_and_size, si_base, di_base, DREG(EAX));
+		}
 	}
 	/* Check what each string operation will be using */
 	switch (op) {
@@ -46,6 +46,7 @@
 #include "inout.h"
 #include "lazyflags.h"
 #include "mem.h"
+#include "metrics.h"
 #include "paging.h"
 #include "pic.h"
 #include "regs.h"
@@ -59,6 +60,7 @@
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
+#define DYN_TRACE_MAX_SKIP	(128) // max bytes a followed jump may skip
 
 
 //#define DYN_LOG 1 //Turn Logging on.
@@ -156,6 +158,7 @@ static_assert(offsetof(core_dynrec_t, readdata) % sizeof(uint32_t) == 0,
 #define POWERPC		0x06
 #define ARMV8LE		0x07
 #define PPC64LE		0x08
+#define RISCV64		0x09
 
 #if C_TARGETCPU == X86_64
 #include "core_dynrec/risc_x64.h"
@@ -171,6 +174,8 @@ static_assert(offsetof(core_dynrec_t, readdata) % sizeof(uint32_t) == 0,
 #include "core_dynrec/risc_armv8le.h"
 #elif C_TARGETCPU == PPC64LE
 #include "core_dynrec/risc_ppc64le.h"
+#elif C_TARGETCPU == RISCV64
+#include "core_dynrec/risc_riscv64.h"
 #endif
 
 #if !defined(WORDS_BIGENDIAN)
@@ -178,6 +183,10 @@ static_assert(offsetof(core_dynrec_t, readdata) % sizeof(uint32_t) == 0,
 #define gen_mov_LE_word_to_reg gen_mov_word_to_reg
 #endif
 
+// emit common FPU instructions as native double precision code where the
+// backend supports it (DRC_USE_NATIVE_FPU)
+static bool dyn_native_fpu = false;
+
 #include "core_dynrec/decoder.h"
 
 CacheBlock *LinkBlocks(BlockReturn ret)
@@ -193,6 +202,12 @@ CacheBlock *LinkBlocks(BlockReturn ret)
 			cache.block.running->LinkTo(ret==BR_Link2,block);
 		}
 	}
+	if (GCC_UNLIKELY(cache_blockprof.enabled)) {
+		if (block)
+			cache_blockprof.link_hits++;
+		else
+			cache_blockprof.link_misses++;
+	}
 	return block;
 }
 
@@ -210,6 +225,9 @@ CacheBlock *LinkBlocks(BlockReturn ret)
 
 Bits CPU_Core_Dynrec_Run(void) {
 	ZoneScoped
+	if (GCC_UNLIKELY(!cache_initialized))
+		cache_init();
+
 	for (;;) {
 		// Determine the linear address of CS:EIP
 		PhysPt ip_point=SegPhys(cs)+reg_eip;
@@ -218,6 +236,12 @@ Bits CPU_Core_Dynrec_Run(void) {
 			return debugCallback;
 #endif
 
+		// code that isn't hot yet is left to the normal core, as is a
+		// page that keeps modifying itself, before a code page handler
+		// gets installed for it
+		if (GCC_UNLIKELY(cache_hot_is_cold(ip_point))) return CPU_Core_Normal_Run();
+		if (GCC_UNLIKELY(cache_smc_is_demoted(ip_point))) return CPU_Core_Normal_Run();
+
 		CodePageHandler *chandler = 0;
 		// see if the current page is present and contains code
 		if (GCC_UNLIKELY(MakeCodePage(ip_point,chandler))) {
@@ -235,10 +259,17 @@ Bits CPU_Core_Dynrec_Run(void) {
 			// no block found, thus translate the instruction stream
 			// unless the instruction is known to be modified
 			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
-				// translate up to 32 instructions
-				block=CreateCacheBlock(chandler,ip_point,32);
-			} else {
-				// let the normal core handle this instruction to avoid zero-sized blocks
+				// translate the blocks known from an earlier
+				// session, then up to 32 instructions once the
+				// code was reached often enough
+				cache_profile_restore(chandler, ip_point);
+				block = chandler->FindCacheBlock(ip_point & 4095);
+				if (!block && chandler->CountExecution(ip_point & 4095, cache_translate_threshold))
+					block = CreateCacheBlock(chandler, ip_point, 32);
+			}
+			if (!block) {
+				// let the normal core handle this instruction to avoid zero-sized
+				// blocks and the translation of code that is run only a few times
 				Bitu old_cycles=CPU_Cycles;
 				CPU_Cycles=1;
 				Bits nc_retcode=CPU_Core_Normal_Run();
@@ -251,6 +282,9 @@ Bits CPU_Core_Dynrec_Run(void) {
 			}
 		}
 
+		if (GCC_UNLIKELY(cache_blockprof.enabled))
+			cache_blockprof.dispatches++;
+
 run_block:
 		cache.block.running=0;
 		// now we're ready to run the dynamic code block
@@ -355,13 +389,54 @@ Bits CPU_Core_Dynrec_Trap_Run(void) {
 void CPU_Core_Dynrec_Init(void) {
 }
 
-void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
-	// Initialize code cache and dynamic blocks
-	cache_init(enable_cache);
-}
-
 void CPU_Core_Dynrec_Cache_Close(void) {
 	cache_close();
 }
 
+void CPU_Core_Dynrec_SetCacheFile(const std::string &filename)
+{
+	cache_profile_load(filename);
+}
+
+void CPU_Core_Dynrec_SetCacheSize(const int size_mb)
+{
+	cache_set_size(size_mb);
+}
+
+void CPU_Core_Dynrec_SetTranslateThreshold(const int threshold)
+{
+	cache_translate_threshold = check_cast<uint8_t>(threshold);
+}
+
+void CPU_Core_Dynrec_SetSmcThreshold(const int threshold)
+{
+	cache_smc_set_threshold(threshold);
+}
+
+void CPU_Core_Dynrec_SetAdaptive(const bool enabled)
+{
+	cache_hot_set_enabled(enabled);
+}
+
+void CPU_Core_Dynrec_FlushCache()
+{
+	cache_release_pages();
+}
+
+void CPU_Core_Dynrec_SetNativeFPU(const bool enabled)
+{
+	dyn_native_fpu = enabled;
+}
+
+void CPU_Core_Dynrec_SetBlockProfiling(const bool enabled)
+{
+	cache_blockprof.enabled = enabled;
+}
+
+void CPU_Core_Dynrec_ReportBlockProfile(const bool pressed)
+{
+	if (pressed)
+		cache_blockprof_report();
+}
+
 #endif
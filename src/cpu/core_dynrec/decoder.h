@@ -42,6 +42,11 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	decode.active_block=decode.block=cache_openblock();
 	decode.block->page.start=(uint16_t)decode.page.index;
 	codepage->AddCacheBlock(decode.block);
+	if (cache_blockprof.enabled) {
+		const auto phys_addr = check_cast<PhysPt>(
+		        (codepage->GetPhysPage() << 12) + decode.page.index);
+		cache_blockprof_start(decode.block, phys_addr, start);
+	}
 
 	auto cache_addr = static_cast<void *>(
 	        const_cast<uint8_t *>(decode.block->cache.start));
@@ -50,11 +55,15 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	dyn_mem_write(cache_addr, cache_bytes);
 
 	InitFlagsOptimization();
+	dyn_reg_forward_reset();
 
 	// every codeblock that is run sets cache.block.running to itself
 	// so the block linking knows the last executed block
 	gen_mov_direct_ptr(&cache.block.running,(Bitu)decode.block);
 
+	if (cache_blockprof.enabled)
+		gen_add_direct_word(&decode.block->profile.exec_count, 1, true);
+
 	// start with the cycles check
 	gen_mov_word_to_reg(FC_RETOP,&CPU_Cycles,true);
 	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_leqzero(FC_RETOP);
@@ -523,17 +532,26 @@ restart_prefix:
 			dyn_call_near_imm();
 			goto finish_block;
 		// 'jmp near imm16/32'
-		case 0xe9:
-			dyn_exit_link(decode.big_op ? (int32_t)decode_fetchd() : (int16_t)decode_fetchw());
+		case 0xe9: {
+			const Bits eip_change = decode.big_op ? (int32_t)decode_fetchd()
+			                                      : (int16_t)decode_fetchw();
+			if (dyn_follow_jump(eip_change))
+				break;
+			dyn_exit_link(eip_change);
 			goto finish_block;
+		}
 		// 'jmp far'
 		case 0xea:
 			dyn_jmp_far_imm();
 			goto finish_block;
 		// 'jmp short imm8'
-		case 0xeb:
-			dyn_exit_link((int8_t)decode_fetchb());
+		case 0xeb: {
+			const Bits eip_change = (int8_t)decode_fetchb();
+			if (dyn_follow_jump(eip_change))
+				break;
+			dyn_exit_link(eip_change);
 			goto finish_block;
+		}
 
 
 		// repeat prefixes
@@ -163,6 +163,7 @@ static bool MakeCodePage(Bitu lin_addr, CodePageHandler *&cph)
 	}
 	// find a free CodePage
 	if (!cache.free_pages) {
+		cache_stats.page_evictions++;
 		if (cache.used_pages!=decode.page.code) cache.used_pages->ClearRelease();
 		else {
 			// try another page to avoid clearing our source-crosspage
@@ -395,18 +396,64 @@ static void inline dyn_get_modrm(void) {
 #endif
 
 
+// forwarding of guest register values between instructions:
+// the most recent store of a host register into cpu_regs is remembered
+// together with the cache position right after it. If the very next code
+// emitted is a load of the same guest register, the host register still
+// holds the value and the memory round-trip can be replaced by a register
+// move (or nothing at all). Any other emitted code moves cache.pos and
+// thereby invalidates the entry, branch targets reset it explicitly.
+// Only dword stores are forwarded: a word load zero-extends into the host
+// register, while the register of a word store may hold anything in its
+// upper half.
+static struct {
+	const uint8_t* pos;
+	const void* reg;
+	HostReg host_reg;
+} reg_forward;
+
+static void dyn_reg_forward_reset(void) {
+	reg_forward.pos=nullptr;
+}
+
+static void dyn_reg_forward_store(HostReg host_reg,const void* reg,bool dword) {
+	if (!dword) {
+		dyn_reg_forward_reset();
+		return;
+	}
+	reg_forward.pos=cache.pos;
+	reg_forward.reg=reg;
+	reg_forward.host_reg=host_reg;
+}
+
+static bool dyn_reg_forward_load(HostReg host_reg,const void* reg,bool dword) {
+	if (!dword || reg_forward.pos!=cache.pos || reg_forward.reg!=reg) return false;
+	if (host_reg!=reg_forward.host_reg) {
+		gen_mov_regs(host_reg,reg_forward.host_reg);
+		// the source register still holds the value after the move
+		reg_forward.pos=cache.pos;
+	}
+	return true;
+}
+
+#define DYN_REG_LOAD(host_reg, reg_ptr, dword, load) \
+	do { if (!dyn_reg_forward_load(host_reg,reg_ptr,dword)) load; } while (0)
+#define DYN_REG_STORE(host_reg, reg_ptr, dword, store) \
+	do { store; dyn_reg_forward_store(host_reg,reg_ptr,dword); } while (0)
+
+
 #ifdef DRC_USE_REGS_ADDR
 
-#define MOV_REG_VAL_TO_HOST_REG(host_reg, reg_index) gen_mov_regval32_to_reg(host_reg,(Bitu)(DRCD_REG_VAL(reg_index)) - (Bitu)(&cpu_regs))
+#define MOV_REG_VAL_TO_HOST_REG(host_reg, reg_index) DYN_REG_LOAD(host_reg,DRCD_REG_VAL(reg_index),true,gen_mov_regval32_to_reg(host_reg,(Bitu)(DRCD_REG_VAL(reg_index)) - (Bitu)(&cpu_regs)))
 #define ADD_REG_VAL_TO_HOST_REG(host_reg, reg_index) gen_add_regval32_to_reg(host_reg,(Bitu)(DRCD_REG_VAL(reg_index)) - (Bitu)(&cpu_regs))
 
-#define MOV_REG_WORD16_TO_HOST_REG(host_reg, reg_index) gen_mov_regval16_to_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,false)) - (Bitu)(&cpu_regs))
-#define MOV_REG_WORD32_TO_HOST_REG(host_reg, reg_index) gen_mov_regval32_to_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,true)) - (Bitu)(&cpu_regs))
-#define MOV_REG_WORD_TO_HOST_REG(host_reg, reg_index, dword) gen_mov_regword_to_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,dword)) - (Bitu)(&cpu_regs), dword)
+#define MOV_REG_WORD16_TO_HOST_REG(host_reg, reg_index) DYN_REG_LOAD(host_reg,DRCD_REG_WORD(reg_index,false),false,gen_mov_regval16_to_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,false)) - (Bitu)(&cpu_regs)))
+#define MOV_REG_WORD32_TO_HOST_REG(host_reg, reg_index) DYN_REG_LOAD(host_reg,DRCD_REG_WORD(reg_index,true),true,gen_mov_regval32_to_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,true)) - (Bitu)(&cpu_regs)))
+#define MOV_REG_WORD_TO_HOST_REG(host_reg, reg_index, dword) DYN_REG_LOAD(host_reg,DRCD_REG_WORD(reg_index,dword),dword,gen_mov_regword_to_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,dword)) - (Bitu)(&cpu_regs), dword))
 
-#define MOV_REG_WORD16_FROM_HOST_REG(host_reg, reg_index) gen_mov_regval16_from_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,false)) - (Bitu)(&cpu_regs))
-#define MOV_REG_WORD32_FROM_HOST_REG(host_reg, reg_index) gen_mov_regval32_from_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,true)) - (Bitu)(&cpu_regs))
-#define MOV_REG_WORD_FROM_HOST_REG(host_reg, reg_index, dword) gen_mov_regword_from_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,dword)) - (Bitu)(&cpu_regs), dword)
+#define MOV_REG_WORD16_FROM_HOST_REG(host_reg, reg_index) DYN_REG_STORE(host_reg,DRCD_REG_WORD(reg_index,false),false,gen_mov_regval16_from_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,false)) - (Bitu)(&cpu_regs)))
+#define MOV_REG_WORD32_FROM_HOST_REG(host_reg, reg_index) DYN_REG_STORE(host_reg,DRCD_REG_WORD(reg_index,true),true,gen_mov_regval32_from_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,true)) - (Bitu)(&cpu_regs)))
+#define MOV_REG_WORD_FROM_HOST_REG(host_reg, reg_index, dword) DYN_REG_STORE(host_reg,DRCD_REG_WORD(reg_index,dword),dword,gen_mov_regword_from_reg(host_reg,(Bitu)(DRCD_REG_WORD(reg_index,dword)) - (Bitu)(&cpu_regs), dword))
 
 #define MOV_REG_BYTE_TO_HOST_REG_LOW(host_reg, reg_index, high_byte) gen_mov_regbyte_to_reg_low(host_reg,(Bitu)(DRCD_REG_BYTE(reg_index,high_byte)) - (Bitu)(&cpu_regs))
 #define MOV_REG_BYTE_TO_HOST_REG_LOW_CANUSEWORD(host_reg, reg_index, high_byte) gen_mov_regbyte_to_reg_low_canuseword(host_reg,(Bitu)(DRCD_REG_BYTE(reg_index,high_byte)) - (Bitu)(&cpu_regs))
@@ -414,16 +461,16 @@ static void inline dyn_get_modrm(void) {
 
 #else
 
-#define MOV_REG_VAL_TO_HOST_REG(host_reg, reg_index) gen_mov_word_to_reg(host_reg,DRCD_REG_VAL(reg_index),true)
+#define MOV_REG_VAL_TO_HOST_REG(host_reg, reg_index) DYN_REG_LOAD(host_reg,DRCD_REG_VAL(reg_index),true,gen_mov_word_to_reg(host_reg,DRCD_REG_VAL(reg_index),true))
 #define ADD_REG_VAL_TO_HOST_REG(host_reg, reg_index) gen_add(host_reg,DRCD_REG_VAL(reg_index))
 
-#define MOV_REG_WORD16_TO_HOST_REG(host_reg, reg_index) gen_mov_word_to_reg(host_reg,DRCD_REG_WORD(reg_index,false),false)
-#define MOV_REG_WORD32_TO_HOST_REG(host_reg, reg_index) gen_mov_word_to_reg(host_reg,DRCD_REG_WORD(reg_index,true),true)
-#define MOV_REG_WORD_TO_HOST_REG(host_reg, reg_index, dword) gen_mov_word_to_reg(host_reg,DRCD_REG_WORD(reg_index,dword),dword)
+#define MOV_REG_WORD16_TO_HOST_REG(host_reg, reg_index) DYN_REG_LOAD(host_reg,DRCD_REG_WORD(reg_index,false),false,gen_mov_word_to_reg(host_reg,DRCD_REG_WORD(reg_index,false),false))
+#define MOV_REG_WORD32_TO_HOST_REG(host_reg, reg_index) DYN_REG_LOAD(host_reg,DRCD_REG_WORD(reg_index,true),true,gen_mov_word_to_reg(host_reg,DRCD_REG_WORD(reg_index,true),true))
+#define MOV_REG_WORD_TO_HOST_REG(host_reg, reg_index, dword) DYN_REG_LOAD(host_reg,DRCD_REG_WORD(reg_index,dword),dword,gen_mov_word_to_reg(host_reg,DRCD_REG_WORD(reg_index,dword),dword))
 
-#define MOV_REG_WORD16_FROM_HOST_REG(host_reg, reg_index) gen_mov_word_from_reg(host_reg,DRCD_REG_WORD(reg_index,false),false)
-#define MOV_REG_WORD32_FROM_HOST_REG(host_reg, reg_index) gen_mov_word_from_reg(host_reg,DRCD_REG_WORD(reg_index,true),true)
-#define MOV_REG_WORD_FROM_HOST_REG(host_reg, reg_index, dword) gen_mov_word_from_reg(host_reg,DRCD_REG_WORD(reg_index,dword),dword)
+#define MOV_REG_WORD16_FROM_HOST_REG(host_reg, reg_index) DYN_REG_STORE(host_reg,DRCD_REG_WORD(reg_index,false),false,gen_mov_word_from_reg(host_reg,DRCD_REG_WORD(reg_index,false),false))
+#define MOV_REG_WORD32_FROM_HOST_REG(host_reg, reg_index) DYN_REG_STORE(host_reg,DRCD_REG_WORD(reg_index,true),true,gen_mov_word_from_reg(host_reg,DRCD_REG_WORD(reg_index,true),true))
+#define MOV_REG_WORD_FROM_HOST_REG(host_reg, reg_index, dword) DYN_REG_STORE(host_reg,DRCD_REG_WORD(reg_index,dword),dword,gen_mov_word_from_reg(host_reg,DRCD_REG_WORD(reg_index,dword),dword))
 
 #define MOV_REG_BYTE_TO_HOST_REG_LOW(host_reg, reg_index, high_byte) gen_mov_byte_to_reg_low(host_reg,DRCD_REG_BYTE(reg_index,high_byte))
 #define MOV_REG_BYTE_TO_HOST_REG_LOW_CANUSEWORD(host_reg, reg_index, high_byte) gen_mov_byte_to_reg_low_canuseword(host_reg,DRCD_REG_BYTE(reg_index,high_byte))
@@ -638,6 +685,7 @@ static void dyn_run_code(void) {
 static void dyn_fill_blocks(void) {
 	for (Bitu sct=0; sct<used_save_info_dynrec; sct++) {
 		gen_fill_branch_long(save_info_dynrec[sct].branch_pos);
+		dyn_reg_forward_reset();
 		switch (save_info_dynrec[sct].type) {
 			case db_exception:
 				// code for exception handling, load cycles and call DynRunException
@@ -755,36 +803,82 @@ bool DRC_CALL_CONV mem_writed_checked_drc(PhysPt address,uint32_t val) {
 
 // functions that enable access to the memory
 
+#ifdef DRC_USE_INLINE_TLB
+// emit the inline access through the TLB for plain memory pages, the code
+// following this (up to dyn_inline_tlb_done) is the helper function path
+// taken for handler-backed pages and accesses that cross a page boundary
+static const uint8_t* dyn_inline_tlb_access(bool write,HostReg reg,Bitu size) {
+	const uint8_t* crossing;
+	const uint8_t* unmapped=gen_tlb_lookup(write,size,&crossing);
+	if (write) gen_tlb_write_host(reg,size);
+	else gen_tlb_read_host(reg,size);
+	const uint8_t* done=gen_create_jump();
+	if (crossing) gen_fill_branch(crossing);
+	gen_fill_branch(unmapped);
+	dyn_reg_forward_reset();
+	return done;
+}
+
+static void dyn_inline_tlb_done(const uint8_t* done) {
+	gen_fill_branch(done);
+	dyn_reg_forward_reset();
+}
+#endif
+
 // read a byte from a given address and store it in reg_dst
 static void dyn_read_byte(HostReg reg_addr,HostReg reg_dst) {
 	gen_mov_regs(FC_OP1,reg_addr);
+#ifdef DRC_USE_INLINE_TLB
+	const uint8_t* done=dyn_inline_tlb_access(false,reg_dst,1);
+#endif
 	gen_call_function_raw((void *)&mem_readb_checked_drc);
 	dyn_check_exception(FC_RETOP);
 	gen_mov_byte_to_reg_low(reg_dst,&core_dynrec.readdata);
+#ifdef DRC_USE_INLINE_TLB
+	dyn_inline_tlb_done(done);
+#endif
 }
 static void dyn_read_byte_canuseword(HostReg reg_addr,HostReg reg_dst) {
 	gen_mov_regs(FC_OP1,reg_addr);
+#ifdef DRC_USE_INLINE_TLB
+	const uint8_t* done=dyn_inline_tlb_access(false,reg_dst,1);
+#endif
 	gen_call_function_raw((void *)&mem_readb_checked_drc);
 	dyn_check_exception(FC_RETOP);
 	gen_mov_byte_to_reg_low_canuseword(reg_dst,&core_dynrec.readdata);
+#ifdef DRC_USE_INLINE_TLB
+	dyn_inline_tlb_done(done);
+#endif
 }
 
 // write a byte from reg_val into the memory given by the address
 static void dyn_write_byte(HostReg reg_addr,HostReg reg_val) {
 	gen_mov_regs(FC_OP2,reg_val);
 	gen_mov_regs(FC_OP1,reg_addr);
+#ifdef DRC_USE_INLINE_TLB
+	const uint8_t* done=dyn_inline_tlb_access(true,FC_OP2,1);
+#endif
 	gen_call_function_raw((void *)&mem_writeb_checked_drc);
 	dyn_check_exception(FC_RETOP);
+#ifdef DRC_USE_INLINE_TLB
+	dyn_inline_tlb_done(done);
+#endif
 }
 
 // read a 32bit (dword=true) or 16bit (dword=false) value
 // from a given address and store it in reg_dst
 static void dyn_read_word(HostReg reg_addr,HostReg reg_dst,bool dword) {
 	gen_mov_regs(FC_OP1,reg_addr);
+#ifdef DRC_USE_INLINE_TLB
+	const uint8_t* done=dyn_inline_tlb_access(false,reg_dst,dword?4:2);
+#endif
 	if (dword) gen_call_function_raw((void *)&mem_readd_checked_drc);
 	else gen_call_function_raw((void *)&mem_readw_checked_drc);
 	dyn_check_exception(FC_RETOP);
 	gen_mov_word_to_reg(reg_dst,&core_dynrec.readdata,dword);
+#ifdef DRC_USE_INLINE_TLB
+	dyn_inline_tlb_done(done);
+#endif
 }
 
 // write a 32bit (dword=true) or 16bit (dword=false) value
@@ -793,9 +887,15 @@ static void dyn_write_word(HostReg reg_addr,HostReg reg_val,bool dword) {
 //	if (!dword) gen_extend_word(false,reg_val);
 	gen_mov_regs(FC_OP2,reg_val);
 	gen_mov_regs(FC_OP1,reg_addr);
+#ifdef DRC_USE_INLINE_TLB
+	const uint8_t* done=dyn_inline_tlb_access(true,FC_OP2,dword?4:2);
+#endif
 	if (dword) gen_call_function_raw((void *)&mem_writed_checked_drc);
 	else gen_call_function_raw((void *)&mem_writew_checked_drc);
 	dyn_check_exception(FC_RETOP);
+#ifdef DRC_USE_INLINE_TLB
+	dyn_inline_tlb_done(done);
+#endif
 }
 
 // effective address calculation helper, op2 has to be present!
@@ -1223,6 +1323,8 @@ static void InvalidateFlags(void* current_simple_function,Bitu flags_type) {
 // this function can be replaced by a simpler one as well
 static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
+	// a full queue only costs the optimization, the call stays as emitted
+	if (mf_functions_num>=std::size(mf_functions)) return;
 	mf_functions[mf_functions_num].pos=cache.pos;
 	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
 	mf_functions[mf_functions_num].ftype=flags_type;
@@ -1235,6 +1337,7 @@ static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_ty
 // this function can be replaced by a simpler one as well
 static void InvalidateFlagsPartially(void* current_simple_function,const uint8_t* cpos,Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
+	if (mf_functions_num>=std::size(mf_functions)) return;
 	mf_functions[mf_functions_num].pos=cpos;
 	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
 	mf_functions[mf_functions_num].ftype=flags_type;
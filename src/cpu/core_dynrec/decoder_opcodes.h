@@ -463,6 +463,7 @@ static void dyn_pop_ev(void) {
 		MOV_REG_WORD32_FROM_HOST_REG(FC_OP2,DRC_REG_ESP);
 		dyn_check_exception(FC_RETOP);
 		gen_fill_branch(no_fault);
+		dyn_reg_forward_reset();
 	} else {
 		if (decode.big_op) gen_call_function_raw((void*)&dynrec_pop_dword);
 		else gen_call_function_raw((void*)&dynrec_pop_word);
@@ -634,13 +635,13 @@ static void dyn_grp2_eb(grp2_types type) {
 	switch (type) {
 	case grp2_1:
 		gen_mov_byte_to_reg_low_imm_canuseword(FC_OP2,1);
-		dyn_shift_byte_gencall((ShiftOps)decode.modrm.reg);
+		dyn_shift_byte_gencall((ShiftOps)decode.modrm.reg,true);
 		break;
 	case grp2_imm: {
 		uint8_t imm=decode_fetchb();
 		if (imm) {
 			gen_mov_byte_to_reg_low_imm_canuseword(FC_OP2,imm&0x1f);
-			dyn_shift_byte_gencall((ShiftOps)decode.modrm.reg);
+			dyn_shift_byte_gencall((ShiftOps)decode.modrm.reg,(imm&0x1f)!=0);
 		} else return;
 		}
 		break;
@@ -670,7 +671,7 @@ static void dyn_grp2_ev(grp2_types type) {
 	switch (type) {
 	case grp2_1:
 		gen_mov_byte_to_reg_low_imm_canuseword(FC_OP2,1);
-		dyn_shift_word_gencall((ShiftOps)decode.modrm.reg,decode.big_op);
+		dyn_shift_word_gencall((ShiftOps)decode.modrm.reg,decode.big_op,true);
 		break;
 	case grp2_imm: {
 		Bitu val;
@@ -683,7 +684,7 @@ static void dyn_grp2_ev(grp2_types type) {
 		uint8_t imm=(uint8_t)val;
 		if (imm) {
 			gen_mov_byte_to_reg_low_imm_canuseword(FC_OP2,imm&0x1f);
-			dyn_shift_word_gencall((ShiftOps)decode.modrm.reg,decode.big_op);
+			dyn_shift_word_gencall((ShiftOps)decode.modrm.reg,decode.big_op,(imm&0x1f)!=0);
 		} else return;
 		}
 		break;
@@ -1096,6 +1097,31 @@ static void dyn_sahf(void) {
 }
 
 
+// Continue translating at the target of a short forward jump that stays
+// within the current page instead of ending the block, so code that hops
+// over a few bytes ends up in one block. The skipped bytes are added to the
+// write map, so modifying them invalidates the block just like its code.
+static bool dyn_follow_jump(Bits eip_change) {
+	if (eip_change <= 0 || eip_change > DYN_TRACE_MAX_SKIP)
+		return false;
+	const auto target_index = decode.page.index + static_cast<Bitu>(eip_change);
+	if (target_index >= 4096)
+		return false;
+	if (!decode.big_op) {
+		// A 16-bit jump truncates the target to 16 bits, which only lands
+		// where the displacement points if neither the current eip nor the
+		// target lie above 0xffff
+		const Bitu next_eip = decode.code - SegPhys(cs);
+		if (next_eip + static_cast<Bitu>(eip_change) > 0xffff)
+			return false;
+	}
+	for (auto i = decode.page.index; i < target_index; i++)
+		decode.page.wmap[i] += 0x01;
+	decode.page.index = target_index;
+	decode.code += static_cast<PhysPt>(eip_change);
+	return true;
+}
+
 static void dyn_exit_link(Bits eip_change) {
 	gen_add_direct_word(&reg_eip,(decode.code-decode.code_start)+eip_change,decode.big_op);
 	dyn_reduce_cycles();
@@ -1115,6 +1141,7 @@ static void dyn_branched_exit(BranchTypes btype,int32_t eip_add) {
 	gen_add_direct_word(&reg_eip,eip_base,decode.big_op);
 	gen_jmp_ptr(&decode.block->link[0].to, offsetof(CacheBlock, cache.start));
 	gen_fill_branch(data);
+	dyn_reg_forward_reset();
 
  	// Branch taken
 	gen_add_direct_word(&reg_eip,eip_base+eip_add,decode.big_op);
@@ -1173,12 +1200,14 @@ static void dyn_loop(LoopTypes type) {
 	gen_jmp_ptr(&decode.block->link[0].to, offsetof(CacheBlock, cache.start));
 	if (branch1) {
 		gen_fill_branch(branch1);
+		dyn_reg_forward_reset();
 		MOV_REG_WORD_TO_HOST_REG(FC_OP1,DRC_REG_ECX,decode.big_addr);
 		gen_add_imm(FC_OP1,(uint32_t)(-1));
 		MOV_REG_WORD_FROM_HOST_REG(FC_OP1,DRC_REG_ECX,decode.big_addr);
 	}
 	// Branch taken
 	gen_fill_branch(branch2);
+	dyn_reg_forward_reset();
 	gen_add_direct_word(&reg_eip,eip_base,decode.big_op);
 	gen_jmp_ptr(&decode.block->link[1].to, offsetof(CacheBlock, cache.start));
 	dyn_closeblock();
@@ -66,15 +66,140 @@ static inline void dyn_fpu_top_swapped() {
 	gen_mov_word_to_reg(FC_OP2,(void*)(&TOP),true);
 }
 
+#if defined(DRC_USE_NATIVE_FPU) && !C_FPU_X86
+#define DYN_NATIVE_FPU 1
+#endif
+
+#if DYN_NATIVE_FPU
+static FpuNativeOp dyn_fpu_native_op(void (*func)(Bitu, Bitu)) {
+	if (func == &FPU_FADD) return FpuNativeOp::Add;
+	if (func == &FPU_FSUB) return FpuNativeOp::Sub;
+	if (func == &FPU_FSUBR) return FpuNativeOp::SubR;
+	if (func == &FPU_FMUL) return FpuNativeOp::Mul;
+	if (func == &FPU_FDIV) return FpuNativeOp::Div;
+	assert(func == &FPU_FDIVR);
+	return FpuNativeOp::DivR;
+}
+
+// read the 32bit (f64=false) or 64bit real at FC_ADDR into the scratch
+// register 8, like the FPU_FLD_F*_EA functions do
+static void dyn_fpu_native_read_ea(bool f64) {
+	if (f64) {
+		dyn_read_word(FC_ADDR,FC_OP1,true);
+		gen_mov_word_from_reg(FC_OP1,(void*)(&fpu.regs[8].l.lower),true);
+		gen_add_imm(FC_ADDR,4);
+		dyn_read_word(FC_ADDR,FC_OP1,true);
+		gen_mov_word_from_reg(FC_OP1,(void*)(&fpu.regs[8].l.upper),true);
+	} else {
+		dyn_read_word(FC_ADDR,FC_OP1,true);
+		gen_fpu_float_to_d1(FC_OP1);
+		gen_fpu_base(FC_OP3,(void*)(&fpu.regs[0]));
+		gen_mov_dword_to_reg_imm(FC_OP2,8);
+		gen_fpu_store_d1(FC_OP3,FC_OP2);
+	}
+}
+
+// FLD of a 32bit (f64=false) or 64bit real at FC_ADDR
+static void dyn_fpu_native_fld(bool f64) {
+	// read first so a page fault leaves the stack untouched
+	dyn_fpu_native_read_ea(f64);
+	gen_call_function_raw((void*)&FPU_PREP_PUSH);
+	gen_fpu_base(FC_OP3,(void*)(&fpu.regs[0]));
+	gen_mov_dword_to_reg_imm(FC_OP2,8);
+	gen_fpu_load_d1(FC_OP3,FC_OP2);
+	gen_mov_word_to_reg(FC_OP1,(void*)(&TOP),true);
+	gen_fpu_store_d1(FC_OP3,FC_OP1);
+}
+
+// FST of ST(0) to the 32bit (f64=false) or 64bit real at FC_ADDR
+static void dyn_fpu_native_fst(bool f64) {
+	gen_fpu_base(FC_OP3,(void*)(&fpu.regs[0]));
+	gen_mov_word_to_reg(FC_OP1,(void*)(&TOP),true);
+	if (f64) {
+		gen_fpu_load_d1(FC_OP3,FC_OP1);
+		gen_mov_dword_to_reg_imm(FC_OP2,8);
+		gen_fpu_store_d1(FC_OP3,FC_OP2);
+		gen_mov_word_to_reg(FC_OP2,(void*)(&fpu.regs[8].l.lower),true);
+		dyn_write_word(FC_ADDR,FC_OP2,true);
+		gen_add_imm(FC_ADDR,4);
+		gen_mov_word_to_reg(FC_OP2,(void*)(&fpu.regs[8].l.upper),true);
+		dyn_write_word(FC_ADDR,FC_OP2,true);
+	} else {
+		gen_fpu_reg_to_float(FC_OP2,FC_OP3,FC_OP1);
+		dyn_write_word(FC_ADDR,FC_OP2,true);
+	}
+}
+#endif
+
+// regs[FC_OP1] op= regs[FC_OP2] through one of the arithmetic FPU functions,
+// or as native code if enabled
+static void dyn_fpu_arith(void (*func)(Bitu, Bitu)) {
+#if DYN_NATIVE_FPU
+	if (dyn_native_fpu && !fpu.accurate) {
+		gen_fpu_base(FC_OP3,(void*)(&fpu.regs[0]));
+		gen_fpu_load_d1(FC_OP3,FC_OP2);
+		gen_fpu_arith_d1(dyn_fpu_native_op(func),FC_OP3,FC_OP1);
+		return;
+	}
+#endif
+	gen_call_function_RR((void*)func,FC_OP1,FC_OP2);
+}
+
+// load the memory operand at FC_ADDR into the scratch register 8
+static void dyn_fpu_read_ea(bool f64) {
+#if DYN_NATIVE_FPU
+	if (dyn_native_fpu && !fpu.accurate) {
+		dyn_fpu_native_read_ea(f64);
+		return;
+	}
+#endif
+	if (f64) gen_call_function_R((void*)&FPU_FLD_F64_EA,FC_ADDR);
+	else gen_call_function_R((void*)&FPU_FLD_F32_EA,FC_ADDR);
+}
+
+// FLD of the 32bit (f64=false) or 64bit real at the effective address
+static void dyn_fpu_fld(bool f64) {
+#if DYN_NATIVE_FPU
+	if (dyn_native_fpu && !fpu.accurate) {
+		dyn_fill_ea(FC_ADDR);
+		dyn_fpu_native_fld(f64);
+		return;
+	}
+#endif
+	gen_call_function_raw((void*)&FPU_PREP_PUSH);
+	dyn_fill_ea(FC_OP1);
+	gen_mov_word_to_reg(FC_OP2,(void*)(&TOP),true);
+	if (f64) gen_call_function_RR((void*)&FPU_FLD_F64,FC_OP1,FC_OP2);
+	else gen_call_function_RR((void*)&FPU_FLD_F32,FC_OP1,FC_OP2);
+}
+
+// FST of ST(0) to the 32bit (f64=false) or 64bit real at FC_ADDR
+static void dyn_fpu_fst(bool f64) {
+#if DYN_NATIVE_FPU
+	if (dyn_native_fpu && !fpu.accurate) {
+		dyn_fpu_native_fst(f64);
+		return;
+	}
+#endif
+	if (f64) gen_call_function_R((void*)&FPU_FST_F64,FC_ADDR);
+	else gen_call_function_R((void*)&FPU_FST_F32,FC_ADDR);
+}
+
+// regs[FC_OP1] op= regs[8], see dyn_fpu_read_ea()
+static void dyn_fpu_arith_ea(void (*func)(Bitu, Bitu)) {
+	gen_mov_dword_to_reg_imm(FC_OP2,8);
+	dyn_fpu_arith(func);
+}
+
 static void dyn_eatree() {
 //	Bitu group = (decode.modrm.val >> 3) & 7;
 	Bitu group = decode.modrm.reg&7; //It is already that, but compilers.
 	switch (group){
 	case 0x00:		// FADD ST,STi
-		gen_call_function_R((void*)&FPU_FADD_EA,FC_OP1);
+		dyn_fpu_arith_ea(&FPU_FADD);
 		break;
 	case 0x01:		// FMUL  ST,STi
-		gen_call_function_R((void*)&FPU_FMUL_EA,FC_OP1);
+		dyn_fpu_arith_ea(&FPU_FMUL);
 		break;
 	case 0x02:		// FCOM  STi
 		gen_call_function_R((void*)&FPU_FCOM_EA,FC_OP1);
@@ -84,16 +209,16 @@ static void dyn_eatree() {
 		gen_call_function_raw((void*)&FPU_FPOP);
 		break;
 	case 0x04:		// FSUB  ST,STi
-		gen_call_function_R((void*)&FPU_FSUB_EA,FC_OP1);
+		dyn_fpu_arith_ea(&FPU_FSUB);
 		break;	
 	case 0x05:		// FSUBR ST,STi
-		gen_call_function_R((void*)&FPU_FSUBR_EA,FC_OP1);
+		dyn_fpu_arith_ea(&FPU_FSUBR);
 		break;
 	case 0x06:		// FDIV  ST,STi
-		gen_call_function_R((void*)&FPU_FDIV_EA,FC_OP1);
+		dyn_fpu_arith_ea(&FPU_FDIV);
 		break;
 	case 0x07:		// FDIVR ST,STi
-		gen_call_function_R((void*)&FPU_FDIVR_EA,FC_OP1);
+		dyn_fpu_arith_ea(&FPU_FDIVR);
 		break;
 	default:
 		break;
@@ -107,10 +232,10 @@ static void dyn_fpu_esc0(){
 		dyn_fpu_top();
 		switch (decode.modrm.reg){
 		case 0x00:		//FADD ST,STi
-			gen_call_function_RR((void*)&FPU_FADD,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FADD);
 			break;
 		case 0x01:		// FMUL  ST,STi
-			gen_call_function_RR((void*)&FPU_FMUL,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FMUL);
 			break;
 		case 0x02:		// FCOM  STi
 			gen_call_function_RR((void*)&FPU_FCOM,FC_OP1,FC_OP2);
@@ -120,23 +245,23 @@ static void dyn_fpu_esc0(){
 			gen_call_function_raw((void*)&FPU_FPOP);
 			break;
 		case 0x04:		// FSUB  ST,STi
-			gen_call_function_RR((void*)&FPU_FSUB,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FSUB);
 			break;	
 		case 0x05:		// FSUBR ST,STi
-			gen_call_function_RR((void*)&FPU_FSUBR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FSUBR);
 			break;
 		case 0x06:		// FDIV  ST,STi
-			gen_call_function_RR((void*)&FPU_FDIV,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FDIV);
 			break;
 		case 0x07:		// FDIVR ST,STi
-			gen_call_function_RR((void*)&FPU_FDIVR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FDIVR);
 			break;
 		default:
 			break;
 		}
 	} else { 
 		dyn_fill_ea(FC_ADDR);
-		gen_call_function_R((void*)&FPU_FLD_F32_EA,FC_ADDR); 
+		dyn_fpu_read_ea(false);
 		gen_mov_word_to_reg(FC_OP1,(void*)(&TOP),true);
 		dyn_eatree();
 	}
@@ -291,21 +416,18 @@ static void dyn_fpu_esc1(){
 	} else {
 		switch(decode.modrm.reg){
 		case 0x00: /* FLD float*/
-			gen_call_function_raw((void*)&FPU_PREP_PUSH);
-			dyn_fill_ea(FC_OP1);
-			gen_mov_word_to_reg(FC_OP2,(void*)(&TOP),true);
-			gen_call_function_RR((void*)&FPU_FLD_F32,FC_OP1,FC_OP2);
+			dyn_fpu_fld(false);
 			break;
 		case 0x01: /* UNKNOWN */
 			LOG(LOG_FPU,LOG_WARN)("ESC EA 1:Unhandled group %X subfunction %X",static_cast<uint32_t>(decode.modrm.reg),static_cast<uint32_t>(decode.modrm.rm));
 			break;
 		case 0x02: /* FST float*/
 			dyn_fill_ea(FC_ADDR);
-			gen_call_function_R((void*)&FPU_FST_F32,FC_ADDR);
+			dyn_fpu_fst(false);
 			break;
 		case 0x03: /* FSTP float*/
 			dyn_fill_ea(FC_ADDR);
-			gen_call_function_R((void*)&FPU_FST_F32,FC_ADDR);
+			dyn_fpu_fst(false);
 			gen_call_function_raw((void*)&FPU_FPOP);
 			break;
 		case 0x04: /* FLDENV */
@@ -439,11 +561,11 @@ static void dyn_fpu_esc4(){
 		switch(decode.modrm.reg){
 		case 0x00:	/* FADD STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FADD,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FADD);
 			break;
 		case 0x01:	/* FMUL STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FMUL,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FMUL);
 			break;
 		case 0x02:  /* FCOM*/
 			dyn_fpu_top();
@@ -456,26 +578,26 @@ static void dyn_fpu_esc4(){
 			break;
 		case 0x04:  /* FSUBR STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FSUBR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FSUBR);
 			break;
 		case 0x05:  /* FSUB  STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FSUB,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FSUB);
 			break;
 		case 0x06:  /* FDIVR STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FDIVR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FDIVR);
 			break;
 		case 0x07:  /* FDIV STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FDIV,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FDIV);
 			break;
 		default:
 			break;
 		}
 	} else { 
 		dyn_fill_ea(FC_ADDR);
-		gen_call_function_R((void*)&FPU_FLD_F64_EA,FC_ADDR); 
+		dyn_fpu_read_ea(true);
 		gen_mov_word_to_reg(FC_OP1,(void*)(&TOP),true);
 		dyn_eatree();
 	}
@@ -514,21 +636,18 @@ static void dyn_fpu_esc5(){
 	} else {
 		switch(decode.modrm.reg){
 		case 0x00:  /* FLD double real*/
-			gen_call_function_raw((void*)&FPU_PREP_PUSH);
-			dyn_fill_ea(FC_OP1); 
-			gen_mov_word_to_reg(FC_OP2,(void*)(&TOP),true);
-			gen_call_function_RR((void*)&FPU_FLD_F64,FC_OP1,FC_OP2);
+			dyn_fpu_fld(true);
 			break;
 		case 0x01:  /* FISTTP longint*/
 			LOG(LOG_FPU,LOG_WARN)("ESC 5 EA:Unhandled group %X subfunction %X",static_cast<uint32_t>(decode.modrm.reg),static_cast<uint32_t>(decode.modrm.rm));
 			break;
 		case 0x02:   /* FST double real*/
 			dyn_fill_ea(FC_ADDR); 
-			gen_call_function_R((void*)&FPU_FST_F64,FC_ADDR);
+			dyn_fpu_fst(true);
 			break;
 		case 0x03:	/* FSTP double real*/
 			dyn_fill_ea(FC_ADDR); 
-			gen_call_function_R((void*)&FPU_FST_F64,FC_ADDR);
+			dyn_fpu_fst(true);
 			gen_call_function_raw((void*)&FPU_FPOP);
 			break;
 		case 0x04:	/* FRSTOR */
@@ -559,11 +678,11 @@ static void dyn_fpu_esc6(){
 		switch(decode.modrm.reg){
 		case 0x00:	/*FADDP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FADD,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FADD);
 			break;
 		case 0x01:	/* FMULP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FMUL,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FMUL);
 			break;
 		case 0x02:  /* FCOMP5*/
 			dyn_fpu_top();
@@ -583,19 +702,19 @@ static void dyn_fpu_esc6(){
 			break;
 		case 0x04:  /* FSUBRP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FSUBR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FSUBR);
 			break;
 		case 0x05:  /* FSUBP  STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FSUB,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FSUB);
 			break;
 		case 0x06:	/* FDIVRP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FDIVR,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FDIVR);
 			break;
 		case 0x07:  /* FDIVP STi,ST*/
 			dyn_fpu_top_swapped();
-			gen_call_function_RR((void*)&FPU_FDIV,FC_OP1,FC_OP2);
+			dyn_fpu_arith(&FPU_FDIV);
 			break;
 		default:
 			break;
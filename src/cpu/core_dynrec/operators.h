@@ -1112,7 +1112,14 @@ static uint32_t DRC_CALL_CONV dynrec_sar_dword_simple(uint32_t op1,uint8_t op2)
 	else return op1 >> op2;
 }
 
-static void dyn_shift_byte_gencall(ShiftOps op) {
+// a shift by a count known to be nonzero at translation time replaces all
+// condition flags, so earlier flag producers can be simplified right away
+static void dyn_shift_invalidate_flags(void* simple_function,Bitu flags_type,bool count_nonzero) {
+	if (count_nonzero) InvalidateFlags(simple_function,flags_type);
+	else InvalidateFlagsPartially(simple_function,flags_type);
+}
+
+static void dyn_shift_byte_gencall(ShiftOps op,bool count_nonzero=false) {
 	switch (op) {
 		case SHIFT_ROL:
 			InvalidateFlagsPartially((void*)&dynrec_rol_byte_simple,t_ROLb);
@@ -1132,22 +1139,22 @@ static void dyn_shift_byte_gencall(ShiftOps op) {
 			break;
 		case SHIFT_SHL:
 		case SHIFT_SAL:
-			InvalidateFlagsPartially((void*)&dynrec_shl_byte_simple,t_SHLb);
+			dyn_shift_invalidate_flags((void*)&dynrec_shl_byte_simple,t_SHLb,count_nonzero);
 			gen_call_function_raw((void*)&dynrec_shl_byte);
 			break;
 		case SHIFT_SHR:
-			InvalidateFlagsPartially((void*)&dynrec_shr_byte_simple,t_SHRb);
+			dyn_shift_invalidate_flags((void*)&dynrec_shr_byte_simple,t_SHRb,count_nonzero);
 			gen_call_function_raw((void*)&dynrec_shr_byte);
 			break;
 		case SHIFT_SAR:
-			InvalidateFlagsPartially((void*)&dynrec_sar_byte_simple,t_SARb);
+			dyn_shift_invalidate_flags((void*)&dynrec_sar_byte_simple,t_SARb,count_nonzero);
 			gen_call_function_raw((void*)&dynrec_sar_byte);
 			break;
 		default: IllegalOptionDynrec("dyn_shift_byte_gencall");
 	}
 }
 
-static void dyn_shift_word_gencall(ShiftOps op,bool dword) {
+static void dyn_shift_word_gencall(ShiftOps op,bool dword,bool count_nonzero=false) {
 	if (dword) {
 		switch (op) {
 			case SHIFT_ROL:
@@ -1168,15 +1175,15 @@ static void dyn_shift_word_gencall(ShiftOps op,bool dword) {
 				break;
 			case SHIFT_SHL:
 			case SHIFT_SAL:
-				InvalidateFlagsPartially((void*)&dynrec_shl_dword_simple,t_SHLd);
+				dyn_shift_invalidate_flags((void*)&dynrec_shl_dword_simple,t_SHLd,count_nonzero);
 				gen_call_function_raw((void*)&dynrec_shl_dword);
 				break;
 			case SHIFT_SHR:
-				InvalidateFlagsPartially((void*)&dynrec_shr_dword_simple,t_SHRd);
+				dyn_shift_invalidate_flags((void*)&dynrec_shr_dword_simple,t_SHRd,count_nonzero);
 				gen_call_function_raw((void*)&dynrec_shr_dword);
 				break;
 			case SHIFT_SAR:
-				InvalidateFlagsPartially((void*)&dynrec_sar_dword_simple,t_SARd);
+				dyn_shift_invalidate_flags((void*)&dynrec_sar_dword_simple,t_SARd,count_nonzero);
 				gen_call_function_raw((void*)&dynrec_sar_dword);
 				break;
 			default: IllegalOptionDynrec("dyn_shift_dword_gencall");
@@ -1201,15 +1208,15 @@ static void dyn_shift_word_gencall(ShiftOps op,bool dword) {
 				break;
 			case SHIFT_SHL:
 			case SHIFT_SAL:
-				InvalidateFlagsPartially((void*)&dynrec_shl_word_simple,t_SHLw);
+				dyn_shift_invalidate_flags((void*)&dynrec_shl_word_simple,t_SHLw,count_nonzero);
 				gen_call_function_raw((void*)&dynrec_shl_word);
 				break;
 			case SHIFT_SHR:
-				InvalidateFlagsPartially((void*)&dynrec_shr_word_simple,t_SHRw);
+				dyn_shift_invalidate_flags((void*)&dynrec_shr_word_simple,t_SHRw,count_nonzero);
 				gen_call_function_raw((void*)&dynrec_shr_word);
 				break;
 			case SHIFT_SAR:
-				InvalidateFlagsPartially((void*)&dynrec_sar_word_simple,t_SARw);
+				dyn_shift_invalidate_flags((void*)&dynrec_sar_word_simple,t_SARw,count_nonzero);
 				gen_call_function_raw((void*)&dynrec_sar_word);
 				break;
 			default: IllegalOptionDynrec("dyn_shift_word_gencall");
@@ -1651,11 +1658,8 @@ static uint16_t DRC_CALL_CONV dynrec_movsb_word(uint16_t count,int16_t add_index
 		count=(uint16_t)CPU_Cycles;
 		CPU_Cycles=0;
 	}
-	for (;count>0;count--) {
-		mem_writeb(di_base+reg_di,mem_readb(si_base+reg_si));
-		reg_si+=add_index;
-		reg_di+=add_index;
-	}
+	string_rep_movs(si_base, reg_si, di_base, reg_di, 0xffff, add_index, count,
+	                [](const PhysPt src, const PhysPt dst) { mem_writeb(dst, mem_readb(src)); });
 	return count_left;
 }
 
@@ -1669,11 +1673,8 @@ static uint32_t DRC_CALL_CONV dynrec_movsb_dword(uint32_t count,int32_t add_inde
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
-	for (;count>0;count--) {
-		mem_writeb(di_base+reg_edi,mem_readb(si_base+reg_esi));
-		reg_esi+=add_index;
-		reg_edi+=add_index;
-	}
+	string_rep_movs(si_base, reg_esi, di_base, reg_edi, 0xffffffff, add_index, count,
+	                [](const PhysPt src, const PhysPt dst) { mem_writeb(dst, mem_readb(src)); });
 	return count_left;
 }
 
@@ -1688,11 +1689,8 @@ static uint16_t DRC_CALL_CONV dynrec_movsw_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
-	for (;count>0;count--) {
-		mem_writew(di_base+reg_di,mem_readw(si_base+reg_si));
-		reg_si+=add_index;
-		reg_di+=add_index;
-	}
+	string_rep_movs(si_base, reg_si, di_base, reg_di, 0xffff, add_index, count,
+	                [](const PhysPt src, const PhysPt dst) { mem_writew(dst, mem_readw(src)); });
 	return count_left;
 }
 
@@ -1707,11 +1705,8 @@ static uint32_t DRC_CALL_CONV dynrec_movsw_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
-	for (;count>0;count--) {
-		mem_writew(di_base+reg_edi,mem_readw(si_base+reg_esi));
-		reg_esi+=add_index;
-		reg_edi+=add_index;
-	}
+	string_rep_movs(si_base, reg_esi, di_base, reg_edi, 0xffffffff, add_index, count,
+	                [](const PhysPt src, const PhysPt dst) { mem_writew(dst, mem_readw(src)); });
 	return count_left;
 }
 
@@ -1726,11 +1721,8 @@ static uint16_t DRC_CALL_CONV dynrec_movsd_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
-	for (;count>0;count--) {
-		mem_writed(di_base+reg_di,mem_readd(si_base+reg_si));
-		reg_si+=add_index;
-		reg_di+=add_index;
-	}
+	string_rep_movs(si_base, reg_si, di_base, reg_di, 0xffff, add_index, count,
+	                [](const PhysPt src, const PhysPt dst) { mem_writed(dst, mem_readd(src)); });
 	return count_left;
 }
 
@@ -1745,11 +1737,8 @@ static uint32_t DRC_CALL_CONV dynrec_movsd_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
-	for (;count>0;count--) {
-		mem_writed(di_base+reg_edi,mem_readd(si_base+reg_esi));
-		reg_esi+=add_index;
-		reg_edi+=add_index;
-	}
+	string_rep_movs(si_base, reg_esi, di_base, reg_edi, 0xffffffff, add_index, count,
+	                [](const PhysPt src, const PhysPt dst) { mem_writed(dst, mem_readd(src)); });
 	return count_left;
 }
 
@@ -1871,10 +1860,8 @@ static uint16_t DRC_CALL_CONV dynrec_stosb_word(uint16_t count,int16_t add_index
 		count=(uint16_t)CPU_Cycles;
 		CPU_Cycles=0;
 	}
-	for (;count>0;count--) {
-		mem_writeb(di_base+reg_di,reg_al);
-		reg_di+=add_index;
-	}
+	string_rep_stos<uint8_t>(di_base, reg_di, 0xffff, add_index, count, reg_al,
+	                         [](const PhysPt address) { mem_writeb(address, reg_al); });
 	return count_left;
 }
 
@@ -1888,10 +1875,8 @@ static uint32_t DRC_CALL_CONV dynrec_stosb_dword(uint32_t count,int32_t add_inde
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
-	for (;count>0;count--) {
-		mem_writeb(di_base+reg_edi,reg_al);
-		reg_edi+=add_index;
-	}
+	string_rep_stos<uint8_t>(di_base, reg_edi, 0xffffffff, add_index, count, reg_al,
+	                         [](const PhysPt address) { mem_writeb(address, reg_al); });
 	return count_left;
 }
 
@@ -1906,10 +1891,8 @@ static uint16_t DRC_CALL_CONV dynrec_stosw_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
-	for (;count>0;count--) {
-		mem_writew(di_base+reg_di,reg_ax);
-		reg_di+=add_index;
-	}
+	string_rep_stos<uint16_t>(di_base, reg_di, 0xffff, add_index, count, reg_ax,
+	                          [](const PhysPt address) { mem_writew(address, reg_ax); });
 	return count_left;
 }
 
@@ -1924,10 +1907,8 @@ static uint32_t DRC_CALL_CONV dynrec_stosw_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
-	for (;count>0;count--) {
-		mem_writew(di_base+reg_edi,reg_ax);
-		reg_edi+=add_index;
-	}
+	string_rep_stos<uint16_t>(di_base, reg_edi, 0xffffffff, add_index, count, reg_ax,
+	                          [](const PhysPt address) { mem_writew(address, reg_ax); });
 	return count_left;
 }
 
@@ -1942,10 +1923,8 @@ static uint16_t DRC_CALL_CONV dynrec_stosd_word(uint16_t count,int16_t add_index
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
-	for (;count>0;count--) {
-		mem_writed(di_base+reg_di,reg_eax);
-		reg_di+=add_index;
-	}
+	string_rep_stos<uint32_t>(di_base, reg_di, 0xffff, add_index, count, reg_eax,
+	                          [](const PhysPt address) { mem_writed(address, reg_eax); });
 	return count_left;
 }
 
@@ -1960,10 +1939,8 @@ static uint32_t DRC_CALL_CONV dynrec_stosd_dword(uint32_t count,int32_t add_inde
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
-	for (;count>0;count--) {
-		mem_writed(di_base+reg_edi,reg_eax);
-		reg_edi+=add_index;
-	}
+	string_rep_stos<uint32_t>(di_base, reg_edi, 0xffffffff, add_index, count, reg_eax,
+	                          [](const PhysPt address) { mem_writed(address, reg_eax); });
 	return count_left;
 }
 
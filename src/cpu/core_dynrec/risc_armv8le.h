@@ -29,6 +29,12 @@
 // try to replace _simple functions by code
 #define DRC_FLAGS_INVALIDATION_DCODE
 
+// access guest memory inline through the TLB if the page is plain memory
+#define DRC_USE_INLINE_TLB
+
+// emit double precision arithmetic on the FPU register file inline
+#define DRC_USE_NATIVE_FPU
+
 // calling convention modifier
 #define DRC_CALL_CONV	/* nothing */
 #define DRC_FC			/* nothing */
@@ -290,9 +296,43 @@ typedef uint8_t HostReg;
 // sturb reg, [addr, #imm]		@	-256 <= imm < 256
 #define STURB_IMM(reg, addr, imm) (0x38000000 + (reg) + ((addr) << 5) + (((imm) << 12) & 0x001ff000) )
 
+// ldr reg, [addr1, addr2, uxtw]
+#define LDR_REG_UXTW(reg, addr1, addr2) (0xb8604800 + (reg) + ((addr1) << 5) + ((addr2) << 16) )
+// ldrh reg, [addr1, addr2, uxtw]
+#define LDRH_REG_UXTW(reg, addr1, addr2) (0x78604800 + (reg) + ((addr1) << 5) + ((addr2) << 16) )
+// ldrb reg, [addr1, addr2, uxtw]
+#define LDRB_REG_UXTW(reg, addr1, addr2) (0x38604800 + (reg) + ((addr1) << 5) + ((addr2) << 16) )
+// str reg, [addr1, addr2, uxtw]
+#define STR_REG_UXTW(reg, addr1, addr2) (0xb8204800 + (reg) + ((addr1) << 5) + ((addr2) << 16) )
+// strh reg, [addr1, addr2, uxtw]
+#define STRH_REG_UXTW(reg, addr1, addr2) (0x78204800 + (reg) + ((addr1) << 5) + ((addr2) << 16) )
+// strb reg, [addr1, addr2, uxtw]
+#define STRB_REG_UXTW(reg, addr1, addr2) (0x38204800 + (reg) + ((addr1) << 5) + ((addr2) << 16) )
+
+// floating point (double precision)
+// ldr dreg, [addr1, addr2, uxtw #3]
+#define LDR_D_REG_UXTW_3(dreg, addr1, addr2) (0xfc605800 + (dreg) + ((addr1) << 5) + ((addr2) << 16) )
+// str dreg, [addr1, addr2, uxtw #3]
+#define STR_D_REG_UXTW_3(dreg, addr1, addr2) (0xfc205800 + (dreg) + ((addr1) << 5) + ((addr2) << 16) )
+// fadd/fsub/fmul/fdiv dst, src1, src2
+#define FADD_D(dst, src1, src2) (0x1e602800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+#define FSUB_D(dst, src1, src2) (0x1e603800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+#define FMUL_D(dst, src1, src2) (0x1e600800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+#define FDIV_D(dst, src1, src2) (0x1e601800 + (dst) + ((src1) << 5) + ((src2) << 16) )
+// fmov sreg, wreg
+#define FMOV_S_FROM_W(sreg, wreg) (0x1e270000 + (sreg) + ((wreg) << 5) )
+// fmov wreg, sreg
+#define FMOV_W_FROM_S(wreg, sreg) (0x1e260000 + (wreg) + ((sreg) << 5) )
+// fcvt dreg, sreg
+#define FCVT_D_FROM_S(dreg, sreg) (0x1e22c000 + (dreg) + ((sreg) << 5) )
+// fcvt sreg, dreg
+#define FCVT_S_FROM_D(sreg, dreg) (0x1e624000 + (sreg) + ((dreg) << 5) )
+
 // branch
 // bgt pc+imm		@	0 <= imm < 1M	&	imm mod 4 = 0
 #define BGT_FWD(imm) (0x5400000c + ((imm) << 3) )
+// bhs pc+imm		@	0 <= imm < 1M	&	imm mod 4 = 0
+#define BHS_FWD(imm) (0x54000002 + ((imm) << 3) )
 // b pc+imm		@	0 <= imm < 128M	&	imm mod 4 = 0
 #define B_FWD(imm) (0x14000000 + ((imm) >> 2) )
 // br reg
@@ -303,6 +343,8 @@ typedef uint8_t HostReg;
 #define CBZ_FWD(reg, imm) (0x34000000 + (reg) + ((imm) << 3) )
 // cbnz reg, pc+imm		@	0 <= imm < 1M	&	imm mod 4 = 0
 #define CBNZ_FWD(reg, imm) (0x35000000 + (reg) + ((imm) << 3) )
+// cbz reg64, pc+imm		@	0 <= imm < 1M	&	imm mod 4 = 0
+#define CBZ64_FWD(reg, imm) (0xb4000000 + (reg) + ((imm) << 3) )
 // ret reg
 #define RET_REG(reg) (0xd65f0000 + ((reg) << 5) )
 // ret
@@ -872,6 +914,53 @@ static void inline gen_fill_branch_long(const uint8_t* data) {
 	cache_addd(((data[3]<<24)&~0x03ffffff)|(offset&0x03ffffff),data);
 }
 
+#ifdef DRC_USE_INLINE_TLB
+// unconditional forward jump (cbz on the zero register)
+// the destination is set by gen_fill_branch() later
+static const uint8_t* gen_create_jump(void) {
+	cache_addd( CBZ_FWD(HOST_wzr, 0) );      // cbz wzr, j
+	return (cache.pos-4);
+}
+
+// look up the linear address in FC_OP1 in paging.tlb.read/write and leave
+// the host base of the page in temp1. Branches to the returned locations
+// (crossing may be nullptr) have to be filled in with the slow path that
+// calls the memory helper function instead.
+static const uint8_t* gen_tlb_lookup(bool write,Bitu size,const uint8_t** crossing) {
+	if (size>1) {
+		cache_addd( UBFM(temp2, FC_OP1, 0, 11) );      // ubfx temp2, FC_OP1, #0, #12
+		cache_addd( CMP_IMM(temp2, 0x1000 - size + 1, 0) );      // cmp temp2, #(0x1000 - size + 1)
+		cache_addd( BHS_FWD(0) );      // bhs crossing
+		*crossing=cache.pos-4;
+	} else {
+		*crossing=nullptr;
+	}
+	cache_addd( UBFM(temp1, FC_OP1, 12, 31) );      // lsr temp1, FC_OP1, #12
+	gen_mov_qword_to_reg_imm(temp2, (uint64_t)(write ? &paging.tlb.write[0] : &paging.tlb.read[0]));
+	cache_addd( LDR64_REG_LSL_IMM(temp1, temp2, temp1, 1) );      // ldr temp1, [temp2, temp1, lsl #3]
+	cache_addd( CBZ64_FWD(temp1, 0) );      // cbz temp1, unmapped
+	return (cache.pos-4);
+}
+
+// read size bytes from [temp1+FC_OP1] into dest_reg after a successful lookup
+static void gen_tlb_read_host(HostReg dest_reg,Bitu size) {
+	switch (size) {
+		case 4: cache_addd( LDR_REG_UXTW(dest_reg, temp1, FC_OP1) ); break;      // ldr dest_reg, [temp1, FC_OP1, uxtw]
+		case 2: cache_addd( LDRH_REG_UXTW(dest_reg, temp1, FC_OP1) ); break;     // ldrh dest_reg, [temp1, FC_OP1, uxtw]
+		default: cache_addd( LDRB_REG_UXTW(dest_reg, temp1, FC_OP1) ); break;    // ldrb dest_reg, [temp1, FC_OP1, uxtw]
+	}
+}
+
+// write size bytes of src_reg to [temp1+FC_OP1] after a successful lookup
+static void gen_tlb_write_host(HostReg src_reg,Bitu size) {
+	switch (size) {
+		case 4: cache_addd( STR_REG_UXTW(src_reg, temp1, FC_OP1) ); break;       // str src_reg, [temp1, FC_OP1, uxtw]
+		case 2: cache_addd( STRH_REG_UXTW(src_reg, temp1, FC_OP1) ); break;      // strh src_reg, [temp1, FC_OP1, uxtw]
+		default: cache_addd( STRB_REG_UXTW(src_reg, temp1, FC_OP1) ); break;     // strb src_reg, [temp1, FC_OP1, uxtw]
+	}
+}
+#endif
+
 static void gen_run_code(void) {
 	const uint8_t *pos1, *pos2, *pos3;
 
@@ -1230,4 +1319,52 @@ static void gen_mov_regbyte_from_reg_low(HostReg src_reg,Bitu index) {
 	cache_addd( STRB_IMM(src_reg, FC_REGS_ADDR, index) );      // strb src_reg, [FC_REGS_ADDR, #index]
 }
 
+// native FPU support, the FPU registers are 8 byte doubles indexed by a
+// register holding the stack slot; only d0 and d1 are used, which are
+// caller-saved and never live across emitted instructions
+
+enum class FpuNativeOp { Add, Sub, SubR, Mul, Div, DivR };
+
+// load the address of the FPU register file into base_reg
+static void gen_fpu_base(HostReg base_reg, void *regs) {
+	gen_mov_qword_to_reg_imm(base_reg, (uint64_t)regs);
+}
+
+// regs[st_reg] = regs[st_reg] op d1
+static void gen_fpu_arith_d1(FpuNativeOp op, HostReg base_reg, HostReg st_reg) {
+	cache_addd( LDR_D_REG_UXTW_3(0, base_reg, st_reg) );      // ldr d0, [base_reg, st_reg, uxtw #3]
+	switch (op) {
+		case FpuNativeOp::Add:  cache_addd( FADD_D(0, 0, 1) ); break;     // fadd d0, d0, d1
+		case FpuNativeOp::Sub:  cache_addd( FSUB_D(0, 0, 1) ); break;     // fsub d0, d0, d1
+		case FpuNativeOp::SubR: cache_addd( FSUB_D(0, 1, 0) ); break;     // fsub d0, d1, d0
+		case FpuNativeOp::Mul:  cache_addd( FMUL_D(0, 0, 1) ); break;     // fmul d0, d0, d1
+		case FpuNativeOp::Div:  cache_addd( FDIV_D(0, 0, 1) ); break;     // fdiv d0, d0, d1
+		case FpuNativeOp::DivR: cache_addd( FDIV_D(0, 1, 0) ); break;     // fdiv d0, d1, d0
+	}
+	cache_addd( STR_D_REG_UXTW_3(0, base_reg, st_reg) );      // str d0, [base_reg, st_reg, uxtw #3]
+}
+
+// convert the single precision value in src_reg to double precision in d1
+static void gen_fpu_float_to_d1(HostReg src_reg) {
+	cache_addd( FMOV_S_FROM_W(1, src_reg) );      // fmov s1, src_reg
+	cache_addd( FCVT_D_FROM_S(1, 1) );            // fcvt d1, s1
+}
+
+// load regs[st_reg] into d1
+static void gen_fpu_load_d1(HostReg base_reg, HostReg st_reg) {
+	cache_addd( LDR_D_REG_UXTW_3(1, base_reg, st_reg) );      // ldr d1, [base_reg, st_reg, uxtw #3]
+}
+
+// store d1 into regs[st_reg]
+static void gen_fpu_store_d1(HostReg base_reg, HostReg st_reg) {
+	cache_addd( STR_D_REG_UXTW_3(1, base_reg, st_reg) );      // str d1, [base_reg, st_reg, uxtw #3]
+}
+
+// convert regs[st_reg] to single precision and move it into dest_reg
+static void gen_fpu_reg_to_float(HostReg dest_reg, HostReg base_reg, HostReg st_reg) {
+	cache_addd( LDR_D_REG_UXTW_3(0, base_reg, st_reg) );      // ldr d0, [base_reg, st_reg, uxtw #3]
+	cache_addd( FCVT_S_FROM_D(0, 0) );                        // fcvt s0, d0
+	cache_addd( FMOV_W_FROM_S(dest_reg, 0) );                 // fmov dest_reg, s0
+}
+
 #endif
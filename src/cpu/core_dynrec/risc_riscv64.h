@@ -0,0 +1,1266 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* RISC-V RV64GC (little endian, 64-bit) backend */
+
+// Only base integer instructions (RV64I) are emitted, so the generated code
+// runs on any RV64 Linux host without depending on the B/Zb* extensions.
+//
+// 32-bit guest values are kept sign-extended to 64 bit in the host registers
+// (the form the LP64 calling convention uses for 32-bit arguments and return
+// values), so all 32-bit arithmetic is done with the *W instructions.
+// 8-bit and 16-bit values are kept zero-extended where they are passed to or
+// returned from helper functions.
+
+// some configuring defines that specify the capabilities of this architecture
+// or aspects of the recompiling
+
+// protect FC_ADDR over function calls if necessaray
+// #define DRC_PROTECT_ADDR_REG
+
+// try to use non-flags generating functions if possible
+#define DRC_FLAGS_INVALIDATION
+// try to replace _simple functions by code
+#define DRC_FLAGS_INVALIDATION_DCODE
+
+// access guest memory inline through the TLB if the page is plain memory
+#define DRC_USE_INLINE_TLB
+
+// calling convention modifier
+#define DRC_CALL_CONV	/* nothing */
+#define DRC_FC			/* nothing */
+
+// use FC_REGS_ADDR to hold the address of "cpu_regs" and to access it using FC_REGS_ADDR
+#define DRC_USE_REGS_ADDR
+// use FC_SEGS_ADDR to hold the address of "Segs" and to access it using FC_SEGS_ADDR
+#define DRC_USE_SEGS_ADDR
+
+// register mapping
+typedef uint8_t HostReg;
+
+// registers
+#define HOST_zero	 0
+#define HOST_ra		 1
+#define HOST_sp		 2
+#define HOST_gp		 3
+#define HOST_tp		 4
+#define HOST_t0		 5
+#define HOST_t1		 6
+#define HOST_t2		 7
+#define HOST_s0		 8
+#define HOST_s1		 9
+#define HOST_a0		10
+#define HOST_a1		11
+#define HOST_a2		12
+#define HOST_a3		13
+#define HOST_a4		14
+#define HOST_a5		15
+#define HOST_a6		16
+#define HOST_a7		17
+#define HOST_s2		18
+#define HOST_s3		19
+#define HOST_s4		20
+#define HOST_s5		21
+#define HOST_s6		22
+#define HOST_s7		23
+#define HOST_s8		24
+#define HOST_s9		25
+#define HOST_s10	26
+#define HOST_s11	27
+#define HOST_t3		28
+#define HOST_t4		29
+#define HOST_t5		30
+#define HOST_t6		31
+
+
+// temporary registers
+#define temp1 HOST_t0
+#define temp2 HOST_t1
+#define temp3 HOST_t2
+
+// register that holds function return values
+#define FC_RETOP HOST_a0
+
+// register used for address calculations,
+#define FC_ADDR HOST_s1			// has to be saved across calls, see DRC_PROTECT_ADDR_REG
+
+// register that holds the first parameter
+#define FC_OP1 HOST_a0
+
+// register that holds the second parameter
+#define FC_OP2 HOST_a1
+
+// special register that holds the third parameter for _R3 calls (byte accessible)
+#define FC_OP3 HOST_a2
+
+// register that holds byte-accessible temporary values
+#define FC_TMP_BA1 HOST_a0
+
+// register that holds byte-accessible temporary values
+#define FC_TMP_BA2 HOST_a1
+
+// temporary register for LEA
+#define TEMP_REG_DRC HOST_t3
+
+// used to hold the address of "cpu_regs" - preferably filled in function gen_run_code
+#define FC_REGS_ADDR HOST_s2
+
+// used to hold the address of "Segs" - preferably filled in function gen_run_code
+#define FC_SEGS_ADDR HOST_s3
+
+// used to hold the address of "core_dynrec.readdata" - filled in function gen_run_code
+#define readdata_addr HOST_s4
+
+
+// instruction encodings
+
+// immediate fields
+#define RV_I_IMM(imm) ((((uint32_t)(imm)) & 0xfff) << 20)
+#define RV_S_IMM(imm) (((((uint32_t)(imm)) & 0x1f) << 7) + ((((uint32_t)(imm)) & 0xfe0) << 20))
+#define RV_B_IMM(imm) (((((uint32_t)(imm)) & 0x1000) << 19) + ((((uint32_t)(imm)) & 0x7e0) << 20) + ((((uint32_t)(imm)) & 0x1e) << 7) + ((((uint32_t)(imm)) & 0x800) >> 4))
+#define RV_J_IMM(imm) (((((uint32_t)(imm)) & 0x100000) << 11) + ((((uint32_t)(imm)) & 0x7fe) << 20) + ((((uint32_t)(imm)) & 0x800) << 9) + (((uint32_t)(imm)) & 0xff000))
+
+// register-immediate
+// addi dst, src, #imm		@	-2048 <= imm < 2048
+#define ADDI(dst, src, imm) (0x00000013u + ((dst) << 7) + ((src) << 15) + RV_I_IMM(imm) )
+// addiw dst, src, #imm		@	-2048 <= imm < 2048
+#define ADDIW(dst, src, imm) (0x0000001bu + ((dst) << 7) + ((src) << 15) + RV_I_IMM(imm) )
+// andi dst, src, #imm		@	-2048 <= imm < 2048
+#define ANDI(dst, src, imm) (0x00007013u + ((dst) << 7) + ((src) << 15) + RV_I_IMM(imm) )
+// slli dst, src, #imm		@	0 <= imm < 64
+#define SLLI(dst, src, imm) (0x00001013u + ((dst) << 7) + ((src) << 15) + ((imm) << 20) )
+// srli dst, src, #imm		@	0 <= imm < 64
+#define SRLI(dst, src, imm) (0x00005013u + ((dst) << 7) + ((src) << 15) + ((imm) << 20) )
+// srai dst, src, #imm		@	0 <= imm < 64
+#define SRAI(dst, src, imm) (0x40005013u + ((dst) << 7) + ((src) << 15) + ((imm) << 20) )
+// slliw dst, src, #imm		@	0 <= imm < 32
+#define SLLIW(dst, src, imm) (0x0000101bu + ((dst) << 7) + ((src) << 15) + ((imm) << 20) )
+// srliw dst, src, #imm		@	0 <= imm < 32
+#define SRLIW(dst, src, imm) (0x0000501bu + ((dst) << 7) + ((src) << 15) + ((imm) << 20) )
+// lui dst, #imm		@	0 <= imm < 0x100000
+#define LUI(dst, imm) (0x00000037u + ((dst) << 7) + ((((uint32_t)(imm)) & 0xfffff) << 12) )
+// auipc dst, #imm		@	0 <= imm < 0x100000
+#define AUIPC(dst, imm) (0x00000017u + ((dst) << 7) + ((((uint32_t)(imm)) & 0xfffff) << 12) )
+// mv dst, src
+#define MV(dst, src) ADDI(dst, src, 0)
+// nop
+#define NOP ADDI(HOST_zero, HOST_zero, 0)
+
+// register-register, 64-bit
+// add dst, src1, src2
+#define ADD(dst, src1, src2) (0x00000033u + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// sll dst, src1, src2
+#define SLL(dst, src1, src2) (0x00001033u + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// srl dst, src1, src2
+#define SRL(dst, src1, src2) (0x00005033u + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// and dst, src1, src2
+#define AND(dst, src1, src2) (0x00007033u + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// or dst, src1, src2
+#define OR(dst, src1, src2) (0x00006033u + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// xor dst, src1, src2
+#define XOR(dst, src1, src2) (0x00004033u + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+
+// register-register, 32-bit (result sign-extended to 64-bit)
+// addw dst, src1, src2
+#define ADDW(dst, src1, src2) (0x0000003bu + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// subw dst, src1, src2
+#define SUBW(dst, src1, src2) (0x4000003bu + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// sllw dst, src1, src2
+#define SLLW(dst, src1, src2) (0x0000103bu + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// srlw dst, src1, src2
+#define SRLW(dst, src1, src2) (0x0000503bu + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+// sraw dst, src1, src2
+#define SRAW(dst, src1, src2) (0x4000503bu + ((dst) << 7) + ((src1) << 15) + ((src2) << 20) )
+
+// load
+// ld reg, [addr, #imm]		@	-2048 <= imm < 2048
+#define LD(reg, addr, imm) (0x00003003u + ((reg) << 7) + ((addr) << 15) + RV_I_IMM(imm) )
+// lw reg, [addr, #imm]		@	-2048 <= imm < 2048
+#define LW(reg, addr, imm) (0x00002003u + ((reg) << 7) + ((addr) << 15) + RV_I_IMM(imm) )
+// lhu reg, [addr, #imm]		@	-2048 <= imm < 2048
+#define LHU(reg, addr, imm) (0x00005003u + ((reg) << 7) + ((addr) << 15) + RV_I_IMM(imm) )
+// lbu reg, [addr, #imm]		@	-2048 <= imm < 2048
+#define LBU(reg, addr, imm) (0x00004003u + ((reg) << 7) + ((addr) << 15) + RV_I_IMM(imm) )
+
+// store
+// sd reg, [addr, #imm]		@	-2048 <= imm < 2048
+#define SD(reg, addr, imm) (0x00003023u + ((reg) << 20) + ((addr) << 15) + RV_S_IMM(imm) )
+// sw reg, [addr, #imm]		@	-2048 <= imm < 2048
+#define SW(reg, addr, imm) (0x00002023u + ((reg) << 20) + ((addr) << 15) + RV_S_IMM(imm) )
+// sh reg, [addr, #imm]		@	-2048 <= imm < 2048
+#define SH(reg, addr, imm) (0x00001023u + ((reg) << 20) + ((addr) << 15) + RV_S_IMM(imm) )
+// sb reg, [addr, #imm]		@	-2048 <= imm < 2048
+#define SB(reg, addr, imm) (0x00000023u + ((reg) << 20) + ((addr) << 15) + RV_S_IMM(imm) )
+
+// branch
+// beq src1, src2, pc+imm		@	-4096 <= imm < 4096	&	imm mod 2 = 0
+#define BEQ(src1, src2, imm) (0x00000063u + ((src1) << 15) + ((src2) << 20) + RV_B_IMM(imm) )
+// bne src1, src2, pc+imm		@	-4096 <= imm < 4096	&	imm mod 2 = 0
+#define BNE(src1, src2, imm) (0x00001063u + ((src1) << 15) + ((src2) << 20) + RV_B_IMM(imm) )
+// blt src1, src2, pc+imm		@	-4096 <= imm < 4096	&	imm mod 2 = 0
+#define BLT(src1, src2, imm) (0x00004063u + ((src1) << 15) + ((src2) << 20) + RV_B_IMM(imm) )
+// jal dst, pc+imm		@	-1M <= imm < 1M	&	imm mod 2 = 0
+#define JAL(dst, imm) (0x0000006fu + ((dst) << 7) + RV_J_IMM(imm) )
+// jalr dst, [src, #imm]		@	-2048 <= imm < 2048
+#define JALR(dst, src, imm) (0x00000067u + ((dst) << 7) + ((src) << 15) + RV_I_IMM(imm) )
+// ret
+#define RET JALR(HOST_zero, HOST_ra, 0)
+
+// mask of the fields of a B-type instruction that are not part of the offset
+#define RV_B_FIELDS_MASK 0x01fff07f
+
+// number of instructions of the sequence emitted by gen_call_function_raw
+#define RV_CALL_INSNS 7
+
+
+// helper function - sign-extend the lowest 12 bits of a value
+static inline int32_t gen_low12(int64_t value) {
+	return static_cast<int32_t>(((value & 0xfff) ^ 0x800) - 0x800);
+}
+
+// helper function - check if a value fits into a 12 bit signed immediate
+static inline bool gen_fits_imm12(int64_t value) {
+	return (value >= -2048) && (value < 2048);
+}
+
+// move a full register from reg_src to reg_dst
+static void gen_mov_regs(HostReg reg_dst,HostReg reg_src) {
+	if(reg_src == reg_dst) return;
+	cache_addd( MV(reg_dst, reg_src) );      // mv reg_dst, reg_src
+}
+
+// move a 32bit constant value into dest_reg
+static void gen_mov_dword_to_reg_imm(HostReg dest_reg,uint32_t imm) {
+	const int32_t value = static_cast<int32_t>(imm);
+	if (gen_fits_imm12(value)) {
+		cache_addd( ADDI(dest_reg, HOST_zero, value) );     // li dest_reg, #imm
+		return;
+	}
+	const int32_t low = gen_low12(value);
+	cache_addd( LUI(dest_reg, (imm - static_cast<uint32_t>(low)) >> 12) );      // lui dest_reg, #((imm - low) >> 12)
+	if (low) {
+		cache_addd( ADDIW(dest_reg, dest_reg, low) );        // addiw dest_reg, dest_reg, #low
+	}
+}
+
+// helper function - move a 64bit constant value into dest_reg
+// without using the position of the code
+static void gen_mov_qword_to_reg_imm_abs(HostReg dest_reg,uint64_t imm) {
+	if (static_cast<int64_t>(imm) == static_cast<int32_t>(imm)) {
+		gen_mov_dword_to_reg_imm(dest_reg, static_cast<uint32_t>(imm));
+		return;
+	}
+	const int32_t low = gen_low12(static_cast<int64_t>(imm));
+	int64_t high = static_cast<int64_t>(imm - static_cast<uint64_t>(static_cast<int64_t>(low))) >> 12;
+	uint32_t shift = 12;
+	while (((high & 1) == 0) && (high != static_cast<int32_t>(high))) {
+		high >>= 1;
+		shift++;
+	}
+	gen_mov_qword_to_reg_imm_abs(dest_reg, static_cast<uint64_t>(high));
+	cache_addd( SLLI(dest_reg, dest_reg, shift) );      // slli dest_reg, dest_reg, #shift
+	if (low) {
+		cache_addd( ADDI(dest_reg, dest_reg, low) );    // addi dest_reg, dest_reg, #low
+	}
+}
+
+// helper function - check if a value can be reached with auipc from the
+// current position, and return the offsets for auipc and the following
+// instruction in high and low
+static bool gen_pcrel_offset(uint64_t value, int32_t &high, int32_t &low) {
+	const int64_t offset = static_cast<int64_t>(value - (uint64_t)cache.pos);
+	if ((offset < INT32_MIN + 0x800) || (offset > INT32_MAX - 0x800)) return false;
+	low = gen_low12(offset);
+	high = static_cast<int32_t>((offset - low) >> 12);
+	return true;
+}
+
+// helper function - move a 64bit constant value into dest_reg
+static void gen_mov_qword_to_reg_imm(HostReg dest_reg,uint64_t imm) {
+	int32_t high, low;
+	if (static_cast<int64_t>(imm) == static_cast<int32_t>(imm)) {
+		gen_mov_dword_to_reg_imm(dest_reg, static_cast<uint32_t>(imm));
+	} else if (gen_pcrel_offset(imm, high, low)) {
+		cache_addd( AUIPC(dest_reg, high) );                // auipc dest_reg, #high
+		if (low) {
+			cache_addd( ADDI(dest_reg, dest_reg, low) );    // addi dest_reg, dest_reg, #low
+		}
+	} else {
+		gen_mov_qword_to_reg_imm_abs(dest_reg, imm);
+	}
+}
+
+// helper function - load an address into dest_reg, except for the lowest
+// 12 bits that are returned to be used as offset of the memory access
+static int32_t gen_addr_to_reg(HostReg dest_reg,uint64_t addr) {
+	int32_t high, low;
+	if ((static_cast<int64_t>(addr) == static_cast<int32_t>(addr)) &&
+	    (static_cast<int64_t>(addr) < INT32_MAX - 0x7ff)) {
+		low = gen_low12(static_cast<int64_t>(addr));
+		cache_addd( LUI(dest_reg, (static_cast<uint32_t>(addr) - static_cast<uint32_t>(low)) >> 12) );      // lui dest_reg, #((addr - low) >> 12)
+	} else if (gen_pcrel_offset(addr, high, low)) {
+		cache_addd( AUIPC(dest_reg, high) );        // auipc dest_reg, #high
+	} else {
+		low = gen_low12(static_cast<int64_t>(addr));
+		gen_mov_qword_to_reg_imm_abs(dest_reg, addr - static_cast<uint64_t>(static_cast<int64_t>(low)));
+	}
+	return low;
+}
+
+// helper function - generate a fixed length sequence that moves a
+// (user space) address into dest_reg, used for patchable function calls
+static void gen_addr_fixed(uint32_t (&code)[RV_CALL_INSNS - 1],HostReg dest_reg,uint64_t addr) {
+	const int64_t value0 = static_cast<int64_t>(addr);
+	const int32_t low0 = gen_low12(value0);
+	const int64_t value1 = (value0 - low0) >> 12;
+	const int32_t low1 = gen_low12(value1);
+	const uint32_t value2 = static_cast<uint32_t>((value1 - low1) >> 12);
+	const int32_t low2 = gen_low12(static_cast<int32_t>(value2));
+	code[0] = LUI(dest_reg, (value2 - static_cast<uint32_t>(low2)) >> 12);    // lui dest_reg, #((value2 - low2) >> 12)
+	code[1] = ADDIW(dest_reg, dest_reg, low2);                              // addiw dest_reg, dest_reg, #low2
+	code[2] = SLLI(dest_reg, dest_reg, 12);                                 // slli dest_reg, dest_reg, #12
+	code[3] = ADDI(dest_reg, dest_reg, low1);                               // addi dest_reg, dest_reg, #low1
+	code[4] = SLLI(dest_reg, dest_reg, 12);                                 // slli dest_reg, dest_reg, #12
+	code[5] = ADDI(dest_reg, dest_reg, low0);                               // addi dest_reg, dest_reg, #low0
+}
+
+// helper function
+static bool gen_mov_memval_to_reg_helper(HostReg dest_reg, uint64_t data, Bitu size, HostReg addr_reg, uint64_t addr_data) {
+	const int64_t offset = static_cast<int64_t>(data - addr_data);
+	if (!gen_fits_imm12(offset)) return false;
+	switch (size) {
+		case 8:
+			cache_addd( LD(dest_reg, addr_reg, offset) );       // ld dest_reg, [addr_reg, #(data - addr_data)]
+			return true;
+		case 4:
+			cache_addd( LW(dest_reg, addr_reg, offset) );       // lw dest_reg, [addr_reg, #(data - addr_data)]
+			return true;
+		case 2:
+			cache_addd( LHU(dest_reg, addr_reg, offset) );      // lhu dest_reg, [addr_reg, #(data - addr_data)]
+			return true;
+		case 1:
+			cache_addd( LBU(dest_reg, addr_reg, offset) );      // lbu dest_reg, [addr_reg, #(data - addr_data)]
+			return true;
+		default:
+			break;
+	}
+	return false;
+}
+
+// helper function
+static bool gen_mov_memval_to_reg(HostReg dest_reg, void *data, Bitu size) {
+	if (gen_mov_memval_to_reg_helper(dest_reg, (uint64_t)data, size, FC_REGS_ADDR, (uint64_t)&cpu_regs)) return true;
+	if (gen_mov_memval_to_reg_helper(dest_reg, (uint64_t)data, size, readdata_addr, (uint64_t)&core_dynrec.readdata)) return true;
+	if (gen_mov_memval_to_reg_helper(dest_reg, (uint64_t)data, size, FC_SEGS_ADDR, (uint64_t)&Segs)) return true;
+	return false;
+}
+
+// helper function for gen_mov_word_to_reg
+static void gen_mov_word_to_reg_helper(HostReg dest_reg,bool dword,HostReg data_reg,int32_t offset) {
+	if (dword) {
+		cache_addd( LW(dest_reg, data_reg, offset) );       // lw dest_reg, [data_reg, #offset]
+	} else {
+		cache_addd( LHU(dest_reg, data_reg, offset) );      // lhu dest_reg, [data_reg, #offset]
+	}
+}
+
+// move a 32bit (dword==true) or 16bit (dword==false) value from memory into dest_reg
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_word_to_reg(HostReg dest_reg,void* data,bool dword) {
+	if (!gen_mov_memval_to_reg(dest_reg, data, (dword)?4:2)) {
+		const int32_t offset = gen_addr_to_reg(temp1, (uint64_t)data);
+		gen_mov_word_to_reg_helper(dest_reg, dword, temp1, offset);
+	}
+}
+
+// move a 16bit constant value into dest_reg
+// the upper 16bit of the destination register may be destroyed
+static void inline gen_mov_word_to_reg_imm(HostReg dest_reg,uint16_t imm) {
+	gen_mov_dword_to_reg_imm(dest_reg, imm);
+}
+
+// helper function
+static bool gen_mov_memval_from_reg_helper(HostReg src_reg, uint64_t data, Bitu size, HostReg addr_reg, uint64_t addr_data) {
+	const int64_t offset = static_cast<int64_t>(data - addr_data);
+	if (!gen_fits_imm12(offset)) return false;
+	switch (size) {
+		case 8:
+			cache_addd( SD(src_reg, addr_reg, offset) );        // sd src_reg, [addr_reg, #(data - addr_data)]
+			return true;
+		case 4:
+			cache_addd( SW(src_reg, addr_reg, offset) );        // sw src_reg, [addr_reg, #(data - addr_data)]
+			return true;
+		case 2:
+			cache_addd( SH(src_reg, addr_reg, offset) );        // sh src_reg, [addr_reg, #(data - addr_data)]
+			return true;
+		case 1:
+			cache_addd( SB(src_reg, addr_reg, offset) );        // sb src_reg, [addr_reg, #(data - addr_data)]
+			return true;
+		default:
+			break;
+	}
+	return false;
+}
+
+// helper function
+static bool gen_mov_memval_from_reg(HostReg src_reg, void *dest, Bitu size) {
+	if (gen_mov_memval_from_reg_helper(src_reg, (uint64_t)dest, size, FC_REGS_ADDR, (uint64_t)&cpu_regs)) return true;
+	if (gen_mov_memval_from_reg_helper(src_reg, (uint64_t)dest, size, readdata_addr, (uint64_t)&core_dynrec.readdata)) return true;
+	if (gen_mov_memval_from_reg_helper(src_reg, (uint64_t)dest, size, FC_SEGS_ADDR, (uint64_t)&Segs)) return true;
+	return false;
+}
+
+// helper function for gen_mov_word_from_reg
+static void gen_mov_word_from_reg_helper(HostReg src_reg,bool dword,HostReg data_reg,int32_t offset) {
+	if (dword) {
+		cache_addd( SW(src_reg, data_reg, offset) );        // sw src_reg, [data_reg, #offset]
+	} else {
+		cache_addd( SH(src_reg, data_reg, offset) );        // sh src_reg, [data_reg, #offset]
+	}
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of a register into memory
+static void gen_mov_word_from_reg(HostReg src_reg,void* dest,bool dword) {
+	if (!gen_mov_memval_from_reg(src_reg, dest, (dword)?4:2)) {
+		const int32_t offset = gen_addr_to_reg(temp1, (uint64_t)dest);
+		gen_mov_word_from_reg_helper(src_reg, dword, temp1, offset);
+	}
+}
+
+// move an 8bit value from memory into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void gen_mov_byte_to_reg_low(HostReg dest_reg,void* data) {
+	if (!gen_mov_memval_to_reg(dest_reg, data, 1)) {
+		const int32_t offset = gen_addr_to_reg(temp1, (uint64_t)data);
+		cache_addd( LBU(dest_reg, temp1, offset) );     // lbu dest_reg, [temp1, #offset]
+	}
+}
+
+// move an 8bit value from memory into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void inline gen_mov_byte_to_reg_low_canuseword(HostReg dest_reg,void* data) {
+	gen_mov_byte_to_reg_low(dest_reg, data);
+}
+
+// move an 8bit constant value into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void gen_mov_byte_to_reg_low_imm(HostReg dest_reg,uint8_t imm) {
+	cache_addd( ADDI(dest_reg, HOST_zero, imm) );   // li dest_reg, #imm
+}
+
+// move an 8bit constant value into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void inline gen_mov_byte_to_reg_low_imm_canuseword(HostReg dest_reg,uint8_t imm) {
+	gen_mov_byte_to_reg_low_imm(dest_reg, imm);
+}
+
+// move the lowest 8bit of a register into memory
+// static void gen_mov_byte_from_reg_low(HostReg src_reg,void* dest) {
+// 	if (!gen_mov_memval_from_reg(src_reg, dest, 1)) {
+// 		const int32_t offset = gen_addr_to_reg(temp1, (uint64_t)dest);
+// 		cache_addd( SB(src_reg, temp1, offset) );      // sb src_reg, [temp1, #offset]
+// 	}
+// }
+
+
+
+// convert an 8bit word to a 32bit dword
+// the register is zero-extended (sign==false) or sign-extended (sign==true)
+static void gen_extend_byte(bool sign,HostReg reg) {
+	if (sign) {
+		cache_addd( SLLI(reg, reg, 56) );      // slli reg, reg, #56
+		cache_addd( SRAI(reg, reg, 56) );      // srai reg, reg, #56
+	} else {
+		cache_addd( ANDI(reg, reg, 0xff) );    // andi reg, reg, #0xff
+	}
+}
+
+// convert a 16bit word to a 32bit dword
+// the register is zero-extended (sign==false) or sign-extended (sign==true)
+static void gen_extend_word(bool sign,HostReg reg) {
+	cache_addd( SLLI(reg, reg, 48) );          // slli reg, reg, #48
+	if (sign) {
+		cache_addd( SRAI(reg, reg, 48) );      // srai reg, reg, #48
+	} else {
+		cache_addd( SRLI(reg, reg, 48) );      // srli reg, reg, #48
+	}
+}
+
+// add a 32bit value from memory to a full register
+static void gen_add(HostReg reg,void* op) {
+	gen_mov_word_to_reg(temp3, op, 1);
+	cache_addd( ADDW(reg, reg, temp3) );      // addw reg, reg, temp3
+}
+
+// add a 32bit constant value to a full register
+static void gen_add_imm(HostReg reg,uint32_t imm) {
+	if(!imm) return;
+
+	if (gen_fits_imm12(static_cast<int32_t>(imm))) {
+		cache_addd( ADDIW(reg, reg, static_cast<int32_t>(imm)) );      // addiw reg, reg, #imm
+	} else {
+		gen_mov_dword_to_reg_imm(temp2, imm);
+		cache_addd( ADDW(reg, reg, temp2) );      // addw reg, reg, temp2
+	}
+}
+
+// and a 32bit constant value with a full register
+static void gen_and_imm(HostReg reg,uint32_t imm) {
+	if (imm == 0xffffffff) return;
+
+	if (gen_fits_imm12(static_cast<int32_t>(imm))) {
+		cache_addd( ANDI(reg, reg, static_cast<int32_t>(imm)) );       // andi reg, reg, #imm
+	} else if (imm == 0xffff) {
+		cache_addd( SLLI(reg, reg, 48) );      // slli reg, reg, #48
+		cache_addd( SRLI(reg, reg, 48) );      // srli reg, reg, #48
+	} else {
+		gen_mov_dword_to_reg_imm(temp2, imm);
+		cache_addd( AND(reg, reg, temp2) );    // and reg, reg, temp2
+	}
+}
+
+
+// move a 32bit constant value into memory
+static void gen_mov_direct_dword(void* dest,uint32_t imm) {
+	gen_mov_dword_to_reg_imm(temp3, imm);
+	gen_mov_word_from_reg(temp3, dest, 1);
+}
+
+// move an address into memory
+static void inline gen_mov_direct_ptr(void* dest,Bitu imm) {
+	gen_mov_qword_to_reg_imm(temp3, imm);
+	if (!gen_mov_memval_from_reg(temp3, dest, 8)) {
+		const int32_t offset = gen_addr_to_reg(temp1, (uint64_t)dest);
+		cache_addd( SD(temp3, temp1, offset) );       // sd temp3, [temp1, #offset]
+	}
+}
+
+// add a 32bit (dword==true) or 16bit (dword==false) constant value to a memory value
+static void gen_add_direct_word(void* dest,uint32_t imm,bool dword) {
+	if (!dword) imm &= 0xffff;
+	if(!imm) return;
+
+	int32_t offset = 0;
+	if (!gen_mov_memval_to_reg(temp3, dest, (dword)?4:2)) {
+		offset = gen_addr_to_reg(temp1, (uint64_t)dest);
+		gen_mov_word_to_reg_helper(temp3, dword, temp1, offset);
+	}
+	gen_add_imm(temp3, imm);
+	if (!gen_mov_memval_from_reg(temp3, dest, (dword)?4:2)) {
+		gen_mov_word_from_reg_helper(temp3, dword, temp1, offset);
+	}
+}
+
+// add an 8bit constant value to a dword memory value
+// static void gen_add_direct_byte(void* dest,int8_t imm) {
+// 	gen_add_direct_word(dest, (int32_t)imm, 1);
+// }
+
+// subtract a 32bit (dword==true) or 16bit (dword==false) constant value from a memory value
+static void gen_sub_direct_word(void* dest,uint32_t imm,bool dword) {
+	if (!dword) imm &= 0xffff;
+	if(!imm) return;
+
+	// subtracting imm is adding its two's complement, word values only
+	// keep the lower 16bit of it
+	gen_add_direct_word(dest, 0u - imm, dword);
+}
+
+// subtract an 8bit constant value from a dword memory value
+// static void gen_sub_direct_byte(void* dest,int8_t imm) {
+// 	gen_sub_direct_word(dest, (int32_t)imm, 1);
+// }
+
+// effective address calculation, destination is dest_reg
+// scale_reg is scaled by scale (scale_reg*(2^scale)) and
+// added to dest_reg, then the immediate value is added
+static inline void gen_lea(HostReg dest_reg,HostReg scale_reg,Bitu scale,Bits imm) {
+	if (scale) {
+		cache_addd( SLLI(temp1, scale_reg, scale) );        // slli temp1, scale_reg, #scale
+		cache_addd( ADDW(dest_reg, dest_reg, temp1) );      // addw dest_reg, dest_reg, temp1
+	} else {
+		cache_addd( ADDW(dest_reg, dest_reg, scale_reg) );  // addw dest_reg, dest_reg, scale_reg
+	}
+	gen_add_imm(dest_reg, imm);
+}
+
+// effective address calculation, destination is dest_reg
+// dest_reg is scaled by scale (dest_reg*(2^scale)),
+// then the immediate value is added
+static inline void gen_lea(HostReg dest_reg,Bitu scale,Bits imm) {
+	if (scale) {
+		cache_addd( SLLIW(dest_reg, dest_reg, scale) );      // slliw dest_reg, dest_reg, #scale
+	}
+	gen_add_imm(dest_reg, imm);
+}
+
+// generate a call to a parameterless function
+// the sequence has a fixed length of RV_CALL_INSNS instructions,
+// see gen_fill_function_ptr
+static void inline gen_call_function_raw(void * func) {
+	uint32_t code[RV_CALL_INSNS - 1];
+	gen_addr_fixed(code, temp1, (uint64_t)func);
+	for (const auto insn : code) {
+		cache_addd( insn );            // li temp1, #func
+	}
+	cache_addd( JALR(HOST_ra, temp1, 0) );      // jalr temp1
+}
+
+// generate a call to a function with paramcount parameters
+// note: the parameters are loaded in the architecture specific way
+// using the gen_load_param_ functions below
+static inline const uint8_t* gen_call_function_setup(void * func, [[maybe_unused]] Bitu paramcount, [[maybe_unused]] bool fastcall=false) {
+	const uint8_t* proc_addr = cache.pos;
+	gen_call_function_raw(func);
+	return proc_addr;
+}
+
+// load an immediate value as param'th function parameter
+static void inline gen_load_param_imm(Bitu imm,Bitu param) {
+	gen_mov_qword_to_reg_imm(HOST_a0 + param, imm);
+}
+
+// load an address as param'th function parameter
+static void inline gen_load_param_addr(Bitu addr,Bitu param) {
+	gen_mov_qword_to_reg_imm(HOST_a0 + param, addr);
+}
+
+// load a host-register as param'th function parameter
+static void inline gen_load_param_reg(Bitu reg,Bitu param) {
+	gen_mov_regs(HOST_a0 + param, reg);
+}
+
+// load a value from memory as param'th function parameter
+static void inline gen_load_param_mem(Bitu mem,Bitu param) {
+	gen_mov_word_to_reg(HOST_a0 + param, (void *)mem, 1);
+}
+
+// jump to an address pointed at by ptr, offset is in imm
+static void gen_jmp_ptr(void * ptr,Bits imm=0) {
+	if (!gen_mov_memval_to_reg(temp3, ptr, 8)) {
+		const int32_t offset = gen_addr_to_reg(temp1, (uint64_t)ptr);
+		cache_addd( LD(temp3, temp1, offset) );     // ld temp3, [temp1, #offset]
+	}
+
+	if (gen_fits_imm12(imm)) {
+		cache_addd( LD(temp1, temp3, imm) );            // ld temp1, [temp3, #imm]
+	} else {
+		gen_mov_qword_to_reg_imm(temp2, imm);
+		cache_addd( ADD(temp1, temp3, temp2) );         // add temp1, temp3, temp2
+		cache_addd( LD(temp1, temp1, 0) );              // ld temp1, [temp1]
+	}
+
+	cache_addd( JALR(HOST_zero, temp1, 0) );      // jr temp1
+}
+
+// short conditional jump (+-127 bytes) if register is zero
+// the destination is set by gen_fill_branch() later
+static const uint8_t* gen_create_branch_on_zero(HostReg reg,bool dword) {
+	if (dword) {
+		cache_addd( BEQ(reg, HOST_zero, 0) );       // beqz reg, j
+	} else {
+		cache_addd( SLLI(temp1, reg, 48) );         // slli temp1, reg, #48
+		cache_addd( BEQ(temp1, HOST_zero, 0) );     // beqz temp1, j
+	}
+	return (cache.pos-4);
+}
+
+// short conditional jump (+-127 bytes) if register is nonzero
+// the destination is set by gen_fill_branch() later
+static const uint8_t* gen_create_branch_on_nonzero(HostReg reg,bool dword) {
+	if (dword) {
+		cache_addd( BNE(reg, HOST_zero, 0) );       // bnez reg, j
+	} else {
+		cache_addd( SLLI(temp1, reg, 48) );         // slli temp1, reg, #48
+		cache_addd( BNE(temp1, HOST_zero, 0) );     // bnez temp1, j
+	}
+	return (cache.pos-4);
+}
+
+// calculate relative offset and fill it into the location pointed to by data
+static void inline gen_fill_branch(const uint8_t* data) {
+#if C_DEBUG
+	Bits len=cache.pos-data;
+	if (len<0) len=-len;
+	if (len>=0x1000) LOG_MSG("Big jump %ld",len);
+#endif
+	const uint32_t insn = data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+	cache_addd((insn & RV_B_FIELDS_MASK) | RV_B_IMM(cache.pos-data),data);
+}
+
+// conditional jump if register is nonzero
+// for isdword==true the 32bit of the register are tested
+// for isdword==false the lowest 8bit of the register are tested
+static const uint8_t* gen_create_branch_long_nonzero(HostReg reg,bool isdword) {
+	if (isdword) {
+		cache_addd( BEQ(reg, HOST_zero, 8) );       // beqz reg, pc+8    // skip next instruction
+	} else {
+		cache_addd( ANDI(temp1, reg, 0xff) );       // andi temp1, reg, #0xff
+		cache_addd( BEQ(temp1, HOST_zero, 8) );     // beqz temp1, pc+8  // skip next instruction
+	}
+	cache_addd( JAL(HOST_zero, 0) );        // j j
+	return (cache.pos-4);
+}
+
+// compare 32bit-register against zero and jump if value less/equal than zero
+static const uint8_t* gen_create_branch_long_leqzero(HostReg reg) {
+	cache_addd( BLT(HOST_zero, reg, 8) );       // bgtz reg, pc+8 // skip next instruction
+	cache_addd( JAL(HOST_zero, 0) );            // j j
+	return (cache.pos-4);
+}
+
+// calculate long relative offset and fill it into the location pointed to by data
+static void inline gen_fill_branch_long(const uint8_t* data) {
+#if C_DEBUG
+	Bits len=cache.pos-data;
+	if (len<0) len=-len;
+	if (len>=0x00100000) LOG_MSG("Big jump %ld",len);
+#endif
+	cache_addd(JAL(HOST_zero, cache.pos-data),data);
+}
+
+#ifdef DRC_USE_INLINE_TLB
+// unconditional forward jump (beq on the zero register)
+// the destination is set by gen_fill_branch() later
+static const uint8_t* gen_create_jump(void) {
+	cache_addd( BEQ(HOST_zero, HOST_zero, 0) );      // beq zero, zero, j
+	return (cache.pos-4);
+}
+
+// look up the linear address in FC_OP1 in paging.tlb.read/write and leave
+// the host base of the page in temp1. Branches to the returned locations
+// (crossing may be nullptr) have to be filled in with the slow path that
+// calls the memory helper function instead.
+// Misaligned accesses take the slow path as well: they might trap on the
+// host, and an aligned access never crosses a page boundary.
+static const uint8_t* gen_tlb_lookup(bool write,Bitu size,const uint8_t** crossing) {
+	if (size>1) {
+		cache_addd( ANDI(temp2, FC_OP1, size - 1) );      // andi temp2, FC_OP1, #(size - 1)
+		cache_addd( BNE(temp2, HOST_zero, 0) );           // bnez temp2, crossing
+		*crossing=cache.pos-4;
+	} else {
+		*crossing=nullptr;
+	}
+	cache_addd( SRLIW(temp1, FC_OP1, 12) );      // srliw temp1, FC_OP1, #12
+	cache_addd( SLLI(temp1, temp1, 3) );         // slli temp1, temp1, #3
+	const int32_t offset = gen_addr_to_reg(temp2, (uint64_t)(write ? &paging.tlb.write[0] : &paging.tlb.read[0]));
+	cache_addd( ADD(temp1, temp1, temp2) );      // add temp1, temp1, temp2
+	cache_addd( LD(temp1, temp1, offset) );      // ld temp1, [temp1, #offset]
+	cache_addd( BEQ(temp1, HOST_zero, 0) );      // beqz temp1, unmapped
+	return (cache.pos-4);
+}
+
+// helper function - compute temp1 + zero-extended FC_OP1 into temp2
+static void gen_tlb_host_addr(void) {
+	cache_addd( SLLI(temp2, FC_OP1, 32) );       // slli temp2, FC_OP1, #32
+	cache_addd( SRLI(temp2, temp2, 32) );        // srli temp2, temp2, #32
+	cache_addd( ADD(temp2, temp1, temp2) );      // add temp2, temp1, temp2
+}
+
+// read size bytes from [temp1+FC_OP1] into dest_reg after a successful lookup
+static void gen_tlb_read_host(HostReg dest_reg,Bitu size) {
+	gen_tlb_host_addr();
+	switch (size) {
+		case 4: cache_addd( LW(dest_reg, temp2, 0) ); break;      // lw dest_reg, [temp2]
+		case 2: cache_addd( LHU(dest_reg, temp2, 0) ); break;     // lhu dest_reg, [temp2]
+		default: cache_addd( LBU(dest_reg, temp2, 0) ); break;    // lbu dest_reg, [temp2]
+	}
+}
+
+// write size bytes of src_reg to [temp1+FC_OP1] after a successful lookup
+static void gen_tlb_write_host(HostReg src_reg,Bitu size) {
+	gen_tlb_host_addr();
+	switch (size) {
+		case 4: cache_addd( SW(src_reg, temp2, 0) ); break;       // sw src_reg, [temp2]
+		case 2: cache_addd( SH(src_reg, temp2, 0) ); break;       // sh src_reg, [temp2]
+		default: cache_addd( SB(src_reg, temp2, 0) ); break;      // sb src_reg, [temp2]
+	}
+}
+#endif
+
+static void gen_run_code(void) {
+	cache_addd( ADDI(HOST_sp, HOST_sp, -48) );              // addi sp, sp, #-48
+	cache_addd( SD(HOST_ra, HOST_sp, 40) );                 // sd ra, [sp, #40]
+	cache_addd( SD(FC_ADDR, HOST_sp, 32) );                 // sd FC_ADDR, [sp, #32]
+	cache_addd( SD(FC_REGS_ADDR, HOST_sp, 24) );            // sd FC_REGS_ADDR, [sp, #24]
+	cache_addd( SD(FC_SEGS_ADDR, HOST_sp, 16) );            // sd FC_SEGS_ADDR, [sp, #16]
+	cache_addd( SD(readdata_addr, HOST_sp, 8) );            // sd readdata_addr, [sp, #8]
+
+	gen_mov_qword_to_reg_imm(FC_SEGS_ADDR, (uint64_t)&Segs);                    // li FC_SEGS_ADDR, #(&Segs)
+	gen_mov_qword_to_reg_imm(FC_REGS_ADDR, (uint64_t)&cpu_regs);                // li FC_REGS_ADDR, #(&cpu_regs)
+	gen_mov_qword_to_reg_imm(readdata_addr, (uint64_t)&core_dynrec.readdata);   // li readdata_addr, #(&core_dynrec.readdata)
+
+	cache_addd( JALR(HOST_zero, HOST_a0, 0) );              // jr a0
+
+	// align cache.pos to 32 bytes
+	if ((((Bitu)cache.pos) & 0x1f) != 0) {
+		cache.pos = cache.pos + (32 - (((Bitu)cache.pos) & 0x1f));
+	}
+}
+
+// return from a function
+static void gen_return_function(void) {
+	cache_addd( LD(HOST_ra, HOST_sp, 40) );                 // ld ra, [sp, #40]
+	cache_addd( LD(FC_ADDR, HOST_sp, 32) );                 // ld FC_ADDR, [sp, #32]
+	cache_addd( LD(FC_REGS_ADDR, HOST_sp, 24) );            // ld FC_REGS_ADDR, [sp, #24]
+	cache_addd( LD(FC_SEGS_ADDR, HOST_sp, 16) );            // ld FC_SEGS_ADDR, [sp, #16]
+	cache_addd( LD(readdata_addr, HOST_sp, 8) );            // ld readdata_addr, [sp, #8]
+	cache_addd( ADDI(HOST_sp, HOST_sp, 48) );               // addi sp, sp, #48
+	cache_addd( RET );                                      // ret
+}
+
+#ifdef DRC_FLAGS_INVALIDATION
+
+// helper function - fill the instruction slots of the call sequence at pos
+// with code, the remaining slots are filled with nops
+template <size_t count>
+static void gen_fill_call_slots(const uint8_t * pos,const uint32_t (&code)[count]) {
+	static_assert(count <= RV_CALL_INSNS, "code does not fit into the call sequence");
+	for (size_t i = 0; i < RV_CALL_INSNS; i++) {
+		cache_addd((i < count) ? code[i] : NOP,pos+i*4);
+	}
+}
+
+// called when a call to a function can be replaced by a
+// call to a simpler function
+// the results of byte and word operations are zero-extended like the
+// return values of the _simple functions
+static void gen_fill_function_ptr(const uint8_t * pos,void* fct_ptr,Bitu flags_type) {
+#ifdef DRC_FLAGS_INVALIDATION_DCODE
+	// try to avoid function calls but rather directly fill in code
+	switch (flags_type) {
+		case t_ADDb:
+			gen_fill_call_slots(pos, {
+				ADDW(FC_RETOP, HOST_a0, HOST_a1),      // addw FC_RETOP, a0, a1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_ADDw:
+			gen_fill_call_slots(pos, {
+				ADDW(FC_RETOP, HOST_a0, HOST_a1),      // addw FC_RETOP, a0, a1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_ADDd:
+			gen_fill_call_slots(pos, {
+				ADDW(FC_RETOP, HOST_a0, HOST_a1),      // addw FC_RETOP, a0, a1
+			});
+			break;
+		case t_ORb:
+			gen_fill_call_slots(pos, {
+				OR(FC_RETOP, HOST_a0, HOST_a1),        // or FC_RETOP, a0, a1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_ORw:
+			gen_fill_call_slots(pos, {
+				OR(FC_RETOP, HOST_a0, HOST_a1),        // or FC_RETOP, a0, a1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_ORd:
+			gen_fill_call_slots(pos, {
+				OR(FC_RETOP, HOST_a0, HOST_a1),        // or FC_RETOP, a0, a1
+			});
+			break;
+		case t_ANDb:
+			gen_fill_call_slots(pos, {
+				AND(FC_RETOP, HOST_a0, HOST_a1),       // and FC_RETOP, a0, a1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_ANDw:
+			gen_fill_call_slots(pos, {
+				AND(FC_RETOP, HOST_a0, HOST_a1),       // and FC_RETOP, a0, a1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_ANDd:
+			gen_fill_call_slots(pos, {
+				AND(FC_RETOP, HOST_a0, HOST_a1),       // and FC_RETOP, a0, a1
+			});
+			break;
+		case t_SUBb:
+			gen_fill_call_slots(pos, {
+				SUBW(FC_RETOP, HOST_a0, HOST_a1),      // subw FC_RETOP, a0, a1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_SUBw:
+			gen_fill_call_slots(pos, {
+				SUBW(FC_RETOP, HOST_a0, HOST_a1),      // subw FC_RETOP, a0, a1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_SUBd:
+			gen_fill_call_slots(pos, {
+				SUBW(FC_RETOP, HOST_a0, HOST_a1),      // subw FC_RETOP, a0, a1
+			});
+			break;
+		case t_XORb:
+			gen_fill_call_slots(pos, {
+				XOR(FC_RETOP, HOST_a0, HOST_a1),       // xor FC_RETOP, a0, a1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_XORw:
+			gen_fill_call_slots(pos, {
+				XOR(FC_RETOP, HOST_a0, HOST_a1),       // xor FC_RETOP, a0, a1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_XORd:
+			gen_fill_call_slots(pos, {
+				XOR(FC_RETOP, HOST_a0, HOST_a1),       // xor FC_RETOP, a0, a1
+			});
+			break;
+		case t_CMPb:
+		case t_CMPw:
+		case t_CMPd:
+		case t_TESTb:
+		case t_TESTw:
+		case t_TESTd:
+			gen_fill_call_slots(pos, {
+				NOP,                                   // nop
+			});
+			break;
+		case t_INCb:
+			gen_fill_call_slots(pos, {
+				ADDIW(FC_RETOP, HOST_a0, 1),           // addiw FC_RETOP, a0, #1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_INCw:
+			gen_fill_call_slots(pos, {
+				ADDIW(FC_RETOP, HOST_a0, 1),           // addiw FC_RETOP, a0, #1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_INCd:
+			gen_fill_call_slots(pos, {
+				ADDIW(FC_RETOP, HOST_a0, 1),           // addiw FC_RETOP, a0, #1
+			});
+			break;
+		case t_DECb:
+			gen_fill_call_slots(pos, {
+				ADDIW(FC_RETOP, HOST_a0, -1),          // addiw FC_RETOP, a0, #-1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_DECw:
+			gen_fill_call_slots(pos, {
+				ADDIW(FC_RETOP, HOST_a0, -1),          // addiw FC_RETOP, a0, #-1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_DECd:
+			gen_fill_call_slots(pos, {
+				ADDIW(FC_RETOP, HOST_a0, -1),          // addiw FC_RETOP, a0, #-1
+			});
+			break;
+		case t_SHLb:
+			gen_fill_call_slots(pos, {
+				SLLW(FC_RETOP, HOST_a0, HOST_a1),      // sllw FC_RETOP, a0, a1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_SHLw:
+			gen_fill_call_slots(pos, {
+				SLLW(FC_RETOP, HOST_a0, HOST_a1),      // sllw FC_RETOP, a0, a1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_SHLd:
+			gen_fill_call_slots(pos, {
+				SLLW(FC_RETOP, HOST_a0, HOST_a1),      // sllw FC_RETOP, a0, a1
+			});
+			break;
+		case t_SHRb:
+			gen_fill_call_slots(pos, {
+				ANDI(FC_RETOP, HOST_a0, 0xff),         // andi FC_RETOP, a0, #0xff
+				SRLW(FC_RETOP, FC_RETOP, HOST_a1),     // srlw FC_RETOP, FC_RETOP, a1
+			});
+			break;
+		case t_SHRw:
+			gen_fill_call_slots(pos, {
+				SLLI(FC_RETOP, HOST_a0, 48),           // slli FC_RETOP, a0, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+				SRLW(FC_RETOP, FC_RETOP, HOST_a1),     // srlw FC_RETOP, FC_RETOP, a1
+			});
+			break;
+		case t_SHRd:
+			gen_fill_call_slots(pos, {
+				SRLW(FC_RETOP, HOST_a0, HOST_a1),      // srlw FC_RETOP, a0, a1
+			});
+			break;
+		case t_SARb:
+			gen_fill_call_slots(pos, {
+				SLLI(FC_RETOP, HOST_a0, 56),           // slli FC_RETOP, a0, #56
+				SRAI(FC_RETOP, FC_RETOP, 56),          // srai FC_RETOP, FC_RETOP, #56
+				SRAW(FC_RETOP, FC_RETOP, HOST_a1),     // sraw FC_RETOP, FC_RETOP, a1
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_SARw:
+			gen_fill_call_slots(pos, {
+				SLLI(FC_RETOP, HOST_a0, 48),           // slli FC_RETOP, a0, #48
+				SRAI(FC_RETOP, FC_RETOP, 48),          // srai FC_RETOP, FC_RETOP, #48
+				SRAW(FC_RETOP, FC_RETOP, HOST_a1),     // sraw FC_RETOP, FC_RETOP, a1
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_SARd:
+			gen_fill_call_slots(pos, {
+				SRAW(FC_RETOP, HOST_a0, HOST_a1),      // sraw FC_RETOP, a0, a1
+			});
+			break;
+		case t_RORb:
+			gen_fill_call_slots(pos, {
+				ANDI(HOST_a0, HOST_a0, 0xff),          // andi a0, a0, #0xff
+				SLLI(temp1, HOST_a0, 8),               // slli temp1, a0, #8
+				OR(temp1, temp1, HOST_a0),             // or temp1, temp1, a0
+				ANDI(temp2, HOST_a1, 7),               // andi temp2, a1, #7
+				SRL(temp1, temp1, temp2),              // srl temp1, temp1, temp2
+				ANDI(FC_RETOP, temp1, 0xff),           // andi FC_RETOP, temp1, #0xff
+			});
+			break;
+		case t_RORw:
+			gen_fill_call_slots(pos, {
+				SLLI(temp1, HOST_a0, 48),              // slli temp1, a0, #48
+				SRLI(temp2, temp1, 16),                // srli temp2, temp1, #16
+				OR(temp1, temp1, temp2),               // or temp1, temp1, temp2
+				ANDI(temp2, HOST_a1, 15),              // andi temp2, a1, #15
+				SRL(temp1, temp1, temp2),              // srl temp1, temp1, temp2
+				SLLI(temp1, temp1, 16),                // slli temp1, temp1, #16
+				SRLI(FC_RETOP, temp1, 48),             // srli FC_RETOP, temp1, #48
+			});
+			break;
+		case t_RORd:
+			gen_fill_call_slots(pos, {
+				SRLW(temp1, HOST_a0, HOST_a1),         // srlw temp1, a0, a1
+				SUBW(temp2, HOST_zero, HOST_a1),       // negw temp2, a1
+				SLLW(FC_RETOP, HOST_a0, temp2),        // sllw FC_RETOP, a0, temp2
+				OR(FC_RETOP, FC_RETOP, temp1),         // or FC_RETOP, FC_RETOP, temp1
+			});
+			break;
+		case t_ROLb:
+			gen_fill_call_slots(pos, {
+				ANDI(HOST_a0, HOST_a0, 0xff),          // andi a0, a0, #0xff
+				SLLI(temp1, HOST_a0, 8),               // slli temp1, a0, #8
+				OR(temp1, temp1, HOST_a0),             // or temp1, temp1, a0
+				ANDI(temp2, HOST_a1, 7),               // andi temp2, a1, #7
+				SLL(temp1, temp1, temp2),              // sll temp1, temp1, temp2
+				SRLI(temp1, temp1, 8),                 // srli temp1, temp1, #8
+				ANDI(FC_RETOP, temp1, 0xff),           // andi FC_RETOP, temp1, #0xff
+			});
+			break;
+		case t_ROLw:
+			gen_fill_call_slots(pos, {
+				SLLI(temp1, HOST_a0, 48),              // slli temp1, a0, #48
+				SRLI(temp2, temp1, 48),                // srli temp2, temp1, #48
+				SRLI(temp1, temp1, 32),                // srli temp1, temp1, #32
+				OR(temp1, temp1, temp2),               // or temp1, temp1, temp2
+				ANDI(temp2, HOST_a1, 15),              // andi temp2, a1, #15
+				SLL(temp1, temp1, temp2),              // sll temp1, temp1, temp2
+				SRLIW(FC_RETOP, temp1, 16),            // srliw FC_RETOP, temp1, #16
+			});
+			break;
+		case t_ROLd:
+			gen_fill_call_slots(pos, {
+				SLLW(temp1, HOST_a0, HOST_a1),         // sllw temp1, a0, a1
+				SUBW(temp2, HOST_zero, HOST_a1),       // negw temp2, a1
+				SRLW(FC_RETOP, HOST_a0, temp2),        // srlw FC_RETOP, a0, temp2
+				OR(FC_RETOP, FC_RETOP, temp1),         // or FC_RETOP, FC_RETOP, temp1
+			});
+			break;
+		case t_NEGb:
+			gen_fill_call_slots(pos, {
+				SUBW(FC_RETOP, HOST_zero, HOST_a0),    // negw FC_RETOP, a0
+				ANDI(FC_RETOP, FC_RETOP, 0xff),        // andi FC_RETOP, FC_RETOP, #0xff
+			});
+			break;
+		case t_NEGw:
+			gen_fill_call_slots(pos, {
+				SUBW(FC_RETOP, HOST_zero, HOST_a0),    // negw FC_RETOP, a0
+				SLLI(FC_RETOP, FC_RETOP, 48),          // slli FC_RETOP, FC_RETOP, #48
+				SRLI(FC_RETOP, FC_RETOP, 48),          // srli FC_RETOP, FC_RETOP, #48
+			});
+			break;
+		case t_NEGd:
+			gen_fill_call_slots(pos, {
+				SUBW(FC_RETOP, HOST_zero, HOST_a0),    // negw FC_RETOP, a0
+			});
+			break;
+		case t_DSHLd:
+			gen_fill_call_slots(pos, {
+				SLLI(temp1, HOST_a0, 32),              // slli temp1, a0, #32
+				SLLI(temp2, HOST_a1, 32),              // slli temp2, a1, #32
+				SRLI(temp2, temp2, 32),                // srli temp2, temp2, #32
+				OR(temp1, temp1, temp2),               // or temp1, temp1, temp2
+				ANDI(temp2, HOST_a2, 0x1f),            // andi temp2, a2, #0x1f
+				SLL(temp1, temp1, temp2),              // sll temp1, temp1, temp2
+				SRAI(FC_RETOP, temp1, 32),             // srai FC_RETOP, temp1, #32
+			});
+			break;
+		case t_DSHRd:
+			gen_fill_call_slots(pos, {
+				SLLI(temp1, HOST_a1, 32),              // slli temp1, a1, #32
+				SLLI(temp2, HOST_a0, 32),              // slli temp2, a0, #32
+				SRLI(temp2, temp2, 32),                // srli temp2, temp2, #32
+				OR(temp1, temp1, temp2),               // or temp1, temp1, temp2
+				ANDI(temp2, HOST_a2, 0x1f),            // andi temp2, a2, #0x1f
+				SRL(temp1, temp1, temp2),              // srl temp1, temp1, temp2
+				ADDIW(FC_RETOP, temp1, 0),             // sext.w FC_RETOP, temp1
+			});
+			break;
+		default:
+			{
+				uint32_t code[RV_CALL_INSNS - 1];
+				gen_addr_fixed(code, temp1, (uint64_t)fct_ptr);
+				for (size_t i = 0; i < std::size(code); i++) {
+					cache_addd(code[i],pos+i*4);        // li temp1, #fct_ptr
+				}
+			}
+			break;
+
+	}
+#else
+	uint32_t code[RV_CALL_INSNS - 1];
+	gen_addr_fixed(code, temp1, (uint64_t)fct_ptr);
+	for (size_t i = 0; i < std::size(code); i++) {
+		cache_addd(code[i],pos+i*4);        // li temp1, #fct_ptr
+	}
+#endif
+}
+#endif
+
+static void cache_block_closing([[maybe_unused]] const uint8_t *block_start,
+                                [[maybe_unused]] Bitu block_size) { }
+
+static void cache_block_before_close(void) { }
+
+#ifdef DRC_USE_SEGS_ADDR
+
+// mov 16bit value from Segs[index] into dest_reg using FC_SEGS_ADDR (index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_seg16_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LHU(dest_reg, FC_SEGS_ADDR, index) );      // lhu dest_reg, [FC_SEGS_ADDR, #index]
+}
+
+// mov 32bit value from Segs[index] into dest_reg using FC_SEGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_seg32_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LW(dest_reg, FC_SEGS_ADDR, index) );      // lw dest_reg, [FC_SEGS_ADDR, #index]
+}
+
+// add a 32bit value from Segs[index] to a full register using FC_SEGS_ADDR (index modulo 4 must be zero)
+static void gen_add_seg32_to_reg(HostReg reg,Bitu index) {
+	cache_addd( LW(temp1, FC_SEGS_ADDR, index) );      // lw temp1, [FC_SEGS_ADDR, #index]
+	cache_addd( ADDW(reg, reg, temp1) );               // addw reg, reg, temp1
+}
+
+#endif
+
+#ifdef DRC_USE_REGS_ADDR
+
+// mov 16bit value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_regval16_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LHU(dest_reg, FC_REGS_ADDR, index) );      // lhu dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// mov 32bit value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_regval32_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LW(dest_reg, FC_REGS_ADDR, index) );      // lw dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// move a 32bit (dword==true) or 16bit (dword==false) value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (if dword==true index modulo 4 must be zero) (if dword==false index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_regword_to_reg(HostReg dest_reg,Bitu index,bool dword) {
+	if (dword) {
+		cache_addd( LW(dest_reg, FC_REGS_ADDR, index) );      // lw dest_reg, [FC_REGS_ADDR, #index]
+	} else {
+		cache_addd( LHU(dest_reg, FC_REGS_ADDR, index) );     // lhu dest_reg, [FC_REGS_ADDR, #index]
+	}
+}
+
+// move an 8bit value from cpu_regs[index]  into dest_reg using FC_REGS_ADDR
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void gen_mov_regbyte_to_reg_low(HostReg dest_reg,Bitu index) {
+	cache_addd( LBU(dest_reg, FC_REGS_ADDR, index) );      // lbu dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// move an 8bit value from cpu_regs[index]  into dest_reg using FC_REGS_ADDR
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void gen_mov_regbyte_to_reg_low_canuseword(HostReg dest_reg,Bitu index) {
+	cache_addd( LBU(dest_reg, FC_REGS_ADDR, index) );      // lbu dest_reg, [FC_REGS_ADDR, #index]
+}
+
+
+// add a 32bit value from cpu_regs[index] to a full register using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_add_regval32_to_reg(HostReg reg,Bitu index) {
+	cache_addd( LW(temp2, FC_REGS_ADDR, index) );      // lw temp2, [FC_REGS_ADDR, #index]
+	cache_addd( ADDW(reg, reg, temp2) );               // addw reg, reg, temp2
+}
+
+
+// move 16bit of register into cpu_regs[index] using FC_REGS_ADDR (index modulo 2 must be zero)
+static void gen_mov_regval16_from_reg(HostReg src_reg,Bitu index) {
+	cache_addd( SH(src_reg, FC_REGS_ADDR, index) );      // sh src_reg, [FC_REGS_ADDR, #index]
+}
+
+// move 32bit of register into cpu_regs[index] using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_regval32_from_reg(HostReg src_reg,Bitu index) {
+	cache_addd( SW(src_reg, FC_REGS_ADDR, index) );      // sw src_reg, [FC_REGS_ADDR, #index]
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of a register into cpu_regs[index] using FC_REGS_ADDR (if dword==true index modulo 4 must be zero) (if dword==false index modulo 2 must be zero)
+static void gen_mov_regword_from_reg(HostReg src_reg,Bitu index,bool dword) {
+	if (dword) {
+		cache_addd( SW(src_reg, FC_REGS_ADDR, index) );      // sw src_reg, [FC_REGS_ADDR, #index]
+	} else {
+		cache_addd( SH(src_reg, FC_REGS_ADDR, index) );      // sh src_reg, [FC_REGS_ADDR, #index]
+	}
+}
+
+// move the lowest 8bit of a register into cpu_regs[index] using FC_REGS_ADDR
+static void gen_mov_regbyte_from_reg_low(HostReg src_reg,Bitu index) {
+	cache_addd( SB(src_reg, FC_REGS_ADDR, index) );      // sb src_reg, [FC_REGS_ADDR, #index]
+}
+
+#endif
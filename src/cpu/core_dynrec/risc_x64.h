@@ -29,6 +29,12 @@
 // try to replace _simple functions by code
 #define DRC_FLAGS_INVALIDATION_DCODE
 
+// access guest memory inline through the TLB if the page is plain memory
+// (needs a scratch register besides FC_OP1/FC_OP2, so not on Win64)
+#if !defined(_WIN64)
+#define DRC_USE_INLINE_TLB
+#endif
+
 // calling convention modifier
 #define DRC_CALL_CONV	/* nothing */
 #define DRC_FC			/* nothing */
@@ -599,6 +605,65 @@ static void gen_fill_branch_long(const uint8_t* data) {
 	cache_addd((uint32_t)(cache.pos-data-4),data);
 }
 
+#ifdef DRC_USE_INLINE_TLB
+// short unconditional jump (+-127 bytes)
+// the destination is set by gen_fill_branch() later
+static const uint8_t* gen_create_jump(void) {
+	cache_addw(0x00eb);		// jmp addr
+	return (cache.pos-1);
+}
+
+// look up the linear address in FC_OP1 in paging.tlb.read/write and leave
+// the host base of the page in rax. Branches to the returned locations
+// (crossing may be nullptr) have to be filled in with the slow path that
+// calls the memory helper function instead.
+static const uint8_t* gen_tlb_lookup(bool write,Bitu size,const uint8_t** crossing) {
+	// the full register is used for addressing, clear the upper 32bit
+	cache_addw(0xc08b+((FC_OP1+(FC_OP1<<3))<<8));		// mov FC_OP1,FC_OP1
+	cache_addw(0xc88b+(FC_OP1<<8));		// mov ecx,FC_OP1
+	if (size>1) {
+		// page index in the low 20bit, page offset in the upper 12bit
+		cache_addw(0xc9c1);		// ror ecx,12
+		cache_addb(0x0c);
+		cache_addw(0xf981);		// cmp ecx,0xffd00000/0xfff00000
+		cache_addd((size==4)?0xffd00000:0xfff00000);
+		cache_addw(0x0073);		// jae crossing
+		*crossing=cache.pos-1;
+		cache_addw(0xe181);		// and ecx,0x000fffff
+		cache_addd(0x000fffff);
+	} else {
+		cache_addw(0xe9c1);		// shr ecx,12
+		cache_addb(0x0c);
+		*crossing=nullptr;
+	}
+	cache_addw(0xb848);		// mov rax,&paging.tlb.read/write[0]
+	cache_addq((uint64_t)(write ? &paging.tlb.write[0] : &paging.tlb.read[0]));
+	cache_addd(0xc8048b48);		// mov rax,[rax+rcx*8]
+	cache_addb(0x48);		// test rax,rax
+	cache_addw(0xc085);
+	cache_addw(0x0074);		// jz unmapped
+	return (cache.pos-1);
+}
+
+// read size bytes from [rax+FC_OP1] into dest_reg after a successful lookup
+static void gen_tlb_read_host(HostReg dest_reg,Bitu size) {
+	if (size==4) cache_addb(0x8b);		// mov dest_reg,[rax+FC_OP1]
+	else cache_addw((size==2)?0xb70f:0xb60f);		// movzx dest_reg,word/byte [rax+FC_OP1]
+	cache_addb(0x04+(dest_reg<<3));
+	cache_addb(FC_OP1<<3);
+}
+
+// write size bytes of src_reg to [rax+FC_OP1] after a successful lookup
+static void gen_tlb_write_host(HostReg src_reg,Bitu size) {
+	if (size==2) cache_addb(0x66);
+	// sil/dil are only byte-accessible with a REX prefix
+	if ((size==1) && (src_reg>=4)) cache_addb(0x40);
+	cache_addb((size==1)?0x88:0x89);		// mov [rax+FC_OP1],src_reg
+	cache_addb(0x04+(src_reg<<3));
+	cache_addb(FC_OP1<<3);
+}
+#endif
+
 static void gen_run_code(void) {
 	cache_addw(0x5355);     // push rbp,rbx
 	cache_addb(0x56);       // push rsi
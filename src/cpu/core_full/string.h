@@ -96,47 +96,32 @@
 		}
 		break;
 	case R_STOSB:
-		for (;count>0;count--) {
-			SaveMb(di_base+di_index,reg_al);
-			di_index=(di_index+add_index) & add_mask;
-		}
+		string_rep_stos<uint8_t>(di_base, di_index, add_mask, add_index, count, reg_al,
+		                         [](const PhysPt address) { SaveMb(address, reg_al); });
 		break;
 	case R_STOSW:
 		add_index *= 2;
-		for (;count>0;count--) {
-			SaveMw(di_base+di_index,reg_ax);
-			di_index=(di_index+add_index) & add_mask;
-		}
+		string_rep_stos<uint16_t>(di_base, di_index, add_mask, add_index, count, reg_ax,
+		                          [](const PhysPt address) { SaveMw(address, reg_ax); });
 		break;
 	case R_STOSD:
 		add_index *= 4;
-		for (;count>0;count--) {
-			SaveMd(di_base+di_index,reg_eax);
-			di_index=(di_index+add_index) & add_mask;
-		}
+		string_rep_stos<uint32_t>(di_base, di_index, add_mask, add_index, count, reg_eax,
+		                          [](const PhysPt address) { SaveMd(address, reg_eax); });
 		break;
 	case R_MOVSB:
-		for (;count>0;count--) {
-			SaveMb(di_base+di_index,LoadMb(si_base+si_index));
-			di_index=(di_index+add_index) & add_mask;
-			si_index=(si_index+add_index) & add_mask;
-		}
+		string_rep_movs(si_base, si_index, di_base, di_index, add_mask, add_index, count,
+		                [](const PhysPt src, const PhysPt dst) { SaveMb(dst, LoadMb(src)); });
 		break;
 	case R_MOVSW:
 		add_index *= 2;
-		for (;count>0;count--) {
-			SaveMw(di_base+di_index,LoadMw(si_base+si_index));
-			di_index=(di_index+add_index) & add_mask;
-			si_index=(si_index+add_index) & add_mask;
-		}
+		string_rep_movs(si_base, si_index, di_base, di_index, add_mask, add_index, count,
+		                [](const PhysPt src, const PhysPt dst) { SaveMw(dst, LoadMw(src)); });
 		break;
 	case R_MOVSD:
 		add_index *= 4;
-		for (;count>0;count--) {
-			SaveMd(di_base+di_index,LoadMd(si_base+si_index));
-			di_index=(di_index+add_index) & add_mask;
-			si_index=(si_index+add_index) & add_mask;
-		}
+		string_rep_movs(si_base, si_index, di_base, di_index, add_mask, add_index, count,
+		                [](const PhysPt src, const PhysPt dst) { SaveMd(dst, LoadMd(src)); });
 		break;
 	case R_LODSB:
 		for (;count>0;count--) {
@@ -17,6 +17,8 @@
  */
 #include "dosbox.h"
 
+#include <cstring>
+
 #include "callback.h"
 #include "cpu.h"
 #include "fpu.h"
@@ -35,17 +37,17 @@
 #define LoadMb(off) mem_readb(off)
 #define LoadMw(off) mem_readw(off)
 #define LoadMd(off) mem_readd(off)
-#define SaveMb(off,val)	mem_writeb(off,val)
-#define SaveMw(off,val)	mem_writew(off,val)
-#define SaveMd(off,val)	mem_writed(off,val)
+#define StoreMb(off,val)	mem_writeb(off,val)
+#define StoreMw(off,val)	mem_writew(off,val)
+#define StoreMd(off,val)	mem_writed(off,val)
 #else 
 #include "paging.h"
 #define LoadMb(off) mem_readb_inline(off)
 #define LoadMw(off) mem_readw_inline(off)
 #define LoadMd(off) mem_readd_inline(off)
-#define SaveMb(off,val)	mem_writeb_inline(off,val)
-#define SaveMw(off,val)	mem_writew_inline(off,val)
-#define SaveMd(off,val)	mem_writed_inline(off,val)
+#define StoreMb(off,val)	mem_writeb_inline(off,val)
+#define StoreMw(off,val)	mem_writew_inline(off,val)
+#define StoreMd(off,val)	mem_writed_inline(off,val)
 #endif
 
 extern Bitu cycle_count;
@@ -81,9 +83,12 @@ extern Bitu cycle_count;
 	core.ea_table=&EATable[(core.prefixes&1) * 256];	\
 	goto restart_opcode;
 
+// A repeated string instruction only writes its registers back at the end,
+// so one interrupted by a page fault can't be rewound
 #define DO_PREFIX_REP(_ZERO)				\
 	core.prefixes|=PREFIX_REP;				\
 	core.rep_zero=_ZERO;					\
+	restart_point.valid=false;				\
 	goto restart_opcode;
 
 typedef PhysPt (*GetEAHandler)(void);
@@ -98,35 +103,138 @@ static struct {
 	bool rep_zero;
 	Bitu prefixes;
 	GetEAHandler * ea_table;
+	// Host view of the code page the current instruction started in, or
+	// nullptr when that page is not backed by directly readable memory.
+	HostPt fetch_host;
+	PhysPt fetch_page;
 } core;
 
+// The state the current instruction started from, kept while the guest is
+// taking page faults so that a fault can rewind the instruction (see
+// paging.h)
+static struct {
+	CPU_Regs regs = {};
+	LazyFlags lflags = {};
+	uint16_t seg_values[8] = {};
+	Bitu cpl = 0;
+	int run_depth = 0;
+	bool valid = false;
+} restart_point = {};
+
+static inline void SaveRestartPoint() {
+	restart_point.regs = cpu_regs;
+	restart_point.lflags = lflags;
+	memcpy(restart_point.seg_values, Segs.val, sizeof(Segs.val));
+	restart_point.cpl = cpu.cpl;
+	restart_point.valid = true;
+}
+
+bool CPU_Core_Normal_CanRestart()
+{
+	// Not from a loop nested in the instruction, nor once the instruction
+	// has loaded a segment or changed privilege, which rewinding wouldn't
+	// undo
+	return restart_point.valid &&
+	       restart_point.run_depth == DOSBOX_GetRunDepth() &&
+	       restart_point.cpl == cpu.cpl &&
+	       memcmp(restart_point.seg_values, Segs.val, sizeof(Segs.val)) == 0;
+}
+
+// Once an instruction has written memory it can't be rewound, as running it
+// again could work on what it already wrote (e.g. a read-modify-write).
+// Unaligned writes go out a byte at a time, so one crossing into the next
+// page gives up the restart point before its first byte is written.
+static inline void BeginWrite(PhysPt off, Bitu bytes) {
+	if ((off & 0xfff) + bytes > 0x1000) restart_point.valid=false;
+}
+
+static inline void SaveMb(PhysPt off, uint8_t val) {
+	StoreMb(off,val);
+	restart_point.valid=false;
+}
+
+static inline void SaveMw(PhysPt off, uint16_t val) {
+	BeginWrite(off,2);
+	StoreMw(off,val);
+	restart_point.valid=false;
+}
+
+static inline void SaveMd(PhysPt off, uint32_t val) {
+	BeginWrite(off,4);
+	StoreMd(off,val);
+	restart_point.valid=false;
+}
+
+static inline void Push_16(Bitu val) {
+	BeginWrite(SegPhys(ss)+((reg_esp-2)&cpu.stack.mask),2);
+	CPU_Push16(val);
+	restart_point.valid=false;
+}
+
+static inline void Push_32(Bitu val) {
+	BeginWrite(SegPhys(ss)+((reg_esp-4)&cpu.stack.mask),4);
+	CPU_Push32(val);
+	restart_point.valid=false;
+}
+
+// ENTER and the FPU's memory forms write several places, so they never
+// rewind
+static void EnterFrame(bool use32, Bitu bytes, Bitu level) {
+	restart_point.valid=false;
+	CPU_ENTER(use32,bytes,level);
+}
+#define CPU_ENTER EnterFrame
+
 #define GETIP		(core.cseip-SegBase(cs))
 #define SAVEIP		reg_eip=GETIP;
-#define LOADIP		core.cseip=(SegBase(cs)+reg_eip);
+#define LOADIP		do {											\
+		core.cseip=(SegBase(cs)+reg_eip);							\
+		LoadFetchPage();											\
+	} while (0)
+
+// Resolve the code page once per instruction so that the opcode, ModRM and
+// immediate fetches can read guest memory without going through the TLB
+// for every byte. The page's host memory is read directly, so writes to
+// the code (self-modifying code) are seen without further invalidation;
+// fetches that leave the page fall back to the regular memory path.
+static inline void LoadFetchPage() {
+	core.fetch_page = core.cseip & ~static_cast<PhysPt>(0xfff);
+	core.fetch_host = get_tlb_read(core.cseip);
+}
+
+template <typename T>
+static inline bool CanFetchDirect() {
+	return core.fetch_host &&
+	       (core.cseip - core.fetch_page) <= (0x1000 - sizeof(T));
+}
 
 #define SegBase(c)	SegPhys(c)
 #define BaseDS		core.base_ds
 #define BaseSS		core.base_ss
 
 static inline uint8_t Fetchb() {
-	uint8_t temp=LoadMb(core.cseip);
+	uint8_t temp = CanFetchDirect<uint8_t>()
+	                       ? host_readb(core.fetch_host + core.cseip)
+	                       : LoadMb(core.cseip);
 	core.cseip+=1;
 	return temp;
 }
 
 static inline uint16_t Fetchw() {
-	uint16_t temp=LoadMw(core.cseip);
+	uint16_t temp = CanFetchDirect<uint16_t>()
+	                        ? host_readw(core.fetch_host + core.cseip)
+	                        : LoadMw(core.cseip);
 	core.cseip+=2;
 	return temp;
 }
 static inline uint32_t Fetchd() {
-	uint32_t temp=LoadMd(core.cseip);
+	uint32_t temp = CanFetchDirect<uint32_t>()
+	                        ? host_readd(core.fetch_host + core.cseip)
+	                        : LoadMd(core.cseip);
 	core.cseip+=4;
 	return temp;
 }
 
-#define Push_16 CPU_Push16
-#define Push_32 CPU_Push32
 #define Pop_16 CPU_Pop16
 #define Pop_32 CPU_Pop32
 
@@ -134,11 +242,21 @@ static inline uint32_t Fetchd() {
 #include "core_normal/support.h"
 #include "core_normal/string.h"
 
+#undef FPU_ESC
+#define FPU_ESC(code) {														\
+	uint8_t rm=Fetchb();														\
+	if (rm >= 0xc0) {															\
+		FPU_ESC ## code ## _Normal(rm);										\
+	} else {																\
+		restart_point.valid=false;											\
+		GetEAa;FPU_ESC ## code ## _EA(rm,eaa);								\
+	}																		\
+}
+
 
 #define EALookupTable (core.ea_table)
 
-Bits CPU_Core_Normal_Run(void) {
-	ZoneScoped
+static Bits RunInstructions(const bool keep_restart_points) {
 	while (CPU_Cycles-->0) {
 		LOADIP;
 		core.opcode_index=cpu.code.big*0x200;
@@ -147,6 +265,8 @@ Bits CPU_Core_Normal_Run(void) {
 		BaseDS=SegBase(ds);
 		BaseSS=SegBase(ss);
 		core.base_val_ds=ds;
+		if (keep_restart_points)
+			SaveRestartPoint();
 #if C_DEBUG
 #if C_HEAVY_DEBUG
 		if (DEBUG_HeavyIsBreakpoint()) {
@@ -190,6 +310,28 @@ decode_end:
 	return CBRET_NONE;
 }
 
+Bits CPU_Core_Normal_Run(void) {
+	ZoneScoped
+	// Keeping the restart points costs every instruction a little, so it's
+	// only done while the guest is taking page faults
+	const bool keep_restart_points = paging.enabled && PAGING_HadRecentFaults();
+	restart_point.run_depth = DOSBOX_GetRunDepth();
+	while (true) {
+		try {
+			const auto ret = RunInstructions(keep_restart_points);
+			restart_point.valid = false;
+			return ret;
+		} catch (const GuestPageFault &fault) {
+			// The guest's handler returns to the start of the
+			// instruction, which then runs again
+			cpu_regs = restart_point.regs;
+			lflags = restart_point.lflags;
+			restart_point.valid = false;
+			CPU_Exception(EXCEPTION_PF, fault.error_code);
+		}
+	}
+}
+
 Bits CPU_Core_Normal_Trap_Run(void) {
 	Bits oldCycles = CPU_Cycles;
 	CPU_Cycles = 1;
@@ -20,6 +20,10 @@
 #define GetEAa												\
 	PhysPt eaa=EALookupTable[rm]();					
 
+/* Same as GetEAa with the 16bit address decoding inlined */
+#define GetEAaInline										\
+	PhysPt eaa=TEST_PREFIX_ADDR ? EALookupTable[rm]() : EA_16_Inline(rm);
+
 #define GetRMEAa											\
 	GetRM;													\
 	GetEAa;											
@@ -304,14 +304,14 @@
 		{	
 			GetRMrd;
 			if (rm >= 0xc0 ) {GetEArd;*eard=*rmrd;}
-			else {GetEAa;SaveMd(eaa,*rmrd);}
+			else {GetEAaInline;SaveMd(eaa,*rmrd);}
 			break;
 		}
 	CASE_D(0x8b)												/* MOV Gd,Ed */
 		{	
 			GetRMrd;
 			if (rm >= 0xc0 ) {GetEArd;*rmrd=*eard;}
-			else {GetEAa;*rmrd=LoadMd(eaa);}
+			else {GetEAaInline;*rmrd=LoadMd(eaa);}
 			break;
 		}
 	CASE_D(0x8c)												/* Mov Ew,Sw */
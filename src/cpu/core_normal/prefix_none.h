@@ -442,7 +442,7 @@
 						}
 					}
 				}
-				GetEAa;SaveMb(eaa,*rmrb);
+				GetEAaInline;SaveMb(eaa,*rmrb);
 			}
 			break;
 		}
@@ -450,21 +450,21 @@
 		{	
 			GetRMrw;
 			if (rm >= 0xc0 ) {GetEArw;*earw=*rmrw;}
-			else {GetEAa;SaveMw(eaa,*rmrw);}
+			else {GetEAaInline;SaveMw(eaa,*rmrw);}
 			break;
 		}
 	CASE_B(0x8a)												/* MOV Gb,Eb */
 		{	
 			GetRMrb;
 			if (rm >= 0xc0 ) {GetEArb;*rmrb=*earb;}
-			else {GetEAa;*rmrb=LoadMb(eaa);}
+			else {GetEAaInline;*rmrb=LoadMb(eaa);}
 			break;
 		}
 	CASE_W(0x8b)												/* MOV Gw,Ew */
 		{	
 			GetRMrw;
 			if (rm >= 0xc0 ) {GetEArw;*rmrw=*earw;}
-			else {GetEAa;*rmrw=LoadMw(eaa);}
+			else {GetEAaInline;*rmrw=LoadMw(eaa);}
 			break;
 		}
 	CASE_W(0x8c)												/* Mov Ew,Sw */
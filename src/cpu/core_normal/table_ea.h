@@ -16,35 +16,40 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <array>
+#include <utility>
+
 typedef PhysPt (*EA_LookupHandler)(void);
 
-/* The MOD/RM Decoder for EA for this decoder's addressing modes */
-static PhysPt EA_16_00_n(void) { return BaseDS+(uint16_t)(reg_bx+(int16_t)reg_si); }
-static PhysPt EA_16_01_n(void) { return BaseDS+(uint16_t)(reg_bx+(int16_t)reg_di); }
-static PhysPt EA_16_02_n(void) { return BaseSS+(uint16_t)(reg_bp+(int16_t)reg_si); }
-static PhysPt EA_16_03_n(void) { return BaseSS+(uint16_t)(reg_bp+(int16_t)reg_di); }
-static PhysPt EA_16_04_n() { return BaseDS + reg_si; }
-static PhysPt EA_16_05_n() { return BaseDS + reg_di; }
-static PhysPt EA_16_06_n() { return BaseDS + Fetchw(); }
-static PhysPt EA_16_07_n() { return BaseDS + reg_bx; }
-
-static PhysPt EA_16_40_n(void) { return BaseDS+(uint16_t)(reg_bx+(int16_t)reg_si+Fetchbs()); }
-static PhysPt EA_16_41_n(void) { return BaseDS+(uint16_t)(reg_bx+(int16_t)reg_di+Fetchbs()); }
-static PhysPt EA_16_42_n(void) { return BaseSS+(uint16_t)(reg_bp+(int16_t)reg_si+Fetchbs()); }
-static PhysPt EA_16_43_n(void) { return BaseSS+(uint16_t)(reg_bp+(int16_t)reg_di+Fetchbs()); }
-static PhysPt EA_16_44_n(void) { return BaseDS+(uint16_t)(reg_si+Fetchbs()); }
-static PhysPt EA_16_45_n(void) { return BaseDS+(uint16_t)(reg_di+Fetchbs()); }
-static PhysPt EA_16_46_n(void) { return BaseSS+(uint16_t)(reg_bp+Fetchbs()); }
-static PhysPt EA_16_47_n(void) { return BaseDS+(uint16_t)(reg_bx+Fetchbs()); }
-
-static PhysPt EA_16_80_n(void) { return BaseDS+(uint16_t)(reg_bx+(int16_t)reg_si+Fetchws()); }
-static PhysPt EA_16_81_n(void) { return BaseDS+(uint16_t)(reg_bx+(int16_t)reg_di+Fetchws()); }
-static PhysPt EA_16_82_n(void) { return BaseSS+(uint16_t)(reg_bp+(int16_t)reg_si+Fetchws()); }
-static PhysPt EA_16_83_n(void) { return BaseSS+(uint16_t)(reg_bp+(int16_t)reg_di+Fetchws()); }
-static PhysPt EA_16_84_n(void) { return BaseDS+(uint16_t)(reg_si+Fetchws()); }
-static PhysPt EA_16_85_n(void) { return BaseDS+(uint16_t)(reg_di+Fetchws()); }
-static PhysPt EA_16_86_n(void) { return BaseSS+(uint16_t)(reg_bp+Fetchws()); }
-static PhysPt EA_16_87_n(void) { return BaseDS+(uint16_t)(reg_bx+Fetchws()); }
+/* The MOD/RM Decoder for EA for this decoder's addressing modes.
+ * One template per address size covers all mod/rm combinations,
+ * the lookup tables below are generated from them at compile time. */
+
+// base register (sum) of the 16bit addressing modes
+template <unsigned rm>
+static inline int EA_16_Base()
+{
+	if constexpr (rm == 0) return reg_bx + (int16_t)reg_si;
+	else if constexpr (rm == 1) return reg_bx + (int16_t)reg_di;
+	else if constexpr (rm == 2) return reg_bp + (int16_t)reg_si;
+	else if constexpr (rm == 3) return reg_bp + (int16_t)reg_di;
+	else if constexpr (rm == 4) return reg_si;
+	else if constexpr (rm == 5) return reg_di;
+	else if constexpr (rm == 6) return reg_bp;
+	else return reg_bx;
+}
+
+template <unsigned mod, unsigned rm>
+static PhysPt EA_16()
+{
+	static_assert(mod < 3 && rm < 8);
+	// modes based on bp default to the stack segment
+	constexpr bool stack = (rm == 2) || (rm == 3) || (rm == 6);
+	if constexpr (mod == 0 && rm == 6) return BaseDS + Fetchw();
+	else if constexpr (mod == 0) return (stack ? BaseSS : BaseDS) + (uint16_t)EA_16_Base<rm>();
+	else if constexpr (mod == 1) return (stack ? BaseSS : BaseDS) + (uint16_t)(EA_16_Base<rm>() + Fetchbs());
+	else return (stack ? BaseSS : BaseDS) + (uint16_t)(EA_16_Base<rm>() + Fetchws());
+}
 
 static uint32_t SIBZero=0;
 static uint32_t * SIBIndex[8]= { &reg_eax,&reg_ecx,&reg_edx,&reg_ebx,&SIBZero,&reg_ebp,&reg_esi,&reg_edi };
@@ -78,101 +83,79 @@ static inline PhysPt Sib(Bitu mode) {
 	return base;
 }
 
-static PhysPt EA_32_00_n(void) { return BaseDS+reg_eax; }
-static PhysPt EA_32_01_n(void) { return BaseDS+reg_ecx; }
-static PhysPt EA_32_02_n(void) { return BaseDS+reg_edx; }
-static PhysPt EA_32_03_n(void) { return BaseDS+reg_ebx; }
-static PhysPt EA_32_04_n(void) { return Sib(0);}
-static PhysPt EA_32_05_n(void) { return BaseDS+Fetchd(); }
-static PhysPt EA_32_06_n(void) { return BaseDS+reg_esi; }
-static PhysPt EA_32_07_n(void) { return BaseDS+reg_edi; }
-
-static PhysPt EA_32_40_n(void) { return BaseDS+reg_eax+Fetchbs(); }
-static PhysPt EA_32_41_n(void) { return BaseDS+reg_ecx+Fetchbs(); }
-static PhysPt EA_32_42_n(void) { return BaseDS+reg_edx+Fetchbs(); }
-static PhysPt EA_32_43_n(void) { return BaseDS+reg_ebx+Fetchbs(); }
-static PhysPt EA_32_44_n(void) { PhysPt temp=Sib(1);return temp+Fetchbs();}
-//static PhysPt EA_32_44_n(void) { return Sib(1)+Fetchbs();}
-static PhysPt EA_32_45_n(void) { return BaseSS+reg_ebp+Fetchbs(); }
-static PhysPt EA_32_46_n(void) { return BaseDS+reg_esi+Fetchbs(); }
-static PhysPt EA_32_47_n(void) { return BaseDS+reg_edi+Fetchbs(); }
-
-static PhysPt EA_32_80_n(void) { return BaseDS+reg_eax+Fetchds(); }
-static PhysPt EA_32_81_n(void) { return BaseDS+reg_ecx+Fetchds(); }
-static PhysPt EA_32_82_n(void) { return BaseDS+reg_edx+Fetchds(); }
-static PhysPt EA_32_83_n(void) { return BaseDS+reg_ebx+Fetchds(); }
-static PhysPt EA_32_84_n(void) { PhysPt temp=Sib(2);return temp+Fetchds();}
-//static PhysPt EA_32_84_n(void) { return Sib(2)+Fetchds();}
-static PhysPt EA_32_85_n(void) { return BaseSS+reg_ebp+Fetchds(); }
-static PhysPt EA_32_86_n(void) { return BaseDS+reg_esi+Fetchds(); }
-static PhysPt EA_32_87_n(void) { return BaseDS+reg_edi+Fetchds(); }
-
-static GetEAHandler EATable[512]={
-/* 00 */
-	EA_16_00_n,EA_16_01_n,EA_16_02_n,EA_16_03_n,EA_16_04_n,EA_16_05_n,EA_16_06_n,EA_16_07_n,
-	EA_16_00_n,EA_16_01_n,EA_16_02_n,EA_16_03_n,EA_16_04_n,EA_16_05_n,EA_16_06_n,EA_16_07_n,
-	EA_16_00_n,EA_16_01_n,EA_16_02_n,EA_16_03_n,EA_16_04_n,EA_16_05_n,EA_16_06_n,EA_16_07_n,
-	EA_16_00_n,EA_16_01_n,EA_16_02_n,EA_16_03_n,EA_16_04_n,EA_16_05_n,EA_16_06_n,EA_16_07_n,
-	EA_16_00_n,EA_16_01_n,EA_16_02_n,EA_16_03_n,EA_16_04_n,EA_16_05_n,EA_16_06_n,EA_16_07_n,
-	EA_16_00_n,EA_16_01_n,EA_16_02_n,EA_16_03_n,EA_16_04_n,EA_16_05_n,EA_16_06_n,EA_16_07_n,
-	EA_16_00_n,EA_16_01_n,EA_16_02_n,EA_16_03_n,EA_16_04_n,EA_16_05_n,EA_16_06_n,EA_16_07_n,
-	EA_16_00_n,EA_16_01_n,EA_16_02_n,EA_16_03_n,EA_16_04_n,EA_16_05_n,EA_16_06_n,EA_16_07_n,
-/* 01 */
-	EA_16_40_n,EA_16_41_n,EA_16_42_n,EA_16_43_n,EA_16_44_n,EA_16_45_n,EA_16_46_n,EA_16_47_n,
-	EA_16_40_n,EA_16_41_n,EA_16_42_n,EA_16_43_n,EA_16_44_n,EA_16_45_n,EA_16_46_n,EA_16_47_n,
-	EA_16_40_n,EA_16_41_n,EA_16_42_n,EA_16_43_n,EA_16_44_n,EA_16_45_n,EA_16_46_n,EA_16_47_n,
-	EA_16_40_n,EA_16_41_n,EA_16_42_n,EA_16_43_n,EA_16_44_n,EA_16_45_n,EA_16_46_n,EA_16_47_n,
-	EA_16_40_n,EA_16_41_n,EA_16_42_n,EA_16_43_n,EA_16_44_n,EA_16_45_n,EA_16_46_n,EA_16_47_n,
-	EA_16_40_n,EA_16_41_n,EA_16_42_n,EA_16_43_n,EA_16_44_n,EA_16_45_n,EA_16_46_n,EA_16_47_n,
-	EA_16_40_n,EA_16_41_n,EA_16_42_n,EA_16_43_n,EA_16_44_n,EA_16_45_n,EA_16_46_n,EA_16_47_n,
-	EA_16_40_n,EA_16_41_n,EA_16_42_n,EA_16_43_n,EA_16_44_n,EA_16_45_n,EA_16_46_n,EA_16_47_n,
-/* 10 */
-	EA_16_80_n,EA_16_81_n,EA_16_82_n,EA_16_83_n,EA_16_84_n,EA_16_85_n,EA_16_86_n,EA_16_87_n,
-	EA_16_80_n,EA_16_81_n,EA_16_82_n,EA_16_83_n,EA_16_84_n,EA_16_85_n,EA_16_86_n,EA_16_87_n,
-	EA_16_80_n,EA_16_81_n,EA_16_82_n,EA_16_83_n,EA_16_84_n,EA_16_85_n,EA_16_86_n,EA_16_87_n,
-	EA_16_80_n,EA_16_81_n,EA_16_82_n,EA_16_83_n,EA_16_84_n,EA_16_85_n,EA_16_86_n,EA_16_87_n,
-	EA_16_80_n,EA_16_81_n,EA_16_82_n,EA_16_83_n,EA_16_84_n,EA_16_85_n,EA_16_86_n,EA_16_87_n,
-	EA_16_80_n,EA_16_81_n,EA_16_82_n,EA_16_83_n,EA_16_84_n,EA_16_85_n,EA_16_86_n,EA_16_87_n,
-	EA_16_80_n,EA_16_81_n,EA_16_82_n,EA_16_83_n,EA_16_84_n,EA_16_85_n,EA_16_86_n,EA_16_87_n,
-	EA_16_80_n,EA_16_81_n,EA_16_82_n,EA_16_83_n,EA_16_84_n,EA_16_85_n,EA_16_86_n,EA_16_87_n,
-/* 11 These are illegal so make em 0 */
-	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,
-	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,
-	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,
-	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,
-/* 00 */
-	EA_32_00_n,EA_32_01_n,EA_32_02_n,EA_32_03_n,EA_32_04_n,EA_32_05_n,EA_32_06_n,EA_32_07_n,
-	EA_32_00_n,EA_32_01_n,EA_32_02_n,EA_32_03_n,EA_32_04_n,EA_32_05_n,EA_32_06_n,EA_32_07_n,
-	EA_32_00_n,EA_32_01_n,EA_32_02_n,EA_32_03_n,EA_32_04_n,EA_32_05_n,EA_32_06_n,EA_32_07_n,
-	EA_32_00_n,EA_32_01_n,EA_32_02_n,EA_32_03_n,EA_32_04_n,EA_32_05_n,EA_32_06_n,EA_32_07_n,
-	EA_32_00_n,EA_32_01_n,EA_32_02_n,EA_32_03_n,EA_32_04_n,EA_32_05_n,EA_32_06_n,EA_32_07_n,
-	EA_32_00_n,EA_32_01_n,EA_32_02_n,EA_32_03_n,EA_32_04_n,EA_32_05_n,EA_32_06_n,EA_32_07_n,
-	EA_32_00_n,EA_32_01_n,EA_32_02_n,EA_32_03_n,EA_32_04_n,EA_32_05_n,EA_32_06_n,EA_32_07_n,
-	EA_32_00_n,EA_32_01_n,EA_32_02_n,EA_32_03_n,EA_32_04_n,EA_32_05_n,EA_32_06_n,EA_32_07_n,
-/* 01 */
-	EA_32_40_n,EA_32_41_n,EA_32_42_n,EA_32_43_n,EA_32_44_n,EA_32_45_n,EA_32_46_n,EA_32_47_n,
-	EA_32_40_n,EA_32_41_n,EA_32_42_n,EA_32_43_n,EA_32_44_n,EA_32_45_n,EA_32_46_n,EA_32_47_n,
-	EA_32_40_n,EA_32_41_n,EA_32_42_n,EA_32_43_n,EA_32_44_n,EA_32_45_n,EA_32_46_n,EA_32_47_n,
-	EA_32_40_n,EA_32_41_n,EA_32_42_n,EA_32_43_n,EA_32_44_n,EA_32_45_n,EA_32_46_n,EA_32_47_n,
-	EA_32_40_n,EA_32_41_n,EA_32_42_n,EA_32_43_n,EA_32_44_n,EA_32_45_n,EA_32_46_n,EA_32_47_n,
-	EA_32_40_n,EA_32_41_n,EA_32_42_n,EA_32_43_n,EA_32_44_n,EA_32_45_n,EA_32_46_n,EA_32_47_n,
-	EA_32_40_n,EA_32_41_n,EA_32_42_n,EA_32_43_n,EA_32_44_n,EA_32_45_n,EA_32_46_n,EA_32_47_n,
-	EA_32_40_n,EA_32_41_n,EA_32_42_n,EA_32_43_n,EA_32_44_n,EA_32_45_n,EA_32_46_n,EA_32_47_n,
-/* 10 */
-	EA_32_80_n,EA_32_81_n,EA_32_82_n,EA_32_83_n,EA_32_84_n,EA_32_85_n,EA_32_86_n,EA_32_87_n,
-	EA_32_80_n,EA_32_81_n,EA_32_82_n,EA_32_83_n,EA_32_84_n,EA_32_85_n,EA_32_86_n,EA_32_87_n,
-	EA_32_80_n,EA_32_81_n,EA_32_82_n,EA_32_83_n,EA_32_84_n,EA_32_85_n,EA_32_86_n,EA_32_87_n,
-	EA_32_80_n,EA_32_81_n,EA_32_82_n,EA_32_83_n,EA_32_84_n,EA_32_85_n,EA_32_86_n,EA_32_87_n,
-	EA_32_80_n,EA_32_81_n,EA_32_82_n,EA_32_83_n,EA_32_84_n,EA_32_85_n,EA_32_86_n,EA_32_87_n,
-	EA_32_80_n,EA_32_81_n,EA_32_82_n,EA_32_83_n,EA_32_84_n,EA_32_85_n,EA_32_86_n,EA_32_87_n,
-	EA_32_80_n,EA_32_81_n,EA_32_82_n,EA_32_83_n,EA_32_84_n,EA_32_85_n,EA_32_86_n,EA_32_87_n,
-	EA_32_80_n,EA_32_81_n,EA_32_82_n,EA_32_83_n,EA_32_84_n,EA_32_85_n,EA_32_86_n,EA_32_87_n,
-/* 11 These are illegal so make em 0 */
-	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,
-	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,
-	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,
-	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0,	0
-};
+template <unsigned rm>
+static inline uint32_t EA_32_Base()
+{
+	if constexpr (rm == 0) return reg_eax;
+	else if constexpr (rm == 1) return reg_ecx;
+	else if constexpr (rm == 2) return reg_edx;
+	else if constexpr (rm == 3) return reg_ebx;
+	else if constexpr (rm == 5) return reg_ebp;
+	else if constexpr (rm == 6) return reg_esi;
+	else return reg_edi;
+}
+
+template <unsigned mod, unsigned rm>
+static PhysPt EA_32()
+{
+	static_assert(mod < 3 && rm < 8);
+	if constexpr (rm == 4) {
+		// the SIB byte comes before the displacement
+		const PhysPt base = Sib(mod);
+		if constexpr (mod == 0) return base;
+		else if constexpr (mod == 1) return base + Fetchbs();
+		else return base + Fetchds();
+	} else if constexpr (mod == 0 && rm == 5) {
+		return BaseDS + Fetchd();
+	} else {
+		constexpr bool stack = (rm == 5);
+		if constexpr (mod == 0) return (stack ? BaseSS : BaseDS) + EA_32_Base<rm>();
+		else if constexpr (mod == 1) return (stack ? BaseSS : BaseDS) + EA_32_Base<rm>() + Fetchbs();
+		else return (stack ? BaseSS : BaseDS) + EA_32_Base<rm>() + Fetchds();
+	}
+}
+
+// index is the address size (0/1) * 256 + the modrm byte,
+// register operands (mod 11) have no effective address
+template <size_t index>
+static constexpr EA_LookupHandler EA_Entry()
+{
+	constexpr unsigned mod = (index >> 6) & 3;
+	constexpr unsigned rm = index & 7;
+	if constexpr (mod == 3) return nullptr;
+	else if constexpr (index >= 256) return &EA_32<mod, rm>;
+	else return &EA_16<mod, rm>;
+}
+
+template <size_t... indices>
+static constexpr std::array<EA_LookupHandler, 512> EA_MakeTable(std::index_sequence<indices...>)
+{
+	return {{EA_Entry<indices>()...}};
+}
+
+static std::array<EA_LookupHandler, 512> EATable = EA_MakeTable(std::make_index_sequence<512>());
+
+// 16bit address decoding with the computation inlined into the caller,
+// used by the most frequent memory instructions instead of the table call
+static inline PhysPt EA_16_Inline(uint8_t rm)
+{
+	switch (rm & 0xc7) {
+#define EA_16_CASES(mod) \
+	case (mod << 6) + 0: return EA_16<mod, 0>(); \
+	case (mod << 6) + 1: return EA_16<mod, 1>(); \
+	case (mod << 6) + 2: return EA_16<mod, 2>(); \
+	case (mod << 6) + 3: return EA_16<mod, 3>(); \
+	case (mod << 6) + 4: return EA_16<mod, 4>(); \
+	case (mod << 6) + 5: return EA_16<mod, 5>(); \
+	case (mod << 6) + 6: return EA_16<mod, 6>(); \
+	case (mod << 6) + 7: return EA_16<mod, 7>();
+	EA_16_CASES(0)
+	EA_16_CASES(1)
+	EA_16_CASES(2)
+#undef EA_16_CASES
+	default: return EATable[rm]();
+	}
+}
 
 #define GetEADirect							\
 	PhysPt eaa;								\
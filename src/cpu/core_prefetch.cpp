@@ -37,17 +37,17 @@
 #define LoadMb(off) mem_readb(off)
 #define LoadMw(off) mem_readw(off)
 #define LoadMd(off) mem_readd(off)
-#define SaveMb(off,val)	mem_writeb(off,val)
-#define SaveMw(off,val)	mem_writew(off,val)
-#define SaveMd(off,val)	mem_writed(off,val)
+#define StoreMb(off,val)	mem_writeb(off,val)
+#define StoreMw(off,val)	mem_writew(off,val)
+#define StoreMd(off,val)	mem_writed(off,val)
 #else 
 #include "paging.h"
 #define LoadMb(off) mem_readb_inline(off)
 #define LoadMw(off) mem_readw_inline(off)
 #define LoadMd(off) mem_readd_inline(off)
-#define SaveMb(off,val)	mem_writeb_inline(off,val)
-#define SaveMw(off,val)	mem_writew_inline(off,val)
-#define SaveMd(off,val)	mem_writed_inline(off,val)
+#define StoreMb(off,val)	mem_writeb_inline(off,val)
+#define StoreMw(off,val)	mem_writew_inline(off,val)
+#define StoreMd(off,val)	mem_writed_inline(off,val)
 #endif
 
 extern Bitu cycle_count;
@@ -116,27 +116,55 @@ static uint8_t prefetch_buffer[MAX_PQ_SIZE];
 static bool pq_valid=false;
 static Bitu pq_start;
 
+// The queue only has to hold its own copy of the code once something writes
+// into it, as until then its bytes match the memory they were fetched from.
+// So the code is fetched straight from memory and only the position of the
+// queue is tracked; the first write hitting the queue fills it with the
+// bytes it was holding, and fetches use those until the queue is reloaded.
+static bool pq_filled=false;
+
+static void pq_fill() {
+	for (Bitu i=0; i<CPU_PrefetchQueueSize; i++) prefetch_buffer[i]=LoadMb(pq_start+i);
+	pq_filled=true;
+}
+
+static inline void pq_check_write(PhysPt addr,Bitu bytes) {
+	if (pq_valid && !pq_filled && (addr<pq_start+CPU_PrefetchQueueSize) &&
+		(addr+bytes>pq_start)) {
+		pq_fill();
+	}
+}
+
+// Restarts the queue at start, for instance after a jump
+static inline void pq_reload(PhysPt start) {
+	pq_start=start;
+	pq_valid=true;
+	pq_filled=false;
+}
+
+// Moves the start of the queue up to next, keeping the bytes it holds
+static void pq_advance(PhysPt next) {
+	if (pq_filled) {
+		Bitu remaining_bytes=pq_start+CPU_PrefetchQueueSize-next;
+		for (Bitu i=0; i<remaining_bytes; i++) prefetch_buffer[i]=prefetch_buffer[next-pq_start+i];
+		for (Bitu i=remaining_bytes; i<CPU_PrefetchQueueSize; i++) prefetch_buffer[i]=LoadMb(next+i);
+	}
+	pq_start=next;
+	pq_valid=true;
+}
+
 static uint8_t Fetchb() {
 	uint8_t temp;
 	if (pq_valid && (core.cseip>=pq_start) && (core.cseip<pq_start+CPU_PrefetchQueueSize)) {
-		temp=prefetch_buffer[core.cseip-pq_start];
+		temp=pq_filled ? prefetch_buffer[core.cseip-pq_start] : LoadMb(core.cseip);
 		if ((core.cseip+1>=pq_start+CPU_PrefetchQueueSize-4) &&
 			(core.cseip+1<pq_start+CPU_PrefetchQueueSize)) {
-			Bitu remaining_bytes=pq_start+CPU_PrefetchQueueSize-(core.cseip+1);
-			for (Bitu i=0; i<remaining_bytes; i++) prefetch_buffer[i]=prefetch_buffer[core.cseip+1-pq_start+i];
-			for (Bitu i=remaining_bytes; i<CPU_PrefetchQueueSize; i++) prefetch_buffer[i]=LoadMb(core.cseip+1+i);
-			pq_start=core.cseip+1;
-			pq_valid=true;
+			pq_advance(core.cseip+1);
 		}
 	} else {
-		for (Bitu i=0; i<CPU_PrefetchQueueSize; i++) prefetch_buffer[i]=LoadMb(core.cseip+i);
-		pq_start=core.cseip;
-		pq_valid=true;
-		temp=prefetch_buffer[0];
+		pq_reload(core.cseip);
+		temp=LoadMb(core.cseip);
 	}
-/*	if (temp!=LoadMb(core.cseip)) {
-		LOG_MSG("prefetch queue content!=memory at %x:%x",SegValue(cs),reg_eip);
-	} */
 	core.cseip+=1;
 	return temp;
 }
@@ -144,25 +172,20 @@ static uint8_t Fetchb() {
 static uint16_t Fetchw() {
 	uint16_t temp;
 	if (pq_valid && (core.cseip>=pq_start) && (core.cseip+2<pq_start+CPU_PrefetchQueueSize)) {
-		temp=prefetch_buffer[core.cseip-pq_start]|
-			(prefetch_buffer[core.cseip-pq_start+1]<<8);
+		if (pq_filled) {
+			temp=prefetch_buffer[core.cseip-pq_start]|
+				(prefetch_buffer[core.cseip-pq_start+1]<<8);
+		} else {
+			temp=LoadMw(core.cseip);
+		}
 		if ((core.cseip+2>=pq_start+CPU_PrefetchQueueSize-4) &&
 			(core.cseip+2<pq_start+CPU_PrefetchQueueSize)) {
-			Bitu remaining_bytes=pq_start+CPU_PrefetchQueueSize-(core.cseip+2);
-			for (Bitu i=0; i<remaining_bytes; i++) prefetch_buffer[i]=prefetch_buffer[core.cseip+2-pq_start+i];
-			for (Bitu i=remaining_bytes; i<CPU_PrefetchQueueSize; i++) prefetch_buffer[i]=LoadMb(core.cseip+2+i);
-			pq_start=core.cseip+2;
-			pq_valid=true;
+			pq_advance(core.cseip+2);
 		}
 	} else {
-		for (Bitu i=0; i<CPU_PrefetchQueueSize; i++) prefetch_buffer[i]=LoadMb(core.cseip+i);
-		pq_start=core.cseip;
-		pq_valid=true;
-		temp=prefetch_buffer[0] | (prefetch_buffer[1]<<8);
+		pq_reload(core.cseip);
+		temp=LoadMw(core.cseip);
 	}
-/*	if (temp!=LoadMw(core.cseip)) {
-		LOG_MSG("prefetch queue content!=memory at %x:%x",SegValue(cs),reg_eip);
-	} */
 	core.cseip+=2;
 	return temp;
 }
@@ -170,40 +193,104 @@ static uint16_t Fetchw() {
 static uint32_t Fetchd() {
 	uint32_t temp;
 	if (pq_valid && (core.cseip>=pq_start) && (core.cseip+4<pq_start+CPU_PrefetchQueueSize)) {
-		temp=prefetch_buffer[core.cseip-pq_start]|
-			(prefetch_buffer[core.cseip-pq_start+1]<<8)|
-			(prefetch_buffer[core.cseip-pq_start+2]<<16)|
-			(prefetch_buffer[core.cseip-pq_start+3]<<24);
+		if (pq_filled) {
+			temp=prefetch_buffer[core.cseip-pq_start]|
+				(prefetch_buffer[core.cseip-pq_start+1]<<8)|
+				(prefetch_buffer[core.cseip-pq_start+2]<<16)|
+				(prefetch_buffer[core.cseip-pq_start+3]<<24);
+		} else {
+			temp=LoadMd(core.cseip);
+		}
 		if ((core.cseip+4>=pq_start+CPU_PrefetchQueueSize-4) &&
 			(core.cseip+4<pq_start+CPU_PrefetchQueueSize)) {
-			Bitu remaining_bytes=pq_start+CPU_PrefetchQueueSize-(core.cseip+4);
-			for (Bitu i=0; i<remaining_bytes; i++) prefetch_buffer[i]=prefetch_buffer[core.cseip+4-pq_start+i];
-			for (Bitu i=remaining_bytes; i<CPU_PrefetchQueueSize; i++) prefetch_buffer[i]=LoadMb(core.cseip+4+i);
-			pq_start=core.cseip+4;
-			pq_valid=true;
+			pq_advance(core.cseip+4);
 		}
 	} else {
-		for (Bitu i=0; i<CPU_PrefetchQueueSize; i++) prefetch_buffer[i]=LoadMb(core.cseip+i);
-		pq_start=core.cseip;
-		pq_valid=true;
-		temp=prefetch_buffer[0] | (prefetch_buffer[1]<<8) |
-			(prefetch_buffer[2]<<16) | (prefetch_buffer[3]<<24);
+		pq_reload(core.cseip);
+		temp=LoadMd(core.cseip);
 	}
-/*	if (temp!=LoadMd(core.cseip)) {
-		LOG_MSG("prefetch queue content!=memory at %x:%x",SegValue(cs),reg_eip);
-	} */
 	core.cseip+=4;
 	return temp;
 }
 
-#define Push_16 CPU_Push16
-#define Push_32 CPU_Push32
+// The writes of the core check whether they hit the queue first
+
+static inline void pq_writeb(PhysPt off,uint8_t val) {
+	pq_check_write(off,1);
+	StoreMb(off,val);
+}
+
+static inline void pq_writew(PhysPt off,uint16_t val) {
+	pq_check_write(off,2);
+	StoreMw(off,val);
+}
+
+static inline void pq_writed(PhysPt off,uint32_t val) {
+	pq_check_write(off,4);
+	StoreMd(off,val);
+}
+
+#define SaveMb(off,val)	pq_writeb(off,val)
+#define SaveMw(off,val)	pq_writew(off,val)
+#define SaveMd(off,val)	pq_writed(off,val)
+
+static void pq_push16(Bitu value) {
+	pq_check_write(SegPhys(ss)+((reg_esp-2)&cpu.stack.mask),2);
+	CPU_Push16(value);
+}
+
+static void pq_push32(Bitu value) {
+	pq_check_write(SegPhys(ss)+((reg_esp-4)&cpu.stack.mask),4);
+	CPU_Push32(value);
+}
+
+// ENTER pushes the frame pointer and up to 31 outer frame pointers
+static void pq_enter(bool use32,Bitu bytes,Bitu level) {
+	const Bitu written=((level & 0x1f)+1)*(use32 ? 4 : 2);
+	const Bitu top=reg_esp & cpu.stack.mask;
+	if (top>=written) pq_check_write(SegPhys(ss)+top-written,written);
+	else if (pq_valid && !pq_filled) pq_fill();
+	CPU_ENTER(use32,bytes,level);
+}
+
+#define Push_16 pq_push16
+#define Push_32 pq_push32
+#define CPU_ENTER pq_enter
 #define Pop_16 CPU_Pop16
 #define Pop_32 CPU_Pop32
 
 #include "instructions.h"
 #include "core_normal/support.h"
+
+// The FPU stores its operands itself; 108 bytes covers the largest, FSAVE
+#undef FPU_ESC
+#define FPU_ESC(code) {														\
+	uint8_t rm=Fetchb();														\
+	if (rm >= 0xc0) {															\
+		FPU_ESC ## code ## _Normal(rm);										\
+	} else {																\
+		GetEAa;pq_check_write(eaa,108);FPU_ESC ## code ## _EA(rm,eaa);		\
+	}																		\
+}
+
+// Bulk string runs write to memory directly, so the queue gets filled
+// before any string instruction that stores
+#define DoString DoString_Unchecked
 #include "core_normal/string.h"
+#undef DoString
+
+static void DoString(STRING_OP type) {
+	switch (type) {
+	case R_INSB: case R_INSW: case R_INSD:
+	case R_MOVSB: case R_MOVSW: case R_MOVSD:
+	case R_STOSB: case R_STOSW: case R_STOSD:
+		if (pq_valid && !pq_filled) pq_fill();
+		break;
+	default:
+		break;
+	}
+	DoString_Unchecked(type);
+}
 
 
 #define EALookupTable (core.ea_table)
@@ -18,15 +18,21 @@
 
 #include "cpu.h"
 
+#include <array>
 #include <assert.h>
+#include <cinttypes>
 #include <sstream>
 #include <stddef.h>
+#include <unordered_map>
 
 #include "memory.h"
+#include "cycle_telemetry.h"
 #include "debug.h"
+#include "inout.h"
 #include "mapper.h"
 #include "setup.h"
 #include "programs.h"
+#include "snapshot.h"
 #include "paging.h"
 #include "lazyflags.h"
 #include "support.h"
@@ -59,6 +65,8 @@ int64_t CPU_IODelayRemoved = 0;
 CPU_Decoder * cpudecoder;
 bool CPU_CycleAutoAdjust = false;
 bool CPU_SkipCycleAutoAdjust = false;
+bool CPU_IdleSleep = false;
+CyclesController CPU_CyclesController = CyclesController::Reactive;
 Bitu CPU_AutoDetermineMode = 0;
 
 Bitu CPU_ArchitectureType = CPU_ARCHTYPE_MIXED;
@@ -72,13 +80,26 @@ void CPU_Core_Normal_Init(void);
 void CPU_Core_Simple_Init(void);
 #if (C_DYNAMIC_X86)
 void CPU_Core_Dyn_X86_Init(void);
-void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
 void CPU_Core_Dyn_X86_Cache_Close(void);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
+void CPU_Core_Dyn_X86_SetCacheFile(const std::string &filename);
+void CPU_Core_Dyn_X86_SetCacheSize(int size_mb);
+void CPU_Core_Dyn_X86_SetTranslateThreshold(int threshold);
+void CPU_Core_Dyn_X86_SetSmcThreshold(int threshold);
+void CPU_Core_Dyn_X86_SetAdaptive(bool enabled);
+void CPU_Core_Dyn_X86_FlushCache();
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
-void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
 void CPU_Core_Dynrec_Cache_Close(void);
+void CPU_Core_Dynrec_SetCacheFile(const std::string &filename);
+void CPU_Core_Dynrec_SetCacheSize(int size_mb);
+void CPU_Core_Dynrec_SetTranslateThreshold(int threshold);
+void CPU_Core_Dynrec_SetSmcThreshold(int threshold);
+void CPU_Core_Dynrec_SetAdaptive(bool enabled);
+void CPU_Core_Dynrec_FlushCache();
+void CPU_Core_Dynrec_SetNativeFPU(bool enabled);
+void CPU_Core_Dynrec_SetBlockProfiling(bool enabled);
+void CPU_Core_Dynrec_ReportBlockProfile(bool pressed);
 #endif
 
 /* In debug mode exceptions are tested and dosbox exits when 
@@ -132,6 +153,97 @@ void Descriptor:: Save(PhysPt address) {
 	cpu.mpl=03;
 }
 
+// The descriptors are kept by their linear address, so the GDT and every
+// LDT can share the cache. The pages they came from are watched for writes;
+// a page written again before the cache paid off for it is left uncached.
+constexpr size_t descriptor_cache_size = 256;
+constexpr uint64_t descriptor_cache_payoff_hits = 64;
+constexpr uint8_t descriptor_cache_max_strikes = 8;
+
+struct CachedDescriptor {
+	PhysPt address = 0;
+	bool valid = false;
+	Descriptor desc = {};
+};
+
+static struct {
+	std::array<CachedDescriptor, descriptor_cache_size> entries = {};
+	bool is_empty = true;
+	uint64_t hits_since_flush = 0;
+	std::unordered_map<Bitu, uint8_t> strikes = {}; // per physical page
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t flushes = 0;
+} descriptor_cache;
+
+void CPU_FlushDescriptorCache()
+{
+	if (descriptor_cache.is_empty)
+		return;
+	for (auto &entry : descriptor_cache.entries)
+		entry.valid = false;
+	descriptor_cache.is_empty = true;
+	descriptor_cache.hits_since_flush = 0;
+	++descriptor_cache.flushes;
+}
+
+static void descriptor_page_written(const Bitu phys_page)
+{
+	auto &strikes = descriptor_cache.strikes[phys_page];
+	if (descriptor_cache.hits_since_flush < descriptor_cache_payoff_hits) {
+		if (strikes < descriptor_cache_max_strikes)
+			++strikes;
+	} else {
+		strikes = 0;
+	}
+	CPU_FlushDescriptorCache();
+}
+
+static bool watch_descriptor_page(const Bitu phys_page)
+{
+	const auto strikes = descriptor_cache.strikes.find(phys_page);
+	if (strikes != descriptor_cache.strikes.end() &&
+	    strikes->second >= descriptor_cache_max_strikes)
+		return false;
+	return MEM_WatchWrites(phys_page);
+}
+
+void CPU_LoadDescriptor(const PhysPt address, Descriptor &desc)
+{
+	auto &entry = descriptor_cache.entries[(address >> 3) % descriptor_cache_size];
+	if (entry.valid && entry.address == address) {
+		desc = entry.desc;
+		++descriptor_cache.hits;
+		++descriptor_cache.hits_since_flush;
+		return;
+	}
+	++descriptor_cache.misses;
+	desc.Load(address);
+
+	// Both reads have linked their pages, so the physical pages are known.
+	// Watching a page can clear the TLB, which flushes the cache when
+	// paging is on, so the entry is only filled in afterwards.
+	const Bitu first_page = PAGING_GetPhysicalAddress(address) / MEM_PAGE_SIZE;
+	const Bitu last_page = PAGING_GetPhysicalAddress(address + 7) / MEM_PAGE_SIZE;
+	if (!watch_descriptor_page(first_page) || !watch_descriptor_page(last_page))
+		return;
+	entry.address = address;
+	entry.desc = desc;
+	entry.valid = true;
+	descriptor_cache.is_empty = false;
+}
+
+static void descriptor_cache_report()
+{
+	if (descriptor_cache.hits || descriptor_cache.misses)
+		LOG_MSG("CPU: Descriptor cache: %" PRIu64 " hits, %" PRIu64
+		        " misses, %" PRIu64 " flushes",
+		        descriptor_cache.hits,
+		        descriptor_cache.misses,
+		        descriptor_cache.flushes);
+}
+
 
 void CPU_Push16(Bitu value) {
 	uint32_t new_esp=(reg_esp&cpu.stack.notmask)|((reg_esp-2)&cpu.stack.mask);
@@ -1536,6 +1648,7 @@ void CPU_LGDT(Bitu limit,Bitu base) {
 	LOG(LOG_CPU,LOG_NORMAL)("GDT Set to base:%X limit:%X",base,limit);
 	cpu.gdt.SetLimit(limit);
 	cpu.gdt.SetBase(base);
+	CPU_FlushDescriptorCache();
 }
 
 void CPU_LIDT(Bitu limit,Bitu base) {
@@ -1589,12 +1702,10 @@ void CPU_SET_CRX(Bitu cr,Bitu value) {
 				}
 #if (C_DYNAMIC_X86)
 				if (CPU_AutoDetermineMode&CPU_AUTODETERMINE_CORE) {
-					CPU_Core_Dyn_X86_Cache_Init(true);
 					cpudecoder=&CPU_Core_Dyn_X86_Run;
 				}
 #elif (C_DYNREC)
 				if (CPU_AutoDetermineMode&CPU_AUTODETERMINE_CORE) {
-					CPU_Core_Dynrec_Cache_Init(true);
 					cpudecoder=&CPU_Core_Dynrec_Run;
 				}
 #endif
@@ -2066,6 +2177,11 @@ static Bits HLT_Decode(void) {
 	return 0;
 }
 
+bool CPU_IsWaitingForInterrupt()
+{
+	return cpudecoder == &HLT_Decode && GETFLAG(IF);
+}
+
 void CPU_HLT(Bitu oldeip) {
 	reg_eip=oldeip;
 	CPU_IODelayRemoved += CPU_Cycles;
@@ -2184,6 +2300,39 @@ void CPU_Reset_AutoAdjust(void) {
 	ticksScheduled = 0;
 }
 
+static void cpu_snapshot(SnapshotStream &s)
+{
+	auto halted = (cpudecoder == &HLT_Decode);
+	s.Pod(cpu_regs);
+	s.Pod(Segs);
+	s.Pod(cpu);
+	s.Pod(cpu_tss);
+	s.Pod(lflags);
+	s.Pod(halted);
+	if (!s.IsLoading())
+		return;
+
+	// Enter the saved mode the way the program did, so the automatic core
+	// and cycles settings follow
+	cpu.hlt.old_decoder = nullptr;
+	const auto cr0 = cpu.cr0;
+	cpu.cr0 = 0;
+	CPU_SET_CRX(0, cr0);
+
+	// the translated code and the cached descriptors came from the memory
+	// that was just replaced
+	CPU_FlushDescriptorCache();
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_FlushCache();
+#elif (C_DYNREC)
+	CPU_Core_Dynrec_FlushCache();
+#endif
+	if (halted) {
+		cpu.hlt.old_decoder = cpudecoder;
+		cpudecoder = &HLT_Decode;
+	}
+}
+
 class CPU final : public Module_base {
 private:
 	static bool inited;
@@ -2246,11 +2395,22 @@ public:
 		                  PRIMARY_MOD, "cycledown", "Dec Cycles");
 		MAPPER_AddHandler(CPU_CycleIncrease, SDL_SCANCODE_F12,
 		                  PRIMARY_MOD, "cycleup", "Inc Cycles");
+#if (C_DYNREC)
+		MAPPER_AddHandler(CPU_Core_Dynrec_ReportBlockProfile,
+		                  SDL_SCANCODE_UNKNOWN, 0, "dynprof", "Dyn Profile");
+#endif
+		const auto cpu_section = static_cast<Section_prop *>(configuration);
+		TELEMETRY_Open(cpu_section->Get_path("cycle_telemetry_file")->realpath);
 		Change_Config(configuration);
 		CPU_JMP(false,0,0,0);					//Setup the first cpu core
+		SNAPSHOT_AddComponent("cpu", cpu_snapshot);
+		MEM_AddWriteWatchHandler(descriptor_page_written);
 	}
 
-	~CPU() override = default;
+	~CPU() override
+	{
+		descriptor_cache_report();
+	}
 
 	bool Change_Config(Section *newconfig) override
 	{
@@ -2260,6 +2420,12 @@ public:
 		CPU_Cycles=0;
 		CPU_SkipCycleAutoAdjust=false;
 
+		const std::string controller = section->Get_string("cycles_controller");
+		CPU_CyclesController = (controller == "predictive")
+		                             ? CyclesController::Predictive
+		                             : CyclesController::Reactive;
+		TELEMETRY_SetRequired(CPU_CyclesController == CyclesController::Predictive);
+
 		// Sets the value if the string in within the min and max values
 		auto set_if_in_range = [](const std::string &str, int &value,
 		                          const int min_value = 1,
@@ -2333,6 +2499,8 @@ public:
 
 		CPU_CycleUp=section->Get_int("cycleup");
 		CPU_CycleDown=section->Get_int("cycledown");
+		IO_SetPollFastForward(section->Get_bool("skip_polling"));
+		CPU_IdleSleep = section->Get_bool("idle_sleep");
 		std::string core(section->Get_string("core"));
 		cpudecoder=&CPU_Core_Normal_Run;
 		if (core == "normal") {
@@ -2346,7 +2514,7 @@ public:
 #if (C_DYNAMIC_X86)
 			CPU_AutoDetermineMode|=CPU_AUTODETERMINE_CORE;
 		}
-		else if (core == "dynamic") {
+		else if (core == "dynamic" || core == "adaptive") {
 			cpudecoder=&CPU_Core_Dyn_X86_Run;
 			CPU_Core_Dyn_X86_SetFPUMode(true);
 		} else if (core == "dynamic_nodhfpu") {
@@ -2355,7 +2523,7 @@ public:
 #elif (C_DYNREC)
 			CPU_AutoDetermineMode|=CPU_AUTODETERMINE_CORE;
 		}
-		else if (core == "dynamic") {
+		else if (core == "dynamic" || core == "adaptive") {
 			cpudecoder=&CPU_Core_Dynrec_Run;
 #else
 
@@ -2363,9 +2531,21 @@ public:
 		}
 
 #if (C_DYNAMIC_X86)
-		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"));
+		CPU_Core_Dyn_X86_SetCacheFile(section->Get_path("dynamic_cache_file")->realpath);
+		CPU_Core_Dyn_X86_SetCacheSize(section->Get_int("dynamic_cache_size"));
+		CPU_Core_Dyn_X86_SetTranslateThreshold(section->Get_int("dynamic_translate_threshold"));
+		CPU_Core_Dyn_X86_SetSmcThreshold(section->Get_int("dynamic_smc_threshold"));
+		CPU_Core_Dyn_X86_SetAdaptive(core == "adaptive");
+		// The code cache is allocated when the dynamic core first runs
 #elif (C_DYNREC)
-		CPU_Core_Dynrec_Cache_Init( core == "dynamic" );
+		CPU_Core_Dynrec_SetCacheFile(section->Get_path("dynamic_cache_file")->realpath);
+		CPU_Core_Dynrec_SetCacheSize(section->Get_int("dynamic_cache_size"));
+		CPU_Core_Dynrec_SetTranslateThreshold(section->Get_int("dynamic_translate_threshold"));
+		CPU_Core_Dynrec_SetSmcThreshold(section->Get_int("dynamic_smc_threshold"));
+		CPU_Core_Dynrec_SetNativeFPU(section->Get_bool("dynamic_native_fpu"));
+		CPU_Core_Dynrec_SetBlockProfiling(section->Get_bool("dynamic_block_profile"));
+		CPU_Core_Dynrec_SetAdaptive(core == "adaptive");
+		// The code cache is allocated when the dynamic core first runs
 #endif
 
 		CPU_ArchitectureType = CPU_ARCHTYPE_MIXED;
@@ -2428,6 +2608,7 @@ void CPU_ShutDown([[maybe_unused]] Section* sec) {
 #elif (C_DYNREC)
 	CPU_Core_Dynrec_Cache_Close();
 #endif
+	TELEMETRY_Close();
 	delete test;
 }
 
@@ -0,0 +1,237 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cycle_telemetry.h"
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+
+#include "cpu.h"
+#include "tracy.h"
+
+bool telemetry_active = false;
+
+using telemetry_clock = std::chrono::steady_clock;
+
+constexpr auto num_buckets = static_cast<size_t>(TelemetryBucket::NumBuckets);
+
+static struct {
+	std::array<int64_t, num_buckets> ns = {};
+	telemetry_clock::time_point last_switch = {};
+	TelemetryBucket current = TelemetryBucket::Other;
+	int64_t cycles = 0;
+	uint64_t tick = 0;
+
+	TelemetryTotals totals = {};
+	bool required = false;
+
+	TelemetryRun run = {};
+	bool run_started = false;
+
+	CycleAdjustDecision adjust = {};
+	bool has_adjust = false;
+
+	FILE *csv = nullptr;
+} telemetry;
+
+static void restart_accounting()
+{
+	telemetry.ns.fill(0);
+	telemetry.cycles = 0;
+	telemetry.last_switch = telemetry_clock::now();
+}
+
+void TELEMETRY_Open(const std::string &csv_path)
+{
+	TELEMETRY_Close();
+	if (csv_path.empty())
+		return;
+
+	telemetry.csv = fopen(csv_path.c_str(), "w");
+	if (!telemetry.csv) {
+		LOG_WARNING("CPU: Can't open cycle telemetry file '%s'",
+		            csv_path.c_str());
+		return;
+	}
+	fputs("tick,cycle_max,cycles,cpu_ns,pic_ns,render_ns,mixer_ns,idle_ns,"
+	      "other_ns,cpu_ns_per_kcycle,adjust,ratio,ticks_done,"
+	      "ticks_scheduled,ticks_added,io_delay_ratio,new_cycle_max\n",
+	      telemetry.csv);
+	LOG_MSG("CPU: Writing cycle telemetry to '%s'", csv_path.c_str());
+
+	telemetry.tick = 0;
+	telemetry.has_adjust = false;
+	telemetry.current = TelemetryBucket::Other;
+	restart_accounting();
+	telemetry_active = true;
+}
+
+void TELEMETRY_Close()
+{
+	if (telemetry.csv) {
+		fclose(telemetry.csv);
+		telemetry.csv = nullptr;
+	}
+	telemetry_active = false;
+}
+
+void TELEMETRY_SetRequired(const bool required)
+{
+	telemetry.required = required;
+}
+
+TelemetryTotals TELEMETRY_TakeTotals()
+{
+	const auto totals = telemetry.totals;
+	telemetry.totals = {};
+	return totals;
+}
+
+void TELEMETRY_StartRun()
+{
+	telemetry.run = {};
+	telemetry.run_started = true;
+}
+
+TelemetryRun TELEMETRY_GetRun()
+{
+	return telemetry.run;
+}
+
+TelemetryBucket TELEMETRY_Switch(const TelemetryBucket bucket)
+{
+	const auto now = telemetry_clock::now();
+	const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+	        now - telemetry.last_switch);
+	telemetry.ns[static_cast<size_t>(telemetry.current)] += elapsed.count();
+	telemetry.last_switch = now;
+
+	const auto previous = telemetry.current;
+	telemetry.current = bucket;
+	return previous;
+}
+
+void TELEMETRY_AddCycles(const int64_t cycles)
+{
+	telemetry.cycles += cycles;
+}
+
+void TELEMETRY_LogAdjust(const CycleAdjustDecision &decision)
+{
+	TracyPlot("Cycle ratio", static_cast<int64_t>(decision.ratio));
+	TracyMessageL(decision.action);
+
+	// Attached to the row of the tick in which it takes effect
+	telemetry.adjust = decision;
+	telemetry.has_adjust = true;
+}
+
+void TELEMETRY_EndTick()
+{
+	// Tracy builds only pay for the accounting while a profiler is attached
+	const bool wanted = telemetry.csv || telemetry.required ||
+	                    telemetry.run_started || TracyIsConnected;
+	if (wanted != telemetry_active) {
+		telemetry_active = wanted;
+		if (wanted) {
+			telemetry.current = TelemetryBucket::Other;
+			telemetry.totals = {};
+			restart_accounting();
+		}
+		return;
+	}
+	if (!telemetry_active)
+		return;
+
+	// Charge the time since the last switch to the current bucket
+	TELEMETRY_Switch(telemetry.current);
+
+	auto bucket_ns = [](const TelemetryBucket bucket) {
+		return telemetry.ns[static_cast<size_t>(bucket)];
+	};
+	const auto cpu_ns    = bucket_ns(TelemetryBucket::Cpu);
+	const auto pic_ns    = bucket_ns(TelemetryBucket::Pic);
+	const auto render_ns = bucket_ns(TelemetryBucket::Render);
+	const auto mixer_ns  = bucket_ns(TelemetryBucket::Mixer);
+	const auto idle_ns   = bucket_ns(TelemetryBucket::Idle);
+	const auto other_ns  = bucket_ns(TelemetryBucket::Other);
+
+	++telemetry.totals.ticks;
+	telemetry.totals.cycles += telemetry.cycles;
+	telemetry.totals.cpu_ns += cpu_ns;
+	telemetry.totals.busy_ns += cpu_ns + pic_ns + render_ns + mixer_ns + other_ns;
+
+	if (telemetry.run_started) {
+		++telemetry.run.ticks;
+		telemetry.run.cycles += telemetry.cycles;
+		for (size_t i = 0; i < num_buckets; ++i)
+			telemetry.run.ns[i] += telemetry.ns[i];
+	}
+
+	const double ns_per_kcycle = telemetry.cycles > 0
+	                                   ? cpu_ns * 1000.0 / telemetry.cycles
+	                                   : 0.0;
+
+	TracyPlot("Cycle max", static_cast<int64_t>(CPU_CycleMax));
+	TracyPlot("Cycles executed", telemetry.cycles);
+	TracyPlot("CPU core ns", cpu_ns);
+	TracyPlot("PIC events ns", pic_ns);
+	TracyPlot("Render ns", render_ns);
+	TracyPlot("Mixer ns", mixer_ns);
+	TracyPlot("Idle ns", idle_ns);
+	TracyPlot("CPU ns per 1000 cycles", ns_per_kcycle);
+
+	if (telemetry.csv) {
+		fprintf(telemetry.csv,
+		        "%" PRIu64 ",%d,%" PRId64 ",%" PRId64 ",%" PRId64
+		        ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%" PRId64 ",%.1f",
+		        telemetry.tick,
+		        CPU_CycleMax,
+		        telemetry.cycles,
+		        cpu_ns,
+		        pic_ns,
+		        render_ns,
+		        mixer_ns,
+		        idle_ns,
+		        other_ns,
+		        ns_per_kcycle);
+		if (telemetry.has_adjust) {
+			const auto &a = telemetry.adjust;
+			fprintf(telemetry.csv,
+			        ",%s,%d,%d,%d,%d,%.4f,%d\n",
+			        a.action,
+			        a.ratio,
+			        a.ticks_done,
+			        a.ticks_scheduled,
+			        a.ticks_added,
+			        a.io_delay_ratio,
+			        a.new_cycle_max);
+		} else {
+			fputs(",,,,,,,\n", telemetry.csv);
+		}
+	}
+
+	telemetry.has_adjust = false;
+	++telemetry.tick;
+	restart_accounting();
+}
@@ -21,11 +21,18 @@
 
 #include <cerrno>
 #include <cassert>
-#include <array>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
 #include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "mem_unaligned.h"
+#include "memory_report.h"
 #include "paging.h"
+#include "pic.h"
 #include "types.h"
 
 #if defined(HAVE_MMAP)
@@ -45,7 +52,18 @@
 #include <processthreadsapi.h>
 #endif
 
+#define XXH_INLINE_ALL 1
+#define XXH_NO_INLINE_HINTS 1
+#define XXH_STATIC_LINKING_ONLY 1
+#include "../libs/decoders/xxhash.h"
+
 class CodePageHandler;
+class CacheBlock;
+
+static void cache_profile_record(CodePageHandler *codepage);
+static void cache_blockprof_retire(CacheBlock *block);
+static void cache_blockprof_invalidate(const CacheBlock *block);
+static void cache_smc_record(Bitu phys_page);
 
 // basic cache block representation
 class CacheBlock {
@@ -98,6 +116,15 @@ public:
 	} link[2];                // maximum two links (conditional jumps)
 
 	CacheBlock *crossblock;
+
+	// execution statistics, only gathered when the block profiler is on
+	struct {
+		uint32_t exec_count; // incremented by the translated code
+		uint32_t phys_addr;  // physical address of the first instruction
+		uint32_t eip;
+		uint16_t cs;
+		bool live;
+	} profile;
 };
 
 static struct {
@@ -126,9 +153,23 @@ static uint8_t *cache_code_start_ptr = nullptr;
 static uint8_t *cache_code = nullptr;
 static uint8_t *cache_code_link_blocks = nullptr;
 
-static std::array<CacheBlock, CACHE_BLOCKS> cache_blocks = {};
+// size of the code cache, configurable before the cache is initialized;
+// the number of cache blocks scales along with it
+static size_t cache_total = CACHE_TOTAL;
+static std::vector<CacheBlock> cache_blocks = {};
 static CacheBlock link_blocks[2]; // default linking (specially marked)
 
+// number of times code has to be reached before it gets translated,
+// until then it is run by the normal core (0 translates right away)
+static uint8_t cache_translate_threshold = 0;
+
+// counters to help sizing the cache for a given program
+static struct {
+	uint64_t restarts = 0;       // cache was full and restarted from its start
+	uint64_t blocks_purged = 0;  // translated blocks overwritten on restart
+	uint64_t page_evictions = 0; // code pages dropped due to lack of free pages
+} cache_stats;
+
 // the CodePageHandler class provides access to the contained
 // cache blocks and intercepts writes to the code for special treatment
 class CodePageHandler final : public PageHandler {
@@ -151,6 +192,7 @@ public:
 
 		active_blocks=0;
 		active_count=16;
+		profile_checked=false;
 
 		// initialize the maps with zero (no cache blocks as well as
 		// code present)
@@ -160,6 +202,10 @@ public:
 			delete [] invalidation_map;
 			invalidation_map = nullptr;
 		}
+		if (execution_map) {
+			delete [] execution_map;
+			execution_map = nullptr;
+		}
 	}
 
 	// clear out blocks that contain code which has been modified
@@ -174,6 +220,7 @@ public:
 		ip_point = (PAGING_GetPhysicalPage(ip_point) -
 		            check_cast<uint32_t>(phys_page << 12)) +
 		           (ip_point & 0xfff);
+		cache_smc_record(phys_page);
 		while (index >= 0) {
 			Bitu map=0;
 			// see if there is still some code in the range
@@ -187,6 +234,7 @@ public:
 				// test if this block is in the range
 				if (start<=block->page.end && end>=block->page.start) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
+					cache_blockprof_invalidate(block);
 					block->Clear(); // clear the block,
 					                // decrements the
 					                // write_map accordingly
@@ -208,6 +256,20 @@ public:
 		return map;
 	}
 
+	// count how often the untranslated code at addr was reached, returns
+	// true once it was reached often enough to be worth translating
+	bool CountExecution(Bitu addr, uint8_t threshold)
+	{
+		if (!threshold)
+			return true;
+		if (!execution_map)
+			execution_map = alloc_invalidation_map();
+		if (execution_map[addr] >= threshold)
+			return true;
+		execution_map[addr]++;
+		return false;
+	}
+
 	// the following functions will clean all cache blocks that are invalid
 	// now due to the write
 
@@ -458,6 +520,9 @@ public:
 
 	void ClearRelease()
 	{
+		// remember which blocks were translated from this page
+		cache_profile_record(this);
+
 		// clear out all cache blocks in this page
 		Bitu count=active_blocks;
 		CacheBlock **map=hash_map;
@@ -484,6 +549,22 @@ public:
 		return 0; // none found
 	}
 
+	// collect the page offsets of all blocks that start and end in this page
+	void GetBlockStarts(std::vector<uint16_t> &starts) const
+	{
+		for (Bitu i = 1; i <= DYN_PAGE_HASH; i++) {
+			for (auto block = hash_map[i]; block; block = block->hash.next) {
+				if (!block->crossblock)
+					starts.push_back(block->page.start);
+			}
+		}
+	}
+
+	Bitu GetPhysPage() const
+	{
+		return phys_page;
+	}
+
 	HostPt GetHostReadPt(Bitu phys_page) override
 	{
 		hostmem = old_pagehandler->GetHostReadPt(phys_page);
@@ -500,10 +581,15 @@ public:
 	// the byte at address i
 	uint8_t write_map[4096] = {};
 	uint8_t *invalidation_map = nullptr;
+	// executions of not yet translated code, see CountExecution
+	uint8_t *execution_map = nullptr;
 
 	CodePageHandler *prev = nullptr;
 	CodePageHandler *next = nullptr;
 
+	// set once the persistent profile was consulted for this page
+	bool profile_checked = false;
+
 private:
 	PageHandler *old_pagehandler = nullptr;
 
@@ -537,6 +623,7 @@ static CacheBlock *cache_getblock()
 
 void CacheBlock::Clear()
 {
+	cache_blockprof_retire(this);
 	Bitu ind;
 	// check if this is not a cross page block
 	if (hash.index) for (ind=0;ind<2;ind++) {
@@ -590,8 +677,11 @@ static CacheBlock *cache_openblock()
 	// check for enough space in this block
 	Bitu size=block->cache.size;
 	CacheBlock *nextblock = block->cache.next;
-	if (block->page.handler)
+	if (block->page.handler) {
 		block->Clear();
+		cache_stats.blocks_purged++;
+		METRICS_Add(Metric::DynrecCachePurges);
+	}
 	// block size must be at least CACHE_MAXSIZE
 	while (size<CACHE_MAXSIZE) {
 		if (!nextblock)
@@ -599,8 +689,11 @@ static CacheBlock *cache_openblock()
 		// merge blocks
 		size+=nextblock->cache.size;
 		CacheBlock *tempblock = nextblock->cache.next;
-		if (nextblock->page.handler)
+		if (nextblock->page.handler) {
 			nextblock->Clear();
+			cache_stats.blocks_purged++;
+			METRICS_Add(Metric::DynrecCachePurges);
+		}
 		// block is free now
 		cache_add_unused_block(nextblock);
 		nextblock=tempblock;
@@ -653,12 +746,13 @@ static void cache_closeblock()
 #if (C_DYNAMIC_X86)
 	const bool cache_is_full = !block->cache.next;
 #elif (C_DYNREC)
-	const uint8_t *limit = (cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE);
+	const uint8_t *limit = (cache_code_start_ptr + cache_total - CACHE_MAXSIZE);
 	const bool cache_is_full = (!block->cache.next ||
 	                            (block->cache.next->cache.start > limit));
 #endif
 	if (cache_is_full) {
 		// DEBUG_LOG_MSG("Cache full; restarting");
+		cache_stats.restarts++;
 		cache.block.active=cache.block.first;
 	} else {
 		cache.block.active=block->cache.next;
@@ -736,7 +830,432 @@ static void cache_block_before_close();
 static void cache_block_closing(const uint8_t *block_start, Bitu block_size);
 #endif
 
-static constexpr size_t cache_code_size = CACHE_TOTAL + CACHE_MAXSIZE + host_pagesize - 1 + host_pagesize;
+static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bitu max_opcodes);
+
+// Block profiler
+// ~~~~~~~~~~~~~~
+// Counts executions per translated block, how often block linking finds its
+// target, and how often blocks get invalidated by self-modifying code. The
+// statistics of cleared blocks are folded into a table keyed by the block's
+// physical start address, so they survive cache restarts.
+
+struct CacheBlockProfile {
+	uint64_t executions = 0;
+	uint32_t translations = 0;
+	uint32_t invalidations = 0;
+	uint32_t guest_size = 0;
+	uint32_t eip = 0;
+	uint16_t cs = 0;
+};
+
+static struct {
+	bool enabled = false;
+	uint64_t dispatches = 0;  // blocks entered from the core's run loop
+	uint64_t link_hits = 0;   // link requests that found a translated block
+	uint64_t link_misses = 0; // link requests that found nothing to link to
+	std::unordered_map<uint32_t, CacheBlockProfile> blocks = {};
+} cache_blockprof;
+
+static void cache_blockprof_start(CacheBlock *block, const PhysPt phys_addr,
+                                  const PhysPt lin_addr)
+{
+	block->profile.exec_count = 0;
+	block->profile.phys_addr = phys_addr;
+	block->profile.cs = check_cast<uint16_t>(SegValue(cs));
+	block->profile.eip = lin_addr - SegPhys(cs);
+	block->profile.live = true;
+}
+
+static void cache_blockprof_fold(const CacheBlock &block, CacheBlockProfile &entry)
+{
+	entry.executions += block.profile.exec_count;
+	entry.guest_size = static_cast<uint32_t>(block.page.end - block.page.start + 1);
+	entry.eip = block.profile.eip;
+	entry.cs = block.profile.cs;
+}
+
+static void cache_blockprof_retire(CacheBlock *block)
+{
+	if (!cache_blockprof.enabled || !block->profile.live)
+		return;
+	auto &entry = cache_blockprof.blocks[block->profile.phys_addr];
+	cache_blockprof_fold(*block, entry);
+	entry.translations++;
+	block->profile.live = false;
+}
+
+static void cache_blockprof_invalidate(const CacheBlock *block)
+{
+	if (!cache_blockprof.enabled || !block->profile.live)
+		return;
+	cache_blockprof.blocks[block->profile.phys_addr].invalidations++;
+}
+
+static void cache_blockprof_report()
+{
+	if (!cache_blockprof.enabled)
+		return;
+
+	// merge the blocks that are still translated into a snapshot
+	auto snapshot = cache_blockprof.blocks;
+	for (const auto &block : cache_blocks) {
+		if (!block.profile.live)
+			continue;
+		auto &entry = snapshot[block.profile.phys_addr];
+		cache_blockprof_fold(block, entry);
+		entry.translations++;
+	}
+
+	std::vector<std::pair<uint32_t, CacheBlockProfile>> ranked(snapshot.begin(),
+	                                                           snapshot.end());
+	std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+		return a.second.executions > b.second.executions;
+	});
+
+	const auto links = cache_blockprof.link_hits + cache_blockprof.link_misses;
+	LOG_MSG("CPU: Block profile: %" PRIu64 " dispatches, %" PRIu64
+	        " link requests (%.1f%% hits), %u distinct blocks",
+	        cache_blockprof.dispatches,
+	        links,
+	        links ? 100.0 * static_cast<double>(cache_blockprof.link_hits) /
+	                        static_cast<double>(links)
+	              : 0.0,
+	        static_cast<unsigned>(ranked.size()));
+	LOG_MSG("CPU:   CS:EIP          phys      size   executions  translated  invalidated");
+
+	constexpr size_t max_rows = 25;
+	for (size_t i = 0; i < ranked.size() && i < max_rows; ++i) {
+		const auto &[phys_addr, entry] = ranked[i];
+		LOG_MSG("CPU:   %04x:%08x   %08x  %4u  %11" PRIu64 "  %10u  %11u",
+		        entry.cs,
+		        entry.eip,
+		        phys_addr,
+		        entry.guest_size,
+		        entry.executions,
+		        entry.translations,
+		        entry.invalidations);
+	}
+}
+
+// Self-modifying code demotion
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Code that keeps modifying its own page (or shares it with frequently
+// written data) gets its blocks invalidated and retranslated over and over.
+// A page that sees too many invalidations within a second is demoted: it is
+// run by the normal core without a code page handler, so writes to it cost
+// nothing. The demotion expires after a while to pick up code that settled
+// down, and lasts twice as long every time the page gets demoted again.
+
+struct CacheSmcPage {
+	uint32_t window_start = 0;  // PIC_Ticks when the current window began
+	uint32_t window_count = 0;  // invalidations in the current window
+	uint32_t demoted_until = 0; // PIC_Ticks when the demotion expires
+	uint32_t demotions = 0;
+	uint64_t invalidations = 0;
+	bool demoted = false;
+};
+
+constexpr uint32_t cache_smc_window_ms = 1000;
+constexpr uint32_t cache_smc_demote_ms = 10000;
+constexpr uint32_t cache_smc_max_backoff = 6; // up to 64 times as long
+
+static struct {
+	uint32_t threshold = 0; // invalidations per window that demote, 0 is off
+	size_t demoted_pages = 0;
+	std::unordered_map<uint32_t, CacheSmcPage> pages = {}; // by physical page
+} cache_smc;
+
+static void cache_smc_record(const Bitu phys_page)
+{
+	if (!cache_smc.threshold)
+		return;
+	auto &page = cache_smc.pages[check_cast<uint32_t>(phys_page)];
+	page.invalidations++;
+	if (page.demoted)
+		return;
+	if (PIC_Ticks - page.window_start >= cache_smc_window_ms) {
+		page.window_start = PIC_Ticks;
+		page.window_count = 0;
+	}
+	if (++page.window_count < cache_smc.threshold)
+		return;
+
+	const auto backoff = std::min(page.demotions, cache_smc_max_backoff);
+	page.demoted_until = PIC_Ticks + (cache_smc_demote_ms << backoff);
+	page.demotions++;
+	page.demoted = true;
+	cache_smc.demoted_pages++;
+	LOG_MSG("CPU: Running code page %08x in the normal core after %u modifications within %u ms",
+	        check_cast<uint32_t>(phys_page << 12),
+	        page.window_count,
+	        cache_smc_window_ms);
+}
+
+// returns true if the code at lin_addr is in a demoted page; the page's
+// translated blocks are dropped so writes to it are no longer intercepted
+static bool cache_smc_is_demoted(const PhysPt lin_addr)
+{
+	if (GCC_LIKELY(!cache_smc.demoted_pages))
+		return false;
+	Bitu phys_page = lin_addr >> 12;
+	if (!PAGING_MakePhysPage(phys_page))
+		return false;
+	const auto it = cache_smc.pages.find(check_cast<uint32_t>(phys_page));
+	if (it == cache_smc.pages.end() || !it->second.demoted)
+		return false;
+
+	auto &page = it->second;
+	if (static_cast<int32_t>(PIC_Ticks - page.demoted_until) >= 0) {
+		page.demoted = false;
+		page.window_start = PIC_Ticks;
+		page.window_count = 0;
+		cache_smc.demoted_pages--;
+		return false;
+	}
+	PageHandler *handler = get_tlb_readhandler(lin_addr);
+	if (handler->flags & PFLAG_HASCODE)
+		static_cast<CodePageHandler *>(handler)->ClearRelease();
+	return true;
+}
+
+static void cache_smc_report()
+{
+	std::vector<std::pair<uint32_t, CacheSmcPage>> demoted = {};
+	for (const auto &entry : cache_smc.pages) {
+		if (entry.second.demotions)
+			demoted.emplace_back(entry);
+	}
+	if (demoted.empty())
+		return;
+	std::sort(demoted.begin(), demoted.end(), [](const auto &a, const auto &b) {
+		return a.second.invalidations > b.second.invalidations;
+	});
+	LOG_MSG("CPU: %u code pages were demoted to the normal core due to self-modifying code:",
+	        static_cast<unsigned>(demoted.size()));
+	LOG_MSG("CPU:   phys      invalidated  demoted");
+	for (const auto &[phys_page, page] : demoted) {
+		LOG_MSG("CPU:   %08x  %11" PRIu64 "  %7u",
+		        phys_page << 12,
+		        page.invalidations,
+		        page.demotions);
+	}
+}
+
+static void cache_smc_set_threshold(const int threshold)
+{
+	cache_smc.threshold = check_cast<uint32_t>(threshold);
+	if (!cache_smc.threshold) {
+		for (auto &entry : cache_smc.pages)
+			entry.second.demoted = false;
+		cache_smc.demoted_pages = 0;
+	}
+}
+
+// Adaptive core selection
+// ~~~~~~~~~~~~~~~~~~~~~~~
+// With core=adaptive, all code starts out in the normal core, which costs
+// nothing to start and takes self-modifying code in stride. Whenever the
+// dynamic core is about to run code in a page without translations, the page
+// is sampled and, while it's cold, the rest of the time slice is left to the
+// normal core. A page that comes up often enough is hot and gets translated
+// from then on. Pages that turn out to keep modifying themselves
+// go back to the normal core through the demotion above, which is enabled
+// with a default threshold unless one was configured.
+
+constexpr uint32_t cache_hot_page_samples = 16;
+constexpr int cache_hot_smc_threshold = 32;
+
+static struct {
+	bool enabled = false;
+	uint64_t promotions = 0;
+	std::unordered_map<uint32_t, uint32_t> samples = {}; // by physical page
+} cache_hot;
+
+// returns true if the code at lin_addr is in a page that was not sampled
+// often enough yet to be worth translating
+static bool cache_hot_is_cold(const PhysPt lin_addr)
+{
+	if (GCC_LIKELY(!cache_hot.enabled))
+		return false;
+	// already promoted and translated
+	if (get_tlb_readhandler(lin_addr)->flags & PFLAG_HASCODE)
+		return false;
+	Bitu phys_page = lin_addr >> 12;
+	if (!PAGING_MakePhysPage(phys_page))
+		return false;
+	auto &samples = cache_hot.samples[check_cast<uint32_t>(phys_page)];
+	if (samples >= cache_hot_page_samples)
+		return false;
+	if (++samples < cache_hot_page_samples)
+		return true;
+	cache_hot.promotions++;
+	return false;
+}
+
+static void cache_hot_set_enabled(const bool enabled)
+{
+	cache_hot.enabled = enabled;
+	cache_hot.samples.clear();
+	if (enabled && !cache_smc.threshold)
+		cache_smc_set_threshold(cache_hot_smc_threshold);
+}
+
+// Persistent translation profile
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The translated host code itself can't be stored between sessions because
+// it embeds absolute host addresses (the register file, memory handlers, and
+// the cache itself). Instead, for every guest code page we remember a hash of
+// its contents and the offsets of the blocks that were translated from it.
+// When a page with identical contents is executed in a later session, all of
+// its recorded blocks are translated in one go on first entry instead of
+// trickling in one block at a time.
+
+struct CacheProfilePage {
+	uint64_t hash = 0;
+	bool code_big = false;
+	std::vector<uint16_t> block_starts = {};
+};
+
+static struct {
+	std::string filename = {};
+	std::unordered_map<uint32_t, CacheProfilePage> pages = {};
+} cache_profile;
+
+constexpr char cache_profile_magic[8] = {'D', 'Y', 'N', 'P', 'R', 'O', 'F', '1'};
+
+static uint64_t cache_profile_hash(const HostPt page_mem)
+{
+	constexpr size_t page_size = 4096;
+	return XXH64(page_mem, page_size, 0);
+}
+
+static void cache_profile_record(CodePageHandler *codepage)
+{
+	if (cache_profile.filename.empty())
+		return;
+
+	const auto phys_page = codepage->GetPhysPage();
+	const auto page_mem = codepage->GetHostReadPt(phys_page);
+	if (!page_mem)
+		return;
+
+	CacheProfilePage entry = {};
+	codepage->GetBlockStarts(entry.block_starts);
+	if (entry.block_starts.empty())
+		return;
+
+	entry.hash = cache_profile_hash(page_mem);
+	entry.code_big = (codepage->flags & PFLAG_HASCODE32) != 0;
+	cache_profile.pages[check_cast<uint32_t>(phys_page)] = std::move(entry);
+}
+
+static void cache_profile_load(const std::string &filename)
+{
+	if (filename == cache_profile.filename)
+		return;
+	cache_profile.filename = filename;
+	cache_profile.pages.clear();
+	if (filename.empty())
+		return;
+
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return; // nothing recorded yet
+
+	char magic[sizeof(cache_profile_magic)] = {};
+	bool valid = fread(magic, sizeof(magic), 1, f) == 1 &&
+	             memcmp(magic, cache_profile_magic, sizeof(magic)) == 0;
+
+	while (valid) {
+		uint32_t phys_page = 0;
+		uint8_t code_big = 0;
+		uint16_t num_blocks = 0;
+		CacheProfilePage entry = {};
+		if (fread(&phys_page, sizeof(phys_page), 1, f) != 1)
+			break; // clean end of file
+		valid = fread(&entry.hash, sizeof(entry.hash), 1, f) == 1 &&
+		        fread(&code_big, sizeof(code_big), 1, f) == 1 &&
+		        fread(&num_blocks, sizeof(num_blocks), 1, f) == 1 &&
+		        num_blocks > 0 && num_blocks <= 4096;
+		if (!valid)
+			break;
+		entry.code_big = code_big != 0;
+		entry.block_starts.resize(num_blocks);
+		valid = fread(entry.block_starts.data(), sizeof(uint16_t), num_blocks, f) ==
+		        num_blocks;
+		if (valid)
+			cache_profile.pages[phys_page] = std::move(entry);
+	}
+	fclose(f);
+
+	if (!valid) {
+		LOG_WARNING("CPU: Ignoring invalid dynamic core cache file '%s'",
+		            filename.c_str());
+		cache_profile.pages.clear();
+		return;
+	}
+	LOG_MSG("CPU: Loaded dynamic core cache profile with %u code pages",
+	        static_cast<unsigned>(cache_profile.pages.size()));
+}
+
+static void cache_profile_save()
+{
+	if (cache_profile.filename.empty())
+		return;
+
+	for (auto page = cache.used_pages; page; page = page->next)
+		cache_profile_record(page);
+
+	FILE *f = fopen(cache_profile.filename.c_str(), "wb");
+	if (!f) {
+		LOG_WARNING("CPU: Failed to write dynamic core cache file '%s'",
+		            cache_profile.filename.c_str());
+		return;
+	}
+	fwrite(cache_profile_magic, sizeof(cache_profile_magic), 1, f);
+	for (const auto &[phys_page, entry] : cache_profile.pages) {
+		const uint8_t code_big = entry.code_big ? 1 : 0;
+		const auto num_blocks = check_cast<uint16_t>(entry.block_starts.size());
+		fwrite(&phys_page, sizeof(phys_page), 1, f);
+		fwrite(&entry.hash, sizeof(entry.hash), 1, f);
+		fwrite(&code_big, sizeof(code_big), 1, f);
+		fwrite(&num_blocks, sizeof(num_blocks), 1, f);
+		fwrite(entry.block_starts.data(), sizeof(uint16_t), num_blocks, f);
+	}
+	fclose(f);
+}
+
+// Translate the blocks recorded for this page in an earlier session, provided
+// the page still holds the same code. Called from the core's run loop (never
+// while decoding) with ip_point located inside the page.
+static void cache_profile_restore(CodePageHandler *codepage, const PhysPt ip_point)
+{
+	if (codepage->profile_checked)
+		return;
+	codepage->profile_checked = true;
+
+	const auto it = cache_profile.pages.find(
+	        check_cast<uint32_t>(codepage->GetPhysPage()));
+	if (it == cache_profile.pages.end())
+		return;
+
+	const auto &entry = it->second;
+	const auto page_mem = codepage->GetHostReadPt(codepage->GetPhysPage());
+	if (!page_mem || entry.code_big != cpu.code.big ||
+	    entry.hash != cache_profile_hash(page_mem))
+		return;
+
+	const PhysPt page_base = ip_point & ~static_cast<PhysPt>(4095);
+	for (const auto start : entry.block_starts) {
+		if (!codepage->FindCacheBlock(start))
+			CreateCacheBlock(codepage, page_base + start, 32);
+	}
+}
+
+static size_t cache_code_size()
+{
+	return cache_total + CACHE_MAXSIZE + host_pagesize - 1 + host_pagesize;
+}
 constexpr bool is_64bit_platform = sizeof(void *) == 8;
 
 static inline void dyn_mem_adjust(void *&ptr, size_t &size)
@@ -815,100 +1334,147 @@ static inline void dyn_cache_invalidate([[maybe_unused]] void *ptr,
 
 static bool cache_initialized = false;
 
-static void cache_init(bool enable) {
-	if (enable) {
-		// see if cache is already initialized
-		if (cache_initialized) return;
-		cache_initialized = true;
-		cache.block.free=&cache_blocks[0];
-		// initialize the cache blocks
-		for (int i=0;i<CACHE_BLOCKS-1;i++) {
-			cache_blocks[i].link[0].to = (CacheBlock *)1;
-			cache_blocks[i].link[1].to = (CacheBlock *)1;
-			cache_blocks[i].cache.next = &cache_blocks[i + 1];
-		}
-		if (cache_code_start_ptr == nullptr) {
-			// allocate the code cache memory
+// Set the size of the code cache in MiB; only effective before the cache
+// memory is allocated.
+static void cache_set_size(const int size_mb)
+{
+	constexpr size_t bytes_per_mb = 1024 * 1024;
+	if (size_mb <= 0 || cache_code_start_ptr)
+		return;
+	cache_total = static_cast<size_t>(size_mb) * bytes_per_mb;
+}
+
+static void cache_log_stats()
+{
+	if (!cache_initialized)
+		return;
+	LOG_MSG("CPU: Dynamic core cache of %u MB restarted %" PRIu64
+	        " times, purged %" PRIu64 " blocks, evicted %" PRIu64 " code pages",
+	        static_cast<unsigned>(cache_total / (1024 * 1024)),
+	        cache_stats.restarts,
+	        cache_stats.blocks_purged,
+	        cache_stats.page_evictions);
+	if (cache_hot.enabled)
+		LOG_MSG("CPU: Adaptive core translated %" PRIu64 " of %u sampled code pages",
+		        cache_hot.promotions,
+		        static_cast<unsigned>(cache_hot.samples.size()));
+}
+
+// Allocates the code cache and its blocks; called when the dynamic core first
+// runs, so sessions that stay on the other cores don't hold them
+static void cache_init()
+{
+	if (cache_initialized)
+		return;
+	cache_initialized = true;
+	// scale the number of cache blocks along with the cache size
+	const auto num_blocks = static_cast<size_t>(
+	        static_cast<uint64_t>(CACHE_BLOCKS) * cache_total / CACHE_TOTAL);
+	cache_blocks.resize(std::max(num_blocks, static_cast<size_t>(CACHE_BLOCKS / 8)));
+	cache.block.free=&cache_blocks[0];
+	// initialize the cache blocks
+	for (size_t i = 0; i < cache_blocks.size() - 1; i++) {
+		cache_blocks[i].link[0].to = (CacheBlock *)1;
+		cache_blocks[i].link[1].to = (CacheBlock *)1;
+		cache_blocks[i].cache.next = &cache_blocks[i + 1];
+	}
+	if (cache_code_start_ptr == nullptr) {
+		// allocate the code cache memory
 #if defined (WIN32)
-			LPVOID lp_vmem = nullptr;
-			if (CPU_UseRwxMemProtect) {
-				lp_vmem = VirtualAlloc(nullptr, cache_code_size,
-				                       MEM_COMMIT,
-				                       PAGE_EXECUTE_READWRITE); // all operations allowed
-			} else {
-				lp_vmem = VirtualAlloc(nullptr, cache_code_size,
-				                       MEM_COMMIT | MEM_RESERVE,
-				                       PAGE_READWRITE); // needs on-going management
-			}
-			assert(lp_vmem);
-			cache_code_start_ptr = static_cast<uint8_t *>(lp_vmem);
+		LPVOID lp_vmem = nullptr;
+		if (CPU_UseRwxMemProtect) {
+			lp_vmem = VirtualAlloc(nullptr, cache_code_size(),
+			                       MEM_COMMIT,
+			                       PAGE_EXECUTE_READWRITE); // all operations allowed
+		} else {
+			lp_vmem = VirtualAlloc(nullptr, cache_code_size(),
+			                       MEM_COMMIT | MEM_RESERVE,
+			                       PAGE_READWRITE); // needs on-going management
+		}
+		assert(lp_vmem);
+		cache_code_start_ptr = static_cast<uint8_t *>(lp_vmem);
 #elif defined(HAVE_MMAP)
-			int map_flags = MAP_PRIVATE | MAP_ANON;
-			int prot_flags = PROT_READ | PROT_WRITE | PROT_EXEC;
+		int map_flags = MAP_PRIVATE | MAP_ANON;
+		int prot_flags = PROT_READ | PROT_WRITE | PROT_EXEC;
 #if defined(HAVE_MAP_JIT)
-			map_flags |= MAP_JIT;
+		map_flags |= MAP_JIT;
 #endif
-			cache_code_start_ptr=static_cast<uint8_t *>(mmap(nullptr, cache_code_size, prot_flags, map_flags, -1, 0));
-			if (cache_code_start_ptr == MAP_FAILED) {
-				E_Exit("Allocating dynamic core cache memory failed with errno %d", errno);
-			}
+		cache_code_start_ptr=static_cast<uint8_t *>(mmap(nullptr, cache_code_size(), prot_flags, map_flags, -1, 0));
+		if (cache_code_start_ptr == MAP_FAILED) {
+			E_Exit("Allocating dynamic core cache memory failed with errno %d", errno);
+		}
 #else
-			cache_code_start_ptr=static_cast<uint8_t *>(malloc(cache_code_size));
-			if (!cache_code_start_ptr) {
-				E_Exit("Allocating dynamic core cache memory failed");
-			}
-#endif
-			// align the cache at a page boundary
-			cache_code = reinterpret_cast<uint8_t *>(
-			    (reinterpret_cast<uintptr_t>(cache_code_start_ptr) +
-			    host_pagesize - 1) & ~(host_pagesize - 1));
-
-			cache_code_link_blocks=cache_code;
-			cache_code=cache_code+host_pagesize;
-			CacheBlock *block = cache_getblock();
-			cache.block.first=block;
-			cache.block.active=block;
-			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
-			block->cache.next = nullptr; // last block in the list
+		cache_code_start_ptr=static_cast<uint8_t *>(malloc(cache_code_size()));
+		if (!cache_code_start_ptr) {
+			E_Exit("Allocating dynamic core cache memory failed");
 		}
-		// setup the default blocks for block linkage returns
-		cache.pos=&cache_code_link_blocks[0];
-		link_blocks[0].cache.start=cache.pos;
+#endif
+		// align the cache at a page boundary
+		cache_code = reinterpret_cast<uint8_t *>(
+		    (reinterpret_cast<uintptr_t>(cache_code_start_ptr) +
+		    host_pagesize - 1) & ~(host_pagesize - 1));
+
+		cache_code_link_blocks=cache_code;
+		cache_code=cache_code+host_pagesize;
+		CacheBlock *block = cache_getblock();
+		cache.block.first=block;
+		cache.block.active=block;
+		block->cache.start=&cache_code[0];
+		block->cache.size=cache_total;
+		block->cache.next = nullptr; // last block in the list
+	}
+	// setup the default blocks for block linkage returns
+	cache.pos=&cache_code_link_blocks[0];
+	link_blocks[0].cache.start=cache.pos;
 
-		auto cache_addr = static_cast<void *>(cache_code);
-		constexpr size_t cache_bytes = CACHE_MAXSIZE;
+	auto cache_addr = static_cast<void *>(cache_code);
+	constexpr size_t cache_bytes = CACHE_MAXSIZE;
 
-		dyn_mem_write(cache_addr, cache_bytes);
-		// link code that returns with a special return code
-		dyn_return(BR_Link1,false);
-		cache.pos=&cache_code_link_blocks[32];
-		link_blocks[1].cache.start=cache.pos;
-		// link code that returns with a special return code
-		dyn_return(BR_Link2,false);
+	dyn_mem_write(cache_addr, cache_bytes);
+	// link code that returns with a special return code
+	dyn_return(BR_Link1,false);
+	cache.pos=&cache_code_link_blocks[32];
+	link_blocks[1].cache.start=cache.pos;
+	// link code that returns with a special return code
+	dyn_return(BR_Link2,false);
 
 #if (C_DYNREC)
-		cache.pos=&cache_code_link_blocks[64];
-		core_dynrec.runcode=(BlockReturn (*)(const uint8_t*))cache.pos;
+	cache.pos=&cache_code_link_blocks[64];
+	core_dynrec.runcode=(BlockReturn (*)(const uint8_t*))cache.pos;
 //		link_blocks[1].cache.start=cache.pos;
-		dyn_run_code();
+	dyn_run_code();
 #endif
-		dyn_mem_execute(cache_addr, cache_bytes);
-		dyn_cache_invalidate(cache_addr, cache_bytes);
-
-		cache.free_pages=nullptr;
-		cache.last_page=nullptr;
-		cache.used_pages=nullptr;
-		// setup the code pages
-		for (int i=0;i<CACHE_PAGES;i++) {
-			CodePageHandler *newpage = new CodePageHandler();
-			newpage->next=cache.free_pages;
-			cache.free_pages=newpage;
-		}
+	dyn_mem_execute(cache_addr, cache_bytes);
+	dyn_cache_invalidate(cache_addr, cache_bytes);
+
+	cache.free_pages=nullptr;
+	cache.last_page=nullptr;
+	cache.used_pages=nullptr;
+	// setup the code pages
+	for (int i=0;i<CACHE_PAGES;i++) {
+		CodePageHandler *newpage = new CodePageHandler();
+		newpage->next=cache.free_pages;
+		cache.free_pages=newpage;
 	}
+
+	MEMREPORT_Add(MemoryUser::DynamicCoreCache,
+	              static_cast<int64_t>(cache_code_size() +
+	                                   cache_blocks.size() * sizeof(CacheBlock) +
+	                                   CACHE_PAGES * sizeof(CodePageHandler)));
+}
+
+// Drops all translated code, for when memory was replaced wholesale
+static void cache_release_pages()
+{
+	while (cache.used_pages)
+		cache.used_pages->ClearRelease();
 }
 
 static void cache_close(void) {
+	cache_profile_save();
+	cache_log_stats();
+	cache_smc_report();
+	cache_blockprof_report();
 /*	for (;;) {
 		if (cache.used_pages) {
 			CodePageHandler * cpage=cache.used_pages;
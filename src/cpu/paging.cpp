@@ -28,7 +28,10 @@
 #include "lazyflags.h"
 #include "cpu.h"
 #include "debug.h"
+#include "metrics.h"
+#include "pic.h"
 #include "setup.h"
+#include "snapshot.h"
 
 #define LINK_TOTAL		(64*1024)
 
@@ -111,6 +114,12 @@ bool PageHandler::writed_checked(PhysPt addr, uint32_t val)
 	writed(addr,val);	return false;
 }
 
+void PageHandler::write_span(PhysPt addr, const uint8_t *data, uint32_t bytes)
+{
+	for (uint32_t i = 0; i < bytes; ++i)
+		writeb(addr + i, data[i]);
+}
+
 struct PF_Entry {
 	uint32_t cs;
 	uint32_t eip;
@@ -145,7 +154,27 @@ static Bits PageFaultCore(void) {
 
 bool first=false;
 
+static struct {
+	bool any = false;
+	uint32_t last_tick = 0;
+} recent_faults = {};
+
+bool PAGING_HadRecentFaults()
+{
+	return recent_faults.any && PIC_Ticks - recent_faults.last_tick < 1000;
+}
+
 void PAGING_PageFault(PhysPt lin_addr,uint32_t page_addr,uint32_t faultcode) {
+	METRICS_Add(Metric::PageFaults);
+	recent_faults.any = true;
+	recent_faults.last_tick = PIC_Ticks;
+	if (CPU_Core_Normal_CanRestart()) {
+		LOG(LOG_PAGING, LOG_NORMAL)("PageFault at %X type [%x], rewinding the instruction", lin_addr, faultcode);
+		paging.cr2=lin_addr;
+		throw GuestPageFault{faultcode};
+	}
+	METRICS_Add(Metric::PageFaultsNested);
+
 	/* Save the state of the cpu cores */
 	const auto old_lflags = lflags;
 	const auto old_cpudecoder=cpudecoder;
@@ -181,12 +210,36 @@ static inline void InitPageUpdateLink(uint32_t relink,PhysPt addr) {
 	if (relink>1) PAGING_LinkPage_ReadOnly(addr>>12,relink);
 }
 
+// The directory entry of the last page walk, kept while it's present and
+// accessed like a real CPU keeps it in its TLB; the guest has to flush the
+// TLB after changing it
+static struct {
+	PhysPt addr = 0;
+	X86PageEntry entry = {};
+	bool valid = false;
+} dir_cache = {};
+
+static inline void read_dir_entry(const PhysPt table_addr, X86PageEntry &table)
+{
+	if (dir_cache.valid && dir_cache.addr == table_addr) {
+		METRICS_Add(Metric::PageDirCacheHits);
+		table = dir_cache.entry;
+		return;
+	}
+	table.load = phys_readd(table_addr);
+	if (table.block.p && table.block.a) {
+		dir_cache.addr = table_addr;
+		dir_cache.entry = table;
+		dir_cache.valid = true;
+	}
+}
+
 static inline void InitPageCheckPresence(PhysPt lin_addr,bool writing,X86PageEntry& table,X86PageEntry& entry) {
 	const auto lin_page=lin_addr >> 12;
 	const auto d_index=lin_page >> 10;
 	const auto t_index=lin_page & 0x3ff;
 	const auto table_addr=(paging.base.page<<12)+d_index*4;
-	table.load=phys_readd(table_addr);
+	read_dir_entry(table_addr, table);
 	if (!table.block.p) {
 		LOG(LOG_PAGING,LOG_NORMAL)("NP Table");
 		PAGING_PageFault(lin_addr,table_addr,
@@ -212,7 +265,7 @@ static inline bool InitPageCheckPresence_CheckOnly(PhysPt lin_addr,bool writing,
 	const auto d_index=lin_page >> 10;
 	const auto t_index=lin_page & 0x3ff;
 	const auto table_addr=(paging.base.page<<12)+d_index*4;
-	table.load=phys_readd(table_addr);
+	read_dir_entry(table_addr, table);
 	if (!table.block.p) {
 		paging.cr2=lin_addr;
 		cpu.exception.which=EXCEPTION_PF;
@@ -668,44 +721,68 @@ bool PAGING_ForcePageInit(Bitu lin_addr) {
 
 #if defined(USE_FULL_TLB)
 void PAGING_InitTLB(void) {
+	dir_cache.valid=false;
 	for (auto i=0;i<TLB_SIZE;i++) {
 		paging.tlb.read[i]=nullptr;
 		paging.tlb.write[i]=nullptr;
-		paging.tlb.readhandler[i]=&init_page_handler;
-		paging.tlb.writehandler[i]=&init_page_handler;
+		paging.tlb.page[i].readhandler=&init_page_handler;
+		paging.tlb.page[i].writehandler=&init_page_handler;
 	}
 	paging.links.used=0;
 }
 
 void PAGING_ClearTLB(void) {
+	dir_cache.valid=false;
+	// the descriptor tables may now be mapped elsewhere
+	if (paging.enabled)
+		CPU_FlushDescriptorCache();
 	uint32_t * entries=&paging.links.entries[0];
 	for (;paging.links.used>0;paging.links.used--) {
 		const auto page=*entries++;
 		paging.tlb.read[page]=nullptr;
 		paging.tlb.write[page]=nullptr;
-		paging.tlb.readhandler[page]=&init_page_handler;
-		paging.tlb.writehandler[page]=&init_page_handler;
+		paging.tlb.page[page].readhandler=&init_page_handler;
+		paging.tlb.page[page].writehandler=&init_page_handler;
 	}
 	paging.links.used=0;
 }
 
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
+	dir_cache.valid=false;
 	for (;pages>0;pages--) {
 		paging.tlb.read[lin_page]=nullptr;
 		paging.tlb.write[lin_page]=nullptr;
-		paging.tlb.readhandler[lin_page]=&init_page_handler;
-		paging.tlb.writehandler[lin_page]=&init_page_handler;
+		paging.tlb.page[lin_page].readhandler=&init_page_handler;
+		paging.tlb.page[lin_page].writehandler=&init_page_handler;
 		lin_page++;
 	}
 }
 
+void PAGING_RelinkPages(Bitu lin_page,Bitu pages) {
+	for (;pages>0;pages--,lin_page++) {
+		auto &page=paging.tlb.page[lin_page];
+		if (page.readhandler==&init_page_handler)
+			continue;
+		const auto handler=MEM_GetPageHandler(page.phys_page);
+		if (handler!=page.readhandler) {
+			PAGING_UnlinkPages(lin_page,1);
+			continue;
+		}
+		const auto lin_base=lin_page << 12;
+		if (handler->flags & PFLAG_READABLE) paging.tlb.read[lin_page]=handler->GetHostReadPt(page.phys_page)-lin_base;
+		if (handler->flags & PFLAG_WRITEABLE && page.writehandler==handler)
+			paging.tlb.write[lin_page]=handler->GetHostWritePt(page.phys_page)-lin_base;
+	}
+}
+
 void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
+	CPU_FlushDescriptorCache();
 	if (lin_page<LINK_START) {
 		paging.firstmb[lin_page]=phys_page;
 		paging.tlb.read[lin_page]=nullptr;
 		paging.tlb.write[lin_page]=nullptr;
-		paging.tlb.readhandler[lin_page]=&init_page_handler;
-		paging.tlb.writehandler[lin_page]=&init_page_handler;
+		paging.tlb.page[lin_page].readhandler=&init_page_handler;
+		paging.tlb.page[lin_page].writehandler=&init_page_handler;
 	} else {
 		PAGING_LinkPage(lin_page,phys_page);
 	}
@@ -723,15 +800,15 @@ void PAGING_LinkPage(uint32_t lin_page,uint32_t phys_page) {
 		assert(paging.links.used == 0);
 	}
 
-	paging.tlb.phys_page[lin_page]=phys_page;
+	paging.tlb.page[lin_page].phys_page=phys_page;
 	if (handler->flags & PFLAG_READABLE) paging.tlb.read[lin_page]=handler->GetHostReadPt(phys_page)-lin_base;
 	else paging.tlb.read[lin_page]=nullptr;
 	if (handler->flags & PFLAG_WRITEABLE) paging.tlb.write[lin_page]=handler->GetHostWritePt(phys_page)-lin_base;
 	else paging.tlb.write[lin_page]=nullptr;
 
 	paging.links.entries[paging.links.used++]=lin_page;
-	paging.tlb.readhandler[lin_page]=handler;
-	paging.tlb.writehandler[lin_page]=handler;
+	paging.tlb.page[lin_page].readhandler=handler;
+	paging.tlb.page[lin_page].writehandler=handler;
 }
 
 void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page) {
@@ -746,14 +823,14 @@ void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page) {
 		assert(paging.links.used == 0);
 	}
 
-	paging.tlb.phys_page[lin_page]=phys_page;
+	paging.tlb.page[lin_page].phys_page=phys_page;
 	if (handler->flags & PFLAG_READABLE) paging.tlb.read[lin_page]=handler->GetHostReadPt(phys_page)-lin_base;
 	else paging.tlb.read[lin_page]=nullptr;
 	paging.tlb.write[lin_page]=nullptr;
 
 	paging.links.entries[paging.links.used++]=lin_page;
-	paging.tlb.readhandler[lin_page]=handler;
-	paging.tlb.writehandler[lin_page]=&init_page_handler_userro;
+	paging.tlb.page[lin_page].readhandler=handler;
+	paging.tlb.page[lin_page].writehandler=&init_page_handler_userro;
 }
 
 #else
@@ -774,11 +851,16 @@ void PAGING_InitTLBBank(tlb_entry **bank) {
 }
 
 void PAGING_InitTLB(void) {
+	dir_cache.valid=false;
 	InitTLBInt(paging.tlbh);
  	paging.links.used=0;
 }
 
 void PAGING_ClearTLB(void) {
+	dir_cache.valid=false;
+	// the descriptor tables may now be mapped elsewhere
+	if (paging.enabled)
+		CPU_FlushDescriptorCache();
 	uint32_t * entries=&paging.links.entries[0];
 	for (;paging.links.used>0;paging.links.used--) {
 		Bitu page=*entries++;
@@ -792,6 +874,7 @@ void PAGING_ClearTLB(void) {
 }
 
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
+	dir_cache.valid=false;
 	for (;pages>0;pages--) {
 		tlb_entry *entry = get_tlb_entry(lin_page<<12);
 		entry->read=0;
@@ -802,7 +885,25 @@ void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
 	}
 }
 
+void PAGING_RelinkPages(Bitu lin_page,Bitu pages) {
+	for (;pages>0;pages--,lin_page++) {
+		tlb_entry *entry = get_tlb_entry(lin_page<<12);
+		if (entry->readhandler==&init_page_handler)
+			continue;
+		PageHandler * handler=MEM_GetPageHandler(entry->phys_page);
+		if (handler!=entry->readhandler) {
+			PAGING_UnlinkPages(lin_page,1);
+			continue;
+		}
+		Bitu lin_base=lin_page << 12;
+		if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(entry->phys_page)-lin_base;
+		if (handler->flags & PFLAG_WRITEABLE && entry->writehandler==handler)
+			entry->write=handler->GetHostWritePt(entry->phys_page)-lin_base;
+	}
+}
+
 void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
+	CPU_FlushDescriptorCache();
 	if (lin_page<LINK_START) {
 		paging.firstmb[lin_page]=phys_page;
 		paging.tlbh[lin_page].read=0;
@@ -878,6 +979,7 @@ void PAGING_Enable(bool enabled) {
 	/* If paging is disabled, we work from a default paging table */
 	if (paging.enabled==enabled) return;
 	paging.enabled=enabled;
+	CPU_FlushDescriptorCache();
 	if (enabled) {
 		if (GCC_UNLIKELY(cpudecoder==CPU_Core_Simple_Run)) {
 //			LOG_MSG("CPU core simple won't run this game,switching to normal");
@@ -895,6 +997,18 @@ bool PAGING_Enabled(void) {
 	return paging.enabled;
 }
 
+static void paging_snapshot(SnapshotStream &s)
+{
+	s.Pod(paging.cr3);
+	s.Pod(paging.cr2);
+	s.Pod(paging.base);
+	s.Pod(paging.firstmb);
+	s.Pod(paging.enabled);
+	// the TLB holds host pointers, it refills from the page tables
+	if (s.IsLoading())
+		PAGING_InitTLB();
+}
+
 class PAGING final : public Module_base{
 public:
 	PAGING(Section* configuration):Module_base(configuration){
@@ -905,6 +1019,7 @@ public:
 			paging.firstmb[i]=i;
 		}
 		pf_queue.used=0;
+		SNAPSHOT_AddComponent("paging", paging_snapshot);
 	}
 };
 
@@ -20,6 +20,13 @@
 #ifndef DOSBOX_STRING_OPS_H
 #define DOSBOX_STRING_OPS_H
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "mem.h"
+#include "paging.h"
+
 // string instructions
 enum STRING_OP {
 	R_OUTSB = 0,
@@ -45,4 +52,171 @@ enum STRING_OP {
 	R_CMPSD,
 };
 
+/* Bulk REP MOVS/STOS
+ * A run is the stretch of elements, starting with the current one, that
+ * stays within one page for every operand and does not wrap the address
+ * mask. When its pages are plain host RAM, the whole run is done with one
+ * host memory operation; otherwise the caller does its elements one by one.
+ */
+struct StringRun {
+	uint32_t elements = 1;
+	bool bulk = false;
+};
+
+// Elements of the run starting at 'base + index', zero if the current
+// element itself crosses a page or wraps the address mask
+static inline uint32_t string_run_length(const PhysPt base, const uint32_t index,
+                                         const uint32_t mask, const int32_t step,
+                                         const uint32_t count)
+{
+	const auto size   = static_cast<uint32_t>(step > 0 ? step : -step);
+	const auto offset = (base + index) & 0xfff;
+	if (offset + size > 0x1000 || uint64_t{index} + size - 1 > mask)
+		return 0;
+
+	const uint64_t bytes = (step > 0)
+	                             ? std::min(uint64_t{0x1000} - offset,
+	                                        uint64_t{mask} - index + 1)
+	                             : uint64_t{std::min(offset, index)} + size;
+	return static_cast<uint32_t>(std::min(bytes / size, uint64_t{count}));
+}
+
+static inline StringRun string_movs_run(const PhysPt si_base, const uint32_t si_index,
+                                        const PhysPt di_base, const uint32_t di_index,
+                                        const uint32_t mask, const int32_t step,
+                                        const uint32_t count)
+{
+	const auto elements = std::min(
+	        string_run_length(si_base, si_index, mask, step, count),
+	        string_run_length(di_base, di_index, mask, step, count));
+	if (!elements)
+		return {};
+
+	// The runs count downwards when the direction flag is set
+	const auto size  = static_cast<uint32_t>(step > 0 ? step : -step);
+	const auto bytes = elements * size;
+	const auto back  = (step > 0) ? 0 : bytes - size;
+	const PhysPt src = si_base + si_index - back;
+	const PhysPt dst = di_base + di_index - back;
+
+	const HostPt src_tlb = get_tlb_read(src);
+	const HostPt dst_tlb = get_tlb_write(dst);
+	if (!src_tlb)
+		return {elements, false};
+	if (!dst_tlb) {
+		// Blits from RAM to video memory
+		const auto handler = get_tlb_writehandler(dst);
+		if (!(handler->flags & PFLAG_WRITESPAN))
+			return {elements, false};
+		handler->write_span(dst, src_tlb + src, bytes);
+		return {elements, true};
+	}
+
+	// Copying element by element only matches memmove if the destination
+	// does not run into source bytes that are still to be read
+	const auto s = reinterpret_cast<uintptr_t>(src_tlb + src);
+	const auto d = reinterpret_cast<uintptr_t>(dst_tlb + dst);
+	const bool overlaps = (step > 0) ? (d > s && d < s + bytes)
+	                                 : (d < s && d + bytes > s);
+	if (overlaps)
+		return {elements, false};
+
+	memmove(dst_tlb + dst, src_tlb + src, bytes);
+	return {elements, true};
+}
+
+template <typename T>
+static inline void string_fill(HostPt host, const uint32_t elements, const T value)
+{
+	if constexpr (sizeof(T) == 1) {
+		memset(host, value, elements);
+	} else {
+		for (uint32_t i = 0; i < elements; ++i, host += sizeof(T)) {
+			if constexpr (sizeof(T) == 2)
+				host_writew(host, value);
+			else
+				host_writed(host, value);
+		}
+	}
+}
+
+template <typename T>
+static inline StringRun string_stos_run(const PhysPt di_base, const uint32_t di_index,
+                                        const uint32_t mask, const int32_t step,
+                                        const uint32_t count, const T value)
+{
+	const auto elements = string_run_length(di_base, di_index, mask, step, count);
+	if (!elements)
+		return {};
+
+	const auto back  = (step > 0) ? 0 : (elements - 1) * sizeof(T);
+	const PhysPt dst = di_base + di_index - static_cast<uint32_t>(back);
+
+	const HostPt dst_tlb = get_tlb_write(dst);
+	if (!dst_tlb) {
+		// Clears of video memory
+		const auto handler = get_tlb_writehandler(dst);
+		if (!(handler->flags & PFLAG_WRITESPAN))
+			return {elements, false};
+		uint8_t pattern[4096];
+		string_fill(pattern, elements, value);
+		handler->write_span(dst, pattern, elements * sizeof(T));
+		return {elements, true};
+	}
+	string_fill(dst_tlb + dst, elements, value);
+	return {elements, true};
+}
+
+/* The REP MOVS/STOS loops shared by the cores: 'count' elements are done
+ * in runs, in bulk where the run allows and otherwise through the core's
+ * own element function, which is given the element's address(es). The
+ * indexes are left pointing past the last element and 'count' at zero.
+ */
+template <typename Index, typename Count, typename CopyElement>
+static inline void string_rep_movs(const PhysPt si_base, Index &si_index,
+                                   const PhysPt di_base, Index &di_index,
+                                   const uint32_t mask, const int32_t step,
+                                   Count &count, CopyElement copy_element)
+{
+	while (count > 0) {
+		const auto run = string_movs_run(si_base, static_cast<uint32_t>(si_index),
+		                                 di_base, static_cast<uint32_t>(di_index),
+		                                 mask, step, static_cast<uint32_t>(count));
+		if (run.bulk) {
+			si_index = static_cast<Index>((si_index + run.elements * step) & mask);
+			di_index = static_cast<Index>((di_index + run.elements * step) & mask);
+		} else {
+			for (auto i = run.elements; i > 0; i--) {
+				copy_element(si_base + static_cast<PhysPt>(si_index),
+				             di_base + static_cast<PhysPt>(di_index));
+				si_index = static_cast<Index>((si_index + step) & mask);
+				di_index = static_cast<Index>((di_index + step) & mask);
+			}
+		}
+		count -= run.elements;
+	}
+}
+
+template <typename T, typename Index, typename Count, typename StoreElement>
+static inline void string_rep_stos(const PhysPt di_base, Index &di_index,
+                                   const uint32_t mask, const int32_t step,
+                                   Count &count, const T value,
+                                   StoreElement store_element)
+{
+	while (count > 0) {
+		const auto run = string_stos_run<T>(di_base, static_cast<uint32_t>(di_index),
+		                                    mask, step,
+		                                    static_cast<uint32_t>(count), value);
+		if (run.bulk) {
+			di_index = static_cast<Index>((di_index + run.elements * step) & mask);
+		} else {
+			for (auto i = run.elements; i > 0; i--) {
+				store_element(di_base + static_cast<PhysPt>(di_index));
+				di_index = static_cast<Index>((di_index + step) & mask);
+			}
+		}
+		count -= run.elements;
+	}
+}
+
 #endif
@@ -0,0 +1,210 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cpu_trace.h"
+
+#if C_HEAVY_DEBUG
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "../cpu/lazyflags.h"
+#include "cpu.h"
+#include "paging.h"
+#include "regs.h"
+
+// The ring holds about 4.5 MB of records; the writer thread drains it in
+// runs of up to its whole size
+constexpr size_t ring_capacity = 1 << 16;
+constexpr size_t ring_mask = ring_capacity - 1;
+
+static struct {
+	FILE *file = nullptr;
+	std::thread writer = {};
+	std::unique_ptr<CpuTraceRecord[]> ring = {};
+
+	// The emulation thread only advances head, the writer only tail
+	std::atomic<size_t> head = 0;
+	std::atomic<size_t> tail = 0;
+	std::atomic<bool> running = false;
+
+	uint32_t remaining = 0;
+	CpuTraceRecord previous = {};
+	bool is_first = true;
+} trace = {};
+
+static void write_records()
+{
+	using namespace std::chrono_literals;
+
+	for (;;) {
+		const auto tail = trace.tail.load(std::memory_order_relaxed);
+		const auto head = trace.head.load(std::memory_order_acquire);
+		if (head == tail) {
+			if (!trace.running.load(std::memory_order_acquire) &&
+			    trace.head.load(std::memory_order_acquire) == tail)
+				break;
+			std::this_thread::sleep_for(1ms);
+			continue;
+		}
+		// Write up to the end of the ring at once
+		const auto start = tail & ring_mask;
+		const auto count = std::min(head - tail, ring_capacity - start);
+		fwrite(&trace.ring[start], sizeof(CpuTraceRecord), count, trace.file);
+		trace.tail.store(tail + count, std::memory_order_release);
+	}
+}
+
+bool CPU_TRACE_IsActive()
+{
+	return trace.file != nullptr;
+}
+
+bool CPU_TRACE_Start(const char *filename, const uint32_t count)
+{
+	if (CPU_TRACE_IsActive())
+		CPU_TRACE_Stop();
+
+	trace.file = fopen(filename, "wb");
+	if (!trace.file)
+		return false;
+
+	CpuTraceHeader header = {};
+	memcpy(header.magic, cpu_trace_magic, sizeof(header.magic));
+	header.version = cpu_trace_version;
+	header.record_size = sizeof(CpuTraceRecord);
+	header.byte_order = 0x01020304;
+	fwrite(&header, sizeof(header), 1, trace.file);
+
+	if (!trace.ring)
+		trace.ring = std::make_unique<CpuTraceRecord[]>(ring_capacity);
+	trace.head = 0;
+	trace.tail = 0;
+	trace.remaining = count;
+	trace.is_first = true;
+	trace.running = true;
+	trace.writer = std::thread(write_records);
+	return true;
+}
+
+void CPU_TRACE_Stop()
+{
+	if (!CPU_TRACE_IsActive())
+		return;
+	trace.running.store(false, std::memory_order_release);
+	if (trace.writer.joinable())
+		trace.writer.join();
+	fclose(trace.file);
+	trace.file = nullptr;
+}
+
+static uint32_t current_flags()
+{
+	// The arithmetic flags may still be pending in the lazy flags, so
+	// resolve them without disturbing the CPU state
+	uint32_t flags = reg_flags & ~FMASK_TEST;
+	if (get_CF())
+		flags |= FLAG_CF;
+	if (get_PF())
+		flags |= FLAG_PF;
+	if (get_AF())
+		flags |= FLAG_AF;
+	if (get_ZF())
+		flags |= FLAG_ZF;
+	if (get_SF())
+		flags |= FLAG_SF;
+	if (get_OF())
+		flags |= FLAG_OF;
+	return flags;
+}
+
+static void fill_record(CpuTraceRecord &record)
+{
+	record.eip = reg_eip;
+	record.regs[0] = reg_eax;
+	record.regs[1] = reg_ebx;
+	record.regs[2] = reg_ecx;
+	record.regs[3] = reg_edx;
+	record.regs[4] = reg_esi;
+	record.regs[5] = reg_edi;
+	record.regs[6] = reg_ebp;
+	record.regs[7] = reg_esp;
+	record.flags = current_flags();
+	record.segs[0] = SegValue(cs);
+	record.segs[1] = SegValue(ds);
+	record.segs[2] = SegValue(es);
+	record.segs[3] = SegValue(fs);
+	record.segs[4] = SegValue(gs);
+	record.segs[5] = SegValue(ss);
+	record.code_big = cpu.code.big ? 1 : 0;
+
+	// Take up to the longest possible instruction; the decoder works out
+	// how many of the bytes belong to it
+	const PhysPt start = SegPhys(cs) + reg_eip;
+	uint8_t len = 0;
+	while (len < 15 && !mem_readb_checked(start + len, &record.opcode[len]))
+		++len;
+	record.opcode_len = len;
+
+	uint16_t changed = 0;
+	for (int i = 0; i < 8; ++i)
+		if (trace.is_first || record.regs[i] != trace.previous.regs[i])
+			changed |= static_cast<uint16_t>(TRACE_EAX << i);
+	if (trace.is_first || record.flags != trace.previous.flags)
+		changed |= TRACE_FLAGS;
+	for (int i = 0; i < 6; ++i)
+		if (trace.is_first || record.segs[i] != trace.previous.segs[i])
+			changed |= static_cast<uint16_t>(TRACE_CS << i);
+	record.changed = changed;
+
+	trace.previous = record;
+	trace.is_first = false;
+}
+
+bool CPU_TRACE_Record()
+{
+	if (!CPU_TRACE_IsActive())
+		return false;
+	if (trace.remaining == 0) {
+		CPU_TRACE_Stop();
+		return false;
+	}
+
+	const auto head = trace.head.load(std::memory_order_relaxed);
+	// Rather than dropping records, wait for the writer when it falls behind
+	while (head - trace.tail.load(std::memory_order_acquire) >= ring_capacity)
+		std::this_thread::yield();
+
+	fill_record(trace.ring[head & ring_mask]);
+	trace.head.store(head + 1, std::memory_order_release);
+
+	if (--trace.remaining == 0) {
+		CPU_TRACE_Stop();
+		return false;
+	}
+	return true;
+}
+
+#endif // C_HEAVY_DEBUG
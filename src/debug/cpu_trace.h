@@ -0,0 +1,97 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_CPU_TRACE_H
+#define DOSBOX_CPU_TRACE_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+
+/*
+Binary CPU Trace
+~~~~~~~~~~~~~~~~
+The heavy debugger's LOGB command records one fixed-size record per executed
+instruction instead of formatting a text line for it. The emulation thread
+only fills the record into a lock-free single-producer ring; a writer thread
+drains the ring to the file in large blocks, so long traces can be captured
+without slowing the emulation down to a crawl.
+
+File layout (host byte order, see byte_order):
+  CpuTraceHeader, followed by CpuTraceRecord entries until the end of file.
+
+scripts/decode-cpu-trace.py turns a trace back into text.
+*/
+
+constexpr char cpu_trace_magic[8] = {'D', 'B', 'X', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint16_t cpu_trace_version = 1;
+
+struct CpuTraceHeader {
+	char magic[8];
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t byte_order; // 0x01020304 as written by the host
+};
+static_assert(sizeof(CpuTraceHeader) == 16, "the header has no padding");
+
+// Bits of CpuTraceRecord::changed, set for the registers that differ from
+// the previous record (all of them in the first record)
+enum CpuTraceChanged : uint16_t {
+	TRACE_EAX = 1 << 0,
+	TRACE_EBX = 1 << 1,
+	TRACE_ECX = 1 << 2,
+	TRACE_EDX = 1 << 3,
+	TRACE_ESI = 1 << 4,
+	TRACE_EDI = 1 << 5,
+	TRACE_EBP = 1 << 6,
+	TRACE_ESP = 1 << 7,
+	TRACE_FLAGS = 1 << 8,
+	TRACE_CS = 1 << 9,
+	TRACE_DS = 1 << 10,
+	TRACE_ES = 1 << 11,
+	TRACE_FS = 1 << 12,
+	TRACE_GS = 1 << 13,
+	TRACE_SS = 1 << 14,
+};
+
+struct CpuTraceRecord {
+	uint32_t eip;
+	uint32_t regs[8]; // EAX, EBX, ECX, EDX, ESI, EDI, EBP, ESP
+	uint32_t flags;
+	uint16_t segs[6]; // CS, DS, ES, FS, GS, SS
+	uint16_t changed;
+	uint8_t code_big;
+	uint8_t opcode_len; // readable bytes at CS:EIP, at most 15
+	uint8_t opcode[16];
+};
+static_assert(sizeof(CpuTraceRecord) == 72, "the record has no padding");
+
+// Starts tracing the next 'count' instructions to the file
+bool CPU_TRACE_Start(const char *filename, uint32_t count);
+
+// Records the instruction at CS:EIP. Returns false once the requested count
+// has been traced and the trace was closed.
+bool CPU_TRACE_Record();
+
+void CPU_TRACE_Stop();
+
+bool CPU_TRACE_IsActive();
+
+#endif
@@ -22,6 +22,7 @@
 
 #include <string.h>
 #include <list>
+#include <unordered_map>
 #include <vector>
 #include <ctype.h>
 #include <fstream>
@@ -47,6 +48,7 @@ using namespace std;
 #include "shell.h"
 #include "programs.h"
 #include "debug_inc.h"
+#include "cpu_trace.h"
 #include "../cpu/lazyflags.h"
 #include "keyboard.h"
 #include "setup.h"
@@ -297,11 +299,12 @@ class CBreakpoint
 public:
 
 	CBreakpoint(void);
+	~CBreakpoint();
 	void					SetAddress		(uint16_t seg, uint32_t off)	{ location = GetAddress(seg,off); type = BKPNT_PHYSICAL; segment = seg; offset = off; }
 	void					SetAddress		(PhysPt adr)				{ location = adr; type = BKPNT_PHYSICAL; }
 	void					SetInt			(uint8_t _intNr, uint16_t ah, uint16_t al)	{ intNr = _intNr, ahValue = ah; alValue = al; type = BKPNT_INTERRUPT; }
 	void					SetOnce			(bool _once)				{ once = _once; }
-	void					SetType			(EBreakpoint _type)			{ type = _type; }
+	void					SetType			(EBreakpoint _type);
 	void					SetValue		(uint8_t value)				{ ahValue = value; }
 	void					SetOther		(uint8_t other)				{ alValue = other; }
 
@@ -334,9 +337,19 @@ public:
 	static bool				DeleteByIndex		(uint16_t index);
 	static void				DeleteAll			(void);
 	static void				ShowList			(void);
+#	if C_HEAVY_DEBUG
+	static bool				CheckMemBreakpoints	(void);
+#	endif
 
 
 private:
+	bool IsMemoryType() const noexcept
+	{
+		return type == BKPNT_MEMORY || type == BKPNT_MEMORY_PROT ||
+		       type == BKPNT_MEMORY_LINEAR;
+	}
+	void Track(bool tracked);
+
 	EBreakpoint type = {};
 	// Physical
 	PhysPt location  = 0;
@@ -350,6 +363,7 @@ private:
 	// Shared
 	bool active = 0;
 	bool once   = 0;
+	bool is_tracked = false; // counted in the active locations
 
 #	if C_HEAVY_DEBUG
 	friend bool DEBUG_HeavyIsBreakpoint(void);
@@ -362,6 +376,70 @@ location(0),oldData(0xCC),
 segment(0),offset(0),intNr(0),ahValue(0),alValue(0),
 active(false),once(false){ }
 
+// Active execution breakpoints, counted by their physical address, so the
+// check before each instruction is a single lookup
+static std::unordered_map<PhysPt, int> active_locations = {};
+
+#if C_HEAVY_DEBUG
+// Memory breakpoints
+// ~~~~~~~~~~~~~~~~~~
+// Rather than comparing the byte of every memory breakpoint after each
+// instruction, the RAM pages holding them are watched for writes, and the
+// bytes are only compared after one of those pages was written. A watch ends
+// with the first write, so the pages are watched again after comparing.
+// Breakpoints whose byte can't be watched are still compared after every
+// instruction: those in pages that aren't plain RAM, such as video memory,
+// and, as their pages can move without a write, those that depend on paging
+// or on protected-mode segments.
+static struct {
+	bool is_armed    = false; // the watches reflect the breakpoints
+	bool any         = false; // there are active memory breakpoints
+	bool polling     = false; // some can't be watched
+	bool written     = false; // a watched page was written
+	bool pmode       = false; // the CPU mode the watches were set up in
+	bool vm86        = false;
+	bool paging      = false;
+	bool has_handler = false;
+} mem_bps = {};
+
+static void mem_bp_page_written(Bitu)
+{
+	mem_bps.written = true;
+}
+#endif
+
+CBreakpoint::~CBreakpoint()
+{
+	Track(false);
+}
+
+void CBreakpoint::SetType(EBreakpoint _type)
+{
+	Track(false);
+	type = _type;
+	Track(active);
+}
+
+// Keeps the active execution breakpoints' index up to date, and has the
+// memory breakpoints set up again before the next instruction
+void CBreakpoint::Track(bool tracked)
+{
+#if C_HEAVY_DEBUG
+	if (IsMemoryType())
+		mem_bps.is_armed = false;
+#endif
+	if (type != BKPNT_PHYSICAL || tracked == is_tracked)
+		return;
+	is_tracked = tracked;
+	if (tracked) {
+		++active_locations[location];
+	} else {
+		const auto it = active_locations.find(location);
+		if (it != active_locations.end() && --it->second == 0)
+			active_locations.erase(it);
+	}
+}
+
 void CBreakpoint::Activate(bool _active)
 {
 #if !C_HEAVY_DEBUG
@@ -400,6 +478,7 @@ void CBreakpoint::Activate(bool _active)
 	}
 #endif
 	active = _active;
+	Track(_active);
 }
 
 // Statics
@@ -463,15 +542,19 @@ void CBreakpoint::ActivateBreakpointsExceptAt(PhysPt adr)
 // Checks if breakpoint is valid and should stop execution
 bool CBreakpoint::CheckBreakpoint(Bitu seg, Bitu off)
 {
-	// Quick exit if there are no breakpoints
-	if (BPoints.empty()) return false;
+	// Quick exit if there's no active breakpoint at the address
+	if (active_locations.empty())
+		return false;
+	const auto adr = GetAddress(seg, off);
+	if (!active_locations.count(adr))
+		return false;
 
 	// Search matching breakpoint
 	for (auto i = BPoints.begin(); i != BPoints.end(); ++i) {
 		auto bp = (*i);
 
 		if ((bp->GetType() == BKPNT_PHYSICAL) && bp->IsActive() &&
-		    (bp->GetLocation() == GetAddress(seg, off))) {
+		    (bp->GetLocation() == adr)) {
 			// Found
 			if (bp->GetOnce()) {
 				// delete it, if it should only be used once
@@ -489,38 +572,106 @@ bool CBreakpoint::CheckBreakpoint(Bitu seg, Bitu off)
 			}
 			return true;
 		}
+	}
+	return false;
+}
+
 #if C_HEAVY_DEBUG
-		// Memory breakpoint support
-		else if (bp->IsActive()) {
-			if ((bp->GetType()==BKPNT_MEMORY) || (bp->GetType()==BKPNT_MEMORY_PROT) || (bp->GetType()==BKPNT_MEMORY_LINEAR)) {
-				// Watch Protected Mode Memoryonly in pmode
-				if (bp->GetType()==BKPNT_MEMORY_PROT) {
-					// Check if pmode is active
-					if (!cpu.pmode) return false;
-					// Check if descriptor is valid
-					Descriptor desc;
-					if (!cpu.gdt.GetDescriptor(bp->GetSegment(),desc)) return false;
-					if (desc.GetLimit()==0) return false;
-				}
+// Watches the pages of the active memory breakpoints, and decides which ones
+// need polling instead
+static void arm_mem_breakpoints()
+{
+	if (!mem_bps.has_handler) {
+		MEM_AddWriteWatchHandler(mem_bp_page_written);
+		mem_bps.has_handler = true;
+	}
+	mem_bps.is_armed = true;
+	mem_bps.any      = false;
+	mem_bps.polling  = false;
+	mem_bps.written  = false;
+	mem_bps.pmode    = cpu.pmode;
+	mem_bps.vm86     = (reg_flags & FLAG_VM) != 0;
+	mem_bps.paging   = paging.enabled;
+
+	for (const auto &bp : BPoints) {
+		const auto type = bp->GetType();
+		if (!bp->IsActive() || (type != BKPNT_MEMORY && type != BKPNT_MEMORY_PROT &&
+		                        type != BKPNT_MEMORY_LINEAR))
+			continue;
+		mem_bps.any = true;
 
-				Bitu address; 
-				if (bp->GetType()==BKPNT_MEMORY_LINEAR) address = bp->GetOffset();
-				else address = GetAddress(bp->GetSegment(),bp->GetOffset());
-				uint8_t value=0;
-				if (mem_readb_checked(address,&value)) return false;
-				if (bp->GetValue() != value) {
-					// Yup, memory value changed
-					DEBUG_ShowMsg("DEBUG: Memory breakpoint %s: %04X:%04X - %02X -> %02X\n",(bp->GetType()==BKPNT_MEMORY_PROT)?"(Prot)":"",bp->GetSegment(),bp->GetOffset(),bp->GetValue(),value);
-					bp->SetValue(value);
-					return true;
-				}
-			}
+		const bool is_real_mode = !mem_bps.pmode || mem_bps.vm86;
+		if (mem_bps.paging || (type != BKPNT_MEMORY_LINEAR && !is_real_mode)) {
+			mem_bps.polling = true;
+			continue;
+		}
+		if (type == BKPNT_MEMORY_PROT)
+			continue; // only watched in protected mode
+
+		const PhysPt address = (type == BKPNT_MEMORY_LINEAR)
+		                             ? bp->GetOffset()
+		                             : GetAddress(bp->GetSegment(),
+		                                          bp->GetOffset());
+		// Reading the byte links its page, translating the address
+		uint8_t value = 0;
+		if (mem_readb_checked(address, &value) ||
+		    !MEM_WatchWrites(PAGING_GetPhysicalAddress(address) / MEM_PAGE_SIZE))
+			mem_bps.polling = true;
+	}
+}
+
+// Checks if a memory breakpoint's byte changed
+bool CBreakpoint::CheckMemBreakpoints()
+{
+	for (auto &bp : BPoints) {
+		if (!bp->IsActive() || !bp->IsMemoryType())
+			continue;
+
+		// Watch Protected Mode Memoryonly in pmode
+		if (bp->GetType()==BKPNT_MEMORY_PROT) {
+			// Check if pmode is active
+			if (!cpu.pmode) continue;
+			// Check if descriptor is valid
+			Descriptor desc;
+			if (!cpu.gdt.GetDescriptor(bp->GetSegment(),desc)) continue;
+			if (desc.GetLimit()==0) continue;
+		}
+
+		Bitu address; 
+		if (bp->GetType()==BKPNT_MEMORY_LINEAR) address = bp->GetOffset();
+		else address = GetAddress(bp->GetSegment(),bp->GetOffset());
+		uint8_t value=0;
+		if (mem_readb_checked(address,&value)) continue;
+		if (bp->GetValue() != value) {
+			// Yup, memory value changed
+			DEBUG_ShowMsg("DEBUG: Memory breakpoint %s: %04X:%04X - %02X -> %02X\n",(bp->GetType()==BKPNT_MEMORY_PROT)?"(Prot)":"",bp->GetSegment(),bp->GetOffset(),bp->GetValue(),value);
+			bp->SetValue(value);
+			return true;
 		}
-#endif
 	}
 	return false;
 }
 
+// Compares the memory breakpoints' bytes when one of their pages was written,
+// or after every instruction for those that can't be watched
+static bool check_mem_breakpoints()
+{
+	if (!mem_bps.is_armed || mem_bps.pmode != cpu.pmode ||
+	    mem_bps.vm86 != ((reg_flags & FLAG_VM) != 0) ||
+	    mem_bps.paging != paging.enabled)
+		arm_mem_breakpoints();
+
+	if (!mem_bps.any || (!mem_bps.polling && !mem_bps.written))
+		return false;
+
+	// Watch the written pages again
+	if (mem_bps.written)
+		mem_bps.is_armed = false;
+
+	return CBreakpoint::CheckMemBreakpoints();
+}
+#endif
+
 bool CBreakpoint::CheckIntBreakpoint([[maybe_unused]] PhysPt adr, uint8_t intNr, uint16_t ahValue, uint16_t alValue)
 // Checks if interrupt breakpoint is valid and should stop execution
 {
@@ -1223,6 +1374,19 @@ bool ParseCommand(char* str) {
 		command = "logcode";
 	}
 
+	if (command == "LOGB") { // Create binary cpu trace file
+		const auto count = static_cast<uint32_t>(GetHexValue(found, found));
+		if (!CPU_TRACE_Start("LOGCPU.BIN", count)) {
+			DEBUG_ShowMsg("DEBUG: Tracefile couldn't be created.\n");
+			return false;
+		}
+		DEBUG_ShowMsg("DEBUG: Starting trace\n");
+		debugging = false;
+		CBreakpoint::ActivateBreakpointsExceptAt(SegPhys(cs)+reg_eip);
+		DOSBOX_SetNormalLoop();
+		return true;
+	}
+
 	if (command == "logcode") { //Shared code between all logs
 		DEBUG_ShowMsg("DEBUG: Starting log\n");
 		cpuLogFile.open("LOGCPU.TXT");
@@ -1351,6 +1515,7 @@ bool ParseCommand(char* str) {
 #if C_HEAVY_DEBUG
 		DEBUG_ShowMsg("LOG [num]                 - Write cpu log file.\n");
 		DEBUG_ShowMsg("LOGS/LOGL/LOGC [num]      - Write short/long/cs:ip-only cpu log file.\n");
+		DEBUG_ShowMsg("LOGB [num]                - Write binary cpu trace file.\n");
 		DEBUG_ShowMsg("HEAVYLOG                  - Enable/Disable automatic cpu log when DOSBox exits.\n");
 		DEBUG_ShowMsg("ZEROPROTECT               - Enable/Disable zero code execution detection.\n");
 #endif
@@ -2244,6 +2409,9 @@ Bitu DEBUG_EnableDebugger()
 void DEBUG_ShutDown(Section * /*sec*/) {
 	CBreakpoint::DeleteAll();
 	CDebugVar::DeleteAll();
+#if C_HEAVY_DEBUG
+	CPU_TRACE_Stop();
+#endif
 	curs_set(old_cursor_state);
 
 	if (pdc_window)
@@ -2608,6 +2776,11 @@ bool DEBUG_HeavyIsBreakpoint(void) {
 			return true;
 		}
 	}
+	if (CPU_TRACE_IsActive() && !CPU_TRACE_Record()) {
+		DEBUG_ShowMsg("DEBUG: cpu trace LOGCPU.BIN created\n");
+		DEBUG_EnableDebugger();
+		return true;
+	}
 	// LogInstruction
 	if (logHeavy) DEBUG_HeavyLogInstruction();
 	if (zeroProtect) {
@@ -2623,10 +2796,12 @@ bool DEBUG_HeavyIsBreakpoint(void) {
 		skipFirstInstruction = false;
 		return false;
 	}
-	if (BPoints.size() && CBreakpoint::CheckBreakpoint(SegValue(cs), reg_eip))
+	if (BPoints.empty())
+		return false;
+	if (CBreakpoint::CheckBreakpoint(SegValue(cs), reg_eip))
 		return true;
 
-	return false;
+	return check_mem_breakpoints();
 }
 
 #endif // HEAVY DEBUG
@@ -121,15 +121,16 @@ void DEBUG_RefreshPage(int scroll) {
 	wrefresh(dbg.win_out);
 }
 
-void LOG::operator() (char const* format, ...){
+void LogMessage::operator() (char const* format, ...){
+	if (d_type>=LOG_MAX) return;
+	if ((d_severity!=LOG_ERROR) && (!loggrp[d_type].enabled)) return;
+
 	char buf[512];
 	va_list msg;
 	va_start(msg,format);
 	vsprintf(buf,format,msg);
 	va_end(msg);
 
-	if (d_type>=LOG_MAX) return;
-	if ((d_severity!=LOG_ERROR) && (!loggrp[d_type].enabled)) return;
 	DEBUG_ShowMsg("%10u: %s:%s\n",static_cast<uint32_t>(cycle_count),loggrp[d_type].front,buf);
 }
 
@@ -24,13 +24,16 @@
 
 #include "dosbox.h"
 
+#include <condition_variable>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <SDL.h>
@@ -248,6 +251,35 @@ private:
 		std::ifstream   *file;
 	};
 
+	// Reads a BIN or ISO track through a read-only mapping of the whole
+	// file, so sectors are copied straight out of the page cache and runs
+	// of sectors take a single copy. The host reads ahead on its own as
+	// the mapping is told it's accessed sequentially.
+	class MappedFile final : public TrackFile {
+	public:
+		MappedFile      (const char *filename, bool &error);
+		~MappedFile     ();
+
+		MappedFile      () = delete;
+		MappedFile      (const MappedFile&) = delete; // prevent copying
+		MappedFile&     operator= (const MappedFile&) = delete; // prevent assignment
+
+		bool            read(uint8_t *buffer,
+		                     const uint32_t offset,
+		                     const uint32_t requested_bytes);
+		bool            seek(const uint32_t offset);
+		uint32_t        decode(int16_t *buffer, const uint32_t desired_track_frames);
+		uint16_t          getEndian();
+		uint32_t          getRate() { return 44100; }
+		uint8_t           getChannels() { return 2; }
+		int             getLength() { return length_redbook_bytes; }
+		void setAudioPosition(uint32_t pos) { audio_pos = pos; }
+
+	private:
+		const uint8_t   *data = nullptr;
+		size_t          size = 0;
+	};
+
 	class AudioFile final : public TrackFile {
 	public:
 		AudioFile       (const char *filename, bool &error);
@@ -270,7 +302,25 @@ private:
 		// areas of this class.
 		void setAudioPosition([[maybe_unused]] uint32_t pos) {}
 	private:
+		bool            seekSample(const uint32_t offset);
+		void            stopReadAhead();
+		void            readAhead();
+
 		Sound_Sample *sample = nullptr;
+
+		// Playback decodes ahead on a thread of its own into a ring of
+		// the track's frames, so slow stretches of the codec don't
+		// starve the mixer. Seeking elsewhere cancels the read-ahead.
+		std::thread             decoder = {};
+		std::mutex              sample_mutex = {}; // guards the sample
+		std::mutex              ring_mutex = {};   // guards what follows
+		std::condition_variable ring_changed = {};
+		std::vector<uint8_t>    ring = {};
+		size_t                  ring_start = 0;
+		size_t                  ring_fill = 0;
+		bool                    reading_ahead = false;
+		bool                    decoded_to_end = false;
+		bool                    quit = false;
 	};
 
 public:
@@ -312,6 +362,7 @@ private:
 	static struct imagePlayer {
 		// Objects, pointers, and then scalars; in descending size-order.
 		std::weak_ptr<TrackFile> trackFile = {};
+		std::vector<int16_t>     buffer    = {}; // allocated on first play
 		mixer_channel_t channel = nullptr;
 		CDROM_Interface_Image    *cd                = nullptr;
 		void (MixerChannel::*addFrames)(uint16_t, const int16_t *) = nullptr;
@@ -319,17 +370,20 @@ private:
 		uint32_t                 totalTrackFrames   = 0;
 		uint32_t                 startSector        = 0;
 		uint32_t                 totalRedbookFrames = 0;
-		int16_t                  buffer[MIXER_BUFSIZE * REDBOOK_CHANNELS] = {0};
 		bool                     isPlaying          = false;
 		bool                     isPaused           = false;
 	} player;
 
 	// Private utility functions
+	static std::shared_ptr<TrackFile> OpenBinaryTrack(const char *filename,
+	                                                  bool &error);
 	bool  LoadIsoFile(char *filename);
 	bool  CanReadPVD(TrackFile *file,
 	                 const uint16_t sectorSize,
 	                 const bool mode2);
 	std::vector<Track>::iterator GetTrack(const uint32_t sector);
+	uint32_t ReadSectorRun(uint8_t *buffer, const bool raw,
+	                       const uint32_t sector, const uint32_t num);
 	void CDAudioCallBack(uint16_t desired_frames);
 
 	// Private functions for cue sheet processing
@@ -346,6 +400,7 @@ private:
 	// member variables
 	std::vector<Track>   tracks;
 	std::vector<uint8_t> readBuffer;
+	std::vector<uint8_t> sectorRunBuffer = {};
 	std::string          mcn;
 	static int           refCount;
 };
@@ -23,11 +23,13 @@
 
 #include "cdrom.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 #include <chrono>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -37,12 +39,21 @@
 
 #if !defined(WIN32)
 #include <libgen.h>
-#else
-#include <cstring>
+#endif
+
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #include "drives.h"
 #include "fs_utils.h"
+#include "memory_report.h"
+#include "metrics.h"
 #include "setup.h"
 #include "string_utils.h"
 #include "math_utils.h"
@@ -58,6 +69,11 @@ using track_iter       = vector<CDROM_Interface_Image::Track>::iterator;
 using track_const_iter = vector<CDROM_Interface_Image::Track>::const_iterator;
 using tracks_size_t    = vector<CDROM_Interface_Image::Track>::size_type;
 
+// How far codec-based tracks are decoded ahead of the playback, and in how
+// large steps
+constexpr uint32_t audio_readahead_seconds = 2;
+constexpr uint32_t audio_readahead_chunk_frames = 2048;
+
 // Report bad seeks that would go beyond the end of the track
 bool CDROM_Interface_Image::TrackFile::offsetInsideTrack(const uint32_t offset)
 {
@@ -217,6 +233,124 @@ uint32_t CDROM_Interface_Image::BinaryFile::decode(int16_t *buffer,
 	return ceil_udivide(bytes_read, BYTES_PER_REDBOOK_PCM_FRAME);
 }
 
+CDROM_Interface_Image::MappedFile::MappedFile(const char *filename, bool &error)
+        : TrackFile(BYTES_PER_RAW_REDBOOK_FRAME)
+{
+	error = true;
+#if defined(WIN32)
+	const auto file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+	                              nullptr, OPEN_EXISTING,
+	                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	LARGE_INTEGER file_size = {};
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 &&
+	    static_cast<uint64_t>(file_size.QuadPart) <= MAX_REDBOOK_BYTES) {
+		const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+		                                        0, 0, nullptr);
+		if (mapping) {
+			// The view keeps the mapping and the file open
+			data = static_cast<const uint8_t *>(
+			        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+		size = static_cast<size_t>(file_size.QuadPart);
+	}
+	CloseHandle(file);
+#elif defined(HAVE_MMAP)
+	const auto fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat file_stat = {};
+	if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0 &&
+	    static_cast<uint64_t>(file_stat.st_size) <= MAX_REDBOOK_BYTES) {
+		size = static_cast<size_t>(file_stat.st_size);
+		const auto ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr != MAP_FAILED) {
+			madvise(ptr, size, MADV_SEQUENTIAL);
+			data = static_cast<const uint8_t *>(ptr);
+		}
+	}
+	// The mapping keeps the file open
+	close(fd);
+#else
+	(void)filename;
+#endif
+	if (!data)
+		return;
+	length_redbook_bytes = static_cast<int>(size);
+	error = false;
+}
+
+CDROM_Interface_Image::MappedFile::~MappedFile()
+{
+	// Guard: only cleanup if needed
+	if (data == nullptr)
+		return;
+#if defined(WIN32)
+	UnmapViewOfFile(data);
+#elif defined(HAVE_MMAP)
+	munmap(const_cast<uint8_t *>(data), size);
+#endif
+	data = nullptr;
+}
+
+bool CDROM_Interface_Image::MappedFile::read(uint8_t *buffer,
+                                             const uint32_t offset,
+                                             const uint32_t requested_bytes)
+{
+	// Check for logic bugs and illegal values
+	assertm(data && buffer, "The mapping and/or buffer pointer is invalid");
+	assertm(offset <= MAX_REDBOOK_BYTES, "Requested offset exceeds CDROM size");
+	assertm(requested_bytes <= MAX_REDBOOK_BYTES, "Requested bytes exceeds CDROM size");
+
+	const uint32_t adjusted_bytes = adjustOverRead(offset, requested_bytes);
+	if (adjusted_bytes == 0) // no work to do!
+		return true;
+
+	memcpy(buffer, data + offset, adjusted_bytes);
+	return true;
+}
+
+uint16_t CDROM_Interface_Image::MappedFile::getEndian()
+{
+	// Image files are always little endian
+	return AUDIO_S16LSB;
+}
+
+bool CDROM_Interface_Image::MappedFile::seek(const uint32_t offset)
+{
+	// Check for logic bugs and illegal values
+	assertm(offset <= MAX_REDBOOK_BYTES, "Requested offset exceeds CDROM size");
+
+	// Reads are positioned by their offset, so there's nothing to move
+	return offsetInsideTrack(offset);
+}
+
+uint32_t CDROM_Interface_Image::MappedFile::decode(int16_t *buffer,
+                                                   const uint32_t desired_track_frames)
+{
+	// Guard against logic bugs and illegal values
+	assertm(buffer && data, "The mapping or buffer pointer are invalid");
+	assertm(desired_track_frames <= MAX_REDBOOK_FRAMES,
+	        "Requested number of frames exceeds the maximum for a CDROM");
+	assertm(audio_pos < MAX_REDBOOK_BYTES,
+	        "Tried to decode audio before the playback position was set");
+
+	if (!offsetInsideTrack(audio_pos))
+		return 0;
+
+	const auto bytes_read = std::min(desired_track_frames * BYTES_PER_REDBOOK_PCM_FRAME,
+	                                 static_cast<uint32_t>(size) - audio_pos);
+	memcpy(buffer, data + audio_pos, bytes_read);
+
+	// decoding is an audio-task, so update our audio position
+	audio_pos += bytes_read;
+
+	// Return the number of decoded Redbook frames
+	return ceil_udivide(bytes_read, BYTES_PER_REDBOOK_PCM_FRAME);
+}
+
 CDROM_Interface_Image::AudioFile::AudioFile(const char *filename, bool &error)
 	: TrackFile(4096)
 {
@@ -237,6 +371,15 @@ CDROM_Interface_Image::AudioFile::AudioFile(const char *filename, bool &error)
 
 CDROM_Interface_Image::AudioFile::~AudioFile()
 {
+	if (decoder.joinable()) {
+		{
+			std::lock_guard<std::mutex> ring_lock(ring_mutex);
+			quit = true;
+		}
+		ring_changed.notify_all();
+		decoder.join();
+	}
+
 	// Guard to prevent double-free or nullptr free
 	if (sample == nullptr)
 		return;
@@ -258,6 +401,17 @@ CDROM_Interface_Image::AudioFile::~AudioFile()
  *  time-offset, and use the Sound_Seek() function to move the read position.
  */
 bool CDROM_Interface_Image::AudioFile::seek(const uint32_t requested_pos)
+{
+	std::lock_guard<std::mutex> sample_lock(sample_mutex);
+	std::lock_guard<std::mutex> ring_lock(ring_mutex);
+	const bool result = seekSample(requested_pos);
+	ring_changed.notify_all();
+	return result;
+}
+
+// Seeks with both mutexes held. The read-ahead, if running, continues from
+// the new position.
+bool CDROM_Interface_Image::AudioFile::seekSample(const uint32_t requested_pos)
 {
 	// Check for logic bugs and if the track is already positioned as requested
 	assertm(sample, "Audio sample needs to be valid, but is the nullptr");
@@ -266,6 +420,7 @@ bool CDROM_Interface_Image::AudioFile::seek(const uint32_t requested_pos)
 	if (!offsetInsideTrack(requested_pos))
 		return false;
 
+	// The frames read ahead continue from the playback position
 	if (audio_pos == requested_pos) {
 #ifdef DEBUG
 		LOG_MSG("CDROM: seek to %u avoided with position-tracking", requested_pos);
@@ -273,6 +428,11 @@ bool CDROM_Interface_Image::AudioFile::seek(const uint32_t requested_pos)
 		return true;
 	}
 
+	// Drop what was read ahead from the previous position
+	ring_start = 0;
+	ring_fill = 0;
+	decoded_to_end = false;
+
 	// Convert the position from a byte offset to time offset, in milliseconds.
 	const uint32_t ms_per_s = 1000;
 	const uint32_t pos_in_frames = ceil_udivide(requested_pos, BYTES_PER_RAW_REDBOOK_FRAME);
@@ -346,8 +506,14 @@ bool CDROM_Interface_Image::AudioFile::read(uint8_t *buffer,
 		return false; // we always correctly return false to the application in this case.
 	}
 
-	if (!seek(requested_pos))
-		return false;
+	// Extract the audio directly from the codec, from the requested position
+	std::lock_guard<std::mutex> sample_lock(sample_mutex);
+	{
+		std::lock_guard<std::mutex> ring_lock(ring_mutex);
+		stopReadAhead();
+		if (!seekSample(requested_pos))
+			return false;
+	}
 
 	const uint32_t adjusted_bytes = adjustOverRead(requested_pos, requested_bytes);
 	if (adjusted_bytes == 0) // no work to do!
@@ -420,22 +586,109 @@ bool CDROM_Interface_Image::AudioFile::read(uint8_t *buffer,
 		decoded_bytes *= REDBOOK_CHANNELS;
 	}
 	// reading DAE is an audio-task, so update our audio position
+	std::lock_guard<std::mutex> ring_lock(ring_mutex);
 	audio_pos += decoded_bytes;
 	return !(sample->flags & SOUND_SAMPLEFLAG_ERROR);
 }
 
+// Stops the read-ahead, with the ring mutex held, and leaves the sample in
+// need of a seek if it was decoded past the playback position
+void CDROM_Interface_Image::AudioFile::stopReadAhead()
+{
+	if (ring_fill)
+		audio_pos = std::numeric_limits<uint32_t>::max();
+	ring_start = 0;
+	ring_fill = 0;
+	decoded_to_end = false;
+	reading_ahead = false;
+}
+
+// The decoder thread's loop, which keeps the ring filled while playing
+void CDROM_Interface_Image::AudioFile::readAhead()
+{
+	const size_t frame_bytes = getChannels() * REDBOOK_BPS;
+	std::vector<uint8_t> chunk(audio_readahead_chunk_frames * frame_bytes);
+
+	auto has_room = [&]() {
+		return reading_ahead && !decoded_to_end &&
+		       ring.size() - ring_fill >= chunk.size();
+	};
+	while (true) {
+		{
+			std::unique_lock<std::mutex> ring_lock(ring_mutex);
+			ring_changed.wait(ring_lock, [&]() { return quit || has_room(); });
+			if (quit)
+				return;
+		}
+		// A seek may have come in between, so check again with the
+		// sample held
+		std::lock_guard<std::mutex> sample_lock(sample_mutex);
+		{
+			std::lock_guard<std::mutex> ring_lock(ring_mutex);
+			if (quit)
+				return;
+			if (!has_room())
+				continue;
+		}
+
+		// Sound_Decode_Direct returns frames (agnostic of bitrate and channels)
+		const uint32_t frames_decoded = Sound_Decode_Direct(sample, chunk.data(),
+		                                                    audio_readahead_chunk_frames);
+		const bool at_end = !frames_decoded ||
+		                    (sample->flags & (SOUND_SAMPLEFLAG_ERROR |
+		                                      SOUND_SAMPLEFLAG_EOF));
+
+		std::lock_guard<std::mutex> ring_lock(ring_mutex);
+		const size_t bytes = frames_decoded * frame_bytes;
+		const size_t ring_end = (ring_start + ring_fill) % ring.size();
+		const size_t first_part = std::min(bytes, ring.size() - ring_end);
+		memcpy(ring.data() + ring_end, chunk.data(), first_part);
+		memcpy(ring.data(), chunk.data() + first_part, bytes - first_part);
+		ring_fill += bytes;
+		decoded_to_end = at_end;
+		ring_changed.notify_all();
+	}
+}
+
 uint32_t CDROM_Interface_Image::AudioFile::decode(int16_t *buffer,
                                                   const uint32_t desired_track_frames)
 {
+	std::unique_lock<std::mutex> ring_lock(ring_mutex);
 	assertm(audio_pos < MAX_REDBOOK_BYTES,
 	        "Tried to decode audio before the playback position was set");
 
-	// Sound_Decode_Direct returns frames (agnostic of bitrate and channels)
-	const uint32_t frames_decoded =
-	    Sound_Decode_Direct(sample, (void*)buffer, desired_track_frames);
+	const size_t frame_bytes = getChannels() * REDBOOK_BPS;
+	if (!reading_ahead) {
+		if (!decoder.joinable()) {
+			ring.resize(getRate() * audio_readahead_seconds * frame_bytes);
+			decoder = std::thread(&AudioFile::readAhead, this);
+			set_thread_name(decoder, "dosbox:cdaudio");
+		}
+		reading_ahead = true;
+		ring_changed.notify_all();
+	}
+
+	// Wait for the decoder only when it's fallen behind, such as right
+	// after starting or seeking
+	const size_t max_bytes = ring.size() - audio_readahead_chunk_frames * frame_bytes;
+	const size_t wanted_bytes = std::min(desired_track_frames * frame_bytes,
+	                                     max_bytes - max_bytes % frame_bytes);
+	ring_changed.wait(ring_lock, [&]() {
+		return ring_fill >= wanted_bytes || decoded_to_end || !reading_ahead;
+	});
+
+	const size_t bytes = std::min(ring_fill, wanted_bytes);
+	const size_t first_part = std::min(bytes, ring.size() - ring_start);
+	auto out = reinterpret_cast<uint8_t *>(buffer);
+	memcpy(out, ring.data() + ring_start, first_part);
+	memcpy(out + first_part, ring.data(), bytes - first_part);
+	ring_start = (ring_start + bytes) % ring.size();
+	ring_fill -= bytes;
+	ring_changed.notify_all();
 
 	// decoding is an audio-task, so update our audio position
 	// in terms of Redbook-equivalent bytes
+	const auto frames_decoded = static_cast<uint32_t>(bytes / frame_bytes);
 	const uint32_t redbook_bytes = frames_decoded * BYTES_PER_REDBOOK_PCM_FRAME;
 	audio_pos += redbook_bytes;
 
@@ -866,21 +1119,11 @@ bool CDROM_Interface_Image::ReadSectors(PhysPt buffer,
 	if (readBuffer.size() < requested_bytes)
 		readBuffer.resize(requested_bytes);
 
-	// Setup state-tracking variables to be used in the read-loop
-	bool success = true; //Gobliiins reads 0 sectors
-	uint32_t bytes_read = 0;
-	uint32_t current_sector = sector;
-	uint8_t* buffer_position = readBuffer.data();
-
 	// Read until we have enough or fail
-	while (bytes_read < requested_bytes) {
-		success = ReadSector(buffer_position, raw, current_sector);
-		if (!success)
-			break;
-		current_sector++;
-		bytes_read += sectorSize;
-		buffer_position += sectorSize;
-	}
+	const uint32_t sectors_read = ReadSectorRun(readBuffer.data(), raw, sector, num);
+	const bool success = (sectors_read == num); // Gobliiins reads 0 sectors
+	const uint32_t bytes_read = sectors_read * sectorSize;
+
 	// Write only the successfully read bytes
 	MEM_BlockWrite(buffer, readBuffer.data(), bytes_read);
 #ifdef DEBUG
@@ -910,20 +1153,17 @@ track_iter CDROM_Interface_Image::GetTrack(const uint32_t sector)
 	}
 
 	/**
-	 *  Walk the tracks checking if the desired sector falls inside of a given
-	 *  track's range, which starts at the end of the prior track and goes to
-	 *  the current track's (start + length).
+	 *  Each track's range starts at the end of the prior track and goes to
+	 *  the current track's (start + length), so the ranges are in order and
+	 *  the desired sector's track is the first one ending beyond it.
 	 */
-	track_iter track = tracks.begin();
-	uint32_t lower_bound = track->start;
-	while (track != tracks.end()) {
-		const uint32_t upper_bound = track->start + track->length;
-		if (lower_bound <= sector && sector < upper_bound) {
-			break;
-		}
-		++track;
-		lower_bound = upper_bound;
-	}
+	if (sector < tracks.front().start)
+		return tracks.end();
+	const auto ends_after = [](const uint32_t s, const Track &t) {
+		return s < t.start + t.length;
+	};
+	track_iter track = std::upper_bound(tracks.begin(), tracks.end(),
+	                                    sector, ends_after);
 #ifdef DEBUG
 	if (track != tracks.end() && track->number != 1) {
 		if (sector < track->start) {
@@ -978,19 +1218,79 @@ bool CDROM_Interface_Image::ReadSector(uint8_t *buffer, const bool raw, const ui
 	        length);
 #endif
 #endif
-	return track->file->read(buffer, offset, length);
+	if (!track->file->read(buffer, offset, length))
+		return false;
+	METRICS_Add(Metric::CdromBytesRead, length);
+	return true;
 }
 
-bool CDROM_Interface_Image::ReadSectorsHost(void *buffer, bool raw, unsigned long sector, unsigned long num)
+// Reads up to num sectors, taking the runs of sectors in the same track with
+// a single read, and returns the number of sectors read
+uint32_t CDROM_Interface_Image::ReadSectorRun(uint8_t *buffer,
+                                              const bool raw,
+                                              const uint32_t sector,
+                                              const uint32_t num)
 {
-	unsigned int sectorSize = raw ? BYTES_PER_RAW_REDBOOK_FRAME : BYTES_PER_COOKED_REDBOOK_FRAME;
-	bool success = true; //Gobliiins reads 0 sectors
-	for(unsigned long i = 0; i < num; i++) {
-		success = ReadSector((uint8_t*)buffer + (i * (Bitu)sectorSize), raw, sector + i);
-		if (!success) break;
+	const uint16_t length = (raw ? BYTES_PER_RAW_REDBOOK_FRAME
+	                             : BYTES_PER_COOKED_REDBOOK_FRAME);
+	uint32_t sectors_read = 0;
+	while (sectors_read < num) {
+		const uint32_t current_sector = sector + sectors_read;
+		uint8_t *buffer_position = buffer + sectors_read * length;
+
+		// The sectors are back to back if the track holds just the
+		// requested part of each, and otherwise raw sectors hold the
+		// cooked data after their header
+		const track_const_iter track = GetTrack(current_sector);
+		const bool is_readable = track != tracks.end() &&
+		                         track->file != nullptr &&
+		                         current_sector >= track->start;
+		const uint32_t header = (!is_readable || raw) ? 0
+		                        : (track->mode2 ? 24 : 16);
+		const bool is_back_to_back = is_readable &&
+		                             track->sectorSize == length && !header;
+		const bool is_raw_track = is_readable &&
+		                          track->sectorSize == BYTES_PER_RAW_REDBOOK_FRAME;
+		if (!is_back_to_back && !is_raw_track) {
+			if (!ReadSector(buffer_position, raw, current_sector))
+				break;
+			++sectors_read;
+			continue;
+		}
+
+		const uint32_t run = std::min(num - sectors_read,
+		                              track->start + track->length - current_sector);
+		const uint32_t offset = track->skip +
+		                        (current_sector - track->start) * track->sectorSize;
+		if (is_back_to_back) {
+			if (!track->file->read(buffer_position, offset, run * length))
+				break;
+			METRICS_Add(Metric::CdromBytesRead, run * length);
+			sectors_read += run;
+			continue;
+		}
+
+		const uint32_t run_bytes = run * track->sectorSize;
+		if (sectorRunBuffer.size() < run_bytes)
+			sectorRunBuffer.resize(run_bytes);
+		if (!track->file->read(sectorRunBuffer.data(), offset, run_bytes))
+			break;
+		METRICS_Add(Metric::CdromBytesRead, run * length);
+		for (uint32_t i = 0; i < run; ++i)
+			memcpy(buffer_position + i * length,
+			       sectorRunBuffer.data() + i * track->sectorSize + header,
+			       length);
+		sectors_read += run;
 	}
+	return sectors_read;
+}
 
-	return success;
+bool CDROM_Interface_Image::ReadSectorsHost(void *buffer, bool raw, unsigned long sector, unsigned long num)
+{
+	//Gobliiins reads 0 sectors
+	return ReadSectorRun(static_cast<uint8_t *>(buffer), raw,
+	                     static_cast<uint32_t>(sector),
+	                     static_cast<uint32_t>(num)) == num;
 }
 
 void CDROM_Interface_Image::CDAudioCallBack(uint16_t desired_track_frames)
@@ -1017,8 +1317,13 @@ void CDROM_Interface_Image::CDAudioCallBack(uint16_t desired_track_frames)
 		return;
 	}
 
+	if (player.buffer.empty()) {
+		player.buffer.resize(MIXER_BUFSIZE * REDBOOK_CHANNELS);
+		MEMREPORT_Add(MemoryUser::CdAudioBuffer,
+		              static_cast<int64_t>(player.buffer.size() * sizeof(int16_t)));
+	}
 	const auto decoded_track_frames = check_cast<uint16_t>(
-	        track_file->decode(player.buffer, desired_track_frames));
+	        track_file->decode(player.buffer.data(), desired_track_frames));
 
 	if (!decoded_track_frames) {
 		// This particular CDDA track has come to an end, but the
@@ -1045,7 +1350,8 @@ void CDROM_Interface_Image::CDAudioCallBack(uint16_t desired_track_frames)
 
 	// Use the stereo or mono and native or nonnative AddSamples call
 	// assigned during construction
-	(player.channel.get()->*player.addFrames)(decoded_track_frames, player.buffer);
+	(player.channel.get()->*player.addFrames)(decoded_track_frames,
+	                                          player.buffer.data());
 
 	player.playedTrackFrames += decoded_track_frames;
 	if (player.playedTrackFrames >= player.totalTrackFrames) {
@@ -1058,6 +1364,17 @@ void CDROM_Interface_Image::CDAudioCallBack(uint16_t desired_track_frames)
 	}
 }
 
+// Maps BIN and ISO tracks if the host allows, and otherwise reads them as
+// streams
+std::shared_ptr<CDROM_Interface_Image::TrackFile> CDROM_Interface_Image::OpenBinaryTrack(
+        const char *filename, bool &error)
+{
+	auto mapped_file = make_shared<MappedFile>(filename, error);
+	if (!error)
+		return mapped_file;
+	return make_shared<BinaryFile>(filename, error);
+}
+
 bool CDROM_Interface_Image::LoadIsoFile(char* filename)
 {
 	tracks.clear();
@@ -1065,7 +1382,7 @@ bool CDROM_Interface_Image::LoadIsoFile(char* filename)
 	// data track (track 1)
 	Track track;
 	bool error;
-	track.file = make_shared<BinaryFile>(filename, error);
+	track.file = OpenBinaryTrack(filename, error);
 
 	if (error) {
 		return false;
@@ -1242,7 +1559,7 @@ bool CDROM_Interface_Image::LoadCueSheet(char *cuefile)
 
 			bool error = true;
 			if (type == "BINARY") {
-				track.file = make_shared<BinaryFile>(filename.c_str(), error);
+				track.file = OpenBinaryTrack(filename.c_str(), error);
 			}
 			else {
 				track.file = make_shared<AudioFile>(filename.c_str(), error);
@@ -38,6 +38,7 @@ public:
 private:
 	void ClearAnsi();
 	void Output(uint8_t chr);
+	void OutputText(const uint8_t *chars, uint16_t count);
 
 	uint8_t readcache = 0;
 	struct ansi {
@@ -148,9 +149,18 @@ bool device_CON::Write(uint8_t * data,uint16_t * size) {
 				} while(col%8);
 				count++;
 				continue;
-			} else { 
-				Output(data[count]);
-				count++;
+			} else {
+				// Hand the run of plain characters up to the next
+				// escape sequence or tab over in one go
+				uint16_t run = 1;
+				while (count + run < *size) {
+					const uint8_t next = data[count + run];
+					if (next == '\033' || (next == '\t' && !dos.direct_output))
+						break;
+					run++;
+				}
+				OutputText(data + count, run);
+				count += run;
 				continue;
 		}
 	}
@@ -431,3 +441,13 @@ void device_CON::Output(uint8_t chr) {
 		INT10_TeletypeOutputAttr(chr,ansi.attr,true);
 	} else INT10_TeletypeOutput(chr,7);
  }
+
+// Same as calling Output for each character, without the per-character
+// cursor updates and scrolling
+void device_CON::OutputText(const uint8_t *chars, const uint16_t count)
+{
+	if (dos.internal_output || ansi.enabled)
+		INT10_TeletypeOutputText(chars, count, ansi.attr, true);
+	else
+		INT10_TeletypeOutputText(chars, count, 7, CurMode->type != M_TEXT);
+}
@@ -31,6 +31,7 @@
 #include "regs.h"
 #include "serialport.h"
 #include "setup.h"
+#include "snapshot.h"
 #include "string_utils.h"
 #include "support.h"
 #include "program_mount_common.h"
@@ -810,8 +811,7 @@ static Bitu DOS_21Handler(void) {
 		{ 
 			uint16_t toread=DOS_GetAmount();
 			dos.echo=true;
-			if (DOS_ReadFile(reg_bx,dos_copybuf,&toread)) {
-				MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
+			if (DOS_ReadFileToMem(reg_bx, SegPhys(ds) + reg_dx, &toread)) {
 				reg_ax=toread;
 				CALLBACK_SCF(false);
 			} else {
@@ -825,8 +825,7 @@ static Bitu DOS_21Handler(void) {
 	case 0x40:					/* WRITE Write to file or device */
 		{
 			uint16_t towrite=DOS_GetAmount();
-			MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
-			if (DOS_WriteFile(reg_bx,dos_copybuf,&towrite)) {
+			if (DOS_WriteFileFromMem(reg_bx, SegPhys(ds) + reg_dx, &towrite)) {
 				reg_ax=towrite;
 	   			CALLBACK_SCF(false);
 			} else {
@@ -1483,6 +1482,67 @@ DOS_Version DOS_ParseVersion(const char *word, const char *args)
 	return new_version;
 }
 
+// Snapshots are only taken while devices are the only open files, so the
+// file table is rebuilt by opening the same devices
+static void snapshot_device_file(SnapshotStream &s, DOS_File *&file)
+{
+	auto open = (file != nullptr);
+	char name[DOS_NAMELENGTH_ASCII] = {};
+	Bits refs = 0;
+	uint32_t flags = 0;
+	if (file) {
+		safe_strcpy(name, file->name.c_str());
+		refs = file->refCtr;
+		flags = file->flags;
+	}
+	s.Pod(open);
+	s.Pod(name);
+	s.Pod(refs);
+	s.Pod(flags);
+	if (!s.IsLoading())
+		return;
+
+	if (file && (!open || file->name != name)) {
+		file->Close();
+		delete file;
+		file = nullptr;
+	}
+	if (open && !file) {
+		const auto devnum = DOS_FindDevice(name);
+		if (devnum >= DOS_DEVICES || !Devices[devnum]) {
+			s.Fail();
+			return;
+		}
+		file = new DOS_Device(*Devices[devnum]);
+	}
+	if (file) {
+		file->refCtr = refs;
+		file->flags = flags;
+	}
+}
+
+static void dos_snapshot(SnapshotStream &s)
+{
+	const auto country = dos.tables.country;
+	s.Pod(dos);
+	dos.tables.country = country;
+
+	// the drives are mounted by the configuration, only their current
+	// directories change
+	for (const auto drive : Drives) {
+		auto mounted = (drive != nullptr);
+		s.Pod(mounted);
+		if (mounted != (drive != nullptr)) {
+			s.Fail();
+			return;
+		}
+		if (drive)
+			s.Pod(drive->curdir);
+	}
+	for (auto &file : Files)
+		snapshot_device_file(s, file);
+}
+
 class DOS:public Module_base{
 private:
 	CALLBACK_HandlerObject callback[7];
@@ -1543,6 +1603,7 @@ public:
 			dos.version.major = new_version.major;
 			dos.version.minor = new_version.minor;
 		}
+		SNAPSHOT_AddComponent("dos", dos_snapshot);
 	}
 	~DOS(){
 		for (uint16_t i = 0; i < DOS_DRIVES; i++)	delete Drives[i];
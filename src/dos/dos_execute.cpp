@@ -21,6 +21,10 @@
 #include <string.h>
 #include <ctype.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "cpu.h"
 #include "callback.h"
 #include "debug.h"
@@ -28,6 +32,7 @@
 #include "mem.h"
 #include "programs.h"
 #include "regs.h"
+#include "startup.h"
 #include "string_utils.h"
 
 const char * RunningProgram="DOSBOX";
@@ -237,13 +242,70 @@ static void SetupCMDLine(uint16_t pspseg,DOS_ParamBlock & block) {
 	psp.SetCommandTail(block.exec.cmdtail);
 }
 
+// The DOS file calls move at most 64 KiB at a time
+constexpr uint16_t max_read_size = 0xf000;
+
+static uint32_t file_size(const uint16_t fhandle)
+{
+	uint32_t pos = 0;
+	DOS_SeekFile(fhandle, &pos, DOS_SEEK_END);
+	return pos;
+}
+
+// Reads the image straight into guest memory, which is a single host read
+// per chunk for files on the host
+static void load_image(const uint16_t fhandle, PhysPt address, Bitu size)
+{
+	while (size > 0) {
+		auto readsize = static_cast<uint16_t>(std::min<Bitu>(size, max_read_size));
+		const auto chunk = readsize;
+		DOS_ReadFileToMem(fhandle, address, &readsize);
+		address += chunk;
+		size -= chunk;
+	}
+}
+
+// Reads the whole relocation table at once and applies the fixups through a
+// host pointer to the image when it's plain RAM
+static void relocate_image(const uint16_t fhandle, const EXE_Header &head,
+                           const uint16_t loadseg, const Bitu image_size,
+                           const uint16_t relocate)
+{
+	std::vector<uint8_t> table(head.relocations * sizeof(RealPt));
+	uint32_t pos = head.reloctable;
+	DOS_SeekFile(fhandle, &pos, DOS_SEEK_SET);
+	size_t table_size = 0;
+	while (table_size < table.size()) {
+		auto readsize = static_cast<uint16_t>(
+		        std::min<size_t>(table.size() - table_size, max_read_size));
+		if (!DOS_ReadFile(fhandle, table.data() + table_size, &readsize) || !readsize)
+			break;
+		table_size += readsize;
+	}
+
+	const PhysPt image_start = PhysMake(loadseg, 0);
+	const HostPt image = MEM_GetHostBlock(image_start, image_size, true);
+	for (size_t i = 0; i + sizeof(RealPt) <= table_size; i += sizeof(RealPt)) {
+		const RealPt relocpt = host_readd(&table[i]);
+		const PhysPt address = PhysMake(RealSeg(relocpt) + loadseg, RealOff(relocpt));
+		const auto offset = address - image_start;
+		if (image && address >= image_start && offset + 1 < image_size) {
+			host_writew(image + offset, host_readw(image + offset) + relocate);
+		} else {
+			// Fixups outside the image go through the page handlers
+			mem_writew(address, mem_readw(address) + relocate);
+		}
+	}
+}
+
 bool DOS_Execute(char * name,PhysPt block_pt,uint8_t flags) {
 	EXE_Header head;Bitu i;
 	uint16_t fhandle;uint16_t len;uint32_t pos;
-	uint16_t pspseg,envseg,loadseg,memsize,readsize;
-	PhysPt loadaddress;RealPt relocpt;
+	uint16_t pspseg,envseg,loadseg,memsize;
+	PhysPt loadaddress;
 	Bitu headersize=0,imagesize=0;
 	DOS_ParamBlock block(block_pt);
+	const StartupStage stage(std::string("Execute ") + name);
 
 	block.LoadData();
 	//Remove the loadhigh flag for the moment!
@@ -291,13 +353,11 @@ bool DOS_Execute(char * name,PhysPt block_pt,uint8_t flags) {
 			if (imagesize+headersize<512) imagesize = 512-headersize;
 		}
 	}
-	uint8_t *loadbuf = new uint8_t[0x10000];
 	if (flags!=OVERLAY) {
 		/* Create an environment block */
 		envseg=block.exec.envseg;
 		if (!MakeEnv(name,&envseg)) {
 			DOS_CloseFile(fhandle);
-			delete [] loadbuf;
 			return false;
 		}
 		/* Get Memory */		
@@ -306,9 +366,7 @@ bool DOS_Execute(char * name,PhysPt block_pt,uint8_t flags) {
 			minsize=0x1000;maxsize=0xffff;
 			if (machine==MCH_PCJR) {
 				/* try to load file into memory below 96k */ 
-				pos=0;DOS_SeekFile(fhandle,&pos,DOS_SEEK_SET);	
-				uint16_t dataread=0x1800;
-				DOS_ReadFile(fhandle,loadbuf,&dataread);
+				const auto dataread=file_size(fhandle);
 				if (dataread<0x1800) maxsize=((dataread+0x10)>>4)+0x20;
 				if (minsize>maxsize) minsize=maxsize;
 			}
@@ -320,16 +378,13 @@ bool DOS_Execute(char * name,PhysPt block_pt,uint8_t flags) {
 		if (maxfree<minsize) {
 			if (iscom) {
 				/* Reduce minimum of needed memory size to filesize */
-				pos=0;DOS_SeekFile(fhandle,&pos,DOS_SEEK_SET);	
-				uint16_t dataread=0xf800;
-				DOS_ReadFile(fhandle,loadbuf,&dataread);
+				const auto dataread=file_size(fhandle);
 				if (dataread<0xf800) minsize=((dataread+0x10)>>4)+0x20;
 			}
 			if (maxfree<minsize) {
 				DOS_CloseFile(fhandle);
 				DOS_SetError(DOSERR_INSUFFICIENT_MEMORY);
 				DOS_FreeMemory(envseg);
-				delete [] loadbuf;
 				return false;
 			}
 		}
@@ -354,35 +409,17 @@ bool DOS_Execute(char * name,PhysPt block_pt,uint8_t flags) {
 
 	if (iscom) {	/* COM Load 64k - 256 bytes max */
 		pos=0;DOS_SeekFile(fhandle,&pos,DOS_SEEK_SET);	
-		readsize=0xffff-256;
-		DOS_ReadFile(fhandle,loadbuf,&readsize);
-		MEM_BlockWrite(loadaddress,loadbuf,readsize);
-	} else {	/* EXE Load in 32kb blocks and then relocate */
+		uint16_t readsize=0xffff-256;
+		DOS_ReadFileToMem(fhandle,loadaddress,&readsize);
+	} else {	/* EXE Load straight into memory and then relocate */
 		pos=headersize;DOS_SeekFile(fhandle,&pos,DOS_SEEK_SET);	
-		while (imagesize>0x7FFF) {
-			readsize=0x8000;DOS_ReadFile(fhandle,loadbuf,&readsize);
-			MEM_BlockWrite(loadaddress,loadbuf,readsize);
-//			if (readsize!=0x8000) LOG(LOG_EXEC,LOG_NORMAL)("Illegal header");
-			loadaddress+=0x8000;imagesize-=0x8000;
-		}
-		if (imagesize>0) {
-			readsize=(uint16_t)imagesize;DOS_ReadFile(fhandle,loadbuf,&readsize);
-			MEM_BlockWrite(loadaddress,loadbuf,readsize);
-//			if (readsize!=imagesize) LOG(LOG_EXEC,LOG_NORMAL)("Illegal header");
-		}
+		load_image(fhandle,loadaddress,imagesize);
 		/* Relocate the exe image */
 		uint16_t relocate;
 		if (flags==OVERLAY) relocate=block.overlay.relocation;
 		else relocate=loadseg;
-		pos=head.reloctable;DOS_SeekFile(fhandle,&pos,0);
-		for (i=0;i<head.relocations;i++) {
-			readsize=4;DOS_ReadFile(fhandle,(uint8_t *)&relocpt,&readsize);
-			relocpt=host_readd((HostPt)&relocpt);		//Endianize
-			PhysPt address=PhysMake(RealSeg(relocpt)+loadseg,RealOff(relocpt));
-			mem_writew(address,mem_readw(address)+relocate);
-		}
+		relocate_image(fhandle,head,loadseg,imagesize,relocate);
 	}
-	delete [] loadbuf;
 	DOS_CloseFile(fhandle);
 
 	/* Setup a psp */
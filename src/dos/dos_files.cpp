@@ -32,6 +32,7 @@
 #include "cross.h"
 #include "string_utils.h"
 #include "support.h"
+#include "tracy.h"
 
 #define DOS_FILESTART 4
 
@@ -315,6 +316,7 @@ bool DOS_Rename(char const * const oldname,char const * const newname) {
 
 bool DOS_FindFirst(const char *search, uint16_t attr, bool fcb_findfirst)
 {
+	ZoneScopedSubsystem("DOS find first");
 	LOG(LOG_FILES,LOG_NORMAL)("file search attributes %X name %s",attr,search);
 	DOS_DTA dta(dos.dta());
 	uint8_t drive;char fullsearch[DOS_PATHLENGTH];
@@ -363,6 +365,7 @@ bool DOS_FindFirst(const char *search, uint16_t attr, bool fcb_findfirst)
 }
 
 bool DOS_FindNext(void) {
+	ZoneScopedSubsystem("DOS find next");
 	DOS_DTA dta(dos.dta());
 	uint8_t i = dta.GetSearchDrive();
 	if(i >= DOS_DRIVES || !Drives[i]) {
@@ -377,6 +380,7 @@ bool DOS_FindNext(void) {
 
 
 bool DOS_ReadFile(uint16_t entry,uint8_t * data,uint16_t * amount,bool fcb) {
+	ZoneScopedSubsystem("DOS read file");
 	uint32_t handle = fcb?entry:RealHandle(entry);
 	if (handle>=DOS_FILES) {
 		DOS_SetError(DOSERR_INVALID_HANDLE);
@@ -399,6 +403,7 @@ bool DOS_ReadFile(uint16_t entry,uint8_t * data,uint16_t * amount,bool fcb) {
 }
 
 bool DOS_WriteFile(uint16_t entry,uint8_t * data,uint16_t * amount,bool fcb) {
+	ZoneScopedSubsystem("DOS write file");
 	uint32_t handle = fcb?entry:RealHandle(entry);
 	if (handle>=DOS_FILES) {
 		DOS_SetError(DOSERR_INVALID_HANDLE);
@@ -420,7 +425,46 @@ bool DOS_WriteFile(uint16_t entry,uint8_t * data,uint16_t * amount,bool fcb) {
 	return ret;
 }
 
+bool DOS_File::ReadToMem(const PhysPt pt, uint16_t *size)
+{
+	if (!Read(dos_copybuf, size))
+		return false;
+	MEM_BlockWrite(pt, dos_copybuf, *size);
+	return true;
+}
+
+bool DOS_File::WriteFromMem(const PhysPt pt, uint16_t *size)
+{
+	MEM_BlockRead(pt, dos_copybuf, *size);
+	return Write(dos_copybuf, size);
+}
+
+// Like DOS_ReadFile and DOS_WriteFile, but straight into and out of guest
+// memory
+bool DOS_ReadFileToMem(const uint16_t entry, const PhysPt pt, uint16_t *amount)
+{
+	ZoneScopedSubsystem("DOS read file to memory");
+	const uint32_t handle = RealHandle(entry);
+	if (handle >= DOS_FILES || !Files[handle] || !Files[handle]->IsOpen()) {
+		DOS_SetError(DOSERR_INVALID_HANDLE);
+		return false;
+	}
+	return Files[handle]->ReadToMem(pt, amount);
+}
+
+bool DOS_WriteFileFromMem(const uint16_t entry, const PhysPt pt, uint16_t *amount)
+{
+	ZoneScopedSubsystem("DOS write file from memory");
+	const uint32_t handle = RealHandle(entry);
+	if (handle >= DOS_FILES || !Files[handle] || !Files[handle]->IsOpen()) {
+		DOS_SetError(DOSERR_INVALID_HANDLE);
+		return false;
+	}
+	return Files[handle]->WriteFromMem(pt, amount);
+}
+
 bool DOS_SeekFile(uint16_t entry,uint32_t * pos,uint32_t type,bool fcb) {
+	ZoneScopedSubsystem("DOS seek file");
 	uint32_t handle = fcb?entry:RealHandle(entry);
 	if (handle>=DOS_FILES) {
 		DOS_SetError(DOSERR_INVALID_HANDLE);
@@ -434,6 +478,7 @@ bool DOS_SeekFile(uint16_t entry,uint32_t * pos,uint32_t type,bool fcb) {
 }
 
 bool DOS_CloseFile(uint16_t entry, bool fcb, uint8_t * refcnt) {
+	ZoneScopedSubsystem("DOS close file");
 	uint32_t handle = fcb?entry:RealHandle(entry);
 	if (handle>=DOS_FILES) {
 		DOS_SetError(DOSERR_INVALID_HANDLE);
@@ -527,6 +572,7 @@ bool DOS_CreateFile(char const * name,uint16_t attributes,uint16_t * entry,bool
 }
 
 bool DOS_OpenFile(char const * name,uint8_t flags,uint16_t * entry,bool fcb) {
+	ZoneScopedSubsystem("DOS open file");
 	/* First check for devices */
 	if (flags>2) LOG(LOG_FILES,LOG_ERROR)("Special file open command %X file %s",flags,name);
 	else LOG(LOG_FILES,LOG_NORMAL)("file open command %X file %s",flags,name);
@@ -19,15 +19,19 @@
 
 #include "dos_keyboard_layout.h"
 
+#include <cinttypes>
+#include <fstream>
 #include <map>
 #include <memory>
 #include <string_view>
+#include <vector>
 using sv = std::string_view;
 
 #include "../ints/int10.h"
 #include "bios.h"
 #include "bios_disk.h"
 #include "callback.h"
+#include "cross.h"
 #include "dos_inc.h"
 #include "drives.h"
 #include "mapper.h"
@@ -817,6 +821,138 @@ const char *get_builtin_cp_filename(const int codepage_id)
 	}
 }
 
+// Codepage font cache
+// ~~~~~~~~~~~~~~~~~~~
+// Finding a codepage means walking the whole CPI file, and a UPX-packed CPX
+// file first has to be unpacked by running its decompressor in the guest.
+// The fonts found for a codepage are kept under 'codepages' in the config
+// directory, in a file named after a hash of the codepage and the packed
+// file's contents, so loading the same codepage again reads them back in one
+// go. An edited or different file simply misses the cache.
+struct CodePageFont {
+	uint8_t height = 0;
+	std::vector<uint8_t> bitmap = {}; // 256 characters of 'height' rows
+};
+
+static uint64_t get_codepage_cache_key(const uint8_t *data, const size_t size,
+                                       const int32_t codepage_id)
+{
+	// 64-bit FNV-1a, which is stable across builds and platforms
+	uint64_t hash = 0xcbf29ce484222325;
+	auto add = [&hash](const uint8_t byte) {
+		hash ^= byte;
+		hash *= 0x100000001b3;
+	};
+	for (size_t i = 0; i < sizeof(codepage_id); ++i)
+		add(static_cast<uint8_t>(codepage_id >> (i * 8)));
+	for (size_t i = 0; i < size; ++i)
+		add(data[i]);
+	return hash;
+}
+
+static std_fs::path get_codepage_cache_path(const uint64_t key)
+{
+	char name[32];
+	safe_sprintf(name, "%016" PRIx64 ".bin", key);
+	return std_fs::path(CROSS_GetPlatformConfigDir()) / "codepages" / name;
+}
+
+static constexpr char codepage_cache_magic[4] = {'D', 'B', 'C', 'P'};
+
+// The file holds the magic followed by each font's height and bitmap
+static bool read_cached_codepage(const uint64_t key, std::vector<CodePageFont> &fonts)
+{
+	std::ifstream file(get_codepage_cache_path(key), std::ios::binary);
+	const std::vector<uint8_t> data(std::istreambuf_iterator<char>(file), {});
+	if (data.size() < sizeof(codepage_cache_magic) ||
+	    memcmp(data.data(), codepage_cache_magic, sizeof(codepage_cache_magic)) != 0)
+		return false;
+
+	fonts.clear();
+	auto pos = sizeof(codepage_cache_magic);
+	while (pos < data.size()) {
+		CodePageFont font = {};
+		font.height = data[pos++];
+		const auto bitmap_size = font.height * 256u;
+		if (data.size() - pos < bitmap_size)
+			return false;
+		font.bitmap.assign(data.begin() + pos, data.begin() + pos + bitmap_size);
+		pos += bitmap_size;
+		fonts.emplace_back(std::move(font));
+	}
+	return !fonts.empty();
+}
+
+static void write_cached_codepage(const uint64_t key, const std::vector<CodePageFont> &fonts)
+{
+	const auto path = get_codepage_cache_path(key);
+	std::error_code ec;
+	std_fs::create_directories(path.parent_path(), ec);
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(codepage_cache_magic, sizeof(codepage_cache_magic));
+	for (const auto &font : fonts) {
+		file.put(static_cast<char>(font.height));
+		file.write(reinterpret_cast<const char *>(font.bitmap.data()),
+		           static_cast<std::streamsize>(font.bitmap.size()));
+	}
+	if (!file)
+		LOG_WARNING("CODEPAGE: Can't write the codepage cache file '%s'",
+		            path.string().c_str());
+}
+
+// Copies the fonts into the video BIOS, returning whether any was replaced
+static bool load_codepage_fonts(const std::vector<CodePageFont> &fonts)
+{
+	bool font_changed = false;
+	for (const auto &font : fonts) {
+		if (font.height == 0x10) {
+			// 16x8 font
+			const auto font16pt = Real2Phys(int10.rom.font_16);
+			for (uint16_t i = 0; i < 256 * 16; ++i) {
+				phys_writeb(font16pt + i, font.bitmap[i]);
+			}
+			// terminate alternate list to prevent loading
+			phys_writeb(Real2Phys(int10.rom.font_16_alternate),0);
+			font_changed=true;
+		} else if (font.height == 0x0e) {
+			// 14x8 font
+			const auto font14pt = Real2Phys(int10.rom.font_14);
+			for (uint16_t i = 0; i < 256 * 14; ++i) {
+				phys_writeb(font14pt + i, font.bitmap[i]);
+			}
+			// terminate alternate list to prevent loading
+			phys_writeb(Real2Phys(int10.rom.font_14_alternate),0);
+			font_changed=true;
+		} else if (font.height == 0x08) {
+			// 8x8 fonts
+			auto font8pt = Real2Phys(int10.rom.font_8_first);
+			for (uint16_t i = 0; i < 128 * 8; ++i) {
+				phys_writeb(font8pt + i, font.bitmap[i]);
+			}
+			font8pt=Real2Phys(int10.rom.font_8_second);
+			for (uint16_t i = 0; i < 128 * 8; ++i) {
+				phys_writeb(font8pt + i, font.bitmap[i + 128 * 8]);
+			}
+			font_changed=true;
+		}
+	}
+	return font_changed;
+}
+
+static void set_loaded_codepage(const int32_t codepage_id, const bool font_changed)
+{
+	LOG(LOG_BIOS,LOG_NORMAL)("Codepage %i successfully loaded",codepage_id);
+
+	// set codepage entries
+	dos.loaded_codepage=(uint16_t)(codepage_id&0xffff);
+
+	// update font if necessary
+	if (font_changed && (CurMode->type==M_TEXT) && (IS_EGAVGA_ARCH)) {
+		INT10_ReloadFont();
+	}
+	INT10_SetupRomMemoryChecksum();
+}
+
 KeyboardErrorCode KeyboardLayout::ReadCodePageFile(const char *requested_cp_filename, const int32_t codepage_id)
 {
 	assert(requested_cp_filename);
@@ -932,6 +1068,16 @@ KeyboardErrorCode KeyboardLayout::ReadCodePageFile(const char *requested_cp_file
 			return KEYB_INVALIDCPFILE;
 	}
 
+	// The fonts might have been found in this file before
+	const auto cache_key = get_codepage_cache_key(cpi_buf.data(),
+	                                              upxfound ? size_of_cpxdata : cpi_buf_size,
+	                                              codepage_id);
+	std::vector<CodePageFont> fonts = {};
+	if (read_cached_codepage(cache_key, fonts)) {
+		set_loaded_codepage(codepage_id, load_codepage_fonts(fonts));
+		return KEYB_NOERROR;
+	}
+
 	if (upxfound) {
 		if (size_of_cpxdata>0xfe00) E_Exit("Size of cpx-compressed data too big");
 
@@ -1007,54 +1153,27 @@ KeyboardErrorCode KeyboardLayout::ReadCodePageFile(const char *requested_cp_file
 			auto font_data_start = font_data_header_pt + 0x06;
 
 			// load all fonts if possible
-			bool font_changed = false;
 			for (uint16_t current_font = 0; current_font < number_of_fonts; ++current_font) {
 				const auto font_height = cpi_buf.at(font_data_start);
 				font_data_start += 6;
-				if (font_height == 0x10) {
-					// 16x8 font
-					const auto font16pt = Real2Phys(int10.rom.font_16);
-					for (uint16_t i = 0; i < 256 * 16; ++i) {
-						phys_writeb(font16pt + i, cpi_buf.at(font_data_start + i));
-					}
-					// terminate alternate list to prevent loading
-					phys_writeb(Real2Phys(int10.rom.font_16_alternate),0);
-					font_changed=true;
-				} else if (font_height == 0x0e) {
-					// 14x8 font
-					const auto font14pt = Real2Phys(int10.rom.font_14);
-					for (uint16_t i = 0; i < 256 * 14; ++i) {
-						phys_writeb(font14pt + i, cpi_buf.at(font_data_start + i));
+				if (font_height == 0x10 || font_height == 0x0e || font_height == 0x08) {
+					const auto font_end = font_data_start + font_height * 256;
+					if (font_end > cpi_buf.size()) {
+						LOG(LOG_BIOS, LOG_ERROR)
+						("Code-page file %s has a truncated font", cp_filename.c_str());
+						return KEYB_INVALIDCPFILE;
 					}
-					// terminate alternate list to prevent loading
-					phys_writeb(Real2Phys(int10.rom.font_14_alternate),0);
-					font_changed=true;
-				} else if (font_height == 0x08) {
-					// 8x8 fonts
-					auto font8pt = Real2Phys(int10.rom.font_8_first);
-					for (uint16_t i = 0; i < 128 * 8; ++i) {
-						phys_writeb(font8pt + i, cpi_buf.at(font_data_start + i));
-					}
-					font8pt=Real2Phys(int10.rom.font_8_second);
-					for (uint16_t i = 0; i < 128 * 8; ++i) {
-						phys_writeb(font8pt + i,
-						            cpi_buf.at(font_data_start + i + 128 * 8));
-					}
-					font_changed=true;
+					CodePageFont font = {font_height, {}};
+					font.bitmap.assign(cpi_buf.begin() + font_data_start,
+					                   cpi_buf.begin() + font_end);
+					fonts.emplace_back(std::move(font));
 				}
 				font_data_start+=font_height*256;
 			}
 
-			LOG(LOG_BIOS,LOG_NORMAL)("Codepage %i successfully loaded",codepage_id);
-
-			// set codepage entries
-			dos.loaded_codepage=(uint16_t)(codepage_id&0xffff);
-
-			// update font if necessary
-			if (font_changed && (CurMode->type==M_TEXT) && (IS_EGAVGA_ARCH)) {
-				INT10_ReloadFont();
-			}
-			INT10_SetupRomMemoryChecksum();
+			if (!fonts.empty())
+				write_cached_codepage(cache_key, fonts);
+			set_loaded_codepage(codepage_id, load_codepage_fonts(fonts));
 
 			return KEYB_NOERROR;
 		}
@@ -19,13 +19,21 @@
 #include "dos_system.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <deque>
 #include <iterator>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include "cross.h"
 #include "dos_inc.h"
 #include "drives.h"
+#include "std_filesystem.h"
 #include "string_utils.h"
 #include "support.h"
 
@@ -51,6 +59,126 @@ bool SortByDirNameRev(DOS_Drive_Cache::CFileInfo* const &a, DOS_Drive_Cache::CFi
 	return strcmp(a->shortname,b->shortname)>0;
 }
 
+// The host names are looked up as the host compares them
+static std::string long_name_key(const char* name) {
+#if defined (WIN32)
+	std::string key = name;
+	lowcase(key);
+	return key;
+#else
+	return name;
+#endif
+}
+
+// Prefetching
+// ~~~~~~~~~~~
+// Once a drive is mounted, a worker thread lists the directories below its
+// base directory, breadth first, so opening large trees for the first time
+// doesn't freeze the guest. Only the host listings are read ahead: the
+// entries and their short names are still made on the emulation thread when
+// a directory is first opened. A listing is only used if the directory
+// hasn't been modified since it was read.
+constexpr size_t max_prefetched_entries = 100000;
+
+struct DOS_Drive_Cache::Prefetcher {
+	struct Listing {
+		std_fs::file_time_type modified = {};
+		std::vector<std::pair<std::string, bool>> entries = {}; // name, is directory
+	};
+
+	Prefetcher(const std::string &base_path);
+	~Prefetcher();
+
+	// Moves the listing of the directory out, if it's still current
+	bool Take(const char *dir_path, Listing &listing);
+
+private:
+	void Run(std::string base_path);
+
+	std::mutex mutex = {};
+	std::unordered_map<std::string, Listing> listings = {}; // by path
+	std::atomic<bool> is_stopping = {false};
+	std::thread worker; // started last, once the rest is set up
+};
+
+DOS_Drive_Cache::Prefetcher::Prefetcher(const std::string &base_path)
+        : worker(&Prefetcher::Run, this, base_path)
+{}
+
+DOS_Drive_Cache::Prefetcher::~Prefetcher()
+{
+	is_stopping = true;
+	worker.join();
+}
+
+bool DOS_Drive_Cache::Prefetcher::Take(const char *dir_path, Listing &listing)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto it = listings.find(dir_path);
+		if (it == listings.end())
+			return false;
+		listing = std::move(it->second);
+		listings.erase(it);
+	}
+	std::error_code ec = {};
+	const auto modified = std_fs::last_write_time(dir_path, ec);
+	return !ec && modified == listing.modified;
+}
+
+void DOS_Drive_Cache::Prefetcher::Run(std::string base_path)
+{
+	// The base directory is read when mounting, so only its
+	// subdirectories are kept
+	std::deque<std::string> dir_paths = {base_path};
+	size_t num_entries = 0;
+	while (!dir_paths.empty() && !is_stopping && num_entries < max_prefetched_entries) {
+		const auto dir_path = std::move(dir_paths.front());
+		dir_paths.pop_front();
+
+		// Taken first, so changes while listing make it out of date
+		std::error_code ec = {};
+		Listing listing = {};
+		listing.modified = std_fs::last_write_time(dir_path, ec);
+		if (ec)
+			continue;
+
+		// Listed like open_directory does, with the dot entries
+		listing.entries.emplace_back(".", true);
+		listing.entries.emplace_back("..", true);
+		try {
+			for (auto it = std_fs::directory_iterator(dir_path, ec);
+			     !ec && it != std_fs::directory_iterator() && !is_stopping;
+			     it.increment(ec)) {
+				auto name = it->path().filename().string();
+				std::error_code type_ec = {};
+				const bool is_dir = it->is_directory(type_ec);
+				if (is_dir && !it->is_symlink(type_ec))
+					dir_paths.push_back(dir_path + name + CROSS_FILESPLIT);
+				listing.entries.emplace_back(std::move(name), is_dir);
+			}
+		} catch (const std::exception &) {
+			// Names the host can't convert are left to open_directory
+			continue;
+		}
+		if (ec || dir_path == base_path)
+			continue;
+
+		num_entries += listing.entries.size();
+		std::lock_guard<std::mutex> lock(mutex);
+		listings.emplace(dir_path, std::move(listing));
+	}
+}
+
+void DOS_Drive_Cache::PrefetchDirs(void) {
+	if (is_empty(basePath))
+		return;
+	std::string base_path = basePath;
+	if (base_path.back() != CROSS_FILESPLIT)
+		base_path += CROSS_FILESPLIT;
+	prefetcher = std::make_unique<Prefetcher>(base_path);
+}
+
 DOS_Drive_Cache::DOS_Drive_Cache(void)
 	: dirBase(new CFileInfo),
 	  dirPath{0},
@@ -61,10 +189,10 @@ DOS_Drive_Cache::DOS_Drive_Cache(void)
 	  save_expanded{0},
 	  srchNr(0),
 	  dirSearch{nullptr},
-	  dirFindFirst{nullptr},
 	  nextFreeFindFirst(0),
 	  label{0},
-	  updatelabel(true)
+	  updatelabel(true),
+	  prefetcher(nullptr)
 {
 }
 
@@ -78,20 +206,16 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path)
 	  save_expanded{0},
 	  srchNr(0),
 	  dirSearch{nullptr},
-	  dirFindFirst{nullptr},
 	  nextFreeFindFirst(0),
 	  label{0},
-	  updatelabel(true)
+	  updatelabel(true),
+	  prefetcher(nullptr)
 {
 	SetBaseDir(path);
 }
 
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
 	Clear();
-	for (uint32_t i=0; i<MAX_OPENDIRS; i++) {
-		DeleteFileInfo(dirFindFirst[i]);
-		dirFindFirst[i] = nullptr;
-	}
 }
 
 void DOS_Drive_Cache::Clear(void) {
@@ -316,6 +440,149 @@ void DOS_Drive_Cache::DeleteEntry(const char* path, bool ignoreLastDir) {
 	}
 }
 
+void DOS_Drive_Cache::UpdateEntry(const char* path) {
+	const char* host_path = GetExpandName(path);
+	const char* pos = strrchr(host_path,CROSS_FILESPLIT);
+	if (!pos)
+		return;
+	const std::string name = pos + 1;
+
+	char dir_path[CROSS_LEN];
+	safe_strcpy(dir_path, path);
+	char* dir_end = strrchr(dir_path,CROSS_FILESPLIT);
+	if (!dir_end)
+		return;
+	dir_end[1] = 0;
+	char expand[CROSS_LEN];
+	CFileInfo* dir = FindDirInfo(dir_path,expand);
+	if (dir)
+		UpdateHostEntry(dir, expand, name.c_str());
+}
+
+void DOS_Drive_Cache::RemoveEntry(const char* path) {
+	const char* pos = strrchr(path,CROSS_FILESPLIT);
+	if (!pos)
+		return;
+	char file[CROSS_LEN];
+	safe_strcpy(file, pos + 1);
+
+	// Finding the directory of the path itself would cache it in
+	char dir_path[CROSS_LEN];
+	safe_strcpy(dir_path, path);
+	dir_path[pos - path + 1] = 0;
+	char expand[CROSS_LEN];
+	CFileInfo* dir = FindDirInfo(dir_path,expand);
+	if (!dir)
+		return;
+	const Bits index = GetLongName(dir, file, sizeof(file));
+	if (index >= 0)
+		RemoveEntry(dir, static_cast<size_t>(index));
+}
+
+void DOS_Drive_Cache::SetWatchHost(bool watch) {
+	watchHost = watch;
+	if (!watch)
+		watcher.reset();
+}
+
+void DOS_Drive_Cache::RemoveEntry(CFileInfo* dir, size_t index) {
+	CFileInfo* info = dir->fileList[index];
+	dir->fileList.erase(dir->fileList.begin() + index);
+	++dir->generation;
+	if (FindShortName(dir, info->shortname) == info)
+		dir->index->shortNames.erase(info->shortname);
+	if (FindLongName(dir, info->orgname) == info)
+		dir->index->longNames.erase(long_name_key(info->orgname));
+
+	// Check if there are any open search dir that are affected by this...
+	for (uint32_t i=0; i<MAX_OPENDIRS; i++) {
+		if ((dirSearch[i]==dir) && (index<dirSearch[i]->nextEntry))
+			dirSearch[i]->nextEntry--;
+	}
+	save_dir = nullptr;
+	DeleteFileInfo(info);
+}
+
+// Adds, removes, or replaces the entry to match the host
+void DOS_Drive_Cache::UpdateHostEntry(CFileInfo* dir, const char* dir_path, const char* name) {
+	// Directories that aren't cached in are read when they're needed
+	if (!IsCachedIn(dir) || dir->isOverlayDir)
+		return;
+
+	std::string host_path = dir_path;
+	if (!host_path.empty() && host_path.back() != CROSS_FILESPLIT)
+		host_path += CROSS_FILESPLIT;
+	host_path += name;
+	struct stat status;
+	const bool exists = (stat(host_path.c_str(),&status) == 0);
+	const bool is_directory = exists && (status.st_mode & S_IFDIR);
+
+	if (CFileInfo* cached = FindLongName(dir, name)) {
+		if (exists && cached->isDir == is_directory)
+			return;
+		const Bits index = GetEntryIndex(dir, cached);
+		if (index >= 0)
+			RemoveEntry(dir, static_cast<size_t>(index));
+	}
+	if (!exists)
+		return;
+
+	CFileInfo* info = CreateEntry(dir,name,is_directory);
+	const auto index = static_cast<Bitu>(GetEntryIndex(dir, info));
+	for (uint32_t i=0; i<MAX_OPENDIRS; i++) {
+		if ((dirSearch[i]==dir) && (index<=dirSearch[i]->nextEntry))
+			dirSearch[i]->nextEntry++;
+	}
+}
+
+// Updates the entries that differ from the host, when the watcher can't
+// tell which entries changed
+void DOS_Drive_Cache::UpdateHostDir(CFileInfo* dir, const char* dir_path) {
+	if (!IsCachedIn(dir) || dir->isOverlayDir)
+		return;
+	dir_information* dirp = open_directory(dir_path);
+	if (!dirp)
+		return;
+	std::unordered_set<std::string> host_names = {};
+	char dir_name[CROSS_LEN];
+	bool is_directory;
+	if (read_directory_first(dirp, dir_name, is_directory)) {
+		host_names.emplace(dir_name);
+		while (read_directory_next(dirp, dir_name, is_directory))
+			host_names.emplace(dir_name);
+	}
+	close_directory(dirp);
+
+	std::unordered_set<std::string> cached_names = {};
+	for (const auto info : dir->fileList)
+		cached_names.emplace(info->orgname);
+
+	std::vector<std::string> changed_names = {};
+	for (const auto &name : host_names)
+		if (!cached_names.count(name))
+			changed_names.push_back(name);
+	for (const auto &name : cached_names)
+		if (!host_names.count(name))
+			changed_names.push_back(name);
+	for (const auto &name : changed_names)
+		UpdateHostEntry(dir, dir_path, name.c_str());
+}
+
+void DOS_Drive_Cache::ProcessHostChanges(void) {
+	if (!watcher)
+		return;
+	for (const auto &change : watcher->TakeChanges()) {
+		// The directory may have been removed by an earlier change
+		if (!watcher->IsWatching(change.tag))
+			continue;
+		const auto dir = static_cast<CFileInfo*>(change.tag);
+		if (change.name.empty())
+			UpdateHostDir(dir, change.dir_path.c_str());
+		else
+			UpdateHostEntry(dir, change.dir_path.c_str(), change.name.c_str());
+	}
+}
+
 void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	char expand[CROSS_LEN] = { 0 };
 	CFileInfo* dir;
@@ -347,7 +614,8 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	}
 	// clear lists
 	dir->fileList.clear();
-	dir->longNameList.clear();
+	++dir->generation;
+	dir->index.reset();
 	save_dir = nullptr;
 }
 
@@ -367,83 +635,42 @@ bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
 	else
 		return false;
 
-	std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-	if (GCC_UNLIKELY(filelist_size<=0))
+	// Only the names that needed a short version have one
+	const CFileInfo* info = FindLongName(curDir, pos);
+	if (!info || !info->shortNr)
 		return false;
+	safe_strncpy(shortname, info->shortname, DOS_NAMELENGTH_ASCII);
+	return true;
+}
 
-	// The orgname part of the list is not sorted (shortname is)! So we can only walk through it.
-	for(Bitu i = 0; i < filelist_size; i++) {
-#if defined (WIN32)
-		if (strcasecmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#else
-		if (strcmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#endif
-			safe_strncpy(shortname, curDir->longNameList[i]->shortname, DOS_NAMELENGTH_ASCII);
-			return true;
-		}
-	}
-	return false;
+unsigned DOS_Drive_Cache::CreateShortNameID(CFileInfo *curDir, const std::string &prefix)
+{
+	assert(curDir && curDir->index);
+	const auto it = curDir->index->nextShortNr.find(prefix);
+	return it != curDir->index->nextShortNr.end() ? it->second : 1; // short name IDs start with 1
 }
 
-int DOS_Drive_Cache::CompareShortname(const char* compareName, const char* shortName) {
-	char const* cpos = strchr(shortName,'~');
-	if (cpos) {
-/* the following code is replaced as it's not safe when char* is 64 bits */
-/*		Bits compareCount1	= (int)cpos - (int)shortName;
-		char* endPos		= strchr(cpos,'.');
-		Bitu numberSize		= endPos ? int(endPos)-int(cpos) : safe_strlen(cpos);
-		
-		char* lpos			= strchr(compareName,'.');
-		Bits compareCount2	= lpos ? int(lpos)-int(compareName) : safe_strlen(compareName);
-		if (compareCount2>8) compareCount2 = 8;
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindShortName(CFileInfo* curDir, const char* shortname) {
+	if (!curDir->index)
+		return nullptr;
+	const auto it = curDir->index->shortNames.find(shortname);
+	return it != curDir->index->shortNames.end() ? it->second : nullptr;
+}
 
-		compareCount2 -= numberSize;
-		if (compareCount2>compareCount1) compareCount1 = compareCount2;
-*/
-		size_t compareCount1 = strcspn(shortName,"~");
-		size_t numberSize    = strcspn(cpos,".");
-		size_t compareCount2 = strcspn(compareName,".");
-		if(compareCount2 > 8) compareCount2 = 8;
-		/* We want 
-		 * compareCount2 -= numberSize;
-		 * if (compareCount2>compareCount1) compareCount1 = compareCount2;
-		 * but to prevent negative numbers: 
-		 */
-		if(compareCount2 > compareCount1 + numberSize)
-			compareCount1 = compareCount2 - numberSize;
-		return strncmp(compareName,shortName,compareCount1);
-	}
-	return strcmp(compareName,shortName);
-}
-
-unsigned DOS_Drive_Cache::CreateShortNameID(CFileInfo *curDir, const char *name)
-{
-	assert(curDir);
-	const auto filelist_size = curDir->longNameList.size();
-	if (filelist_size == 0)
-		return 1; // short name IDs start with 1
-
-	unsigned found_nr = 0;
-	Bits low = 0;
-	Bits high = (Bits)(filelist_size - 1);
-
-	while (low <= high) {
-		auto mid = (low + high) / 2;
-		const char *other_shortname = curDir->longNameList[mid]->shortname;
-		const int res = CompareShortname(name, other_shortname);
-		
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; 
-		else {
-			// any more same x chars in next entries ?	
-			do {
-				found_nr = curDir->longNameList[mid]->shortNr;
-				mid++;
-			} while((Bitu)mid < filelist_size && (CompareShortname(name, curDir->longNameList[mid]->shortname) == 0));
-			break;
-		};
-	}
-	return found_nr + 1;
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindLongName(CFileInfo* curDir, const char* name) {
+	if (!curDir->index)
+		return nullptr;
+	const auto it = curDir->index->longNames.find(long_name_key(name));
+	return it != curDir->index->longNames.end() ? it->second : nullptr;
+}
+
+Bits DOS_Drive_Cache::GetEntryIndex(CFileInfo* curDir, CFileInfo* info) {
+	const auto begin = curDir->fileList.begin();
+	const auto end = curDir->fileList.end();
+	auto it = std::lower_bound(begin, end, info, SortByName);
+	if (it == end || *it != info)
+		it = std::find(begin, end, info);
+	return it != end ? static_cast<Bits>(it - begin) : -1;
 }
 
 bool DOS_Drive_Cache::RemoveTrailingDot(char* shortname) {
@@ -545,18 +772,9 @@ Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName, const size
 	// Remove dot, if no extension...
 	RemoveTrailingDot(shortName);
 	// Search long name and return array number of element
-	Bits low	= 0;
-	Bits high	= (Bits)(filelist_size-1);
-	Bits mid,res;
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = strcmp(shortName,curDir->fileList[mid]->shortname);
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; else
-		{	// Found
-			safe_strncpy(shortName, curDir->fileList[mid]->orgname, shortName_len);
-			return mid;
-		};
+	if (CFileInfo* info = FindShortName(curDir, shortName)) {
+		safe_strncpy(shortName, info->orgname, shortName_len);
+		return GetEntryIndex(curDir, info);
 	}
 #ifdef WINE_DRIVE_SUPPORT
 	if (strlen(shortName) < 8 || shortName[4] != '~' || shortName[5] == '.' || shortName[6] == '.' || shortName[7] == '.') return -1; // not available
@@ -564,7 +782,7 @@ Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName, const size
 	// The above test is rather strict as the following loop can be really slow if filelist_size is large.
 	char buff[CROSS_LEN];
 	for (Bitu i = 0; i < filelist_size; i++) {
-		res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
+		const Bits res = wine_hash_short_file_name(curDir->fileList[i]->orgname,buff);
 		buff[res] = 0;
 		if (!strcmp(shortName,buff)) {	
 			// Found
@@ -621,72 +839,57 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 	if (!createShort) {
 		char buffer[CROSS_LEN];
 		safe_strcpy(buffer, tmpName);
-		createShort = (GetLongName(curDir, buffer, sizeof(buffer)) >= 0);
+		RemoveTrailingDot(buffer);
+		createShort = (FindShortName(curDir, buffer) != nullptr);
 	}
 
 	if (createShort) {
-		// Create number
-		info->shortNr = CreateShortNameID(curDir, tmpName);
-
-		// If processing a directory containing 10 million or more long files,
-		// then ten duplicate short filenames will be named ~1000000.ext,
-		// another 10 duplicates will be named ~1000001.ext, and so on, back
-		// through to ~9999999.ext if 999,999,999 files are present.
-		// Yes, this is a broken corner-case, but is still memory-safe.
-		// TODO: modify MOUNT/IMGMOUNT to exit with an error when encountering
-		// a directory having more than 65534 files, which is FAT32's limit.
-		char short_nr[8] = {'\0'};
-		if (GCC_UNLIKELY(info->shortNr > 9999999)) E_Exit("~9999999 same name files overflow");
-		safe_sprintf(short_nr, "%u", info->shortNr);
-
-		// Copy first letters
-		Bits tocopy = 0;
-		size_t buflen = safe_strlen(short_nr);
-		if (len + buflen + 1 > 8)
-			tocopy = (Bits)(8 - buflen - 1);
-		else
-			tocopy = len;
-
-		// Copy the lesser of "DOS_NAMELENGTH_ASCII" or "tocopy + 1" characters.
-		safe_strncpy(info->shortname, tmpName,
-		             tocopy < DOS_NAMELENGTH_ASCII ? tocopy + 1 : DOS_NAMELENGTH_ASCII);
-		// Copy number
-		safe_strcat(info->shortname, "~");
-		safe_strcat(info->shortname, short_nr);
-
-		// Add (and cut) Extension, if available
-		if (pos) {
-			// Step to last extension...
-			pos = strrchr(tmpName, '.'); // extensions are at-most 3 chars (4 with terminator)
-			// add extension
-			unsigned int remaining_space = DOS_NAMELENGTH_ASCII - safe_strlen(info->shortname) - 1;
-			strncat(info->shortname, pos, 4 < remaining_space ? 4 : remaining_space);
-			info->shortname[DOS_NAMELENGTH] = 0;
-		}
-
-		// keep list sorted for CreateShortNameID to work correctly
-		if (curDir->longNameList.size()>0) {
-			if (!(strcmp(info->shortname,curDir->longNameList.back()->shortname)<0)) {
-				// append at end of list
-				curDir->longNameList.push_back(info);
-			} else {
-				// look for position where to insert this element
-				bool found=false;
-				std::vector<CFileInfo*>::iterator it;
-				for (it=curDir->longNameList.begin(); it!=curDir->longNameList.end(); ++it) {
-					if (strcmp(info->shortname,(*it)->shortname)<0) {
-						found = true;
-						break;
-					}
-				}
-				// Put it in longname list...
-				if (found) curDir->longNameList.insert(it,info);
-				else curDir->longNameList.push_back(info);
+		// Create number; the names starting alike count up together,
+		// skipping the short names that are taken
+		const std::string prefix(tmpName, static_cast<size_t>(std::min<Bits>(len, 6)));
+		info->shortNr = CreateShortNameID(curDir, prefix);
+		while (true) {
+			// If processing a directory containing 10 million or more long files,
+			// then ten duplicate short filenames will be named ~1000000.ext,
+			// another 10 duplicates will be named ~1000001.ext, and so on, back
+			// through to ~9999999.ext if 999,999,999 files are present.
+			// Yes, this is a broken corner-case, but is still memory-safe.
+			// TODO: modify MOUNT/IMGMOUNT to exit with an error when encountering
+			// a directory having more than 65534 files, which is FAT32's limit.
+			char short_nr[8] = {'\0'};
+			if (GCC_UNLIKELY(info->shortNr > 9999999)) E_Exit("~9999999 same name files overflow");
+			safe_sprintf(short_nr, "%u", info->shortNr);
+
+			// Copy first letters
+			Bits tocopy = 0;
+			size_t buflen = safe_strlen(short_nr);
+			if (len + buflen + 1 > 8)
+				tocopy = (Bits)(8 - buflen - 1);
+			else
+				tocopy = len;
+
+			// Copy the lesser of "DOS_NAMELENGTH_ASCII" or "tocopy + 1" characters.
+			safe_strncpy(info->shortname, tmpName,
+			             tocopy < DOS_NAMELENGTH_ASCII ? tocopy + 1 : DOS_NAMELENGTH_ASCII);
+			// Copy number
+			safe_strcat(info->shortname, "~");
+			safe_strcat(info->shortname, short_nr);
+
+			// Add (and cut) Extension, if available
+			if (pos) {
+				// Step to last extension...
+				const char* ext = strrchr(tmpName, '.'); // extensions are at-most 3 chars (4 with terminator)
+				// add extension
+				unsigned int remaining_space = DOS_NAMELENGTH_ASCII - safe_strlen(info->shortname) - 1;
+				strncat(info->shortname, ext, 4 < remaining_space ? 4 : remaining_space);
+				info->shortname[DOS_NAMELENGTH] = 0;
 			}
-		} else {
-			// empty file list, append
-			curDir->longNameList.push_back(info);
+			RemoveTrailingDot(info->shortname);
+			if (!FindShortName(curDir, info->shortname))
+				break;
+			info->shortNr++;
 		}
+		curDir->index->nextShortNr[prefix] = info->shortNr + 1;
 	} else {
 		safe_strcpy(info->shortname, tmpName);
 	}
@@ -704,6 +907,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
 	CFileInfo*	curDir = dirBase;
 	uint16_t		id;
 
+	ProcessHostChanges();
+
 	if (save_dir && (strcmp(path,save_path)==0)) {
 		safe_strncpy(expandedPath, save_expanded, CROSS_LEN);
 		return save_dir;
@@ -821,50 +1026,32 @@ bool DOS_Drive_Cache::OpenDir(CFileInfo* dir, const char* expand, uint16_t& id)
 	return false;
 }
 
-void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_directory) {
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_directory, bool keepSorted) {
 	CFileInfo* info = new CFileInfo;
 	safe_strcpy(info->orgname, name);
 	info->shortNr = 0;
 	info->isDir = is_directory;
 
-	// Check for long filenames...
-	CreateShortName(dir, info);		
-
-	bool found = false;
+	if (!dir->index)
+		dir->index = std::make_unique<CFileInfo::Index>();
 
-	// keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
-	if (dir->fileList.size()>0) {
-		if (!(strcmp(info->shortname,dir->fileList.back()->shortname)<0)) {
-			// append at end of list
-			dir->fileList.push_back(info);
-		} else {
-			// look for position where to insert this element
-			std::vector<CFileInfo*>::iterator it;
-			for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
-				if (strcmp(info->shortname,(*it)->shortname)<0) {
-					found = true;
-					break;
-				}
-			}
-			// Put file in lists
-			if (found) dir->fileList.insert(it,info);
-			else dir->fileList.push_back(info);
-		}
-	} else {
-		// empty file list, append
+	// Check for long filenames...
+	CreateShortName(dir, info);
+
+	dir->index->shortNames.emplace(info->shortname, info);
+	dir->index->longNames.emplace(long_name_key(info->orgname), info);
+
+	// keep list sorted (so GetLongName works correctly); whoever reads
+	// a whole directory sorts it once at the end instead
+	if (keepSorted)
+		dir->fileList.insert(std::upper_bound(dir->fileList.begin(),
+		                                      dir->fileList.end(), info,
+		                                      SortByName),
+		                     info);
+	else
 		dir->fileList.push_back(info);
-	}
-}
-
-void DOS_Drive_Cache::CopyEntry(CFileInfo* dir, CFileInfo* from) {
-	CFileInfo* info = new CFileInfo;
-	// just copy things into new fileinfo
-	safe_strcpy(info->orgname, from->orgname);
-	safe_strcpy(info->shortname, from->shortname);
-	info->shortNr = from->shortNr;
-	info->isDir = from->isDir;
-
-	dir->fileList.push_back(info);
+	++dir->generation;
+	return info;
 }
 
 bool DOS_Drive_Cache::ReadDir(uint16_t id, char* &result) {
@@ -873,27 +1060,40 @@ bool DOS_Drive_Cache::ReadDir(uint16_t id, char* &result) {
 		return false;
 
 	if (!IsCachedIn(dirSearch[id])) {
-		// Try to open directory
-		dir_information* dirp = open_directory(dirPath);
-		if (!dirp) {
-			if (dirSearch[id]) {
-				dirSearch[id]->id = MAX_OPENDIRS;
-				dirSearch[id] = nullptr;
-			}
-			return false;
+		// Watch it first, so no changes are missed while reading it
+		if (watchHost) {
+			if (!watcher)
+				watcher = std::make_unique<DirWatcher>();
+			watcher->Watch(dirPath, dirSearch[id]);
 		}
-		// Read complete directory
-		char dir_name[CROSS_LEN];
-		bool is_directory;
-		if (read_directory_first(dirp, dir_name, is_directory)) {
-			CreateEntry(dirSearch[id], dir_name, is_directory);
-			while (read_directory_next(dirp, dir_name, is_directory)) {
-				CreateEntry(dirSearch[id], dir_name, is_directory);
+		Prefetcher::Listing listing = {};
+		if (prefetcher && prefetcher->Take(dirPath, listing)) {
+			for (const auto &[name, is_directory] : listing.entries)
+				CreateEntry(dirSearch[id], name.c_str(), is_directory, false);
+		} else {
+			// Try to open directory
+			dir_information* dirp = open_directory(dirPath);
+			if (!dirp) {
+				if (dirSearch[id]) {
+					dirSearch[id]->id = MAX_OPENDIRS;
+					dirSearch[id] = nullptr;
+				}
+				return false;
+			}
+			// Read complete directory
+			char dir_name[CROSS_LEN];
+			bool is_directory;
+			if (read_directory_first(dirp, dir_name, is_directory)) {
+				CreateEntry(dirSearch[id], dir_name, is_directory, false);
+				while (read_directory_next(dirp, dir_name, is_directory)) {
+					CreateEntry(dirSearch[id], dir_name, is_directory, false);
+				}
 			}
-		}
 
-		// close dir
-		close_directory(dirp);
+			// close dir
+			close_directory(dirp);
+		}
+		std::sort(dirSearch[id]->fileList.begin(), dirSearch[id]->fileList.end(), SortByName);
 
 		// Info
 /*		if (!dirp) {
@@ -928,8 +1128,43 @@ bool DOS_Drive_Cache::SetResult(CFileInfo* dir, char* &result, Bitu entryNr)
 	return true;
 }
 
+// The matches are kept for a few patterns per directory, which is plenty for
+// programs listing the same directories over and over
+constexpr size_t max_cached_patterns = 16;
+
+std::shared_ptr<const std::vector<std::string>> DOS_Drive_Cache::GetMatches(CFileInfo* dir, const char* pattern)
+{
+	auto it = dir->matches.find(pattern);
+	if (it != dir->matches.end() && it->second.generation == dir->generation &&
+	    it->second.sort == sortDirType)
+		return it->second.names;
+
+	std::vector<CFileInfo*> found = {};
+	for (const auto info : dir->fileList)
+		if (WildFileCmp(info->shortname, pattern))
+			found.push_back(info);
+
+	// Now sort the matches accordingly to output
+	switch (sortDirType) {
+		case ALPHABETICAL		: break;
+		case DIRALPHABETICAL	: std::sort(found.begin(), found.end(), SortByDirName);		break;
+		case ALPHABETICALREV	: std::sort(found.begin(), found.end(), SortByNameRev);		break;
+		case DIRALPHABETICALREV	: std::sort(found.begin(), found.end(), SortByDirNameRev);	break;
+		case NOSORT				: break;
+	}
+	auto names = std::make_shared<std::vector<std::string>>();
+	names->reserve(found.size());
+	for (const auto info : found)
+		names->emplace_back(info->shortname);
+
+	if (it == dir->matches.end() && dir->matches.size() >= max_cached_patterns)
+		dir->matches.clear();
+	dir->matches[pattern] = {dir->generation, sortDirType, names};
+	return names;
+}
+
 // FindFirst / FindNext
-bool DOS_Drive_Cache::FindFirst(char* path, uint16_t& id) {
+bool DOS_Drive_Cache::FindFirst(char* path, const char* pattern, uint16_t& id) {
 	uint16_t	dirID;
 	// Cache directory in 
 	if (!OpenDir(path,dirID)) return false;
@@ -938,7 +1173,7 @@ bool DOS_Drive_Cache::FindFirst(char* path, uint16_t& id) {
 	//If the next one isn't free, move on to the next, if none is free => reset and assume the worst
 	uint16_t local_findcounter = 0;
 	while ( local_findcounter < MAX_OPENDIRS ) {
-		if (dirFindFirst[this->nextFreeFindFirst] == nullptr) break;
+		if (!findSearches[this->nextFreeFindFirst].names) break;
 		if (++this->nextFreeFindFirst >= MAX_OPENDIRS) this->nextFreeFindFirst = 0; //Wrap around
 		local_findcounter++;
 	}
@@ -952,30 +1187,14 @@ bool DOS_Drive_Cache::FindFirst(char* path, uint16_t& id) {
 		// Clear the internal list then.
 		dirFindFirstID = 0;
 		this->nextFreeFindFirst = 1; //the next free one after this search
-		for(Bitu n=0; n<MAX_OPENDIRS;n++) {	
-	     	// Clear and reuse slot
-			DeleteFileInfo(dirFindFirst[n]);
-			dirFindFirst[n] = nullptr;
-		}
-	   
+		for (auto &search : findSearches)
+			search = {};
 	}
-	assert(dirFindFirst[dirFindFirstID] == nullptr);
-	dirFindFirst[dirFindFirstID] = new CFileInfo();
-	dirFindFirst[dirFindFirstID]->nextEntry = 0;
+	assert(!findSearches[dirFindFirstID].names);
 
-	// Copy entries to use with FindNext
-	for (Bitu i=0; i<dirSearch[dirID]->fileList.size(); i++) {
-		CopyEntry(dirFindFirst[dirFindFirstID],dirSearch[dirID]->fileList[i]);
-	}
-	// Now re-sort the fileList accordingly to output
-	switch (sortDirType) {
-		case ALPHABETICAL		: break;
-//		case ALPHABETICAL		: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByName);		break;
-		case DIRALPHABETICAL	: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByDirName);		break;
-		case ALPHABETICALREV	: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByNameRev);		break;
-		case DIRALPHABETICALREV	: std::sort(dirFindFirst[dirFindFirstID]->fileList.begin(), dirFindFirst[dirFindFirstID]->fileList.end(), SortByDirNameRev);	break;
-		case NOSORT				: break;
-	}
+	// Searches see the directory as it was when they started, as the
+	// matches aren't changed once found
+	findSearches[dirFindFirstID] = {GetMatches(dirSearch[dirID], pattern), 0};
 
 //	LOG(LOG_MISC,LOG_ERROR)("DIRCACHE: FindFirst : %s (ID:%02X)",path,dirFindFirstID);
 	id = dirFindFirstID;
@@ -983,17 +1202,21 @@ bool DOS_Drive_Cache::FindFirst(char* path, uint16_t& id) {
 }
 
 bool DOS_Drive_Cache::FindNext(uint16_t id, char* &result) {
+	static char res[CROSS_LEN] = { 0 };
+
 	// out of range ?
-	if ((id>=MAX_OPENDIRS) || !dirFindFirst[id]) {
+	if ((id>=MAX_OPENDIRS) || !findSearches[id].names) {
 		LOG(LOG_MISC,LOG_ERROR)("DIRCACHE: FindFirst/Next failure : ID out of range: %04X",id);
 		return false;
 	}
-	if (!SetResult(dirFindFirst[id], result, dirFindFirst[id]->nextEntry)) {
+	auto &search = findSearches[id];
+	if (search.next >= search.names->size()) {
 		// free slot
-		DeleteFileInfo(dirFindFirst[id]);
-		dirFindFirst[id] = nullptr;
+		search = {};
 		return false;
 	}
+	safe_strcpy(res, (*search.names)[search.next++].c_str());
+	result = res;
 	return true;
 }
 
@@ -1006,6 +1229,8 @@ void DOS_Drive_Cache::ClearFileInfo(CFileInfo *dir) {
 		dirSearch[dir->id] = nullptr;
 		dir->id = MAX_OPENDIRS;
 	}
+	if (watcher)
+		watcher->Unwatch(dir);
 }
 
 void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
@@ -18,6 +18,7 @@
 
 #include "drives.h"
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,6 +39,9 @@
 #define FAT16		   1
 #define FAT32		   2
 
+/* Directories whose entries are kept, before starting over */
+constexpr size_t fat_dir_cache_max = 256;
+
 class fatFile final : public DOS_File {
 public:
 	fatFile(const char* name, uint32_t startCluster, uint32_t fileLen, fatDrive *useDrive);
@@ -304,112 +308,147 @@ uint32_t fatDrive::getClustFirstSect(uint32_t clustNum) {
 	return ((clustNum - 2) * bootbuffer.sectorspercluster) + firstDataSector;
 }
 
-uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
-	uint32_t fatoffset=0;
-	uint32_t fatsectnum;
-	uint32_t fatentoff;
-	uint32_t clustValue=0;
-
+uint32_t fatDrive::getFatEntryOffset(uint32_t clustNum) const {
 	switch(fattype) {
-		case FAT12:
-			fatoffset = clustNum + (clustNum / 2);
-			break;
-		case FAT16:
-			fatoffset = clustNum * 2;
-			break;
-		case FAT32:
-			fatoffset = clustNum * 4;
-			break;
+		case FAT12: return clustNum + (clustNum / 2);
+		case FAT16: return clustNum * 2;
+		default:    return clustNum * 4;
 	}
-	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
-	fatentoff = fatoffset % bootbuffer.bytespersector;
+}
 
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		readSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			readSector(fatsectnum+1, &fatSectBuffer[512]);
-		curFatSect = fatsectnum;
+// Reads the first FAT and decodes the values of all the clusters
+void fatDrive::loadFat() {
+	const uint32_t bytesPerSector = bootbuffer.bytespersector;
+	const uint32_t numEntries = CountOfClusters + 2;
+	/* Cover all the clusters, even if the FAT is said to be too small */
+	const uint32_t neededBytes = getFatEntryOffset(numEntries) + 2;
+	const uint32_t numSectors = std::max<uint32_t>(bootbuffer.sectorsperfat,
+	        (neededBytes + bytesPerSector - 1) / bytesPerSector);
+
+	fatImage.assign(static_cast<size_t>(numSectors + 1) * bytesPerSector, 0);
+	for (uint32_t i = 0; i < numSectors; i++)
+		readSector(bootbuffer.reservedsectors + partSectOff + i,
+		           &fatImage[static_cast<size_t>(i) * bytesPerSector]);
+	fatDirtySectors.assign(numSectors, false);
+	fatDirty = false;
+
+	fatTable.resize(numEntries);
+	for (uint32_t clustNum = 0; clustNum < numEntries; clustNum++) {
+		const uint8_t *entry = &fatImage[getFatEntryOffset(clustNum)];
+		uint32_t clustValue = 0;
+		switch(fattype) {
+			case FAT12:
+				clustValue = var_read((uint16_t *)entry);
+				if(clustNum & 0x1) {
+					clustValue >>= 4;
+				} else {
+					clustValue &= 0xfff;
+				}
+				break;
+			case FAT16:
+				clustValue = var_read((uint16_t *)entry);
+				break;
+			case FAT32:
+				clustValue = var_read((uint32_t *)entry);
+				break;
+		}
+		fatTable[clustNum] = clustValue;
 	}
+}
 
-	switch(fattype) {
-		case FAT12:
-			clustValue = var_read((uint16_t *)&fatSectBuffer[fatentoff]);
-			if(clustNum & 0x1) {
-				clustValue >>= 4;
-			} else {
-				clustValue &= 0xfff;
-			}
-			break;
-		case FAT16:
-			clustValue = var_read((uint16_t *)&fatSectBuffer[fatentoff]);
-			break;
-		case FAT32:
-			clustValue = var_read((uint32_t *)&fatSectBuffer[fatentoff]);
-			break;
+// Writes the changed FAT sectors to all the FAT copies
+void fatDrive::flushFat() {
+	if (!fatDirty)
+		return;
+	fatDirty = false;
+	const uint32_t bytesPerSector = bootbuffer.bytespersector;
+	for (uint32_t i = 0; i < fatDirtySectors.size(); i++) {
+		if (!fatDirtySectors[i])
+			continue;
+		fatDirtySectors[i] = false;
+		const uint32_t fatsectnum = bootbuffer.reservedsectors + i + partSectOff;
+		for(int fc=0;fc<bootbuffer.fatcopies;fc++) {
+			writeSector(fatsectnum + (fc * bootbuffer.sectorsperfat),
+			            &fatImage[static_cast<size_t>(i) * bytesPerSector]);
+		}
 	}
-
-	return clustValue;
 }
 
-void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
-	uint32_t fatoffset=0;
-	uint32_t fatsectnum;
-	uint32_t fatentoff;
+// Drops what was read from the disk if it was written to from outside
+// this drive since its last write
+void fatDrive::checkDiskWrites() {
+	if (!loadedDisk || loadedDisk->write_count == diskWrites)
+		return;
+	diskWrites = loadedDisk->write_count;
+	if (fatDirty)
+		LOG_WARNING("FAT: Disk was written to while the FAT had changes pending");
+	fatImage.clear();
+	fatTable.clear();
+	fatDirtySectors.clear();
+	fatDirty = false;
+	clearDirCache();
+}
 
-	switch(fattype) {
-		case FAT12:
-			fatoffset = clustNum + (clustNum / 2);
-			break;
-		case FAT16:
-			fatoffset = clustNum * 2;
-			break;
-		case FAT32:
-			fatoffset = clustNum * 4;
-			break;
+uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
+	checkDiskWrites();
+	if (fatTable.empty())
+		loadFat();
+	if (clustNum >= fatTable.size()) {
+		/* Past the end of the volume, treat it like the end of a chain */
+		switch(fattype) {
+			case FAT12: return 0xfff;
+			case FAT16: return 0xffff;
+			default:    return 0xffffffff;
+		}
 	}
-	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
-	fatentoff = fatoffset % bootbuffer.bytespersector;
+	return fatTable[clustNum];
+}
 
-	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
-		readSector(fatsectnum, &fatSectBuffer[0]);
-		if (fattype==FAT12)
-			readSector(fatsectnum+1, &fatSectBuffer[512]);
-		curFatSect = fatsectnum;
-	}
+void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
+	checkDiskWrites();
+	if (fatTable.empty())
+		loadFat();
+	if (clustNum >= fatTable.size())
+		return;
 
+	/* The directory using the cluster now has a different chain */
+	const auto owner = dirClusterOwners.find(clustNum);
+	if (owner != dirClusterOwners.end())
+		dropCachedDir(owner->second);
+
+	const uint32_t fatoffset = getFatEntryOffset(clustNum);
+	uint8_t *entry = &fatImage[fatoffset];
 	switch(fattype) {
 		case FAT12: {
-			uint16_t tmpValue = var_read((uint16_t *)&fatSectBuffer[fatentoff]);
+			clustValue &= 0xfff;
+			uint16_t tmpValue = var_read((uint16_t *)entry);
 			if(clustNum & 0x1) {
-				clustValue &= 0xfff;
-				clustValue <<= 4;
 				tmpValue &= 0xf;
-				tmpValue |= (uint16_t)clustValue;
-
+				tmpValue |= (uint16_t)(clustValue << 4);
 			} else {
-				clustValue &= 0xfff;
 				tmpValue &= 0xf000;
 				tmpValue |= (uint16_t)clustValue;
 			}
-			var_write((uint16_t *)&fatSectBuffer[fatentoff], tmpValue);
+			var_write((uint16_t *)entry, tmpValue);
 			break;
 			}
 		case FAT16:
-			var_write((uint16_t *)&fatSectBuffer[fatentoff], (uint16_t)clustValue);
+			clustValue &= 0xffff;
+			var_write((uint16_t *)entry, (uint16_t)clustValue);
 			break;
 		case FAT32:
-			var_write((uint32_t *)&fatSectBuffer[fatentoff], clustValue);
+			var_write((uint32_t *)entry, clustValue);
 			break;
 	}
-	for(int fc=0;fc<bootbuffer.fatcopies;fc++) {
-		writeSector(fatsectnum + (fc * bootbuffer.sectorsperfat), &fatSectBuffer[0]);
-		if (fattype==FAT12) {
-			if (fatentoff>=511)
-				writeSector(fatsectnum+1+(fc * bootbuffer.sectorsperfat), &fatSectBuffer[512]);
-		}
-	}
+	fatTable[clustNum] = clustValue;
+
+	/* FAT12 entries can straddle two sectors */
+	const uint32_t entryBytes = (fattype == FAT32) ? 4 : 2;
+	const uint32_t firstSector = fatoffset / bootbuffer.bytespersector;
+	const uint32_t lastSector = (fatoffset + entryBytes - 1) / bootbuffer.bytespersector;
+	for (uint32_t i = firstSector; i <= lastSector && i < fatDirtySectors.size(); i++)
+		fatDirtySectors[i] = true;
+	fatDirty = true;
 }
 
 bool fatDrive::getEntryName(char *fullname, char *entname) {
@@ -546,15 +585,31 @@ uint8_t fatDrive::writeSector(uint32_t sectnum, void * data) {
 		return 0;
 	}
 
-	if (absolute) {
-		return loadedDisk->Write_AbsoluteSector(sectnum, data);
+	/* Keep the cached entries of the directory up to date */
+	const auto owner = dirSectorOwners.find(sectnum);
+	if (owner != dirSectorOwners.end()) {
+		CachedDir &dir = dirEntryCache[owner->second];
+		const auto it = std::find(dir.sectors.begin(), dir.sectors.end(), sectnum);
+		direntry *entries = &dir.entries[(it - dir.sectors.begin()) * 16];
+		if (entries != data)
+			memcpy(entries, data, 16 * sizeof(direntry));
 	}
-	uint32_t cylindersize = bootbuffer.headcount * bootbuffer.sectorspertrack;
-	uint32_t cylinder = sectnum / cylindersize;
-	sectnum %= cylindersize;
-	uint32_t head = sectnum / bootbuffer.sectorspertrack;
-	uint32_t sector = sectnum % bootbuffer.sectorspertrack + 1L;
-	return loadedDisk->Write_Sector(head, cylinder, sector, data);
+
+	const bool inSync = (loadedDisk->write_count == diskWrites);
+	uint8_t result;
+	if (absolute) {
+		result = loadedDisk->Write_AbsoluteSector(sectnum, data);
+	} else {
+		uint32_t cylindersize = bootbuffer.headcount * bootbuffer.sectorspertrack;
+		uint32_t cylinder = sectnum / cylindersize;
+		sectnum %= cylindersize;
+		uint32_t head = sectnum / bootbuffer.sectorspertrack;
+		uint32_t sector = sectnum % bootbuffer.sectorspertrack + 1L;
+		result = loadedDisk->Write_Sector(head, cylinder, sector, data);
+	}
+	if (inSync)
+		diskWrites = loadedDisk->write_count;
+	return result;
 }
 
 uint32_t fatDrive::getSectorCount()
@@ -740,9 +795,7 @@ fatDrive::fatDrive(const char *sysFilename,
 	  CountOfClusters(0),
 	  firstDataSector(0),
 	  firstRootDirSect(0),
-	  cwdDirCluster(0),
-	  fatSectBuffer{0},
-	  curFatSect(0)
+	  cwdDirCluster(0)
 {
 	FILE *diskfile;
 	uint32_t filesize;
@@ -920,13 +973,16 @@ fatDrive::fatDrive(const char *sysFilename,
 	/* There is no cluster 0, this means we are in the root directory */
 	cwdDirCluster = 0;
 
-	memset(fatSectBuffer,0,1024);
-	curFatSect = 0xffffffff;
+	diskWrites = loadedDisk->write_count;
 
 	type = DosDriveType::Fat;
 	safe_strcpy(info, sysFilename);
 }
 
+fatDrive::~fatDrive() {
+	flushFat();
+}
+
 bool fatDrive::AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster, uint16_t *_total_clusters, uint16_t *_free_clusters) {
 	// Guard
 	if (!loadedDisk) {
@@ -1094,6 +1150,7 @@ bool fatDrive::FileUnlink(char * name) {
 	directoryChange(dirClust, &fileEntry, subEntry);
 
 	if(fileEntry.loFirstClust != 0) deleteClustChain(fileEntry.loFirstClust, 0);
+	flushFat();
 
 	return true;
 }
@@ -1163,10 +1220,8 @@ static void copyDirEntry(const direntry *src, direntry *dst) {
 }
 
 bool fatDrive::FindNextInternal(uint32_t dirClustNumber, DOS_DTA &dta, direntry *foundEntry) {
-	direntry sectbuf[16]; /* 16 directory entries per sector */
-	uint32_t logentsector; /* Logical entry sector */
-	uint32_t entryoffset;  /* Index offset within sector */
-	uint32_t tmpsector;
+	const CachedDir *dir = getCachedDir(dirClustNumber);
+	const direntry *entry;
 	uint8_t attrs;
 	uint16_t dirPos;
 	char srch_pattern[DOS_NAMELENGTH_ASCII];
@@ -1177,43 +1232,30 @@ bool fatDrive::FindNextInternal(uint32_t dirClustNumber, DOS_DTA &dta, direntry
 	dirPos = dta.GetDirID();
 
 nextfile:
-	logentsector = dirPos / 16;
-	entryoffset = dirPos % 16;
-
-	if(dirClustNumber==0) {
-		if(dirPos >= bootbuffer.rootdirentries) {
-			DOS_SetError(DOSERR_NO_MORE_FILES);
-			return false;
-		}
-		readSector(firstRootDirSect+logentsector,sectbuf);
-	} else {
-		tmpsector = getAbsoluteSectFromChain(dirClustNumber, logentsector);
-		/* A zero sector number can't happen */
-		if(tmpsector == 0) {
-			DOS_SetError(DOSERR_NO_MORE_FILES);
-			return false;
-		}
-		readSector(tmpsector,sectbuf);
+	if(dirPos >= dir->numEntries) {
+		DOS_SetError(DOSERR_NO_MORE_FILES);
+		return false;
 	}
+	entry = &dir->entries[dirPos];
 	dirPos++;
 	dta.SetDirID(dirPos);
 
 	/* Deleted file entry */
-	if (sectbuf[entryoffset].entryname[0] == 0xe5) goto nextfile;
+	if (entry->entryname[0] == 0xe5) goto nextfile;
 
 	/* End of directory list */
-	if (sectbuf[entryoffset].entryname[0] == 0x00) {
+	if (entry->entryname[0] == 0x00) {
 		DOS_SetError(DOSERR_NO_MORE_FILES);
 		return false;
 	}
 	memset(find_name,0,DOS_NAMELENGTH_ASCII);
 	memset(extension,0,4);
-	memcpy(find_name,&sectbuf[entryoffset].entryname[0],8);
-	memcpy(extension,&sectbuf[entryoffset].entryname[8],3);
+	memcpy(find_name,&entry->entryname[0],8);
+	memcpy(extension,&entry->entryname[8],3);
 	trimString(&find_name[0], sizeof(find_name));
 	trimString(&extension[0], sizeof(extension));
 	
-	//if(!(sectbuf[entryoffset].attrib & DOS_ATTR_DIRECTORY))
+	//if(!(entry->attrib & DOS_ATTR_DIRECTORY))
 	if (extension[0]!=0) {
 		safe_strcat(find_name, ".");
 		safe_strcat(find_name, extension);
@@ -1223,17 +1265,17 @@ nextfile:
 
 	//TODO What about attrs = DOS_ATTR_VOLUME|DOS_ATTR_DIRECTORY ?
 	if (attrs == DOS_ATTR_VOLUME) {
-		if (!(sectbuf[entryoffset].attrib & DOS_ATTR_VOLUME)) goto nextfile;
+		if (!(entry->attrib & DOS_ATTR_VOLUME)) goto nextfile;
 		dirCache.SetLabel(find_name, false, true);
 	} else {
-		if (~attrs & sectbuf[entryoffset].attrib & (DOS_ATTR_DIRECTORY | DOS_ATTR_VOLUME | DOS_ATTR_SYSTEM | DOS_ATTR_HIDDEN) ) goto nextfile;
+		if (~attrs & entry->attrib & (DOS_ATTR_DIRECTORY | DOS_ATTR_VOLUME | DOS_ATTR_SYSTEM | DOS_ATTR_HIDDEN) ) goto nextfile;
 	}
 
 
 	/* Compare name to search pattern */
 	if(!WildFileCmp(find_name,srch_pattern)) goto nextfile;
 
-	copyDirEntry(&sectbuf[entryoffset], foundEntry);
+	copyDirEntry(entry, foundEntry);
 
 	//dta.SetResult(find_name, foundEntry->entrysize, foundEntry->crtDate, foundEntry->crtTime, foundEntry->attrib);
 
@@ -1291,121 +1333,137 @@ bool fatDrive::SetFileAttr(const char *name, const uint16_t attr)
 	return true;
 }
 
-bool fatDrive::directoryBrowse(uint32_t dirClustNumber, direntry *useEntry, int32_t entNum, int32_t start/*=0*/) {
-	direntry sectbuf[16];	/* 16 directory entries per sector */
-	uint32_t logentsector;	/* Logical entry sector */
-	uint32_t entryoffset = 0;	/* Index offset within sector */
-	uint32_t tmpsector;
-	if ((start<0) || (start>65535)) return false;
-	uint16_t dirPos = (uint16_t)start;
-	if (entNum<start) return false;
-	entNum-=start;
-
-	while(entNum>=0) {
+// Returns the entries of the directory, reading them on first use
+fatDrive::CachedDir *fatDrive::getCachedDir(uint32_t dirClustNumber) {
+	checkDiskWrites();
+	const auto cached = dirEntryCache.find(dirClustNumber);
+	if (cached != dirEntryCache.end())
+		return &cached->second;
 
-		logentsector = dirPos / 16;
-		entryoffset = dirPos % 16;
+	if (dirEntryCache.size() >= fat_dir_cache_max)
+		clearDirCache();
 
-		if(dirClustNumber==0) {
-			if(dirPos >= bootbuffer.rootdirentries) return false;
-			tmpsector = firstRootDirSect+logentsector;
-			readSector(tmpsector,sectbuf);
-		} else {
-			tmpsector = getAbsoluteSectFromChain(dirClustNumber, logentsector);
-			/* A zero sector number can't happen */
-			if(tmpsector == 0) return false;
-			readSector(tmpsector,sectbuf);
+	CachedDir dir = {};
+	std::vector<uint32_t> clusters = {};
+	if(dirClustNumber==0) {
+		const uint32_t numSectors = (bootbuffer.rootdirentries + 15) / 16;
+		for (uint32_t i = 0; i < numSectors; i++)
+			dir.sectors.push_back(firstRootDirSect + i);
+	} else {
+		/* DOS can't address more than 65536 entries in a directory,
+		 * which also stops at chains that loop */
+		const uint32_t maxSectors = 65536 / 16;
+		uint32_t currentClust = dirClustNumber;
+		while (dir.sectors.size() < maxSectors) {
+			clusters.push_back(currentClust);
+			for (uint32_t i = 0; i < bootbuffer.sectorspercluster; i++)
+				dir.sectors.push_back(getClustFirstSect(currentClust) + i);
+			const uint32_t testvalue = getClusterValue(currentClust);
+			bool isEOF = false;
+			switch(fattype) {
+				case FAT12:
+					if(testvalue >= 0xff8) isEOF = true;
+					break;
+				case FAT16:
+					if(testvalue >= 0xfff8) isEOF = true;
+					break;
+				case FAT32:
+					if(testvalue >= 0xfffffff8) isEOF = true;
+					break;
+			}
+			if(isEOF) break;
+			currentClust = testvalue;
 		}
-		dirPos++;
+	}
 
+	dir.entries.resize(dir.sectors.size() * 16);
+	for (size_t i = 0; i < dir.sectors.size(); i++)
+		readSector(dir.sectors[i], &dir.entries[i * 16]);
+	dir.numEntries = dir.entries.size();
+	if(dirClustNumber==0)
+		dir.numEntries = std::min<size_t>(dir.numEntries, bootbuffer.rootdirentries);
 
+	for (const auto sector : dir.sectors)
+		dirSectorOwners[sector] = dirClustNumber;
+	for (const auto cluster : clusters)
+		dirClusterOwners[cluster] = dirClustNumber;
+	return &(dirEntryCache[dirClustNumber] = std::move(dir));
+}
+
+void fatDrive::dropCachedDir(uint32_t dirClustNumber) {
+	const auto cached = dirEntryCache.find(dirClustNumber);
+	if (cached == dirEntryCache.end())
+		return;
+	for (const auto sector : cached->second.sectors)
+		dirSectorOwners.erase(sector);
+	for (auto it = dirClusterOwners.begin(); it != dirClusterOwners.end();) {
+		if (it->second == dirClustNumber)
+			it = dirClusterOwners.erase(it);
+		else
+			++it;
+	}
+	dirEntryCache.erase(cached);
+}
+
+void fatDrive::clearDirCache() {
+	dirEntryCache.clear();
+	dirSectorOwners.clear();
+	dirClusterOwners.clear();
+}
+
+bool fatDrive::directoryBrowse(uint32_t dirClustNumber, direntry *useEntry, int32_t entNum, int32_t start/*=0*/) {
+	if ((start<0) || (start>65535)) return false;
+	if (entNum<start) return false;
+
+	const CachedDir *dir = getCachedDir(dirClustNumber);
+	for (int32_t dirPos = start; dirPos <= entNum; dirPos++) {
+		if (static_cast<size_t>(dirPos) >= dir->numEntries) return false;
 		/* End of directory list */
-		if (sectbuf[entryoffset].entryname[0] == 0x00) return false;
-		--entNum;
+		if (dir->entries[dirPos].entryname[0] == 0x00) return false;
 	}
 
-	copyDirEntry(&sectbuf[entryoffset], useEntry);
+	copyDirEntry(&dir->entries[entNum], useEntry);
 	return true;
 }
 
 bool fatDrive::directoryChange(uint32_t dirClustNumber, direntry *useEntry, int32_t entNum) {
-	direntry sectbuf[16];	/* 16 directory entries per sector */
-	uint32_t logentsector;	/* Logical entry sector */
-	uint32_t entryoffset = 0;	/* Index offset within sector */
-	uint32_t tmpsector = 0;
-	uint16_t dirPos = 0;
-	
-	while(entNum>=0) {
-		
-		logentsector = dirPos / 16;
-		entryoffset = dirPos % 16;
-
-		if(dirClustNumber==0) {
-			if(dirPos >= bootbuffer.rootdirentries) return false;
-			tmpsector = firstRootDirSect+logentsector;
-			readSector(tmpsector,sectbuf);
-		} else {
-			tmpsector = getAbsoluteSectFromChain(dirClustNumber, logentsector);
-			/* A zero sector number can't happen */
-			if(tmpsector == 0) return false;
-			readSector(tmpsector,sectbuf);
-		}
-		dirPos++;
-
+	/* The clusters the entry refers to go to the disk first */
+	flushFat();
 
+	if (entNum<0) return false;
+	CachedDir *dir = getCachedDir(dirClustNumber);
+	for (int32_t dirPos = 0; dirPos <= entNum; dirPos++) {
+		if (static_cast<size_t>(dirPos) >= dir->numEntries) return false;
 		/* End of directory list */
-		if (sectbuf[entryoffset].entryname[0] == 0x00) return false;
-		--entNum;
-	}
-	if(tmpsector != 0) {
-		copyDirEntry(useEntry, &sectbuf[entryoffset]);
-		writeSector(tmpsector, sectbuf);
-		return true;
-	} else {
-		return false;
+		if (dir->entries[dirPos].entryname[0] == 0x00) return false;
 	}
+
+	copyDirEntry(useEntry, &dir->entries[entNum]);
+	writeSector(dir->sectors[entNum / 16], &dir->entries[(entNum / 16) * 16]);
+	return true;
 }
 
 bool fatDrive::addDirectoryEntry(uint32_t dirClustNumber, direntry useEntry) {
-	direntry sectbuf[16]; /* 16 directory entries per sector */
-	uint32_t logentsector; /* Logical entry sector */
-	uint32_t entryoffset;  /* Index offset within sector */
-	uint32_t tmpsector;
-	uint16_t dirPos = 0;
-	
-	for(;;) {
-		
-		logentsector = dirPos / 16;
-		entryoffset = dirPos % 16;
-
-		if(dirClustNumber==0) {
-			if(dirPos >= bootbuffer.rootdirentries) return false;
-			tmpsector = firstRootDirSect+logentsector;
-			readSector(tmpsector,sectbuf);
-		} else {
-			tmpsector = getAbsoluteSectFromChain(dirClustNumber, logentsector);
-			/* A zero sector number can't happen - we need to allocate more room for this directory*/
-			if(tmpsector == 0) {
-				uint32_t newClust;
-				newClust = appendCluster(dirClustNumber);
-				if(newClust == 0) return false;
-				/* Try again to get tmpsector */
-				tmpsector = getAbsoluteSectFromChain(dirClustNumber, logentsector);
-				if(tmpsector == 0) return false; /* Give up if still can't get more room for directory */
-			}
-			readSector(tmpsector,sectbuf);
+	CachedDir *dir = getCachedDir(dirClustNumber);
+	for (size_t dirPos = 0;; dirPos++) {
+		if (dirPos >= dir->numEntries) {
+			if (dirClustNumber == 0) return false;
+			/* We need to allocate more room for this directory */
+			if (appendCluster(dirClustNumber) == 0) return false;
+			dir = getCachedDir(dirClustNumber);
+			/* Give up if still can't get more room for directory */
+			if (dirPos >= dir->numEntries) return false;
 		}
-		dirPos++;
-
 		/* Deleted file entry or end of directory list */
-		if ((sectbuf[entryoffset].entryname[0] == 0xe5) || (sectbuf[entryoffset].entryname[0] == 0x00)) {
-			copyDirEntry(&useEntry, &sectbuf[entryoffset]);
-			writeSector(tmpsector,sectbuf);
-			break;
+		if ((dir->entries[dirPos].entryname[0] == 0xe5) ||
+		    (dir->entries[dirPos].entryname[0] == 0x00)) {
+			flushFat();
+			copyDirEntry(&useEntry, &dir->entries[dirPos]);
+			writeSector(dir->sectors[dirPos / 16],
+			            &dir->entries[(dirPos / 16) * 16]);
+			return true;
 		}
 	}
-
-	return true;
 }
 
 void fatDrive::zeroOutCluster(uint32_t clustNumber) {
@@ -1445,7 +1503,10 @@ bool fatDrive::MakeDir(char *dir) {
 	zeroOutCluster(dummyClust);
 
 	/* Can we find the base directory? */
-	if(!getDirClustNum(dir, &dirClust, true)) return false;
+	if(!getDirClustNum(dir, &dirClust, true)) {
+		flushFat();
+		return false;
+	}
 	
 	/* Add the new directory to the base directory */
 	memset(&tmpentry,0, sizeof(direntry));
@@ -1521,6 +1582,7 @@ bool fatDrive::RemoveDir(char *dir) {
 			tmpentry.entryname[0] = 0xe5;
 			directoryChange(dirClust, &tmpentry, fileidx);
 			deleteClustChain(dummyClust, 0);
+			flushFat();
 
 			break;
 		}
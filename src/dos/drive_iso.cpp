@@ -18,12 +18,17 @@
 
 #include "drives.h"
 
+#include <algorithm>
 #include <cctype>
+#include <cinttypes>
 #include <cstring>
 
 #include "cdrom.h"
+#include "control.h"
 #include "dos_mscdex.h"
 #include "dos_system.h"
+#include "memory_report.h"
+#include "setup.h"
 #include "string_utils.h"
 #include "support.h"
 
@@ -43,6 +48,8 @@ public:
 	uint16_t GetInformation(void);
 
 private:
+	uint32_t ReadaheadFrom(const uint32_t sector) const;
+
 	isoDrive *drive = nullptr;
 	int cachedSector = -1;
 	uint32_t fileBegin = 0;
@@ -75,7 +82,10 @@ bool isoFile::Read(uint8_t *data, uint16_t *size) {
 	uint32_t sector = filePos / ISO_FRAMESIZE;
 
 	if (static_cast<int>(sector) != cachedSector) {
-		if (drive->readSector(buffer, sector)) {
+		// Read ahead if the program reads on from the previous sector
+		const bool sequential = static_cast<int>(sector) == cachedSector + 1;
+		if (drive->readSector(buffer, sector,
+		                      sequential ? ReadaheadFrom(sector) : 1)) {
 			cachedSector = static_cast<int>(sector);
 		} else {
 			*size = 0;
@@ -95,7 +105,7 @@ bool isoFile::Read(uint8_t *data, uint16_t *size) {
 			sectorPos = 0;
 			sector++;
 			cachedSector++;
-			if (!drive->readSector(buffer, sector)) {
+			if (!drive->readSector(buffer, sector, ReadaheadFrom(sector))) {
 				*size = nowSize;
 				cachedSector = -1;
 			}
@@ -109,6 +119,16 @@ bool isoFile::Read(uint8_t *data, uint16_t *size) {
 	return true;
 }
 
+// The number of sectors to read ahead from the given one, up to the end of
+// the file
+uint32_t isoFile::ReadaheadFrom(const uint32_t sector) const
+{
+	const uint32_t end_sector = (fileEnd + ISO_FRAMESIZE - 1) / ISO_FRAMESIZE;
+	if (sector >= end_sector)
+		return 1;
+	return std::min<uint32_t>(ISO_READAHEAD_SECTORS, end_sector - sector);
+}
+
 bool isoFile::Write(uint8_t* /*data*/, uint16_t* /*size*/) {
 	return false;
 }
@@ -155,9 +175,13 @@ isoDrive::isoDrive(char driveLetter, const char *fileName, uint8_t mediaid, int
 	this->fileName[0]  = '\0';
 	this->discLabel[0] = '\0';
 	memset(dirIterators, 0, sizeof(dirIterators));
-	memset(sectorHashEntries, 0, sizeof(sectorHashEntries));
 	memset(&rootEntry, 0, sizeof(isoDirEntry));
 
+	const auto dos_section = static_cast<Section_prop *>(control->GetSection("dos"));
+	assert(dos_section);
+	sectorCacheSize = static_cast<size_t>(dos_section->Get_int("iso_sector_cache")) *
+	                  1024 / ISO_FRAMESIZE;
+
 	safe_strcpy(this->fileName, fileName);
 	type  = DosDriveType::Iso;
 	error = UpdateMscdex(driveLetter, fileName, subUnit);
@@ -182,7 +206,14 @@ isoDrive::isoDrive(char driveLetter, const char *fileName, uint8_t mediaid, int
 	}
 }
 
-isoDrive::~isoDrive() { }
+isoDrive::~isoDrive()
+{
+	if (driveLetter && (sectorCacheHits || sectorCacheMisses))
+		LOG_MSG("ISO: Drive %c sector cache: %" PRIu64 " hits, %" PRIu64 " misses",
+		        driveLetter, sectorCacheHits, sectorCacheMisses);
+	MEMREPORT_Add(MemoryUser::IsoSectorCache,
+	              -static_cast<int64_t>(sectorCache.size() * sizeof(CachedSector)));
+}
 
 int isoDrive::UpdateMscdex(char drive_letter, const char *path, uint8_t &sub_unit)
 {
@@ -465,26 +496,76 @@ void isoDrive::FreeDirIterator(const int dirIterator) {
 	}
 }
 
-bool isoDrive::ReadCachedSector(uint8_t** buffer, const uint32_t sector) {
-	// get hash table entry
-	int pos = sector % ISO_MAX_HASH_TABLE_SIZE;
-	SectorHashEntry& he = sectorHashEntries[pos];
+// Adds an entry for the sector at the front of the cache, reusing the least
+// recently used one if the cache is full, and returns its data to fill in
+uint8_t *isoDrive::CacheSector(const uint32_t sector)
+{
+	if (sectorCache.size() < sectorCacheSize) {
+		sectorCache.emplace_front();
+		MEMREPORT_Add(MemoryUser::IsoSectorCache, sizeof(CachedSector));
+	} else {
+		sectorCacheIndex.erase(sectorCache.back().sector);
+		sectorCache.splice(sectorCache.begin(), sectorCache,
+		                   std::prev(sectorCache.end()));
+	}
+	auto &entry = sectorCache.front();
+	entry.sector = sector;
+	sectorCacheIndex[sector] = sectorCache.begin();
+	return entry.data;
+}
 
-	// check if the entry is valid and contains the correct sector
-	if (!he.valid || he.sector != sector) {
-		if (!CDROM_Interface_Image::images[subUnit]->ReadSector(he.data, false, sector)) {
-			return false;
+// Points the buffer to the cached sector, reading it on a miss along with
+// the sectors following it, up to the given number of sectors in total
+bool isoDrive::ReadCachedSector(uint8_t **buffer, const uint32_t sector,
+                                const uint32_t readahead)
+{
+	const auto cached = sectorCacheIndex.find(sector);
+	if (cached != sectorCacheIndex.end()) {
+		++sectorCacheHits;
+		sectorCache.splice(sectorCache.begin(), sectorCache, cached->second);
+		*buffer = cached->second->data;
+		return true;
+	}
+	++sectorCacheMisses;
+
+	auto cdrom = CDROM_Interface_Image::images[subUnit];
+
+	// Keep the read ahead from pushing out more than half the cache
+	const auto run = std::min<size_t>(readahead, sectorCacheSize / 2);
+	if (run > 1) {
+		std::vector<uint8_t> data(run * ISO_FRAMESIZE);
+		if (cdrom->ReadSectorsHost(data.data(), false, sector, run)) {
+			// The sector asked for ends up the most recently used
+			for (auto i = run; i-- > 0;) {
+				if (i > 0 && sectorCacheIndex.count(sector + i))
+					continue;
+				memcpy(CacheSector(sector + static_cast<uint32_t>(i)),
+				       data.data() + i * ISO_FRAMESIZE, ISO_FRAMESIZE);
+			}
+			*buffer = sectorCache.front().data;
+			return true;
 		}
-		he.valid = true;
-		he.sector = sector;
 	}
 
-	*buffer = he.data;
+	const auto data = CacheSector(sector);
+	if (!cdrom->ReadSector(data, false, sector)) {
+		sectorCacheIndex.erase(sector);
+		sectorCache.pop_front();
+		MEMREPORT_Add(MemoryUser::IsoSectorCache,
+		              -static_cast<int64_t>(sizeof(CachedSector)));
+		return false;
+	}
+	*buffer = data;
 	return true;
 }
 
-inline bool isoDrive :: readSector(uint8_t *buffer, uint32_t sector) {
-	return CDROM_Interface_Image::images[subUnit]->ReadSector(buffer, false, sector);
+bool isoDrive::readSector(uint8_t *buffer, uint32_t sector, uint32_t readahead)
+{
+	uint8_t *cached_data = nullptr;
+	if (!ReadCachedSector(&cached_data, sector, readahead))
+		return false;
+	memcpy(buffer, cached_data, ISO_FRAMESIZE);
+	return true;
 }
 
 int isoDrive :: readDirEntry(isoDirEntry *de, uint8_t *data) {
@@ -557,28 +638,45 @@ bool isoDrive :: lookup(isoDirEntry *de, const char *path) {
 	strreplace(isoPath, '\\', '/');
 
 	// iterate over all path elements (name), and search each of them in the current de
+	std::string dirPath = {};
 	for(char* name = strtok(isoPath, "/"); NULL != name; name = strtok(NULL, "/")) {
 
-		bool found = false;
 		// current entry must be a directory, abort otherwise
-		if (IS_DIR(FLAGS2)) {
-
-			// remove the trailing dot if present
-			size_t nameLength = strlen(name);
-			if (nameLength > 0) {
-				if (name[nameLength - 1] == '.') name[nameLength - 1] = 0;
-			}
+		if (!IS_DIR(FLAGS2)) return false;
 
-			// look for the current path element
-			int dirIterator = GetDirIterator(de);
-			while (!found && GetNextDirEntry(dirIterator, de)) {
-				if (!IS_ASSOC(FLAGS2) && (0 == strncasecmp((char*) de->ident, name, ISO_MAX_FILENAME_LENGTH))) {
-					found = true;
-				}
-			}
-			FreeDirIterator(dirIterator);
+		// remove the trailing dot if present
+		size_t nameLength = strlen(name);
+		if (nameLength > 0) {
+			if (name[nameLength - 1] == '.') name[nameLength - 1] = 0;
 		}
-		if (!found) return false;
+
+		// look for the current path element in the directory's index
+		if (!indexedDirs.count(dirPath))
+			IndexDir(dirPath, *de);
+		std::string entryName(name, strnlen(name, ISO_MAX_FILENAME_LENGTH));
+		upcase(entryName);
+		dirPath += '/';
+		dirPath += entryName;
+
+		const auto entry = dirIndex.find(dirPath);
+		if (entry == dirIndex.end()) return false;
+		*de = entry->second;
 	}
 	return true;
 }
+
+// Adds the entries of a directory to the index, reading its records once
+void isoDrive::IndexDir(const std::string &dir_path, const isoDirEntry &dir_entry) {
+	isoDirEntry de;
+	const int dirIterator = GetDirIterator(&dir_entry);
+	while (GetNextDirEntry(dirIterator, &de)) {
+		if (IS_ASSOC(FLAGS1)) continue;
+		const auto ident = reinterpret_cast<const char *>(de.ident);
+		std::string entryName(ident, strnlen(ident, ISO_MAX_FILENAME_LENGTH));
+		upcase(entryName);
+		// the first entry with a name wins, as when walking the records
+		dirIndex.emplace(dir_path + '/' + entryName, de);
+	}
+	FreeDirIterator(dirIterator);
+	indexedDirs.insert(dir_path);
+}
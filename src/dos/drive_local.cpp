@@ -26,12 +26,18 @@
 
 #include <cerrno>
 #include <climits>
+#include <condition_variable>
 #include <cstdio>
 #include <ctime>
+#include <deque>
+#include <functional>
 #include <limits>
+#include <mutex>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <thread>
+#include <unordered_map>
 
 #ifdef _MSC_VER
 #include <sys/utime.h>
@@ -39,12 +45,191 @@
 #include <utime.h>
 #endif
 
+#include "control.h"
 #include "dos_inc.h"
 #include "dos_mscdex.h"
 #include "fs_utils.h"
+#include "setup.h"
 #include "string_utils.h"
 #include "cross.h"
 #include "inout.h"
+#include "timer.h"
+
+// Host handle reuse
+// ~~~~~~~~~~~~~~~~~
+// Some games open and close the same files many times a second. Handles that
+// were opened for reading stay open for a moment after the file is closed,
+// indexed by host path, so opening the file again soon after skips the host.
+// Anything that changes a local drive's files closes the kept handles, which
+// also lets Windows remove or rename the files.
+constexpr int64_t kept_handle_ms = 2000;
+constexpr size_t max_kept_handles = 16;
+
+struct KeptHandle {
+	FILE *handle = nullptr;
+	int64_t closed_at = 0;
+};
+static std::unordered_multimap<std::string, KeptHandle> kept_handles = {};
+
+static void close_expired_handles()
+{
+	const auto now = GetTicks();
+	for (auto it = kept_handles.begin(); it != kept_handles.end();) {
+		if (now - it->second.closed_at < kept_handle_ms) {
+			++it;
+			continue;
+		}
+		fclose(it->second.handle);
+		it = kept_handles.erase(it);
+	}
+	if (kept_handles.empty())
+		TIMER_DelTickHandler(close_expired_handles);
+}
+
+static void close_kept_handles()
+{
+	if (kept_handles.empty())
+		return;
+	for (const auto &[host_path, kept] : kept_handles)
+		fclose(kept.handle);
+	kept_handles.clear();
+	TIMER_DelTickHandler(close_expired_handles);
+}
+
+static void keep_handle(const std::string &host_path, FILE *handle)
+{
+	if (kept_handles.size() >= max_kept_handles) {
+		auto oldest = kept_handles.begin();
+		for (auto it = kept_handles.begin(); it != kept_handles.end(); ++it)
+			if (it->second.closed_at < oldest->second.closed_at)
+				oldest = it;
+		fclose(oldest->second.handle);
+		kept_handles.erase(oldest);
+	}
+	if (kept_handles.empty())
+		TIMER_AddTickHandler(close_expired_handles);
+	kept_handles.emplace(host_path, KeptHandle{handle, GetTicks()});
+}
+
+static FILE *take_kept_handle(const std::string &host_path)
+{
+	const auto it = kept_handles.find(host_path);
+	if (it == kept_handles.end())
+		return nullptr;
+	FILE *handle = it->second.handle;
+	kept_handles.erase(it);
+	if (kept_handles.empty())
+		TIMER_DelTickHandler(close_expired_handles);
+
+	// Start from the beginning, dropping anything the stream buffered
+	if (fseek(handle, 0, SEEK_SET) != 0) {
+		fclose(handle);
+		return nullptr;
+	}
+	return handle;
+}
+
+// Write-behind
+// ~~~~~~~~~~~~
+// With write_behind set, the files on local drives hand their writes and
+// closes to a background thread, which carries them out in the order they
+// were queued. A file waits for its own queued writes before it reads, moves
+// its stream or asks the host about itself, and the drive functions wait for
+// all of them, so DOS sees the same sizes, positions and dates as without the
+// queue. The queue is bounded, so a program writing faster than the host
+// can keep up ends up waiting for it.
+constexpr size_t max_queued_writes = 256;
+
+class WriteBehindQueue {
+public:
+	WriteBehindQueue() : worker(&WriteBehindQueue::Run, this) {}
+	~WriteBehindQueue();
+
+	// Returns the job's number, to wait for it with
+	uint64_t Add(std::function<void()> job);
+	void WaitFor(uint64_t job_number);
+	void WaitForAll();
+
+private:
+	WriteBehindQueue(const WriteBehindQueue &) = delete;
+	WriteBehindQueue &operator=(const WriteBehindQueue &) = delete;
+
+	void Run();
+
+	std::mutex mutex = {};
+	std::condition_variable has_jobs = {};
+	std::condition_variable has_finished = {};
+	std::deque<std::function<void()>> jobs = {};
+	uint64_t num_added = 0;
+	uint64_t num_finished = 0;
+	bool is_stopping = false;
+	std::thread worker; // started last, once the rest is set up
+};
+
+WriteBehindQueue::~WriteBehindQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		is_stopping = true;
+	}
+	has_jobs.notify_one();
+	worker.join();
+}
+
+uint64_t WriteBehindQueue::Add(std::function<void()> job)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	has_finished.wait(lock, [this] { return jobs.size() < max_queued_writes; });
+	jobs.push_back(std::move(job));
+	const auto job_number = ++num_added;
+	lock.unlock();
+	has_jobs.notify_one();
+	return job_number;
+}
+
+void WriteBehindQueue::WaitFor(const uint64_t job_number)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	has_finished.wait(lock, [&] { return num_finished >= job_number; });
+}
+
+void WriteBehindQueue::WaitForAll()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	has_finished.wait(lock, [this] { return num_finished == num_added; });
+}
+
+void WriteBehindQueue::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		has_jobs.wait(lock, [this] { return !jobs.empty() || is_stopping; });
+		if (jobs.empty())
+			return;
+		auto job = std::move(jobs.front());
+		jobs.pop_front();
+		lock.unlock();
+		job();
+		lock.lock();
+		++num_finished;
+		has_finished.notify_all();
+	}
+}
+
+static std::unique_ptr<WriteBehindQueue> write_behind_queue = {};
+
+static uint64_t queue_write_behind(std::function<void()> job)
+{
+	if (!write_behind_queue)
+		write_behind_queue = std::make_unique<WriteBehindQueue>();
+	return write_behind_queue->Add(std::move(job));
+}
+
+static void wait_for_write_behind()
+{
+	if (write_behind_queue)
+		write_behind_queue->WaitForAll();
+}
 
 bool localDrive::FileCreate(DOS_File * * file,char * name,uint16_t /*attributes*/) {
 //TODO Maybe care for attributes but not likely
@@ -53,6 +238,8 @@ bool localDrive::FileCreate(DOS_File * * file,char * name,uint16_t /*attributes*
 	safe_strcat(newname, name);
 	CROSS_FILENAME(newname);
 	char* temp_name = dirCache.GetExpandName(newname); //Can only be used in till a new drive_cache action is preformed */
+	wait_for_write_behind();
+	close_kept_handles();
 	/* Test if file exists (so we need to truncate it). don't add to dirCache then */
 	bool existing_file = false;
 	
@@ -71,8 +258,11 @@ bool localDrive::FileCreate(DOS_File * * file,char * name,uint16_t /*attributes*
    
 	if (!existing_file) dirCache.AddEntry(newname, true);
 	/* Make the 16 bit device information */
-	*file = new localFile(name, hand, basedir);
-	(*file)->flags=OPEN_READWRITE;
+	auto local_file = new localFile(name, hand, basedir);
+	local_file->flags = OPEN_READWRITE;
+	if (write_behind)
+		local_file->EnableWriteBehind();
+	*file = local_file;
 
 	return true;
 }
@@ -127,13 +317,24 @@ bool localDrive::FileOpen(DOS_File **file, char *name, uint32_t flags)
 	CROSS_FILENAME(newname);
 	dirCache.ExpandName(newname);
 
+	// Other handles to the file see its queued writes
+	wait_for_write_behind();
+
 	// If the file's already open then flush it before continuing
 	// (Betrayal in Antara)
 	auto open_file = dynamic_cast<localFile *>(FindOpenFile(this, name));
 	if (open_file)
 		open_file->Flush();
 
-	FILE* fhandle = fopen(newname, type);
+	const bool is_read_only = (strcmp(type, "rb") == 0);
+	FILE *fhandle = is_read_only ? take_kept_handle(newname) : nullptr;
+	if (!fhandle) {
+		// Writes can't be mixed with kept handles on the same file
+		if (!is_read_only)
+			close_kept_handles();
+		fhandle = fopen(newname, type);
+	}
+	const bool is_opened_as_requested = (fhandle != nullptr);
 
 #ifdef DEBUG
 	std::string open_msg;
@@ -190,8 +391,13 @@ bool localDrive::FileOpen(DOS_File **file, char *name, uint32_t flags)
 #endif
 
 	if (fhandle) {
-		*file = new localFile(name, fhandle, basedir);
-		(*file)->flags = flags;  // for the inheritance flag and maybe check for others.
+		auto local_file = new localFile(name, fhandle, basedir);
+		local_file->flags = flags; // for the inheritance flag and maybe check for others.
+		if (is_read_only)
+			local_file->KeepHandleOnClose(newname);
+		else if (write_behind && is_opened_as_requested)
+			local_file->EnableWriteBehind();
+		*file = local_file;
 	} else {
 		// Otherwise we really can't open the file.
 		DOS_SetError(DOSERR_INVALID_HANDLE);
@@ -207,6 +413,9 @@ FILE * localDrive::GetSystemFilePtr(char const * const name, char const * const
 	CROSS_FILENAME(newname);
 	dirCache.ExpandName(newname);
 
+	wait_for_write_behind();
+	if (strcmp(type, "rb") != 0)
+		close_kept_handles();
 	return fopen_wrap(newname,type);
 }
 
@@ -216,6 +425,7 @@ bool localDrive::GetSystemFilename(char *sysName, char const * const dosName) {
 	strcat(sysName, dosName);
 	CROSS_FILENAME(sysName);
 	dirCache.ExpandName(sysName);
+	wait_for_write_behind();
 	return true;
 }
 
@@ -233,10 +443,12 @@ bool localDrive::FileUnlink(char * name) {
 	safe_strcat(newname, name);
 	CROSS_FILENAME(newname);
 	const char *fullname = dirCache.GetExpandName(newname);
+	wait_for_write_behind();
+	close_kept_handles();
 
 	// Can we remove the file without issue?
 	if (remove(fullname) == 0) {
-		dirCache.DeleteEntry(newname);
+		dirCache.UpdateEntry(newname);
 		return true;
 	}
 
@@ -253,7 +465,7 @@ bool localDrive::FileUnlink(char * name) {
 		}
 		// and try removing it again.
 		if (remove(fullname) == 0) {
-			dirCache.DeleteEntry(newname);
+			dirCache.UpdateEntry(newname);
 			return true;
 		}
 	}
@@ -268,6 +480,9 @@ bool localDrive::FindFirst(char * _dir,DOS_DTA & dta,bool fcb_findfirst) {
 	safe_strcat(tempDir, _dir);
 	CROSS_FILENAME(tempDir);
 
+	// The sizes and dates found include the queued writes
+	wait_for_write_behind();
+
 	if (allocation.mediaid==0xF0) {
 		EmptyCache(); //rescan floppie-content on each findfirst
 	}
@@ -276,16 +491,17 @@ bool localDrive::FindFirst(char * _dir,DOS_DTA & dta,bool fcb_findfirst) {
 	if (tempDir[strlen(tempDir) - 1] != CROSS_FILESPLIT)
 		safe_strcat(tempDir, end);
 
+	uint8_t sAttr;
+	char pattern[DOS_NAMELENGTH_ASCII];
+	dta.GetSearchParams(sAttr, pattern);
+
 	uint16_t id;
-	if (!dirCache.FindFirst(tempDir,id)) {
+	if (!dirCache.FindFirst(tempDir, pattern, id)) {
 		DOS_SetError(DOSERR_PATH_NOT_FOUND);
 		return false;
 	}
 	safe_strcpy(srchInfo[id].srch_dir, tempDir);
 	dta.SetDirID(id);
-	
-	uint8_t sAttr;
-	dta.GetSearchParams(sAttr,tempDir);
 
 	if (this->isRemote() && this->isRemovable()) {
 		// cdroms behave a bit different than regular drives
@@ -307,7 +523,7 @@ bool localDrive::FindFirst(char * _dir,DOS_DTA & dta,bool fcb_findfirst) {
 		} else if ((sAttr & DOS_ATTR_VOLUME)  && (*_dir == 0) && !fcb_findfirst) { 
 		//should check for a valid leading directory instead of 0
 		//exists==true if the volume label matches the searchmask and the path is valid
-			if (WildFileCmp(dirCache.GetLabel(),tempDir)) {
+			if (WildFileCmp(dirCache.GetLabel(), pattern)) {
 				dta.SetResult(dirCache.GetLabel(),0,0,0,DOS_ATTR_VOLUME);
 				return true;
 			}
@@ -330,11 +546,11 @@ bool localDrive::FindNext(DOS_DTA & dta) {
 	uint16_t id = dta.GetDirID();
 
 again:
+	// Only the entries matching the pattern are found
 	if (!dirCache.FindNext(id,dir_ent)) {
 		DOS_SetError(DOSERR_NO_MORE_FILES);
 		return false;
 	}
-	if (!WildFileCmp(dir_ent,srch_pattern)) goto again;
 
 	safe_strcpy(full_name, srchInfo[id].srch_dir);
 	safe_strcat(full_name, dir_ent);
@@ -468,7 +684,7 @@ bool localDrive::MakeDir(char * dir) {
 	CROSS_FILENAME(newdir);
 	const int temp = create_dir(dirCache.GetExpandName(newdir), 0775);
 	if (temp == 0)
-		dirCache.CacheOut(newdir, true);
+		dirCache.UpdateEntry(newdir);
 	return (temp==0);// || ((temp!=0) && (errno==EEXIST));
 }
 
@@ -477,8 +693,10 @@ bool localDrive::RemoveDir(char * dir) {
 	safe_strcpy(newdir, basedir);
 	safe_strcat(newdir, dir);
 	CROSS_FILENAME(newdir);
+	wait_for_write_behind();
+	close_kept_handles();
 	int temp=rmdir(dirCache.GetExpandName(newdir));
-	if (temp==0) dirCache.DeleteEntry(newdir,true);
+	if (temp==0) dirCache.UpdateEntry(newdir);
 	return (temp==0);
 }
 
@@ -504,14 +722,20 @@ bool localDrive::Rename(char * oldname,char * newname) {
 	safe_strcpy(newold, basedir);
 	safe_strcat(newold, oldname);
 	CROSS_FILENAME(newold);
-	dirCache.ExpandName(newold);
-	
+	char hostold[CROSS_LEN];
+	safe_strcpy(hostold, dirCache.GetExpandName(newold));
+
 	char newnew[CROSS_LEN];
 	safe_strcpy(newnew, basedir);
 	safe_strcat(newnew, newname);
 	CROSS_FILENAME(newnew);
-	int temp=rename(newold,dirCache.GetExpandName(newnew));
-	if (temp==0) dirCache.CacheOut(newnew);
+	wait_for_write_behind();
+	close_kept_handles();
+	int temp=rename(hostold,dirCache.GetExpandName(newnew));
+	if (temp==0) {
+		dirCache.UpdateEntry(newold);
+		dirCache.UpdateEntry(newnew);
+	}
 	return (temp==0);
 
 }
@@ -542,6 +766,7 @@ bool localDrive::FileStat(const char* name, FileStat_Block * const stat_block) {
 	safe_strcat(newname, name);
 	CROSS_FILENAME(newname);
 	dirCache.ExpandName(newname);
+	wait_for_write_behind();
 	struct stat temp_stat;
 	if (stat(newname,&temp_stat)!=0) return false;
 	/* Convert the stat to a FileStat */
@@ -570,6 +795,8 @@ bool localDrive::isRemovable(void) {
 }
 
 Bits localDrive::UnMount(void) { 
+	wait_for_write_behind();
+	close_kept_handles();
 	delete this;
 	return 0; 
 }
@@ -591,6 +818,11 @@ localDrive::localDrive(const char * startdir,
 	safe_strcpy(basedir, startdir);
 	safe_strcpy(info, startdir);
 	dirCache.SetBaseDir(basedir);
+	dirCache.PrefetchDirs();
+
+	const auto dos_section = static_cast<Section_prop *>(control->GetSection("dos"));
+	assert(dos_section);
+	write_behind = dos_section->Get_bool("write_behind");
 }
 
 // Updates the internal file's current position
@@ -627,6 +859,56 @@ void localFile::fseek_and_check(int whence)
 	static_cast<void>(fseek_to_and_check(stream_pos, whence));
 }
 
+// Read-ahead
+// ~~~~~~~~~~
+// Games tend to read their files in small pieces, one after the other. Once
+// a read carries on where the previous one ended, the file is read 64 KB at
+// a time into a buffer that serves the reads that follow, straight from the
+// file descriptor and at the tracked position, so the reads don't seek the
+// stream. Larger and random reads go straight to the caller. Writing to any
+// local file drops the buffers, as the file could be open more than once.
+constexpr size_t read_ahead_size = 64 * 1024;
+static uint32_t local_file_writes = 0;
+
+uint16_t localFile::read_buffered(uint8_t *data, const uint16_t requested)
+{
+	const bool is_sequential = (stream_pos == next_read_pos);
+	if (read_ahead_writes != local_file_writes)
+		read_ahead_bytes = 0;
+
+	size_t done = 0;
+	const auto buffer_end = read_ahead_pos + static_cast<long>(read_ahead_bytes);
+	if (stream_pos >= read_ahead_pos && stream_pos < buffer_end) {
+		const auto offset = static_cast<size_t>(stream_pos - read_ahead_pos);
+		done = std::min(static_cast<size_t>(requested), read_ahead_bytes - offset);
+		memcpy(data, read_ahead.data() + offset, done);
+	}
+
+	const auto pos = stream_pos + static_cast<long>(done);
+	const auto remaining = requested - done;
+	if (remaining && is_sequential && remaining < read_ahead_size / 4) {
+		if (read_ahead.empty()) {
+			read_ahead.resize(read_ahead_size);
+			advise_sequential_reads(fhandle);
+		}
+		const auto bytes = read_file_at(fhandle, read_ahead.data(),
+		                                read_ahead_size, pos);
+		read_ahead_pos = pos;
+		read_ahead_bytes = bytes > 0 ? static_cast<size_t>(bytes) : 0;
+		read_ahead_writes = local_file_writes;
+
+		const auto from_buffer = std::min(remaining, read_ahead_bytes);
+		memcpy(data + done, read_ahead.data(), from_buffer);
+		done += from_buffer;
+	} else if (remaining) {
+		const auto bytes = read_file_at(fhandle, data + done, remaining, pos);
+		if (bytes > 0)
+			done += static_cast<size_t>(bytes);
+	}
+	next_read_pos = stream_pos + static_cast<long>(done);
+	return static_cast<uint16_t>(done);
+}
+
 //TODO Maybe use fflush, but that seemed to fuck up in visual c
 bool localFile::Read(uint8_t *data, uint16_t *size)
 {
@@ -636,14 +918,20 @@ bool localFile::Read(uint8_t *data, uint16_t *size)
 		return false;
 	}
 
-	// Seek if we last wrote
-	if (last_action == WRITE)
-		if (ftell_and_check())
-			fseek_and_check(SEEK_SET);
+	wait_for_queued_writes();
+
+	// Reads track the position themselves, leaving the stream behind
+	// until the next write or seek
+	if (last_action != READ) {
+		if (last_action == WRITE)
+			fflush(fhandle);
+		static_cast<void>(ftell_and_check());
+	}
 
 	last_action = READ;
 	const auto requested = *size;
-	const auto actual = static_cast<uint16_t>(fread(data, 1, requested, fhandle));
+	const auto actual = read_buffered(data, requested);
+	stream_pos += actual;
 	*size = actual; // always save the actual
 
 	// if (actual != requested)
@@ -668,10 +956,32 @@ bool localFile::Write(uint8_t *data, uint16_t *size)
 		return false;
 	}
 
-	// Seek if we last read
+	++local_file_writes;
+
+	// Queued writes go to the tracked position, leaving the stream behind
+	if (write_behind && *size) {
+		if (last_action == WRITE)
+			fflush(fhandle);
+		if (last_action != READ)
+			static_cast<void>(ftell_and_check());
+		const auto pos = stream_pos;
+		last_queued_write = queue_write_behind(
+		        [handle = fhandle, bytes = std::vector<uint8_t>(data, data + *size),
+		         pos, file_name = name] {
+			        if (!write_file_at(handle, bytes.data(), bytes.size(), pos))
+				        LOG_WARNING("FS: Failed writing %u bytes to file %s",
+				                    static_cast<unsigned>(bytes.size()),
+				                    file_name.c_str());
+		        });
+		stream_pos += *size;
+		last_action = READ;
+		return true;
+	}
+	wait_for_queued_writes();
+
+	// Catch the stream up if we last read
 	if (last_action == READ)
-		if (ftell_and_check())
-			fseek_and_check(SEEK_SET);
+		fseek_and_check(SEEK_SET);
 
 	last_action = WRITE;
 
@@ -704,6 +1014,20 @@ bool localFile::Write(uint8_t *data, uint16_t *size)
 	return true;    // always return true, even if partially written
 }
 
+// Files on the host are read and written straight from RAM, as long as the
+// guest's buffer is contiguous on the host
+bool localFile::ReadToMem(const PhysPt pt, uint16_t *size)
+{
+	const auto data = MEM_GetHostBlock(pt, *size, true);
+	return data ? Read(data, size) : DOS_File::ReadToMem(pt, size);
+}
+
+bool localFile::WriteFromMem(const PhysPt pt, uint16_t *size)
+{
+	const auto data = MEM_GetHostBlock(pt, *size, false);
+	return data ? Write(data, size) : DOS_File::WriteFromMem(pt, size);
+}
+
 bool localFile::Seek(uint32_t *pos_addr, uint32_t type)
 {
 	int seektype;
@@ -720,19 +1044,25 @@ bool localFile::Seek(uint32_t *pos_addr, uint32_t type)
 	// uint32_t* pointer (pos_addr), so reinterpret the underlying memory as
 	// such to prevent rollover into the unsigned range.
 	const auto pos = *reinterpret_cast<int32_t *>(pos_addr);
-	if (!fseek_to_and_check(pos, seektype)) {
-		// Failed to seek, but try again this time seeking to
-		// the end of file, which satisfies Black Thorne.
-		stream_pos = 0;
-		fseek_and_check(SEEK_END);
-	}
-#if 0
-	fpos_t temppos;
-	fgetpos(fhandle,&temppos);
-	uint32_t * fake_pos=(uint32_t*)&temppos;
-	*pos_addr = *fake_pos;
-#endif
-	static_cast<void>(ftell_and_check());
+
+	// Seeks between reads only move the read position, so the reads can
+	// carry on from the read-ahead buffer
+	const auto read_target = (seektype == SEEK_SET) ? pos : stream_pos + pos;
+	if (last_action == READ && seektype != SEEK_END && read_target >= 0) {
+		stream_pos = read_target;
+	} else {
+		wait_for_queued_writes();
+		if (last_action == READ)
+			fseek_and_check(SEEK_SET);
+		if (!fseek_to_and_check(pos, seektype)) {
+			// Failed to seek, but try again this time seeking to
+			// the end of file, which satisfies Black Thorne.
+			stream_pos = 0;
+			fseek_and_check(SEEK_END);
+		}
+		static_cast<void>(ftell_and_check());
+		last_action = NONE;
+	}
 
 	// The inbound position is actually an int32_t being passed through a
 	// uint32_t* pointer (pos_addr), so before we save the seeked position
@@ -742,51 +1072,89 @@ bool localFile::Seek(uint32_t *pos_addr, uint32_t type)
 	assert(stream_pos >= std::numeric_limits<int32_t>::min() &&
 	       stream_pos <= std::numeric_limits<int32_t>::max());
 	*reinterpret_cast<int32_t *>(pos_addr) = static_cast<int32_t>(stream_pos);
-
-	last_action = NONE;
 	return true;
 }
 
+static bool set_host_file_time(const char *fullname, const uint16_t date,
+                               const uint16_t time)
+{
+	// backport from DOS_PackDate() and DOS_PackTime()
+	struct tm tim = {};
+	tim.tm_sec = (time & 0x1f) * 2;
+	tim.tm_min = (time >> 5) & 0x3f;
+	tim.tm_hour = (time >> 11) & 0x1f;
+	tim.tm_mday = date & 0x1f;
+	tim.tm_mon = ((date >> 5) & 0x0f) - 1;
+	tim.tm_year = (date >> 9) + 1980 - 1900;
+	//  have the C run-time library code compute whether standard
+	//  time or daylight saving time is in effect.
+	tim.tm_isdst = -1;
+	// serialize time
+	mktime(&tim);
+
+	utimbuf ftim;
+	ftim.actime = ftim.modtime = mktime(&tim);
+
+	// FIXME: utime is deprecated, need a modern cross-platform
+	// implementation.
+	return utime(fullname, &ftim) == 0;
+}
+
 bool localFile::Close() {
+	char fullname[CROSS_LEN];
+	safe_sprintf(fullname, "%s%s", basedir, name.c_str());
+	CROSS_FILENAME(fullname);
+
+	// Files with queued writes are closed after them, on the same thread
+	if (refCtr == 1 && write_behind && fhandle) {
+		queue_write_behind([handle = fhandle, host_name = std::string(fullname),
+		                    file_date = date, file_time = time,
+		                    has_newtime = newtime] {
+			fclose(handle);
+			if (has_newtime && !set_host_file_time(host_name.c_str(),
+			                                       file_date, file_time))
+				LOG_WARNING("FS: Failed setting the date of file %s",
+				            host_name.c_str());
+		});
+		last_queued_write = 0;
+		fhandle = nullptr;
+		open = false;
+		return true;
+	}
+	wait_for_queued_writes();
+
 	// only close if one reference left
 	if (refCtr==1) {
-		if (fhandle) fclose(fhandle);
+		if (fhandle && fhandle == kept_handle && !newtime)
+			keep_handle(kept_host_path, fhandle);
+		else if (fhandle)
+			fclose(fhandle);
 		fhandle = 0;
 		open = false;
 	};
 
-	if (newtime) {
-		// backport from DOS_PackDate() and DOS_PackTime()
-		struct tm tim = {};
-		tim.tm_sec = (time & 0x1f) * 2;
-		tim.tm_min = (time >> 5) & 0x3f;
-		tim.tm_hour = (time >> 11) & 0x1f;
-		tim.tm_mday = date & 0x1f;
-		tim.tm_mon = ((date >> 5) & 0x0f) - 1;
-		tim.tm_year = (date >> 9) + 1980 - 1900;
-		//  have the C run-time library code compute whether standard
-		//  time or daylight saving time is in effect.
-		tim.tm_isdst = -1;
-		// serialize time
-		mktime(&tim);
-
-		utimbuf ftim;
-		ftim.actime = ftim.modtime = mktime(&tim);
-
-		char fullname[CROSS_LEN];
-		safe_sprintf(fullname, "%s%s", basedir, name.c_str());
-		CROSS_FILENAME(fullname);
-
-		// FIXME: utime is deprecated, need a modern cross-platform
-		// implementation.
-		if (utime(fullname, &ftim)) {
-			return false;
-		}
-	}
+	if (newtime && !set_host_file_time(fullname, date, time))
+		return false;
 
 	return true;
 }
 
+void localFile::wait_for_queued_writes()
+{
+	if (!last_queued_write)
+		return;
+	write_behind_queue->WaitFor(last_queued_write);
+	last_queued_write = 0;
+}
+
+// Closing the file keeps its handle open for a moment, to be reused by the
+// next open of the same host path
+void localFile::KeepHandleOnClose(const std::string &host_path)
+{
+	kept_handle = fhandle;
+	kept_host_path = host_path;
+}
+
 uint16_t localFile::GetInformation(void) {
 	return read_only_medium?0x40:0;
 }
@@ -809,6 +1177,7 @@ bool localFile::UpdateDateTimeFromHost()
 {
 	if (!open)
 		return false;
+	wait_for_queued_writes();
 
 	// Legal defaults if we're unable to populate them
 	time = 1;
@@ -833,6 +1202,14 @@ bool localFile::UpdateDateTimeFromHost()
 
 void localFile::Flush()
 {
+	wait_for_queued_writes();
+
+	// Bring the stream back to the position the reads left off at
+	if (last_action == READ) {
+		fseek_and_check(SEEK_SET);
+		last_action = NONE;
+		return;
+	}
 	if (last_action != WRITE)
 		return;
 
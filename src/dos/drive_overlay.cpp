@@ -65,11 +65,10 @@ using namespace std;
 //TODO Check: Maybe handle file redirection in ccc (opening the new file), (call update datetime host there ?)
 
 
-/* For rename/delete(unlink)/makedir/removedir we need to rebuild the cache. (shouldn't be needed, 
- * but cacheout/delete entry currently throw away the cached folder and rebuild it on read. 
- * so we have to ensure the rebuilding is controlled through the overlay.
- * In order to not reread the overlay directory contents, the information in there is cached and updated when
- * it changes (when deleting a file or adding one)
+/* For rename/delete(unlink)/makedir/removedir only the entry involved is added to or removed from the
+ * drive_cache, as throwing away the cached folder would lose the overlay entries in it.
+ * The overlay directory contents are read once, by update_cache, and the information in there is
+ * cached and updated when it changes (when deleting a file or adding one)
  */
 
 
@@ -94,12 +93,7 @@ bool Overlay_Drive::RemoveDir(char * dir) {
 		int temp = rmdir(odir);
 		if (temp == 0) {
 			remove_DOSdir_from_cache(dir);
-			char newdir[CROSS_LEN];
-			safe_strcpy(newdir, basedir);
-			safe_strcat(newdir, dir);
-			CROSS_FILENAME(newdir);
-			dirCache.DeleteEntry(newdir,true);
-			update_cache(false);
+			remove_overlay_entry_from_cache(dir);
 		}
 		return (temp == 0);
 	} else {
@@ -264,6 +258,9 @@ bool OverlayFile::create_copy() {
 	//ensure file position
 	if (logoverlay) LOG_MSG("create_copy called %s",GetName());
 
+	// Catch the stream up with the reads
+	Flush();
+
 	FILE* lhandle = this->fhandle;
 	assert(lhandle);
 
@@ -358,6 +355,10 @@ Overlay_Drive::Overlay_Drive(const char *startdir,
           DOSdirs_cache{},
           special_prefix("DBOVERLAY")
 {
+	// The cache holds the overlay's entries too, which the host changes
+	// of the base directory can't be applied to
+	dirCache.SetWatchHost(false);
+
 	//Currently this flag does nothing, as the current behavior is to not reread due to caching everything.
 #if defined (WIN32)	
 	if (strcasecmp(startdir,overlay) == 0) {
@@ -389,7 +390,7 @@ Overlay_Drive::Overlay_Drive(const char *startdir,
 	//add_deleted_path(dirname); //update_cache will add the overlap_folder
 	overlap_folder = dirname;
 
-	update_cache(true);
+	update_cache();
 }
 
 void Overlay_Drive::convert_overlay_to_DOSname_in_base(char* dirname ) 
@@ -527,27 +528,33 @@ bool Overlay_Drive::FileCreate(DOS_File * * file,char * name,uint16_t /*attribut
 	of->overlay_active = true;
 	of->flags = OPEN_READWRITE;
 	*file = of;
-	//create fake name for the drive cache
-	char fakename[CROSS_LEN];
-	safe_strcpy(fakename, overlaydir);
-	safe_strcat(fakename, name);
-	CROSS_FILENAME(fakename);
-	dirCache.AddEntry(fakename,true); //add it.
+	add_overlay_entry_to_cache(name);
 	add_DOSname_to_cache(name);
 	remove_deleted_file(name,true);
 	return true;
 }
 void Overlay_Drive::add_DOSname_to_cache(const char* name) {
-	for (std::vector<std::string>::const_iterator itc = DOSnames_cache.begin(); itc != DOSnames_cache.end(); ++itc){
-		if (name == (*itc)) return;
-	}
-	DOSnames_cache.push_back(name);
+	DOSnames_cache.insert(name);
 }
 void Overlay_Drive::remove_DOSname_from_cache(const char* name) {
-	for (std::vector<std::string>::iterator it = DOSnames_cache.begin(); it != DOSnames_cache.end(); ++it) {
-		if (name == (*it)) { DOSnames_cache.erase(it); return;}
-	}
+	DOSnames_cache.erase(name);
+}
 
+//Add or remove the fake entry of an overlay file or directory in the drive_cache,
+//leaving the rest of its directory as it is.
+void Overlay_Drive::add_overlay_entry_to_cache(const char* name) {
+	char fakename[CROSS_LEN];
+	safe_strcpy(fakename, basedir);
+	safe_strcat(fakename, name);
+	CROSS_FILENAME(fakename);
+	dirCache.AddEntry(fakename,true);
+}
+void Overlay_Drive::remove_overlay_entry_from_cache(const char* name) {
+	char fakename[CROSS_LEN];
+	safe_strcpy(fakename, basedir);
+	safe_strcat(fakename, name);
+	CROSS_FILENAME(fakename);
+	dirCache.RemoveEntry(fakename);
 }
 
 bool Overlay_Drive::Sync_leading_dirs(const char* dos_filename){
@@ -595,20 +602,18 @@ bool Overlay_Drive::Sync_leading_dirs(const char* dos_filename){
 
 	return true;
 }
-void Overlay_Drive::update_cache(bool read_directory_contents) {
+void Overlay_Drive::update_cache() {
 	const auto a = logoverlay ? GetTicks() : 0;
 	std::vector<std::string> specials;
 	std::vector<std::string> dirnames;
 	std::vector<std::string> filenames;
-	if (read_directory_contents) {
-		//Clear all lists
-		DOSnames_cache.clear();
-		DOSdirs_cache.clear();
-		deleted_files_in_base.clear();
-		deleted_paths_in_base.clear();
-		//Ensure hiding of the folder that contains the overlay, if it is part of the base folder.
-		add_deleted_path(overlap_folder.c_str(), false);
-	}
+	//Clear all lists
+	DOSnames_cache.clear();
+	DOSdirs_cache.clear();
+	deleted_files_in_base.clear();
+	deleted_paths_in_base.clear();
+	//Ensure hiding of the folder that contains the overlay, if it is part of the base folder.
+	add_deleted_path(overlap_folder.c_str(), false);
 
 	//Needs later to support stored renames and removals of files existing in the localDrive plane.
 	//and by taking in account if the file names are actually already renamed. 
@@ -626,157 +631,146 @@ void Overlay_Drive::update_cache(bool read_directory_contents) {
 
 	//Random TODO: Does the root drive under DOS have . and .. ? 
 
-	//This function needs to be called after any localDrive function calling cacheout/deleteentry, as those throw away directories.
-	//either do this with a parameter stating the part that needs to be rebuild,(directory) or clear the cache by default and do it all.
+	//This function reads the whole overlay, so it's only called on mounting and when the cache is emptied.
+	//Other changes update the lists and the drive_cache entries they involve.
 
 	std::vector<std::string>::iterator i;
 	std::string::size_type const prefix_lengh = special_prefix.length();
-	if (read_directory_contents) {
-		dir_information* dirp = open_directory(overlaydir);
-		if (dirp == NULL) return;
-		// Read complete directory
-		char dir_name[CROSS_LEN];
-		bool is_directory;
-		if (read_directory_first(dirp, dir_name, is_directory)) {
+	dir_information* dirp = open_directory(overlaydir);
+	if (dirp == NULL) return;
+	// Read complete directory
+	char dir_name[CROSS_LEN];
+	bool is_directory;
+	if (read_directory_first(dirp, dir_name, is_directory)) {
+		if ((safe_strlen(dir_name) > prefix_lengh+5) && strncmp(dir_name,special_prefix.c_str(),prefix_lengh) == 0) specials.push_back(dir_name);
+		else if (is_directory) dirnames.push_back(dir_name);
+		else filenames.push_back(dir_name);
+		while (read_directory_next(dirp, dir_name, is_directory)) {
 			if ((safe_strlen(dir_name) > prefix_lengh+5) && strncmp(dir_name,special_prefix.c_str(),prefix_lengh) == 0) specials.push_back(dir_name);
 			else if (is_directory) dirnames.push_back(dir_name);
 			else filenames.push_back(dir_name);
-			while (read_directory_next(dirp, dir_name, is_directory)) {
-				if ((safe_strlen(dir_name) > prefix_lengh+5) && strncmp(dir_name,special_prefix.c_str(),prefix_lengh) == 0) specials.push_back(dir_name);
-				else if (is_directory) dirnames.push_back(dir_name);
-				else filenames.push_back(dir_name);
-			}
 		}
-		close_directory(dirp);
-		dirp = nullptr;
-
-		// parse directories to add them.
-		for (i = dirnames.begin(); i != dirnames.end(); ++i) {
-			if ((*i) == ".") continue;
-			if ((*i) == "..") continue;
-			std::string testi(*i);
-			std::string::size_type ll = testi.length();
-			//TODO: Use the dirname\. and dirname\.. for creating fake directories in the driveCache.
-			if( ll >2 && testi[ll-1] == '.' && testi[ll-2] == CROSS_FILESPLIT) continue; 
-			if( ll >3 && testi[ll-1] == '.' && testi[ll-2] == '.' && testi[ll-3] == CROSS_FILESPLIT) continue;
+	}
+	close_directory(dirp);
+	dirp = nullptr;
+
+	// parse directories to add them.
+	for (i = dirnames.begin(); i != dirnames.end(); ++i) {
+		if ((*i) == ".") continue;
+		if ((*i) == "..") continue;
+		std::string testi(*i);
+		std::string::size_type ll = testi.length();
+		//TODO: Use the dirname\. and dirname\.. for creating fake directories in the driveCache.
+		if( ll >2 && testi[ll-1] == '.' && testi[ll-2] == CROSS_FILESPLIT) continue; 
+		if( ll >3 && testi[ll-1] == '.' && testi[ll-2] == '.' && testi[ll-3] == CROSS_FILESPLIT) continue;
 
 #if OVERLAY_DIR
-			char tdir[CROSS_LEN];
-			safe_strcpy(tdir, (*i).c_str());
-			CROSS_DOSFILENAME(tdir);
-			bool dir_exists_in_base = localDrive::TestDir(tdir);
+		char tdir[CROSS_LEN];
+		safe_strcpy(tdir, (*i).c_str());
+		CROSS_DOSFILENAME(tdir);
+		bool dir_exists_in_base = localDrive::TestDir(tdir);
 #endif
 
-			char dir[CROSS_LEN];
-			safe_strcpy(dir, overlaydir);
-			safe_strcat(dir, (*i).c_str());
-			char dirpush[CROSS_LEN];
-			safe_strcpy(dirpush, (*i).c_str());
-			static char end[2] = {CROSS_FILESPLIT,0};
-			safe_strcat(dirpush, end); // Linux ?
+		char dir[CROSS_LEN];
+		safe_strcpy(dir, overlaydir);
+		safe_strcat(dir, (*i).c_str());
+		char dirpush[CROSS_LEN];
+		safe_strcpy(dirpush, (*i).c_str());
+		static char end[2] = {CROSS_FILESPLIT,0};
+		safe_strcat(dirpush, end); // Linux ?
 
-			assert(dirp == nullptr);
-			dirp = open_directory(dir);
-			if (dirp == NULL) continue;
+		assert(dirp == nullptr);
+		dirp = open_directory(dir);
+		if (dirp == NULL) continue;
 
 #if OVERLAY_DIR
-			//Good directory, add to DOSdirs_cache if not existing in localDrive. tested earlier to prevent problems with opendir
-			if (!dir_exists_in_base) add_DOSdir_to_cache(tdir);
+		//Good directory, add to DOSdirs_cache if not existing in localDrive. tested earlier to prevent problems with opendir
+		if (!dir_exists_in_base) add_DOSdir_to_cache(tdir);
 #endif
 
-			std::string backupi(*i);
-			// Read complete directory
-			if (read_directory_first(dirp, dir_name, is_directory)) {
+		std::string backupi(*i);
+		// Read complete directory
+		if (read_directory_first(dirp, dir_name, is_directory)) {
+			if ((safe_strlen(dir_name) > prefix_lengh+5) && strncmp(dir_name,special_prefix.c_str(),prefix_lengh) == 0) specials.push_back(string(dirpush)+dir_name);
+			else if (is_directory) dirnames.push_back(string(dirpush)+dir_name);
+			else filenames.push_back(string(dirpush)+dir_name);
+			while (read_directory_next(dirp, dir_name, is_directory)) {
 				if ((safe_strlen(dir_name) > prefix_lengh+5) && strncmp(dir_name,special_prefix.c_str(),prefix_lengh) == 0) specials.push_back(string(dirpush)+dir_name);
 				else if (is_directory) dirnames.push_back(string(dirpush)+dir_name);
 				else filenames.push_back(string(dirpush)+dir_name);
-				while (read_directory_next(dirp, dir_name, is_directory)) {
-					if ((safe_strlen(dir_name) > prefix_lengh+5) && strncmp(dir_name,special_prefix.c_str(),prefix_lengh) == 0) specials.push_back(string(dirpush)+dir_name);
-					else if (is_directory) dirnames.push_back(string(dirpush)+dir_name);
-					else filenames.push_back(string(dirpush)+dir_name);
-				}
 			}
-			close_directory(dirp);
-			dirp = nullptr;
-
-			// find current directory again, for the next round. But
-			// if it's not there, then bail out before the next
-			// round to avoid incrementing beyond the end.
-			i = std::find(dirnames.begin(), dirnames.end(), backupi);
-			if (i == dirnames.end())
-				break;
 		}
+		close_directory(dirp);
+		dirp = nullptr;
+
+		// find current directory again, for the next round. But
+		// if it's not there, then bail out before the next
+		// round to avoid incrementing beyond the end.
+		i = std::find(dirnames.begin(), dirnames.end(), backupi);
+		if (i == dirnames.end())
+			break;
 	}
 
 
-	if (read_directory_contents) {
-		for( i = filenames.begin(); i != filenames.end(); ++i) {
-			char dosname[CROSS_LEN];
-			safe_strcpy(dosname, (*i).c_str());
-			upcase(dosname);  //Should not be really needed, as uppercase in the overlay is a requirement...
-			CROSS_DOSFILENAME(dosname);
-			if (logoverlay) LOG_MSG("update cache add dosname %s",dosname);
-			DOSnames_cache.push_back(dosname);
-		}
+	for( i = filenames.begin(); i != filenames.end(); ++i) {
+		char dosname[CROSS_LEN];
+		safe_strcpy(dosname, (*i).c_str());
+		upcase(dosname);  //Should not be really needed, as uppercase in the overlay is a requirement...
+		CROSS_DOSFILENAME(dosname);
+		if (logoverlay) LOG_MSG("update cache add dosname %s",dosname);
+		DOSnames_cache.insert(dosname);
 	}
 
 #if OVERLAY_DIR
-	for (i = DOSdirs_cache.begin(); i !=DOSdirs_cache.end(); ++i) {
+	for (const auto &dosdir : DOSdirs_cache) {
 		char fakename[CROSS_LEN];
 		safe_strcpy(fakename, basedir);
-		safe_strcat(fakename, (*i).c_str());
+		safe_strcat(fakename, dosdir.c_str());
 		CROSS_FILENAME(fakename);
 		dirCache.AddEntryDirOverlay(fakename,true);
 	}
 #endif
 
-	for (i = DOSnames_cache.begin(); i != DOSnames_cache.end(); ++i) {
-		char fakename[CROSS_LEN];
-		safe_strcpy(fakename, basedir);
-		safe_strcat(fakename, (*i).c_str());
-		CROSS_FILENAME(fakename);
-		dirCache.AddEntry(fakename,true);
-	}
-
-	if (read_directory_contents) {
-		for (i = specials.begin(); i != specials.end(); ++i) {
-			//Specials look like this DBOVERLAY_YYY_FILENAME.EXT or DIRNAME[\/]DBOVERLAY_YYY_FILENAME.EXT where 
-			//YYY is the operation involved. Currently only DEL is supported.
-			//DEL = file marked as deleted, (but exists in localDrive!)
-			std::string name(*i);
-			std::string special_dir("");
-			std::string special_file("");
-			std::string special_operation("");
-			std::string::size_type s = name.find(special_prefix);
-			if (s == std::string::npos) continue;
-			if (s) {
-				special_dir = name.substr(0,s);
-				name.erase(0,s);
-			}
-			name.erase(0,special_prefix.length()+1); //Erase DBOVERLAY_
-			s = name.find('_');
-			if (s == std::string::npos || s == 0) continue;
-			special_operation = name.substr(0,s);
-			name.erase(0,s + 1);
-			special_file = name;
-			if (special_file.length() == 0) continue;
-			if (special_operation == "DEL") {
-				name = special_dir + special_file;
-				//CROSS_DOSFILENAME for strings:
-				while ( (s = name.find('/')) != std::string::npos) name.replace(s,1,"\\");
-				
-				add_deleted_file(name.c_str(),false);
-			} else if (special_operation == "RMD") {
-				name = special_dir + special_file;
-				//CROSS_DOSFILENAME for strings:
-				while ( (s = name.find('/')) != std::string::npos) name.replace(s,1,"\\");
-				add_deleted_path(name.c_str(),false);
-
-			} else {
-				if (logoverlay) LOG_MSG("unsupported operation %s on %s",special_operation.c_str(),(*i).c_str());
-			}
-
+	for (const auto &dosname : DOSnames_cache)
+		add_overlay_entry_to_cache(dosname.c_str());
+
+	for (i = specials.begin(); i != specials.end(); ++i) {
+		//Specials look like this DBOVERLAY_YYY_FILENAME.EXT or DIRNAME[\/]DBOVERLAY_YYY_FILENAME.EXT where 
+		//YYY is the operation involved. Currently only DEL is supported.
+		//DEL = file marked as deleted, (but exists in localDrive!)
+		std::string name(*i);
+		std::string special_dir("");
+		std::string special_file("");
+		std::string special_operation("");
+		std::string::size_type s = name.find(special_prefix);
+		if (s == std::string::npos) continue;
+		if (s) {
+			special_dir = name.substr(0,s);
+			name.erase(0,s);
 		}
+		name.erase(0,special_prefix.length()+1); //Erase DBOVERLAY_
+		s = name.find('_');
+		if (s == std::string::npos || s == 0) continue;
+		special_operation = name.substr(0,s);
+		name.erase(0,s + 1);
+		special_file = name;
+		if (special_file.length() == 0) continue;
+		if (special_operation == "DEL") {
+			name = special_dir + special_file;
+			//CROSS_DOSFILENAME for strings:
+			while ( (s = name.find('/')) != std::string::npos) name.replace(s,1,"\\");
+			
+			add_deleted_file(name.c_str(),false);
+		} else if (special_operation == "RMD") {
+			name = special_dir + special_file;
+			//CROSS_DOSFILENAME for strings:
+			while ( (s = name.find('/')) != std::string::npos) name.replace(s,1,"\\");
+			add_deleted_path(name.c_str(),false);
+
+		} else {
+			if (logoverlay) LOG_MSG("unsupported operation %s on %s",special_operation.c_str(),(*i).c_str());
+		}
+
 	}
 	if (logoverlay)
 		LOG_MSG("OPTIMISE: update cache took %d", GetTicksSince(a));
@@ -796,11 +790,11 @@ bool Overlay_Drive::FindNext(DOS_DTA & dta) {
 	uint16_t id = dta.GetDirID();
 
 again:
+	// Only the entries matching the pattern are found
 	if (!dirCache.FindNext(id,dir_ent)) {
 		DOS_SetError(DOSERR_NO_MORE_FILES);
 		return false;
 	}
-	if(!WildFileCmp(dir_ent,srch_pattern)) goto again;
 
 	safe_strcpy(full_name, srchInfo[id].srch_dir);
 	safe_strcat(full_name, dir_ent);
@@ -947,31 +941,21 @@ bool Overlay_Drive::FileUnlink(char * name) {
 		std::error_code ec = {};
 		if (std_fs::remove(overlayname, ec)) {
 			// Overlay file removed, mark basefile as deleted if it
-			// exists:
+			// exists, otherwise its entry goes as well:
 			if (localDrive::FileExists(name))
 				add_deleted_file(name, true);
-			remove_DOSname_from_cache(name); // Should be an else ?
-			                                 // although better safe
-			                                 // than sorry.
-			// Handle this better
-			dirCache.DeleteEntry(basename);
-			update_cache(false);
-			//Check if it exists in the base dir as well
-			
+			else
+				remove_overlay_entry_from_cache(name);
+			remove_DOSname_from_cache(name);
 			return true;
 		}
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	} else { //Removed from overlay.
-		//TODO IF it exists in the basedir: and more locations above.
+		//Mark the file as deleted if it exists in the basedir, otherwise remove its entry.
 		if (localDrive::FileExists(name)) add_deleted_file(name,true);
+		else remove_overlay_entry_from_cache(name);
 		remove_DOSname_from_cache(name);
-		//TODODO remove from the update_cache cache as well
-		//Handle this better
-		//Check if it exists in the base dir as well
-		dirCache.DeleteEntry(basename);
-
-		update_cache(false);
 		if (logoverlay)
 			LOG_MSG("OPTIMISE: unlink took %d", GetTicksSince(a));
 		return true;
@@ -1018,11 +1002,9 @@ bool Overlay_Drive::SetFileAttr(const char *name, uint16_t /*attr*/)
 
 void Overlay_Drive::add_deleted_file(const char* name,bool create_on_disk) {
 	if (logoverlay) LOG_MSG("add del file %s",name);
-	if (!is_deleted_file(name)) {
-		deleted_files_in_base.push_back(name);
-		if (create_on_disk) add_special_file_to_disk(name, "DEL");
-
-	}
+	if (!name || !*name) return;
+	if (deleted_files_in_base.insert(name).second && create_on_disk)
+		add_special_file_to_disk(name, "DEL");
 }
 
 void Overlay_Drive::add_special_file_to_disk(const char* dosname, const char* operation) {
@@ -1063,53 +1045,33 @@ std::string Overlay_Drive::create_filename_of_special_operation(const char* dosn
 
 bool Overlay_Drive::is_dir_only_in_overlay(const char* name) {
 	if (!name || !*name) return false;
-	if (DOSdirs_cache.empty()) return false;
-	for(std::vector<std::string>::iterator it = DOSdirs_cache.begin(); it != DOSdirs_cache.end(); ++it) {
-		if (*it == name) return true;
-	}
-	return false;
+	return DOSdirs_cache.count(name) != 0;
 }
 
 bool Overlay_Drive::is_deleted_file(const char* name) {
 	if (!name || !*name) return false;
-	if (deleted_files_in_base.empty()) return false;
-	for(std::vector<std::string>::iterator it = deleted_files_in_base.begin(); it != deleted_files_in_base.end(); ++it) {
-		if (*it == name) return true;
-	}
-	return false;
+	return deleted_files_in_base.count(name) != 0;
 }
 
 void Overlay_Drive::add_DOSdir_to_cache(const char* name) {
 	if (!name || !*name ) return; //Skip empty file.
 	LOG_MSG("Adding name to overlay_only_dir_cache %s",name);
-	if (!is_dir_only_in_overlay(name)) {
-		DOSdirs_cache.push_back(name); 
-	}
+	DOSdirs_cache.insert(name);
 }
 
 void Overlay_Drive::remove_DOSdir_from_cache(const char* name) {
-	for(std::vector<std::string>::iterator it = DOSdirs_cache.begin(); it != DOSdirs_cache.end(); ++it) {
-		if ( *it == name) {
-			DOSdirs_cache.erase(it);
-			return;
-		}
-	}
+	DOSdirs_cache.erase(name);
 }
 
 void Overlay_Drive::remove_deleted_file(const char* name,bool create_on_disk) {
-	for(std::vector<std::string>::iterator it = deleted_files_in_base.begin(); it != deleted_files_in_base.end(); ++it) {
-		if (*it == name) {
-			deleted_files_in_base.erase(it);
-			if (create_on_disk) remove_special_file_from_disk(name, "DEL");
-			return;
-		}
-	}
+	if (deleted_files_in_base.erase(name) && create_on_disk)
+		remove_special_file_from_disk(name, "DEL");
 }
 void Overlay_Drive::add_deleted_path(const char* name, bool create_on_disk) {
 	if (!name || !*name ) return; //Skip empty file.
 	if (logoverlay) LOG_MSG("add del path %s",name);
 	if (!is_deleted_path(name)) {
-		deleted_paths_in_base.push_back(name);
+		deleted_paths_in_base.insert(name);
 		//Add it to deleted files as well, so it gets skipped in FindNext. 
 		//Maybe revise that.
 		if (create_on_disk) add_special_file_to_disk(name,"RMD");
@@ -1119,26 +1081,18 @@ void Overlay_Drive::add_deleted_path(const char* name, bool create_on_disk) {
 bool Overlay_Drive::is_deleted_path(const char* name) {
 	if (!name || !*name) return false;
 	if (deleted_paths_in_base.empty()) return false;
-	std::string sname(name);
-	std::string::size_type namelen = sname.length();;
-	for(std::vector<std::string>::iterator it = deleted_paths_in_base.begin(); it != deleted_paths_in_base.end(); ++it) {
-		std::string::size_type blockedlen = (*it).length();
-		if (namelen < blockedlen) continue;
-		//See if input starts with name. 
-		std::string::size_type n = sname.find(*it);
-		if (n == 0 && ((namelen == blockedlen) || *(name + blockedlen) == '\\' )) return true;
+	//The path is deleted if it or one of its leading directories is.
+	const std::string sname(name);
+	for (auto pos = sname.find('\\'); pos != std::string::npos; pos = sname.find('\\', pos + 1)) {
+		if (deleted_paths_in_base.count(sname.substr(0, pos))) return true;
 	}
-	return false;
+	return deleted_paths_in_base.count(sname) != 0;
 }
 
 void Overlay_Drive::remove_deleted_path(const char* name, bool create_on_disk) {
-	for(std::vector<std::string>::iterator it = deleted_paths_in_base.begin(); it != deleted_paths_in_base.end(); ++it) {
-		if (*it == name) {
-			deleted_paths_in_base.erase(it);
-			remove_deleted_file(name,false); //Rethink maybe.
-			if (create_on_disk) remove_special_file_from_disk(name,"RMD");
-			break;
-		}
+	if (deleted_paths_in_base.erase(name)) {
+		remove_deleted_file(name,false); //Rethink maybe.
+		if (create_on_disk) remove_special_file_from_disk(name,"RMD");
 	}
 }
 bool Overlay_Drive::check_if_leading_is_deleted(const char* name){
@@ -1243,8 +1197,10 @@ bool Overlay_Drive::Rename(char * oldname,char * newname) {
 		//handle the drive_cache (a bit better)
 		//Ensure that the file is not marked as deleted anymore.
 		if (is_deleted_file(newname)) remove_deleted_file(newname,true);
-		dirCache.EmptyCache();
-		update_cache(true);
+		remove_DOSname_from_cache(oldname);
+		if (!localDrive::FileExists(oldname)) remove_overlay_entry_from_cache(oldname);
+		add_DOSname_to_cache(newname);
+		add_overlay_entry_to_cache(newname);
 		if (logoverlay)
 			LOG_MSG("OPTIMISE: rename took %d", GetTicksSince(a));
 	}
@@ -1293,6 +1249,6 @@ Bits Overlay_Drive::UnMount(void) {
 }
 void Overlay_Drive::EmptyCache(void){
 	localDrive::EmptyCache();
-	update_cache(true);//lets rebuild it.
+	update_cache();//lets rebuild it.
 }
 
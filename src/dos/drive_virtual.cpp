@@ -23,12 +23,15 @@
 #include <string.h>
 #include <time.h>
 
+#include <unordered_map>
+
 #include "cross.h"
 #include "dos_inc.h"
 #include "fs_utils.h"
 #include "shell.h"
 #include "string_utils.h"
 #include "support.h"
+#include "timer.h"
 
 constexpr auto default_date = DOS_PackDate(2002, 10, 1);
 constexpr auto default_time = DOS_PackTime(12, 34, 56);
@@ -60,6 +63,35 @@ struct VFILE_Block {
 static VFILE_Block *first_file = nullptr;
 static VFILE_Block *parent_dir = nullptr;
 
+// The files are also indexed by their uppercase DOS path on the drive, as
+// looked up by name: either the file's name, or its directory's short name
+// and the file's name joined by a backslash
+static std::unordered_map<std::string, VFILE_Block *> vfile_index = {};
+
+// Counts the changes to the registered files
+static uint32_t vfile_generation = 0;
+
+uint32_t VFILE_GetGeneration()
+{
+	return vfile_generation;
+}
+
+static std::string vfile_key(const unsigned int onpos, const char *name)
+{
+	std::string key = onpos ? vfilenames[onpos].shortname + '\\' : std::string();
+	key += name;
+	upcase(key);
+	return key;
+}
+
+static VFILE_Block *find_vfile(const char *path)
+{
+	std::string key = path;
+	upcase(key);
+	const auto it = vfile_index.find(key);
+	return it != vfile_index.end() ? it->second : nullptr;
+}
+
 char *VFILE_Generate_8x3(const char *name, const unsigned int onpos)
 {
 	if (!name || !*name) {
@@ -76,26 +108,15 @@ char *VFILE_Generate_8x3(const char *name, const unsigned int onpos)
 	if (lfn.length() >= LFN_NAMELENGTH)
 		lfn.erase(LFN_NAMELENGTH);
 	unsigned int num = 1;
-	const VFILE_Block *cur_file;
 	// Get 8.3 names for LFNs by iterating the numbers
 	while (1) {
 		const auto str = generate_8x3(lfn.c_str(), num);
 		safe_strcpy(sfn, str.length() < DOS_NAMELENGTH_ASCII ? str.c_str() : "");
 		if (!*sfn)
 			return sfn;
-		cur_file = first_file;
-		bool found = false;
-		while (cur_file) {
-			// If 8.3 name already exists, try next number
-			if (onpos == cur_file->onpos &&
-			    (strcasecmp(sfn, cur_file->name) == 0)) {
-				found = true;
-				break;
-			}
-			cur_file = cur_file->next;
-		}
-		// Return if 8.3 name does not already exist
-		if (!found)
+		// Return if 8.3 name does not already exist, otherwise try
+		// the next number
+		if (!vfile_index.count(vfile_key(onpos, sfn)))
 			return sfn;
 		num++;
 	}
@@ -127,12 +148,8 @@ void VFILE_Register(const char *name,
 		if (onpos == 0)
 			return;
 	}
-	const VFILE_Block *cur_file = first_file;
-	while (cur_file) {
-		if (onpos == cur_file->onpos && strcasecmp(name, cur_file->name) == 0)
-			return;
-		cur_file = cur_file->next;
-	}
+	if (vfile_index.count(vfile_key(onpos, name)))
+		return;
 	Filename filename;
 	filename.fullname = name;
 	filename.shortname = filename_not_strict_8x3(name)
@@ -157,6 +174,8 @@ void VFILE_Register(const char *name,
 	new_file->isdir = isdir;
 	new_file->next = first_file;
 	first_file = new_file;
+	vfile_index[vfile_key(onpos, new_file->name)] = new_file;
+	++vfile_generation;
 }
 
 void VFILE_Register(const char *name, const std::vector<uint8_t> &blob, const char *dir)
@@ -186,6 +205,8 @@ void VFILE_Remove(const char *name, const char *dir = "")
 			*where = chan->next;
 			if (chan == first_file)
 				first_file = chan->next;
+			vfile_index.erase(vfile_key(onpos, chan->name));
+			++vfile_generation;
 			delete chan;
 			return;
 		}
@@ -366,23 +387,12 @@ bool Virtual_Drive::FileOpen(DOS_File * * file,char * name,uint32_t flags) {
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	}
-/* Scan through the internal list of files */
-	VFILE_Block * cur_file = first_file;
-	while (cur_file) {
-		unsigned int onpos = cur_file->onpos;
-		if (strcasecmp(name, (std::string(onpos ? vfilenames[onpos].shortname +
-		                                                  std::string(1, '\\')
-		                                        : "") +
-		                      cur_file->name)
-		                             .c_str()) == 0) {
-			/* We have a match */
-			*file = new Virtual_File(cur_file->data, cur_file->size);
-			(*file)->flags = flags;
-			return true;
-		}
-		cur_file = cur_file->next;
-	}
-	return false;
+	const auto cur_file = find_vfile(name);
+	if (!cur_file)
+		return false;
+	*file = new Virtual_File(cur_file->data, cur_file->size);
+	(*file)->flags = flags;
+	return true;
 }
 
 bool Virtual_Drive::FileCreate(DOS_File * * /*file*/,char * /*name*/,uint16_t /*attributes*/) {
@@ -419,41 +429,21 @@ bool Virtual_Drive::TestDir(char * dir) {
 
 bool Virtual_Drive::FileStat(const char* name, FileStat_Block * const stat_block){
 	assert(name);
-	VFILE_Block * cur_file = first_file;
-	while (cur_file) {
-		unsigned int onpos = cur_file->onpos;
-		if (strcasecmp(name, (std::string(onpos ? vfilenames[onpos].shortname +
-		                                                  std::string(1, '\\')
-		                                        : "") +
-		                      cur_file->name)
-		                             .c_str()) == 0) {
-			stat_block->attr = (int)(cur_file->isdir
-			                                 ? DOS_ATTR_DIRECTORY
-			                                 : DOS_ATTR_ARCHIVE);
-			stat_block->size = cur_file->size;
-			stat_block->date = default_date;
-			stat_block->time = default_time;
-			return true;
-		}
-		cur_file = cur_file->next;
-	}
-	return false;
+	const auto cur_file = find_vfile(name);
+	if (!cur_file)
+		return false;
+	stat_block->attr = (int)(cur_file->isdir ? DOS_ATTR_DIRECTORY
+	                                         : DOS_ATTR_ARCHIVE);
+	stat_block->size = cur_file->size;
+	stat_block->date = default_date;
+	stat_block->time = default_time;
+	return true;
 }
 
 bool Virtual_Drive::FileExists(const char* name){
 	assert(name);
-	VFILE_Block * cur_file = first_file;
-	while (cur_file) {
-		unsigned int onpos = cur_file->onpos;
-		if (strcasecmp(name, (std::string(onpos ? vfilenames[onpos].shortname +
-		                                                  std::string(1, '\\')
-		                                        : "") +
-		                      cur_file->name)
-		                             .c_str()) == 0)
-			return !cur_file->isdir;
-		cur_file = cur_file->next;
-	}
-	return false;
+	const auto cur_file = find_vfile(name);
+	return cur_file && !cur_file->isdir;
 }
 
 bool Virtual_Drive::FindFirst(char *_dir, DOS_DTA &dta, bool fcb_findfirst)
@@ -540,21 +530,12 @@ bool Virtual_Drive::GetFileAttr(char *name, uint16_t *attr)
 		*attr = DOS_ATTR_DIRECTORY;
 		return true;
 	}
-	VFILE_Block *cur_file = first_file;
-	while (cur_file) {
-		unsigned int onpos = cur_file->onpos;
-		if (strcasecmp(name, (std::string(onpos ? vfilenames[onpos].shortname +
-		                                                  std::string(1, '\\')
-		                                        : "") +
-		                      cur_file->name)
-		                             .c_str()) == 0) {
-			*attr = (int)(cur_file->isdir ? DOS_ATTR_DIRECTORY // Maybe
-			                              : DOS_ATTR_ARCHIVE); // Read-only?
-			return true;
-		}
-		cur_file = cur_file->next;
-	}
-	return false;
+	const auto cur_file = find_vfile(name);
+	if (!cur_file)
+		return false;
+	*attr = (int)(cur_file->isdir ? DOS_ATTR_DIRECTORY // Maybe
+	                              : DOS_ATTR_ARCHIVE); // Read-only?
+	return true;
 }
 
 bool Virtual_Drive::SetFileAttr(const char *name, [[maybe_unused]] uint16_t attr)
@@ -564,20 +545,7 @@ bool Virtual_Drive::SetFileAttr(const char *name, [[maybe_unused]] uint16_t attr
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return true;
 	}
-	const VFILE_Block *cur_file = first_file;
-	while (cur_file) {
-		unsigned int onpos = cur_file->onpos;
-		if (strcasecmp(name, (std::string(onpos ? vfilenames[onpos].shortname +
-		                                                  std::string(1, '\\')
-		                                        : "") +
-		                      cur_file->name)
-		                             .c_str()) == 0) {
-			DOS_SetError(DOSERR_ACCESS_DENIED);
-			return false;
-		}
-		cur_file = cur_file->next;
-	}
-	DOS_SetError(DOSERR_FILE_NOT_FOUND);
+	DOS_SetError(find_vfile(name) ? DOSERR_ACCESS_DENIED : DOSERR_FILE_NOT_FOUND);
 	return false;
 }
 
@@ -620,8 +588,670 @@ void Virtual_Drive::EmptyCache()
 		delete first_file;
 		first_file = n;
 	}
+	vfile_index.clear();
+	++vfile_generation;
 	vfile_pos = 1;
 	PROGRAMS_Destroy(nullptr);
 	vfilenames = {Filename{"", ""}};
 	Add_VFiles(first_shell != nullptr);
 }
+
+// RAM drive
+// ~~~~~~~~~
+struct MemoryFileData {
+	std::vector<uint8_t> bytes = {};
+	std::string host_path = {}; // written back to, with write-through
+	uint16_t date = 0;
+	uint16_t time = 0;
+	bool dirty = false;
+};
+
+static void get_current_dos_time(uint16_t &dos_date, uint16_t &dos_time)
+{
+	const auto now = ::time(nullptr);
+	struct tm datetime;
+	if (cross::localtime_r(&now, &datetime)) {
+		dos_date = DOS_PackDate(datetime);
+		dos_time = DOS_PackTime(datetime);
+	} else {
+		dos_date = default_date;
+		dos_time = default_time;
+	}
+}
+
+static void write_back(MemoryFileData &data)
+{
+	if (!data.dirty || data.host_path.empty())
+		return;
+	data.dirty = false;
+	FILE *f = fopen_wrap(data.host_path.c_str(), "wb");
+	const bool written = f && (data.bytes.empty() ||
+	                           fwrite(data.bytes.data(), data.bytes.size(), 1, f) == 1);
+	if (f)
+		fclose(f);
+	if (!written)
+		LOG_WARNING("DRIVE: Can't write %s back to the host",
+		            data.host_path.c_str());
+}
+
+class Memory_File final : public DOS_File {
+public:
+	Memory_File(const char *name, std::shared_ptr<MemoryFileData> file_data,
+	            uint8_t attributes);
+
+	Memory_File(const Memory_File &) = delete; // prevent copying
+	Memory_File &operator=(const Memory_File &) = delete; // prevent assignment
+
+	bool Read(uint8_t *data, uint16_t *size);
+	bool Write(uint8_t *data, uint16_t *size);
+	bool Seek(uint32_t *pos, uint32_t type);
+	bool Close();
+	uint16_t GetInformation();
+
+private:
+	std::shared_ptr<MemoryFileData> file_data;
+	uint32_t file_pos = 0;
+	bool modified = false;
+};
+
+Memory_File::Memory_File(const char *name,
+                         std::shared_ptr<MemoryFileData> data,
+                         const uint8_t attributes)
+        : file_data(std::move(data))
+{
+	SetName(name);
+	date = file_data->date;
+	time = file_data->time;
+	attr = attributes;
+	open = true;
+}
+
+bool Memory_File::Read(uint8_t *data, uint16_t *size)
+{
+	if ((flags & 0xf) == OPEN_WRITE) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	const auto &bytes = file_data->bytes;
+	if (file_pos >= bytes.size())
+		*size = 0;
+	else if (*size > bytes.size() - file_pos)
+		*size = static_cast<uint16_t>(bytes.size() - file_pos);
+	if (*size)
+		memcpy(data, &bytes[file_pos], *size);
+	file_pos += *size;
+	return true;
+}
+
+bool Memory_File::Write(uint8_t *data, uint16_t *size)
+{
+	const auto mode = flags & 0xf;
+	if (mode == OPEN_READ || mode == OPEN_READ_NO_MOD) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	auto &bytes = file_data->bytes;
+	if (*size == 0) {
+		// Writing nothing truncates or extends the file to the position
+		bytes.resize(file_pos);
+	} else {
+		if (*size > UINT32_MAX - file_pos)
+			*size = static_cast<uint16_t>(UINT32_MAX - file_pos);
+		const auto end = static_cast<size_t>(file_pos) + *size;
+		if (end > bytes.size())
+			bytes.resize(end);
+		memcpy(&bytes[file_pos], data, *size);
+		file_pos += *size;
+	}
+	file_data->dirty = true;
+	modified = true;
+	return true;
+}
+
+bool Memory_File::Seek(uint32_t *pos, uint32_t type)
+{
+	// Positions past the end are allowed, with the offset being signed
+	const auto offset = static_cast<int32_t>(*pos);
+	int64_t new_pos = 0;
+	switch (type) {
+	case DOS_SEEK_SET: new_pos = offset; break;
+	case DOS_SEEK_CUR: new_pos = static_cast<int64_t>(file_pos) + offset; break;
+	case DOS_SEEK_END:
+		new_pos = static_cast<int64_t>(file_data->bytes.size()) + offset;
+		break;
+	default: DOS_SetError(DOSERR_FUNCTION_NUMBER_INVALID); return false;
+	}
+	if (new_pos < 0 || new_pos > UINT32_MAX) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	file_pos = static_cast<uint32_t>(new_pos);
+	*pos = file_pos;
+	return true;
+}
+
+bool Memory_File::Close()
+{
+	if (refCtr == 1) {
+		open = false;
+		if (newtime) {
+			file_data->date = date;
+			file_data->time = time;
+		} else if (modified) {
+			get_current_dos_time(file_data->date, file_data->time);
+		}
+		write_back(*file_data);
+	}
+	return true;
+}
+
+uint16_t Memory_File::GetInformation()
+{
+	return 0;
+}
+
+Memory_Drive::Memory_Drive(const char *host_dir_path,
+                           const bool write_through_enabled,
+                           const uint16_t bytes_sector,
+                           const uint8_t sectors_cluster,
+                           const uint16_t total_clusters,
+                           const uint16_t free_clusters,
+                           const uint8_t mediaid,
+                           bool &success)
+        : root(std::make_unique<Node>()),
+          host_dir(host_dir_path),
+          write_through(write_through_enabled)
+{
+	type = DosDriveType::Memory;
+	safe_strcpy(info, host_dir_path);
+	allocation.bytes_sector = bytes_sector;
+	allocation.sectors_cluster = sectors_cluster;
+	allocation.total_clusters = total_clusters;
+	allocation.free_clusters = free_clusters;
+	allocation.mediaid = mediaid;
+
+	if (!host_dir.empty() && host_dir.back() != CROSS_FILESPLIT)
+		host_dir += CROSS_FILESPLIT;
+	root->is_dir = true;
+	root->attr = DOS_ATTR_DIRECTORY;
+
+	const auto start = GetTicks();
+	success = LoadDir(*root, host_dir);
+	if (success)
+		LOG_MSG("DRIVE: Preloaded %.1f MB from %s in %d ms",
+		        static_cast<double>(loaded_bytes) / (1024 * 1024),
+		        host_dir_path, GetTicksSince(start));
+}
+
+Memory_Drive::~Memory_Drive()
+{
+	WriteBackAll(*root);
+}
+
+// Reads the host directory and everything in it into the node
+bool Memory_Drive::LoadDir(Node &dir, const std::string &host_path)
+{
+	std::error_code ec = {};
+	std::vector<std_fs::directory_entry> host_entries = {};
+	for (auto it = std_fs::directory_iterator(host_path, ec);
+	     !ec && it != std_fs::directory_iterator(); it.increment(ec))
+		host_entries.push_back(*it);
+	if (ec) {
+		LOG_WARNING("DRIVE: Can't read %s: %s", host_path.c_str(),
+		            ec.message().c_str());
+		return false;
+	}
+
+	std::vector<std::string> host_names = {};
+	for (const auto &entry : host_entries)
+		host_names.push_back(entry.path().filename().string());
+	const auto dos_names = generate_unique_8x3_names(host_names);
+
+	for (size_t i = 0; i < host_entries.size(); ++i) {
+		const auto &entry = host_entries[i];
+		const auto is_dir = entry.is_directory(ec);
+		if (dos_names[i].empty() || (!is_dir && !entry.is_regular_file(ec)))
+			continue;
+
+		auto node = std::make_unique<Node>();
+		node->name = dos_names[i];
+		node->host_name = host_names[i];
+		node->parent = &dir;
+		node->is_dir = is_dir;
+		node->attr = is_dir ? DOS_ATTR_DIRECTORY : DOS_ATTR_ARCHIVE;
+
+		uint16_t dos_date = default_date;
+		uint16_t dos_time = default_time;
+		const auto rawtime = to_time_t(entry.last_write_time(ec));
+		struct tm datetime;
+		if (!ec && cross::localtime_r(&rawtime, &datetime)) {
+			dos_date = DOS_PackDate(datetime);
+			dos_time = DOS_PackTime(datetime);
+		}
+
+		const auto child_path = host_path + host_names[i];
+		if (is_dir) {
+			node->date = dos_date;
+			node->time = dos_time;
+			if (!LoadDir(*node, child_path + CROSS_FILESPLIT))
+				return false;
+		} else {
+			const auto size = entry.file_size(ec);
+			if (ec || size > UINT32_MAX) {
+				LOG_WARNING("DRIVE: Skipping %s, as it's too large for DOS",
+				            child_path.c_str());
+				continue;
+			}
+			auto data = std::make_shared<MemoryFileData>();
+			data->bytes.resize(static_cast<size_t>(size));
+			FILE *f = fopen_wrap(child_path.c_str(), "rb");
+			const bool loaded = f && (size == 0 ||
+			                          fread(data->bytes.data(), data->bytes.size(), 1, f) == 1);
+			if (f)
+				fclose(f);
+			if (!loaded) {
+				LOG_WARNING("DRIVE: Can't read %s", child_path.c_str());
+				return false;
+			}
+			data->date = dos_date;
+			data->time = dos_time;
+			if (write_through)
+				data->host_path = child_path;
+			loaded_bytes += size;
+			node->data = std::move(data);
+		}
+		dir.children[node->name] = std::move(node);
+	}
+	return true;
+}
+
+Memory_Drive::Node *Memory_Drive::Lookup(const char *path) const
+{
+	Node *node = root.get();
+	std::string name = {};
+	for (const char *pos = path;; ++pos) {
+		if (*pos && *pos != '\\') {
+			name += *pos;
+			continue;
+		}
+		if (!name.empty()) {
+			upcase(name);
+			const auto it = node->children.find(name);
+			if (!node->is_dir || it == node->children.end())
+				return nullptr;
+			node = it->second.get();
+			name.clear();
+		}
+		if (!*pos)
+			return node;
+	}
+}
+
+// Finds the directory of the path, setting name to the path's last part
+Memory_Drive::Node *Memory_Drive::LookupParent(const char *path, std::string &name) const
+{
+	const std::string full_path = path;
+	const auto separator = full_path.rfind('\\');
+	name = separator == std::string::npos ? full_path
+	                                      : full_path.substr(separator + 1);
+	upcase(name);
+	Node *dir = Lookup(separator == std::string::npos
+	                           ? ""
+	                           : full_path.substr(0, separator).c_str());
+	return (dir && dir->is_dir && !name.empty()) ? dir : nullptr;
+}
+
+std::string Memory_Drive::HostPath(const Node &node) const
+{
+	std::string path = {};
+	for (auto current = &node; current->parent; current = current->parent)
+		path = current->host_name +
+		       (path.empty() ? "" : std::string(1, CROSS_FILESPLIT) + path);
+	return host_dir + path;
+}
+
+// Points the files at their host paths again, after the node was renamed
+void Memory_Drive::UpdateHostPaths(Node &node)
+{
+	if (node.data)
+		node.data->host_path = HostPath(node);
+	for (auto &[name, child] : node.children)
+		UpdateHostPaths(*child);
+}
+
+void Memory_Drive::WriteBackAll(Node &dir)
+{
+	for (auto &[name, child] : dir.children) {
+		if (child->data)
+			write_back(*child->data);
+		else
+			WriteBackAll(*child);
+	}
+}
+
+bool Memory_Drive::FileOpen(DOS_File **file, char *name, uint32_t flags)
+{
+	const auto node = Lookup(name);
+	if (!node || node->is_dir) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	*file = new Memory_File(name, node->data, node->attr);
+	(*file)->flags = flags;
+	return true;
+}
+
+bool Memory_Drive::FileCreate(DOS_File **file, char *name, uint16_t attributes)
+{
+	std::string file_name = {};
+	const auto dir = LookupParent(name, file_name);
+	if (!dir) {
+		DOS_SetError(DOSERR_PATH_NOT_FOUND);
+		return false;
+	}
+	auto &node = dir->children[file_name];
+	if (node && node->is_dir) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	if (node) {
+		node->data->bytes.clear();
+	} else {
+		node = std::make_unique<Node>();
+		node->name = file_name;
+		node->host_name = file_name;
+		node->parent = dir;
+		node->data = std::make_shared<MemoryFileData>();
+		if (write_through)
+			node->data->host_path = HostPath(*node);
+	}
+	node->attr = static_cast<uint8_t>(
+	        (attributes & (DOS_ATTR_READ_ONLY | DOS_ATTR_HIDDEN | DOS_ATTR_SYSTEM)) |
+	        DOS_ATTR_ARCHIVE);
+	get_current_dos_time(node->data->date, node->data->time);
+	node->data->dirty = true;
+
+	*file = new Memory_File(name, node->data, node->attr);
+	(*file)->flags = OPEN_READWRITE;
+	return true;
+}
+
+bool Memory_Drive::FileUnlink(char *name)
+{
+	std::string file_name = {};
+	const auto dir = LookupParent(name, file_name);
+	const auto it = dir ? dir->children.find(file_name) : decltype(dir->children.end())();
+	if (!dir || it == dir->children.end() || it->second->is_dir) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	// Files still open keep their data, but aren't written back
+	auto &data = *it->second->data;
+	if (write_through) {
+		std::error_code ec = {};
+		std_fs::remove(HostPath(*it->second), ec);
+	}
+	data.host_path.clear();
+	data.dirty = false;
+	dir->children.erase(it);
+	return true;
+}
+
+bool Memory_Drive::RemoveDir(char *dir)
+{
+	std::string dir_name = {};
+	const auto parent = LookupParent(dir, dir_name);
+	const auto it = parent ? parent->children.find(dir_name)
+	                       : decltype(parent->children.end())();
+	if (!parent || it == parent->children.end() || !it->second->is_dir) {
+		DOS_SetError(DOSERR_PATH_NOT_FOUND);
+		return false;
+	}
+	if (!it->second->children.empty()) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	if (write_through) {
+		std::error_code ec = {};
+		std_fs::remove(HostPath(*it->second), ec);
+	}
+	parent->children.erase(it);
+	return true;
+}
+
+bool Memory_Drive::MakeDir(char *dir)
+{
+	std::string dir_name = {};
+	const auto parent = LookupParent(dir, dir_name);
+	if (!parent || parent->children.count(dir_name)) {
+		DOS_SetError(parent ? DOSERR_ACCESS_DENIED : DOSERR_PATH_NOT_FOUND);
+		return false;
+	}
+	auto node = std::make_unique<Node>();
+	node->name = dir_name;
+	node->host_name = dir_name;
+	node->parent = parent;
+	node->is_dir = true;
+	node->attr = DOS_ATTR_DIRECTORY;
+	get_current_dos_time(node->date, node->time);
+	if (write_through) {
+		const auto host_path = HostPath(*node);
+		std::error_code ec = {};
+		if (create_dir(host_path.c_str(), 0775) != 0 &&
+		    !std_fs::is_directory(host_path, ec)) {
+			DOS_SetError(DOSERR_ACCESS_DENIED);
+			return false;
+		}
+	}
+	parent->children[dir_name] = std::move(node);
+	return true;
+}
+
+bool Memory_Drive::TestDir(char *dir)
+{
+	const auto node = Lookup(dir);
+	return node && node->is_dir;
+}
+
+bool Memory_Drive::Rename(char *oldname, char *newname)
+{
+	std::string old_name = {};
+	const auto old_dir = LookupParent(oldname, old_name);
+	const auto it = old_dir ? old_dir->children.find(old_name)
+	                        : decltype(old_dir->children.end())();
+	if (!old_dir || it == old_dir->children.end()) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	std::string new_name = {};
+	const auto new_dir = LookupParent(newname, new_name);
+	if (!new_dir) {
+		DOS_SetError(DOSERR_PATH_NOT_FOUND);
+		return false;
+	}
+	if (new_dir->children.count(new_name)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	// A directory can't be moved into itself
+	for (auto dir = new_dir; dir; dir = dir->parent) {
+		if (dir == it->second.get()) {
+			DOS_SetError(DOSERR_ACCESS_DENIED);
+			return false;
+		}
+	}
+
+	const auto old_host_path = HostPath(*it->second);
+	auto node = std::move(it->second);
+	old_dir->children.erase(it);
+	node->name = new_name;
+	node->host_name = new_name;
+	node->parent = new_dir;
+	auto &moved = *node;
+	new_dir->children[new_name] = std::move(node);
+
+	if (write_through) {
+		std::error_code ec = {};
+		std_fs::rename(old_host_path, HostPath(moved), ec);
+		if (ec)
+			LOG_WARNING("DRIVE: Can't rename %s on the host: %s",
+			            old_host_path.c_str(), ec.message().c_str());
+		UpdateHostPaths(moved);
+	}
+	return true;
+}
+
+bool Memory_Drive::FindFirst(char *_dir, DOS_DTA &dta, bool fcb_findfirst)
+{
+	const auto dir = Lookup(_dir);
+	if (!dir || !dir->is_dir) {
+		DOS_SetError(DOSERR_PATH_NOT_FOUND);
+		return false;
+	}
+
+	uint8_t attr = 0;
+	char pattern[CROSS_LEN];
+	dta.GetSearchParams(attr, pattern);
+	const auto label = GetLabel();
+	if (attr == DOS_ATTR_VOLUME) {
+		if (is_empty(label)) {
+			DOS_SetError(DOSERR_NO_MORE_FILES);
+			return false;
+		}
+		dta.SetResult(label, 0, 0, 0, DOS_ATTR_VOLUME);
+		return true;
+	}
+
+	Search search = {};
+	// Volume labels come first, and only from the root directory
+	if ((attr & DOS_ATTR_VOLUME) && dir == root.get() && !fcb_findfirst &&
+	    !is_empty(label) && WildFileCmp(label, pattern))
+		search.results.push_back({label, 0, 0, 0, DOS_ATTR_VOLUME});
+
+	const auto add_result = [&](const char *name, const Node &node) {
+		if (!WildFileCmp(name, pattern))
+			return;
+		if (~attr & node.attr & (DOS_ATTR_DIRECTORY | DOS_ATTR_HIDDEN | DOS_ATTR_SYSTEM))
+			return;
+		if (node.is_dir)
+			search.results.push_back({name, 0, node.date, node.time, node.attr});
+		else
+			search.results.push_back(
+			        {name, static_cast<uint32_t>(node.data->bytes.size()),
+			         node.data->date, node.data->time, node.attr});
+	};
+	if (dir != root.get()) {
+		add_result(".", *dir);
+		add_result("..", *dir);
+	}
+	for (const auto &[name, child] : dir->children)
+		add_result(name.c_str(), *child);
+
+	const auto id = nextSearchId;
+	nextSearchId = (nextSearchId + 1) % MAX_OPENDIRS;
+	searches[id] = std::move(search);
+	dta.SetDirID(id);
+	return FindNext(dta);
+}
+
+bool Memory_Drive::FindNext(DOS_DTA &dta)
+{
+	const auto it = searches.find(dta.GetDirID());
+	if (it == searches.end() || it->second.next >= it->second.results.size()) {
+		if (it != searches.end())
+			searches.erase(it);
+		DOS_SetError(DOSERR_NO_MORE_FILES);
+		return false;
+	}
+	const auto &result = it->second.results[it->second.next++];
+	dta.SetResult(result.name.c_str(), result.size, result.date, result.time,
+	              result.attr);
+	return true;
+}
+
+bool Memory_Drive::GetFileAttr(char *name, uint16_t *attr)
+{
+	const auto node = Lookup(name);
+	if (!node) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	*attr = node->attr;
+	return true;
+}
+
+bool Memory_Drive::SetFileAttr(const char *name, const uint16_t attr)
+{
+	const auto node = Lookup(name);
+	if (!node || node == root.get()) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	node->attr = static_cast<uint8_t>(
+	        (attr & (DOS_ATTR_READ_ONLY | DOS_ATTR_HIDDEN | DOS_ATTR_SYSTEM |
+	                 DOS_ATTR_ARCHIVE)) |
+	        (node->is_dir ? DOS_ATTR_DIRECTORY : 0));
+	return true;
+}
+
+bool Memory_Drive::AllocationInfo(uint16_t *_bytes_sector,
+                                  uint8_t *_sectors_cluster,
+                                  uint16_t *_total_clusters,
+                                  uint16_t *_free_clusters)
+{
+	*_bytes_sector = allocation.bytes_sector;
+	*_sectors_cluster = allocation.sectors_cluster;
+	*_total_clusters = allocation.total_clusters;
+	*_free_clusters = allocation.free_clusters;
+	return true;
+}
+
+bool Memory_Drive::FileExists(const char *name)
+{
+	const auto node = Lookup(name);
+	return node && !node->is_dir;
+}
+
+bool Memory_Drive::FileStat(const char *name, FileStat_Block *const stat_block)
+{
+	const auto node = Lookup(name);
+	if (!node)
+		return false;
+	stat_block->attr = node->attr;
+	if (node->is_dir) {
+		stat_block->size = 0;
+		stat_block->date = node->date;
+		stat_block->time = node->time;
+	} else {
+		stat_block->size = static_cast<uint32_t>(node->data->bytes.size());
+		stat_block->date = node->data->date;
+		stat_block->time = node->data->time;
+	}
+	return true;
+}
+
+uint8_t Memory_Drive::GetMediaByte()
+{
+	return allocation.mediaid;
+}
+
+void Memory_Drive::EmptyCache()
+{
+	// Everything is in memory, so there's nothing to re-read
+}
+
+bool Memory_Drive::isRemote()
+{
+	return false;
+}
+
+bool Memory_Drive::isRemovable()
+{
+	return false;
+}
+
+Bits Memory_Drive::UnMount()
+{
+	delete this;
+	return 0;
+}
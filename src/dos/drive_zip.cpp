@@ -0,0 +1,1011 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "drives.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+#include <zlib.h>
+
+#include "control.h"
+#include "cross.h"
+#include "mem.h"
+#include "setup.h"
+#include "std_filesystem.h"
+#include "string_utils.h"
+#include "support.h"
+
+// Record signatures and the compression methods we can read
+constexpr uint32_t zip_local_header_sig = 0x04034b50;
+constexpr uint32_t zip_central_header_sig = 0x02014b50;
+constexpr uint32_t zip_end_sig = 0x06054b50;
+constexpr uint32_t zip64_end_sig = 0x06064b50;
+constexpr uint32_t zip64_locator_sig = 0x07064b50;
+constexpr uint16_t zip_method_stored = 0;
+constexpr uint16_t zip_method_deflated = 8;
+
+constexpr size_t zip_local_header_size = 30;
+constexpr size_t zip_central_header_size = 46;
+constexpr size_t zip_end_size = 22;
+constexpr size_t zip64_end_size = 56;
+constexpr size_t zip64_locator_size = 20;
+constexpr size_t zip_max_comment = 0xffff;
+
+// Files decompressed at once, each keeping its position in the stream
+constexpr size_t zip_max_inflaters = 8;
+
+static uint64_t read_qword(const uint8_t *data)
+{
+	return host_readd(data) | (static_cast<uint64_t>(host_readd(data + 4)) << 32);
+}
+
+// A deflated file's decompression, carrying on from where the previous
+// block ended
+struct zipDrive::Inflater {
+	size_t index = 0;
+	z_stream stream = {};
+	bool started = false;
+	uint64_t read_pos = 0;        // of the next compressed byte
+	uint64_t compressed_left = 0; // bytes not yet read
+	uint32_t inflated = 0;        // bytes decompressed so far
+	uint32_t crc = 0;
+	uint8_t input[16 * 1024] = {};
+
+	~Inflater()
+	{
+		if (started)
+			inflateEnd(&stream);
+	}
+};
+
+// The most recently used decompressions, the most recent first
+struct zipDrive::InflaterPool {
+	std::list<std::unique_ptr<Inflater>> inflaters = {};
+
+	// Returns the file's decompression, taking the least recently used
+	// one over if the file has none
+	Inflater &Get(const size_t index)
+	{
+		auto it = std::find_if(inflaters.begin(), inflaters.end(),
+		                       [=](const auto &inflater) {
+			                       return inflater->index == index;
+		                       });
+		if (it != inflaters.end()) {
+			inflaters.splice(inflaters.begin(), inflaters, it);
+			return *inflaters.front();
+		}
+		if (inflaters.size() < zip_max_inflaters)
+			inflaters.push_front(std::make_unique<Inflater>());
+		else
+			inflaters.splice(inflaters.begin(), inflaters,
+			                 std::prev(inflaters.end()));
+		auto &inflater = *inflaters.front();
+		inflater.index = index;
+		inflater.inflated = UINT32_MAX; // start over
+		return inflater;
+	}
+};
+
+// A file opened from the archive, which turns into a copy in the overlay
+// directory when it's first written
+class zipFile final : public DOS_File {
+public:
+	zipFile(zipDrive *drive, size_t index, const char *name,
+	        const FileStat_Block &stat);
+	zipFile(const zipFile &) = delete;            // prevent copying
+	zipFile &operator=(const zipFile &) = delete; // prevent assignment
+	~zipFile();
+
+	bool Read(uint8_t *data, uint16_t *size);
+	bool Write(uint8_t *data, uint16_t *size);
+	bool Seek(uint32_t *pos, uint32_t type);
+	bool Close();
+	uint16_t GetInformation();
+
+private:
+	zipDrive *drive = nullptr;
+	size_t index = 0;
+	uint32_t filePos = 0;
+	uint32_t fileSize = 0;
+	DOS_File *copy = nullptr; // in the overlay, once written
+};
+
+zipFile::zipFile(zipDrive *zip_drive, const size_t entry_index,
+                 const char *name, const FileStat_Block &stat)
+        : drive(zip_drive),
+          index(entry_index),
+          fileSize(stat.size)
+{
+	SetName(name);
+	time = stat.time;
+	date = stat.date;
+	attr = stat.attr;
+	open = true;
+}
+
+zipFile::~zipFile()
+{
+	delete copy;
+}
+
+bool zipFile::Read(uint8_t *data, uint16_t *size)
+{
+	if ((flags & 0xf) == OPEN_WRITE) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	if (copy)
+		return copy->Read(data, size);
+
+	if (filePos >= fileSize)
+		*size = 0;
+	else if (*size > fileSize - filePos)
+		*size = static_cast<uint16_t>(fileSize - filePos);
+	if (*size && !drive->ReadFileData(index, filePos, data, size)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	filePos += *size;
+	return true;
+}
+
+bool zipFile::Write(uint8_t *data, uint16_t *size)
+{
+	const auto mode = flags & 0xf;
+	if (mode == OPEN_READ || mode == OPEN_READ_NO_MOD) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	if (!copy) {
+		copy = drive->CopyToOverlay(index, GetName());
+		if (!copy) {
+			DOS_SetError(DOSERR_ACCESS_DENIED);
+			return false;
+		}
+		copy->flags = flags;
+		uint32_t pos = filePos;
+		copy->Seek(&pos, DOS_SEEK_SET);
+	}
+	return copy->Write(data, size);
+}
+
+bool zipFile::Seek(uint32_t *pos, uint32_t type)
+{
+	if (copy)
+		return copy->Seek(pos, type);
+
+	// Like other files, positions past the end are allowed, with the
+	// offset being signed
+	const auto offset = static_cast<int32_t>(*pos);
+	int64_t new_pos = 0;
+	switch (type) {
+	case DOS_SEEK_SET: new_pos = offset; break;
+	case DOS_SEEK_CUR: new_pos = static_cast<int64_t>(filePos) + offset; break;
+	case DOS_SEEK_END: new_pos = static_cast<int64_t>(fileSize) + offset; break;
+	default: DOS_SetError(DOSERR_FUNCTION_NUMBER_INVALID); return false;
+	}
+	if (new_pos < 0 || new_pos > UINT32_MAX) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	filePos = static_cast<uint32_t>(new_pos);
+	*pos = filePos;
+	return true;
+}
+
+bool zipFile::Close()
+{
+	if (refCtr == 1) {
+		open = false;
+		if (copy)
+			return copy->Close();
+	}
+	return true;
+}
+
+uint16_t zipFile::GetInformation()
+{
+	return drive->HasOverlay() ? 0 : 0x40; // read-only without overlay
+}
+
+zipDrive::zipDrive(const char *archive_path, const uint8_t media_id, bool &success)
+        : inflaters(std::make_unique<InflaterPool>()),
+          mediaid(media_id)
+{
+	type = DosDriveType::Zip;
+	safe_strcpy(info, archive_path);
+
+	const auto dos_section = static_cast<Section_prop *>(control->GetSection("dos"));
+	assert(dos_section);
+	blockCacheSize = std::max<size_t>(1, static_cast<size_t>(dos_section->Get_int("zip_block_cache")) *
+	                                             1024 / ZIP_BLOCK_SIZE);
+
+	archive = fopen_wrap(archive_path, "rb");
+	success = archive && LoadArchive();
+	if (success)
+		LOG_MSG("ZIP: Indexed %u entries in %s", static_cast<unsigned>(entries.size() - 1),
+		        archive_path);
+}
+
+zipDrive::~zipDrive()
+{
+	if (archive)
+		fclose(archive);
+}
+
+bool zipDrive::LoadArchive()
+{
+	// The end of central directory record is followed only by the
+	// archive comment, so it's in the last 64 KB of the archive
+	std::error_code ec = {};
+	const auto archive_size = static_cast<int64_t>(std_fs::file_size(info, ec));
+	if (ec || archive_size < static_cast<int64_t>(zip_end_size))
+		return false;
+	const auto tail_size = static_cast<size_t>(
+	        std::min<int64_t>(archive_size, zip_end_size + zip_max_comment));
+	std::vector<uint8_t> tail(tail_size);
+	const auto tail_pos = archive_size - static_cast<int64_t>(tail_size);
+	if (read_file_at(archive, tail.data(), tail_size, tail_pos) !=
+	    static_cast<int64_t>(tail_size))
+		return false;
+
+	size_t end_pos = tail_size - zip_end_size + 1;
+	do {
+		if (end_pos-- == 0) {
+			LOG_WARNING("ZIP: %s isn't a ZIP archive", info);
+			return false;
+		}
+	} while (host_readd(&tail[end_pos]) != zip_end_sig);
+
+	const auto end = &tail[end_pos];
+	uint64_t num_entries = host_readw(end + 10);
+	uint64_t directory_size = host_readd(end + 12);
+	uint64_t directory_pos = host_readd(end + 16);
+
+	// ZIP64 archives keep the values that don't fit in their own record
+	if (end_pos >= zip64_locator_size &&
+	    host_readd(end - zip64_locator_size) == zip64_locator_sig) {
+		uint8_t zip64_end[zip64_end_size];
+		const auto zip64_end_pos = read_qword(end - zip64_locator_size + 8);
+		if (read_file_at(archive, zip64_end, sizeof(zip64_end),
+		                 static_cast<int64_t>(zip64_end_pos)) ==
+		            static_cast<int64_t>(sizeof(zip64_end)) &&
+		    host_readd(zip64_end) == zip64_end_sig) {
+			num_entries = read_qword(zip64_end + 32);
+			directory_size = read_qword(zip64_end + 40);
+			directory_pos = read_qword(zip64_end + 48);
+		}
+	}
+	if (directory_pos + directory_size > static_cast<uint64_t>(archive_size)) {
+		LOG_WARNING("ZIP: The central directory of %s is damaged", info);
+		return false;
+	}
+
+	std::vector<uint8_t> directory(static_cast<size_t>(directory_size));
+	if (read_file_at(archive, directory.data(), directory.size(),
+	                 static_cast<int64_t>(directory_pos)) !=
+	    static_cast<int64_t>(directory.size()))
+		return false;
+
+	entries.clear();
+	entries.emplace_back(); // the root directory
+	entries.front().is_dir = true;
+	entries.front().attr = DOS_ATTR_DIRECTORY;
+
+	size_t skipped = 0;
+	size_t pos = 0;
+	for (uint64_t i = 0; i < num_entries; ++i) {
+		if (pos + zip_central_header_size > directory.size() ||
+		    host_readd(&directory[pos]) != zip_central_header_sig) {
+			LOG_WARNING("ZIP: The central directory of %s is damaged", info);
+			return false;
+		}
+		const auto header = &directory[pos];
+		const auto name_len = host_readw(header + 28);
+		const auto extra_len = host_readw(header + 30);
+		const auto comment_len = host_readw(header + 32);
+		const auto record_size = zip_central_header_size + name_len +
+		                         extra_len + comment_len;
+		if (pos + record_size > directory.size()) {
+			LOG_WARNING("ZIP: The central directory of %s is damaged", info);
+			return false;
+		}
+		pos += record_size;
+
+		const auto host_system = header[5];
+		const auto flags = host_readw(header + 8);
+		const auto method = host_readw(header + 10);
+		uint64_t compressed_size = host_readd(header + 20);
+		uint64_t size = host_readd(header + 24);
+		uint64_t header_offset = host_readd(header + 42);
+
+		// The ZIP64 extra field holds the sizes and offset that don't
+		// fit, in that order
+		auto extra = header + zip_central_header_size + name_len;
+		const auto extra_end = extra + extra_len;
+		while (extra + 4 <= extra_end) {
+			const auto id = host_readw(extra);
+			const auto len = host_readw(extra + 2);
+			auto field = extra + 4;
+			extra = field + len;
+			if (id != 0x0001 || extra > extra_end)
+				continue;
+			for (auto value : {&size, &compressed_size, &header_offset}) {
+				if (*value != UINT32_MAX || field + 8 > extra)
+					continue;
+				*value = read_qword(field);
+				field += 8;
+			}
+		}
+
+		std::string name(reinterpret_cast<const char *>(
+		                         header + zip_central_header_size),
+		                 name_len);
+		// Names are in code page 437, unless flagged as UTF-8
+		if (flags & 0x800) {
+			std::string dos_name;
+			UTF8_RenderForDos(name, dos_name, UTF8_GetCodePage());
+			name = dos_name;
+		}
+		std::replace(name.begin(), name.end(), '\\', '/');
+		const bool is_dir = !name.empty() && name.back() == '/';
+
+		// Walk down the path, adding the directories on the way
+		size_t parent = 0;
+		bool valid = true;
+		std::vector<std::string> parts = {};
+		for (size_t start = 0; start < name.size();) {
+			auto end_part = name.find('/', start);
+			if (end_part == std::string::npos)
+				end_part = name.size();
+			const auto part = name.substr(start, end_part - start);
+			start = end_part + 1;
+			if (part.empty() || part == ".")
+				continue;
+			if (part == "..")
+				valid = false;
+			parts.push_back(part);
+		}
+		if (!valid || parts.empty()) {
+			++skipped;
+			continue;
+		}
+		for (size_t p = 0; p + 1 < parts.size(); ++p)
+			parent = AddEntry(parent, parts[p], true);
+		const auto index = AddEntry(parent, parts.back(), is_dir);
+		if (is_dir)
+			continue;
+
+		// Files that can't be read are still listed, but fail to open
+		auto &entry = entries[index];
+		if ((flags & 0x1) ||
+		    (method != zip_method_stored && method != zip_method_deflated) ||
+		    size > UINT32_MAX) {
+			LOG_WARNING("ZIP: Can't read %s from %s, as it's %s", name.c_str(),
+			            info,
+			            (flags & 0x1)         ? "encrypted"
+			            : size > UINT32_MAX ? "over 4 GB"
+			                                : "compressed with an unsupported method");
+		}
+		entry.header_offset = header_offset;
+		entry.compressed_size = compressed_size;
+		entry.size = static_cast<uint32_t>(std::min<uint64_t>(size, UINT32_MAX));
+		entry.crc = host_readd(header + 16);
+		entry.method = (flags & 0x1) ? UINT16_MAX : method;
+		entry.time = host_readw(header + 12);
+		entry.date = host_readw(header + 14);
+
+		// The low byte of the attributes holds the DOS ones for archives
+		// made on DOS, OS/2, Windows NT, and VFAT systems
+		const auto host_attr = header[38];
+		if (host_system == 0 || host_system == 6 || host_system == 10 ||
+		    host_system == 11 || host_system == 14)
+			entry.attr = host_attr & (DOS_ATTR_READ_ONLY | DOS_ATTR_HIDDEN |
+			                          DOS_ATTR_SYSTEM | DOS_ATTR_ARCHIVE);
+		else
+			entry.attr = DOS_ATTR_ARCHIVE;
+		total_size += entry.size;
+	}
+	if (skipped)
+		LOG_WARNING("ZIP: Skipped %u entries with invalid names in %s",
+		            static_cast<unsigned>(skipped), info);
+
+	for (size_t i = 0; i < entries.size(); ++i)
+		if (entries[i].is_dir)
+			AssignShortNames(i);
+	IndexPaths(0, "");
+	return true;
+}
+
+// Adds an entry to the directory, or returns the one by the same name; a
+// file added again replaces the earlier one, as in an updated archive
+size_t zipDrive::AddEntry(const size_t parent, const std::string &long_name,
+                          const bool is_dir)
+{
+	for (const auto child : entries[parent].children) {
+		auto &entry = entries[child];
+		if (!string_iequals(entry.long_name, long_name))
+			continue;
+		if (entry.is_dir || is_dir)
+			return child;
+		total_size -= entry.size;
+		entry = Entry();
+		entry.long_name = long_name;
+		return child;
+	}
+	const auto index = entries.size();
+	Entry entry = {};
+	entry.long_name = long_name;
+	entry.is_dir = is_dir;
+	entry.attr = is_dir ? DOS_ATTR_DIRECTORY : DOS_ATTR_ARCHIVE;
+	entry.date = DOS_PackDate(1980, 1, 1);
+	entries.push_back(std::move(entry));
+	entries[parent].children.push_back(index);
+	return index;
+}
+
+void zipDrive::AssignShortNames(const size_t dir)
+{
+	const auto &children = entries[dir].children;
+	std::vector<std::string> long_names = {};
+	for (const auto child : children)
+		long_names.push_back(entries[child].long_name);
+	const auto names = generate_unique_8x3_names(long_names);
+	for (size_t i = 0; i < children.size(); ++i)
+		entries[children[i]].name = names[i];
+}
+
+void zipDrive::IndexPaths(const size_t dir, const std::string &path)
+{
+	for (const auto child : entries[dir].children) {
+		const auto &entry = entries[child];
+		if (entry.name.empty())
+			continue;
+		const auto child_path = path.empty() ? entry.name
+		                                     : path + "\\" + entry.name;
+		paths[child_path] = child;
+		if (entry.is_dir)
+			IndexPaths(child, child_path);
+	}
+}
+
+bool zipDrive::Lookup(const char *name, size_t &index) const
+{
+	std::string path = name;
+	upcase(path);
+	while (!path.empty() && path.back() == '\\')
+		path.pop_back();
+	if (path.empty()) {
+		index = 0;
+		return true;
+	}
+	const auto it = paths.find(path);
+	if (it == paths.end())
+		return false;
+	index = it->second;
+	return true;
+}
+
+// The file's data follows its local header, whose name and extra field can
+// differ in length from the central directory's
+bool zipDrive::FindData(Entry &entry)
+{
+	if (entry.data_offset)
+		return true;
+	uint8_t header[zip_local_header_size];
+	if (read_file_at(archive, header, sizeof(header),
+	                 static_cast<int64_t>(entry.header_offset)) !=
+	            static_cast<int64_t>(sizeof(header)) ||
+	    host_readd(header) != zip_local_header_sig) {
+		LOG_WARNING("ZIP: The local header of %s in %s is damaged",
+		            entry.long_name.c_str(), info);
+		return false;
+	}
+	entry.data_offset = entry.header_offset + zip_local_header_size +
+	                    host_readw(header + 26) + host_readw(header + 28);
+	return true;
+}
+
+// Adds a block at the front of the cache, reusing the least recently used
+// one if the cache is full, and returns its data to fill in
+std::vector<uint8_t> &zipDrive::CacheBlock(const uint64_t key)
+{
+	const auto cached = blockCacheIndex.find(key);
+	if (cached != blockCacheIndex.end()) {
+		blockCache.splice(blockCache.begin(), blockCache, cached->second);
+		return blockCache.front().data;
+	}
+	if (blockCache.size() < blockCacheSize) {
+		blockCache.emplace_front();
+	} else {
+		blockCacheIndex.erase(blockCache.back().key);
+		blockCache.splice(blockCache.begin(), blockCache,
+		                  std::prev(blockCache.end()));
+	}
+	auto &block = blockCache.front();
+	block.key = key;
+	blockCacheIndex[key] = blockCache.begin();
+	return block.data;
+}
+
+bool zipDrive::Inflate(Inflater &inflater, Entry &entry, uint8_t *data,
+                       const uint32_t size)
+{
+	auto &stream = inflater.stream;
+	stream.next_out = data;
+	stream.avail_out = size;
+	while (stream.avail_out) {
+		if (!stream.avail_in && inflater.compressed_left) {
+			const auto chunk = static_cast<size_t>(std::min<uint64_t>(
+			        inflater.compressed_left, sizeof(inflater.input)));
+			if (read_file_at(archive, inflater.input, chunk,
+			                 static_cast<int64_t>(inflater.read_pos)) !=
+			    static_cast<int64_t>(chunk))
+				return false;
+			inflater.read_pos += chunk;
+			inflater.compressed_left -= chunk;
+			stream.next_in = inflater.input;
+			stream.avail_in = static_cast<uInt>(chunk);
+		}
+		const auto result = inflate(&stream, Z_NO_FLUSH);
+		if (result == Z_STREAM_END)
+			break;
+		if (result != Z_OK) {
+			LOG_WARNING("ZIP: Can't decompress %s in %s", entry.long_name.c_str(), info);
+			return false;
+		}
+	}
+	if (stream.avail_out)
+		return false;
+
+	inflater.crc = crc32(inflater.crc, data, size);
+	inflater.inflated += size;
+	if (inflater.inflated == entry.size && inflater.crc != entry.crc)
+		LOG_WARNING("ZIP: %s in %s fails its CRC check", entry.long_name.c_str(), info);
+	return true;
+}
+
+// Returns a block of the file, from the cache if it's there. Deflated files
+// are decompressed from the start up to the block, or from the block the
+// file's decompression left off at, caching each block on the way.
+const std::vector<uint8_t> *zipDrive::ReadBlock(const size_t index, const uint32_t block)
+{
+	const uint64_t key = (static_cast<uint64_t>(index) << 32) | block;
+	const auto cached = blockCacheIndex.find(key);
+	if (cached != blockCacheIndex.end()) {
+		blockCache.splice(blockCache.begin(), blockCache, cached->second);
+		return &cached->second->data;
+	}
+
+	auto &entry = entries[index];
+	if (!FindData(entry))
+		return nullptr;
+	const auto start = block * ZIP_BLOCK_SIZE;
+	if (start >= entry.size)
+		return nullptr;
+
+	if (entry.method == zip_method_stored) {
+		const auto size = std::min(ZIP_BLOCK_SIZE, entry.size - start);
+		std::vector<uint8_t> data(size);
+		if (read_file_at(archive, data.data(), size,
+		                 static_cast<int64_t>(entry.data_offset + start)) != size)
+			return nullptr;
+		auto &cached_data = CacheBlock(key);
+		cached_data = std::move(data);
+		return &cached_data;
+	}
+	if (entry.method != zip_method_deflated)
+		return nullptr;
+
+	auto &inflater = inflaters->Get(index);
+
+	if (inflater.inflated > start) {
+		if (!inflater.started) {
+			if (inflateInit2(&inflater.stream, -MAX_WBITS) != Z_OK)
+				return nullptr;
+			inflater.started = true;
+		} else {
+			inflateReset(&inflater.stream);
+		}
+		inflater.stream.avail_in = 0;
+		inflater.read_pos = entry.data_offset;
+		inflater.compressed_left = entry.compressed_size;
+		inflater.inflated = 0;
+		inflater.crc = 0;
+	}
+	while (true) {
+		const auto block_start = inflater.inflated;
+		const auto size = std::min(ZIP_BLOCK_SIZE, entry.size - block_start);
+		std::vector<uint8_t> data(size);
+		if (!Inflate(inflater, entry, data.data(), size)) {
+			inflater.inflated = UINT32_MAX; // start over next time
+			return nullptr;
+		}
+		const uint64_t block_key = (static_cast<uint64_t>(index) << 32) |
+		                           (block_start / ZIP_BLOCK_SIZE);
+		auto &cached_data = CacheBlock(block_key);
+		cached_data = std::move(data);
+		if (block_start == start)
+			return &cached_data;
+	}
+}
+
+bool zipDrive::ReadFileData(const size_t index, uint32_t pos, uint8_t *data,
+                            uint16_t *size)
+{
+	uint16_t done = 0;
+	while (done < *size) {
+		const auto block = ReadBlock(index, pos / ZIP_BLOCK_SIZE);
+		if (!block)
+			return false;
+		const auto offset = pos % ZIP_BLOCK_SIZE;
+		if (offset >= block->size())
+			break;
+		const auto chunk = std::min<size_t>(*size - done, block->size() - offset);
+		memcpy(data + done, block->data() + offset, chunk);
+		done += static_cast<uint16_t>(chunk);
+		pos += static_cast<uint32_t>(chunk);
+	}
+	*size = done;
+	return true;
+}
+
+void zipDrive::SetOverlay(const char *dir, const uint16_t bytes_sector,
+                          const uint8_t sectors_cluster,
+                          const uint16_t total_clusters,
+                          const uint16_t free_clusters)
+{
+	overlay = std::make_unique<localDrive>(dir, bytes_sector, sectors_cluster,
+	                                       total_clusters, free_clusters,
+	                                       mediaid);
+	searches.clear();
+}
+
+bool zipDrive::InOverlay(const char *name) const
+{
+	if (!overlay)
+		return false;
+	char path[DOS_PATHLENGTH];
+	safe_strcpy(path, name);
+	return overlay->FileExists(path) || overlay->TestDir(path);
+}
+
+// Creates the directories leading up to the file or directory in the
+// overlay, as they're in the archive
+void zipDrive::MakeOverlayDirs(const char *name)
+{
+	char path[DOS_PATHLENGTH];
+	safe_strcpy(path, name);
+	for (auto separator = strchr(path, '\\'); separator;
+	     separator = strchr(separator + 1, '\\')) {
+		*separator = '\0';
+		if (!overlay->TestDir(path))
+			overlay->MakeDir(path);
+		*separator = '\\';
+	}
+}
+
+// Copies a file from the archive to the overlay, returning it opened for
+// reading and writing
+DOS_File *zipDrive::CopyToOverlay(const size_t index, const char *name)
+{
+	if (!overlay)
+		return nullptr;
+	MakeOverlayDirs(name);
+	char path[DOS_PATHLENGTH];
+	safe_strcpy(path, name);
+	DOS_File *file = nullptr;
+	if (!overlay->FileCreate(&file, path, DOS_ATTR_ARCHIVE))
+		return nullptr;
+	file->AddRef();
+
+	const auto &entry = entries[index];
+	std::vector<uint8_t> buffer(ZIP_BLOCK_SIZE);
+	for (uint32_t pos = 0; pos < entry.size;) {
+		auto size = static_cast<uint16_t>(std::min(ZIP_BLOCK_SIZE, entry.size - pos));
+		const auto requested = size;
+		if (!ReadFileData(index, pos, buffer.data(), &size) ||
+		    !file->Write(buffer.data(), &size) || size != requested) {
+			LOG_WARNING("ZIP: Can't copy %s to the overlay", name);
+			file->Close();
+			delete file;
+			char unlink_path[DOS_PATHLENGTH];
+			safe_strcpy(unlink_path, name);
+			overlay->FileUnlink(unlink_path);
+			return nullptr;
+		}
+		pos += size;
+	}
+	// Keep the archive's date and time
+	file->time = entry.time;
+	file->date = entry.date;
+	file->newtime = true;
+	return file;
+}
+
+bool zipDrive::FileOpen(DOS_File **file, char *name, const uint32_t flags)
+{
+	if (InOverlay(name))
+		return overlay->FileOpen(file, name, flags);
+
+	size_t index = 0;
+	if (!Lookup(name, index) || entries[index].is_dir) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	const auto mode = flags & 0xf;
+	if (mode == OPEN_WRITE && !overlay) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	FileStat_Block stat = {};
+	FileStat(name, &stat);
+	*file = new zipFile(this, index, name, stat);
+	(*file)->flags = flags;
+	return true;
+}
+
+bool zipDrive::FileCreate(DOS_File **file, char *name, const uint16_t attributes)
+{
+	size_t index = 0;
+	if (!overlay || (Lookup(name, index) && entries[index].is_dir)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	MakeOverlayDirs(name);
+	return overlay->FileCreate(file, name, attributes);
+}
+
+// Files and directories in the archive stay, so only those created in the
+// overlay can be removed or renamed
+bool zipDrive::FileUnlink(char *name)
+{
+	size_t index = 0;
+	if (Lookup(name, index)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	if (!overlay) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	return overlay->FileUnlink(name);
+}
+
+bool zipDrive::RemoveDir(char *dir)
+{
+	size_t index = 0;
+	if (!overlay || Lookup(dir, index)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	return overlay->RemoveDir(dir);
+}
+
+bool zipDrive::MakeDir(char *dir)
+{
+	size_t index = 0;
+	if (!overlay || Lookup(dir, index)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	MakeOverlayDirs(dir);
+	return overlay->MakeDir(dir);
+}
+
+bool zipDrive::TestDir(char *dir)
+{
+	size_t index = 0;
+	if (Lookup(dir, index))
+		return entries[index].is_dir;
+	return overlay && overlay->TestDir(dir);
+}
+
+bool zipDrive::Rename(char *oldname, char *newname)
+{
+	size_t index = 0;
+	if (!overlay || Lookup(oldname, index) || Lookup(newname, index)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	MakeOverlayDirs(newname);
+	return overlay->Rename(oldname, newname);
+}
+
+bool zipDrive::FindFirst(char *_dir, DOS_DTA &dta, bool fcb_findfirst)
+{
+	size_t dir = 0;
+	const bool in_archive = Lookup(_dir, dir) && entries[dir].is_dir;
+	const bool in_overlay = overlay && overlay->TestDir(_dir);
+	if (!in_archive && !in_overlay) {
+		DOS_SetError(DOSERR_PATH_NOT_FOUND);
+		return false;
+	}
+
+	uint8_t attr = 0;
+	char pattern[CROSS_LEN];
+	dta.GetSearchParams(attr, pattern);
+	const auto label = GetLabel();
+	if (attr == DOS_ATTR_VOLUME) {
+		if (is_empty(label)) {
+			DOS_SetError(DOSERR_NO_MORE_FILES);
+			return false;
+		}
+		dta.SetResult(label, 0, 0, 0, DOS_ATTR_VOLUME);
+		return true;
+	}
+
+	Search search = {};
+	std::unordered_set<std::string> overlay_names = {};
+	if (in_overlay) {
+		char name[DOS_NAMELENGTH_ASCII];
+		SearchResult result = {};
+		for (bool found = overlay->FindFirst(_dir, dta, fcb_findfirst); found;
+		     found = overlay->FindNext(dta)) {
+			dta.GetResult(name, result.size, result.date, result.time,
+			              result.attr);
+			if (result.attr & DOS_ATTR_VOLUME)
+				continue;
+			result.name = name;
+			overlay_names.insert(result.name);
+			search.results.push_back(result);
+		}
+	}
+	if (in_archive) {
+		const auto add_result = [&](const char *name, const Entry &entry) {
+			if (!WildFileCmp(name, pattern) || overlay_names.count(name))
+				return;
+			auto find_attr = entry.attr;
+			if (!overlay && !entry.is_dir)
+				find_attr |= DOS_ATTR_READ_ONLY;
+			if (~attr & find_attr &
+			    (DOS_ATTR_DIRECTORY | DOS_ATTR_HIDDEN | DOS_ATTR_SYSTEM))
+				return;
+			search.results.push_back({name, entry.size, entry.date,
+			                          entry.time, find_attr});
+		};
+		if (dir != 0) {
+			add_result(".", entries[dir]);
+			add_result("..", entries[dir]);
+		}
+		for (const auto child : entries[dir].children)
+			if (!entries[child].name.empty())
+				add_result(entries[child].name.c_str(), entries[child]);
+	}
+
+	// Volume labels come first, and only from the root directory
+	if ((attr & DOS_ATTR_VOLUME) && !*_dir && !fcb_findfirst &&
+	    !is_empty(label) && WildFileCmp(label, pattern))
+		search.results.insert(search.results.begin(),
+		                      {label, 0, 0, 0, DOS_ATTR_VOLUME});
+
+	const auto id = nextSearchId;
+	nextSearchId = (nextSearchId + 1) % MAX_OPENDIRS;
+	searches[id] = std::move(search);
+	dta.SetDirID(id);
+	return FindNext(dta);
+}
+
+bool zipDrive::FindNext(DOS_DTA &dta)
+{
+	const auto it = searches.find(dta.GetDirID());
+	if (it == searches.end() || it->second.next >= it->second.results.size()) {
+		if (it != searches.end())
+			searches.erase(it);
+		DOS_SetError(DOSERR_NO_MORE_FILES);
+		return false;
+	}
+	const auto &result = it->second.results[it->second.next++];
+	dta.SetResult(result.name.c_str(), result.size, result.date, result.time,
+	              result.attr);
+	return true;
+}
+
+bool zipDrive::GetFileAttr(char *name, uint16_t *attr)
+{
+	if (InOverlay(name))
+		return overlay->GetFileAttr(name, attr);
+	size_t index = 0;
+	if (!Lookup(name, index)) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	*attr = entries[index].attr;
+	if (!overlay && !entries[index].is_dir)
+		*attr |= DOS_ATTR_READ_ONLY;
+	return true;
+}
+
+bool zipDrive::SetFileAttr(const char *name, const uint16_t attr)
+{
+	if (InOverlay(name))
+		return overlay->SetFileAttr(name, attr);
+	size_t index = 0;
+	DOS_SetError(Lookup(name, index) ? DOSERR_ACCESS_DENIED : DOSERR_FILE_NOT_FOUND);
+	return false;
+}
+
+bool zipDrive::AllocationInfo(uint16_t *bytes_sector, uint8_t *sectors_cluster,
+                              uint16_t *total_clusters, uint16_t *free_clusters)
+{
+	if (overlay)
+		return overlay->AllocationInfo(bytes_sector, sectors_cluster,
+		                               total_clusters, free_clusters);
+	*bytes_sector = 512;
+	*sectors_cluster = 32;
+	*total_clusters = static_cast<uint16_t>(
+	        std::min<uint64_t>(total_size / (512 * 32) + 1, UINT16_MAX));
+	*free_clusters = 0;
+	return true;
+}
+
+bool zipDrive::FileExists(const char *name)
+{
+	size_t index = 0;
+	if (Lookup(name, index) && !entries[index].is_dir)
+		return true;
+	return overlay && overlay->FileExists(name);
+}
+
+bool zipDrive::FileStat(const char *name, FileStat_Block *const stat_block)
+{
+	if (InOverlay(name))
+		return overlay->FileStat(name, stat_block);
+	size_t index = 0;
+	if (!Lookup(name, index))
+		return false;
+	const auto &entry = entries[index];
+	stat_block->attr = entry.attr;
+	if (!overlay && !entry.is_dir)
+		stat_block->attr |= DOS_ATTR_READ_ONLY;
+	stat_block->size = entry.size;
+	stat_block->date = entry.date;
+	stat_block->time = entry.time;
+	return true;
+}
+
+uint8_t zipDrive::GetMediaByte()
+{
+	return mediaid;
+}
+
+void zipDrive::EmptyCache()
+{
+	if (overlay)
+		overlay->EmptyCache();
+}
+
+bool zipDrive::isRemote()
+{
+	return false;
+}
+
+bool zipDrive::isRemovable()
+{
+	return false;
+}
+
+Bits zipDrive::UnMount()
+{
+	delete this;
+	return 0;
+}
@@ -18,6 +18,7 @@
 #include "drives.h"
 
 #include <string_view>
+#include <unordered_set>
 
 #include "bios_disk.h"
 #include "ide.h"
@@ -181,6 +182,31 @@ bool filename_not_strict_8x3(const char *n)
 	return false; /* it is strict 8.3 upper case */
 }
 
+std::vector<std::string> generate_unique_8x3_names(const std::vector<std::string> &names)
+{
+	std::vector<std::string> dos_names(names.size());
+	std::unordered_set<std::string> taken = {};
+	for (size_t i = 0; i < names.size(); ++i) {
+		if (filename_not_8x3(names[i].c_str()))
+			continue;
+		auto name = names[i];
+		upcase(name);
+		if (taken.insert(name).second)
+			dos_names[i] = name;
+	}
+	// The rest, including those differing only in case, get a number
+	for (size_t i = 0; i < names.size(); ++i) {
+		for (unsigned int num = 1; dos_names[i].empty(); ++num) {
+			const auto name = generate_8x3(names[i].c_str(), num);
+			if (name.empty())
+				break;
+			if (taken.insert(name).second)
+				dos_names[i] = name;
+		}
+	}
+	return dos_names;
+}
+
 DOS_Drive::DOS_Drive()
 	: dirCache()
 {
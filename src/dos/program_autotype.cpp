@@ -149,6 +149,9 @@ void AUTOTYPE::Run()
 		return;
 	const auto pace_ms = static_cast<uint32_t>(pace_s * 1000);
 
+	// Hold each button back until the previous ones have been read?
+	const bool wait_for_empty_buffer = cmd->FindExist("-b", true);
+
 	// Get the button sequence
 	std::vector<std::string> sequence;
 	cmd->FillVector(sequence);
@@ -156,7 +159,7 @@ void AUTOTYPE::Run()
 		WriteOut_NoParsing("AUTOTYPE: button sequence is empty\n");
 		return;
 	}
-	MAPPER_AutoType(sequence, wait_ms, pace_ms);
+	MAPPER_AutoType(sequence, wait_ms, pace_ms, wait_for_empty_buffer);
 }
 
 void AUTOTYPE::AddMessages() {
@@ -165,11 +168,12 @@ void AUTOTYPE::AddMessages() {
 	        "\n"
 	        "Usage:\n"
 	        "  [color=green]autotype[reset] -list\n"
-	        "  [color=green]autotype[reset] [-w [color=white]WAIT[reset]] [-p [color=white]PACE[reset]] [color=cyan]BUTTONS[reset]\n"
+	        "  [color=green]autotype[reset] [-w [color=white]WAIT[reset]] [-p [color=white]PACE[reset]] [-b] [color=cyan]BUTTONS[reset]\n"
 	        "\n"
 	        "Where:\n"
 	        "  [color=white]WAIT[reset]    is the number of seconds to wait before typing begins (max of 30).\n"
 	        "  [color=white]PACE[reset]    is the number of seconds before each keystroke (max of 10).\n"
+	        "  -b      waits for the keyboard buffer to be empty before each keystroke.\n"
 	        "  [color=cyan]BUTTONS[reset] is one or more space-separated buttons.\n"
 	        "\n"
 	        "Notes:\n"
@@ -177,6 +181,7 @@ void AUTOTYPE::AddMessages() {
 	        "  after they start. Autotyping begins after [color=cyan]WAIT[reset] seconds, and each button is\n"
 	        "  entered every [color=white]PACE[reset] seconds. The [color=cyan],[reset] character inserts an extra [color=white]PACE[reset] delay.\n"
 	        "  [color=white]WAIT[reset] and [color=white]PACE[reset] default to 2 and 0.5 seconds respectively if not specified.\n"
+	        "  Both are measured in emulated time, so they follow the emulation speed.\n"
 	        "  A list of all available button names can be obtained using the -list option.\n"
 	        "\n"
 	        "Examples:\n"
@@ -229,6 +229,9 @@ void MOUNT::Run(void) {
 			sizes[count] = atoi(number);
 		}
 
+		const bool preload = cmd->FindExist("-preload", true);
+		const bool write_through = cmd->FindExist("-writethrough", true);
+
 		// get the drive letter
 		cmd->FindCommand(1,temp_line);
 		if ((temp_line.size() > 2) || ((temp_line.size() > 1) && (temp_line[1]!=':'))) goto showusage;
@@ -298,13 +301,20 @@ void MOUNT::Run(void) {
 			WriteOut(MSG_Get("PROGRAM_MOUNT_ERROR_1"),temp_line.c_str());
 			return;
 		}
-		/* Not a switch so a normal directory/file */
-		if (!S_ISDIR(test.st_mode)) {
+		/* Not a switch so a normal directory/file, or a ZIP archive
+		 * mounted in place of a directory */
+		std::string extension = temp_line.size() > 4
+		                                ? temp_line.substr(temp_line.size() - 4)
+		                                : "";
+		upcase(extension);
+		const bool is_zip = type == "dir" && S_ISREG(test.st_mode) &&
+		                    extension == ".ZIP";
+		if (!S_ISDIR(test.st_mode) && !is_zip) {
 			WriteOut(MSG_Get("PROGRAM_MOUNT_ERROR_2"),temp_line.c_str());
 			return;
 		}
 
-		if (temp_line[temp_line.size() - 1] != CROSS_FILESPLIT) temp_line += CROSS_FILESPLIT;
+		if (!is_zip && temp_line[temp_line.size() - 1] != CROSS_FILESPLIT) temp_line += CROSS_FILESPLIT;
 		uint8_t int8_tize = (uint8_t)sizes[1];
 
 		if (type == "cdrom") {
@@ -342,7 +352,16 @@ void MOUNT::Run(void) {
 #else
 			if (temp_line == "/") WriteOut(MSG_Get("PROGRAM_MOUNT_WARNING_OTHER"));
 #endif
-			if (type == "overlay") {
+			zipDrive *zdp = dynamic_cast<zipDrive *>(
+			        Drives[drive_index(drive)]);
+			if (type == "overlay" && zdp) {
+				// Archives take the overlay in place of a
+				// copy-on-write drive, as there's no base
+				// directory to compare with
+				zdp->SetOverlay(temp_line.c_str(), sizes[0],
+				                int8_tize, sizes[2], sizes[3]);
+				newdrive = zdp;
+			} else if (type == "overlay") {
 				localDrive *ldp = dynamic_cast<localDrive *>(
 						Drives[drive_index(drive)]);
 				cdromDrive *cdp = dynamic_cast<cdromDrive *>(
@@ -370,6 +389,30 @@ void MOUNT::Run(void) {
 
 				delete Drives[drive_index(drive)];
 				Drives[drive_index(drive)] = nullptr;
+			} else if (is_zip) {
+				bool success = false;
+				auto zip_drive = new zipDrive(temp_line.c_str(), mediaid, success);
+				if (!success) {
+					WriteOut(MSG_Get("PROGRAM_MOUNT_ZIP_ERROR"),
+					         temp_line.c_str());
+					delete zip_drive;
+					return;
+				}
+				newdrive = zip_drive;
+			} else if (type == "dir" && preload) {
+				bool success = false;
+				auto memory_drive = new Memory_Drive(temp_line.c_str(),
+				                                     write_through,
+				                                     sizes[0], int8_tize,
+				                                     sizes[2], sizes[3],
+				                                     mediaid, success);
+				if (!success) {
+					WriteOut(MSG_Get("PROGRAM_MOUNT_PRELOAD_ERROR"),
+					         temp_line.c_str());
+					delete memory_drive;
+					return;
+				}
+				newdrive = memory_drive;
 			} else {
 				newdrive = new localDrive(temp_line.c_str(),sizes[0],int8_tize,sizes[2],sizes[3],mediaid);
 			}
@@ -431,6 +474,10 @@ void MOUNT::AddMessages() {
 	        "\n"
 	        "Notes:\n"
 	        "  - '-t overlay' redirects writes for mounted drive to another directory.\n"
+	        "  - A ZIP archive can be mounted as a read-only DIRECTORY; add an overlay\n"
+	        "    to keep the files written to it.\n"
+	        "  - '-preload' copies a DIRECTORY into memory; writes stay in memory\n"
+	        "    unless '-writethrough' is also given.\n"
 	        "  - Additional options are described in the manual (README file, chapter 4).\n"
 	        "\n"
 	        "Examples:\n"
@@ -452,6 +499,8 @@ void MOUNT::AddMessages() {
 	MSG_Add("PROGRAM_MOUNT_CDROMS_FOUND","CDROMs found: %d\n");
 	MSG_Add("PROGRAM_MOUNT_ERROR_1","Directory %s doesn't exist.\n");
 	MSG_Add("PROGRAM_MOUNT_ERROR_2","%s isn't a directory\n");
+	MSG_Add("PROGRAM_MOUNT_ZIP_ERROR", "%s isn't a ZIP archive that can be read.\n");
+	MSG_Add("PROGRAM_MOUNT_PRELOAD_ERROR", "%s can't be read into memory.\n");
 	MSG_Add("PROGRAM_MOUNT_ILL_TYPE","Illegal type %s\n");
 	MSG_Add("PROGRAM_MOUNT_ALREADY_MOUNTED","Drive %c already mounted with %s\n");
 	MSG_Add("PROGRAM_MOUNT_UMOUNT_NOT_MOUNTED","Drive %c isn't mounted.\n");
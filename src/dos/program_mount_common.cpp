@@ -91,6 +91,8 @@ void AddMountTypeMessages() {
 	MSG_Add("MOUNT_TYPE_CDROM", "CD-ROM drive");
 	MSG_Add("MOUNT_TYPE_FAT", "FAT drive");
 	MSG_Add("MOUNT_TYPE_ISO", "ISO drive");
+	MSG_Add("MOUNT_TYPE_ZIP", "ZIP archive");
+	MSG_Add("MOUNT_TYPE_MEMORY", "RAM copy of directory");
 	MSG_Add("MOUNT_TYPE_VIRTUAL", "internal virtual drive");
 	MSG_Add("MOUNT_TYPE_UNKNOWN", "unknown drive");
 }
@@ -21,35 +21,43 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <limits>
-#include <thread>
 #include <unistd.h>
 
 #include "callback.h"
 #include "control.h"
 #include "cpu.h"
 #include "cross.h"
+#include "cycle_telemetry.h"
 #include "debug.h"
 #include "dos_inc.h"
 #include "hardware.h"
 #include "inout.h"
 #include "ints/int10.h"
 #include "mapper.h"
+#include "memory_report.h"
+#include "metrics.h"
 #include "midi.h"
 #include "mixer.h"
 #include "ne2000.h"
+#include "netplay.h"
 #include "pci_bus.h"
 #include "pic.h"
 #include "programs.h"
 #include "render.h"
+#include "replay.h"
+#include "rewind.h"
 #include "setup.h"
 #include "shell.h"
+#include "snapshot.h"
 #include "support.h"
+#include "thread_control.h"
 #include "timer.h"
 #include "tracy.h"
 #include "video.h"
@@ -141,11 +149,43 @@ void Null_Init([[maybe_unused]] Section *sec) {
 	// do nothing
 }
 
+// Publishes the cycle rate over the last host second, and the current
+// cycle setting, to the metrics endpoint
+static void update_cycle_metrics()
+{
+	static int64_t last_update_ms = GetTicks();
+	static int64_t last_cycles_total = 0;
+
+	METRICS_Set(Metric::CycleMax, CPU_CycleMax);
+
+	const auto elapsed_ms = GetTicksSince(last_update_ms);
+	if (elapsed_ms < 1000)
+		return;
+	last_update_ms = GetTicks();
+	const auto cycles_total = METRICS_Get(Metric::Cycles);
+	METRICS_Set(Metric::CyclesPerSecond,
+	            (cycles_total - last_cycles_total) * 1000 / elapsed_ms);
+	last_cycles_total = cycles_total;
+}
+
 static Bitu Normal_Loop() {
 	Bits ret;
 	while (1) {
-		if (PIC_RunQueue()) {
+		bool run_cpu;
+		{
+			TelemetryScope scope(TelemetryBucket::Pic);
+			run_cpu = PIC_RunQueue();
+		}
+		if (run_cpu) {
+			TelemetryScope scope(TelemetryBucket::Cpu);
+			const auto budget = CPU_Cycles + CPU_CycleLeft;
 			ret = (*cpudecoder)();
+			if (telemetry_active || metrics_active) {
+				const auto cycles = budget - (CPU_Cycles + CPU_CycleLeft);
+				if (telemetry_active)
+					TELEMETRY_AddCycles(cycles);
+				METRICS_Add(Metric::Cycles, cycles);
+			}
 			if (GCC_UNLIKELY(ret<0)) return 1;
 			if (ret>0) {
 				if (GCC_UNLIKELY(ret >= CB_MAX)) return 0;
@@ -159,6 +199,15 @@ static Bitu Normal_Loop() {
 			if (!GFX_Events())
 				return 0;
 			if (ticksRemain > 0) {
+				if (GCC_UNLIKELY(snapshot_requested))
+					SNAPSHOT_ServiceRequest();
+				ticksRemain += NETPLAY_ServiceTick();
+				REWIND_ServiceTick();
+				REPLAY_ServiceTick();
+				TELEMETRY_EndTick();
+				if (metrics_active)
+					update_cycle_metrics();
+				TelemetryScope scope(TelemetryBucket::Pic);
 				TIMER_AddTick();
 				ticksRemain--;
 			} else {increaseticks();return 0;}
@@ -166,6 +215,90 @@ static Bitu Normal_Loop() {
 	}
 }
 
+/*
+Predictive cycles controller
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Rather than waiting for ticks to overrun, the cycle telemetry is used to keep
+exponentially weighted moving averages of the host time a guest cycle costs
+and of the host time each tick spends outside the CPU core (PIC events,
+rendering, mixing). The cycles are then set so the next tick is predicted to
+use the targeted share of a millisecond. An integral term slowly corrects what
+the model misses, such as IO delays or time taken by other host processes.
+*/
+static struct {
+	double ns_per_cycle = 0.0;
+	double overhead_ns  = 0.0;
+	double integral     = 0.0;
+	bool primed         = false;
+} predictor;
+
+static void predictive_auto_adjust(const TelemetryTotals &totals)
+{
+	if (totals.ticks == 0 || totals.cycles <= 0)
+		return;
+
+	// Like 'reactive', aim for 90% of the requested CPU usage
+	const double target_ns = CPU_CyclePercUsed * 0.9 / 100.0 * 1000000.0;
+
+	const double ticks = totals.ticks;
+	const double cycle_ns = static_cast<double>(totals.cpu_ns) / totals.cycles;
+	const double overhead_ns = (totals.busy_ns - totals.cpu_ns) / ticks;
+	const double busy_ns = totals.busy_ns / ticks;
+
+	// Falling far behind means the averages are stale; restart them from
+	// the current sample so the cycles drop right away.
+	const bool lagging = ticksAdded > 15;
+	if (!predictor.primed || lagging) {
+		predictor.ns_per_cycle = cycle_ns;
+		predictor.overhead_ns = overhead_ns;
+		predictor.integral = 0.0;
+		predictor.primed = true;
+	} else {
+		constexpr double alpha = 0.25;
+		predictor.ns_per_cycle += alpha * (cycle_ns - predictor.ns_per_cycle);
+		predictor.overhead_ns += alpha * (overhead_ns - predictor.overhead_ns);
+
+		constexpr double ki = 0.05;
+		constexpr double integral_limit = 0.5;
+		const double error = (target_ns - busy_ns) / target_ns;
+		predictor.integral = std::clamp(predictor.integral + ki * error,
+		                                -integral_limit,
+		                                integral_limit);
+	}
+	if (predictor.ns_per_cycle <= 0.0)
+		return;
+
+	const double cpu_budget_ns = std::max(target_ns - predictor.overhead_ns,
+	                                      target_ns * 0.1);
+	double cycles = cpu_budget_ns / predictor.ns_per_cycle *
+	                (1.0 + predictor.integral);
+
+	// Limit the step size to hold the pacing steady against outliers,
+	// but let it drop without limit when behind.
+	constexpr double max_growth = 1.25;
+	constexpr double max_shrink = 0.5;
+	cycles = std::min(cycles, CPU_CycleMax * max_growth);
+	if (!lagging)
+		cycles = std::max(cycles, CPU_CycleMax * max_shrink);
+
+	const int32_t upper_limit = CPU_CycleLimit > 0 ? CPU_CycleLimit : 2000000;
+	const auto new_cmax = std::clamp(static_cast<int32_t>(cycles),
+	                                 CPU_CYCLES_LOWER_LIMIT,
+	                                 upper_limit);
+
+	CycleAdjustDecision decision = {};
+	decision.action = lagging ? "predict_lagging" : "predict";
+	decision.old_cycle_max = CPU_CycleMax;
+	decision.new_cycle_max = new_cmax;
+	decision.ratio = static_cast<int32_t>(busy_ns * 1024.0 / target_ns);
+	decision.ticks_done = ticksDone;
+	decision.ticks_scheduled = ticksScheduled;
+	decision.ticks_added = ticksAdded;
+	TELEMETRY_LogAdjust(decision);
+
+	CPU_CycleMax = new_cmax;
+}
+
 void increaseticks() { //Make it return ticksRemain and set it in the function above to remove the global variable.
 	ZoneScoped
 	if (GCC_UNLIKELY(ticksLocked)) { // For Fast Forward Mode
@@ -183,8 +316,18 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 	if (ticksNew <= ticksLast) { //lower should not be possible, only equal.
 		ticksAdded = 0;
 
-		constexpr auto duration = std::chrono::milliseconds(1);
-		std::this_thread::sleep_for(duration);
+		// A halted program can't run until an event raises an IRQ, so
+		// sleep until the next one is due rather than for a single tick
+		constexpr int max_idle_sleep_ms = 10;
+		auto duration = std::chrono::milliseconds(1);
+		if (CPU_IdleSleep && CPU_IsWaitingForInterrupt()) {
+			const auto ticks = PIC_TicksUntilNextEvent(max_idle_sleep_ms);
+			duration = std::chrono::milliseconds(std::max(ticks, 1));
+		}
+		{
+			TelemetryScope scope(TelemetryBucket::Idle);
+			GFX_WaitForEvents(static_cast<int>(duration.count()));
+		}
 
 		const auto timeslept = GetTicksSince(ticksNew);
 
@@ -213,6 +356,16 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 	}
 	ticksAdded = ticksRemain;
 
+	if (CPU_CyclesController == CyclesController::Predictive) {
+		const auto totals = TELEMETRY_TakeTotals();
+		if (CPU_CycleAutoAdjust && !CPU_SkipCycleAutoAdjust)
+			predictive_auto_adjust(totals);
+		CPU_IODelayRemoved = 0;
+		ticksDone = 0;
+		ticksScheduled = 0;
+		return;
+	}
+
 	// Is the system in auto cycle mode guessing ? If not just exit. (It can be temporary disabled)
 	if (!CPU_CycleAutoAdjust || CPU_SkipCycleAutoAdjust) return;
 
@@ -258,6 +411,15 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 
 		if (new_cmax < CPU_CYCLES_LOWER_LIMIT)
 			new_cmax = CPU_CYCLES_LOWER_LIMIT;
+
+		CycleAdjustDecision decision = {};
+		decision.old_cycle_max = CPU_CycleMax;
+		decision.ratio = ratio;
+		decision.ticks_done = ticksDone;
+		decision.ticks_scheduled = ticksScheduled;
+		decision.ticks_added = ticksAdded;
+		decision.io_delay_ratio = ratioremoved;
+		decision.action = "skip_dropout";
 		/*
 		LOG(LOG_MISC,LOG_ERROR)("cyclelog: current %06d   cmax %06d   ratio  %05d  done %03d   sched %03d Add %d rr %4.2f",
 			CPU_CycleMax,
@@ -280,8 +442,14 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 				if (CPU_CycleLimit > 0) {
 					if (CPU_CycleMax > CPU_CycleLimit) CPU_CycleMax = CPU_CycleLimit;
 				} else if (CPU_CycleMax > 2000000) CPU_CycleMax = 2000000; //Hardcoded limit, if no limit was specified.
+				decision.action = "adjust";
+			} else {
+				decision.action = "skip_host_load";
 			}
 		}
+		decision.new_cycle_max = CPU_CycleMax;
+		if (telemetry_active)
+			TELEMETRY_LogAdjust(decision);
 
 		//Reset cycleguessing parameters.
 		CPU_IODelayRemoved = 0;
@@ -291,9 +459,20 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 		/* ticksAdded > 15 but ticksScheduled < 5, lower the cycles
 		   but do not reset the scheduled/done ticks to take them into
 		   account during the next auto cycle adjustment */
+		CycleAdjustDecision decision = {};
+		decision.action = "lower";
+		decision.old_cycle_max = CPU_CycleMax;
+		decision.ticks_done = ticksDone;
+		decision.ticks_scheduled = ticksScheduled;
+		decision.ticks_added = ticksAdded;
+
 		CPU_CycleMax /= 3;
 		if (CPU_CycleMax < CPU_CYCLES_LOWER_LIMIT)
 			CPU_CycleMax = CPU_CYCLES_LOWER_LIMIT;
+
+		decision.new_cycle_max = CPU_CycleMax;
+		if (telemetry_active)
+			TELEMETRY_LogAdjust(decision);
 	} //if (ticksScheduled >= 250 || ticksDone >= 250 || (ticksAdded > 15 && ticksScheduled >= 5) )
 }
 
@@ -305,15 +484,27 @@ void DOSBOX_SetNormalLoop() {
 	loop=Normal_Loop;
 }
 
+static int run_depth = 0;
+
 void DOSBOX_RunMachine()
 {
+	++run_depth;
 	while ((*loop)() == 0 && !shutdown_requested)
 		;
+	--run_depth;
 }
 
-static void DOSBOX_UnlockSpeed( bool pressed ) {
+int DOSBOX_GetRunDepth()
+{
+	return run_depth;
+}
+
+static void set_fast_forward(const bool enabled)
+{
 	static bool autoadjust = false;
-	if (pressed) {
+	if (enabled == ticksLocked)
+		return;
+	if (enabled) {
 		LOG_MSG("Fast Forward ON");
 		ticksLocked = true;
 		if (CPU_CycleAutoAdjust) {
@@ -332,16 +523,63 @@ static void DOSBOX_UnlockSpeed( bool pressed ) {
 	}
 }
 
+// Fast-forwards while held
+static void DOSBOX_UnlockSpeed( bool pressed ) {
+	set_fast_forward(pressed);
+}
+
+// Switches fast-forwarding on and off with each press
+static void DOSBOX_ToggleFastForward(bool pressed)
+{
+	if (pressed)
+		set_fast_forward(!ticksLocked);
+}
+
+#if C_TRACY
+bool tracy_subsystem_zones = true;
+
+static void DOSBOX_ToggleProfilerZones(bool pressed)
+{
+	if (!pressed)
+		return;
+	tracy_subsystem_zones = !tracy_subsystem_zones;
+	LOG_MSG("PROFILER: Subsystem zones %s",
+	        tracy_subsystem_zones ? "enabled" : "disabled");
+}
+#endif
+
+static void DOSBOX_LogMemoryReport(bool pressed)
+{
+	if (pressed)
+		MEMREPORT_Log("Now");
+}
+
+static void DOSBOX_StopMetrics(Section *)
+{
+	METRICS_Stop();
+}
+
 static void DOSBOX_RealInit(Section * sec) {
 	Section_prop * section=static_cast<Section_prop *>(sec);
 	/* Initialize some dosbox internals */
 	ticksRemain=0;
 	ticksLast=GetTicks();
+	// Headless batch runs don't need to keep pace with the host's clock
 	ticksLocked = false;
+	set_fast_forward(GFX_WantsFastForward() ||
+	                 section->Get_bool("fast_forward"));
 	DOSBOX_SetLoop(&Normal_Loop);
 
 	MAPPER_AddHandler(DOSBOX_UnlockSpeed, SDL_SCANCODE_F12, MMOD2,
 	                  "speedlock", "Speedlock");
+	MAPPER_AddHandler(DOSBOX_ToggleFastForward, SDL_SCANCODE_F12,
+	                  MMOD1 | MMOD2, "fastforward", "Fast Forward");
+	MAPPER_AddHandler(DOSBOX_LogMemoryReport, SDL_SCANCODE_UNKNOWN, 0,
+	                  "memreport", "Mem. Report");
+#if C_TRACY
+	MAPPER_AddHandler(DOSBOX_ToggleProfilerZones, SDL_SCANCODE_UNKNOWN, 0,
+	                  "profzones", "Prof. Zones");
+#endif
 
 	std::string cmd_machine;
 	if (control->cmdline->FindString("-machine",cmd_machine,true)){
@@ -404,6 +642,13 @@ static void DOSBOX_RealInit(Section * sec) {
 	}
 
 	VGA_SetRatePreference(section->Get_string("dos_rate"));
+
+	THREAD_Configure(section->Get_string("thread_affinity"),
+	                 section->Get_string("thread_priority"));
+	THREAD_ApplyToCurrent(ThreadClass::Emulation);
+
+	METRICS_Start(section->Get_string("metrics_endpoint"));
+	section->AddDestroyFunction(&DOSBOX_StopMetrics);
 }
 
 // Returns decimal seconds of elapsed uptime.
@@ -457,6 +702,113 @@ void DOSBOX_Init()
 	pstring->Set_help(
 	        "Directory where things like wave, midi, screenshot get captured.");
 
+	const char *capture_fsync_modes[] = {"off", "on_close", "per_block", 0};
+	pstring = secprop->Add_string("capture_fsync", always, "off");
+	pstring->Set_values(capture_fsync_modes);
+	pstring->Set_help(
+	        "When wave and MIDI captures are synced to storage (off by default):\n"
+	        "  off:        Leave it to the operating system.\n"
+	        "  on_close:   Once the capture is complete.\n"
+	        "  per_block:  After every 256 KB written, so little is lost if the host\n"
+	        "              crashes. The captures are written in the background either way.");
+
+	const char *capture_sources[] = {"emulated", "display", 0};
+	pstring = secprop->Add_string("capture_source", always, "emulated");
+	pstring->Set_values(capture_sources);
+	pstring->Set_help(
+	        "Image that screenshots and videos are captured from (emulated by default):\n"
+	        "  emulated:  The emulated image at its original resolution.\n"
+	        "  display:   The final output at the window's resolution, after scaling and\n"
+	        "             the OpenGL shader. Needs the 'opengl' output; otherwise the\n"
+	        "             emulated image is captured.");
+
+	const char *screenshot_formats[] = {"png", "qoi", "bmp", 0};
+	pstring = secprop->Add_string("screenshot_format", always, "png");
+	pstring->Set_values(screenshot_formats);
+	pstring->Set_help(
+	        "File format of screenshots (png by default):\n"
+	        "  png:  Compressed at 'screenshot_png_level'.\n"
+	        "  qoi:  The Quite OK Image Format; lossless and several times faster to\n"
+	        "        encode than PNG, for bursts of screenshots.\n"
+	        "  bmp:  Uncompressed; the fastest, but the largest.\n"
+	        "Screenshots are encoded in the background either way.");
+
+	pint = secprop->Add_int("screenshot_png_level", always, 9);
+	pint->SetMinMax(0, 9);
+	pint->Set_help(
+	        "zlib compression level of PNG screenshots, from 1 (fastest) to 9 (smallest),\n"
+	        "or 0 for none (9 by default).");
+
+	const char *capture_formats[] = {"zmbv", "ffmpeg", 0};
+	pstring = secprop->Add_string("capture_format", always, "zmbv");
+	pstring->Set_values(capture_formats);
+	pstring->Set_help(
+	        "How videos are captured (zmbv by default):\n"
+	        "  zmbv:    Lossless ZMBV video in an AVI file.\n"
+	        "  ffmpeg:  Encode the video while capturing by streaming it to the 'ffmpeg'\n"
+	        "           program, which must be on the PATH, into an MKV file with AAC\n"
+	        "           audio. Falls back to zmbv if FFmpeg can't be started.\n"
+	        "           Not available on Windows.");
+
+	const char *capture_encoders[] = {"h264",       "hevc",
+	                                  "h264_nvenc", "hevc_nvenc",
+	                                  "h264_vaapi", "hevc_vaapi",
+	                                  "h264_videotoolbox",
+	                                  "hevc_videotoolbox", 0};
+	pstring = secprop->Add_string("capture_encoder", always, "h264");
+	pstring->Set_values(capture_encoders);
+	pstring->Set_help(
+	        "FFmpeg video encoder used with 'capture_format = ffmpeg' (h264 by default):\n"
+	        "  h264, hevc:  Software encoding with x264 or x265.\n"
+	        "  *_nvenc:     NVIDIA hardware encoding.\n"
+	        "  *_vaapi:     VA-API hardware encoding (Intel and AMD on Linux).\n"
+	        "  *_videotoolbox:  macOS hardware encoding.");
+
+	pstring = secprop->Add_string("capture_ffmpeg_options", always, "");
+	pstring->Set_help(
+	        "Extra FFmpeg output options, such as '-crf 23' or '-b:v 8M', which\n"
+	        "override the encoder's defaults.");
+
+	Pbool = secprop->Add_bool("io_port_profile", only_at_start, false);
+	Pbool->Set_help(
+	        "Count the accesses of every IO port and the host time spent handling\n"
+	        "them, and log the most expensive ports at shutdown (disabled by\n"
+	        "default). Shows which devices a program keeps polling. Slows down\n"
+	        "port accesses a little while enabled.");
+
+	pstring = secprop->Add_string("thread_affinity", only_at_start, "");
+	pstring->Set_help(
+	        "Pin threads to host cores, as a list of <thread>=<cores> entries, such as\n"
+	        "'emulation=2 audio=3 midi=3' or 'render=0,1' (not set by default).\n"
+	        "The threads are: emulation, audio, render (the OpenGL presenter), and\n"
+	        "midi (the MT-32 and FluidSynth synths). Not supported on macOS.");
+
+	const char *thread_priorities[] = {"normal", "high", "realtime", nullptr};
+	pstring = secprop->Add_string("thread_priority", only_at_start, "normal");
+	pstring->Set_values(thread_priorities);
+	pstring->Set_help(
+	        "Priority of the emulation, audio, render, and MIDI threads (normal by\n"
+	        "default). Raising it makes audio glitches on busy hosts less likely.\n"
+	        "  high:      Above the other programs' threads.\n"
+	        "  realtime:  Also use a real-time class for the audio and MIDI threads:\n"
+	        "             SCHED_FIFO on Linux (needs an 'rtprio' limit), MMCSS on\n"
+	        "             Windows, and the user-interactive QoS class on macOS.");
+
+	pstring = secprop->Add_string("metrics_endpoint", only_at_start, "");
+	pstring->Set_help(
+	        "Serve counters such as the emulated cycles per second, presented and\n"
+	        "dropped frames, audio underruns, and disk and network traffic in the\n"
+	        "Prometheus text format (disabled by default):\n"
+	        "  <port>:       HTTP on the given TCP port, on 127.0.0.1 only.\n"
+	        "  unix:<path>:  HTTP on a Unix domain socket (not on Windows).");
+
+	Pbool = secprop->Add_bool("fast_forward", only_at_start, false);
+	Pbool->Set_help(
+	        "Start fast-forwarding, running the emulation as fast as the host\n"
+	        "allows (disabled by default). The fast-forward hotkey toggles it\n"
+	        "while running, and the speedlock hotkey fast-forwards while held.\n"
+	        "See [sdl] fast_forward_frameskip and [mixer] fast_forward_mute.");
+
 #if C_DEBUG
 	LOG_StartUp();
 #endif
@@ -473,6 +825,16 @@ void DOSBOX_Init()
 	        "though few games might require a higher value.\n"
 	        "There is generally no speed advantage when raising this value.");
 
+	const char *huge_pages_modes[] = {"off", "transparent", "reserved", nullptr};
+	pstring = secprop->Add_string("huge_pages", when_idle, huge_pages_modes[0]);
+	pstring->Set_values(huge_pages_modes);
+	pstring->Set_help(
+	        "Back the emulated memory with huge host pages, which reduces the host's TLB\n"
+	        "misses in memory heavy programs (off by default).\n"
+	        "  transparent:  Ask the kernel for transparent huge pages (Linux only).\n"
+	        "  reserved:     Take them from the pool reserved by the administrator\n"
+	        "                (Linux only); falls back to normal pages when it's empty.");
+
 	const char *mcb_fault_strategies[] = {"deny", "repair", "report", "allow", nullptr};
 	pstring = secprop->Add_string("mcb_fault_strategy",
 	                              only_at_start,
@@ -578,12 +940,88 @@ void DOSBOX_Init()
 	        "quiet       |   no    |    no\n"
 	        "auto        | 'low' if exec or dir is passed, otherwise 'high'");
 
+	pstring = secprop->Add_path("fast_boot_snapshot", only_at_start, "");
+	pstring->Set_help(
+	        "File holding a snapshot of the machine to skip a program's start-up\n"
+	        "(disabled by default). While the program started by [autoexec] runs,\n"
+	        "press the 'Save Snapshot' mapper key to save the machine. The next time\n"
+	        "the same command runs with the same configuration, the program resumes\n"
+	        "from the snapshot. Sound devices and the mouse driver are not saved,\n"
+	        "so take the snapshot when the program doesn't play sound, for example\n"
+	        "at a menu. Saving again replaces the snapshot.");
+
+	Pbool = secprop->Add_bool("fast_boot_shared_memory", only_at_start, false);
+	Pbool->Set_help(
+	        "Keep the emulated memory of the fast boot snapshot in a separate, uncompressed\n"
+	        "file that is mapped copy-on-write when resuming (disabled by default).\n"
+	        "Instances resuming the same snapshot then share the memory none of them\n"
+	        "changed, which saves host memory when many run at once.");
+	secprop->AddInitFunction(&SNAPSHOT_Init);
+
+	pstring = secprop->Add_path("input_record", only_at_start, "");
+	pstring->Set_help(
+	        "File to record the keyboard and mouse input, the received network packets,\n"
+	        "and the cycle adjustments of the session to (disabled by default). Replaying\n"
+	        "it with 'input_replay' repeats the session exactly, as a benchmark or to\n"
+	        "check that a change to the emulation didn't alter the output.");
+
+	pstring = secprop->Add_path("input_replay", only_at_start, "");
+	pstring->Set_help(
+	        "File recorded with 'input_record' to replay instead of taking the host's\n"
+	        "input (disabled by default). The replay runs as fast as possible, logs the\n"
+	        "time it took and any frames that differ from the recording, then quits.\n"
+	        "Start it with the same configuration and files as the recording.");
+	secprop->AddInitFunction(&REPLAY_Init);
+
+	pstring = secprop->Add_string("netplay", only_at_start, "");
+	pstring->Set_help(
+	        "Share this session with a second player over UDP (disabled by default).\n"
+	        "  host:<port>:            Wait for the other player on the given port.\n"
+	        "  join:<address>:<port>:  Join the player hosting at the given address.\n"
+	        "Both players start with the same configuration and files, and only their\n"
+	        "keyboard and mouse input is exchanged. The host's cycles setting is used.");
+
+	pint = secprop->Add_int("netplay_delay", only_at_start, 3);
+	pint->SetMinMax(0, 200);
+	pint->Set_help(
+	        "Milliseconds of emulated time before the local input takes effect, giving\n"
+	        "it time to reach the other player (3 by default). Raise it on slow links\n"
+	        "to wait for the other player less often.");
+
+	pint = secprop->Add_int("netplay_rollback", only_at_start, 0);
+	pint->SetMinMax(0, 500);
+	pint->Set_help(
+	        "Milliseconds of emulated time to run ahead of the other player's input,\n"
+	        "rolling back when it turns out different. Rollback isn't supported yet,\n"
+	        "so both players always wait for each other's input every millisecond\n"
+	        "(lockstep, 0 by default).");
+	secprop->AddInitFunction(&NETPLAY_Init);
+
+	pint = secprop->Add_int("rewind_buffer", only_at_start, 0);
+	pint->SetMinMax(0, 4096);
+	pint->Set_help(
+	        "Megabytes of memory to keep the recent past of a program started by the\n"
+	        "shell in, to step back through it while the 'Rewind' mapper key is held\n"
+	        "(0 by default, disabled). On top of this, a copy of the emulated memory is\n"
+	        "kept. Sound devices and files the program wrote aren't rolled back.");
+
+	pint = secprop->Add_int("rewind_rate", only_at_start, 60);
+	pint->SetMinMax(1, 60);
+	pint->Set_help("Rewind points taken per second of emulated time (60 by default).");
+	secprop->AddInitFunction(&REWIND_Init);
+
 	secprop = control->AddSection_prop("render", &RENDER_Init, true);
 	secprop->AddEarlyInitFunction(&RENDER_InitShaderSource, true);
 	pint = secprop->Add_int("frameskip", always, 0);
 	pint->SetMinMax(0, 10);
 	pint->Set_help("How many frames DOSBox skips before drawing one.");
 
+	Pbool = secprop->Add_bool("auto_frameskip", always, false);
+	Pbool->Set_help("Skip more frames, up to 10, while the host can't keep up with the\n"
+	                "emulation, and fewer again once it catches up (disabled by default).\n"
+	                "Never skips fewer than set by 'frameskip'. Skipped frames aren't\n"
+	                "drawn by the emulated video card at all.");
+
 	Pbool = secprop->Add_bool("aspect", always, true);
 	Pbool->Set_help("Scales the vertical resolution to produce a 4:3 display aspect\n"
 	                "ratio, matching that of the original standard-definition monitors\n"
@@ -661,6 +1099,13 @@ void DOSBOX_Init()
 	pstring = pmulti->GetSection()->Add_string("force", always, "");
 	pstring->Set_values(force);
 
+	pint = secprop->Add_int("scaler_threads", only_at_start, 0);
+	pint->Set_help(
+	        "Number of extra threads to scale each frame with, in horizontal bands\n"
+	        "(0 by default). Only applies to the advmame, advinterp, hq, and sai scalers.\n"
+	        "With 0, frames are scaled on the emulation thread as their lines are drawn.");
+	pint->SetMinMax(0, 15);
+
 #if C_OPENGL
 	pstring = secprop->Add_path("glshader", always, "default");
 	pstring->Set_help("Either 'none' or a GLSL shader name. Works only with\n"
@@ -679,13 +1124,15 @@ void DOSBOX_Init()
 	secprop=control->AddSection_prop("cpu",&CPU_Init,true);//done
 	const char* cores[] = { "auto",
 #if (C_DYNAMIC_X86) || (C_DYNREC)
-		"dynamic",
+		"dynamic", "adaptive",
 #endif
 		"normal", "simple",0 };
 	Pstring = secprop->Add_string("core", when_idle, "auto");
 	Pstring->Set_values(cores);
 	Pstring->Set_help("CPU Core used in emulation. auto will switch to dynamic if available and\n"
-		"appropriate.");
+		"appropriate. adaptive starts all code in the normal core and translates\n"
+		"only the code pages that turn out to be hot, handing pages that keep\n"
+		"modifying themselves back to the normal core.");
 
 	const char* cputype_values[] = { "auto", "386", "386_slow", "486_slow", "pentium_slow", "386_prefetch", 0};
 	Pstring = secprop->Add_string("cputype", always, "auto");
@@ -712,6 +1159,17 @@ void DOSBOX_Init()
 
 	pmulti_remain->GetSection()->Add_string("parameters", always, "");
 
+	const char *cycles_controllers[] = {"reactive", "predictive", 0};
+	Pstring = secprop->Add_string("cycles_controller", always, "reactive");
+	Pstring->Set_values(cycles_controllers);
+	Pstring->Set_help(
+	        "How 'cycles = auto' and 'cycles = max' adjust the cycles ('reactive' by\n"
+	        "default):\n"
+	        "  reactive:    Adjust after the time used by past ticks went off target.\n"
+	        "  predictive:  Predict the cycles that fit the target from the measured\n"
+	        "               host time per cycle. Converges faster and holds steadier\n"
+	        "               under changing host load, at a small measuring cost.");
+
 	Pint = secprop->Add_int("cycleup", always, 10);
 	Pint->SetMinMax(1,1000000);
 	Pint->Set_help("Number of cycles added or subtracted with speed control hotkeys.\n"
@@ -721,7 +1179,88 @@ void DOSBOX_Init()
 	Pint->SetMinMax(1,1000000);
 	Pint->Set_help("Setting it lower than 100 will be a percentage.");
 
+	Pbool = secprop->Add_bool("skip_polling", always, false);
+	Pbool->Set_help(
+	        "Skip ahead when a program waits for the video retrace, the keyboard\n"
+	        "controller or the Sound Blaster DSP in a tight loop (disabled by default).\n"
+	        "Only the cycles the wait would spend are skipped, which frees host CPU\n"
+	        "time for the rest of the program at high cycle settings.\n"
+	        "Loops counting the timed joystick axes are skipped too, with their\n"
+	        "counters advanced to the value the polling would have reached.");
+
+	Pbool = secprop->Add_bool("idle_sleep", always, false);
+	Pbool->Set_help(
+	        "Let the host sleep until the next emulated event is due while a program\n"
+	        "waits for an interrupt with HLT (disabled by default). This saves host CPU\n"
+	        "time in idle programs, at the cost of handling input and audio in batches\n"
+	        "of up to 10 ms.");
+
+	Pstring = secprop->Add_path("cycle_telemetry_file", only_at_start, "");
+	Pstring->Set_help(
+	        "CSV file receiving, for every emulated millisecond, the cycles executed,\n"
+	        "the host time spent in the CPU core, PIC events, rendering, the mixer and\n"
+	        "idling, and the decisions of the automatic cycle adjustment (disabled by\n"
+	        "default). Use it to find a good 'cycles' setting for a program.");
+
+	Pint = secprop->Add_int("dynamic_cache_size", only_at_start, 8);
+	Pint->SetMinMax(1, 256);
+	Pint->Set_help(
+	        "Size of the dynamic core's code cache in MB (8 by default).\n"
+	        "Large protected mode programs can fill the default cache, which forces\n"
+	        "translated code to be purged and translated again. The number of purges\n"
+	        "is logged on exit to help picking a size.");
+
+	Pint = secprop->Add_int("dynamic_translate_threshold", when_idle, 0);
+	Pint->SetMinMax(0, 255);
+	Pint->Set_help(
+	        "How often the dynamic core has to reach code before translating it\n"
+	        "(0 by default, translate right away). Code reached fewer times is run\n"
+	        "by the normal core, which avoids stutter when a program loads large\n"
+	        "amounts of code that only runs once, like installers or level loaders.");
+
+	Pint = secprop->Add_int("dynamic_smc_threshold", when_idle, 0);
+	Pint->SetMinMax(0, 10000);
+	Pint->Set_help(
+	        "How often self-modifying code may invalidate the translated code of a\n"
+	        "page within a second before the page is run by the normal core instead\n"
+	        "(0 by default, never). Helps programs that keep patching their own code\n"
+	        "or keep data next to it, which otherwise get retranslated endlessly.\n"
+	        "Demoted pages are retried after a while and are listed on exit.");
+
+#if (C_DYNREC)
+	Pbool = secprop->Add_bool("dynamic_native_fpu", only_at_start, false);
+	Pbool->Set_help(
+	        "Let the dynamic core translate common FPU instructions (FADD, FSUB,\n"
+	        "FMUL, FDIV and FLD/FST of 32 and 64-bit reals) to native double precision\n"
+	        "code instead of calling the FPU emulation (disabled by default). Results\n"
+	        "are the same; 80-bit loads and stores and all other instructions still\n"
+	        "use the FPU emulation. Only supported on ARM64 hosts.");
+
+	Pbool = secprop->Add_bool("dynamic_block_profile", only_at_start, false);
+	Pbool->Set_help(
+	        "Count how often each block translated by the dynamic core runs, how\n"
+	        "often block linking succeeds, and how often self-modifying code\n"
+	        "invalidates blocks (disabled by default). A ranked report is logged on\n"
+	        "exit or by the 'Dyn Profile' mapper event. Slows down emulation.");
+#endif
+
+	Pstring = secprop->Add_path("dynamic_cache_file", only_at_start, "");
+	Pstring->Set_help(
+	        "File used to remember which code the dynamic core has translated, so\n"
+	        "it can be translated up-front when the same program runs again\n"
+	        "(disabled by default). Pages whose contents changed are ignored.");
+
 #if C_FPU
+	const char *fpu_modes[] = {"fast", "accurate", 0};
+	Pstring = secprop->Add_string("fpu", only_at_start, "fast");
+	Pstring->Set_values(fpu_modes);
+	Pstring->Set_help(
+	        "Precision of the FPU emulation on hosts without an x87 FPU (fast by\n"
+	        "default). x86 hosts always have the full precision of their own FPU.\n"
+	        "  fast:      Calculate in double precision (53-bit significand).\n"
+	        "  accurate:  Calculate additions, multiplications, divisions, loads,\n"
+	        "             stores and comparisons in 80-bit extended precision as\n"
+	        "             real FPUs do. Slower, and disables 'dynamic_native_fpu'.");
 	secprop->AddInitFunction(&FPU_Init);
 #endif
 	secprop->AddInitFunction(&DMA_Init);//done
@@ -1104,7 +1643,11 @@ void DOSBOX_Init()
 	        "   Default is type:wheel+msm rate:smooth\n"
 	        "for direct: realport (required), rxdelay (optional).\n"
 	        "   (realport:COM1 realport:ttyS0).\n"
-	        "for modem: listenport, sock, baudrate (all optional).\n"
+	        "for modem: listenport, sock, baudrate, linerate (all optional).\n"
+	        "   linerate sets the bits per second between the modem and the\n"
+	        "   UART (by default the rate the UART is programmed for).\n"
+	        "   Modems with the same listenport share it, and an incoming call\n"
+	        "   goes to the first idle one (for multi-node BBSes).\n"
 	        "for nullmodem: server, rxdelay, txdelay, telnet, usedtr,\n"
 	        "   transparent, port, inhsocket, sock (all optional).\n"
 	        "SOCK parameter specifies the protocol to be used by both sides\n"
@@ -1177,13 +1720,40 @@ void DOSBOX_Init()
 	secprop->AddInitFunction(&MSCDEX_Init);
 	secprop->AddInitFunction(&DRIVES_Init);
 	secprop->AddInitFunction(&CDROM_Image_Init);
+
+	pint = secprop->Add_int("iso_sector_cache", when_idle, 1024);
+	pint->SetMinMax(64, 262144);
+	pint->Set_help("Size in KB of the cache of recently read sectors that each mounted\n"
+	               "CD-ROM image keeps, covering both directories and files (1024 by default).\n"
+	               "Larger caches speed up programs scanning big directory trees on images\n"
+	               "kept on slow storage.");
+
+	pint = secprop->Add_int("zip_block_cache", when_idle, 8192);
+	pint->SetMinMax(256, 262144);
+	pint->Set_help("Size in KB of the cache of decompressed blocks that each mounted ZIP\n"
+	               "archive keeps (8192 by default). Larger caches avoid decompressing\n"
+	               "the files again when programs seek back in them.");
+
+	pint = secprop->Add_int("image_disk_cache", when_idle, 4096);
+	pint->SetMinMax(0, 262144);
+	pint->Set_help("Size in KB of the block cache that each mounted floppy or hard disk image\n"
+	               "keeps (4096 by default). Sequential reads are read ahead, and writes are\n"
+	               "held back and written to the image once a second and when unmounting.\n"
+	               "0 reads and writes every sector directly.");
+
+	Pbool = secprop->Add_bool("write_behind", when_idle, false);
+	Pbool->Set_help("Queue writes to files on mounted directories for a background thread,\n"
+	                "so saving to slow or network drives doesn't stall the emulation (disabled\n"
+	                "by default). Reading the files back waits for their writes; errors\n"
+	                "while writing can only be logged.");
+
 #if C_IPX
 	secprop=control->AddSection_prop("ipx",&IPX_Init,true);
 	Pbool = secprop->Add_bool("ipx", when_idle,  false);
 	Pbool->Set_help("Enable ipx over UDP/IP emulation.");
 #endif
 
-#if C_SLIRP
+#if C_NE2000
 	secprop = control->AddSection_prop("ethernet", &NE2K_Init, true);
 
 	Pbool = secprop->Add_bool("ne2000", when_idle,  true);
@@ -1199,6 +1769,34 @@ void DOSBOX_Init()
 	        "      from the host into the DOS guest, and from your router to your\n"
 	        "      host when acting as the server for multiplayer games.");
 
+	const char *ethernet_backends[] = {
+#if C_SLIRP
+	        "slirp",
+#endif
+#if defined(__linux__)
+	        "tap",
+#endif
+#if C_PCAP
+	        "pcap",
+#endif
+	        0};
+	Pstring = secprop->Add_string("backend", when_idle, ethernet_backends[0]);
+	Pstring->Set_values(ethernet_backends);
+	Pstring->Set_help(
+	        "How the NE2000 card reaches the network:\n"
+	        "  slirp: A virtual LAN behind the host, as described above.\n"
+	        "  tap:   A TAP interface on the host, usually bridged with a\n"
+	        "         physical one (Linux only).\n"
+	        "  pcap:  A physical host interface through libpcap, which\n"
+	        "         usually needs administrator rights.\n"
+	        "With 'tap' and 'pcap', the guest is on the host's network and\n"
+	        "gets its address from there.");
+
+	Pstring = secprop->Add_string("host_interface", when_idle, "");
+	Pstring->Set_help(
+	        "The host interface used by the 'tap' and 'pcap' backends\n"
+	        "(e.g., tap0 or eth0).");
+
 	const char *nic_addresses[] = {"200", "220", "240", "260", "280", "2c0",
 	                               "300", "320", "340", "360", 0};
 	Phex = secprop->Add_hex("nicbase", when_idle, 0x300);
@@ -26,6 +26,8 @@
 #include "mem.h"
 #include "fpu.h"
 #include "cpu.h"
+#include "setup.h"
+#include "snapshot.h"
 
 FPU_rec fpu;
 
@@ -624,8 +626,24 @@ void FPU_ESC7_Normal(Bitu rm) {
 }
 
 
-void FPU_Init(Section*) {
+static void fpu_snapshot(SnapshotStream &s)
+{
+	// the registers are kept differently in the two modes
+	const auto accurate = fpu.accurate;
+	s.Pod(fpu);
+	if (fpu.accurate != accurate) {
+		fpu.accurate = accurate;
+		s.Fail();
+	}
+}
+
+void FPU_Init(Section* sec) {
+	const auto section = static_cast<Section_prop *>(sec);
+	fpu.accurate = std::string(section->Get_string("fpu")) == "accurate";
+	if (fpu.accurate)
+		LOG_MSG("FPU: Using 80-bit extended precision");
 	FPU_FINIT();
+	SNAPSHOT_AddComponent("fpu", fpu_snapshot);
 }
 
 #endif
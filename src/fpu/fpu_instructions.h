@@ -20,6 +20,45 @@
 #include "fpu.h"
 #endif
 
+/* Accurate mode
+ * fpu.ext holds every register as an 80-bit value and is what the
+ * arithmetic, loads, stores and comparisons work on. fpu.regs keeps them
+ * rounded to double for the remaining operations, which are computed in
+ * double precision and write their results back through FPU_SetReg.
+ */
+
+static inline void FPU_SetReg(Bitu r, double d) {
+	fpu.regs[r].d = d;
+	if (fpu.accurate) fpu.ext[r] = ext80_from_double(d);
+}
+
+static inline void FPU_SetExt(Bitu r, const Ext80 &x) {
+	fpu.ext[r] = x;
+	fpu.regs[r].d = ext80_to_double(x, ROUND_Nearest);
+}
+
+static inline Ext80Control FPU_ExtControl() {
+	return ext80_control(fpu.cw);
+}
+
+static inline Ext80 FPU_ReadExt80(PhysPt addr) {
+	Ext80 x;
+	x.mant = mem_readd(addr) | (static_cast<uint64_t>(mem_readd(addr + 4)) << 32);
+	x.sign_exp = mem_readw(addr + 8);
+	return x;
+}
+
+static inline void FPU_WriteExt80(PhysPt addr, const Ext80 &x) {
+	mem_writed(addr, static_cast<uint32_t>(x.mant));
+	mem_writed(addr + 4, static_cast<uint32_t>(x.mant >> 32));
+	mem_writew(addr + 8, x.sign_exp);
+}
+
+// Rounds ST(0) to an integer the way the FIST instructions do
+static inline bool FPU_ExtToInt(int64_t &result) {
+	return ext80_to_int64(fpu.ext[TOP], fpu.round, result);
+}
+
 
 static void FPU_FINIT(void) {
 	FPU_SetCW(0x37F);
@@ -68,7 +107,7 @@ static void FPU_PREP_PUSH(void){
 
 static void FPU_PUSH(double in){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = in;
+	FPU_SetReg(TOP, in);
 //	LOG(LOG_FPU,LOG_ERROR)("Pushed at %d  %g to the stack",newtop,in);
 	return;
 }
@@ -153,6 +192,10 @@ static Real64 FPU_FLD80(PhysPt addr) {
 }
 
 static void FPU_ST80(PhysPt addr,Bitu reg) {
+	if (fpu.accurate) {
+		FPU_WriteExt80(addr, fpu.ext[reg]);
+		return;
+	}
 	struct {
 		int16_t begin;
 		FPU_Reg eind;
@@ -182,33 +225,36 @@ static void FPU_FLD_F32(PhysPt addr,Bitu store_to) {
 		uint32_t l;
 	}	blah;
 	blah.l = mem_readd(addr);
-	fpu.regs[store_to].d = static_cast<Real64>(blah.f);
+	FPU_SetReg(store_to, static_cast<Real64>(blah.f));
 }
 
 static void FPU_FLD_F64(PhysPt addr,Bitu store_to) {
 	fpu.regs[store_to].l.lower = mem_readd(addr);
 	fpu.regs[store_to].l.upper = mem_readd(addr+4);
+	if (fpu.accurate) fpu.ext[store_to] = ext80_from_double(fpu.regs[store_to].d);
 }
 
 static void FPU_FLD_F80(PhysPt addr) {
-	fpu.regs[TOP].d = FPU_FLD80(addr);
+	if (fpu.accurate) FPU_SetExt(TOP, FPU_ReadExt80(addr));
+	else fpu.regs[TOP].d = FPU_FLD80(addr);
 }
 
 static void FPU_FLD_I16(PhysPt addr,Bitu store_to) {
 	int16_t blah = mem_readw(addr);
-	fpu.regs[store_to].d = static_cast<Real64>(blah);
+	FPU_SetReg(store_to, static_cast<Real64>(blah));
 }
 
 static void FPU_FLD_I32(PhysPt addr,Bitu store_to) {
 	int32_t blah = mem_readd(addr);
-	fpu.regs[store_to].d = static_cast<Real64>(blah);
+	FPU_SetReg(store_to, static_cast<Real64>(blah));
 }
 
 static void FPU_FLD_I64(PhysPt addr,Bitu store_to) {
 	FPU_Reg blah;
 	blah.l.lower = mem_readd(addr);
 	blah.l.upper = mem_readd(addr+4);
-	fpu.regs[store_to].d = static_cast<Real64>(blah.ll);
+	if (fpu.accurate) FPU_SetExt(store_to, ext80_from_int64(blah.ll));
+	else fpu.regs[store_to].d = static_cast<Real64>(blah.ll);
 }
 
 static void FPU_FBLD(PhysPt addr,Bitu store_to) {
@@ -229,7 +275,7 @@ static void FPU_FBLD(PhysPt addr,Bitu store_to) {
 	in = mem_readb(addr + 9);
 	temp += ( (in&0xf) * base );
 	if(in&0x80) temp *= -1.0;
-	fpu.regs[store_to].d = temp;
+	FPU_SetReg(store_to, temp);
 }
 
 
@@ -253,11 +299,19 @@ static void FPU_FST_F32(PhysPt addr) {
 		uint32_t l;
 	}	blah;
 	//should depend on rounding method
-	blah.f = static_cast<float>(fpu.regs[TOP].d);
+	if (fpu.accurate) blah.f = ext80_to_float(fpu.ext[TOP], fpu.round);
+	else blah.f = static_cast<float>(fpu.regs[TOP].d);
 	mem_writed(addr,blah.l);
 }
 
 static void FPU_FST_F64(PhysPt addr) {
+	if (fpu.accurate) {
+		FPU_Reg blah;
+		blah.d = ext80_to_double(fpu.ext[TOP], fpu.round);
+		mem_writed(addr,blah.l.lower);
+		mem_writed(addr+4,blah.l.upper);
+		return;
+	}
 	mem_writed(addr,fpu.regs[TOP].l.lower);
 	mem_writed(addr+4,fpu.regs[TOP].l.upper);
 }
@@ -267,19 +321,36 @@ static void FPU_FST_F80(PhysPt addr) {
 }
 
 static void FPU_FST_I16(PhysPt addr) {
+	int64_t ival;
+	if (fpu.accurate) {
+		const bool fits = FPU_ExtToInt(ival) && ival >= INT16_MIN && ival <= INT16_MAX;
+		mem_writew(addr, fits ? static_cast<int16_t>(ival) : 0x8000);
+		return;
+	}
 	double val = FROUND(fpu.regs[TOP].d);
 	mem_writew(addr,(val < 32768.0 && val >= -32768.0)?static_cast<int16_t>(val):0x8000);
 }
 
 static void FPU_FST_I32(PhysPt addr) {
+	int64_t ival;
+	if (fpu.accurate) {
+		const bool fits = FPU_ExtToInt(ival) && ival >= INT32_MIN && ival <= INT32_MAX;
+		mem_writed(addr, fits ? static_cast<int32_t>(ival) : 0x80000000);
+		return;
+	}
 	double val = FROUND(fpu.regs[TOP].d);
 	mem_writed(addr,(val < 2147483648.0 && val >= -2147483648.0)?static_cast<int32_t>(val):0x80000000);
 }
 
 static void FPU_FST_I64(PhysPt addr) {
-	double val = FROUND(fpu.regs[TOP].d);
 	FPU_Reg blah;
-	blah.ll = (val < 9223372036854775808.0 && val >= -9223372036854775808.0)?static_cast<int64_t>(val):LONGTYPE(0x8000000000000000);
+	if (fpu.accurate) {
+		int64_t ival;
+		blah.ll = FPU_ExtToInt(ival) ? ival : LONGTYPE(0x8000000000000000);
+	} else {
+		double val = FROUND(fpu.regs[TOP].d);
+		blah.ll = (val < 9223372036854775808.0 && val >= -9223372036854775808.0)?static_cast<int64_t>(val):LONGTYPE(0x8000000000000000);
+	}
 
 	mem_writed(addr,blah.l.lower);
 	mem_writed(addr+4,blah.l.upper);
@@ -317,13 +388,17 @@ static void FPU_FBST(PhysPt addr) {
 }
 
 static void FPU_FADD(Bitu op1, Bitu op2){
+	if (fpu.accurate) {
+		FPU_SetExt(op1, ext80_add(fpu.ext[op1], fpu.ext[op2], FPU_ExtControl()));
+		return;
+	}
 	fpu.regs[op1].d+=fpu.regs[op2].d;
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSIN(void){
-	fpu.regs[TOP].d = sin(fpu.regs[TOP].d);
+	FPU_SetReg(TOP, sin(fpu.regs[TOP].d));
 	FPU_SET_C2(0);
 	//flags and such :)
 	return;
@@ -331,7 +406,7 @@ static void FPU_FSIN(void){
 
 static void FPU_FSINCOS(void){
 	Real64 temp = fpu.regs[TOP].d;
-	fpu.regs[TOP].d = sin(temp);
+	FPU_SetReg(TOP, sin(temp));
 	FPU_PUSH(cos(temp));
 	FPU_SET_C2(0);
 	//flags and such :)
@@ -339,55 +414,75 @@ static void FPU_FSINCOS(void){
 }
 
 static void FPU_FCOS(void){
-	fpu.regs[TOP].d = cos(fpu.regs[TOP].d);
+	FPU_SetReg(TOP, cos(fpu.regs[TOP].d));
 	FPU_SET_C2(0);
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSQRT(void){
-	fpu.regs[TOP].d = sqrt(fpu.regs[TOP].d);
+	FPU_SetReg(TOP, sqrt(fpu.regs[TOP].d));
 	//flags and such :)
 	return;
 }
 static void FPU_FPATAN(void){
-	fpu.regs[STV(1)].d = atan2(fpu.regs[STV(1)].d,fpu.regs[TOP].d);
+	FPU_SetReg(STV(1), atan2(fpu.regs[STV(1)].d,fpu.regs[TOP].d));
 	FPU_FPOP();
 	//flags and such :)
 	return;
 }
 static void FPU_FPTAN(void){
-	fpu.regs[TOP].d = tan(fpu.regs[TOP].d);
+	FPU_SetReg(TOP, tan(fpu.regs[TOP].d));
 	FPU_PUSH(1.0);
 	FPU_SET_C2(0);
 	//flags and such :)
 	return;
 }
 static void FPU_FDIV(Bitu st, Bitu other){
+	if (fpu.accurate) {
+		FPU_SetExt(st, ext80_div(fpu.ext[st], fpu.ext[other], FPU_ExtControl()));
+		return;
+	}
 	fpu.regs[st].d= fpu.regs[st].d/fpu.regs[other].d;
 	//flags and such :)
 	return;
 }
 
 static void FPU_FDIVR(Bitu st, Bitu other){
+	if (fpu.accurate) {
+		FPU_SetExt(st, ext80_div(fpu.ext[other], fpu.ext[st], FPU_ExtControl()));
+		return;
+	}
 	fpu.regs[st].d= fpu.regs[other].d/fpu.regs[st].d;
 	// flags and such :)
 	return;
 }
 
 static void FPU_FMUL(Bitu st, Bitu other){
+	if (fpu.accurate) {
+		FPU_SetExt(st, ext80_mul(fpu.ext[st], fpu.ext[other], FPU_ExtControl()));
+		return;
+	}
 	fpu.regs[st].d*=fpu.regs[other].d;
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSUB(Bitu st, Bitu other){
+	if (fpu.accurate) {
+		FPU_SetExt(st, ext80_sub(fpu.ext[st], fpu.ext[other], FPU_ExtControl()));
+		return;
+	}
 	fpu.regs[st].d = fpu.regs[st].d - fpu.regs[other].d;
 	//flags and such :)
 	return;
 }
 
 static void FPU_FSUBR(Bitu st, Bitu other){
+	if (fpu.accurate) {
+		FPU_SetExt(st, ext80_sub(fpu.ext[other], fpu.ext[st], FPU_ExtControl()));
+		return;
+	}
 	fpu.regs[st].d= fpu.regs[other].d - fpu.regs[st].d;
 	//flags and such :)
 	return;
@@ -396,15 +491,19 @@ static void FPU_FSUBR(Bitu st, Bitu other){
 static void FPU_FXCH(Bitu st, Bitu other){
 	FPU_Tag tag = fpu.tags[other];
 	FPU_Reg reg = fpu.regs[other];
+	Ext80 ext = fpu.ext[other];
 	fpu.tags[other] = fpu.tags[st];
 	fpu.regs[other] = fpu.regs[st];
+	fpu.ext[other] = fpu.ext[st];
 	fpu.tags[st] = tag;
 	fpu.regs[st] = reg;
+	fpu.ext[st] = ext;
 }
 
 static void FPU_FST(Bitu st, Bitu other){
 	fpu.tags[other] = fpu.tags[st];
 	fpu.regs[other] = fpu.regs[st];
+	fpu.ext[other] = fpu.ext[st];
 }
 
 
@@ -413,6 +512,14 @@ static void FPU_FCOM(Bitu st, Bitu other){
 		((fpu.tags[other] != TAG_Valid) && (fpu.tags[other] != TAG_Zero))){
 		FPU_SET_C3(1);FPU_SET_C2(1);FPU_SET_C0(1);return;
 	}
+	if (fpu.accurate) {
+		switch (ext80_compare(fpu.ext[st], fpu.ext[other])) {
+		case 0: FPU_SET_C3(1);FPU_SET_C2(0);FPU_SET_C0(0);return;
+		case -1: FPU_SET_C3(0);FPU_SET_C2(0);FPU_SET_C0(1);return;
+		case 1: FPU_SET_C3(0);FPU_SET_C2(0);FPU_SET_C0(0);return;
+		default: FPU_SET_C3(1);FPU_SET_C2(1);FPU_SET_C0(1);return;
+		}
+	}
 	if(fpu.regs[st].d == fpu.regs[other].d){
 		FPU_SET_C3(1);FPU_SET_C2(0);FPU_SET_C0(0);return;
 	}
@@ -429,13 +536,20 @@ static void FPU_FUCOM(Bitu st, Bitu other){
 }
 
 static void FPU_FRNDINT(void){
+	if (fpu.accurate) {
+		const Ext80 rounded = ext80_round_to_int(fpu.ext[TOP], fpu.round);
+		if ((fpu.cw&0x20) && !(rounded == fpu.ext[TOP]))
+			fpu.sw |= 0x20; //Set Precision Exception
+		FPU_SetExt(TOP, rounded);
+		return;
+	}
 	int64_t temp  = static_cast<int64_t>(FROUND(fpu.regs[TOP].d));
 	double tempd = static_cast<double>(temp);
 	if (fpu.cw&0x20) { //As we don't generate exceptions; only do it when masked
 		if (tempd != fpu.regs[TOP].d)
 			fpu.sw |= 0x20; //Set Precision Exception
 	}
-	fpu.regs[TOP].d = tempd;
+	FPU_SetReg(TOP, tempd);
 }
 
 static void FPU_FPREM(void){
@@ -445,7 +559,7 @@ static void FPU_FPREM(void){
 // Some backups
 //	Real64 res=valtop - ressaved*valdiv; 
 //      res= fmod(valtop,valdiv);
-	fpu.regs[TOP].d = valtop - ressaved*valdiv;
+	FPU_SetReg(TOP, valtop - ressaved*valdiv);
 	FPU_SET_C0(static_cast<Bitu>(ressaved&4));
 	FPU_SET_C3(static_cast<Bitu>(ressaved&2));
 	FPU_SET_C1(static_cast<Bitu>(ressaved&1));
@@ -461,7 +575,7 @@ static void FPU_FPREM1(void){
 	if (quot-quotf>0.5) ressaved = static_cast<int64_t>(quotf+1);
 	else if (quot-quotf<0.5) ressaved = static_cast<int64_t>(quotf);
 	else ressaved = static_cast<int64_t>((((static_cast<int64_t>(quotf))&1)!=0)?(quotf+1):(quotf));
-	fpu.regs[TOP].d = valtop - ressaved*valdiv;
+	FPU_SetReg(TOP, valtop - ressaved*valdiv);
 	FPU_SET_C0(static_cast<Bitu>(ressaved&4));
 	FPU_SET_C3(static_cast<Bitu>(ressaved&2));
 	FPU_SET_C1(static_cast<Bitu>(ressaved&1));
@@ -482,7 +596,8 @@ static void FPU_FXAM(void){
 		FPU_SET_C3(1);FPU_SET_C2(0);FPU_SET_C0(1);
 		return;
 	}
-	if(fpu.regs[TOP].d == 0.0)		//zero or normalized number.
+	const bool zero = fpu.accurate ? ext80_is_zero(fpu.ext[TOP]) : fpu.regs[TOP].d == 0.0;
+	if(zero)		//zero or normalized number.
 	{ 
 		FPU_SET_C3(1);FPU_SET_C2(0);FPU_SET_C0(0);
 	}
@@ -494,24 +609,24 @@ static void FPU_FXAM(void){
 
 
 static void FPU_F2XM1(void){
-	fpu.regs[TOP].d = pow(2.0,fpu.regs[TOP].d) - 1;
+	FPU_SetReg(TOP, pow(2.0,fpu.regs[TOP].d) - 1);
 	return;
 }
 
 static void FPU_FYL2X(void){
-	fpu.regs[STV(1)].d*=log(fpu.regs[TOP].d)/log(static_cast<Real64>(2.0));
+	FPU_SetReg(STV(1), fpu.regs[STV(1)].d*log(fpu.regs[TOP].d)/log(static_cast<Real64>(2.0)));
 	FPU_FPOP();
 	return;
 }
 
 static void FPU_FYL2XP1(void){
-	fpu.regs[STV(1)].d*=log(fpu.regs[TOP].d+1.0)/log(static_cast<Real64>(2.0));
+	FPU_SetReg(STV(1), fpu.regs[STV(1)].d*log(fpu.regs[TOP].d+1.0)/log(static_cast<Real64>(2.0)));
 	FPU_FPOP();
 	return;
 }
 
 static void FPU_FSCALE(void){
-	fpu.regs[TOP].d *= pow(2.0,static_cast<Real64>(static_cast<int64_t>(fpu.regs[STV(1)].d)));
+	FPU_SetReg(TOP, fpu.regs[TOP].d * pow(2.0,static_cast<Real64>(static_cast<int64_t>(fpu.regs[STV(1)].d))));
 	//FPU_SET_C1(0);
 	return; //2^x where x is chopped.
 }
@@ -562,7 +677,8 @@ static void FPU_FRSTOR(PhysPt addr){
 	FPU_FLDENV(addr);
 	Bitu start = (cpu.code.big?28:14);
 	for(Bitu i = 0;i < 8;i++){
-		fpu.regs[STV(i)].d = FPU_FLD80(addr+start);
+		if (fpu.accurate) FPU_SetExt(STV(i), FPU_ReadExt80(addr+start));
+		else fpu.regs[STV(i)].d = FPU_FLD80(addr+start);
 		start += 10;
 	}
 }
@@ -576,56 +692,63 @@ static void FPU_FXTRACT(void) {
 	int64_t exp80 =  test.ll&LONGTYPE(0x7ff0000000000000);
 	int64_t exp80final = (exp80>>52) - BIAS64;
 	Real64 mant = test.d / (pow(2.0,static_cast<Real64>(exp80final)));
-	fpu.regs[TOP].d = static_cast<Real64>(exp80final);
+	FPU_SetReg(TOP, static_cast<Real64>(exp80final));
 	FPU_PUSH(mant);
 }
 
 static void FPU_FCHS(void){
 	fpu.regs[TOP].d = -1.0*(fpu.regs[TOP].d);
+	fpu.ext[TOP] = ext80_negate(fpu.ext[TOP]);
 }
 
 static void FPU_FABS(void){
 	fpu.regs[TOP].d = fabs(fpu.regs[TOP].d);
+	fpu.ext[TOP] = ext80_abs(fpu.ext[TOP]);
 }
 
 static void FPU_FTST(void){
-	fpu.regs[8].d = 0.0;
+	FPU_SetReg(8, 0.0);
 	FPU_FCOM(TOP,8);
 }
 
 static void FPU_FLD1(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = 1.0;
+	FPU_SetReg(TOP, 1.0);
 }
 
 static void FPU_FLDL2T(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = L2T;
+	if (fpu.accurate) FPU_SetExt(TOP, Ext80{LONGTYPE(0xd49a784bcd1b8afe), 0x4000});
+	else fpu.regs[TOP].d = L2T;
 }
 
 static void FPU_FLDL2E(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = L2E;
+	if (fpu.accurate) FPU_SetExt(TOP, Ext80{LONGTYPE(0xb8aa3b295c17f0bc), 0x3fff});
+	else fpu.regs[TOP].d = L2E;
 }
 
 static void FPU_FLDPI(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = M_PI;
+	if (fpu.accurate) FPU_SetExt(TOP, Ext80{LONGTYPE(0xc90fdaa22168c235), 0x4000});
+	else fpu.regs[TOP].d = M_PI;
 }
 
 static void FPU_FLDLG2(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = LG2;
+	if (fpu.accurate) FPU_SetExt(TOP, Ext80{LONGTYPE(0x9a209a84fbcff799), 0x3ffd});
+	else fpu.regs[TOP].d = LG2;
 }
 
 static void FPU_FLDLN2(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = LN2;
+	if (fpu.accurate) FPU_SetExt(TOP, Ext80{LONGTYPE(0xb17217f7d1cf79ac), 0x3ffe});
+	else fpu.regs[TOP].d = LN2;
 }
 
 static void FPU_FLDZ(void){
 	FPU_PREP_PUSH();
-	fpu.regs[TOP].d = 0.0;
+	FPU_SetReg(TOP, 0.0);
 	fpu.tags[TOP] = TAG_Zero;
 }
 
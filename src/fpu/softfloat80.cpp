@@ -0,0 +1,602 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "softfloat80.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+constexpr int32_t exp_bias = 16383;
+constexpr int32_t exp_max  = 0x7fff;
+
+constexpr uint64_t integer_bit = UINT64_C(1) << 63;
+constexpr uint64_t quiet_bit   = UINT64_C(1) << 62;
+
+constexpr Ext80 indefinite = {integer_bit | quiet_bit, 0xffff};
+
+// Smallest normal exponents of the formats we round to, in extended bias
+constexpr int32_t ext_min_exp    = 1;
+constexpr int32_t double_min_exp = 1 - 1023 + exp_bias;
+
+// Significand bits by the precision control field; 01 is reserved and
+// treated as extended precision
+constexpr uint8_t precision_bits[4] = {24, 64, 53, 64};
+
+// Rounding control values that round the magnitude up whenever inexact,
+// indexed by rounding control and sign. Round to nearest is decided by the
+// discarded bits instead.
+constexpr bool rounds_away[4][2] = {
+        {false, false}, // nearest
+        {false, true},  // down (towards -infinity)
+        {true, false},  // up (towards +infinity)
+        {false, false}, // chop (towards zero)
+};
+
+constexpr uint8_t round_nearest = 0;
+
+Ext80Control ext80_control(const uint16_t cw)
+{
+	return {static_cast<uint8_t>((cw >> 10) & 3), precision_bits[(cw >> 8) & 3]};
+}
+
+static inline int count_leading_zeros(const uint64_t x)
+{
+	// x must not be zero
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index = 0;
+	_BitScanReverse64(&index, x);
+	return 63 - static_cast<int>(index);
+#elif defined(_MSC_VER)
+	unsigned long index = 0;
+	if (_BitScanReverse(&index, static_cast<uint32_t>(x >> 32)))
+		return 31 - static_cast<int>(index);
+	_BitScanReverse(&index, static_cast<uint32_t>(x));
+	return 63 - static_cast<int>(index);
+#else
+	return __builtin_clzll(x);
+#endif
+}
+
+#if defined(__SIZEOF_INT128__)
+// GCC and Clang's 128-bit integers aren't standard C++; __extension__ keeps
+// -Wpedantic quiet about them. Other compilers use the portable paths below.
+__extension__ typedef unsigned __int128 uint128_t;
+#endif
+
+// 64 x 64 -> 128-bit product
+static inline void mul_64x64(const uint64_t a, const uint64_t b, uint64_t &hi, uint64_t &lo)
+{
+#if defined(__SIZEOF_INT128__)
+	const auto product = static_cast<uint128_t>(a) * b;
+	hi = static_cast<uint64_t>(product >> 64);
+	lo = static_cast<uint64_t>(product);
+#else
+	const uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32;
+	const uint64_t b_lo = b & 0xffffffff, b_hi = b >> 32;
+	const uint64_t ll = a_lo * b_lo;
+	const uint64_t lh = a_lo * b_hi;
+	const uint64_t hl = a_hi * b_lo;
+	const uint64_t hh = a_hi * b_hi;
+	const uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+	lo = (mid << 32) | (ll & 0xffffffff);
+	hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+// Divides hi:lo by d, where hi < d, returning the quotient and remainder
+static inline uint64_t div_128x64(const uint64_t hi, const uint64_t lo,
+                                  const uint64_t d, uint64_t &rem)
+{
+#if defined(__SIZEOF_INT128__)
+	const auto n = (static_cast<uint128_t>(hi) << 64) | lo;
+	rem = static_cast<uint64_t>(n % d);
+	return static_cast<uint64_t>(n / d);
+#else
+	uint64_t r = hi, q = 0;
+	for (int i = 63; i >= 0; --i) {
+		const bool carry = (r >> 63) != 0;
+		r = (r << 1) | ((lo >> i) & 1);
+		if (carry || r >= d) {
+			r -= d;
+			q |= UINT64_C(1) << i;
+		}
+	}
+	rem = r;
+	return q;
+#endif
+}
+
+// Shifts hi:lo right by 'count' bits, ORing everything shifted out into the
+// lowest bit so that rounding still sees it
+static inline void shift_right_sticky(uint64_t &hi, uint64_t &lo, const int32_t count)
+{
+	if (count <= 0)
+		return;
+	if (count < 64) {
+		const bool sticky = (lo << (64 - count)) != 0;
+		lo = (lo >> count) | (hi << (64 - count)) | sticky;
+		hi >>= count;
+	} else if (count < 128) {
+		const bool sticky = lo != 0 || (count > 64 && (hi << (128 - count)) != 0);
+		lo = (count == 64 ? hi : hi >> (count - 64)) | sticky;
+		hi = 0;
+	} else {
+		lo = (hi | lo) != 0;
+		hi = 0;
+	}
+}
+
+struct Unpacked {
+	uint64_t mant = 0;
+	int32_t exp   = 0;
+	bool sign     = false;
+};
+
+// Splits a finite non-zero value, normalising denormals into the range
+// below the smallest exponent
+static inline Unpacked unpack(const Ext80 x)
+{
+	Unpacked u = {x.mant, x.sign_exp & exp_max, ext80_is_negative(x)};
+	if (u.exp == 0)
+		u.exp = 1;
+	const int shift = count_leading_zeros(u.mant);
+	u.mant <<= shift;
+	u.exp -= shift;
+	return u;
+}
+
+static inline bool is_nan(const Ext80 x)
+{
+	return (x.sign_exp & exp_max) == exp_max && (x.mant << 1) != 0;
+}
+
+static inline bool is_inf(const Ext80 x)
+{
+	return (x.sign_exp & exp_max) == exp_max && (x.mant << 1) == 0;
+}
+
+static inline bool is_special(const Ext80 x)
+{
+	return (x.sign_exp & exp_max) == exp_max || x.mant == 0;
+}
+
+// Unnormals, pseudo-infinities and pseudo-NaNs (a non-zero exponent
+// without the integer bit) are invalid operands since the 387
+static inline bool is_unsupported(const Ext80 x)
+{
+	return (x.sign_exp & exp_max) != 0 && !(x.mant & integer_bit);
+}
+
+static inline Ext80 quiet(const Ext80 x)
+{
+	return {x.mant | integer_bit | quiet_bit, x.sign_exp};
+}
+
+static inline Ext80 propagate_nan(const Ext80 a, const Ext80 b)
+{
+	return quiet(is_nan(a) ? a : b);
+}
+
+static inline Ext80 make_inf(const bool sign)
+{
+	return {integer_bit, static_cast<uint16_t>((sign ? 0x8000 : 0) | exp_max)};
+}
+
+static inline Ext80 make_zero(const bool sign)
+{
+	return {0, static_cast<uint16_t>(sign ? 0x8000 : 0)};
+}
+
+// Whether rounding the kept bits with the given discarded bits (aligned to
+// the top of the word) increments the magnitude
+static inline bool round_increments(const uint64_t kept, const uint64_t discarded,
+                                    const bool sign, const uint8_t rounding)
+{
+	if (rounding == round_nearest)
+		return discarded > integer_bit || (discarded == integer_bit && (kept & 1));
+	return discarded != 0 && rounds_away[rounding & 3][sign];
+}
+
+// Rounds hi:lo to the top 'bits' bits of hi, where the value is
+// hi.lo * 2^(exp - bias - 63) and hi is normalised. Values below 'min_exp'
+// become denormal, leaving the integer bit clear.
+static void round_significand(Unpacked &u, uint64_t lo, const int bits,
+                              const int32_t min_exp, const uint8_t rounding)
+{
+	uint64_t hi = u.mant;
+	if (u.exp < min_exp) {
+		shift_right_sticky(hi, lo, min_exp - u.exp);
+		u.exp = min_exp;
+	}
+	const int drop = 64 - bits;
+	uint64_t kept = hi, discarded = lo;
+	if (drop) {
+		kept = hi >> drop;
+		discarded = (hi << (64 - drop)) | (lo != 0);
+	}
+	if (round_increments(kept, discarded, u.sign, rounding)) {
+		++kept;
+		const bool carried = bits == 64 ? kept == 0 : (kept >> bits) != 0;
+		if (carried) {
+			kept = integer_bit >> drop;
+			++u.exp;
+		}
+	}
+	u.mant = kept << drop;
+}
+
+// Rounds and packs to extended format. Overflow gives infinity or the
+// largest finite value, depending on the rounding direction.
+static Ext80 round_pack(Unpacked u, const uint64_t lo, const Ext80Control ctrl)
+{
+	round_significand(u, lo, ctrl.precision, ext_min_exp, ctrl.rounding);
+	const uint16_t sign = u.sign ? 0x8000 : 0;
+	if (u.exp >= exp_max) {
+		if (ctrl.rounding == round_nearest || rounds_away[ctrl.rounding & 3][u.sign])
+			return make_inf(u.sign);
+		const uint64_t largest = ~UINT64_C(0) << (64 - ctrl.precision);
+		return {largest, static_cast<uint16_t>(sign | (exp_max - 1))};
+	}
+	if (u.mant == 0)
+		return make_zero(u.sign);
+	const int32_t exp = (u.mant & integer_bit) ? u.exp : 0;
+	return {u.mant, static_cast<uint16_t>(sign | exp)};
+}
+
+static Ext80 add_magnitudes(Ext80 a, Ext80 b, const bool subtract, const Ext80Control ctrl)
+{
+	const bool b_sign = ext80_is_negative(b) != subtract;
+	if (is_unsupported(a) || is_unsupported(b))
+		return indefinite;
+	if (is_nan(a) || is_nan(b))
+		return propagate_nan(a, b);
+	if (is_inf(a)) {
+		if (is_inf(b) && ext80_is_negative(a) != b_sign)
+			return indefinite;
+		return a;
+	}
+	if (is_inf(b))
+		return make_inf(b_sign);
+	if (b.mant == 0) {
+		if (a.mant == 0) {
+			// Zeros of opposite signs add to +0, or -0 when rounding down
+			const bool a_sign = ext80_is_negative(a);
+			return make_zero(a_sign == b_sign ? a_sign : ctrl.rounding == 1);
+		}
+		return round_pack(unpack(a), 0, ctrl);
+	}
+	if (a.mant == 0) {
+		auto u = unpack(b);
+		u.sign = b_sign;
+		return round_pack(u, 0, ctrl);
+	}
+
+	auto ua = unpack(a);
+	auto ub = unpack(b);
+	ub.sign = b_sign;
+	if (ua.exp < ub.exp || (ua.exp == ub.exp && ua.mant < ub.mant)) {
+		const auto t = ua;
+		ua = ub;
+		ub = t;
+	}
+	uint64_t b_hi = ub.mant, b_lo = 0;
+	shift_right_sticky(b_hi, b_lo, ua.exp - ub.exp);
+
+	uint64_t hi, lo;
+	if (ua.sign == ub.sign) {
+		lo = b_lo;
+		hi = ua.mant + b_hi;
+		if (hi < ua.mant) {
+			// Carry into a new integer bit
+			lo = (lo >> 1) | (hi << 63) | (lo & 1);
+			hi = (hi >> 1) | integer_bit;
+			++ua.exp;
+		}
+	} else {
+		lo = 0 - b_lo;
+		hi = ua.mant - b_hi - (b_lo != 0);
+		if (hi == 0 && lo == 0)
+			return make_zero(ctrl.rounding == 1);
+		// At most one position can be lost when anything was shifted
+		// into the sticky bits, so normalising keeps them below
+		if (hi == 0) {
+			hi = lo;
+			lo = 0;
+			ua.exp -= 64;
+		}
+		const int shift = count_leading_zeros(hi);
+		if (shift) {
+			hi = (hi << shift) | (lo >> (64 - shift));
+			lo <<= shift;
+			ua.exp -= shift;
+		}
+	}
+	ua.mant = hi;
+	return round_pack(ua, lo, ctrl);
+}
+
+Ext80 ext80_add(const Ext80 a, const Ext80 b, const Ext80Control ctrl)
+{
+	return add_magnitudes(a, b, false, ctrl);
+}
+
+Ext80 ext80_sub(const Ext80 a, const Ext80 b, const Ext80Control ctrl)
+{
+	return add_magnitudes(a, b, true, ctrl);
+}
+
+Ext80 ext80_mul(const Ext80 a, const Ext80 b, const Ext80Control ctrl)
+{
+	const bool sign = ext80_is_negative(a) != ext80_is_negative(b);
+	if (is_unsupported(a) || is_unsupported(b))
+		return indefinite;
+	if (is_special(a) || is_special(b)) {
+		if (is_nan(a) || is_nan(b))
+			return propagate_nan(a, b);
+		if (is_inf(a) || is_inf(b)) {
+			// Infinity times zero is invalid
+			if (a.mant == 0 || b.mant == 0)
+				return indefinite;
+			return make_inf(sign);
+		}
+		return make_zero(sign);
+	}
+	auto ua = unpack(a);
+	const auto ub = unpack(b);
+	uint64_t hi, lo;
+	mul_64x64(ua.mant, ub.mant, hi, lo);
+	ua.exp += ub.exp - exp_bias + 1;
+	if (!(hi & integer_bit)) {
+		hi = (hi << 1) | (lo >> 63);
+		lo <<= 1;
+		--ua.exp;
+	}
+	ua.mant = hi;
+	ua.sign = sign;
+	return round_pack(ua, lo, ctrl);
+}
+
+Ext80 ext80_div(const Ext80 a, const Ext80 b, const Ext80Control ctrl)
+{
+	const bool sign = ext80_is_negative(a) != ext80_is_negative(b);
+	if (is_unsupported(a) || is_unsupported(b))
+		return indefinite;
+	if (is_special(a) || is_special(b)) {
+		if (is_nan(a) || is_nan(b))
+			return propagate_nan(a, b);
+		if (is_inf(a))
+			return is_inf(b) ? indefinite : make_inf(sign);
+		if (is_inf(b))
+			return make_zero(sign);
+		if (b.mant == 0)
+			return a.mant == 0 ? indefinite : make_inf(sign);
+		return make_zero(sign);
+	}
+	auto ua = unpack(a);
+	const auto ub = unpack(b);
+	ua.exp -= ub.exp - exp_bias;
+
+	// Makes the integer part of the quotient exactly one bit
+	uint64_t n_hi = ua.mant, n_lo = 0;
+	if (ua.mant >= ub.mant) {
+		n_lo = n_hi << 63;
+		n_hi >>= 1;
+	} else {
+		--ua.exp;
+	}
+	uint64_t rem;
+	const uint64_t q = div_128x64(n_hi, n_lo, ub.mant, rem);
+	const uint64_t q_lo = div_128x64(rem, 0, ub.mant, rem);
+	ua.mant = q;
+	ua.sign = sign;
+	return round_pack(ua, q_lo | (rem != 0), ctrl);
+}
+
+int ext80_compare(const Ext80 a, const Ext80 b)
+{
+	if (is_nan(a) || is_nan(b) || is_unsupported(a) || is_unsupported(b))
+		return 2;
+	const bool a_zero = a.mant == 0, b_zero = b.mant == 0;
+	if (a_zero && b_zero)
+		return 0;
+	const bool a_sign = ext80_is_negative(a), b_sign = ext80_is_negative(b);
+	if (a_sign != b_sign)
+		return a_sign ? -1 : 1;
+
+	// Denormals share the smallest exponent, and their significands then
+	// compare correctly against those of the smallest normals
+	const int32_t a_exp = std::max(a.sign_exp & exp_max, ext_min_exp);
+	const int32_t b_exp = std::max(b.sign_exp & exp_max, ext_min_exp);
+	int magnitude = 0;
+	if (a_zero)
+		magnitude = -1;
+	else if (b_zero)
+		magnitude = 1;
+	else if (a_exp != b_exp)
+		magnitude = a_exp < b_exp ? -1 : 1;
+	else if (a.mant != b.mant)
+		magnitude = a.mant < b.mant ? -1 : 1;
+	return a_sign ? -magnitude : magnitude;
+}
+
+Ext80 ext80_from_double(const double d)
+{
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	const uint16_t sign = (bits >> 63) ? 0x8000 : 0;
+	const int32_t exp   = (bits >> 52) & 0x7ff;
+	const uint64_t frac = bits & ((UINT64_C(1) << 52) - 1);
+	if (exp == 0x7ff)
+		return {integer_bit | (frac << 11), static_cast<uint16_t>(sign | exp_max)};
+	if (exp == 0) {
+		if (frac == 0)
+			return {0, sign};
+		const int shift = count_leading_zeros(frac);
+		return {frac << shift,
+		        static_cast<uint16_t>(sign | (double_min_exp + 11 - shift))};
+	}
+	return {integer_bit | (frac << 11),
+	        static_cast<uint16_t>(sign | (exp - 1023 + exp_bias))};
+}
+
+Ext80 ext80_from_int64(const int64_t i)
+{
+	if (i == 0)
+		return {0, 0};
+	const bool sign = i < 0;
+	const uint64_t magnitude = sign ? 0 - static_cast<uint64_t>(i)
+	                                : static_cast<uint64_t>(i);
+	const int shift = count_leading_zeros(magnitude);
+	return {magnitude << shift,
+	        static_cast<uint16_t>((sign ? 0x8000 : 0) | (exp_bias + 63 - shift))};
+}
+
+// Rounds a finite value to a narrower IEEE format, given as the significand
+// bits including the integer bit and the exponent field width
+static uint64_t round_to_ieee(const Ext80 x, const uint8_t rounding,
+                              const int bits, const int exp_bits)
+{
+	const int32_t ieee_bias = (1 << (exp_bits - 1)) - 1;
+	const int32_t ieee_max  = (1 << exp_bits) - 1;
+	const int32_t min_exp   = 1 - ieee_bias + exp_bias;
+	const uint64_t sign     = ext80_is_negative(x) ? 1 : 0;
+	const int frac_bits     = bits - 1;
+	const uint64_t exp_field_inf = static_cast<uint64_t>(ieee_max) << frac_bits;
+	const uint64_t sign_field    = sign << (frac_bits + exp_bits);
+
+	if (is_unsupported(x))
+		return round_to_ieee(indefinite, rounding, bits, exp_bits);
+	if (is_nan(x))
+		return sign_field | exp_field_inf | (UINT64_C(1) << (frac_bits - 1)) |
+		       ((x.mant << 2) >> (66 - bits));
+	if (is_inf(x))
+		return sign_field | exp_field_inf;
+	if (x.mant == 0)
+		return sign_field;
+
+	auto u = unpack(x);
+	round_significand(u, 0, bits, min_exp, rounding);
+	const int32_t exp = u.exp - exp_bias + ieee_bias;
+	if (exp >= ieee_max) {
+		if (rounding == round_nearest || rounds_away[rounding & 3][sign])
+			return sign_field | exp_field_inf;
+		return sign_field | (exp_field_inf - 1);
+	}
+	const uint64_t mant = u.mant >> (64 - bits);
+	if (!(u.mant & integer_bit))
+		return sign_field | mant; // denormal, or rounded down to zero
+	return sign_field | (static_cast<uint64_t>(exp) << frac_bits) |
+	       (mant & ((UINT64_C(1) << frac_bits) - 1));
+}
+
+double ext80_to_double(const Ext80 x, const uint8_t rounding)
+{
+	const uint64_t bits = round_to_ieee(x, rounding, 53, 11);
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+float ext80_to_float(const Ext80 x, const uint8_t rounding)
+{
+	const auto bits = static_cast<uint32_t>(round_to_ieee(x, rounding, 24, 8));
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// Splits a finite value into its integer part and the fraction bits aligned
+// to the top of a word (with everything below them as a sticky bit); returns
+// false if the integer part needs more than 64 bits
+static bool split_integer(const Ext80 x, uint64_t &integer, uint64_t &fraction)
+{
+	const int32_t exp = (x.sign_exp & exp_max) - exp_bias;
+	if (x.mant == 0 || exp < -64) {
+		integer  = 0;
+		fraction = x.mant != 0;
+		return true;
+	}
+	if (exp > 63)
+		return false;
+	if (exp == 63) {
+		integer  = x.mant;
+		fraction = 0;
+	} else if (exp >= 0) {
+		integer  = x.mant >> (63 - exp);
+		fraction = x.mant << (exp + 1);
+	} else {
+		uint64_t hi = x.mant, lo = 0;
+		shift_right_sticky(hi, lo, -exp - 1);
+		integer  = 0;
+		fraction = hi | (lo != 0);
+	}
+	return true;
+}
+
+bool ext80_to_int64(const Ext80 x, const uint8_t rounding, int64_t &result)
+{
+	if ((x.sign_exp & exp_max) == exp_max || is_unsupported(x))
+		return false;
+	uint64_t integer, fraction;
+	if (!split_integer(x, integer, fraction))
+		return false;
+	const bool sign = ext80_is_negative(x);
+	if (round_increments(integer, fraction, sign, rounding)) {
+		if (++integer == 0)
+			return false;
+	}
+	if (sign) {
+		if (integer > integer_bit)
+			return false;
+		result = static_cast<int64_t>(0 - integer);
+	} else {
+		if (integer >= integer_bit)
+			return false;
+		result = static_cast<int64_t>(integer);
+	}
+	return true;
+}
+
+Ext80 ext80_round_to_int(const Ext80 x, const uint8_t rounding)
+{
+	const int32_t exp = x.sign_exp & exp_max;
+	if (is_unsupported(x))
+		return indefinite;
+	if (exp == exp_max)
+		return is_nan(x) ? quiet(x) : x;
+	// Values from 2^63 upwards have no fraction bits
+	if (exp >= exp_bias + 63 || x.mant == 0)
+		return x;
+	uint64_t integer, fraction;
+	split_integer(x, integer, fraction);
+	const bool sign = ext80_is_negative(x);
+	if (round_increments(integer, fraction, sign, rounding))
+		++integer;
+	if (integer == 0)
+		return make_zero(sign);
+	// Values below 2^63 round to at most 2^63, which still fits
+	const int shift = count_leading_zeros(integer);
+	return {integer << shift,
+	        static_cast<uint16_t>((sign ? 0x8000 : 0) | (exp_bias + 63 - shift))};
+}
@@ -65,6 +65,19 @@ These are common options:
   --list-glshaders    List available GLSL shaders and their directories.
                       Results are useable in the "glshader = " conf setting.
 
+  --benchmark-render  Draw generated frames through each scaler and the
+                      configured output, report the frame rate, CPU time and
+                      bytes uploaded per frame, and exit.
+
+  --benchmark         Run FILE as fast as possible without audio until
+  [--frames <n>]      <n> frames (default 1000) were rendered, report the
+                      emulated cycles per second, the frames rendered and
+                      mixed, and the host time taken by each subsystem, and
+                      exit.
+
+  --trace-startup     Log the time taken by each startup stage, including
+                      the initialization of each configuration section.
+
   -machine <type>     Setup dosbox to emulate a specific type of machine.
                       The machine type has influence on both the videocard
                       and the emulated soundcards.  Valid choices are:
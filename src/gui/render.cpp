@@ -18,27 +18,38 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <fstream>
 #include <functional>
+#include <mutex>
 #include <regex>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <sys/types.h>
 
 #include "control.h"
 #include "cross.h"
+#include "cycle_telemetry.h"
 #include "hardware.h"
 #include "mapper.h"
 #include "render.h"
+#include "replay.h"
 #include "setup.h"
 #include "shell.h"
 #include "string_utils.h"
 #include "support.h"
+#include "timedemo.h"
+#include "timer.h"
+#include "tracy.h"
 #include "vga.h"
 #include "video.h"
 
@@ -47,9 +58,150 @@
 Render_t render;
 ScalerLineHandler_t RENDER_DrawLine;
 
+// Scales the rows of a complex scaler's frame in horizontal bands, one per
+// thread. The emulation thread takes the first band itself.
+class ScalerBands {
+public:
+	~ScalerBands()
+	{
+		Stop();
+	}
+
+	void Start(const int extra_threads)
+	{
+		Stop();
+		bands.resize(static_cast<size_t>(extra_threads) + 1);
+		for (int i = 1; i <= extra_threads; ++i)
+			workers.emplace_back(&ScalerBands::Work, this, i);
+	}
+
+	void Stop()
+	{
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto &worker : workers)
+			worker.join();
+		workers.clear();
+		stopping = false;
+	}
+
+	void Scale(const ScalerComplexBandHandler_t scale_band, const Bitu first,
+	           const Bitu last)
+	{
+		// Split the rows evenly and find where each band's lines start.
+		// Rows lead their own output lines, so bands share nothing but
+		// the frame cache they read.
+		const auto rows = last - first + 1;
+		const auto count = std::min(bands.size(), static_cast<size_t>(rows));
+		uint8_t *out = render.scale.outWrite;
+		Bitu row = first;
+		for (size_t i = 0; i < bands.size(); ++i) {
+			auto &band = bands[i];
+			const auto band_rows = i < count ? (rows * (i + 1)) / count -
+			                                           (rows * i) / count
+			                                 : 0;
+			band.first = row;
+			band.last  = row + band_rows - 1;
+			band.out   = out;
+			for (; row <= band.last && band_rows; ++row)
+				out += render.scale.outPitch * Scaler_Aspect[row];
+		}
+		{
+			std::lock_guard lock(mutex);
+			handler = scale_band;
+			pending = workers.size();
+			++generation;
+		}
+		wake.notify_all();
+		Run(bands[0]);
+		std::unique_lock lock(mutex);
+		done.wait(lock, [this] { return pending == 0; });
+	}
+
+	uint8_t changed[SCALER_MAXHEIGHT] = {};
+
+private:
+	struct Band {
+		Bitu first = 0;
+		Bitu last  = 0;
+		uint8_t *out = nullptr;
+	};
+
+	void Run(const Band &band)
+	{
+		ZoneScopedSubsystem("Render scale band");
+		if (band.last >= band.first && band.out)
+			handler(band.first, band.last, band.out, changed);
+	}
+
+	void Work(const size_t index)
+	{
+		uint64_t seen = 0;
+		while (true) {
+			{
+				std::unique_lock lock(mutex);
+				wake.wait(lock, [&] {
+					return stopping || generation != seen;
+				});
+				if (stopping)
+					return;
+				seen = generation;
+			}
+			Run(bands[index]);
+			std::lock_guard lock(mutex);
+			if (--pending == 0)
+				done.notify_one();
+		}
+	}
+
+	std::vector<std::thread> workers = {};
+	std::vector<Band> bands = {Band()};
+	std::mutex mutex = {};
+	std::condition_variable wake = {};
+	std::condition_variable done = {};
+	ScalerComplexBandHandler_t handler = nullptr;
+	size_t pending = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+};
+
+static ScalerBands scaler_bands;
+
+// The rows are scaled at the end of the frame instead
+static void RENDER_EmptyComplexHandler() {}
+
+// Scales the rows a complex scaler would have worked through while the
+// frame was drawn
+static void RENDER_ScaleBands()
+{
+	// The first row only primes the frame cache
+	const Bitu first = std::max(render.scale.outLine, 1u);
+	const Bitu last  = render.scale.inLine == render.scale.inHeight
+	                          ? render.scale.inHeight
+	                          : render.scale.inLine - 1;
+	if (last < first)
+		return;
+	scaler_bands.Scale(render.scale.complexBandHandler, first, last);
+	for (Bitu row = first; row <= last; ++row) {
+		const Bitu changed = scaler_bands.changed[row];
+		const Bitu count   = Scaler_Aspect[row];
+		if ((Scaler_ChangedLineIndex & 1) == changed)
+			Scaler_ChangedLines[Scaler_ChangedLineIndex] += count;
+		else
+			Scaler_ChangedLines[++Scaler_ChangedLineIndex] = count;
+		render.scale.outWrite += render.scale.outPitch * count;
+	}
+	render.scale.outLine = static_cast<uint32_t>(last + 1);
+}
+
 static void RENDER_CallBack(GFX_CallBackFunctions_t function);
 
-static void Check_Palette(void)
+// Returns whether the palette of an output expanding 8-bit frames itself
+// changed, in which case the frame has to be presented even if no line did
+static bool Check_Palette(void)
 {
 	/* Clean up any previous changed palette data */
 	if (render.pal.changed) {
@@ -57,10 +209,25 @@ static void Check_Palette(void)
 		render.pal.changed = false;
 	}
 	if (render.pal.first > render.pal.last)
-		return;
+		return false;
+	bool output_palette_changed = false;
 	Bitu i;
 	switch (render.scale.outMode) {
-	case scalerMode8: break;
+	case scalerMode8:
+		for (i = render.pal.first; i <= render.pal.last; i++) {
+			uint8_t r = render.pal.rgb[i].red;
+			uint8_t g = render.pal.rgb[i].green;
+			uint8_t b = render.pal.rgb[i].blue;
+
+			uint32_t new_pal = GFX_GetRGB(r, g, b);
+			if (new_pal != render.pal.lut.b32[i]) {
+				output_palette_changed = true;
+				render.pal.lut.b32[i]  = new_pal;
+			}
+		}
+		if (output_palette_changed)
+			GFX_SetPalette(render.pal.lut.b32);
+		break;
 	case scalerMode15:
 	case scalerMode16:
 		for (i = render.pal.first; i <= render.pal.last; i++) {
@@ -95,6 +262,7 @@ static void Check_Palette(void)
 	/* Setup pal index to startup values */
 	render.pal.first = 256;
 	render.pal.last  = 0;
+	return output_palette_changed;
 }
 
 void RENDER_SetPal(uint8_t entry, uint8_t red, uint8_t green, uint8_t blue)
@@ -108,6 +276,22 @@ void RENDER_SetPal(uint8_t entry, uint8_t red, uint8_t green, uint8_t blue)
 		render.pal.last = entry;
 }
 
+bool RENDER_CanDecodeComposite()
+{
+	// Scalers other than plain pixel repetition would mix up the hdots
+	return render.scale.op == scalerOpNormal && GFX_CanDecodeComposite();
+}
+
+// The decoder of the composite hdots changed, in which case the frame has to
+// be presented even if no line did
+static bool composite_decoder_changed = false;
+
+void RENDER_SetCompositeDecoder(const GFX_CompositeDecoder *decoder)
+{
+	if (GFX_SetCompositeDecoder(decoder))
+		composite_decoder_changed = true;
+}
+
 static void RENDER_EmptyLineHandler(const void *) {}
 
 static void RENDER_StartLineHandler(const void *s)
@@ -121,6 +305,9 @@ static void RENDER_StartLineHandler(const void *s)
 			if (GCC_UNLIKELY(src_val != cache[0])) {
 				if (!GFX_StartUpdate(render.scale.outWrite,
 				                     render.scale.outPitch)) {
+					// The lines of this frame are lost, so
+					// the next one can't rely on the cache
+					render.scale.clearCache = true;
 					RENDER_DrawLine = RENDER_EmptyLineHandler;
 					return;
 				}
@@ -141,6 +328,34 @@ static void RENDER_StartLineHandler(const void *s)
 	render.scale.outLine++;
 }
 
+// After a palette change, the update only starts at the first line that
+// differs from the cache or shows one of the changed colours. Lines skipped
+// by the VGA are unchanged in video memory, so their cached pixels are
+// checked instead.
+static void RENDER_StartPalLineHandler(const void *s)
+{
+	const uint8_t *cache = render.scale.cacheRead;
+	const auto src = s ? static_cast<const uint8_t *>(s) : cache;
+	for (Bitu x = 0; x < render.src.width; ++x) {
+		if (src[x] == cache[x] && !render.pal.modified[src[x]])
+			continue;
+		if (!GFX_StartUpdate(render.scale.outWrite, render.scale.outPitch)) {
+			render.scale.clearCache = true;
+			RENDER_DrawLine = RENDER_EmptyLineHandler;
+			return;
+		}
+		render.scale.outWrite += render.scale.outPitch *
+		                         Scaler_ChangedLines[0];
+		RENDER_DrawLine = render.scale.linePalHandler;
+		RENDER_DrawLine(s);
+		return;
+	}
+	render.scale.cacheRead += render.scale.cachePitch;
+	Scaler_ChangedLines[0] += Scaler_Aspect[render.scale.inLine];
+	render.scale.inLine++;
+	render.scale.outLine++;
+}
+
 static void RENDER_FinishLineHandler(const void *s)
 {
 	if (s) {
@@ -168,19 +383,66 @@ static void RENDER_ClearCacheHandler(const void *src)
 	render.scale.lineHandler(src);
 }
 
+// Automatic frameskip compares the host time taken by a second's worth of
+// emulated frames against that second. Running behind means the host can't
+// keep up, so another frame gets skipped; catching up gives one back.
+static struct {
+	bool enabled          = false;
+	int min_skip          = 0;
+	int64_t last_frame_us = 0;
+	int64_t host_us       = 0;
+	double emulated_us    = 0.0;
+} auto_frameskip = {};
+
+static void update_auto_frameskip()
+{
+	auto &af = auto_frameskip;
+	if (!af.enabled || render.src.fps <= 0.0 || REPLAY_IsActive())
+		return;
+
+	const auto now_us = GetTicksUs();
+	const auto frame_host_us = now_us - af.last_frame_us;
+	af.last_frame_us = now_us;
+
+	// Ignore the gaps left by pauses, menus, and mode changes
+	const auto frame_period_us = 1'000'000.0 / render.src.fps;
+	if (frame_host_us <= 0 || frame_host_us > 4 * frame_period_us)
+		return;
+	af.host_us += frame_host_us;
+	af.emulated_us += frame_period_us;
+	if (af.emulated_us < 1'000'000.0)
+		return;
+
+	const auto load = static_cast<double>(af.host_us) / af.emulated_us;
+	constexpr double behind = 1.05;
+	constexpr double caught_up = 1.01;
+	constexpr int max_skip = 10;
+	auto &skip = render.frameskip.max;
+	if (load > behind && skip < max_skip)
+		++skip;
+	else if (load < caught_up && skip > af.min_skip)
+		--skip;
+	af.host_us = 0;
+	af.emulated_us = 0.0;
+}
+
 bool RENDER_StartUpdate(void)
 {
 	if (GCC_UNLIKELY(render.updating))
 		return false;
 	if (GCC_UNLIKELY(!render.active))
 		return false;
+	update_auto_frameskip();
 	if (GCC_UNLIKELY(render.frameskip.count < render.frameskip.max)) {
 		render.frameskip.count++;
 		return false;
 	}
 	render.frameskip.count = 0;
+	bool output_palette_changed = false;
 	if (render.scale.inMode == scalerMode8) {
-		Check_Palette();
+		output_palette_changed = Check_Palette() ||
+		                         composite_decoder_changed;
+		composite_decoder_changed = false;
 	}
 	render.scale.inLine     = 0;
 	render.scale.outLine    = 0;
@@ -203,20 +465,25 @@ bool RENDER_StartUpdate(void)
 		RENDER_DrawLine         = RENDER_ClearCacheHandler;
 	} else {
 		if (render.pal.changed) {
-			/* Assume pal changes always do a full screen update
-			 * anyway */
-			if (GCC_UNLIKELY(!GFX_StartUpdate(render.scale.outWrite,
-			                                  render.scale.outPitch)))
-				return false;
-			RENDER_DrawLine  = render.scale.linePalHandler;
-			render.fullFrame = true;
+			// Only the lines showing the changed colours are drawn,
+			// so the VGA can keep skipping unchanged lines
+			RENDER_DrawLine  = RENDER_StartPalLineHandler;
+			render.fullFrame = (CaptureState &
+			                    (CAPTURE_IMAGE | CAPTURE_VIDEO)) != 0 ||
+			                   REPLAY_IsActive();
 		} else {
 			RENDER_DrawLine = RENDER_StartLineHandler;
 			if (GCC_UNLIKELY(CaptureState &
-			                 (CAPTURE_IMAGE | CAPTURE_VIDEO)))
+			                 (CAPTURE_IMAGE | CAPTURE_VIDEO)) ||
+			    GCC_UNLIKELY(REPLAY_IsActive()))
 				render.fullFrame = true;
 			else
 				render.fullFrame = false;
+			// The new colours show without redrawing any line
+			if (GCC_UNLIKELY(output_palette_changed) &&
+			    !GFX_StartUpdate(render.scale.outWrite,
+			                     render.scale.outPitch))
+				return false;
 		}
 	}
 	render.updating = true;
@@ -231,13 +498,49 @@ static void RENDER_Halt(void)
 	render.active   = false;
 }
 
+// A 64-bit FNV-1a hash of the frame's source lines and, if it has one, its
+// palette, taken eight bytes at a time
+static uint64_t frame_checksum()
+{
+	constexpr uint64_t prime = 0x100000001b3;
+	uint64_t hash = 0xcbf29ce484222325;
+	auto add = [&](const uint8_t *data, const size_t num_bytes) {
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= num_bytes; i += sizeof(uint64_t)) {
+			uint64_t word = 0;
+			memcpy(&word, data + i, sizeof(word));
+			hash = (hash ^ word) * prime;
+		}
+		for (; i < num_bytes; ++i)
+			hash = (hash ^ data[i]) * prime;
+	};
+
+	const auto line_bytes = render.src.width * ((render.src.bpp + 7) / 8);
+	const auto cache = reinterpret_cast<const uint8_t *>(&scalerSourceCache);
+	for (uint32_t y = 0; y < render.src.height; ++y)
+		add(cache + y * render.scale.cachePitch, line_bytes);
+	if (render.src.bpp == 8)
+		add(reinterpret_cast<const uint8_t *>(&render.pal.rgb),
+		    sizeof(render.pal.rgb));
+	return hash;
+}
+
 extern uint32_t PIC_Ticks;
 void RENDER_EndUpdate(bool abort)
 {
 	if (GCC_UNLIKELY(!render.updating))
 		return;
+	TelemetryScope telemetry_scope(TelemetryBucket::Render);
+	ZoneScopedSubsystem("Render end update");
+
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
-	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE | CAPTURE_VIDEO))) {
+	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE | CAPTURE_VIDEO)) &&
+	    CAPTURE_WantsDisplayImage()) {
+		auto fps = render.src.fps;
+		if (render.frameskip.max)
+			fps /= 1 + render.frameskip.max;
+		CAPTURE_TickDisplayFrame(static_cast<float>(fps));
+	} else if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE | CAPTURE_VIDEO))) {
 		Bitu pitch, flags;
 		flags = 0;
 		if (render.src.dblw != render.src.dblh) {
@@ -261,7 +564,17 @@ void RENDER_EndUpdate(bool abort)
 		                 (uint8_t *)&scalerSourceCache,
 		                 (uint8_t *)&render.pal.rgb);
 	}
+	if (GCC_UNLIKELY(REPLAY_IsActive()) && !abort)
+		REPLAY_AddFrame(frame_checksum());
+	if (GCC_UNLIKELY(TIMEDEMO_IsActive()) && !abort)
+		TIMEDEMO_AddFrame();
+	// The lines left undrawn won't show the changed colours otherwise, as
+	// the palette changes are forgotten by the next frame
+	if (abort && render.pal.changed)
+		render.scale.clearCache = true;
 	if (render.scale.outWrite) {
+		if (render.scale.complexBandHandler && !abort)
+			RENDER_ScaleBands();
 		GFX_EndUpdate(abort ? NULL : Scaler_ChangedLines);
 		render.frameskip.hadSkip[render.frameskip.index] = 0;
 	} else {
@@ -280,6 +593,45 @@ void RENDER_EndUpdate(bool abort)
 	render.updating = false;
 }
 
+bool RENDER_StartDirectUpdate()
+{
+	// The frame must come out of the scalers exactly as it went in
+	const bool can_draw_direct = render.updating && render.src.bpp == 32 &&
+	                             render.scale.outMode == scalerMode32 &&
+	                             render.scale.op == scalerOpNormal &&
+	                             render.scale.size == 1 && !render.src.dblw &&
+	                             !render.src.dblh &&
+	                             !(CaptureState & (CAPTURE_IMAGE | CAPTURE_VIDEO)) &&
+	                             !REPLAY_IsActive() && GFX_CanUploadDirect();
+	if (!can_draw_direct)
+		return false;
+
+	RENDER_DrawLine = RENDER_EmptyLineHandler;
+	// The scaler cache won't hold what's displayed, whether or not the
+	// frame is completed
+	render.scale.clearCache = true;
+	return true;
+}
+
+void RENDER_EndDirectUpdate(const uint8_t *pixels, const int pitch)
+{
+	if (GCC_UNLIKELY(!render.updating))
+		return;
+	TelemetryScope telemetry_scope(TelemetryBucket::Render);
+	ZoneScopedSubsystem("Render end direct update");
+
+	// No line was drawn, so the output's update may not have started yet
+	if (render.scale.outWrite ||
+	    GFX_StartUpdate(render.scale.outWrite, render.scale.outPitch)) {
+		GFX_EndUpdateDirect(pixels, pitch);
+	} else {
+		GFX_EndUpdate(nullptr);
+	}
+	render.frameskip.index = (render.frameskip.index + 1) &
+	                         (RENDER_SKIP_CACHE - 1);
+	render.updating = false;
+}
+
 static Bitu MakeAspectTable(Bitu skip, Bitu height, double scaley, Bitu miny)
 {
 	Bitu i;
@@ -521,12 +873,15 @@ static void RENDER_Reset(void)
 	else
 		E_Exit("Failed to create a rendering output");
 	ScalerLineBlock_t *lineBlock;
+	render.scale.complexBandHandler = nullptr;
 	if (gfx_flags & GFX_HARDWARE) {
 #if RENDER_USE_ADVANCED_SCALERS > 1
 		if (complexBlock) {
 			lineBlock = &ScalerCache;
 			render.scale.complexHandler =
 			        complexBlock->Linear[render.scale.outMode];
+			render.scale.complexBandHandler =
+			        complexBlock->LinearBand[render.scale.outMode];
 		} else
 #endif
 		{
@@ -539,6 +894,8 @@ static void RENDER_Reset(void)
 			lineBlock = &ScalerCache;
 			render.scale.complexHandler =
 			        complexBlock->Random[render.scale.outMode];
+			render.scale.complexBandHandler =
+			        complexBlock->RandomBand[render.scale.outMode];
 		} else
 #endif
 		{
@@ -546,6 +903,12 @@ static void RENDER_Reset(void)
 			lineBlock                   = &simpleBlock->Random;
 		}
 	}
+	// With threads to spare, the rows are scaled in bands once the frame
+	// is complete rather than one by one as it's drawn
+	if (render.scale.complexBandHandler && render.scale.threads > 0)
+		render.scale.complexHandler = RENDER_EmptyComplexHandler;
+	else
+		render.scale.complexBandHandler = nullptr;
 	switch (render.src.bpp) {
 	case 8:
 		render.scale.lineHandler = (*lineBlock)[0][render.scale.outMode];
@@ -587,6 +950,9 @@ static void RENDER_Reset(void)
 	render.pal.last    = 255;
 	render.pal.changed = false;
 	memset(render.pal.modified, 0, sizeof(render.pal.modified));
+	// An output expanding the palette itself has to be passed all of it
+	if (render.scale.outMode == scalerMode8)
+		memset(render.pal.lut.b32, 0, sizeof(render.pal.lut.b32));
 	// Finish this frame using a copy only handler
 	RENDER_DrawLine       = RENDER_FinishLineHandler;
 	render.scale.outWrite = 0;
@@ -915,6 +1281,17 @@ void RENDER_Init(Section *sec)
 	render.frameskip.max   = section->Get_int("frameskip");
 	render.frameskip.count = 0;
 
+	auto_frameskip.enabled  = section->Get_bool("auto_frameskip");
+	auto_frameskip.min_skip = render.frameskip.max;
+	auto_frameskip.host_us  = 0;
+	auto_frameskip.emulated_us = 0.0;
+
+	if (render.scale.threads == 0) {
+		render.scale.threads = section->Get_int("scaler_threads");
+		if (render.scale.threads > 0)
+			scaler_bands.Start(render.scale.threads);
+	}
+
 	VGA_SetMonoPalette(section->Get_string("monochrome_palette"));
 
 	// Check for commandline paramters and parse them through the
@@ -1033,3 +1410,134 @@ void RENDER_Init(Section *sec)
 
 	GFX_SetTitle(-1, render.frameskip.max, false);
 }
+
+// Render Benchmark
+// ~~~~~~~~~~~~~~~~
+// Feeds generated frame sequences through each scaler and the configured
+// output, as the VGA would, and reports the throughput. The sequences stand in
+// for typical content: a still screen, a screen scrolling by a line each
+// frame, and a sprite moving over a still background.
+struct BenchmarkSequence {
+	const char *name = "";
+	uint32_t width = 0;
+	uint32_t height = 0;
+	unsigned bpp = 8;
+	std::vector<std::vector<uint8_t>> frames = {};
+};
+
+static BenchmarkSequence make_benchmark_sequence(
+        const char *name, const uint32_t width, const uint32_t height,
+        const unsigned bpp, const int num_frames,
+        const std::function<uint32_t(uint32_t x, uint32_t y, int frame)> &pixel)
+{
+	BenchmarkSequence sequence = {name, width, height, bpp};
+	const auto bytes_per_pixel = bpp / 8;
+	for (int frame = 0; frame < num_frames; ++frame) {
+		std::vector<uint8_t> pixels(width * height * bytes_per_pixel);
+		auto *p = pixels.data();
+		for (uint32_t y = 0; y < height; ++y)
+			for (uint32_t x = 0; x < width; ++x) {
+				const auto value = pixel(x, y, frame);
+				memcpy(p, &value, bytes_per_pixel);
+				p += bytes_per_pixel;
+			}
+		sequence.frames.emplace_back(std::move(pixels));
+	}
+	return sequence;
+}
+
+static std::vector<BenchmarkSequence> make_benchmark_sequences()
+{
+	auto pattern = [](const uint32_t x, const uint32_t y) {
+		return ((x / 8) ^ (y / 8)) * 7 + x / 32;
+	};
+	auto sprite = [pattern](const uint32_t x, const uint32_t y, const int frame) {
+		const auto left = static_cast<uint32_t>(frame * 4 % 288);
+		const auto top = static_cast<uint32_t>(frame * 2 % 168);
+		if (x >= left && x < left + 32 && y >= top && y < top + 32)
+			return 255u;
+		return pattern(x, y) & 0xff;
+	};
+	auto scroll_8 = [pattern](const uint32_t x, const uint32_t y, const int frame) {
+		return pattern(x, y + static_cast<uint32_t>(frame)) & 0xff;
+	};
+	auto scroll_32 = [pattern](const uint32_t x, const uint32_t y, const int frame) {
+		const auto value = pattern(x, y + static_cast<uint32_t>(frame));
+		return (value * 0x010305) & 0xffffff;
+	};
+	auto still = [pattern](const uint32_t x, const uint32_t y, int) {
+		return pattern(x, y) & 0xff;
+	};
+
+	std::vector<BenchmarkSequence> sequences = {};
+	sequences.emplace_back(make_benchmark_sequence(
+	        "320x200 8-bit still", 320, 200, 8, 1, still));
+	sequences.emplace_back(make_benchmark_sequence(
+	        "320x200 8-bit sprite", 320, 200, 8, 64, sprite));
+	sequences.emplace_back(make_benchmark_sequence(
+	        "320x200 8-bit scroll", 320, 200, 8, 64, scroll_8));
+	sequences.emplace_back(make_benchmark_sequence(
+	        "640x480 32-bit scroll", 640, 480, 32, 16, scroll_32));
+	return sequences;
+}
+
+void RENDER_Benchmark()
+{
+	constexpr int frames_per_run = 600;
+
+	auto render_section = control->GetSection("render");
+	assert(render_section);
+	auto section = static_cast<Section_prop *>(render_section);
+	const auto scaler_types = section->GetMultiVal("scaler")->GetValues();
+
+	const auto sdl_section = static_cast<Section_prop *>(
+	        control->GetSection("sdl"));
+	printf("Render benchmark: %d frames per run with output '%s'\n\n",
+	       frames_per_run, sdl_section->Get_string("output"));
+	printf("%-12s %-22s %9s %12s %12s\n", "scaler", "sequence", "fps",
+	       "cpu ms/frame", "KB/frame");
+
+	const auto sequences = make_benchmark_sequences();
+	for (const auto &type : scaler_types) {
+		const auto scaler = type.ToString();
+		section->HandleInputline("scaler=" + scaler + " forced");
+		RENDER_Init(render_section);
+
+		for (auto i = 0; i < 256; ++i) {
+			const auto level = static_cast<uint8_t>(i);
+			RENDER_SetPal(level, level, static_cast<uint8_t>(level * 3),
+			              static_cast<uint8_t>(255 - level));
+		}
+
+		for (const auto &sequence : sequences) {
+			RENDER_SetSize(sequence.width, sequence.height,
+			               sequence.bpp, 70.0, 1.0, false, false);
+			const auto pitch = sequence.width * sequence.bpp / 8;
+			GFX_Events();
+
+			const auto start_bytes = GFX_GetUploadedBytes();
+			const auto start_cpu = std::clock();
+			const auto start_us = GetTicksUs();
+			for (auto frame = 0; frame < frames_per_run; ++frame) {
+				const auto index = static_cast<size_t>(frame) %
+				                   sequence.frames.size();
+				const auto &pixels = sequence.frames[index];
+				if (!RENDER_StartUpdate())
+					continue;
+				for (uint32_t y = 0; y < sequence.height; ++y)
+					RENDER_DrawLine(pixels.data() + y * pitch);
+				RENDER_EndUpdate(false);
+			}
+			const auto elapsed_us = GetTicksUsSince(start_us);
+			const auto cpu_ms = 1000.0 * (std::clock() - start_cpu) /
+			                    CLOCKS_PER_SEC;
+			const auto bytes = GFX_GetUploadedBytes() - start_bytes;
+
+			printf("%-12s %-22s %9.1f %12.3f %12.1f\n",
+			       scaler.c_str(), sequence.name,
+			       frames_per_run * 1e6 / std::max(elapsed_us, 1),
+			       cpu_ms / frames_per_run,
+			       bytes / 1024.0 / frames_per_run);
+		}
+	}
+}
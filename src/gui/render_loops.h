@@ -16,33 +16,25 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
-#if defined (SCALERLINEAR)
-static void conc3d(SCALERNAME,SBPP,L)(void) {
-#else
-static void conc3d(SCALERNAME,SBPP,R)(void) {
-#endif
-//Skip the first one for multiline input scalers
-	if (!render.scale.outLine) {
-		render.scale.outLine++;
-		return;
-	}
-lastagain:
-	if (!CC[render.scale.outLine][0]) {
-#if defined(SCALERLINEAR) 
-		Bitu scaleLines = SCALERHEIGHT;
+#if defined(SCALERLINEAR)
+#define SCALERROW   conc3d(SCALERNAME,SBPP,RowL)
+#define SCALERLINES(row) SCALERHEIGHT
 #else
-		Bitu scaleLines = Scaler_Aspect[ render.scale.outLine ];
+#define SCALERROW   conc3d(SCALERNAME,SBPP,RowR)
+#define SCALERLINES(row) Scaler_Aspect[row]
 #endif
-		ScalerAddLines( 0, scaleLines );
-		if (++render.scale.outLine == render.scale.inHeight)
-			goto lastagain;
-		return;
-	}
+
+/* Scales a row of the frame cache into the lines starting at out, returning
+ * whether it had changes. Rows only touch their own lines and change marks,
+ * so bands of them can be scaled in parallel. */
+static inline bool SCALERROW(const Bitu row, uint8_t *out) {
+	if (!CC[row][0])
+		return false;
 	/* Clear the complete line marker */
-	CC[render.scale.outLine][0] = 0;
-	const PTYPE * fc = &FC[render.scale.outLine][1];
-	PTYPE * line0=(PTYPE *)(render.scale.outWrite);
-	uint8_t * changed = &CC[render.scale.outLine][1];
+	CC[row][0] = 0;
+	const PTYPE * fc = &FC[row][1];
+	PTYPE * line0=(PTYPE *)(out);
+	uint8_t * changed = &CC[row][1];
 	Bitu b;
 	for (b=0;b<render.scale.blocks;b++) {
 #if (SCALERHEIGHT > 1) 
@@ -190,21 +182,50 @@ lastagain:
 			break;
 		}
 	}
-#if defined(SCALERLINEAR) 
-	Bitu scaleLines = SCALERHEIGHT;
-#else
-	Bitu scaleLines = Scaler_Aspect[ render.scale.outLine ];
+#if !defined(SCALERLINEAR)
+	Bitu scaleLines = Scaler_Aspect[row];
 	if ( ((Bits)(scaleLines - SCALERHEIGHT)) > 0 ) {
-		BituMove( render.scale.outWrite + render.scale.outPitch * SCALERHEIGHT,
-			render.scale.outWrite + render.scale.outPitch * (SCALERHEIGHT-1),
+		BituMove( out + render.scale.outPitch * SCALERHEIGHT,
+			out + render.scale.outPitch * (SCALERHEIGHT-1),
 			render.src.width * SCALERWIDTH * PSIZE);
 	}
 #endif
-	ScalerAddLines( 1, scaleLines );
+	return true;
+}
+
+#if defined (SCALERLINEAR)
+static void conc3d(SCALERNAME,SBPP,L)(void) {
+#else
+static void conc3d(SCALERNAME,SBPP,R)(void) {
+#endif
+//Skip the first one for multiline input scalers
+	if (!render.scale.outLine) {
+		render.scale.outLine++;
+		return;
+	}
+lastagain:
+	const Bitu row = render.scale.outLine;
+	ScalerAddLines(SCALERROW(row, render.scale.outWrite), SCALERLINES(row));
 	if (++render.scale.outLine == render.scale.inHeight)
 		goto lastagain;
 }
 
+/* Scales the rows first to last into the lines starting at out, noting
+ * which rows had changes */
+#if defined (SCALERLINEAR)
+static void conc3d(SCALERNAME,SBPP,BandL)(Bitu first, Bitu last, uint8_t *out, uint8_t *changed) {
+#else
+static void conc3d(SCALERNAME,SBPP,BandR)(Bitu first, Bitu last, uint8_t *out, uint8_t *changed) {
+#endif
+	for (Bitu row = first; row <= last; row++) {
+		changed[row] = SCALERROW(row, out);
+		out += render.scale.outPitch * SCALERLINES(row);
+	}
+}
+
+#undef SCALERROW
+#undef SCALERLINES
+
 #if !defined(SCALERLINEAR) 
 #define SCALERLINEAR 1
 #include "render_loops.h"
@@ -25,11 +25,20 @@
 #include "render.h"
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RENDER_SCALER_SIMD 1
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define RENDER_SCALER_SIMD 1
+#endif
+
 uint8_t Scaler_Aspect[SCALER_MAXHEIGHT];
 uint16_t Scaler_ChangedLines[SCALER_MAXHEIGHT];
 Bitu Scaler_ChangedLineIndex;
 
-static union {
+// Each thread scaling bands of a frame needs its own
+static thread_local union {
 	 //The +1 is a at least for the normal scalers not needed. (-1 is enough)
 	uint32_t b32 [SCALER_MAX_MUL_HEIGHT + 1][SCALER_MAXLINE_WIDTH];
 	uint16_t b16 [SCALER_MAX_MUL_HEIGHT + 1][SCALER_MAXLINE_WIDTH];
@@ -72,6 +81,35 @@ static inline void ScalerAddLines( Bitu changed, Bitu count ) {
 }
 
 
+/* Four 32-bit pixels at a time, for the simple scalers between 32-bit
+ * formats and the pattern detection of the hq scalers */
+#if defined(RENDER_SCALER_SIMD)
+#if defined(__SSE2__) || defined(_M_X64)
+using pixel_vec = __m128i;
+static inline pixel_vec pixels_zero() { return _mm_setzero_si128(); }
+static inline pixel_vec pixels_load(const uint32_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+static inline void pixels_store(uint32_t *p, const pixel_vec v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+static inline void pixels_store_x2(uint32_t *p, const pixel_vec v)
+{
+	pixels_store(p, _mm_unpacklo_epi32(v, v));
+	pixels_store(p + 4, _mm_unpackhi_epi32(v, v));
+}
+static inline void pixels_store_x3(uint32_t *p, const pixel_vec v)
+{
+	pixels_store(p, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+	pixels_store(p + 4, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+	pixels_store(p + 8, _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+}
+#else
+using pixel_vec = uint32x4_t;
+static inline pixel_vec pixels_zero() { return vdupq_n_u32(0); }
+static inline pixel_vec pixels_load(const uint32_t *p) { return vld1q_u32(p); }
+static inline void pixels_store(uint32_t *p, const pixel_vec v) { vst1q_u32(p, v); }
+static inline void pixels_store_x2(uint32_t *p, const pixel_vec v) { vst2q_u32(p, uint32x4x2_t{{v, v}}); }
+static inline void pixels_store_x3(uint32_t *p, const pixel_vec v) { vst3q_u32(p, uint32x4x3_t{{v, v, v}}); }
+#endif
+#endif
+
 #define BituMove2(_DST,_SRC,_SIZE)			\
 {											\
 	Bitu bsize=(_SIZE)/sizeof(Bitu);		\
@@ -405,7 +443,9 @@ ScalerComplexBlock_t ScaleAdvMame2x ={
 	GFX_CAN_8|GFX_CAN_15|GFX_CAN_16|GFX_CAN_32,
 	2,2,
 {	AdvMame2x_8_L,AdvMame2x_16_L,AdvMame2x_16_L,AdvMame2x_32_L},
-{	AdvMame2x_8_R,AdvMame2x_16_R,AdvMame2x_16_R,AdvMame2x_32_R}
+{	AdvMame2x_8_R,AdvMame2x_16_R,AdvMame2x_16_R,AdvMame2x_32_R},
+{	AdvMame2x_8_BandL,AdvMame2x_16_BandL,AdvMame2x_16_BandL,AdvMame2x_32_BandL},
+{	AdvMame2x_8_BandR,AdvMame2x_16_BandR,AdvMame2x_16_BandR,AdvMame2x_32_BandR}
 };
 
 ScalerComplexBlock_t ScaleAdvMame3x = {
@@ -413,7 +453,9 @@ ScalerComplexBlock_t ScaleAdvMame3x = {
 	GFX_CAN_8|GFX_CAN_15|GFX_CAN_16|GFX_CAN_32,
 	3,3,
 {	AdvMame3x_8_L,AdvMame3x_16_L,AdvMame3x_16_L,AdvMame3x_32_L},
-{	AdvMame3x_8_R,AdvMame3x_16_R,AdvMame3x_16_R,AdvMame3x_32_R}
+{	AdvMame3x_8_R,AdvMame3x_16_R,AdvMame3x_16_R,AdvMame3x_32_R},
+{	AdvMame3x_8_BandL,AdvMame3x_16_BandL,AdvMame3x_16_BandL,AdvMame3x_32_BandL},
+{	AdvMame3x_8_BandR,AdvMame3x_16_BandR,AdvMame3x_16_BandR,AdvMame3x_32_BandR}
 };
 
 /* These need specific 15bpp versions */
@@ -422,7 +464,9 @@ ScalerComplexBlock_t ScaleHQ2x ={
 	GFX_CAN_15|GFX_CAN_16|GFX_CAN_32|GFX_RGBONLY,
 	2,2,
 {	0,HQ2x_16_L,HQ2x_16_L,HQ2x_32_L},
-{	0,HQ2x_16_R,HQ2x_16_R,HQ2x_32_R}
+{	0,HQ2x_16_R,HQ2x_16_R,HQ2x_32_R},
+{	0,HQ2x_16_BandL,HQ2x_16_BandL,HQ2x_32_BandL},
+{	0,HQ2x_16_BandR,HQ2x_16_BandR,HQ2x_32_BandR}
 };
 
 ScalerComplexBlock_t ScaleHQ3x ={
@@ -430,7 +474,9 @@ ScalerComplexBlock_t ScaleHQ3x ={
 	GFX_CAN_15|GFX_CAN_16|GFX_CAN_32|GFX_RGBONLY,
 	3,3,
 {	0,HQ3x_16_L,HQ3x_16_L,HQ3x_32_L},
-{	0,HQ3x_16_R,HQ3x_16_R,HQ3x_32_R}
+{	0,HQ3x_16_R,HQ3x_16_R,HQ3x_32_R},
+{	0,HQ3x_16_BandL,HQ3x_16_BandL,HQ3x_32_BandL},
+{	0,HQ3x_16_BandR,HQ3x_16_BandR,HQ3x_32_BandR}
 };
 
 ScalerComplexBlock_t ScaleSuper2xSaI ={
@@ -438,7 +484,9 @@ ScalerComplexBlock_t ScaleSuper2xSaI ={
 	GFX_CAN_15|GFX_CAN_16|GFX_CAN_32|GFX_RGBONLY,
 	2,2,
 {	0,Super2xSaI_16_L,Super2xSaI_16_L,Super2xSaI_32_L},
-{	0,Super2xSaI_16_R,Super2xSaI_16_R,Super2xSaI_32_R}
+{	0,Super2xSaI_16_R,Super2xSaI_16_R,Super2xSaI_32_R},
+{	0,Super2xSaI_16_BandL,Super2xSaI_16_BandL,Super2xSaI_32_BandL},
+{	0,Super2xSaI_16_BandR,Super2xSaI_16_BandR,Super2xSaI_32_BandR}
 };
 
 ScalerComplexBlock_t Scale2xSaI ={
@@ -446,7 +494,9 @@ ScalerComplexBlock_t Scale2xSaI ={
 	GFX_CAN_15|GFX_CAN_16|GFX_CAN_32|GFX_RGBONLY,
 	2,2,
 {	0,_2xSaI_16_L,_2xSaI_16_L,_2xSaI_32_L},
-{	0,_2xSaI_16_R,_2xSaI_16_R,_2xSaI_32_R}
+{	0,_2xSaI_16_R,_2xSaI_16_R,_2xSaI_32_R},
+{	0,_2xSaI_16_BandL,_2xSaI_16_BandL,_2xSaI_32_BandL},
+{	0,_2xSaI_16_BandR,_2xSaI_16_BandR,_2xSaI_32_BandR}
 };
 
 ScalerComplexBlock_t ScaleSuperEagle ={
@@ -454,7 +504,9 @@ ScalerComplexBlock_t ScaleSuperEagle ={
 	GFX_CAN_15|GFX_CAN_16|GFX_CAN_32|GFX_RGBONLY,
 	2,2,
 {	0,SuperEagle_16_L,SuperEagle_16_L,SuperEagle_32_L},
-{	0,SuperEagle_16_R,SuperEagle_16_R,SuperEagle_32_R}
+{	0,SuperEagle_16_R,SuperEagle_16_R,SuperEagle_32_R},
+{	0,SuperEagle_16_BandL,SuperEagle_16_BandL,SuperEagle_32_BandL},
+{	0,SuperEagle_16_BandR,SuperEagle_16_BandR,SuperEagle_32_BandR}
 };
 
 ScalerComplexBlock_t ScaleAdvInterp2x = {
@@ -462,7 +514,9 @@ ScalerComplexBlock_t ScaleAdvInterp2x = {
 	GFX_CAN_15|GFX_CAN_16|GFX_CAN_32|GFX_RGBONLY,
 	2,2,
 {	0,AdvInterp2x_15_L,AdvInterp2x_16_L,AdvInterp2x_32_L},
-{	0,AdvInterp2x_15_R,AdvInterp2x_16_R,AdvInterp2x_32_R}
+{	0,AdvInterp2x_15_R,AdvInterp2x_16_R,AdvInterp2x_32_R},
+{	0,AdvInterp2x_15_BandL,AdvInterp2x_16_BandL,AdvInterp2x_32_BandL},
+{	0,AdvInterp2x_15_BandR,AdvInterp2x_16_BandR,AdvInterp2x_32_BandR}
 };
 
 ScalerComplexBlock_t ScaleAdvInterp3x = {
@@ -470,7 +524,9 @@ ScalerComplexBlock_t ScaleAdvInterp3x = {
 	GFX_CAN_15|GFX_CAN_16|GFX_CAN_32|GFX_RGBONLY,
 	3,3,
 {	0,AdvInterp3x_15_L,AdvInterp3x_16_L,AdvInterp3x_32_L},
-{	0,AdvInterp3x_15_R,AdvInterp3x_16_R,AdvInterp3x_32_R}
+{	0,AdvInterp3x_15_R,AdvInterp3x_16_R,AdvInterp3x_32_R},
+{	0,AdvInterp3x_15_BandL,AdvInterp3x_16_BandL,AdvInterp3x_32_BandL},
+{	0,AdvInterp3x_15_BandR,AdvInterp3x_16_BandR,AdvInterp3x_32_BandR}
 };
 
 #endif
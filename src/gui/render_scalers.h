@@ -74,6 +74,7 @@ typedef enum scalerOperation {
 
 typedef void (*ScalerLineHandler_t)(const void *src);
 typedef void (*ScalerComplexHandler_t)(void);
+typedef void (*ScalerComplexBandHandler_t)(Bitu first, Bitu last, uint8_t *out, uint8_t *changed);
 
 extern uint8_t Scaler_Aspect[];
 extern uint8_t diff_table[];
@@ -105,6 +106,8 @@ typedef struct {
 	Bitu xscale,yscale;
 	ScalerComplexHandler_t Linear[4];
 	ScalerComplexHandler_t Random[4];
+	ScalerComplexBandHandler_t LinearBand[4];
+	ScalerComplexBandHandler_t RandomBand[4];
 } ScalerComplexBlock_t;
 
 typedef struct {
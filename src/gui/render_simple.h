@@ -32,6 +32,12 @@ static void conc4d(SCALERNAME,SBPP,DBPP,L)(const void *s) {
 static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 #endif
 #ifdef RENDER_NULL_INPUT
+#if (SBPP == 9)
+	// A line skipped as unchanged in video memory can still show changed
+	// colours, and its pixels are the ones cached from the previous frame
+	if (!s && render.pal.changed)
+		s = render.scale.cacheRead;
+#endif
 	if (!s) {
 		render.scale.cacheRead += render.scale.cachePitch;
 #if defined(SCALERLINEAR) 
@@ -105,7 +111,31 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 #endif
 #endif //defined(SCALERLINEAR)
 			hadChange = 1;
-			for (Bitu i = x > 32 ? 32 : x;i>0;i--,x--) {
+			Bitu run = x > 32 ? 32 : x;
+#if defined(SCALERSPAN4)
+			/* Four pixels at a time where the scaler has a vector form */
+			for (; run >= 4; run -= 4, x -= 4) {
+				const pixel_vec P4 = pixels_load(src);
+				pixels_store(cache, P4);
+				src += 4;
+				cache += 4;
+				SCALERSPAN4;
+				line0 += 4 * SCALERWIDTH;
+#if (SCALERHEIGHT > 1) 
+				line1 += 4 * SCALERWIDTH;
+#endif
+#if (SCALERHEIGHT > 2) 
+				line2 += 4 * SCALERWIDTH;
+#endif
+#if (SCALERHEIGHT > 3) 
+				line3 += 4 * SCALERWIDTH;
+#endif
+#if (SCALERHEIGHT > 4) 
+				line4 += 4 * SCALERWIDTH;
+#endif
+			}
+#endif
+			for (Bitu i = run;i>0;i--,x--) {
 				const SRCTYPE S = *src;
 				*cache = S;
 				src++;cache++;
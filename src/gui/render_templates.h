@@ -199,6 +199,11 @@
 #if RENDER_USE_ADVANCED_SCALERS>1
 static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #ifdef RENDER_NULL_INPUT
+#if (SBPP == 9)
+	// Skipped lines can still show changed colours, see the simple scalers
+	if (!s && render.pal.changed)
+		s = render.scale.cacheRead;
+#endif
 	if (!s) {
 		render.scale.cacheRead += render.scale.cachePitch;
 		render.scale.inLine++;
@@ -261,7 +266,12 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERHEIGHT	1
 #define SCALERFUNC								\
 	line0[0] = P;
+#if defined(RENDER_SCALER_SIMD) && (SBPP == 32) && (DBPP == 32)
+#define SCALERSPAN4								\
+	pixels_store(line0, P4);
+#endif
 #include "render_simple.h"
+#undef SCALERSPAN4
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
@@ -275,7 +285,13 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line0[1] = P;								\
 	line1[0] = P;								\
 	line1[1] = P;
+#if defined(RENDER_SCALER_SIMD) && (SBPP == 32) && (DBPP == 32)
+#define SCALERSPAN4								\
+	pixels_store_x2(line0, P4);	\
+	pixels_store_x2(line1, P4);
+#endif
 #include "render_simple.h"
+#undef SCALERSPAN4
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
@@ -294,7 +310,14 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line2[0] = P;								\
 	line2[1] = P;								\
 	line2[2] = P;
+#if defined(RENDER_SCALER_SIMD) && (SBPP == 32) && (DBPP == 32)
+#define SCALERSPAN4								\
+	pixels_store_x3(line0, P4);	\
+	pixels_store_x3(line1, P4);	\
+	pixels_store_x3(line2, P4);
+#endif
 #include "render_simple.h"
+#undef SCALERSPAN4
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
@@ -306,7 +329,12 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERFUNC								\
 	line0[0] = P;								\
 	line0[1] = P;
+#if defined(RENDER_SCALER_SIMD) && (SBPP == 32) && (DBPP == 32)
+#define SCALERSPAN4								\
+	pixels_store_x2(line0, P4);
+#endif
 #include "render_simple.h"
+#undef SCALERSPAN4
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
@@ -318,7 +346,13 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERFUNC								\
 	line0[0] = P;								\
 	line1[0] = P;
+#if defined(RENDER_SCALER_SIMD) && (SBPP == 32) && (DBPP == 32)
+#define SCALERSPAN4								\
+	pixels_store(line0, P4);	\
+	pixels_store(line1, P4);
+#endif
 #include "render_simple.h"
+#undef SCALERSPAN4
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
@@ -414,7 +448,13 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line0[1]=P;							\
 	line1[0]=0;							\
 	line1[1]=0;
+#if defined(RENDER_SCALER_SIMD) && (SBPP == 32) && (DBPP == 32)
+#define SCALERSPAN4								\
+	pixels_store_x2(line0, P4);	\
+	pixels_store_x2(line1, pixels_zero());
+#endif
 #include "render_simple.h"
+#undef SCALERSPAN4
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
@@ -433,7 +473,14 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line2[0]=0;				\
 	line2[1]=0;				\
 	line2[2]=0;
+#if defined(RENDER_SCALER_SIMD) && (SBPP == 32) && (DBPP == 32)
+#define SCALERSPAN4								\
+	pixels_store_x3(line0, P4);	\
+	pixels_store_x3(line1, P4);	\
+	pixels_store_x3(line2, pixels_zero());
+#endif
 #include "render_simple.h"
+#undef SCALERSPAN4
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
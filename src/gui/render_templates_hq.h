@@ -23,11 +23,14 @@
  */
 
 #include <stdlib.h>
+#include <mutex>
 
 #ifndef RENDER_TEMPLATES_HQNX_TABLE_H
 #define RENDER_TEMPLATES_HQNX_TABLE_H
 
 static uint32_t *_RGBtoYUV = 0;
+// Bands of a frame can be scaled on several threads
+static std::once_flag _RGBtoYUV_once;
 static inline bool diffYUV(uint32_t yuv1, uint32_t yuv2)
 {
 	static const uint32_t Ymask = 0x00FF0000;
@@ -58,6 +61,42 @@ static inline bool diffYUV(uint32_t yuv1, uint32_t yuv2)
 	return false;
 }
 
+#if defined(RENDER_SCALER_SIMD)
+// Compares the colour in the centre against its eight neighbours at once,
+// returning the bit of each neighbour diffYUV finds different. The Y, U, and
+// V values are a byte each, so the thresholds are checked bytewise.
+static inline uint32_t hq_pattern(const uint32_t yuv4, const uint32_t *yuv)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+	const auto centre = _mm_set1_epi32(static_cast<int>(yuv4));
+	const auto thresholds = _mm_set1_epi32(0x00300706);
+	const auto zero = _mm_setzero_si128();
+	const auto same = [&](const __m128i neighbours) {
+		const auto diff = _mm_sub_epi8(_mm_max_epu8(centre, neighbours),
+		                               _mm_min_epu8(centre, neighbours));
+		return _mm_cmpeq_epi32(_mm_subs_epu8(diff, thresholds), zero);
+	};
+	const auto lo = same(pixels_load(yuv));
+	const auto hi = same(pixels_load(yuv + 4));
+	const auto same16 = _mm_packs_epi32(lo, hi);
+	const auto mask = _mm_movemask_epi8(_mm_packs_epi16(same16, same16));
+	return ~static_cast<uint32_t>(mask) & 0xff;
+#else
+	const auto centre = vreinterpretq_u8_u32(vdupq_n_u32(yuv4));
+	const auto thresholds = vreinterpretq_u8_u32(vdupq_n_u32(0x00300706));
+	const auto differs = [&](const uint32x4_t neighbours) {
+		const auto diff = vabdq_u8(centre, vreinterpretq_u8_u32(neighbours));
+		const auto over = vreinterpretq_u32_u8(vqsubq_u8(diff, thresholds));
+		return vmovn_u32(vtstq_u32(over, over));
+	};
+	const auto bits = vcombine_u16(differs(pixels_load(yuv)),
+	                               differs(pixels_load(yuv + 4)));
+	static const uint16_t weights[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+	return vaddvq_u16(vandq_u16(bits, vld1q_u16(weights)));
+#endif
+}
+#endif
+
 #endif
 
 static inline void conc2d(InitLUTs,SBPP)(void)
@@ -87,8 +87,14 @@
 
 inline void conc2d(Hq2x,SBPP)(PTYPE * line0, PTYPE * line1, const PTYPE * fc)
 {
-	if (_RGBtoYUV == 0) conc2d(InitLUTs,SBPP)();
+	std::call_once(_RGBtoYUV_once, conc2d(InitLUTs,SBPP));
 
+#if defined(RENDER_SCALER_SIMD)
+	const uint32_t neighbours[8] = {RGBtoYUV(C0), RGBtoYUV(C1), RGBtoYUV(C2),
+	                                RGBtoYUV(C3), RGBtoYUV(C5), RGBtoYUV(C6),
+	                                RGBtoYUV(C7), RGBtoYUV(C8)};
+	const uint32_t pattern = hq_pattern(RGBtoYUV(C4), neighbours);
+#else
 	uint32_t pattern = 0;
 	const uint32_t YUV4 = RGBtoYUV(C4);
 	if (C4 != C0 && diffYUV(YUV4, RGBtoYUV(C0))) pattern |= 0x0001;
@@ -99,6 +105,7 @@ inline void conc2d(Hq2x,SBPP)(PTYPE * line0, PTYPE * line1, const PTYPE * fc)
 	if (C4 != C6 && diffYUV(YUV4, RGBtoYUV(C6))) pattern |= 0x0020;
 	if (C4 != C7 && diffYUV(YUV4, RGBtoYUV(C7))) pattern |= 0x0040;
 	if (C4 != C8 && diffYUV(YUV4, RGBtoYUV(C8))) pattern |= 0x0080;
+#endif
 
 	switch (pattern) {
 	case 0:
@@ -24,24 +24,23 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
-#include <chrono>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <atomic>
 #include <list>
-#include <thread>
 #include <vector>
 
 #include <SDL.h>
 #include <SDL_thread.h>
 
+#include "bios.h"
 #include "control.h"
 #include "joystick.h"
 #include "keyboard.h"
 #include "mapper.h"
 #include "math_utils.h"
+#include "mem.h"
 #include "pic.h"
 #include "rgb24.h"
 #include "setup.h"
@@ -785,6 +784,11 @@ public:
 		}
 		for (int i = 0; i < axes; i++) {
 			Sint16 caxis_pos = SDL_JoystickGetAxis(sdl_joystick, i);
+			// Analog axes are polled every update; only re-run their
+			// bindings when the position actually moved
+			if (caxis_pos == old_axis_pos[i])
+				continue;
+			old_axis_pos[i] = caxis_pos;
 			/* activate bindings for joystick position */
 			if (caxis_pos>1) {
 				if (old_neg_axis_state[i]) {
@@ -916,6 +920,7 @@ protected:
 	bool old_button_state[MAXBUTTON] = {};
 	bool old_pos_axis_state[MAXAXIS] = {};
 	bool old_neg_axis_state[MAXAXIS] = {};
+	Sint16 old_axis_pos[MAXAXIS] = {};
 	uint8_t old_hat_state[MAXHAT] = {};
 	bool is_dummy;
 };
@@ -1243,6 +1248,8 @@ void MAPPER_TriggerEvent(const CEvent *event, const bool deactivation_state) {
 	}
 }
 
+// Types the sequence from PIC events, so the keystrokes are paced in
+// emulated time and keep in step with the emulation at any speed
 class Typer {
 public:
 	Typer() = default;
@@ -1252,35 +1259,30 @@ public:
 	void Start(std::vector<CEvent *> *ext_events,
 	           std::vector<std::string> &ext_sequence,
 	           const uint32_t wait_ms,
-	           const uint32_t pace_ms)
+	           const uint32_t pace_ms,
+	           const bool wait_for_empty_buffer)
 	{
 		// Guard against empty inputs
 		if (!ext_events || ext_sequence.empty())
 			return;
-		Wait();
+		Stop();
 		m_events = ext_events;
 		m_sequence = std::move(ext_sequence);
+		m_next_button = 0;
 		m_wait_ms = wait_ms;
 		m_pace_ms = pace_ms;
-		m_stop_requested = false;
-		m_instance = std::thread(&Typer::Callback, this);
-		set_thread_name(m_instance, "dosbox:autotype");
-	}
-	void Wait()
-	{
-		if (m_instance.joinable())
-			m_instance.join();
+		m_wait_for_empty_buffer = wait_for_empty_buffer;
+		m_active = this;
+		PIC_AddEvent(PressNextButton, m_wait_ms);
 	}
 	void Stop()
 	{
-		m_stop_requested = true;
-		Wait();
-	}
-	void StopImmediately()
-	{
-		m_stop_requested = true;
-		if (m_instance.joinable())
-			m_instance.detach();
+		if (m_active != this)
+			return;
+		PIC_RemoveEvents(PressNextButton);
+		PIC_RemoveEvents(ReleaseButton);
+		ReleaseButton(0);
+		m_active = nullptr;
 	}
 
 private:
@@ -1298,69 +1300,93 @@ private:
 		return lshift_event;
 	}
 
-	void Callback()
+	static void PressNextButton(uint32_t /*val*/)
 	{
-		// quit before our initial wait time
-		if (m_stop_requested)
+		assert(m_active);
+		m_active->Press();
+	}
+
+	static void ReleaseButton(uint32_t /*val*/)
+	{
+		if (!m_active)
 			return;
-		std::this_thread::sleep_for(std::chrono::milliseconds(m_wait_ms));
-		for (const auto &button : m_sequence) {
-			if (m_stop_requested)
-				return;
-			bool found = false;
-			// comma adds an extra pause, similar to on phones
-			if (button == ",") {
-				found = true;
-				// quit before the pause
-				if (m_stop_requested)
-					return;
-				std::this_thread::sleep_for(std::chrono::milliseconds(m_pace_ms));
-				// Otherwise trigger the matching button if we have one
-			} else {
-				// is the button an upper case letter?
-				const auto is_cap = button.length() == 1 && isupper(button[0]);
-				const auto maybe_lshift = is_cap ? GetLShiftEvent() : nullptr;
-				const std::string lbutton = is_cap ? std::string{int_to_char(
-				                                             tolower(button[0]))}
-				                                   : button;
-				const std::string bind_name = "key_" + lbutton;
-				for (auto &event : *m_events) {
-					if (bind_name == event->GetName()) {
-						found = true;
-						if (maybe_lshift)
-							maybe_lshift->Active(true);
-						event->Active(true);
-						std::this_thread::sleep_for(
-						        std::chrono::milliseconds(50));
-						event->Active(false);
-						if (maybe_lshift)
-							maybe_lshift->Active(false);
-						break;
-					}
-				}
-			}
-			/*
-			 *  Terminate the sequence for safety reasons if we can't find
-			 * a button. For example, we don't wan't DEAL becoming DEL, or
-			 * 'rem' becoming 'rm'
-			 */
-			if (!found) {
-				LOG_MSG("MAPPER: Couldn't find a button named '%s', stopping.",
-				        button.c_str());
+		Typer &typer = *m_active;
+		if (typer.m_pressed_event)
+			typer.m_pressed_event->Active(false);
+		if (typer.m_pressed_lshift)
+			typer.m_pressed_lshift->Active(false);
+		typer.m_pressed_event = nullptr;
+		typer.m_pressed_lshift = nullptr;
+	}
+
+	// Key presses from the previous buttons are still waiting to be read
+	static bool IsKeyboardBufferBusy()
+	{
+		return mem_readw(BIOS_KEYBOARD_BUFFER_HEAD) !=
+		       mem_readw(BIOS_KEYBOARD_BUFFER_TAIL);
+	}
+
+	void Press()
+	{
+		// Let go of the previous button if its release is still queued
+		PIC_RemoveEvents(ReleaseButton);
+		ReleaseButton(0);
+		if (m_next_button >= m_sequence.size()) {
+			m_active = nullptr;
+			return;
+		}
+		if (m_wait_for_empty_buffer && IsKeyboardBufferBusy()) {
+			constexpr double poll_ms = 10.0;
+			PIC_AddEvent(PressNextButton, poll_ms);
+			return;
+		}
+		const auto &button = m_sequence[m_next_button++];
+		// comma adds an extra pause, similar to on phones
+		if (button == ",") {
+			PIC_AddEvent(PressNextButton, m_pace_ms);
+			return;
+		}
+		// Otherwise trigger the matching button if we have one
+		// is the button an upper case letter?
+		const auto is_cap = button.length() == 1 && isupper(button[0]);
+		const std::string lbutton = is_cap ? std::string{int_to_char(
+		                                             tolower(button[0]))}
+		                                   : button;
+		const std::string bind_name = "key_" + lbutton;
+		for (auto &event : *m_events) {
+			if (bind_name == event->GetName()) {
+				m_pressed_lshift = is_cap ? GetLShiftEvent() : nullptr;
+				m_pressed_event = event;
+				if (m_pressed_lshift)
+					m_pressed_lshift->Active(true);
+				event->Active(true);
+				constexpr double hold_ms = 50.0;
+				PIC_AddEvent(ReleaseButton, hold_ms);
+				PIC_AddEvent(PressNextButton, hold_ms + m_pace_ms);
 				return;
 			}
-			if (m_stop_requested) // quit before the pacing delay
-				return;
-			std::this_thread::sleep_for(std::chrono::milliseconds(m_pace_ms));
 		}
+		/*
+		 *  Terminate the sequence for safety reasons if we can't find
+		 * a button. For example, we don't wan't DEAL becoming DEL, or
+		 * 'rem' becoming 'rm'
+		 */
+		LOG_MSG("MAPPER: Couldn't find a button named '%s', stopping.",
+		        button.c_str());
+		m_active = nullptr;
 	}
 
-	std::thread m_instance = {};
+	// The typer whose events are queued, if any
+	static inline Typer *m_active = nullptr;
+
 	std::vector<std::string> m_sequence = {};
 	std::vector<CEvent *> *m_events = nullptr;
+	CEvent *m_pressed_event = nullptr;
+	CEvent *m_pressed_lshift = nullptr;
+	size_t m_next_button = 0;
 	uint32_t m_wait_ms = 0;
 	uint32_t m_pace_ms = 0;
-	std::atomic_bool m_stop_requested{false};
+	bool m_wait_for_empty_buffer = false;
 };
 
 static struct CMapper {
@@ -2482,8 +2508,8 @@ static struct {
                    {0, SDL_SCANCODE_UNKNOWN}};
 
 static void ClearAllBinds() {
-	// wait for the auto-typer to complete because it might be accessing events
-	mapper.typist.Wait();
+	// stop the auto-typer because it might be holding down keys
+	mapper.typist.Stop();
 
 	for (CEvent *event : events) {
 		event->ClearBinds();
@@ -2637,9 +2663,29 @@ static bool load_binds_from_file(const std::string_view mapperfile_path,
 
 void MAPPER_CheckEvent(SDL_Event *event)
 {
-	for (auto &group : bindgroups)
-		if (group->CheckEvent(event))
-			return;
+	// Key binds are indexed by scancode within the key groups and stick
+	// binds by axis, button, and hat within the stick groups, so only hand
+	// the event to the groups of its device type.
+	switch (event->type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		for (auto &group : keybindgroups)
+			if (group->CheckEvent(event))
+				return;
+		return;
+	case SDL_JOYAXISMOTION:
+	case SDL_JOYBUTTONDOWN:
+	case SDL_JOYBUTTONUP:
+	case SDL_JOYHATMOTION:
+		for (auto &group : stickbindgroups)
+			if (group->CheckEvent(event))
+				return;
+		return;
+	default:
+		for (auto &group : bindgroups)
+			if (group->CheckEvent(event))
+				return;
+	}
 }
 
 void BIND_MappingEvents() {
@@ -3101,13 +3147,15 @@ std::vector<std::string> MAPPER_GetEventNames(const std::string &prefix) {
 
 void MAPPER_AutoType(std::vector<std::string> &sequence,
                      const uint32_t wait_ms,
-                     const uint32_t pace_ms) {
-	mapper.typist.Start(&events, sequence, wait_ms, pace_ms);
+                     const uint32_t pace_ms,
+                     const bool wait_for_empty_buffer)
+{
+	mapper.typist.Start(&events, sequence, wait_ms, pace_ms, wait_for_empty_buffer);
 }
 
 void MAPPER_AutoTypeStopImmediately()
 {
-	mapper.typist.StopImmediately();
+	mapper.typist.Stop();
 }
 
 void MAPPER_StartUp(Section * sec) {
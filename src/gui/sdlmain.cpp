@@ -21,16 +21,26 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <cinttypes>
+#include <condition_variable>
 #include <cstdlib>
+#include <fstream>
+#include <mutex>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <sys/types.h>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <math.h>
 
 #if C_DEBUG
@@ -54,10 +64,13 @@
 #include "debug.h"
 #include "fs_utils.h"
 #include "gui_msgs.h"
+#include "hardware.h"
 #include "joystick.h"
 #include "keyboard.h"
 #include "mapper.h"
 #include "math_utils.h"
+#include "memory_report.h"
+#include "metrics.h"
 #include "mixer.h"
 #include "mouse.h"
 #include "pacer.h"
@@ -65,7 +78,11 @@
 #include "render.h"
 #include "sdlmain.h"
 #include "setup.h"
+#include "startup.h"
+#include "std_filesystem.h"
 #include "string_utils.h"
+#include "thread_control.h"
+#include "timedemo.h"
 #include "timer.h"
 #include "tracy.h"
 #include "vga.h"
@@ -108,6 +125,40 @@ PFNGLBUFFERDATAARBPROC glBufferDataARB = NULL;
 PFNGLMAPBUFFERARBPROC glMapBufferARB = NULL;
 PFNGLUNMAPBUFFERARBPROC glUnmapBufferARB = NULL;
 
+// For keeping a ring of pixel buffers mapped, with fences marking the
+// regions still being uploaded
+#ifndef GL_ARB_sync
+typedef uint64_t GLuint64;
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT    0x00000001
+#define GL_ALREADY_SIGNALED           0x911A
+#define GL_TIMEOUT_EXPIRED            0x911B
+#define GL_CONDITION_SATISFIED        0x911C
+#define GL_WAIT_FAILED                0x911D
+#endif
+#ifndef GL_ARB_map_buffer_range
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_ARB_buffer_storage
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT   0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC_NP) (GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void *(APIENTRYP PFNGLMAPBUFFERRANGEPROC_NP) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLsync (APIENTRYP PFNGLFENCESYNCPROC_NP) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP PFNGLCLIENTWAITSYNCPROC_NP) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (APIENTRYP PFNGLDELETESYNCPROC_NP) (GLsync sync);
+
+// For caching linked shader programs as driver-specific binaries
+#ifndef GL_ARB_get_program_binary
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+#endif
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC_NP) (GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC_NP) (GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC_NP) (GLuint program, GLenum pname, GLint value);
+
 /* Don't guard these with GL_VERSION_2_0 - Apple defines it but not these typedefs.
  * If they're already defined they should match these definitions, so no conflicts.
  */
@@ -132,6 +183,20 @@ typedef void (APIENTRYP PFNGLUNIFORM1IPROC) (GLint location, GLint v0);
 typedef void (APIENTRYP PFNGLUSEPROGRAMPROC) (GLuint program);
 typedef void (APIENTRYP PFNGLVERTEXATTRIBPOINTERPROC) (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
 
+// For expanding the palette of 8-bit frames on the GPU
+typedef void (APIENTRYP PFNGLACTIVETEXTUREPROC) (GLenum texture);
+typedef void (APIENTRYP PFNGLGENFRAMEBUFFERSEXTPROC) (GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRYP PFNGLDELETEFRAMEBUFFERSEXTPROC) (GLsizei n, const GLuint *framebuffers);
+typedef void (APIENTRYP PFNGLBINDFRAMEBUFFEREXTPROC) (GLenum target, GLuint framebuffer);
+typedef void (APIENTRYP PFNGLFRAMEBUFFERTEXTURE2DEXTPROC) (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+typedef GLenum (APIENTRYP PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC) (GLenum target);
+
+#ifndef GL_EXT_framebuffer_object
+#define GL_FRAMEBUFFER_EXT          0x8D40
+#define GL_COLOR_ATTACHMENT0_EXT    0x8CE0
+#define GL_FRAMEBUFFER_COMPLETE_EXT 0x8CD5
+#endif
+
 /* Apple defines these functions in their GL header (as core functions)
  * so we can't use their names as function pointers. We can't link
  * directly as some platforms may not have them. So they get their own
@@ -144,6 +209,7 @@ PFNGLCREATEPROGRAMPROC glCreateProgram = NULL;
 PFNGLCREATESHADERPROC glCreateShader = NULL;
 PFNGLDELETEPROGRAMPROC glDeleteProgram = NULL;
 PFNGLDELETESHADERPROC glDeleteShader = NULL;
+PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray = NULL;
 PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray = NULL;
 PFNGLGETATTRIBLOCATIONPROC glGetAttribLocation = NULL;
 PFNGLGETPROGRAMIVPROC glGetProgramiv = NULL;
@@ -157,6 +223,20 @@ PFNGLUNIFORM2FPROC glUniform2f = NULL;
 PFNGLUNIFORM1IPROC glUniform1i = NULL;
 PFNGLUSEPROGRAMPROC glUseProgram = NULL;
 PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer = NULL;
+PFNGLACTIVETEXTUREPROC glActiveTexture = NULL;
+PFNGLGENFRAMEBUFFERSEXTPROC glGenFramebuffersEXT = NULL;
+PFNGLDELETEFRAMEBUFFERSEXTPROC glDeleteFramebuffersEXT = NULL;
+PFNGLBINDFRAMEBUFFEREXTPROC glBindFramebufferEXT = NULL;
+PFNGLFRAMEBUFFERTEXTURE2DEXTPROC glFramebufferTexture2DEXT = NULL;
+PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC glCheckFramebufferStatusEXT = NULL;
+PFNGLBUFFERSTORAGEPROC_NP glBufferStorage = NULL;
+PFNGLMAPBUFFERRANGEPROC_NP glMapBufferRange = NULL;
+PFNGLFENCESYNCPROC_NP glFenceSync = NULL;
+PFNGLCLIENTWAITSYNCPROC_NP glClientWaitSync = NULL;
+PFNGLDELETESYNCPROC_NP glDeleteSync = NULL;
+PFNGLGETPROGRAMBINARYPROC_NP glGetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC_NP glProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC_NP glProgramParameteri = NULL;
 }
 
 /* "using" is meant to hide identical names declared in outer scope
@@ -168,6 +248,7 @@ PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer = NULL;
 #define glCreateShader            gl2::glCreateShader
 #define glDeleteProgram           gl2::glDeleteProgram
 #define glDeleteShader            gl2::glDeleteShader
+#define glDisableVertexAttribArray gl2::glDisableVertexAttribArray
 #define glEnableVertexAttribArray gl2::glEnableVertexAttribArray
 #define glGetAttribLocation       gl2::glGetAttribLocation
 #define glGetProgramiv            gl2::glGetProgramiv
@@ -181,6 +262,20 @@ PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer = NULL;
 #define glUniform1i               gl2::glUniform1i
 #define glUseProgram              gl2::glUseProgram
 #define glVertexAttribPointer     gl2::glVertexAttribPointer
+#define glActiveTexture           gl2::glActiveTexture
+#define glGenFramebuffersEXT      gl2::glGenFramebuffersEXT
+#define glDeleteFramebuffersEXT   gl2::glDeleteFramebuffersEXT
+#define glBindFramebufferEXT      gl2::glBindFramebufferEXT
+#define glFramebufferTexture2DEXT gl2::glFramebufferTexture2DEXT
+#define glCheckFramebufferStatusEXT gl2::glCheckFramebufferStatusEXT
+#define glBufferStorage           gl2::glBufferStorage
+#define glMapBufferRange          gl2::glMapBufferRange
+#define glFenceSync               gl2::glFenceSync
+#define glClientWaitSync          gl2::glClientWaitSync
+#define glDeleteSync              gl2::glDeleteSync
+#define glGetProgramBinary        gl2::glGetProgramBinary
+#define glProgramBinary           gl2::glProgramBinary
+#define glProgramParameteri       gl2::glProgramParameteri
 
 #endif // C_OPENGL
 
@@ -383,6 +478,7 @@ static double get_host_refresh_rate()
 	// To be populated in the switch
 	auto rate = 0.0;                   // refresh rate as a floating point number
 	const char *rate_description = ""; // description of the refresh rate
+	sdl.desktop.host_rate_is_vrr = false;
 
 	switch (sdl.desktop.host_rate_mode) {
 	case HOST_RATE_MODE::AUTO:
@@ -390,6 +486,7 @@ static double get_host_refresh_rate()
 		    sdl.desktop.fullscreen && sdl_rate >= REFRESH_RATE_HOST_VRR_MIN) {
 			rate = get_vrr_rate(sdl_rate);
 			rate_description = "VRR-adjusted (auto)";
+			sdl.desktop.host_rate_is_vrr = true;
 		} else {
 			rate = get_sdi_rate(sdl_rate);
 			rate_description = "standard SDI (auto)";
@@ -402,6 +499,7 @@ static double get_host_refresh_rate()
 	case HOST_RATE_MODE::VRR:
 		rate = get_vrr_rate(get_sdl_rate());
 		rate_description = "VRR-adjusted";
+		sdl.desktop.host_rate_is_vrr = true;
 		break;
 	case HOST_RATE_MODE::CUSTOM:
 		assert(sdl.desktop.preferred_host_rate >= REFRESH_RATE_MIN);
@@ -576,7 +674,16 @@ check_surface:
 		break;
 #if C_OPENGL
 	case SCREEN_OPENGL:
+		// 8-bit frames can be taken as is and expanded on the GPU
+		if (sdl.opengl.gpu_palette && (flags & GFX_LOVE_8) &&
+		    (flags & GFX_CAN_8)) {
+			flags |= GFX_SCALING;
+			flags &= ~(GFX_CAN_15 | GFX_CAN_16 | GFX_CAN_32);
+			break;
+		}
+		[[fallthrough]];
 #endif
+	case SCREEN_HEADLESS:
 	case SCREEN_TEXTURE:
 		// We only accept 32bit output from the scalers here
 		if (!(flags&GFX_CAN_32)) goto check_surface;
@@ -594,6 +701,7 @@ check_surface:
 // Useful during output initialization or transitions.
 void GFX_DisengageRendering()
 {
+	stop_gl_presenter();
 	sdl.frame.update  = update_frame_noop;
 	sdl.frame.present = present_frame_noop;
 }
@@ -698,6 +806,7 @@ static void log_display_properties(int source_w, int source_h,
 	case FRAME_MODE::VFR: frame_mode = "VFR"; break;
 	case FRAME_MODE::SYNCED_CFR: frame_mode = "synced CFR"; break;
 	case FRAME_MODE::THROTTLED_VFR: frame_mode = "throttled VFR"; break;
+	case FRAME_MODE::VRR: frame_mode = "VRR"; break;
 	case FRAME_MODE::UNSET: break;
 	}
 	assert(frame_mode);
@@ -956,6 +1065,207 @@ static void remove_window()
 	}
 }
 
+// Presentation statistics
+// ~~~~~~~~~~~~~~~~~~~~~~~
+// With [sdl] presentation_stats, the host time between emulated frames and
+// between presents, the time spent uploading frames, and the frames dropped or
+// shown more than once are summarised in the log every few seconds. The same
+// figures are plotted per frame in Tracy while a profiler is connected.
+//
+// Key presses are probed as well: how long each waited in SDL's queue until
+// the emulation polled it, and how long until the next frame was presented
+// after it, an upper bound of the input to photon latency on the host side.
+static struct {
+	bool enabled = false;
+	std::vector<int> frame_intervals_us = {};
+	std::vector<int> present_intervals_us = {};
+	std::vector<int> upload_us = {};
+	std::vector<int> input_poll_us = {};
+	std::vector<int> input_present_us = {};
+	int64_t pending_input_us = 0; // the oldest key press not yet presented
+	int64_t last_frame_us = 0;
+	int64_t last_present_us = 0;
+	int64_t report_start_us = 0;
+	int presented = 0;
+	int dropped = 0;    // new frames replaced before they were presented
+	int duplicated = 0; // presents showing the same frame again
+	int skipped = 0;    // presents the render pacer skipped
+	bool frame_pending = false;
+} present_stats;
+
+constexpr int present_stats_report_us = 5'000'000;
+
+static bool collecting_present_stats()
+{
+	return present_stats.enabled || TracyIsConnected || metrics_active;
+}
+
+// Surfaces present while updating, and the threaded presenter presents on its
+// own, so only the emulated side of those is accounted
+static bool tracking_presents()
+{
+	return sdl.frame.present != present_frame_noop;
+}
+
+static float percentile_ms(std::vector<int> &samples, const int percent)
+{
+	if (samples.empty())
+		return 0.0f;
+	const auto nth = samples.begin() + (samples.size() - 1) * percent / 100;
+	std::nth_element(samples.begin(), nth, samples.end());
+	return *nth / 1000.0f;
+}
+
+static void report_present_stats(const int64_t now)
+{
+	auto &s = present_stats;
+	const auto elapsed_us = GetTicksDiff(now, s.report_start_us);
+	if (elapsed_us < present_stats_report_us)
+		return;
+
+	LOG_MSG("SDL: In %.1f s, %d frames emulated (interval p50 %.2f, p99 %.2f ms), "
+	        "%d presented (interval p50 %.2f, p99 %.2f ms)",
+	        elapsed_us / 1'000'000.0,
+	        static_cast<int>(s.frame_intervals_us.size()),
+	        percentile_ms(s.frame_intervals_us, 50),
+	        percentile_ms(s.frame_intervals_us, 99),
+	        s.presented,
+	        percentile_ms(s.present_intervals_us, 50),
+	        percentile_ms(s.present_intervals_us, 99));
+	if (!s.input_poll_us.empty())
+		LOG_MSG("SDL: %d key presses, polled after p50 %.2f, p99 %.2f ms, "
+		        "presented after p50 %.2f, p99 %.2f ms",
+		        static_cast<int>(s.input_poll_us.size()),
+		        percentile_ms(s.input_poll_us, 50),
+		        percentile_ms(s.input_poll_us, 99),
+		        percentile_ms(s.input_present_us, 50),
+		        percentile_ms(s.input_present_us, 99));
+	LOG_MSG("SDL: %d frames dropped, %d duplicated, %d skipped by the pacer; "
+	        "upload p50 %.2f, p95 %.2f, p99 %.2f ms",
+	        s.dropped,
+	        s.duplicated,
+	        s.skipped,
+	        percentile_ms(s.upload_us, 50),
+	        percentile_ms(s.upload_us, 95),
+	        percentile_ms(s.upload_us, 99));
+
+	s.frame_intervals_us.clear();
+	s.present_intervals_us.clear();
+	s.upload_us.clear();
+	s.input_poll_us.clear();
+	s.input_present_us.clear();
+	s.presented = 0;
+	s.dropped = 0;
+	s.duplicated = 0;
+	s.skipped = 0;
+	s.report_start_us = now;
+}
+
+// SDL stamps its events with SDL_GetTicks() milliseconds
+static void note_key_pressed(const uint32_t timestamp_ms)
+{
+	auto &s = present_stats;
+	const auto queued_ms = static_cast<int>(SDL_GetTicks() - timestamp_ms);
+	const auto poll_us = std::max(queued_ms, 0) * 1000;
+	TracyPlot("Key poll delay us", static_cast<int64_t>(poll_us));
+	if (!s.pending_input_us)
+		s.pending_input_us = GetTicksUs() - poll_us;
+	if (s.enabled)
+		s.input_poll_us.push_back(poll_us);
+}
+
+static void note_input_presented(const int64_t now)
+{
+	auto &s = present_stats;
+	if (!s.pending_input_us)
+		return;
+	const auto latency_us = GetTicksDiff(now, s.pending_input_us);
+	s.pending_input_us = 0;
+	TracyPlot("Key to present us", static_cast<int64_t>(latency_us));
+	if (s.enabled)
+		s.input_present_us.push_back(latency_us);
+}
+
+static void note_frame_update(const bool frame_is_new, const int64_t start_us)
+{
+	if (!collecting_present_stats())
+		return;
+
+	auto &s = present_stats;
+	const auto now = GetTicksUs();
+	const auto upload_us = GetTicksDiff(now, start_us);
+	TracyPlot("Frame upload us", static_cast<int64_t>(upload_us));
+	if (!frame_is_new)
+		return;
+
+	const auto interval_us = GetTicksDiff(start_us, s.last_frame_us);
+	s.last_frame_us = start_us;
+	TracyPlot("Emulated frame interval us", static_cast<int64_t>(interval_us));
+	if (tracking_presents()) {
+		if (s.frame_pending) {
+			++s.dropped;
+			METRICS_Add(Metric::FramesDropped);
+		}
+		s.frame_pending = true;
+	} else {
+		note_input_presented(now);
+	}
+
+	if (s.enabled) {
+		s.frame_intervals_us.push_back(interval_us);
+		s.upload_us.push_back(upload_us);
+		report_present_stats(now);
+	}
+}
+
+extern bool ticksLocked;
+
+// Presenting every frame would hold the emulation back to the display's
+// rate while fast-forwarding, so most of them are skipped
+static bool skip_fast_forward_frame()
+{
+	static int skipped = 0;
+	// Captures of the displayed image need every frame
+	if (!ticksLocked || CAPTURE_WantsDisplayImage() ||
+	    skipped >= sdl.frame.fast_forward_skip) {
+		skipped = 0;
+		return false;
+	}
+	++skipped;
+	return true;
+}
+
+// Presents through the current presentation function, accounting the result
+static bool present_frame()
+{
+	const auto is_presenting = !skip_fast_forward_frame() &&
+	                           sdl.frame.present();
+	if (!collecting_present_stats() || !tracking_presents())
+		return is_presenting;
+
+	auto &s = present_stats;
+	if (!is_presenting) {
+		++s.skipped;
+		METRICS_Add(Metric::FramesSkipped);
+		return false;
+	}
+	const auto now = GetTicksUs();
+	const auto interval_us = GetTicksDiff(now, s.last_present_us);
+	s.last_present_us = now;
+	TracyPlot("Present interval us", static_cast<int64_t>(interval_us));
+	note_input_presented(now);
+
+	++s.presented;
+	METRICS_Add(Metric::FramesPresented);
+	if (s.frame_pending)
+		s.frame_pending = false;
+	else
+		++s.duplicated;
+	if (s.enabled)
+		s.present_intervals_us.push_back(interval_us);
+	return true;
+}
+
 // The throttled presenter skip frames that have an inter-frame spaces more
 // narrow than the allowed frame period.
 static void maybe_present_throttled(const bool frame_is_new)
@@ -972,7 +1282,7 @@ static void maybe_present_throttled(const bool frame_is_new)
 		// this extra wait back by deducting it from the recorded time.
 		const auto wait_overage = elapsed % sdl.frame.period_us;
 		last_present_time = now - (9 * wait_overage / 10);
-		last_frame_shown = sdl.frame.present();
+		last_frame_shown = present_frame();
 	} else {
 		last_frame_shown = false;
 	}
@@ -994,7 +1304,7 @@ static void maybe_present_synced(const bool present_if_last_skipped)
 	const auto should_present = on_time ||
 	                            (present_if_last_skipped && !last_frame_shown);
 
-	last_frame_shown = should_present ? sdl.frame.present() : false;
+	last_frame_shown = should_present ? present_frame() : false;
 
 	last_sync_time = should_present ? GetTicksUs() : now;
 }
@@ -1061,11 +1371,22 @@ static void setup_presentation_mode(FRAME_MODE &previous_mode)
 	const bool wants_vsync = sdl.vsync.current == VSYNC_STATE::ON ||
 	                         get_vsync_preference().requested == VSYNC_STATE::ON;
 
+	// A variable refresh display follows the DOS rate when it's within
+	// the display's range, so frames can be shown as soon as the emulated
+	// display has completed them.
+	const auto vrr_fits = sdl.desktop.host_rate_is_vrr &&
+	                      atleast_as_fast(host_rate, dos_rate);
+
 	// to be set below
 	auto mode = FRAME_MODE::UNSET;
 
+	// Manual VRR
+	if (sdl.frame.desired_mode == FRAME_MODE::VRR && vrr_fits) {
+		mode = FRAME_MODE::VRR;
+		save_rate_to_frame_period(dos_rate);
+	}
 	// Manual full CFR
-	if (sdl.frame.desired_mode == FRAME_MODE::CFR) {
+	else if (sdl.frame.desired_mode == FRAME_MODE::CFR) {
 		if (configure_cfr_mode() != FRAME_MODE::CFR && wants_vsync) {
 			LOG_WARNING("SDL: CFR performance warning: the DOS rate of %2.5g"
 			            " Hz exceeds the host's %2.5g Hz vsynced rate",
@@ -1104,8 +1425,21 @@ static void setup_presentation_mode(FRAME_MODE &previous_mode)
 		return;
 	previous_mode = mode;
 
+	// Otherwise VRR falls back to the automatic modes above
+	if (sdl.frame.desired_mode == FRAME_MODE::VRR && mode != FRAME_MODE::VRR) {
+		if (sdl.desktop.host_rate_is_vrr)
+			LOG_WARNING("SDL: VRR presentation unavailable: the DOS rate of"
+			            " %2.5g Hz exceeds the host's %2.5g Hz VRR range",
+			            dos_rate, host_rate);
+		else
+			LOG_WARNING("SDL: VRR presentation unavailable: the display"
+			            " doesn't appear to have a variable refresh rate;"
+			            " use fullscreen or set [sdl] host_rate = vrr");
+	}
+
 	// Configure the pacer. We only use it for VFR modes because CFR modes
 	// determine if the frame is presented based on the scheduler's accuracy.
+	// In VRR mode skipping a frame would show as judder, so it's not used.
 	const auto is_vfr_mode = mode == FRAME_MODE::VFR ||
 	                         mode == FRAME_MODE::THROTTLED_VFR;
 	render_pacer.SetTimeout(is_vfr_mode ? sdl.vsync.skip_us : 0);
@@ -1187,8 +1521,10 @@ static SDL_Window *SetWindowMode(SCREEN_TYPES screen_type,
 
 		if (screen_type == SCREEN_TEXTURE) {
 			if (sdl.renderer) {
+				// Takes the cursor textures with it
 				SDL_DestroyRenderer(sdl.renderer);
 				sdl.renderer = nullptr;
+				sdl.cursor.texture = {};
 			}
 
 			assert(sdl.renderer == nullptr);
@@ -1204,8 +1540,19 @@ static SDL_Window *SetWindowMode(SCREEN_TYPES screen_type,
 			if (sdl.opengl.context) {
 				SDL_GL_DeleteContext(sdl.opengl.context);
 				sdl.opengl.context = nullptr;
+				sdl.cursor.gl = {};
 			}
 
+			// The sync objects went away with the old context
+			sdl.opengl.pbo_ring.fences   = {};
+			sdl.opengl.frame_queue.fences = {};
+			sdl.opengl.frame_queue.index  = 0;
+			sdl.opengl.readback.buffers = {};
+			sdl.opengl.readback.fences  = {};
+			sdl.opengl.readback.width   = 0;
+			sdl.opengl.readback.height  = 0;
+			sdl.opengl.readback.pending = 0;
+
 			assert(sdl.opengl.context == nullptr);
 			sdl.opengl.context = SDL_GL_CreateContext(sdl.window);
 			if (sdl.opengl.context == nullptr) {
@@ -1345,6 +1692,10 @@ static SDL_Rect get_canvas_size(const SCREEN_TYPES screen_type)
 		SDL_GL_GetDrawableSize(sdl.window, &canvas.w, &canvas.h);
 		break;
 #endif
+	case SCREEN_HEADLESS:
+		canvas.w = sdl.draw.width;
+		canvas.h = sdl.draw.height;
+		break;
 	}
 
 	assert(canvas.w > 0 && canvas.h > 0);
@@ -1530,6 +1881,558 @@ static bool LoadGLShaders(const std::string_view source_sv, GLuint *vertex,
 	}
 	return false;
 }
+
+// Linked programs are kept as driver-specific binaries, in memory for mode
+// switches and under 'glshaders/cache' in the config directory for later
+// launches. They're keyed by a hash of the shader source, the defines that
+// BuildShader() adds, and the driver's vendor, renderer, and version, so a
+// driver update or an edited shader simply misses the cache.
+struct GlProgramBinary {
+	GLenum format = 0;
+	std::vector<uint8_t> data = {};
+};
+
+static std::unordered_map<uint64_t, GlProgramBinary> gl_program_binaries = {};
+
+static uint64_t get_gl_program_key(const std::string_view source_sv)
+{
+	// 64-bit FNV-1a, which is stable across builds and platforms
+	uint64_t hash = 0xcbf29ce484222325;
+	auto add = [&hash](const std::string_view sv) {
+		for (const auto c : sv) {
+			hash ^= static_cast<uint8_t>(c);
+			hash *= 0x100000001b3;
+		}
+		hash ^= 0xff; // separates the fields
+		hash *= 0x100000001b3;
+	};
+	add(safe_gl_get_string(GL_VENDOR, ""));
+	add(safe_gl_get_string(GL_RENDERER, ""));
+	add(safe_gl_get_string(GL_VERSION, ""));
+	add(sdl.opengl.bilinear ? "bilinear" : "nearest");
+	add(source_sv);
+	return hash;
+}
+
+static std_fs::path get_gl_program_cache_path(const uint64_t key)
+{
+	char name[32];
+	safe_sprintf(name, "%016" PRIx64 ".bin", key);
+	return std_fs::path(CROSS_GetPlatformConfigDir()) / "glshaders" / "cache" / name;
+}
+
+static constexpr char gl_program_magic[4] = {'D', 'B', 'P', 'B'};
+
+static bool read_gl_program_binary(const uint64_t key, GlProgramBinary &binary)
+{
+	std::ifstream file(get_gl_program_cache_path(key), std::ios::binary);
+	char magic[sizeof(gl_program_magic)] = {};
+	uint32_t format = 0;
+	if (!file.read(magic, sizeof(magic)) ||
+	    memcmp(magic, gl_program_magic, sizeof(magic)) != 0 ||
+	    !file.read(reinterpret_cast<char *>(&format), sizeof(format)))
+		return false;
+
+	binary.format = format;
+	binary.data.assign(std::istreambuf_iterator<char>(file),
+	                   std::istreambuf_iterator<char>());
+	return !binary.data.empty();
+}
+
+static void write_gl_program_binary(const uint64_t key, const GlProgramBinary &binary)
+{
+	const auto path = get_gl_program_cache_path(key);
+	std::error_code ec;
+	std_fs::create_directories(path.parent_path(), ec);
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	const auto format = static_cast<uint32_t>(binary.format);
+	file.write(gl_program_magic, sizeof(gl_program_magic));
+	file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+	file.write(reinterpret_cast<const char *>(binary.data.data()),
+	           static_cast<std::streamsize>(binary.data.size()));
+	if (!file)
+		LOG_WARNING("OPENGL: Can't write the shader cache file '%s'",
+		            path.string().c_str());
+}
+
+// Returns a program created from the cached binary, or 0 if there's none or
+// the driver rejects it
+static GLuint load_cached_gl_program(const uint64_t key)
+{
+	auto cached = gl_program_binaries.find(key);
+	if (cached == gl_program_binaries.end()) {
+		GlProgramBinary binary = {};
+		if (!read_gl_program_binary(key, binary))
+			return 0;
+		cached = gl_program_binaries.emplace(key, std::move(binary)).first;
+	}
+	const auto &binary = cached->second;
+
+	GLuint program = glCreateProgram();
+	if (!program)
+		return 0;
+	glProgramBinary(program, binary.format, binary.data.data(),
+	                static_cast<GLsizei>(binary.data.size()));
+	GLint is_linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &is_linked);
+	if (!is_linked) {
+		glDeleteProgram(program);
+		gl_program_binaries.erase(cached);
+		return 0;
+	}
+	return program;
+}
+
+static void cache_gl_program(const uint64_t key, const GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	GlProgramBinary binary = {};
+	binary.data.resize(static_cast<size_t>(length));
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &binary.format,
+	                   binary.data.data());
+	if (written <= 0)
+		return;
+	binary.data.resize(static_cast<size_t>(written));
+
+	write_gl_program_binary(key, binary);
+	gl_program_binaries[key] = std::move(binary);
+}
+
+// Builds and links the vertex and fragment shaders in the source into a
+// program, reusing a cached binary of it when possible. Returns 0 on failure.
+static GLuint create_gl_program(const std::string_view source_sv)
+{
+	const auto key = sdl.opengl.program_binaries ? get_gl_program_key(source_sv)
+	                                             : 0;
+	if (sdl.opengl.program_binaries) {
+		if (const auto program = load_cached_gl_program(key); program)
+			return program;
+	}
+
+	GLuint vertex_shader = 0;
+	GLuint fragment_shader = 0;
+	if (!LoadGLShaders(source_sv, &vertex_shader, &fragment_shader)) {
+		LOG_ERR("SDL:OPENGL: Failed to compile shader!");
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	if (!program) {
+		glDeleteShader(vertex_shader);
+		glDeleteShader(fragment_shader);
+		LOG_WARNING("SDL:OPENGL: Can't create program object");
+		return 0;
+	}
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	if (sdl.opengl.program_binaries)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	// Link the program
+	glLinkProgram(program);
+	// Even if we *are* successful, we may delete the shader objects
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	// Check the link status
+	GLint is_linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &is_linked);
+	if (!is_linked) {
+		GLint info_len = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_len);
+
+		if (info_len > 1) {
+			std::vector<GLchar> info_log(info_len);
+			glGetProgramInfoLog(program, info_len, NULL, info_log.data());
+			LOG_ERR("SDL:OPENGL: Error link program:\n %s", info_log.data());
+		}
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	if (sdl.opengl.program_binaries)
+		cache_gl_program(key, program);
+	return program;
+}
+
+// Keeps the pixel buffer mapped for good and splits it into a ring of frames:
+// while the GPU is still uploading one frame, the next is drawn into another.
+// The buffer has to be bound.
+static bool create_gl_pbo_ring(const size_t frame_bytes)
+{
+	auto &ring = sdl.opengl.pbo_ring;
+	if (!sdl.opengl.persistent_pbo)
+		return false;
+	constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+	                             GL_MAP_COHERENT_BIT;
+	const auto ring_bytes = frame_bytes * ring.fences.size();
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER_EXT, ring_bytes, nullptr, flags);
+	ring.pixels = static_cast<uint8_t *>(
+	        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_EXT, 0, ring_bytes, flags));
+	if (!ring.pixels) {
+		LOG_WARNING("OPENGL: Failed mapping the pixel buffer persistently");
+		// The storage can't be respecified, so start over
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, 0);
+		glDeleteBuffersARB(1, &sdl.opengl.buffer);
+		glGenBuffersARB(1, &sdl.opengl.buffer);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, sdl.opengl.buffer);
+		sdl.opengl.persistent_pbo = false;
+		return false;
+	}
+	ring.frame_bytes = frame_bytes;
+	ring.index = 0;
+	return true;
+}
+
+static void destroy_gl_pbo_ring()
+{
+	auto &ring = sdl.opengl.pbo_ring;
+	for (auto &fence : ring.fences) {
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+	// Deleting the buffer unmaps it
+	ring.pixels = nullptr;
+}
+
+// Waits for the GPU to pass the fence, if one is set, and clears it
+static bool wait_for_gl_fence(GLsync &fence)
+{
+	if (!fence)
+		return true;
+	constexpr GLuint64 timeout_ns = 1000000000;
+	GLenum result = GL_TIMEOUT_EXPIRED;
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+	glDeleteSync(fence);
+	fence = nullptr;
+	return result != GL_WAIT_FAILED;
+}
+
+// Returns the next frame of the ring once the GPU is done uploading from it
+static uint8_t *wait_for_gl_pbo_ring()
+{
+	auto &ring = sdl.opengl.pbo_ring;
+	if (!wait_for_gl_fence(ring.fences[ring.index]))
+		return nullptr;
+	return ring.pixels + ring.index * ring.frame_bytes;
+}
+
+// Keeps the driver from queueing up more than the set number of presented
+// frames, which would each add a refresh of latency
+static void limit_queued_gl_frames()
+{
+	auto &queue = sdl.opengl.frame_queue;
+	if (!queue.limit)
+		return;
+	auto &fence = queue.fences[queue.index];
+	wait_for_gl_fence(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	queue.index = (queue.index + 1) % queue.limit;
+}
+
+// Passes the oldest frame read back to the capture, once the GPU has
+// written it or, if asked to, after waiting for it
+static bool deliver_gl_readback(const bool wait)
+{
+	auto &readback = sdl.opengl.readback;
+	if (!readback.pending)
+		return false;
+
+	const auto num_buffers = readback.buffers.size();
+	const auto oldest = (readback.next + num_buffers - readback.pending) %
+	                    num_buffers;
+
+	auto &fence = readback.fences[oldest];
+	if (!wait) {
+		const auto status = glClientWaitSync(fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return false;
+	}
+	wait_for_gl_fence(fence);
+	--readback.pending;
+
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, readback.buffers[oldest]);
+	const auto pixels = static_cast<const uint8_t *>(
+	        glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY));
+	if (pixels) {
+		// The rows are read bottom-up
+		const auto pitch = readback.width * 4;
+		CAPTURE_AddDisplayImage(readback.width,
+		                        readback.height,
+		                        -pitch,
+		                        pixels + (readback.height - 1) * pitch);
+		glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+	}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	return true;
+}
+
+// Starts reading the presented frame back into the next buffer. The copy
+// runs on the GPU; it's only mapped once its fence is passed, so capturing
+// doesn't stall the pipeline unless all of the buffers are still pending.
+static void read_back_gl_frame()
+{
+	auto &readback = sdl.opengl.readback;
+	const auto width = sdl.clip.w;
+	const auto height = sdl.clip.h;
+
+	if (width != readback.width || height != readback.height) {
+		// Pass on the frames of the old size before reallocating
+		while (deliver_gl_readback(true))
+			;
+		if (!readback.buffers[0])
+			glGenBuffersARB(static_cast<GLsizei>(readback.buffers.size()),
+			                readback.buffers.data());
+		const auto frame_bytes = static_cast<GLsizeiptr>(width) * height * 4;
+		for (const auto buffer : readback.buffers) {
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, buffer);
+			glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, frame_bytes,
+			                nullptr, GL_STREAM_READ_ARB);
+		}
+		readback.width = width;
+		readback.height = height;
+		readback.next = 0;
+	}
+	if (readback.pending == readback.buffers.size())
+		deliver_gl_readback(true);
+
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, readback.buffers[readback.next]);
+	glReadPixels(sdl.clip.x, sdl.clip.y, width, height, GL_BGRA_EXT,
+	             GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+	readback.fences[readback.next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.next = (readback.next + 1) % readback.buffers.size();
+	++readback.pending;
+}
+
+// Looks up the colours of an 8-bit frame, held by the texture on unit 1, in
+// the palette on unit 2
+constexpr char palette_expansion_shader[] = R"GLSL(#version 120
+#if defined(VERTEX)
+attribute vec4 a_position;
+
+void main()
+{
+	gl_Position = a_position;
+}
+#elif defined(FRAGMENT)
+uniform sampler2D indexes;
+uniform sampler2D palette;
+uniform vec2 texture_size;
+
+void main()
+{
+	float index = texture2D(indexes, gl_FragCoord.xy / texture_size).r;
+	gl_FragColor = texture2D(palette, vec2(index * (255.0 / 256.0) + 0.5 / 256.0, 0.5));
+}
+#endif
+)GLSL";
+
+// Decodes the RGBI colours of the hdots of a CGA composite frame, held by the
+// texture on unit 1, into RGB as Composite_Process in vga_draw.cpp does. The
+// composite levels of each pair of hdots and carrier phase are on unit 3.
+constexpr char composite_decode_shader[] = R"GLSL(#version 120
+#if defined(VERTEX)
+attribute vec4 a_position;
+
+void main()
+{
+	gl_Position = a_position;
+}
+#elif defined(FRAGMENT)
+uniform sampler2D indexes;
+uniform sampler2D levels;
+uniform vec2 texture_size;
+uniform float frame_width;
+uniform float hdots;
+uniform float border;
+uniform bool monochrome;
+uniform float sharpness;
+uniform vec3 i_factors;
+uniform vec3 q_factors;
+
+float rgbi(float hdot)
+{
+	if (hdot < 0.0 || hdot >= hdots)
+		return border;
+	float x = floor((hdot + 0.5) * frame_width / hdots) + 0.5;
+	float index = texture2D(indexes, vec2(x, gl_FragCoord.y) / texture_size).r;
+	return floor(index * 255.0 + 0.5);
+}
+
+float level(float hdot)
+{
+	float index = rgbi(hdot) * 64.0 + rgbi(hdot + 1.0) * 4.0 + mod(hdot, 4.0);
+	vec2 bytes = texture2D(levels, vec2((index + 0.5) / 1024.0, 0.5)).rg;
+	bytes = floor(bytes * 255.0 + 0.5);
+	return bytes.r + bytes.g * 256.0 - 32768.0;
+}
+
+vec3 to_colour(vec3 v)
+{
+	return clamp(floor(v / 8192.0), 0.0, 255.0) / 255.0;
+}
+
+void main()
+{
+	float hdot = floor(floor(gl_FragCoord.x) * hdots / frame_width);
+
+	// The levels of this hdot, at s[5], and the five on either side
+	float s[11];
+	for (int k = 0; k < 11; ++k)
+		s[k] = level(hdot + float(k - 5));
+
+	if (monochrome) {
+		float c = 16.0 * s[5];
+		float d = 8.0 * (s[4] + s[6]);
+		float y = (c + d) * 256.0 + sharpness * (c - d);
+		gl_FragColor = vec4(to_colour(vec3(y)), 1.0);
+		return;
+	}
+
+	// Separate the chroma from the luma
+	float a_prev = s[0] - 2.0 * (s[2] - s[4] + s[6]) + s[8];
+	float a = s[1] - 2.0 * (s[3] - s[5] + s[7]) + s[9];
+	float a_next = s[2] - 2.0 * (s[4] - s[6] + s[8]) + s[10];
+	float b = 2.0 * (s[2] - s[4] + s[6] - s[8]);
+
+	float c = 2.0 * (8.0 * s[5] - a);
+	float d = (8.0 * s[4] - a_prev) + (8.0 * s[6] - a_next);
+	float y = (c + d) * 256.0 + sharpness * (c - d);
+
+	// Rotate the chroma by the carrier phase of the hdot
+	float phase = mod(hdot, 4.0);
+	vec2 iq = phase < 0.5 ? vec2(a, b)
+	        : phase < 1.5 ? vec2(-b, a)
+	        : phase < 2.5 ? vec2(-a, -b)
+	                      : vec2(b, -a);
+
+	gl_FragColor = vec4(to_colour(vec3(y) + i_factors * iq.x + q_factors * iq.y), 1.0);
+}
+#endif
+)GLSL";
+
+static void destroy_gl_indexed()
+{
+	auto &indexed = sdl.opengl.indexed;
+	if (indexed.framebuffer)
+		glDeleteFramebuffersEXT(1, &indexed.framebuffer);
+	if (indexed.index_texture)
+		glDeleteTextures(1, &indexed.index_texture);
+	if (indexed.palette_texture)
+		glDeleteTextures(1, &indexed.palette_texture);
+	if (indexed.program)
+		glDeleteProgram(indexed.program);
+	auto &composite = indexed.composite;
+	if (composite.levels_texture)
+		glDeleteTextures(1, &composite.levels_texture);
+	if (composite.program)
+		glDeleteProgram(composite.program);
+	indexed.active          = false;
+	indexed.program         = 0;
+	indexed.framebuffer     = 0;
+	indexed.index_texture   = 0;
+	indexed.palette_texture = 0;
+	indexed.position        = -1;
+	composite.program        = 0;
+	composite.position       = -1;
+	composite.levels_texture = 0;
+	// The colours and the decoder are kept for the next setup
+	indexed.colours_changed = true;
+	composite.changed       = true;
+}
+
+static GLuint create_gl_lookup_texture(const GLenum unit, const GLint format,
+                                       const int width, const int height,
+                                       const GLenum pixel_format,
+                                       const GLenum pixel_type, const void *pixels)
+{
+	GLuint texture = 0;
+	glActiveTexture(unit);
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, pixel_format,
+	             pixel_type, pixels);
+	glActiveTexture(GL_TEXTURE0);
+	return texture;
+}
+
+// Builds one of the programs drawing 8-bit frames into the texture the
+// shader presents, or returns 0
+static GLuint create_gl_indexed_program(const char *source, GLint &position,
+                                        const int texsize_w, const int texsize_h)
+{
+	const GLuint program = create_gl_program(source);
+	if (!program)
+		return 0;
+
+	position = glGetAttribLocation(program, "a_position");
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "indexes"), 1);
+	glUniform1i(glGetUniformLocation(program, "palette"), 2);
+	glUniform1i(glGetUniformLocation(program, "levels"), 3);
+	glUniform2f(glGetUniformLocation(program, "texture_size"),
+	            static_cast<GLfloat>(texsize_w),
+	            static_cast<GLfloat>(texsize_h));
+	glUseProgram(sdl.opengl.program_object);
+	return program;
+}
+
+// Sets up uploading 8-bit frames as is and expanding them through the
+// palette, or decoding them as composite hdots, into the texture the shader
+// presents
+static bool create_gl_indexed(const int texsize_w, const int texsize_h)
+{
+	auto &indexed = sdl.opengl.indexed;
+	// The expansion draws with the vertices set up for the shader
+	if (!sdl.opengl.program_object)
+		return false;
+
+	indexed.program = create_gl_indexed_program(palette_expansion_shader,
+	                                            indexed.position,
+	                                            texsize_w, texsize_h);
+	auto &composite = indexed.composite;
+	composite.program = create_gl_indexed_program(composite_decode_shader,
+	                                              composite.position,
+	                                              texsize_w, texsize_h);
+	if (!indexed.program || !composite.program)
+		return false;
+
+	indexed.index_texture = create_gl_lookup_texture(GL_TEXTURE1,
+	                                                 GL_LUMINANCE8,
+	                                                 texsize_w, texsize_h,
+	                                                 GL_LUMINANCE,
+	                                                 GL_UNSIGNED_BYTE,
+	                                                 nullptr);
+	indexed.palette_texture = create_gl_lookup_texture(GL_TEXTURE2, GL_RGB8,
+	                                                   256, 1, GL_BGRA_EXT,
+	                                                   GL_UNSIGNED_INT_8_8_8_8_REV,
+	                                                   indexed.colours);
+	indexed.colours_changed = false;
+	composite.levels_texture = create_gl_lookup_texture(GL_TEXTURE3, GL_RGBA8,
+	                                                    1024, 1, GL_RGBA,
+	                                                    GL_UNSIGNED_BYTE,
+	                                                    composite.levels);
+
+	glGenFramebuffersEXT(1, &indexed.framebuffer);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, indexed.framebuffer);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+	                          GL_TEXTURE_2D, sdl.opengl.texture, 0);
+	const auto status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	return status == GL_FRAMEBUFFER_COMPLETE_EXT;
+}
 #endif
 
 
@@ -1824,12 +2727,17 @@ dosurface:
 	case SCREEN_OPENGL: {
 		if (sdl.opengl.pixel_buffer_object) {
 			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, 0);
+			destroy_gl_pbo_ring();
 			if (sdl.opengl.buffer) glDeleteBuffersARB(1, &sdl.opengl.buffer);
+			sdl.opengl.buffer = 0;
 		} else {
 			free(sdl.opengl.framebuf);
 		}
 		sdl.opengl.framebuf=0;
-		if (!(flags & GFX_CAN_32))
+		destroy_gl_indexed();
+
+		bool indexed = sdl.opengl.gpu_palette && (flags & GFX_CAN_8);
+		if (!indexed && !(flags & GFX_CAN_32))
 			goto dosurface;
 
 		int texsize_w, texsize_h;
@@ -1895,50 +2803,17 @@ dosurface:
 
 				// does program need to be rebuilt?
 				if (sdl.opengl.program_object == 0) {
-					GLuint vertexShader, fragmentShader;
-
-					if (!LoadGLShaders(sdl.opengl.shader_source_sv,
-					                   &vertexShader,
-					                   &fragmentShader)) {
-						LOG_ERR("SDL:OPENGL: Failed to compile shader!");
-						goto dosurface;
-					}
-
-					sdl.opengl.program_object = glCreateProgram();
+					sdl.opengl.program_object = create_gl_program(
+					        sdl.opengl.shader_source_sv);
 					if (!sdl.opengl.program_object) {
-						glDeleteShader(vertexShader);
-						glDeleteShader(fragmentShader);
-						LOG_WARNING("SDL:OPENGL: Can't create program object, falling back to surface");
-						goto dosurface;
-					}
-					glAttachShader(sdl.opengl.program_object, vertexShader);
-					glAttachShader(sdl.opengl.program_object, fragmentShader);
-					// Link the program
-					glLinkProgram(sdl.opengl.program_object);
-					// Even if we *are* successful, we may delete the shader objects
-					glDeleteShader(vertexShader);
-					glDeleteShader(fragmentShader);
-
-					// Check the link status
-					GLint isProgramLinked;
-					glGetProgramiv(sdl.opengl.program_object, GL_LINK_STATUS, &isProgramLinked);
-					if (!isProgramLinked) {
-						GLint info_len = 0;
-						glGetProgramiv(sdl.opengl.program_object, GL_INFO_LOG_LENGTH, &info_len);
-
-						if (info_len > 1) {
-							std::vector<GLchar> info_log(info_len);
-							glGetProgramInfoLog(sdl.opengl.program_object, info_len, NULL, info_log.data());
-							LOG_ERR("SDL:OPENGL: Error link program:\n %s", info_log.data());
-						}
-						glDeleteProgram(sdl.opengl.program_object);
-						sdl.opengl.program_object = 0;
+						LOG_WARNING("SDL:OPENGL: Can't build the shader program, falling back to surface");
 						goto dosurface;
 					}
 
 					glUseProgram(sdl.opengl.program_object);
 
 					GLint u = glGetAttribLocation(sdl.opengl.program_object, "a_position");
+					sdl.opengl.position = u;
 					// upper left
 					sdl.opengl.vertex_data[0] = -1.0f;
 					sdl.opengl.vertex_data[1] = 1.0f;
@@ -1968,7 +2843,8 @@ dosurface:
 		if (sdl.opengl.pixel_buffer_object) {
 			glGenBuffersARB(1, &sdl.opengl.buffer);
 			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, sdl.opengl.buffer);
-			glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_EXT, framebuffer_bytes, NULL, GL_STREAM_DRAW_ARB);
+			if (!create_gl_pbo_ring(framebuffer_bytes))
+				glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_EXT, framebuffer_bytes, NULL, GL_STREAM_DRAW_ARB);
 			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, 0);
 		} else {
 			sdl.opengl.framebuf = malloc(framebuffer_bytes); // 32 bit color
@@ -2054,6 +2930,16 @@ dosurface:
 		             emptytex);
 		delete[] emptytex;
 
+		if (indexed && !create_gl_indexed(texsize_w, texsize_h)) {
+			LOG_WARNING("OPENGL: Failed setting up the palette expansion, converting 8-bit frames on the CPU");
+			destroy_gl_indexed();
+			sdl.opengl.gpu_palette = false;
+			indexed = false;
+		}
+		sdl.opengl.indexed.active = indexed;
+		if (indexed)
+			sdl.opengl.pitch = width;
+
 		if (sdl.opengl.framebuffer_is_srgb_encoded) {
 			glEnable(GL_FRAMEBUFFER_SRGB);
 		}
@@ -2105,8 +2991,13 @@ dosurface:
 
 		OPENGL_ERROR("End of setsize");
 
-		retFlags = GFX_CAN_32 | GFX_SCALING;
-		if (sdl.opengl.pixel_buffer_object) {
+		retFlags = (indexed ? GFX_CAN_8 : GFX_CAN_32) | GFX_SCALING;
+		if (indexed) {
+			sdl.frame.update = update_frame_gl_indexed;
+		} else if (sdl.opengl.pbo_ring.pixels) {
+			retFlags |= GFX_HARDWARE;
+			sdl.frame.update = update_frame_gl_pbo_ring;
+		} else if (sdl.opengl.pixel_buffer_object) {
 			retFlags |= GFX_HARDWARE;
 			sdl.frame.update = update_frame_gl_pbo;
 		} else {
@@ -2119,11 +3010,24 @@ dosurface:
 		break; // SCREEN_OPENGL
 	}
 #endif // C_OPENGL
+	case SCREEN_HEADLESS:
+		// Frames are drawn into memory and never presented, so there's
+		// nothing to pace or sync
+		sdl.clip = {0, 0, width, height};
+		sdl.headless.framebuf.resize(static_cast<size_t>(width) * height * 4);
+		retFlags = GFX_CAN_32 | GFX_SCALING;
+
+		sdl.frame.update = update_frame_noop;
+		sdl.frame.present = present_frame_noop;
+
+		sdl.desktop.type = SCREEN_HEADLESS;
+		break; // SCREEN_HEADLESS
 	}
 
 	// Ensure mouse emulation knows the current parameters
 	NewMouseScreenParams();
-	update_vsync_state();
+	if (sdl.desktop.type != SCREEN_HEADLESS)
+		update_vsync_state();
 
 	if (retFlags)
 		GFX_Start();
@@ -2140,6 +3044,7 @@ void GFX_SetShader([[maybe_unused]] const std::string &source)
 		return;
 
 	if (sdl.opengl.program_object) {
+		stop_gl_presenter();
 		glDeleteProgram(sdl.opengl.program_object);
 		sdl.opengl.program_object = 0;
 	}
@@ -2280,6 +3185,8 @@ void sticky_keys(bool restore){
 
 void GFX_SwitchFullScreen()
 {
+	if (sdl.headless.enabled)
+		return;
 	sdl.desktop.switching_fullscreen = true;
 #if defined (WIN32)
 	// We are about to switch to the opposite of our current mode
@@ -2307,6 +3214,147 @@ static void SwitchFullScreen(bool pressed)
 		GFX_SwitchFullScreen();
 }
 
+#if C_OPENGL
+// Threaded OpenGL presentation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// With [sdl] threaded_presentation, the texture upload, drawing, and buffer
+// swap run on a thread of their own that holds the OpenGL context, so a swap
+// blocked on vsync or the compositor no longer stalls the emulation.
+//
+// Completed frames are handed over through a triple buffer: the emulation
+// thread copies each new frame into its back slot and exchanges it with the
+// ready slot, and the presenter exchanges its front slot with the ready slot
+// whenever a newer frame is waiting there. Neither side waits for the other;
+// frames arriving faster than the presenter can show them are dropped.
+//
+// Anything else that uses the context (changing the video mode, the window
+// size, or the shader) stops the presenter first, and the following frame
+// starts it again.
+struct GlPresenter {
+	std::thread thread = {};
+	std::atomic<bool> running = false;
+
+	// Slot index of the latest frame, flagged until the presenter takes it
+	static constexpr uint8_t slot_mask   = 0b011;
+	static constexpr uint8_t fresh_frame = 0b100;
+	std::atomic<uint8_t> ready = 0;
+
+	std::array<std::vector<uint8_t>, 3> slots = {};
+	uint8_t back  = 1; // owned by the emulation thread
+	uint8_t front = 2; // owned by the presenter
+
+	// Only used to sleep when there's nothing to present
+	std::mutex wake_mutex = {};
+	std::condition_variable wake = {};
+
+	// The presentation functions, while the presenter has replaced them
+	update_frame_buffer_f *update = update_frame_noop;
+	present_frame_f *present = present_frame_noop;
+
+	~GlPresenter()
+	{
+		if (thread.joinable()) {
+			running = false;
+			{
+				std::lock_guard lock(wake_mutex);
+			}
+			wake.notify_one();
+			thread.join();
+		}
+	}
+};
+
+static GlPresenter gl_presenter;
+
+static void wake_gl_presenter()
+{
+	// Taking the lock orders this wake-up after the presenter has either
+	// checked for work or gone to sleep, so it can't be missed
+	{
+		std::lock_guard lock(gl_presenter.wake_mutex);
+	}
+	gl_presenter.wake.notify_one();
+}
+
+static void run_gl_presenter()
+{
+	auto &p = gl_presenter;
+	THREAD_ApplyToCurrent(ThreadClass::Render);
+	SDL_GL_MakeCurrent(sdl.window, sdl.opengl.context);
+
+	while (true) {
+		{
+			std::unique_lock lock(p.wake_mutex);
+			p.wake.wait(lock, [&p] {
+				return !p.running || (p.ready & GlPresenter::fresh_frame);
+			});
+		}
+		if (!p.running)
+			break;
+
+		p.front = p.ready.exchange(p.front) & GlPresenter::slot_mask;
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sdl.draw.width,
+		                sdl.draw.height, GL_BGRA_EXT,
+		                GL_UNSIGNED_INT_8_8_8_8_REV,
+		                p.slots[p.front].data());
+		p.present();
+	}
+	SDL_GL_MakeCurrent(sdl.window, nullptr);
+}
+
+static void start_gl_presenter()
+{
+	auto &p = gl_presenter;
+	if (p.running || sdl.frame.present != present_frame_gl)
+		return;
+
+	const auto frame_bytes = static_cast<size_t>(sdl.opengl.pitch) *
+	                         sdl.draw.height;
+	for (auto &slot : p.slots)
+		slot.resize(frame_bytes);
+
+	// Drop a frame left over from before the presenter was stopped
+	p.ready &= GlPresenter::slot_mask;
+
+	// The emulation thread no longer updates or presents frames
+	p.update = sdl.frame.update;
+	p.present = sdl.frame.present;
+	sdl.frame.update = update_frame_noop;
+	sdl.frame.present = present_frame_noop;
+
+	SDL_GL_MakeCurrent(sdl.window, nullptr);
+	p.running = true;
+	p.thread = std::thread(run_gl_presenter);
+}
+
+static void stop_gl_presenter()
+{
+	auto &p = gl_presenter;
+	if (!p.running)
+		return;
+
+	p.running = false;
+	wake_gl_presenter();
+	p.thread.join();
+	SDL_GL_MakeCurrent(sdl.window, sdl.opengl.context);
+
+	sdl.frame.update = p.update;
+	sdl.frame.present = p.present;
+}
+
+static void publish_gl_frame()
+{
+	auto &p = gl_presenter;
+	auto &slot = p.slots[p.back];
+	assert(sdl.opengl.framebuf);
+	memcpy(slot.data(), sdl.opengl.framebuf, slot.size());
+
+	p.back = p.ready.exchange(p.back | GlPresenter::fresh_frame) &
+	         GlPresenter::slot_mask;
+	wake_gl_presenter();
+}
+#endif // C_OPENGL
+
 // This function returns write'able buffer for user to draw upon. Successful
 // return depends on properly initialized SDL_Block structure (which generally
 // can be achieved via GFX_SetSize call), and specifically - properly initialized
@@ -2334,7 +3382,12 @@ bool GFX_StartUpdate(uint8_t * &pixels, int &pitch)
 		return true;
 #if C_OPENGL
 	case SCREEN_OPENGL:
-		if (sdl.opengl.pixel_buffer_object) {
+		if (sdl.opengl.threaded_presentation)
+			start_gl_presenter();
+
+		if (sdl.opengl.pbo_ring.pixels) {
+			pixels = wait_for_gl_pbo_ring();
+		} else if (sdl.opengl.pixel_buffer_object) {
 			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, sdl.opengl.buffer);
 			pixels = static_cast<uint8_t *>(glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, GL_WRITE_ONLY));
 		} else {
@@ -2359,15 +3412,61 @@ bool GFX_StartUpdate(uint8_t * &pixels, int &pitch)
 		pitch = sdl.surface->pitch;
 		sdl.updating = true;
 		return true;
+	case SCREEN_HEADLESS:
+		pixels = sdl.headless.framebuf.data();
+		pitch = sdl.draw.width * 4;
+		sdl.updating = true;
+		return true;
 	}
 	return false;
 }
 
+// Adds up the bytes the output uploads for the frame: the changed lines, or
+// all of them from the mapped pixel buffer
+static void count_uploaded_bytes(const uint16_t *changedLines)
+{
+	if (!changedLines || !sdl.updating || !sdl.update_display_contents)
+		return;
+	int lines = 0;
+	int y = 0;
+	size_t index = 0;
+	while (y < sdl.draw.height) {
+		if (index & 1)
+			lines += changedLines[index];
+		y += changedLines[index];
+		index++;
+	}
+	int bytes_per_pixel = 4;
+#if C_OPENGL
+	if (sdl.frame.update == update_frame_gl_pbo)
+		lines = sdl.draw.height;
+	if (sdl.frame.update == update_frame_gl_indexed)
+		bytes_per_pixel = 1;
+#endif
+	sdl.frame.uploaded_bytes += static_cast<uint64_t>(lines) *
+	                            sdl.draw.width * bytes_per_pixel;
+}
+
+uint64_t GFX_GetUploadedBytes()
+{
+	return sdl.frame.uploaded_bytes;
+}
+
 void GFX_EndUpdate(const uint16_t *changedLines)
 {
+#if C_OPENGL
+	// Only frames with changes are handed to the presenter
+	if (gl_presenter.running && changedLines && sdl.updating)
+		publish_gl_frame();
+#endif
+	count_uploaded_bytes(changedLines);
+	const auto update_start_us = GetTicksUs();
 	sdl.frame.update(changedLines);
 
-	const auto frame_is_new = sdl.update_display_contents && sdl.updating;
+	// A moved cursor overlay needs presenting even without changed lines
+	const auto frame_is_new = (sdl.update_display_contents && sdl.updating) ||
+	                          std::exchange(sdl.cursor.changed, false);
+	note_frame_update(frame_is_new, update_start_us);
 
 	switch (sdl.frame.mode) {
 	case FRAME_MODE::CFR:
@@ -2375,11 +3474,15 @@ void GFX_EndUpdate(const uint16_t *changedLines)
 		break;
 	case FRAME_MODE::VFR:
 		if (frame_is_new)
-			sdl.frame.present();
+			present_frame();
 		break;
 	case FRAME_MODE::THROTTLED_VFR:
 		maybe_present_throttled(frame_is_new);
 		break;
+	// Unchanged frames are presented too, keeping the display at the DOS rate
+	case FRAME_MODE::VRR:
+		present_frame();
+		break;
 	// Synced CFR is started when the presetation mode is setup
 	case FRAME_MODE::SYNCED_CFR:
 	case FRAME_MODE::UNSET:
@@ -2389,16 +3492,154 @@ void GFX_EndUpdate(const uint16_t *changedLines)
 	FrameMark
 }
 
+bool GFX_CanCaptureDisplay()
+{
+#if C_OPENGL
+	return sdl.frame.present == present_frame_gl && sdl.opengl.readback.supported;
+#else
+	return false;
+#endif
+}
+
+bool GFX_CanUploadDirect()
+{
+#if C_OPENGL
+	if (sdl.frame.update == update_frame_gl_fb)
+		return true;
+#endif
+	return sdl.frame.update == update_frame_texture;
+}
+
+void GFX_EndUpdateDirect(const uint8_t *pixels, const int pitch)
+{
+	assert(GFX_CanUploadDirect());
+	sdl.direct.pixels = pixels;
+	sdl.direct.pitch = pitch;
+
+	const uint16_t all_lines[] = {0, check_cast<uint16_t>(sdl.draw.height)};
+	GFX_EndUpdate(all_lines);
+
+	sdl.direct.pixels = nullptr;
+}
+
+bool GFX_CanOverlayCursor()
+{
+	if (sdl.frame.present == present_frame_texture)
+		return !sdl.cursor.texture.unsupported;
+#if C_OPENGL
+	// The cursor is drawn with the shader's vertex setup, and the presenter
+	// thread would have to be handed the cursor along with each frame
+	if (sdl.frame.present == present_frame_gl)
+		return sdl.opengl.program_object && !sdl.opengl.threaded_presentation &&
+		       !sdl.cursor.gl.unsupported;
+#endif
+	return false;
+}
+
+void GFX_SetCursorImage(const uint32_t *colours, const uint32_t *inverted)
+{
+	auto &cursor = sdl.cursor;
+	std::copy_n(colours, std::size(cursor.colours), cursor.colours);
+	std::copy_n(inverted, std::size(cursor.inverted), cursor.inverted);
+	++cursor.image_version;
+	cursor.changed |= cursor.visible;
+}
+
+void GFX_SetCursorPosition(const bool visible, const float x, const float y,
+                           const float w, const float h)
+{
+	auto &cursor = sdl.cursor;
+	cursor.changed |= visible || cursor.visible;
+	cursor.visible = visible;
+	cursor.x = x;
+	cursor.y = y;
+	cursor.w = w;
+	cursor.h = h;
+}
+
 // Texture update and presentation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-static void update_frame_texture([[maybe_unused]] const uint16_t *changedLines)
+// Only the runs of changed lines are uploaded; the texture keeps the rest
+static void update_frame_texture(const uint16_t *changedLines)
+{
+	if (!sdl.update_display_contents || !changedLines)
+		return;
+	const auto surface = sdl.texture.input_surface;
+	const auto pixels = sdl.direct.pixels
+	                          ? sdl.direct.pixels
+	                          : static_cast<uint8_t *>(surface->pixels);
+	const auto pitch = sdl.direct.pixels ? sdl.direct.pitch : surface->pitch;
+	int y = 0;
+	size_t index = 0;
+	while (y < sdl.draw.height) {
+		if (!(index & 1)) {
+			y += changedLines[index];
+		} else {
+			const int height = changedLines[index];
+			const SDL_Rect rect = {0, y, surface->w, height};
+			SDL_UpdateTexture(sdl.texture.texture, &rect,
+			                  pixels + y * pitch, pitch);
+			y += height;
+		}
+		index++;
+	}
+}
+
+// Makes the cursor textures, or marks the overlay unsupported when the
+// renderer can't invert what's beneath it
+static bool create_cursor_textures()
 {
-	if (sdl.update_display_contents) {
-		SDL_UpdateTexture(sdl.texture.texture,
-		                  nullptr, // update entire texture
-		                  sdl.texture.input_surface->pixels,
-		                  sdl.texture.input_surface->pitch);
+	auto &texture = sdl.cursor.texture;
+	const auto create = [](const SDL_BlendMode mode) {
+		auto t = SDL_CreateTexture(sdl.renderer, SDL_PIXELFORMAT_ARGB8888,
+		                           SDL_TEXTUREACCESS_STATIC, 64, 64);
+		if (t && SDL_SetTextureBlendMode(t, mode) != 0) {
+			SDL_DestroyTexture(t);
+			t = nullptr;
+		}
+		return t;
+	};
+	// Both sources are opaque, so white in the inverted mask gives
+	// 1 - destination and black leaves the destination as it is
+	const auto invert = SDL_ComposeCustomBlendMode(
+	        SDL_BLENDFACTOR_ONE_MINUS_DST_COLOR, SDL_BLENDFACTOR_ONE_MINUS_SRC_COLOR,
+	        SDL_BLENDOPERATION_ADD, SDL_BLENDFACTOR_ZERO,
+	        SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
+	texture.colours = create(SDL_BLENDMODE_BLEND);
+	texture.inverted = create(invert);
+	if (!texture.colours || !texture.inverted) {
+		if (texture.colours)
+			SDL_DestroyTexture(texture.colours);
+		if (texture.inverted)
+			SDL_DestroyTexture(texture.inverted);
+		texture = {};
+		texture.unsupported = true;
+		LOG_WARNING("SDL: The renderer can't draw the hardware cursor, drawing it into the frame");
+		return false;
 	}
+	return true;
+}
+
+static void draw_cursor_texture()
+{
+	auto &cursor = sdl.cursor;
+	if (!cursor.visible || cursor.texture.unsupported)
+		return;
+	if (!cursor.texture.colours && !create_cursor_textures())
+		return;
+	constexpr int pitch = 64 * sizeof(uint32_t);
+	if (cursor.texture.image_version != cursor.image_version) {
+		SDL_UpdateTexture(cursor.texture.colours, nullptr, cursor.colours, pitch);
+		SDL_UpdateTexture(cursor.texture.inverted, nullptr, cursor.inverted, pitch);
+		cursor.texture.image_version = cursor.image_version;
+	}
+	// The frame fills the viewport
+	SDL_Rect viewport = {};
+	SDL_RenderGetViewport(sdl.renderer, &viewport);
+	const SDL_Rect rect = {iround(cursor.x * viewport.w), iround(cursor.y * viewport.h),
+	                       iround(cursor.w * viewport.w), iround(cursor.h * viewport.h)};
+	SDL_RenderCopy(sdl.renderer, cursor.texture.colours, nullptr, &rect);
+	SDL_RenderCopy(sdl.renderer, cursor.texture.inverted, nullptr, &rect);
 }
 
 static bool present_frame_texture()
@@ -2407,6 +3648,7 @@ static bool present_frame_texture()
 	if (is_presenting) {
 		SDL_RenderClear(sdl.renderer);
 		SDL_RenderCopy(sdl.renderer, sdl.texture.texture, nullptr, nullptr);
+		draw_cursor_texture();
 		SDL_RenderPresent(sdl.renderer);
 	}
 	render_pacer.Checkpoint();
@@ -2416,6 +3658,41 @@ static bool present_frame_texture()
 // OpenGL PBO-based update, frame-based update, and presentation
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 #if C_OPENGL
+// Each frame of the ring only holds the lines drawn into it, so only those
+// are uploaded; the texture keeps the rest
+static void update_frame_gl_pbo_ring(const uint16_t *changedLines)
+{
+	if (!sdl.updating) {
+		sdl.opengl.actual_frame_count++;
+		return;
+	}
+	if (!changedLines)
+		return;
+	auto &ring = sdl.opengl.pbo_ring;
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, sdl.opengl.buffer);
+	const auto offset = ring.index * ring.frame_bytes;
+	const auto pitch = sdl.opengl.pitch;
+	int y = 0;
+	size_t index = 0;
+	while (y < sdl.draw.height) {
+		if (!(index & 1)) {
+			y += changedLines[index];
+		} else {
+			const auto pixels = reinterpret_cast<const void *>(
+			        offset + static_cast<size_t>(y) * pitch);
+			const int height = changedLines[index];
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, sdl.draw.width,
+			                height, GL_BGRA_EXT,
+			                GL_UNSIGNED_INT_8_8_8_8_REV, pixels);
+			y += height;
+		}
+		index++;
+	}
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, 0);
+	ring.fences[ring.index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring.index = (ring.index + 1) % ring.fences.size();
+}
+
 static void update_frame_gl_pbo([[maybe_unused]] const uint16_t *changedLines)
 {
 	if (sdl.updating) {
@@ -2432,8 +3709,15 @@ static void update_frame_gl_pbo([[maybe_unused]] const uint16_t *changedLines)
 static void update_frame_gl_fb(const uint16_t *changedLines)
 {
 	if (changedLines) {
-		const auto framebuf = static_cast<uint8_t *>(sdl.opengl.framebuf);
-		const auto pitch = sdl.opengl.pitch;
+		const auto framebuf = sdl.direct.pixels
+		                            ? sdl.direct.pixels
+		                            : static_cast<uint8_t *>(sdl.opengl.framebuf);
+		const auto pitch = sdl.direct.pixels ? sdl.direct.pitch
+		                                     : sdl.opengl.pitch;
+		// Lines in video memory can be further apart than in the frame
+		// buffer
+		if (sdl.direct.pixels)
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / 4);
 		int y = 0;
 		size_t index = 0;
 		while (y < sdl.draw.height) {
@@ -2449,11 +3733,218 @@ static void update_frame_gl_fb(const uint16_t *changedLines)
 			}
 			index++;
 		}
+		if (sdl.direct.pixels)
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	} else {
 		sdl.opengl.actual_frame_count++;
 	}
 }
 
+// Hands the composite decoder to its program, which has to be in use
+static void set_gl_composite_decoder()
+{
+	auto &composite = sdl.opengl.indexed.composite;
+	const auto &decoder = composite.decoder;
+	const auto program = composite.program;
+
+	glActiveTexture(GL_TEXTURE3);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1024, 1, GL_RGBA,
+	                GL_UNSIGNED_BYTE, composite.levels);
+	glActiveTexture(GL_TEXTURE0);
+
+	auto uniform = [program](const char *name) {
+		return glGetUniformLocation(program, name);
+	};
+	glUniform1f(uniform("frame_width"), static_cast<GLfloat>(sdl.draw.width));
+	glUniform1f(uniform("hdots"), static_cast<GLfloat>(decoder.hdots));
+	glUniform1f(uniform("border"), decoder.border);
+	glUniform1i(uniform("monochrome"), decoder.monochrome);
+	glUniform1f(uniform("sharpness"), static_cast<GLfloat>(decoder.sharpness));
+	glUniform3f(uniform("i_factors"),
+	            static_cast<GLfloat>(decoder.ri),
+	            static_cast<GLfloat>(decoder.gi),
+	            static_cast<GLfloat>(decoder.bi));
+	glUniform3f(uniform("q_factors"),
+	            static_cast<GLfloat>(decoder.rq),
+	            static_cast<GLfloat>(decoder.gq),
+	            static_cast<GLfloat>(decoder.bq));
+	composite.changed = false;
+}
+
+// Uploads the changed lines of an 8-bit frame and expands the frame through
+// the palette, or decodes its composite hdots, into the texture the shader
+// presents
+static void update_frame_gl_indexed(const uint16_t *changedLines)
+{
+	if (!changedLines) {
+		sdl.opengl.actual_frame_count++;
+		return;
+	}
+	auto &indexed = sdl.opengl.indexed;
+
+	glActiveTexture(GL_TEXTURE1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	const auto framebuf = static_cast<uint8_t *>(sdl.opengl.framebuf);
+	const auto pitch = sdl.opengl.pitch;
+	int y = 0;
+	size_t index = 0;
+	while (y < sdl.draw.height) {
+		if (!(index & 1)) {
+			y += changedLines[index];
+		} else {
+			const uint8_t *pixels = framebuf + y * pitch;
+			const int height = changedLines[index];
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, sdl.draw.width,
+			                height, GL_LUMINANCE, GL_UNSIGNED_BYTE, pixels);
+			y += height;
+		}
+		index++;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if (indexed.colours_changed) {
+		glActiveTexture(GL_TEXTURE2);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 1, GL_BGRA_EXT,
+		                GL_UNSIGNED_INT_8_8_8_8_REV, indexed.colours);
+		indexed.colours_changed = false;
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	// The colours are copied as they are, like the CPU conversion does
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, indexed.framebuffer);
+	glViewport(0, 0, sdl.draw.width, sdl.draw.height);
+	if (sdl.opengl.framebuffer_is_srgb_encoded)
+		glDisable(GL_FRAMEBUFFER_SRGB);
+	auto &composite = indexed.composite;
+	const auto position = composite.active ? composite.position
+	                                       : indexed.position;
+	glUseProgram(composite.active ? composite.program : indexed.program);
+	if (composite.active && composite.changed)
+		set_gl_composite_decoder();
+	glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, 0,
+	                      sdl.opengl.vertex_data);
+	glEnableVertexAttribArray(position);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+	glUseProgram(sdl.opengl.program_object);
+	glVertexAttribPointer(sdl.opengl.position, 2, GL_FLOAT, GL_FALSE, 0,
+	                      sdl.opengl.vertex_data);
+	glEnableVertexAttribArray(sdl.opengl.position);
+	if (sdl.opengl.framebuffer_is_srgb_encoded)
+		glEnable(GL_FRAMEBUFFER_SRGB);
+	glViewport(sdl.clip.x, sdl.clip.y, sdl.clip.w, sdl.clip.h);
+}
+
+// Draws the hardware cursor texture, held on unit 4, over the frame
+constexpr char cursor_overlay_shader[] = R"GLSL(#version 120
+#if defined(VERTEX)
+attribute vec4 a_position;
+attribute vec2 a_texcoord;
+varying vec2 v_texcoord;
+
+void main()
+{
+	gl_Position = a_position;
+	v_texcoord = a_texcoord;
+}
+#elif defined(FRAGMENT)
+uniform sampler2D image;
+varying vec2 v_texcoord;
+
+void main()
+{
+	gl_FragColor = texture2D(image, v_texcoord);
+}
+#endif
+)GLSL";
+
+// Makes the cursor program and texture, or marks the overlay unsupported
+static bool create_cursor_gl()
+{
+	auto &gl = sdl.cursor.gl;
+	if (glDisableVertexAttribArray)
+		gl.program = create_gl_program(cursor_overlay_shader);
+	if (!gl.program) {
+		gl.unsupported = true;
+		LOG_WARNING("SDL:OPENGL: Can't draw the hardware cursor, drawing it into the frame");
+		return false;
+	}
+	gl.position = glGetAttribLocation(gl.program, "a_position");
+	gl.texcoord = glGetAttribLocation(gl.program, "a_texcoord");
+	glUseProgram(gl.program);
+	glUniform1i(glGetUniformLocation(gl.program, "image"), 4);
+
+	// The colours on top of the inverted mask
+	gl.texture = create_gl_lookup_texture(GL_TEXTURE4, GL_RGBA8, 64, 128,
+	                                      GL_BGRA_EXT,
+	                                      GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+	return true;
+}
+
+static void draw_cursor_gl()
+{
+	auto &cursor = sdl.cursor;
+	if (!cursor.visible || !sdl.opengl.program_object || cursor.gl.unsupported)
+		return;
+	if (!cursor.gl.program && !create_cursor_gl())
+		return;
+	auto &gl = cursor.gl;
+	glUseProgram(gl.program);
+
+	glActiveTexture(GL_TEXTURE4);
+	if (gl.image_version != cursor.image_version) {
+		// The image comes from memory rather than the frame's buffer
+		GLint unpack_buffer = 0;
+		glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING_ARB, &unpack_buffer);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT, 0);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 64, 64, GL_BGRA_EXT,
+		                GL_UNSIGNED_INT_8_8_8_8_REV, cursor.colours);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 64, 64, 64, GL_BGRA_EXT,
+		                GL_UNSIGNED_INT_8_8_8_8_REV, cursor.inverted);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_EXT,
+		                static_cast<GLuint>(unpack_buffer));
+		gl.image_version = cursor.image_version;
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	// The frame fills the viewport, top row first
+	const auto left = cursor.x * 2.0f - 1.0f;
+	const auto top = 1.0f - cursor.y * 2.0f;
+	const auto right = left + cursor.w * 2.0f;
+	const auto bottom = top - cursor.h * 2.0f;
+	const GLfloat positions[] = {left, top, right, top, left, bottom, right, bottom};
+	const GLfloat colour_coords[] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 1.0f, 0.5f};
+	const GLfloat invert_coords[] = {0.0f, 0.5f, 1.0f, 0.5f, 0.0f, 1.0f, 1.0f, 1.0f};
+	glVertexAttribPointer(gl.position, 2, GL_FLOAT, GL_FALSE, 0, positions);
+	glEnableVertexAttribArray(gl.position);
+	glEnableVertexAttribArray(gl.texcoord);
+	if (sdl.opengl.framebuffer_is_srgb_encoded)
+		glDisable(GL_FRAMEBUFFER_SRGB);
+	glEnable(GL_BLEND);
+
+	// The colours are either opaque or fully transparent, so they're
+	// premultiplied as they are
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	glVertexAttribPointer(gl.texcoord, 2, GL_FLOAT, GL_FALSE, 0, colour_coords);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	// White in the mask gives 1 - destination, and black leaves it be
+	glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ONE_MINUS_SRC_COLOR);
+	glVertexAttribPointer(gl.texcoord, 2, GL_FLOAT, GL_FALSE, 0, invert_coords);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	// Back to the shader's state for the next frame
+	glDisable(GL_BLEND);
+	if (sdl.opengl.framebuffer_is_srgb_encoded)
+		glEnable(GL_FRAMEBUFFER_SRGB);
+	glDisableVertexAttribArray(gl.texcoord);
+	glUseProgram(sdl.opengl.program_object);
+	glVertexAttribPointer(sdl.opengl.position, 2, GL_FLOAT, GL_FALSE, 0,
+	                      sdl.opengl.vertex_data);
+	glEnableVertexAttribArray(sdl.opengl.position);
+}
+
 static bool present_frame_gl()
 {
 	const auto is_presenting = render_pacer.CanRun();
@@ -2463,11 +3954,18 @@ static bool present_frame_gl()
 			glUniform1i(sdl.opengl.ruby.frame_count,
 			            sdl.opengl.actual_frame_count++);
 			glDrawArrays(GL_TRIANGLES, 0, 3);
+			draw_cursor_gl();
 		} else {
 			glCallList(sdl.opengl.displaylist);
 		}
+		if (CAPTURE_WantsDisplayImage())
+			read_back_gl_frame();
 		SDL_GL_SwapWindow(sdl.window);
+		limit_queued_gl_frames();
 	}
+	// Pass on the frames read back earlier that are ready by now
+	while (deliver_gl_readback(false))
+		;
 	render_pacer.Checkpoint();
 	return is_presenting;
 }
@@ -2516,15 +4014,78 @@ Bitu GFX_GetRGB(uint8_t red,uint8_t green,uint8_t blue) {
 		return SDL_MapRGB(sdl.texture.pixelFormat, red, green, blue);
 #if C_OPENGL
 	case SCREEN_OPENGL:
-		return ((blue << 0) | (green << 8) | (red << 16)) | (255 << 24);
 #endif
+	case SCREEN_HEADLESS:
+		return ((blue << 0) | (green << 8) | (red << 16)) | (255 << 24);
 	}
 	return 0;
 }
 
+void GFX_SetPalette([[maybe_unused]] const uint32_t *colours)
+{
+#if C_OPENGL
+	auto &indexed = sdl.opengl.indexed;
+	memcpy(indexed.colours, colours, sizeof(indexed.colours));
+	indexed.colours_changed = true;
+#endif
+}
+
+bool GFX_CanDecodeComposite()
+{
+#if C_OPENGL
+	return sdl.desktop.want_type == SCREEN_OPENGL && sdl.opengl.gpu_palette;
+#else
+	return false;
+#endif
+}
+
+bool GFX_SetCompositeDecoder([[maybe_unused]] const GFX_CompositeDecoder *decoder)
+{
+#if C_OPENGL
+	auto &composite = sdl.opengl.indexed.composite;
+	if (!decoder) {
+		const bool was_active = composite.active;
+		composite.active = false;
+		return was_active;
+	}
+	uint8_t levels[sizeof(composite.levels)];
+	for (int i = 0; i < 1024; ++i) {
+		const auto level = static_cast<uint16_t>(
+		        std::clamp(decoder->levels[i] + 32768, 0,
+		                   static_cast<int>(UINT16_MAX)));
+		levels[i * 4 + 0] = static_cast<uint8_t>(level & 0xff);
+		levels[i * 4 + 1] = static_cast<uint8_t>(level >> 8);
+		levels[i * 4 + 2] = 0;
+		levels[i * 4 + 3] = 0;
+	}
+	const auto &last = composite.decoder;
+	const bool is_same = composite.active &&
+	                     !memcmp(levels, composite.levels, sizeof(levels)) &&
+	                     decoder->hdots == last.hdots &&
+	                     decoder->sharpness == last.sharpness &&
+	                     decoder->ri == last.ri && decoder->rq == last.rq &&
+	                     decoder->gi == last.gi && decoder->gq == last.gq &&
+	                     decoder->bi == last.bi && decoder->bq == last.bq &&
+	                     decoder->border == last.border &&
+	                     decoder->monochrome == last.monochrome;
+	if (is_same)
+		return false;
+	memcpy(composite.levels, levels, sizeof(levels));
+	composite.decoder = *decoder;
+	// The levels are copied, so don't keep pointing at them
+	composite.decoder.levels = nullptr;
+	composite.active = true;
+	composite.changed = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
 void GFX_Stop() {
 	if (sdl.updating)
 		GFX_EndUpdate(nullptr);
+	stop_gl_presenter();
 	sdl.active=false;
 }
 
@@ -3123,6 +4684,12 @@ static void set_output(Section *sec, bool should_stretch_pixels)
 	GFX_DisengageRendering();
 	// it's the job of everything after this to re-engage it.
 
+	// There's no window to set up without the video subsystem
+	if (sdl.headless.enabled) {
+		sdl.desktop.want_type = SCREEN_HEADLESS;
+		return;
+	}
+
 	if (output == "surface") {
 		sdl.desktop.want_type = SCREEN_SURFACE;
 	} else if (output == "texture") {
@@ -3214,6 +4781,8 @@ static void set_output(Section *sec, bool should_stretch_pixels)
 			        "glDeleteProgram");
 			glDeleteShader = (PFNGLDELETESHADERPROC)SDL_GL_GetProcAddress(
 			        "glDeleteShader");
+			glDisableVertexAttribArray = (PFNGLDISABLEVERTEXATTRIBARRAYPROC)
+			        SDL_GL_GetProcAddress("glDisableVertexAttribArray");
 			glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)
 			        SDL_GL_GetProcAddress("glEnableVertexAttribArray");
 			glGetAttribLocation = (PFNGLGETATTRIBLOCATIONPROC)
@@ -3240,6 +4809,18 @@ static void set_output(Section *sec, bool should_stretch_pixels)
 			        "glUseProgram");
 			glVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)
 			        SDL_GL_GetProcAddress("glVertexAttribPointer");
+			glActiveTexture = (PFNGLACTIVETEXTUREPROC)SDL_GL_GetProcAddress(
+			        "glActiveTexture");
+			glGenFramebuffersEXT = (PFNGLGENFRAMEBUFFERSEXTPROC)
+			        SDL_GL_GetProcAddress("glGenFramebuffersEXT");
+			glDeleteFramebuffersEXT = (PFNGLDELETEFRAMEBUFFERSEXTPROC)
+			        SDL_GL_GetProcAddress("glDeleteFramebuffersEXT");
+			glBindFramebufferEXT = (PFNGLBINDFRAMEBUFFEREXTPROC)
+			        SDL_GL_GetProcAddress("glBindFramebufferEXT");
+			glFramebufferTexture2DEXT = (PFNGLFRAMEBUFFERTEXTURE2DEXTPROC)
+			        SDL_GL_GetProcAddress("glFramebufferTexture2DEXT");
+			glCheckFramebufferStatusEXT = (PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC)
+			        SDL_GL_GetProcAddress("glCheckFramebufferStatusEXT");
 			sdl.opengl.use_shader =
 			        (glAttachShader && glCompileShader &&
 			         glCreateProgram && glDeleteProgram &&
@@ -3275,14 +4856,72 @@ static void set_output(Section *sec, bool should_stretch_pixels)
 			                              glBufferDataARB &&
 			                              glMapBufferARB &&
 			                              glUnmapBufferARB;
+			glBufferStorage = (PFNGLBUFFERSTORAGEPROC_NP)
+			        SDL_GL_GetProcAddress("glBufferStorage");
+			glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC_NP)
+			        SDL_GL_GetProcAddress("glMapBufferRange");
+			glFenceSync = (PFNGLFENCESYNCPROC_NP)SDL_GL_GetProcAddress(
+			        "glFenceSync");
+			glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC_NP)
+			        SDL_GL_GetProcAddress("glClientWaitSync");
+			glDeleteSync = (PFNGLDELETESYNCPROC_NP)SDL_GL_GetProcAddress(
+			        "glDeleteSync");
+			glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC_NP)
+			        SDL_GL_GetProcAddress("glGetProgramBinary");
+			glProgramBinary = (PFNGLPROGRAMBINARYPROC_NP)
+			        SDL_GL_GetProcAddress("glProgramBinary");
+			glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC_NP)
+			        SDL_GL_GetProcAddress("glProgramParameteri");
 
 			const auto gl_version_string = safe_gl_get_string(GL_VERSION,
 			                                                  "0.0.0");
 			const int gl_version_major = gl_version_string[0] - '0';
 
+			const bool have_framebuffer_objects =
+			        glActiveTexture && glGenFramebuffersEXT &&
+			        glDeleteFramebuffersEXT && glBindFramebufferEXT &&
+			        glFramebufferTexture2DEXT &&
+			        glCheckFramebufferStatusEXT &&
+			        SDL_GL_ExtensionSupported("GL_EXT_framebuffer_object");
+			if (sdl.opengl.gpu_palette &&
+			    !(sdl.opengl.use_shader && have_framebuffer_objects)) {
+				LOG_WARNING("OPENGL: Expanding the palette on the GPU needs shader and framebuffer object support");
+				sdl.opengl.gpu_palette = false;
+			}
+
+			// The presenter thread uploads frames from memory it owns,
+			// and indexed frames are uploaded from memory too
 			sdl.opengl.pixel_buffer_object =
-			        have_arb_buffers &&
+			        !sdl.opengl.threaded_presentation &&
+			        !sdl.opengl.gpu_palette && have_arb_buffers &&
+			        SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object");
+			sdl.opengl.persistent_pbo =
+			        sdl.opengl.pixel_buffer_object && glBufferStorage &&
+			        glMapBufferRange && glFenceSync && glClientWaitSync &&
+			        glDeleteSync &&
+			        SDL_GL_ExtensionSupported("GL_ARB_buffer_storage") &&
+			        SDL_GL_ExtensionSupported("GL_ARB_map_buffer_range") &&
+			        SDL_GL_ExtensionSupported("GL_ARB_sync");
+
+			const bool have_sync = glFenceSync && glClientWaitSync &&
+			                       glDeleteSync &&
+			                       SDL_GL_ExtensionSupported("GL_ARB_sync");
+			sdl.opengl.readback.supported =
+			        have_arb_buffers && have_sync &&
 			        SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object");
+			if (sdl.opengl.frame_queue.limit && !have_sync) {
+				LOG_WARNING("OPENGL: Limiting the queued frames needs sync object support");
+				sdl.opengl.frame_queue.limit = 0;
+			}
+
+			// Drivers may support the extension but no binary formats
+			GLint num_binary_formats = 0;
+			if (sdl.opengl.use_shader && glGetProgramBinary &&
+			    glProgramBinary && glProgramParameteri &&
+			    SDL_GL_ExtensionSupported("GL_ARB_get_program_binary"))
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,
+				              &num_binary_formats);
+			sdl.opengl.program_binaries = num_binary_formats > 0;
 
 			sdl.opengl.npot_textures_supported =
 			        gl_version_major >= 2 ||
@@ -3308,10 +4947,13 @@ static void set_output(Section *sec, bool should_stretch_pixels)
 			                            "unknown"));
 
 			LOG_INFO("OPENGL: Pixel buffer object: %s",
-			         sdl.opengl.pixel_buffer_object ? "available"
-			                                        : "missing");
+			         sdl.opengl.persistent_pbo ? "available, persistently mapped"
+			         : sdl.opengl.pixel_buffer_object ? "available"
+			                                          : "missing");
 			LOG_INFO("OPENGL: NPOT textures: %s",
 			         npot_support_msg.c_str());
+			LOG_INFO("OPENGL: Shader program cache: %s",
+			         sdl.opengl.program_binaries ? "available" : "missing");
 		}
 	} /* OPENGL is requested end */
 #endif    // OPENGL
@@ -3379,7 +5021,10 @@ static void GUI_StartUp(Section *sec)
 	sdl.resizing_window = false;
 	sdl.wait_on_error = section->Get_bool("waitonerror");
 
-	sdl.desktop.fullscreen=section->Get_bool("fullscreen");
+	sdl.desktop.fullscreen = section->Get_bool("fullscreen") &&
+	                         !sdl.headless.enabled;
+	sdl.headless.fast_forward = section->Get_bool("headless_fast_forward");
+	sdl.frame.fast_forward_skip = section->Get_int("fast_forward_frameskip");
 
 	auto priority_conf = section->GetMultiVal("priority")->GetSection();
 	SetPriorityLevels(priority_conf->Get_string("active"),
@@ -3444,9 +5089,33 @@ static void GUI_StartUp(Section *sec)
 	                                              : VSYNC_STATE::OFF;
 	sdl.vsync.skip_us = section->Get_int("vsync_skip");
 
+	present_stats.enabled = section->Get_bool("presentation_stats");
+	present_stats.report_start_us = GetTicksUs();
+	present_stats.last_frame_us = present_stats.report_start_us;
+	present_stats.last_present_us = present_stats.report_start_us;
+
+#if C_OPENGL
+	sdl.opengl.threaded_presentation = section->Get_bool("threaded_presentation");
+#	if defined(MACOSX)
+	// macOS only lets the main thread present to a window
+	if (sdl.opengl.threaded_presentation) {
+		LOG_WARNING("SDL: Threaded presentation isn't supported on macOS");
+		sdl.opengl.threaded_presentation = false;
+	}
+#	endif
+	sdl.opengl.frame_queue.limit = section->Get_int("max_queued_frames");
+	sdl.opengl.gpu_palette = section->Get_bool("gpu_palette");
+	// The presenter thread uploads 32-bit frames only
+	if (sdl.opengl.gpu_palette && sdl.opengl.threaded_presentation) {
+		LOG_WARNING("SDL: gpu_palette doesn't apply with threaded_presentation");
+		sdl.opengl.gpu_palette = false;
+	}
+#endif
+
 
 	const int display = section->Get_int("display");
-	if ((display >= 0) && (display < SDL_GetNumVideoDisplays())) {
+	if (sdl.headless.enabled ||
+	    ((display >= 0) && (display < SDL_GetNumVideoDisplays()))) {
 		sdl.display_number = display;
 	} else {
 		LOG_WARNING("SDL: Display number out of bounds, using display 0");
@@ -3461,6 +5130,8 @@ static void GUI_StartUp(Section *sec)
 		sdl.frame.desired_mode = FRAME_MODE::CFR;
 	else if (presentation_mode_pref == "vfr")
 		sdl.frame.desired_mode = FRAME_MODE::VFR;
+	else if (presentation_mode_pref == "vrr")
+		sdl.frame.desired_mode = FRAME_MODE::VRR;
 	else {
 		sdl.frame.desired_mode = FRAME_MODE::UNSET;
 		LOG_WARNING("SDL: Invalid 'presentation_mode' value: '%s'",
@@ -3468,14 +5139,16 @@ static void GUI_StartUp(Section *sec)
 	}
 
 	sdl.desktop.full.display_res = sdl.desktop.full.fixed && (!sdl.desktop.full.width || !sdl.desktop.full.height);
-	if (sdl.desktop.full.display_res) {
+	if (sdl.desktop.full.display_res && !sdl.headless.enabled) {
 		GFX_ObtainDisplayDimensions();
 	}
 
 	set_output(section, should_stretch_pixels);
 
-	SDL_SetWindowTitle(sdl.window, "DOSBox Staging");
-	SetIcon();
+	if (!sdl.headless.enabled) {
+		SDL_SetWindowTitle(sdl.window, "DOSBox Staging");
+		SetIcon();
+	}
 
 	// Apply the user's mouse settings
 	Section_prop* s = section->GetMultiVal("capture_mouse")->GetSection();
@@ -3555,12 +5228,36 @@ static void GUI_StartUp(Section *sec)
 
 static void HandleMouseMotion(SDL_MouseMotionEvent *motion)
 {
+	// High polling rate mice queue several motion events between two
+	// ticks; pass the consecutive ones as a single movement, as the guest
+	// only samples the mouse at its own rate anyway. Events of other types
+	// end the batch, so the movement and the clicks stay in order.
+	auto x_rel = motion->xrel;
+	auto y_rel = motion->yrel;
+	auto x_abs = motion->x;
+	auto y_abs = motion->y;
+	auto peek_next_motion = [&](SDL_Event &next) {
+		return SDL_PeepEvents(&next, 1, SDL_PEEKEVENT, SDL_FIRSTEVENT,
+		                      SDL_LASTEVENT) == 1 &&
+		       next.type == SDL_MOUSEMOTION &&
+		       next.motion.windowID == motion->windowID;
+	};
+	SDL_Event next;
+	while (peek_next_motion(next)) {
+		SDL_PeepEvents(&next, 1, SDL_GETEVENT, SDL_MOUSEMOTION,
+		               SDL_MOUSEMOTION);
+		x_rel += next.motion.xrel;
+		y_rel += next.motion.yrel;
+		x_abs = next.motion.x;
+		y_abs = next.motion.y;
+	}
+
 	if (mouse_seamless_driver || mouse_is_captured ||
 	    sdl.mouse.control_choice == Seamless)
-		MOUSE_EventMoved(static_cast<float>(motion->xrel) * sdl.mouse.xsensitivity,
-		                 static_cast<float>(motion->yrel) * sdl.mouse.ysensitivity,
-		                 std::clamp(motion->x, 0, static_cast<int>(UINT16_MAX)),
-		                 std::clamp(motion->y, 0, static_cast<int>(UINT16_MAX)));
+		MOUSE_EventMoved(static_cast<float>(x_rel) * sdl.mouse.xsensitivity,
+		                 static_cast<float>(y_rel) * sdl.mouse.ysensitivity,
+		                 std::clamp(x_abs, 0, static_cast<int>(UINT16_MAX)),
+		                 std::clamp(y_abs, 0, static_cast<int>(UINT16_MAX)));
 }
 
 static void HandleMouseWheel(SDL_MouseWheelEvent *wheel)
@@ -3627,12 +5324,23 @@ bool GFX_IsFullscreen() {
 	return sdl.desktop.fullscreen;
 }
 
+bool GFX_WantsFastForward()
+{
+	return sdl.headless.enabled && sdl.headless.fast_forward;
+}
+
 void GFX_RegenerateWindow(Section *sec) {
 	if (first_window) {
 		first_window = false;
 		return;
 	}
 	const auto section = static_cast<const Section_prop *>(sec);
+	const auto wants_headless = !strcmp(section->Get_string("output"),
+	                                    "headless");
+	if (wants_headless != sdl.headless.enabled) {
+		LOG_WARNING("SDL: The headless output can only be changed at start");
+		return;
+	}
 	if (strcmp(section->Get_string("output"), "surface"))
 		remove_window();
 	set_output(sec, wants_stretched_pixels());
@@ -3660,6 +5368,7 @@ static void HandleVideoResize(int width, int height)
 
 #if C_OPENGL
 	if (sdl.desktop.window.resizable && sdl.desktop.type == SCREEN_OPENGL) {
+		stop_gl_presenter();
 		const auto canvas = get_canvas_size(sdl.desktop.type);
 		sdl.clip          = calc_viewport(canvas.w, canvas.h);
 		glViewport(sdl.clip.x, sdl.clip.y, sdl.clip.w, sdl.clip.h);
@@ -3769,6 +5478,10 @@ bool GFX_Events()
 			continue;
 		}
 #endif
+		if (event.type == SDL_KEYDOWN && !event.key.repeat &&
+		    collecting_present_stats())
+			note_key_pressed(event.key.timestamp);
+
 		switch (event.type) {
 		case SDL_WINDOWEVENT:
 			switch (event.window.event) {
@@ -3891,6 +5604,7 @@ bool GFX_Events()
 				}
 #	if C_OPENGL
 				if (sdl.desktop.type == SCREEN_OPENGL) {
+					stop_gl_presenter();
 					glViewport(sdl.clip.x,
 					           sdl.clip.y,
 					           sdl.clip.w,
@@ -4045,6 +5759,21 @@ bool GFX_Events()
 	return !shutdown_requested;
 }
 
+void GFX_WaitForEvents(const int timeout_ms)
+{
+	// Without a window there's no input to wait for, and the polling
+	// skipped on macOS would leave the events queued and never sleep
+#if defined(MACOSX)
+	constexpr bool can_wait = false;
+#else
+	const bool can_wait = !sdl.headless.enabled;
+#endif
+	if (can_wait)
+		SDL_WaitEventTimeout(nullptr, timeout_ms);
+	else
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+}
+
 #if defined (WIN32)
 static BOOL WINAPI ConsoleEventHandler(DWORD event) {
 	switch (event) {
@@ -4178,14 +5907,51 @@ void Config_Add_SDL() {
 	               "frame. 0 disables this and will always render.");
 	pint->SetMinMax(0, 14000);
 
-	const char *presentation_modes[] = {"auto", "cfr", "vfr", 0};
+	pbool = sdl_sec->Add_bool("presentation_stats", on_start, false);
+	pbool->Set_help(
+	        "Log frame pacing statistics every five seconds (disabled by default):\n"
+	        "the host time between emulated frames and between presents, frames\n"
+	        "dropped, duplicated or skipped by vsync_skip, and the time spent\n"
+	        "uploading frames. Helps choosing the presentation_mode for a display.\n"
+	        "Key presses are timed from the host event to the next present.");
+
+#if C_OPENGL
+	pbool = sdl_sec->Add_bool("threaded_presentation", on_start, false);
+	pbool->Set_help(
+	        "Present frames from a thread of their own when using an OpenGL output, so\n"
+	        "waiting for vsync doesn't stall the emulation (disabled by default).\n"
+	        "Frames are then shown as soon as they're completed and the\n"
+	        "presentation_mode setting doesn't apply. Not supported on macOS.");
+
+	pint = sdl_sec->Add_int("max_queued_frames", on_start, 0);
+	pint->Set_help(
+	        "Maximum number of frames the OpenGL driver may queue up for presentation\n"
+	        "(0 by default, leaving it to the driver). Every queued frame adds a refresh\n"
+	        "of input latency; 1 gives the lowest latency, at the cost of throughput.");
+	pint->SetMinMax(0, 3);
+
+	pbool = sdl_sec->Add_bool("gpu_palette", on_start, false);
+	pbool->Set_help(
+	        "Upload 256-colour frames as is and look up their colours on the GPU when\n"
+	        "using an OpenGL output (disabled by default). This uploads a quarter of\n"
+	        "the data, and palette changes don't need the frame converted again.\n"
+	        "CGA composite modes are then also decoded on the GPU, unless a scaler\n"
+	        "other than 'none' or 'normal' is used.\n"
+	        "Doesn't apply with threaded_presentation.");
+#endif
+
+	const char *presentation_modes[] = {"auto", "cfr", "vfr", "vrr", 0};
 	pstring = sdl_sec->Add_string("presentation_mode", always, "auto");
 	pstring->Set_help(
 	        "Optionally select the frame presentation mode:\n"
 	        "  auto:  Intelligently time and drop frames to prevent\n"
 	        "         emulation stalls, based on host and DOS frame rates.\n"
 	        "  cfr:   Always present DOS frames at a constant frame rate.\n"
-	        "  vfr:   Always present changed DOS frames at a variable frame rate.");
+	        "  vfr:   Always present changed DOS frames at a variable frame rate.\n"
+	        "  vrr:   Present every DOS frame as soon as it's completed, for variable\n"
+	        "         refresh rate (G-Sync, FreeSync) displays. Needs fullscreen on\n"
+	        "         a display of at least 75 Hz, or host_rate = vrr, and a DOS rate\n"
+	        "         below the host's; falls back to auto otherwise.");
 	pstring->Set_values(presentation_modes);
 
 	const char *outputs[] =
@@ -4198,6 +5964,7 @@ void Config_Add_SDL() {
 	  "openglnb",
 	  "openglpp",
 #endif
+	  "headless",
 	  0 };
 
 #if C_OPENGL
@@ -4205,9 +5972,25 @@ void Config_Add_SDL() {
 #else
 	Pstring = sdl_sec->Add_string("output", always, "texture");
 #endif
-	Pstring->Set_help("What video system to use for output.");
+	Pstring->Set_help(
+	        "What video system to use for output.\n"
+	        "headless draws frames into memory only, without a window or the\n"
+	        "video subsystem; images and video can still be captured. It can\n"
+	        "only be selected at start. Use [render] frameskip to draw fewer\n"
+	        "frames.");
 	Pstring->Set_values(outputs);
 
+	pbool = sdl_sec->Add_bool("headless_fast_forward", on_start, false);
+	pbool->Set_help(
+	        "Run the emulation as fast as possible with output=headless, as when\n"
+	        "holding the fast-forward hotkey (disabled by default).");
+
+	pint = sdl_sec->Add_int("fast_forward_frameskip", on_start, 9);
+	pint->SetMinMax(0, 100);
+	pint->Set_help(
+	        "Number of frames to skip presenting between each presented frame\n"
+	        "while fast-forwarding (9 by default). Captures still get every frame.");
+
 	pstring = sdl_sec->Add_string("texture_renderer", always, "auto");
 	pstring->Set_help("Choose a renderer driver when using a texture output mode.\n"
 	                  "Use texture_renderer=auto for an automatic choice.");
@@ -4547,6 +6330,9 @@ int sdl_main(int argc, char *argv[])
 	LOG_MSG("LOG: Loguru version %d.%d.%d initialized", LOGURU_VERSION_MAJOR,
 	        LOGURU_VERSION_MINOR, LOGURU_VERSION_PATCH);
 
+	STARTUP_EnableTrace(control->cmdline->FindExist("--trace-startup") ||
+	                    control->cmdline->FindExist("-trace-startup"));
+
 	int rcode = 0; // assume good until proven otherwise
 	try {
 		Disable_OS_Scaling(); //Do this early on, maybe override it through some parameter.
@@ -4555,8 +6341,11 @@ int sdl_main(int argc, char *argv[])
 		CROSS_DetermineConfigPaths();
 
 		/* Init the configuration system and add default values */
-		Config_Add_SDL();
-		DOSBOX_Init();
+		{
+			const StartupStage stage("config defaults");
+			Config_Add_SDL();
+			DOSBOX_Init();
+		}
 
 		if (control->cmdline->FindExist("--editconf") ||
 		    control->cmdline->FindExist("-editconf")) {
@@ -4610,9 +6399,9 @@ int sdl_main(int argc, char *argv[])
 	SetConsoleCtrlHandler((PHANDLER_ROUTINE) ConsoleEventHandler,TRUE);
 #endif
 
-	check_kmsdrm_setting();
-
-	if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0)
+	// The video subsystem is initialized once the configuration tells
+	// whether the output is headless
+	if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_EVENTS) < 0)
 		E_Exit("Can't init SDL %s", SDL_GetError());
 	if (SDL_CDROMInit() < 0)
 		LOG_WARNING("Failed to init CD-ROM support");
@@ -4621,12 +6410,11 @@ int sdl_main(int argc, char *argv[])
 	// Once initialized, ensure we clean up SDL for all exit conditions
 	atexit(QuitSDL);
 
-	LOG_MSG("SDL: version %d.%d.%d initialized (%s video and %s audio)",
-		SDL_MAJOR_VERSION, SDL_MINOR_VERSION, SDL_PATCHLEVEL,
-		SDL_GetCurrentVideoDriver(), SDL_GetCurrentAudioDriver());
-
 	const auto config_path = CROSS_GetPlatformConfigDir();
-	SETUP_ParseConfigFiles(config_path);
+	{
+		const StartupStage stage("config files");
+		SETUP_ParseConfigFiles(config_path);
+	}
 
 	MSG_Add("PROGRAM_CONFIG_PROPERTY_ERROR", "No such section or property: %s\n");
 	MSG_Add("PROGRAM_CONFIG_NO_PROPERTY",
@@ -4662,6 +6450,25 @@ int sdl_main(int argc, char *argv[])
 		}
 	}
 
+	// The benchmark mode's settings take precedence over the user's
+	if (TIMEDEMO_ParseCommandLine(*control->cmdline))
+		TIMEDEMO_ApplySettings();
+
+	const auto sdl_output = static_cast<Section_prop *>(
+	        control->GetSection("sdl"))->Get_string("output");
+	sdl.headless.enabled = !strcmp(sdl_output, "headless");
+	if (!sdl.headless.enabled) {
+		const StartupStage stage("SDL video");
+		check_kmsdrm_setting();
+		if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
+			E_Exit("Can't init SDL video %s", SDL_GetError());
+	}
+
+	LOG_MSG("SDL: version %d.%d.%d initialized (%s video and %s audio)",
+		SDL_MAJOR_VERSION, SDL_MINOR_VERSION, SDL_PATCHLEVEL,
+		sdl.headless.enabled ? "headless" : SDL_GetCurrentVideoDriver(),
+		SDL_GetCurrentAudioDriver());
+
 #if C_OPENGL
 	const std::string glshaders_dir = config_path + "glshaders";
 	if (create_dir(glshaders_dir.c_str(), 0700, OK_IF_EXISTS) != 0)
@@ -4699,10 +6506,22 @@ int sdl_main(int argc, char *argv[])
 		// All subsystems' hotkeys need to be registered at this point
 		// to ensure their hotkeys appear in the graphical mapper.
 		MAPPER_BindKeys(sdl_sec);
-		if (control->cmdline->FindExist("-startmapper"))
+		if (STARTUP_IsTracing())
+			LOG_MSG("STARTUP: Ready to run after %d ms",
+			        static_cast<int>(GetTicks()));
+		MEMREPORT_Log("At startup");
+
+		if (control->cmdline->FindExist("-startmapper") &&
+		    !sdl.headless.enabled)
 			MAPPER_DisplayUI();
 
-		control->StartUp(); // Run the machine until shutdown
+		if (control->cmdline->FindExist("--benchmark-render") ||
+		    control->cmdline->FindExist("-benchmark-render"))
+			RENDER_Benchmark();
+		else
+			control->StartUp(); // Run the machine until shutdown
+		TIMEDEMO_Finish();
+		MEMREPORT_Log("At shutdown");
 		control.reset();  // Shutdown and release
 
 	} catch (char *error) {
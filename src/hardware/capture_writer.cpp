@@ -0,0 +1,206 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "capture_writer.h"
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "hardware.h"
+#include "rwqueue.h"
+#include "support.h"
+
+// Data is handed to the writer thread in blocks of this size, of which up
+// to the maximum can wait to be written, about a minute of CD audio, before
+// the callers wait for the writer to catch up
+constexpr size_t block_bytes       = 256 * 1024;
+constexpr size_t max_queued_blocks = 64;
+
+using job_t = std::function<void()>;
+
+static struct {
+	RWQueue<job_t> jobs{max_queued_blocks};
+	std::thread thread = {};
+	std::mutex mutex   = {}; // guards starting and stopping the thread
+	int num_open_files = 0;
+	std::atomic<CaptureFsync> fsync = {CaptureFsync::Off};
+} writer;
+
+static void run_writer()
+{
+	while (true) {
+		auto job = writer.jobs.Dequeue();
+		if (!job)
+			break;
+		job();
+	}
+}
+
+static void sync_file(FILE *file)
+{
+	fflush(file);
+#if defined(WIN32)
+	const auto result = _commit(_fileno(file));
+#else
+	const auto result = fsync(fileno(file));
+#endif
+	if (result != 0)
+		LOG_WARNING("CAPTURE: Failed syncing a capture file: %s",
+		            safe_strerror(errno).c_str());
+}
+
+static void write_block(FILE *file, const long offset,
+                        const std::vector<uint8_t> &data,
+                        const CaptureFsync fsync)
+{
+	if (fseek(file, offset, SEEK_SET) != 0 ||
+	    fwrite(data.data(), 1, data.size(), file) != data.size()) {
+		LOG_WARNING("CAPTURE: Failed writing a capture file: %s",
+		            safe_strerror(errno).c_str());
+		return;
+	}
+	if (fsync == CaptureFsync::PerBlock)
+		sync_file(file);
+}
+
+void CaptureWriter::SetFsync(const CaptureFsync fsync)
+{
+	writer.fsync = fsync;
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	Close();
+}
+
+bool CaptureWriter::Open(const char *type, const char *ext)
+{
+	assert(!IsOpen());
+
+	file = OpenCaptureFile(type, ext);
+	if (!file)
+		return false;
+
+	// The blocks are large enough to be written as they are
+	setvbuf(file, nullptr, _IONBF, 0);
+
+	block.reserve(block_bytes);
+	size = 0;
+
+	const std::lock_guard<std::mutex> lock(writer.mutex);
+	if (writer.num_open_files++ == 0)
+		writer.thread = std::thread(run_writer);
+	return true;
+}
+
+bool CaptureWriter::IsOpen() const
+{
+	return file != nullptr;
+}
+
+size_t CaptureWriter::GetSize() const
+{
+	return size;
+}
+
+// Hands the collected block to the writer thread, to be written at the
+// offset, and starts a new block
+void CaptureWriter::QueueBlock(const long offset)
+{
+	std::vector<uint8_t> data = {};
+	data.swap(block);
+	block.reserve(block_bytes);
+
+	const auto fsync = writer.fsync.load();
+	writer.jobs.Enqueue([f = file, offset, data = std::move(data), fsync] {
+		write_block(f, offset, data, fsync);
+	});
+}
+
+void CaptureWriter::Write(const void *data, const size_t num_bytes)
+{
+	assert(IsOpen());
+
+	const auto bytes = static_cast<const uint8_t *>(data);
+	block.insert(block.end(), bytes, bytes + num_bytes);
+	size += num_bytes;
+
+	if (block.size() >= block_bytes)
+		QueueBlock(static_cast<long>(size - block.size()));
+}
+
+void CaptureWriter::WriteAt(const size_t offset, const void *data,
+                            const size_t num_bytes)
+{
+	assert(IsOpen());
+	assert(offset + num_bytes <= size);
+
+	// Keep the writes in order
+	if (!block.empty())
+		QueueBlock(static_cast<long>(size - block.size()));
+
+	const auto bytes = static_cast<const uint8_t *>(data);
+	block.assign(bytes, bytes + num_bytes);
+	QueueBlock(static_cast<long>(offset));
+}
+
+void CaptureWriter::Close()
+{
+	if (!IsOpen())
+		return;
+
+	if (!block.empty())
+		QueueBlock(static_cast<long>(size - block.size()));
+
+	// Wait for the file's writes, then close it
+	auto closed = std::make_shared<std::promise<void>>();
+	const auto fsync = writer.fsync.load();
+	writer.jobs.Enqueue([f = file, closed, fsync] {
+		if (fsync == CaptureFsync::OnClose)
+			sync_file(f);
+		fclose(f);
+		closed->set_value();
+	});
+	closed->get_future().wait();
+
+	file = nullptr;
+	block.clear();
+	block.shrink_to_fit();
+	size = 0;
+
+	const std::lock_guard<std::mutex> lock(writer.mutex);
+	if (--writer.num_open_files == 0) {
+		writer.jobs.Enqueue(job_t{}); // stops the thread
+		writer.thread.join();
+	}
+}
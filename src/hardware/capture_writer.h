@@ -0,0 +1,81 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_CAPTURE_WRITER_H
+#define DOSBOX_CAPTURE_WRITER_H
+
+#include "dosbox.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*  Capture Writer
+ *  --------------
+ *  Writes a capture file from a background thread, so slow storage, such
+ *  as a network share, doesn't hold up the audio and MIDI callers.
+ *
+ *  The data is collected into large blocks, which are handed to a writer
+ *  thread shared by all of the open files and written without any further
+ *  buffering by the C library. Header fields patched in when the capture
+ *  stops are written in order after the data before them.
+ *
+ *  Use
+ *  ---
+ *  1. Call Open() with the capture's type and file extension.
+ *  2. Append the data with Write(); GetSize() returns the bytes so far.
+ *  3. Overwrite earlier bytes, such as a header's sizes, with WriteAt().
+ *  4. Call Close() to wait for the writes and close the file.
+ */
+
+enum class CaptureFsync {
+	Off,      // leave the flushing to the operating system
+	OnClose,  // sync the file once it's complete
+	PerBlock, // sync after every block, losing little if the host fails
+};
+
+class CaptureWriter {
+public:
+	static void SetFsync(const CaptureFsync fsync);
+
+	CaptureWriter() = default;
+	~CaptureWriter();
+
+	bool Open(const char *type, const char *ext);
+	bool IsOpen() const;
+
+	void Write(const void *data, const size_t num_bytes);
+	void WriteAt(const size_t offset, const void *data, const size_t num_bytes);
+	size_t GetSize() const;
+
+	void Close();
+
+private:
+	CaptureWriter(const CaptureWriter &)            = delete;
+	CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+	void QueueBlock(const long offset);
+
+	FILE *file                 = nullptr;
+	std::vector<uint8_t> block = {}; // collecting the data to append
+	size_t size                = 0;  // including the collected data
+};
+
+#endif
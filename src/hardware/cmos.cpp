@@ -26,8 +26,10 @@
 #include "inout.h"
 #include "mem.h"
 #include "pic.h"
+#include "replay.h"
 #include "setup.h"
 #include "timer.h"
+#include "tracy.h"
 
 static struct {
 	uint8_t regs[0x40];
@@ -39,6 +41,9 @@ static struct {
 		uint8_t div;
 		double delay;
 		bool acknowledged;
+		bool scheduled;
+		double flags_read;
+		uint64_t interrupts;
 	} timer;
 	struct {
 		double timer;
@@ -48,32 +53,52 @@ static struct {
 	bool update_ended;
 } cmos;
 
+// The periodic interrupt is only raised again once register C has been read,
+// so an event is only scheduled for the end of the period after that read.
+// Periods that end while the interrupt is pending need no event: their flags
+// in register C are worked out from the time when it's read.
 static void cmos_timerevent(uint32_t /*val*/)
 {
+	cmos.timer.scheduled = false;
 	if (cmos.timer.acknowledged) {
 		cmos.timer.acknowledged = false;
 		PIC_ActivateIRQ(8);
-	}
-	if (cmos.timer.enabled) {
-		PIC_AddEvent(cmos_timerevent,cmos.timer.delay);
 		cmos.regs[0xc] = 0xC0;//Contraption Zack (music)
+		TracyPlot("RTC periodic interrupts", static_cast<int64_t>(++cmos.timer.interrupts));
 	}
 }
 
+static void cmos_schedule_timer()
+{
+	if (cmos.timer.scheduled || !cmos.timer.enabled || !cmos.timer.acknowledged)
+		return;
+	/* A rtc is always running */
+	const auto remd = fmod(PIC_FullIndex(), cmos.timer.delay);
+	// Should be more like a real pc. Check
+	PIC_AddEvent(cmos_timerevent, cmos.timer.delay - remd);
+	cmos.timer.scheduled = true;
+}
+
 static void cmos_checktimer(void) {
 	PIC_RemoveEvents(cmos_timerevent);
+	cmos.timer.scheduled = false;
 	if (cmos.timer.div<=2) cmos.timer.div+=7;
 	cmos.timer.delay = (1000.0 / (32768.0 / (1 << (cmos.timer.div - 1))));
+	// Periods only count from here on
+	cmos.timer.flags_read = PIC_FullIndex();
 	if (!cmos.timer.div || !cmos.timer.enabled) return;
 	LOG(LOG_PIT, LOG_NORMAL)("RTC Timer at %.2f hz", 1000.0 / static_cast<double>(cmos.timer.delay));
-	//	PIC_AddEvent(cmos_timerevent,cmos.timer.delay);
-	/* A rtc is always running */
-	const auto remd = fmod(PIC_FullIndex(), cmos.timer.delay);
-	// Should be more like a real pc. Check
-	PIC_AddEvent(cmos_timerevent, cmos.timer.delay - remd);
+	cmos_schedule_timer();
 	// Status reg A reading with this (and with other delays actually)
 }
 
+// Whether a period ended since the flags were last read
+static bool cmos_period_ended(const double index)
+{
+	const auto delay = cmos.timer.delay;
+	return floor(index / delay) > floor(cmos.timer.flags_read / delay);
+}
+
 void cmos_selreg(io_port_t, io_val_t value, io_width_t)
 {
 	const auto val = check_cast<uint8_t>(value);
@@ -137,7 +162,7 @@ static uint8_t cmos_readreg(io_port_t, io_width_t)
 	Bitu drive_a, drive_b;
 	uint8_t hdparm;
 
-	const time_t curtime = time(nullptr);
+	const time_t curtime = REPLAY_Time();
 	struct tm datetime;
 	cross::localtime_r(&curtime, &datetime);
 
@@ -172,8 +197,13 @@ static uint8_t cmos_readreg(io_port_t, io_width_t)
 		cmos.timer.acknowledged=true;
 		if (cmos.timer.enabled) {
 			/* In periodic interrupt mode only care for those flags */
+			const auto index = PIC_FullIndex();
 			uint8_t val=cmos.regs[0xc];
+			if (cmos_period_ended(index))
+				val = 0xC0;
 			cmos.regs[0xc]=0;
+			cmos.timer.flags_read = index;
+			cmos_schedule_timer();
 			return val;
 		} else {
 			/* Give correct values at certain times */
@@ -24,7 +24,16 @@
 #include <array>
 #include <cassert>
 #include <cmath>
- 
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COMPRESSOR_SIMD 1
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define COMPRESSOR_SIMD 1
+#endif
+
 #include "checks.h"
 #include "mixer.h"
 
@@ -73,39 +82,222 @@ void Compressor::Reset()
 	max_over_db     = 0.0f;
 }
 
+// Fast log2 and exp2 approximations
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The level detection and gain computation take a log and an exp of every
+// frame. Both are split into the float's exponent and a short series for
+// the mantissa, accurate to about 2e-5, which is far below what the
+// compressor's smoothing lets through. The vector versions compute the very
+// same series four lanes at a time.
+
+constexpr auto ln_2 = 0.6931471805599453f;
+
+// log2(m) for m in [1, 2) with t = (m - 1) / (m + 1), from the series of
+// atanh(t) = ln(m) / 2
+constexpr auto log_c1 = 2.0f / ln_2;
+constexpr auto log_c3 = log_c1 / 3.0f;
+constexpr auto log_c5 = log_c1 / 5.0f;
+constexpr auto log_c7 = log_c1 / 7.0f;
+
+// 2^f for f in [-0.5, 0.5] from the Taylor series of exp(f * ln(2))
+constexpr auto exp_c1 = ln_2;
+constexpr auto exp_c2 = exp_c1 * ln_2 / 2.0f;
+constexpr auto exp_c3 = exp_c2 * ln_2 / 3.0f;
+constexpr auto exp_c4 = exp_c3 * ln_2 / 4.0f;
+constexpr auto exp_c5 = exp_c4 * ln_2 / 5.0f;
+
+// Keeps the exponent of the result in the range of normal floats
+constexpr auto exp_min = -126.0f;
+constexpr auto exp_max = 127.0f;
+
+static inline float fast_log2(const float x)
+{
+	int32_t bits = 0;
+	std::memcpy(&bits, &x, sizeof(bits));
+	const auto exponent = static_cast<float>(((bits >> 23) & 0xff) - 127);
+	bits = (bits & 0x007fffff) | 0x3f800000;
+	float m = 0.0f;
+	std::memcpy(&m, &bits, sizeof(m));
+
+	const auto t  = (m - 1.0f) / (m + 1.0f);
+	const auto t2 = t * t;
+	return exponent + t * (log_c1 + t2 * (log_c3 + t2 * (log_c5 + t2 * log_c7)));
+}
+
+static inline float fast_exp2(float x)
+{
+	x = std::clamp(x, exp_min, exp_max);
+	const auto n = static_cast<int32_t>(std::lrint(x));
+	const auto f = x - static_cast<float>(n);
+	const auto p = 1.0f +
+	               f * (exp_c1 + f * (exp_c2 + f * (exp_c3 + f * (exp_c4 + f * exp_c5))));
+	const int32_t bits = (n + 127) << 23;
+	float scale = 0.0f;
+	std::memcpy(&scale, &bits, sizeof(scale));
+	return p * scale;
+}
+
+#if defined(COMPRESSOR_SIMD)
+#if defined(__SSE2__) || defined(_M_X64)
+using vec4 = __m128;
+static inline vec4 vec4_load(const float *p) { return _mm_loadu_ps(p); }
+static inline void vec4_store(float *p, const vec4 v) { _mm_storeu_ps(p, v); }
+static inline vec4 vec4_set(const float x) { return _mm_set1_ps(x); }
+static inline vec4 vec4_add(const vec4 a, const vec4 b) { return _mm_add_ps(a, b); }
+static inline vec4 vec4_sub(const vec4 a, const vec4 b) { return _mm_sub_ps(a, b); }
+static inline vec4 vec4_mul(const vec4 a, const vec4 b) { return _mm_mul_ps(a, b); }
+static inline vec4 vec4_div(const vec4 a, const vec4 b) { return _mm_div_ps(a, b); }
+static inline vec4 vec4_clamp(const vec4 v, const float lo, const float hi) { return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(lo)), _mm_set1_ps(hi)); }
+// Splits the float into its unbiased exponent and its mantissa in [1, 2)
+static inline vec4 vec4_frexp(const vec4 v, vec4 &mantissa)
+{
+	const auto bits = _mm_castps_si128(v);
+	const auto exponent = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0xff)), _mm_set1_epi32(127));
+	mantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+	return _mm_cvtepi32_ps(exponent);
+}
+// Rounds to the nearest integer n and returns 2^n, leaving the rest in frac
+static inline vec4 vec4_split_exp2(const vec4 v, vec4 &frac)
+{
+	const auto n = _mm_cvtps_epi32(v);
+	frac = _mm_sub_ps(v, _mm_cvtepi32_ps(n));
+	return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+}
+#else
+using vec4 = float32x4_t;
+static inline vec4 vec4_load(const float *p) { return vld1q_f32(p); }
+static inline void vec4_store(float *p, const vec4 v) { vst1q_f32(p, v); }
+static inline vec4 vec4_set(const float x) { return vdupq_n_f32(x); }
+static inline vec4 vec4_add(const vec4 a, const vec4 b) { return vaddq_f32(a, b); }
+static inline vec4 vec4_sub(const vec4 a, const vec4 b) { return vsubq_f32(a, b); }
+static inline vec4 vec4_mul(const vec4 a, const vec4 b) { return vmulq_f32(a, b); }
+static inline vec4 vec4_div(const vec4 a, const vec4 b) { return vdivq_f32(a, b); }
+static inline vec4 vec4_clamp(const vec4 v, const float lo, const float hi) { return vminq_f32(vmaxq_f32(v, vdupq_n_f32(lo)), vdupq_n_f32(hi)); }
+static inline vec4 vec4_frexp(const vec4 v, vec4 &mantissa)
+{
+	const auto bits = vreinterpretq_s32_f32(v);
+	const auto exponent = vsubq_s32(vandq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(0xff)), vdupq_n_s32(127));
+	mantissa = vreinterpretq_f32_s32(vorrq_s32(vandq_s32(bits, vdupq_n_s32(0x007fffff)), vdupq_n_s32(0x3f800000)));
+	return vcvtq_f32_s32(exponent);
+}
+static inline vec4 vec4_split_exp2(const vec4 v, vec4 &frac)
+{
+	const auto n = vcvtnq_s32_f32(v);
+	frac = vsubq_f32(v, vcvtq_f32_s32(n));
+	return vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(n, vdupq_n_s32(127)), 23));
+}
+#endif
+#endif
+
+// out[i] = scale * log2(in[i]) + offset
+static void log2_block(const float *in, float *out, const size_t n,
+                       const float scale, const float offset)
+{
+	size_t i = 0;
+#if defined(COMPRESSOR_SIMD)
+	const auto one = vec4_set(1.0f);
+	for (; i + 4 <= n; i += 4) {
+		vec4 m;
+		const auto exponent = vec4_frexp(vec4_load(in + i), m);
+		const auto t  = vec4_div(vec4_sub(m, one), vec4_add(m, one));
+		const auto t2 = vec4_mul(t, t);
+		auto p = vec4_add(vec4_set(log_c5), vec4_mul(t2, vec4_set(log_c7)));
+		p = vec4_add(vec4_set(log_c3), vec4_mul(t2, p));
+		p = vec4_add(vec4_set(log_c1), vec4_mul(t2, p));
+		const auto log2 = vec4_add(exponent, vec4_mul(t, p));
+		vec4_store(out + i, vec4_add(vec4_mul(log2, vec4_set(scale)), vec4_set(offset)));
+	}
+#endif
+	for (; i < n; ++i)
+		out[i] = scale * fast_log2(in[i]) + offset;
+}
+
+// out[i] = scale * exp2(in[i])
+static void exp2_block(const float *in, float *out, const size_t n, const float scale)
+{
+	size_t i = 0;
+#if defined(COMPRESSOR_SIMD)
+	for (; i + 4 <= n; i += 4) {
+		vec4 f;
+		const auto pow2 = vec4_split_exp2(vec4_clamp(vec4_load(in + i), exp_min, exp_max), f);
+		auto p = vec4_add(vec4_set(exp_c4), vec4_mul(f, vec4_set(exp_c5)));
+		p = vec4_add(vec4_set(exp_c3), vec4_mul(f, p));
+		p = vec4_add(vec4_set(exp_c2), vec4_mul(f, p));
+		p = vec4_add(vec4_set(exp_c1), vec4_mul(f, p));
+		p = vec4_add(vec4_set(1.0f), vec4_mul(f, p));
+		vec4_store(out + i, vec4_mul(vec4_mul(p, pow2), vec4_set(scale)));
+	}
+#endif
+	for (; i < n; ++i)
+		out[i] = scale * fast_exp2(in[i]);
+}
+
 AudioFrame Compressor::Process(const AudioFrame &in)
 {
-	const float left  = in.left  * scale_in;
-	const float right = in.right * scale_in;
+	float frame[2] = {in.left, in.right};
+	Process(frame, 1);
+	return {frame[0], frame[1]};
+}
 
-	const auto sum_squares = (left * left) + (right * right);
-	run_sum_squares = sum_squares + rms_coeff * (run_sum_squares - sum_squares);
-	const auto det = sqrtf(fmaxf(0.0f, run_sum_squares));
+// The frames are processed in chunks: the running RMS and the gain smoothing
+// depend on the previous frame, so they stay sequential, while the logs and
+// exps between them are taken for the whole chunk at once
+void Compressor::Process(float *frames, const int num_frames)
+{
+	constexpr auto chunk_size = 64;
+	std::array<float, chunk_size> levels;
 
-	over_db = 2.08136898f * logf(det / threshold_value) * log_to_db;
+	// 2.08136898 * 20 * log10(sqrt(x) / threshold), in terms of log2(x)
+	constexpr auto over_scale = 2.08136898f * log_to_db * ln_2 / 2.0f;
+	const auto over_offset = -2.08136898f * log_to_db * logf(threshold_value);
 
-	if (over_db > max_over_db)
-		max_over_db = over_db;
+	// exp(db * db_to_log) in terms of exp2
+	constexpr auto db_to_log2 = db_to_log / ln_2;
 
-	over_db = fmaxf(0.0f, over_db);
+	for (auto start = 0; start < num_frames; start += chunk_size) {
+		const auto n = static_cast<size_t>(std::min(chunk_size, num_frames - start));
+		auto chunk = frames + start * 2;
 
-	run_db = over_db + (run_db - over_db) * (over_db > run_db ? attack_coeff
-	                                                          : release_coeff);
+		for (size_t i = 0; i < n; ++i) {
+			const float left  = chunk[i * 2 + 0] * scale_in;
+			const float right = chunk[i * 2 + 1] * scale_in;
 
-	over_db = run_db;
+			const auto sum_squares = (left * left) + (right * right);
+			run_sum_squares = sum_squares + rms_coeff * (run_sum_squares - sum_squares);
+			levels[i] = fmaxf(0.0f, run_sum_squares);
+		}
 
-	constexpr auto ratio_threshold_db = 6.0f;
-	comp_ratio = 1.0f + ratio * fminf(over_db, ratio_threshold_db) /
-	                            ratio_threshold_db;
+		log2_block(levels.data(), levels.data(), n, over_scale, over_offset);
 
-	const auto gain_reduction_db = -over_db * (comp_ratio - 1.0f) / comp_ratio;
-	const auto gain_reduction_factor = expf(gain_reduction_db * db_to_log);
+		for (size_t i = 0; i < n; ++i) {
+			over_db = levels[i];
 
-	run_max_db  = max_over_db + release_coeff * (run_max_db - max_over_db);
-	max_over_db = run_max_db;
+			if (over_db > max_over_db)
+				max_over_db = over_db;
 
-	const auto gain_scalar = gain_reduction_factor * scale_out;
+			over_db = fmaxf(0.0f, over_db);
 
-	return {left * gain_scalar, right * gain_scalar};
-}
+			run_db = over_db + (run_db - over_db) * (over_db > run_db ? attack_coeff
+			                                                          : release_coeff);
+
+			over_db = run_db;
+
+			constexpr auto ratio_threshold_db = 6.0f;
+			comp_ratio = 1.0f + ratio * fminf(over_db, ratio_threshold_db) /
+			                            ratio_threshold_db;
 
+			const auto gain_reduction_db = -over_db * (comp_ratio - 1.0f) / comp_ratio;
+			levels[i] = gain_reduction_db * db_to_log2;
+
+			run_max_db  = max_over_db + release_coeff * (run_max_db - max_over_db);
+			max_over_db = run_max_db;
+		}
+
+		exp2_block(levels.data(), levels.data(), n, scale_out);
+
+		for (size_t i = 0; i < n; ++i) {
+			chunk[i * 2 + 0] *= scale_in * levels[i];
+			chunk[i * 2 + 1] *= scale_in * levels[i];
+		}
+	}
+}
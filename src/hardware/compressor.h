@@ -87,6 +87,9 @@ public:
 
 	AudioFrame Process(const AudioFrame &in);
 
+	// Compresses interleaved stereo frames in place
+	void Process(float *frames, int num_frames);
+
 	// prevent copying
 	Compressor(const Compressor &) = delete;
 	// prevent assignment
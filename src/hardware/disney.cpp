@@ -28,7 +28,7 @@ CHECK_NARROWING();
 Disney::Disney() : LptDac("DISNEY", use_mixer_rate)
 {
 	// Prime the FIFO with a single silent sample
-	fifo.emplace(data_reg);
+	fifo.Enqueue(data_reg);
 }
 
 void Disney::BindToPort(const io_port_t lpt_port)
@@ -78,16 +78,16 @@ void Disney::ConfigureFilters(const FilterState state)
 // is clocked from this FIFO at the fixed rate of 7 kHz +/- 5%.
 AudioFrame Disney::Render()
 {
-	assert(fifo.size());
-	const float sample = lut_u8to16[fifo.front()];
-	if (fifo.size() > 1)
-		fifo.pop();
+	assert(!fifo.IsEmpty());
+	const float sample = lut_u8to16[fifo.Front()];
+	if (fifo.Size() > 1)
+		fifo.Dequeue();
 	return {sample, sample};
 }
 
 bool Disney::IsFifoFull() const
 {
-	return fifo.size() >= max_fifo_size;
+	return fifo.IsFull();
 }
 
 void Disney::WriteData(const io_port_t, const io_val_t data, const io_width_t)
@@ -116,12 +116,12 @@ void Disney::WriteControl(const io_port_t, const io_val_t value, const io_width_
 
 	if (!control_reg.select && new_control.select)
 		if (!IsFifoFull())
-			fifo.emplace(data_reg);
+			fifo.Enqueue(data_reg);
 
 	control_reg.data = new_control.data;
 }
 
 Disney::~Disney()
 {
-	fifo = {};
+	fifo.Clear();
 }
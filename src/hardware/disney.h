@@ -21,7 +21,6 @@
 
 #include "dosbox.h"
 
-#include <queue>
 
 #include "inout.h"
 #include "lpt_dac.h"
@@ -49,7 +48,7 @@ private:
 	static constexpr uint8_t max_fifo_size = 16;
 
 	// Managed objects
-	std::queue<uint8_t> fifo = {};
+	RingBuffer<uint8_t, max_fifo_size> fifo = {};
 };
 
 #endif
@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <string.h>
 #include <memory>
+#include <vector>
 
 #include "dma.h"
 #include "mem.h"
@@ -28,6 +29,7 @@
 #include "pic.h"
 #include "paging.h"
 #include "setup.h"
+#include "tracy.h"
 
 DmaController *DmaControllers[2];
 
@@ -45,14 +47,15 @@ static void UpdateEMSMapping(void) {
 	}
 }
 
-// Generic function to read or write a block of data to or from memory.
-// Don't use this directly; call two helpers: DMA_BlockRead or DMA_BlockWrite
-static void perform_dma_io(const DMA_DIRECTION direction,
-                           const PhysPt spage,
-                           PhysPt mem_address,
-                           void *data_start,
-                           const size_t num_words,
-                           const uint8_t is_dma16)
+using DmaChunkFunction = std::function<void(PhysPt start, uint16_t bytes)>;
+
+// Walks the guest memory of a transfer, calling the function for each part
+// of it within a page
+static void for_each_dma_chunk(const PhysPt spage,
+                               PhysPt mem_address,
+                               const size_t num_words,
+                               const uint8_t is_dma16,
+                               const DmaChunkFunction &chunk_function)
 {
 	assert(is_dma16 == 0 || is_dma16 == 1);
 
@@ -61,9 +64,6 @@ static void perform_dma_io(const DMA_DIRECTION direction,
 	// Maybe move the mem_address into the 16-bit range
 	mem_address <<= is_dma16;
 
-	// The data pointer will be incremented per transfer
-	auto data_pt = reinterpret_cast<uint8_t *>(data_start);
-
 	// Convert from DMA 'words' to actual bytes, no greater than 64 KiB
 	auto remaining_bytes = check_cast<uint16_t>(num_words << is_dma16);
 	do {
@@ -84,22 +84,47 @@ static void perform_dma_io(const DMA_DIRECTION direction,
 		// Determine how many bytes to transfer within this page
 		const auto chunk_bytes = std::min(remaining_bytes, bytes_to_page_end);
 
-		// Copy the data from the page address into the data pointer
-		if (direction == DMA_DIRECTION::READ)
-			for (auto i = 0; i < chunk_bytes; ++i)
-				data_pt[i] = phys_readb(chunk_start + i);
-
-		// Copy the data from the data pointer into the page address
-		else if (direction == DMA_DIRECTION::WRITE)
-			for (auto i = 0; i < chunk_bytes; ++i)
-				phys_writeb(chunk_start + i, data_pt[i]);
+		chunk_function(chunk_start, chunk_bytes);
 
 		mem_address += chunk_bytes;
-		data_pt += chunk_bytes;
 		remaining_bytes -= chunk_bytes;
 	} while (remaining_bytes);
 }
 
+// Transfers outside of the RAM see an open bus
+static bool is_in_ram(const PhysPt start, const uint16_t bytes)
+{
+	return start + bytes <= MEM_TotalPages() * dos_pagesize;
+}
+
+// Generic function to read or write a block of data to or from memory.
+// Don't use this directly; call two helpers: DMA_BlockRead or DMA_BlockWrite
+static void perform_dma_io(const DMA_DIRECTION direction,
+                           const PhysPt spage,
+                           const PhysPt mem_address,
+                           void *data_start,
+                           const size_t num_words,
+                           const uint8_t is_dma16)
+{
+	// The data pointer will be incremented per transfer
+	auto data_pt = reinterpret_cast<uint8_t *>(data_start);
+
+	auto copy_chunk = [&](const PhysPt chunk_start, const uint16_t chunk_bytes) {
+		if (!is_in_ram(chunk_start, chunk_bytes)) {
+			if (direction == DMA_DIRECTION::READ)
+				memset(data_pt, 0xff, chunk_bytes);
+		} else if (direction == DMA_DIRECTION::READ) {
+			memcpy(data_pt, MemBase + chunk_start, chunk_bytes);
+		} else {
+			memcpy(MemBase + chunk_start, data_pt, chunk_bytes);
+			if (mem_tracking_dirty_pages || mem_watching_writes)
+				MEM_MarkDirty(chunk_start, chunk_bytes);
+		}
+		data_pt += chunk_bytes;
+	};
+	for_each_dma_chunk(spage, mem_address, num_words, is_dma16, copy_chunk);
+}
+
 DmaChannel * GetDMAChannel(uint8_t chan) {
 	if (chan<4) {
 		/* channel on first DMA controller */
@@ -329,19 +354,39 @@ DmaChannel::DmaChannel(uint8_t num, bool dma16)
 
 size_t DmaChannel::ReadOrWrite(DMA_DIRECTION direction, size_t words, uint8_t *buffer)
 {
+	return Transfer(words, [&](const uint32_t address, const uint16_t count) {
+		perform_dma_io(direction, pagebase, address, buffer, count, DMA16);
+		buffer += count << DMA16;
+	});
+}
+
+size_t DmaChannel::ReadSpans(size_t words, const DmaSpanConsumer &consumer)
+{
+	static const std::vector<uint8_t> open_bus(dos_pagesize, 0xff);
+	auto pass_chunk = [&](const PhysPt chunk_start, const uint16_t chunk_bytes) {
+		const auto in_ram = is_in_ram(chunk_start, chunk_bytes);
+		consumer(in_ram ? MemBase + chunk_start : open_bus.data(), chunk_bytes);
+	};
+	return Transfer(words, [&](const uint32_t address, const uint16_t count) {
+		for_each_dma_chunk(pagebase, address, count, DMA16, pass_chunk);
+	});
+}
+
+size_t DmaChannel::Transfer(size_t words, const DmaWordsFunction &words_function)
+{
+	ZoneScopedSubsystem("DMA transfer");
 	auto want = check_cast<uint16_t>(words);
 	uint16_t done = 0;
 	curraddr &= dma_wrapping;
 again:
 	Bitu left = (currcnt + 1);
 	if (want < left) {
-		perform_dma_io(direction, pagebase, curraddr, buffer, want, DMA16);
+		words_function(curraddr, want);
 		done += want;
 		curraddr += want;
 		currcnt -= want;
 	} else {
-		perform_dma_io(direction, pagebase, curraddr, buffer, left, DMA16);
-		buffer += left << DMA16;
+		words_function(curraddr, check_cast<uint16_t>(left));
 		want -= left;
 		done += left;
 		ReachedTC();
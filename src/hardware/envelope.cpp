@@ -31,8 +31,7 @@ void Envelope::Reactivate()
 {
 	edge        = 0.0f;
 	frames_done = 0;
-
-	process = &Envelope::Apply;
+	is_done     = false;
 }
 
 void Envelope::Update(const int frame_rate, const int peak_amplitude,
@@ -76,9 +75,17 @@ bool Envelope::ClampSample(float &sample, const float lip)
 	return false;
 }
 
-void Envelope::Process(const bool is_stereo, AudioFrame &frame)
+void Envelope::Process(const bool is_stereo, float *frames, const int num_frames)
 {
-	process(*this, is_stereo, frame);
+	for (auto i = 0; i < num_frames && !is_done; ++i) {
+		const auto sample = frames + i * 2;
+
+		AudioFrame frame = {sample[0], sample[1]};
+		Apply(is_stereo, frame);
+
+		sample[0] = frame.left;
+		sample[1] = is_stereo ? frame.right : frame.left;
+	}
 }
 
 void Envelope::Apply(const bool is_stereo, AudioFrame &frame)
@@ -98,7 +105,7 @@ void Envelope::Apply(const bool is_stereo, AudioFrame &frame)
 
 	// Should we deactivate the envelope?
 	if (++frames_done > expire_after_frames || edge >= edge_limit) {
-		process = &Envelope::Skip;
+		is_done = true;
 		(void)channel_name; // [[maybe_unused]] in release builds
 		DEBUG_LOG_MSG("ENVELOPE: %s done after %u frames, peak sample was %f",
 		              channel_name,
@@ -0,0 +1,294 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "ffmpeg_capture.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <vector>
+
+#if !defined(WIN32)
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "string_utils.h"
+#include "support.h"
+
+#if !defined(WIN32)
+extern char **environ;
+#endif
+
+struct EncoderPreset {
+	const char *name;
+	std::vector<std::string> input_args;  // placed before the inputs
+	std::vector<std::string> output_args; // placed before the output file
+};
+
+// The video arguments per encoder. The software encoders keep the quality
+// close to lossless; the hardware encoders trade some of it for speed and
+// a near-zero load on the CPU.
+static const std::vector<EncoderPreset> encoder_presets = {
+        {"h264", {}, {"-c:v", "libx264", "-preset", "veryfast", "-crf", "18", "-pix_fmt", "yuv420p"}},
+        {"hevc", {}, {"-c:v", "libx265", "-preset", "veryfast", "-crf", "20", "-pix_fmt", "yuv420p"}},
+        {"h264_nvenc", {}, {"-c:v", "h264_nvenc", "-preset", "p4", "-cq", "19", "-pix_fmt", "yuv420p"}},
+        {"hevc_nvenc", {}, {"-c:v", "hevc_nvenc", "-preset", "p4", "-cq", "21", "-pix_fmt", "yuv420p"}},
+        {"h264_vaapi",
+         {"-vaapi_device", "/dev/dri/renderD128"},
+         {"-vf", "format=nv12,hwupload", "-c:v", "h264_vaapi", "-qp", "19"}},
+        {"hevc_vaapi",
+         {"-vaapi_device", "/dev/dri/renderD128"},
+         {"-vf", "format=nv12,hwupload", "-c:v", "hevc_vaapi", "-qp", "21"}},
+        {"h264_videotoolbox", {}, {"-c:v", "h264_videotoolbox", "-q:v", "65", "-pix_fmt", "yuv420p"}},
+        {"hevc_videotoolbox", {}, {"-c:v", "hevc_videotoolbox", "-q:v", "60", "-pix_fmt", "yuv420p"}},
+};
+
+static const EncoderPreset *find_preset(const std::string &encoder)
+{
+	for (const auto &preset : encoder_presets)
+		if (encoder == preset.name)
+			return &preset;
+	return nullptr;
+}
+
+bool FfmpegCapture::IsSupported()
+{
+#if defined(WIN32)
+	return false;
+#else
+	return true;
+#endif
+}
+
+bool FfmpegCapture::IsKnownEncoder(const std::string &encoder)
+{
+	return find_preset(encoder) != nullptr;
+}
+
+FfmpegCapture::~FfmpegCapture()
+{
+	Close();
+}
+
+bool FfmpegCapture::IsOpen() const
+{
+	return process_id != 0;
+}
+
+#if defined(WIN32)
+
+bool FfmpegCapture::Open(const std::string &, const int, const int,
+                         const float, const int, const std::string &,
+                         const std::string &)
+{
+	LOG_WARNING("CAPTURE: Capturing through FFmpeg isn't supported on this platform");
+	return false;
+}
+
+bool FfmpegCapture::WriteFrame(const uint8_t *)
+{
+	return false;
+}
+
+bool FfmpegCapture::WriteAudio(const int16_t *, const size_t)
+{
+	return false;
+}
+
+void FfmpegCapture::Close() {}
+
+bool FfmpegCapture::Write(int &, const void *, size_t)
+{
+	return false;
+}
+
+#else
+
+static bool create_pipe(int (&fds)[2])
+{
+	if (pipe(fds) != 0)
+		return false;
+
+	// Keep the ends out of the child, apart from those it's given below
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	return true;
+}
+
+static void close_pipe(int (&fds)[2])
+{
+	for (auto &fd : fds) {
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+	}
+}
+
+bool FfmpegCapture::Open(const std::string &file_name, const int width,
+                         const int height, const float fps,
+                         const int sample_rate, const std::string &encoder,
+                         const std::string &extra_options)
+{
+	assert(!IsOpen());
+	assert(width > 0 && height > 0 && fps > 0.0f && sample_rate > 0);
+
+	const auto preset = find_preset(encoder);
+	if (!preset) {
+		LOG_WARNING("CAPTURE: Unknown FFmpeg encoder '%s'", encoder.c_str());
+		return false;
+	}
+
+	// The frame rate as a fraction keeps the non-integer VGA rates, such
+	// as 70.086 Hz, from drifting against the audio
+	const auto framerate = std::to_string(std::lround(fps * 1000.0f)) + "/1000";
+	const auto video_size = std::to_string(width) + "x" + std::to_string(height);
+
+	std::vector<std::string> args = {"ffmpeg", "-hide_banner", "-loglevel",
+	                                 "error", "-y"};
+	args.insert(args.end(), preset->input_args.begin(), preset->input_args.end());
+	args.insert(args.end(),
+	            {"-f", "rawvideo", "-pixel_format", "bgr0", "-video_size",
+	             video_size, "-framerate", framerate, "-i", "pipe:0",
+	             "-f", "s16le", "-ar", std::to_string(sample_rate), "-ac",
+	             "2", "-i", "pipe:3", "-map", "0:v", "-map", "1:a"});
+	args.insert(args.end(), preset->output_args.begin(), preset->output_args.end());
+	args.insert(args.end(), {"-c:a", "aac", "-b:a", "192k"});
+
+	// The user's options come last so they override the preset's
+	for (const auto &option : split(extra_options))
+		args.push_back(option);
+	args.push_back(file_name);
+
+	std::vector<char *> argv = {};
+	for (auto &arg : args)
+		argv.push_back(arg.data());
+	argv.push_back(nullptr);
+
+	int video_pipe[2] = {-1, -1};
+	int audio_pipe[2] = {-1, -1};
+	if (!create_pipe(video_pipe) || !create_pipe(audio_pipe)) {
+		LOG_WARNING("CAPTURE: Can't create the pipes to FFmpeg: %s",
+		            safe_strerror(errno).c_str());
+		close_pipe(video_pipe);
+		close_pipe(audio_pipe);
+		return false;
+	}
+
+	// The child reads the video from its standard input and the audio
+	// from file descriptor 3
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, video_pipe[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, audio_pipe[0], 3);
+
+	pid_t pid        = 0;
+	const auto error = posix_spawnp(&pid, "ffmpeg", &actions, nullptr,
+	                                argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+
+	close(video_pipe[0]);
+	close(audio_pipe[0]);
+	if (error != 0) {
+		LOG_WARNING("CAPTURE: Can't start FFmpeg: %s",
+		            safe_strerror(error).c_str());
+		close(video_pipe[1]);
+		close(audio_pipe[1]);
+		return false;
+	}
+
+	// A failed encoder closes its end of the pipes; report that from the
+	// writes instead of being terminated by the signal
+	signal(SIGPIPE, SIG_IGN);
+
+	video_fd    = video_pipe[1];
+	audio_fd    = audio_pipe[1];
+	process_id  = static_cast<long>(pid);
+	frame_bytes = static_cast<size_t>(width) * static_cast<size_t>(height) * 4;
+
+	LOG_MSG("CAPTURE: Encoding %s with FFmpeg's %s encoder",
+	        file_name.c_str(), encoder.c_str());
+	return true;
+}
+
+// Writes all of the data, retrying after interrupts and partial writes.
+// Closes the pipe if ffmpeg stops reading it.
+bool FfmpegCapture::Write(int &fd, const void *data, size_t num_bytes)
+{
+	if (fd < 0)
+		return false;
+
+	auto bytes = static_cast<const uint8_t *>(data);
+	while (num_bytes > 0) {
+		const auto written = write(fd, bytes, num_bytes);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			LOG_WARNING("CAPTURE: Can't write to FFmpeg: %s",
+			            safe_strerror(errno).c_str());
+			close(fd);
+			fd = -1;
+			return false;
+		}
+		bytes += written;
+		num_bytes -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+bool FfmpegCapture::WriteFrame(const uint8_t *bgrx_pixels)
+{
+	return Write(video_fd, bgrx_pixels, frame_bytes);
+}
+
+bool FfmpegCapture::WriteAudio(const int16_t *frames, const size_t num_frames)
+{
+	return Write(audio_fd, frames, num_frames * 2 * sizeof(int16_t));
+}
+
+void FfmpegCapture::Close()
+{
+	if (!IsOpen())
+		return;
+
+	// Closing the pipes ends the inputs, after which ffmpeg flushes its
+	// encoder and finishes the file
+	if (video_fd >= 0)
+		close(video_fd);
+	if (audio_fd >= 0)
+		close(audio_fd);
+	video_fd = -1;
+	audio_fd = -1;
+
+	int status     = 0;
+	const auto pid = static_cast<pid_t>(process_id);
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+	process_id = 0;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		LOG_WARNING("CAPTURE: FFmpeg failed to encode the capture (status %d)",
+		            status);
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_FFMPEG_CAPTURE_H
+#define DOSBOX_FFMPEG_CAPTURE_H
+
+#include "dosbox.h"
+
+#include <string>
+
+/*  FFmpeg Capture
+ *  --------------
+ *  Streams captured video and audio to an external 'ffmpeg' process, which
+ *  encodes them straight into a compressed file, such as with a hardware
+ *  H.264 or HEVC encoder, so the capture doesn't have to be transcoded
+ *  afterwards.
+ *
+ *  The frames are written to ffmpeg's standard input as raw 32-bit BGRX
+ *  video and the audio to a second pipe, on file descriptor 3, as 16-bit
+ *  stereo PCM. Only hosts with POSIX pipes and processes are supported.
+ *
+ *  Use
+ *  ---
+ *  1. Check the encoder name with IsKnownEncoder().
+ *  2. Call Open() with the file to create and the stream's parameters.
+ *  3. Write every frame with WriteFrame() and the audio played since the
+ *     previous frame with WriteAudio(); the video's timing comes from the
+ *     number of frames, so repeat frames rather than skipping them.
+ *  4. Call Close() to wait for ffmpeg to finish the file.
+ */
+
+class FfmpegCapture {
+public:
+	static bool IsSupported();
+	static bool IsKnownEncoder(const std::string &encoder);
+
+	FfmpegCapture() = default;
+	~FfmpegCapture();
+
+	bool Open(const std::string &file_name, const int width, const int height,
+	          const float fps, const int sample_rate,
+	          const std::string &encoder, const std::string &extra_options);
+	bool IsOpen() const;
+
+	bool WriteFrame(const uint8_t *bgrx_pixels);
+	bool WriteAudio(const int16_t *frames, const size_t num_frames);
+
+	void Close();
+
+private:
+	FfmpegCapture(const FfmpegCapture &)            = delete;
+	FfmpegCapture &operator=(const FfmpegCapture &) = delete;
+
+	bool Write(int &fd, const void *data, size_t num_bytes);
+
+	int video_fd     = -1;
+	int audio_fd     = -1;
+	long process_id  = 0;
+	size_t frame_bytes = 0;
+};
+
+#endif
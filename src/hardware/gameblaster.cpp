@@ -21,6 +21,9 @@
 
 #include "gameblaster.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "setup.h"
 #include "pic.h"
 
@@ -85,6 +88,7 @@ void GameBlaster::Open(const int port_choice, const std::string &card_choice,
 	                            ChannelFeature::Stereo,
 	                            ChannelFeature::ReverbSend,
 	                            ChannelFeature::ChorusSend,
+	                            ChannelFeature::ParallelRender,
 	                            ChannelFeature::Synthesizer});
 
 	// The filter parameters have been tweaked by analysing real hardware
@@ -108,10 +112,18 @@ void GameBlaster::Open(const int port_choice, const std::string &card_choice,
 	// Calculate rates and ratio based on the mixer's rate
 	const auto frame_rate_hz = channel->GetSampleRate();
 
-	// Setup the resampler to convert from the render rate to the mixer's frame rate
-	const auto max_freq = std::max(frame_rate_hz * 0.9 / 2, 8000.0);
+	// Decimate the render rate first, then resample to the mixer's frame
+	// rate; the resampler's cost grows with its input rate
+	constexpr auto decimated_rate_hz = static_cast<double>(render_rate_hz) /
+	                                   decimation_factor;
+	const auto max_freq = std::clamp(frame_rate_hz * 0.9 / 2,
+	                                 8000.0,
+	                                 decimated_rate_hz * 0.9 / 2);
+	for (auto &d : decimators)
+		d = std::make_unique<DecimatingFir>(decimation_factor);
 	for (auto &r : resamplers)
-		r.reset(reSIDfp::TwoPassSincResampler::create(render_rate_hz, frame_rate_hz, max_freq));
+		r.reset(reSIDfp::TwoPassSincResampler::create(decimated_rate_hz, frame_rate_hz, max_freq));
+	samples_per_frame = static_cast<double>(render_rate_hz) / frame_rate_hz;
 
 	LOG_MSG("%s: Running on port %xh with two %0.3f MHz Phillips SAA-1099 chips",
 	        CardName(),
@@ -127,104 +139,123 @@ void GameBlaster::Open(const int port_choice, const std::string &card_choice,
 	is_open = true;
 }
 
-bool GameBlaster::MaybeRenderFrame(AudioFrame &frame)
+// Renders a run of samples from both SAA-1099 devices at their native rate
+// and adds the frames they make up once decimated and resampled
+void GameBlaster::RenderSamples(const int num_samples)
 {
-	// Static containers setup once and reused
-	static std::array<int16_t, 2> buf = {}; // left and right
-	static int16_t *p_buf[]           = {&buf[0], &buf[1]};
-	static device_sound_interface::sound_stream stream;
-
-	// Accumulate the samples from both SAA-1099 devices
-	devices[0]->sound_stream_update(stream, 0, p_buf, 1);
-	int left_accum = buf[0];
-	int right_accum = buf[1];
-
-	devices[1]->sound_stream_update(stream, 0, p_buf, 1);
-	left_accum += buf[0];
-	right_accum += buf[1];
-
-	// Increment our time datum up to which the device has rendered
-	last_rendered_ms += ms_per_render;
+	assert(num_samples > 0);
+	const auto n = static_cast<size_t>(num_samples);
+	for (auto &device_samples : render_samples)
+		for (auto &side : device_samples)
+			if (side.size() < n)
+				side.resize(n);
 
-	// Resample the limited frame
-	const auto l_ready = resamplers[0]->input(left_accum);
-	const auto r_ready = resamplers[1]->input(right_accum);
-	assert(l_ready == r_ready);
-	const auto frame_is_ready = l_ready && r_ready;
+	static device_sound_interface::sound_stream stream;
+	for (size_t d = 0; d < 2; ++d) {
+		int16_t *p_buf[] = {render_samples[d][0].data(),
+		                    render_samples[d][1].data()};
+		devices[d]->sound_stream_update(stream, 0, p_buf, num_samples);
+	}
 
-	// Get the frame from the resampler
-	if (frame_is_ready) {
-		frame.left  = static_cast<float>(resamplers[0]->output());
-		frame.right = static_cast<float>(resamplers[1]->output());
+	for (size_t i = 0; i < n; ++i) {
+		const auto left  = render_samples[0][0][i] + render_samples[1][0][i];
+		const auto right = render_samples[0][1][i] + render_samples[1][1][i];
+
+		const auto l_decimated = decimators[0]->Input(static_cast<float>(left));
+		const auto r_decimated = decimators[1]->Input(static_cast<float>(right));
+		assert(l_decimated == r_decimated);
+		if (!l_decimated || !r_decimated)
+			continue;
+
+		const auto l_ready = resamplers[0]->input(
+		        static_cast<int>(std::lround(decimators[0]->Output())));
+		const auto r_ready = resamplers[1]->input(
+		        static_cast<int>(std::lround(decimators[1]->Output())));
+		assert(l_ready == r_ready);
+		if (l_ready && r_ready)
+			render_frames.push_back({static_cast<float>(resamplers[0]->output()),
+			                         static_cast<float>(resamplers[1]->output())});
 	}
-	return frame_is_ready;
+	last_rendered_ms += num_samples * ms_per_render;
 }
 
-void GameBlaster::RenderUpToNow()
+// Writes to the device and port at the given offset from the base port:
+// the left device's data and control, then the right device's
+void GameBlaster::ApplyWrite(const io_port_t port_offset, const uint8_t data)
+{
+	auto &device = devices[port_offset / 2];
+	if (port_offset % 2)
+		device->control_w(0, 0, data);
+	else
+		device->data_w(0, 0, data);
+}
+
+void GameBlaster::QueueWrite(const io_port_t port, const io_val_t value)
 {
 	const auto now = PIC_FullIndex();
 
-	// Wake up the channel and update the last rendered time datum.
+	// Wake up the channel and restart the render clock from now
 	assert(channel);
-	if (channel->WakeUp()) {
+	if (channel->WakeUp())
 		last_rendered_ms = now;
-		return;
-	}
-	// Keep rendering until we're current
-	while (last_rendered_ms < now) {
-		last_rendered_ms += ms_per_render;
-		if (AudioFrame f = {}; MaybeRenderFrame(f))
-			fifo.emplace(f);
-	}
+
+	const auto port_offset = check_cast<io_port_t>(port - base_port);
+	writes.Enqueue(now, port_offset, check_cast<uint8_t>(value), [this](auto p, auto v) {
+		ApplyWrite(p, v);
+	});
 }
 
-void GameBlaster::WriteDataToLeftDevice(io_port_t, io_val_t value, io_width_t)
+void GameBlaster::WriteDataToLeftDevice(io_port_t port, io_val_t value, io_width_t)
 {
-	RenderUpToNow();
-	devices[0]->data_w(0, 0, check_cast<uint8_t>(value));
+	QueueWrite(port, value);
 }
 
-void GameBlaster::WriteControlToLeftDevice(io_port_t, io_val_t value, io_width_t)
+void GameBlaster::WriteControlToLeftDevice(io_port_t port, io_val_t value, io_width_t)
 {
-	RenderUpToNow();
-	devices[0]->control_w(0, 0, check_cast<uint8_t>(value));
+	QueueWrite(port, value);
 }
 
-void GameBlaster::WriteDataToRightDevice(io_port_t, io_val_t value, io_width_t)
+void GameBlaster::WriteDataToRightDevice(io_port_t port, io_val_t value, io_width_t)
 {
-	RenderUpToNow();
-	devices[1]->data_w(0, 0, check_cast<uint8_t>(value));
+	QueueWrite(port, value);
 }
 
-void GameBlaster::WriteControlToRightDevice(io_port_t, io_val_t value, io_width_t)
+void GameBlaster::WriteControlToRightDevice(io_port_t port, io_val_t value, io_width_t)
 {
-	RenderUpToNow();
-	devices[1]->control_w(0, 0, check_cast<uint8_t>(value));
+	QueueWrite(port, value);
 }
 
 void GameBlaster::AudioCallback(const uint16_t requested_frames)
 {
 	assert(channel);
 
-	//if (fifo.size())
-	//	LOG_MSG("%s: Queued %2lu cycle-accurate frames", CardName(), fifo.size());
+	const auto apply_write = [this](auto p, auto v) { ApplyWrite(p, v); };
 
-	auto frames_remaining = requested_frames;
+	// Render the devices in runs until they've produced the requested
+	// frames, ending each run at the next queued write so the write lands
+	// on the same sample as when rendering one sample at a time. Frames
+	// rendered beyond the request are kept for next time.
+	while (render_frames.size() < requested_frames) {
+		writes.ApplyUpTo(last_rendered_ms, apply_write);
 
-	// First, add any frames we've queued since the last callback
-	while (frames_remaining && fifo.size()) {
-		channel->AddSamples_sfloat(1, &fifo.front()[0]);
-		fifo.pop();
-		--frames_remaining;
-	}
-	// If the queue's run dry, render the remainder and sync-up our time datum
-	while (frames_remaining) {
-		if (AudioFrame f = {}; MaybeRenderFrame(f)) {
-			channel->AddSamples_sfloat(1, &f[0]);
+		const auto frames_needed = requested_frames - render_frames.size();
+		auto samples = static_cast<int>(
+		        std::ceil(static_cast<double>(frames_needed) * samples_per_frame));
+
+		if (double next_write_ms = 0.0; writes.GetNextTimestamp(next_write_ms)) {
+			const auto samples_to_write = static_cast<int>(
+			        std::ceil((next_write_ms - last_rendered_ms) / ms_per_render));
+			samples = std::min(samples, samples_to_write);
 		}
-		--frames_remaining;
+		RenderSamples(std::max(samples, 1));
 	}
+	channel->AddSamples_sfloat(requested_frames, &render_frames[0][0]);
+	render_frames.erase(render_frames.begin(),
+	                    render_frames.begin() + requested_frames);
+
+	// Catch up with any writes left and sync-up our time datum
 	last_rendered_ms = PIC_FullIndex();
+	writes.ApplyUpTo(last_rendered_ms, apply_write);
 }
 
 void GameBlaster::WriteToDetectionPort(io_port_t port, io_val_t value, io_width_t)
@@ -276,8 +307,11 @@ void GameBlaster::Close()
 	channel.reset();
 	devices[0].reset();
 	devices[1].reset();
+	decimators[0].reset();
+	decimators[1].reset();
 	resamplers[0].reset();
 	resamplers[1].reset();
+	render_frames.clear();
 
 	is_open = false;
 }
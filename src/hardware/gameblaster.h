@@ -25,7 +25,6 @@
 
 #include <array>
 #include <memory>
-#include <queue>
 #include <string>
 #include <vector>
 
@@ -48,10 +47,10 @@ public:
 
 private:
 	// Audio rendering
-	bool MaybeRenderFrame(AudioFrame &frame);
-	std::vector<int16_t> GetFrame();
+	void RenderSamples(int num_samples);
 	void AudioCallback(const uint16_t requested_frames);
-	void RenderUpToNow();
+	void ApplyWrite(io_port_t port_offset, uint8_t data);
+	void QueueWrite(io_port_t port, io_val_t value);
 
 	// IO callbacks to the left SAA1099 device
 	void WriteDataToLeftDevice(io_port_t port, io_val_t value, io_width_t width);
@@ -75,9 +74,13 @@ private:
 	IO_ReadHandleObject read_handler_for_detection   = {};
 
 	std::unique_ptr<saa1099_device> devices[2]                   = {};
+	std::unique_ptr<DecimatingFir> decimators[2]                 = {};
 	std::unique_ptr<reSIDfp::TwoPassSincResampler> resamplers[2] = {};
 
-	std::queue<AudioFrame> fifo = {};
+	DeviceWriteQueue writes               = {};
+	std::vector<AudioFrame> render_frames = {};
+	// the left and right samples of each device
+	std::vector<int16_t> render_samples[2][2] = {};
 
 	// Static rate-related configuration
 	static constexpr auto chip_clock     = 14318180 / 2;
@@ -85,8 +88,10 @@ private:
 	static constexpr auto render_rate_hz = ceil_sdivide(chip_clock,
 	                                                    render_divisor);
 	static constexpr auto ms_per_render  = millis_in_second / render_rate_hz;
+	static constexpr auto decimation_factor = 4;
 
 	// Runtime states
+	double samples_per_frame       = 0;
 	double last_rendered_ms        = 0;
 	io_port_t base_port            = 0;
 	bool is_standalone_gameblaster = false;
@@ -21,17 +21,19 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <array>
 #include <iomanip>
 #include <memory>
 #include <string>
 #include <unistd.h>
-#include <queue>
+#include <vector>
 
 #include "control.h"
 #include "dma.h"
 #include "hardware.h"
 #include "math_utils.h"
+#include "memory_report.h"
 #include "mixer.h"
 #include "pic.h"
 #include "setup.h"
@@ -84,6 +86,9 @@ constexpr uint16_t VOLUME_LEVELS = 4096u;
 // Interwave addressing constant
 constexpr int16_t WAVE_WIDTH = 1 << 9; // Wave interpolation width (9 bits)
 
+// Voice rendering constant
+constexpr int VOICE_RENDER_CHUNK = 64; // frames stepped at a time per voice
+
 // IO address quantities
 constexpr uint8_t READ_HANDLERS = 8u;
 constexpr uint8_t WRITE_HANDLERS = 9u;
@@ -130,9 +135,10 @@ class Voice {
 public:
 	Voice(uint8_t num, VoiceIrq &irq) noexcept;
 
-	AudioFrame RenderFrame(const ram_array_t &ram,
-	                       const vol_scalars_array_t &vol_scalars,
-	                       const pan_scalars_array_t &pan_scalars);
+	void RenderFrames(const ram_array_t &ram,
+	                  const vol_scalars_array_t &vol_scalars,
+	                  const pan_scalars_array_t &pan_scalars,
+	                  AudioFrame *frames, int num_frames);
 
 	uint8_t ReadVolState() const noexcept;
 	uint8_t ReadWaveState() const noexcept;
@@ -155,8 +161,10 @@ private:
 	Voice &operator=(const Voice &) = delete; // prevent assignment
 	bool CheckWaveRolloverCondition() noexcept;
 	bool Is16Bit() const noexcept;
+	bool IsStopped() const noexcept;
 	float GetVolScalar(const vol_scalars_array_t &vol_scalars);
-	float GetSample(const ram_array_t &ram) noexcept;
+	void PopWaveSamples(const ram_array_t &ram, float &sample,
+	                    float &next_sample, float &fraction) noexcept;
 	int32_t PopWavePos() noexcept;
 	float PopVolScalar(const vol_scalars_array_t &vol_scalars);
 	float Read8BitSample(const ram_array_t &ram, int32_t addr) const noexcept;
@@ -237,6 +245,7 @@ private:
 	void StartDmaTransfers();
 	bool IsDmaPcm16Bit() noexcept;
 	bool IsDmaXfer16Bit() noexcept;
+	ram_array_t &Ram();
 	uint16_t ReadFromRegister();
 	void PopulateAutoExec(uint16_t port, const std::string &dir);
 	void PopulatePanScalars() noexcept;
@@ -246,7 +255,7 @@ private:
 
 	void RegisterIoHandlers();
 	void Reset(uint8_t state);
-	AudioFrame RenderFrame();
+	void RenderFrames(int num_frames);
 	void RenderUpToNow();
 	void SetLevelCallback(const AudioFrame &levels);
 	void StopPlayback();
@@ -258,10 +267,11 @@ private:
 	void WriteToRegister();
 
 	// Collections
-	std::queue<AudioFrame> fifo = {};
+	DeviceFrameQueue<AudioFrame> fifo = {};
+	std::vector<AudioFrame> render_frames = {};
 	vol_scalars_array_t vol_scalars = {{}};
 	pan_scalars_array_t pan_scalars = {{}};
-	alignas(sizeof(int16_t)) ram_array_t ram = {{0u}};
+	std::unique_ptr<ram_array_t> ram = {}; // allocated on first use
 	read_io_array_t read_handlers = {};   // std::functions
 	write_io_array_t write_handlers = {}; // std::functions
 	const address_array_t dma_addresses = {
@@ -414,43 +424,79 @@ bool Voice::Is16Bit() const noexcept
 	return (wave_ctrl.state & CTRL::BIT16);
 }
 
-float Voice::GetSample(const ram_array_t &ram) noexcept
+// A voice is silent once both its wave and volume controls have stopped
+bool Voice::IsStopped() const noexcept
+{
+	return (vol_ctrl.state & wave_ctrl.state & CTRL::DISABLED);
+}
+
+// Reads the sample at the current wave position along with the sample to
+// interpolate toward and the fraction of the way there, and increments the
+// position. The fraction is zero when there's nothing to interpolate.
+void Voice::PopWaveSamples(const ram_array_t &ram, float &sample,
+                           float &next_sample, float &fraction) noexcept
 {
 	const int32_t pos = PopWavePos();
 	const auto addr = pos / WAVE_WIDTH;
-	const auto fraction = pos & (WAVE_WIDTH - 1);
-	const bool should_interpolate = wave_ctrl.inc < WAVE_WIDTH && fraction;
+	const auto pos_fraction = pos & (WAVE_WIDTH - 1);
+	const bool should_interpolate = wave_ctrl.inc < WAVE_WIDTH && pos_fraction;
 	const auto is_16bit = Is16Bit();
-	float sample = is_16bit ? Read16BitSample(ram, addr)
-	                        : Read8BitSample(ram, addr);
+	sample = is_16bit ? Read16BitSample(ram, addr) : Read8BitSample(ram, addr);
 	if (should_interpolate) {
 		const auto next_addr = addr + (1 << (is_16bit ? 1 : 0));
-		const float next_sample = is_16bit ? Read16BitSample(ram, next_addr)
-		                                   : Read8BitSample(ram, next_addr);
+		next_sample = is_16bit ? Read16BitSample(ram, next_addr)
+		                       : Read8BitSample(ram, next_addr);
 		constexpr float WAVE_WIDTH_INV = 1.0 / WAVE_WIDTH;
-		sample += (next_sample - sample) *
-		          static_cast<float>(fraction) * WAVE_WIDTH_INV;
+		fraction = static_cast<float>(pos_fraction) * WAVE_WIDTH_INV;
+	} else {
+		next_sample = sample;
+		fraction = 0.0f;
 	}
-	assert(sample >= static_cast<float>(MIN_AUDIO) &&
-	       sample <= static_cast<float>(MAX_AUDIO));
-	return sample;
 }
 
-AudioFrame Voice::RenderFrame(const ram_array_t &ram,
-                              const vol_scalars_array_t &vol_scalars,
-                              const pan_scalars_array_t &pan_scalars)
+// Adds the voice's next frames into the given frames. The wave and volume
+// controls are stepped through a chunk of frames first, which leaves the
+// interpolation, volume, and panning of the chunk as straight runs that the
+// compiler can vectorise.
+void Voice::RenderFrames(const ram_array_t &ram,
+                         const vol_scalars_array_t &vol_scalars,
+                         const pan_scalars_array_t &pan_scalars,
+                         AudioFrame *frames, const int num_frames)
 {
-	if (vol_ctrl.state & wave_ctrl.state & CTRL::DISABLED)
-		return {0.0f, 0.0f};
-
-	// Keep track of how many ms this voice has generated
-	Is16Bit() ? ++generated_16bit_ms : ++generated_8bit_ms;
-
-	const auto sample = GetSample(ram) * PopVolScalar(vol_scalars);
+	std::array<float, VOICE_RENDER_CHUNK> samples;
+	std::array<float, VOICE_RENDER_CHUNK> next_samples;
+	std::array<float, VOICE_RENDER_CHUNK> fractions;
+	std::array<float, VOICE_RENDER_CHUNK> volumes;
 
 	const auto pan_scalar = pan_scalars.at(pan_position);
 
-	return {sample * pan_scalar.left, sample * pan_scalar.right};
+	auto frames_left = num_frames;
+	while (frames_left > 0 && !IsStopped()) {
+		const auto chunk_size = std::min(frames_left, VOICE_RENDER_CHUNK);
+		auto n = 0;
+		for (; n < chunk_size && !IsStopped(); ++n) {
+			PopWaveSamples(ram, samples[n], next_samples[n], fractions[n]);
+			volumes[n] = PopVolScalar(vol_scalars);
+		}
+
+		// Keep track of how many ms this voice has generated
+		if (Is16Bit())
+			generated_16bit_ms += n;
+		else
+			generated_8bit_ms += n;
+
+		for (auto i = 0; i < n; ++i) {
+			auto sample = samples[i];
+			sample += (next_samples[i] - sample) * fractions[i];
+			assert(sample >= static_cast<float>(MIN_AUDIO) &&
+			       sample <= static_cast<float>(MAX_AUDIO));
+			sample *= volumes[i];
+			frames[i].left += sample * pan_scalar.left;
+			frames[i].right += sample * pan_scalar.right;
+		}
+		frames += n;
+		frames_left -= n;
+	}
 }
 
 // Returns the current wave position and increments the position
@@ -663,9 +709,13 @@ void Gus::SetLevelCallback(const AudioFrame &levels)
 	accumulator_scalar = {levels.left * rms_squared, levels.right * rms_squared};
 }
 
-AudioFrame Gus::RenderFrame()
+// Renders a block of frames into render_frames, one voice at a time.
+// Stopped voices are skipped. The voices' IRQs are checked once the block
+// is done.
+void Gus::RenderFrames(const int num_frames)
 {
-	AudioFrame accumulator = {};
+	assert(num_frames > 0);
+	render_frames.assign(static_cast<size_t>(num_frames), AudioFrame{});
 
 	if (dac_enabled) {
 
@@ -673,19 +723,16 @@ AudioFrame Gus::RenderFrame()
 		const auto voice_end = voice + active_voices;
 
 		while (voice < voice_end && *voice) {
-			const auto voice_frame = voice->get()->RenderFrame(
-			        ram, vol_scalars, pan_scalars);
-
-			accumulator.left += voice_frame.left;
-			accumulator.right += voice_frame.right;
-
+			voice->get()->RenderFrames(Ram(), vol_scalars, pan_scalars,
+			                           render_frames.data(), num_frames);
 			++voice;
 		}
-		accumulator.left *= accumulator_scalar.left;
-		accumulator.right *= accumulator_scalar.right;
+		for (auto &frame : render_frames) {
+			frame.left *= accumulator_scalar.left;
+			frame.right *= accumulator_scalar.right;
+		}
 	}
 	CheckVoiceIrq();
-	return accumulator;
 }
 
 void Gus::RenderUpToNow()
@@ -699,32 +746,38 @@ void Gus::RenderUpToNow()
 		return;
 	}
 	// Keep rendering until we're current
+	auto num_frames = 0;
 	while (last_rendered_ms < now) {
 		last_rendered_ms += ms_per_render;
-		fifo.emplace(RenderFrame());
+		++num_frames;
 	}
+	if (num_frames == 0)
+		return;
+
+	RenderFrames(num_frames);
+	for (const auto &frame : render_frames)
+		fifo.Enqueue(frame);
 }
 
 void Gus::AudioCallback(const uint16_t requested_frames)
 {
 	assert(audio_channel);
 
-	//if (fifo.size())
-	//	LOG_MSG("GUS: Queued %2lu cycle-accurate frames", fifo.size());
+	//if (fifo.Size())
+	//	LOG_MSG("GUS: Queued %2lu cycle-accurate frames", fifo.Size());
 
 	auto frames_remaining = requested_frames;
 
 	// First, send any frames we've queued since the last callback
-	while (frames_remaining && fifo.size()) {
-		audio_channel->AddSamples_sfloat(1, &fifo.front()[0]);
-		fifo.pop();
-		--frames_remaining;
-	}
+	const auto add_frames = [&](const AudioFrame *frames, const size_t n) {
+		audio_channel->AddSamples_sfloat(check_cast<uint16_t>(n), &frames[0][0]);
+	};
+	frames_remaining = check_cast<uint16_t>(
+	        frames_remaining - fifo.DequeueBulk(frames_remaining, add_frames));
 	// If the queue's run dry, render the remainder and sync-up our time datum
-	while (frames_remaining) {
-		const auto frame = RenderFrame();
-		audio_channel->AddSamples_sfloat(1, &frame[0]);
-		--frames_remaining;
+	if (frames_remaining) {
+		RenderFrames(frames_remaining);
+		audio_channel->AddSamples_sfloat(frames_remaining, &render_frames[0][0]);
 	}
 	last_rendered_ms = PIC_FullIndex();
 }
@@ -851,6 +904,7 @@ bool Gus::PerformDmaTransfer()
 	const uint16_t desired = dma_channel->currcnt + 1;
 
 	// Will the maximum transfer stay within the GUS RAM's size?
+	auto &ram = Ram();
 	assert(static_cast<size_t>(offset) + desired <= ram.size());
 
 	// Perform the DMA transfer
@@ -1113,7 +1167,8 @@ uint16_t Gus::ReadFromPort(const io_port_t port, io_width_t width)
 			return ReadFromRegister() & 0xff;
 	case 0x305: return ReadFromRegister() >> 8;
 	case 0x307:
-		return dram_addr < ram.size() ? ram.at(dram_addr) : 0;
+		// Memory that was never written reads as zero
+		return (ram && dram_addr < RAM_SIZE) ? ram->at(dram_addr) : 0;
 	default:
 #if LOG_GUS
 		LOG_MSG("GUS: Read at port %#x", port);
@@ -1379,8 +1434,8 @@ void Gus::WriteToPort(io_port_t port, io_val_t value, io_width_t width)
 		WriteToRegister();
 		break;
 	case 0x307:
-		if (dram_addr < ram.size())
-			ram.at(dram_addr) = static_cast<uint8_t>(val);
+		if (dram_addr < RAM_SIZE)
+			Ram().at(dram_addr) = static_cast<uint8_t>(val);
 		break;
 	default:
 #if LOG_GUS
@@ -1551,11 +1606,25 @@ void Gus::WriteToRegister()
 	return;
 }
 
+// Allocates the GUS RAM when a program first uses it, so instances that
+// never play through the GUS don't hold the megabyte
+ram_array_t &Gus::Ram()
+{
+	if (GCC_UNLIKELY(!ram)) {
+		ram = std::make_unique<ram_array_t>();
+		MEMREPORT_Add(MemoryUser::GusRam, sizeof(ram_array_t));
+	}
+	return *ram;
+}
+
 Gus::~Gus()
 {
 	DEBUG_LOG_MSG("GUS: Shutting down");
 	StopPlayback();
 
+	if (ram)
+		MEMREPORT_Add(MemoryUser::GusRam, -static_cast<int64_t>(sizeof(ram_array_t)));
+
 	// remove the mixer channel
 	audio_channel.reset();
 
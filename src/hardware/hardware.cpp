@@ -18,11 +18,16 @@
 
 #include "hardware.h"
 
+#include <array>
+#include <cassert>
 #include <cerrno>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <thread>
+#include <vector>
 
+#include "capture_writer.h"
 #include "cross.h"
 #include "dosbox.h"
 #include "fs_utils.h"
@@ -31,37 +36,40 @@
 #include "pic.h"
 #include "render.h"
 #include "rgb24.h"
+#include "rwqueue.h"
 #include "setup.h"
 #include "string_utils.h"
 #include "support.h"
+#include "video.h"
 
 #if (C_SSHOT)
-#include <png.h>
 #include "../libs/zmbv/zmbv.h"
+#include "ffmpeg_capture.h"
+#include "mixer.h"
+#include "screenshot_encoder.h"
 #endif
 
 static std::string capturedir;
+static std::string capture_format;
+static std::string capture_encoder;
+static std::string capture_ffmpeg_options;
+static bool capture_display = false;
 extern const char* RunningProgram;
 Bitu CaptureState;
 
-#define WAVE_BUF 16*1024
-#define MIDI_BUF 4*1024
 #define AVI_HEADER_SIZE	500
 
+constexpr int max_capture_width  = 7680;
+constexpr int max_capture_height = 4320;
+
 static struct {
 	struct {
-		FILE *handle = nullptr;
-		uint16_t buf[WAVE_BUF][2] = {};
-		uint32_t used = 0;
-		uint32_t length = 0;
+		CaptureWriter file = {};
 		uint32_t freq = 0;
 	} wave = {};
 
 	struct {
-		FILE *handle = nullptr;
-		uint8_t buffer[MIDI_BUF] = {0};
-		uint32_t used = 0;
-		uint32_t done = 0;
+		CaptureWriter file = {};
 		uint32_t last = 0;
 	} midi = {};
 
@@ -69,33 +77,81 @@ static struct {
 		uint32_t rowlen = 0;
 	} image = {};
 
+	// Emulated frames and their rate while capturing the display output
+	struct {
+		float fps = 0.0f;
+		uint32_t frames = 0; // since the last image was read back
+	} display = {};
+
 #if (C_SSHOT)
+	ScreenshotEncoder screenshots = {};
+
 	struct {
 		FILE *handle = nullptr;
-		uint32_t frames = 0;
-		int16_t audiobuf[WAVE_BUF][2] = {};
-		uint32_t audioused = 0;
-		uint32_t audiorate = 0;
-		uint32_t audiowritten = 0;
-		VideoCodec *codec = nullptr;
 		int width = 0;
 		int height = 0;
 		int bpp = 0;
-		uint32_t written = 0;
 		float fps = 0.0f;
+		ZMBV_FORMAT format = ZMBV_FORMAT::NONE;
+		std::vector<int16_t> audio = {}; // stereo, since the last frame
+		uint32_t audiorate = 0;
+		uint32_t dropped = 0;     // frames the encoder couldn't keep up with
+		uint32_t undelivered = 0; // dropped since the last queued frame
+
+		// Used instead of the AVI file when encoding with FFmpeg; opened
+		// and closed by the emulation thread, written by the encoder
+		FfmpegCapture ffmpeg = {};
+
+		// Only used by the encoder thread while it runs
+		VideoCodec *codec = nullptr;
+		uint32_t frames = 0;
+		uint32_t frames_since_key = 0;
+		uint32_t audiowritten = 0;
+		uint32_t written = 0;
 		uint32_t bufSize = 0;
 		std::vector<uint8_t> buf = {};
 		std::vector<uint8_t> index = {};
 		uint32_t indexused = 0;
+		std::vector<uint8_t> bgrx = {}; // the last frame sent to FFmpeg
+		std::vector<uint32_t> row = {}; // a converted or doubled row
 	} video = {};
 #endif
 
 } capture = {};
 
-FILE * OpenCaptureFile(const char * type,const char * ext) {
+#if (C_SSHOT)
+// Video frames are compressed and written out by an encoder thread, so a
+// recording doesn't hold up the emulation. The emulation thread copies each
+// frame's source lines into a free slot and queues it; if no slot is free
+// because the encoder has fallen behind, the frame is dropped and recorded
+// as a repeat of the previous one, keeping the timing and audio intact.
+struct CaptureFrame {
+	std::vector<uint8_t> lines = {}; // the source lines, back to back
+	std::vector<int16_t> audio = {}; // stereo, since the previous frame
+	uint8_t palette[256 * 4] = {};
+	uint32_t dropped_before = 0;
+	int line_bytes = 0;
+	uint8_t flags = 0;
+};
+
+constexpr int max_queued_frames = 8;
+constexpr int stop_encoding     = -1; // queued after the last frame
+
+static struct {
+	std::array<CaptureFrame, max_queued_frames> frames = {};
+	SpscQueue<int> queued{max_queued_frames + 1}; // frames to encode
+	SpscQueue<int> spares{max_queued_frames};     // free frames
+	std::thread thread = {};
+} encoder;
+#endif
+
+// Returns the next free numbered file name in the capture directory, or an
+// empty name if the directory can't be used
+static std::string find_capture_file_name(const char *type, const char *ext)
+{
 	if(capturedir.empty()) {
 		LOG_MSG("Please specify a capture directory");
-		return 0;
+		return {};
 	}
 
 	/* Find a filename to open */
@@ -111,7 +167,7 @@ FILE * OpenCaptureFile(const char * type,const char * ext) {
 		if (!dir) {
 			LOG_MSG("ERROR: Can't open dir '%s' for capturing %s",
 			        capturedir.c_str(), type);
-			return 0;
+			return {};
 		}
 	}
 
@@ -137,12 +193,20 @@ FILE * OpenCaptureFile(const char * type,const char * ext) {
 	char file_name[CROSS_LEN];
 	sprintf(file_name, "%s%c%s%03d%s",
 	        capturedir.c_str(), CROSS_FILESPLIT, file_start, last, ext);
+	return file_name;
+}
+
+FILE * OpenCaptureFile(const char * type,const char * ext) {
+	const auto file_name = find_capture_file_name(type, ext);
+	if (file_name.empty())
+		return nullptr;
+
 	/* Open the actual file */
-	FILE * handle=fopen(file_name,"wb");
+	FILE *handle = fopen(file_name.c_str(), "wb");
 	if (handle) {
-		LOG_MSG("Capturing %s to %s",type,file_name);
+		LOG_MSG("Capturing %s to %s", type, file_name.c_str());
 	} else {
-		LOG_MSG("Failed to open %s for capturing %s",file_name,type);
+		LOG_MSG("Failed to open %s for capturing %s", file_name.c_str(), type);
 	}
 	return handle;
 }
@@ -156,7 +220,8 @@ static void CAPTURE_AddAviChunk(const char * tag, uint32_t size, void * data, ui
 	/* Write the actual data */
 	fwrite(chunk,1,8,capture.video.handle);
 	writesize = (size+1)&~1;
-	fwrite(data,1,writesize,capture.video.handle);
+	if (writesize)
+		fwrite(data,1,writesize,capture.video.handle);
 	pos = capture.video.written + 4;
 	capture.video.written += writesize + 8;
 	if (capture.video.indexused + 16 >= capture.video.index.size())
@@ -172,6 +237,264 @@ static void CAPTURE_AddAviChunk(const char * tag, uint32_t size, void * data, ui
 	host_writed(index+8, pos);
 	host_writed(index+12, size);
 }
+
+// Compresses the frame into the codec buffer, returning the compressed size
+static int compress_frame(const CaptureFrame &frame)
+{
+	auto &video = capture.video;
+
+	// Start with a key frame and add one at least every 300 frames
+	const int codecFlags = (video.frames_since_key == 0 ||
+	                        video.frames_since_key >= 300) ? 1 : 0;
+	if (!video.codec->PrepareCompressFrame(codecFlags, video.format,
+	                                       const_cast<uint8_t *>(frame.palette),
+	                                       video.buf.data(), video.bufSize))
+		return -1;
+
+	video.row.resize(static_cast<size_t>(video.width));
+	const auto doubleRow = reinterpret_cast<uint8_t *>(video.row.data());
+
+	const auto bpp = video.bpp;
+	const auto width = video.width;
+	const bool is_double_width = frame.flags & CAPTURE_FLAG_DBLW;
+	const auto height_divisor = (frame.flags & CAPTURE_FLAG_DBLH) ? 1 : 0;
+
+	for (auto i = 0; i < video.height; ++i) {
+		auto rowPointer = doubleRow;
+		const auto srcLine = const_cast<uint8_t *>(frame.lines.data()) +
+		                     (i >> height_divisor) * frame.line_bytes;
+
+		if (is_double_width) {
+			const auto countWidth = width >> 1;
+			switch ( bpp) {
+			case 8:
+				for (auto x = 0; x < countWidth; ++x)
+					doubleRow[x * 2 + 0] = doubleRow[x * 2 + 1] = srcLine[x];
+				break;
+			case 15:
+			case 16:
+				for (auto x = 0; x < countWidth; ++x)
+					((uint16_t *)doubleRow)[x*2+0] =
+					((uint16_t *)doubleRow)[x*2+1] = ((uint16_t *)srcLine)[x];
+				break;
+			case 24:
+				for (auto x = 0; x < countWidth; ++x) {
+					const auto pixel = reinterpret_cast<rgb24 *>(srcLine)[x];
+					reinterpret_cast<uint32_t *>(doubleRow)[x * 2 + 0] = pixel;
+					reinterpret_cast<uint32_t *>(doubleRow)[x * 2 + 1] = pixel;
+				}
+				break;
+			case 32:
+				for (auto x = 0; x < countWidth; ++x)
+					((uint32_t *)doubleRow)[x*2+0] =
+					((uint32_t *)doubleRow)[x*2+1] = ((uint32_t *)srcLine)[x];
+				break;
+			}
+			rowPointer=doubleRow;
+		} else {
+			if (bpp == 24) {
+				for (auto x = 0; x < width; ++x) {
+					const auto pixel = reinterpret_cast<rgb24 *>(srcLine)[x];
+					reinterpret_cast<uint32_t *>(doubleRow)[x] = pixel;
+				}
+				// Using doubleRow for this conversion when it is not actually double row!
+				rowPointer = doubleRow;
+			} else {
+				rowPointer = srcLine;
+			}
+		}
+		video.codec->CompressLines( 1, &rowPointer);
+	}
+	const auto written = video.codec->FinishCompressFrame();
+	if (written >= 0)
+		video.frames_since_key = codecFlags ? 1 : video.frames_since_key + 1;
+	return written;
+}
+
+static void encode_frame(const CaptureFrame &frame)
+{
+	auto &video = capture.video;
+
+	// Empty chunks stand in for the dropped frames, which players show
+	// as repeats of the previous frame
+	for (uint32_t i = 0; i < frame.dropped_before; ++i) {
+		CAPTURE_AddAviChunk("00dc", 0, nullptr, 0);
+		video.frames++;
+	}
+
+	const auto written = compress_frame(frame);
+	if (written >= 0) {
+		const auto is_key = (video.frames_since_key == 1);
+		CAPTURE_AddAviChunk("00dc", written, video.buf.data(), is_key ? 0x10 : 0x0);
+	} else {
+		CAPTURE_AddAviChunk("00dc", 0, nullptr, 0);
+	}
+	video.frames++;
+
+	if (!frame.audio.empty()) {
+		const auto bytes = static_cast<uint32_t>(frame.audio.size() * sizeof(int16_t));
+		CAPTURE_AddAviChunk("01wb", bytes,
+		                    const_cast<int16_t *>(frame.audio.data()), 0);
+		video.audiowritten += bytes;
+	}
+}
+
+// Converts the frame to the 32-bit BGRX pixels FFmpeg is given, doubling
+// the lines and pixels as flagged
+static void convert_to_bgrx(const CaptureFrame &frame, std::vector<uint8_t> &bgrx)
+{
+	auto &video = capture.video;
+
+	const auto width = video.width;
+	const auto src_width = (frame.flags & CAPTURE_FLAG_DBLW) ? width / 2 : width;
+	const auto x_shift = (frame.flags & CAPTURE_FLAG_DBLW) ? 1 : 0;
+	const auto y_shift = (frame.flags & CAPTURE_FLAG_DBLH) ? 1 : 0;
+
+	bgrx.resize(static_cast<size_t>(width * video.height * 4));
+	auto out = reinterpret_cast<uint32_t *>(bgrx.data());
+
+	// Packs the colour components into a little-endian BGRX pixel
+	auto pack = [](const uint32_t b, const uint32_t g, const uint32_t r) {
+		return host_to_le(b | (g << 8) | (r << 16));
+	};
+
+	auto &row = video.row;
+	row.resize(static_cast<size_t>(src_width));
+	for (auto y = 0; y < video.height; ++y) {
+		const auto src = frame.lines.data() + (y >> y_shift) * frame.line_bytes;
+		for (auto x = 0; x < src_width; ++x) {
+			switch (video.bpp) {
+			case 8: {
+				const auto entry = frame.palette + src[x] * 4;
+				row[x] = pack(entry[2], entry[1], entry[0]);
+				break;
+			}
+			case 15: {
+				const auto pixel = host_to_le(reinterpret_cast<const uint16_t *>(src)[x]);
+				row[x] = pack(((pixel & 0x001f) * 0x21) >> 2,
+				              ((pixel & 0x03e0) * 0x21) >> 7,
+				              ((pixel & 0x7c00) * 0x21) >> 12);
+				break;
+			}
+			case 16: {
+				const auto pixel = host_to_le(reinterpret_cast<const uint16_t *>(src)[x]);
+				row[x] = pack(((pixel & 0x001f) * 0x21) >> 2,
+				              ((pixel & 0x07e0) * 0x41) >> 9,
+				              ((pixel & 0xf800) * 0x21) >> 13);
+				break;
+			}
+			case 24:
+				row[x] = pack(src[x * 3 + 0], src[x * 3 + 1], src[x * 3 + 2]);
+				break;
+			case 32:
+				row[x] = pack(src[x * 4 + 0], src[x * 4 + 1], src[x * 4 + 2]);
+				break;
+			}
+		}
+		for (auto x = 0; x < width; ++x)
+			*out++ = row[x >> x_shift];
+	}
+}
+
+// Sends the frame and its audio to FFmpeg. FFmpeg reads its inputs on
+// separate threads, so blocking on one pipe doesn't stall the other.
+static void send_frame_to_ffmpeg(const CaptureFrame &frame)
+{
+	auto &video = capture.video;
+
+	// The stream's timing comes from the frame count, so the dropped
+	// frames are sent as repeats of the previous frame
+	if (!video.bgrx.empty()) {
+		for (uint32_t i = 0; i < frame.dropped_before; ++i) {
+			video.ffmpeg.WriteFrame(video.bgrx.data());
+			video.frames++;
+		}
+	}
+
+	if (!frame.audio.empty()) {
+		video.ffmpeg.WriteAudio(frame.audio.data(), frame.audio.size() / 2);
+		video.audiowritten += static_cast<uint32_t>(frame.audio.size() *
+		                                            sizeof(int16_t));
+	}
+
+	convert_to_bgrx(frame, video.bgrx);
+	video.ffmpeg.WriteFrame(video.bgrx.data());
+	video.frames++;
+}
+
+static void run_video_encoder()
+{
+	while (true) {
+		const auto slot = encoder.queued.Dequeue();
+		if (slot == stop_encoding)
+			break;
+		if (capture.video.ffmpeg.IsOpen())
+			send_frame_to_ffmpeg(encoder.frames[slot]);
+		else
+			encode_frame(encoder.frames[slot]);
+		encoder.spares.Enqueue(slot);
+	}
+}
+
+static void start_video_encoder()
+{
+	assert(!encoder.thread.joinable());
+
+	while (!encoder.spares.IsEmpty())
+		encoder.spares.Dequeue();
+	for (auto slot = 0; slot < max_queued_frames; ++slot)
+		encoder.spares.Enqueue(slot);
+
+	encoder.thread = std::thread(run_video_encoder);
+	set_thread_name(encoder.thread, "dosbox:capture");
+}
+
+// Waits for the encoder to write out the queued frames
+static void stop_video_encoder()
+{
+	if (!encoder.thread.joinable())
+		return;
+
+	encoder.queued.Enqueue(stop_encoding);
+	encoder.thread.join();
+}
+
+// Passes the frame to the encoder, or drops it if the encoder is behind
+static void queue_video_frame(const int width, const int height, const int bpp,
+                              const int pitch, const uint8_t flags,
+                              const uint8_t *data, const uint8_t *pal)
+{
+	auto &video = capture.video;
+
+	if (encoder.spares.IsEmpty()) {
+		video.dropped++;
+		video.undelivered++;
+		return;
+	}
+	auto &frame = encoder.frames[encoder.spares.Dequeue()];
+
+	// Copy the lines as they are, leaving the doubling to the encoder
+	const auto bytes_per_pixel = (bpp + 7) / 8;
+	const auto src_width = (flags & CAPTURE_FLAG_DBLW) ? width / 2 : width;
+	const auto src_height = (flags & CAPTURE_FLAG_DBLH) ? height / 2 : height;
+
+	frame.line_bytes = src_width * bytes_per_pixel;
+	frame.lines.resize(static_cast<size_t>(frame.line_bytes * src_height));
+	for (auto i = 0; i < src_height; ++i)
+		memcpy(frame.lines.data() + i * frame.line_bytes,
+		       data + i * pitch,
+		       static_cast<size_t>(frame.line_bytes));
+	if (pal)
+		memcpy(frame.palette, pal, sizeof(frame.palette));
+
+	frame.flags = flags;
+	frame.dropped_before = video.undelivered;
+	frame.audio.swap(video.audio);
+	video.audio.clear();
+	video.undelivered = 0;
+
+	encoder.queued.Enqueue(static_cast<int>(&frame - encoder.frames.data()));
+}
 #endif
 
 #if (C_SSHOT)
@@ -180,10 +503,24 @@ static void CAPTURE_VideoEvent(bool pressed) {
 		return;
 	if (CaptureState & CAPTURE_VIDEO) {
 		/* Close the video */
+		stop_video_encoder();
 		if (capture.video.codec)
 			capture.video.codec->FinishVideo();
 		CaptureState &= ~CAPTURE_VIDEO;
-		LOG_MSG("Stopped capturing video.");	
+		if (capture.video.dropped)
+			LOG_MSG("Stopped capturing video, %u of %u frames were dropped "
+			        "as the encoder couldn't keep up.",
+			        capture.video.dropped,
+			        capture.video.frames);
+		else
+			LOG_MSG("Stopped capturing video.");
+
+		if (capture.video.ffmpeg.IsOpen()) {
+			// Waits for FFmpeg to finish encoding the file
+			capture.video.ffmpeg.Close();
+			capture.video.bgrx.clear();
+			return;
+		}
 
 		uint8_t avi_header[AVI_HEADER_SIZE];
 		Bitu main_list;
@@ -306,6 +643,7 @@ static void CAPTURE_VideoEvent(bool pressed) {
 		fwrite(&avi_header, 1, AVI_HEADER_SIZE, capture.video.handle);
 		fclose(capture.video.handle);
 		delete capture.video.codec;
+		capture.video.codec = nullptr;
 		capture.video.handle = nullptr;
 	} else {
 		CaptureState |= CAPTURE_VIDEO;
@@ -347,178 +685,43 @@ void CAPTURE_AddImage([[maybe_unused]] int width,
                       [[maybe_unused]] uint8_t *pal)
 {
 #if (C_SSHOT)
-	uint8_t doubleRow[SCALER_MAXWIDTH * 4];
-	auto countWidth = width;
-
 	if (flags & CAPTURE_FLAG_DBLH)
 		height *= 2;
 	if (flags & CAPTURE_FLAG_DBLW)
 		width *= 2;
 
-	if (height > SCALER_MAXHEIGHT)
+	// The display output can be captured at up to 8K
+	if (height > max_capture_height)
 		return;
-	if (width > SCALER_MAXWIDTH)
+	if (width > max_capture_width)
 		return;
-	
-	if (CaptureState & CAPTURE_IMAGE) {
-		png_structp png_ptr;
-		png_infop info_ptr;
-		png_color palette[256];
 
+	if (CaptureState & CAPTURE_IMAGE) {
 		CaptureState &= ~CAPTURE_IMAGE;
-		/* Open the actual file */
-		FILE *fp = OpenCaptureFile("Screenshot", ".png");
-		if (!fp)
-			goto skip_shot;
-		/* First try to allocate the png structures */
-		png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,NULL, NULL);
-		if (!png_ptr) {
-			fclose(fp);
-			goto skip_shot;
-		}
-		info_ptr = png_create_info_struct(png_ptr);
-		if (!info_ptr) {
-			png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
-			fclose(fp);
-			goto skip_shot;
-		}
-	
-		/* Finalize the initing of png library */
-		png_init_io(png_ptr, fp);
-		png_set_compression_level(png_ptr,Z_BEST_COMPRESSION);
-		
-		/* set other zlib parameters */
-		png_set_compression_mem_level(png_ptr, 8);
-		png_set_compression_strategy(png_ptr,Z_DEFAULT_STRATEGY);
-		png_set_compression_window_bits(png_ptr, 15);
-		png_set_compression_method(png_ptr, 8);
-		png_set_compression_buffer_size(png_ptr, 8192);
-	
-		if (bpp==8) {
-			png_set_IHDR(png_ptr, info_ptr, width, height,
-				8, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
-				PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-			for (auto i = 0; i < 256; ++i) {
-				palette[i].red=pal[i*4+0];
-				palette[i].green=pal[i*4+1];
-				palette[i].blue=pal[i*4+2];
-			}
-			png_set_PLTE(png_ptr, info_ptr, palette,256);
-		} else {
-			png_set_bgr( png_ptr );
-			png_set_IHDR(png_ptr, info_ptr, width, height,
-				8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-				PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-		}
-#ifdef PNG_TEXT_SUPPORTED
-		constexpr char keyword[] = "Software";
-		constexpr char value[] = CANONICAL_PROJECT_NAME " " VERSION;
-		constexpr int num_text = 1;
-		static_assert(sizeof(keyword) < 80, "libpng limit");
-		png_text texts[num_text] = {};
-		texts[0].compression = PNG_TEXT_COMPRESSION_NONE;
-		texts[0].key = const_cast<png_charp>(keyword);
-		texts[0].text = const_cast<png_charp>(value);
-		texts[0].text_length = sizeof(value);
-		png_set_text(png_ptr, info_ptr, texts, num_text);
-#endif
-		png_write_info(png_ptr, info_ptr);
-
-		const bool is_double_width = (flags & CAPTURE_FLAG_DBLW);
-		const auto row_divisor = (flags & CAPTURE_FLAG_DBLH) ? 1 : 0;
-
-		for (auto i = 0; i < height; ++i) {
-			auto srcLine = data + (i >> row_divisor) * pitch;
-			auto rowPointer = srcLine;
-			switch (bpp) {
-			case 8:
-				if (is_double_width) {
-					for (auto x = 0; x < countWidth; ++x)
-						doubleRow[x * 2 + 0] = doubleRow[x * 2 + 1] = srcLine[x];
-					rowPointer = doubleRow;
-				}
-				break;
-			case 15:
-				if (is_double_width) {
-					for (auto x = 0; x < countWidth; ++x) {
-						const auto pixel = host_to_le(reinterpret_cast<uint16_t *>(srcLine)[x]);
-						doubleRow[x * 6 + 0] = doubleRow[x * 6 + 3] = ((pixel & 0x001f) * 0x21) >> 2;
-						doubleRow[x * 6 + 1] = doubleRow[x * 6 + 4] = ((pixel & 0x03e0) * 0x21) >> 7;
-						doubleRow[x * 6 + 2] = doubleRow[x * 6 + 5] = ((pixel & 0x7c00) * 0x21) >> 12;
-					}
-				} else {
-					for (auto x = 0; x < countWidth; ++x) {
-						const auto pixel = host_to_le(reinterpret_cast<uint16_t *>(srcLine)[x]);
-						doubleRow[x * 3 + 0] = ((pixel & 0x001f) * 0x21) >> 2;
-						doubleRow[x * 3 + 1] = ((pixel & 0x03e0) * 0x21) >> 7;
-						doubleRow[x * 3 + 2] = ((pixel & 0x7c00) * 0x21) >> 12;
-					}
-				}
-				rowPointer = doubleRow;
-				break;
-			case 16:
-				if (is_double_width) {
-					for (auto x = 0; x < countWidth; ++x) {
-						const auto pixel = host_to_le(reinterpret_cast<uint16_t *>(srcLine)[x]);
-						doubleRow[x * 6 + 0] = doubleRow[x * 6 + 3] = ((pixel & 0x001f) * 0x21) >> 2;
-						doubleRow[x * 6 + 1] = doubleRow[x * 6 + 4] = ((pixel & 0x07e0) * 0x41) >> 9;
-						doubleRow[x * 6 + 2] = doubleRow[x * 6 + 5] = ((pixel & 0xf800) * 0x21) >> 13;
-					}
-				} else {
-					for (auto x = 0; x < countWidth; ++x) {
-						const auto pixel = host_to_le(reinterpret_cast<uint16_t *>(srcLine)[x]);
-						doubleRow[x * 3 + 0] = ((pixel & 0x001f) * 0x21) >> 2;
-						doubleRow[x * 3 + 1] = ((pixel & 0x07e0) * 0x41) >> 9;
-						doubleRow[x * 3 + 2] = ((pixel & 0xf800) * 0x21) >> 13;
-					}
-				}
-				rowPointer = doubleRow;
-				break;
-			case 24:
-				if (is_double_width) {
-					for (auto x = 0; x < countWidth; ++x) {
-						const auto pixel = host_to_le(reinterpret_cast<rgb24 *>(srcLine)[x]);
-						reinterpret_cast<rgb24 *>(doubleRow)[x * 2 + 0] = pixel;
-						reinterpret_cast<rgb24 *>(doubleRow)[x * 2 + 1] = pixel;
-						rowPointer = doubleRow;
-					}
-				}
-				// There is no else statement here because
-				// rowPointer is already defined as srcLine
-				// above which is already 24-bit single row
-
-				break;
-			case 32:
-				if (is_double_width) {
-					for (auto x = 0; x < countWidth; ++x) {
-						doubleRow[x * 6 + 0] = doubleRow[x * 6 + 3] = srcLine[x * 4 + 0];
-						doubleRow[x * 6 + 1] = doubleRow[x * 6 + 4] = srcLine[x * 4 + 1];
-						doubleRow[x * 6 + 2] = doubleRow[x * 6 + 5] = srcLine[x * 4 + 2];
-					}
-				} else {
-					for (auto x = 0; x < countWidth; ++x) {
-						doubleRow[x * 3 + 0] = srcLine[x * 4 + 0];
-						doubleRow[x * 3 + 1] = srcLine[x * 4 + 1];
-						doubleRow[x * 3 + 2] = srcLine[x * 4 + 2];
-					}
-				}
-				rowPointer = doubleRow;
-				break;
-			}
-			png_write_row(png_ptr, rowPointer);
+		FILE *fp = OpenCaptureFile("Screenshot",
+		                           capture.screenshots.GetExtension());
+		if (fp) {
+			// Hand a copy of the frame to the encoder thread
+			ScreenshotImage image = {};
+			image.width      = width;
+			image.height     = height;
+			image.bpp        = bpp;
+			image.flags      = flags;
+			image.line_bytes = pitch;
+			const auto num_lines = (flags & CAPTURE_FLAG_DBLH) ? height / 2
+			                                                   : height;
+			image.lines.assign(data, data + static_cast<size_t>(num_lines) *
+			                                        static_cast<size_t>(pitch));
+			if (pal)
+				memcpy(image.palette, pal, sizeof(image.palette));
+			capture.screenshots.Queue(fp, std::move(image));
 		}
-		/* Finish writing */
-		png_write_end(png_ptr, 0);
-		/*Destroy PNG structs*/
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		/*close file*/
-		fclose(fp);
 	}
-skip_shot:
 	if (CaptureState & CAPTURE_VIDEO) {
 		ZMBV_FORMAT format;
 		/* Disable capturing if any of the test fails */
-		if (capture.video.handle && (
+		const auto is_open = capture.video.handle || capture.video.ffmpeg.IsOpen();
+		if (is_open && (
 			capture.video.width != width ||
 			capture.video.height != height ||
 			capture.video.bpp != bpp ||
@@ -541,7 +744,18 @@ skip_shot:
 		case 32: format = ZMBV_FORMAT::BPP_32; break;
 		default: goto skip_video;
 		}
-		if (!capture.video.handle) {
+		if (!is_open) {
+			if (capture_format == "ffmpeg") {
+				const auto file_name = find_capture_file_name("Video", ".mkv");
+				if (!file_name.empty() &&
+				    !capture.video.ffmpeg.Open(file_name, width, height, fps,
+				                               MIXER_GetSampleRate(),
+				                               capture_encoder,
+				                               capture_ffmpeg_options))
+					LOG_WARNING("CAPTURE: Capturing to a ZMBV video instead");
+			}
+		}
+		if (!capture.video.handle && !capture.video.ffmpeg.IsOpen()) {
 			capture.video.handle = OpenCaptureFile("Video",".avi");
 			if (!capture.video.handle)
 				goto skip_video;
@@ -554,86 +768,26 @@ skip_shot:
 			capture.video.buf.resize(capture.video.bufSize);
 			capture.video.index.resize(16 * 4096);
 			capture.video.indexused = 8;
-
+			for (auto i = 0; i < AVI_HEADER_SIZE; ++i)
+				fputc(0,capture.video.handle);
+		}
+		if (!is_open) {
 			capture.video.width = width;
 			capture.video.height = height;
 			capture.video.bpp = bpp;
 			capture.video.fps = fps;
-			for (auto i = 0; i < AVI_HEADER_SIZE; ++i)
-				fputc(0,capture.video.handle);
+			capture.video.format = format;
 			capture.video.frames = 0;
+			capture.video.frames_since_key = 0;
 			capture.video.written = 0;
-			capture.video.audioused = 0;
+			capture.video.audio.clear();
 			capture.video.audiowritten = 0;
+			capture.video.dropped = 0;
+			capture.video.undelivered = 0;
+
+			start_video_encoder();
 		}
-		int codecFlags;
-		if (capture.video.frames % 300 == 0)
-			codecFlags = 1;
-		else codecFlags = 0;
-		if (!capture.video.codec->PrepareCompressFrame(codecFlags, format, pal,
-		                                               capture.video.buf.data(),
-		                                               capture.video.bufSize))
-			goto skip_video;
-
-		const bool is_double_width = flags & CAPTURE_FLAG_DBLW;
-		const auto height_divisor = (flags & CAPTURE_FLAG_DBLH) ? 1 : 0;
-
-		for (auto i = 0; i < height; ++i) {
-			auto rowPointer = doubleRow;
-			const auto srcLine = data + (i >> height_divisor) * pitch;
-
-			if (is_double_width) {
-				countWidth = width >> 1;
-				switch ( bpp) {
-				case 8:
-					for (auto x = 0; x < countWidth; ++x)
-						doubleRow[x * 2 + 0] = doubleRow[x * 2 + 1] = srcLine[x];
-					break;
-				case 15:
-				case 16:
-					for (auto x = 0; x < countWidth; ++x)
-						((uint16_t *)doubleRow)[x*2+0] =
-						((uint16_t *)doubleRow)[x*2+1] = ((uint16_t *)srcLine)[x];
-					break;
-				case 24:
-					for (auto x = 0; x < countWidth; ++x) {
-						const auto pixel = reinterpret_cast<rgb24 *>(srcLine)[x];
-						reinterpret_cast<uint32_t *>(doubleRow)[x * 2 + 0] = pixel;
-						reinterpret_cast<uint32_t *>(doubleRow)[x * 2 + 1] = pixel;
-					}
-					break;
-				case 32:
-					for (auto x = 0; x < countWidth; ++x)
-						((uint32_t *)doubleRow)[x*2+0] =
-						((uint32_t *)doubleRow)[x*2+1] = ((uint32_t *)srcLine)[x];
-					break;
-				}
-                rowPointer=doubleRow;
-			} else {
-				if (bpp == 24) {
-					for (auto x = 0; x < width; ++x) {
-						const auto pixel = reinterpret_cast<rgb24 *>(srcLine)[x];
-						reinterpret_cast<uint32_t *>(doubleRow)[x] = pixel;
-					}
-					// Using doubleRow for this conversion when it is not actually double row!
-					rowPointer = doubleRow;
-				} else {
-					rowPointer = srcLine;
-				}
-			}
-			capture.video.codec->CompressLines( 1, &rowPointer);
-		}
-		int written = capture.video.codec->FinishCompressFrame();
-		if (written < 0)
-			goto skip_video;
-		CAPTURE_AddAviChunk("00dc", written, capture.video.buf.data(), codecFlags & 1 ? 0x10 : 0x0);
-		capture.video.frames++;
-//		LOG_MSG("Frame %d video %d audio %d",capture.video.frames, written, capture.video.audioused *4 );
-		if ( capture.video.audioused ) {
-			CAPTURE_AddAviChunk( "01wb", capture.video.audioused * 4, capture.video.audiobuf, 0);
-			capture.video.audiowritten = capture.video.audioused*4;
-			capture.video.audioused = 0;
-		}
+		queue_video_frame(width, height, bpp, pitch, flags, data, pal);
 
 		/* Everything went okay, set flag again for next frame */
 		CaptureState |= CAPTURE_VIDEO;
@@ -665,63 +819,39 @@ static uint8_t wavheader[]={
 void CAPTURE_AddWave(uint32_t freq, uint32_t len, int16_t * data) {
 #if (C_SSHOT)
 	if (CaptureState & CAPTURE_VIDEO) {
-		Bitu left = WAVE_BUF - capture.video.audioused;
-		if (left > len)
-			left = len;
-		memcpy( &capture.video.audiobuf[capture.video.audioused], data, left*4);
-		capture.video.audioused += left;
+		// Held until the next frame is queued
+		capture.video.audio.insert(capture.video.audio.end(), data, data + len * 2);
 		capture.video.audiorate = freq;
 	}
 #endif
 	if (CaptureState & CAPTURE_WAVE) {
-		if (!capture.wave.handle) {
-			capture.wave.handle=OpenCaptureFile("Wave Output",".wav");
-			if (!capture.wave.handle) {
+		if (!capture.wave.file.IsOpen()) {
+			if (!capture.wave.file.Open("Wave Output", ".wav")) {
 				CaptureState &= ~CAPTURE_WAVE;
 				return;
 			}
-			capture.wave.length = 0;
-			capture.wave.used = 0;
 			capture.wave.freq = freq;
-			fwrite(wavheader,1,sizeof(wavheader),capture.wave.handle);
-		}
-		int16_t * read = data;
-		while (len > 0 ) {
-			Bitu left = WAVE_BUF - capture.wave.used;
-			if (!left) {
-				fwrite(capture.wave.buf,1,4*WAVE_BUF,capture.wave.handle);
-				capture.wave.length += 4*WAVE_BUF;
-				capture.wave.used = 0;
-				left = WAVE_BUF;
-			}
-			if (left > len)
-				left = len;
-			memcpy( &capture.wave.buf[capture.wave.used], read, left*4);
-			capture.wave.used += left;
-			read += left*2;
-			len -= left;
+			capture.wave.file.Write(wavheader, sizeof(wavheader));
 		}
+		capture.wave.file.Write(data, len * 4);
 	}
 }
 static void CAPTURE_WaveEvent(bool pressed) {
 	if (!pressed)
 		return;
 	/* Check for previously opened wave file */
-	if (capture.wave.handle) {
+	if (capture.wave.file.IsOpen()) {
 		LOG_MSG("Stopped capturing wave output.");
-		/* Write last piece of audio in buffer */
-		fwrite(capture.wave.buf,1,capture.wave.used*4,capture.wave.handle);
-		capture.wave.length+=capture.wave.used*4;
+		const auto length = static_cast<uint32_t>(capture.wave.file.GetSize() -
+		                                          sizeof(wavheader));
 		/* Fill in the header with useful information */
-		host_writed(&wavheader[0x04],capture.wave.length+sizeof(wavheader)-8);
+		host_writed(&wavheader[0x04],length+sizeof(wavheader)-8);
 		host_writed(&wavheader[0x18],capture.wave.freq);
 		host_writed(&wavheader[0x1C],capture.wave.freq*4);
-		host_writed(&wavheader[0x28],capture.wave.length);
-		
-		fseek(capture.wave.handle,0,0);
-		fwrite(wavheader,1,sizeof(wavheader),capture.wave.handle);
-		fclose(capture.wave.handle);
-		capture.wave.handle=0;
+		host_writed(&wavheader[0x28],length);
+
+		capture.wave.file.WriteAt(0, wavheader, sizeof(wavheader));
+		capture.wave.file.Close();
 		CaptureState |= CAPTURE_WAVE;
 	} 
 	CaptureState ^= CAPTURE_WAVE;
@@ -742,12 +872,7 @@ static uint8_t midi_header[]={
 
 
 static void RawMidiAdd(uint8_t data) {
-	capture.midi.buffer[capture.midi.used++]=data;
-	if (capture.midi.used >= MIDI_BUF ) {
-		capture.midi.done += capture.midi.used;
-		fwrite(capture.midi.buffer,1,MIDI_BUF,capture.midi.handle);
-		capture.midi.used = 0;
-	}
+	capture.midi.file.Write(&data, 1);
 }
 
 static void RawMidiAddNumber(uint32_t val) {
@@ -758,12 +883,11 @@ static void RawMidiAddNumber(uint32_t val) {
 }
 
 void CAPTURE_AddMidi(bool sysex, Bitu len, uint8_t * data) {
-	if (!capture.midi.handle) {
-		capture.midi.handle=OpenCaptureFile("Raw Midi",".mid");
-		if (!capture.midi.handle) {
+	if (!capture.midi.file.IsOpen()) {
+		if (!capture.midi.file.Open("Raw Midi", ".mid")) {
 			return;
 		}
-		fwrite(midi_header,1,sizeof(midi_header),capture.midi.handle);
+		capture.midi.file.Write(midi_header, sizeof(midi_header));
 		capture.midi.last=PIC_Ticks;
 	}
 	uint32_t delta=PIC_Ticks-capture.midi.last;
@@ -781,7 +905,7 @@ static void CAPTURE_MidiEvent(bool pressed) {
 	if (!pressed)
 		return;
 	/* Check for previously opened wave file */
-	if (capture.midi.handle) {
+	if (capture.midi.file.IsOpen()) {
 		LOG_MSG("Stopping raw midi saving and finalizing file.");
 		//Delta time
 		RawMidiAdd(0x00);
@@ -789,43 +913,84 @@ static void CAPTURE_MidiEvent(bool pressed) {
 		RawMidiAdd(0xff);
 		RawMidiAdd(0x2F);
 		RawMidiAdd(0x00);
-		/* clear out the final data in the buffer if any */
-		fwrite(capture.midi.buffer,1,capture.midi.used,capture.midi.handle);
-		capture.midi.done+=capture.midi.used;
-		if (fseek(capture.midi.handle, 18, SEEK_SET) != 0) {
-			LOG_WARNING("CAPTURE: Failed seeking in MIDI capture file: %s",
-			            strerror(errno));
-			CaptureState ^= CAPTURE_MIDI;
-			return;
-		}
+		const auto done = static_cast<uint32_t>(capture.midi.file.GetSize() -
+		                                        sizeof(midi_header));
 		uint8_t size[4];
-		size[0]=(uint8_t)(capture.midi.done >> 24);
-		size[1]=(uint8_t)(capture.midi.done >> 16);
-		size[2]=(uint8_t)(capture.midi.done >> 8);
-		size[3]=(uint8_t)(capture.midi.done >> 0);
-		fwrite(&size,1,4,capture.midi.handle);
-		fclose(capture.midi.handle);
-		capture.midi.handle=0;
+		size[0]=(uint8_t)(done >> 24);
+		size[1]=(uint8_t)(done >> 16);
+		size[2]=(uint8_t)(done >> 8);
+		size[3]=(uint8_t)(done >> 0);
+		capture.midi.file.WriteAt(18, size, sizeof(size));
+		capture.midi.file.Close();
 		CaptureState &= ~CAPTURE_MIDI;
 		return;
 	} 
 	CaptureState ^= CAPTURE_MIDI;
 	if (CaptureState & CAPTURE_MIDI) {
 		LOG_MSG("Preparing for raw midi capture, will start with first data.");
-		capture.midi.used=0;
-		capture.midi.done=0;
-		capture.midi.handle=0;
 	} else {
 		LOG_MSG("Stopped capturing raw midi before any data arrived.");
 	}
 }
 
+bool CAPTURE_WantsDisplayImage()
+{
+	return capture_display &&
+	       (CaptureState & (CAPTURE_IMAGE | CAPTURE_VIDEO)) &&
+	       GFX_CanCaptureDisplay();
+}
+
+void CAPTURE_TickDisplayFrame(const float fps)
+{
+	capture.display.fps = fps;
+	capture.display.frames++;
+}
+
+void CAPTURE_AddDisplayImage(const int width, const int height,
+                             const int pitch, const uint8_t *data)
+{
+	if (!capture.display.frames)
+		return;
+
+#if (C_SSHOT)
+	// Only presented frames are read back; the emulated frames in
+	// between are recorded as repeats
+	if (CaptureState & CAPTURE_VIDEO)
+		capture.video.undelivered += capture.display.frames - 1;
+#endif
+	capture.display.frames = 0;
+
+	CAPTURE_AddImage(width, height, 32, pitch, 0, capture.display.fps,
+	                 const_cast<uint8_t *>(data), nullptr);
+}
+
 class HARDWARE final : public Module_base{
 public:
 	HARDWARE(Section* configuration):Module_base(configuration){
 		Section_prop * section = static_cast<Section_prop *>(configuration);
 		Prop_path* proppath= section->Get_path("captures");
 		capturedir = proppath->realpath;
+		capture_format = section->Get_string("capture_format");
+		capture_encoder = section->Get_string("capture_encoder");
+		capture_ffmpeg_options = section->Get_string("capture_ffmpeg_options");
+		capture_display = (section->Get_string("capture_source") ==
+		                   std::string("display"));
+#if (C_SSHOT)
+		const std::string screenshot_format = section->Get_string("screenshot_format");
+		capture.screenshots.SetFormat(
+		        screenshot_format == "qoi"   ? ScreenshotFormat::Qoi
+		        : screenshot_format == "bmp" ? ScreenshotFormat::Bmp
+		                                     : ScreenshotFormat::Png,
+		        section->Get_int("screenshot_png_level"));
+#endif
+
+		const std::string fsync = section->Get_string("capture_fsync");
+		if (fsync == "on_close")
+			CaptureWriter::SetFsync(CaptureFsync::OnClose);
+		else if (fsync == "per_block")
+			CaptureWriter::SetFsync(CaptureFsync::PerBlock);
+		else
+			CaptureWriter::SetFsync(CaptureFsync::Off);
 		CaptureState = 0;
 		MAPPER_AddHandler(CAPTURE_WaveEvent, SDL_SCANCODE_F6,
 		                  PRIMARY_MOD, "recwave", "Rec. Audio");
@@ -840,10 +1005,14 @@ public:
 	}
 	~HARDWARE(){
 #if (C_SSHOT)
-		if (capture.video.handle) CAPTURE_VideoEvent(true);
+		if (capture.video.handle || capture.video.ffmpeg.IsOpen())
+			CAPTURE_VideoEvent(true);
+#endif
+#if (C_SSHOT)
+		capture.screenshots.Stop();
 #endif
-		if (capture.wave.handle) CAPTURE_WaveEvent(true);
-		if (capture.midi.handle) CAPTURE_MidiEvent(true);
+		if (capture.wave.file.IsOpen()) CAPTURE_WaveEvent(true);
+		if (capture.midi.file.IsOpen()) CAPTURE_MidiEvent(true);
 	}
 };
 
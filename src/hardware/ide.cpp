@@ -25,6 +25,7 @@
 #include "setup.h"
 #include "string_utils.h"
 #include "timer.h"
+#include "tracy.h"
 
 #include "../src/dos/cdrom.h"
 
@@ -241,6 +242,7 @@ public:
 	virtual void io_completion();
 	virtual void atapi_cmd_completion();
 	virtual void on_atapi_busy_time();
+	virtual void read_next_block();
 	virtual void read_subchannel();
 	virtual void play_audio_msf();
 	virtual void pause_resume();
@@ -315,6 +317,10 @@ public:
 	double spinup_time = 0.0;
 	double spindown_timeout = 0.0;
 	double cd_insertion_time = 0.0;
+	/* throughput, logged when the controller is removed */
+	uint64_t bytes_read = 0;
+	uint64_t bytes_written = 0;
+	uint32_t commands = 0;
 
 public:
 	IDEController(const uint8_t index,
@@ -957,6 +963,39 @@ void IDEATAPICDROMDevice::read_toc()
 	prepare_read(0, std::min(std::min((uint32_t)(write - sector), host_maximum_byte_count), AllocationLength));
 }
 
+/* reads the next DRQ block of a READ(10) or READ(12) transfer, reading the
+   sectors of the block at once */
+void IDEATAPICDROMDevice::read_next_block()
+{
+	ZoneScopedSubsystem("IDE ATAPI read block");
+	const uint32_t block_sectors = std::clamp(host_maximum_byte_count / 2048, 1u,
+	                                          static_cast<uint32_t>(sizeof(sector) / 2048));
+	const uint32_t n = std::min(TransferLength, block_sectors);
+
+	CDROM_Interface *cdrom = getMSCDEXDrive();
+	bool res = (cdrom != nullptr ? cdrom->ReadSectorsHost(/*buffer*/ sector, false, LBA, n) : false);
+	if (res) {
+		prepare_read(0, std::min((n * 2048), host_maximum_byte_count));
+		controller->bytes_read += sector_total;
+		LBA += n;
+		TransferLength -= n;
+		feature = 0x00;
+		count = 0x02;
+		state = IDE_DEV_DATA_READ;
+		status = IDE_STATUS_DRIVE_READY | IDE_STATUS_DRQ | IDE_STATUS_DRIVE_SEEK_COMPLETE;
+	} else {
+		feature = 0xF4;   /* abort sense=0xF */
+		count = 0x03;     /* no more transfer */
+		sector_total = 0; /*nothing to transfer */
+		TransferLength = 0;
+		state = IDE_DEV_READY;
+		status = IDE_STATUS_DRIVE_READY | IDE_STATUS_ERROR;
+		LOG_WARNING("IDE: ATAPI: Failed to read %lu sectors at %lu", (unsigned long)n,
+		            (unsigned long)LBA);
+		/* TBD: write sense data */
+	}
+}
+
 /* when the ATAPI command has been accepted, and the timeout has passed */
 void IDEATAPICDROMDevice::on_atapi_busy_time()
 {
@@ -1117,24 +1156,7 @@ void IDEATAPICDROMDevice::on_atapi_busy_time()
 			status = IDE_STATUS_DRIVE_READY;
 		} else {
 			/* OK, try to read */
-			CDROM_Interface *cdrom = getMSCDEXDrive();
-			bool res = (cdrom != nullptr ? cdrom->ReadSectorsHost(/*buffer*/ sector, false, LBA, TransferLength)
-			                          : false);
-			if (res) {
-				prepare_read(0, std::min((TransferLength * 2048), host_maximum_byte_count));
-				feature = 0x00;
-				state = IDE_DEV_DATA_READ;
-				status = IDE_STATUS_DRIVE_READY | IDE_STATUS_DRQ | IDE_STATUS_DRIVE_SEEK_COMPLETE;
-			} else {
-				feature = 0xF4;   /* abort sense=0xF */
-				count = 0x03;     /* no more transfer */
-				sector_total = 0; /*nothing to transfer */
-				state = IDE_DEV_READY;
-				status = IDE_STATUS_DRIVE_READY | IDE_STATUS_ERROR;
-				LOG_WARNING("IDE: ATAPI: Failed to read %lu sectors at %lu",
-				        (unsigned long)TransferLength, (unsigned long)LBA);
-				/* TBD: write sense data */
-			}
+			read_next_block();
 		}
 
 		/* ATAPI protocol also says we write back into LBA 23:8 what we're going to transfer in the block */
@@ -1366,7 +1388,18 @@ void IDEATAPICDROMDevice::io_completion()
 
 	/* depending on the command, either continue it or finish up */
 	switch (command) {
-	case 0xA0: /*ATAPI PACKET*/ atapi_io_completion(); break;
+	case 0xA0: /*ATAPI PACKET*/
+		if ((atapi_cmd[0] == 0x28 || atapi_cmd[0] == 0xA8) && TransferLength != 0) {
+			/* READ(10) and READ(12) continue with the next DRQ block */
+			count = 0x02;
+			state = IDE_DEV_ATAPI_BUSY;
+			status = IDE_STATUS_BUSY;
+			PIC_AddEvent(IDE_DelayedCommand, (faked_command ? 0.000001 : 0.01) /*ms*/,
+			             controller->interface_index);
+			break;
+		}
+		atapi_io_completion();
+		break;
 	default: /* most commands: signal drive ready, return to ready state */
 		/* NTS: Some MS-DOS CD-ROM drivers will loop endlessly if we never set "drive seek complete"
 		        because they like to hit the device with DEVICE RESET (08h) whether or not it's
@@ -1628,15 +1661,11 @@ void IDEATAPICDROMDevice::atapi_cmd_completion()
 			TransferLength = ((uint32_t)atapi_cmd[6] << 24UL) | ((uint32_t)atapi_cmd[7] << 16UL) |
 			                 ((uint32_t)atapi_cmd[8] << 8UL) | ((uint32_t)atapi_cmd[9]);
 
-			/* TBD: We actually should NOT be capping the transfer length, but instead should
-			   be breaking the larger transfer into smaller DRQ block transfers like
-			   most IDE ATAPI drives do. Writing the test IDE code taught me that if you
-			   go to most drives and request a transfer length of 0xFFFE the drive will
-			   happily set itself up to transfer that many sectors in one IDE command! */
-			/* NTS: In case you're wondering, it's legal to issue READ(10) with transfer length ==
+			/* NTS: Like most IDE ATAPI drives, larger transfers are broken into DRQ
+			   blocks, which fit both the sector buffer and the host's maximum byte
+			   count. See read_next_block().
+			   In case you're wondering, it's legal to issue READ(10) with transfer length ==
 			   0. MSCDEX.EXE does it when starting up, for example */
-			if ((TransferLength * 2048) > sizeof(sector))
-				TransferLength = sizeof(sector) / 2048;
 
 			count = 0x02;
 			state = IDE_DEV_ATAPI_BUSY;
@@ -1666,15 +1695,11 @@ void IDEATAPICDROMDevice::atapi_cmd_completion()
 			      ((uint32_t)atapi_cmd[4] << 8UL) | ((uint32_t)atapi_cmd[5] << 0UL);
 			TransferLength = ((uint32_t)atapi_cmd[7] << 8) | ((uint32_t)atapi_cmd[8]);
 
-			/* TBD: We actually should NOT be capping the transfer length, but instead should
-			   be breaking the larger transfer into smaller DRQ block transfers like
-			   most IDE ATAPI drives do. Writing the test IDE code taught me that if you
-			   go to most drives and request a transfer length of 0xFFFE the drive will
-			   happily set itself up to transfer that many sectors in one IDE command! */
-			/* NTS: In case you're wondering, it's legal to issue READ(10) with transfer length ==
+			/* NTS: Like most IDE ATAPI drives, larger transfers are broken into DRQ
+			   blocks, which fit both the sector buffer and the host's maximum byte
+			   count. See read_next_block().
+			   In case you're wondering, it's legal to issue READ(10) with transfer length ==
 			   0. MSCDEX.EXE does it when starting up, for example */
-			if ((TransferLength * 2048) > sizeof(sector))
-				TransferLength = sizeof(sector) / 2048;
 
 			count = 0x02;
 			state = IDE_DEV_ATAPI_BUSY;
@@ -2936,6 +2961,7 @@ void IDE_ResetDiskByBIOS(uint8_t disk)
 
 static void IDE_DelayedCommand(uint32_t idx /*which IDE controller*/)
 {
+	ZoneScopedSubsystem("IDE command");
 	IDEDevice *dev = GetIDESelectedDevice(GetIDEController(idx));
 	if (dev == nullptr)
 		return;
@@ -2995,6 +3021,7 @@ static void IDE_DelayedCommand(uint32_t idx /*which IDE controller*/)
 				dev->controller->raise_irq();
 				return;
 			}
+			dev->controller->bytes_written += 512;
 
 			/* NTS: the way this command works is that the drive writes ONE sector, then fires the IRQ
 			        and lets the host read it, then reads another sector, fires the IRQ, etc. One
@@ -3072,6 +3099,7 @@ static void IDE_DelayedCommand(uint32_t idx /*which IDE controller*/)
 				dev->controller->raise_irq();
 				return;
 			}
+			dev->controller->bytes_read += 512;
 
 			/* NTS: the way this command works is that the drive reads ONE sector, then fires the IRQ
 			        and lets the host read it, then reads another sector, fires the IRQ, etc. One
@@ -3200,16 +3228,14 @@ static void IDE_DelayedCommand(uint32_t idx /*which IDE controller*/)
 			if ((512 * ata->multiple_sector_count) > sizeof(ata->sector))
 				E_Exit("SECTOR OVERFLOW");
 
-			for (uint32_t cc = 0; cc < std::min(ata->multiple_sector_count, sectcount); cc++) {
-				/* it would be great if the disk object had a "read
-				 * multiple sectors" member function */
-				if (disk->Read_AbsoluteSector(sectorn + cc, ata->sector + (cc * 512)) != 0) {
-					LOG_WARNING("IDE: ATA read failed");
-					ata->abort_error();
-					dev->controller->raise_irq();
-					return;
-				}
+			sectcount = std::min(ata->multiple_sector_count, sectcount);
+			if (disk->Read_AbsoluteSectors(sectorn, sectcount, ata->sector) != 0) {
+				LOG_WARNING("IDE: ATA read failed");
+				ata->abort_error();
+				dev->controller->raise_irq();
+				return;
 			}
+			dev->controller->bytes_read += 512 * sectcount;
 
 			/* NTS: the way this command works is that the drive reads ONE sector, then fires the IRQ
 			        and lets the host read it, then reads another sector, fires the IRQ, etc. One
@@ -3218,7 +3244,7 @@ static void IDE_DelayedCommand(uint32_t idx /*which IDE controller*/)
 			/* NTS: The sector advance + count decrement is done in the I/O completion function */
 			dev->state = IDE_DEV_DATA_READ;
 			dev->status = IDE_STATUS_DRQ | IDE_STATUS_DRIVE_READY | IDE_STATUS_DRIVE_SEEK_COMPLETE;
-			ata->prepare_read(0, 512 * std::min(ata->multiple_sector_count, sectcount));
+			ata->prepare_read(0, 512 * sectcount);
 			dev->controller->raise_irq();
 			break;
 
@@ -3263,16 +3289,14 @@ static void IDE_DelayedCommand(uint32_t idx /*which IDE controller*/)
 				          ((uint32_t)ata->lba[0] - 1);
 			}
 
-			for (uint32_t cc = 0; cc < std::min(ata->multiple_sector_count, sectcount); cc++) {
-				/* it would be great if the disk object had a "write
-				 * multiple sectors" member function */
-				if (disk->Write_AbsoluteSector(sectorn + cc, ata->sector + (cc * 512)) != 0) {
-					LOG_WARNING("IDE: Failed to write sector");
-					ata->abort_error();
-					dev->controller->raise_irq();
-					return;
-				}
+			if (disk->Write_AbsoluteSectors(sectorn, std::min(ata->multiple_sector_count, sectcount),
+			                                ata->sector) != 0) {
+				LOG_WARNING("IDE: Failed to write sector");
+				ata->abort_error();
+				dev->controller->raise_irq();
+				return;
 			}
+			dev->controller->bytes_written += 512 * std::min(ata->multiple_sector_count, sectcount);
 
 			for (uint32_t cc = 0; cc < std::min(ata->multiple_sector_count, sectcount); cc++) {
 				if ((ata->count & 0xFF) == 1) {
@@ -3864,6 +3888,12 @@ void IDEController::uninstall_io_ports()
 
 IDEController::~IDEController()
 {
+	if (commands)
+		LOG_MSG("IDE: %s controller ran %u commands, reading %.1f MB and writing %.1f MB",
+		        get_controller_name(interface_index), commands,
+		        static_cast<double>(bytes_read) / (1024 * 1024),
+		        static_cast<double>(bytes_written) / (1024 * 1024));
+
 	lower_irq();
 	uninstall_io_ports();
 
@@ -4092,8 +4122,10 @@ static void ide_baseio_w(io_port_t port, io_val_t val, io_width_t width)
 		ide->drivehead = check_cast<uint8_t>(val);
 		break;
 	case 7: /* 1F7 */
-		if (dev)
+		if (dev) {
+			ide->commands++;
 			dev->writecommand(check_cast<uint8_t>(val));
+		}
 		break;
 	}
 }
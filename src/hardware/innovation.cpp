@@ -21,6 +21,9 @@
 
 #include "innovation.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "checks.h"
 #include "control.h"
 #include "pic.h"
@@ -31,7 +34,8 @@ CHECK_NARROWING();
 void Innovation::Open(const std::string &model_choice,
                       const std::string &clock_choice, const int filter_strength_6581,
                       const int filter_strength_8580, const int port_choice,
-                      const std::string &channel_filter_choice)
+                      const std::string &channel_filter_choice,
+                      const std::string &quality_choice)
 {
 	Close();
 
@@ -84,6 +88,7 @@ void Innovation::Open(const std::string &model_choice,
 	                                      {ChannelFeature::Sleep,
 	                                       ChannelFeature::ReverbSend,
 	                                       ChannelFeature::ChorusSend,
+	                                       ChannelFeature::ParallelRender,
 	                                       ChannelFeature::Synthesizer});
 
 	if (!mixer_channel->TryParseAndSetCustomFilter(channel_filter_choice)) {
@@ -97,14 +102,26 @@ void Innovation::Open(const std::string &model_choice,
 
 	const auto frame_rate_hz = mixer_channel->GetSampleRate();
 
-	// Determine the passband frequency, which is capped at 90% of Nyquist.
-	const double passband = 0.9 * frame_rate_hz / 2;
+	// The sinc resampler's cost grows with its passband, which is capped
+	// at 90% of Nyquist; decimating skips the resampler's filter entirely
+	auto sampling_method = reSIDfp::RESAMPLE;
+	auto passband_share  = 0.9;
+	if (quality_choice == "balanced") {
+		passband_share = 0.7;
+	} else if (quality_choice == "fast") {
+		sampling_method = reSIDfp::DECIMATE;
+	} else if (quality_choice != "accurate") {
+		LOG_WARNING("INNOVATION: Invalid 'sid_quality' value: '%s', using 'accurate'",
+		            quality_choice.c_str());
+	}
+	const double passband = passband_share * frame_rate_hz / 2;
 
 	// Assign the sampling parameters
 	sid_service->setSamplingParameters(chip_clock,
-	                                   reSIDfp::RESAMPLE,
+	                                   sampling_method,
 	                                   frame_rate_hz,
 	                                   passband);
+	clocks_per_frame = chip_clock / frame_rate_hz;
 
 	// Setup and assign the port address
 	const auto read_from = std::bind(&Innovation::ReadFromPort, this, _1, _2);
@@ -119,6 +136,8 @@ void Innovation::Open(const std::string &model_choice,
 
 	// Ready state-values for rendering
 	last_rendered_ms = 0.0;
+	writes.Clear();
+	render_frames.clear();
 
 	constexpr auto us_per_s = 1'000'000.0;
 	if (filter_strength == 0)
@@ -163,71 +182,79 @@ uint8_t Innovation::ReadFromPort(io_port_t port, io_width_t)
 	return service->read(sid_port);
 }
 
-void Innovation::WriteToPort(io_port_t port, io_val_t value, io_width_t)
+void Innovation::ApplyWrite(const io_port_t sid_port, const uint8_t data)
 {
-	RenderUpToNow();
-
-	const auto data = check_cast<uint8_t>(value);
-	const auto sid_port = static_cast<io_port_t>(port - base_port);
 	service->write(sid_port, data);
 }
 
-void Innovation::RenderUpToNow()
+void Innovation::WriteToPort(io_port_t port, io_val_t value, io_width_t)
 {
 	const auto now = PIC_FullIndex();
 
-	// Wake up the channel and update the last rendered time datum.
+	// Wake up the channel and restart the render clock from now
 	assert(channel);
-	if (channel->WakeUp()) {
+	if (channel->WakeUp())
 		last_rendered_ms = now;
-		return;
-	}
-	// Keep rendering until we're current
-	while (last_rendered_ms < now) {
-		last_rendered_ms += ms_per_clock;
-		if (float frame = 0.0f; MaybeRenderFrame(frame))
-			fifo.emplace(frame);
-	}
+
+	const auto data = check_cast<uint8_t>(value);
+	const auto sid_port = static_cast<io_port_t>(port - base_port);
+	writes.Enqueue(now, sid_port, data, [this](auto p, auto v) {
+		ApplyWrite(p, v);
+	});
 }
 
-bool Innovation::MaybeRenderFrame(float &frame)
+// Clocks the SID for a run of cycles and adds the frames it produced
+void Innovation::RenderCycles(const int cycles)
 {
 	assert(service);
+	assert(cycles > 0);
 
-	int16_t sample = {0};
+	// Leave room for the resampler's rounding
+	const auto max_frames = static_cast<size_t>(cycles / clocks_per_frame) + 2;
+	if (render_samples.size() < max_frames)
+		render_samples.resize(max_frames);
 
-	const auto frame_is_ready = service->clock(1, &sample);
+	const auto num_frames = service->clock(static_cast<unsigned int>(cycles),
+	                                       render_samples.data());
 
-	// Get the frame
-	if (frame_is_ready)
-		frame = static_cast<float>(sample * 2);
+	for (auto i = 0; i < num_frames; ++i)
+		render_frames.push_back(
+		        static_cast<float>(render_samples[static_cast<size_t>(i)] * 2));
 
-	return frame_is_ready;
+	last_rendered_ms += cycles * ms_per_clock;
 }
 
 void Innovation::AudioCallback(const uint16_t requested_frames)
 {
 	assert(channel);
 
-	//if (fifo.size())
-	//	LOG_MSG("INNOVATION: Queued %2lu cycle-accurate frames", fifo.size());
+	const auto apply_write = [this](auto p, auto v) { ApplyWrite(p, v); };
 
-	auto frames_remaining = requested_frames;
+	// Clock the SID in runs until it has produced the requested frames,
+	// ending each run at the next queued write so the write lands on the
+	// same cycle as when clocking one cycle at a time. The resampler can
+	// produce a frame more than asked for, which is kept for next time.
+	while (render_frames.size() < requested_frames) {
+		writes.ApplyUpTo(last_rendered_ms, apply_write);
 
-	// First, send any frames we've queued since the last callback
-	while (frames_remaining && fifo.size()) {
-		channel->AddSamples_mfloat(1, &fifo.front());
-		fifo.pop();
-		--frames_remaining;
-	}
-	// If the queue's run dry, render the remainder and sync-up our time datum
-	while (frames_remaining) {
-		if (float frame = 0.0f; MaybeRenderFrame(frame)) {
-			channel->AddSamples_mfloat(1, &frame);
+		const auto frames_needed = requested_frames - render_frames.size();
+		auto cycles = static_cast<int>(static_cast<double>(frames_needed) *
+		                               clocks_per_frame);
+
+		if (double next_write_ms = 0.0; writes.GetNextTimestamp(next_write_ms)) {
+			const auto cycles_to_write = static_cast<int>(
+			        std::ceil((next_write_ms - last_rendered_ms) / ms_per_clock));
+			cycles = std::min(cycles, cycles_to_write);
 		}
-		--frames_remaining;
+		RenderCycles(std::max(cycles, 1));
 	}
+	channel->AddSamples_mfloat(requested_frames, render_frames.data());
+	render_frames.erase(render_frames.begin(),
+	                    render_frames.begin() + requested_frames);
+
+	// Catch up with any writes left and sync-up our time datum
 	last_rendered_ms = PIC_FullIndex();
+	writes.ApplyUpTo(last_rendered_ms, apply_write);
 }
 
 Innovation innovation;
@@ -247,13 +274,15 @@ static void innovation_init(Section *sec)
 	const auto filter_strength_6581  = conf->Get_int("6581filter");
 	const auto filter_strength_8580  = conf->Get_int("8580filter");
 	const auto channel_filter_choice = conf->Get_string("innovation_filter");
+	const auto quality_choice        = conf->Get_string("sid_quality");
 
 	innovation.Open(model_choice,
 	                clock_choice,
 	                filter_strength_6581,
 	                filter_strength_8580,
 	                port_choice,
-	                channel_filter_choice);
+	                channel_filter_choice,
+	                quality_choice);
 
 	sec->AddDestroyFunction(&innovation_destroy, true);
 }
@@ -304,6 +333,20 @@ static void init_innovation_dosbox_settings(Section_prop &sec_prop)
 	int_prop->Set_help(
 	        "Adjusts the 8580's filtering strength as a percent from 0 to 100.");
 
+	// Sampling quality
+	str_prop = sec_prop.Add_string("sid_quality", when_idle, "accurate");
+	const char *sid_qualities[] = {"accurate", "balanced", "fast", 0};
+	str_prop->Set_values(sid_qualities);
+	str_prop->Set_help(
+	        "How the SID's output is sampled down to the mixer rate. Rendering a filtered\n"
+	        "6581 at 48 kHz costs roughly the following share of a 3 GHz core:\n"
+	        " - accurate:  Sinc resampling that's accurate up to 90% of the Nyquist\n"
+	        "              frequency (about 5%, default).\n"
+	        " - balanced:  Sinc resampling that's accurate up to 70% of the Nyquist\n"
+	        "              frequency (about 4.5%).\n"
+	        " - fast:      Takes the nearest sample without filtering, which lets high\n"
+	        "              tones alias (about 3%).");
+
 	str_prop = sec_prop.Add_string("innovation_filter", when_idle, "off");
 	assert(str_prop);
 	str_prop->Set_help(
@@ -24,8 +24,8 @@
 #include "dosbox.h"
 
 #include <memory>
-#include <queue>
 #include <string>
+#include <vector>
 
 #include "mixer.h"
 #include "inout.h"
@@ -35,7 +35,8 @@ class Innovation {
 public:
 	void Open(const std::string &model_choice, const std::string &clock_choice,
 	          int filter_strength_6581, int filter_strength_8580,
-	          int port_choice, const std::string &channel_filter_choice);
+	          int port_choice, const std::string &channel_filter_choice,
+	          const std::string &quality_choice);
 
 	void Close();
 	~Innovation()
@@ -44,10 +45,10 @@ public:
 	}
 
 private:
-	bool MaybeRenderFrame(float &frame);
+	void RenderCycles(const int cycles);
+	void ApplyWrite(io_port_t sid_port, uint8_t data);
 	void AudioCallback(const uint16_t requested_frames);
 	uint8_t ReadFromPort(io_port_t port, io_width_t width);
-	void RenderUpToNow();
 	int16_t TallySilence(const int16_t sample);
 	void WriteToPort(io_port_t port, io_val_t value, io_width_t width);
 
@@ -56,11 +57,14 @@ private:
 	IO_ReadHandleObject read_handler      = {};
 	IO_WriteHandleObject write_handler    = {};
 	std::unique_ptr<reSIDfp::SID> service = {};
-	std::queue<float> fifo                = {};
+	DeviceWriteQueue writes               = {};
+	std::vector<float> render_frames      = {};
+	std::vector<int16_t> render_samples   = {};
 
 	// Initial configuration
 	double chip_clock            = 0.0;
 	double ms_per_clock          = 0.0;
+	double clocks_per_frame      = 0.0;
 	io_port_t base_port          = 0;
 	int idle_after_silent_frames = 0;
 
@@ -21,22 +21,24 @@
 
 #include "inout.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <limits>
 #include <cstring>
 #include <unordered_map>
+#include <vector>
 
 #include "setup.h"
 #include "cpu.h"
 #include "../src/cpu/lazyflags.h"
 #include "callback.h"
+#include "pic.h"
+#include "tracy.h"
 
 //#define ENABLE_PORTLOG
 
-// type-sized IO handler containers
-extern std::unordered_map<io_port_t, io_read_f> io_read_handlers[io_widths];
-extern std::unordered_map<io_port_t, io_write_f> io_write_handlers[io_widths];
-
 // type-sized IO handler API
 uint8_t read_byte_from_port(const io_port_t port);
 uint16_t read_word_from_port(const io_port_t port);
@@ -73,6 +75,112 @@ static Bits IOFaultCore(void) {
 }
 
 
+/* Port access profiling
+ * Counts the accesses of each port, width and direction, and the host time
+ * spent in their handlers. The table is logged at shutdown, most expensive
+ * first, and the totals per tick are plotted in Tracy.
+ */
+
+using profile_clock = std::chrono::steady_clock;
+
+struct PortProfile {
+	uint64_t accesses = 0;
+	uint64_t ns = 0;
+};
+
+static struct {
+	bool enabled = false;
+	std::vector<PortProfile> ports = {}; // by width, direction, and port
+	uint32_t tick = 0;
+	uint64_t tick_accesses = 0;
+	uint64_t tick_ns = 0;
+} io_profile;
+
+constexpr size_t profile_index(const io_width_t width, const bool write,
+                               const io_port_t port)
+{
+	const size_t width_index = width == io_width_t::byte   ? 0
+	                           : width == io_width_t::word ? 1
+	                                                       : 2;
+	return ((width_index * 2 + (write ? 1 : 0)) << 16) | port;
+}
+
+class PortProfileScope {
+public:
+	PortProfileScope(const io_width_t width, const bool write, const io_port_t port)
+	{
+		if (GCC_LIKELY(!io_profile.enabled))
+			return;
+		index = profile_index(width, write, port);
+		start = profile_clock::now();
+		active = true;
+	}
+
+	~PortProfileScope()
+	{
+		if (GCC_LIKELY(!active))
+			return;
+		const auto ns = static_cast<uint64_t>(
+		        std::chrono::duration_cast<std::chrono::nanoseconds>(
+		                profile_clock::now() - start)
+		                .count());
+		auto &entry = io_profile.ports[index];
+		++entry.accesses;
+		entry.ns += ns;
+
+		if (io_profile.tick != PIC_Ticks) {
+			TracyPlot("IO port accesses", static_cast<int64_t>(io_profile.tick_accesses));
+			TracyPlot("IO handlers ns", static_cast<int64_t>(io_profile.tick_ns));
+			io_profile.tick = PIC_Ticks;
+			io_profile.tick_accesses = 0;
+			io_profile.tick_ns = 0;
+		}
+		++io_profile.tick_accesses;
+		io_profile.tick_ns += ns;
+	}
+
+	PortProfileScope(const PortProfileScope &) = delete;
+	PortProfileScope &operator=(const PortProfileScope &) = delete;
+
+private:
+	profile_clock::time_point start = {};
+	size_t index = 0;
+	bool active = false;
+};
+
+static void io_profile_report()
+{
+	if (!io_profile.enabled)
+		return;
+
+	std::vector<size_t> used = {};
+	for (size_t i = 0; i < io_profile.ports.size(); ++i)
+		if (io_profile.ports[i].accesses)
+			used.push_back(i);
+	std::sort(used.begin(), used.end(), [](const size_t a, const size_t b) {
+		return io_profile.ports[a].ns > io_profile.ports[b].ns;
+	});
+
+	constexpr size_t max_rows = 32;
+	constexpr const char *widths[] = {"byte", "word", "dword"};
+	LOG_MSG("IOBUS: Port access profile (%d entries), most host time first:",
+	        static_cast<int>(used.size()));
+	LOG_MSG("IOBUS:   port  width  dir      accesses    total ms  ns/access");
+	for (size_t row = 0; row < std::min(used.size(), max_rows); ++row) {
+		const auto i = used[row];
+		const auto &entry = io_profile.ports[i];
+		LOG_MSG("IOBUS:   %04Xh %-6s %-5s %12llu %11.2f %10.1f",
+		        static_cast<unsigned>(i & 0xffff),
+		        widths[i >> 17],
+		        (i >> 16) & 1 ? "write" : "read",
+		        static_cast<unsigned long long>(entry.accesses),
+		        static_cast<double>(entry.ns) / 1e6,
+		        static_cast<double>(entry.ns) / static_cast<double>(entry.accesses));
+	}
+	io_profile.ports.clear();
+	io_profile.enabled = false;
+}
+
 /* Some code to make io operations take some virtual time. Helps certain
  * games with their timing of certain operations
  */
@@ -163,6 +271,192 @@ void log_io(io_width_t width, bool write, io_port_t port, io_val_t val)
 #define log_io(W, X, Y, Z)
 #endif
 
+// Polling fast-forward
+// A program waiting on a port in a tight loop makes the same read from the
+// same instruction over and over, with nothing else changing. Once it has
+// done so often enough, and the device can tell how long the value will
+// stay the same, the remaining cycles up to that time are skipped. Skipping
+// ends with the CPU slice, so the next PIC event is never passed.
+//
+// Counting loops, which time the port by stepping a register on every read,
+// are only skipped on ports registered for them. The number of reads up to
+// the hinted time follows from the cycles each pass takes, and the counters
+// are advanced by that many steps. They're never stepped up to zero or past
+// a 16-bit wrap, so LOOP, DEC/JNZ and overflow exits still happen as usual.
+constexpr int io_poll_repeats = 16;
+constexpr int32_t io_poll_max_loop_cycles = 64;
+
+using io_poll_regs_t = std::array<uint32_t, 8>;
+
+struct IoPollHint {
+	io_poll_f until = {};
+	io_poll_loop_t loop = io_poll_loop_t::waiting;
+};
+
+static struct {
+	bool enabled = false;
+	std::unordered_map<io_port_t, IoPollHint> hints = {};
+
+	// the last read and the machine state it was made in
+	io_port_t port = 0;
+	uint32_t value = 0;
+	uint32_t eip = 0;
+	uint16_t cs = 0;
+	uint32_t tick = 0;
+	int32_t cycles = 0;
+	io_poll_regs_t regs = {};
+	int repeats = 0;
+
+	// how the registers and cycles moved since the read before it
+	io_poll_regs_t steps = {};
+	int32_t loop_cycles = 0;
+} io_poll;
+
+void IO_RegisterPollHint(const io_port_t port, io_poll_f hint,
+                         const io_poll_loop_t loop)
+{
+	io_poll.hints[port] = {std::move(hint), loop};
+}
+
+void IO_FreePollHint(const io_port_t port)
+{
+	io_poll.hints.erase(port);
+}
+
+void IO_SetPollFastForward(const bool enabled)
+{
+	io_poll.enabled = enabled;
+	io_poll.repeats = 0;
+}
+
+// The cycles left in the slice up to the hinted time, or 0 if there's no hint
+static int32_t io_poll_skippable_cycles(const IoPollHint &hint, const io_port_t port)
+{
+	const auto ms = hint.until(port) - PIC_FullIndex();
+	if (ms <= 0)
+		return 0;
+	// to the end of the slice if the hint is io_poll_until_event
+	const auto cycles = ms * CPU_CycleMax;
+	return cycles < CPU_Cycles ? static_cast<int32_t>(cycles) : CPU_Cycles;
+}
+
+static void io_poll_skip_cycles(const int32_t skipped)
+{
+	if (skipped <= 0)
+		return;
+	CPU_Cycles -= skipped;
+	CPU_IODelayRemoved += skipped;
+}
+
+static void io_poll_fast_forward(const io_port_t port)
+{
+	const auto hint = io_poll.hints.find(port);
+	if (hint == io_poll.hints.end() ||
+	    hint->second.loop != io_poll_loop_t::waiting)
+		return;
+	io_poll_skip_cycles(io_poll_skippable_cycles(hint->second, port));
+}
+
+// The most passes a counter can step before reaching zero or wrapping in
+// its low 16 bits, or -1 if it isn't a counter that can be stepped safely
+static int64_t io_poll_counter_passes(const uint32_t reg, const uint32_t step)
+{
+	const auto step16 = static_cast<int16_t>(step & 0xffff);
+	if (step != static_cast<uint32_t>(static_cast<int32_t>(step16)))
+		return -1;
+	const int64_t low = reg & 0xffff;
+	if (step16 < 0)
+		return low > 0 ? (low - 1) / -step16 : 0;
+	return (0xffff - low) / step16;
+}
+
+static void io_poll_fast_forward_counting(const io_port_t port)
+{
+	const auto hint = io_poll.hints.find(port);
+	if (hint == io_poll.hints.end() ||
+	    hint->second.loop != io_poll_loop_t::counting || io_poll.loop_cycles <= 0)
+		return;
+	// a loop that pushes or pops isn't a plain counting loop
+	if (io_poll.steps[7] != 0)
+		return;
+
+	int64_t passes = io_poll_skippable_cycles(hint->second, port) /
+	                 io_poll.loop_cycles;
+	for (size_t i = 0; i < io_poll.steps.size(); ++i) {
+		if (io_poll.steps[i] == 0)
+			continue;
+		const auto limit = io_poll_counter_passes(io_poll.regs[i],
+		                                          io_poll.steps[i]);
+		passes = limit < 0 ? 0 : std::min(passes, limit);
+	}
+	if (passes <= 0)
+		return;
+
+	const auto n = static_cast<uint32_t>(passes);
+	reg_eax += n * io_poll.steps[0];
+	reg_ebx += n * io_poll.steps[1];
+	reg_ecx += n * io_poll.steps[2];
+	reg_edx += n * io_poll.steps[3];
+	reg_esi += n * io_poll.steps[4];
+	reg_edi += n * io_poll.steps[5];
+	reg_ebp += n * io_poll.steps[6];
+	for (size_t i = 0; i < io_poll.regs.size(); ++i)
+		io_poll.regs[i] += n * io_poll.steps[i];
+	io_poll_skip_cycles(static_cast<int32_t>(passes * io_poll.loop_cycles));
+}
+
+static int32_t io_poll_cycles_done()
+{
+	return CPU_CycleMax - CPU_CycleLeft - CPU_Cycles;
+}
+
+static void io_poll_check(const io_port_t port, const uint32_t value,
+                          const uint32_t width_mask)
+{
+	// the read's value lands in the accumulator, so it's left out
+	const io_poll_regs_t regs = {reg_eax & ~width_mask,
+	                             reg_ebx,
+	                             reg_ecx,
+	                             reg_edx,
+	                             reg_esi,
+	                             reg_edi,
+	                             reg_ebp,
+	                             reg_esp};
+	io_poll_regs_t steps = {};
+	for (size_t i = 0; i < regs.size(); ++i)
+		steps[i] = regs[i] - io_poll.regs[i];
+	const auto loop_cycles = io_poll_cycles_done() - io_poll.cycles;
+
+	const bool same_read = port == io_poll.port && value == io_poll.value &&
+	                       reg_eip == io_poll.eip &&
+	                       SegValue(cs) == io_poll.cs &&
+	                       PIC_Ticks == io_poll.tick &&
+	                       loop_cycles <= io_poll_max_loop_cycles;
+	const bool waiting = same_read && regs == io_poll.regs;
+	const bool counting = same_read && !waiting && steps == io_poll.steps &&
+	                      loop_cycles == io_poll.loop_cycles;
+
+	io_poll.regs = regs;
+	io_poll.steps = steps;
+	io_poll.loop_cycles = loop_cycles;
+	if (!waiting && !counting) {
+		io_poll.port = port;
+		io_poll.value = value;
+		io_poll.eip = reg_eip;
+		io_poll.cs = SegValue(cs);
+		io_poll.tick = PIC_Ticks;
+		io_poll.repeats = 0;
+	} else if (++io_poll.repeats >= io_poll_repeats) {
+		if (waiting)
+			io_poll_fast_forward(port);
+		else
+			io_poll_fast_forward_counting(port);
+		io_poll.repeats = 0;
+	}
+	// taken after any skipping, so the next read is measured from here
+	io_poll.cycles = io_poll_cycles_done();
+}
+
 void IO_WriteB(io_port_t port, uint8_t val)
 {
 	log_io(io_width_t::byte, true, port, val);
@@ -194,6 +488,8 @@ void IO_WriteB(io_port_t port, uint8_t val)
 	}
 	else {
 		IO_USEC_write_delay();
+		io_poll.repeats = 0;
+		const PortProfileScope profile(io_width_t::byte, true, port);
 		write_byte_to_port(port, val);
 	}
 }
@@ -229,6 +525,8 @@ void IO_WriteW(io_port_t port, uint16_t val)
 	}
 	else {
 		IO_USEC_write_delay();
+		io_poll.repeats = 0;
+		const PortProfileScope profile(io_width_t::word, true, port);
 		write_word_to_port(port, val);
 	}
 }
@@ -262,6 +560,8 @@ void IO_WriteD(io_port_t port, uint32_t val)
 		lflags = old_lflags;
 		cpudecoder=old_cpudecoder;
 	} else {
+		io_poll.repeats = 0;
+		const PortProfileScope profile(io_width_t::dword, true, port);
 		write_dword_to_port(port, val);
 	}
 }
@@ -298,7 +598,12 @@ uint8_t IO_ReadB(io_port_t port)
 	}
 	else {
 		IO_USEC_read_delay();
-		retval = read_byte_from_port(port);
+		{
+			const PortProfileScope profile(io_width_t::byte, false, port);
+			retval = read_byte_from_port(port);
+		}
+		if (io_poll.enabled)
+			io_poll_check(port, retval, 0xff);
 	}
 	log_io(io_width_t::byte, false, port, retval);
 	return retval;
@@ -335,7 +640,12 @@ uint16_t IO_ReadW(io_port_t port)
 	}
 	else {
 		IO_USEC_read_delay();
-		retval = read_word_from_port(port);
+		{
+			const PortProfileScope profile(io_width_t::word, false, port);
+			retval = read_word_from_port(port);
+		}
+		if (io_poll.enabled)
+			io_poll_check(port, retval, 0xffff);
 	}
 	log_io(io_width_t::word, false, port, retval);
 	return retval;
@@ -370,6 +680,7 @@ uint32_t IO_ReadD(io_port_t port)
 		lflags = old_lflags;
 		cpudecoder=old_cpudecoder;
 	} else {
+		const PortProfileScope profile(io_width_t::dword, false, port);
 		retval = read_dword_from_port(port);
 	}
 
@@ -382,23 +693,19 @@ class IO final : public Module_base {
 public:
 	IO(Section* configuration):Module_base(configuration){
 		iof_queue.used = 0;
+
+		const auto section = static_cast<Section_prop *>(configuration);
+		io_profile.enabled = section->Get_bool("io_port_profile");
+		if (io_profile.enabled) {
+			const auto last = profile_index(io_width_t::dword, true, UINT16_MAX);
+			io_profile.ports.resize(last + 1);
+		}
 	}
 	~IO()
 	{
-		[[maybe_unused]] size_t total_bytes = 0u;
-		for (uint8_t i = 0; i < io_widths; ++i) {
-			const auto readers = io_read_handlers[i].size();
-			const auto writers = io_write_handlers[i].size();
-			DEBUG_LOG_MSG("IOBUS: Releasing %d read and %d write %d-bit port handlers",
-			              static_cast<int>(readers), static_cast<int>(writers), 8 << i);
-
-			total_bytes += readers * sizeof(io_read_f) + sizeof(io_read_handlers[i]);
-			total_bytes += writers * sizeof(io_write_f) + sizeof(io_write_handlers[i]);
-			io_read_handlers[i].clear();
-			io_write_handlers[i].clear();
-		}
-		DEBUG_LOG_MSG("IOBUS: Handlers consumed %d total bytes",
-		              static_cast<int>(total_bytes));
+		io_profile_report();
+		IO_FreeAllHandlers();
+		io_poll.hints.clear();
 	}
 };
 
@@ -21,11 +21,13 @@
 
 #include "dosbox.h"
 
+#include <array>
+#include <bitset>
 #include <cassert>
 #include <cstring>
 #include <functional>
 #include <limits>
-#include <unordered_map>
+#include <memory>
 
 #include "inout.h"
 #include "support.h"
@@ -54,74 +56,134 @@ IO_WriteHandleObject::~IO_WriteHandleObject(){
 	// static_cast<uint32_t>(m_port));
 }
 
+// Handlers are kept in pages of 256 ports, allocated for the pages that have
+// handlers, so finding one takes two indexed loads and no hashing
+template <typename handler_t>
+class IoHandlerTable {
+public:
+	const handler_t *Find(const io_port_t port) const
+	{
+		const auto &page = pages[port >> 8];
+		if (!page)
+			return nullptr;
+		const auto &handler = (*page)[port & 0xff];
+		return handler ? &handler : nullptr;
+	}
+
+	void Set(const io_port_t port, const handler_t &handler)
+	{
+		auto &page = pages[port >> 8];
+		if (!page)
+			page = std::make_unique<Page>();
+		(*page)[port & 0xff] = handler;
+	}
+
+	void Erase(const io_port_t port)
+	{
+		const auto &page = pages[port >> 8];
+		if (page)
+			(*page)[port & 0xff] = nullptr;
+	}
+
+	size_t Size() const
+	{
+		size_t count = 0;
+		for (const auto &page : pages)
+			if (page)
+				for (const auto &handler : *page)
+					count += handler ? 1 : 0;
+		return count;
+	}
+
+	size_t AllocatedBytes() const
+	{
+		size_t bytes = sizeof(pages);
+		for (const auto &page : pages)
+			bytes += page ? sizeof(Page) : 0;
+		return bytes;
+	}
+
+	void Clear()
+	{
+		for (auto &page : pages)
+			page.reset();
+	}
+
+private:
+	using Page = std::array<handler_t, 256>;
+	std::array<std::unique_ptr<Page>, 256> pages = {};
+};
+
 // type-sized IO handlers
-std::unordered_map<io_port_t, io_read_f> io_read_handlers[io_widths] = {};
+static IoHandlerTable<io_read_f> io_read_handlers[io_widths] = {};
 constexpr auto &io_read_byte_handler = io_read_handlers[0];
 constexpr auto &io_read_word_handler = io_read_handlers[1];
 constexpr auto &io_read_dword_handler = io_read_handlers[2];
 
-std::unordered_map<io_port_t, io_write_f> io_write_handlers[io_widths] = {};
+static IoHandlerTable<io_write_f> io_write_handlers[io_widths] = {};
 constexpr auto &io_write_byte_handler = io_write_handlers[0];
 constexpr auto &io_write_word_handler = io_write_handlers[1];
 constexpr auto &io_write_dword_handler = io_write_handlers[2];
 
-constexpr io_val_t blocked_read(const io_port_t, const io_width_t)
-{
-	return 0xff;
-}
+// Ports already reported as unhandled, to only warn once
+static std::bitset<UINT16_MAX + 1> reported_reads = {};
+static std::bitset<UINT16_MAX + 1> reported_writes = {};
 
 // type-sized IO handler API
 uint8_t read_byte_from_port(const io_port_t port)
 {
-	const auto [it, was_blocked] = io_read_byte_handler.emplace(port, blocked_read);
-	if (was_blocked)
+	const auto reader = io_read_byte_handler.Find(port);
+	if (reader)
+		return (*reader)(port, io_width_t::byte) & 0xff;
+
+	if (!reported_reads[port]) {
+		reported_reads[port] = true;
 		LOG(LOG_IO, LOG_WARN)("Unhandled read from port %04Xh; blocking", port);
-	return it->second(port, io_width_t::byte) & 0xff;
+	}
+	return 0xff;
 }
 
 uint16_t read_word_from_port(const io_port_t port)
 {
-	const auto reader = io_read_word_handler.find(port);
-	const auto value = reader != io_read_word_handler.end()
-	                           ? (reader->second(port, io_width_t::word) & 0xffff)
-	                           : static_cast<io_val_t>(
-	                                     read_byte_from_port(port) |
-	                                     (read_byte_from_port(port + 1) << 8));
+	const auto reader = io_read_word_handler.Find(port);
+	const auto value = reader ? ((*reader)(port, io_width_t::word) & 0xffff)
+	                          : static_cast<io_val_t>(
+	                                    read_byte_from_port(port) |
+	                                    (read_byte_from_port(port + 1) << 8));
 	return check_cast<uint16_t>(value);
 }
 
 uint32_t read_dword_from_port(const io_port_t port)
 {
-	const auto reader = io_read_dword_handler.find(port);
-	const auto value = reader != io_read_dword_handler.end()
-	                           ? reader->second(port, io_width_t::dword)
-	                           : static_cast<io_val_t>(
-	                                     read_word_from_port(port) |
-	                                     (read_word_from_port(port + 2) << 16));
+	const auto reader = io_read_dword_handler.Find(port);
+	const auto value = reader ? (*reader)(port, io_width_t::dword)
+	                          : static_cast<io_val_t>(
+	                                    read_word_from_port(port) |
+	                                    (read_word_from_port(port + 2) << 16));
 	assert(value <= UINT32_MAX);
 	return static_cast<uint32_t>(value);
 }
 
-constexpr void blocked_write(const io_port_t, const io_val_t, const io_width_t)
-{
-	// nothing to write to
-}
-
 void write_byte_to_port(const io_port_t port, const uint8_t val)
 {
-	const auto [it, was_blocked] = io_write_byte_handler.emplace(port, blocked_write);
-	if (was_blocked)
+	const auto writer = io_write_byte_handler.Find(port);
+	if (writer) {
+		(*writer)(port, val, io_width_t::byte);
+		return;
+	}
+	if (!reported_writes[port]) {
+		reported_writes[port] = true;
 		LOG(LOG_IO, LOG_WARN)("Unhandled write of value 0x%02x"
 		                      " (%u) to port %04Xh; blocking",
 		                      val, val, port);
-	it->second(port, val, io_width_t::byte);
+	}
 }
 
 void write_word_to_port(const io_port_t port, const uint16_t val)
 {
-	const auto writer = io_write_word_handler.find(port);
-	if (writer != io_write_word_handler.end()) {
-		writer->second(port, val, io_width_t::word);
+	const auto writer = io_write_word_handler.Find(port);
+	if (writer) {
+		(*writer)(port, val, io_width_t::word);
 	} else {
 		write_byte_to_port(port, static_cast<uint8_t>(val & 0xff));
 		write_byte_to_port(port + 1, static_cast<uint8_t>(val >> 8));
@@ -130,9 +192,9 @@ void write_word_to_port(const io_port_t port, const uint16_t val)
 
 void write_dword_to_port(const io_port_t port, const uint32_t val)
 {
-	const auto writer = io_write_dword_handler.find(port);
-	if (writer != io_write_dword_handler.end()) {
-		writer->second(port, val, io_width_t::dword);
+	const auto writer = io_write_dword_handler.Find(port);
+	if (writer) {
+		(*writer)(port, val, io_width_t::dword);
 	} else {
 		write_word_to_port(port, static_cast<uint16_t>(val & 0xffff));
 		write_word_to_port(port + 2, static_cast<uint16_t>(val >> 16));
@@ -145,11 +207,11 @@ void IO_RegisterReadHandler(io_port_t port,
                             io_port_t range)
 {
 	while (range--) {
-		io_read_byte_handler[port] = handler;
+		io_read_byte_handler.Set(port, handler);
 		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_read_word_handler[port] = handler;
+			io_read_word_handler.Set(port, handler);
 		if (max_width == io_width_t::dword)
-			io_read_dword_handler[port] = handler;
+			io_read_dword_handler.Set(port, handler);
 		++port;
 	}
 }
@@ -160,11 +222,11 @@ void IO_RegisterWriteHandler(io_port_t port,
                              io_port_t range)
 {
 	while (range--) {
-		io_write_byte_handler[port] = handler;
+		io_write_byte_handler.Set(port, handler);
 		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_write_word_handler[port] = handler;
+			io_write_word_handler.Set(port, handler);
 		if (max_width == io_width_t::dword)
-			io_write_dword_handler[port] = handler;
+			io_write_dword_handler.Set(port, handler);
 		++port;
 	}
 }
@@ -174,11 +236,11 @@ void IO_FreeReadHandler(io_port_t port,
                         io_port_t range)
 {
 	while (range--) {
-		io_read_byte_handler.erase(port);
+		io_read_byte_handler.Erase(port);
 		if (max_width == io_width_t::word || max_width == io_width_t::dword)
-			io_read_word_handler.erase(port);
+			io_read_word_handler.Erase(port);
 		if (max_width == io_width_t::dword)
-			io_read_dword_handler.erase(port);
+			io_read_dword_handler.Erase(port);
 		++port;
 	}
 }
@@ -188,15 +250,33 @@ void IO_FreeWriteHandler(io_port_t port,
                          io_port_t range)
 {
 	while (range--) {
-		io_write_byte_handler.erase(port);
+		io_write_byte_handler.Erase(port);
 		if (width == io_width_t::word || width == io_width_t::dword)
-			io_write_word_handler.erase(port);
+			io_write_word_handler.Erase(port);
 		if (width == io_width_t::dword)
-			io_write_dword_handler.erase(port);
+			io_write_dword_handler.Erase(port);
 		++port;
 	}
 }
 
+void IO_FreeAllHandlers()
+{
+	[[maybe_unused]] size_t total_bytes = 0u;
+	for (uint8_t i = 0; i < io_widths; ++i) {
+		const auto readers = io_read_handlers[i].Size();
+		const auto writers = io_write_handlers[i].Size();
+		DEBUG_LOG_MSG("IOBUS: Releasing %d read and %d write %d-bit port handlers",
+		              static_cast<int>(readers), static_cast<int>(writers), 8 << i);
+
+		total_bytes += io_read_handlers[i].AllocatedBytes();
+		total_bytes += io_write_handlers[i].AllocatedBytes();
+		io_read_handlers[i].Clear();
+		io_write_handlers[i].Clear();
+	}
+	DEBUG_LOG_MSG("IOBUS: Handlers consumed %d total bytes",
+	              static_cast<int>(total_bytes));
+}
+
 void IO_ReadHandleObject::Install(const io_port_t port,
                                   const io_read_f handler,
                                   const io_width_t max_width,
@@ -26,6 +26,9 @@
 #include <time.h>
 #include <stdio.h>
 
+#include <chrono>
+#include <memory>
+
 #include "cross.h"
 #include "string_utils.h"
 #include "cpu.h"
@@ -39,8 +42,14 @@
 #include "ipx.h"
 #include "ipxserver.h"
 #include "timer.h"
+#include "metrics.h"
 #include "programs.h"
 #include "pic.h"
+#include "spsc_queue_impl.h"
+#include "tracy.h"
+
+// The receivers' inboxes are the only queues of datagrams
+template class SpscQueue<IpxDatagram>;
 
 #define SOCKTABLESIZE	150 // DOS IPX driver was limited to 150 open sockets
 
@@ -55,7 +64,9 @@ bool isIpxConnected;
 IPaddress ipxServConnIp;			// IPAddress for client connection to server
 UDPsocket ipxClientSocket;
 int UDPChannel;						// Channel used by UDP connection
-uint8_t recvBuffer[IPXBUFFERSIZE];	// Incoming packet buffer
+static std::unique_ptr<IpxReceiver> clientReceiver;
+static IpxDatagram heldPacket;		// Received packet waiting for a taker
+static bool isPacketHeld;
 
 static RealPt ipx_callback;
 
@@ -80,6 +91,68 @@ void PackIP(IPaddress ipAddr, PackedIP *ipPack) {
 	ipPack->port = ipAddr.port;
 }
 
+// How long the receiver waits on its socket before checking if it's stopping
+constexpr int receiver_wait_ms = 100;
+
+// Datagrams received beyond this are dropped, as a full socket buffer would
+constexpr size_t max_received_datagrams = 256;
+
+IpxReceiver::IpxReceiver(UDPsocket udp_socket)
+        : socket(udp_socket),
+          inbox(max_received_datagrams)
+{
+	socket_set = SDLNet_AllocSocketSet(1);
+	if (socket_set)
+		SDLNet_UDP_AddSocket(socket_set, socket);
+	else
+		LOG_WARNING("IPX: Can't wait for network data: %s",
+		            SDLNet_GetError());
+	thread = std::thread([this] { Run(); });
+}
+
+IpxReceiver::~IpxReceiver()
+{
+	is_stopping = true;
+	thread.join();
+	if (socket_set)
+		SDLNet_FreeSocketSet(socket_set);
+}
+
+bool IpxReceiver::Take(IpxDatagram &datagram)
+{
+	if (inbox.IsEmpty())
+		return false;
+	datagram = inbox.Dequeue();
+	return true;
+}
+
+void IpxReceiver::Run()
+{
+	std::vector<uint8_t> buffer(IPXBUFFERSIZE);
+	UDPpacket packet = {};
+	packet.data      = buffer.data();
+	packet.maxlen    = IPXBUFFERSIZE;
+
+	while (!is_stopping) {
+		// Without a socket set, fall back to checking every wait
+		if (!socket_set)
+			std::this_thread::sleep_for(
+			        std::chrono::milliseconds(receiver_wait_ms));
+		else if (SDLNet_CheckSockets(socket_set, receiver_wait_ms) <= 0)
+			continue;
+
+		while (SDLNet_UDP_Recv(socket, &packet) > 0) {
+			// Only the emulation thread takes datagrams out, so the
+			// inbox can't fill up after this check
+			if (packet.len < static_cast<int>(sizeof(IPXHeader)) ||
+			    inbox.Size() >= inbox.MaxCapacity())
+				continue;
+			inbox.Enqueue({packet.address,
+			               {buffer.begin(), buffer.begin() + packet.len}});
+		}
+	}
+}
+
 ECBClass *ECBList;  // Linked list of ECB's
 ECBClass* ESRList;	// ECBs waiting to be ESR notified
 
@@ -605,16 +678,36 @@ static void receivePacket(uint8_t *buffer, int16_t bufSize) {
 	LOG_IPX("IPX: RX Packet loss!");
 }
 
+// Whether a received packet would be taken by a listening ECB or answered
+// as a ping
+static bool isPacketExpected(const IpxDatagram &datagram) {
+	const auto header = reinterpret_cast<const IPXHeader *>(datagram.data.data());
+	const uint16_t useSocket = SDLNet_Read16(header->dest.socket);
+	if (useSocket == 0x2)
+		return true;
+	for (auto ecb = ECBList; ecb != NULL; ecb = ecb->nextECB)
+		if (ecb->iuflag == USEFLAG_LISTENING && ecb->mysocket == useSocket)
+			return true;
+	return false;
+}
+
 static void IPX_ClientLoop(void) {
-	int numrecv;
-	UDPpacket inPacket;
-	inPacket.data = (Uint8 *)recvBuffer;
-	inPacket.maxlen = IPXBUFFERSIZE;
-	inPacket.channel = UDPChannel;
-
-	// Its amazing how much simpler UDP is than TCP
-	numrecv = SDLNet_UDP_Recv(ipxClientSocket, &inPacket);
-	if(numrecv) receivePacket(inPacket.data, inPacket.len);
+	ZoneScopedSubsystem("IPX client loop");
+	// All the received packets are handed over while they have takers.
+	// The first one without waits for the next tick, as the program may
+	// still be putting its ECBs back to listen, and is lost if there's
+	// still no taker then.
+	bool isFirst = true;
+	while (isPacketHeld || clientReceiver->Take(heldPacket)) {
+		isPacketHeld = true;
+		if (!isFirst && !isPacketExpected(heldPacket))
+			return;
+		receivePacket(heldPacket.data.data(),
+		              static_cast<int16_t>(heldPacket.data.size()));
+		METRICS_Add(Metric::IpxPacketsReceived);
+		isPacketHeld = false;
+		isFirst = false;
+	}
 }
 
 
@@ -623,6 +716,8 @@ void DisconnectFromServer(bool unexpected) {
 	if(incomingPacket.connected) {
 		incomingPacket.connected = false;
 		TIMER_DelTickHandler(&IPX_ClientLoop);
+		clientReceiver.reset();
+		isPacketHeld = false;
 		SDLNet_UDP_Close(ipxClientSocket);
 	}
 }
@@ -723,6 +818,7 @@ static void sendPacket(ECBClass* sendecb) {
 			return;
 		} else {
 			sendecb->setCompletionFlag(COMP_SUCCESS);
+			METRICS_Add(Metric::IpxPacketsSent);
 			LOG_IPX("Packet sent: size: %d",packetsize);
 		}
 	}
@@ -737,17 +833,9 @@ static void sendPacket(ECBClass* sendecb) {
 }
 
 static bool pingCheck(IPXHeader * outHeader) {
-	char buffer[1024];
-	UDPpacket regPacket;
-	IPXHeader *regHeader;
-	regPacket.data = (Uint8 *)buffer;
-	regPacket.maxlen = sizeof(buffer);
-	regPacket.channel = UDPChannel;
-	regHeader = (IPXHeader *)buffer;
-
-	const int result = SDLNet_UDP_Recv(ipxClientSocket, &regPacket);
-	if (result != 0) {
-		memcpy(outHeader, regHeader, sizeof(IPXHeader));
+	IpxDatagram datagram;
+	if (clientReceiver->Take(datagram)) {
+		memcpy(outHeader, datagram.data.data(), sizeof(IPXHeader));
 		return true;
 	}
 	return false;
@@ -824,6 +912,7 @@ bool ConnectToServer(char const *strAddr) {
 				LOG_MSG("IPX: Connected to server.  IPX address is %d:%d:%d:%d:%d:%d", CONVIPX(localIpxAddr.netnode));
 
 				incomingPacket.connected = true;
+				clientReceiver = std::make_unique<IpxReceiver>(ipxClientSocket);
 				TIMER_AddTickHandler(&IPX_ClientLoop);
 				return true;
 			}
@@ -22,8 +22,10 @@
 
 #include "ipxserver.h"
 #include "timer.h"
+#include "tracy.h"
 #include <stdlib.h>
 #include <string.h>
+#include <memory>
 #include "ipx.h"
 
 constexpr int UDP_UNICAST = -1; // SDLNet magic number
@@ -33,7 +35,7 @@ UDPsocket ipxServerSocket;  // Listening server socket
 
 packetBuffer connBuffer[SOCKETTABLESIZE];
 
-uint8_t inBuffer[IPXBUFFERSIZE];
+static std::unique_ptr<IpxReceiver> serverReceiver;
 IPaddress ipconn[SOCKETTABLESIZE];  // Active TCP/IP connection
 UDPsocket tcpconn[SOCKETTABLESIZE]; // Active TCP/IP connections
 SDLNet_SocketSet serverSocketSet;
@@ -146,62 +148,64 @@ static void ackClient(IPaddress clientAddr) {
 		        SDLNet_GetError());
 }
 
-static void IPX_ServerLoop() {
-	UDPpacket inPacket;
+static void handlePacket(IpxDatagram &inPacket) {
 	IPaddress tmpAddr;
 
 	//char regString[] = "IPX Register\0";
 
 	uint32_t host;
 
-	inPacket.channel = -1;
-	inPacket.data = &inBuffer[0];
-	inPacket.maxlen = IPXBUFFERSIZE;
-
-	const int result = SDLNet_UDP_Recv(ipxServerSocket, &inPacket);
-	if (result != 0) {
-		// Check to see if incoming packet is a registration packet
-		// For this, I just spoofed the echo protocol packet designation 0x02
-		IPXHeader *tmpHeader;
-		tmpHeader = (IPXHeader *)&inBuffer[0];
-
-		// Check to see if echo packet
-		if(SDLNet_Read16(tmpHeader->dest.socket) == 0x2) {
-			// Null destination node means its a server registration packet
-			if(tmpHeader->dest.addr.byIP.host == 0x0) {
-				UnpackIP(tmpHeader->src.addr.byIP, &tmpAddr);
-				for (uint16_t i = 0; i < SOCKETTABLESIZE; ++i) {
-					if(!connBuffer[i].connected) {
-						// Use prefered host IP rather than the reported source IP
-						// It may be better to use the reported source
-						ipconn[i] = inPacket.address;
-
-						connBuffer[i].connected = true;
-						host = ipconn[i].host;
-						LOG_MSG("IPXSERVER: Connect from %d.%d.%d.%d", CONVIP(host));
+	// Check to see if incoming packet is a registration packet
+	// For this, I just spoofed the echo protocol packet designation 0x02
+	IPXHeader *tmpHeader;
+	tmpHeader = (IPXHeader *)inPacket.data.data();
+
+	// Check to see if echo packet
+	if(SDLNet_Read16(tmpHeader->dest.socket) == 0x2) {
+		// Null destination node means its a server registration packet
+		if(tmpHeader->dest.addr.byIP.host == 0x0) {
+			UnpackIP(tmpHeader->src.addr.byIP, &tmpAddr);
+			for (uint16_t i = 0; i < SOCKETTABLESIZE; ++i) {
+				if(!connBuffer[i].connected) {
+					// Use prefered host IP rather than the reported source IP
+					// It may be better to use the reported source
+					ipconn[i] = inPacket.address;
+
+					connBuffer[i].connected = true;
+					host = ipconn[i].host;
+					LOG_MSG("IPXSERVER: Connect from %d.%d.%d.%d", CONVIP(host));
+					ackClient(inPacket.address);
+					return;
+				} else {
+					if((ipconn[i].host == tmpAddr.host) && (ipconn[i].port == tmpAddr.port)) {
+
+						LOG_MSG("IPXSERVER: Reconnect from %d.%d.%d.%d", CONVIP(tmpAddr.host));
+						// Update anonymous port number if changed
+						ipconn[i].port = inPacket.address.port;
 						ackClient(inPacket.address);
 						return;
-					} else {
-						if((ipconn[i].host == tmpAddr.host) && (ipconn[i].port == tmpAddr.port)) {
-
-							LOG_MSG("IPXSERVER: Reconnect from %d.%d.%d.%d", CONVIP(tmpAddr.host));
-							// Update anonymous port number if changed
-							ipconn[i].port = inPacket.address.port;
-							ackClient(inPacket.address);
-							return;
-						}
 					}
 				}
 			}
 		}
-
-		// IPX packet is complete.  Now interpret IPX header and send to respective IP address
-		sendIPXPacket((uint8_t *)inPacket.data, inPacket.len);
 	}
+
+	// IPX packet is complete.  Now interpret IPX header and send to respective IP address
+	sendIPXPacket(inPacket.data.data(),
+	              static_cast<int16_t>(inPacket.data.size()));
+}
+
+static void IPX_ServerLoop() {
+	ZoneScopedSubsystem("IPX server loop");
+	// Forward all the packets received since the last tick
+	IpxDatagram inPacket;
+	while (serverReceiver->Take(inPacket))
+		handlePacket(inPacket);
 }
 
 void IPX_StopServer() {
 	TIMER_DelTickHandler(&IPX_ServerLoop);
+	serverReceiver.reset();
 	SDLNet_UDP_Close(ipxServerSocket);
 }
 
@@ -215,6 +219,7 @@ bool IPX_StartServer(uint16_t portnum)
 		for (uint16_t i = 0; i < SOCKETTABLESIZE; ++i)
 			connBuffer[i].connected = false;
 
+		serverReceiver = std::make_unique<IpxReceiver>(ipxServerSocket);
 		TIMER_AddTickHandler(&IPX_ServerLoop);
 		return true;
 	}
@@ -242,6 +242,24 @@ static uint8_t read_p201_timed(io_port_t, io_width_t)
 	return ret;
 }
 
+// The time the next axis bit drops, for programs counting how long it stays set
+static double poll_p201_timed(io_port_t)
+{
+	const auto now = PIC_FullIndex();
+	auto next = io_poll_until_event; // buttons only change between slices
+	auto consider = [&](const double tick) {
+		if (tick >= now && tick < next)
+			next = tick;
+	};
+	for (const auto &s : stick) {
+		if (s.enabled) {
+			consider(s.xtick);
+			consider(s.ytick);
+		}
+	}
+	return next;
+}
+
 static void write_p201(io_port_t, io_val_t, io_width_t)
 {
 	/* Store writetime index */
@@ -602,12 +620,18 @@ public:
 			WriteHandler.Install(0x201,
 			                     wants_timed ? write_p201_timed : write_p201,
 			                     io_width_t::byte);
+			// Programs read the axes by counting passes of a polling
+			// loop until the timed one-shots expire
+			if (wants_timed)
+				IO_RegisterPollHint(0x201, poll_p201_timed,
+				                    io_poll_loop_t::counting);
 		}
 	}
 	~JOYSTICK() {
 		// No-op if IO handlers were not installed
 		WriteHandler.Uninstall();
 		ReadHandler.Uninstall();
+		IO_FreePollHint(0x201);
 	}
 };
 
@@ -24,6 +24,7 @@
 #include "pic.h"
 #include "mem.h"
 #include "mixer.h"
+#include "replay.h"
 #include "timer.h"
 #include "support.h"
 
@@ -309,6 +310,8 @@ static uint8_t read_p64(io_port_t, io_width_t)
 }
 
 void KEYBOARD_AddKey(KBD_KEYS keytype,bool pressed) {
+	if (!REPLAY_PassKey(keytype, pressed))
+		return;
 	uint8_t ret=0;bool extend=false;
 	switch (keytype) {
 	case KBD_esc:ret=1;break;
@@ -477,6 +480,8 @@ void KEYBOARD_Init(Section* /*sec*/) {
 		IO_RegisterReadHandler(0x62, read_p62, io_width_t::byte);
 	IO_RegisterWriteHandler(0x64, write_p64, io_width_t::byte);
 	IO_RegisterReadHandler(0x64, read_p64, io_width_t::byte);
+	// new scancodes arrive from timer ticks, PIC events and host input
+	IO_RegisterPollHint(0x64, [](io_port_t) { return io_poll_until_event; });
 	TIMER_AddTickHandler(&KEYBOARD_TickHandler);
 	write_p61(0, 0, io_width_t::byte);
 	/* Init the keyb struct */
@@ -91,7 +91,7 @@ void LptDac::RenderUpToNow()
 	assert(ms_per_frame > 0.0);
 	while (last_rendered_ms < now) {
 		last_rendered_ms += ms_per_frame;
-		render_queue.emplace(Render());
+		render_queue.Enqueue(Render());
 	}
 }
 
@@ -102,11 +102,12 @@ void LptDac::AudioCallback(const uint16_t requested_frames)
 	auto frames_remaining = requested_frames;
 
 	// First, add any frames we've queued since the last callback
-	while (frames_remaining && render_queue.size()) {
-		channel->AddSamples_sfloat(1, &render_queue.front()[0]);
-		render_queue.pop();
-		--frames_remaining;
-	}
+	const auto add_frames = [&](const AudioFrame *frames, const size_t n) {
+		channel->AddSamples_sfloat(check_cast<uint16_t>(n), &frames[0][0]);
+	};
+	frames_remaining = check_cast<uint16_t>(
+	        frames_remaining -
+	        render_queue.DequeueBulk(frames_remaining, add_frames));
 	// If the queue's run dry, render the remainder and sync-up our time datum
 	while (frames_remaining) {
 		const auto frame = Render();
@@ -129,7 +130,7 @@ LptDac::~LptDac()
 
 	channel->Enable(false);
 
-	render_queue = {};
+	render_queue.Clear();
 }
 
 std::unique_ptr<LptDac> lpt_dac = {};
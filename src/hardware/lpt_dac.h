@@ -23,7 +23,6 @@
 
 #include "dosbox.h"
 
-#include <queue>
 #include <string>
 
 #include "inout.h"
@@ -52,8 +51,8 @@ protected:
 	virtual AudioFrame Render() = 0;
 	void RenderUpToNow();
 	void AudioCallback(const uint16_t requested_frames);
-	std::queue<AudioFrame> render_queue = {};
-	mixer_channel_t channel             = {};
+	DeviceFrameQueue<AudioFrame> render_queue = {};
+	mixer_channel_t channel                   = {};
 
 	double last_rendered_ms = 0.0;
 	double ms_per_frame     = 0.0;
@@ -19,12 +19,26 @@
 
 #include "mem.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <string.h>
+#include <vector>
+
+#if defined(WIN32)
+#include <memoryapi.h>
+#elif defined(HAVE_MMAP)
+#include <sys/mman.h>
+#endif
 
 #include "inout.h"
+#include "memory_report.h"
 #include "setup.h"
 #include "paging.h"
 #include "regs.h"
+#include "snapshot.h"
 #include "support.h"
 
 #define PAGES_IN_BLOCK	((1024*1024)/MEM_PAGE_SIZE)
@@ -57,7 +71,142 @@ static struct MemoryBlock {
 	} a20;
 } memory;
 
-alignas(host_pagesize) uint8_t MemBase[MAX_MEMORY*1024*1024];
+// Guest RAM is mapped when the memory module starts, so the host only
+// commits the pages the guest touches. The mapping always spans
+// MAX_MEMORY: the page table walks and DMA read physical addresses the
+// guest controls, and those read zeroes above the configured RAM rather
+// than leaving the host's memory.
+HostPt MemBase = nullptr;
+static size_t membase_size = 0;
+static bool membase_hugetlb = false;
+
+constexpr size_t huge_page_size = 2 * 1024 * 1024;
+constexpr size_t membase_reserve = MAX_MEMORY * 1024 * 1024;
+
+static HostPt map_memory([[maybe_unused]] const size_t size, const std::string &huge_pages)
+{
+#if defined(WIN32)
+	if (huge_pages != "off")
+		LOG_WARNING("MEMORY: Huge pages aren't supported on this host");
+	return static_cast<HostPt>(VirtualAlloc(nullptr, membase_reserve,
+	                                        MEM_COMMIT | MEM_RESERVE,
+	                                        PAGE_READWRITE));
+#elif defined(HAVE_MMAP)
+	constexpr int prot_flags = PROT_READ | PROT_WRITE;
+	constexpr int map_flags = MAP_PRIVATE | MAP_ANON | MAP_NORESERVE;
+	if (huge_pages == "transparent") {
+#if defined(HAVE_MADV_HUGEPAGE)
+		// map a huge page more, to place the memory on a huge page boundary
+		const auto ptr = mmap(nullptr, membase_reserve + huge_page_size,
+		                      prot_flags, map_flags, -1, 0);
+		if (ptr == MAP_FAILED)
+			return nullptr;
+		const auto start = reinterpret_cast<uintptr_t>(ptr);
+		const auto aligned = (start + huge_page_size - 1) & ~(huge_page_size - 1);
+		if (aligned > start)
+			munmap(ptr, aligned - start);
+		const auto tail = huge_page_size - (aligned - start);
+		if (tail)
+			munmap(reinterpret_cast<void *>(aligned + membase_reserve), tail);
+		madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+		return reinterpret_cast<HostPt>(aligned);
+#else
+		LOG_WARNING("MEMORY: Transparent huge pages aren't supported on this host");
+#endif
+	}
+	const auto ptr = mmap(nullptr, membase_reserve, prot_flags, map_flags, -1, 0);
+	if (ptr == MAP_FAILED)
+		return nullptr;
+	if (huge_pages == "reserved") {
+#if defined(HAVE_MAP_HUGETLB)
+		// only the RAM itself is backed by the huge page pool, reserved
+		// up front so touching it later can't fail
+		constexpr int hugetlb_flags = MAP_PRIVATE | MAP_ANON | MAP_FIXED |
+		                              MAP_HUGETLB;
+		if (mmap(ptr, size, prot_flags, hugetlb_flags, -1, 0) != MAP_FAILED) {
+			membase_hugetlb = true;
+		} else {
+			LOG_WARNING("MEMORY: No reserved huge pages are available (errno %d), using normal pages",
+			            errno);
+			// a failed fixed mapping may have dropped the range
+			if (mmap(ptr, size, prot_flags, map_flags | MAP_FIXED, -1, 0) == MAP_FAILED) {
+				munmap(ptr, membase_reserve);
+				return nullptr;
+			}
+		}
+#else
+		LOG_WARNING("MEMORY: Reserved huge pages aren't supported on this host");
+#endif
+	}
+	return static_cast<HostPt>(ptr);
+#else
+	if (huge_pages != "off")
+		LOG_WARNING("MEMORY: Huge pages aren't supported on this host");
+	return static_cast<HostPt>(calloc(membase_reserve, 1));
+#endif
+}
+
+static void unmap_memory()
+{
+	if (!MemBase)
+		return;
+#if defined(WIN32)
+	VirtualFree(MemBase, 0, MEM_RELEASE);
+#elif defined(HAVE_MMAP)
+	munmap(MemBase, membase_reserve);
+#else
+	free(MemBase);
+#endif
+	MEMREPORT_Add(MemoryUser::GuestRam, -static_cast<int64_t>(membase_size));
+	MemBase = nullptr;
+	membase_size = 0;
+	membase_hugetlb = false;
+}
+
+// The shared RAM file holds the RAM followed by a tag telling which
+// snapshot it belongs to. It's replaced rather than rewritten, as other
+// instances can still be using the pages of the previous one.
+static bool write_shared_memory(const std::string &path, const size_t bytes,
+                                const uint64_t tag)
+{
+	const auto temp_path = path + ".tmp";
+	FILE *f = fopen(temp_path.c_str(), "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(MemBase, bytes, 1, f) == 1 &&
+	          fwrite(&tag, sizeof(tag), 1, f) == 1;
+	ok = (fclose(f) == 0) && ok;
+	remove(path.c_str());
+	if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+		remove(temp_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+static bool read_shared_memory(const std::string &path, const size_t bytes,
+                               const uint64_t tag)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+	uint64_t file_tag = 0;
+	bool ok = fseek(f, static_cast<long>(bytes), SEEK_SET) == 0 &&
+	          fread(&file_tag, sizeof(file_tag), 1, f) == 1 &&
+	          fgetc(f) == EOF && file_tag == tag;
+#if defined(HAVE_MMAP) && !defined(WIN32)
+	// hugetlb mappings can't be partly replaced by file pages
+	if (ok && !membase_hugetlb &&
+	    mmap(MemBase, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+	         fileno(f), 0) != MAP_FAILED) {
+		fclose(f);
+		return true;
+	}
+#endif
+	ok = ok && fseek(f, 0, SEEK_SET) == 0 && fread(MemBase, bytes, 1, f) == 1;
+	fclose(f);
+	return ok;
+}
 
 class IllegalPageHandler final : public PageHandler {
 public:
@@ -66,28 +215,16 @@ public:
 	}
 	uint8_t readb(PhysPt addr)
 	{
-#if C_DEBUG
-		LOG_MSG("Illegal read from %x, CS:IP %8x:%8x",addr,SegValue(cs),reg_eip);
-#else
-		static Bits lcount=0;
-		if (lcount<1000) {
-			lcount++;
+		static LogRateLimiter limiter(100, 1000);
+		if (limiter.Allow())
 			LOG_MSG("Illegal read from %x, CS:IP %8x:%8x",addr,SegValue(cs),reg_eip);
-		}
-#endif
 		return 0xff;
 	}
 	void writeb(PhysPt addr, [[maybe_unused]] uint8_t val)
 	{
-#if C_DEBUG
-		LOG_MSG("Illegal write to %x, CS:IP %8x:%8x",addr,SegValue(cs),reg_eip);
-#else
-		static Bits lcount=0;
-		if (lcount<1000) {
-			lcount++;
+		static LogRateLimiter limiter(100, 1000);
+		if (limiter.Allow())
 			LOG_MSG("Illegal write to %x, CS:IP %8x:%8x",addr,SegValue(cs),reg_eip);
-		}
-#endif
 	}
 };
 
@@ -126,6 +263,174 @@ static IllegalPageHandler illegal_page_handler;
 static RAMPageHandler ram_page_handler;
 static ROMPageHandler rom_page_handler;
 
+// Dirty page tracking
+// ~~~~~~~~~~~~~~~~~~~
+// While tracking, the RAM pages written since the last time the dirty pages
+// were taken are the ones with the normal RAM page handler. The clean pages
+// get a handler that isn't writeable, so the TLB sends the first write to
+// each of them here, where the page gets back its normal handler. Pages with
+// any other handler, such as those holding the dynamic core's code, are
+// written without this handler seeing it, so they always count as dirty.
+bool mem_tracking_dirty_pages = false;
+static std::vector<uint8_t> dirty_pages = {}; // per page, set when written
+
+// Write watches share the protection with the tracking above
+bool mem_watching_writes = false;
+static std::vector<uint8_t> watched_pages = {}; // per page, set while watched
+static size_t watched_page_count = 0;
+static std::vector<mem_write_watch_f> write_watch_handlers = {};
+
+static void end_write_watch(const Bitu phys_page)
+{
+	if (phys_page >= watched_pages.size() || !watched_pages[phys_page])
+		return;
+	watched_pages[phys_page] = 0;
+	mem_watching_writes = --watched_page_count > 0;
+	for (const auto handler : write_watch_handlers)
+		handler(phys_page);
+}
+
+class WriteTrackingPageHandler final : public PageHandler {
+public:
+	WriteTrackingPageHandler()
+	{
+		flags = PFLAG_READABLE;
+	}
+	HostPt GetHostReadPt(Bitu phys_page) override
+	{
+		return MemBase + phys_page * MEM_PAGE_SIZE;
+	}
+	uint8_t readb(PhysPt addr) override
+	{
+		return host_readb(host_address(addr));
+	}
+	uint16_t readw(PhysPt addr) override
+	{
+		return host_readw(host_address(addr));
+	}
+	uint32_t readd(PhysPt addr) override
+	{
+		return host_readd(host_address(addr));
+	}
+	void writeb(PhysPt addr, uint8_t val) override
+	{
+		host_writeb(unprotect(addr), val);
+	}
+	void writew(PhysPt addr, uint16_t val) override
+	{
+		host_writew(unprotect(addr), val);
+	}
+	void writed(PhysPt addr, uint32_t val) override
+	{
+		host_writed(unprotect(addr), val);
+	}
+
+	// Marks the page dirty and links it writeable again for the writes
+	// that follow
+	static HostPt unprotect(const PhysPt addr)
+	{
+		const auto phys_addr = PAGING_GetPhysicalAddress(addr);
+		const auto phys_page = phys_addr / MEM_PAGE_SIZE;
+		if (mem_tracking_dirty_pages)
+			dirty_pages[phys_page] = 1;
+		memory.phandlers[phys_page] = &ram_page_handler;
+		PAGING_UnlinkPages(addr / MEM_PAGE_SIZE, 1);
+		end_write_watch(phys_page);
+		return MemBase + phys_addr;
+	}
+
+private:
+	static HostPt host_address(const PhysPt addr)
+	{
+		return MemBase + PAGING_GetPhysicalAddress(addr);
+	}
+};
+
+static WriteTrackingPageHandler write_tracking_page_handler;
+
+void MEM_MarkDirty(const PhysPt addr, const size_t bytes)
+{
+	if (!bytes)
+		return;
+	const auto end_page = std::min(static_cast<size_t>(memory.pages),
+	                               (addr + bytes - 1) / MEM_PAGE_SIZE + 1);
+	for (auto page = addr / MEM_PAGE_SIZE; page < end_page; ++page) {
+		if (mem_tracking_dirty_pages)
+			dirty_pages[page] = 1;
+		end_write_watch(page);
+	}
+}
+
+void MEM_TrackDirtyPages(const bool enabled)
+{
+	if (enabled == mem_tracking_dirty_pages)
+		return;
+	mem_tracking_dirty_pages = enabled;
+	if (enabled) {
+		// Nothing is known about the pages written before
+		dirty_pages.assign(memory.pages, 1);
+		return;
+	}
+	// the watched pages stay protected
+	for (Bitu page = 0; page < memory.pages; ++page)
+		if (memory.phandlers[page] == &write_tracking_page_handler &&
+		    (page >= watched_pages.size() || !watched_pages[page]))
+			memory.phandlers[page] = &ram_page_handler;
+	dirty_pages.clear();
+	PAGING_ClearTLB();
+}
+
+std::vector<uint32_t> MEM_TakeDirtyPages()
+{
+	std::vector<uint32_t> pages = {};
+	if (!mem_tracking_dirty_pages)
+		return pages;
+
+	for (uint32_t page = 0; page < memory.pages; ++page) {
+		const auto handler = memory.phandlers[page];
+		if (handler == &write_tracking_page_handler && !dirty_pages[page])
+			continue;
+		pages.push_back(page);
+		dirty_pages[page] = 0;
+		if (handler == &ram_page_handler)
+			memory.phandlers[page] = &write_tracking_page_handler;
+	}
+	// Drop the writeable links to the pages protected again
+	if (!pages.empty())
+		PAGING_ClearTLB();
+	return pages;
+}
+
+void MEM_AddWriteWatchHandler(const mem_write_watch_f handler)
+{
+	if (std::find(write_watch_handlers.begin(), write_watch_handlers.end(),
+	              handler) == write_watch_handlers.end())
+		write_watch_handlers.push_back(handler);
+}
+
+bool MEM_WatchWrites(const Bitu phys_page)
+{
+	if (phys_page >= memory.pages)
+		return false;
+	if (watched_pages.size() != memory.pages)
+		watched_pages.assign(memory.pages, 0);
+	if (watched_pages[phys_page])
+		return true;
+
+	const auto handler = memory.phandlers[phys_page];
+	if (handler == &ram_page_handler) {
+		memory.phandlers[phys_page] = &write_tracking_page_handler;
+		// Drop the writeable links to the page, from any linear address
+		PAGING_ClearTLB();
+	} else if (handler != &write_tracking_page_handler) {
+		return false;
+	}
+	watched_pages[phys_page] = 1;
+	++watched_page_count;
+	mem_watching_writes = true;
+	return true;
+}
+
 void MEM_SetLFB(Bitu page, Bitu pages, PageHandler *handler, PageHandler *mmiohandler) {
 	memory.lfb.handler=handler;
 	memory.lfb.mmiohandler=mmiohandler;
@@ -149,6 +454,10 @@ PageHandler * MEM_GetPageHandler(Bitu phys_page) {
 
 void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
 	for (;pages>0;pages--) {
+		// the page may be written without the tracking handler seeing it
+		if (mem_tracking_dirty_pages && phys_page < memory.pages)
+			dirty_pages[phys_page] = 1;
+		end_write_watch(phys_page);
 		memory.phandlers[phys_page]=handler;
 		phys_page++;
 	}
@@ -156,6 +465,7 @@ void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
 
 void MEM_ResetPageHandler(Bitu phys_page, Bitu pages) {
 	for (;pages>0;pages--) {
+		end_write_watch(phys_page);
 		memory.phandlers[phys_page]=&ram_page_handler;
 		phys_page++;
 	}
@@ -176,25 +486,109 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 	mem_writeb_inline(dest,0);
 }
 
+// The host memory behind a linear address, linking its page first if it
+// hasn't been accessed since the TLB was cleared
+static HostPt host_pointer(const PhysPt address, const bool for_write)
+{
+	const auto lookup = [=]() {
+		return for_write ? get_tlb_write(address) : get_tlb_read(address);
+	};
+	HostPt base = lookup();
+	// With paging, linking a page could raise a page fault
+	if (!base && !PAGING_Enabled()) {
+		if (for_write && get_tlb_writehandler(address) == &write_tracking_page_handler)
+			WriteTrackingPageHandler::unprotect(address);
+		PAGING_ForcePageInit(address);
+		base = lookup();
+	}
+	return base ? base + address : nullptr;
+}
+
+// The block functions move the part of a block within a page at once when
+// the page is plain RAM, linking it first if needed. Otherwise a single byte
+// goes through the page handler, which can fill the TLB entry for the rest
+// of the page.
+static inline Bitu bytes_left_in_page(const PhysPt address)
+{
+	return MEM_PAGE_SIZE - (address & (MEM_PAGE_SIZE - 1));
+}
+
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	while (size) {
+		const auto chunk = std::min({size, bytes_left_in_page(src),
+		                             bytes_left_in_page(dest)});
+		const HostPt from = host_pointer(src, false);
+		const HostPt to = from ? host_pointer(dest, true) : nullptr;
+		if (!from || !to) {
+			mem_writeb_inline(dest++, mem_readb_inline(src++));
+			--size;
+			continue;
+		}
+		if (to <= from || to >= from + chunk) {
+			memmove(to, from, chunk);
+		} else {
+			// copy forwards like the byte loop, repeating the overlap
+			for (Bitu i = 0; i < chunk; ++i)
+				to[i] = from[i];
+		}
+		src += static_cast<PhysPt>(chunk);
+		dest += static_cast<PhysPt>(chunk);
+		size -= chunk;
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	uint8_t * write=reinterpret_cast<uint8_t *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	while (size) {
+		const HostPt read = host_pointer(pt, false);
+		if (!read) {
+			*write++ = mem_readb_inline(pt++);
+			--size;
+			continue;
+		}
+		const auto chunk = std::min(size, bytes_left_in_page(pt));
+		memcpy(write, read, chunk);
+		pt += static_cast<PhysPt>(chunk);
+		write += chunk;
+		size -= chunk;
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt, const void *data, size_t size)
 {
 	const uint8_t *read = static_cast<const uint8_t *>(data);
-	while (size--) {
-		mem_writeb_inline(pt++,*read++);
+	while (size) {
+		const HostPt write = host_pointer(pt, true);
+		const auto chunk = std::min(size, static_cast<size_t>(bytes_left_in_page(pt)));
+		if (!write) {
+			// Video memory handlers can take the whole span at once
+			const auto handler = get_tlb_writehandler(pt);
+			if (!(handler->flags & PFLAG_WRITESPAN)) {
+				mem_writeb_inline(pt++, *read++);
+				--size;
+				continue;
+			}
+			handler->write_span(pt, read, static_cast<uint32_t>(chunk));
+		} else {
+			memcpy(write, read, chunk);
+		}
+		pt += static_cast<PhysPt>(chunk);
+		read += chunk;
+		size -= chunk;
 	}
 }
 
+HostPt MEM_GetHostBlock(const PhysPt pt, const size_t size, const bool for_write)
+{
+	const HostPt block = host_pointer(pt, for_write);
+	if (!block)
+		return nullptr;
+	for (auto offset = bytes_left_in_page(pt); offset < size; offset += MEM_PAGE_SIZE)
+		if (host_pointer(pt + static_cast<PhysPt>(offset), for_write) != block + offset)
+			return nullptr;
+	return block;
+}
+
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size) {
 	mem_memcpy(dest,src,size);
 }
@@ -574,6 +968,41 @@ void MEM_PreparePCJRCartRom()
 
 HostPt GetMemBase(void) { return MemBase; }
 
+// The page handlers and links only depend on the configuration
+static void memory_snapshot(SnapshotStream &s)
+{
+	auto pages = static_cast<uint32_t>(memory.pages);
+	s.Pod(pages);
+	if (pages != memory.pages) {
+		s.Fail();
+		return;
+	}
+	const size_t bytes = memory.pages * MEM_PAGE_SIZE;
+	const auto shared_path = SNAPSHOT_SharedMemoryPath();
+	auto shared = !shared_path.empty();
+	s.Pod(shared);
+	if (s.ExcludesRam()) {
+		// kept by the caller
+	} else if (!shared) {
+		s.Bytes(MemBase, bytes);
+	} else {
+		auto tag = static_cast<uint64_t>(
+		        std::chrono::system_clock::now().time_since_epoch().count());
+		s.Pod(tag);
+		if (shared_path.empty())
+			s.Fail();
+		else if (!s.IsLoading() && !write_shared_memory(shared_path, bytes, tag))
+			s.Fail();
+		else if (s.IsLoading() && !read_shared_memory(shared_path, bytes, tag))
+			s.Fail();
+	}
+	if (s.IsLoading() && !s.ExcludesRam() &&
+	    (mem_tracking_dirty_pages || mem_watching_writes))
+		MEM_MarkDirty(0, bytes);
+	s.Bytes(memory.mhandles, memory.pages * sizeof(memory.mhandles[0]));
+	s.Pod(memory.a20);
+}
+
 class MEMORY final : public Module_base {
 private:
 	IO_ReadHandleObject ReadHandler{};
@@ -598,8 +1027,14 @@ public:
 			LOG_MSG("Memory sizes above %d MB are NOT recommended.",SAFE_MEMORY - 1);
 			LOG_MSG("Stick with the default values unless you are absolutely certain.");
 		}
-		memset((void*)MemBase, 0, memsize * 1024 * 1024);
-		memory.pages = (memsize * 1024 * 1024) / 4096;
+		// whole huge pages, so the last one can be backed by one too
+		const size_t bytes = memsize * 1024 * 1024;
+		membase_size = (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+		MemBase = map_memory(membase_size, section->Get_string("huge_pages"));
+		if (!MemBase)
+			E_Exit("MEMORY: Can't allocate %u MiB for the emulated memory", memsize);
+		memory.pages = bytes / 4096;
+		MEMREPORT_Add(MemoryUser::GuestRam, static_cast<int64_t>(membase_size));
 		LOG_MSG("MEMORY: Base address: %p", static_cast<void *>(MemBase));
 		LOG_MSG("MEMORY: Using %d DOS memory pages (%u MiB)",
 		        static_cast<int>(memory.pages), memsize);
@@ -628,6 +1063,12 @@ public:
 		WriteHandler.Install(0x92, write_p92, io_width_t::byte);
 		ReadHandler.Install(0x92, read_p92, io_width_t::byte);
 		InitA20();
+		SNAPSHOT_AddComponent("memory", memory_snapshot);
+	}
+
+	~MEMORY()
+	{
+		unmap_memory();
 	}
 };
 
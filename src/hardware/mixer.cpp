@@ -26,12 +26,18 @@
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <map>
+#include <mutex>
 #include <set>
+#include <string_view>
 #include <sys/types.h>
+#include <thread>
+#include <vector>
 
 #if defined (WIN32)
 //Midi listing
@@ -42,22 +48,34 @@
 #include <mmsystem.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIXER_SIMD 1
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define MIXER_SIMD 1
+#endif
+
 #include <SDL.h>
 #include <speex/speex_resampler.h>
 
 #include "ansi_code_markup.h"
 #include "control.h"
 #include "cross.h"
+#include "cycle_telemetry.h"
 #include "hardware.h"
 #include "mapper.h"
 #include "math_utils.h"
 #include "mem.h"
+#include "memory_report.h"
+#include "metrics.h"
 #include "midi.h"
 #include "mixer.h"
 #include "pic.h"
 #include "programs.h"
 #include "setup.h"
 #include "string_utils.h"
+#include "thread_control.h"
 #include "timer.h"
 #include "tracy.h"
 
@@ -95,8 +113,181 @@ static constexpr int16_t MIXER_CLIP(const int sample)
 	return static_cast<int16_t>(sample);
 }
 
+/* Two interleaved stereo frames at a time, for the bulk conversion and
+ * mixing of the channels' samples */
+#if defined(MIXER_SIMD)
+#if defined(__SSE2__) || defined(_M_X64)
+using sample_vec = __m128;
+static inline sample_vec samples_load(const float *p) { return _mm_loadu_ps(p); }
+static inline void samples_store(float *p, const sample_vec v) { _mm_storeu_ps(p, v); }
+static inline sample_vec samples_set(const float l, const float r) { return _mm_setr_ps(l, r, l, r); }
+static inline sample_vec samples_add(const sample_vec a, const sample_vec b) { return _mm_add_ps(a, b); }
+static inline sample_vec samples_mul(const sample_vec a, const sample_vec b) { return _mm_mul_ps(a, b); }
+// [l0 r0 l1 r1] to [l0 l0 l1 l1] and [r0 r0 r1 r1]
+static inline sample_vec samples_dup_left(const sample_vec v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0)); }
+static inline sample_vec samples_dup_right(const sample_vec v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1)); }
+// Four mono samples [a b c d] to [a a b b] and [c c d d]
+static inline sample_vec samples_dup_low(const sample_vec v) { return _mm_unpacklo_ps(v, v); }
+static inline sample_vec samples_dup_high(const sample_vec v) { return _mm_unpackhi_ps(v, v); }
+static inline sample_vec samples_from_s16(const int16_t *p)
+{
+	const auto v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+// Flipping the sign bit turns unsigned samples into signed ones
+static inline sample_vec samples_from_u16(const uint16_t *p)
+{
+	const auto u = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+	const auto v = _mm_xor_si128(u, _mm_set1_epi16(INT16_MIN));
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+#else
+using sample_vec = float32x4_t;
+static inline sample_vec samples_load(const float *p) { return vld1q_f32(p); }
+static inline void samples_store(float *p, const sample_vec v) { vst1q_f32(p, v); }
+static inline sample_vec samples_set(const float l, const float r) { const float lr[4] = {l, r, l, r}; return vld1q_f32(lr); }
+static inline sample_vec samples_add(const sample_vec a, const sample_vec b) { return vaddq_f32(a, b); }
+static inline sample_vec samples_mul(const sample_vec a, const sample_vec b) { return vmulq_f32(a, b); }
+static inline sample_vec samples_dup_left(const sample_vec v) { return vtrn1q_f32(v, v); }
+static inline sample_vec samples_dup_right(const sample_vec v) { return vtrn2q_f32(v, v); }
+static inline sample_vec samples_dup_low(const sample_vec v) { return vzip1q_f32(v, v); }
+static inline sample_vec samples_dup_high(const sample_vec v) { return vzip2q_f32(v, v); }
+static inline sample_vec samples_from_s16(const int16_t *p) { return vcvtq_f32_s32(vmovl_s16(vld1_s16(p))); }
+static inline sample_vec samples_from_u16(const uint16_t *p) { return vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vmovl_u16(vld1_u16(p))), vdupq_n_s32(32768))); }
+#endif
+#endif
+
+// Converts native signed or unsigned 16-bit samples to interleaved stereo
+// frames
+template <bool stereo, class Type>
+static void convert_16bit_frames(const Type *in, const int num_frames, float *out)
+{
+	static_assert(std::is_same_v<Type, int16_t> || std::is_same_v<Type, uint16_t>);
+	constexpr auto is_signed = std::is_same_v<Type, int16_t>;
+
+	auto i = 0;
+#if defined(MIXER_SIMD)
+	auto load = [](const Type *p) {
+		if constexpr (is_signed)
+			return samples_from_s16(p);
+		else
+			return samples_from_u16(p);
+	};
+	if constexpr (stereo) {
+		for (; i + 2 <= num_frames; i += 2)
+			samples_store(out + i * 2, load(in + i * 2));
+	} else {
+		for (; i + 4 <= num_frames; i += 4) {
+			const auto v = load(in + i);
+			samples_store(out + i * 2, samples_dup_low(v));
+			samples_store(out + i * 2 + 4, samples_dup_high(v));
+		}
+	}
+#endif
+	auto to_float = [](const Type sample) {
+		if constexpr (is_signed)
+			return static_cast<float>(sample);
+		else
+			return static_cast<float>(static_cast<int>(sample) - 32768);
+	};
+	for (; i < num_frames; ++i) {
+		out[i * 2 + 0] = to_float(in[stereo ? i * 2 + 0 : i]);
+		out[i * 2 + 1] = to_float(in[stereo ? i * 2 + 1 : i]);
+	}
+}
+
+// Copies float samples to interleaved stereo frames
+template <bool stereo>
+static void convert_float_frames(const float *in, const int num_frames, float *out)
+{
+	if constexpr (stereo) {
+		std::copy(in, in + num_frames * 2, out);
+		return;
+	}
+	auto i = 0;
+#if defined(MIXER_SIMD)
+	for (; i + 4 <= num_frames; i += 4) {
+		const auto v = samples_load(in + i);
+		samples_store(out + i * 2, samples_dup_low(v));
+		samples_store(out + i * 2 + 4, samples_dup_high(v));
+	}
+#endif
+	for (; i < num_frames; ++i) {
+		out[i * 2 + 0] = in[i];
+		out[i * 2 + 1] = in[i];
+	}
+}
+
+// Scales the left and right samples of interleaved frames
+static void scale_frames(float *frames, const int num_frames, const AudioFrame gain)
+{
+	auto i = 0;
+#if defined(MIXER_SIMD)
+	const auto g = samples_set(gain.left, gain.right);
+	for (; i + 2 <= num_frames; i += 2)
+		samples_store(frames + i * 2,
+		              samples_mul(samples_load(frames + i * 2), g));
+#endif
+	for (; i < num_frames; ++i) {
+		frames[i * 2 + 0] *= gain.left;
+		frames[i * 2 + 1] *= gain.right;
+	}
+}
+
+// Pans the left and right samples of interleaved frames into the stereo field
+// using the -6dB linear pan law (pan: 0.0 = left, 0.5 = center, 1.0 = right)
+static void crossfeed_frames(float *frames, const int num_frames,
+                             const float pan_left, const float pan_right)
+{
+	auto i = 0;
+#if defined(MIXER_SIMD)
+	const auto from_left  = samples_set(1.0f - pan_left, pan_left);
+	const auto from_right = samples_set(1.0f - pan_right, pan_right);
+	for (; i + 2 <= num_frames; i += 2) {
+		const auto v = samples_load(frames + i * 2);
+		samples_store(frames + i * 2,
+		              samples_add(samples_mul(samples_dup_left(v), from_left),
+		                          samples_mul(samples_dup_right(v), from_right)));
+	}
+#endif
+	for (; i < num_frames; ++i) {
+		const auto l = frames[i * 2 + 0];
+		const auto r = frames[i * 2 + 1];
+		frames[i * 2 + 0] = (1.0f - pan_left) * l + (1.0f - pan_right) * r;
+		frames[i * 2 + 1] = pan_left * l + pan_right * r;
+	}
+}
+
+// Adds interleaved frames, scaled by the gain, to a bus
+static void accumulate_frames(const float *frames, const int num_frames,
+                              const float gain, float *bus)
+{
+	auto i = 0;
+#if defined(MIXER_SIMD)
+	const auto g = samples_set(gain, gain);
+	for (; i + 2 <= num_frames; i += 2) {
+		const auto scaled = samples_mul(samples_load(frames + i * 2), g);
+		samples_store(bus + i * 2,
+		              samples_add(samples_load(bus + i * 2), scaled));
+	}
+#endif
+	for (; i < num_frames; ++i) {
+		bus[i * 2 + 0] += frames[i * 2 + 0] * gain;
+		bus[i * 2 + 1] += frames[i * 2 + 1] * gain;
+	}
+}
+
 using highpass_filter_t = std::array<Iir::Butterworth::HighPass<2>, 2>;
 
+// Host time accounting for the MIXER /STATS view
+using stats_clock = std::chrono::steady_clock;
+
+static int64_t ns_between(const stats_clock::time_point start,
+                          const stats_clock::time_point end)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
 using EmVerb = MVerb<float>;
 
 enum class ReverbPreset { None, Tiny, Small, Medium, Large, Huge };
@@ -115,6 +306,9 @@ struct reverb_settings_t {
 	float digital_audio_send_level = 0.0f;
 	float highpass_cutoff_freq     = 1.0f;
 
+	// Skipped while no channel sends to it
+	bool is_idle = false;
+
 	void Setup(const float predelay, const float early_mix, const float size,
 	           const float density, const float bandwidth_freq,
 	           const float decay, const float dampening_freq,
@@ -165,14 +359,217 @@ struct chorus_settings_t {
 	}
 };
 
+// The frames mixed by the emulation thread on each tick, waiting to be played
+// by SDL's audio callback. Only the emulation thread pushes (the producer) and
+// only the callback pops (the consumer), so neither side ever waits on the
+// other.
+class OutputQueue {
+public:
+	// Returns the number of frames queued for playback; exact when called by
+	// either side, a lower or upper bound on the other's progress
+	int Size() const
+	{
+		return static_cast<int>(write_index.load(std::memory_order_acquire) -
+		                        read_index.load(std::memory_order_acquire));
+	}
+
+	// Producer: queues as many frames as fit, returning how many did
+	int Push(const AudioFrame *in, const int num_frames)
+	{
+		const auto w    = write_index.load(std::memory_order_relaxed);
+		const auto r    = read_index.load(std::memory_order_acquire);
+		const auto room = capacity - static_cast<int>(w - r);
+		const auto n    = std::min(num_frames, room);
+
+		for (auto i = 0; i < n; ++i)
+			frames[(w + i) & mask] = in[i];
+
+		write_index.store(w + n, std::memory_order_release);
+		return n;
+	}
+
+	// Consumer: dequeues up to the requested frames, returning how many
+	int Pop(AudioFrame *out, const int num_frames)
+	{
+		const auto r = read_index.load(std::memory_order_relaxed);
+		const auto w = write_index.load(std::memory_order_acquire);
+		const auto n = std::min(num_frames, static_cast<int>(w - r));
+
+		for (auto i = 0; i < n; ++i)
+			out[i] = frames[(r + i) & mask];
+
+		read_index.store(r + n, std::memory_order_release);
+		return n;
+	}
+
+	// Drops the queued frames; only while the consumer isn't running
+	void Clear()
+	{
+		read_index.store(write_index.load());
+	}
+
+	static constexpr int capacity = MIXER_BUFSIZE;
+
+private:
+	static constexpr uint32_t mask = capacity - 1;
+	static_assert((capacity & mask) == 0, "the capacity is a power of two");
+
+	std::array<AudioFrame, capacity> frames = {};
+
+	// Free-running counts of the frames pushed and popped
+	std::atomic<uint32_t> write_index = 0;
+	std::atomic<uint32_t> read_index  = 0;
+};
+
+using mix_buffer_t = matrix<float, MIXER_BUFSIZE, 2>;
+
+// The buffers the channels mix into: the master output and the reverb and
+// chorus sends. The sends are only allocated once a channel sends to them.
+struct mix_buffers_t {
+	mix_buffer_t work = {};
+	std::unique_ptr<mix_buffer_t> aux_reverb = {};
+	std::unique_ptr<mix_buffer_t> aux_chorus = {};
+
+	mix_buffers_t()
+	{
+		MEMREPORT_Add(MemoryUser::MixerBuffers, sizeof(mix_buffer_t));
+	}
+
+	~mix_buffers_t()
+	{
+		const auto num_buffers = 1 + (aux_reverb ? 1 : 0) + (aux_chorus ? 1 : 0);
+		MEMREPORT_Add(MemoryUser::MixerBuffers,
+		              -static_cast<int64_t>(num_buffers * sizeof(mix_buffer_t)));
+	}
+
+	mix_buffer_t &Reverb()
+	{
+		return Allocate(aux_reverb);
+	}
+
+	mix_buffer_t &Chorus()
+	{
+		return Allocate(aux_chorus);
+	}
+
+private:
+	static mix_buffer_t &Allocate(std::unique_ptr<mix_buffer_t> &buffer)
+	{
+		if (GCC_UNLIKELY(!buffer)) {
+			buffer = std::make_unique<mix_buffer_t>();
+			MEMREPORT_Add(MemoryUser::MixerBuffers, sizeof(mix_buffer_t));
+		}
+		return *buffer;
+	}
+};
+
+// Mixes the channels that can render concurrently on a few worker threads,
+// with the calling thread mixing its share of the channels as well
+class ParallelMixPool {
+public:
+	~ParallelMixPool()
+	{
+		Stop();
+	}
+
+	void Start(const int num_workers)
+	{
+		Stop();
+		should_stop = false;
+		for (auto i = 0; i < num_workers; ++i)
+			workers.emplace_back(&ParallelMixPool::Work, this);
+	}
+
+	void Stop()
+	{
+		{
+			std::lock_guard lock(mutex);
+			should_stop = true;
+		}
+		work_available.notify_all();
+		for (auto &worker : workers)
+			worker.join();
+		workers.clear();
+	}
+
+	bool IsRunning() const
+	{
+		return !workers.empty();
+	}
+
+	// Mixes the channels' frames, returning once they're all done
+	void Mix(const std::vector<MixerChannel *> &channels, const int frames)
+	{
+		std::unique_lock lock(mutex);
+		queue            = channels;
+		next_channel     = 0;
+		channels_done    = 0;
+		frames_requested = frames;
+		work_available.notify_all();
+
+		MixQueued(lock);
+		work_done.wait(lock, [this] { return channels_done == queue.size(); });
+		queue.clear();
+		next_channel = 0;
+	}
+
+private:
+	void MixQueued(std::unique_lock<std::mutex> &lock)
+	{
+		while (next_channel < queue.size()) {
+			const auto channel = queue[next_channel++];
+
+			lock.unlock();
+			channel->Mix(frames_requested);
+			lock.lock();
+
+			if (++channels_done == queue.size())
+				work_done.notify_one();
+		}
+	}
+
+	void Work()
+	{
+		std::unique_lock lock(mutex);
+		while (true) {
+			work_available.wait(lock, [this] {
+				return should_stop || next_channel < queue.size();
+			});
+			if (should_stop)
+				return;
+			MixQueued(lock);
+		}
+	}
+
+	std::vector<std::thread> workers       = {};
+	std::mutex mutex                       = {};
+	std::condition_variable work_available = {};
+	std::condition_variable work_done      = {};
+	std::vector<MixerChannel *> queue      = {};
+	size_t next_channel                    = 0;
+	size_t channels_done                   = 0;
+	int frames_requested                   = 0;
+	bool should_stop                       = false;
+};
+
 struct mixer_t {
 	// complex types
-	matrix<float, MIXER_BUFSIZE, 2> work = {};
-	matrix<float, MIXER_BUFSIZE, 2> aux_reverb = {};
-	matrix<float, MIXER_BUFSIZE, 2> aux_chorus = {};
+	mix_buffers_t buffers = {};
+
+	// Renders the channels that support it in parallel, if enabled
+	ParallelMixPool parallel_mix_pool             = {};
+	std::vector<MixerChannel *> parallel_channels = {};
+
+	// Planar scratch buffers for the reverb and chorus
+	std::vector<float> effect_left  = {};
+	std::vector<float> effect_right = {};
 
-	std::vector<float> resample_temp = {};
-	std::vector<float> resample_out = {};
+	OutputQueue output_queue = {};
+	std::vector<AudioFrame> output_frames = {};
+
+	// Guards the channels and the work buffers against threads other than
+	// the emulation thread; the audio callback never takes it
+	std::recursive_mutex mutex = {};
 
 	AudioFrame master_volume = {1.0f, 1.0f};
 	std::map<std::string, mixer_channel_t> channels = {};
@@ -181,10 +578,29 @@ struct mixer_t {
 	std::atomic<work_index_t> pos = 0;
 	std::atomic<int> frames_done = 0;
 	std::atomic<int> frames_needed = 0;
-	std::atomic<int> min_frames_needed = 0;
-	std::atomic<int> max_frames_needed = 0;
 	std::atomic<int> tick_add = 0; // samples needed per millisecond tick
 
+	// The frames mixed since startup, whether or not they were played
+	int64_t frames_mixed = 0;
+
+	// The frames left queued after each callback, which the emulation
+	// steers towards the latency target by mixing more or fewer frames
+	std::atomic<int> frames_queued_after_callback = 0;
+	int latency_target_frames = 0;
+	int max_queued_frames     = 0; // beyond this, newly mixed frames are dropped
+
+	std::atomic<int> underruns = 0; // callbacks played as silence
+	std::atomic<int> overruns  = 0; // ticks that dropped mixed frames
+
+	// Measured by the audio callback since the stats were last taken, for
+	// the device period and latency in the MIXER /STATS view
+	struct {
+		std::atomic<int64_t> last_callback_ns = 0;
+		std::atomic<int64_t> intervals_ns     = 0;
+		std::atomic<int64_t> queued_frames    = 0;
+		std::atomic<int> num_callbacks        = 0;
+	} callback_stats = {};
+
 	int tick_counter = 0;
 	std::atomic<int> sample_rate = 0; // sample rate negotiated with SDL
 	uint16_t blocksize = 0; // matches SDL AudioSpec.samples type
@@ -202,20 +618,86 @@ struct mixer_t {
 
 	chorus_settings_t chorus = {};
 	bool do_chorus = false;
+
+	// Resample with precomputed polyphase filters instead of Speex where
+	// the rates allow
+	bool use_polyphase_resampler = false;
+
+	// Receives the mixed output as it's captured, such as to checksum it
+	MIXER_OutputTap output_tap = nullptr;
+
+	// Keep fast-forwarded audio from reaching the speakers as choppy,
+	// sped-up fragments
+	bool mute_fast_forward = true;
+
+	// Host time spent on the master effects since the stats were last
+	// taken, for the MIXER /STATS view
+	struct {
+		int64_t effects_ns               = 0;
+		stats_clock::time_point taken_at = {};
+	} stats = {};
 };
 
 static struct mixer_t mixer = {};
 
+static double frames_to_ms(const int frames)
+{
+	const auto rate = std::max(mixer.sample_rate.load(), 1);
+	return static_cast<double>(frames) * 1000.0 / rate;
+}
+
 alignas(sizeof(float)) uint8_t MixTemp[MIXER_BUFSIZE] = {};
 
-static void MIXER_LockAudioDevice()
+DecimatingFir::DecimatingFir(const int decimation_factor)
+        : factor(decimation_factor)
+{
+	assert(factor >= 1);
+
+	// Twelve taps per kept sample give the Hamming-windowed filter a
+	// transition band of about a quarter of the decimated rate, centred
+	// on its Nyquist frequency
+	const auto num_taps = static_cast<size_t>(12 * factor);
+	const auto cutoff   = 0.5 / factor;
+	const auto middle   = (static_cast<double>(num_taps) - 1) / 2;
+	const auto pi       = 3.14159265358979323846;
+
+	taps.resize(num_taps);
+	double sum = 0.0;
+	for (size_t i = 0; i < num_taps; ++i) {
+		const auto x    = static_cast<double>(i) - middle;
+		const auto sinc = (x == 0.0) ? 2 * cutoff
+		                             : std::sin(2 * pi * cutoff * x) / (pi * x);
+		const auto window = 0.54 - 0.46 * std::cos(2 * pi * static_cast<double>(i) /
+		                                           static_cast<double>(num_taps - 1));
+		taps[i] = static_cast<float>(sinc * window);
+		sum += taps[i];
+	}
+	// Unity gain at DC
+	for (auto &tap : taps)
+		tap = static_cast<float>(tap / sum);
+
+	history.resize(2 * num_taps);
+}
+
+float DecimatingFir::Output() const
 {
-	SDL_LockAudioDevice(mixer.sdldevice);
+	// The oldest sample is at pos, so the window is reversed relative to
+	// the taps; they're symmetric, which makes that irrelevant
+	const auto window = &history[pos];
+	float output = 0.0f;
+	for (size_t i = 0; i < taps.size(); ++i)
+		output += taps[i] * window[i];
+	return output;
 }
 
-static void MIXER_UnlockAudioDevice()
+static void MIXER_LockMixer()
 {
-	SDL_UnlockAudioDevice(mixer.sdldevice);
+	mixer.mutex.lock();
+}
+
+static void MIXER_UnlockMixer()
+{
+	mixer.mutex.unlock();
 }
 
 MixerChannel::MixerChannel(MIXER_Handler _handler, const char *_name,
@@ -225,7 +707,9 @@ MixerChannel::MixerChannel(MIXER_Handler _handler, const char *_name,
           handler(_handler),
           features(_features),
           sleeper(*this),
-          do_sleep(HasFeature(ChannelFeature::Sleep))
+          do_sleep(HasFeature(ChannelFeature::Sleep)),
+          mix_buffers(&mixer.buffers),
+          own_buffers(nullptr)
 {}
 
 bool MixerChannel::HasFeature(const ChannelFeature feature)
@@ -485,15 +969,22 @@ mixer_channel_t MIXER_AddChannel(MIXER_Handler handler, const int freq,
 		        chan_rate,
 		        chan_rate > mixer.sample_rate ? "downsampling" : "upsampling");
 
-	MIXER_LockAudioDevice();
+	MIXER_LockMixer();
 	mixer.channels[name] = chan; // replace the old, if it exists
-	MIXER_UnlockAudioDevice();
+	MIXER_UnlockMixer();
 	return chan;
 }
 
+void MIXER_SetOutputTap(MIXER_OutputTap tap)
+{
+	MIXER_LockMixer();
+	mixer.output_tap = std::move(tap);
+	MIXER_UnlockMixer();
+}
+
 mixer_channel_t MIXER_FindChannel(const char *name)
 {
-	MIXER_LockAudioDevice();
+	MIXER_LockMixer();
 	auto it = mixer.channels.find(name);
 
 	if (it == mixer.channels.end()) {
@@ -512,7 +1003,7 @@ mixer_channel_t MIXER_FindChannel(const char *name)
 	}
 
 	const auto chan = (it != mixer.channels.end()) ? it->second : nullptr;
-	MIXER_UnlockAudioDevice();
+	MIXER_UnlockMixer();
 
 	return chan;
 }
@@ -572,12 +1063,12 @@ void MixerChannel::SetVolumeScale(const float left, const float right)
 
 static void MIXER_UpdateAllChannelVolumes()
 {
-	MIXER_LockAudioDevice();
+	MIXER_LockMixer();
 
 	for (auto &it : mixer.channels)
 		it.second->UpdateVolume();
 
-	MIXER_UnlockAudioDevice();
+	MIXER_UnlockMixer();
 }
 
 void MixerChannel::ChangeChannelMap(const LINE_INDEX mapped_as_left,
@@ -601,7 +1092,7 @@ void MixerChannel::Enable(const bool should_enable)
 		return;
 
 	// Lock the channel before changing states
-	MIXER_LockAudioDevice();
+	MIXER_LockMixer();
 
 	// Prepare the channel to accept samples
 	if (should_enable) {
@@ -628,7 +1119,7 @@ void MixerChannel::Enable(const bool should_enable)
 	}
 	is_enabled = should_enable;
 
-	MIXER_UnlockAudioDevice();
+	MIXER_UnlockMixer();
 }
 
 // Depending on the resampling method and the channel, mixer and ZoH upsampler
@@ -693,6 +1184,24 @@ void MixerChannel::ConfigureResampler()
 		if (!do_resample)
 			return;
 
+		// Prefer the polyphase resampler when it's enabled and handles
+		// the ratio, otherwise fall back to Speex
+		if (mixer.use_polyphase_resampler &&
+		    PolyphaseResampler::SupportsRates(in_rate, out_rate)) {
+			if (!polyphase_resampler ||
+			    polyphase_resampler->GetInputRate() != in_rate ||
+			    polyphase_resampler->GetOutputRate() != out_rate) {
+				polyphase_resampler = std::make_unique<PolyphaseResampler>(
+				        in_rate, out_rate);
+			}
+			// DEBUG_LOG_MSG("%s: Polyphase resampler is on, input rate: %d Hz, output rate: %d Hz)",
+			//               name.c_str(),
+			//               in_rate,
+			//               out_rate);
+			break;
+		}
+		polyphase_resampler.reset();
+
 		if (!speex_resampler.state) {
 			constexpr auto num_channels = 2; // always stereo
 			constexpr auto quality      = 5;
@@ -727,7 +1236,9 @@ void MixerChannel::ClearResampler()
 		[[fallthrough]];
 
 	case ResampleMethod::Resample:
-		if (do_resample) {
+		if (do_resample && polyphase_resampler) {
+			polyphase_resampler->Reset();
+		} else if (do_resample) {
 			assert(speex_resampler.state);
 			speex_resampler_reset_mem(speex_resampler.state);
 			speex_resampler_skip_zeros(speex_resampler.state);
@@ -789,6 +1300,11 @@ void MixerChannel::Mix(const int frames_requested)
 {
 	if (!is_enabled)
 		return;
+	ZoneTransientSubsystem(name.c_str());
+
+	const auto started_at = stats_clock::now();
+	const auto processing_ns_before = stats.resample_ns + stats.filter_ns +
+	                                  stats.effects_ns;
 
 	frames_needed = frames_requested;
 	while (frames_needed > frames_done) {
@@ -801,13 +1317,96 @@ void MixerChannel::Mix(const int frames_requested)
 		frames_remaining = std::min(frames_remaining, MIXER_BUFSIZE); // avoid overflow
 		handler(check_cast<uint16_t>(frames_remaining));
 	}
+
+	// Charge the handler with the time not spent processing its frames
+	const auto processing_ns = stats.resample_ns + stats.filter_ns +
+	                           stats.effects_ns - processing_ns_before;
+	stats.handler_ns += ns_between(started_at, stats_clock::now()) -
+	                    processing_ns;
+
+	// Channels mixed in parallel consider sleeping once they're merged,
+	// because that can reconfigure the mixer
+	if (do_sleep && !IsMixingInParallel())
+		sleeper.MaybeSleep();
+}
+
+MixerChannelStats MixerChannel::TakeStats()
+{
 	if (do_sleep)
+		sleeper.ChargeAsleepTime();
+
+	const auto taken = stats;
+	stats            = {};
+	return taken;
+}
+
+void MixerChannel::PrepareParallelMix()
+{
+	if (!own_buffers)
+		own_buffers = std::make_unique<mix_buffers_t>();
+
+	mix_buffers        = own_buffers.get();
+	parallel_mix_start = frames_done;
+}
+
+void MixerChannel::MergeParallelMix()
+{
+	assert(IsMixingInParallel());
+	mix_buffers = &mixer.buffers;
+
+	// Add the frames mixed since preparing to the mixer's buffers and
+	// clear our own for the next round
+	auto &own = *own_buffers;
+	const auto own_reverb = own.aux_reverb.get();
+	const auto own_chorus = own.aux_chorus.get();
+	const auto reverb = own_reverb ? &mixer.buffers.Reverb() : nullptr;
+	const auto chorus = own_chorus ? &mixer.buffers.Chorus() : nullptr;
+
+	auto pos  = check_cast<work_index_t>((mixer.pos + parallel_mix_start) &
+                                            MIXER_BUFMASK);
+	for (auto i = parallel_mix_start; i < frames_done; ++i) {
+		for (auto ch = 0; ch < 2; ++ch) {
+			mixer.buffers.work[pos][ch] += own.work[pos][ch];
+			if (own_reverb)
+				(*reverb)[pos][ch] += (*own_reverb)[pos][ch];
+			if (own_chorus)
+				(*chorus)[pos][ch] += (*own_chorus)[pos][ch];
+		}
+		own.work[pos] = {};
+		if (own_reverb)
+			(*own_reverb)[pos] = {};
+		if (own_chorus)
+			(*own_chorus)[pos] = {};
+
+		pos = (pos + 1) & MIXER_BUFMASK;
+	}
+
+	if (is_enabled && do_sleep)
 		sleeper.MaybeSleep();
 }
 
+bool MixerChannel::IsMixingInParallel() const
+{
+	return mix_buffers != &mixer.buffers;
+}
+
+// The emulation thread holds the lock on behalf of channels mixing in
+// parallel, so they skip it
+void MixerChannel::LockMixer()
+{
+	if (!IsMixingInParallel())
+		MIXER_LockMixer();
+}
+
+void MixerChannel::UnlockMixer()
+{
+	if (!IsMixingInParallel())
+		MIXER_UnlockMixer();
+}
+
 void MixerChannel::AddSilence()
 {
-	MIXER_LockAudioDevice();
+	LockMixer();
 
 	if (frames_done < frames_needed) {
 		if (prev_frame[0] == 0.0f && prev_frame[1] == 0.0f) {
@@ -842,10 +1441,10 @@ void MixerChannel::AddSilence()
 
 				mixpos &= MIXER_BUFMASK;
 
-				mixer.work[mixpos][mapped_output_left] +=
+				mix_buffers->work[mixpos][mapped_output_left] +=
 				        prev_frame.left * volume_gain.left;
 
-				mixer.work[mixpos][mapped_output_right] +=
+				mix_buffers->work[mixpos][mapped_output_right] +=
 				        (stereo ? prev_frame.right : prev_frame.left) *
 				        volume_gain.right;
 
@@ -858,7 +1457,7 @@ void MixerChannel::AddSilence()
 	}
 	last_samples_were_silence = true;
 
-	MIXER_UnlockAudioDevice();
+	UnlockMixer();
 }
 
 static void log_filter_settings(const std::string &channel_name,
@@ -1195,6 +1794,24 @@ constexpr void fill_8to16_lut()
 		lut_u8to16[i] = u8to16(i);
 }
 
+// Converts 8-bit samples to interleaved stereo frames through the lookup
+// tables, as the conversion isn't linear
+template <bool stereo, bool signeddata, class Type>
+static void convert_8bit_frames(const Type *in, const int num_frames, float *out)
+{
+	static_assert(sizeof(Type) == 1);
+	auto to_float = [](const Type sample) {
+		if constexpr (signeddata)
+			return static_cast<float>(lut_s8to16[static_cast<int8_t>(sample)]);
+		else
+			return static_cast<float>(lut_u8to16[static_cast<uint8_t>(sample)]);
+	};
+	for (auto i = 0; i < num_frames; ++i) {
+		out[i * 2 + 0] = to_float(in[stereo ? i * 2 + 0 : i]);
+		out[i * 2 + 1] = to_float(in[stereo ? i * 2 + 1 : i]);
+	}
+}
+
 template <class Type, bool stereo, bool signeddata, bool nativeorder>
 AudioFrame MixerChannel::ConvertNextFrame(const Type *data, const work_index_t pos)
 {
@@ -1322,6 +1939,53 @@ void MixerChannel::ConvertSamples(const Type *data, const uint16_t frames,
 	const auto mapped_channel_left  = channel_map.left;
 	const auto mapped_channel_right = channel_map.right;
 
+	// Without upsampling or remapping, the samples are converted and
+	// enveloped in bulk. The frames are still delayed by one, as in the
+	// frame-by-frame path below.
+	const auto is_mapped_as_is = mapped_output_left == LEFT &&
+	                             mapped_output_right == RIGHT &&
+	                             mapped_channel_left == LEFT &&
+	                             (!stereo || mapped_channel_right == RIGHT);
+
+	if (is_mapped_as_is && !do_zoh_upsample) {
+		out.resize((frames + 1) * 2u);
+		out[0] = next_frame.left;
+		out[1] = stereo ? next_frame.right : next_frame.left;
+
+		const auto converted = out.data() + 2;
+		if constexpr (std::is_same_v<Type, float>) {
+			convert_float_frames<stereo>(data, frames, converted);
+		} else if constexpr (sizeof(Type) == 2 && nativeorder) {
+			if constexpr (signeddata)
+				convert_16bit_frames<stereo>(
+				        reinterpret_cast<const int16_t *>(data), frames, converted);
+			else
+				convert_16bit_frames<stereo>(
+				        reinterpret_cast<const uint16_t *>(data), frames, converted);
+		} else if constexpr (sizeof(Type) == 1) {
+			convert_8bit_frames<stereo, signeddata>(data, frames, converted);
+		} else {
+			for (work_index_t i = 0; i < frames; ++i) {
+				const auto frame = ConvertNextFrame<Type, stereo, signeddata, nativeorder>(
+				        data, i);
+				converted[i * 2 + 0] = frame.left;
+				converted[i * 2 + 1] = stereo ? frame.right : frame.left;
+			}
+		}
+
+		envelope.Process(stereo, out.data(), frames);
+
+		const auto last_frame = [&](const size_t i) -> AudioFrame {
+			return {out[i * 2], stereo ? out[i * 2 + 1] : 0.0f};
+		};
+		next_frame = last_frame(frames);
+		prev_frame = last_frame(frames - 1u);
+
+		out.resize(frames * 2u);
+		scale_frames(out.data(), frames, volume_gain);
+		return;
+	}
+
 	work_index_t pos = 0;
 	std::array<float, 2> out_frame;
 
@@ -1384,18 +2048,6 @@ spx_uint32_t estimate_max_out_frames(SpeexResamplerState *resampler_state,
 	return ceil_udivide(in_frames * ratio_den, ratio_num);
 }
 
-AudioFrame MixerChannel::ApplyCrossfeed(const AudioFrame &frame) const
-{
-	// Pan mono sample using -6dB linear pan law in the stereo field
-	// pan: 0.0 = left, 0.5 = center, 1.0 = right
-	auto pan = [](const float sample, const float pan) -> AudioFrame {
-		return {(1.0f - pan) * sample, pan * sample};
-	};
-	const auto a = pan(frame.left, crossfeed.pan_left);
-	const auto b = pan(frame.right, crossfeed.pan_right);
-	return {a.left + b.left, a.right + b.right};
-}
-
 MixerChannel::Sleeper::Sleeper(MixerChannel &c) : channel(c) {}
 
 // Records if samples had a magnitude great than 1. This is a one-way street;
@@ -1424,6 +2076,8 @@ void MixerChannel::Sleeper::MaybeSleep()
 		WakeUp();
 	} else {
 		channel.Enable(false);
+		is_asleep         = true;
+		fell_asleep_at_ms = GetTicks();
 		// LOG_INFO("MIXER: %s fell asleep", channel.name.c_str());
 	}
 }
@@ -1435,14 +2089,32 @@ bool MixerChannel::Sleeper::WakeUp()
 	woken_at_ms = GetTicks();
 	had_noise   = false;
 
+	if (is_asleep) {
+		ChargeAsleepTime();
+		is_asleep = false;
+	}
+
 	const auto was_sleeping = !channel.is_enabled;
 	if (was_sleeping) {
 		channel.Enable(true);
+		++channel.stats.wake_ups;
 		// LOG_INFO("MIXER: %s woke up", channel.name.c_str());
 	}
 	return was_sleeping;
 }
 
+// Adds the time asleep so far to the channel's stats, so the MIXER /STATS
+// view can show it even for channels that haven't woken up since
+void MixerChannel::Sleeper::ChargeAsleepTime()
+{
+	if (!is_asleep)
+		return;
+
+	const auto now = GetTicks();
+	channel.stats.asleep_ms += now - fell_asleep_at_ms;
+	fell_asleep_at_ms = now;
+}
+
 // Audio devices that use the sleep feature need to wake up the channel whenever
 // they might prepare new samples for it. Typically this is on IO port
 // writes into the card.
@@ -1457,9 +2129,11 @@ void MixerChannel::AddSamples(const uint16_t frames, const Type *data)
 {
 	assert(frames > 0);
 
+	const auto started_at = stats_clock::now();
+
 	last_samples_were_stereo = stereo;
 
-	auto &convert_out = do_resample ? mixer.resample_temp : mixer.resample_out;
+	auto &convert_out = do_resample ? resample_temp : resample_out;
 	ConvertSamples<Type, stereo, signeddata, nativeorder>(data, frames, convert_out);
 
 	if (do_resample) {
@@ -1467,11 +2141,11 @@ void MixerChannel::AddSamples(const uint16_t frames, const Type *data)
 		case ResampleMethod::LinearInterpolation: {
 			auto &s = lerp_upsampler;
 
-			auto in_pos = mixer.resample_temp.begin();
-			auto &out   = mixer.resample_out;
+			auto in_pos = resample_temp.begin();
+			auto &out   = resample_out;
 			out.resize(0);
 
-			while (in_pos != mixer.resample_temp.end()) {
+			while (in_pos != resample_temp.end()) {
 				AudioFrame curr_frame = {*in_pos, *(in_pos + 1)};
 
 				const auto out_left = lerp(s.last_frame.left,
@@ -1516,90 +2190,115 @@ void MixerChannel::AddSamples(const uint16_t frames, const Type *data)
 			// number of temporary buffers
 
 		case ResampleMethod::Resample: {
+			if (polyphase_resampler) {
+				resample_out.clear();
+				polyphase_resampler->Process(
+				        resample_temp.data(),
+				        static_cast<int>(resample_temp.size() / 2),
+				        resample_out);
+				break;
+			}
+
 			auto in_frames = check_cast<uint32_t>(
-			                         mixer.resample_temp.size()) /
+			                         resample_temp.size()) /
 			                 2u;
 
 			auto out_frames = estimate_max_out_frames(
 			        speex_resampler.state, in_frames);
 
-			mixer.resample_out.resize(out_frames * 2);
+			resample_out.resize(out_frames * 2);
 
 			speex_resampler_process_interleaved_float(
 			        speex_resampler.state,
-			        mixer.resample_temp.data(),
+			        resample_temp.data(),
 			        &in_frames,
-			        mixer.resample_out.data(),
+			        resample_out.data(),
 			        &out_frames);
 
 			// out_frames now contains the actual number of
 			// resampled frames, ensure the number of output frames
 			// is within the logical size.
-			assert(out_frames <= mixer.resample_out.size() / 2);
-			mixer.resample_out.resize(out_frames * 2); // only shrinks
+			assert(out_frames <= resample_out.size() / 2);
+			resample_out.resize(out_frames * 2); // only shrinks
 		} break;
 		}
 	}
 
-	MIXER_LockAudioDevice();
-
-	// Optionally filter, apply crossfeed, then mix the results to the
-	// master output
-	const auto out_frames = static_cast<int>(mixer.resample_out.size()) / 2;
-
-	auto pos    = mixer.resample_out.begin();
-	auto mixpos = check_cast<work_index_t>(mixer.pos + frames_done);
+	LockMixer();
 
-	while (pos != mixer.resample_out.end()) {
-		mixpos &= MIXER_BUFMASK;
+	const auto resampled_at = stats_clock::now();
+	stats.resample_ns += ns_between(started_at, resampled_at);
 
-		AudioFrame frame = {*pos++, *pos++};
+	const auto out_frames = static_cast<int>(resample_out.size()) / 2;
+	auto out = resample_out.data();
 
-		if (do_highpass_filter) {
-			frame.left = filters.highpass.hpf[0].filter(frame.left);
-			frame.right = filters.highpass.hpf[1].filter(frame.right);
-		}
-		if (do_lowpass_filter) {
-			frame.left  = filters.lowpass.lpf[0].filter(frame.left);
-			frame.right = filters.lowpass.lpf[1].filter(frame.right);
-		}
-		if (do_crossfeed)
-			frame = ApplyCrossfeed(frame);
-
-		if (do_reverb_send) {
-			// Mix samples to the reverb aux buffer, scaled by the
-			// reverb send volume
-			mixer.aux_reverb[mixpos][0] += frame.left * reverb.send_gain;
-			mixer.aux_reverb[mixpos][1] += frame.right * reverb.send_gain;
-		}
-		if (do_chorus_send) {
-			// Mix samples to the chorus aux buffer, scaled by the
-			// chorus send volume
-			mixer.aux_chorus[mixpos][0] += frame.left * chorus.send_gain;
-			mixer.aux_chorus[mixpos][1] += frame.right * chorus.send_gain;
+	// The channel's filters run frame by frame, in place
+	if (do_highpass_filter || do_lowpass_filter) {
+		for (auto i = 0; i < out_frames; ++i) {
+			auto &left  = out[i * 2 + 0];
+			auto &right = out[i * 2 + 1];
+			if (do_highpass_filter) {
+				left  = filters.highpass.hpf[0].filter(left);
+				right = filters.highpass.hpf[1].filter(right);
+			}
+			if (do_lowpass_filter) {
+				left  = filters.lowpass.lpf[0].filter(left);
+				right = filters.lowpass.lpf[1].filter(right);
+			}
 		}
+	}
+	const auto filtered_at = stats_clock::now();
+	stats.filter_ns += ns_between(resampled_at, filtered_at);
+
+	// Optionally apply crossfeed, then mix the results to the master
+	// output and effect sends in bulk, in up to two runs as the work
+	// buffers wrap around
+	if (do_crossfeed)
+		crossfeed_frames(out,
+		                 out_frames,
+		                 crossfeed.pan_left,
+		                 crossfeed.pan_right);
+	if (do_sleep)
+		for (auto i = 0; i < out_frames; ++i)
+			sleeper.Listen({out[i * 2], out[i * 2 + 1]});
 
-		if (do_sleep)
-			sleeper.Listen(frame);
-
-		// Mix samples to the master output
-		mixer.work[mixpos][0] += frame.left;
-		mixer.work[mixpos][1] += frame.right;
-
-		++mixpos;
+	auto mixpos = check_cast<work_index_t>(mixer.pos + frames_done);
+	auto frames_remaining = out_frames;
+	while (frames_remaining) {
+		mixpos &= MIXER_BUFMASK;
+		const auto run = std::min(frames_remaining, MIXER_BUFSIZE - mixpos);
+
+		if (do_reverb_send)
+			accumulate_frames(out,
+			                  run,
+			                  reverb.send_gain,
+			                  &mix_buffers->Reverb()[mixpos][0]);
+		if (do_chorus_send)
+			accumulate_frames(out,
+			                  run,
+			                  chorus.send_gain,
+			                  &mix_buffers->Chorus()[mixpos][0]);
+
+		accumulate_frames(out, run, 1.0f, &mix_buffers->work[mixpos][0]);
+
+		out += run * 2;
+		mixpos = check_cast<work_index_t>(mixpos + run);
+		frames_remaining -= run;
 	}
 	frames_done += out_frames;
 
-	MIXER_UnlockAudioDevice();
+	stats.effects_ns += ns_between(filtered_at, stats_clock::now());
+
+	UnlockMixer();
 }
 
 void MixerChannel::AddStretched(const uint16_t len, int16_t *data)
 {
-	MIXER_LockAudioDevice();
+	LockMixer();
 
 	if (frames_done >= frames_needed) {
 		LOG_MSG("Can't add, buffer full");
-		MIXER_UnlockAudioDevice();
+		UnlockMixer();
 		return;
 	}
 	// Target samples this inputs gets stretched into
@@ -1638,15 +2337,15 @@ void MixerChannel::AddStretched(const uint16_t len, int16_t *data)
 		if (do_sleep)
 			sleeper.Listen(frame_with_gain);
 
-		mixer.work[mixpos][mapped_output_left] += frame_with_gain.left;
-		mixer.work[mixpos][mapped_output_right] += frame_with_gain.right;
+		mix_buffers->work[mixpos][mapped_output_left] += frame_with_gain.left;
+		mix_buffers->work[mixpos][mapped_output_right] += frame_with_gain.right;
 
 		mixpos++;
 	}
 
 	frames_done = frames_needed;
 
-	MIXER_UnlockAudioDevice();
+	UnlockMixer();
 }
 
 void MixerChannel::AddSamples_m8(const uint16_t len, const uint8_t *data)
@@ -1727,9 +2426,9 @@ void MixerChannel::FillUp()
 	if (!is_enabled || frames_done < mixer.frames_done)
 		return;
 	const auto index = PIC_TickIndex();
-	MIXER_LockAudioDevice();
+	MIXER_LockMixer();
 	Mix(check_cast<uint16_t>(static_cast<int64_t>(index * mixer.frames_needed)));
-	MIXER_UnlockAudioDevice();
+	MIXER_UnlockMixer();
 }
 
 std::string MixerChannel::DescribeLineout() const
@@ -1788,111 +2487,187 @@ static constexpr int calc_tickadd(const int freq)
 #endif
 }
 
-// Mix a certain amount of new sample frames
-static void MIXER_MixData(const int frames_requested)
+// The effects process the mixed frames in blocks, in up to two runs as the
+// work buffers wrap around. They work on planar copies of their aux buffers,
+// as MVerb and the chorus engine take separate left and right streams.
+static void load_effect_input(const mix_buffer_t &aux,
+                              const work_index_t pos, const int num_frames)
 {
-	constexpr auto capture_buf_frames = 1024;
+	auto &left  = mixer.effect_left;
+	auto &right = mixer.effect_right;
+	left.resize(static_cast<size_t>(num_frames));
+	right.resize(static_cast<size_t>(num_frames));
 
-	const auto frames_added = check_cast<work_index_t>(
-	        std::min(frames_requested - mixer.frames_done, capture_buf_frames));
+	for (auto i = 0; i < num_frames; ++i) {
+		left[i]  = aux[pos + i][0];
+		right[i] = aux[pos + i][1];
+	}
+}
 
-	const auto start_pos = check_cast<work_index_t>(
-	        (mixer.pos + mixer.frames_done) & MIXER_BUFMASK);
+static void mix_effect_output(const work_index_t pos, const int num_frames)
+{
+	const auto left  = mixer.effect_left.data();
+	const auto right = mixer.effect_right.data();
+
+	for (auto i = 0; i < num_frames; ++i) {
+		mixer.buffers.work[pos + i][0] += left[i];
+		mixer.buffers.work[pos + i][1] += right[i];
+	}
+}
 
-	// Render all channels and accumulate results in the master mixbuffer
+// Returns true if any channel sends to the effect, otherwise its aux buffer
+// is silent and the effect can be skipped
+static bool any_channel_sends(float (MixerChannel::*get_send_level)())
+{
 	for (auto &it : mixer.channels)
-		it.second->Mix(frames_requested);
+		if (((*it.second).*get_send_level)() > 0.0f)
+			return true;
+	return false;
+}
 
-	if (mixer.do_reverb) {
-		// Apply reverb effect to the reverb aux buffer, then mix the
-		// results to the master output
-		auto pos = start_pos;
+static void apply_reverb(const work_index_t start_pos, const int num_frames)
+{
+	auto &r = mixer.reverb;
 
-		for (work_index_t i = 0; i < frames_added; ++i) {
-			AudioFrame frame = {mixer.aux_reverb[pos][0],
-			                    mixer.aux_reverb[pos][1]};
+	if (!any_channel_sends(&MixerChannel::GetReverbLevel)) {
+		// Drop the tail, so it doesn't resume with stale reflections
+		if (!r.is_idle)
+			r.mverb.reset();
+		r.is_idle = true;
+		return;
+	}
+	r.is_idle = false;
 
-			// High-pass filter the reverb input
-			for (auto ch = 0; ch < 2; ++ch)
-				frame[ch] = mixer.reverb.highpass_filter[ch].filter(
-				        frame[ch]);
+	auto pos              = start_pos;
+	auto frames_remaining = num_frames;
+	while (frames_remaining) {
+		const auto run = std::min(frames_remaining, MIXER_BUFSIZE - pos);
 
-			// MVerb operates on two non-interleaved sample streams
-			static float in_left[1]     = {};
-			static float in_right[1]    = {};
-			static float *reverb_buf[2] = {in_left, in_right};
+		load_effect_input(mixer.buffers.Reverb(), pos, run);
 
-			in_left[0]  = frame.left;
-			in_right[0] = frame.right;
+		// High-pass filter the reverb input
+		for (auto &sample : mixer.effect_left)
+			sample = r.highpass_filter[0].filter(sample);
+		for (auto &sample : mixer.effect_right)
+			sample = r.highpass_filter[1].filter(sample);
 
-			const auto in         = reverb_buf;
-			auto out              = reverb_buf;
-			constexpr auto frames = 1;
-			mixer.reverb.mverb.process(in, out, frames);
+		float *streams[2] = {mixer.effect_left.data(), mixer.effect_right.data()};
+		r.mverb.process(streams, streams, run);
 
-			mixer.work[pos][0] += reverb_buf[0][0];
-			mixer.work[pos][1] += reverb_buf[1][0];
+		mix_effect_output(pos, run);
 
-			pos = (pos + 1) & MIXER_BUFMASK;
-		}
+		pos = (pos + run) & MIXER_BUFMASK;
+		frames_remaining -= run;
 	}
+}
 
-	if (mixer.do_chorus) {
-		// Apply chorus effect to the chorus aux buffer, then mix the
-		// results to the master output
-		auto pos = start_pos;
+static void apply_chorus(const work_index_t start_pos, const int num_frames)
+{
+	if (!any_channel_sends(&MixerChannel::GetChorusLevel))
+		return;
 
-		for (work_index_t i = 0; i < frames_added; ++i) {
-			AudioFrame frame = {mixer.aux_chorus[pos][0],
-			                    mixer.aux_chorus[pos][1]};
+	auto pos              = start_pos;
+	auto frames_remaining = num_frames;
+	while (frames_remaining) {
+		const auto run = std::min(frames_remaining, MIXER_BUFSIZE - pos);
 
-			mixer.chorus.chorus_engine.process(&frame.left, &frame.right);
+		load_effect_input(mixer.buffers.Chorus(), pos, run);
 
-			mixer.work[pos][0] += frame.left;
-			mixer.work[pos][1] += frame.right;
+		mixer.chorus.chorus_engine.process(mixer.effect_left.data(),
+		                                   mixer.effect_right.data(),
+		                                   run);
 
-			pos = (pos + 1) & MIXER_BUFMASK;
+		mix_effect_output(pos, run);
+
+		pos = (pos + run) & MIXER_BUFMASK;
+		frames_remaining -= run;
+	}
+}
+
+// Mix a certain amount of new sample frames
+static void MIXER_MixData(const int frames_requested)
+{
+	constexpr auto capture_buf_frames = 1024;
+
+	const auto frames_added = check_cast<work_index_t>(
+	        std::min(frames_requested - mixer.frames_done, capture_buf_frames));
+
+	const auto start_pos = check_cast<work_index_t>(
+	        (mixer.pos + mixer.frames_done) & MIXER_BUFMASK);
+
+	// Render the channels that support it in parallel, each into its own
+	// buffers
+	if (mixer.parallel_mix_pool.IsRunning()) {
+		auto &parallel_channels = mixer.parallel_channels;
+		parallel_channels.clear();
+		for (auto &it : mixer.channels) {
+			auto &channel = it.second;
+			if (channel->is_enabled &&
+			    channel->HasFeature(ChannelFeature::ParallelRender)) {
+				channel->PrepareParallelMix();
+				parallel_channels.push_back(channel.get());
+			}
 		}
+		mixer.parallel_mix_pool.Mix(parallel_channels, frames_requested);
+	}
+
+	// Render the remaining channels and accumulate the results in the
+	// master mixbuffer, in channel order so the sums are deterministic
+	for (auto &it : mixer.channels) {
+		if (it.second->IsMixingInParallel())
+			it.second->MergeParallelMix();
+		else
+			it.second->Mix(frames_requested);
 	}
 
+	const auto effects_started_at = stats_clock::now();
+
+	if (mixer.do_reverb)
+		apply_reverb(start_pos, frames_added);
+
+	if (mixer.do_chorus)
+		apply_chorus(start_pos, frames_added);
+
 	// Apply high-pass filter to the master output
 	auto pos = start_pos;
 
 	for (work_index_t i = 0; i < frames_added; ++i) {
 		for (auto ch = 0; ch < 2; ++ch) {
-			mixer.work[pos][ch] = mixer.highpass_filter[ch].filter(
-			        mixer.work[pos][ch]);
+			mixer.buffers.work[pos][ch] = mixer.highpass_filter[ch].filter(
+			        mixer.buffers.work[pos][ch]);
 		}
 		pos = (pos + 1) & MIXER_BUFMASK;
 	}
 
 	if (mixer.do_compressor) {
 		// Apply compressor to the master output as the very last step
+		// in runs up to the end of the ring buffer
 		pos = start_pos;
 
-		for (work_index_t i = 0; i < frames_added; ++i) {
-			AudioFrame frame = {mixer.work[pos][0], mixer.work[pos][1]};
-
-			frame = mixer.compressor.Process(frame);
+		for (int remaining = frames_added; remaining > 0;) {
+			const auto run = std::min(remaining, MIXER_BUFSIZE - pos);
 
-			mixer.work[pos][0] = frame.left;
-			mixer.work[pos][1] = frame.right;
+			mixer.compressor.Process(&mixer.buffers.work[pos][0], run);
 
-			pos = (pos + 1) & MIXER_BUFMASK;
+			pos = check_cast<work_index_t>((pos + run) & MIXER_BUFMASK);
+			remaining -= run;
 		}
 	}
 
+	mixer.stats.effects_ns += ns_between(effects_started_at, stats_clock::now());
+
 	// Capture audio output if requested
-	if (CaptureState & (CAPTURE_WAVE | CAPTURE_VIDEO)) {
+	const auto is_capturing = (CaptureState & (CAPTURE_WAVE | CAPTURE_VIDEO)) != 0;
+	if (is_capturing || mixer.output_tap) {
 		int16_t out[capture_buf_frames][2];
 		auto pos = start_pos;
 
 		for (work_index_t i = 0; i < frames_added; i++) {
 			const auto left = static_cast<uint16_t>(
-			        MIXER_CLIP(static_cast<int>(mixer.work[pos][0])));
+			        MIXER_CLIP(static_cast<int>(mixer.buffers.work[pos][0])));
 
 			const auto right = static_cast<uint16_t>(
-			        MIXER_CLIP(static_cast<int>(mixer.work[pos][1])));
+			        MIXER_CLIP(static_cast<int>(mixer.buffers.work[pos][1])));
 
 			out[i][0] = static_cast<int16_t>(host_to_le16(left));
 			out[i][1] = static_cast<int16_t>(host_to_le16(right));
@@ -1900,9 +2675,14 @@ static void MIXER_MixData(const int frames_requested)
 			pos = (pos + 1) & MIXER_BUFMASK;
 		}
 
-		CAPTURE_AddWave(mixer.sample_rate,
-		                frames_added,
-		                reinterpret_cast<int16_t *>(out));
+		if (is_capturing)
+			CAPTURE_AddWave(mixer.sample_rate,
+			                frames_added,
+			                reinterpret_cast<int16_t *>(out));
+
+		if (mixer.output_tap)
+			mixer.output_tap(reinterpret_cast<int16_t *>(out),
+			                 static_cast<int>(frames_added));
 	}
 
 	// Reset the the tick_add for constant speed
@@ -1912,16 +2692,6 @@ static void MIXER_MixData(const int frames_requested)
 	mixer.frames_done = frames_requested;
 }
 
-static void MIXER_Mix()
-{
-	MIXER_LockAudioDevice();
-	MIXER_MixData(mixer.frames_needed);
-	mixer.tick_counter += mixer.tick_add;
-	mixer.frames_needed += mixer.tick_counter >> TICK_SHIFT;
-	mixer.tick_counter &= TICK_MASK;
-	MIXER_UnlockAudioDevice();
-}
-
 static void MIXER_ReduceChannelsDoneCounts(const int at_most)
 {
 	for (auto &it : mixer.channels)
@@ -1929,17 +2699,63 @@ static void MIXER_ReduceChannelsDoneCounts(const int at_most)
 		                                   at_most);
 }
 
-static void MIXER_Mix_NoSound()
+// Queues the frames mixed this tick for the audio callback, dropping those
+// that would take the queue beyond its maximum latency
+static void queue_mixed_frames(const int num_frames)
 {
-	MIXER_LockAudioDevice();
-	MIXER_MixData(mixer.frames_needed);
+	auto &frames = mixer.output_frames;
+	frames.resize(static_cast<size_t>(num_frames));
+
+	auto pos = mixer.pos.load();
+	for (auto &frame : frames) {
+		frame = {mixer.buffers.work[pos][0], mixer.buffers.work[pos][1]};
+		pos   = (pos + 1) & MIXER_BUFMASK;
+	}
+
+	const auto room = std::max(mixer.max_queued_frames -
+	                                   mixer.output_queue.Size(),
+	                           0);
+	const auto to_queue = std::min(num_frames, room);
+
+	if (mixer.output_queue.Push(frames.data(), to_queue) < num_frames)
+		++mixer.overruns;
+}
+
+// Steers the frames left queued after each callback towards the latency
+// target by mixing a few more or fewer frames per tick
+static void update_tick_add()
+{
+	if (Mixer_irq_important())
+		return;
+
+	const auto target = mixer.latency_target_frames;
+	const auto diff   = std::clamp(target - mixer.frames_queued_after_callback,
+	                               -2 * target,
+	                               2 * target);
+
+	// Recover quickly from running short, and drain an excess gently
+	const auto correction = diff > 0 ? diff * 3 : diff / 5;
+
+	mixer.tick_add = calc_tickadd(mixer.sample_rate + correction);
+}
+
+// Releases the frames mixed this tick from the work buffers and sets up the
+// frames needed for the next tick
+static void release_mixed_frames()
+{
+	const auto reverb = mixer.buffers.aux_reverb.get();
+	const auto chorus = mixer.buffers.aux_chorus.get();
 
-	/* Clear piece we've just generated */
 	for (auto i = 0; i < mixer.frames_needed; ++i) {
-		mixer.work[mixer.pos][0] = 0;
-		mixer.work[mixer.pos][1] = 0;
+		const auto pos = mixer.pos.load();
+
+		mixer.buffers.work[pos] = {};
+		if (reverb)
+			(*reverb)[pos] = {};
+		if (chorus)
+			(*chorus)[pos] = {};
 
-		mixer.pos = (mixer.pos + 1) & MIXER_BUFMASK;
+		mixer.pos = (pos + 1) & MIXER_BUFMASK;
 	}
 
 	MIXER_ReduceChannelsDoneCounts(mixer.frames_needed);
@@ -1949,179 +2765,99 @@ static void MIXER_Mix_NoSound()
 	mixer.frames_needed = (mixer.tick_counter >> TICK_SHIFT);
 	mixer.tick_counter &= TICK_MASK;
 	mixer.frames_done = 0;
-	MIXER_UnlockAudioDevice();
 }
 
-#define INDEX_SHIFT_LOCAL 14
+static void MIXER_Mix()
+{
+	TelemetryScope telemetry_scope(TelemetryBucket::Mixer);
+
+	MIXER_LockMixer();
+	MIXER_MixData(mixer.frames_needed);
+	mixer.frames_mixed += mixer.frames_needed;
+	// The frames are still mixed so they can be captured
+	if (!(ticksLocked && mixer.mute_fast_forward))
+		queue_mixed_frames(mixer.frames_needed);
+	update_tick_add();
+	release_mixed_frames();
+	MIXER_UnlockMixer();
+}
+
+static void MIXER_Mix_NoSound()
+{
+	TelemetryScope telemetry_scope(TelemetryBucket::Mixer);
 
+	MIXER_LockMixer();
+	MIXER_MixData(mixer.frames_needed);
+	mixer.frames_mixed += mixer.frames_needed;
+	release_mixed_frames();
+	MIXER_UnlockMixer();
+}
+
+// Runs on SDL's audio thread and only touches the output queue, so it never
+// waits on the emulation
 static void SDLCALL MIXER_CallBack([[maybe_unused]] void *userdata,
                                    Uint8 *stream, int len)
 {
 	ZoneScoped
 	memset(stream, 0, len);
 
-	auto frames_requested = len / mixer_frame_size;
-	auto output           = reinterpret_cast<int16_t *>(stream);
-	auto reduce_frames    = 0;
-	work_index_t pos      = 0;
-
-	// Local resampling counter to manipulate the data when sending it off
-	// to the callback
-	auto index_add = (1 << INDEX_SHIFT_LOCAL);
-	auto index     = (index_add % frames_requested) ? frames_requested : 0;
-
-	/* Enough room in the buffer ? */
-	if (mixer.frames_done < frames_requested) {
-		//		LOG_WARNING("Full underrun requested %d, have
-		//%d, min %d", frames_requested, mixer.frames_done.load(),
-		// mixer.min_frames_needed.load());
-		if ((frames_requested - mixer.frames_done) >
-		    (frames_requested >> 7)) // Max 1 percent
-		                             // stretch.
-			return;
-		reduce_frames = mixer.frames_done;
-		index_add = (reduce_frames << INDEX_SHIFT_LOCAL) / frames_requested;
-		mixer.tick_add = calc_tickadd(mixer.sample_rate +
-		                              mixer.min_frames_needed);
-
-	} else if (mixer.frames_done < mixer.max_frames_needed) {
-		auto frames_remaining = mixer.frames_done - frames_requested;
-
-		if (frames_remaining < mixer.min_frames_needed) {
-			if (!Mixer_irq_important()) {
-				auto frames_needed = mixer.frames_needed -
-				                     frames_requested;
-				auto diff = (mixer.min_frames_needed > frames_needed
-				                     ? mixer.min_frames_needed.load()
-				                     : frames_needed) -
-				            frames_remaining;
-
-				mixer.tick_add = calc_tickadd(mixer.sample_rate +
-				                              (diff * 3));
-				frames_remaining = 0; // No stretching as we
-				                      // compensate with the
-				                      // tick_add value
-			} else {
-				frames_remaining = (mixer.min_frames_needed -
-				                    frames_remaining);
-				frames_remaining = 1 + (2 * frames_remaining) /
-				                               mixer.min_frames_needed; // frames_remaining=1,2,3
-			}
-			//			LOG_WARNING("needed underrun
-			// requested %d, have %d, min %d, frames_remaining %d",
-			// frames_requested, mixer.frames_done.load(),
-			// mixer.min_frames_needed.load(), frames_remaining);
-			reduce_frames = frames_requested - frames_remaining;
-			index_add     = (reduce_frames << INDEX_SHIFT_LOCAL) /
-			            frames_requested;
-		} else {
-			reduce_frames = frames_requested;
-			index_add     = (1 << INDEX_SHIFT_LOCAL);
-			//			LOG_MSG("regular run requested
-			//%d, have %d, min %d, frames_remaining %d",
-			// frames_requested, mixer.frames_done.load(),
-			// mixer.min_frames_needed.load(), frames_remaining);
-
-			/* Mixer tick value being updated:
-			 * 3 cases:
-			 * 1) A lot too high. >division by 5. but maxed by 2*
-			 * min to prevent too fast drops. 2) A little too high >
-			 * division by 8 3) A little to nothing above the
-			 * min_needed buffer > go to default value
-			 */
-			int diff = frames_remaining - mixer.min_frames_needed;
-
-			if (diff > (mixer.min_frames_needed << 1))
-				diff = mixer.min_frames_needed << 1;
-
-			if (diff > (mixer.min_frames_needed >> 1))
-				mixer.tick_add = calc_tickadd(mixer.sample_rate -
-				                              (diff / 5));
-
-			else if (diff > (mixer.min_frames_needed >> 2))
-				mixer.tick_add = calc_tickadd(mixer.sample_rate -
-				                              (diff >> 3));
-			else
-				mixer.tick_add = calc_tickadd(mixer.sample_rate);
-		}
-	} else {
-		/* There is way too much data in the buffer */
-		//		LOG_WARNING("overflow run requested %u, have %u,
-		// min %u", frames_requested, mixer.frames_done.load(),
-		// mixer.min_frames_needed.load());
-		if (mixer.frames_done > MIXER_BUFSIZE)
-			index_add = MIXER_BUFSIZE - 2 * mixer.min_frames_needed;
-		else
-			index_add = mixer.frames_done - 2 * mixer.min_frames_needed;
-
-		index_add = (index_add << INDEX_SHIFT_LOCAL) / frames_requested;
-		reduce_frames = mixer.frames_done - 2 * mixer.min_frames_needed;
-
-		mixer.tick_add = calc_tickadd(mixer.sample_rate -
-		                              (mixer.min_frames_needed / 5));
+	// SDL may run the callback on a new thread whenever it reopens the device
+	static thread_local bool is_thread_configured = false;
+	if (!is_thread_configured) {
+		THREAD_ApplyToCurrent(ThreadClass::Audio);
+		is_thread_configured = true;
 	}
 
-	MIXER_ReduceChannelsDoneCounts(reduce_frames);
-
-	// Reset mixer.tick_add when irqs are important
-	if (Mixer_irq_important())
-		mixer.tick_add = calc_tickadd(mixer.sample_rate);
-
-	mixer.frames_done -= reduce_frames;
-	mixer.frames_needed -= reduce_frames;
-
-	pos       = mixer.pos;
-	mixer.pos = (mixer.pos + reduce_frames) & MIXER_BUFMASK;
-
-	if (frames_requested != reduce_frames) {
-		while (frames_requested--) {
-			const auto i = check_cast<work_index_t>(
-			        (pos + (index >> INDEX_SHIFT_LOCAL)) & MIXER_BUFMASK);
-			index += index_add;
-
-			*output++ = MIXER_CLIP(static_cast<int>(mixer.work[i][0]));
-			*output++ = MIXER_CLIP(static_cast<int>(mixer.work[i][1]));
-		}
-		// Clean the used buffers
-		while (reduce_frames--) {
-			pos &= MIXER_BUFMASK;
-
-			mixer.work[pos][0] = 0.0f;
-			mixer.work[pos][1] = 0.0f;
-
-			mixer.aux_reverb[pos][0] = 0.0f;
-			mixer.aux_reverb[pos][1] = 0.0f;
-
-			mixer.aux_chorus[pos][0] = 0.0f;
-			mixer.aux_chorus[pos][1] = 0.0f;
+	// Time the device's actual period between callbacks
+	auto &callback_stats  = mixer.callback_stats;
+	const auto now_ns     = ns_between({}, stats_clock::now());
+	const auto last_ns    = callback_stats.last_callback_ns.exchange(now_ns);
+	if (last_ns) {
+		callback_stats.intervals_ns += now_ns - last_ns;
+		callback_stats.queued_frames += mixer.output_queue.Size();
+		++callback_stats.num_callbacks;
+	}
 
-			++pos;
-		}
-	} else {
-		while (reduce_frames--) {
-			pos &= MIXER_BUFMASK;
+	const auto frames_requested = len / mixer_frame_size;
 
-			*output++ = MIXER_CLIP(static_cast<int>(mixer.work[pos][0]));
-			*output++ = MIXER_CLIP(static_cast<int>(mixer.work[pos][1]));
+	// Play silence until a whole block is queued, rather than starting and
+	// stopping within the block
+	if (mixer.output_queue.Size() < frames_requested) {
+		++mixer.underruns;
+		METRICS_Add(Metric::AudioUnderruns);
+		mixer.frames_queued_after_callback = mixer.output_queue.Size();
+		TracyPlot("Mixer underruns", static_cast<int64_t>(mixer.underruns));
+		return;
+	}
 
-			mixer.work[pos][0] = 0.0f;
-			mixer.work[pos][1] = 0.0f;
+	// The callback can't allocate, so it pops in chunks
+	constexpr auto chunk_frames = 256;
+	std::array<AudioFrame, chunk_frames> chunk;
 
-			mixer.aux_reverb[pos][0] = 0.0f;
-			mixer.aux_reverb[pos][1] = 0.0f;
+	auto output           = reinterpret_cast<int16_t *>(stream);
+	auto frames_remaining = frames_requested;
 
-			mixer.aux_chorus[pos][0] = 0.0f;
-			mixer.aux_chorus[pos][1] = 0.0f;
+	while (frames_remaining > 0) {
+		const auto n = mixer.output_queue.Pop(
+		        chunk.data(), std::min(frames_remaining, chunk_frames));
 
-			++pos;
+		for (auto i = 0; i < n; ++i) {
+			*output++ = MIXER_CLIP(static_cast<int>(chunk[i].left));
+			*output++ = MIXER_CLIP(static_cast<int>(chunk[i].right));
 		}
+		assert(n > 0);
+		frames_remaining -= n;
 	}
-}
 
-#undef INDEX_SHIFT_LOCAL
+	mixer.frames_queued_after_callback = mixer.output_queue.Size();
+	TracyPlot("Mixer queued frames",
+	          static_cast<int64_t>(mixer.frames_queued_after_callback));
+}
 
 static void MIXER_Stop([[maybe_unused]] Section *sec)
-{}
+{
+	mixer.parallel_mix_pool.Stop();
+}
 
 class MIXER final : public Program {
 public:
@@ -2144,6 +2880,10 @@ public:
 			MIDI_ListAll(this);
 			return;
 		}
+		if (cmd->FindExist("/STATS")) {
+			ShowMixerStats();
+			return;
+		}
 		auto showStatus = !cmd->FindExist("/NOSHOW", true);
 
 		std::vector<std::string> args = {};
@@ -2152,7 +2892,7 @@ public:
 		mixer_channel_t channel = {};
 		auto is_master          = false;
 
-		MIXER_LockAudioDevice();
+		MIXER_LockMixer();
 		for (auto &arg : args) {
 			// Does this argument set the target channel of
 			// subsequent commands?
@@ -2257,7 +2997,7 @@ public:
 				channel->SetVolume(volume.left, volume.right);
 			}
 		}
-		MIXER_UnlockAudioDevice();
+		MIXER_UnlockMixer();
 
 		MIXER_UpdateAllChannelVolumes();
 
@@ -2274,6 +3014,7 @@ private:
 		        "Usage:\n"
 		        "  [color=green]mixer[reset] [color=cyan][CHANNEL][reset] [color=white]COMMANDS[reset] [/noshow]\n"
 		        "  [color=green]mixer[reset] [/listmidi]\n"
+		        "  [color=green]mixer[reset] [/stats]\n"
 		        "\n"
 		        "Where:\n"
 		        "  [color=cyan]CHANNEL[reset]  is the sound channel to change the settings of.\n"
@@ -2289,6 +3030,10 @@ private:
 		        "  If channel is unspecified, you can set crossfeed, reverb or chorus globally.\n"
 		        "  You can view the list of available MIDI devices with /listmidi.\n"
 		        "  The /noshow option applies the changes without showing the mixer settings.\n"
+		        "  The /stats option shows the host CPU time spent on each channel since the\n"
+		        "  previous /stats, so you can see which device is the most demanding, and\n"
+		        "  how long each channel that sleeps through silence has been asleep.\n"
+		        "  It also shows the audio device's measured period and output latency.\n"
 		        "\n"
 		        "Examples:\n"
 		        "  [color=green]mixer[reset] [color=cyan]cdda[reset] [color=white]50[reset] [color=cyan]sb[reset] [color=white]reverse[reset] /noshow\n"
@@ -2305,6 +3050,23 @@ private:
 		MSG_Add("SHELL_CMD_MIXER_CHANNEL_STEREO", "Stereo");
 
 		MSG_Add("SHELL_CMD_MIXER_CHANNEL_MONO", "Mono");
+
+		MSG_Add("SHELL_CMD_MIXER_STATS_INTRO",
+		        "Host CPU time over the last %.1f seconds, as a percentage of one core:\n");
+
+		MSG_Add("SHELL_CMD_MIXER_STATS_LAYOUT",
+		        "%-22s %-6s %5s %6s %8.2f %8.2f %8.2f %8.2f %8.2f");
+
+		MSG_Add("SHELL_CMD_MIXER_STATS_LABELS",
+		        "[color=white]Channel      State  Wakes Asleep  Handler Resample  Filters  Effects    Total[reset]");
+
+		MSG_Add("SHELL_CMD_MIXER_STATS_LATENCY",
+		        "\nAudio output through the %s driver in %u-frame blocks every %.2f ms,\n"
+		        "with %.2f ms queued: %.2f ms of latency plus the driver's own buffering.\n");
+
+		MSG_Add("SHELL_CMD_MIXER_CHANNEL_AWAKE", "awake");
+
+		MSG_Add("SHELL_CMD_MIXER_CHANNEL_ASLEEP", "asleep");
 	}
 
 	void ParseVolume(const std::string &s, AudioFrame &volume)
@@ -2376,7 +3138,7 @@ private:
 		const auto off_value = MSG_Get("SHELL_CMD_MIXER_CHANNEL_OFF");
 		constexpr auto none_value = "-";
 
-		MIXER_LockAudioDevice();
+		MIXER_LockMixer();
 
 		constexpr auto master_channel_string = "[color=cyan]MASTER[reset]";
 
@@ -2434,7 +3196,116 @@ private:
 			             chorus);
 		}
 
-		MIXER_UnlockAudioDevice();
+		MIXER_UnlockMixer();
+	}
+
+	void ShowMixerStats()
+	{
+		std::string column_layout = MSG_Get("SHELL_CMD_MIXER_STATS_LAYOUT");
+		column_layout.append({'\n'});
+
+		MIXER_LockMixer();
+
+		const auto now        = stats_clock::now();
+		const auto elapsed_ns = std::max(ns_between(mixer.stats.taken_at, now),
+		                                 int64_t{1});
+		mixer.stats.taken_at  = now;
+
+		auto percent_of = [elapsed_ns](const int64_t ns) {
+			return static_cast<double>(ns) * 100.0 /
+			       static_cast<double>(elapsed_ns);
+		};
+
+		auto show_channel = [&](const std::string &name,
+		                        const std::string &state,
+		                        const std::string &wake_ups,
+		                        const std::string &asleep,
+		                        const MixerChannelStats &stats) {
+			const auto total_ns = stats.handler_ns + stats.resample_ns +
+			                      stats.filter_ns + stats.effects_ns;
+			WriteOut(column_layout.c_str(),
+			         name.c_str(),
+			         state.c_str(),
+			         wake_ups.c_str(),
+			         asleep.c_str(),
+			         percent_of(stats.handler_ns),
+			         percent_of(stats.resample_ns),
+			         percent_of(stats.filter_ns),
+			         percent_of(stats.effects_ns),
+			         percent_of(total_ns));
+		};
+
+		WriteOut(MSG_Get("SHELL_CMD_MIXER_STATS_INTRO"),
+		         static_cast<double>(elapsed_ns) / 1e9);
+		WriteOut("%s\n", MSG_Get("SHELL_CMD_MIXER_STATS_LABELS"));
+
+		constexpr auto none_value = "-";
+
+		// The master channel's only cost is its effects
+		MixerChannelStats master_stats = {};
+		master_stats.effects_ns        = mixer.stats.effects_ns;
+		mixer.stats.effects_ns         = 0;
+
+		constexpr auto master_channel_string = "[color=cyan]MASTER[reset]";
+		show_channel(convert_ansi_markup(master_channel_string),
+		             none_value,
+		             none_value,
+		             none_value,
+		             master_stats);
+
+		for (auto &[name, chan] : mixer.channels) {
+			const auto stats = chan->TakeStats();
+
+			std::string state = chan->is_enabled
+			                          ? MSG_Get("SHELL_CMD_MIXER_CHANNEL_AWAKE")
+			                          : MSG_Get("SHELL_CMD_MIXER_CHANNEL_OFF");
+			std::string wake_ups = none_value;
+			std::string asleep   = none_value;
+			if (chan->HasFeature(ChannelFeature::Sleep)) {
+				if (!chan->is_enabled)
+					state = MSG_Get("SHELL_CMD_MIXER_CHANNEL_ASLEEP");
+				wake_ups = std::to_string(stats.wake_ups);
+
+				// The share of the wall-clock time spent asleep
+				char asleep_percent[16];
+				safe_sprintf(asleep_percent,
+				             "%.0f%%",
+				             std::min(percent_of(stats.asleep_ms * 1'000'000),
+				                      100.0));
+				asleep = asleep_percent;
+			}
+
+			auto channel_name = std::string("[color=cyan]") + name +
+			                    std::string("[reset]");
+
+			show_channel(convert_ansi_markup(channel_name),
+			             state,
+			             wake_ups,
+			             asleep,
+			             stats);
+		}
+
+		// The device's measured period and the frames queued ahead of
+		// each callback make up the output latency
+		auto &callback_stats     = mixer.callback_stats;
+		const auto num_callbacks = callback_stats.num_callbacks.exchange(0);
+		const auto intervals_ns  = callback_stats.intervals_ns.exchange(0);
+		const auto queued_frames = callback_stats.queued_frames.exchange(0);
+		if (num_callbacks > 0) {
+			const auto period_ms = static_cast<double>(intervals_ns) /
+			                       num_callbacks / 1e6;
+			const auto queued_ms = frames_to_ms(
+			        static_cast<int>(queued_frames / num_callbacks));
+
+			WriteOut(MSG_Get("SHELL_CMD_MIXER_STATS_LATENCY"),
+			         SDL_GetCurrentAudioDriver(),
+			         mixer.blocksize,
+			         period_ms,
+			         queued_ms,
+			         period_ms + queued_ms);
+		}
+
+		MIXER_UnlockMixer();
 	}
 };
 
@@ -2442,6 +3313,16 @@ std::unique_ptr<Program> MIXER_ProgramCreate() {
 	return ProgramCreate<MIXER>();
 }
 
+int MIXER_GetSampleRate()
+{
+	return mixer.sample_rate.load();
+}
+
+int64_t MIXER_GetFramesMixed()
+{
+	return mixer.frames_mixed;
+}
+
 bool MIXER_IsManuallyMuted()
 {
 	return mixer.state == MixerState::Mute;
@@ -2482,6 +3363,8 @@ void MIXER_SetState(MixerState requested)
 		// LOG_MSG("MIXER: Changed from on to %s",
 		// MixerStateToString(requested));
 	} else if (mixer.state != MixerState::On && requested == MixerState::On) {
+		// The device is paused, so drop the frames left from before
+		mixer.output_queue.Clear();
 		TIMER_DelTickHandler(MIXER_Mix_NoSound);
 		TIMER_AddTickHandler(MIXER_Mix);
 		// LOG_MSG("MIXER: Changed from %s to on",
@@ -2529,18 +3412,81 @@ void MIXER_CloseAudioDevice()
 	TIMER_DelTickHandler(MIXER_Mix);
 	TIMER_DelTickHandler(MIXER_Mix_NoSound);
 
-	MIXER_LockAudioDevice();
+	MIXER_LockMixer();
 	for (auto &it : mixer.channels)
 		it.second->Enable(false);
-	MIXER_UnlockAudioDevice();
+	MIXER_UnlockMixer();
 
 	if (mixer.sdldevice) {
 		SDL_CloseAudioDevice(mixer.sdldevice);
 		mixer.sdldevice = 0;
+
+		if (mixer.underruns || mixer.overruns)
+			LOG_MSG("MIXER: Played %d blocks of silence waiting for frames "
+			        "and dropped frames on %d ticks",
+			        mixer.underruns.load(),
+			        mixer.overruns.load());
 	}
+	mixer.underruns = 0;
+	mixer.overruns  = 0;
+
+	mixer.callback_stats.last_callback_ns = 0;
+	mixer.callback_stats.intervals_ns     = 0;
+	mixer.callback_stats.queued_frames    = 0;
+	mixer.callback_stats.num_callbacks    = 0;
+
 	mixer.state = MixerState::Uninitialized;
 }
 
+static void configure_parallel_render(const bool parallel_render_enabled)
+{
+	mixer.parallel_mix_pool.Stop();
+	if (!parallel_render_enabled)
+		return;
+
+	// Leave a core for the emulation thread, which mixes channels too
+	constexpr auto max_workers = 3;
+	const auto num_cores = static_cast<int>(std::thread::hardware_concurrency());
+	const auto num_workers = std::min(num_cores - 1, max_workers);
+
+	if (num_workers < 1) {
+		LOG_WARNING("MIXER: Parallel rendering needs more than one CPU core, rendering serially");
+		return;
+	}
+	mixer.parallel_mix_pool.Start(num_workers);
+	LOG_MSG("MIXER: Rendering channels in parallel on %d worker threads",
+	        num_workers);
+}
+
+// Switches SDL to the requested audio driver, such as the low-latency WASAPI,
+// CoreAudio, or PipeWire drivers, falling back to SDL's default driver
+static void select_audio_driver(const std::string &requested_driver)
+{
+	const auto current_driver = SDL_GetCurrentAudioDriver();
+
+	const auto use_default = (requested_driver == "auto");
+	if (use_default || !current_driver || requested_driver == current_driver)
+		return;
+
+	SDL_AudioQuit();
+	if (SDL_AudioInit(requested_driver.c_str()) == 0)
+		return;
+
+	LOG_WARNING("MIXER: Can't use the '%s' audio driver (%s), using the default driver",
+	            requested_driver.c_str(),
+	            SDL_GetError());
+
+	if (SDL_AudioInit(nullptr) != 0)
+		LOG_WARNING("MIXER: Can't initialise the default audio driver: %s",
+		            SDL_GetError());
+}
+
+// Whether the mixer section selects the polyphase resampler
+bool is_polyphase_resampler_selected(const Section_prop &section)
+{
+	return std::string_view(section.Get_string("resampler")) == "polyphase";
+}
+
 void MIXER_Init(Section *sec)
 {
 	const auto channel_states = save_channel_states();
@@ -2556,6 +3502,8 @@ void MIXER_Init(Section *sec)
 	mixer.blocksize = static_cast<uint16_t>(section->Get_int("blocksize"));
 	const auto negotiate = section->Get_bool("negotiate");
 
+	select_audio_driver(section->Get_string("audio_driver"));
+
 	/* Start the Mixer using SDL Sound at 22 khz */
 	SDL_AudioSpec spec;
 	SDL_AudioSpec obtained;
@@ -2622,10 +3570,13 @@ void MIXER_Init(Section *sec)
 		mixer.tick_add = calc_tickadd(mixer.sample_rate);
 		MIXER_SetState(MixerState::On);
 
-		LOG_MSG("MIXER: Negotiated %u-channel %u-Hz audio in %u-frame blocks",
+		LOG_MSG("MIXER: Negotiated %u-channel %u-Hz audio in %u-frame blocks "
+		        "(%.1f ms) with the %s driver",
 		        obtained.channels,
 		        mixer.sample_rate.load(),
-		        mixer.blocksize);
+		        mixer.blocksize,
+		        frames_to_ms(mixer.blocksize),
+		        SDL_GetCurrentAudioDriver());
 	}
 
 	// 1000 = 8 *125
@@ -2638,11 +3589,30 @@ void MIXER_Init(Section *sec)
 
 	const auto prebuffer_frames = (mixer.sample_rate * prebuffer_ms) / 1000;
 
-	mixer.pos               = 0;
-	mixer.frames_done       = 0;
-	mixer.frames_needed     = mixer.min_frames_needed + 1;
-	mixer.min_frames_needed = 0;
-	mixer.max_frames_needed = mixer.blocksize * 2 + 2 * prebuffer_frames;
+	mixer.pos           = 0;
+	mixer.frames_done   = 0;
+	mixer.frames_needed = 1;
+
+	mixer.stats = {0, stats_clock::now()};
+
+	// Keep the prebuffer queued after each callback, but at least a couple
+	// of ticks' worth to ride out the jitter of the emulation's ticks
+	const auto frames_per_tick  = mixer.sample_rate / 1000;
+	mixer.latency_target_frames = std::max(prebuffer_frames,
+	                                       2 * frames_per_tick);
+
+	mixer.max_queued_frames = std::min(mixer.blocksize * 2 +
+	                                           2 * mixer.latency_target_frames,
+	                                   OutputQueue::capacity);
+
+	// A frame waits for the queue ahead of it and then plays through the
+	// device's block; the driver's own buffering comes on top
+	if (mixer.state == MixerState::On)
+		LOG_MSG("MIXER: Expecting %.1f ms of output latency (%.1f ms device period "
+		        "and %.1f ms queued), plus the driver's own buffering",
+		        frames_to_ms(2 * mixer.blocksize + mixer.latency_target_frames),
+		        frames_to_ms(mixer.blocksize),
+		        frames_to_ms(mixer.blocksize + mixer.latency_target_frames));
 
 	// Initialize the 8-bit to 16-bit lookup table
 	fill_8to16_lut();
@@ -2682,6 +3652,12 @@ void MIXER_Init(Section *sec)
 	// Initialise compressor
 	configure_compressor(section->Get_bool("compressor"));
 
+	mixer.use_polyphase_resampler = is_polyphase_resampler_selected(*section);
+
+	configure_parallel_render(section->Get_bool("parallel_render"));
+
+	mixer.mute_fast_forward = section->Get_bool("fast_forward_mute");
+
 	restore_channel_states(channel_states);
 }
 
@@ -2742,12 +3718,13 @@ void init_mixer_dosbox_settings(Section_prop &sec_prop)
 	int_prop->Set_values(rates);
 	int_prop->Set_help("Mixer sample rate.");
 
-	const char *blocksizes[] = {"128", "256", "512", "1024", "2048", "4096", "8192", 0};
+	const char *blocksizes[] = {"64", "128", "256", "512", "1024", "2048", "4096", "8192", 0};
 
 	int_prop = sec_prop.Add_int("blocksize", only_at_start, default_blocksize);
 	int_prop->Set_values(blocksizes);
 	int_prop->Set_help("Mixer block size; larger values might help with sound stuttering but sound will\n"
-	                   "also be more lagged.");
+	                   "also be more lagged. Blocks of 64 or 128 frames need a low-latency driver\n"
+	                   "(see 'audio_driver').");
 
 	int_prop = sec_prop.Add_int("prebuffer", only_at_start, default_prebuffer_ms);
 	int_prop->SetMinMax(0, max_prebuffer_ms);
@@ -2755,6 +3732,14 @@ void init_mixer_dosbox_settings(Section_prop &sec_prop)
 	        "How many milliseconds of sound to render on top of the blocksize; larger values\n"
 	        "might help with sound stuttering but sound will also be more lagged.");
 
+	auto string_prop = sec_prop.Add_string("audio_driver", only_at_start, "auto");
+	string_prop->Set_help(
+	        "The SDL audio driver to play through ('auto' by default, which uses SDL's\n"
+	        "default driver). The low-latency drivers are 'wasapi' on Windows, 'coreaudio'\n"
+	        "on macOS, and 'pipewire' on Linux; others include 'directsound', 'pulseaudio',\n"
+	        "'alsa', and 'jack'. Falls back to the default driver if unavailable.\n"
+	        "Note: The MIXER /STATS command shows the measured device period and latency.");
+
 	bool_prop = sec_prop.Add_bool("negotiate",
 	                              only_at_start,
 	                              default_allow_negotiate);
@@ -2768,7 +3753,7 @@ void init_mixer_dosbox_settings(Section_prop &sec_prop)
 	                    "  off:  Disable compressor.\n"
 	                    "  on:   Enable compressor (default).");
 
-	auto string_prop = sec_prop.Add_string("crossfeed", when_idle, "off");
+	string_prop = sec_prop.Add_string("crossfeed", when_idle, "off");
 	string_prop->Set_help(
 	        "Set crossfeed globally on all stereo channels for headphone listening:\n"
 	        "  off:         No crossfeed (default).\n"
@@ -2810,6 +3795,26 @@ void init_mixer_dosbox_settings(Section_prop &sec_prop)
 	        "Note: You can fine-tune per-channel chorus levels via mixer commands.");
 	string_prop->Set_values(chorus_presets);
 
+	const char *resamplers[] = {"speex", "polyphase", nullptr};
+	string_prop = sec_prop.Add_string("resampler", only_at_start, resamplers[0]);
+	string_prop->Set_help(
+	        "Resampler used for the channels that need high-quality resampling to the\n"
+	        "mixer rate:\n"
+	        "  speex:      Resample with Speex (default).\n"
+	        "  polyphase:  Resample with precomputed polyphase filters, which cost less.\n"
+	        "              Rates without a simple ratio to the mixer rate still use Speex.");
+	string_prop->Set_values(resamplers);
+
+	bool_prop = sec_prop.Add_bool("parallel_render", only_at_start, false);
+	bool_prop->Set_help(
+	        "Render the synthesizer channels that support it (OPL, CMS, Tandy, PS/1 Audio,\n"
+	        "and Innovation) in parallel on a few worker threads (disabled by default).\n"
+	        "This can help on slower multi-core systems when several synths play at once.");
+
+	bool_prop = sec_prop.Add_bool("fast_forward_mute", when_idle, default_on);
+	bool_prop->Set_help("Mute the audio output while fast-forwarding (enabled by default).\n"
+	                    "The audio is still mixed, so it can be captured.");
+
 	MAPPER_AddHandler(ToggleMute, SDL_SCANCODE_F8, PRIMARY_MOD, "mute", "Mute");
 }
 
@@ -29,16 +29,21 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
+#include <deque>
+#include <vector>
 
 #include "callback.h"
 #include "cpu.h"
 #include "ethernet.h"
 #include "inout.h"
+#include "metrics.h"
 #include "pic.h"
+#include "replay.h"
 #include "setup.h"
 #include "string_utils.h"
 #include "support.h"
 #include "timer.h"
+#include "tracy.h"
 
 /* Couldn't find a real spec for the NE2000 out there, hence this is adapted heavily from Bochs */
 
@@ -265,6 +270,7 @@ bx_ne2k_c::write_cr(io_val_t data)
       // BX_NE2K_THIS ethdev->sendpkt(& BX_NE2K_THIS s.mem[BX_NE2K_THIS
       // s.tx_page_start*256 - BX_NE2K_MEMSTART], BX_NE2K_THIS s.tx_bytes);
       ethernet->SendPacket(&s.mem[s.tx_page_start * 256 - BX_NE2K_MEMSTART], s.tx_bytes);
+      METRICS_Add(Metric::Ne2000PacketsSent);
       // s.tx_timer_index = (64 + 96 + 4*8 + BX_NE2K_THIS s.tx_bytes*8)/10;
       s.tx_timer_active = 1;
 
@@ -1220,10 +1226,35 @@ bx_ne2k_c::rx_handler(void *arg, const void *buf, unsigned len)
  * rx ring has enough room, it is copied into it and
  * the receive process is updated
  */
-int bx_ne2k_c::rx_frame(const void *buf, unsigned io_len)
+bool bx_ne2k_c::rx_has_room(unsigned io_len)
 {
   int pages;
   int avail;
+
+  // Add the pkt header + CRC to the length, and work
+  // out how many 256-byte pages the frame would occupy
+  pages = (int)((io_len + 4u + 4u + 255u)/256u);
+
+  if (BX_NE2K_THIS s.curr_page < BX_NE2K_THIS s.bound_ptr) {
+    avail = BX_NE2K_THIS s.bound_ptr - BX_NE2K_THIS s.curr_page;    
+  } else {
+    avail = (BX_NE2K_THIS s.page_stop - BX_NE2K_THIS s.page_start) -
+      (BX_NE2K_THIS s.curr_page - BX_NE2K_THIS s.bound_ptr);
+  }
+
+  // Avoid getting into a buffer overflow condition by not attempting
+  // to do partial receives. The emulation to handle this condition
+  // seems particularly painful.
+  return !((avail < pages)
+#if BX_NE2K_NEVER_FULL_RING
+      || (avail == pages)
+#endif
+      );
+}
+
+int bx_ne2k_c::rx_frame(const void *buf, unsigned io_len, bool raise_irq)
+{
+  int pages;
   unsigned idx;
 //  int wrapped;
   uint8_t nextpage;
@@ -1250,22 +1281,7 @@ int bx_ne2k_c::rx_frame(const void *buf, unsigned io_len)
   // out how many 256-byte pages the frame would occupy
   pages = (int)((io_len + 4u + 4u + 255u)/256u);
 
-  if (BX_NE2K_THIS s.curr_page < BX_NE2K_THIS s.bound_ptr) {
-    avail = BX_NE2K_THIS s.bound_ptr - BX_NE2K_THIS s.curr_page;    
-  } else {
-    avail = (BX_NE2K_THIS s.page_stop - BX_NE2K_THIS s.page_start) -
-      (BX_NE2K_THIS s.curr_page - BX_NE2K_THIS s.bound_ptr);
-//    wrapped = 1;
-  }
-
-  // Avoid getting into a buffer overflow condition by not attempting
-  // to do partial receives. The emulation to handle this condition
-  // seems particularly painful.
-  if ((avail < pages) 
-#if BX_NE2K_NEVER_FULL_RING
-      || (avail == pages)
-#endif
-      ) {
+  if (!rx_has_room(io_len)) {
 	BX_DEBUG("no space");
 	return -1;
   }
@@ -1346,7 +1362,7 @@ int bx_ne2k_c::rx_frame(const void *buf, unsigned io_len)
 
   BX_NE2K_THIS s.ISR.pkt_rx = 1;
 
-  if (BX_NE2K_THIS s.IMR.rx_inte) {
+  if (BX_NE2K_THIS s.IMR.rx_inte && raise_irq) {
 	//LOG_MSG("packet rx interrupt");
 	  PIC_ActivateIRQ(s.base_irq);
     //DEV_pic_raise_irq(BX_NE2K_THIS s.base_irq);
@@ -1428,15 +1444,55 @@ static void NE2000_TX_Event([[maybe_unused]] uint32_t val)
 	theNE2kDevice->tx_timer();
 }
 
+// Frames received from the backend wait here until they fit in the
+// receive ring, instead of being lost whenever the ring is momentarily full
+constexpr size_t max_queued_rx_frames = 128;
+static std::deque<std::vector<uint8_t>> rx_queue = {};
+
+static int NE2000_Receive(const uint8_t *packet, int len) {
+	//LOG_MSG("NE2000: Received %d bytes", header->len);
+
+	// don't receive in loopback modes
+	if((theNE2kDevice->s.DCR.loop == 0) || (theNE2kDevice->s.TCR.loop_cntl != 0))
+		return -1;
+	if (len <= 0 || rx_queue.size() >= max_queued_rx_frames)
+		return -1;
+	rx_queue.emplace_back(packet, packet + len);
+	return len;
+}
+
+// Moves as many queued frames into the receive ring as fit, raising one
+// interrupt for all of them
+static void NE2000_DeliverFrames() {
+	auto &s = theNE2kDevice->s;
+	bool has_received = false;
+	while (!rx_queue.empty()) {
+		const auto &frame = rx_queue.front();
+		const auto len = static_cast<unsigned>(frame.size());
+		if (!s.CR.stop && s.page_start != 0 && !theNE2kDevice->rx_has_room(len))
+			break;
+		if (theNE2kDevice->rx_frame(frame.data(), len, false) >= 0) {
+			METRICS_Add(Metric::Ne2000PacketsReceived);
+			has_received = true;
+		}
+		rx_queue.pop_front();
+	}
+	if (has_received && s.IMR.rx_inte)
+		PIC_ActivateIRQ(s.base_irq);
+}
+
 static void NE2000_Poller(void) {
-	ethernet->GetPackets([](const uint8_t *packet, int len) {
-		//LOG_MSG("NE2000: Received %d bytes", header->len);
-		
-		// don't receive in loopback modes
-		if((theNE2kDevice->s.DCR.loop == 0) || (theNE2kDevice->s.TCR.loop_cntl != 0))
-			return -1;
-		return theNE2kDevice->rx_frame(packet, check_cast<uint16_t>(len));
-	});
+	ZoneScopedSubsystem("NE2000 poller");
+	// A replayed session receives the recorded packets instead
+	if (REPLAY_IsPlaying()) {
+		REPLAY_ReplayPackets(NE2000_Receive);
+	} else {
+		ethernet->GetPackets([](const uint8_t *packet, int len) {
+			REPLAY_AddPacket(packet, len);
+			return NE2000_Receive(packet, len);
+		});
+	}
+	NE2000_DeliverFrames();
 }
 
 class NE2K final : public Module_base {
@@ -1459,10 +1515,12 @@ public:
 			return;
 		}
 
-		ethernet = ETHERNET_OpenConnection("slirp");
+		const std::string backend = section->Get_string("backend");
+		ethernet = ETHERNET_OpenConnection(backend);
 		if(!ethernet)
 		{
-			LOG_MSG("NE2000: Failed to open Ethernet slirp backend");
+			LOG_MSG("NE2000: Failed to open Ethernet %s backend",
+			        backend.c_str());
 			load_success = false;
 			return;
 		}
@@ -1522,6 +1580,7 @@ public:
 		theNE2kDevice = nullptr;
 		TIMER_DelTickHandler(NE2000_Poller);
 		PIC_RemoveEvents(NE2000_TX_Event);
+		rx_queue.clear();
 	}	
 };
 
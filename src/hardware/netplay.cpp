@@ -0,0 +1,733 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "netplay.h"
+
+#if C_NETPLAY
+
+#include <SDL_net.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+
+#include "cpu.h"
+#include "dos_inc.h"
+#include "mem.h"
+#include "paging.h"
+#include "pic.h"
+#include "replay.h"
+#include "setup.h"
+#include "snapshot.h"
+#include "string_utils.h"
+#include "timer.h"
+#include "vga.h"
+
+bool NetWrapper_InitializeSDLNet(); // from misc_util.cpp
+
+// Every message starts with the magic and its type, followed by:
+//   Hello:    nothing, sent by the joining peer until it's welcomed
+//   Welcome:  the start time (8) and the protocol version (1)
+//   Inputs:   the tick the sender won't add input up to (4), the number of
+//             inputs it has received (4), the sequence number of the first
+//             input (4), whether all unacknowledged inputs follow (1), and
+//             the inputs: tick (4), type (1), payload size (2), payload
+//   Bye:      nothing, sent when the session ends
+// all little-endian
+constexpr char netplay_magic[8] = {'D', 'B', 'N', 'E', 'T', 'P', 'L', 'Y'};
+constexpr uint8_t netplay_version = 1;
+constexpr int max_message_bytes = 1400;
+
+enum class MessageType : uint8_t { Hello = 1, Welcome = 2, Inputs = 3, Bye = 4 };
+
+// Netplay's own input type, next to the replay's input records: the host's
+// cycles per tick, which both peers run at
+constexpr uint8_t cycle_max_input = 0x80;
+
+constexpr uint32_t snapshot_interval_ticks = 8;
+constexpr uint32_t send_interval_ticks = 2;
+constexpr int stall_send_interval_ms = 4;
+constexpr int hello_interval_ms = 250;
+constexpr int join_timeout_ms = 15 * 1000;
+constexpr int host_timeout_ms = 120 * 1000;
+constexpr int peer_timeout_ms = 10 * 1000;
+
+constexpr size_t page_bytes = MEM_PAGE_SIZE;
+
+struct Input {
+	uint32_t tick = 0;
+	uint8_t type = 0;
+	std::vector<uint8_t> payload = {};
+};
+
+struct OpenFile {
+	DOS_File *file = nullptr;
+	uint32_t pos = 0;
+
+	bool operator==(const OpenFile &other) const
+	{
+		return file == other.file;
+	}
+};
+
+// The machine as of the start of a tick, before its input was applied
+struct Snapshot {
+	uint32_t tick = 0;
+	std::vector<uint8_t> state = {};
+	std::vector<OpenFile> files = {};
+
+	// The RAM pages that changed since the previous snapshot, as they
+	// were then; empty for the oldest snapshot
+	std::vector<uint32_t> undo_pages = {};
+	std::vector<uint8_t> undo_data = {};
+};
+
+static struct {
+	bool active = false;
+	bool is_host = false;
+	UDPsocket socket = nullptr;
+	IPaddress peer = {};
+	UDPpacket *packet = nullptr;
+
+	time_t start_time = 0;
+	int32_t cycle_max = 0; // zero until the host sends its cycles
+	uint32_t delay_ticks = 0;
+	uint32_t window_ticks = 0;
+
+	// Input log, kept back to the oldest snapshot
+	std::deque<Input> local_inputs = {};
+	uint32_t local_first_seq = 0;
+	uint32_t local_acked_seq = 0; // the inputs the peer has received
+	std::deque<Input> remote_inputs = {};
+	uint32_t remote_first_seq = 0;
+	uint32_t remote_next_seq = 0;
+
+	int64_t applied_through = -1;  // the last tick the input was applied to
+	int64_t promised = -1;         // no more local input up to this tick
+	int64_t remote_confirmed = -1; // nor remote input up to this one
+	int64_t last_sent_tick = -1;
+	int64_t last_sent_ms = 0;
+	int64_t last_heard_ms = 0;
+	int32_t sent_cycle_max = 0;
+	bool has_unsent_input = false;
+
+	// The RAM as of the newest snapshot
+	std::vector<uint8_t> ram = {};
+	std::deque<Snapshot> snapshots = {};
+
+	uint64_t rollbacks = 0;
+	uint64_t rolled_back_ticks = 0;
+	uint64_t stalled_ms = 0;
+} netplay;
+
+// Encoding
+// ~~~~~~~~
+static void put(std::vector<uint8_t> &out, const uint64_t value, const int num_bytes)
+{
+	for (auto i = 0; i < num_bytes; ++i)
+		out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+static uint64_t get(const uint8_t *in, const size_t size, size_t &pos, const int num_bytes)
+{
+	uint64_t value = 0;
+	for (auto i = 0; i < num_bytes && pos < size; ++i)
+		value |= static_cast<uint64_t>(in[pos++]) << (i * 8);
+	return value;
+}
+
+static std::vector<uint8_t> start_message(const MessageType type)
+{
+	std::vector<uint8_t> message(netplay_magic, netplay_magic + sizeof(netplay_magic));
+	put(message, static_cast<uint8_t>(type), 1);
+	return message;
+}
+
+static void send_message(const std::vector<uint8_t> &message)
+{
+	UDPpacket packet = {};
+	packet.channel = -1;
+	packet.data = const_cast<uint8_t *>(message.data());
+	packet.len = static_cast<int>(message.size());
+	packet.maxlen = packet.len;
+	packet.address = netplay.peer;
+	SDLNet_UDP_Send(netplay.socket, -1, &packet);
+}
+
+// Receives the next message into the packet and returns its type, skipping
+// anything that isn't netplay's
+static bool receive_message(MessageType &type, size_t &pos)
+{
+	auto &packet = *netplay.packet;
+	while (SDLNet_UDP_Recv(netplay.socket, &packet) > 0) {
+		const auto size = static_cast<size_t>(packet.len);
+		if (size <= sizeof(netplay_magic) ||
+		    memcmp(packet.data, netplay_magic, sizeof(netplay_magic)) != 0)
+			continue;
+		pos = sizeof(netplay_magic);
+		type = static_cast<MessageType>(get(packet.data, size, pos, 1));
+		return true;
+	}
+	return false;
+}
+
+// Machine state
+// ~~~~~~~~~~~~~
+static std::vector<uint32_t> take_dirty_pages()
+{
+	// The Tandy and PCjr video memory isn't written through the RAM's
+	// page handlers
+	if (IS_TANDY_ARCH && vga.tandy.mem_base)
+		MEM_MarkDirty(static_cast<PhysPt>(vga.tandy.mem_base - MemBase),
+		              32 * 1024);
+	return MEM_TakeDirtyPages();
+}
+
+static std::vector<OpenFile> open_files()
+{
+	std::vector<OpenFile> files = {};
+	for (const auto file : Files) {
+		if (!file || (file->GetInformation() & 0x8000))
+			continue;
+		uint32_t pos = 0;
+		file->Seek(&pos, DOS_SEEK_CUR);
+		files.push_back({file, pos});
+	}
+	return files;
+}
+
+static void take_snapshot()
+{
+	Snapshot snapshot = {};
+	if (!SNAPSHOT_CaptureState(snapshot.state))
+		return;
+	snapshot.tick = PIC_Ticks;
+	snapshot.files = open_files();
+
+	const auto ram_size = MEM_TotalPages() * page_bytes;
+	if (netplay.snapshots.empty()) {
+		MEM_TrackDirtyPages(true);
+		take_dirty_pages();
+		netplay.ram.assign(MemBase, MemBase + ram_size);
+	} else {
+		// Rollbacks are short, so the undo isn't worth compressing
+		for (const auto page : take_dirty_pages()) {
+			const auto offset = page * page_bytes;
+			if (offset >= netplay.ram.size() ||
+			    memcmp(netplay.ram.data() + offset, MemBase + offset, page_bytes) == 0)
+				continue;
+			snapshot.undo_pages.push_back(page);
+			snapshot.undo_data.insert(snapshot.undo_data.end(),
+			                          netplay.ram.begin() + offset,
+			                          netplay.ram.begin() + offset + page_bytes);
+			memcpy(netplay.ram.data() + offset, MemBase + offset, page_bytes);
+		}
+	}
+	netplay.snapshots.push_back(std::move(snapshot));
+}
+
+static void drop_snapshots()
+{
+	netplay.snapshots.clear();
+	netplay.ram.clear();
+	netplay.ram.shrink_to_fit();
+	MEM_TrackDirtyPages(false);
+}
+
+// Restores the newest snapshot taken at or before the tick, dropping the
+// ones after it
+static bool restore_snapshot(const uint32_t tick)
+{
+	auto &snapshots = netplay.snapshots;
+	auto target = snapshots.size();
+	while (target > 0 && snapshots[target - 1].tick > tick)
+		--target;
+	if (target == 0 || open_files() != snapshots[target - 1].files)
+		return false;
+
+	// Back to the newest snapshot, then step back through the undos
+	for (const auto page : take_dirty_pages()) {
+		const auto offset = page * page_bytes;
+		memcpy(MemBase + offset, netplay.ram.data() + offset, page_bytes);
+	}
+	while (snapshots.size() > target) {
+		const auto &newest = snapshots.back();
+		for (size_t i = 0; i < newest.undo_pages.size(); ++i) {
+			const auto offset = newest.undo_pages[i] * page_bytes;
+			const auto data = newest.undo_data.data() + i * page_bytes;
+			memcpy(netplay.ram.data() + offset, data, page_bytes);
+			memcpy(MemBase + offset, data, page_bytes);
+		}
+		snapshots.pop_back();
+	}
+	const auto &snapshot = snapshots.back();
+	SNAPSHOT_RestoreState(snapshot.state);
+	for (const auto &open_file : snapshot.files) {
+		auto pos = open_file.pos;
+		open_file.file->Seek(&pos, DOS_SEEK_SET);
+	}
+	// The restored state may have re-installed page handlers
+	take_dirty_pages();
+	return true;
+}
+
+// Session
+// ~~~~~~~
+static void end_session(const char *reason)
+{
+	if (!netplay.active)
+		return;
+	send_message(start_message(MessageType::Bye));
+	LOG_MSG("NETPLAY: Session ended, %s; rolled back %" PRIu64 " times "
+	        "(%" PRIu64 " ms in all) and stalled for %" PRIu64 " ms",
+	        reason, netplay.rollbacks, netplay.rolled_back_ticks,
+	        netplay.stalled_ms);
+
+	drop_snapshots();
+	netplay.local_inputs.clear();
+	netplay.remote_inputs.clear();
+	SDLNet_FreePacket(netplay.packet);
+	netplay.packet = nullptr;
+	SDLNet_UDP_Close(netplay.socket);
+	netplay.socket = nullptr;
+	netplay.active = false;
+}
+
+static void send_inputs()
+{
+	const auto tick = static_cast<int64_t>(PIC_Ticks);
+	netplay.promised = std::max(netplay.promised,
+	                            std::max(tick, netplay.applied_through) +
+	                                    std::max<int64_t>(netplay.delay_ticks, 1) - 1);
+
+	auto message = start_message(MessageType::Inputs);
+	put(message, static_cast<uint32_t>(netplay.promised), 4);
+	put(message, netplay.remote_next_seq, 4);
+
+	// Resend everything the peer hasn't acknowledged, as much as fits
+	const auto first_seq = std::max(netplay.local_acked_seq, netplay.local_first_seq);
+	put(message, first_seq, 4);
+	const auto complete_pos = message.size();
+	put(message, 1, 1);
+	for (auto i = first_seq - netplay.local_first_seq; i < netplay.local_inputs.size(); ++i) {
+		const auto &input = netplay.local_inputs[i];
+		if (message.size() + 7 + input.payload.size() > max_message_bytes) {
+			message[complete_pos] = 0;
+			break;
+		}
+		put(message, input.tick, 4);
+		put(message, input.type, 1);
+		put(message, input.payload.size(), 2);
+		message.insert(message.end(), input.payload.begin(), input.payload.end());
+	}
+	send_message(message);
+	netplay.last_sent_tick = tick;
+	netplay.last_sent_ms = GetTicks();
+	netplay.has_unsent_input = false;
+}
+
+// Takes the peer's messages; returns the earliest tick that got input
+// after it was already run, or -1
+static int64_t receive_inputs()
+{
+	int64_t earliest_late = -1;
+	MessageType type = {};
+	size_t pos = 0;
+	while (receive_message(type, pos)) {
+		const auto data = netplay.packet->data;
+		const auto size = static_cast<size_t>(netplay.packet->len);
+		netplay.last_heard_ms = GetTicks();
+
+		if (type == MessageType::Hello && netplay.is_host) {
+			// The welcome got lost
+			auto welcome = start_message(MessageType::Welcome);
+			put(welcome, static_cast<uint64_t>(netplay.start_time), 8);
+			put(welcome, netplay_version, 1);
+			send_message(welcome);
+			continue;
+		}
+		if (type == MessageType::Bye) {
+			end_session("the other player left");
+			return -1;
+		}
+		if (type != MessageType::Inputs)
+			continue;
+
+		const auto confirmed = static_cast<int64_t>(get(data, size, pos, 4));
+		const auto acked = static_cast<uint32_t>(get(data, size, pos, 4));
+		auto seq = static_cast<uint32_t>(get(data, size, pos, 4));
+		const auto is_complete = get(data, size, pos, 1) != 0;
+		netplay.local_acked_seq = std::max(netplay.local_acked_seq, acked);
+
+		bool has_gap = false;
+		while (size - pos >= 7) {
+			Input input = {};
+			input.tick = static_cast<uint32_t>(get(data, size, pos, 4));
+			input.type = static_cast<uint8_t>(get(data, size, pos, 1));
+			const auto num_bytes = static_cast<size_t>(get(data, size, pos, 2));
+			if (size - pos < num_bytes)
+				break;
+			input.payload.assign(data + pos, data + pos + num_bytes);
+			pos += num_bytes;
+
+			if (seq > netplay.remote_next_seq) {
+				has_gap = true;
+				break;
+			}
+			if (seq++ < netplay.remote_next_seq)
+				continue;
+			if (input.tick <= netplay.applied_through &&
+			    (earliest_late < 0 || input.tick < earliest_late))
+				earliest_late = input.tick;
+			netplay.remote_inputs.push_back(std::move(input));
+			++netplay.remote_next_seq;
+		}
+		// The promise only holds once everything before it arrived
+		if (is_complete && !has_gap)
+			netplay.remote_confirmed = std::max(netplay.remote_confirmed, confirmed);
+	}
+	return earliest_late;
+}
+
+static void apply_inputs(const std::deque<Input> &inputs, const uint32_t tick)
+{
+	for (const auto &input : inputs) {
+		if (input.tick < tick)
+			continue;
+		if (input.tick > tick)
+			break;
+		if (input.type == cycle_max_input) {
+			size_t pos = 0;
+			netplay.cycle_max = static_cast<int32_t>(
+			        get(input.payload.data(), input.payload.size(), pos, 4));
+		} else {
+			REPLAY_ApplyInput(input.type, input.payload);
+		}
+	}
+}
+
+// Whether the tick may run before the peer's input for it is known
+static bool may_run(const uint32_t tick)
+{
+	if (tick <= netplay.remote_confirmed)
+		return true;
+	return netplay.window_ticks &&
+	       tick - netplay.remote_confirmed <= netplay.window_ticks &&
+	       !netplay.snapshots.empty() &&
+	       netplay.snapshots.front().tick <= netplay.remote_confirmed + 1;
+}
+
+static void prune_log()
+{
+	// Snapshots before the one a late input would roll back to
+	auto &snapshots = netplay.snapshots;
+	while (snapshots.size() > 1 &&
+	       snapshots[1].tick <= netplay.remote_confirmed + 1) {
+		snapshots.pop_front();
+		snapshots.front().undo_pages = {};
+		snapshots.front().undo_data = {};
+	}
+	const auto oldest_needed = snapshots.empty()
+	                                 ? netplay.applied_through + 1
+	                                 : static_cast<int64_t>(snapshots.front().tick);
+
+	while (!netplay.local_inputs.empty() &&
+	       netplay.local_first_seq < netplay.local_acked_seq &&
+	       netplay.local_inputs.front().tick < oldest_needed) {
+		netplay.local_inputs.pop_front();
+		++netplay.local_first_seq;
+	}
+	while (!netplay.remote_inputs.empty() &&
+	       netplay.remote_inputs.front().tick < oldest_needed) {
+		netplay.remote_inputs.pop_front();
+		++netplay.remote_first_seq;
+	}
+}
+
+// Rolls back to before the tick; returns the number of ticks rolled back
+static int roll_back(const uint32_t tick)
+{
+	const auto current = PIC_Ticks;
+	if (!restore_snapshot(tick)) {
+		end_session("the sessions went out of sync, as input arrived too late to roll back");
+		return 0;
+	}
+	netplay.applied_through = static_cast<int64_t>(PIC_Ticks) - 1;
+	const auto rolled_back = static_cast<int>(current - PIC_Ticks);
+	++netplay.rollbacks;
+	netplay.rolled_back_ticks += static_cast<uint64_t>(rolled_back);
+	return rolled_back;
+}
+
+// Interface
+// ~~~~~~~~~
+bool NETPLAY_IsActive()
+{
+	return netplay.active;
+}
+
+void NETPLAY_AddInput(const uint8_t type, const std::vector<uint8_t> &payload)
+{
+	if (!netplay.active)
+		return;
+	// Never in the past, nor before what the peer was promised
+	const auto tick = std::max({static_cast<int64_t>(PIC_Ticks) + netplay.delay_ticks,
+	                            netplay.applied_through + 1,
+	                            netplay.promised + 1});
+	netplay.local_inputs.push_back({static_cast<uint32_t>(tick), type, payload});
+	netplay.has_unsent_input = true;
+}
+
+time_t NETPLAY_StartTime()
+{
+	return netplay.start_time;
+}
+
+int NETPLAY_ServiceTick()
+{
+	if (!netplay.active)
+		return 0;
+
+	// The host's cycle setting is the one both peers run at
+	if (netplay.is_host && CPU_CycleMax != netplay.cycle_max &&
+	    CPU_CycleMax != netplay.sent_cycle_max) {
+		std::vector<uint8_t> payload = {};
+		put(payload, static_cast<uint32_t>(CPU_CycleMax), 4);
+		NETPLAY_AddInput(cycle_max_input, payload);
+		netplay.sent_cycle_max = CPU_CycleMax;
+	}
+
+	int rolled_back = 0;
+	auto late_tick = receive_inputs();
+	const auto stall_start_ms = GetTicks();
+	while (netplay.active && late_tick < 0) {
+		// No rollback can reach back past a point that couldn't be saved
+		if (netplay.window_ticks &&
+		    (netplay.snapshots.empty() ||
+		     PIC_Ticks - netplay.snapshots.back().tick >= snapshot_interval_ticks)) {
+			if (SNAPSHOT_CanCapture())
+				take_snapshot();
+			else if (!netplay.snapshots.empty())
+				drop_snapshots();
+		}
+		if (may_run(PIC_Ticks))
+			break;
+
+		// Wait for the peer, keeping it informed so it doesn't wait on us
+		if (GetTicksSince(netplay.last_heard_ms) > peer_timeout_ms) {
+			end_session("the other player stopped responding");
+			break;
+		}
+		if (GetTicksSince(netplay.last_sent_ms) >= stall_send_interval_ms)
+			send_inputs();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		late_tick = receive_inputs();
+	}
+	netplay.stalled_ms += static_cast<uint64_t>(GetTicksSince(stall_start_ms));
+	if (!netplay.active)
+		return 0;
+
+	if (late_tick >= 0) {
+		rolled_back = roll_back(static_cast<uint32_t>(late_tick));
+		if (!netplay.active)
+			return 0;
+	}
+
+	const auto tick = PIC_Ticks;
+	if (netplay.is_host) {
+		apply_inputs(netplay.local_inputs, tick);
+		apply_inputs(netplay.remote_inputs, tick);
+	} else {
+		apply_inputs(netplay.remote_inputs, tick);
+		apply_inputs(netplay.local_inputs, tick);
+	}
+	netplay.applied_through = tick;
+	if (netplay.cycle_max)
+		CPU_CycleMax = netplay.cycle_max;
+
+	if (netplay.has_unsent_input || rolled_back ||
+	    tick - netplay.last_sent_tick >= send_interval_ticks)
+		send_inputs();
+	prune_log();
+	return rolled_back;
+}
+
+// Set-up
+// ~~~~~~
+static bool host_session(const uint16_t port)
+{
+	netplay.socket = SDLNet_UDP_Open(port);
+	if (!netplay.socket) {
+		LOG_WARNING("NETPLAY: Can't listen on UDP port %u: %s", port, SDLNet_GetError());
+		return false;
+	}
+	LOG_MSG("NETPLAY: Waiting for the other player on UDP port %u", port);
+
+	const auto start_ms = GetTicks();
+	MessageType type = {};
+	size_t pos = 0;
+	while (!receive_message(type, pos) || type != MessageType::Hello) {
+		if (GetTicksSince(start_ms) > host_timeout_ms) {
+			LOG_WARNING("NETPLAY: Nobody joined, starting on our own");
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	netplay.peer = netplay.packet->address;
+	netplay.start_time = time(nullptr);
+
+	auto welcome = start_message(MessageType::Welcome);
+	put(welcome, static_cast<uint64_t>(netplay.start_time), 8);
+	put(welcome, netplay_version, 1);
+	send_message(welcome);
+	return true;
+}
+
+static bool join_session(const std::string &address)
+{
+	const auto colon = address.rfind(':');
+	const auto host = address.substr(0, colon);
+	const auto port = colon == std::string::npos
+	                        ? 0
+	                        : atoi(address.substr(colon + 1).c_str());
+	if (host.empty() || port <= 0 || port > UINT16_MAX ||
+	    SDLNet_ResolveHost(&netplay.peer, host.c_str(), static_cast<uint16_t>(port)) != 0) {
+		LOG_WARNING("NETPLAY: Can't resolve '%s', expected <address>:<port>",
+		            address.c_str());
+		return false;
+	}
+	netplay.socket = SDLNet_UDP_Open(0);
+	if (!netplay.socket) {
+		LOG_WARNING("NETPLAY: Can't open a UDP socket: %s", SDLNet_GetError());
+		return false;
+	}
+	LOG_MSG("NETPLAY: Joining the session at %s", address.c_str());
+
+	const auto start_ms = GetTicks();
+	int64_t last_hello_ms = start_ms - hello_interval_ms;
+	MessageType type = {};
+	size_t pos = 0;
+	while (!receive_message(type, pos) || type != MessageType::Welcome) {
+		if (GetTicksSince(start_ms) > join_timeout_ms) {
+			LOG_WARNING("NETPLAY: No answer from %s, starting on our own",
+			            address.c_str());
+			return false;
+		}
+		if (GetTicksSince(last_hello_ms) >= hello_interval_ms) {
+			send_message(start_message(MessageType::Hello));
+			last_hello_ms = GetTicks();
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	const auto data = netplay.packet->data;
+	const auto size = static_cast<size_t>(netplay.packet->len);
+	netplay.start_time = static_cast<time_t>(get(data, size, pos, 8));
+	if (get(data, size, pos, 1) != netplay_version) {
+		LOG_WARNING("NETPLAY: The host runs a different version of netplay");
+		return false;
+	}
+	return true;
+}
+
+static void NETPLAY_Destroy(Section *)
+{
+	end_session("the emulator was shut down");
+}
+
+void NETPLAY_Init(Section *sec)
+{
+	const auto section = static_cast<Section_prop *>(sec);
+	const std::string setting = section->Get_string("netplay");
+	sec->AddDestroyFunction(&NETPLAY_Destroy);
+	if (setting.empty())
+		return;
+	if (REPLAY_IsActive()) {
+		LOG_WARNING("NETPLAY: Disabled while recording or replaying the input");
+		return;
+	}
+	if (!NetWrapper_InitializeSDLNet())
+		return;
+
+	netplay = {};
+	netplay.delay_ticks = static_cast<uint32_t>(section->Get_int("netplay_delay"));
+	// A rollback only restores the components registered for snapshots
+	// and the RAM; the keyboard controller, DMA, mouse, sound devices and
+	// the PIC's event queue would keep what the rolled back ticks did to
+	// them, and nothing would notice the peers drifting apart. Until those
+	// are captured and the peers compare state checksums, run in lockstep.
+	if (section->Get_int("netplay_rollback") > 0)
+		LOG_WARNING("NETPLAY: Rollback isn't supported yet, running in lockstep");
+	netplay.window_ticks = 0;
+	netplay.packet = SDLNet_AllocPacket(max_message_bytes + 64);
+	if (!netplay.packet)
+		return;
+
+	bool is_connected = false;
+	if (starts_with("host:", setting)) {
+		netplay.is_host = true;
+		is_connected = host_session(static_cast<uint16_t>(atoi(setting.c_str() + 5)));
+	} else if (starts_with("join:", setting)) {
+		is_connected = join_session(setting.substr(5));
+	} else {
+		LOG_WARNING("NETPLAY: Invalid setting '%s', expected 'host:<port>' or "
+		            "'join:<address>:<port>'", setting.c_str());
+	}
+	if (!is_connected) {
+		if (netplay.socket)
+			SDLNet_UDP_Close(netplay.socket);
+		SDLNet_FreePacket(netplay.packet);
+		netplay = {};
+		return;
+	}
+
+	netplay.applied_through = static_cast<int64_t>(PIC_Ticks) - 1;
+	netplay.last_heard_ms = GetTicks();
+	netplay.active = true;
+	LOG_MSG("NETPLAY: Connected as the %s, with %u ms of input delay",
+	        netplay.is_host ? "host" : "second player", netplay.delay_ticks);
+}
+
+#else
+
+bool NETPLAY_IsActive()
+{
+	return false;
+}
+
+void NETPLAY_AddInput(uint8_t, const std::vector<uint8_t> &) {}
+
+time_t NETPLAY_StartTime()
+{
+	return 0;
+}
+
+int NETPLAY_ServiceTick()
+{
+	return 0;
+}
+
+void NETPLAY_Init(Section *) {}
+
+#endif // C_NETPLAY
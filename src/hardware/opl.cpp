@@ -508,19 +508,25 @@ io_port_t OPL::WriteAddr(const io_port_t port, const uint8_t val)
 	return addr;
 }
 
-AudioFrame OPL::RenderFrame()
+// Renders a block of frames into render_frames. The register writes are
+// applied between blocks, as each port write first renders up to its time.
+void OPL::RenderFrames(const int num_frames)
 {
-	static int16_t buf[2] = {};
-	OPL3_GenerateStream(&oplchip, buf, 1);
+	assert(num_frames > 0);
+	const auto n = static_cast<uint32_t>(num_frames);
+
+	render_samples.resize(n * 2);
+	render_frames.resize(n);
+
+	OPL3_GenerateStream(&oplchip, render_samples.data(), n);
 
-	AudioFrame frame = {};
 	if (adlib_gold) {
-		adlib_gold->Process(buf, 1, &frame[0]);
+		adlib_gold->Process(render_samples.data(), n, &render_frames[0][0]);
 	} else {
-		frame.left  = buf[0];
-		frame.right = buf[1];
+		for (uint32_t i = 0; i < n; ++i)
+			render_frames[i] = {static_cast<float>(render_samples[i * 2 + 0]),
+			                    static_cast<float>(render_samples[i * 2 + 1])};
 	}
-	return frame;
 }
 
 void OPL::RenderUpToNow()
@@ -533,32 +539,38 @@ void OPL::RenderUpToNow()
 		return;
 	}
 	// Keep rendering until we're current
+	auto num_frames = 0;
 	while (last_rendered_ms < now) {
 		last_rendered_ms += ms_per_frame;
-		fifo.emplace(RenderFrame());
+		++num_frames;
 	}
+	if (num_frames == 0)
+		return;
+
+	RenderFrames(num_frames);
+	for (const auto &frame : render_frames)
+		fifo.Enqueue(frame);
 }
 
 void OPL::AudioCallback(const uint16_t requested_frames)
 {
 	assert(channel);
 
-	//if (fifo.size())
-	//	LOG_MSG("OPL: Queued %2lu cycle-accurate frames", fifo.size());
+	//if (fifo.Size())
+	//	LOG_MSG("OPL: Queued %2lu cycle-accurate frames", fifo.Size());
 
 	auto frames_remaining = requested_frames;
 
 	// First, send any frames we've queued since the last callback
-	while (frames_remaining && fifo.size()) {
-		channel->AddSamples_sfloat(1, &fifo.front()[0]);
-		fifo.pop();
-		--frames_remaining;
-	}
+	const auto add_frames = [&](const AudioFrame *frames, const size_t n) {
+		channel->AddSamples_sfloat(check_cast<uint16_t>(n), &frames[0][0]);
+	};
+	frames_remaining = check_cast<uint16_t>(
+	        frames_remaining - fifo.DequeueBulk(frames_remaining, add_frames));
 	// If the queue's run dry, render the remainder and sync-up our time datum
-	while (frames_remaining) {
-		const auto frame = RenderFrame();
-		channel->AddSamples_sfloat(1, &frame[0]);
-		--frames_remaining;
+	if (frames_remaining) {
+		RenderFrames(frames_remaining);
+		channel->AddSamples_sfloat(frames_remaining, &render_frames[0][0]);
 	}
 	last_rendered_ms = PIC_FullIndex();
 }
@@ -882,6 +894,7 @@ OPL::OPL(Section *configuration, const OplMode oplmode)
 	std::set channel_features = {ChannelFeature::Sleep,
 	                             ChannelFeature::ReverbSend,
 	                             ChannelFeature::ChorusSend,
+	                             ChannelFeature::ParallelRender,
 	                             ChannelFeature::Synthesizer};
 
 	const auto dual_opl = mode != Mode::Opl2;
@@ -22,7 +22,7 @@
 #include "dosbox.h"
 
 #include <cmath>
-#include <queue>
+#include <vector>
 
 #include "adlib_gold.h"
 #include "mixer.h"
@@ -100,7 +100,11 @@ private:
 	IO_ReadHandleObject ReadHandler[3];
 	IO_WriteHandleObject WriteHandler[3];
 
-	std::queue<AudioFrame> fifo = {};
+	DeviceFrameQueue<AudioFrame> fifo = {};
+
+	// Blocks of frames rendered in one pass through the core
+	std::vector<int16_t> render_samples = {};
+	std::vector<AudioFrame> render_frames = {};
 
 	Mode mode = {};
 
@@ -134,7 +138,7 @@ private:
 	void Init(const uint16_t sample_rate);
 
 	void AudioCallback(const uint16_t frames);
-	AudioFrame RenderFrame();
+	void RenderFrames(const int num_frames);
 	void RenderUpToNow();
 
 	void PortWrite(const io_port_t port, const io_val_t value,
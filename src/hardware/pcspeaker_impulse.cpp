@@ -25,6 +25,16 @@
 
 #include "pcspeaker_impulse.h"
 
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PCSPEAKER_SIMD_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PCSPEAKER_SIMD_NEON 1
+#endif
+
 #include "checks.h"
 #include "math_utils.h"
 
@@ -391,6 +401,30 @@ float PcSpeakerImpulse::CalcImpulse(const double t) const
 		return 0.0f;
 }
 
+// Adds the scaled taps to the waveform, four at a time
+static void add_scaled(const float *taps, const int num_taps,
+                       const float amplitude, float *waveform)
+{
+	assert(num_taps % 4 == 0);
+#if defined(PCSPEAKER_SIMD_SSE2)
+	const auto scale = _mm_set1_ps(amplitude);
+	for (auto i = 0; i < num_taps; i += 4) {
+		const auto product = _mm_mul_ps(_mm_loadu_ps(taps + i), scale);
+		_mm_storeu_ps(waveform + i,
+		              _mm_add_ps(_mm_loadu_ps(waveform + i), product));
+	}
+#elif defined(PCSPEAKER_SIMD_NEON)
+	const auto scale = vdupq_n_f32(amplitude);
+	for (auto i = 0; i < num_taps; i += 4) {
+		const auto product = vmulq_f32(vld1q_f32(taps + i), scale);
+		vst1q_f32(waveform + i, vaddq_f32(vld1q_f32(waveform + i), product));
+	}
+#else
+	for (auto i = 0; i < num_taps; ++i)
+		waveform[i] += taps[i] * amplitude;
+#endif
+}
+
 void PcSpeakerImpulse::AddImpulse(float index, const int16_t amplitude)
 {
 	if (channel->WakeUp())
@@ -404,79 +438,98 @@ void PcSpeakerImpulse::AddImpulse(float index, const int16_t amplitude)
 	// Make sure the time index is valid
 	index = clamp(index, 0.0f, 1.0f);
 
-#ifdef USE_LOOKUP_TABLES
-	// Use pre-calculated sinc lookup tables
-	const auto samples_in_impulse = index * sample_rate_per_ms;
-	auto phase = static_cast<int>(samples_in_impulse * sinc_oversampling_factor) %
-	             sinc_oversampling_factor;
-	auto offset = static_cast<int>(samples_in_impulse);
-	if (phase != 0) {
-		offset++;
-		phase = sinc_oversampling_factor - phase;
-	}
-
-	for (uint16_t i = 0; i < sinc_filter_quality; ++i) {
-		const auto wave_i    = check_cast<uint16_t>(offset + i);
-		const auto impulse_i = check_cast<uint16_t>(
-		        phase + i * sinc_oversampling_factor);
-		waveform_deque.at(wave_i) += amplitude * impulse_lut.at(impulse_i);
-	}
+	if (pending_impulses.size() >= max_pending_impulses)
+		ApplyPendingImpulses();
+	pending_impulses.push_back({index, amplitude});
 }
 
-#else
-	// Mathematically intensive reference implementation
-	const auto portion_of_ms = static_cast <double>(index) / millis_in_second;
-	for (size_t i = 0; i < waveform_deque.size(); ++i) {
-		const auto impulse_time = static_cast<double>(i) / sample_rate - portion_of_ms;
+// Adds the impulses queued during this tick to the waveform, in the order
+// they happened
+void PcSpeakerImpulse::ApplyPendingImpulses()
+{
+	for (const auto &impulse : pending_impulses) {
+		const auto amplitude = static_cast<float>(impulse.amplitude);
 
-		waveform_deque[i] += amplitude * CalcImpulse(impulse_time);
+#ifdef USE_LOOKUP_TABLES
+		// Use pre-calculated sinc lookup tables
+		const auto samples_in_impulse = impulse.index * sample_rate_per_ms;
+		auto phase = static_cast<int>(samples_in_impulse *
+		                              sinc_oversampling_factor) %
+		             sinc_oversampling_factor;
+		auto offset = static_cast<int>(samples_in_impulse);
+		if (phase != 0) {
+			offset++;
+			phase = sinc_oversampling_factor - phase;
+		}
+		assert(offset + sinc_filter_quality <= waveform_size);
+
+		add_scaled(impulse_lut[static_cast<size_t>(phase)].data(),
+		           sinc_filter_quality,
+		           amplitude,
+		           waveform.data() + offset);
+#else
+		// Mathematically intensive reference implementation
+		const auto portion_of_ms = static_cast<double>(impulse.index) /
+		                           millis_in_second;
+		for (size_t i = 0; i < waveform.size(); ++i) {
+			const auto impulse_time = static_cast<double>(i) / sample_rate -
+			                          portion_of_ms;
+
+			waveform[i] += amplitude * CalcImpulse(impulse_time);
+		}
+#endif
 	}
+	pending_impulses.clear();
 }
-#endif
 
 void PcSpeakerImpulse::ChannelCallback(uint16_t requested_frames)
 {
 	ForwardPIT(1.0f);
 	pit.last_index = 0;
 
-	static float accumulator = 0;
-	while (requested_frames > 0 && waveform_deque.size()) {
-		// Pop the first sample off the waveform
-		accumulator += waveform_deque.front();
-		waveform_deque.pop_front();
-		waveform_deque.push_back(0.0f);
-
-		// Pass the sample to the mixer and decrement the requested frames
-		channel->AddSamples_mfloat(1, &accumulator);
-		--requested_frames;
-
-		// Keep a tally of sequential silence so we can sleep the channel
-		tally_of_silence = fabsf(accumulator) > 1.0f
-		                         ? 0
-		                         : tally_of_silence + 1;
-
-		// Scale down the running volume amplitude. Eventually it will
-		// hit 0 if no other waveforms are generated.
-		accumulator *= sinc_amplitude_fade;
-	}
+	ApplyPendingImpulses();
 
-	// Write silence if the waveform deque ran out
-	if (requested_frames)
-		pit.prev_amplitude = neutral_amplitude;
+	while (requested_frames > 0) {
+		const auto num_frames = std::min(requested_frames, sample_rate_per_ms);
+
+		// Integrate the waveform's leading frames into a block
+		for (uint16_t i = 0; i < num_frames; ++i) {
+			accumulator += waveform[i];
+			render_buffer[i] = accumulator;
 
-	while (requested_frames) {
-		channel->AddSamples_m16(1, &neutral_amplitude);
-		++tally_of_silence;
-		--requested_frames;
+			// Keep a tally of sequential silence so we can sleep
+			// the channel
+			tally_of_silence = fabsf(accumulator) > 1.0f
+			                         ? 0
+			                         : tally_of_silence + 1;
+
+			// Scale down the running volume amplitude. Eventually
+			// it will hit 0 if no other waveforms are generated.
+			accumulator *= sinc_amplitude_fade;
+		}
+		channel->AddSamples_mfloat(num_frames, render_buffer.data());
+
+		// Move the rest of the waveform up to the next frame
+		std::copy(waveform.begin() + num_frames, waveform.end(), waveform.begin());
+		std::fill(waveform.end() - num_frames, waveform.end(), 0.0f);
+
+		requested_frames -= num_frames;
 	}
 }
 
 void PcSpeakerImpulse::InitializeImpulseLUT()
 {
-	assert(impulse_lut.size() == sinc_filter_width);
-	for (auto i = 0u; i < sinc_filter_width; ++i)
-		impulse_lut[i] = CalcImpulse(i / (static_cast<double>(sample_rate) *
-		                                  sinc_oversampling_factor));
+	static_assert(sinc_filter_quality % 4 == 0,
+	              "The phases are added four taps at a time");
+
+	// Each phase takes every sinc_oversampling_factor-th point of the
+	// oversampled impulse
+	for (auto i = 0u; i < sinc_filter_width; ++i) {
+		const auto phase = i % sinc_oversampling_factor;
+		const auto tap   = i / sinc_oversampling_factor;
+		impulse_lut[phase][tap] = CalcImpulse(
+		        i / (static_cast<double>(sample_rate) * sinc_oversampling_factor));
+	}
 }
 
 void PcSpeakerImpulse::SetFilterState(const FilterState filter_state)
@@ -521,9 +574,7 @@ PcSpeakerImpulse::PcSpeakerImpulse()
 
 	InitializeImpulseLUT();
 
-	// Size the waveform queue
-	constexpr auto waveform_size = sinc_filter_quality + sample_rate_per_ms;
-	waveform_deque.resize(waveform_size, 0.0f);
+	pending_impulses.reserve(max_pending_impulses);
 
 	// Register the sound channel
 	const auto callback = std::bind(&PcSpeakerImpulse::ChannelCallback, this, std::placeholders::_1);
@@ -21,8 +21,8 @@
 #include "pcspeaker.h"
 
 #include <array>
-#include <deque>
 #include <string>
+#include <vector>
 
 #include "inout.h"
 #include "setup.h"
@@ -42,6 +42,7 @@ public:
 
 private:
 	void AddImpulse(float index, const int16_t amplitude);
+	void ApplyPendingImpulses();
 	void AddPITOutput(const float index);
 	void ChannelCallback(uint16_t requested_frames);
 	void ForwardPIT(const float new_index);
@@ -80,6 +81,12 @@ private:
 	static constexpr uint16_t sinc_filter_width = sinc_filter_quality *
 	                                              sinc_oversampling_factor;
 
+	static constexpr uint16_t waveform_size = sinc_filter_quality + sample_rate_per_ms;
+
+	// Transitions are queued as they happen and added to the waveform in
+	// a batch before it's rendered, or sooner if this many pile up
+	static constexpr size_t max_pending_impulses = 1024;
+
 	static constexpr float max_possible_pit_ms = 1320000.0f / PIT_TICK_RATE;
 
 	// Compound types and containers	
@@ -105,9 +112,23 @@ private:
 		int16_t prev_amplitude = negative_amplitude;
 	} pit = {};
 
-	std::deque<float> waveform_deque = {};
+	struct Impulse {
+		float index       = 0.0f;
+		int16_t amplitude = 0;
+	};
+	std::vector<Impulse> pending_impulses = {};
+
+	// The upcoming impulses, starting with the next frame to render
+	std::array<float, waveform_size> waveform = {};
+
+	// The windowed sinc split into its oversampled phases, each holding
+	// the taps that land on whole frames for impulses at that phase
+	using impulse_phase_t = std::array<float, sinc_filter_quality>;
+	std::array<impulse_phase_t, sinc_oversampling_factor> impulse_lut = {};
+
+	std::array<float, sample_rate_per_ms> render_buffer = {};
 
-	std::array<float, sinc_filter_width> impulse_lut = {};
+	float accumulator = 0.0f;
 
 	mixer_channel_t channel = nullptr;
 
@@ -22,7 +22,13 @@
 #include "callback.h"
 #include "pic.h"
 #include "timer.h"
+#include "tracy.h"
 #include "setup.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 // PIC Controllers
 // ~~~~~~~~~~~~~~~
@@ -38,8 +44,6 @@
 // "master-slave" relationship, which is misleading given that fact that the
 // primary has no control over the secondary.
 
-#define PIC_QUEUESIZE 512
-
 struct PIC_Controller {
 	Bitu icw_words;
 	Bitu icw_index;
@@ -191,17 +195,234 @@ void PIC_Controller::start_irq(uint8_t val) {
 
 
 struct PICEntry {
-	double index;
-	Bitu value;
-	PIC_EventHandler pic_event;
-	PICEntry * next;
+	double index = 0;
+	uint32_t value = 0;
+	PIC_EventHandler pic_event = nullptr;
+#if C_TRACY
+	const char *name = nullptr;
+#endif
 };
 
-static struct {
-	PICEntry entries[PIC_QUEUESIZE];
-	PICEntry * free_entry;
-	PICEntry * next_entry;
-} pic_queue;
+// The queue of scheduled events, a binary min-heap ordered by index. Events
+// due at the same index run in the order they were added. Each handler's
+// events are also linked together, so removing them doesn't search the heap.
+//
+// Periodic events, like the PIT's, add their next event while being run.
+// Popping leaves the top of the heap vacant until the next change, so such
+// an event takes its place with a single sift instead of two.
+class PicEventQueue {
+public:
+	bool Empty()
+	{
+		Settle();
+		return heap.empty();
+	}
+
+	const PICEntry &Next()
+	{
+		Settle();
+		return slots[heap.front()].entry;
+	}
+
+	void Add(const PICEntry &entry)
+	{
+		uint32_t id = 0;
+		if (free_slots.empty()) {
+			id = static_cast<uint32_t>(slots.size());
+			slots.emplace_back();
+		} else {
+			id = free_slots.back();
+			free_slots.pop_back();
+		}
+		auto &slot = slots[id];
+		slot.entry = entry;
+		slot.order = next_order++;
+
+		// link it to the front of its handler's events
+		const auto head = by_handler.try_emplace(entry.pic_event, none).first;
+		slot.handler_prev = none;
+		slot.handler_next = head->second;
+		if (head->second != none)
+			slots[head->second].handler_prev = id;
+		head->second = id;
+
+		if (top_vacant) {
+			top_vacant = false;
+			Place(0, id);
+			SiftDown(0);
+			return;
+		}
+		slot.heap_pos = heap.size();
+		heap.push_back(id);
+		SiftUp(slot.heap_pos);
+	}
+
+	PICEntry PopNext()
+	{
+		const auto entry = Next();
+		const auto id = heap.front();
+		Unlink(id);
+		free_slots.push_back(id);
+		top_vacant = true;
+		return entry;
+	}
+
+	void RemoveHandler(const PIC_EventHandler handler)
+	{
+		Settle();
+		const auto head = by_handler.find(handler);
+		if (head == by_handler.end())
+			return;
+		for (auto id = head->second; id != none;) {
+			const auto next = slots[id].handler_next;
+			Remove(id);
+			id = next;
+		}
+	}
+
+	void RemoveSpecific(const PIC_EventHandler handler, const uint32_t value)
+	{
+		Settle();
+		const auto head = by_handler.find(handler);
+		if (head == by_handler.end())
+			return;
+		for (auto id = head->second; id != none;) {
+			const auto next = slots[id].handler_next;
+			if (slots[id].entry.value == value)
+				Remove(id);
+			id = next;
+		}
+	}
+
+	// Moving every event by the same amount keeps the heap ordered
+	void ShiftIndexes(const double amount)
+	{
+		Settle();
+		for (const auto id : heap)
+			slots[id].entry.index += amount;
+	}
+
+	void Clear()
+	{
+		slots.clear();
+		free_slots.clear();
+		heap.clear();
+		by_handler.clear();
+		next_order = 0;
+		top_vacant = false;
+	}
+
+private:
+	static constexpr uint32_t none = UINT32_MAX;
+
+	struct Slot {
+		PICEntry entry = {};
+		uint64_t order = 0;
+		size_t heap_pos = 0;
+		uint32_t handler_prev = none;
+		uint32_t handler_next = none;
+	};
+
+	bool Before(const uint32_t a, const uint32_t b) const
+	{
+		const auto &slot_a = slots[a];
+		const auto &slot_b = slots[b];
+		if (slot_a.entry.index != slot_b.entry.index)
+			return slot_a.entry.index < slot_b.entry.index;
+		return slot_a.order < slot_b.order;
+	}
+
+	void Place(const size_t pos, const uint32_t id)
+	{
+		heap[pos] = id;
+		slots[id].heap_pos = pos;
+	}
+
+	void SiftUp(size_t pos)
+	{
+		const auto id = heap[pos];
+		while (pos > 0) {
+			const auto parent = (pos - 1) / 2;
+			if (!Before(id, heap[parent]))
+				break;
+			Place(pos, heap[parent]);
+			pos = parent;
+		}
+		Place(pos, id);
+	}
+
+	void SiftDown(size_t pos)
+	{
+		const auto id = heap[pos];
+		const auto size = heap.size();
+		for (;;) {
+			auto child = 2 * pos + 1;
+			if (child >= size)
+				break;
+			if (child + 1 < size && Before(heap[child + 1], heap[child]))
+				++child;
+			if (!Before(heap[child], id))
+				break;
+			Place(pos, heap[child]);
+			pos = child;
+		}
+		Place(pos, id);
+	}
+
+	// Fills a top left vacant by PopNext with the last event
+	void Settle()
+	{
+		if (!top_vacant)
+			return;
+		top_vacant = false;
+		const auto last = heap.back();
+		heap.pop_back();
+		if (!heap.empty()) {
+			Place(0, last);
+			SiftDown(0);
+		}
+	}
+
+	// Takes it off its handler's events
+	void Unlink(const uint32_t id)
+	{
+		auto &slot = slots[id];
+		if (slot.handler_next != none)
+			slots[slot.handler_next].handler_prev = slot.handler_prev;
+		if (slot.handler_prev != none)
+			slots[slot.handler_prev].handler_next = slot.handler_next;
+		else
+			by_handler[slot.entry.pic_event] = slot.handler_next;
+	}
+
+	void Remove(const uint32_t id)
+	{
+		Unlink(id);
+
+		// fill its place in the heap with the last event
+		const auto pos = slots[id].heap_pos;
+		const auto last = heap.back();
+		heap.pop_back();
+		if (last != id) {
+			Place(pos, last);
+			if (pos > 0 && Before(last, heap[(pos - 1) / 2]))
+				SiftUp(pos);
+			else
+				SiftDown(pos);
+		}
+		free_slots.push_back(id);
+	}
+
+	std::vector<Slot> slots = {};
+	std::vector<uint32_t> free_slots = {};
+	std::vector<uint32_t> heap = {};
+	// handlers stay once added, so periodic events don't allocate
+	std::unordered_map<PIC_EventHandler, uint32_t> by_handler = {};
+	uint64_t next_order = 0;
+	bool top_vacant = false;
+};
+
+static PicEventQueue pic_queue;
 
 static void write_command(io_port_t port, io_val_t value, io_width_t)
 {
@@ -416,104 +637,58 @@ void PIC_SetIRQMask(uint32_t irq, bool masked)
 	pic->set_imr(newmask);
 }
 
-static void AddEntry(PICEntry * entry) {
-	PICEntry * find_entry=pic_queue.next_entry;
-	if (GCC_UNLIKELY(find_entry ==0)) {
-		entry->next=0;
-		pic_queue.next_entry=entry;
-	} else if (find_entry->index>entry->index) {
-		pic_queue.next_entry=entry;
-		entry->next=find_entry;
-	} else while (find_entry) {
-		if (find_entry->next) {
-			/* See if the next index comes later than this one */
-			if (find_entry->next->index > entry->index) {
-				entry->next=find_entry->next;
-				find_entry->next=entry;
-				break;
-			} else {
-				find_entry=find_entry->next;
-			}
-		} else {
-			entry->next=find_entry->next;
-			find_entry->next=entry;
-			break;
-		}
-	}
-	Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
-	if (cycles<CPU_Cycles) {
-		CPU_CycleLeft+=CPU_Cycles;
-		CPU_Cycles=0;
-	}
-}
 static bool InEventService = false;
 static double srv_lag = 0.0;
 
-void PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val)
+static void add_event(PICEntry &entry, const double delay)
+{
+	entry.index = delay + (InEventService ? srv_lag : PIC_TickIndex());
+	pic_queue.Add(entry);
+
+	// end the current slice early if the new event is due within it
+	const Bits cycles = PIC_MakeCycles(pic_queue.Next().index - PIC_TickIndex());
+	if (cycles < CPU_Cycles) {
+		CPU_CycleLeft += CPU_Cycles;
+		CPU_Cycles = 0;
+	}
+}
+
+// Parenthesised so the profiling builds' naming macro doesn't expand it
+void (PIC_AddEvent)(PIC_EventHandler handler, double delay, uint32_t val)
+{
+	PICEntry entry = {};
+	entry.pic_event = handler;
+	entry.value = val;
+	add_event(entry, delay);
+}
+
+#if C_TRACY
+void PIC_AddNamedEvent(const char *name, PIC_EventHandler handler,
+                       double delay, uint32_t val)
 {
-	if (GCC_UNLIKELY(!pic_queue.free_entry)) {
-		LOG(LOG_PIC,LOG_ERROR)("Event queue full");
-		return;
-	}
-	PICEntry * entry=pic_queue.free_entry;
-	if(InEventService) entry->index = delay + srv_lag;
-	else entry->index = delay + PIC_TickIndex();
-
-	entry->pic_event=handler;
-	entry->value=val;
-	pic_queue.free_entry=pic_queue.free_entry->next;
-	AddEntry(entry);
+	PICEntry entry = {};
+	entry.pic_event = handler;
+	entry.value = val;
+	entry.name = name;
+	add_event(entry, delay);
 }
+#endif
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, uint32_t val)
 {
-	PICEntry *entry = pic_queue.next_entry;
-	PICEntry *prev_entry;
-	prev_entry = 0;
-	while (entry) {
-		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}
+	pic_queue.RemoveSpecific(handler, val);
 }
 
-void PIC_RemoveEvents(PIC_EventHandler handler) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry=0;
-	while (entry) {
-		if (GCC_UNLIKELY(entry->pic_event==handler)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}
+void PIC_RemoveEvents(PIC_EventHandler handler)
+{
+	pic_queue.RemoveHandler(handler);
+}
+
+int PIC_TicksUntilNextEvent(const int limit)
+{
+	if (pic_queue.Empty() || pic_queue.Next().index >= limit)
+		return limit;
+	return std::max(static_cast<int>(pic_queue.Next().index), 0);
 }
 
 
@@ -529,24 +704,20 @@ bool PIC_RunQueue(void) {
 
 	/* Check the queue for an entry */
 	InEventService = true;
-	while (pic_queue.next_entry &&
-	       (pic_queue.next_entry->index * static_cast<double>(CPU_CycleMax) <= index_nd_f)) {
-		PICEntry *entry = pic_queue.next_entry;
-		pic_queue.next_entry = entry->next;
-
-		srv_lag = entry->index;
-		(entry->pic_event)(entry->value); // call the event handler
+	while (!pic_queue.Empty() &&
+	       (pic_queue.Next().index * static_cast<double>(CPU_CycleMax) <= index_nd_f)) {
+		const auto entry = pic_queue.PopNext();
 
-		/* Put the entry in the free list */
-		entry->next=pic_queue.free_entry;
-		pic_queue.free_entry=entry;
+		srv_lag = entry.index;
+		ZoneTransientSubsystem(entry.name ? entry.name : "PIC event");
+		(entry.pic_event)(entry.value); // call the event handler
 	}
 	InEventService = false;
 
 	/* Check when to set the new cycle end */
-	if (pic_queue.next_entry) {
+	if (!pic_queue.Empty()) {
 		auto cycles = static_cast<int32_t>(
-		        pic_queue.next_entry->index * static_cast<double>(CPU_CycleMax) -
+		        pic_queue.Next().index * static_cast<double>(CPU_CycleMax) -
 		        index_nd_f);
 		if (GCC_UNLIKELY(!cycles))
 			cycles = 1;
@@ -597,11 +768,7 @@ void TIMER_AddTick(void) {
 	CPU_Cycles=0;
 	PIC_Ticks++;
 	/* Go through the list of scheduled events and lower their index with 1000 */
-	PICEntry * entry=pic_queue.next_entry;
-	while (entry) {
-		entry->index -= 1.0f;
-		entry=entry->next;
-	}
+	pic_queue.ShiftIndexes(-1.0);
 	/* Call our list of ticker handlers */
 	TickerBlock * ticker=firstticker;
 	while (ticker) {
@@ -611,6 +778,15 @@ void TIMER_AddTick(void) {
 	}
 }
 
+// Queued events belong to the devices that added them, the devices that are
+// saved schedule theirs again
+static void pic_snapshot(SnapshotStream &s)
+{
+	s.Pod(pics);
+	s.Pod(PIC_Ticks);
+	s.Pod(PIC_IRQCheck);
+}
+
 /* Use full name to avoid name clash with compile option for position-independent code */
 class PIC_8259A final : public Module_base {
 private:
@@ -654,13 +830,8 @@ public:
 		ReadHandler[3].Install(0xa1, read_data, io_width_t::byte);
 		WriteHandler[2].Install(0xa0, write_command, io_width_t::byte);
 		WriteHandler[3].Install(0xa1, write_data, io_width_t::byte);
-		/* Initialize the pic queue */
-		for (i=0;i<PIC_QUEUESIZE-1;i++) {
-			pic_queue.entries[i].next=&pic_queue.entries[i+1];
-		}
-		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
-		pic_queue.free_entry=&pic_queue.entries[0];
-		pic_queue.next_entry=0;
+		pic_queue.Clear();
+		SNAPSHOT_AddComponent("pic", pic_snapshot);
 	}
 
 	~PIC_8259A(){
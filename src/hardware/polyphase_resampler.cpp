@@ -0,0 +1,296 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RESAMPLER_SIMD_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RESAMPLER_SIMD_NEON 1
+#endif
+
+// Ratios reducing to more phases than this are left to other resamplers, as
+// their banks would take over a megabyte
+constexpr int max_phases = 4096;
+
+// Taps per phase when upsampling; downsampling scales them by the ratio to
+// keep the transition band's width, up to the maximum
+constexpr int base_taps_per_phase = 64;
+constexpr int max_taps_per_phase  = 256;
+
+// The share of the lower Nyquist frequency that's passed, and the Kaiser
+// window's shape, which gives about 80 dB of stopband attenuation
+constexpr double passband    = 0.92;
+constexpr double kaiser_beta = 7.86;
+
+constexpr double pi = 3.14159265358979323846;
+
+struct PolyphaseResampler::FilterBank {
+	int num_phases     = 0; // interpolation factor of the reduced ratio
+	int step           = 0; // decimation factor of the reduced ratio
+	int taps_per_phase = 0; // a multiple of four for the SIMD loops
+
+	// The phases' taps, each reversed so they line up with the history
+	// running from the oldest to the newest frame
+	std::vector<float> taps = {};
+};
+
+using filter_bank_t = PolyphaseResampler::FilterBank;
+
+static std::pair<int, int> reduce_ratio(const int in_rate, const int out_rate)
+{
+	const auto divisor = std::gcd(in_rate, out_rate);
+	return {out_rate / divisor, in_rate / divisor};
+}
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser
+// window
+static double bessel_i0(const double x)
+{
+	auto sum  = 1.0;
+	auto term = 1.0;
+	for (auto k = 1; k < 50; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+static std::shared_ptr<const filter_bank_t> design_bank(const int num_phases,
+                                                        const int step)
+{
+	auto bank = std::make_shared<filter_bank_t>();
+
+	bank->num_phases = num_phases;
+	bank->step       = step;
+
+	// Downsampling needs longer filters for the same transition band
+	const auto ratio   = std::max(1.0, static_cast<double>(step) / num_phases);
+	const auto wanted  = static_cast<int>(std::ceil(base_taps_per_phase * ratio));
+	const auto rounded = (wanted + 3) / 4 * 4;
+	const auto taps    = std::min(rounded, max_taps_per_phase);
+
+	bank->taps_per_phase = taps;
+
+	// The windowed-sinc prototype runs at the input rate times the number
+	// of phases; its cutoff is given relative to the input rate
+	const auto cutoff  = 0.5 * passband / ratio;
+	const auto length  = num_phases * taps;
+	const auto centre  = (length - 1) / 2.0;
+	const auto i0_beta = bessel_i0(kaiser_beta);
+
+	auto prototype = [&](const int m) {
+		const auto x    = (m - centre) / num_phases; // in input frames
+		const auto arg  = 2.0 * cutoff * x;
+		const auto sinc = (arg == 0.0) ? 1.0 : std::sin(pi * arg) / (pi * arg);
+
+		const auto w      = 2.0 * m / (length - 1) - 1.0;
+		const auto window = bessel_i0(kaiser_beta *
+		                              std::sqrt(std::max(0.0, 1.0 - w * w))) /
+		                    i0_beta;
+		return 2.0 * cutoff * sinc * window;
+	};
+
+	bank->taps.resize(static_cast<size_t>(length));
+	std::vector<double> coeffs(static_cast<size_t>(taps));
+	for (auto p = 0; p < num_phases; ++p) {
+		auto phase_taps = bank->taps.data() + p * taps;
+
+		// Each phase takes every num_phases-th tap of the prototype,
+		// normalised so a constant signal passes at unity gain
+		auto sum = 0.0;
+		for (auto k = 0; k < taps; ++k) {
+			coeffs[k] = prototype(p + k * num_phases);
+			sum += coeffs[k];
+		}
+		for (auto k = 0; k < taps; ++k)
+			phase_taps[taps - 1 - k] = static_cast<float>(coeffs[k] / sum);
+	}
+	return bank;
+}
+
+// Returns the bank for the ratio, designing it unless a resampler with the
+// same ratio already uses one
+static std::shared_ptr<const filter_bank_t> get_bank(const int num_phases,
+                                                     const int step)
+{
+	static std::map<std::pair<int, int>, std::weak_ptr<const filter_bank_t>> banks = {};
+
+	auto &cached = banks[{num_phases, step}];
+	auto bank    = cached.lock();
+	if (!bank) {
+		bank   = design_bank(num_phases, step);
+		cached = bank;
+	}
+	return bank;
+}
+
+// Filters the left and right history with the same taps
+static void dot_products(const float *taps, const float *left,
+                         const float *right, const int num_taps,
+                         float &out_left, float &out_right)
+{
+	assert(num_taps % 4 == 0);
+#if defined(RESAMPLER_SIMD_SSE2)
+	auto sum_left  = _mm_setzero_ps();
+	auto sum_right = _mm_setzero_ps();
+	for (auto i = 0; i < num_taps; i += 4) {
+		const auto t = _mm_loadu_ps(taps + i);
+		sum_left  = _mm_add_ps(sum_left, _mm_mul_ps(t, _mm_loadu_ps(left + i)));
+		sum_right = _mm_add_ps(sum_right, _mm_mul_ps(t, _mm_loadu_ps(right + i)));
+	}
+	// Add up the lanes of both sums at once, leaving the left total in
+	// the first lane and the right total in the second
+	const auto lo    = _mm_unpacklo_ps(sum_left, sum_right); // l0 r0 l1 r1
+	const auto hi    = _mm_unpackhi_ps(sum_left, sum_right); // l2 r2 l3 r3
+	const auto pairs = _mm_add_ps(lo, hi);
+	const auto sums  = _mm_add_ps(pairs, _mm_movehl_ps(pairs, pairs));
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, sums);
+	out_left  = lanes[0];
+	out_right = lanes[1];
+#elif defined(RESAMPLER_SIMD_NEON)
+	auto sum_left  = vdupq_n_f32(0.0f);
+	auto sum_right = vdupq_n_f32(0.0f);
+	for (auto i = 0; i < num_taps; i += 4) {
+		const auto t = vld1q_f32(taps + i);
+		sum_left  = vmlaq_f32(sum_left, t, vld1q_f32(left + i));
+		sum_right = vmlaq_f32(sum_right, t, vld1q_f32(right + i));
+	}
+	out_left  = vaddvq_f32(sum_left);
+	out_right = vaddvq_f32(sum_right);
+#else
+	float sum_left[4]  = {};
+	float sum_right[4] = {};
+	for (auto i = 0; i < num_taps; i += 4) {
+		for (auto lane = 0; lane < 4; ++lane) {
+			sum_left[lane] += taps[i + lane] * left[i + lane];
+			sum_right[lane] += taps[i + lane] * right[i + lane];
+		}
+	}
+	out_left  = (sum_left[0] + sum_left[2]) + (sum_left[1] + sum_left[3]);
+	out_right = (sum_right[0] + sum_right[2]) + (sum_right[1] + sum_right[3]);
+#endif
+}
+
+bool PolyphaseResampler::SupportsRates(const int in_rate, const int out_rate)
+{
+	if (in_rate <= 0 || out_rate <= 0)
+		return false;
+
+	const auto num_phases = reduce_ratio(in_rate, out_rate).first;
+	return num_phases <= max_phases;
+}
+
+PolyphaseResampler::PolyphaseResampler(const int _in_rate, const int _out_rate)
+        : in_rate(_in_rate),
+          out_rate(_out_rate)
+{
+	assert(SupportsRates(in_rate, out_rate));
+
+	const auto [num_phases, step] = reduce_ratio(in_rate, out_rate);
+	bank = get_bank(num_phases, step);
+
+	Reset();
+}
+
+int PolyphaseResampler::GetInputRate() const
+{
+	return in_rate;
+}
+
+int PolyphaseResampler::GetOutputRate() const
+{
+	return out_rate;
+}
+
+void PolyphaseResampler::Reset()
+{
+	const auto history_frames = static_cast<size_t>(bank->taps_per_phase - 1);
+
+	history_left.assign(history_frames, 0.0f);
+	history_right.assign(history_frames, 0.0f);
+
+	// Start half a filter in, which skips the filter's delay the same way
+	// Speex skips its zeros
+	phase      = 0;
+	next_input = bank->taps_per_phase / 2;
+}
+
+void PolyphaseResampler::Process(const float *in, const int num_frames,
+                                 std::vector<float> &out)
+{
+	assert(num_frames >= 0);
+
+	const auto num_taps       = bank->taps_per_phase;
+	const auto history_frames = num_taps - 1;
+
+	// Append the block to the history, one stream per side
+	const auto total_frames = static_cast<size_t>(history_frames + num_frames);
+	history_left.resize(total_frames);
+	history_right.resize(total_frames);
+	for (auto i = 0; i < num_frames; ++i) {
+		history_left[history_frames + i]  = in[i * 2 + 0];
+		history_right[history_frames + i] = in[i * 2 + 1];
+	}
+
+	// Each output frame filters the history up to its newest input frame
+	// with its phase's taps, then steps the phase by the decimation factor
+	while (next_input < num_frames) {
+		const auto taps = bank->taps.data() + phase * num_taps;
+
+		float left  = 0.0f;
+		float right = 0.0f;
+		dot_products(taps,
+		             history_left.data() + next_input,
+		             history_right.data() + next_input,
+		             num_taps,
+		             left,
+		             right);
+		out.push_back(left);
+		out.push_back(right);
+
+		phase += bank->step;
+		next_input += phase / bank->num_phases;
+		phase %= bank->num_phases;
+	}
+	next_input -= num_frames;
+
+	// Keep the newest frames as the next block's history
+	std::copy(history_left.end() - history_frames,
+	          history_left.end(),
+	          history_left.begin());
+	std::copy(history_right.end() - history_frames,
+	          history_right.end(),
+	          history_right.begin());
+	history_left.resize(static_cast<size_t>(history_frames));
+	history_right.resize(static_cast<size_t>(history_frames));
+}
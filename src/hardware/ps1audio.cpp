@@ -24,8 +24,8 @@
 #include <algorithm>
 #include <cassert>
 #include <memory>
-#include <queue>
 #include <string.h>
+#include <vector>
 
 #include "control.h"
 #include "dma.h"
@@ -379,7 +379,7 @@ private:
 
 	void AudioCallback(uint16_t requested_frames);
 	bool MaybeRenderFrame(float &frame);
-	void RenderUpToNow();
+	void ApplyWrite(io_port_t port, uint8_t data);
 
 	void WriteSoundGeneratorPort205(io_port_t port, io_val_t, io_width_t);
 
@@ -388,7 +388,8 @@ private:
 	IO_WriteHandleObject write_handler = {};
 	sn76496_device device;
 	std::unique_ptr<reSIDfp::TwoPassSincResampler> resampler = {};
-	std::queue<float> fifo                                   = {};
+	DeviceWriteQueue writes                                  = {};
+	std::vector<float> render_frames                         = {};
 
 	// Static rate-related configuration
 	static constexpr auto ps1_psg_clock_hz = 4000000;
@@ -413,6 +414,7 @@ Ps1Synth::Ps1Synth(const std::string &filter_choice)
 	                           {ChannelFeature::Sleep,
 	                            ChannelFeature::ReverbSend,
 	                            ChannelFeature::ChorusSend,
+	                            ChannelFeature::ParallelRender,
 	                            ChannelFeature::Synthesizer});
 
 	// Setup filters
@@ -465,54 +467,44 @@ bool Ps1Synth::MaybeRenderFrame(float &frame)
 	return frame_is_ready;
 }
 
-void Ps1Synth::RenderUpToNow()
+void Ps1Synth::ApplyWrite(io_port_t, const uint8_t data)
 {
-	const auto now = PIC_FullIndex();
-
-	// Wake up the channel and update the last rendered time datum.
-	if (channel->WakeUp()) {
-		last_rendered_ms = now;
-		return;
-	}
-	// Keep rendering until we're current
-	while (last_rendered_ms < now) {
-		last_rendered_ms += ms_per_render;
-		if (float frame = 0.0f; MaybeRenderFrame(frame))
-			fifo.emplace(frame);
-	}
+	device.write(data);
 }
 
-void Ps1Synth::WriteSoundGeneratorPort205(io_port_t, io_val_t value, io_width_t)
+void Ps1Synth::WriteSoundGeneratorPort205(io_port_t port, io_val_t value, io_width_t)
 {
-	RenderUpToNow();
+	const auto now = PIC_FullIndex();
 
-	const auto data = check_cast<uint8_t>(value);
-	device.write(data);
+	// Wake up the channel and restart the render clock from now
+	if (channel->WakeUp())
+		last_rendered_ms = now;
+
+	writes.Enqueue(now, port, check_cast<uint8_t>(value), [this](auto p, auto v) {
+		ApplyWrite(p, v);
+	});
 }
 
 void Ps1Synth::AudioCallback(const uint16_t requested_frames)
 {
 	assert(channel);
 
-	// if (fifo.size())
-	//	LOG_MSG("PS1: Queued %2lu cycle-accurate frames", fifo.size());
-
-	auto frames_remaining = requested_frames;
+	const auto apply_write = [this](auto p, auto v) { ApplyWrite(p, v); };
 
-	// First, send any frames we've queued since the last callback
-	while (frames_remaining && fifo.size()) {
-		channel->AddSamples_mfloat(1, &fifo.front());
-		fifo.pop();
-		--frames_remaining;
-	}
-	// If the queue's run dry, render the remainder and sync-up our time datum
-	while (frames_remaining) {
-		if (float frame = 0.0f; MaybeRenderFrame(frame)) {
-			channel->AddSamples_mfloat(1, &frame);
-		}
-		--frames_remaining;
+	// Render the requested frames, applying the queued writes as the
+	// render clock passes them
+	render_frames.clear();
+	while (render_frames.size() < requested_frames) {
+		writes.ApplyUpTo(last_rendered_ms, apply_write);
+		last_rendered_ms += ms_per_render;
+		if (float frame = 0.0f; MaybeRenderFrame(frame))
+			render_frames.push_back(frame);
 	}
+	channel->AddSamples_mfloat(requested_frames, render_frames.data());
+
+	// Catch up with any writes left and sync-up our time datum
 	last_rendered_ms = PIC_FullIndex();
+	writes.ApplyUpTo(last_rendered_ms, apply_write);
 }
 
 Ps1Synth::~Ps1Synth()
@@ -0,0 +1,493 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "replay.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+#include "mouse.h"
+#include "netplay.h"
+#include "pic.h"
+#include "setup.h"
+#include "support.h"
+#include "timer.h"
+#include "video.h"
+
+extern bool ticksLocked;
+
+// The file starts with the magic and the host time the recording started
+// at, followed by the records: the tick, the type, the payload's size, and
+// the payload, all little-endian
+constexpr char replay_magic[8] = {'D', 'B', 'R', 'E', 'P', 'L', 'A', 'Y'};
+constexpr size_t header_bytes  = sizeof(replay_magic) + 8;
+constexpr size_t record_header_bytes = 4 + 1 + 2;
+
+enum class RecordType : uint8_t {
+	Key         = 1, // key, pressed
+	MouseMoved  = 2, // x_rel, y_rel, x_abs, y_abs
+	MouseButton = 3, // idx, pressed
+	MouseWheel  = 4, // w_rel
+	Packet      = 5, // the packet's bytes
+	CycleMax    = 6, // the cycles per tick, when they change
+	Frame       = 7, // the frame's checksum
+	End         = 8, // the tick the recording ended at
+};
+
+struct Record {
+	uint32_t tick   = 0;
+	RecordType type = RecordType::End;
+	std::vector<uint8_t> payload = {};
+};
+
+enum class ReplayMode { Off, Recording, Playing };
+
+static struct {
+	ReplayMode mode  = ReplayMode::Off;
+	time_t start_time = 0;
+	bool injecting   = false; // passing a replayed input on
+
+	// Recording
+	FILE *file = nullptr;
+	int32_t recorded_cycle_max = 0;
+
+	// Playing, with the packets and frames taken out of the event stream
+	// as they're consumed at different points
+	std::deque<Record> events  = {};
+	std::deque<Record> packets = {};
+	std::vector<uint64_t> frame_checksums = {};
+	int32_t cycle_max = 0;
+	uint32_t end_tick = 0;
+	int64_t start_host_ms = 0;
+	bool finished = false;
+
+	// Both
+	uint64_t frames = 0;
+	uint64_t differing_frames = 0;
+	uint64_t first_differing_frame = 0;
+} replay;
+
+// Payload encoding
+// ~~~~~~~~~~~~~~~~
+static void put(std::vector<uint8_t> &out, const uint64_t value, const int num_bytes)
+{
+	for (auto i = 0; i < num_bytes; ++i)
+		out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+static void put_float(std::vector<uint8_t> &out, const float value)
+{
+	uint32_t bits = 0;
+	static_assert(sizeof(bits) == sizeof(value));
+	memcpy(&bits, &value, sizeof(bits));
+	put(out, bits, 4);
+}
+
+static uint64_t get(const std::vector<uint8_t> &in, size_t &pos, const int num_bytes)
+{
+	uint64_t value = 0;
+	for (auto i = 0; i < num_bytes && pos < in.size(); ++i)
+		value |= static_cast<uint64_t>(in[pos++]) << (i * 8);
+	return value;
+}
+
+static float get_float(const std::vector<uint8_t> &in, size_t &pos)
+{
+	const auto bits = static_cast<uint32_t>(get(in, pos, 4));
+	float value = 0.0f;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// Recording
+// ~~~~~~~~~
+static void write_record(const RecordType type, const std::vector<uint8_t> &payload)
+{
+	assert(replay.file);
+	assert(payload.size() <= UINT16_MAX);
+
+	std::vector<uint8_t> record = {};
+	record.reserve(record_header_bytes + payload.size());
+	put(record, PIC_Ticks, 4);
+	put(record, static_cast<uint8_t>(type), 1);
+	put(record, payload.size(), 2);
+	record.insert(record.end(), payload.begin(), payload.end());
+
+	if (fwrite(record.data(), 1, record.size(), replay.file) != record.size()) {
+		LOG_WARNING("REPLAY: Failed writing the recording, stopped recording: %s",
+		            safe_strerror(errno).c_str());
+		fclose(replay.file);
+		replay.file = nullptr;
+		replay.mode = ReplayMode::Off;
+	}
+}
+
+static bool start_recording(const std::string &path)
+{
+	replay.file = fopen(path.c_str(), "wb");
+	if (!replay.file) {
+		LOG_WARNING("REPLAY: Can't create the recording '%s': %s",
+		            path.c_str(), safe_strerror(errno).c_str());
+		return false;
+	}
+	replay.start_time = time(nullptr);
+
+	std::vector<uint8_t> header(replay_magic, replay_magic + sizeof(replay_magic));
+	put(header, static_cast<uint64_t>(replay.start_time), 8);
+	fwrite(header.data(), 1, header.size(), replay.file);
+
+	replay.recorded_cycle_max = 0;
+	replay.mode = ReplayMode::Recording;
+	LOG_MSG("REPLAY: Recording the input to '%s'", path.c_str());
+	return true;
+}
+
+static void stop_recording()
+{
+	write_record(RecordType::End, {});
+	if (replay.file)
+		fclose(replay.file);
+	replay.file = nullptr;
+
+	LOG_MSG("REPLAY: Recorded %u ms of emulated time and %" PRIu64 " frames",
+	        PIC_Ticks, replay.frames);
+}
+
+// Playing
+// ~~~~~~~
+static bool start_playing(const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) {
+		LOG_WARNING("REPLAY: Can't open the recording '%s': %s",
+		            path.c_str(), safe_strerror(errno).c_str());
+		return false;
+	}
+	std::vector<uint8_t> data = {};
+	uint8_t chunk[64 * 1024];
+	size_t num_read = 0;
+	while ((num_read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		data.insert(data.end(), chunk, chunk + num_read);
+	fclose(file);
+
+	if (data.size() < header_bytes ||
+	    memcmp(data.data(), replay_magic, sizeof(replay_magic)) != 0) {
+		LOG_WARNING("REPLAY: '%s' isn't an input recording", path.c_str());
+		return false;
+	}
+	size_t pos = sizeof(replay_magic);
+	replay.start_time = static_cast<time_t>(get(data, pos, 8));
+
+	bool has_end = false;
+	while (data.size() - pos >= record_header_bytes) {
+		Record record = {};
+		record.tick = static_cast<uint32_t>(get(data, pos, 4));
+		record.type = static_cast<RecordType>(get(data, pos, 1));
+		const auto num_bytes = static_cast<size_t>(get(data, pos, 2));
+		if (data.size() - pos < num_bytes)
+			break;
+		record.payload.assign(data.begin() + static_cast<ptrdiff_t>(pos),
+		                      data.begin() + static_cast<ptrdiff_t>(pos + num_bytes));
+		pos += num_bytes;
+
+		switch (record.type) {
+		case RecordType::Packet:
+			replay.packets.push_back(std::move(record));
+			break;
+		case RecordType::Frame: {
+			size_t payload_pos = 0;
+			replay.frame_checksums.push_back(get(record.payload, payload_pos, 8));
+			break;
+		}
+		case RecordType::End:
+			replay.end_tick = record.tick;
+			has_end = true;
+			break;
+		default: replay.events.push_back(std::move(record)); break;
+		}
+	}
+	if (!has_end) {
+		LOG_WARNING("REPLAY: The recording '%s' is incomplete, replaying what's there",
+		            path.c_str());
+		replay.end_tick = replay.events.empty() ? 0 : replay.events.back().tick;
+	}
+
+	// Run as fast as the host allows
+	ticksLocked = true;
+	replay.cycle_max = CPU_CycleMax;
+	replay.start_host_ms = GetTicks();
+	replay.mode = ReplayMode::Playing;
+	LOG_MSG("REPLAY: Replaying '%s', %u ms of emulated time",
+	        path.c_str(), replay.end_tick);
+	return true;
+}
+
+static void report_replay()
+{
+	const auto host_ms = std::max<int64_t>(GetTicksSince(replay.start_host_ms), 1);
+	const auto fps = static_cast<double>(replay.frames) * 1000.0 / host_ms;
+
+	LOG_MSG("REPLAY: Replayed %u ms of emulated time in %.3f s, %.2fx real time",
+	        PIC_Ticks, host_ms / 1000.0, PIC_Ticks / static_cast<double>(host_ms));
+	LOG_MSG("REPLAY: %" PRIu64 " frames at %.1f frames per second",
+	        replay.frames, fps);
+
+	if (replay.frames != replay.frame_checksums.size())
+		LOG_WARNING("REPLAY: %" PRIu64 " frames were rendered, %zu were recorded",
+		            replay.frames, replay.frame_checksums.size());
+	if (replay.differing_frames)
+		LOG_WARNING("REPLAY: %" PRIu64 " frames differ from the recording, "
+		            "the first being frame %" PRIu64,
+		            replay.differing_frames, replay.first_differing_frame);
+	else
+		LOG_MSG("REPLAY: All of the frames match the recording");
+}
+
+static void apply_event(const Record &record)
+{
+	size_t pos = 0;
+	const auto &p = record.payload;
+
+	replay.injecting = true;
+	switch (record.type) {
+	case RecordType::Key: {
+		const auto key = static_cast<KBD_KEYS>(get(p, pos, 2));
+		const auto pressed = get(p, pos, 1) != 0;
+		KEYBOARD_AddKey(key, pressed);
+		break;
+	}
+	case RecordType::MouseMoved: {
+		const auto x_rel = get_float(p, pos);
+		const auto y_rel = get_float(p, pos);
+		const auto x_abs = static_cast<uint16_t>(get(p, pos, 2));
+		const auto y_abs = static_cast<uint16_t>(get(p, pos, 2));
+		MOUSE_EventMoved(x_rel, y_rel, x_abs, y_abs);
+		break;
+	}
+	case RecordType::MouseButton: {
+		const auto idx = static_cast<uint8_t>(get(p, pos, 1));
+		if (get(p, pos, 1))
+			MOUSE_EventPressed(idx);
+		else
+			MOUSE_EventReleased(idx);
+		break;
+	}
+	case RecordType::MouseWheel:
+		MOUSE_EventWheel(static_cast<int16_t>(get(p, pos, 2)));
+		break;
+	case RecordType::CycleMax:
+		replay.cycle_max = static_cast<int32_t>(get(p, pos, 4));
+		break;
+	default: break;
+	}
+	replay.injecting = false;
+}
+
+// Interface
+// ~~~~~~~~~
+bool REPLAY_IsActive()
+{
+	return replay.mode != ReplayMode::Off;
+}
+
+bool REPLAY_IsPlaying()
+{
+	return replay.mode == ReplayMode::Playing;
+}
+
+// Whether the host's input needs encoding, to be recorded or sent to the
+// netplay peer
+static bool wants_payload()
+{
+	return replay.mode == ReplayMode::Recording ||
+	       (NETPLAY_IsActive() && !replay.injecting);
+}
+
+// Records the input and passes it on, blocks the host's input while
+// replaying, or holds it back for netplay to apply when it's due
+static bool pass_input(const RecordType type, const std::vector<uint8_t> &payload)
+{
+	switch (replay.mode) {
+	case ReplayMode::Off:
+		if (replay.injecting || !NETPLAY_IsActive())
+			return true;
+		NETPLAY_AddInput(static_cast<uint8_t>(type), payload);
+		return false;
+	case ReplayMode::Recording: write_record(type, payload); return true;
+	case ReplayMode::Playing: return replay.injecting;
+	}
+	return true;
+}
+
+bool REPLAY_PassKey(const KBD_KEYS key, const bool pressed)
+{
+	if (!wants_payload())
+		return pass_input(RecordType::Key, {});
+
+	std::vector<uint8_t> payload = {};
+	put(payload, static_cast<uint16_t>(key), 2);
+	put(payload, pressed, 1);
+	return pass_input(RecordType::Key, payload);
+}
+
+bool REPLAY_PassMouseMoved(const float x_rel, const float y_rel,
+                           const uint16_t x_abs, const uint16_t y_abs)
+{
+	if (!wants_payload())
+		return pass_input(RecordType::MouseMoved, {});
+
+	std::vector<uint8_t> payload = {};
+	put_float(payload, x_rel);
+	put_float(payload, y_rel);
+	put(payload, x_abs, 2);
+	put(payload, y_abs, 2);
+	return pass_input(RecordType::MouseMoved, payload);
+}
+
+bool REPLAY_PassMouseButton(const uint8_t idx, const bool pressed)
+{
+	if (!wants_payload())
+		return pass_input(RecordType::MouseButton, {});
+
+	std::vector<uint8_t> payload = {};
+	put(payload, idx, 1);
+	put(payload, pressed, 1);
+	return pass_input(RecordType::MouseButton, payload);
+}
+
+bool REPLAY_PassMouseWheel(const int16_t w_rel)
+{
+	if (!wants_payload())
+		return pass_input(RecordType::MouseWheel, {});
+
+	std::vector<uint8_t> payload = {};
+	put(payload, static_cast<uint16_t>(w_rel), 2);
+	return pass_input(RecordType::MouseWheel, payload);
+}
+
+void REPLAY_AddPacket(const uint8_t *packet, const int len)
+{
+	if (replay.mode != ReplayMode::Recording || len <= 0 || len > UINT16_MAX)
+		return;
+	write_record(RecordType::Packet, std::vector<uint8_t>(packet, packet + len));
+}
+
+void REPLAY_ReplayPackets(const std::function<int(const uint8_t *, int)> &receive)
+{
+	while (!replay.packets.empty() && replay.packets.front().tick <= PIC_Ticks) {
+		const auto &packet = replay.packets.front().payload;
+		receive(packet.data(), static_cast<int>(packet.size()));
+		replay.packets.pop_front();
+	}
+}
+
+void REPLAY_ApplyInput(const uint8_t type, const std::vector<uint8_t> &payload)
+{
+	Record record = {};
+	record.type = static_cast<RecordType>(type);
+	record.payload = payload;
+	apply_event(record);
+}
+
+time_t REPLAY_Time()
+{
+	if (replay.mode == ReplayMode::Off && NETPLAY_IsActive())
+		return NETPLAY_StartTime() + static_cast<time_t>(PIC_Ticks / 1000);
+	if (replay.mode == ReplayMode::Off)
+		return time(nullptr);
+	return replay.start_time + static_cast<time_t>(PIC_Ticks / 1000);
+}
+
+void REPLAY_AddFrame(const uint64_t checksum)
+{
+	const auto frame = replay.frames++;
+	if (replay.mode == ReplayMode::Recording) {
+		std::vector<uint8_t> payload = {};
+		put(payload, checksum, 8);
+		write_record(RecordType::Frame, payload);
+	} else if (replay.mode == ReplayMode::Playing) {
+		if (frame < replay.frame_checksums.size() &&
+		    replay.frame_checksums[frame] == checksum)
+			return;
+		if (!replay.differing_frames++)
+			replay.first_differing_frame = frame;
+	}
+}
+
+void REPLAY_ServiceTick()
+{
+	if (replay.mode == ReplayMode::Recording) {
+		if (CPU_CycleMax != replay.recorded_cycle_max) {
+			std::vector<uint8_t> payload = {};
+			put(payload, static_cast<uint32_t>(CPU_CycleMax), 4);
+			write_record(RecordType::CycleMax, payload);
+			replay.recorded_cycle_max = CPU_CycleMax;
+		}
+		return;
+	}
+	if (replay.mode != ReplayMode::Playing || replay.finished)
+		return;
+
+	while (!replay.events.empty() && replay.events.front().tick <= PIC_Ticks) {
+		apply_event(replay.events.front());
+		replay.events.pop_front();
+	}
+
+	// The automatic cycle adjustment depends on the host's speed, so the
+	// recorded cycles replace it
+	CPU_CycleMax = replay.cycle_max;
+
+	if (PIC_Ticks >= replay.end_tick) {
+		replay.finished = true;
+		report_replay();
+		GFX_RequestExit(true);
+	}
+}
+
+static void REPLAY_Destroy(Section *)
+{
+	if (replay.mode == ReplayMode::Recording)
+		stop_recording();
+	else if (replay.mode == ReplayMode::Playing && !replay.finished)
+		report_replay();
+	replay.mode = ReplayMode::Off;
+}
+
+void REPLAY_Init(Section *sec)
+{
+	const auto section = static_cast<Section_prop *>(sec);
+	const std::string record_path = section->Get_path("input_record")->realpath;
+	const std::string replay_path = section->Get_path("input_replay")->realpath;
+
+	if (!replay_path.empty()) {
+		if (!record_path.empty())
+			LOG_WARNING("REPLAY: Replaying an input recording, so not recording another");
+		start_playing(replay_path);
+	} else if (!record_path.empty()) {
+		start_recording(record_path);
+	}
+	sec->AddDestroyFunction(&REPLAY_Destroy);
+}
@@ -0,0 +1,377 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "rewind.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <zlib.h>
+
+#include "dos_inc.h"
+#include "mapper.h"
+#include "mem.h"
+#include "netplay.h"
+#include "paging.h"
+#include "pic.h"
+#include "replay.h"
+#include "setup.h"
+#include "snapshot.h"
+#include "timer.h"
+#include "vga.h"
+
+constexpr size_t page_bytes = MEM_PAGE_SIZE;
+
+// The pages of an image that changed since its previous version, as they
+// were in the previous version
+struct ImageUndo {
+	size_t size = 0; // of the previous version
+	std::vector<uint32_t> pages = {};
+	std::vector<uint8_t> data = {}; // compressed
+	size_t data_bytes = 0;          // uncompressed
+
+	size_t Bytes() const
+	{
+		return pages.size() * sizeof(pages[0]) + data.size();
+	}
+};
+
+// An open file and its position, which the host keeps outside of the
+// emulated state
+struct OpenFile {
+	DOS_File *file = nullptr;
+	uint32_t pos = 0;
+
+	bool operator==(const OpenFile &other) const
+	{
+		return file == other.file;
+	}
+};
+
+struct RewindPoint {
+	uint32_t ticks = 0;
+	int32_t depth = 0;
+	std::vector<OpenFile> files = {};
+
+	// Steps back to the previous point; empty for the oldest point
+	bool has_undo = false;
+	ImageUndo ram_undo = {};
+	ImageUndo state_undo = {};
+
+	size_t Bytes() const
+	{
+		return sizeof(*this) + files.size() * sizeof(files[0]) +
+		       ram_undo.Bytes() + state_undo.Bytes();
+	}
+};
+
+static struct {
+	size_t buffer_bytes = 0; // zero if rewinding is disabled
+	uint32_t interval_ms = 0;
+
+	// The RAM and the other components' state as of the newest point
+	std::vector<uint8_t> ram = {};
+	std::vector<uint8_t> state = {};
+
+	std::deque<RewindPoint> points = {};
+	size_t points_bytes = 0;
+	uint32_t last_point_ticks = 0;
+
+	bool key_held = false;
+	int64_t last_step_ms = 0;
+	bool refused = false; // warned about this press already
+} history;
+
+// Image diffs
+// ~~~~~~~~~~~
+static size_t page_size_in(const size_t image_size, const size_t page)
+{
+	const auto offset = page * page_bytes;
+	return offset < image_size ? std::min(page_bytes, image_size - offset) : 0;
+}
+
+// Brings the copy up to the image, comparing the candidate pages, and
+// returns the undo to bring it back
+static ImageUndo update_copy(std::vector<uint8_t> &copy, const uint8_t *image,
+                             const size_t image_size,
+                             const std::vector<uint32_t> &candidates)
+{
+	ImageUndo undo = {};
+	undo.size = copy.size();
+
+	std::vector<uint8_t> old_data = {};
+	for (const auto page : candidates) {
+		const auto offset = page * page_bytes;
+		const auto old_bytes = page_size_in(copy.size(), page);
+		const auto new_bytes = page_size_in(image_size, page);
+		if (old_bytes == new_bytes &&
+		    (!old_bytes ||
+		     memcmp(copy.data() + offset, image + offset, old_bytes) == 0))
+			continue;
+		undo.pages.push_back(page);
+		old_data.insert(old_data.end(), copy.begin() + offset,
+		                copy.begin() + offset + old_bytes);
+	}
+	copy.resize(image_size);
+	for (const auto page : undo.pages) {
+		const auto offset = page * page_bytes;
+		memcpy(copy.data() + offset, image + offset,
+		       page_size_in(image_size, page));
+	}
+
+	undo.data_bytes = old_data.size();
+	if (!old_data.empty()) {
+		auto compressed_size = compressBound(static_cast<uLong>(old_data.size()));
+		undo.data.resize(compressed_size);
+		compress2(undo.data.data(), &compressed_size, old_data.data(),
+		          static_cast<uLong>(old_data.size()), Z_BEST_SPEED);
+		undo.data.resize(compressed_size);
+		undo.data.shrink_to_fit();
+	}
+	return undo;
+}
+
+static void undo_copy(std::vector<uint8_t> &copy, const ImageUndo &undo)
+{
+	std::vector<uint8_t> old_data(undo.data_bytes);
+	if (!old_data.empty()) {
+		auto size = static_cast<uLongf>(old_data.size());
+		if (uncompress(old_data.data(), &size, undo.data.data(),
+		               static_cast<uLong>(undo.data.size())) != Z_OK ||
+		    size != old_data.size())
+			E_Exit("REWIND: Damaged rewind point");
+	}
+	copy.resize(undo.size);
+	size_t pos = 0;
+	for (const auto page : undo.pages) {
+		const auto bytes = page_size_in(undo.size, page);
+		memcpy(copy.data() + page * page_bytes, old_data.data() + pos, bytes);
+		pos += bytes;
+	}
+}
+
+static std::vector<uint32_t> all_pages(const size_t size_a, const size_t size_b)
+{
+	const auto num_pages = (std::max(size_a, size_b) + page_bytes - 1) / page_bytes;
+	std::vector<uint32_t> pages(num_pages);
+	for (size_t page = 0; page < num_pages; ++page)
+		pages[page] = static_cast<uint32_t>(page);
+	return pages;
+}
+
+// The RAM pages written since they were last taken
+static std::vector<uint32_t> take_dirty_pages()
+{
+	// The Tandy and PCjr video memory is written through the TLB by the
+	// video page handlers
+	if (IS_TANDY_ARCH && vga.tandy.mem_base)
+		MEM_MarkDirty(static_cast<PhysPt>(vga.tandy.mem_base - MemBase),
+		              32 * 1024);
+	return MEM_TakeDirtyPages();
+}
+
+static std::vector<OpenFile> open_files()
+{
+	std::vector<OpenFile> files = {};
+	for (const auto file : Files) {
+		if (!file || (file->GetInformation() & 0x8000))
+			continue;
+		uint32_t pos = 0;
+		file->Seek(&pos, DOS_SEEK_CUR);
+		files.push_back({file, pos});
+	}
+	return files;
+}
+
+// Points
+// ~~~~~~
+static void clear_points()
+{
+	history.points.clear();
+	history.points_bytes = 0;
+	history.ram.clear();
+	history.ram.shrink_to_fit();
+	history.state.clear();
+	history.state.shrink_to_fit();
+	MEM_TrackDirtyPages(false);
+}
+
+static void take_point()
+{
+	std::vector<uint8_t> state = {};
+	if (!SNAPSHOT_CaptureState(state))
+		return;
+
+	RewindPoint point = {};
+	point.ticks = PIC_Ticks;
+	point.depth = DOSBOX_GetRunDepth();
+	point.files = open_files();
+
+	const auto ram_size = MEM_TotalPages() * page_bytes;
+	if (history.points.empty()) {
+		// The first point starts the copies everything else is diffed
+		// against
+		MEM_TrackDirtyPages(true);
+		take_dirty_pages();
+		history.ram.assign(MemBase, MemBase + ram_size);
+		history.state = std::move(state);
+	} else {
+		point.has_undo = true;
+		point.ram_undo = update_copy(history.ram, MemBase, ram_size,
+		                             take_dirty_pages());
+		point.state_undo = update_copy(history.state, state.data(),
+		                               state.size(),
+		                               all_pages(history.state.size(),
+		                                         state.size()));
+	}
+	history.points_bytes += point.Bytes();
+	history.points.push_back(std::move(point));
+	history.last_point_ticks = PIC_Ticks;
+
+	// The oldest point left needs no way back
+	while (history.points.size() > 1 && history.points_bytes > history.buffer_bytes) {
+		history.points_bytes -= history.points.front().Bytes();
+		history.points.pop_front();
+		auto &oldest = history.points.front();
+		history.points_bytes -= oldest.Bytes();
+		oldest.has_undo = false;
+		oldest.ram_undo = {};
+		oldest.state_undo = {};
+		history.points_bytes += oldest.Bytes();
+	}
+}
+
+// Restores the machine to the newest point and drops it, so the next step
+// goes back one point further
+static bool step_back()
+{
+	if (history.points.empty())
+		return false;
+	auto &point = history.points.back();
+	if (open_files() != point.files) {
+		if (!history.refused)
+			LOG_WARNING("REWIND: Can't step back past the program opening or closing files");
+		history.refused = true;
+		return false;
+	}
+
+	// Take back what changed since the point
+	for (const auto page : take_dirty_pages()) {
+		const auto offset = page * page_bytes;
+		memcpy(MemBase + offset, history.ram.data() + offset, page_bytes);
+	}
+	SNAPSHOT_RestoreState(history.state);
+	for (const auto &open_file : point.files) {
+		auto pos = open_file.pos;
+		open_file.file->Seek(&pos, DOS_SEEK_SET);
+	}
+	// The restored state may have re-installed page handlers
+	take_dirty_pages();
+
+	const auto ticks = point.ticks;
+	history.points_bytes -= point.Bytes();
+	if (point.has_undo) {
+		// Move the copies back to the previous point, which makes the
+		// pages that differ from it dirty
+		undo_copy(history.ram, point.ram_undo);
+		undo_copy(history.state, point.state_undo);
+		for (const auto page : point.ram_undo.pages)
+			MEM_MarkDirty(page * page_bytes, page_bytes);
+		history.points.pop_back();
+	} else {
+		history.points.pop_back();
+		clear_points();
+	}
+	history.last_point_ticks = PIC_Ticks;
+	LOG_MSG("REWIND: Stepped back to %.2f s", ticks / 1000.0);
+	return true;
+}
+
+void REWIND_ServiceTick()
+{
+	if (!history.buffer_bytes)
+		return;
+
+	// The points belong to the program running at their depth
+	if (!history.points.empty() &&
+	    DOSBOX_GetRunDepth() < history.points.back().depth) {
+		clear_points();
+		return;
+	}
+	if (!SNAPSHOT_CanCapture())
+		return;
+
+	if (history.key_held) {
+		if (GetTicksSince(history.last_step_ms) < static_cast<int>(history.interval_ms))
+			return;
+		history.last_step_ms = GetTicks();
+		step_back();
+		return;
+	}
+	if (PIC_Ticks - history.last_point_ticks >= history.interval_ms ||
+	    history.points.empty())
+		take_point();
+}
+
+static void rewind_key(const bool pressed)
+{
+	if (pressed && !history.buffer_bytes) {
+		LOG_WARNING("REWIND: Set 'rewind_buffer' in the [dosbox] section to rewind");
+		return;
+	}
+	if (pressed && REPLAY_IsActive()) {
+		LOG_WARNING("REWIND: Can't rewind while recording or replaying the input");
+		return;
+	}
+	if (pressed && NETPLAY_IsActive()) {
+		LOG_WARNING("REWIND: Can't rewind during netplay");
+		return;
+	}
+	history.key_held = pressed;
+	history.refused = false;
+	history.last_step_ms = GetTicks() - history.interval_ms;
+}
+
+static void REWIND_Destroy(Section *)
+{
+	clear_points();
+	history.buffer_bytes = 0;
+}
+
+void REWIND_Init(Section *sec)
+{
+	const auto section = static_cast<Section_prop *>(sec);
+	history.buffer_bytes = static_cast<size_t>(section->Get_int("rewind_buffer")) *
+	                      1024 * 1024;
+	history.interval_ms = 1000 / static_cast<uint32_t>(section->Get_int("rewind_rate"));
+
+	if (history.buffer_bytes && REPLAY_IsActive()) {
+		LOG_WARNING("REWIND: Disabled while recording or replaying the input");
+		history.buffer_bytes = 0;
+	}
+	// Netplay's rollback snapshots track the same dirty pages
+	if (history.buffer_bytes && NETPLAY_IsActive()) {
+		LOG_WARNING("REWIND: Disabled during netplay");
+		history.buffer_bytes = 0;
+	}
+	MAPPER_AddHandler(rewind_key, SDL_SCANCODE_UNKNOWN, 0, "rewind", "Rewind");
+	sec->AddDestroyFunction(&REWIND_Destroy);
+}
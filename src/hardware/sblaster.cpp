@@ -130,6 +130,7 @@ struct SB_INFO {
 		uint32_t remain_size = 0;
 	} dma = {};
 	bool speaker = false;
+	bool channel_on = false; // the channel's output, even while asleep
 	bool midi = false;
 	uint8_t time_constant = 0;
 	DSP_MODES mode = MODE_NONE;
@@ -277,6 +278,25 @@ static void PlayDMATransfer(uint32_t size);
 typedef void (*process_dma_f)(uint32_t);
 static process_dma_f ProcessDMATransfer;
 
+// Turns the channel's output on or off, remembering the state so port writes
+// only wake the channel when its output is on
+static void set_channel_output(const bool requested_state)
+{
+	// Waking up also enables the channel, with a full awake period ahead
+	if (requested_state)
+		sb.chan->WakeUp();
+	else
+		sb.chan->Enable(false);
+
+	sb.channel_on = requested_state;
+}
+
+static void wake_up_channel()
+{
+	if (sb.channel_on)
+		sb.chan->WakeUp();
+}
+
 static void DSP_SetSpeaker(bool requested_state) {
 	// Speaker-output is already in the requested state
 	if (sb.speaker == requested_state)
@@ -290,7 +310,7 @@ static void DSP_SetSpeaker(bool requested_state) {
 		// Speaker powered-on after cold-state, give it warmup time
 		sb.dsp.warmup_remaining_ms = sb.dsp.cold_warmup_ms;
 	}
-	sb.chan->Enable(requested_state);
+	set_channel_output(requested_state);
 	sb.speaker = requested_state;
 	LOG_MSG("%s: Speaker-output has been toggled %s",
 	        CardType(), requested_state ? "on" : "off");
@@ -308,9 +328,9 @@ static void InitializeSpeakerState()
 		const bool is_cold_start = sb.dsp.reset_tally <= DSP_INITIAL_RESET_LIMIT;
 		sb.dsp.warmup_remaining_ms = is_cold_start ? sb.dsp.cold_warmup_ms
 		                                           : sb.dsp.hot_warmup_ms;
-		sb.chan->Enable(true);
+		set_channel_output(true);
 	} else {
-		sb.chan->Enable(false);
+		set_channel_output(false);
 	}
 }
 
@@ -614,6 +634,7 @@ static void DSP_DMA_CallBack(DmaChannel * chan, DMAEvent event) {
 		}
 	} else if (event==DMA_UNMASKED) {
 		if (sb.mode==MODE_DMA_MASKED && sb.dma.mode!=DSP_DMA_NONE) {
+			wake_up_channel();
 			DSP_ChangeMode(MODE_DMA);
 //			sb.mode=MODE_DMA;
 			FlushRemainingDMATransfer();
@@ -733,6 +754,75 @@ static uint32_t ReadDMA16(uint32_t bytes_to_read, uint32_t i = 0) {
 	return check_cast<uint32_t>(bytes_read);
 }
 
+// Plays mono samples straight from guest memory, without copying them into
+// the DMA buffer first. The warm-up silence needs whole callbacks, so it
+// takes the buffered path.
+static bool can_play_from_guest_memory()
+{
+	return !sb.dsp.warmup_remaining_ms && !sb.dma.stereo;
+}
+
+static uint32_t PlayDMA8Spans(uint32_t bytes_to_read)
+{
+	const auto bytes_read = sb.dma.chan->ReadSpans(
+	        bytes_to_read, [](const uint8_t *data, const size_t bytes) {
+		        const auto frames = check_cast<uint16_t>(bytes);
+		        if (sb.dma.sign)
+			        sb.chan->AddSamples_m8s(frames,
+			                                reinterpret_cast<const int8_t *>(data));
+		        else
+			        sb.chan->AddSamples_m8(frames, data);
+	        });
+	return check_cast<uint32_t>(bytes_read);
+}
+
+#if !defined(WORDS_BIGENDIAN)
+// Spans of 16-bit channels hold whole, aligned words
+static uint32_t PlayDMA16Spans(uint32_t words_to_read)
+{
+	const auto words_read = sb.dma.chan->ReadSpans(
+	        words_to_read, [](const uint8_t *data, const size_t bytes) {
+		        const auto frames = check_cast<uint16_t>(bytes / 2);
+		        if (sb.dma.sign)
+			        sb.chan->AddSamples_m16(frames,
+			                                reinterpret_cast<const int16_t *>(data));
+		        else
+			        sb.chan->AddSamples_m16u(frames,
+			                                 reinterpret_cast<const uint16_t *>(data));
+	        });
+	return check_cast<uint32_t>(words_read);
+}
+#endif
+
+// Decodes the whole ADPCM transfer into the mixer's temporary buffer and adds
+// it to the channel in one go, rather than a few samples per byte. The
+// reference byte that starts a transfer is read but not played.
+template <typename DecodeByte>
+static uint32_t PlayADPCMTransfer(const uint32_t bytes_to_read,
+                                  DecodeByte decode_byte, uint32_t &samples)
+{
+	const auto bytes_read = ReadDMA8(bytes_to_read);
+
+	uint32_t i = 0;
+	if (bytes_read && sb.adpcm.haveref) {
+		sb.adpcm.haveref = false;
+		sb.adpcm.reference = sb.dma.buf.b8[0];
+		sb.adpcm.stepsize = MIN_ADAPTIVE_STEP_SIZE;
+		i++;
+	}
+
+	auto out = MixTemp;
+	for (; i < bytes_read; ++i)
+		out = decode_byte(sb.dma.buf.b8[i], out);
+
+	samples = check_cast<uint32_t>(out - MixTemp);
+	assert(samples <= MIXER_BUFSIZE);
+	if (samples)
+		sb.chan->AddSamples_m8(check_cast<uint16_t>(samples),
+		                       maybe_silence(samples, MixTemp));
+	return bytes_read;
+}
+
 static void PlayDMATransfer(uint32_t bytes_requested)
 {
 	// How many bytes should we read from DMA?
@@ -756,70 +846,34 @@ static void PlayDMATransfer(uint32_t bytes_requested)
 
 	last_dma_callback = PIC_FullIndex();
 
-	// Temporary counter for ADPCM modes
-	uint32_t i = 0;
-
 	//Read the actual data, process it and send it off to the mixer
 	switch (sb.dma.mode) {
 	case DSP_DMA_2:
-		bytes_read = ReadDMA8(bytes_to_read);
-		if (bytes_read && sb.adpcm.haveref) {
-			sb.adpcm.haveref=false;
-			sb.adpcm.reference=sb.dma.buf.b8[0];
-			sb.adpcm.stepsize=MIN_ADAPTIVE_STEP_SIZE;
-			i++;
-		}
-		assert(samples == 0);
-		while (i < bytes_read) {
-			MixTemp[samples++] = decode_ADPCM_2_sample((sb.dma.buf.b8[i] >> 6) & 0x3);
-			MixTemp[samples++] = decode_ADPCM_2_sample((sb.dma.buf.b8[i] >> 4) & 0x3);
-			MixTemp[samples++] = decode_ADPCM_2_sample((sb.dma.buf.b8[i] >> 2) & 0x3);
-			MixTemp[samples++] = decode_ADPCM_2_sample((sb.dma.buf.b8[i] >> 0) & 0x3);
-
-			frames = check_cast<uint16_t>(samples / channels);
-			sb.chan->AddSamples_m8(frames, maybe_silence(samples, MixTemp));
-			samples = 0;
-			++i;
-		}
+		bytes_read = PlayADPCMTransfer(bytes_to_read, [](const uint8_t val, uint8_t *out) {
+			*out++ = decode_ADPCM_2_sample((val >> 6) & 0x3);
+			*out++ = decode_ADPCM_2_sample((val >> 4) & 0x3);
+			*out++ = decode_ADPCM_2_sample((val >> 2) & 0x3);
+			*out++ = decode_ADPCM_2_sample((val >> 0) & 0x3);
+			return out;
+		}, samples);
+		frames = check_cast<uint16_t>(samples);
 		break;
 	case DSP_DMA_3:
-		bytes_read = ReadDMA8(bytes_to_read);
-		if (bytes_read && sb.adpcm.haveref) {
-			sb.adpcm.haveref=false;
-			sb.adpcm.reference=sb.dma.buf.b8[0];
-			sb.adpcm.stepsize=MIN_ADAPTIVE_STEP_SIZE;
-			i++;
-		}
-		assert(samples == 0);
-		while (i < bytes_read) {
-			MixTemp[samples++] = decode_ADPCM_3_sample((sb.dma.buf.b8[i] >> 5) & 0x7);
-			MixTemp[samples++] = decode_ADPCM_3_sample((sb.dma.buf.b8[i] >> 2) & 0x7);
-			MixTemp[samples++] = decode_ADPCM_3_sample((sb.dma.buf.b8[i] & 0x3) << 1);
-
-			frames = check_cast<uint16_t>(samples / channels);
-			sb.chan->AddSamples_m8(frames, maybe_silence(samples, MixTemp));
-			samples = 0;
-			++i;
-		}
+		bytes_read = PlayADPCMTransfer(bytes_to_read, [](const uint8_t val, uint8_t *out) {
+			*out++ = decode_ADPCM_3_sample((val >> 5) & 0x7);
+			*out++ = decode_ADPCM_3_sample((val >> 2) & 0x7);
+			*out++ = decode_ADPCM_3_sample((val & 0x3) << 1);
+			return out;
+		}, samples);
+		frames = check_cast<uint16_t>(samples);
 		break;
 	case DSP_DMA_4:
-		bytes_read = ReadDMA8(bytes_to_read);
-		if (bytes_read && sb.adpcm.haveref) {
-			sb.adpcm.haveref=false;
-			sb.adpcm.reference=sb.dma.buf.b8[0];
-			sb.adpcm.stepsize=MIN_ADAPTIVE_STEP_SIZE;
-			i++;
-		}
-		assert(samples == 0);
-		while (i < bytes_read) {
-			MixTemp[samples++] = decode_ADPCM_4_sample(sb.dma.buf.b8[i] >> 4);
-			MixTemp[samples++] = decode_ADPCM_4_sample(sb.dma.buf.b8[i] & 0xf);
-
-			frames = check_cast<uint16_t>(samples / channels);
-			sb.chan->AddSamples_m8(frames, maybe_silence(samples, MixTemp));
-			samples = 0;
-			++i;
-		}
+		bytes_read = PlayADPCMTransfer(bytes_to_read, [](const uint8_t val, uint8_t *out) {
+			*out++ = decode_ADPCM_4_sample(val >> 4);
+			*out++ = decode_ADPCM_4_sample(val & 0xf);
+			return out;
+		}, samples);
+		frames = check_cast<uint16_t>(samples);
 		break;
 	case DSP_DMA_8:
  		if (sb.dma.stereo) {
@@ -850,6 +904,10 @@ static void PlayDMATransfer(uint32_t bytes_requested)
 			} else {
 				sb.dma.remain_size = 0;
 			}
+		} else if (can_play_from_guest_memory()) {
+			bytes_read = PlayDMA8Spans(bytes_to_read);
+			samples = bytes_read;
+			frames = check_cast<uint16_t>(samples);
 		} else { // Mono
 			bytes_read = ReadDMA8(bytes_to_read);
 			samples = bytes_read;
@@ -904,6 +962,12 @@ static void PlayDMATransfer(uint32_t bytes_requested)
 				// The DMA transfer is done
 				sb.dma.remain_size = 0;
 			}
+#if !defined(WORDS_BIGENDIAN)
+		} else if (sb.dma.mode == DSP_DMA_16 && can_play_from_guest_memory()) {
+			bytes_read = PlayDMA16Spans(bytes_to_read);
+			samples = bytes_read;
+			frames = check_cast<uint16_t>(samples);
+#endif
 		} else { // 16-bit mono
 			bytes_read = ReadDMA16(bytes_to_read);
 			samples = bytes_read / dma16_to_sample_divisor;
@@ -1207,7 +1271,7 @@ static void DSP_DoReset(uint8_t val) {
 		// Halt the channel so we're silent across reset events.
 		// Channel is re-enabled (if SB16) or via control by the game
 		// (non-SB16).
-		sb.chan->Enable(false);
+		set_channel_output(false);
 		DSP_Reset();
 		sb.dsp.state=DSP_S_RESET;
 	} else if (((val&1)==0) && (sb.dsp.state==DSP_S_RESET)) {	// reset off
@@ -1949,6 +2013,7 @@ static uint8_t read_sb(io_port_t port, io_width_t)
 static void write_sb(io_port_t port, io_val_t value, io_width_t)
 {
 	const auto val = check_cast<uint8_t>(value);
+	wake_up_channel();
 	switch (port - sb.hw.base) {
 	case DSP_RESET: DSP_DoReset(val); break;
 	case DSP_WRITE_DATA: DSP_DoWrite(val); break;
@@ -1997,6 +2062,9 @@ static void SBLASTER_CallBack(uint32_t len)
 		sb.dac.used=0;
 		break;
 	case MODE_DMA:
+		// The callback drives the DMA transfers and their IRQs, so stay
+		// awake even if the game plays silence
+		sb.chan->WakeUp();
 		len*=sb.dma.mul;
 		if (len&SB_SH_MASK) len+=1 << SB_SH;
 		len>>=SB_SH;
@@ -2138,7 +2206,8 @@ public:
 		if (sb.type == SBT_NONE || sb.type == SBT_GB)
 			return;
 
-		std::set channel_features = {ChannelFeature::ReverbSend,
+		std::set channel_features = {ChannelFeature::Sleep,
+		                             ChannelFeature::ReverbSend,
 		                             ChannelFeature::ChorusSend,
 		                             ChannelFeature::DigitalAudio};
 
@@ -2169,6 +2238,9 @@ public:
 			ReadHandler[i].Install(sb.hw.base + i, read_sb, io_width_t::byte);
 			WriteHandler[i].Install(sb.hw.base + i, write_sb, io_width_t::byte);
 		}
+		// data only arrives from commands written to the DSP or events
+		IO_RegisterPollHint(sb.hw.base + DSP_READ_STATUS,
+		                    [](io_port_t) { return io_poll_until_event; });
 		for (uint16_t i = 0; i < 256; ++i)
 			ASP_regs[i] = 0;
 		ASP_regs[5] = 0x01;
@@ -2233,6 +2305,7 @@ public:
 		}
 		if (sb.type == SBT_NONE || sb.type == SBT_GB)
 			return;
+		IO_FreePollHint(sb.hw.base + DSP_READ_STATUS);
 		DSP_Reset(); // Stop everything
 		sb.dsp.reset_tally = 0;
 	}
@@ -0,0 +1,378 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "screenshot_encoder.h"
+
+#if (C_SSHOT)
+
+#include <cassert>
+#include <cstring>
+#include <png.h>
+#include <zlib.h>
+
+#include "byteorder.h"
+#include "hardware.h"
+#include "rgb24.h"
+#include "support.h"
+
+// Row conversion
+// ~~~~~~~~~~~~~~
+// Converts a row of the screenshot to 24-bit BGR, or for paletted PNGs to
+// palette indices, doubling the pixels if needed
+static const uint8_t *convert_row(const ScreenshotImage &image, const int y,
+                                  const bool keep_indices,
+                                  std::vector<uint8_t> &row)
+{
+	const auto row_divisor = (image.flags & CAPTURE_FLAG_DBLH) ? 1 : 0;
+	const auto is_double_width = (image.flags & CAPTURE_FLAG_DBLW) != 0;
+	const auto src_width = is_double_width ? image.width / 2 : image.width;
+	const auto src = image.lines.data() +
+	                 static_cast<size_t>(y >> row_divisor) *
+	                         static_cast<size_t>(image.line_bytes);
+
+	row.resize(static_cast<size_t>(image.width) * 3);
+	auto out = row.data();
+	auto put = [&](const uint8_t b, const uint8_t g, const uint8_t r) {
+		out[0] = b;
+		out[1] = g;
+		out[2] = r;
+		out += 3;
+		if (is_double_width) {
+			out[0] = b;
+			out[1] = g;
+			out[2] = r;
+			out += 3;
+		}
+	};
+
+	switch (image.bpp) {
+	case 8:
+		if (keep_indices) {
+			if (!is_double_width)
+				return src;
+			for (auto x = 0; x < src_width; ++x)
+				row[x * 2 + 0] = row[x * 2 + 1] = src[x];
+			break;
+		}
+		for (auto x = 0; x < src_width; ++x) {
+			const auto entry = image.palette + src[x] * 4;
+			put(entry[2], entry[1], entry[0]);
+		}
+		break;
+	case 15:
+		for (auto x = 0; x < src_width; ++x) {
+			const auto pixel = host_to_le(reinterpret_cast<const uint16_t *>(src)[x]);
+			put(static_cast<uint8_t>(((pixel & 0x001f) * 0x21) >> 2),
+			    static_cast<uint8_t>(((pixel & 0x03e0) * 0x21) >> 7),
+			    static_cast<uint8_t>(((pixel & 0x7c00) * 0x21) >> 12));
+		}
+		break;
+	case 16:
+		for (auto x = 0; x < src_width; ++x) {
+			const auto pixel = host_to_le(reinterpret_cast<const uint16_t *>(src)[x]);
+			put(static_cast<uint8_t>(((pixel & 0x001f) * 0x21) >> 2),
+			    static_cast<uint8_t>(((pixel & 0x07e0) * 0x41) >> 9),
+			    static_cast<uint8_t>(((pixel & 0xf800) * 0x21) >> 13));
+		}
+		break;
+	case 24:
+		if (!is_double_width)
+			return src;
+		for (auto x = 0; x < src_width; ++x) {
+			const auto pixel = host_to_le(reinterpret_cast<const rgb24 *>(src)[x]);
+			reinterpret_cast<rgb24 *>(row.data())[x * 2 + 0] = pixel;
+			reinterpret_cast<rgb24 *>(row.data())[x * 2 + 1] = pixel;
+		}
+		break;
+	case 32:
+		for (auto x = 0; x < src_width; ++x)
+			put(src[x * 4 + 0], src[x * 4 + 1], src[x * 4 + 2]);
+		break;
+	}
+	return row.data();
+}
+
+// Writers
+// ~~~~~~~
+static bool write_png(FILE *file, const ScreenshotImage &image, const int level)
+{
+	auto png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr,
+	                                       nullptr, nullptr);
+	if (!png_ptr)
+		return false;
+	auto info_ptr = png_create_info_struct(png_ptr);
+	if (!info_ptr) {
+		png_destroy_write_struct(&png_ptr, nullptr);
+		return false;
+	}
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return false;
+	}
+
+	png_init_io(png_ptr, file);
+	png_set_compression_level(png_ptr, level);
+	png_set_compression_mem_level(png_ptr, 8);
+	png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
+	png_set_compression_window_bits(png_ptr, 15);
+	png_set_compression_method(png_ptr, 8);
+	png_set_compression_buffer_size(png_ptr, 8192);
+
+	const auto is_paletted = image.bpp == 8;
+	if (is_paletted) {
+		png_set_IHDR(png_ptr, info_ptr, image.width, image.height, 8,
+		             PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+		             PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		png_color palette[256];
+		for (auto i = 0; i < 256; ++i) {
+			palette[i].red   = image.palette[i * 4 + 0];
+			palette[i].green = image.palette[i * 4 + 1];
+			palette[i].blue  = image.palette[i * 4 + 2];
+		}
+		png_set_PLTE(png_ptr, info_ptr, palette, 256);
+	} else {
+		png_set_bgr(png_ptr);
+		png_set_IHDR(png_ptr, info_ptr, image.width, image.height, 8,
+		             PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+		             PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	}
+#ifdef PNG_TEXT_SUPPORTED
+	constexpr char keyword[] = "Software";
+	constexpr char value[] = CANONICAL_PROJECT_NAME " " VERSION;
+	constexpr int num_text = 1;
+	static_assert(sizeof(keyword) < 80, "libpng limit");
+	png_text texts[num_text] = {};
+	texts[0].compression = PNG_TEXT_COMPRESSION_NONE;
+	texts[0].key = const_cast<png_charp>(keyword);
+	texts[0].text = const_cast<png_charp>(value);
+	texts[0].text_length = sizeof(value);
+	png_set_text(png_ptr, info_ptr, texts, num_text);
+#endif
+	png_write_info(png_ptr, info_ptr);
+
+	std::vector<uint8_t> row = {};
+	for (auto y = 0; y < image.height; ++y) {
+		const auto converted = convert_row(image, y, is_paletted, row);
+		png_write_row(png_ptr, const_cast<png_bytep>(converted));
+	}
+	png_write_end(png_ptr, nullptr);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	return true;
+}
+
+static void put_le(std::vector<uint8_t> &out, const uint32_t value, const int num_bytes)
+{
+	for (auto i = 0; i < num_bytes; ++i)
+		out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+static void put_be32(std::vector<uint8_t> &out, const uint32_t value)
+{
+	for (auto i = 3; i >= 0; --i)
+		out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+// An uncompressed 24-bit BMP, stored bottom-up
+static bool write_bmp(FILE *file, const ScreenshotImage &image)
+{
+	const auto row_bytes = (static_cast<uint32_t>(image.width) * 3 + 3) & ~3u;
+	const auto image_bytes = row_bytes * static_cast<uint32_t>(image.height);
+	constexpr uint32_t headers_bytes = 14 + 40;
+
+	std::vector<uint8_t> out = {};
+	out.reserve(headers_bytes + image_bytes);
+	out.push_back('B');
+	out.push_back('M');
+	put_le(out, headers_bytes + image_bytes, 4);
+	put_le(out, 0, 4); // reserved
+	put_le(out, headers_bytes, 4);
+
+	put_le(out, 40, 4); // BITMAPINFOHEADER
+	put_le(out, static_cast<uint32_t>(image.width), 4);
+	put_le(out, static_cast<uint32_t>(image.height), 4);
+	put_le(out, 1, 2);  // planes
+	put_le(out, 24, 2); // bits per pixel
+	put_le(out, 0, 4);  // uncompressed
+	put_le(out, image_bytes, 4);
+	put_le(out, 2835, 4); // 72 DPI
+	put_le(out, 2835, 4);
+	put_le(out, 0, 4); // colours used
+	put_le(out, 0, 4); // important colours
+
+	std::vector<uint8_t> row = {};
+	const auto padding = row_bytes - static_cast<uint32_t>(image.width) * 3;
+	for (auto y = image.height - 1; y >= 0; --y) {
+		const auto converted = convert_row(image, y, false, row);
+		out.insert(out.end(), converted, converted + image.width * 3);
+		out.insert(out.end(), padding, 0);
+	}
+	return fwrite(out.data(), 1, out.size(), file) == out.size();
+}
+
+// The "Quite OK Image Format", lossless and much faster to encode than PNG
+// at a similar size; see https://qoiformat.org/qoi-specification.pdf
+static bool write_qoi(FILE *file, const ScreenshotImage &image)
+{
+	struct Pixel {
+		uint8_t r = 0;
+		uint8_t g = 0;
+		uint8_t b = 0;
+		uint8_t a = 255; // always opaque, apart from the unused indices
+
+		bool operator==(const Pixel &other) const
+		{
+			return r == other.r && g == other.g && b == other.b &&
+			       a == other.a;
+		}
+	};
+	constexpr uint8_t op_index = 0x00;
+	constexpr uint8_t op_diff  = 0x40;
+	constexpr uint8_t op_luma  = 0x80;
+	constexpr uint8_t op_run   = 0xc0;
+	constexpr uint8_t op_rgb   = 0xfe;
+	constexpr int max_run      = 62;
+
+	std::vector<uint8_t> out = {'q', 'o', 'i', 'f'};
+	out.reserve(static_cast<size_t>(image.width) * image.height * 4);
+	put_be32(out, static_cast<uint32_t>(image.width));
+	put_be32(out, static_cast<uint32_t>(image.height));
+	out.push_back(3); // RGB
+	out.push_back(0); // sRGB with linear alpha
+
+	Pixel seen[64] = {};
+	for (auto &entry : seen)
+		entry = {0, 0, 0, 0};
+	Pixel prev = {};
+	int run        = 0;
+
+	std::vector<uint8_t> row = {};
+	for (auto y = 0; y < image.height; ++y) {
+		const auto converted = convert_row(image, y, false, row);
+		for (auto x = 0; x < image.width; ++x) {
+			const Pixel px = {converted[x * 3 + 2],
+			                  converted[x * 3 + 1],
+			                  converted[x * 3 + 0]};
+			if (px == prev) {
+				if (++run == max_run) {
+					out.push_back(static_cast<uint8_t>(op_run | (run - 1)));
+					run = 0;
+				}
+				continue;
+			}
+			if (run) {
+				out.push_back(static_cast<uint8_t>(op_run | (run - 1)));
+				run = 0;
+			}
+			const auto hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+			if (seen[hash] == px) {
+				out.push_back(static_cast<uint8_t>(op_index | hash));
+			} else {
+				seen[hash] = px;
+				const auto dr = static_cast<int8_t>(px.r - prev.r);
+				const auto dg = static_cast<int8_t>(px.g - prev.g);
+				const auto db = static_cast<int8_t>(px.b - prev.b);
+				const auto dr_dg = dr - dg;
+				const auto db_dg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 &&
+				    db >= -2 && db <= 1) {
+					out.push_back(static_cast<uint8_t>(
+					        op_diff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+				} else if (dg >= -32 && dg <= 31 && dr_dg >= -8 &&
+				           dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+					out.push_back(static_cast<uint8_t>(op_luma | (dg + 32)));
+					out.push_back(static_cast<uint8_t>((dr_dg + 8) << 4 |
+					                                   (db_dg + 8)));
+				} else {
+					out.insert(out.end(), {op_rgb, px.r, px.g, px.b});
+				}
+			}
+			prev = px;
+		}
+	}
+	if (run)
+		out.push_back(static_cast<uint8_t>(op_run | (run - 1)));
+	out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+
+	return fwrite(out.data(), 1, out.size(), file) == out.size();
+}
+
+// Encoder
+// ~~~~~~~
+ScreenshotEncoder::~ScreenshotEncoder()
+{
+	Stop();
+}
+
+void ScreenshotEncoder::SetFormat(const ScreenshotFormat new_format,
+                                  const int new_png_level)
+{
+	format    = new_format;
+	png_level = new_png_level;
+}
+
+const char *ScreenshotEncoder::GetExtension() const
+{
+	switch (format) {
+	case ScreenshotFormat::Png: return ".png";
+	case ScreenshotFormat::Qoi: return ".qoi";
+	case ScreenshotFormat::Bmp: return ".bmp";
+	}
+	return ".png";
+}
+
+bool ScreenshotEncoder::Queue(FILE *file, ScreenshotImage &&image)
+{
+	assert(file);
+	if (jobs.Size() >= jobs.MaxCapacity()) {
+		LOG_WARNING("CAPTURE: Skipped a screenshot, the previous ones are still being encoded");
+		fclose(file);
+		return false;
+	}
+	if (!thread.joinable()) {
+		thread = std::thread([this] {
+			while (auto job = jobs.Dequeue())
+				job();
+		});
+		set_thread_name(thread, "dosbox:sshot");
+	}
+
+	jobs.Enqueue([file, image = std::move(image), format = format,
+	              level = png_level] {
+		bool ok = false;
+		switch (format) {
+		case ScreenshotFormat::Png: ok = write_png(file, image, level); break;
+		case ScreenshotFormat::Qoi: ok = write_qoi(file, image); break;
+		case ScreenshotFormat::Bmp: ok = write_bmp(file, image); break;
+		}
+		if (fclose(file) != 0 || !ok)
+			LOG_WARNING("CAPTURE: Failed writing a screenshot");
+	});
+	return true;
+}
+
+void ScreenshotEncoder::Stop()
+{
+	if (!thread.joinable())
+		return;
+	jobs.Enqueue(std::function<void()>{}); // stops the thread
+	thread.join();
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SCREENSHOT_ENCODER_H
+#define DOSBOX_SCREENSHOT_ENCODER_H
+
+#include "dosbox.h"
+
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "rwqueue.h"
+
+/*  Screenshot Encoder
+ *  ------------------
+ *  Converts and encodes screenshots on a background thread, so taking one
+ *  doesn't hold up the emulation and the audio, even at high resolutions.
+ *
+ *  The emulation thread creates the file, so the screenshots are numbered
+ *  in the order they were taken, and queues a copy of the frame's source
+ *  lines. The thread starts with the first screenshot and stops when the
+ *  encoder is destroyed, after finishing the queued screenshots.
+ *
+ *  Besides PNG, at a configurable compression level, the screenshots can
+ *  be written as QOI or uncompressed BMP images, which take a fraction of
+ *  the time to encode for bursts of screenshots.
+ */
+
+enum class ScreenshotFormat { Png, Qoi, Bmp };
+
+// A frame as the renderer passes it to the capture
+struct ScreenshotImage {
+	std::vector<uint8_t> lines = {}; // the source lines, back to back
+	uint8_t palette[256 * 4] = {};
+	int width = 0;  // of the screenshot, after doubling
+	int height = 0; // of the screenshot, after doubling
+	int bpp = 0;
+	int line_bytes = 0;
+	uint8_t flags = 0; // CAPTURE_FLAG_DBLW and CAPTURE_FLAG_DBLH
+};
+
+class ScreenshotEncoder {
+public:
+	ScreenshotEncoder() = default;
+	~ScreenshotEncoder();
+
+	void SetFormat(const ScreenshotFormat format, const int png_level);
+	const char *GetExtension() const;
+
+	// Takes ownership of the file; returns false and closes it if too
+	// many screenshots are waiting to be encoded
+	bool Queue(FILE *file, ScreenshotImage &&image);
+
+	// Waits for the queued screenshots
+	void Stop();
+
+private:
+	ScreenshotEncoder(const ScreenshotEncoder &)            = delete;
+	ScreenshotEncoder &operator=(const ScreenshotEncoder &) = delete;
+
+	ScreenshotFormat format = ScreenshotFormat::Png;
+	int png_level = 9;
+
+	RWQueue<std::function<void()>> jobs{16};
+	std::thread thread = {};
+};
+
+#endif
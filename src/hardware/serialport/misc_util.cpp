@@ -25,7 +25,10 @@
 
 #include "misc_util.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 
 #include "timer.h"
 
@@ -203,7 +206,7 @@ ENETServerSocket::~ENETServerSocket()
 // covert an ENet address to a string
 static char *enet_address_to_string(const ENetAddress &address)
 {
-	static char ip_buf[INET_ADDRSTRLEN];
+	thread_local static char ip_buf[INET_ADDRSTRLEN];
 	enet_address_get_host_ip_new(&address, ip_buf, sizeof(ip_buf));
 	return ip_buf;
 }
@@ -295,6 +298,7 @@ ENETClientSocket::ENETClientSocket(const char *destination, uint16_t port)
 #endif
 
 	isopen = true;
+	StartService();
 }
 
 ENETClientSocket::ENETClientSocket(ENetHost *host)
@@ -306,19 +310,25 @@ ENETClientSocket::ENETClientSocket(ENetHost *host)
 	isopen  = true;
 	LOG_INFO("ENET: Established connection to client %s:%u",
 	         enet_address_to_string(peer->address), peer->address.port);
+	StartService();
 }
 
 ENETClientSocket::~ENETClientSocket()
 {
-	if (isopen) {
+	is_stopping = true;
+	if (service_thread.joinable())
+		service_thread.join();
+
+	if (client) {
 		assert(peer);
-		enet_peer_reset(peer);
-		enet_host_destroy(client);
 		LOG_INFO("ENET: Closed connection to client %s:%u",
 		         enet_address_to_string(peer->address), peer->address.port);
+		// Tell the other side, rather than leaving it to time out
+		enet_peer_disconnect_now(peer, 0);
+		enet_host_destroy(client);
 		client = nullptr;
-		isopen = false;
 	}
+	isopen = false;
 }
 
 SocketState ENETClientSocket::GetcharNonBlock(uint8_t &val)
@@ -336,34 +346,20 @@ SocketState ENETClientSocket::GetcharNonBlock(uint8_t &val)
 
 bool ENETClientSocket::Putchar(uint8_t val)
 {
-	updateState();
-
-	const auto packet = enet_packet_create(&val, 1, ENET_PACKET_FLAG_RELIABLE);
-
-	// Is the packet OK?
-	if (packet == nullptr) {
-		LOG_WARNING("ENET: Failed creating packet");
-		return false;
-	}
+	return SendArray(&val, 1);
+}
 
-	// Did the packet send successfully?
-	assert(peer);
-	if (enet_peer_send(peer, 0, packet) < 0) {
-		LOG_WARNING("ENET: Failed sending packet to peer %s:%u",
-		            enet_address_to_string(peer->address),
-		            peer->address.port);
-		enet_packet_destroy(packet);
+bool ENETClientSocket::SendArray(const uint8_t *data, size_t n)
+{
+	updateState();
+	if (!isopen || !sendPacket(data, n))
 		return false;
-	}
-
 	updateState();
 	return isopen;
 }
 
-bool ENETClientSocket::SendArray(const uint8_t *data, size_t n)
+bool ENETClientSocket::sendPacket(const uint8_t *data, size_t n)
 {
-	updateState();
-
 	// The UDP protocol sets a maximum packt size of 65535 bytes:
 	// an 8-byte header and 65,527-byte payload.
 	const auto packet_bytes = check_cast<uint16_t>(n);
@@ -379,6 +375,7 @@ bool ENETClientSocket::SendArray(const uint8_t *data, size_t n)
 
 	// Did the packet send successfully?
 	assert(peer);
+	std::lock_guard<std::mutex> lock(host_mutex);
 	if (enet_peer_send(peer, 0, packet) < 0) {
 		LOG_WARNING("ENET: Failed sending %u-byte packet to peer %s:%u",
 		            packet_bytes, enet_address_to_string(peer->address),
@@ -386,9 +383,9 @@ bool ENETClientSocket::SendArray(const uint8_t *data, size_t n)
 		enet_packet_destroy(packet);
 		return false;
 	}
-
-	updateState();
-	return isopen;
+	// Send it now rather than with the service thread's next pass
+	enet_host_flush(client);
+	return true;
 }
 
 bool ENETClientSocket::ReceiveArray(uint8_t *data, size_t &n)
@@ -440,55 +437,102 @@ bool ENETClientSocket::GetRemoteAddressString(char *buffer)
 	return true;
 }
 
+bool ENETClientSocket::GetLinkStats(NetLinkStats &stats)
+{
+	if (!client)
+		return false;
+	assert(peer);
+	std::lock_guard<std::mutex> lock(host_mutex);
+	stats.round_trip_ms = peer->roundTripTime;
+	stats.jitter_ms     = peer->roundTripTimeVariance;
+	stats.packets_sent  = peer->packetsSent;
+	stats.packets_lost  = peer->packetsLost;
+	return true;
+}
+
 void ENETClientSocket::updateState()
 {
 	if (!isopen || !client)
 		return;
 
-	ENetEvent event;
-	while (enet_host_service(client, &event, 0) > 0) {
-		switch (event.type) {
+	// Check this first, so the data received before closing is kept
+	const bool was_closed = is_closed;
+	if (has_inbox) {
+		std::lock_guard<std::mutex> lock(host_mutex);
+		for (const auto byte : inbox)
+			receiveBuffer.push(byte);
+		inbox.clear();
+		has_inbox = false;
+	}
+	if (was_closed)
+		isopen = false;
+}
+
+void ENETClientSocket::StartService()
+{
+	assert(client);
+	service_thread = std::thread(&ENETClientSocket::Service, this);
+}
+
+void ENETClientSocket::Service()
+{
+	// Bounds how late ENet's resends and pings can be, and how long
+	// closing the socket takes
+	constexpr enet_uint64 max_wait_ms = 5;
+
+	while (!is_stopping && !is_closed) {
+		{
+			std::lock_guard<std::mutex> lock(host_mutex);
+			ENetEvent event;
+			while (enet_host_service(client, &event, 0) > 0) {
+				switch (event.type) {
 #ifndef ENET_BLOCKING_CONNECT
-		case ENET_EVENT_TYPE_CONNECT:
-			connecting = false;
-			assert(event.peer);
-			LOG_INFO("ENET: Established connection to server %s:%u",
-			         enet_address_to_string(event.peer->address),
-			         event.peer->address.port);
-			break;
+				case ENET_EVENT_TYPE_CONNECT:
+					connecting = false;
+					assert(event.peer);
+					LOG_INFO("ENET: Established connection to server %s:%u",
+					         enet_address_to_string(event.peer->address),
+					         event.peer->address.port);
+					break;
 #endif
-		case ENET_EVENT_TYPE_RECEIVE:
-			assert(event.packet);
-			for (size_t x = 0; x < event.packet->dataLength; x++) {
-				receiveBuffer.push(event.packet->data[x]);
+				case ENET_EVENT_TYPE_RECEIVE:
+					assert(event.packet);
+					inbox.insert(inbox.end(), event.packet->data,
+					             event.packet->data +
+					                     event.packet->dataLength);
+					has_inbox = true;
+					enet_packet_destroy(event.packet);
+					break;
+
+				case ENET_EVENT_TYPE_DISCONNECT:
+				case ENET_EVENT_TYPE_DISCONNECT_TIMEOUT:
+					is_closed = true;
+					break;
+
+				default: break;
+				}
 			}
-			enet_packet_destroy(event.packet);
-			break;
-
-		case ENET_EVENT_TYPE_DISCONNECT:
-		case ENET_EVENT_TYPE_DISCONNECT_TIMEOUT: isopen = false; break;
-
-		default: break;
-		}
-	}
 
 #ifndef ENET_BLOCKING_CONNECT
-	if (connecting) {
-		// Check for timeout.
-		if (GetTicksSince(connectStart) > connection_timeout_ms) {
-			assert(peer);
-			LOG_WARNING("ENET: Timed out after %.1f seconds waiting for server %s:%u",
-			            connection_timeout_ms / 1000.0,
-			            enet_address_to_string(peer->address),
-			            peer->address.port);
-			enet_peer_reset(peer);
-			enet_host_destroy(client);
-			client = nullptr;
-			connecting = false;
-			isopen     = false;
+			// Check for timeout.
+			if (connecting &&
+			    GetTicksSince(connectStart) > connection_timeout_ms) {
+				assert(peer);
+				LOG_WARNING("ENET: Timed out after %.1f seconds waiting for server %s:%u",
+				            connection_timeout_ms / 1000.0,
+				            enet_address_to_string(peer->address),
+				            peer->address.port);
+				connecting = false;
+				is_closed  = true;
+			}
+#endif
 		}
+
+		// Sleep until a datagram arrives
+		enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE |
+		                        ENET_SOCKET_WAIT_INTERRUPT;
+		enet_socket_wait(client->socket, &condition, max_wait_ms);
 	}
-#endif
 }
 
 // --- TCP NET INTERFACE -----------------------------------------------------
@@ -532,6 +576,118 @@ bool NetWrapper_InitializeSDLNet()
 	return sdl_net_manager.IsInitialized();
 }
 
+// All the TCP client sockets are read on one thread, so an instance serving
+// several lines doesn't take a thread or a poll per line
+class TcpReactor {
+public:
+	static TcpReactor &Get()
+	{
+		static TcpReactor reactor;
+		return reactor;
+	}
+
+	~TcpReactor()
+	{
+		is_stopping = true;
+		wakeup.notify_one();
+		if (thread.joinable())
+			thread.join();
+		if (socket_set)
+			SDLNet_FreeSocketSet(socket_set);
+	}
+
+	void Add(TCPClientSocket *socket)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		sockets.push_back(socket);
+		if (!thread.joinable())
+			thread = std::thread(&TcpReactor::Run, this);
+		wakeup.notify_one();
+	}
+
+	// Once this returns, the reactor won't touch the socket
+	void Remove(TCPClientSocket *socket)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		sockets.erase(std::remove(sockets.begin(), sockets.end(), socket),
+		              sockets.end());
+		waited_on.clear();
+
+		// The socket set might still have it
+		const auto current_pass = pass;
+		if (is_waiting)
+			pass_done.wait(lock, [&] { return pass != current_pass; });
+	}
+
+private:
+	TcpReactor() = default;
+
+	void Run()
+	{
+		// Bounds how long adding and removing sockets waits
+		constexpr uint32_t max_wait_ms = 5;
+
+		std::vector<uint8_t> block(4096);
+		std::vector<TCPClientSocket *> receivers = {};
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!is_stopping) {
+			receivers.clear();
+			for (const auto socket : sockets)
+				if (socket->CanReceive())
+					receivers.push_back(socket);
+			if (receivers.empty() ||
+			    (receivers != waited_on && !RebuildSocketSet(receivers))) {
+				wakeup.wait_for(lock, std::chrono::milliseconds(max_wait_ms));
+				continue;
+			}
+
+			is_waiting = true;
+			lock.unlock();
+			const int num_ready = SDLNet_CheckSockets(socket_set, max_wait_ms);
+			lock.lock();
+			is_waiting = false;
+			++pass;
+			pass_done.notify_all();
+
+			if (num_ready <= 0)
+				continue;
+			for (const auto socket : receivers) {
+				// Skip the ones removed while waiting
+				if (std::find(sockets.begin(), sockets.end(), socket) ==
+				    sockets.end())
+					continue;
+				if (SDLNet_SocketReady(socket->mysock))
+					socket->ReceiveBlock(block);
+			}
+		}
+	}
+
+	bool RebuildSocketSet(const std::vector<TCPClientSocket *> &receivers)
+	{
+		if (socket_set)
+			SDLNet_FreeSocketSet(socket_set);
+		waited_on.clear();
+		socket_set = SDLNet_AllocSocketSet(static_cast<int>(receivers.size()));
+		if (!socket_set)
+			return false;
+		for (const auto socket : receivers)
+			SDLNet_TCP_AddSocket(socket_set, socket->mysock);
+		waited_on = receivers;
+		return true;
+	}
+
+	std::mutex mutex = {}; // guards everything but the stop flag
+	std::condition_variable wakeup = {};
+	std::condition_variable pass_done = {};
+	uint64_t pass = 0;       // counts the waits on the socket set
+	bool is_waiting = false; // on the socket set, without the mutex
+	std::vector<TCPClientSocket *> sockets = {};
+	std::vector<TCPClientSocket *> waited_on = {}; // in the socket set
+	SDLNet_SocketSet socket_set = nullptr;
+	std::atomic<bool> is_stopping = false;
+	std::thread thread = {};
+};
+
 #ifdef NATIVESOCKETS
 TCPClientSocket::TCPClientSocket(int platformsocket)
 {
@@ -570,6 +726,7 @@ TCPClientSocket::TCPClientSocket(int platformsocket)
 		if(!listensocketset) return;
 		SDLNet_TCP_AddSocket(listensocketset, mysock);
 		isopen=true;
+		StartReceiving();
 		return;
 	}
 	return;
@@ -588,6 +745,7 @@ TCPClientSocket::TCPClientSocket(TCPsocket source)
 		SDLNet_TCP_AddSocket(listensocketset, source);
 
 		isopen=true;
+		StartReceiving();
 	}
 }
 
@@ -606,11 +764,15 @@ TCPClientSocket::TCPClientSocket(const char *destination, uint16_t port)
 			return;
 		SDLNet_TCP_AddSocket(listensocketset, mysock);
 		isopen=true;
+		StartReceiving();
 	}
 }
 
 TCPClientSocket::~TCPClientSocket()
 {
+	if (is_receiving)
+		TcpReactor::Get().Remove(this);
+
 #ifdef NATIVESOCKETS
 	delete nativetcpstruct;
 #endif
@@ -640,38 +802,74 @@ bool TCPClientSocket::GetRemoteAddressString(char *buffer)
 
 bool TCPClientSocket::ReceiveArray(uint8_t *data, size_t &n)
 {
-	assertm(n <= static_cast<size_t>(std::numeric_limits<int>::max()),
-	        "SDL_net can't handle more bytes at a time.");
 	assert(data);
-	if (SDLNet_CheckSockets(listensocketset, 0)) {
-		const int result = SDLNet_TCP_Recv(mysock, data, static_cast<int>(n));
-		if(result < 1) {
-			isopen = false;
-			n = 0;
-			return false;
-		} else {
-			n = result;
-			return true;
-		}
-	} else {
-		n = 0;
+	// Check this first, so the data received before closing is kept
+	const bool was_closed = is_closed;
+	if (has_inbox) {
+		std::lock_guard<std::mutex> lock(inbox_mutex);
+		n = std::min(n, inbox.size());
+		std::copy_n(inbox.begin(), n, data);
+		inbox.erase(inbox.begin(), inbox.begin() + static_cast<ptrdiff_t>(n));
+		has_inbox = !inbox.empty();
 		return true;
 	}
+	n = 0;
+	if (was_closed) {
+		isopen = false;
+		return false;
+	}
+	return true;
 }
 
 SocketState TCPClientSocket::GetcharNonBlock(uint8_t &val)
 {
-	SocketState state = SocketState::Empty;
-	if(SDLNet_CheckSockets(listensocketset,0))
-	{
-		if (SDLNet_TCP_Recv(mysock, &val, 1) == 1)
-			state = SocketState::Good;
-		else {
-			isopen = false;
-			state = SocketState::Closed;
-		}
+	const bool was_closed = is_closed;
+	if (has_inbox) {
+		std::lock_guard<std::mutex> lock(inbox_mutex);
+		val = inbox.front();
+		inbox.pop_front();
+		has_inbox = !inbox.empty();
+		return SocketState::Good;
+	}
+	if (was_closed) {
+		isopen = false;
+		return SocketState::Closed;
+	}
+	return SocketState::Empty;
+}
+
+void TCPClientSocket::StartReceiving()
+{
+	assert(mysock);
+	TcpReactor::Get().Add(this);
+	is_receiving = true;
+}
+
+bool TCPClientSocket::CanReceive()
+{
+	// Stop reading while the emulation is this far behind, so TCP's flow
+	// control slows down the sender
+	constexpr size_t max_inbox_bytes = 64 * 1024;
+
+	if (is_closed)
+		return false;
+	if (!has_inbox)
+		return true;
+	std::lock_guard<std::mutex> lock(inbox_mutex);
+	return inbox.size() < max_inbox_bytes;
+}
+
+void TCPClientSocket::ReceiveBlock(std::vector<uint8_t> &block)
+{
+	const int result = SDLNet_TCP_Recv(mysock, block.data(),
+	                                   static_cast<int>(block.size()));
+	if (result < 1) {
+		is_closed = true;
+		return;
 	}
-	return state;
+	std::lock_guard<std::mutex> lock(inbox_mutex);
+	inbox.insert(inbox.end(), block.begin(), block.begin() + result);
+	has_inbox = true;
 }
 
 bool TCPClientSocket::Putchar(uint8_t val)
@@ -51,7 +51,11 @@
 // This is basically how TCP behaves anyway.
 //#define ENET_BLOCKING_CONNECT
 
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <queue>
+#include <thread>
 #ifndef ENET_BLOCKING_CONNECT
 #include <ctime>
 #endif
@@ -72,6 +76,14 @@ enum class SocketState {
 	Closed // didn't have data and socket is closed
 };
 
+// Measurements of a connection, as far as its protocol tracks them
+struct NetLinkStats {
+	uint32_t round_trip_ms = 0; // smoothed round trip time
+	uint32_t jitter_ms     = 0; // mean deviation of the round trip time
+	uint32_t packets_sent  = 0;
+	uint32_t packets_lost  = 0; // resent after going unacknowledged
+};
+
 // --- GENERIC NET INTERFACE -------------------------------------------------
 
 class NETClientSocket {
@@ -92,6 +104,12 @@ public:
 	virtual bool ReceiveArray(uint8_t *data, size_t &n) = 0;
 	virtual bool GetRemoteAddressString(char *buffer) = 0;
 
+	// Returns false if the protocol doesn't measure the connection
+	virtual bool GetLinkStats([[maybe_unused]] NetLinkStats &stats)
+	{
+		return false;
+	}
+
 	void FlushBuffer();
 	void SetSendBufferSize(size_t n);
 	bool SendByteBuffered(uint8_t val);
@@ -151,9 +169,13 @@ public:
 	bool SendArray(const uint8_t *data, size_t n);
 	bool ReceiveArray(uint8_t *data, size_t &n);
 	bool GetRemoteAddressString(char *buffer);
+	bool GetLinkStats(NetLinkStats &stats);
 
 private:
 	void updateState();
+	bool sendPacket(const uint8_t *data, size_t n);
+	void StartService();
+	void Service();
 
 #ifndef ENET_BLOCKING_CONNECT
 	int64_t              connectStart  = 0;
@@ -163,6 +185,16 @@ private:
 	ENetPeer            *peer          = nullptr;
 	ENetAddress          address       = {};
 	std::queue<uint8_t>  receiveBuffer = {};
+
+	// The service thread waits on the socket, so acknowledgements and
+	// received data don't wait for the emulation to poll. The mutex
+	// guards the host and peer, and the received bytes.
+	std::mutex           host_mutex    = {};
+	std::vector<uint8_t> inbox         = {};
+	std::atomic<bool>    has_inbox     = false;
+	std::atomic<bool>    is_closed     = false;
+	std::atomic<bool>    is_stopping   = false;
+	std::thread          service_thread = {};
 };
 
 // --- TCP NET INTERFACE -----------------------------------------------------
@@ -196,6 +228,11 @@ public:
 	bool GetRemoteAddressString(char *buffer);
 
 private:
+	friend class TcpReactor;
+
+	void StartReceiving();
+	bool CanReceive();
+	void ReceiveBlock(std::vector<uint8_t> &block);
 
 #ifdef NATIVESOCKETS
 	_TCPsocketX *nativetcpstruct = nullptr;
@@ -203,6 +240,15 @@ private:
 
 	TCPsocket mysock = nullptr;
 	SDLNet_SocketSet listensocketset = nullptr;
+
+	// The reactor thread waits on the socket and reads what arrives in
+	// blocks, so polling the socket is a check of the flag. The mutex
+	// guards the received bytes.
+	std::mutex inbox_mutex = {};
+	std::deque<uint8_t> inbox = {};
+	std::atomic<bool> has_inbox = false;
+	std::atomic<bool> is_closed = false;
+	bool is_receiving = false;
 };
 
 class TCPServerSocket : public NETServerSocket {
@@ -21,10 +21,16 @@
 
 #if C_MODEM
 
+#include <algorithm>
+
 #include "control.h"
+#include "pic.h"
 #include "serialport.h"
 #include "nullmodem.h"
 
+// How often the measurements of a connection are logged
+constexpr float link_stats_interval_ms = 60000.0f;
+
 CNullModem::CNullModem(const uint8_t port_idx, CommandLine *cmd)
         : CSerial(port_idx, cmd),
           telClient({})
@@ -72,8 +78,9 @@ CNullModem::CNullModem(const uint8_t port_idx, CommandLine *cmd)
 			rx_retry_max=50;
 		}
 	}
-	// txdelay: How many milliseconds to wait before sending data.
-	// This reduces network overhead quite a lot.
+	// txdelay: How many milliseconds to wait at most before sending data.
+	// This reduces network overhead quite a lot. The data goes out sooner
+	// when the application pauses sending, see txIdleGap().
 	if (getUintFromString("txdelay:", tx_gather, cmd)) {
 		if (!(tx_gather<=500)) {
 			tx_gather=12;
@@ -162,17 +169,48 @@ CNullModem::~CNullModem() {
 	}
 }
 
+// Applications send a message as a burst of back-to-back bytes, so a pause
+// of a few byte times means the message is complete and can be sent without
+// waiting out the rest of the txdelay.
+static double txIdleGap(const float bytetime)
+{
+	constexpr double min_gap_ms = 1.0;
+	return std::max(3.0 * bytetime, min_gap_ms);
+}
+
 void CNullModem::WriteChar(uint8_t data)
 {
 	if (clientsocket)
 		clientsocket->SendByteBuffered(data);
+	tx_last_write = PIC_FullIndex();
 	if (!tx_block) {
 		// LOG_MSG("SERIAL: Port %" PRIu8 " setevreduct", GetPortNumber());
-		setEvent(SERIAL_TX_REDUCTION, (float)tx_gather);
+		tx_first_write = tx_last_write;
+		setEvent(SERIAL_TX_REDUCTION,
+		         static_cast<float>(std::min(txIdleGap(bytetime),
+		                                     static_cast<double>(tx_gather))));
 		tx_block=true;
 	}
 }
 
+void CNullModem::StartLinkStats()
+{
+	NetLinkStats stats;
+	if (clientsocket && clientsocket->GetLinkStats(stats))
+		setEvent(SERIAL_NULLMODEM_STATS_EVENT, link_stats_interval_ms);
+}
+
+void CNullModem::LogLinkStats()
+{
+	NetLinkStats stats;
+	if (!clientsocket || !clientsocket->GetLinkStats(stats))
+		return;
+	LOG_MSG("SERIAL: Port %" PRIu8 " round trip %" PRIu32 " ms, jitter %" PRIu32
+	        " ms, %" PRIu32 " of %" PRIu32 " packets resent",
+	        GetPortNumber(), stats.round_trip_ms, stats.jitter_ms,
+	        stats.packets_lost, stats.packets_sent);
+}
+
 SocketState CNullModem::readChar(uint8_t &val)
 {
 	SocketState state = clientsocket->GetcharNonBlock(val);
@@ -216,6 +254,7 @@ bool CNullModem::ClientConnect(NETClientSocket *newsocket)
 	rx_state=N_RX_IDLE;
 	LOG_MSG("SERIAL: Port %" PRIu8 " connected to %s.", GetPortNumber(), peernamebuf);
 	setEvent(SERIAL_POLLING_EVENT, 1);
+	StartLinkStats();
 	setCD(true);
 	return true;
 }
@@ -249,7 +288,8 @@ bool CNullModem::ServerConnect() {
 	clientsocket->SetSendBufferSize(256);
 	rx_state=N_RX_IDLE;
 	setEvent(SERIAL_POLLING_EVENT, 1);
-	
+	StartLinkStats();
+
 	// we don't accept further connections
 	delete serversocket;
 	serversocket=0;
@@ -263,8 +303,10 @@ bool CNullModem::ServerConnect() {
 void CNullModem::Disconnect() {
 	removeEvent(SERIAL_POLLING_EVENT);
 	removeEvent(SERIAL_RX_EVENT);
+	removeEvent(SERIAL_NULLMODEM_STATS_EVENT);
 	// it was disconnected; free the socket and restart the server socket
 	LOG_MSG("SERIAL: Port %" PRIu8 " disconnected.", GetPortNumber());
+	LogLinkStats();
 	delete clientsocket;
 	clientsocket=0;
 	setDSR(false);
@@ -419,10 +461,24 @@ void CNullModem::handleUpperEvent(uint16_t type)
 			break;
 		}
 		case SERIAL_TX_REDUCTION: {
-			// Flush the data in the transmitting buffer.
+			// Flush the data in the transmitting buffer once the
+			// application pauses or the txdelay is up.
+			const auto now = PIC_FullIndex();
+			const auto send_by = std::min(tx_last_write + txIdleGap(bytetime),
+			                              tx_first_write + tx_gather);
+			if (now < send_by) {
+				setEvent(SERIAL_TX_REDUCTION,
+				         static_cast<float>(send_by - now));
+				break;
+			}
 			if (clientsocket) clientsocket->FlushBuffer();
 			tx_block=false;
-			break;						  
+			break;
+		}
+		case SERIAL_NULLMODEM_STATS_EVENT: {
+			LogLinkStats();
+			setEvent(SERIAL_NULLMODEM_STATS_EVENT, link_stats_interval_ms);
+			break;
 		}
 		case SERIAL_NULLMODEM_DTR_EVENT: {
 			if ((!DTR_delta) && getDTR()) {
@@ -31,7 +31,8 @@
 #define SERIAL_SERVER_POLLING_EVENT	SERIAL_BASE_EVENT_COUNT+1
 #define SERIAL_TX_REDUCTION		SERIAL_BASE_EVENT_COUNT+2
 #define SERIAL_NULLMODEM_DTR_EVENT	SERIAL_BASE_EVENT_COUNT+3
-#define SERIAL_NULLMODEM_EVENT_COUNT	SERIAL_BASE_EVENT_COUNT+3
+#define SERIAL_NULLMODEM_STATS_EVENT	SERIAL_BASE_EVENT_COUNT+4
+#define SERIAL_NULLMODEM_EVENT_COUNT	SERIAL_BASE_EVENT_COUNT+4
 
 class CNullModem final : public CSerial {
 public:
@@ -76,6 +77,8 @@ private:
     void Disconnect();
     SocketState readChar(uint8_t &val);
     void WriteChar(uint8_t data);
+	void StartLinkStats();
+	void LogLinkStats();
 
 	bool DTR_delta = false; // with dtrrespect, we try to establish a
 	                        // connection whenever DTR switches to 1. This
@@ -90,7 +93,10 @@ private:
 	                           // causing a overrun error.
 
 	uint32_t tx_gather = 0; // how long to gather tx data before
-	                        // sending all of them [milliseconds]
+	                        // sending all of them at most [milliseconds]
+
+	double tx_first_write = 0.0; // when the gathered tx data started and
+	double tx_last_write = 0.0;  // was last added to [PIC milliseconds]
 
 	bool dtrrespect = false; // dtr behavior - only send data to the serial
 	                         // port when DTR is on
@@ -20,11 +20,13 @@
 
 #if C_MODEM
 
+#include <algorithm>
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <utility>
 #include <fstream>
+#include <map>
 #include <sstream>
 
 #include "string_utils.h"
@@ -111,6 +113,26 @@ static const char *MODEM_GetAddressFromPhone(const char *input) {
 	return nullptr;
 }
 
+// Modems listening on the same TCP port share the listener, so one instance
+// can host several lines of a BBS behind one port. An incoming call goes to
+// the first idle modem that checks for calls.
+static std::shared_ptr<NETServerSocket> MODEM_GetListener(const SocketTypesE socket_type,
+                                                          const uint16_t port)
+{
+	// ENet listeners turn into the connection they accept
+	if (socket_type != SOCKET_TYPE_TCP)
+		return std::shared_ptr<NETServerSocket>(
+		        NETServerSocket::NETServerFactory(socket_type, port));
+
+	static std::map<uint16_t, std::weak_ptr<NETServerSocket>> listeners = {};
+	auto listener = listeners[port].lock();
+	if (!listener) {
+		listener.reset(NETServerSocket::NETServerFactory(socket_type, port));
+		listeners[port] = listener;
+	}
+	return listener;
+}
+
 CSerialModem::CSerialModem(const uint8_t port_idx, CommandLine *cmd)
         : CSerial(port_idx, cmd),
           rqueue(std::make_unique<CFifo>(MODEM_BUFFER_QUEUE_SIZE)),
@@ -166,6 +188,19 @@ CSerialModem::CSerialModem(const uint8_t port_idx, CommandLine *cmd)
 	LOG_MSG("SERIAL: Port %" PRIu8 " will report baud rate %d",
 			GetPortNumber(), val);
 
+	// linerate: How many bits per second move between the modem and the
+	// UART, regardless of the rate the UART is programmed for. By default
+	// the UART's rate is used.
+	constexpr auto min_linerate = 300u;
+	constexpr auto max_linerate = 921600u;
+	if (getUintFromString("linerate:", val, cmd)) {
+		val = clamp(val, min_linerate, max_linerate);
+		// A start bit, 8 data bits, and a stop bit per byte
+		line_bytetime = 10 * 1000.0f / static_cast<float>(val);
+		LOG_MSG("SERIAL: Port %" PRIu8 " modem line rate is %u bps",
+		        GetPortNumber(), val);
+	}
+
 	InstallationSuccessful=true;
 }
 
@@ -176,19 +211,32 @@ CSerialModem::~CSerialModem() {
 		removeEvent(i);
 }
 
+float CSerialModem::LineByteTime() const
+{
+	return line_bytetime > 0.0f ? line_bytetime : bytetime;
+}
+
 void CSerialModem::handleUpperEvent(uint16_t type)
 {
 	switch (type) {
 	case SERIAL_RX_EVENT: {
+		// Hand over as many bytes as the line carries in this long, so
+		// fast line rates don't take an event per byte
+		constexpr float min_rx_interval_ms = 0.1f;
+		const auto byte_time = LineByteTime();
+		const auto burst = std::max(1, static_cast<int>(min_rx_interval_ms /
+		                                                byte_time));
+
 		// check for bytes to be sent to port
-		if (CSerial::CanReceiveByte())
-			if (rqueue->inuse() && (CSerial::getRTS() || (flowcontrol != 3))) {
-				uint8_t rbyte = rqueue->getb();
-				// LOG_MSG("SERIAL: Port %" PRIu8 " modem sending byte %2x"
-				//         " back to UART3", GetPortNumber(), rbyte);
-				CSerial::receiveByte(rbyte);
-			}
-		if(CSerial::CanReceiveByte()) setEvent(SERIAL_RX_EVENT, bytetime*0.98f);
+		for (int i = 0; i < burst && CSerial::CanReceiveByte(); ++i) {
+			if (!rqueue->inuse() || !(CSerial::getRTS() || (flowcontrol != 3)))
+				break;
+			uint8_t rbyte = rqueue->getb();
+			// LOG_MSG("SERIAL: Port %" PRIu8 " modem sending byte %2x"
+			//         " back to UART3", GetPortNumber(), rbyte);
+			CSerial::receiveByte(rbyte);
+		}
+		if(CSerial::CanReceiveByte()) setEvent(SERIAL_RX_EVENT, burst*byte_time*0.98f);
 		break;
 	}
 	case MODEM_TX_EVENT: {
@@ -383,23 +431,22 @@ void CSerialModem::EnterIdleState(){
 	clientsocket.reset(nullptr);
 	waitingclientsocket.reset(nullptr);
 
-	// get rid of everything
-	if (serversocket) {
+	// get rid of everything, unless other modems wait for those calls
+	if (serversocket && serversocket.use_count() == 1) {
 		waitingclientsocket.reset(serversocket->Accept());
 		while (waitingclientsocket) {
 			waitingclientsocket.reset(serversocket->Accept());
 		}
 	}
 	if (listenport) {
-		serversocket.reset(nullptr);
-		serversocket.reset(NETServerSocket::NETServerFactory(socketType,
-		                                                     listenport));
+		serversocket.reset();
+		serversocket = MODEM_GetListener(socketType, listenport);
 		if (!serversocket->isopen) {
 			LOG_MSG("SERIAL: Port %" PRIu8 " modem could not open port "
 			        "%" PRIu16 ".",
 			        GetPortNumber(), listenport);
 
-			serversocket.reset(nullptr);
+			serversocket.reset();
 		} else
 			LOG_MSG("SERIAL: Port %" PRIu8 " modem listening on port "
 			        "%" PRIu16 " ...",
@@ -417,7 +464,7 @@ void CSerialModem::EnterIdleState(){
 
 void CSerialModem::EnterConnectedState() {
 	// we don't accept further calls
-	serversocket.reset(nullptr);
+	serversocket.reset();
 	SendRes(ResCONNECT);
 	commandmode = false;
 	telClient = {}; // reset values
@@ -951,10 +998,9 @@ void CSerialModem::Timer2()
 			EnterIdleState();
 		}
 	}
-	// Handle incoming to the serial port
+	// Handle incoming to the serial port, as much as fits
 	if (!commandmode && clientsocket && rqueue->left()) {
-		size_t usesize = rqueue->left() >= 16 ? 16 : rqueue->left();
-		// size_t usesize = 1;
+		size_t usesize = rqueue->left();
 		if (!clientsocket->ReceiveArray(tmpbuf, usesize)) {
 			SendRes(ResNOCARRIER);
 			LOG_INFO("SERIAL: No carrier on receive");
@@ -1058,7 +1104,7 @@ void CSerialModem::RXBufferEmpty() {
 void CSerialModem::transmitByte(uint8_t val, bool first)
 {
 	waiting_tx_character = val;
-	setEvent(MODEM_TX_EVENT, bytetime); // TX event
+	setEvent(MODEM_TX_EVENT, LineByteTime()); // TX event
 	if (first)
 		ByteTransmitting();
 	// LOG_MSG("SERIAL: Port %" PRIu8 " modem byte %x '%c' to be
@@ -200,6 +200,7 @@ public:
 	void Echo(uint8_t ch);
 	void Timer2();
 	void handleUpperEvent(uint16_t type);
+	float LineByteTime() const;
 
 	void RXBufferEmpty();
 
@@ -244,10 +245,11 @@ protected:
 	uint32_t dtrmode = 0;
 	int32_t dtrofftimer = 0;
 	uint8_t tmpbuf[MODEM_BUFFER_QUEUE_SIZE] = {0};
+	float line_bytetime = 0.0f; // from the linerate, 0 to follow the UART
 	uint16_t listenport = 23; // 23 is the default telnet TCP/IP port
 	uint8_t reg[SREGS] = {0};
 	SocketTypesE socketType = SOCKET_TYPE_TCP;
-	std::unique_ptr<NETServerSocket> serversocket = nullptr;
+	std::shared_ptr<NETServerSocket> serversocket = nullptr;
 	std::unique_ptr<NETClientSocket> clientsocket = nullptr;
 	std::unique_ptr<NETClientSocket> waitingclientsocket = nullptr;
 
@@ -0,0 +1,413 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+#include "callback.h"
+#include "dos_inc.h"
+#include "mapper.h"
+#include "mem.h"
+#include "regs.h"
+#include "setup.h"
+
+bool snapshot_requested = false;
+
+constexpr char snapshot_magic[8] = {'D', 'B', 'S', 'N', 'A', 'P', '0', '1'};
+
+struct SnapshotComponent {
+	std::string name = {};
+	SnapshotHandler handler = nullptr;
+};
+
+// The shell command a snapshot belongs to, and how deeply the emulation
+// loop was nested when the shell started it
+struct SnapshotContext {
+	std::string command = {};
+	int32_t depth = 0;
+	int32_t machine = 0;
+	uint32_t memory_pages = 0;
+
+	bool operator==(const SnapshotContext &other) const
+	{
+		return command == other.command && depth == other.depth &&
+		       machine == other.machine &&
+		       memory_pages == other.memory_pages;
+	}
+};
+
+static struct {
+	std::string path = {};
+	bool shared_memory = false;
+	std::vector<SnapshotComponent> components = {};
+	std::vector<SnapshotContext> running = {}; // programs started by shells
+
+	// a snapshot read when the shell starts its first program, waiting for
+	// its command to run
+	bool resume_checked = false;
+	bool resume_pending = false;
+	SnapshotContext resume_context = {};
+	std::vector<std::pair<std::string, std::vector<uint8_t>>> resume_data = {};
+} snapshot;
+
+void SnapshotStream::Bytes(void *region, const size_t size)
+{
+	if (!is_loading) {
+		const auto bytes = static_cast<const uint8_t *>(region);
+		data.insert(data.end(), bytes, bytes + size);
+		return;
+	}
+	if (failed || size > data.size() - pos) {
+		failed = true;
+		return;
+	}
+	memcpy(region, data.data() + pos, size);
+	pos += size;
+}
+
+void SNAPSHOT_AddComponent(const char *name, SnapshotHandler handler)
+{
+	for (auto &component : snapshot.components) {
+		if (component.name == name) {
+			component.handler = handler;
+			return;
+		}
+	}
+	snapshot.components.push_back({name, handler});
+}
+
+static SnapshotContext current_context(const std::string &command)
+{
+	SnapshotContext context;
+	context.command = command;
+	context.depth = DOSBOX_GetRunDepth();
+	context.machine = static_cast<int32_t>(machine);
+	context.memory_pages = check_cast<uint32_t>(MEM_TotalPages());
+	return context;
+}
+
+static void put_string(std::vector<uint8_t> &out, const std::string &str)
+{
+	const auto size = check_cast<uint32_t>(str.size());
+	out.insert(out.end(), reinterpret_cast<const uint8_t *>(&size),
+	           reinterpret_cast<const uint8_t *>(&size) + sizeof(size));
+	out.insert(out.end(), str.begin(), str.end());
+}
+
+template <typename T>
+static void put_value(std::vector<uint8_t> &out, const T value)
+{
+	const auto bytes = reinterpret_cast<const uint8_t *>(&value);
+	out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+// Reads the pieces written by put_value and put_string
+class SnapshotParser {
+public:
+	explicit SnapshotParser(const std::vector<uint8_t> &source) : data(source)
+	{}
+
+	template <typename T>
+	bool Value(T &value)
+	{
+		if (sizeof(value) > data.size() - pos)
+			return false;
+		memcpy(&value, data.data() + pos, sizeof(value));
+		pos += sizeof(value);
+		return true;
+	}
+
+	bool Bytes(std::vector<uint8_t> &bytes, const uint64_t size)
+	{
+		if (size > data.size() - pos)
+			return false;
+		const auto start = data.begin() + static_cast<ptrdiff_t>(pos);
+		bytes.assign(start, start + static_cast<ptrdiff_t>(size));
+		pos += static_cast<size_t>(size);
+		return true;
+	}
+
+	bool String(std::string &str)
+	{
+		uint32_t size = 0;
+		std::vector<uint8_t> bytes = {};
+		if (!Value(size) || !Bytes(bytes, size))
+			return false;
+		str.assign(bytes.begin(), bytes.end());
+		return true;
+	}
+
+	bool AtEnd() const
+	{
+		return pos == data.size();
+	}
+
+private:
+	const std::vector<uint8_t> &data;
+	size_t pos = 0;
+};
+
+// Open files live in host objects that can't be saved, only the devices
+// every program inherits are the same in every session
+static bool has_open_files()
+{
+	for (const auto file : Files) {
+		if (file && !(file->GetInformation() & 0x8000))
+			return true;
+	}
+	return false;
+}
+
+static void save_snapshot(const SnapshotContext &context)
+{
+	std::vector<uint8_t> payload = {};
+	put_string(payload, context.command);
+	put_value(payload, context.depth);
+	put_value(payload, context.machine);
+	put_value(payload, context.memory_pages);
+	put_value(payload, check_cast<uint32_t>(snapshot.components.size()));
+	for (const auto &component : snapshot.components) {
+		SnapshotStream stream;
+		component.handler(stream);
+		if (stream.Failed()) {
+			LOG_WARNING("SNAPSHOT: Failed saving the state of '%s'",
+			            component.name.c_str());
+			return;
+		}
+		put_string(payload, component.name);
+		put_value(payload, static_cast<uint64_t>(stream.data.size()));
+		payload.insert(payload.end(), stream.data.begin(), stream.data.end());
+	}
+
+	auto compressed_size = compressBound(static_cast<uLong>(payload.size()));
+	std::vector<uint8_t> compressed(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, payload.data(),
+	              static_cast<uLong>(payload.size()), Z_BEST_SPEED) != Z_OK) {
+		LOG_WARNING("SNAPSHOT: Failed to compress the machine state");
+		return;
+	}
+
+	FILE *f = fopen(snapshot.path.c_str(), "wb");
+	if (!f) {
+		LOG_WARNING("SNAPSHOT: Can't write fast boot snapshot '%s'",
+		            snapshot.path.c_str());
+		return;
+	}
+	fwrite(snapshot_magic, sizeof(snapshot_magic), 1, f);
+	const auto payload_size = static_cast<uint64_t>(payload.size());
+	fwrite(&payload_size, sizeof(payload_size), 1, f);
+	fwrite(compressed.data(), compressed_size, 1, f);
+	const bool ok = !ferror(f);
+	fclose(f);
+	if (!ok) {
+		LOG_WARNING("SNAPSHOT: Failed writing fast boot snapshot '%s'",
+		            snapshot.path.c_str());
+		return;
+	}
+	LOG_MSG("SNAPSHOT: Saved the machine running '%s' to '%s' (%u KiB)",
+	        context.command.c_str(),
+	        snapshot.path.c_str(),
+	        static_cast<unsigned>(compressed_size / 1024));
+}
+
+// Reads and checks the whole snapshot, so a damaged file is rejected before
+// any state is replaced
+static bool read_snapshot()
+{
+	FILE *f = fopen(snapshot.path.c_str(), "rb");
+	if (!f)
+		return false;
+	char magic[sizeof(snapshot_magic)] = {};
+	uint64_t payload_size = 0;
+	std::vector<uint8_t> compressed = {};
+	bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+	          memcmp(magic, snapshot_magic, sizeof(magic)) == 0 &&
+	          fread(&payload_size, sizeof(payload_size), 1, f) == 1 &&
+	          payload_size <= UINT32_MAX;
+	if (ok) {
+		uint8_t buffer[64 * 1024];
+		size_t n = 0;
+		while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+			compressed.insert(compressed.end(), buffer, buffer + n);
+		ok = !ferror(f);
+	}
+	fclose(f);
+
+	std::vector<uint8_t> payload(static_cast<size_t>(ok ? payload_size : 0));
+	if (ok) {
+		auto size = static_cast<uLongf>(payload.size());
+		ok = uncompress(payload.data(), &size, compressed.data(),
+		                static_cast<uLong>(compressed.size())) == Z_OK &&
+		     size == payload.size();
+	}
+
+	SnapshotParser parser(payload);
+	auto &context = snapshot.resume_context;
+	uint32_t count = 0;
+	ok = ok && parser.String(context.command) && parser.Value(context.depth) &&
+	     parser.Value(context.machine) && parser.Value(context.memory_pages) &&
+	     parser.Value(count) && count == snapshot.components.size();
+	snapshot.resume_data.clear();
+	for (uint32_t i = 0; ok && i < count; ++i) {
+		std::string name = {};
+		uint64_t size = 0;
+		std::vector<uint8_t> data = {};
+		ok = parser.String(name) && name == snapshot.components[i].name &&
+		     parser.Value(size) && parser.Bytes(data, size);
+		snapshot.resume_data.emplace_back(std::move(name), std::move(data));
+	}
+	if (!ok || !parser.AtEnd()) {
+		LOG_WARNING("SNAPSHOT: Ignoring '%s', it's damaged or from a different version",
+		            snapshot.path.c_str());
+		snapshot.resume_data.clear();
+		return false;
+	}
+	return true;
+}
+
+static void restore_snapshot()
+{
+	for (size_t i = 0; i < snapshot.components.size(); ++i) {
+		SnapshotStream stream(std::move(snapshot.resume_data[i].second));
+		snapshot.components[i].handler(stream);
+		if (stream.Failed())
+			E_Exit("SNAPSHOT: Machine state of '%s' doesn't match this configuration",
+			       snapshot.components[i].name.c_str());
+	}
+	snapshot.resume_data.clear();
+	LOG_MSG("SNAPSHOT: Resumed '%s' from '%s'",
+	        snapshot.resume_context.command.c_str(),
+	        snapshot.path.c_str());
+}
+
+void SNAPSHOT_ExecuteProgram(const std::string &command)
+{
+	// all modules have registered their components by now
+	if (!snapshot.resume_checked) {
+		snapshot.resume_checked = true;
+		snapshot.resume_pending = !snapshot.path.empty() && read_snapshot();
+	}
+
+	const auto context = current_context(command);
+	snapshot.running.push_back(context);
+
+	if (snapshot.resume_pending && context == snapshot.resume_context) {
+		snapshot.resume_pending = false;
+		// like CALLBACK_RunRealInt, but the program is already running
+		const auto old_eip = reg_eip;
+		const auto old_cs = SegValue(cs);
+		restore_snapshot();
+		DOSBOX_RunMachine();
+		reg_eip = old_eip;
+		SegSet16(cs, old_cs);
+	} else {
+		CALLBACK_RunRealInt(0x21);
+	}
+	snapshot.running.pop_back();
+}
+
+void SNAPSHOT_ServiceRequest()
+{
+	if (snapshot.running.empty()) {
+		LOG_WARNING("SNAPSHOT: Snapshots can only be saved while a program started by the shell runs");
+		snapshot_requested = false;
+		return;
+	}
+	// wait until the emulation is back in the program's own loop
+	const auto &context = snapshot.running.back();
+	if (DOSBOX_GetRunDepth() != context.depth + 1)
+		return;
+
+	snapshot_requested = false;
+	if (has_open_files()) {
+		LOG_WARNING("SNAPSHOT: Can't save while the program has files open, try again later");
+		return;
+	}
+	save_snapshot(context);
+}
+
+bool SNAPSHOT_CanCapture()
+{
+	return !snapshot.running.empty() &&
+	       DOSBOX_GetRunDepth() == snapshot.running.back().depth + 1;
+}
+
+bool SNAPSHOT_CaptureState(std::vector<uint8_t> &data)
+{
+	data.clear();
+	for (const auto &component : snapshot.components) {
+		SnapshotStream stream;
+		stream.ExcludeRam();
+		component.handler(stream);
+		if (stream.Failed())
+			return false;
+		put_value(data, static_cast<uint64_t>(stream.data.size()));
+		data.insert(data.end(), stream.data.begin(), stream.data.end());
+	}
+	return true;
+}
+
+void SNAPSHOT_RestoreState(const std::vector<uint8_t> &data)
+{
+	SnapshotParser parser(data);
+	for (const auto &component : snapshot.components) {
+		uint64_t size = 0;
+		std::vector<uint8_t> bytes = {};
+		if (!parser.Value(size) || !parser.Bytes(bytes, size))
+			E_Exit("SNAPSHOT: Machine state of '%s' is missing",
+			       component.name.c_str());
+		SnapshotStream stream(std::move(bytes));
+		stream.ExcludeRam();
+		component.handler(stream);
+		if (stream.Failed())
+			E_Exit("SNAPSHOT: Machine state of '%s' doesn't match this configuration",
+			       component.name.c_str());
+	}
+}
+
+std::string SNAPSHOT_SharedMemoryPath()
+{
+	if (!snapshot.shared_memory || snapshot.path.empty())
+		return {};
+	return snapshot.path + ".ram";
+}
+
+static void request_snapshot(const bool pressed)
+{
+	if (!pressed)
+		return;
+	if (snapshot.path.empty()) {
+		LOG_WARNING("SNAPSHOT: Set 'fast_boot_snapshot' in the [dosbox] section to save snapshots");
+		return;
+	}
+	snapshot_requested = true;
+}
+
+void SNAPSHOT_Init(Section *sec)
+{
+	const auto section = static_cast<Section_prop *>(sec);
+	snapshot.path = section->Get_path("fast_boot_snapshot")->realpath;
+	snapshot.shared_memory = section->Get_bool("fast_boot_shared_memory");
+	MAPPER_AddHandler(request_snapshot, SDL_SCANCODE_UNKNOWN, 0, "snapshot",
+	                  "Save Snapshot");
+}
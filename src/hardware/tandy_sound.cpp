@@ -79,7 +79,7 @@ centerline.
 
 #include <algorithm>
 #include <array>
-#include <queue>
+#include <cmath>
 #include <string_view>
 
 #include "dma.h"
@@ -165,25 +165,30 @@ private:
 	TandyPSG &operator=(const TandyPSG &) = delete;
 
 	void AudioCallback(uint16_t requested_frames);
-	bool MaybeRenderFrame(float &frame);
-	void RenderUpToNow();
+	void RenderSamples(int num_samples);
+	void ApplyWrite(io_port_t port, uint8_t data);
 	void WriteToPort(io_port_t, io_val_t value, io_width_t);
 
 	// Managed objects
 	mixer_channel_t channel                                  = nullptr;
 	IO_WriteHandleObject write_handlers[2]                   = {};
 	std::unique_ptr<sn76496_base_device> device              = {};
+	std::unique_ptr<DecimatingFir> decimator                 = {};
 	std::unique_ptr<reSIDfp::TwoPassSincResampler> resampler = {};
-	std::queue<float> fifo                                   = {};
+	DeviceWriteQueue writes                                  = {};
+	std::vector<float> render_frames                         = {};
+	std::vector<int16_t> render_samples                      = {};
 
 	// Static rate-related configuration
 	static constexpr auto render_divisor = 16;
 	static constexpr auto render_rate_hz = ceil_sdivide(tandy_psg_clock_hz,
 	                                                    render_divisor);
 	static constexpr auto ms_per_render  = millis_in_second / render_rate_hz;
+	static constexpr auto decimation_factor = 4;
 
 	// Runtime states
 	device_sound_interface *dsi       = nullptr;
+	double samples_per_frame          = 0.0;
 	double last_rendered_ms           = 0.0;
 };
 
@@ -436,6 +441,7 @@ TandyPSG::TandyPSG(const ConfigProfile config_profile,
 	                           {ChannelFeature::Sleep,
 	                            ChannelFeature::ReverbSend,
 	                            ChannelFeature::ChorusSend,
+	                            ChannelFeature::ParallelRender,
 	                            ChannelFeature::Synthesizer});
 
 	// Setup filters
@@ -451,12 +457,19 @@ TandyPSG::TandyPSG(const ConfigProfile config_profile,
 		channel->SetLowPassFilter(FilterState::Off);
 	}
 
-	// Setup the resampler
+	// Decimate the render rate first, then resample to the mixer's rate;
+	// the resampler's cost grows with its input rate
 	const auto sample_rate = channel->GetSampleRate();
-	const auto max_freq    = std::max(sample_rate * 0.9 / 2, 8000.0);
-	resampler.reset(reSIDfp::TwoPassSincResampler::create(render_rate_hz,
+	constexpr auto decimated_rate_hz = static_cast<double>(render_rate_hz) /
+	                                   decimation_factor;
+	const auto max_freq = std::clamp(sample_rate * 0.9 / 2,
+	                                 8000.0,
+	                                 decimated_rate_hz * 0.9 / 2);
+	decimator = std::make_unique<DecimatingFir>(decimation_factor);
+	resampler.reset(reSIDfp::TwoPassSincResampler::create(decimated_rate_hz,
 	                                                      sample_rate,
 	                                                      max_freq));
+	samples_per_frame = static_cast<double>(render_rate_hz) / sample_rate;
 
 	// Configure and start the MAME device
 	dsi = static_cast<device_sound_interface *>(device.get());
@@ -470,75 +483,83 @@ TandyPSG::TandyPSG(const ConfigProfile config_profile,
 	                       : "but no DAC, because a Sound Blaster is present");
 }
 
-bool TandyPSG::MaybeRenderFrame(float &frame)
+// Renders a run of samples at the PSG's native rate and adds the frames they
+// make up once decimated and resampled
+void TandyPSG::RenderSamples(const int num_samples)
 {
 	assert(dsi);
+	assert(decimator);
 	assert(resampler);
+	assert(num_samples > 0);
 
-	// Request a frame from the audio device
-	static int16_t sample;
-	static int16_t *buf[] = {&sample, nullptr};
-	static device_sound_interface::sound_stream ss;
-	dsi->sound_stream_update(ss, nullptr, buf, 1);
-
-	const auto frame_is_ready = resampler->input(sample);
+	const auto n = static_cast<size_t>(num_samples);
+	if (render_samples.size() < n)
+		render_samples.resize(n);
 
-	// Get the frame
-	if (frame_is_ready)
-		frame = static_cast<float>(resampler->output());
+	static device_sound_interface::sound_stream ss;
+	int16_t *buf[] = {render_samples.data(), nullptr};
+	dsi->sound_stream_update(ss, nullptr, buf, num_samples);
+
+	for (size_t i = 0; i < n; ++i) {
+		if (!decimator->Input(render_samples[i]))
+			continue;
+		const auto sample = static_cast<int>(std::lround(decimator->Output()));
+		if (resampler->input(sample))
+			render_frames.push_back(static_cast<float>(resampler->output()));
+	}
+	last_rendered_ms += num_samples * ms_per_render;
+}
 
-	return frame_is_ready;
+void TandyPSG::ApplyWrite(io_port_t, const uint8_t data)
+{
+	device->write(data);
 }
 
-void TandyPSG::RenderUpToNow()
+void TandyPSG::WriteToPort(io_port_t port, io_val_t value, io_width_t)
 {
 	const auto now = PIC_FullIndex();
 
-	// Wake up the channel and update the last rendered time datum.
+	// Wake up the channel and restart the render clock from now
 	assert(channel);
-	if (channel->WakeUp()) {
+	if (channel->WakeUp())
 		last_rendered_ms = now;
-		return;
-	}
-	// Keep rendering until we're current
-	while (last_rendered_ms < now) {
-		last_rendered_ms += ms_per_render;
-		if (float frame = 0.0f; MaybeRenderFrame(frame))
-			fifo.emplace(frame);
-	}
-}
-
-void TandyPSG::WriteToPort(io_port_t, io_val_t value, io_width_t)
-{
-	RenderUpToNow();
 
-	const auto data = check_cast<uint8_t>(value);
-	device->write(data);
+	writes.Enqueue(now, port, check_cast<uint8_t>(value), [this](auto p, auto v) {
+		ApplyWrite(p, v);
+	});
 }
 
 void TandyPSG::AudioCallback(const uint16_t requested_frames)
 {
 	assert(channel);
 
-	//if (fifo.size())
-	//	LOG_MSG("TANDY: Queued %2lu cycle-accurate frames", fifo.size());
+	const auto apply_write = [this](auto p, auto v) { ApplyWrite(p, v); };
 
-	auto frames_remaining = requested_frames;
+	// Render the PSG in runs until it has produced the requested frames,
+	// ending each run at the next queued write so the write lands on the
+	// same sample as when rendering one sample at a time. Frames rendered
+	// beyond the request are kept for next time.
+	while (render_frames.size() < requested_frames) {
+		writes.ApplyUpTo(last_rendered_ms, apply_write);
 
-	// First, send any frames we've queued since the last callback
-	while (frames_remaining && fifo.size()) {
-		channel->AddSamples_mfloat(1, &fifo.front());
-		fifo.pop();
-		--frames_remaining;
-	}
-	// If the queue's run dry, render the remainder and sync-up our time datum
-	while (frames_remaining) {
-		if (float frame = 0.0f; MaybeRenderFrame(frame)) {
-			channel->AddSamples_mfloat(1, &frame);
+		const auto frames_needed = requested_frames - render_frames.size();
+		auto samples = static_cast<int>(
+		        std::ceil(static_cast<double>(frames_needed) * samples_per_frame));
+
+		if (double next_write_ms = 0.0; writes.GetNextTimestamp(next_write_ms)) {
+			const auto samples_to_write = static_cast<int>(
+			        std::ceil((next_write_ms - last_rendered_ms) / ms_per_render));
+			samples = std::min(samples, samples_to_write);
 		}
-		--frames_remaining;
+		RenderSamples(std::max(samples, 1));
 	}
+	channel->AddSamples_mfloat(requested_frames, render_frames.data());
+	render_frames.erase(render_frames.begin(),
+	                    render_frames.begin() + requested_frames);
+
+	// Catch up with any writes left and sync-up our time datum
 	last_rendered_ms = PIC_FullIndex();
+	writes.ApplyUpTo(last_rendered_ms, apply_write);
 }
 
 // The Tandy DAC and PSG (programmable sound generator) managed pointers
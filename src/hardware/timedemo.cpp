@@ -0,0 +1,185 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include "timedemo.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "control.h"
+#include "cpu.h"
+#include "cycle_telemetry.h"
+#include "mixer.h"
+#include "pic.h"
+#include "programs.h"
+#include "setup.h"
+#include "timer.h"
+#include "video.h"
+
+constexpr int default_frames = 1000;
+
+static struct {
+	bool active = false;
+	bool started = false;
+	bool finished = false;
+	std::string program = {};
+	int frames_wanted = default_frames;
+	int frames = 0;
+
+	// Taken at the first frame, which the measurement starts from
+	int64_t start_us = 0;
+	uint32_t start_tick = 0;
+	int64_t start_frames_mixed = 0;
+} timedemo = {};
+
+bool TIMEDEMO_ParseCommandLine(CommandLine &cmdline)
+{
+	if (!cmdline.FindExist("--benchmark", true) &&
+	    !cmdline.FindExist("-benchmark", true))
+		return false;
+
+	int frames = default_frames;
+	if (cmdline.FindInt("--frames", frames, true) ||
+	    cmdline.FindInt("-frames", frames, true))
+		timedemo.frames_wanted = std::max(frames, 1);
+
+	// The program stays on the command line, to be started as usual
+	(void)cmdline.FindCommand(1, timedemo.program);
+	timedemo.active = true;
+	return true;
+}
+
+bool TIMEDEMO_IsActive()
+{
+	return timedemo.active;
+}
+
+void TIMEDEMO_ApplySettings()
+{
+	if (!timedemo.active)
+		return;
+
+	const std::vector<std::pair<const char *, const char *>> settings = {
+	        {"cpu", "cycles=max"},
+	        {"dosbox", "fast_forward=true"},
+	        {"mixer", "nosound=true"},
+	        {"render", "frameskip=0"},
+	        {"render", "auto_frameskip=false"},
+	};
+	for (const auto &[name, setting] : settings) {
+		const auto section = control->GetSection(name);
+		if (!section || !section->HandleInputline(setting))
+			LOG_WARNING("BENCHMARK: Can't set [%s] %s", name, setting);
+	}
+}
+
+static void report(const bool completed)
+{
+	const auto host_us = std::max<int64_t>(GetTicksUsSince(timedemo.start_us), 1);
+	const auto host_s = host_us / 1e6;
+	const auto emulated_ms = PIC_Ticks - timedemo.start_tick;
+	const auto run = TELEMETRY_GetRun();
+	const auto frames_mixed = MIXER_GetFramesMixed() - timedemo.start_frames_mixed;
+
+	const auto cpu_section = static_cast<Section_prop *>(control->GetSection("cpu"));
+	const auto sdl_section = static_cast<Section_prop *>(control->GetSection("sdl"));
+
+	printf("\nBenchmark of '%s' with core=%s and output=%s\n",
+	       timedemo.program.c_str(),
+	       cpu_section->Get_string("core"),
+	       sdl_section->Get_string("output"));
+	if (!completed)
+		printf("  Stopped after %d of %d frames\n",
+		       timedemo.frames,
+		       timedemo.frames_wanted);
+
+	printf("  %-20s %.3f s\n", "host time", host_s);
+	printf("  %-20s %.3f s (%.2fx real time)\n",
+	       "emulated time",
+	       emulated_ms / 1000.0,
+	       emulated_ms / (host_us / 1000.0));
+	printf("  %-20s %d (%.1f per second)\n",
+	       "frames rendered",
+	       timedemo.frames,
+	       timedemo.frames / host_s);
+	printf("  %-20s %" PRId64 " (%.0f per second)\n",
+	       "audio frames mixed",
+	       frames_mixed,
+	       frames_mixed / host_s);
+	printf("  %-20s %" PRId64 " (%d per ms)\n",
+	       "emulated cycles",
+	       run.cycles,
+	       CPU_CycleMax);
+	printf("  %-20s %.0f\n", "cycles per second", run.cycles / host_s);
+
+	constexpr std::pair<TelemetryBucket, const char *> buckets[] = {
+	        {TelemetryBucket::Cpu, "cpu"},
+	        {TelemetryBucket::Pic, "pic events"},
+	        {TelemetryBucket::Render, "render"},
+	        {TelemetryBucket::Mixer, "mixer"},
+	        {TelemetryBucket::Idle, "idle"},
+	        {TelemetryBucket::Other, "other"},
+	};
+	int64_t total_ns = 0;
+	for (const auto ns : run.ns)
+		total_ns += ns;
+	printf("  host time by subsystem:\n");
+	for (const auto &[bucket, name] : buckets) {
+		const auto ns = run.ns[static_cast<size_t>(bucket)];
+		printf("    %-18s %8.3f s %6.1f%%\n",
+		       name,
+		       ns / 1e9,
+		       100.0 * ns / std::max<int64_t>(total_ns, 1));
+	}
+	fflush(stdout);
+}
+
+void TIMEDEMO_AddFrame()
+{
+	if (timedemo.finished)
+		return;
+
+	if (!timedemo.started) {
+		timedemo.started = true;
+		timedemo.start_us = GetTicksUs();
+		timedemo.start_tick = PIC_Ticks;
+		timedemo.start_frames_mixed = MIXER_GetFramesMixed();
+		TELEMETRY_StartRun();
+		return;
+	}
+	if (++timedemo.frames < timedemo.frames_wanted)
+		return;
+
+	timedemo.finished = true;
+	report(true);
+	GFX_RequestExit(true);
+}
+
+void TIMEDEMO_Finish()
+{
+	if (!timedemo.active || !timedemo.started || timedemo.finished)
+		return;
+	timedemo.finished = true;
+	report(false);
+}
@@ -18,6 +18,7 @@
 
 #include "timer.h"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
@@ -28,6 +29,7 @@
 #include "math_utils.h"
 #include "mixer.h"
 #include "setup.h"
+#include "snapshot.h"
 
 const std::chrono::steady_clock::time_point system_start_time = std::chrono::steady_clock::now();
 
@@ -628,6 +630,27 @@ bool TIMER_GetOutput2()
 	return counter_output(channel_2);
 }
 
+static void timer_snapshot(SnapshotStream &s)
+{
+	s.Pod(pit);
+	s.Pod(gate2);
+	s.Pod(latched_timerstatus);
+	s.Pod(latched_timerstatus_locked);
+	if (!s.IsLoading())
+		return;
+
+	// Channel 0 has a pending event unless its new control word still waits
+	// for a count, or its one-shot count has already run out
+	PIC_RemoveEvents(PIT0_Event);
+	const auto remaining = channel_0.start + channel_0.delay - PIC_FullIndex();
+	if (channel_0.mode != PitMode::Inactive && !channel_0.mode_changed &&
+	    (channel_0.mode != PitMode::InterruptOnTerminalCount || remaining > 0))
+		PIC_AddEvent(PIT0_Event, std::max(remaining, 0.0));
+
+	PCSPEAKER_SetPITControl(channel_2.mode);
+	PCSPEAKER_SetCounter(channel_2.count, channel_2.mode);
+}
+
 class TIMER final : public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[4];
@@ -681,6 +704,7 @@ public:
 		latched_timerstatus_locked=false;
 		gate2 = false;
 		PIC_AddEvent(PIT0_Event, channel_0.delay);
+		SNAPSHOT_AddComponent("timer", timer_snapshot);
 	}
 	~TIMER(){
 		PIC_RemoveEvents(PIT0_Event);
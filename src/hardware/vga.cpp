@@ -26,6 +26,7 @@
 #include "logging.h"
 #include "math_utils.h"
 #include "pic.h"
+#include "snapshot.h"
 #include "video.h"
 
 VGA_Type vga;
@@ -267,6 +268,7 @@ void VGA_SetClock(const Bitu which, const uint32_t desired_clock)
 }
 
 void VGA_SetCGA2Table(uint8_t val0,uint8_t val1) {
+	VGA_NoteDisplayChange();
 	uint8_t total[2]={ val0,val1};
 	for (Bitu i=0;i<16;i++) {
 		CGA_2_Table[i]=
@@ -281,6 +283,7 @@ void VGA_SetCGA2Table(uint8_t val0,uint8_t val1) {
 }
 
 void VGA_SetCGA4Table(uint8_t val0,uint8_t val1,uint8_t val2,uint8_t val3) {
+	VGA_NoteDisplayChange();
 	uint8_t total[4]={ val0,val1,val2,val3};
 	for (Bitu i=0;i<256;i++) {
 		CGA_4_Table[i]=
@@ -302,6 +305,80 @@ void VGA_SetCGA4Table(uint8_t val0,uint8_t val1,uint8_t val2,uint8_t val3) {
 	}	
 }
 
+// PCjr and Tandy video memory is either part of the system memory or of the
+// video memory, so their pointers are kept as offsets
+static void snapshot_video_pointer(SnapshotStream &s, uint8_t *&pointer)
+{
+	const auto system_end = MemBase + MEM_TotalPages() * 4096;
+	const auto in_system = pointer >= MemBase && pointer < system_end;
+	auto base = in_system ? MemBase : vga.mem.linear;
+	auto offset = static_cast<uint32_t>(pointer ? pointer - base : 0);
+	auto kind = static_cast<uint8_t>(pointer ? (in_system ? 1 : 2) : 0);
+	s.Pod(kind);
+	s.Pod(offset);
+	if (s.IsLoading())
+		pointer = kind ? (kind == 1 ? MemBase : vga.mem.linear) + offset : nullptr;
+}
+
+// The drawing state is rebuilt from the registers when the mode is set up
+// again; the SVGA chipsets' own extended registers are not saved
+static void vga_snapshot(SnapshotStream &s)
+{
+	auto vmemsize = vga.vmemsize;
+	s.Pod(vmemsize);
+	if (vmemsize != vga.vmemsize) {
+		s.Fail();
+		return;
+	}
+	s.Pod(vga.mode);
+	s.Pod(vga.misc_output);
+	s.Pod(vga.config);
+	s.Pod(vga.internal);
+	s.Pod(vga.seq);
+	s.Pod(vga.attr);
+	s.Pod(vga.crtc);
+	s.Pod(vga.gfx);
+	s.Pod(vga.dac);
+	s.Pod(vga.latch);
+	s.Pod(vga.s3);
+	s.Pod(vga.svga);
+	s.Pod(vga.herc);
+	s.Pod(vga.other);
+
+	auto tandy = vga.tandy;
+	s.Pod(tandy);
+	snapshot_video_pointer(s, vga.tandy.draw_base);
+	snapshot_video_pointer(s, vga.tandy.mem_base);
+	if (s.IsLoading()) {
+		tandy.draw_base = vga.tandy.draw_base;
+		tandy.mem_base = vga.tandy.mem_base;
+		vga.tandy = tandy;
+	}
+
+	s.Bytes(vga.mem.linear, vga.vmemsize);
+	s.Bytes(vga.fastmem, vga.vmemsize * 2);
+	s.Pod(vga.draw.font);
+	constexpr auto no_table = UINT32_MAX;
+	for (auto &table : vga.draw.font_tables) {
+		auto offset = table ? static_cast<uint32_t>(table - vga.draw.font)
+		                    : no_table;
+		s.Pod(offset);
+		table = (offset != no_table) ? vga.draw.font + offset : nullptr;
+	}
+	s.Pod(vga.draw.cursor);
+	s.Pod(vga.draw.blinking);
+	s.Pod(vga.draw.blink);
+	s.Pod(CGA_2_Table);
+	s.Pod(CGA_4_Table);
+	s.Pod(CGA_4_HiRes_Table);
+
+	if (s.IsLoading()) {
+		VGA_SetupHandlers();
+		VGA_DACSetEntirePalette();
+		VGA_StartResize();
+	}
+}
+
 void VGA_Init(Section* sec) {
 //	Section_prop * section=static_cast<Section_prop *>(sec);
 	vga.draw.resizing=false;
@@ -368,6 +445,7 @@ void VGA_Init(Section* sec) {
 #endif
 		}
 	}
+	SNAPSHOT_AddComponent("vga", vga_snapshot);
 }
 
 void SVGA_Setup_Driver(void) {
@@ -102,8 +102,11 @@ void write_p3c0(io_port_t, io_val_t value, io_width_t)
 	if (!vga.internal.attrindex) {
 		attr(index)=val & 0x1F;
 		vga.internal.attrindex=true;
+		const auto was_disabled = attr(disabled);
 		if (val & 0x20) attr(disabled) &= ~1;
 		else attr(disabled) |= 1;
+		if (attr(disabled) != was_disabled)
+			VGA_NoteDisplayChange();
 		/* 
 			0-4	Address of data register to write to port 3C0h or read from port 3C1h
 			5	If set screen output is enabled and the palette can not be modified,
@@ -211,9 +214,11 @@ void write_p3c0(io_port_t, io_val_t value, io_width_t)
 			default:
 				vga.config.pel_panning=(val & 0x7);
 			}
-			if (machine==MCH_EGA)
+			if (machine==MCH_EGA) {
 				// On the EGA panning can be programmed for every scanline:
 				vga.draw.panning = vga.config.pel_panning;
+				VGA_NoteDisplayChange();
+			}
 			/*
 				0-3	Indicates number of pixels to shift the display left
 					Value  9bit textmode   256color mode   Other modes
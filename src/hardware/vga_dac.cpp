@@ -66,6 +66,7 @@ static void VGA_DAC_SendColor(uint8_t index, uint8_t src)
 
 	// Set it in the (little endian) 16bit output lookup table
 	var_write(&vga.dac.xlat16[index], check_cast<uint16_t>(rgb565));
+	VGA_NoteDisplayChange();
 
 	// Scale the DAC's 6-bit colors to 8-bit to set the VGA palette
 	auto scale_6_to_8 = [](const uint8_t color_6) -> uint8_t {
@@ -231,6 +232,20 @@ void VGA_DAC_SetEntry(Bitu entry,uint8_t red,uint8_t green,uint8_t blue) {
 			VGA_DAC_SendColor( i, i );
 }
 
+// Sends every colour in use to the renderer, after the DAC was loaded
+void VGA_DACSetEntirePalette(void) {
+	switch (vga.mode) {
+	case M_VGA:
+	case M_LIN8:
+		for (uint16_t i = 0; i < 256; i++)
+			VGA_DAC_UpdateColor(i);
+		break;
+	default:
+		for (uint8_t i = 0; i < 16; i++)
+			VGA_DAC_SendColor(i, vga.dac.combine[i]);
+	}
+}
+
 void VGA_SetupDAC(void) {
 	vga.dac.first_changed=256;
 	vga.dac.bits=6;
@@ -18,18 +18,30 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
+#include <array>
 #include <cstring>
 #include <cmath>
+#include <vector>
 
 #include "../ints/int10.h"
+#include "cycle_telemetry.h"
+#include "hardware.h"
 #include "math_utils.h"
 #include "mem_unaligned.h"
 #include "pic.h"
 #include "render.h"
+#include "replay.h"
+#include "tracy.h"
 #include "../gui/render_scalers.h"
 #include "vga.h"
 #include "video.h"
 
+#if defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define VGA_XLAT_NEON 1
+#endif
+
 //#undef C_DEBUG
 //#define C_DEBUG 1
 //#define LOG(X,Y) LOG_MSG
@@ -152,6 +164,10 @@ static uint8_t *Composite_Process(uint8_t border, uint32_t blocks, bool doublewi
 		w *= 2;
 	}
 
+	// The output decodes the hdots itself
+	if (vga.draw.composite_on_gpu)
+		return TempLine;
+
 	// Simulate CGA composite output
 	int *o = temp;
 	auto push_pixel = [&o](const int v) {
@@ -227,11 +243,33 @@ static uint8_t *Composite_Process(uint8_t border, uint32_t blocks, bool doublewi
 	return TempLine;
 }
 
-static uint8_t *VGA_TEXT_Draw_Line(Bitu vidstart, Bitu line);
+// Passes what Composite_Process would decode the hdots of the frame with on
+// to the output; the border colour is taken once per frame
+static void pass_composite_decoder()
+{
+	GFX_CompositeDecoder decoder = {};
+	decoder.levels     = CGA_Composite_Table;
+	decoder.hdots      = static_cast<int>(vga.draw.width);
+	decoder.sharpness  = vga.sharpness;
+	decoder.ri         = vga.ri;
+	decoder.rq         = vga.rq;
+	decoder.gi         = vga.gi;
+	decoder.gq         = vga.gq;
+	decoder.bi         = vga.bi;
+	decoder.bq         = vga.bq;
+	decoder.border     = vga.mode == M_CGA2_COMPOSITE
+	                           ? 0
+	                           : (vga.tandy.color_select & 0x0f);
+	decoder.monochrome = (vga.tandy.mode_control & 4) != 0;
+	RENDER_SetCompositeDecoder(&decoder);
+}
+
+static uint8_t *draw_text_line(uint8_t *out, uint32_t *cells, Bitu vidstart,
+                               Bitu line);
 
 static uint8_t *VGA_CGA_TEXT_Composite_Draw_Line(Bitu vidstart, Bitu line)
 {
-	VGA_TEXT_Draw_Line(vidstart, line);
+	draw_text_line(TempLine, nullptr, vidstart, line);
 	return Composite_Process(vga.tandy.color_select & 0x0f, vga.draw.blocks * 2,
 	                         (vga.tandy.mode_control & 0x1) == 0);
 }
@@ -278,34 +316,6 @@ static uint8_t * VGA_Draw_4BPP_Line_Double(Bitu vidstart, Bitu line) {
 	return TempLine;
 }
 
-#ifdef VGA_KEEP_CHANGES
-static uint8_t * VGA_Draw_Changes_Line(Bitu vidstart, Bitu line) {
-	Bitu checkMask = vga.changes.checkMask;
-	uint8_t *map = vga.changes.map;
-	Bitu start = (vidstart >> VGA_CHANGE_SHIFT);
-	Bitu end = ((vidstart + vga.draw.line_length ) >> VGA_CHANGE_SHIFT);
-	for (; start <= end; ++start) {
-		if ( map[start] & checkMask ) {
-			Bitu offset = vidstart & vga.draw.linear_mask;
-			if (vga.draw.linear_mask-offset < vga.draw.line_length)
-				memcpy(vga.draw.linear_base+vga.draw.linear_mask+1, vga.draw.linear_base, vga.draw.line_length);
-			uint8_t *ret = &vga.draw.linear_base[ offset ];
-#if !defined(C_UNALIGNED_MEMORY)
-			if (GCC_UNLIKELY( ((Bitu)ret) & (sizeof(Bitu)-1)) ) {
-				memcpy( TempLine, ret, vga.draw.line_length );
-				return TempLine;
-			}
-#endif
-			return ret;
-		}
-	}
-//	memset( TempLine, 0x30, vga.changes.lineWidth );
-//	return TempLine;
-	return 0;
-}
-
-#endif
-
 static uint8_t * VGA_Draw_Linear_Line(Bitu vidstart, Bitu /*line*/) {
 	Bitu offset = vidstart & vga.draw.linear_mask;
 	uint8_t* ret = &vga.draw.linear_base[offset];
@@ -338,11 +348,46 @@ static uint8_t * VGA_Draw_Linear_Line(Bitu vidstart, Bitu /*line*/) {
 	return ret;
 }
 
+// Translates 8-bit pixels through the DAC's 16-bit colour table into 'dst'
+static void VGA_Xlat16_Span(uint8_t *dst, const uint8_t *src, const size_t count)
+{
+	const uint16_t *xlat16 = vga.dac.xlat16;
+	size_t i = 0;
+#if defined(VGA_XLAT_NEON)
+	// The table split into its low and high bytes, a quarter of the 256
+	// entries per four-register lookup
+	uint8x16x4_t lo[4];
+	uint8x16x4_t hi[4];
+	const auto table = reinterpret_cast<const uint8_t *>(xlat16);
+	for (int q = 0; q < 4; ++q) {
+		for (int v = 0; v < 4; ++v) {
+			const auto entries = vld2q_u8(table + (q * 64 + v * 16) * 2);
+			lo[q].val[v] = entries.val[0];
+			hi[q].val[v] = entries.val[1];
+		}
+	}
+	// Indexes past a quarter look up zero, or keep the previous result
+	const auto quarter = vdupq_n_u8(64);
+	for (; i + 16 <= count; i += 16) {
+		auto index = vld1q_u8(src + i);
+		uint8x16x2_t colours = {{vqtbl4q_u8(lo[0], index),
+		                         vqtbl4q_u8(hi[0], index)}};
+		for (int q = 1; q < 4; ++q) {
+			index = vsubq_u8(index, quarter);
+			colours.val[0] = vqtbx4q_u8(colours.val[0], lo[q], index);
+			colours.val[1] = vqtbx4q_u8(colours.val[1], hi[q], index);
+		}
+		vst2q_u8(dst + i * 2, colours);
+	}
+#endif
+	for (; i < count; ++i)
+		write_unaligned_uint16_at(dst, i, xlat16[src[i]]);
+}
+
 static uint8_t *VGA_Draw_Xlat16_Linear_Line(Bitu vidstart, Bitu /*line*/)
 {
 	const auto offset = vidstart & vga.draw.linear_mask;
 	const uint8_t *ret = &vga.draw.linear_base[offset];
-	const uint16_t *xlat16 = vga.dac.xlat16;
 
 	// see VGA_Draw_Linear_Line
 	if (GCC_UNLIKELY((vga.draw.line_length + offset)& ~vga.draw.linear_mask)) {
@@ -354,18 +399,13 @@ static uint8_t *VGA_Draw_Xlat16_Linear_Line(Bitu vidstart, Bitu /*line*/)
 		const auto unwrapped_len = vga.draw.line_length - wrapped_len;
 
 		// unwrapped chunk: to top of memory block
-		for (uintptr_t i = 0; i < unwrapped_len; ++i)
-			write_unaligned_uint16_at(TempLine, i, xlat16[ret[i]]);
+		VGA_Xlat16_Span(TempLine, ret, unwrapped_len);
 
 		// wrapped chunk: from base of memory block
-		for (uintptr_t i = 0; i < wrapped_len; ++i)
-			write_unaligned_uint16_at(TempLine, i + unwrapped_len,
-			                          xlat16[vga.draw.linear_base[i]]);
-
+		VGA_Xlat16_Span(TempLine + unwrapped_len * 2,
+		                vga.draw.linear_base, wrapped_len);
 	} else {
-		for (uintptr_t i = 0; i < vga.draw.line_length; ++i) {
-			write_unaligned_uint16_at(TempLine, i, xlat16[ret[i]]);
-		}
+		VGA_Xlat16_Span(TempLine, ret, vga.draw.line_length);
 	}
 	return TempLine;
 }
@@ -527,6 +567,155 @@ static uint8_t * VGA_Draw_LIN32_Line_HWMouse(Bitu vidstart, Bitu /*line*/) {
 	}
 }
 
+// Where the output can draw it, the S3 hardware cursor is handed over as an
+// overlay instead, so the lines beneath it keep the plain linear drawer and
+// the render cache still skips them while the mouse moves
+static struct {
+	bool active = false;
+	bool visible = false;
+	float x = 0.0f;
+	float y = 0.0f;
+	std::array<uint32_t, 64 * 64> colours = {};
+	std::array<uint32_t, 64 * 64> inverted = {};
+} hwcursor_overlay = {};
+
+static bool hwcursor_overlay_allowed()
+{
+	switch (vga.mode) {
+	case M_LIN8:
+	case M_LIN15:
+	case M_LIN16:
+	case M_LIN32: break;
+	default: return false;
+	}
+	// Captures and replay checksums are taken from the drawn lines
+	return GFX_CanOverlayCursor() && !REPLAY_IsActive() &&
+	       !(CaptureState & (CAPTURE_IMAGE | CAPTURE_VIDEO));
+}
+
+static void hide_hwcursor_overlay()
+{
+	if (hwcursor_overlay.visible)
+		GFX_SetCursorPosition(false, 0.0f, 0.0f, 0.0f, 0.0f);
+	hwcursor_overlay.visible = false;
+}
+
+static uint8_t expand_5bit(const unsigned val)
+{
+	return static_cast<uint8_t>(((val & 0x1f) << 3) | ((val & 0x1f) >> 2));
+}
+
+static uint8_t expand_6bit(const unsigned val)
+{
+	return static_cast<uint8_t>(((val & 0x3f) << 2) | ((val & 0x3f) >> 4));
+}
+
+// The opaque ARGB colour of a cursor colour stack in the mode's format
+static uint32_t hwcursor_colour(const uint8_t *stack)
+{
+	uint8_t red = 0;
+	uint8_t green = 0;
+	uint8_t blue = 0;
+	switch (vga.mode) {
+	case M_LIN15: {
+		const auto colour = read_unaligned_uint16(stack);
+		red = expand_5bit(colour >> 10);
+		green = expand_5bit(colour >> 5);
+		blue = expand_5bit(colour);
+		break;
+	}
+	case M_LIN16: {
+		const auto colour = read_unaligned_uint16(stack);
+		red = expand_5bit(colour >> 11);
+		green = expand_6bit(colour >> 5);
+		blue = expand_5bit(colour);
+		break;
+	}
+	case M_LIN32: return 0xff000000 | read_unaligned_uint32(stack);
+	default:
+		red = render.pal.rgb[stack[0]].red;
+		green = render.pal.rgb[stack[0]].green;
+		blue = render.pal.rgb[stack[0]].blue;
+		break;
+	}
+	return 0xff000000 | (red << 16) | (green << 8) | blue;
+}
+
+// Decodes the cursor pattern and hands it to the output when it changed. The
+// colours of a palettized mode can change without the pattern doing so, so
+// the image is decoded every frame; it's only 64x64 pixels.
+static void update_hwcursor_image()
+{
+	std::array<uint32_t, 64 * 64> colours;
+	std::array<uint32_t, 64 * 64> inverted;
+
+	const auto fore = hwcursor_colour(vga.s3.hgc.forestack);
+	const auto back = hwcursor_colour(vga.s3.hgc.backstack);
+	const auto start = (static_cast<uint32_t>(vga.s3.hgc.startaddr) << 10) &
+	                   (vga.vmemwrap - 1);
+	const auto pattern = &vga.mem.linear[start];
+
+	// Each row takes 16 bytes, in which every 16 pixels have a word of their
+	// A bits followed by a word of their B bits
+	for (int y = 0; y < 64; ++y) {
+		for (int x = 0; x < 64; ++x) {
+			const auto bits = pattern + y * 16 + (x / 16) * 4 + (x % 16) / 8;
+			const auto mask = 0x80 >> (x % 8);
+			const bool a = bits[0] & mask;
+			const bool b = bits[2] & mask;
+			const auto i = y * 64 + x;
+			// A set is transparent, or inverts the screen when B is set too
+			colours[i] = a ? 0 : (b ? fore : back);
+			inverted[i] = (a && b) ? 0xffffffff : 0;
+		}
+	}
+	if (colours == hwcursor_overlay.colours && inverted == hwcursor_overlay.inverted)
+		return;
+	hwcursor_overlay.colours = colours;
+	hwcursor_overlay.inverted = inverted;
+	GFX_SetCursorImage(colours.data(), inverted.data());
+}
+
+// Places the overlay where the line drawers would draw the cursor: the
+// pattern is shifted left by posx and up by posy from the cursor origin
+static void update_hwcursor_position()
+{
+	const auto &hgc = vga.s3.hgc;
+	const auto rows = vga.draw.height / std::max(vga.draw.address_line_total, 1u);
+	if (!vga.draw.width || !rows || hgc.posx >= vga.draw.width) {
+		hide_hwcursor_overlay();
+		return;
+	}
+	const auto width = static_cast<float>(vga.draw.width);
+	const auto height = static_cast<float>(rows);
+	const auto x = (hgc.originx - hgc.posx) / width;
+	const auto y = (hgc.originy - hgc.posy) / height;
+	if (hwcursor_overlay.visible && x == hwcursor_overlay.x && y == hwcursor_overlay.y)
+		return;
+	hwcursor_overlay.visible = true;
+	hwcursor_overlay.x = x;
+	hwcursor_overlay.y = y;
+	GFX_SetCursorPosition(true, x, y, 64 / width, 64 / height);
+}
+
+// Called at the start of each drawn frame; switches between the overlay and
+// the line drawers as the output and captures allow
+static void update_hwcursor_overlay()
+{
+	const bool drawing_cursor = hwcursor_overlay.active ||
+	                            VGA_DrawLine == VGA_Draw_VGA_Line_HWMouse ||
+	                            VGA_DrawLine == VGA_Draw_LIN16_Line_HWMouse ||
+	                            VGA_DrawLine == VGA_Draw_LIN32_Line_HWMouse;
+	if (!drawing_cursor)
+		return;
+	if (hwcursor_overlay.active != hwcursor_overlay_allowed())
+		VGA_ActivateHardwareCursor();
+	if (!hwcursor_overlay.active)
+		return;
+	update_hwcursor_image();
+	update_hwcursor_position();
+}
+
 static const uint8_t* VGA_Text_Memwrap(Bitu vidstart) {
 	vidstart &= vga.draw.linear_mask;
 	Bitu line_end = 2 * vga.draw.blocks;
@@ -547,32 +736,91 @@ static bool SkipCursor(Bitu vidstart, Bitu line)
 	       (vga.draw.cursor.address < vidstart);
 }
 
+/* Text lines are drawn into a cache kept for each line of the frame. When
+ * a line is drawn again with the same state as in the previous frame, only
+ * the cells whose character or attribute changed are expanded again; the rest
+ * of the line is left as it was drawn. */
+constexpr uint16_t text_cache_cells = 160;
+constexpr uint32_t text_cell_redraw = UINT32_MAX;
+
+struct TextLineCache {
+	// The character and attribute each cell was drawn with
+	uint32_t cells[text_cache_cells];
+	Bitu line = ~static_cast<Bitu>(0);
+	alignas(vga_memalign) uint8_t pixels[(text_cache_cells * 9 + 16) * 2];
+};
+
+static std::vector<TextLineCache> text_line_caches;
+
+// Whether the cells cached for the part being drawn are still as shown
+static bool text_cells_valid = false;
+static bool text_cells_valid_frame = false;
+
+// Returns the cache for the line of the frame being drawn, with its cells to
+// be redrawn unless the state they were drawn with still holds
+static TextLineCache *get_text_line_cache(const Bitu line, const Bitu cells)
+{
+	const auto index = vga.draw.lines_done;
+	if (cells > text_cache_cells || index >= vga.draw.lines_total)
+		return nullptr;
+	if (index >= text_line_caches.size())
+		text_line_caches.resize(vga.draw.lines_total);
+	auto &cache = text_line_caches[index];
+	if (!text_cells_valid || cache.line != line) {
+		std::fill(std::begin(cache.cells), std::end(cache.cells),
+		          text_cell_redraw);
+		cache.line = line;
+	}
+	return &cache;
+}
+
 static uint32_t FontMask[2]={0xffffffff,0x0};
 static uint8_t *VGA_TEXT_Draw_Line(Bitu vidstart, Bitu line)
+{
+	auto cache = get_text_line_cache(line, vga.draw.blocks);
+	if (!cache)
+		return draw_text_line(TempLine, nullptr, vidstart, line);
+	return draw_text_line(cache->pixels, cache->cells, vidstart, line);
+}
+
+// Draws the cells that differ from the cached ones, or all if there are none
+static uint8_t *draw_text_line(uint8_t *out, uint32_t *cells, Bitu vidstart,
+                               Bitu line)
 {
 	uint16_t i = 0;
 	const uint8_t* vidmem = VGA_Text_Memwrap(vidstart);
 	for (Bitu cx = 0; cx < vga.draw.blocks; ++cx) {
 		Bitu chr=vidmem[cx*2];
 		Bitu col=vidmem[cx*2+1];
+		if (cells) {
+			const auto cell = static_cast<uint32_t>(chr | (col << 8));
+			if (cells[cx] == cell) {
+				i += 2;
+				continue;
+			}
+			cells[cx] = cell;
+		}
 		Bitu font=vga.draw.font_tables[(col >> 3)&1][chr*32+line];
 		uint32_t mask1=TXT_Font_Table[font>>4] & FontMask[col >> 7];
 		uint32_t mask2=TXT_Font_Table[font&0xf] & FontMask[col >> 7];
 		uint32_t fg=TXT_FG_Table[col&0xf];
 		uint32_t bg=TXT_BG_Table[col>>4];
-		write_unaligned_uint32_at(TempLine, i++, (fg & mask1) | (bg & ~mask1));
-		write_unaligned_uint32_at(TempLine, i++, (fg & mask2) | (bg & ~mask2));
+		write_unaligned_uint32_at(out, i++, (fg & mask1) | (bg & ~mask1));
+		write_unaligned_uint32_at(out, i++, (fg & mask2) | (bg & ~mask2));
 	}
 	if (SkipCursor(vidstart, line))
-		return TempLine;
+		return out;
 	const Bitu font_addr = (vga.draw.cursor.address - vidstart) >> 1;
 	if (font_addr < vga.draw.blocks) {
-		uint32_t *draw = (uint32_t *)&TempLine[font_addr * 8];
+		uint32_t *draw = (uint32_t *)&out[font_addr * 8];
 		uint32_t att=TXT_FG_Table[vga.tandy.draw_base[vga.draw.cursor.address+1]&0xf];
 		*draw++ = att;
 		*draw++ = att;
+		// The cell is drawn without the cursor again
+		if (cells)
+			cells[font_addr] = text_cell_redraw;
 	}
-	return TempLine;
+	return out;
 }
 
 static uint8_t *VGA_TEXT_Herc_Draw_Line(Bitu vidstart, Bitu line)
@@ -640,9 +888,23 @@ static uint8_t *VGA_TEXT_Xlat16_Draw_Line(Bitu vidstart, Bitu line)
 	if (vga.draw.panning)
 		++blocks; // if the text is panned part of an
 		          // additional character becomes visible
-	while (blocks--) { // for each character in the line
+	uint8_t *out = TempLine;
+	uint32_t *cells = nullptr;
+	if (auto cache = get_text_line_cache(line, blocks)) {
+		out = cache->pixels;
+		cells = cache->cells;
+	}
+	for (Bitu cx = 0; cx < blocks; ++cx) { // for each character in the line
 		Bitu chr = *vidmem++;
 		Bitu attr = *vidmem++;
+		if (cells) {
+			const auto cell = static_cast<uint32_t>(chr | (attr << 8));
+			if (cells[cx] == cell) {
+				idx += vga.draw.char9dot ? 9 : 8;
+				continue;
+			}
+			cells[cx] = cell;
+		}
 		// the font pattern
 		Bitu font = vga.draw.font_tables[(attr >> 3)&1][(chr<<5)+line];
 		
@@ -663,14 +925,14 @@ static uint8_t *VGA_TEXT_Xlat16_Draw_Line(Bitu vidstart, Bitu line)
 				(chr>=0xc0) && (chr<=0xdf)) font |= 1;
 			for (int n = 0; n < 9; ++n) {
 				write_unaligned_uint16_at(
-				        TempLine, idx++,
+				        out, idx++,
 				        vga.dac.xlat16[(font & 0x100) ? foreground : background]);
 				font <<= 1;
 			}
 		} else {
 			for (int n = 0; n < 8; ++n) {
 				write_unaligned_uint16_at(
-				        TempLine, idx++,
+				        out, idx++,
 				        vga.dac.xlat16[(font & 0x80) ? foreground : background]);
 				font <<= 1;
 			}
@@ -682,35 +944,21 @@ static uint8_t *VGA_TEXT_Xlat16_Draw_Line(Bitu vidstart, Bitu line)
 		const Bitu attr_addr = (vga.draw.cursor.address - vidstart) >> 1;
 		if (attr_addr < vga.draw.blocks) {
 			Bitu index = attr_addr * (vga.draw.char9dot? 18:16);
-			uint16_t *draw = (uint16_t *)(&TempLine[index]) + 16 -
+			uint16_t *draw = (uint16_t *)(&out[index]) + 16 -
 			               vga.draw.panning;
 
 			Bitu foreground = vga.tandy.draw_base[vga.draw.cursor.address+1] & 0xf;
 			for (int i = 0; i < 8; ++i) {
 				*draw++ = vga.dac.xlat16[foreground];
 			}
+			// The cell is drawn without the cursor again
+			if (cells)
+				cells[attr_addr] = text_cell_redraw;
 		}
 	}
-	return TempLine + 32;
+	return out + 32;
 }
 
-#ifdef VGA_KEEP_CHANGES
-static inline void VGA_ChangesEnd(void ) {
-	if ( vga.changes.active ) {
-//		vga.changes.active = false;
-		Bitu end = vga.draw.address >> VGA_CHANGE_SHIFT;
-		Bitu total = 4 + end - vga.changes.start;
-		uint32_t clearMask = vga.changes.clearMask;
-		total >>= 2;
-		uint32_t *clear = (uint32_t *)&vga.changes.map[  vga.changes.start & ~3 ];
-		while ( total-- ) {
-			clear[0] &= clearMask;
-			++clear;
-		}
-	}
-}
-#endif
-
 
 static void VGA_ProcessSplit() {
 	if (vga.attr.mode_control&0x20) {
@@ -729,7 +977,7 @@ static void VGA_ProcessSplit() {
 }
 
 static uint8_t bg_color_index = 0; // screen-off black index
-static void VGA_DrawSingleLine(uint32_t /*blah*/)
+static void draw_single_line()
 {
 	if (GCC_UNLIKELY(vga.attr.disabled)) {
 		switch(machine) {
@@ -801,12 +1049,20 @@ static void VGA_DrawSingleLine(uint32_t /*blah*/)
 	}
 	++vga.draw.lines_done;
 	if (vga.draw.split_line==vga.draw.lines_done) VGA_ProcessSplit();
+}
+
+static void VGA_DrawSingleLine(uint32_t /*blah*/)
+{
+	TelemetryScope telemetry_scope(TelemetryBucket::Render);
+	ZoneScopedSubsystem("VGA draw single line");
+
+	draw_single_line();
 	if (vga.draw.lines_done < vga.draw.lines_total) {
 		PIC_AddEvent(VGA_DrawSingleLine, vga.draw.delay.htotal);
 	} else RENDER_EndUpdate(false);
 }
 
-static void VGA_DrawEGASingleLine(uint32_t /*blah*/)
+static void draw_ega_single_line()
 {
 	if (GCC_UNLIKELY(vga.attr.disabled)) {
 		memset(TempLine, 0, sizeof(TempLine));
@@ -825,31 +1081,222 @@ static void VGA_DrawEGASingleLine(uint32_t /*blah*/)
 	}
 	++vga.draw.lines_done;
 	if (vga.draw.split_line==vga.draw.lines_done) VGA_ProcessSplit();
+}
+
+static void VGA_DrawEGASingleLine(uint32_t /*blah*/)
+{
+	TelemetryScope telemetry_scope(TelemetryBucket::Render);
+	ZoneScopedSubsystem("VGA draw EGA single line");
+
+	draw_ega_single_line();
 	if (vga.draw.lines_done < vga.draw.lines_total) {
 		PIC_AddEvent(VGA_DrawEGASingleLine, vga.draw.delay.htotal);
 	} else RENDER_EndUpdate(false);
 }
 
+// Frames whose colours and panning haven't changed while they were displayed
+// for this many frames in a row are drawn in a single event
+constexpr uint32_t vga_quiet_frames_to_batch = 8;
+
+// Draws all lines of the frame at once, as they would look when drawn one by
+// one if nothing changes while the frame is displayed
+static void VGA_DrawFrame(uint32_t /*val*/)
+{
+	TelemetryScope telemetry_scope(TelemetryBucket::Render);
+	ZoneScopedSubsystem("VGA draw frame");
+
+	const auto draw_line = vga.draw.mode == EGALINE ? draw_ega_single_line
+	                                                : draw_single_line;
+	while (vga.draw.lines_done < vga.draw.lines_total)
+		draw_line();
+	RENDER_EndUpdate(false);
+}
+
+void VGA_NoteDisplayChange()
+{
+	const auto elapsed = PIC_FullIndex() - vga.draw.delay.framestart;
+	if (elapsed < vga.draw.delay.vdend)
+		vga.draw.quiet_frames = 0;
+}
+
+void VGA_MarkAllChanged()
+{
+	vga.changes.skipping = false;
+	vga.changes.full     = true;
+	text_cells_valid     = false;
+}
+
+// Besides video memory, the lines of a part only depend on this state. If it
+// matches the state the part was drawn with in the previous frame, the lines
+// reading no written blocks come out the same and needn't be drawn again.
+struct VGA_PartState {
+	VGA_Line_Handler draw_line;
+	const uint8_t *linear_base;
+	const uint8_t *draw_base;
+	const uint8_t *font_tables[2];
+	Bitu linear_mask;
+	Bitu address;
+	Bitu address_line;
+	Bitu address_add;
+	Bitu split_line;
+	Bitu bytes_skip;
+	Bitu byte_panning_shift;
+	Bitu blinking;
+	Bitu cursor_address;
+	uint32_t lines_done;
+	uint32_t line_length;
+	uint32_t blocks;
+	uint32_t address_line_total;
+	uint32_t font_mask;
+	uint16_t panning;
+	bool blink;
+	bool char9dot;
+	uint8_t cursor_sline;
+	uint8_t cursor_eline;
+	uint8_t cursor_enabled;
+	uint8_t cursor_shown;
+	uint8_t mode_control;
+	uint8_t underline_location;
+	VGAModes mode;
+	uint16_t xlat16[256];
+	uint32_t fg_table[16];
+	uint32_t bg_table[16];
+};
+
+static VGA_PartState part_states[VGA_PARTS];
+
+// Saves the state the part is drawn with, returning whether it's the same as
+// the one it was drawn with in the previous frame
+static bool VGA_SamePartState(const uint32_t part)
+{
+	VGA_PartState state;
+	// Zeroed so the padding compares equal too
+	memset(&state, 0, sizeof(state));
+	state.draw_line          = VGA_DrawLine;
+	state.linear_base        = vga.draw.linear_base;
+	state.draw_base          = vga.tandy.draw_base;
+	state.font_tables[0]     = vga.draw.font_tables[0];
+	state.font_tables[1]     = vga.draw.font_tables[1];
+	state.linear_mask        = vga.draw.linear_mask;
+	state.address            = vga.draw.address;
+	state.address_line       = vga.draw.address_line;
+	state.address_add        = vga.draw.address_add;
+	state.split_line         = vga.draw.split_line;
+	state.bytes_skip         = vga.draw.bytes_skip;
+	state.byte_panning_shift = vga.draw.byte_panning_shift;
+	state.blinking           = vga.draw.blinking;
+	state.cursor_address     = vga.draw.cursor.address;
+	state.lines_done         = vga.draw.lines_done;
+	state.line_length        = vga.draw.line_length;
+	state.blocks             = vga.draw.blocks;
+	state.address_line_total = vga.draw.address_line_total;
+	state.font_mask          = FontMask[1];
+	state.panning            = vga.draw.panning;
+	state.blink              = vga.draw.blink;
+	state.char9dot           = vga.draw.char9dot;
+	state.cursor_sline       = vga.draw.cursor.sline;
+	state.cursor_eline       = vga.draw.cursor.eline;
+	state.cursor_enabled     = vga.draw.cursor.enabled;
+	state.cursor_shown       = vga.draw.cursor.count & 0x10;
+	state.mode_control       = vga.attr.mode_control;
+	state.underline_location = vga.crtc.underline_location;
+	state.mode               = vga.mode;
+	memcpy(state.xlat16, vga.dac.xlat16, sizeof(state.xlat16));
+	memcpy(state.fg_table, TXT_FG_Table, sizeof(state.fg_table));
+	memcpy(state.bg_table, TXT_BG_Table, sizeof(state.bg_table));
+
+	auto &previous  = part_states[part];
+	const auto same = memcmp(&previous, &state, sizeof(state)) == 0;
+	previous        = state;
+	return same;
+}
+
+// Whether the memory the line at vidstart reads was written since the line
+// was drawn in the previous frame
+static bool VGA_LineChanged(const Bitu vidstart)
+{
+	const auto start = vidstart & vga.draw.linear_mask;
+	const auto bytes = vga.mode == M_TEXT ? (vga.draw.blocks + 1) * 2
+	                                      : vga.draw.line_length;
+	// Lines wrapping around the end of the memory are always drawn
+	if (GCC_UNLIKELY(start + bytes - 1 > vga.draw.linear_mask))
+		return true;
+
+	const auto frame    = vga.changes.frame;
+	const auto previous = static_cast<uint8_t>(frame - 1);
+	const auto last     = (start + bytes - 1) >> VGA_CHANGE_SHIFT;
+	for (auto block = start >> VGA_CHANGE_SHIFT; block <= last; ++block) {
+		const auto stamp = vga.changes.map[block & (vga_changes_blocks - 1)];
+		if (stamp == frame || stamp == previous)
+			return true;
+	}
+	return false;
+}
+
+// A 32-bit LFB frame is a plain block of video memory if it isn't panned,
+// split, line-doubled, or wrapped around the end of the memory. The output can
+// then take it as is, so its lines needn't be drawn.
+static const uint8_t *VGA_DirectFrame()
+{
+	if (vga.mode != M_LIN32 || VGA_DrawLine != VGA_Draw_Linear_Line)
+		return nullptr;
+	if (vga.draw.panning || vga.draw.vblank_skip ||
+	    vga.draw.address_line != 0 || vga.draw.address_line_total != 1 ||
+	    vga.draw.address_add < vga.draw.line_length)
+		return nullptr;
+	if (vga.draw.split_line > 0 && vga.draw.split_line < vga.draw.lines_total)
+		return nullptr;
+
+	const auto start = vga.draw.address & vga.draw.linear_mask;
+	const auto end = start + (vga.draw.lines_total - 1) * vga.draw.address_add +
+	                 vga.draw.line_length;
+	if (end > vga.draw.linear_mask + 1 || !RENDER_StartDirectUpdate())
+		return nullptr;
+	return vga.draw.linear_base + start;
+}
+
 static void VGA_DrawPart(uint32_t lines)
 {
+	TelemetryScope telemetry_scope(TelemetryBucket::Render);
+	ZoneScopedSubsystem("VGA draw part");
+
+	if (vga.draw.direct_frame) {
+		vga.draw.lines_done += lines;
+		if (--vga.draw.parts_left) {
+			PIC_AddEvent(VGA_DrawPart, vga.draw.delay.parts,
+			             (vga.draw.parts_left != 1)
+			                     ? vga.draw.parts_lines
+			                     : (vga.draw.lines_total -
+			                        vga.draw.lines_done));
+		} else {
+			RENDER_EndDirectUpdate(vga.draw.direct_frame,
+			                       static_cast<int>(vga.draw.address_add));
+		}
+		return;
+	}
+
+	const auto part = vga.draw.parts_total - vga.draw.parts_left;
+	const auto same_state = part < VGA_PARTS && VGA_SamePartState(part);
+	const auto skipping = same_state && vga.changes.skipping;
+	text_cells_valid = same_state && text_cells_valid_frame &&
+	                   !vga.changes.full;
+
 	while (lines--) {
-		uint8_t * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );
-		RENDER_DrawLine(data);
+		if (skipping && !VGA_LineChanged(vga.draw.address)) {
+			RENDER_DrawLine(nullptr);
+		} else {
+			uint8_t *data = VGA_DrawLine(vga.draw.address,
+			                             vga.draw.address_line);
+			RENDER_DrawLine(data);
+		}
 		++vga.draw.address_line;
 		if (vga.draw.address_line>=vga.draw.address_line_total) {
 			vga.draw.address_line=0;
 			vga.draw.address+=vga.draw.address_add;
 		}
 		++vga.draw.lines_done;
-		if (vga.draw.split_line==vga.draw.lines_done) {
-#ifdef VGA_KEEP_CHANGES
-			VGA_ChangesEnd( );
-#endif
+		if (vga.draw.split_line==vga.draw.lines_done)
 			VGA_ProcessSplit();
-#ifdef VGA_KEEP_CHANGES
-			vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-#endif
-		}
 	}
 	if (--vga.draw.parts_left) {
 		PIC_AddEvent(VGA_DrawPart, vga.draw.delay.parts,
@@ -857,13 +1304,48 @@ static void VGA_DrawPart(uint32_t lines)
 		                     ? vga.draw.parts_lines
 		                     : (vga.draw.lines_total - vga.draw.lines_done));
 	} else {
-#ifdef VGA_KEEP_CHANGES
-		VGA_ChangesEnd();
-#endif
 		RENDER_EndUpdate(false);
 	}
 }
 
+// Decides whether lines reading unwritten video memory may be skipped in the
+// frame about to be drawn
+static void VGA_ChangesStart()
+{
+	++vga.changes.frame;
+
+	bool mode_tracked = false;
+	switch (vga.mode) {
+	case M_TEXT:
+		mode_tracked = vga.tandy.draw_base == vga.mem.linear;
+		break;
+	case M_VGA:
+		// Chained writes are stamped at their cached pixels, unchained
+		// writes at their planes
+		mode_tracked = vga.config.chained ==
+		               (vga.draw.linear_base == vga.fastmem);
+		break;
+	case M_EGA:
+	case M_LIN4:
+		mode_tracked = vga.draw.linear_base == vga.fastmem;
+		break;
+	default: break;
+	}
+	const bool line_tracked = VGA_DrawLine == VGA_Draw_Linear_Line ||
+	                          VGA_DrawLine == VGA_Draw_Xlat16_Linear_Line ||
+	                          VGA_DrawLine == VGA_TEXT_Draw_Line ||
+	                          VGA_DrawLine == VGA_TEXT_Xlat16_Draw_Line;
+
+	vga.changes.skipping = !vga.changes.full && !render.fullFrame &&
+	                       vga.changes.tracked && mode_tracked &&
+	                       line_tracked && vga.draw.mode == PART;
+	// The cached text cells are compared with video memory itself, so
+	// they don't depend on the writes being tracked
+	text_cells_valid_frame = !vga.changes.full && vga.draw.mode == PART;
+	text_cells_valid       = false;
+	vga.changes.full = false;
+}
+
 void VGA_SetBlinking(const uint8_t enabled)
 {
 	LOG(LOG_VGA, LOG_NORMAL)("Blinking %u", enabled);
@@ -882,29 +1364,6 @@ void VGA_SetBlinking(const uint8_t enabled)
 		                      ((b + i) << 16) | ((b + i) << 24);
 }
 
-#ifdef VGA_KEEP_CHANGES
-static void inline VGA_ChangesStart( void ) {
-	vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-	vga.changes.last = vga.changes.start;
-	if ( vga.changes.lastAddress != vga.draw.address ) {
-//		LOG_MSG("Address");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-		vga.changes.lastAddress = vga.draw.address;
-	} else if ( render.fullFrame ) {
-//		LOG_MSG("Full Frame");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-	} else {
-//		LOG_MSG("Changes");
-		VGA_DrawLine = VGA_Draw_Changes_Line;
-	}
-	vga.changes.active = true;
-	vga.changes.checkMask = vga.changes.writeMask;
-	vga.changes.clearMask = ~( 0x01010101 << (vga.changes.frame & 7));
-	++vga.changes.frame;
-	vga.changes.writeMask = 1 << (vga.changes.frame & 7);
-}
-#endif
-
 static void VGA_VertInterrupt(uint32_t /*val*/)
 {
 	if ((!vga.draw.vret_triggered) &&
@@ -936,6 +1395,9 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 {
 	vga.draw.delay.framestart = PIC_FullIndex();
 	PIC_AddEvent(VGA_VerticalTimer, vga.draw.delay.vtotal);
+	VGA_EndFrameBankSwitches();
+	if (svgaCard == SVGA_S3Trio)
+		XGA_EndFrame();
 
 	switch(machine) {
 	case MCH_PCJR:
@@ -972,8 +1434,11 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 	//Check if we can actually render, else skip the rest (frameskip)
 	++vga.draw.cursor.count; // Do this here, else the cursor speed depends
 	                         // on the frameskip
+	if (vga.draw.composite_on_gpu)
+		pass_composite_decoder();
 	if (!RENDER_StartUpdate())
 		return;
+	update_hwcursor_overlay();
 
 	vga.draw.address_line = vga.config.hlines_skip;
 	if (IS_EGAVGA_ARCH) {
@@ -992,9 +1457,6 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		++vga.draw.split_line; // EGA adds one buggy scanline
 	}
 //	if (machine==MCH_EGA) vga.draw.split_line = ((((vga.config.line_compare&0x5ff)+1)*2-1)/vga.draw.lines_scaled);
-#ifdef VGA_KEEP_CHANGES
-	bool startaddr_changed=false;
-#endif
 	switch (vga.mode) {
 	case M_EGA:
 		if (!(vga.crtc.mode_control&0x1)) vga.draw.linear_mask &= ~0x10000;
@@ -1005,9 +1467,6 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		vga.draw.address += vga.draw.bytes_skip;
 		vga.draw.address *= vga.draw.byte_panning_shift;
 		if (machine!=MCH_EGA) vga.draw.address += vga.draw.panning;
-#ifdef VGA_KEEP_CHANGES
-		startaddr_changed=true;
-#endif
 		break;
 	case M_VGA:
 		if (vga.config.compatible_chain4 && (vga.crtc.underline_location & 0x40)) {
@@ -1027,9 +1486,6 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		vga.draw.address += vga.draw.bytes_skip;
 		vga.draw.address *= vga.draw.byte_panning_shift;
 		vga.draw.address += vga.draw.panning;
-#ifdef VGA_KEEP_CHANGES
-		startaddr_changed=true;
-#endif
 		break;
 	case M_TEXT:
 		vga.draw.byte_panning_shift = 2;
@@ -1065,9 +1521,6 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 		break;
 	}
 	if (GCC_UNLIKELY(vga.draw.split_line==0)) VGA_ProcessSplit();
-#ifdef VGA_KEEP_CHANGES
-	if (startaddr_changed) VGA_ChangesStart();
-#endif
 
 	// check if some lines at the top off the screen are blanked
 	double draw_skip = 0.0;
@@ -1083,7 +1536,10 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 			LOG(LOG_VGAMISC, LOG_NORMAL)("Parts left: %u", vga.draw.parts_left);
 			PIC_RemoveEvents(VGA_DrawPart);
 			RENDER_EndUpdate(true);
+			VGA_MarkAllChanged();
 		}
+		VGA_ChangesStart();
+		vga.draw.direct_frame = VGA_DirectFrame();
 		vga.draw.lines_done = 0;
 		vga.draw.parts_left = vga.draw.parts_total;
 		PIC_AddEvent(VGA_DrawPart, vga.draw.delay.parts + draw_skip, vga.draw.parts_lines);
@@ -1097,15 +1553,22 @@ static void VGA_VerticalTimer(uint32_t /*val*/)
 				PIC_RemoveEvents(VGA_DrawEGASingleLine);
 			else
 				PIC_RemoveEvents(VGA_DrawSingleLine);
+			PIC_RemoveEvents(VGA_DrawFrame);
 			RENDER_EndUpdate(true);
 		}
 		vga.draw.lines_done = 0;
-		if (vga.draw.mode==EGALINE)
+		if (vga.draw.quiet_frames >= vga_quiet_frames_to_batch)
+			// Nothing needs the lines drawn at their own times
+			PIC_AddEvent(VGA_DrawFrame,
+			             vga.draw.delay.htotal / 4.0 + draw_skip);
+		else if (vga.draw.mode==EGALINE)
 			PIC_AddEvent(VGA_DrawEGASingleLine,
 			             vga.draw.delay.htotal / 4.0 + draw_skip);
 		else
 			PIC_AddEvent(VGA_DrawSingleLine,
 			             vga.draw.delay.htotal / 4.0 + draw_skip);
+		if (vga.draw.quiet_frames < vga_quiet_frames_to_batch)
+			++vga.draw.quiet_frames;
 		break;
 	}
 }
@@ -1161,7 +1624,11 @@ void VGA_ActivateHardwareCursor(void) {
 	if (svga.hardware_cursor_active) {
 		if (svga.hardware_cursor_active()) hwcursor_active=true;
 	}
-	if (hwcursor_active) {
+	const bool overlay = hwcursor_active && hwcursor_overlay_allowed();
+	if (!overlay)
+		hide_hwcursor_overlay();
+	hwcursor_overlay.active = overlay;
+	if (hwcursor_active && !overlay) {
 		switch(vga.mode) {
 		case M_LIN32:
 			VGA_DrawLine=VGA_Draw_LIN32_Line_HWMouse;
@@ -1206,6 +1673,9 @@ void VGA_SetupDrawing(uint32_t /*val*/)
 		PIC_RemoveEvents(VGA_DisplayStartLatch);
 		return;
 	}
+	// the linear modes bring the hardware cursor overlay back below
+	hide_hwcursor_overlay();
+	hwcursor_overlay.active = false;
 	// set the drawing mode
 	switch (machine) {
 	case MCH_CGA:
@@ -1511,6 +1981,13 @@ void VGA_SetupDrawing(uint32_t /*val*/)
 	bool doubleheight = false;
 	bool doublewidth = false;
 
+	const bool is_composite = vga.mode == M_CGA2_COMPOSITE ||
+	                          vga.mode == M_CGA4_COMPOSITE ||
+	                          vga.mode == M_CGA_TEXT_COMPOSITE;
+	vga.draw.composite_on_gpu = is_composite && RENDER_CanDecodeComposite();
+	if (!vga.draw.composite_on_gpu)
+		RENDER_SetCompositeDecoder(nullptr);
+
 	unsigned bpp;
 	switch (vga.mode) {
 	case M_LIN15:
@@ -1522,10 +1999,13 @@ void VGA_SetupDrawing(uint32_t /*val*/)
 	case M_LIN24:
 		bpp = 24;
 		break;
-	case M_LIN32:
+	case M_LIN32: bpp = 32; break;
 	case M_CGA2_COMPOSITE:
 	case M_CGA4_COMPOSITE:
-	case M_CGA_TEXT_COMPOSITE: bpp = 32; break;
+	case M_CGA_TEXT_COMPOSITE:
+		// One RGBI colour index per hdot when the output decodes them
+		bpp = vga.draw.composite_on_gpu ? 8 : 32;
+		break;
 	default:
 		bpp = 8;
 		break;
@@ -1798,11 +2278,7 @@ void VGA_SetupDrawing(uint32_t /*val*/)
 	vga.draw.lines_total=height;
 	vga.draw.parts_lines=vga.draw.lines_total/vga.draw.parts_total;
 	vga.draw.line_length = width * ((bpp + 1) / 8);
-#ifdef VGA_KEEP_CHANGES
-	vga.changes.active = false;
-	vga.changes.frame = 0;
-	vga.changes.writeMask = 1;
-#endif
+	VGA_MarkAllChanged();
 	/*
 	   Cheap hack to just make all > 640x480 modes have square pixels
 	*/
@@ -1864,6 +2340,7 @@ void VGA_KillDrawing(void) {
 	PIC_RemoveEvents(VGA_DrawPart);
 	PIC_RemoveEvents(VGA_DrawSingleLine);
 	PIC_RemoveEvents(VGA_DrawEGASingleLine);
+	PIC_RemoveEvents(VGA_DrawFrame);
 	vga.draw.parts_left = 0;
 	vga.draw.lines_done = ~0;
 	RENDER_EndUpdate(true);
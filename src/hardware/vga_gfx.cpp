@@ -225,6 +225,12 @@ static uint8_t read_p3cf(io_port_t port, io_width_t)
 	return 0;	/* Compiler happy */
 }
 
+void VGA_WriteGfxRegister(const uint8_t index, const uint8_t val)
+{
+	write_p3ce(0x3ce, index, io_width_t::byte);
+	write_p3cf(0x3cf, val, io_width_t::byte);
+}
+
 void VGA_SetupGFX(void) {
 	if (IS_EGAVGA_ARCH) {
 		IO_RegisterWriteHandler(0x3ce, write_p3ce, io_width_t::byte);
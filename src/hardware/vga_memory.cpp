@@ -22,12 +22,21 @@
 #include "dosbox.h"
 #include "mem.h"
 #include "mem_host.h"
+#include "metrics.h"
 #include "vga.h"
 #include "paging.h"
 #include "pic.h"
 #include "inout.h"
 #include "setup.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VGA_SPAN_SIMD 1
+#elif defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#include <arm_neon.h>
+#define VGA_SPAN_SIMD 1
+#endif
+
 
 #ifndef C_VGARAM_CHECKED
 #define C_VGARAM_CHECKED 1
@@ -47,12 +56,20 @@
 #define CHECKED4(v) ((v)&((vga.vmemwrap>>2)-1))
 
 
-#ifdef VGA_KEEP_CHANGES
-#define MEM_CHANGED( _MEM ) vga.changes.map[ (_MEM) >> VGA_CHANGE_SHIFT ] |= vga.changes.writeMask;
-//#define MEM_CHANGED( _MEM ) vga.changes.map[ (_MEM) >> VGA_CHANGE_SHIFT ] = 1;
-#else
-#define MEM_CHANGED( _MEM ) 
-#endif
+// Stamps the blocks holding the bytes first to last, addressed the way the
+// draw functions read them, with the number of the frame being drawn. A range
+// that wrapped around the end of video memory invalidates everything.
+static inline void mem_changed(const uint32_t first, const uint32_t last)
+{
+	if (GCC_UNLIKELY(last < first)) {
+		VGA_MarkAllChanged();
+		return;
+	}
+	constexpr auto block_mask = vga_changes_blocks - 1;
+	for (auto block = first >> VGA_CHANGE_SHIFT;
+	     block <= (last >> VGA_CHANGE_SHIFT); ++block)
+		vga.changes.map[block & block_mask] = vga.changes.frame;
+}
 
 #define TANDY_VIDBASE(_X_)  &MemBase[ 0x80000 + (_X_)]
 
@@ -103,6 +120,101 @@ inline static uint32_t ModeOperation(uint8_t val) {
 	return full;
 }
 
+/* Planar span writes
+ * Write mode 0 without rotation covers nearly all planar blits and clears.
+ * The registers can't change within a span, so every stage reduces to
+ * constants: each byte is copied to the four planes, goes through set/reset,
+ * the logical operation with the latches and the bit mask, and is merged
+ * into the planes enabled by the map mask. A vector holds four bytes' worth
+ * of planes.
+ */
+#if defined(VGA_SPAN_SIMD)
+#if defined(__SSE2__) || defined(_M_X64)
+using plane_vec = __m128i;
+static inline plane_vec vec_splat(const uint32_t v) { return _mm_set1_epi32(static_cast<int>(v)); }
+static inline plane_vec vec_and(const plane_vec a, const plane_vec b) { return _mm_and_si128(a, b); }
+static inline plane_vec vec_or(const plane_vec a, const plane_vec b) { return _mm_or_si128(a, b); }
+static inline plane_vec vec_xor(const plane_vec a, const plane_vec b) { return _mm_xor_si128(a, b); }
+static inline plane_vec vec_load(const uint32_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+static inline void vec_store(uint32_t *p, const plane_vec v) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+static inline plane_vec vec_expand(const uint8_t *data)
+{
+	const auto x = _mm_cvtsi32_si128(static_cast<int>(host_readd(data)));
+	const auto y = _mm_unpacklo_epi8(x, x);
+	return _mm_unpacklo_epi16(y, y);
+}
+#else
+using plane_vec = uint32x4_t;
+static inline plane_vec vec_splat(const uint32_t v) { return vdupq_n_u32(v); }
+static inline plane_vec vec_and(const plane_vec a, const plane_vec b) { return vandq_u32(a, b); }
+static inline plane_vec vec_or(const plane_vec a, const plane_vec b) { return vorrq_u32(a, b); }
+static inline plane_vec vec_xor(const plane_vec a, const plane_vec b) { return veorq_u32(a, b); }
+static inline plane_vec vec_load(const uint32_t *p) { return vld1q_u32(p); }
+static inline void vec_store(uint32_t *p, const plane_vec v) { vst1q_u32(p, v); }
+static inline plane_vec vec_expand(const uint8_t *data)
+{
+	const auto x = vreinterpret_u8_u32(vdup_n_u32(host_readd(data)));
+	const auto y = vzip_u8(x, x).val[0];
+	const auto z = vzip_u8(y, y);
+	return vreinterpretq_u32_u8(vcombine_u8(z.val[0], z.val[1]));
+}
+#endif
+
+template <uint8_t raster_op>
+static void write_planes_mode0(uint32_t *planes, const uint8_t *data, const uint32_t vectors)
+{
+	const auto not_enable_set_reset = vec_splat(vga.config.full_not_enable_set_reset);
+	const auto enable_and_set_reset = vec_splat(vga.config.full_enable_and_set_reset);
+	const auto bit_mask     = vec_splat(vga.config.full_bit_mask);
+	const auto not_bit_mask = vec_splat(~vga.config.full_bit_mask);
+	const auto latch        = vec_splat(vga.latch.d);
+	const auto map_mask     = vec_splat(vga.config.full_map_mask);
+	const auto not_map_mask = vec_splat(vga.config.full_not_map_mask);
+
+	for (uint32_t i = 0; i < vectors; ++i, data += 4, planes += 4) {
+		auto full = vec_or(vec_and(vec_expand(data), not_enable_set_reset),
+		                   enable_and_set_reset);
+		// Same as RasterOp()
+		if constexpr (raster_op == 0)
+			full = vec_or(vec_and(full, bit_mask), vec_and(latch, not_bit_mask));
+		else if constexpr (raster_op == 1)
+			full = vec_and(vec_or(full, not_bit_mask), latch);
+		else if constexpr (raster_op == 2)
+			full = vec_or(vec_and(full, bit_mask), latch);
+		else
+			full = vec_xor(vec_and(full, bit_mask), latch);
+
+		const auto old = vec_load(planes);
+		vec_store(planes, vec_or(vec_and(old, not_map_mask),
+		                         vec_and(full, map_mask)));
+	}
+}
+#endif
+
+// Writes the leading part of a span of bytes to the planes at 'start' and
+// returns its size; the caller writes the rest byte by byte
+static uint32_t write_planes_span([[maybe_unused]] const PhysPt start,
+                                  [[maybe_unused]] const uint8_t *data,
+                                  [[maybe_unused]] const uint32_t bytes)
+{
+#if defined(VGA_SPAN_SIMD)
+	if (vga.config.write_mode != 0 || vga.config.data_rotate != 0)
+		return 0;
+
+	const auto planes  = reinterpret_cast<uint32_t *>(vga.mem.linear) + start;
+	const auto vectors = bytes / 4;
+	switch (vga.config.raster_op) {
+	case 0: write_planes_mode0<0>(planes, data, vectors); break;
+	case 1: write_planes_mode0<1>(planes, data, vectors); break;
+	case 2: write_planes_mode0<2>(planes, data, vectors); break;
+	default: write_planes_mode0<3>(planes, data, vectors); break;
+	}
+	return vectors * 4;
+#else
+	return 0;
+#endif
+}
+
 /* Gonna assume that whoever maps vga memory, maps it on 32/64kb boundary */
 
 #define VGA_PAGES		(128/4)
@@ -191,7 +303,18 @@ public:
 	}
 public:	
 	VGA_ChainedEGA_Handler()  {
-		flags=PFLAG_NOCODE;
+		flags=PFLAG_NOCODE|PFLAG_WRITESPAN;
+	}
+
+	void write_span(PhysPt addr, const uint8_t *data, uint32_t bytes)
+	{
+		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
+		addr += vga.svga.bank_write_full;
+		if (bytes)
+			mem_changed((CHECKED(addr) >> 2) << 3,
+			            ((CHECKED(addr + bytes - 1) >> 2) << 3) + 7);
+		for (uint32_t i = 0; i < bytes; ++i)
+			writeHandler(CHECKED(addr + i), data[i]);
 	}
 
 	void writeb(PhysPt addr, uint8_t val)
@@ -199,7 +322,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		mem_changed((addr >> 2) << 3, ((addr >> 2) << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 	}
 
@@ -208,7 +331,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		mem_changed((addr >> 2) << 3, ((CHECKED(addr + 1) >> 2) << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 	}
@@ -218,7 +341,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		mem_changed((addr >> 2) << 3, ((CHECKED(addr + 3) >> 2) << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 		writeHandler(addr+2,(uint8_t)(val >> 16));
@@ -264,6 +387,9 @@ public:
 		pixels.d&=vga.config.full_not_map_mask;
 		pixels.d|=(data & vga.config.full_map_mask);
 		((uint32_t*)vga.mem.linear)[start]=pixels.d;
+		UpdatePixels(start, pixels);
+	}
+	void UpdatePixels(PhysPt start, const VGA_Latch pixels) {
 		uint8_t * write_pixels=&vga.fastmem[start<<3];
 
 		uint32_t colors0_3, colors4_7;
@@ -284,7 +410,27 @@ public:
 	}
 public:	
 	VGA_UnchainedEGA_Handler()  {
-		flags=PFLAG_NOCODE;
+		flags=PFLAG_NOCODE|PFLAG_WRITESPAN;
+	}
+
+	void write_span(PhysPt addr, const uint8_t *data, uint32_t bytes)
+	{
+		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
+		addr += vga.svga.bank_write_full;
+		if (bytes)
+			mem_changed(CHECKED2(addr) << 3,
+			            (CHECKED2(addr + bytes - 1) << 3) + 7);
+		uint32_t done = 0;
+		if (CHECKED2(addr + bytes - 1) == addr + bytes - 1) {
+			done = write_planes_span(addr, data, bytes);
+			for (uint32_t i = 0; i < done; ++i) {
+				VGA_Latch pixels;
+				pixels.d = ((uint32_t*)vga.mem.linear)[addr + i];
+				UpdatePixels(addr + i, pixels);
+			}
+		}
+		for (uint32_t i = done; i < bytes; ++i)
+			writeHandler(CHECKED2(addr + i), data[i]);
 	}
 
 	void writeb(PhysPt addr, uint8_t val)
@@ -292,7 +438,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 3);
+		mem_changed(addr << 3, (addr << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 	}
 
@@ -301,7 +447,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 3);
+		mem_changed(addr << 3, (CHECKED2(addr + 1) << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 	}
@@ -311,7 +457,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 3);
+		mem_changed(addr << 3, (CHECKED2(addr + 3) << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 		writeHandler(addr+2,(uint8_t)(val >> 16));
@@ -323,7 +469,7 @@ public:
 class VGA_ChainedVGA_Handler final : public PageHandler {
 public:
 	VGA_ChainedVGA_Handler()  {
-		flags=PFLAG_NOCODE;
+		flags=PFLAG_NOCODE|PFLAG_WRITESPAN;
 	}
 	static inline uint8_t *ToLinear(PhysPt addr)
 	{
@@ -429,18 +575,30 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
+		mem_changed(addr, addr);
 		writeHandler_byte(addr, val);
 		writeCache_byte(addr, val);
 	}
 
+	void write_span(PhysPt addr, const uint8_t *data, uint32_t bytes)
+	{
+		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
+		addr += vga.svga.bank_write_full;
+		if (bytes)
+			mem_changed(CHECKED(addr), CHECKED(addr + bytes - 1));
+		for (uint32_t i = 0; i < bytes; ++i) {
+			const auto span_addr = CHECKED(addr + i);
+			writeHandler_byte(span_addr, data[i]);
+			writeCache_byte(span_addr, data[i]);
+		}
+	}
+
 	void writew(PhysPt addr, uint16_t val)
 	{
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
-//		MEM_CHANGED( addr + 1);
+		mem_changed(addr, CHECKED(addr + 1));
 		if (GCC_UNLIKELY(addr & 1)) {
 			writeHandler_byte(addr + 0, val >> 0);
 			writeHandler_byte(addr + 1, val >> 8);
@@ -455,8 +613,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
-//		MEM_CHANGED( addr + 3);
+		mem_changed(addr, CHECKED(addr + 3));
 		if (GCC_UNLIKELY(addr & 3)) {
 			writeHandler_byte(addr + 0, val >> 0);
 			writeHandler_byte(addr + 1, val >> 8);
@@ -483,7 +640,21 @@ public:
 	}
 public:
 	VGA_UnchainedVGA_Handler()  {
-		flags=PFLAG_NOCODE;
+		flags=PFLAG_NOCODE|PFLAG_WRITESPAN;
+	}
+
+	void write_span(PhysPt addr, const uint8_t *data, uint32_t bytes)
+	{
+		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
+		addr += vga.svga.bank_write_full;
+		if (bytes)
+			mem_changed(CHECKED2(addr) << 2,
+			            (CHECKED2(addr + bytes - 1) << 2) + 3);
+		uint32_t done = 0;
+		if (CHECKED2(addr + bytes - 1) == addr + bytes - 1)
+			done = write_planes_span(addr, data, bytes);
+		for (uint32_t i = done; i < bytes; ++i)
+			writeHandler(CHECKED2(addr + i), data[i]);
 	}
 
 	void writeb(PhysPt addr, uint8_t val)
@@ -491,7 +662,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 2 );
+		mem_changed(addr << 2, (addr << 2) + 3);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 	}
 
@@ -500,7 +671,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 2);
+		mem_changed(addr << 2, (CHECKED2(addr + 1) << 2) + 3);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 	}
@@ -510,7 +681,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 2);
+		mem_changed(addr << 2, (CHECKED2(addr + 3) << 2) + 3);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 		writeHandler(addr+2,(uint8_t)(val >> 16));
@@ -545,14 +716,20 @@ public:
 		
 		if (GCC_LIKELY(vga.seq.map_mask == 0x4)) {
 			vga.draw.font[addr] = val;
+			VGA_MarkAllChanged();
 		} else {
-			if (vga.seq.map_mask & 0x4) // font map
+			if (vga.seq.map_mask & 0x4) { // font map
 				vga.draw.font[addr] = val;
+				VGA_MarkAllChanged();
+			}
+			const auto cell = CHECKED3(vga.svga.bank_read_full + addr);
 			if (vga.seq.map_mask & 0x2) // character attribute
 				vga.mem.linear[CHECKED3(vga.svga.bank_read_full +
 				                        addr + 1)] = val;
 			if (vga.seq.map_mask & 0x1) // character index
-				vga.mem.linear[CHECKED3(vga.svga.bank_read_full + addr)] = val;
+				vga.mem.linear[cell] = val;
+			if (vga.seq.map_mask & 0x3)
+				mem_changed(cell, CHECKED3(cell + 1));
 		}
 	}
 };
@@ -606,7 +783,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
+		mem_changed(addr, addr);
 		host_writeb(&vga.mem.linear[addr], val);
 	}
 
@@ -615,7 +792,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED(addr);
+		mem_changed(addr, addr + 1);
 		host_writew_at(vga.mem.linear, addr, val);
 	}
 
@@ -624,7 +801,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED(addr);
+		mem_changed(addr, addr + 3);
 		host_writed_at(vga.mem.linear, addr, val);
 	}
 };
@@ -638,7 +815,7 @@ public:
 	{
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
-		MEM_CHANGED( addr << 3 );
+		mem_changed(addr << 3, (addr << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 	}
 
@@ -646,7 +823,7 @@ public:
 	{
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
-		MEM_CHANGED( addr << 3 );
+		mem_changed(addr << 3, (CHECKED4(addr + 1) << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 	}
@@ -655,7 +832,7 @@ public:
 	{
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
-		MEM_CHANGED( addr << 3 );
+		mem_changed(addr << 3, (CHECKED4(addr + 3) << 3) + 7);
 		writeHandler(addr+0,(uint8_t)(val >> 0));
 		writeHandler(addr+1,(uint8_t)(val >> 8));
 		writeHandler(addr+2,(uint8_t)(val >> 16));
@@ -721,7 +898,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
 		host_writeb(&vga.mem.linear[addr], val);
-		MEM_CHANGED( addr );
+		mem_changed(addr, addr);
 	}
 
 	void writew(PhysPt addr, uint16_t val)
@@ -729,7 +906,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
 		host_writew_at(vga.mem.linear, addr, val);
-		MEM_CHANGED( addr );
+		mem_changed(addr, addr + 1);
 	}
 
 	void writed(PhysPt addr, uint32_t val)
@@ -737,7 +914,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
 		host_writed_at(vga.mem.linear, addr, val);
-		MEM_CHANGED( addr );
+		mem_changed(addr, addr + 3);
 	}
 };
 
@@ -889,14 +1066,39 @@ static struct vg {
 	VGA_Empty_Handler empty = {};
 } vgaph;
 
+// The pages VGA_SetupHandlers last mapped the memory window over. Until it
+// runs again, a bank switch only moves the window: the handlers stay, and
+// only the directly mapped pages hold the bank, in their TLB entries.
+static struct {
+	Bitu page = 0;
+	Bitu pages = 0;
+	bool is_current = false;
+	uint32_t frame_switches = 0;
+} bank_window = {};
+
 void VGA_ChangedBank(void) {
+	++bank_window.frame_switches;
+	METRICS_Add(Metric::VgaBankSwitches);
 #ifndef VGA_LFB_MAPPED
 	//If the mode is accurate than the correct mapper must have been installed already
 	if ( vga.mode >= M_LIN4 && vga.mode <= M_LIN32 ) {
 		return;
 	}
 #endif
-	VGA_SetupHandlers();
+	// With paging, any linear page could map the window
+	if (!bank_window.is_current || PAGING_Enabled()) {
+		VGA_SetupHandlers();
+		return;
+	}
+	vga.svga.bank_read_full = vga.svga.bank_read*vga.svga.bank_size;
+	vga.svga.bank_write_full = vga.svga.bank_write*vga.svga.bank_size;
+	PAGING_RelinkPages(bank_window.page, bank_window.pages);
+}
+
+void VGA_EndFrameBankSwitches()
+{
+	METRICS_Set(Metric::VgaBankSwitchesPerFrame, bank_window.frame_switches);
+	bank_window.frame_switches = 0;
 }
 
 void VGA_SetupHandlers(void) {
@@ -904,6 +1106,8 @@ void VGA_SetupHandlers(void) {
 	vga.svga.bank_write_full = vga.svga.bank_write*vga.svga.bank_size;
 
 	PageHandler *newHandler;
+	vga.changes.tracked = false;
+	bank_window.is_current = false;
 	switch (machine) {
 	case MCH_CGA:
 	case MCH_PCJR:
@@ -1001,6 +1205,13 @@ void VGA_SetupHandlers(void) {
 		newHandler = &vgaph.map;
 		break;
 	}
+	// Only these handlers stamp the blocks they write
+	vga.changes.tracked = newHandler == &vgaph.text ||
+	                      newHandler == &vgaph.cvga ||
+	                      newHandler == &vgaph.uvga ||
+	                      newHandler == &vgaph.cega ||
+	                      newHandler == &vgaph.uega ||
+	                      newHandler == &vgaph.lin4;
 	switch ((vga.gfx.miscellaneous >> 2) & 3) {
 	case 0:
 		vgapages.base = VGA_PAGE_A0;
@@ -1015,12 +1226,14 @@ void VGA_SetupHandlers(void) {
 			break;
 		}
 		MEM_SetPageHandler(VGA_PAGE_A0, 32, newHandler );
+		bank_window.pages = 32;
 		break;
 	case 1:
 		vgapages.base = VGA_PAGE_A0;
 		vgapages.mask = 0xffff;
 		MEM_SetPageHandler( VGA_PAGE_A0, 16, newHandler );
 		MEM_SetPageHandler( VGA_PAGE_B0, 16, &vgaph.empty );
+		bank_window.pages = 16;
 		break;
 	case 2:
 		vgapages.base = VGA_PAGE_B0;
@@ -1028,6 +1241,7 @@ void VGA_SetupHandlers(void) {
 		MEM_SetPageHandler( VGA_PAGE_B0, 8, newHandler );
 		MEM_SetPageHandler( VGA_PAGE_A0, 16, &vgaph.empty );
 		MEM_SetPageHandler( VGA_PAGE_B8, 8, &vgaph.empty );
+		bank_window.pages = 8;
 		break;
 	case 3:
 		vgapages.base = VGA_PAGE_B8;
@@ -1035,11 +1249,17 @@ void VGA_SetupHandlers(void) {
 		MEM_SetPageHandler( VGA_PAGE_B8, 8, newHandler );
 		MEM_SetPageHandler( VGA_PAGE_A0, 16, &vgaph.empty );
 		MEM_SetPageHandler( VGA_PAGE_B0, 8, &vgaph.empty );
+		bank_window.pages = 8;
 		break;
 	}
-	if(svgaCard == SVGA_S3Trio && (vga.s3.ext_mem_ctrl & 0x10))
+	bank_window.page = vgapages.base;
+	bank_window.is_current = true;
+	if(svgaCard == SVGA_S3Trio && (vga.s3.ext_mem_ctrl & 0x10)) {
 		MEM_SetPageHandler(VGA_PAGE_A0, 16, &vgaph.mmio);
+		vga.changes.tracked = false;
+	}
 range_done:
+	VGA_MarkAllChanged();
 	PAGING_ClearTLB();
 }
 
@@ -1054,13 +1274,7 @@ void VGA_StartUpdateLFB(void) {
 	MEM_SetLFB(vga.lfb.page, vga.vmemsize / 4096, vga.lfb.handler, &vgaph.mmio);
 }
 
-static void VGA_Memory_ShutDown(Section * /*sec*/) {
-#ifdef VGA_KEEP_CHANGES
-	delete[] vga.changes.map;
-#endif
-}
-
-void VGA_SetupMemory(Section* sec) {
+void VGA_SetupMemory(Section * /*sec*/) {
 	vga.svga.bank_read = vga.svga.bank_write = 0;
 	vga.svga.bank_read_full = vga.svga.bank_write_full = 0;
 
@@ -1080,17 +1294,11 @@ void VGA_SetupMemory(Section* sec) {
 	// vmemwrap <= vmemsize, fastmem implicitly has mem wrap twice as big
 	vga.vmemwrap = vga.vmemsize;
 
-#ifdef VGA_KEEP_CHANGES
-	memset( &vga.changes, 0, sizeof( vga.changes ));
-	int changesMapSize = (vga.vmemsize >> VGA_CHANGE_SHIFT) + 32;
-	vga.changes.map = new uint8_t[changesMapSize];
-	memset(vga.changes.map, 0, changesMapSize);
-#endif
+	vga.changes = {};
 	vga.svga.bank_read = vga.svga.bank_write = 0;
 	vga.svga.bank_read_full = vga.svga.bank_write_full = 0;
 	vga.svga.bank_size = 0x10000; /* most common bank size is 64K */
 
-	sec->AddDestroyFunction(&VGA_Memory_ShutDown);
 
 	if (machine==MCH_PCJR) {
 		/* PCJr does not have dedicated graphics memory but uses
@@ -55,6 +55,29 @@ uint8_t vga_read_p3da(io_port_t, io_width_t)
 	return retval;
 }
 
+// The time the status bits next change, for programs waiting on the retrace
+static double vga_poll_p3da(io_port_t)
+{
+	const auto &delay = vga.draw.delay;
+	const auto timeInFrame = PIC_FullIndex() - delay.framestart;
+
+	auto next = io_poll_until_event; // the end of the frame is an event
+	auto consider = [&](const double boundary) {
+		if (boundary > timeInFrame && boundary < next)
+			next = boundary;
+	};
+	consider(delay.vrstart);
+	consider(delay.vrend);
+	consider(delay.vdend);
+	if (timeInFrame < delay.vdend && delay.htotal > 0) {
+		const auto lineStart = timeInFrame - fmod(timeInFrame, delay.htotal);
+		consider(lineStart + delay.hblkstart);
+		consider(lineStart + delay.hblkend);
+		consider(lineStart + delay.htotal);
+	}
+	return delay.framestart + next;
+}
+
 static void write_p3c2(io_port_t, io_val_t value, io_width_t)
 {
 	const auto val = check_cast<uint8_t>(value);
@@ -104,6 +127,8 @@ static void write_p3c2(io_port_t, io_val_t value, io_width_t)
 
 	IO_RegisterReadHandler(active_base + 0xa, vga_read_p3da, io_width_t::byte);
 	IO_FreeReadHandler(inactive_base + 0xa, io_width_t::byte);
+	IO_RegisterPollHint(active_base + 0xa, vga_poll_p3da);
+	IO_FreePollHint(inactive_base + 0xa);
 }
 
 static uint8_t read_p3cc(io_port_t, io_width_t)
@@ -161,5 +186,6 @@ void VGA_SetupMisc(void) {
 		}
 	} else if (machine==MCH_CGA || IS_TANDY_ARCH) {
 		IO_RegisterReadHandler(0x3da, vga_read_p3da, io_width_t::byte);
+		IO_RegisterPollHint(0x3da, vga_poll_p3da);
 	}
 }
@@ -819,6 +819,8 @@ static void write_cga(io_port_t port, io_val_t value, io_width_t)
 	switch (port) {
 	case 0x3d8:
 		vga.tandy.mode_control = val;
+		if (vga.attr.disabled != ((val & 0x8) ? 0 : 1))
+			VGA_NoteDisplayChange();
 		vga.attr.disabled = (val&0x8)? 0: 1;
 		if (vga.tandy.mode_control & 0x2) {		// graphics mode
 			if (vga.tandy.mode_control & 0x10) {// highres mode
@@ -65,7 +65,7 @@ void SVGA_S3_WriteCRTC(io_port_t reg, io_val_t value, io_width_t)
 			vga.svga.bank_read&=0xf0;
 			vga.svga.bank_read|=val & 0xf;
 			vga.svga.bank_write = vga.svga.bank_read;
-			VGA_SetupHandlers();
+			VGA_ChangedBank();
 		}
 		break;
 		/*
@@ -177,7 +177,7 @@ void SVGA_S3_WriteCRTC(io_port_t reg, io_val_t value, io_width_t)
 			vga.svga.bank_read&=0xcf;
 			vga.svga.bank_read|=(val&0xc)<<2;
 			vga.svga.bank_write = vga.svga.bank_read;
-			VGA_SetupHandlers();
+			VGA_ChangedBank();
 		}
 		if (((val & 0x30) ^ (vga.config.scan_len >> 4)) & 0x30) {
 			vga.config.scan_len&=0xff;
@@ -350,7 +350,7 @@ void SVGA_S3_WriteCRTC(io_port_t reg, io_val_t value, io_width_t)
 	case 0x6a:	/* Extended System Control 4 */
 		vga.svga.bank_read=val & 0x7f;
 		vga.svga.bank_write = vga.svga.bank_read;
-		VGA_SetupHandlers();
+		VGA_ChangedBank();
 		break;
 	case 0x6b:	// BIOS scratchpad: LFB address
 		vga.s3.reg_6b = val;
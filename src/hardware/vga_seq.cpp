@@ -49,8 +49,11 @@ void write_p3c5(io_port_t, io_val_t value, io_width_t)
 			} else {
 				seq(clocking_mode)=val;
 			}
+			const auto was_disabled = vga.attr.disabled;
 			if (val & 0x20) vga.attr.disabled |= 0x2;
 			else vga.attr.disabled &= ~0x2;
+			if (vga.attr.disabled != was_disabled)
+				VGA_NoteDisplayChange();
 		}
 		/* TODO Figure this out :)
 			0	If set character clocks are 8 dots wide, else 9.
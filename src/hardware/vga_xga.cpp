@@ -18,6 +18,7 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <cassert>
 #include <math.h>
 #include <stdio.h>
@@ -27,6 +28,7 @@
 #include "callback.h"
 #include "cpu.h"		// for 0x3da delay
 #include "inout.h"
+#include "tracy.h"
 #include "vga.h"
 
 constexpr auto &XGA_SCREEN_WIDTH = vga.s3.xga_screen_width;
@@ -81,6 +83,16 @@ struct XGAStatus {
 
 } xga;
 
+// Accelerator commands since the last frame, and how many of their rows were
+// drawn as runs of pixels
+static struct {
+	int fills = 0;
+	int blits = 0;
+	int patterns = 0;
+	int lines = 0;
+	int run_rows = 0;
+} xga_counts;
+
 static void XGA_Write_Multifunc(Bitu val)
 {
 	Bitu regselect = val >> 12;
@@ -254,8 +266,222 @@ static Bitu GetMixResult(uint32_t mixmode, Bitu srcval, Bitu dstdata)
 	return destval;
 }
 
+// Drawing in runs of pixels
+// ~~~~~~~~~~~~~~~~~~~~~~~~~
+// Rectangle fills, blits, and pattern fills are drawn a row at a time. A row
+// lying in video memory is clipped to the scissors once and mixed through
+// typed pointers, with the mix decided once per row, so the compiler can
+// vectorize the loops. Rows partly outside of video memory are drawn point
+// by point.
+
+// The pixels x_first to x_last of row y lie within the scissors and video
+// memory, clipped to them
+struct XGA_Run {
+	Bits y = 0;
+	Bits x_first = 0;
+	Bits x_last = 0;
+};
+
+enum class XGA_Clip {
+	Nothing, // no pixel of the row is drawn
+	Run,     // the row is drawn as a run
+	Points,  // the row has to be drawn point by point
+};
+
+static bool XGA_DrawsPoints()
+{
+	return (xga.curcommand & 0x1) && (xga.curcommand & 0x10);
+}
+
+static Bitu XGA_BytesPerPixel()
+{
+	switch (XGA_COLOR_MODE) {
+	case M_LIN8: return 1;
+	case M_LIN15:
+	case M_LIN16: return 2;
+	case M_LIN32: return 4;
+	default: return 0;
+	}
+}
+
+// Whether the given pixels of a row, lying in the same row of pixels as
+// x_first, can be read from video memory
+static bool XGA_InMemory(const Bits y, const Bits x_first, const Bits x_last)
+{
+	if (y < 0 || x_first < 0)
+		return false;
+	const auto end = static_cast<Bitu>(y) * XGA_SCREEN_WIDTH +
+	                 static_cast<Bitu>(x_last) + 1;
+	return end * XGA_BytesPerPixel() <= vga.vmemsize;
+}
+
+// Clips the pixels from x to x + (count - 1) * dx of row y
+static XGA_Clip XGA_ClipRun(const Bits x, const Bits y, const Bits dx,
+                            const Bits count, XGA_Run &run)
+{
+	if (!XGA_DrawsPoints() || y < xga.scissors.y1 || y > xga.scissors.y2)
+		return XGA_Clip::Nothing;
+	const auto x_lowest = dx > 0 ? x : x - (count - 1);
+	run.y = y;
+	run.x_first = std::max(x_lowest, static_cast<Bits>(xga.scissors.x1));
+	run.x_last = std::min(x_lowest + count - 1,
+	                      static_cast<Bits>(xga.scissors.x2));
+	if (run.x_first > run.x_last)
+		return XGA_Clip::Nothing;
+	return XGA_BytesPerPixel() && XGA_InMemory(y, run.x_first, run.x_last)
+	             ? XGA_Clip::Run
+	             : XGA_Clip::Points;
+}
+
+template <typename T>
+static T *XGA_PixelAt(const Bits x, const Bits y)
+{
+	return reinterpret_cast<T *>(vga.mem.linear) +
+	       static_cast<Bitu>(y) * XGA_SCREEN_WIDTH + static_cast<Bitu>(x);
+}
+
+// Mixes count pixels of dst, walked in the given direction, with the values
+// returned by source for each of them; masked like XGA_DrawPoint
+template <typename T, typename Source>
+static void XGA_MixRun(const uint32_t mixmode, T *dst, const Bits count,
+                       const Bits dx, const T mask, Source source)
+{
+	auto apply = [=](auto mix) {
+		if (dx > 0) {
+			for (Bits i = 0; i < count; ++i)
+				dst[i] = static_cast<T>(mix(source(i), dst[i]) & mask);
+		} else {
+			for (Bits i = 0; i > -count; --i)
+				dst[i] = static_cast<T>(mix(source(i), dst[i]) & mask);
+		}
+	};
+	using V = uint32_t;
+	switch (mixmode & 0xf) {
+	case 0x00: apply([](V, V d) { return ~d; }); break;
+	case 0x01: apply([](V, V) { return V(0); }); break;
+	case 0x02: apply([](V, V) { return ~V(0); }); break;
+	case 0x03: apply([](V, V d) { return d; }); break;
+	case 0x04: apply([](V s, V) { return ~s; }); break;
+	case 0x05: apply([](V s, V d) { return s ^ d; }); break;
+	case 0x06: apply([](V s, V d) { return ~(s ^ d); }); break;
+	case 0x07: apply([](V s, V) { return s; }); break;
+	case 0x08: apply([](V s, V d) { return ~(s & d); }); break;
+	case 0x09: apply([](V s, V d) { return ~s | d; }); break;
+	case 0x0a: apply([](V s, V d) { return s | ~d; }); break;
+	case 0x0b: apply([](V s, V d) { return s | d; }); break;
+	case 0x0c: apply([](V s, V d) { return s & d; }); break;
+	case 0x0d: apply([](V s, V d) { return s & ~d; }); break;
+	case 0x0e: apply([](V s, V d) { return ~s & d; }); break;
+	case 0x0f: apply([](V s, V d) { return ~(s | d); }); break;
+	}
+}
+
+// Calls draw with the pixel type and write mask of the colour mode
+template <typename Draw>
+static void XGA_WithPixelType(Draw draw)
+{
+	switch (XGA_COLOR_MODE) {
+	case M_LIN8: draw(uint8_t(0), uint8_t(0xff)); break;
+	case M_LIN15: draw(uint16_t(0), uint16_t(0x7fff)); break;
+	case M_LIN16: draw(uint16_t(0), uint16_t(0xffff)); break;
+	case M_LIN32: draw(uint32_t(0), uint32_t(0xffffffff)); break;
+	default: break;
+	}
+}
+
+// Mixes a run with a single source colour; the pixels don't depend on each
+// other, so they're drawn left to right
+static void XGA_FillRun(const XGA_Run &run, const uint32_t mixmode,
+                        const Bitu srcval)
+{
+	XGA_WithPixelType([&](auto type, const auto mask) {
+		using T = decltype(type);
+		const auto colour = static_cast<T>(srcval);
+		XGA_MixRun<T>(mixmode, XGA_PixelAt<T>(run.x_first, run.y),
+		              run.x_last - run.x_first + 1, 1, mask,
+		              [colour](Bits) { return uint32_t(colour); });
+	});
+	++xga_counts.run_rows;
+}
+
+// Mixes a run with the pixels source_offset to its right in row src_y, walking
+// both in the direction of the blit as overlapping rows require
+static void XGA_BlitRun(const XGA_Run &run, const Bits src_y,
+                        const Bits source_offset, const Bits dx,
+                        const uint32_t mixmode)
+{
+	const auto x = dx > 0 ? run.x_first : run.x_last;
+	XGA_WithPixelType([&](auto type, const auto mask) {
+		using T = decltype(type);
+		const T *src = XGA_PixelAt<T>(x + source_offset, src_y);
+		XGA_MixRun<T>(mixmode, XGA_PixelAt<T>(x, run.y),
+		              run.x_last - run.x_first + 1, dx, mask,
+		              [src](Bits i) { return uint32_t(src[i]); });
+	});
+	++xga_counts.run_rows;
+}
+
+// Mixes a run with the pixels of an 8 pixel wide pattern at pattern_x in row
+// pattern_y, repeating every 8 pixels. Returns false if the row has to be
+// drawn point by point, when the pattern's source or the run overlap.
+static bool XGA_PatternRun(const XGA_Run &run, const Bits pattern_x,
+                           const Bits pattern_y, const Bitu mixselect,
+                           const uint32_t mixmode)
+{
+	const auto pattern_start = static_cast<Bitu>(pattern_y) * XGA_SCREEN_WIDTH +
+	                           static_cast<Bitu>(pattern_x);
+	const auto run_start = static_cast<Bitu>(run.y) * XGA_SCREEN_WIDTH +
+	                       static_cast<Bitu>(run.x_first);
+	const auto run_end = run_start + static_cast<Bitu>(run.x_last - run.x_first);
+	if (pattern_start <= run_end && run_start < pattern_start + 8)
+		return false;
+
+	// The mix and source value of each of the pattern's pixels
+	uint32_t mixes[8] = {};
+	Bitu srcvals[8] = {};
+	bool single_mix = true;
+	for (Bits p = 0; p < 8; ++p) {
+		const auto srcdata = XGA_GetPoint(pattern_x + p, pattern_y);
+		mixes[p] = mixselect == 0x3 ? (srcdata ? xga.foremix : xga.backmix)
+		                            : mixmode;
+		switch ((mixes[p] >> 5) & 0x03) {
+		case 0x00: srcvals[p] = xga.backcolor; break;
+		case 0x01: srcvals[p] = xga.forecolor; break;
+		case 0x02: return false; // logged when drawn point by point
+		case 0x03: srcvals[p] = srcdata; break;
+		}
+		single_mix = single_mix && (mixes[p] & 0xf) == (mixes[0] & 0xf);
+	}
+
+	const auto count = run.x_last - run.x_first + 1;
+	XGA_WithPixelType([&](auto type, const auto mask) {
+		using T = decltype(type);
+		T *dst = XGA_PixelAt<T>(run.x_first, run.y);
+		uint32_t values[8];
+		for (Bits p = 0; p < 8; ++p)
+			values[p] = static_cast<T>(srcvals[p]);
+		const auto phase = run.x_first;
+		if (single_mix) {
+			XGA_MixRun<T>(mixes[0], dst, count, 1, mask,
+			              [&values, phase](Bits i) {
+				              return values[(phase + i) & 0x7];
+			              });
+			return;
+		}
+		for (Bits i = 0; i < count; ++i) {
+			const auto p = (phase + i) & 0x7;
+			dst[i] = static_cast<T>(
+			        GetMixResult(mixes[p], values[p], dst[i]) & mask);
+		}
+	});
+	++xga_counts.run_rows;
+	return true;
+}
+
 static void XGA_DrawLineVector(const uint32_t val, const bool skip_last_pixel)
 {
+	++xga_counts.lines;
+
 	// No work to do with a zero-length line
 	if (!xga.MAPcount)
 		return;
@@ -359,6 +585,7 @@ static void XGA_DrawLineVector(const uint32_t val, const bool skip_last_pixel)
 // vertical lines
 static void XGA_DrawLineBresenham(const uint32_t val, const bool skip_last_pixel)
 {
+	++xga_counts.lines;
 	Bits xat, yat;
 	Bitu srcval = 0;
 	Bits i;
@@ -515,8 +742,28 @@ static void XGA_DrawRectangle(const uint32_t val, const bool skip_last_pixel)
 	// one pixel too wide (but don't underflow below zero).
 	const auto xrun = xga.MAPcount - (xga.MAPcount && skip_last_pixel);
 
+	++xga_counts.fills;
+
+	// Fills with the foreground or background colour are drawn in runs
+	const auto foremix_source = (xga.foremix >> 5) & 0x03;
+	const bool fills_colour = ((xga.pix_cntl >> 6) & 0x3) == 0 &&
+	                          foremix_source <= 0x01;
+
 	for (auto yat = 0; yat <= xga.MIPcount; ++yat) {
 		srcx = xga.curx;
+		XGA_Run run;
+		const auto clip = fills_colour
+		                        ? XGA_ClipRun(srcx, srcy, dx, xrun + 1, run)
+		                        : XGA_Clip::Points;
+		if (clip != XGA_Clip::Points) {
+			if (clip == XGA_Clip::Run)
+				XGA_FillRun(run, xga.foremix,
+				            foremix_source ? xga.forecolor
+				                           : xga.backcolor);
+			srcx += dx * (xrun + 1);
+			srcy += dy;
+			continue;
+		}
 		for (auto xat = 0; xat <= xrun; ++xat) {
 			uint32_t mixmode = (xga.pix_cntl >> 6) & 0x3;
 			Bitu dstdata;
@@ -820,6 +1067,14 @@ void XGA_BlitRect(Bitu val) {
 			break;
 	}
 
+	++xga_counts.blits;
+
+	// With a single mix, and the source in video memory or a colour, rows
+	// are drawn in runs
+	const auto source = (mixmode >> 5) & 0x03;
+	const bool single_mix = mixselect != 0x3 && source != 0x02;
+	const Bits source_offset = xga.curx - xga.destx;
+
 	/* Copy source to video ram */
 	srcy = xga.cury;
 	tary = xga.desty;
@@ -827,6 +1082,25 @@ void XGA_BlitRect(Bitu val) {
 		srcx = xga.curx;
 		tarx = xga.destx;
 
+		XGA_Run run;
+		auto clip = single_mix
+		                  ? XGA_ClipRun(tarx, tary, dx, xga.MAPcount + 1, run)
+		                  : XGA_Clip::Points;
+		if (clip == XGA_Clip::Run && source == 0x03 &&
+		    !XGA_InMemory(srcy, run.x_first + source_offset,
+		                  run.x_last + source_offset))
+			clip = XGA_Clip::Points;
+		if (clip != XGA_Clip::Points) {
+			if (clip == XGA_Clip::Run && source == 0x03)
+				XGA_BlitRun(run, srcy, source_offset, dx, mixmode);
+			else if (clip == XGA_Clip::Run)
+				XGA_FillRun(run, mixmode,
+				            source ? xga.forecolor : xga.backcolor);
+			srcy += dy;
+			tary += dy;
+			continue;
+		}
+
 		for(xat=0;xat<=xga.MAPcount;xat++) {
 			srcdata = XGA_GetPoint(srcx, srcy);
 			dstdata = XGA_GetPoint(tarx, tary);
@@ -911,8 +1185,23 @@ void XGA_DrawPattern(Bitu val) {
 			break;
 	}
 
+	++xga_counts.patterns;
+
 	for(yat=0;yat<=xga.MIPcount;yat++) {
 		tarx = xga.destx;
+
+		XGA_Run run;
+		const auto clip = mixselect == 0x0 || mixselect == 0x3
+		                        ? XGA_ClipRun(tarx, tary, dx,
+		                                      xga.MAPcount + 1, run)
+		                        : XGA_Clip::Points;
+		if (clip == XGA_Clip::Nothing ||
+		    (clip == XGA_Clip::Run &&
+		     XGA_PatternRun(run, srcx, srcy + (tary & 0x7), mixselect, mixmode))) {
+			tary += dy;
+			continue;
+		}
+
 		for(xat=0;xat<=xga.MAPcount;xat++) {
 
 			srcdata = XGA_GetPoint(srcx + (tarx & 0x7), srcy + (tary & 0x7));
@@ -1101,6 +1390,9 @@ void XGA_Write(io_port_t port, io_val_t val, io_width_t width)
 {
 	//	LOG_MSG("XGA: Write to port %x, val %8x, len %x", port,val, len);
 
+	// The accelerator draws into video memory bypassing the page handlers
+	VGA_MarkAllChanged();
+
 	switch (port) {
 	case 0x8100: // drawing control: row (low word), column (high word)
 		// "CUR_X" and "CUR_Y" (see PORT 82E8h,PORT 86E8h)
@@ -1273,6 +1565,16 @@ uint32_t XGA_Read(io_port_t port, io_width_t width)
 	return 0xffffffff;
 }
 
+void XGA_EndFrame()
+{
+	TracyPlot("XGA fills", static_cast<int64_t>(xga_counts.fills));
+	TracyPlot("XGA blits", static_cast<int64_t>(xga_counts.blits));
+	TracyPlot("XGA pattern fills", static_cast<int64_t>(xga_counts.patterns));
+	TracyPlot("XGA lines", static_cast<int64_t>(xga_counts.lines));
+	TracyPlot("XGA rows drawn as runs", static_cast<int64_t>(xga_counts.run_rows));
+	xga_counts = {};
+}
+
 void VGA_SetupXGA(void) {
 	if (!IS_VGA_ARCH) return;
 
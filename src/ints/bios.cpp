@@ -29,6 +29,8 @@
 #include "pci_bus.h"
 #include "joystick.h"
 #include "mouse.h"
+#include "netplay.h"
+#include "replay.h"
 #include "setup.h"
 #include "serialport.h"
 #include <time.h>
@@ -523,6 +525,14 @@ static void BIOS_HostTimeSync() {
 	loctime = localtime (&timebuffer.time);
 	milli = (uint32_t) timebuffer.millitm;
 #endif
+	// Start a replayed session at the time its recording started, and both
+	// netplay peers at the host's time
+	time_t replay_time = 0;
+	if (REPLAY_IsActive() || NETPLAY_IsActive()) {
+		replay_time = REPLAY_Time();
+		loctime = localtime(&replay_time);
+		milli = 0;
+	}
 	/*
 	loctime->tm_hour = 23;
 	loctime->tm_min = 59;
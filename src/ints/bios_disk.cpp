@@ -20,15 +20,25 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cinttypes>
+#include <unordered_set>
 #include <utility>
 
+#if !defined(WIN32)
+#include <unistd.h>
+#endif
+
 #include "callback.h"
+#include "control.h"
 #include "regs.h"
 #include "mem.h"
 #include "dos_inc.h" /* for Drives[] */
 #include "drives.h"
 #include "mapper.h"
+#include "metrics.h"
+#include "setup.h"
 #include "string_utils.h"
+#include "timer.h"
 
 diskGeo DiskGeometryList[] = {
 	{ 160,  8, 1, 40, 0},	// SS/DD 5.25"
@@ -57,6 +67,24 @@ static bool swapping_requested;
 
 void BIOS_SetEquipment(uint16_t equipment);
 
+// The disk images' block caches read and write in blocks of these many
+// sectors, and read up to these many blocks ahead
+constexpr uint32_t disk_cache_block_sectors = 8;
+constexpr uint32_t disk_cache_readahead_blocks = 16;
+
+static std::unordered_set<imageDisk *> open_disks = {};
+
+// Writes the sectors held back by the disk images' caches once a second
+static void flush_disk_caches()
+{
+	static int ticks = 0;
+	if (++ticks < 1000)
+		return;
+	ticks = 0;
+	for (const auto disk : open_disks)
+		disk->Flush();
+}
+
 /* 2 floppys and 2 harddrives, max */
 std::array<std::shared_ptr<imageDisk>, MAX_DISK_IMAGES> imageDiskList;
 std::array<std::shared_ptr<imageDisk>, MAX_SWAPPABLE_DISKS> diskSwap;
@@ -162,21 +190,46 @@ uint8_t imageDisk::Read_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,v
 	return Read_AbsoluteSector(sectnum, data);
 }
 
+uint8_t imageDisk::Read_Sectors(uint32_t head, uint32_t cylinder, uint32_t sector,
+                                uint32_t count, void *data)
+{
+	const uint32_t sectnum = ((cylinder * heads + head) * sectors) + sector - 1;
+	return Read_AbsoluteSectors(sectnum, count, data);
+}
+
 uint8_t imageDisk::Read_AbsoluteSector(uint32_t sectnum, void *data)
 {
-	const uint32_t bytenum = sectnum * sector_size;
+	return Read_AbsoluteSectors(sectnum, 1, data);
+}
 
-	if (last_action == WRITE || bytenum != current_fpos) {
-		if (fseek(diskimg, bytenum, SEEK_SET) != 0) {
-			LOG_ERR("BIOSDISK: Could not seek to sector %u in file '%s': %s",
+uint8_t imageDisk::Read_AbsoluteSectors(uint32_t sectnum, uint32_t count, void *data)
+{
+	const uint64_t bytenum = static_cast<uint64_t>(sectnum) * sector_size;
+
+	if (!cache_max_blocks) {
+		if (ReadImage(bytenum, data, static_cast<size_t>(count) * sector_size) < 0) {
+			LOG_ERR("BIOSDISK: Could not read sector %u in file '%s': %s",
 			        sectnum, diskname, strerror(errno));
 			return 0xff;
 		}
+		METRICS_Add(Metric::DiskBytesRead, static_cast<int64_t>(count) * sector_size);
+		return 0x00;
 	}
-	size_t ret = fread(data, 1, sector_size, diskimg);
-	current_fpos=bytenum+ret;
-	last_action=READ;
 
+	auto buffer = static_cast<uint8_t *>(data);
+	while (count) {
+		const auto block = GetBlock(sectnum / disk_cache_block_sectors);
+		if (!block)
+			return 0xff;
+		const auto sector_in_block = sectnum % disk_cache_block_sectors;
+		const auto num_sectors = std::min(count, disk_cache_block_sectors - sector_in_block);
+		memcpy(buffer, block->data.data() + sector_in_block * sector_size,
+		       num_sectors * sector_size);
+		METRICS_Add(Metric::DiskBytesRead, static_cast<int64_t>(num_sectors) * sector_size);
+		buffer += num_sectors * sector_size;
+		sectnum += num_sectors;
+		count -= num_sectors;
+	}
 	return 0x00;
 }
 
@@ -189,26 +242,210 @@ uint8_t imageDisk::Write_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,
 }
 
 
+uint8_t imageDisk::Write_Sectors(uint32_t head, uint32_t cylinder, uint32_t sector,
+                                 uint32_t count, const void *data)
+{
+	const uint32_t sectnum = ((cylinder * heads + head) * sectors) + sector - 1;
+	return Write_AbsoluteSectors(sectnum, count, data);
+}
+
 uint8_t imageDisk::Write_AbsoluteSector(uint32_t sectnum, void *data) {
-	uint32_t bytenum;
+	return Write_AbsoluteSectors(sectnum, 1, data);
+}
 
-	bytenum = sectnum * sector_size;
+uint8_t imageDisk::Write_AbsoluteSectors(uint32_t sectnum, uint32_t count, const void *data)
+{
+	const uint64_t bytenum = static_cast<uint64_t>(sectnum) * sector_size;
+	write_count += count;
 
 	//LOG_MSG("Writing sectors to %ld at bytenum %d", sectnum, bytenum);
 
-	if (last_action == READ || bytenum != current_fpos) {
-		if (fseek(diskimg, bytenum, SEEK_SET) != 0) {
-			LOG_ERR("BIOSDISK: Could not seek to byte %u in file '%s': %s",
-			        bytenum, diskname, strerror(errno));
-			return 0xff;
+	if (!cache_max_blocks)
+		return WriteImage(bytenum, data, static_cast<size_t>(count) * sector_size)
+		               ? 0x00
+		               : 0x05;
+
+	// The rest of the blocks is read first, so they can be written back
+	// as a whole
+	auto buffer = static_cast<const uint8_t *>(data);
+	while (count) {
+		const auto block = GetBlock(sectnum / disk_cache_block_sectors);
+		if (!block)
+			return 0x05;
+		const auto sector_in_block = sectnum % disk_cache_block_sectors;
+		const auto num_sectors = std::min(count, disk_cache_block_sectors - sector_in_block);
+		memcpy(block->data.data() + sector_in_block * sector_size, buffer,
+		       num_sectors * sector_size);
+		block->dirty_sectors |= ((1u << num_sectors) - 1) << sector_in_block;
+		buffer += num_sectors * sector_size;
+		sectnum += num_sectors;
+		count -= num_sectors;
+	}
+	return 0x00;
+}
+
+// Reads from the image, filling what lies beyond its end with zeros, and
+// returns the number of bytes read or -1 on errors
+int64_t imageDisk::ReadImage(uint64_t offset, void *data, size_t bytes)
+{
+	auto buffer = static_cast<uint8_t *>(data);
+	size_t bytes_read = 0;
+#if defined(WIN32)
+	if (fseek(diskimg, static_cast<long>(offset), SEEK_SET) != 0)
+		return -1;
+	bytes_read = fread(buffer, 1, bytes, diskimg);
+	if (ferror(diskimg))
+		return -1;
+#else
+	while (bytes_read < bytes) {
+		const auto ret = pread(fileno(diskimg), buffer + bytes_read,
+		                       bytes - bytes_read,
+		                       static_cast<off_t>(offset + bytes_read));
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+		if (ret == 0)
+			break;
+		bytes_read += static_cast<size_t>(ret);
+	}
+#endif
+	memset(buffer + bytes_read, 0, bytes - bytes_read);
+	return static_cast<int64_t>(bytes_read);
+}
+
+bool imageDisk::WriteImage(uint64_t offset, const void *data, size_t bytes)
+{
+#if defined(WIN32)
+	if (fseek(diskimg, static_cast<long>(offset), SEEK_SET) != 0)
+		return false;
+	return fwrite(data, 1, bytes, diskimg) == bytes && fflush(diskimg) == 0;
+#else
+	auto buffer = static_cast<const uint8_t *>(data);
+	size_t bytes_written = 0;
+	while (bytes_written < bytes) {
+		const auto ret = pwrite(fileno(diskimg), buffer + bytes_written,
+		                        bytes - bytes_written,
+		                        static_cast<off_t>(offset + bytes_written));
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+		bytes_written += static_cast<size_t>(ret);
+	}
+	return true;
+#endif
+}
+
+// Returns the cached block, reading it on a miss, along with the blocks
+// following it if the previous block was accessed last
+imageDisk::CachedBlock *imageDisk::GetBlock(uint32_t index)
+{
+	const auto cached = cache_index.find(index);
+	if (cached != cache_index.end()) {
+		cache.splice(cache.begin(), cache, cached->second);
+		last_block = index;
+		return &*cached->second;
+	}
+
+	const size_t block_bytes = disk_cache_block_sectors * sector_size;
+	const bool sequential = (last_block != UINT32_MAX && index == last_block + 1);
+	uint32_t num_blocks = 1;
+	if (sequential) {
+		const auto max_blocks = std::min<size_t>(disk_cache_readahead_blocks,
+		                                         std::max<size_t>(cache_max_blocks / 2, 1));
+		while (num_blocks < max_blocks && !cache_index.count(index + num_blocks))
+			++num_blocks;
+	}
+
+	std::vector<uint8_t> data(num_blocks * block_bytes);
+	const auto bytes_read = ReadImage(static_cast<uint64_t>(index) * block_bytes,
+	                                  data.data(), data.size());
+	if (bytes_read < 0) {
+		LOG_ERR("BIOSDISK: Could not read block %u in file '%s': %s", index,
+		        diskname, strerror(errno));
+		return nullptr;
+	}
+
+	// The block asked for ends up the most recently used, and the ones
+	// read ahead are kept only if they hold some of the image
+	for (auto i = num_blocks; i-- > 0;) {
+		if (i > 0 && static_cast<int64_t>(i * block_bytes) >= bytes_read)
+			continue;
+		if (cache.size() < cache_max_blocks) {
+			cache.emplace_front();
+		} else {
+			auto &oldest = cache.back();
+			if (oldest.dirty_sectors)
+				WriteBack({&oldest});
+			cache_index.erase(oldest.index);
+			cache.splice(cache.begin(), cache, std::prev(cache.end()));
+		}
+		auto &block = cache.front();
+		block.index = index + i;
+		block.dirty_sectors = 0;
+		block.data.assign(data.begin() + i * block_bytes,
+		                  data.begin() + (i + 1) * block_bytes);
+		cache_index[block.index] = cache.begin();
+	}
+	last_block = index;
+	return &cache.front();
+}
+
+// Writes the dirty sectors of the blocks, sorted by their index, joining
+// consecutive sectors into single writes
+void imageDisk::WriteBack(const std::vector<CachedBlock *> &blocks)
+{
+	std::vector<uint8_t> run = {};
+	uint64_t run_start = 0;
+	auto write_run = [&]() {
+		if (!run.empty() && !WriteImage(run_start * sector_size, run.data(), run.size()))
+			LOG_ERR("BIOSDISK: Could not write sectors %" PRIu64 " to %" PRIu64
+			        " in file '%s': %s",
+			        run_start, run_start + run.size() / sector_size - 1,
+			        diskname, strerror(errno));
+		run.clear();
+	};
+
+	for (const auto block : blocks) {
+		for (uint32_t i = 0; i < disk_cache_block_sectors; ++i) {
+			if (!(block->dirty_sectors & (1u << i)))
+				continue;
+			const uint64_t sector = static_cast<uint64_t>(block->index) *
+			                                disk_cache_block_sectors + i;
+			if (sector != run_start + run.size() / sector_size) {
+				write_run();
+				run_start = sector;
+			}
+			const auto data = block->data.data() + i * sector_size;
+			run.insert(run.end(), data, data + sector_size);
 		}
+		block->dirty_sectors = 0;
 	}
-	size_t ret = fwrite(data, 1, sector_size, diskimg);
-	current_fpos=bytenum+ret;
-	last_action=WRITE;
+	write_run();
+}
 
-	return ((ret>0)?0x00:0x05);
+void imageDisk::Flush()
+{
+	std::vector<CachedBlock *> dirty_blocks = {};
+	for (auto &block : cache)
+		if (block.dirty_sectors)
+			dirty_blocks.push_back(&block);
+	if (dirty_blocks.empty())
+		return;
+	std::sort(dirty_blocks.begin(), dirty_blocks.end(),
+	          [](const CachedBlock *a, const CachedBlock *b) {
+		          return a->index < b->index;
+	          });
+	WriteBack(dirty_blocks);
+}
 
+void imageDisk::ClearCache()
+{
+	Flush();
+	cache.clear();
+	cache_index.clear();
+	last_block = UINT32_MAX;
 }
 
 imageDisk::imageDisk(FILE *img_file, const char *img_name, uint32_t img_size_k, bool is_hdd)
@@ -219,10 +456,16 @@ imageDisk::imageDisk(FILE *img_file, const char *img_name, uint32_t img_size_k,
           sector_size(512),
           heads(0),
           cylinders(0),
-          sectors(0),
-          current_fpos(0),
-          last_action(NONE)
+          sectors(0)
 {
+	const auto dos_section = static_cast<Section_prop *>(control->GetSection("dos"));
+	assert(dos_section);
+	cache_max_blocks = static_cast<size_t>(dos_section->Get_int("image_disk_cache")) *
+	                   1024 / (disk_cache_block_sectors * sector_size);
+	if (open_disks.empty())
+		TIMER_AddTickHandler(flush_disk_caches);
+	open_disks.insert(this);
+
 	fseek(diskimg,0,SEEK_SET);
 	memset(diskname,0,512);
 	safe_strcpy(diskname, img_name);
@@ -252,7 +495,22 @@ imageDisk::imageDisk(FILE *img_file, const char *img_name, uint32_t img_size_k,
 	}
 }
 
+imageDisk::~imageDisk()
+{
+	Flush();
+	open_disks.erase(this);
+	if (open_disks.empty())
+		TIMER_DelTickHandler(flush_disk_caches);
+	if (diskimg != nullptr)
+		fclose(diskimg);
+}
+
 void imageDisk::Set_Geometry(uint32_t setHeads, uint32_t setCyl, uint32_t setSect, uint32_t setSectSize) {
+	// The cached blocks are made of whole sectors
+	if (setSectSize != sector_size) {
+		ClearCache();
+		cache_max_blocks = cache_max_blocks * sector_size / setSectSize;
+	}
 	heads = setHeads;
 	cylinders = setCyl;
 	sectors = setSect;
@@ -318,6 +576,31 @@ static bool driveInactive(uint8_t driveNum) {
 	return false;
 }
 
+// The INT 13h transfers move all their sectors in one go, between the image
+// and a host buffer and then as a block to or from the guest memory. The
+// guest buffer wraps within its segment, like with the BIOS's own transfers.
+static std::vector<uint8_t> int13_buffer = {};
+
+static void copy_to_guest(const uint16_t seg, const uint16_t off, const size_t bytes)
+{
+	if (off + bytes <= 0x10000) {
+		MEM_BlockWrite(PhysMake(seg, off), int13_buffer.data(), bytes);
+		return;
+	}
+	for (size_t i = 0; i < bytes; ++i)
+		real_writeb(seg, static_cast<uint16_t>(off + i), int13_buffer[i]);
+}
+
+static void copy_from_guest(const uint16_t seg, const uint16_t off, const size_t bytes)
+{
+	if (off + bytes <= 0x10000) {
+		MEM_BlockRead(PhysMake(seg, off), int13_buffer.data(), bytes);
+		return;
+	}
+	for (size_t i = 0; i < bytes; ++i)
+		int13_buffer[i] = real_readb(seg, static_cast<uint16_t>(off + i));
+}
+
 template<typename T, size_t N>
 static bool has_image(const std::array<T, N> &arr) {
 	auto to_bool = [](const T &x) { return bool(x); };
@@ -325,10 +608,7 @@ static bool has_image(const std::array<T, N> &arr) {
 }
 
 static Bitu INT13_DiskHandler(void) {
-	uint16_t segat, bufptr;
-	uint8_t sectbuf[512];
 	uint8_t  drivenum;
-	Bitu t;
 	last_drive = reg_dl;
 	drivenum = GetDosDriveNumber(reg_dl);
 	const bool any_images = has_image(imageDiskList);
@@ -408,10 +688,10 @@ static Bitu INT13_DiskHandler(void) {
 			return CBRET_NONE;
 		}
 
-		segat = SegValue(es);
-		bufptr = reg_bx;
-		for (Bitu i = 0; i < reg_al; i++) {
-			last_status = imageDiskList[drivenum]->Read_Sector((uint32_t)reg_dh, (uint32_t)(reg_ch | ((reg_cl & 0xc0)<< 2)), (uint32_t)((reg_cl & 63)+i), sectbuf);
+		{
+			const size_t bytes = reg_al * imageDiskList[drivenum]->getSectSize();
+			int13_buffer.resize(std::max(int13_buffer.size(), bytes));
+			last_status = imageDiskList[drivenum]->Read_Sectors((uint32_t)reg_dh, (uint32_t)(reg_ch | ((reg_cl & 0xc0)<< 2)), (uint32_t)(reg_cl & 63), reg_al, int13_buffer.data());
 			if((last_status != 0x00) || (killRead)) {
 				LOG_MSG("Error in disk read");
 				killRead = false;
@@ -419,10 +699,7 @@ static Bitu INT13_DiskHandler(void) {
 				CALLBACK_SCF(true);
 				return CBRET_NONE;
 			}
-			for(t=0;t<512;t++) {
-				real_writeb(segat,bufptr,sectbuf[t]);
-				bufptr++;
-			}
+			copy_to_guest(SegValue(es), reg_bx, bytes);
 		}
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
@@ -433,13 +710,11 @@ static Bitu INT13_DiskHandler(void) {
 			CALLBACK_SCF(true);
 			return CBRET_NONE;
 		}
-		bufptr = reg_bx;
-		for (Bitu i = 0; i < reg_al; i++) {
-			for(t=0;t<imageDiskList[drivenum]->getSectSize();t++) {
-				sectbuf[t] = real_readb(SegValue(es),bufptr);
-				bufptr++;
-			}
-			last_status = imageDiskList[drivenum]->Write_Sector((uint32_t)reg_dh, (uint32_t)(reg_ch | ((reg_cl & 0xc0) << 2)), (uint32_t)((reg_cl & 63) + i), &sectbuf[0]);
+		{
+			const size_t bytes = reg_al * imageDiskList[drivenum]->getSectSize();
+			int13_buffer.resize(std::max(int13_buffer.size(), bytes));
+			copy_from_guest(SegValue(es), reg_bx, bytes);
+			last_status = imageDiskList[drivenum]->Write_Sectors((uint32_t)reg_dh, (uint32_t)(reg_ch | ((reg_cl & 0xc0) << 2)), (uint32_t)(reg_cl & 63), reg_al, int13_buffer.data());
 			if(last_status != 0x00) {
 				CALLBACK_SCF(true);
 				return CBRET_NONE;
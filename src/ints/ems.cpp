@@ -19,6 +19,7 @@
 #include "dosbox.h"
 
 #include <algorithm>
+#include <cinttypes>
 #include <cstring>
 #include <cstdlib>
 
@@ -31,6 +32,7 @@
 #include "inout.h"
 #include "dos_inc.h"
 #include "setup.h"
+#include "snapshot.h"
 #include "support.h"
 #include "cpu.h"
 #include "dma.h"
@@ -300,6 +302,17 @@ static uint8_t EMM_ReallocatePages(uint16_t handle,uint16_t & pages) {
 	return EMM_NO_ERROR;
 }
 
+// Page map calls are counted to measure how hard a program works the EMS
+// page frame; the totals are logged at shutdown
+static struct {
+	uint64_t maps   = 0;
+	uint64_t unmaps = 0;
+} ems_stats = {};
+
+// PAGING_MapPage invalidates the TLB entry of each 4 KB page it remaps,
+// and no other linear page can refer to the remapped memory, so the map
+// calls leave the rest of the TLB in place
+
 static uint8_t EMM_MapPage(Bitu phys_page,uint16_t handle,uint16_t log_page) {
 //	LOG_MSG("EMS MapPage handle %d phys %d log %d",handle,phys_page,log_page);
 	/* Check for too high physical page */
@@ -312,7 +325,7 @@ static uint8_t EMM_MapPage(Bitu phys_page,uint16_t handle,uint16_t log_page) {
 		emm_mappings[phys_page].page=NULL_PAGE;
 		for (Bitu i=0;i<4;i++)
 			PAGING_MapPage(EMM_PAGEFRAME4K+phys_page*4+i,EMM_PAGEFRAME4K+phys_page*4+i);
-		PAGING_ClearTLB();
+		++ems_stats.unmaps;
 		return EMM_NO_ERROR;
 	}
 	/* Check for valid handle */
@@ -328,7 +341,7 @@ static uint8_t EMM_MapPage(Bitu phys_page,uint16_t handle,uint16_t log_page) {
 			PAGING_MapPage(EMM_PAGEFRAME4K+phys_page*4+i,memh);
 			memh=MEM_NextHandle(memh);
 		}
-		PAGING_ClearTLB();
+		++ems_stats.maps;
 		return EMM_NO_ERROR;
 	} else  {
 		/* Illegal logical page it is */
@@ -370,7 +383,7 @@ static uint8_t EMM_MapSegment(Bitu segment,uint16_t handle,uint16_t log_page) {
 			}
 			for (Bitu i=0;i<4;i++)
 				PAGING_MapPage(segment*16/4096+i,segment*16/4096+i);
-			PAGING_ClearTLB();
+			++ems_stats.unmaps;
 			return EMM_NO_ERROR;
 		}
 		/* Check for valid handle */
@@ -391,7 +404,7 @@ static uint8_t EMM_MapSegment(Bitu segment,uint16_t handle,uint16_t log_page) {
 				PAGING_MapPage(segment*16/4096+i,memh);
 				memh=MEM_NextHandle(memh);
 			}
-			PAGING_ClearTLB();
+			++ems_stats.maps;
 			return EMM_NO_ERROR;
 		} else  {
 			/* Illegal logical page it is */
@@ -1367,6 +1380,23 @@ Bitu GetEMSType(Section_prop * section) {
 	return rtype;
 }
 
+// The page frame is mapped through the paging tables, which are saved with
+// the rest of the paging state
+static void ems_snapshot(SnapshotStream &s)
+{
+	auto type = ems_type;
+	s.Pod(type);
+	if (type != ems_type) {
+		s.Fail();
+		return;
+	}
+	s.Pod(emm_handles);
+	s.Pod(emm_mappings);
+	s.Pod(emm_segmentmappings);
+	s.Pod(vcpi);
+	s.Pod(GEMMIS_seg);
+}
+
 class EMS final : public Module_base {
 private:
 	uint16_t ems_baseseg = 0;
@@ -1392,6 +1422,7 @@ public:
 
 		vcpi.enabled=false;
 		GEMMIS_seg=0;
+		SNAPSHOT_AddComponent("ems", ems_snapshot);
 
 		Section_prop * section=static_cast<Section_prop *>(configuration);
 		ems_type=GetEMSType(section);
@@ -1494,6 +1525,11 @@ public:
 	~EMS() {
 		if (ems_type<=0) return;
 
+		if (ems_stats.maps || ems_stats.unmaps)
+			LOG_MSG("EMS: Mapped %" PRIu64 " and unmapped %" PRIu64 " pages",
+			        ems_stats.maps, ems_stats.unmaps);
+		ems_stats = {};
+
 		/* Undo Biosclearing */
 		BIOS_ZeroExtendedSize(false);
 
@@ -25,6 +25,7 @@
 #include "int10.h"
 #include "mouse.h"
 #include "setup.h"
+#include "snapshot.h"
 
 Int10Data int10;
 static Bitu call_10;
@@ -723,6 +724,14 @@ static void SetupTandyBios(void) {
 	}
 }
 
+// The video BIOS keeps its mode in the BIOS data area
+static void int10_snapshot(SnapshotStream &s)
+{
+	s.Pod(int10.vesa_setmode);
+	if (s.IsLoading())
+		INT10_SetCurMode();
+}
+
 void INT10_Init(Section* /*sec*/) {
 	INT10_SetupPalette();
 	INT10_InitVGA();
@@ -735,4 +744,5 @@ void INT10_Init(Section* /*sec*/) {
 	INT10_SetupRomMemory();
 	INT10_Seg40Init();
 	INT10_SetVideoMode(0x3);
+	SNAPSHOT_AddComponent("int10", int10_snapshot);
 }
@@ -206,6 +206,7 @@ void INT10_SetCursorShape(uint8_t first,uint8_t last);
 void INT10_SetCursorPos(uint8_t row,uint8_t col,uint8_t page);
 void INT10_TeletypeOutput(uint8_t chr,uint8_t attr);
 void INT10_TeletypeOutputAttr(uint8_t chr,uint8_t attr,bool useattr);
+void INT10_TeletypeOutputText(const uint8_t *chars, uint16_t count, uint8_t attr, bool useattr);
 void INT10_ReadCharAttr(uint16_t * result,uint8_t page);
 void INT10_WriteChar(uint8_t chr, uint8_t attr, uint8_t page, uint16_t count, bool showattr);
 void INT10_WriteString(uint8_t row,uint8_t col,uint8_t flag,uint8_t attr,PhysPt string,uint16_t count,uint8_t page);
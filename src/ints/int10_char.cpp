@@ -20,12 +20,19 @@
 
 #include "int10.h"
 
+#include <array>
+
 #include "bios.h"
 #include "mem.h"
 #include "inout.h"
 #include "pic.h"
 #include "callback.h"
 
+// The graphics rows are filled and copied a scanline at a time through the
+// block memory functions, which hand them to the video memory at once.
+// A scanline of a character row is at most 8 bytes per column.
+using scanline_t = std::array<uint8_t, 8 * 256>;
+
 static void CGA2_CopyRow(uint8_t cleft,uint8_t cright,uint8_t rold,uint8_t rnew,PhysPt base) {
 	BIOS_CHEIGHT;
 	PhysPt dest=base+((CurMode->twidth*rnew)*(cheight/2)+cleft);
@@ -90,9 +97,11 @@ static void VGA_CopyRow(uint8_t cleft,uint8_t cright,uint8_t rold,uint8_t rnew,P
 	src=base+8*((CurMode->twidth*rold)*cheight+cleft);
 	Bitu nextline=8*CurMode->twidth;
 	Bitu rowsize=8*(cright-cleft);
+	scanline_t line;
 	copy=cheight;
 	for (;copy>0;copy--) {
-		for (Bitu x=0;x<rowsize;x++) mem_writeb(dest+x,mem_readb(src+x));
+		MEM_BlockRead(src,line.data(),rowsize);
+		MEM_BlockWrite(dest,line.data(),rowsize);
 		dest+=nextline;src+=nextline;
 	}
 }
@@ -110,11 +119,11 @@ static void CGA2_FillRow(uint8_t cleft,uint8_t cright,uint8_t row,PhysPt base,ui
 	Bitu copy=(cright-cleft);
 	Bitu nextline=CurMode->twidth;
 	attr=(attr & 0x3) | ((attr & 0x3) << 2) | ((attr & 0x3) << 4) | ((attr & 0x3) << 6);
+	scanline_t line;
+	line.fill(attr);
 	for (Bitu i=0;i<cheight/2U;i++) {
-		for (Bitu x=0;x<copy;x++) {
-			mem_writeb(dest+x,attr);
-			mem_writeb(dest+8*1024+x,attr);
-		}
+		MEM_BlockWrite(dest,line.data(),copy);
+		MEM_BlockWrite(dest+8*1024,line.data(),copy);
 		dest+=nextline;
 	}
 }
@@ -124,11 +133,11 @@ static void CGA4_FillRow(uint8_t cleft,uint8_t cright,uint8_t row,PhysPt base,ui
 	PhysPt dest=base+((CurMode->twidth*row)*(cheight/2)+cleft)*2;
 	Bitu copy=(cright-cleft)*2;Bitu nextline=CurMode->twidth*2;
 	attr=(attr & 0x3) | ((attr & 0x3) << 2) | ((attr & 0x3) << 4) | ((attr & 0x3) << 6);
+	scanline_t line;
+	line.fill(attr);
 	for (Bitu i=0;i<cheight/2U;i++) {
-		for (Bitu x=0;x<copy;x++) {
-			mem_writeb(dest+x,attr);
-			mem_writeb(dest+8*1024+x,attr);
-		}
+		MEM_BlockWrite(dest,line.data(),copy);
+		MEM_BlockWrite(dest+8*1024,line.data(),copy);
 		dest+=nextline;
 	}
 }
@@ -139,10 +148,10 @@ static void TANDY16_FillRow(uint8_t cleft,uint8_t cright,uint8_t row,PhysPt base
 	PhysPt dest=base+((CurMode->twidth*row)*(cheight/banks)+cleft)*4;
 	Bitu copy=(cright-cleft)*4;Bitu nextline=CurMode->twidth*4;
 	attr=(attr & 0xf) | (attr & 0xf) << 4;
+	scanline_t line;
+	line.fill(attr);
 	for (Bitu i=0;i<static_cast<Bitu>(cheight/banks);i++) {
-		for (Bitu x=0;x<copy;x++) {
-			for (Bitu b=0;b<banks;b++) mem_writeb(dest+b*8*1024+x,attr);
-		}
+		for (Bitu b=0;b<banks;b++) MEM_BlockWrite(dest+b*8*1024,line.data(),copy);
 		dest+=nextline;
 	}
 }
@@ -159,8 +168,10 @@ static void EGA16_FillRow(uint8_t cleft,uint8_t cright,uint8_t row,PhysPt base,u
 	PhysPt dest=base+(CurMode->twidth*row)*cheight+cleft;	
 	Bitu nextline=CurMode->twidth;
 	Bitu copy = cheight;Bitu rowsize=(cright-cleft);
+	scanline_t line;
+	line.fill(0xff);
 	for (;copy>0;copy--) {
-		for (Bitu x=0;x<rowsize;x++) mem_writeb(dest+x,0xff);
+		MEM_BlockWrite(dest,line.data(),rowsize);
 		dest+=nextline;
 	}
 	IO_Write(0x3cf,0);
@@ -172,8 +183,10 @@ static void VGA_FillRow(uint8_t cleft,uint8_t cright,uint8_t row,PhysPt base,uin
 	PhysPt dest=base+8*((CurMode->twidth*row)*cheight+cleft);
 	Bitu nextline=8*CurMode->twidth;
 	Bitu copy = cheight;Bitu rowsize=8*(cright-cleft);
+	scanline_t line;
+	line.fill(attr);
 	for (;copy>0;copy--) {
-		for (Bitu x=0;x<rowsize;x++) mem_writeb(dest+x,attr);
+		MEM_BlockWrite(dest,line.data(),rowsize);
 		dest+=nextline;
 	}
 }
@@ -720,6 +733,78 @@ void INT10_TeletypeOutput(uint8_t chr,uint8_t attr) {
 	INT10_TeletypeOutputAttr(chr,attr,CurMode->type!=M_TEXT);
 }
 
+// Outputs a run of characters like INT10_TeletypeOutputAttr, but in text
+// modes the characters go straight into video memory, the cursor is only
+// updated once at the end, and the screen is scrolled once for all the
+// line feeds left in the run instead of once per line.
+void INT10_TeletypeOutputText(const uint8_t *chars, const uint16_t count,
+                              const uint8_t attr, const bool useattr)
+{
+	const uint8_t page = real_readb(BIOSMEM_SEG, BIOSMEM_CURRENT_PAGE);
+	if (CurMode->type != M_TEXT) {
+		for (uint16_t i = 0; i < count; ++i)
+			INT10_TeletypeOutputAttr(chars[i], attr, useattr, page);
+		return;
+	}
+	BIOS_NCOLS;BIOS_NROWS;
+	uint8_t cur_row = CURSOR_POS_ROW(page);
+	uint8_t cur_col = CURSOR_POS_COL(page);
+	const uint16_t page_offset = page * real_readw(BIOSMEM_SEG, BIOSMEM_PAGE_SIZE);
+	auto cell_address = [&](uint8_t row, uint8_t col) {
+		const auto address = static_cast<uint16_t>(page_offset + (row * ncols + col) * 2);
+		return CurMode->pstart + address;
+	};
+
+	for (uint16_t i = 0; i < count; ++i) {
+		const uint8_t chr = chars[i];
+		const uint8_t prev_row = cur_row;
+		const uint8_t prev_col = cur_col;
+		switch (chr) {
+		case 7: /* Beep */
+			// Idles while beeping, so show the cursor where it is
+			INT10_SetCursorPos(cur_row, cur_col, page);
+			INT10_TeletypeOutputAttr(chr, attr, useattr, page);
+			continue;
+		case 8:
+			if (cur_col > 0) cur_col--;
+			break;
+		case '\r':
+			cur_col = 0;
+			break;
+		case '\n':
+			cur_row++;
+			break;
+		default: {
+			const PhysPt where = cell_address(cur_row, cur_col);
+			mem_writeb(where, chr);
+			if (useattr) mem_writeb(where + 1, attr);
+			cur_col++;
+		}
+		}
+		if (cur_col == ncols) {
+			cur_col = 0;
+			cur_row++;
+		}
+		if (cur_row == nrows) {
+			// Each line feed still to come moves the cursor down a row
+			// without scrolling, so scroll for all of them now
+			uint16_t lines = 1;
+			for (uint16_t j = i + 1; j < count && lines < nrows; ++j)
+				if (chars[j] == '\n')
+					lines++;
+			// Fill with the given attribute, or the one at the cursor
+			// as INT10_TeletypeOutputAttr does
+			const uint8_t fill = useattr ? attr
+			                             : mem_readb(cell_address(prev_row, prev_col) + 1);
+			INT10_ScrollWindow(0, 0, (uint8_t)(nrows - 1), (uint8_t)(ncols - 1),
+			                   -static_cast<int8_t>(lines), fill, page);
+			cur_row = static_cast<uint8_t>(nrows - lines);
+		}
+	}
+	// Set the cursor for the page
+	INT10_SetCursorPos(cur_row, cur_col, page);
+}
+
 void INT10_WriteString(uint8_t row,uint8_t col,uint8_t flag,uint8_t attr,PhysPt string,uint16_t count,uint8_t page) {
 	uint8_t cur_row=CURSOR_POS_ROW(page);
 	uint8_t cur_col=CURSOR_POS_COL(page);
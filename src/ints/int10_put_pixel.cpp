@@ -20,261 +20,313 @@
 
 #include "mem.h"
 #include "inout.h"
+#include "vga.h"
 
 static uint8_t cga_masks[4]={0x3f,0xcf,0xf3,0xfc};
 static uint8_t cga_masks2[8]={0x7f,0xbf,0xdf,0xef,0xf7,0xfb,0xfd,0xfe};
 
-void INT10_PutPixel(uint16_t x,uint16_t y,uint8_t page,uint8_t color) {
-	static bool putpixelwarned = false;
+/* The pixel functions of each mode type. The ones of the current mode are
+ * picked when it changes, rather than switching on the mode for each pixel. */
+using put_pixel_f = void (*)(uint16_t x, uint16_t y, uint8_t page, uint8_t color);
+using get_pixel_f = uint8_t (*)(uint16_t x, uint16_t y, uint8_t page);
 
-	switch (CurMode->type) {
-	case M_CGA4:
-	{
-		if (real_readb(BIOSMEM_SEG,BIOSMEM_CURRENT_MODE)<=5) {
-			// this is a 16k mode
-			uint16_t off=(y>>1)*80+(x>>2);
-			if (y&1) off+=8*1024;
-
-			uint8_t old=real_readb(0xb800,off);
-			if (color & 0x80) {
-				color&=3;
-				old^=color << (2*(3-(x&3)));
-			} else {
-				old=(old&cga_masks[x&3])|((color&3) << (2*(3-(x&3))));
-			}
-			real_writeb(0xb800,off,old);
-		} else {
-			// a 32k mode: PCJr special case (see M_TANDY16)
-			uint16_t seg;
-			if (machine==MCH_PCJR) {
-				Bitu cpupage =
-					(real_readb(BIOSMEM_SEG, BIOSMEM_CRTCPU_PAGE) >> 3) & 0x7;
-				seg = cpupage << 10; // A14-16 to addr bits 14-16
-			} else
-				seg = 0xb800;
-
-			uint16_t off=(y>>2)*160+((x>>2)&(~1));
-			off+=(8*1024) * (y & 3);
-
-			uint16_t old=real_readw(seg,off);
-			if (color & 0x80) {
-				old^=(color&1) << (7-(x&7));
-				old^=((color&2)>>1) << ((7-(x&7))+8);
-			} else {
-				old=(old&(~(0x101<<(7-(x&7))))) | ((color&1) << (7-(x&7))) | (((color&2)>>1) << ((7-(x&7))+8));
-			}
-			real_writew(seg,off,old);
-		}
-	}
-	break;
-	case M_CGA2:
-		{
-				uint16_t off=(y>>1)*80+(x>>3);
-				if (y&1) off+=8*1024;
-				uint8_t old=real_readb(0xb800,off);
-				if (color & 0x80) {
-					color&=1;
-					old^=color << ((7-(x&7)));
-				} else {
-					old=(old&cga_masks2[x&7])|((color&1) << ((7-(x&7))));
-				}
-				real_writeb(0xb800,off,old);
-		}
-		break;
-	case M_TANDY16:
-	{
-		// find out if we are in a 32k mode (0x9 or 0xa)
-		// This requires special handling on the PCJR
-		// because only 16k are mapped at 0xB800
-		bool is_32k = (real_readb(BIOSMEM_SEG, BIOSMEM_CURRENT_MODE) >= 9)?
-			true:false;
-
-		uint16_t segment, offset;
-		if (is_32k) {
-			if (machine==MCH_PCJR) {
-				Bitu cpupage =
-					(real_readb(BIOSMEM_SEG, BIOSMEM_CRTCPU_PAGE) >> 3) & 0x7;
-				segment = cpupage << 10; // A14-16 to addr bits 14-16
-			} else
-				segment = 0xb800;
-			// bits 1 and 0 of y select the bank
-			// two pixels per byte (thus x>>1)
-			offset = (y >> 2) * (CurMode->swidth >> 1) + (x>>1);
-			// select the scanline bank
-			offset += (8*1024) * (y & 3);
+static void put_pixel_cga4(uint16_t x, uint16_t y, uint8_t, uint8_t color)
+{
+	if (real_readb(BIOSMEM_SEG,BIOSMEM_CURRENT_MODE)<=5) {
+		// this is a 16k mode
+		uint16_t off=(y>>1)*80+(x>>2);
+		if (y&1) off+=8*1024;
+
+		uint8_t old=real_readb(0xb800,off);
+		if (color & 0x80) {
+			color&=3;
+			old^=color << (2*(3-(x&3)));
 		} else {
-			segment = 0xb800;
-			// bit 0 of y selects the bank
-			offset = (y >> 1) * (CurMode->swidth >> 1) + (x>>1);
-			offset += (8*1024) * (y & 1);
+			old=(old&cga_masks[x&3])|((color&3) << (2*(3-(x&3))));
 		}
+		real_writeb(0xb800,off,old);
+	} else {
+		// a 32k mode: PCJr special case (see M_TANDY16)
+		uint16_t seg;
+		if (machine==MCH_PCJR) {
+			Bitu cpupage =
+				(real_readb(BIOSMEM_SEG, BIOSMEM_CRTCPU_PAGE) >> 3) & 0x7;
+			seg = cpupage << 10; // A14-16 to addr bits 14-16
+		} else
+			seg = 0xb800;
 
-		// update the pixel
-		uint8_t old=real_readb(segment, offset);
-		uint8_t p[2];
-		p[1] = (old >> 4) & 0xf;
-		p[0] = old & 0xf;
-		Bitu ind = 1-(x & 0x1);
+		uint16_t off=(y>>2)*160+((x>>2)&(~1));
+		off+=(8*1024) * (y & 3);
 
+		uint16_t old=real_readw(seg,off);
 		if (color & 0x80) {
-			// color is to be XORed
-	 		p[ind]^=(color & 0x7f);
+			old^=(color&1) << (7-(x&7));
+			old^=((color&2)>>1) << ((7-(x&7))+8);
 		} else {
-			p[ind]=color;
+			old=(old&(~(0x101<<(7-(x&7))))) | ((color&1) << (7-(x&7))) | (((color&2)>>1) << ((7-(x&7))+8));
 		}
-		old = (p[1] << 4) | p[0];
-		real_writeb(segment,offset, old);
+		real_writew(seg,off,old);
 	}
-	break;
-	case M_LIN4:
-		if ((machine!=MCH_VGA) || (svgaCard!=SVGA_TsengET4K) ||
-				(CurMode->swidth>800)) {
-			// the ET4000 BIOS supports text output in 800x600 SVGA
-			// (Gateway 2)
-			putpixelwarned = true;
-			LOG(LOG_INT10, LOG_ERROR)("PutPixel unhandled mode type %d", CurMode->type);
-			break;
-		}
-		[[fallthrough]];
-	case M_EGA: {
-		/* Set the correct bitmask for the pixel position */
-		IO_Write(0x3ce, 0x8);
-		uint8_t mask = 128 >> (x & 7);
-		IO_Write(0x3cf, mask);
-		/* Set the color to set/reset register */
-		IO_Write(0x3ce, 0x0);
-		IO_Write(0x3cf, color);
-		/* Enable all the set/resets */
-		IO_Write(0x3ce, 0x1);
-		IO_Write(0x3cf, 0xf);
-		/* test for xorring */
-		if (color & 0x80) {
-			IO_Write(0x3ce, 0x3);
-			IO_Write(0x3cf, 0x18);
-		}
-		// Perhaps also set mode 1
-		/* Calculate where the pixel is in video memory */
-		if (CurMode->plength !=
-		    (Bitu)real_readw(BIOSMEM_SEG, BIOSMEM_PAGE_SIZE))
-			LOG(LOG_INT10, LOG_ERROR)
-			("PutPixel_EGA_p: %u != %x", CurMode->plength,
-			 real_readw(BIOSMEM_SEG, BIOSMEM_PAGE_SIZE));
-		if (CurMode->swidth !=
-		    (Bitu)real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS) * 8)
-			LOG(LOG_INT10, LOG_ERROR)
-			("PutPixel_EGA_w: %u!=%x", CurMode->swidth,
-			 real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS) * 8);
-		PhysPt off = 0xa0000 +
-		             real_readw(BIOSMEM_SEG, BIOSMEM_PAGE_SIZE) * page +
-		             ((y * real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS) * 8 + x) >>
-		              3);
-		/* Bitmask and set/reset should do the rest */
+}
+
+static void put_pixel_cga2(uint16_t x, uint16_t y, uint8_t, uint8_t color)
+{
+	uint16_t off=(y>>1)*80+(x>>3);
+	if (y&1) off+=8*1024;
+	uint8_t old=real_readb(0xb800,off);
+	if (color & 0x80) {
+		color&=1;
+		old^=color << ((7-(x&7)));
+	} else {
+		old=(old&cga_masks2[x&7])|((color&1) << ((7-(x&7))));
+	}
+	real_writeb(0xb800,off,old);
+}
+
+static void tandy16_address(uint16_t x, uint16_t y, uint16_t &segment, uint16_t &offset)
+{
+	// find out if we are in a 32k mode (0x9 or 0xa)
+	// This requires special handling on the PCJR
+	// because only 16k are mapped at 0xB800
+	bool is_32k = (real_readb(BIOSMEM_SEG, BIOSMEM_CURRENT_MODE) >= 9)?
+		true:false;
+
+	if (is_32k) {
+		if (machine==MCH_PCJR) {
+			Bitu cpupage =
+				(real_readb(BIOSMEM_SEG, BIOSMEM_CRTCPU_PAGE) >> 3) & 0x7;
+			segment = cpupage << 10; // A14-16 to addr bits 14-16
+		} else
+			segment = 0xb800;
+		// bits 1 and 0 of y select the bank
+		// two pixels per byte (thus x>>1)
+		offset = (y >> 2) * (CurMode->swidth >> 1) + (x>>1);
+		// select the scanline bank
+		offset += (8*1024) * (y & 3);
+	} else {
+		segment = 0xb800;
+		// bit 0 of y selects the bank
+		offset = (y >> 1) * (CurMode->swidth >> 1) + (x>>1);
+		offset += (8*1024) * (y & 1);
+	}
+}
+
+static void put_pixel_tandy16(uint16_t x, uint16_t y, uint8_t, uint8_t color)
+{
+	uint16_t segment, offset;
+	tandy16_address(x, y, segment, offset);
+
+	// update the pixel
+	uint8_t old=real_readb(segment, offset);
+	uint8_t p[2];
+	p[1] = (old >> 4) & 0xf;
+	p[0] = old & 0xf;
+	Bitu ind = 1-(x & 0x1);
+
+	if (color & 0x80) {
+		// color is to be XORed
+		p[ind]^=(color & 0x7f);
+	} else {
+		p[ind]=color;
+	}
+	old = (p[1] << 4) | p[0];
+	real_writeb(segment,offset, old);
+}
+
+static PhysPt ega_pixel_address(uint16_t x, uint16_t y, uint8_t page)
+{
+	const auto page_size = real_readw(BIOSMEM_SEG, BIOSMEM_PAGE_SIZE);
+	const auto columns = real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS);
+	if (CurMode->plength != page_size)
+		LOG(LOG_INT10, LOG_ERROR)
+		("Pixel_EGA_p: %u != %x", CurMode->plength, page_size);
+	if (CurMode->swidth != columns * 8)
+		LOG(LOG_INT10, LOG_ERROR)
+		("Pixel_EGA_w: %u!=%x", CurMode->swidth, columns * 8);
+	return 0xa0000 + page_size * page + ((y * columns * 8 + x) >> 3);
+}
+
+// The registers are written as the BIOS writes them through the ports, but
+// without going through the IO bus for each of them
+static void put_pixel_ega(uint16_t x, uint16_t y, uint8_t page, uint8_t color)
+{
+	/* Set the correct bitmask for the pixel position */
+	VGA_WriteGfxRegister(0x8, check_cast<uint8_t>(128 >> (x & 7)));
+	/* Set the color to set/reset register */
+	VGA_WriteGfxRegister(0x0, color);
+	/* Enable all the set/resets */
+	VGA_WriteGfxRegister(0x1, 0xf);
+	/* test for xorring */
+	if (color & 0x80)
+		VGA_WriteGfxRegister(0x3, 0x18);
+	// Perhaps also set mode 1
+	/* Calculate where the pixel is in video memory */
+	const auto off = ega_pixel_address(x, y, page);
+	/* Bitmask and set/reset should do the rest */
+	mem_readb(off);
+	mem_writeb(off, 0xff);
+	/* Restore bitmask */
+	VGA_WriteGfxRegister(0x8, 0xff);
+	VGA_WriteGfxRegister(0x1, 0);
+	/* Restore write operating if changed */
+	if (color & 0x80)
+		VGA_WriteGfxRegister(0x3, 0x0);
+}
+
+static void put_pixel_vga(uint16_t x, uint16_t y, uint8_t, uint8_t color)
+{
+	mem_writeb(PhysMake(0xa000,y*320+x),color);
+}
+
+static PhysPt lin8_pixel_address(uint16_t x, uint16_t y)
+{
+	const auto columns = real_readw(BIOSMEM_SEG, BIOSMEM_NB_COLS);
+	if (CurMode->swidth != columns * 8)
+		LOG(LOG_INT10, LOG_ERROR)
+		("Pixel_VGA_w: %u!=%x", CurMode->swidth, columns * 8);
+	return S3_LFB_BASE + y * columns * 8 + x;
+}
+
+static void put_pixel_lin8(uint16_t x, uint16_t y, uint8_t, uint8_t color)
+{
+	mem_writeb(lin8_pixel_address(x, y), color);
+}
+
+static void put_pixel_unhandled(uint16_t, uint16_t, uint8_t, uint8_t)
+{
+	static bool putpixelwarned = false;
+	if(GCC_UNLIKELY(!putpixelwarned)) {
+		putpixelwarned = true;
+		LOG(LOG_INT10,LOG_ERROR)("PutPixel unhandled mode type %d",CurMode->type);
+	}
+}
+
+static uint8_t get_pixel_cga4(uint16_t x, uint16_t y, uint8_t)
+{
+	uint16_t off=(y>>1)*80+(x>>2);
+	if (y&1) off+=8*1024;
+	uint8_t val=real_readb(0xb800,off);
+	return (val>>(((3-(x&3)))*2)) & 3;
+}
+
+static uint8_t get_pixel_cga2(uint16_t x, uint16_t y, uint8_t)
+{
+	uint16_t off=(y>>1)*80+(x>>3);
+	if (y&1) off+=8*1024;
+	uint8_t val=real_readb(0xb800,off);
+	return (val>>(((7-(x&7))))) & 1;
+}
+
+static uint8_t get_pixel_tandy16(uint16_t x, uint16_t y, uint8_t)
+{
+	uint16_t segment, offset;
+	tandy16_address(x, y, segment, offset);
+	uint8_t val=real_readb(segment,offset);
+	return (val>>((x&1)?0:4)) & 0xf;
+}
+
+static uint8_t get_pixel_ega(uint16_t x, uint16_t y, uint8_t page)
+{
+	const auto off = ega_pixel_address(x, y, page);
+	const auto shift = 7 - (x & 7);
+	uint8_t color = 0;
+	if (!vga.config.chained) {
+		// A single read fills the latches with all four planes
 		mem_readb(off);
-		mem_writeb(off, 0xff);
-		/* Restore bitmask */
-		IO_Write(0x3ce, 0x8);
-		IO_Write(0x3cf, 0xff);
-		IO_Write(0x3ce, 0x1);
-		IO_Write(0x3cf, 0);
-		/* Restore write operating if changed */
-		if (color & 0x80) {
-			IO_Write(0x3ce, 0x3);
-			IO_Write(0x3cf, 0x0);
+		for (uint8_t plane = 0; plane < 4; ++plane)
+			color |= ((vga.latch.b[plane] >> shift) & 1) << plane;
+	} else {
+		for (uint8_t plane = 0; plane < 4; ++plane) {
+			VGA_WriteGfxRegister(0x4, plane);
+			color |= ((mem_readb(off) >> shift) & 1) << plane;
 		}
-		break;
 	}
+	// Leave the read map select on the last plane, as reading the planes
+	// one by one does
+	VGA_WriteGfxRegister(0x4, 3);
+	return color;
+}
 
-	case M_VGA:
-		mem_writeb(PhysMake(0xa000,y*320+x),color);
-		break;
-	case M_LIN8: {
-			if (CurMode->swidth!=(Bitu)real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8)
-				LOG(LOG_INT10,LOG_ERROR)("PutPixel_VGA_w: %u!=%x",CurMode->swidth,real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8);
-			PhysPt off=S3_LFB_BASE+y*real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8+x;
-			mem_writeb(off,color);
-			break;
-		}
-	default:
-		if(GCC_UNLIKELY(!putpixelwarned)) {
-			putpixelwarned = true;		
-			LOG(LOG_INT10,LOG_ERROR)("PutPixel unhandled mode type %d",CurMode->type);
-		}
-		break;
-	}	
+static uint8_t get_pixel_vga(uint16_t x, uint16_t y, uint8_t)
+{
+	return mem_readb(PhysMake(0xa000,320*y+x));
 }
 
-void INT10_GetPixel(uint16_t x,uint16_t y,uint8_t page,uint8_t * color) {
+static uint8_t get_pixel_lin8(uint16_t x, uint16_t y, uint8_t)
+{
+	return mem_readb(lin8_pixel_address(x, y));
+}
+
+static uint8_t get_pixel_unhandled(uint16_t, uint16_t, uint8_t)
+{
+	LOG(LOG_INT10,LOG_ERROR)("GetPixel unhandled mode type %d",CurMode->type);
+	return 0;
+}
+
+static struct {
+	const VideoModeBlock *mode = nullptr;
+	VGAModes type = M_ERROR;
+	put_pixel_f put = put_pixel_unhandled;
+	get_pixel_f get = get_pixel_unhandled;
+} pixel_funcs;
+
+static void select_pixel_funcs()
+{
+	pixel_funcs.mode = &*CurMode;
+	pixel_funcs.type = CurMode->type;
+	pixel_funcs.put = put_pixel_unhandled;
+	pixel_funcs.get = get_pixel_unhandled;
+
 	switch (CurMode->type) {
 	case M_CGA4:
-		{
-			uint16_t off=(y>>1)*80+(x>>2);
-			if (y&1) off+=8*1024;
-			uint8_t val=real_readb(0xb800,off);
-			*color=(val>>(((3-(x&3)))*2)) & 3 ;
-		}
+		pixel_funcs.put = put_pixel_cga4;
+		pixel_funcs.get = get_pixel_cga4;
 		break;
 	case M_CGA2:
-		{
-			uint16_t off=(y>>1)*80+(x>>3);
-			if (y&1) off+=8*1024;
-			uint8_t val=real_readb(0xb800,off);
-			*color=(val>>(((7-(x&7))))) & 1 ;
-		}
+		pixel_funcs.put = put_pixel_cga2;
+		pixel_funcs.get = get_pixel_cga2;
 		break;
 	case M_TANDY16:
-		{
-			bool is_32k = (real_readb(BIOSMEM_SEG, BIOSMEM_CURRENT_MODE) >= 9)?true:false;
-			uint16_t segment, offset;
-			if (is_32k) {
-				if (machine==MCH_PCJR) {
-					Bitu cpupage = (real_readb(BIOSMEM_SEG, BIOSMEM_CRTCPU_PAGE) >> 3) & 0x7;
-					segment = cpupage << 10;
-				} else segment = 0xb800;
-				offset = (y >> 2) * (CurMode->swidth >> 1) + (x>>1);
-				offset += (8*1024) * (y & 3);
-			} else {
-				segment = 0xb800;
-				offset = (y >> 1) * (CurMode->swidth >> 1) + (x>>1);
-				offset += (8*1024) * (y & 1);
-			}
-			uint8_t val=real_readb(segment,offset);
-			*color=(val>>((x&1)?0:4)) & 0xf;
-		}
+		pixel_funcs.put = put_pixel_tandy16;
+		pixel_funcs.get = get_pixel_tandy16;
+		break;
+	case M_LIN4:
+		// the ET4000 BIOS supports text output in 800x600 SVGA
+		// (Gateway 2)
+		if ((machine == MCH_VGA) && (svgaCard == SVGA_TsengET4K) &&
+		    (CurMode->swidth <= 800))
+			pixel_funcs.put = put_pixel_ega;
 		break;
 	case M_EGA:
-		{
-			/* Calculate where the pixel is in video memory */
-			if (CurMode->plength!=(Bitu)real_readw(BIOSMEM_SEG,BIOSMEM_PAGE_SIZE))
-				LOG(LOG_INT10,LOG_ERROR)("GetPixel_EGA_p: %u!=%x",CurMode->plength,real_readw(BIOSMEM_SEG,BIOSMEM_PAGE_SIZE));
-			if (CurMode->swidth!=(Bitu)real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8)
-				LOG(LOG_INT10,LOG_ERROR)("GetPixel_EGA_w: %u!=%x",CurMode->swidth,real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8);
-			PhysPt off=0xa0000+real_readw(BIOSMEM_SEG,BIOSMEM_PAGE_SIZE)*page+
-				((y*real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8+x)>>3);
-			Bitu shift=7-(x & 7);
-			/* Set the read map */
-			*color=0;
-			IO_Write(0x3ce,0x4);IO_Write(0x3cf,0);
-			*color|=((mem_readb(off)>>shift) & 1) << 0;
-			IO_Write(0x3ce,0x4);IO_Write(0x3cf,1);
-			*color|=((mem_readb(off)>>shift) & 1) << 1;
-			IO_Write(0x3ce,0x4);IO_Write(0x3cf,2);
-			*color|=((mem_readb(off)>>shift) & 1) << 2;
-			IO_Write(0x3ce,0x4);IO_Write(0x3cf,3);
-			*color|=((mem_readb(off)>>shift) & 1) << 3;
-			break;
-		}
+		pixel_funcs.put = put_pixel_ega;
+		pixel_funcs.get = get_pixel_ega;
+		break;
 	case M_VGA:
-		*color=mem_readb(PhysMake(0xa000,320*y+x));
+		pixel_funcs.put = put_pixel_vga;
+		pixel_funcs.get = get_pixel_vga;
+		break;
+	case M_LIN8:
+		pixel_funcs.put = put_pixel_lin8;
+		pixel_funcs.get = get_pixel_lin8;
 		break;
-	case M_LIN8: {
-			if (CurMode->swidth!=(Bitu)real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8)
-				LOG(LOG_INT10,LOG_ERROR)("GetPixel_VGA_w: %u!=%x",CurMode->swidth,real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8);
-			PhysPt off=S3_LFB_BASE+y*real_readw(BIOSMEM_SEG,BIOSMEM_NB_COLS)*8+x;
-			*color = mem_readb(off);
-			break;
-		}
 	default:
-		LOG(LOG_INT10,LOG_ERROR)("GetPixel unhandled mode type %d",CurMode->type);
 		break;
-	}	
+	}
+}
+
+static inline void check_pixel_funcs()
+{
+	if (GCC_UNLIKELY(pixel_funcs.mode != &*CurMode ||
+	                 pixel_funcs.type != CurMode->type))
+		select_pixel_funcs();
+}
+
+void INT10_PutPixel(uint16_t x,uint16_t y,uint8_t page,uint8_t color) {
+	check_pixel_funcs();
+	pixel_funcs.put(x, y, page, color);
+}
+
+void INT10_GetPixel(uint16_t x,uint16_t y,uint8_t page,uint8_t * color) {
+	check_pixel_funcs();
+	*color = pixel_funcs.get(x, y, page);
 }
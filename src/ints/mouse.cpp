@@ -30,6 +30,7 @@
 #include "mem.h"
 #include "pic.h"
 #include "regs.h"
+#include "replay.h"
 #include "video.h"
 
 CHECK_NARROWING();
@@ -53,6 +54,10 @@ static Bitu int74_ret_callback = 0;
 // Note that at least least Ultima Underworld I and II do not like too high values.
 static constexpr uint8_t max_delay_ms = 5;
 
+// Delays shorter than this count as elapsed, so the rounding of the emulated
+// time doesn't hold an event back for another timer run
+static constexpr double delay_epsilon_ms = 0.001;
+
 // ***************************************************************************
 // Debug code, normally not enabled
 // ***************************************************************************
@@ -143,10 +148,13 @@ private:
     void AggregateDosEvents(MouseEvent &ev);
     void UpdateDelayCounters();
 
-    // Time in milliseconds which has to elapse before event can take place
+    // Time in milliseconds which has to elapse before event can take place;
+    // kept in fractions of a millisecond, so the events are passed at the
+    // exact emulated time the sampling rate allows rather than on the
+    // next whole tick
     struct {
-        uint8_t ps2_ms = 0;
-        uint8_t dos_ms = 0;
+        double ps2_ms = 0.0;
+        double dos_ms = 0.0;
     } delay = {};
 
     // Pending events, waiting to be passed to guest system
@@ -158,7 +166,7 @@ private:
     MouseButtons12S event_dos_buttons_state = 0;
 
     bool timer_in_progress = false;
-    uint32_t pic_ticks_start = 0; // PIC_Ticks value when timer starts
+    double timer_start_ms  = 0.0; // PIC_FullIndex() value when timer starts
 
     // Helpers to check if there are events in the queue
     bool HasEventDos() const;
@@ -199,7 +207,7 @@ void MouseQueue::AddEvent(MouseEvent &ev)
 
     bool restart_timer = false;
     if (ev.request_ps2) {
-        if (!HasEventPS2() && timer_in_progress && !delay.ps2_ms) {
+        if (!HasEventPS2() && timer_in_progress && delay.ps2_ms <= 0.0) {
             DEBUG_QUEUE("AddEvent: restart timer for %s", "PS2");
             // We do not want the timer to start only then DOS event
             // gets processed - for minimum latency it is better to
@@ -214,7 +222,7 @@ void MouseQueue::AddEvent(MouseEvent &ev)
     }
 
     if (ev.request_dos) {
-        if (!HasEventDos() && timer_in_progress && !delay.dos_ms) {
+        if (!HasEventDos() && timer_in_progress && delay.dos_ms <= 0.0) {
             DEBUG_QUEUE("AddEvent: restart timer for %s", "DOS");
             // We do not want the timer to start only then PS/2
             // event gets processed - for minimum latency it is
@@ -306,7 +314,7 @@ void MouseQueue::ClearEventsDOS()
     event_dos_moved  = false;
     event_dos_button = false;
     event_dos_wheel  = false;
-    delay.dos_ms = 0;
+    delay.dos_ms = 0.0;
 
     // If timer is not needed, stop it
     if (!HasEventAny()) {
@@ -322,13 +330,13 @@ void MouseQueue::StartTimerIfNeeded()
         return;
 
     bool timer_needed = false;
-    uint8_t delay_ms  = UINT8_MAX; // dummy delay, will never be used
+    double delay_ms   = max_delay_ms; // dummy delay, will never be used
 
-    if (HasEventPS2() || delay.ps2_ms) {
+    if (HasEventPS2() || delay.ps2_ms > 0.0) {
         timer_needed = true;
         delay_ms     = std::min(delay_ms, delay.ps2_ms);
     }
-    if (HasEventDos() || delay.dos_ms) {
+    if (HasEventDos() || delay.dos_ms > 0.0) {
         timer_needed = true;
         delay_ms     = std::min(delay_ms, delay.dos_ms);
     }
@@ -337,34 +345,32 @@ void MouseQueue::StartTimerIfNeeded()
     if (!timer_needed)
         return;
 
-    // Enforce some non-zero delay between events; needed
-    // for example if DOS interrupt handler is busy
-    delay_ms = std::max(delay_ms, static_cast<uint8_t>(1));
+    // Enforce some non-zero delay between events if an event is ready
+    // but can't be passed yet, for example if DOS interrupt handler is
+    // busy; otherwise wake up right when the nearest delay runs out
+    if (delay_ms <= 0.0)
+        delay_ms = 1.0;
 
     // Start the timer
-    DEBUG_QUEUE("StartTimer, %d", delay_ms);
-    pic_ticks_start   = PIC_Ticks;
+    DEBUG_QUEUE("StartTimer, %.3f", delay_ms);
+    timer_start_ms    = PIC_FullIndex();
     timer_in_progress = true;
-    PIC_AddEvent(mouse_queue_tick, static_cast<double>(delay_ms));
+    PIC_AddEvent(mouse_queue_tick, delay_ms);
 }
 
 void MouseQueue::UpdateDelayCounters()
 {
-    const uint32_t tmp = (PIC_Ticks > pic_ticks_start) ? (PIC_Ticks - pic_ticks_start) : 1;
-    uint8_t elapsed    = static_cast<uint8_t>(
-                std::min(tmp, static_cast<uint32_t>(UINT8_MAX)));
-    if (!pic_ticks_start)
-        elapsed = 1;
+    const auto elapsed = std::max(PIC_FullIndex() - timer_start_ms, 0.0);
 
-    auto calc_new_delay = [](const uint8_t delay, const uint8_t elapsed) {
-        return static_cast<uint8_t>((delay > elapsed) ? (delay - elapsed)
-                                                      : 0);
+    auto calc_new_delay = [](const double delay, const double elapsed) {
+        const auto remaining = delay - elapsed;
+        return (remaining > delay_epsilon_ms) ? remaining : 0.0;
     };
 
     delay.ps2_ms = calc_new_delay(delay.ps2_ms, elapsed);
     delay.dos_ms = calc_new_delay(delay.dos_ms, elapsed);
 
-    pic_ticks_start = 0;
+    timer_start_ms = PIC_FullIndex();
 }
 
 void MouseQueue::Tick()
@@ -402,14 +408,14 @@ bool MouseQueue::HasEventAny() const
 
 bool MouseQueue::HasReadyEventDos() const
 {
-    return HasEventDos() && !delay.dos_ms &&
+    return HasEventDos() && delay.dos_ms <= 0.0 &&
            // do not launch DOS callback if it's busy
            !mouse_shared.dos_cb_running;
 }
 
 bool MouseQueue::HasReadyEventPS2() const
 {
-    return HasEventPS2() && !delay.ps2_ms;
+    return HasEventPS2() && delay.ps2_ms <= 0.0;
 }
 
 bool MouseQueue::HasReadyEventAny() const
@@ -639,6 +645,9 @@ void MOUSE_NotifyStateChanged()
 void MOUSE_EventMoved(const float x_rel, const float y_rel,
                       const uint16_t x_abs, const uint16_t y_abs)
 {
+    if (!REPLAY_PassMouseMoved(x_rel, y_rel, x_abs, y_abs))
+        return;
+
     // From the GUI we are getting mouse movement data in two
     // distinct formats:
     //
@@ -680,6 +689,9 @@ void MOUSE_NotifyMovedFake()
 
 void MOUSE_EventPressed(uint8_t idx)
 {
+    if (!REPLAY_PassMouseButton(idx, true))
+        return;
+
     const auto buttons_12S_old = get_buttons_squished();
 
     switch (idx) {
@@ -736,6 +748,9 @@ void MOUSE_EventPressed(uint8_t idx)
 
 void MOUSE_EventReleased(uint8_t idx)
 {
+    if (!REPLAY_PassMouseButton(idx, false))
+        return;
+
     const auto buttons_12S_old = get_buttons_squished();
 
     switch (idx) {
@@ -792,6 +807,9 @@ void MOUSE_EventReleased(uint8_t idx)
 
 void MOUSE_EventWheel(const int16_t w_rel)
 {
+    if (!REPLAY_PassMouseWheel(w_rel))
+        return;
+
     MouseEvent ev;
 
     if (!mouse_video.autoseamless || mouse_is_captured) {
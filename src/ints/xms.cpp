@@ -26,6 +26,7 @@
 #include "regs.h"
 #include "dos_inc.h"
 #include "setup.h"
+#include "snapshot.h"
 #include "inout.h"
 #include "xms.h"
 #include "bios.h"
@@ -414,6 +415,12 @@ Bitu XMS_Handler(void) {
 
 Bitu GetEMSType(Section_prop * section);
 
+static void xms_snapshot(SnapshotStream &s)
+{
+	s.Pod(xms_handles);
+	s.Pod(umb_available);
+}
+
 class XMS final : public Module_base {
 private:
 	CALLBACK_HandlerObject callbackhandler;
@@ -425,6 +432,7 @@ public:
 	{
 		Section_prop * section=static_cast<Section_prop *>(configuration);
 		umb_available=false;
+		SNAPSHOT_AddComponent("xms", xms_snapshot);
 		if (!section->Get_bool("xms")) return;
 		Bitu i;
 		BIOS_ZeroExtendedSize(true);
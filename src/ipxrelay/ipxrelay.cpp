@@ -0,0 +1,457 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*  IPX Relay
+ *  ---------
+ *  A standalone IPX tunnelling server, speaking the same protocol as the
+ *  server started with IPXNET STARTSERVER, for sessions with more players
+ *  than fit in one emulator's connection table.
+ *
+ *  Clients are found by hashing their address instead of walking a table,
+ *  and broadcasts go out in batches. Each shard thread has a socket of its
+ *  own on the same port, so the host spreads the clients over the shards
+ *  while each client's packets stay in order. Where the host can't spread
+ *  them, one shard is used.
+ */
+
+#include "config.h"
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// IPX header layout, as in ipx.h; addresses are kept in network byte order
+constexpr size_t ipx_header_size      = 30;
+constexpr size_t dest_network_offset  = 6;
+constexpr size_t dest_host_offset     = 10;
+constexpr size_t dest_port_offset     = 14;
+constexpr size_t dest_socket_offset   = 16;
+constexpr size_t src_network_offset   = 18;
+constexpr size_t src_host_offset      = 22;
+constexpr size_t src_port_offset      = 26;
+constexpr size_t src_socket_offset    = 28;
+constexpr uint16_t echo_socket        = 0x2;
+constexpr uint32_t broadcast_host     = 0xffffffff;
+
+constexpr uint16_t default_port        = 213;
+constexpr size_t default_max_clients   = 1024;
+constexpr size_t max_packet_size       = 1424; // IPXBUFFERSIZE
+constexpr unsigned int max_batch       = 64;
+
+static uint16_t read_be16(const uint8_t *p)
+{
+	return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static void write_be16(uint8_t *p, const uint16_t value)
+{
+	p[0] = static_cast<uint8_t>(value >> 8);
+	p[1] = static_cast<uint8_t>(value);
+}
+
+static void write_be32(uint8_t *p, const uint32_t value)
+{
+	write_be16(p, static_cast<uint16_t>(value >> 16));
+	write_be16(p + 2, static_cast<uint16_t>(value));
+}
+
+// The client's host and port exactly as they appear in IPX headers
+static uint64_t to_key(const uint32_t host, const uint16_t port)
+{
+	return (static_cast<uint64_t>(host) << 16) | port;
+}
+
+static uint64_t to_key(const sockaddr_in &address)
+{
+	return to_key(address.sin_addr.s_addr, address.sin_port);
+}
+
+static sockaddr_in to_address(const uint64_t key)
+{
+	sockaddr_in address = {};
+	address.sin_family      = AF_INET;
+	address.sin_addr.s_addr = static_cast<uint32_t>(key >> 16);
+	address.sin_port        = static_cast<uint16_t>(key);
+	return address;
+}
+
+static uint64_t read_key(const uint8_t *packet, const size_t host_offset,
+                         const size_t port_offset)
+{
+	uint32_t host = 0;
+	uint16_t port = 0;
+	memcpy(&host, packet + host_offset, sizeof(host));
+	memcpy(&port, packet + port_offset, sizeof(port));
+	return to_key(host, port);
+}
+
+static std::string to_string(const sockaddr_in &address)
+{
+	char host[INET_ADDRSTRLEN] = {};
+	inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+	return std::string(host) + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+// Connected clients
+// ~~~~~~~~~~~~~~~~~
+// Shared by all the shards. Registrations are rare, so the shards mostly
+// just read.
+class Clients {
+public:
+	Clients(const size_t max_clients) : capacity(max_clients) {}
+
+	enum class Registration { Added, Known, Full };
+
+	Registration Register(const uint64_t key)
+	{
+		const std::unique_lock lock(mutex);
+		if (keys.count(key))
+			return Registration::Known;
+		if (keys.size() >= capacity)
+			return Registration::Full;
+		keys.insert(key);
+		list.push_back(key);
+		return Registration::Added;
+	}
+
+	bool IsKnown(const uint64_t key) const
+	{
+		const std::shared_lock lock(mutex);
+		return keys.count(key) != 0;
+	}
+
+	// Copies out the clients other than the sender
+	void GetOthers(const uint64_t sender, std::vector<uint64_t> &others) const
+	{
+		const std::shared_lock lock(mutex);
+		others.clear();
+		for (const auto key : list)
+			if (key != sender)
+				others.push_back(key);
+	}
+
+private:
+	mutable std::shared_mutex mutex = {};
+	std::unordered_set<uint64_t> keys = {};
+	std::vector<uint64_t> list = {}; // in order of registration
+	const size_t capacity = 0;
+};
+
+// Shards
+// ~~~~~~
+class Shard {
+public:
+	Shard(const int udp_socket, const sockaddr_in &server, Clients &clients)
+	        : fd(udp_socket),
+	          server_address(server),
+	          connected(clients),
+	          buffers(max_batch, std::vector<uint8_t>(max_packet_size)),
+	          senders(max_batch)
+	{
+#if HAVE_SENDMMSG
+		for (unsigned int i = 0; i < max_batch; ++i) {
+			receive_vectors[i] = {buffers[i].data(), max_packet_size};
+			auto &header       = receive_headers[i].msg_hdr;
+			header.msg_name    = &senders[i];
+			header.msg_iov     = &receive_vectors[i];
+			header.msg_iovlen  = 1;
+		}
+#endif
+	}
+
+	void Run()
+	{
+		while (true) {
+			const int num_received = Receive();
+			if (num_received < 0) {
+				if (errno == EINTR)
+					continue;
+				perror("IPXRELAY: Can't receive");
+				return;
+			}
+			for (int i = 0; i < num_received; ++i)
+				Handle(buffers[i].data(), lengths[i], senders[i]);
+			Flush();
+		}
+	}
+
+private:
+	// Waits for datagrams, then takes as many as are queued
+	int Receive()
+	{
+#if HAVE_SENDMMSG
+		for (auto &header : receive_headers)
+			header.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		const int num_received = recvmmsg(fd, receive_headers, max_batch,
+		                                  MSG_WAITFORONE, nullptr);
+		for (int i = 0; i < num_received; ++i)
+			lengths[i] = receive_headers[i].msg_len;
+		return num_received;
+#else
+		socklen_t address_size = sizeof(sockaddr_in);
+		const auto num_bytes = recvfrom(fd, buffers[0].data(), max_packet_size,
+		                                0,
+		                                reinterpret_cast<sockaddr *>(&senders[0]),
+		                                &address_size);
+		if (num_bytes < 0)
+			return -1;
+		lengths[0] = static_cast<size_t>(num_bytes);
+		return 1;
+#endif
+	}
+
+	void Handle(uint8_t *packet, const size_t length, const sockaddr_in &sender)
+	{
+		if (length < ipx_header_size)
+			return;
+		const uint64_t sender_key = to_key(sender);
+
+		// An echo packet to a null node is a registration
+		if (read_be16(packet + dest_socket_offset) == echo_socket &&
+		    read_key(packet, dest_host_offset, dest_port_offset) >> 16 == 0) {
+			Register(sender);
+			return;
+		}
+		if (!connected.IsKnown(sender_key))
+			return;
+
+		const uint64_t dest_key = read_key(packet, dest_host_offset,
+		                                   dest_port_offset);
+		if (dest_key >> 16 == broadcast_host) {
+			// The sender is found by its own account, as in IPXNET
+			connected.GetOthers(read_key(packet, src_host_offset,
+			                             src_port_offset),
+			                    others);
+			for (const auto key : others)
+				Queue(packet, length, to_address(key));
+		} else if (connected.IsKnown(dest_key)) {
+			Queue(packet, length, to_address(dest_key));
+		}
+	}
+
+	void Register(const sockaddr_in &client)
+	{
+		switch (connected.Register(to_key(client))) {
+		case Clients::Registration::Added:
+			printf("IPXRELAY: Connect from %s\n", to_string(client).c_str());
+			break;
+		case Clients::Registration::Known:
+			printf("IPXRELAY: Reconnect from %s\n", to_string(client).c_str());
+			break;
+		case Clients::Registration::Full:
+			printf("IPXRELAY: Refused %s, the relay is full\n",
+			       to_string(client).c_str());
+			return;
+		}
+
+		// The reply tells the client its IPX address
+		std::vector<uint8_t> reply(ipx_header_size);
+		write_be16(reply.data(), 0xffff);
+		write_be16(reply.data() + 2, ipx_header_size);
+		write_be32(reply.data() + dest_network_offset, 0);
+		memcpy(reply.data() + dest_host_offset, &client.sin_addr.s_addr, 4);
+		memcpy(reply.data() + dest_port_offset, &client.sin_port, 2);
+		write_be16(reply.data() + dest_socket_offset, echo_socket);
+		write_be32(reply.data() + src_network_offset, 1);
+		memcpy(reply.data() + src_host_offset, &server_address.sin_addr.s_addr, 4);
+		memcpy(reply.data() + src_port_offset, &server_address.sin_port, 2);
+		write_be16(reply.data() + src_socket_offset, echo_socket);
+		Queue(reply.data(), reply.size(), client);
+		Flush();
+	}
+
+	// Collects the outgoing packets, which point into the receive buffers
+	// until they're flushed after the batch is handled
+	void Queue(const uint8_t *packet, const size_t length,
+	           const sockaddr_in &destination)
+	{
+		outgoing.push_back({packet, length, destination});
+		if (outgoing.size() >= max_batch)
+			Flush();
+	}
+
+	void Flush()
+	{
+#if HAVE_SENDMMSG
+		const auto num_outgoing = static_cast<unsigned int>(outgoing.size());
+		for (unsigned int i = 0; i < num_outgoing; ++i) {
+			auto &out         = outgoing[i];
+			send_vectors[i]   = {const_cast<uint8_t *>(out.packet), out.length};
+			auto &header      = send_headers[i].msg_hdr;
+			header            = {};
+			header.msg_name   = &out.destination;
+			header.msg_namelen = sizeof(sockaddr_in);
+			header.msg_iov    = &send_vectors[i];
+			header.msg_iovlen = 1;
+		}
+		for (unsigned int sent = 0; sent < num_outgoing;) {
+			const int result = sendmmsg(fd, send_headers + sent,
+			                            num_outgoing - sent, 0);
+			if (result < 0 && errno == EINTR)
+				continue;
+			// A failed datagram is lost, as UDP would lose it
+			sent += (result > 0) ? static_cast<unsigned int>(result) : 1;
+		}
+#else
+		for (auto &out : outgoing)
+			sendto(fd, out.packet, out.length, 0,
+			       reinterpret_cast<const sockaddr *>(&out.destination),
+			       sizeof(out.destination));
+#endif
+		outgoing.clear();
+	}
+
+	struct Outgoing {
+		const uint8_t *packet   = nullptr;
+		size_t length           = 0;
+		sockaddr_in destination = {};
+	};
+
+	const int fd = -1;
+	const sockaddr_in server_address = {};
+	Clients &connected;
+
+	std::vector<std::vector<uint8_t>> buffers = {};
+	std::vector<sockaddr_in> senders         = {};
+	size_t lengths[max_batch]                = {};
+	std::vector<Outgoing> outgoing           = {};
+	std::vector<uint64_t> others             = {};
+#if HAVE_SENDMMSG
+	mmsghdr receive_headers[max_batch] = {};
+	iovec receive_vectors[max_batch]   = {};
+	mmsghdr send_headers[max_batch]    = {};
+	iovec send_vectors[max_batch]      = {};
+#endif
+};
+
+static int open_socket(const uint16_t port, const bool is_shared)
+{
+	const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+#if defined(SO_REUSEPORT) && defined(__linux__)
+	if (is_shared) {
+		const int enable = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+	}
+#else
+	(void)is_shared;
+#endif
+	sockaddr_in address     = {};
+	address.sin_family      = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port        = htons(port);
+	if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void print_usage(const char *program)
+{
+	printf("Usage: %s [-p PORT] [-t THREADS] [-m MAX_CLIENTS]\n\n"
+	       "Relays IPX packets between DOSBox instances connected with\n"
+	       "IPXNET CONNECT.\n\n"
+	       "  -p PORT         UDP port to listen on (default %u)\n"
+	       "  -t THREADS      number of shard threads (default: one per\n"
+	       "                  CPU core on Linux, 1 elsewhere)\n"
+	       "  -m MAX_CLIENTS  most clients to accept (default %zu)\n",
+	       program, default_port, default_max_clients);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long port        = default_port;
+	unsigned long num_shards  = 1;
+	unsigned long max_clients = default_max_clients;
+#if defined(SO_REUSEPORT) && defined(__linux__)
+	num_shards = std::max(1u, std::thread::hardware_concurrency());
+#endif
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (i + 1 < argc && (arg == "-p" || arg == "-t" || arg == "-m")) {
+			const auto value = strtoul(argv[++i], nullptr, 10);
+			if (arg == "-p")
+				port = value;
+			else if (arg == "-t")
+				num_shards = value;
+			else
+				max_clients = value;
+			continue;
+		}
+		print_usage(argv[0]);
+		return arg == "-h" || arg == "--help" ? 0 : 1;
+	}
+	if (port == 0 || port > UINT16_MAX || num_shards == 0 || max_clients == 0) {
+		print_usage(argv[0]);
+		return 1;
+	}
+#if !(defined(SO_REUSEPORT) && defined(__linux__))
+	num_shards = 1;
+#endif
+
+	// Clients are told the relay's address as the server sees it, which
+	// IPXNET leaves unresolved as well
+	sockaddr_in server_address = {};
+	server_address.sin_port    = htons(static_cast<uint16_t>(port));
+
+	Clients clients(max_clients);
+	std::vector<int> sockets = {};
+	for (unsigned long i = 0; i < num_shards; ++i) {
+		const int fd = open_socket(static_cast<uint16_t>(port), num_shards > 1);
+		if (fd < 0) {
+			fprintf(stderr, "IPXRELAY: Can't listen on UDP port %lu: %s\n",
+			        port, strerror(errno));
+			return 1;
+		}
+		sockets.push_back(fd);
+	}
+	printf("IPXRELAY: Listening on UDP port %lu with %lu shard%s, for up to %lu clients\n",
+	       port, num_shards, num_shards == 1 ? "" : "s", max_clients);
+
+	std::vector<std::thread> threads = {};
+	for (const auto fd : sockets)
+		threads.emplace_back([fd, &server_address, &clients] {
+			Shard(fd, server_address, clients).Run();
+		});
+	for (auto &thread : threads)
+		thread.join();
+	return 1;
+}
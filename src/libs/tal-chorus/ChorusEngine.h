@@ -104,6 +104,14 @@ public:
         *sampleL= *sampleL+resultL*1.4f;
         *sampleR= *sampleR+resultR*1.4f;
     }
+
+    // Processes blocks of left and right samples in place
+    // (DOSBox Staging addition)
+    void process(float *samplesL, float *samplesR, const int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            process(&samplesL[i], &samplesR[i]);
+    }
 };
 
 #endif
@@ -18,11 +18,21 @@
 
 #include "zmbv.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ZMBV_SIMD_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ZMBV_SIMD_NEON 1
+#endif
 
 #include "math_utils.h"
 #include "mem_unaligned.h"
@@ -44,9 +54,21 @@ constexpr uint8_t COMPRESSION_ZLIB     = 1;
 constexpr int ZLIB_COMPRESSION_LEVEL   = 6;          // 0 to 9 (0 = no compression)
 constexpr auto ZLIB_COMPRESSION_METHOD = Z_DEFLATED; // currently the only option
 constexpr int ZLIB_MEM_LEVEL           = 9;          // 1 to 9 (default 8)
+constexpr int ZLIB_WINDOW_BITS         = 9;          // 9 to 15, a 512-byte window
 constexpr auto ZLIB_STRATEGY           = Z_FILTERED; // Z_DEFAULT_STRATEGY, Z_FILTERED,
                                                      // Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED
 
+constexpr size_t ZLIB_WINDOW_BYTES = size_t{1} << ZLIB_WINDOW_BITS;
+
+// Frames with more data than this per slice are deflated in several slices
+// at once. Each slice is a raw deflate stream primed with the window of data
+// before it and ended on a byte boundary with a sync flush, so the slices
+// join up into the single zlib stream that decoders expect.
+constexpr size_t MIN_SLICE_BYTES = 256 * 1024;
+
+// Blocks this wide are compared and XORed a row of 16 pixels at a time
+constexpr int SIMD_BLOCK_WIDTH = 16;
+
 ZMBV_FORMAT BPPFormat(const int bpp)
 {
 	switch (bpp) {
@@ -154,17 +176,182 @@ void VideoCodec::CreateVectorTable()
 	}
 }
 
+#if defined(ZMBV_SIMD_SSE2)
+
+// Sets the bytes of the pixels that are the same in both vectors
+template <class P>
+static __m128i equal_pixels(const __m128i a, const __m128i b)
+{
+	if constexpr (sizeof(P) == 1) {
+		return _mm_cmpeq_epi8(a, b);
+	} else if constexpr (sizeof(P) == 2) {
+		return _mm_cmpeq_epi16(a, b);
+	} else {
+		// The top byte of 32-bit pixels isn't compared
+		const auto diff = _mm_and_si128(_mm_xor_si128(a, b),
+		                                _mm_set1_epi32(0x00ffffff));
+		return _mm_cmpeq_epi32(diff, _mm_setzero_si128());
+	}
+}
+
+// Returns how many of the pixels differ in the given rows of a block that's
+// SIMD_BLOCK_WIDTH wide, optionally only testing every fourth pixel in them
+template <class P>
+static int count_changed_pixels(const P *pold, const P *pnew, const int pitch,
+                                const int dy, const int row_step,
+                                const bool every_fourth)
+{
+	constexpr int pixels_per_vector  = 16 / sizeof(P);
+	constexpr int vectors_per_row    = SIMD_BLOCK_WIDTH / pixels_per_vector;
+
+	// Pixels 0, 4, 8, and 12 of the row
+	const auto sampled = sizeof(P) == 1 ? _mm_set1_epi32(0xff)
+	                   : sizeof(P) == 2 ? _mm_set_epi32(0, 0xffff, 0, 0xffff)
+	                                    : _mm_set_epi32(0, 0, 0, -1);
+	const auto selected = every_fourth ? sampled : _mm_set1_epi8(-1);
+
+	// Each equal byte adds one to its lane, which counts at most 64
+	auto equal_bytes = _mm_setzero_si128();
+	auto rows        = 0;
+	for (auto y = 0; y < dy; y += row_step) {
+		for (auto v = 0; v < vectors_per_row; ++v) {
+			const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+			        pold + v * pixels_per_vector));
+			const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+			        pnew + v * pixels_per_vector));
+			const auto equal = _mm_and_si128(equal_pixels<P>(a, b), selected);
+			equal_bytes = _mm_sub_epi8(equal_bytes, equal);
+		}
+		pold += pitch * row_step;
+		pnew += pitch * row_step;
+		++rows;
+	}
+	const auto sums = _mm_sad_epu8(equal_bytes, _mm_setzero_si128());
+	const auto total = _mm_cvtsi128_si32(sums) +
+	                   _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+
+	const auto tested = every_fourth ? SIMD_BLOCK_WIDTH / 4 : SIMD_BLOCK_WIDTH;
+	return rows * tested - total / static_cast<int>(sizeof(P));
+}
+
+template <class P>
+static void xor_rows(const P *pold, const P *pnew, const int pitch,
+                     const int dy, uint8_t *out)
+{
+	constexpr int pixels_per_vector = 16 / sizeof(P);
+	constexpr int vectors_per_row   = SIMD_BLOCK_WIDTH / pixels_per_vector;
+
+	for (auto y = 0; y < dy; ++y) {
+		for (auto v = 0; v < vectors_per_row; ++v) {
+			const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+			        pold + v * pixels_per_vector));
+			const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+			        pnew + v * pixels_per_vector));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_xor_si128(b, a));
+			out += 16;
+		}
+		pold += pitch;
+		pnew += pitch;
+	}
+}
+
+#elif defined(ZMBV_SIMD_NEON)
+
+// Sets the bytes of the pixels that are the same in both vectors
+template <class P>
+static uint8x16_t equal_pixels(const uint8x16_t a, const uint8x16_t b)
+{
+	if constexpr (sizeof(P) == 1) {
+		return vceqq_u8(a, b);
+	} else if constexpr (sizeof(P) == 2) {
+		return vreinterpretq_u8_u16(
+		        vceqq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+	} else {
+		// The top byte of 32-bit pixels isn't compared
+		const auto diff = vandq_u32(vreinterpretq_u32_u8(veorq_u8(a, b)),
+		                            vdupq_n_u32(0x00ffffff));
+		return vreinterpretq_u8_u32(vceqq_u32(diff, vdupq_n_u32(0)));
+	}
+}
+
+// Returns how many of the pixels differ in the given rows of a block that's
+// SIMD_BLOCK_WIDTH wide, optionally only testing every fourth pixel in them
+template <class P>
+static int count_changed_pixels(const P *pold, const P *pnew, const int pitch,
+                                const int dy, const int row_step,
+                                const bool every_fourth)
+{
+	constexpr int pixels_per_vector = 16 / sizeof(P);
+	constexpr int vectors_per_row   = SIMD_BLOCK_WIDTH / pixels_per_vector;
+
+	// Pixels 0, 4, 8, and 12 of the row
+	const auto sampled = sizeof(P) == 1
+	                           ? vreinterpretq_u8_u32(vdupq_n_u32(0xff))
+	                   : sizeof(P) == 2
+	                           ? vreinterpretq_u8_u64(vdupq_n_u64(0xffff))
+	                           : vreinterpretq_u8_u64(vcombine_u64(
+	                                     vcreate_u64(0xffffffff), vcreate_u64(0)));
+	const auto selected = every_fourth ? sampled : vdupq_n_u8(0xff);
+
+	// Each equal byte adds one to its lane, which counts at most 64
+	auto equal_bytes = vdupq_n_u8(0);
+	auto rows        = 0;
+	for (auto y = 0; y < dy; y += row_step) {
+		for (auto v = 0; v < vectors_per_row; ++v) {
+			const auto a = vld1q_u8(reinterpret_cast<const uint8_t *>(
+			        pold + v * pixels_per_vector));
+			const auto b = vld1q_u8(reinterpret_cast<const uint8_t *>(
+			        pnew + v * pixels_per_vector));
+			const auto equal = vandq_u8(equal_pixels<P>(a, b), selected);
+			equal_bytes = vsubq_u8(equal_bytes, equal);
+		}
+		pold += pitch * row_step;
+		pnew += pitch * row_step;
+		++rows;
+	}
+	const int total = vaddlvq_u8(equal_bytes);
+
+	const auto tested = every_fourth ? SIMD_BLOCK_WIDTH / 4 : SIMD_BLOCK_WIDTH;
+	return rows * tested - total / static_cast<int>(sizeof(P));
+}
+
+template <class P>
+static void xor_rows(const P *pold, const P *pnew, const int pitch,
+                     const int dy, uint8_t *out)
+{
+	constexpr int pixels_per_vector = 16 / sizeof(P);
+	constexpr int vectors_per_row   = SIMD_BLOCK_WIDTH / pixels_per_vector;
+
+	for (auto y = 0; y < dy; ++y) {
+		for (auto v = 0; v < vectors_per_row; ++v) {
+			const auto a = vld1q_u8(reinterpret_cast<const uint8_t *>(
+			        pold + v * pixels_per_vector));
+			const auto b = vld1q_u8(reinterpret_cast<const uint8_t *>(
+			        pnew + v * pixels_per_vector));
+			vst1q_u8(out, veorq_u8(b, a));
+			out += 16;
+		}
+		pold += pitch;
+		pnew += pitch;
+	}
+}
+
+#endif
+
 template <class P>
 int VideoCodec::PossibleBlock(const int vx, const int vy, const FrameBlock & block)
 {
 	int ret = 0;
 	P *pold = reinterpret_cast<P *>(oldframe) + block.start + (vy * pitch) + vx;
 	P *pnew = reinterpret_cast<P *>(newframe) + block.start;
-	;
+#if defined(ZMBV_SIMD_SSE2) || defined(ZMBV_SIMD_NEON)
+	if (block.dx == SIMD_BLOCK_WIDTH)
+		return count_changed_pixels(pold, pnew, pitch, block.dy, 4, true);
+#endif
 	for (auto y = 0; y < block.dy; y += 4) {
 		for (auto x = 0; x < block.dx; x += 4) {
-			const auto test = 0 - ((pold[x] - pnew[x]) & 0x00ffffff);
-			ret -= check_cast<int>(test >> 31);
+			if ((pold[x] ^ pnew[x]) & 0x00ffffff)
+				++ret;
 		}
 		pold += pitch * 4;
 		pnew += pitch * 4;
@@ -178,11 +365,14 @@ int VideoCodec::CompareBlock(const int vx, const int vy, const FrameBlock & bloc
 	int ret = 0;
 	P *pold = reinterpret_cast<P *>(oldframe) + block.start + (vy * pitch) + vx;
 	P *pnew = reinterpret_cast<P *>(newframe) + block.start;
-	;
+#if defined(ZMBV_SIMD_SSE2) || defined(ZMBV_SIMD_NEON)
+	if (block.dx == SIMD_BLOCK_WIDTH)
+		return count_changed_pixels(pold, pnew, pitch, block.dy, 1, false);
+#endif
 	for (auto y = 0; y < block.dy; y++) {
 		for (auto x = 0; x < block.dx; x++) {
-			const auto test = 0 - ((pold[x] - pnew[x]) & 0x00ffffff);
-			ret -= check_cast<int>(test >> 31);
+			if ((pold[x] ^ pnew[x]) & 0x00ffffff)
+				++ret;
 		}
 		pold += pitch;
 		pnew += pitch;
@@ -195,6 +385,13 @@ void VideoCodec::AddXorBlock(const int vx, const int vy, const FrameBlock & bloc
 {
 	P *pold = reinterpret_cast<P *>(oldframe) + block.start + (vy * pitch) + vx;
 	P *pnew = reinterpret_cast<P *>(newframe) + block.start;
+#if defined(ZMBV_SIMD_SSE2) || defined(ZMBV_SIMD_NEON)
+	if (block.dx == SIMD_BLOCK_WIDTH) {
+		xor_rows(pold, pnew, pitch, block.dy, &work[workUsed]);
+		workUsed += sizeof(P) * SIMD_BLOCK_WIDTH * static_cast<size_t>(block.dy);
+		return;
+	}
+#endif
 	for (auto y = 0; y < block.dy; ++y) {
 		for (auto x = 0; x < block.dx; ++x) {
 			*reinterpret_cast<P *>(&work[workUsed]) = pnew[x] ^ pold[x];
@@ -258,12 +455,34 @@ bool VideoCodec::SetupCompress(const int _width, const int _height)
 	height = _height;
 	pitch  = _width + 2 * MAX_VECTOR;
 	format = ZMBV_FORMAT::NONE;
-	if (deflateInit2(&zstream, ZLIB_COMPRESSION_LEVEL, ZLIB_COMPRESSION_METHOD, ZLIB_MEM_LEVEL, ZLIB_MEM_LEVEL, ZLIB_STRATEGY) !=
+	// Raw deflate, with the zlib header written at each keyframe, so the
+	// data can be picked up by the slices' streams
+	if (deflateInit2(&zstream, ZLIB_COMPRESSION_LEVEL, ZLIB_COMPRESSION_METHOD, -ZLIB_WINDOW_BITS, ZLIB_MEM_LEVEL, ZLIB_STRATEGY) !=
 	    Z_OK)
 		return false;
+	history.clear();
 	return true;
 }
 
+// Writes the zlib stream header that deflate writes for these settings
+static void write_zlib_header(uint8_t *out)
+{
+	const auto method_info = ((ZLIB_WINDOW_BITS - 8) << 4) | ZLIB_COMPRESSION_METHOD;
+
+	auto level_flags = 3;
+	if (ZLIB_STRATEGY >= Z_HUFFMAN_ONLY || ZLIB_COMPRESSION_LEVEL < 2)
+		level_flags = 0;
+	else if (ZLIB_COMPRESSION_LEVEL < 6)
+		level_flags = 1;
+	else if (ZLIB_COMPRESSION_LEVEL == 6)
+		level_flags = 2;
+
+	auto header = (method_info << 8) | (level_flags << 6);
+	header += 31 - (header % 31);
+	out[0] = static_cast<uint8_t>(header >> 8);
+	out[1] = static_cast<uint8_t>(header & 0xff);
+}
+
 bool VideoCodec::SetupDecompress(const int _width, const int _height)
 {
 	width  = _width;
@@ -330,6 +549,9 @@ bool VideoCodec::PrepareCompressFrame(int flags, const ZMBV_FORMAT _format, uint
 		}
 		/* Restart deflate */
 		deflateReset(&zstream);
+		history.clear();
+		write_zlib_header(compress.writeBuf + compress.writeDone);
+		compress.writeDone += 2;
 	} else {
 		const auto palette_bytes = palsize * 4;
 		if (palsize && pal && memcmp(pal, palette, palette_bytes)) {
@@ -388,22 +610,117 @@ int VideoCodec::FinishCompressFrame()
 		}
 	}
 	/* Create the actual frame with compression */
-	zstream.next_in  = work.data();
-	zstream.avail_in = check_cast<uint32_t>(workUsed);
-	zstream.total_in = 0;
+	static const auto num_threads = size_t{std::thread::hardware_concurrency()};
+	const auto num_slices = std::min({MaxSlices, num_threads, workUsed / MIN_SLICE_BYTES});
+	if (num_slices > 1) {
+		if (!DeflateSlices(num_slices))
+			return -1;
+	} else {
+		zstream.next_in  = work.data();
+		zstream.avail_in = check_cast<uint32_t>(workUsed);
+		zstream.total_in = 0;
+
+		zstream.next_out  = compress.writeBuf + compress.writeDone;
+		zstream.avail_out = compress.writeSize - compress.writeDone;
+		zstream.total_out = 0;
+		deflate(&zstream, Z_SYNC_FLUSH);
+		compress.writeDone += static_cast<uint32_t>(zstream.total_out);
+	}
 
-	zstream.next_out  = compress.writeBuf + compress.writeDone;
-	zstream.avail_out = compress.writeSize - compress.writeDone;
-	zstream.total_out = 0;
-	deflate(&zstream, Z_SYNC_FLUSH);
-	const auto bytes_processed = static_cast<int>(compress.writeDone + zstream.total_out);
+	// Keep the end of the data for the next frame's slices
+	GetWindowBefore(workUsed, history);
+
+	const auto bytes_processed = static_cast<int>(compress.writeDone);
 	return bytes_processed;
 }
 
+// Gets the deflate window's worth of data before the given offset in the
+// work buffer, including the previous frames' data
+void VideoCodec::GetWindowBefore(const size_t end, std::vector<uint8_t> &window) const
+{
+	const auto from_work    = std::min(end, ZLIB_WINDOW_BYTES);
+	const auto from_history = std::min(history.size(), ZLIB_WINDOW_BYTES - from_work);
+
+	std::vector<uint8_t> joined(from_history + from_work);
+	std::copy(history.end() - static_cast<ptrdiff_t>(from_history),
+	          history.end(),
+	          joined.begin());
+	std::copy(work.begin() + static_cast<ptrdiff_t>(end - from_work),
+	          work.begin() + static_cast<ptrdiff_t>(end),
+	          joined.begin() + static_cast<ptrdiff_t>(from_history));
+	window = std::move(joined);
+}
+
+void VideoCodec::DeflateSlice(Slice &slice)
+{
+	auto &stream = slice.zstream;
+	deflateReset(&stream);
+	if (!slice.dictionary.empty())
+		deflateSetDictionary(&stream, slice.dictionary.data(),
+		                     check_cast<uInt>(slice.dictionary.size()));
+
+	// Room for the slice's worst case and the sync flush's marker
+	const auto bound = deflateBound(&stream, static_cast<uLong>(slice.size)) + 16;
+	slice.output.resize(bound);
+
+	stream.next_in   = work.data() + slice.start;
+	stream.avail_in  = check_cast<uInt>(slice.size);
+	stream.next_out  = slice.output.data();
+	stream.avail_out = check_cast<uInt>(bound);
+	deflate(&stream, Z_SYNC_FLUSH);
+	slice.outputSize = bound - stream.avail_out;
+}
+
+bool VideoCodec::DeflateSlices(const size_t numSlices)
+{
+	const auto slice_bytes = workUsed / numSlices;
+
+	for (size_t i = 0; i < numSlices; ++i) {
+		auto &slice = slices[i];
+		if (!slice.is_initialized) {
+			if (deflateInit2(&slice.zstream, ZLIB_COMPRESSION_LEVEL, ZLIB_COMPRESSION_METHOD,
+			                 -ZLIB_WINDOW_BITS, ZLIB_MEM_LEVEL, ZLIB_STRATEGY) != Z_OK)
+				return false;
+			slice.is_initialized = true;
+		}
+		slice.start = slice_bytes * i;
+		slice.size  = (i == numSlices - 1) ? workUsed - slice.start : slice_bytes;
+		GetWindowBefore(slice.start, slice.dictionary);
+	}
+
+	std::vector<std::thread> threads = {};
+	for (size_t i = 1; i < numSlices; ++i)
+		threads.emplace_back(&VideoCodec::DeflateSlice, this, std::ref(slices[i]));
+	DeflateSlice(slices[0]);
+	for (auto &thread : threads)
+		thread.join();
+
+	// Join up the slices' data
+	for (size_t i = 0; i < numSlices; ++i) {
+		const auto &slice = slices[i];
+		if (slice.outputSize > compress.writeSize - compress.writeDone)
+			return false;
+		memcpy(compress.writeBuf + compress.writeDone, slice.output.data(), slice.outputSize);
+		compress.writeDone += check_cast<uint32_t>(slice.outputSize);
+	}
+
+	// Pick up the main stream after the frame's data
+	std::vector<uint8_t> window = {};
+	GetWindowBefore(workUsed, window);
+	deflateReset(&zstream);
+	deflateSetDictionary(&zstream, window.data(), check_cast<uInt>(window.size()));
+	return true;
+}
+
 void VideoCodec::FinishVideo()
 {
-	// end the deflation stream
+	// end the deflation streams
 	deflateEnd(&zstream);
+	for (auto &slice : slices) {
+		if (slice.is_initialized)
+			deflateEnd(&slice.zstream);
+		slice.is_initialized = false;
+	}
 }
 
 template <class P>
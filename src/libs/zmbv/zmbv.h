@@ -19,6 +19,7 @@
 #ifndef DOSBOX_ZMBV_H
 #define DOSBOX_ZMBV_H
 
+#include <array>
 #include <cstdint>
 #include <vector>
 
@@ -68,6 +69,17 @@ private:
 		uint8_t *writeBuf = nullptr;
 	};
 
+	// A part of a large frame's data, deflated on its own thread
+	struct Slice {
+		z_stream zstream = {};
+		bool is_initialized = false;
+		size_t start = 0;
+		size_t size = 0;
+		std::vector<uint8_t> dictionary = {}; // the window before the slice
+		std::vector<uint8_t> output = {};
+		size_t outputSize = 0;
+	};
+	static constexpr size_t MaxSlices = 8;
 
 	static constexpr uint8_t keyframeHeaderBytes = {sizeof(KeyframeHeader)};
 
@@ -96,6 +108,9 @@ private:
 	Compress compress = {};
 	z_stream zstream = {};
 
+	std::array<Slice, MaxSlices> slices = {};
+	std::vector<uint8_t> history = {}; // the deflate window's worth of input
+
 	// methods
 	void CreateVectorTable();
 	bool SetupBuffers(ZMBV_FORMAT format, int blockwidth, int blockheight);
@@ -117,6 +132,10 @@ private:
 
 	void AlignWork(size_t & offset);
 
+	void DeflateSlice(Slice &slice);
+	bool DeflateSlices(size_t numSlices);
+	void GetWindowBefore(size_t end, std::vector<uint8_t> &window) const;
+
 public:
 	VideoCodec();
 
@@ -25,22 +25,33 @@
 #if C_FLUIDSYNTH
 
 #include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <deque>
+#include <future>
 #include <string>
 #include <tuple>
 
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "control.h"
 #include "cross.h"
 #include "fs_utils.h"
 #include "mixer.h"
 #include "programs.h"
+#include "startup.h"
 #include "string_utils.h"
 #include "support.h"
 #include "../ints/int10.h"
 #include "string_utils.h"
 
-static constexpr int FRAMES_PER_BUFFER = 48; // synth granularity
-
 MidiHandlerFluidsynth instance;
 
 static void init_fluid_dosbox_settings(Section_prop &secprop)
@@ -212,22 +223,235 @@ static std::string find_sf_file(const std::string &name)
 	return "";
 }
 
-MidiHandlerFluidsynth::MidiHandlerFluidsynth() : keep_rendering(false) {}
+#if defined(WIN32) || defined(HAVE_MMAP)
+
+// SoundFonts are read through a read-only mapping of the file instead of
+// buffered reads, so the file's pages are shared with every other process
+// using the same SoundFont and are only read in as the loader touches them.
+// FluidSynth's loader itself is kept and told to load the samples
+// dynamically, so only the samples of the presets in use get decoded.
+struct MappedSoundFont {
+	const uint8_t *data = nullptr;
+	int64_t size        = 0;
+	int64_t position    = 0;
+#if defined(WIN32)
+	HANDLE mapping = nullptr;
+#endif
+};
 
-bool MidiHandlerFluidsynth::Open([[maybe_unused]] const char *conf)
+static void *open_mapped_sf(const char *filename)
 {
-	Close();
+	auto sf = new MappedSoundFont();
+#if defined(WIN32)
+	const auto file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+	                              nullptr, OPEN_EXISTING,
+	                              FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		delete sf;
+		return nullptr;
+	}
+	LARGE_INTEGER size = {};
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		sf->mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (sf->mapping)
+			sf->data = static_cast<const uint8_t *>(
+			        MapViewOfFile(sf->mapping, FILE_MAP_READ, 0, 0, 0));
+		sf->size = size.QuadPart;
+	}
+	CloseHandle(file); // the mapping keeps the file open
+	if (!sf->data) {
+		if (sf->mapping)
+			CloseHandle(sf->mapping);
+		delete sf;
+		return nullptr;
+	}
+#else
+	const auto fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		delete sf;
+		return nullptr;
+	}
+	struct stat st = {};
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		const auto ptr = mmap(nullptr, static_cast<size_t>(st.st_size),
+		                      PROT_READ, MAP_SHARED, fd, 0);
+		if (ptr != MAP_FAILED)
+			sf->data = static_cast<const uint8_t *>(ptr);
+		sf->size = st.st_size;
+	}
+	close(fd); // the mapping keeps the file open
+	if (!sf->data) {
+		delete sf;
+		return nullptr;
+	}
+#endif
+	return sf;
+}
+
+static int read_mapped_sf(void *buf, fluid_long_long_t count, void *handle)
+{
+	auto sf = static_cast<MappedSoundFont *>(handle);
+	if (count < 0 || count > sf->size - sf->position)
+		return FLUID_FAILED;
+
+	memcpy(buf, sf->data + sf->position, static_cast<size_t>(count));
+	sf->position += count;
+	return FLUID_OK;
+}
+
+static int seek_mapped_sf(void *handle, fluid_long_long_t offset, int origin)
+{
+	auto sf = static_cast<MappedSoundFont *>(handle);
+
+	int64_t position = offset;
+	if (origin == SEEK_CUR)
+		position += sf->position;
+	else if (origin == SEEK_END)
+		position += sf->size;
+	else if (origin != SEEK_SET)
+		return FLUID_FAILED;
+
+	if (position < 0 || position > sf->size)
+		return FLUID_FAILED;
+
+	sf->position = position;
+	return FLUID_OK;
+}
+
+static fluid_long_long_t tell_mapped_sf(void *handle)
+{
+	return static_cast<MappedSoundFont *>(handle)->position;
+}
 
-	fluid_settings_ptr_t fluid_settings(new_fluid_settings(),
-	                                    delete_fluid_settings);
-	if (!fluid_settings) {
+static int close_mapped_sf(void *handle)
+{
+	auto sf = static_cast<MappedSoundFont *>(handle);
+#if defined(WIN32)
+	UnmapViewOfFile(sf->data);
+	CloseHandle(sf->mapping);
+#else
+	munmap(const_cast<uint8_t *>(sf->data), static_cast<size_t>(sf->size));
+#endif
+	delete sf;
+	return FLUID_OK;
+}
+
+// Adds FluidSynth's SoundFont loader reading through file mappings, ahead of
+// the default loader, which remains as the fallback
+static void add_mapped_sf_loader(fluid_settings_t *settings, fluid_synth_t *synth)
+{
+	auto loader = new_fluid_defsfloader(settings);
+	if (!loader) {
+		LOG_WARNING("FSYNTH: Failed to create the mapped SoundFont loader");
+		return;
+	}
+	fluid_sfloader_set_callbacks(loader,
+	                             open_mapped_sf,
+	                             read_mapped_sf,
+	                             seek_mapped_sf,
+	                             tell_mapped_sf,
+	                             close_mapped_sf);
+
+	// The synth owns the loader from here on
+	fluid_synth_add_sfloader(synth, loader);
+}
+
+#else
+
+static void add_mapped_sf_loader(fluid_settings_t *, fluid_synth_t *) {}
+
+#endif
+
+struct LoadedSynth {
+	std::unique_ptr<fluid_settings_t, decltype(&delete_fluid_settings)> settings{
+	        nullptr, &delete_fluid_settings};
+	std::unique_ptr<fluid_synth_t, decltype(&delete_fluid_synth)> synth{
+	        nullptr, &delete_fluid_synth};
+	std::string soundfont = {};
+	int sample_rate       = 0;
+};
+
+// Creates a synthesizer running at the given rate and loads the SoundFont
+static LoadedSynth load_synth(const std::string &soundfont, const int sample_rate)
+{
+	LoadedSynth loaded = {};
+	loaded.soundfont   = soundfont;
+	loaded.sample_rate = sample_rate;
+
+	loaded.settings.reset(new_fluid_settings());
+	if (!loaded.settings) {
 		LOG_MSG("FSYNTH: new_fluid_settings failed");
-		return false;
+		return loaded;
 	}
 
+	// Detailed explanation of all available FluidSynth settings:
+	// http://www.fluidsynth.org/api/fluidsettings.xml
+
+	// Per the FluidSynth API, the sample-rate should be part of the
+	// settings used to instantiate the synth, so we create the mixer
+	// channel first and use its native rate to configure FluidSynth.
+	fluid_settings_setnum(loaded.settings.get(), "synth.sample-rate", sample_rate);
+
+	// Only load the samples of the presets that are selected, as most
+	// games only use a fraction of a General MIDI SoundFont's
+	fluid_settings_setint(loaded.settings.get(), "synth.dynamic-sample-loading", 1);
+
+	loaded.synth.reset(new_fluid_synth(loaded.settings.get()));
+	if (!loaded.synth) {
+		LOG_MSG("FSYNTH: Failed to create the FluidSynth synthesizer.");
+		return loaded;
+	}
+
+	add_mapped_sf_loader(loaded.settings.get(), loaded.synth.get());
+
+	if (!soundfont.empty() && fluid_synth_sfcount(loaded.synth.get()) == 0)
+		fluid_synth_sfload(loaded.synth.get(), soundfont.data(), true);
+
+	return loaded;
+}
+
+// Loading the SoundFont is the slowest part of opening the synth, so when
+// FluidSynth is the selected MIDI device a synth is loaded during the early
+// init pass at the mixer's configured rate. Open() joins it and adopts it if
+// the mixer channel runs at that rate.
+static std::future<LoadedSynth> preloaded_synth = {};
+
+static void fluid_preload([[maybe_unused]] Section *sec)
+{
+	const auto midi_section = static_cast<Section_prop *>(
+	        control->GetSection("midi"));
+	const auto mixer_section = static_cast<Section_prop *>(
+	        control->GetSection("mixer"));
+	const auto section = static_cast<Section_prop *>(
+	        control->GetSection("fluidsynth"));
+	assert(midi_section && mixer_section && section);
+
+	std::string device = midi_section->Get_string("mididevice");
+	lowcase(device);
+	if (device != "fluidsynth" || preloaded_synth.valid())
+		return;
+
+	const auto sf_spec   = parse_sf_pref(section->Get_string("soundfont"));
+	const auto soundfont = find_sf_file(std::get<std::string>(sf_spec));
+	if (soundfont.empty())
+		return;
+
+	const auto sample_rate = mixer_section->Get_int("rate");
+	preloaded_synth = STARTUP_RunTask("FluidSynth SoundFont", [=]() {
+		return load_synth(soundfont, sample_rate);
+	});
+}
+
+MidiHandlerFluidsynth::MidiHandlerFluidsynth() = default;
+
+bool MidiHandlerFluidsynth::Open([[maybe_unused]] const char *conf)
+{
+	Close();
+
 	// Setup the mixer callback
-	const auto mixer_callback = std::bind(&MidiHandlerFluidsynth::MixerCallBack,
-	                                      this, std::placeholders::_1);
+	const auto mixer_callback = std::bind(&MidiRenderAhead::MixerCallBack,
+	                                      &render_ahead,
+	                                      std::placeholders::_1);
 
 	auto mixer_channel = MIXER_AddChannel(mixer_callback,
 	                                      use_mixer_rate,
@@ -252,32 +476,28 @@ bool MidiHandlerFluidsynth::Open([[maybe_unused]] const char *conf)
 		mixer_channel->SetLowPassFilter(FilterState::Off);
 	}
 
-	// Detailed explanation of all available FluidSynth settings:
-	// http://www.fluidsynth.org/api/fluidsettings.xml
-
-	// Per the FluidSynth API, the sample-rate should be part of the
-	// settings used to instantiate the synth, so we create the mixer
-	// channel first and use its native rate to configure FluidSynth.
-	fluid_settings_setnum(fluid_settings.get(),
-	                      "synth.sample-rate",
-	                      mixer_channel->GetSampleRate());
-
-	fsynth_ptr_t fluid_synth(new_fluid_synth(fluid_settings.get()),
-	                         delete_fluid_synth);
-	if (!fluid_synth) {
-		LOG_MSG("FSYNTH: Failed to create the FluidSynth synthesizer.");
-		return false;
-	}
-
 	// Load the requested SoundFont or quit if none provided
 	const char *sf_file = section->Get_string("soundfont");
 	const auto sf_spec = parse_sf_pref(sf_file);
 	const auto soundfont = find_sf_file(std::get<std::string>(sf_spec));
 	auto scale_by_percent = std::get<int>(sf_spec);
 
-	if (!soundfont.empty() && fluid_synth_sfcount(fluid_synth.get()) == 0) {
-		fluid_synth_sfload(fluid_synth.get(), soundfont.data(), true);
+	// Take the preloaded synth if it matches; otherwise load it now
+	const auto sample_rate = mixer_channel->GetSampleRate();
+	LoadedSynth loaded = {};
+	if (preloaded_synth.valid()) {
+		auto preload = preloaded_synth.get();
+		if (preload.soundfont == soundfont && preload.sample_rate == sample_rate)
+			loaded = std::move(preload);
 	}
+	if (!loaded.synth)
+		loaded = load_synth(soundfont, sample_rate);
+
+	auto fluid_settings = std::move(loaded.settings);
+	auto fluid_synth    = std::move(loaded.synth);
+	if (!fluid_settings || !fluid_synth)
+		return false;
+
 	if (fluid_synth_sfcount(fluid_synth.get()) == 0) {
 		LOG_WARNING("FSYNTH: FluidSynth failed to load '%s', check the path.",
 		        sf_file);
@@ -447,11 +667,11 @@ bool MidiHandlerFluidsynth::Open([[maybe_unused]] const char *conf)
 	selected_font = soundfont;
 
 	// Start rendering audio
-	keep_rendering = true;
-	const auto render = std::bind(&MidiHandlerFluidsynth::Render, this);
-	renderer = std::thread(render);
-	set_thread_name(renderer, "dosbox:fsynth");
-	play_buffer = playable.Dequeue(); // populate the first play buffer
+	using namespace std::placeholders;
+	render_ahead.Start(channel,
+	                   std::bind(&MidiHandlerFluidsynth::Render, this, _1, _2),
+	                   std::bind(&MidiHandlerFluidsynth::ApplyMsg, this, _1),
+	                   std::bind(&MidiHandlerFluidsynth::ApplySysex, this, _1, _2));
 
 	// Start playback
 	is_open = true;
@@ -472,22 +692,13 @@ void MidiHandlerFluidsynth::Close()
 	if (channel)
 		channel->Enable(false);
 
-	// Stop rendering and drain the rings
-	keep_rendering = false;
-	if (!backstock.Size())
-		backstock.Enqueue(std::move(play_buffer));
-	while (playable.Size())
-		play_buffer = playable.Dequeue();
-
-	// Wait for the rendering thread to finish
-	if (renderer.joinable())
-		renderer.join();
+	// Stop rendering
+	render_ahead.Stop();
 
 	// Reset the members
 	channel.reset();
 	synth.reset();
 	settings.reset();
-	last_played_frame = 0;
 	selected_font.clear();
 
 	is_open = false;
@@ -498,6 +709,20 @@ void MidiHandlerFluidsynth::PlayMsg(const uint8_t *msg)
 	assert(channel);
 	channel->WakeUp();
 
+	render_ahead.QueueMsg(msg);
+}
+
+void MidiHandlerFluidsynth::PlaySysex(uint8_t *sysex, size_t len)
+{
+	assert(channel);
+	channel->WakeUp();
+
+	render_ahead.QueueSysex(sysex, len);
+}
+
+// Plays the message on the rendering thread, at its frame
+void MidiHandlerFluidsynth::ApplyMsg(const uint8_t *msg)
+{
 	const int chanID = msg[0] & 0b1111;
 
 	switch (msg[0] & 0b1111'0000) {
@@ -523,87 +748,25 @@ void MidiHandlerFluidsynth::PlayMsg(const uint8_t *msg)
 		fluid_synth_pitch_bend(synth.get(), chanID, msg[1] + (msg[2] << 7));
 		break;
 	default: {
-		uint64_t tmp;
+		// The queued messages hold four bytes
+		uint32_t tmp;
 		memcpy(&tmp, msg, sizeof(tmp));
-		LOG_MSG("FSYNTH: unknown MIDI command: %0" PRIx64, tmp);
+		LOG_MSG("FSYNTH: unknown MIDI command: %0" PRIx32, tmp);
 		break;
 	}
 	}
 }
 
-void MidiHandlerFluidsynth::PlaySysex(uint8_t *sysex, size_t len)
+void MidiHandlerFluidsynth::ApplySysex(const uint8_t *sysex, const size_t len)
 {
-	assert(channel);
-	channel->WakeUp();
-
 	const char *data = reinterpret_cast<const char *>(sysex);
 	const auto n = static_cast<int>(len);
 	fluid_synth_sysex(synth.get(), data, n, nullptr, nullptr, nullptr, false);
 }
 
-void MidiHandlerFluidsynth::MixerCallBack(uint16_t requested_frames)
+void MidiHandlerFluidsynth::Render(float *frames, const int num_frames)
 {
-	while (requested_frames) {
-		const auto frames_to_be_played = std::min(GetRemainingFrames(),
-		                                          requested_frames);
-		const auto sample_offset_in_buffer = play_buffer.data() +
-		                                     last_played_frame * 2;
-
-		assert(frames_to_be_played <= play_buffer.size());
-		channel->AddSamples_sfloat(frames_to_be_played,
-		                           sample_offset_in_buffer);
-
-		requested_frames -= frames_to_be_played;
-		last_played_frame += frames_to_be_played;
-	}
-}
-
-// Returns the number of frames left to play in the buffer.
-uint16_t MidiHandlerFluidsynth::GetRemainingFrames()
-{
-	// If the current buffer has some frames left, then return those ...
-	if (last_played_frame < FRAMES_PER_BUFFER)
-		return FRAMES_PER_BUFFER - last_played_frame;
-
-	// Otherwise put the spent buffer in backstock and get the next buffer
-	backstock.Enqueue(std::move(play_buffer));
-	play_buffer = playable.Dequeue();
-	last_played_frame = 0; // reset the frame counter to the beginning
-
-	return FRAMES_PER_BUFFER;
-}
-
-// Populates the playable queue with freshly rendered buffers
-void MidiHandlerFluidsynth::Render()
-{
-	// Allocate our buffers once and reuse for the duration.
-	constexpr auto SAMPLES_PER_BUFFER = FRAMES_PER_BUFFER * 2; // L & R
-	std::vector<float> render_buffer(SAMPLES_PER_BUFFER);
-	std::vector<float> playable_buffer(SAMPLES_PER_BUFFER);
-
-	// Populate the backstock using copies of the current buffer.
-	while (backstock.Size() < backstock.MaxCapacity() - 1)
-		backstock.Enqueue(playable_buffer);
-
-	backstock.Enqueue(std::move(playable_buffer));
-	assert(backstock.Size() == backstock.MaxCapacity());
-
-	while (keep_rendering.load()) {
-		fluid_synth_write_float(synth.get(), FRAMES_PER_BUFFER,
-		                        render_buffer.data(), 0, 2,
-		                        render_buffer.data(), 1, 2);
-
-		// Grab the next buffer from backstock and populate it ...
-		playable_buffer = backstock.Dequeue();
-
-		// Swap buffers & scale
-		std::swap(render_buffer, playable_buffer);
-		for (auto &s : playable_buffer)
-			s *= INT16_MAX;
-
-		// and then move it into the playable queue
-		playable.Enqueue(std::move(playable_buffer));
-	}
+	fluid_synth_write_float(synth.get(), num_frames, frames, 0, 2, frames, 1, 2);
 }
 
 std::string format_sf2_line(size_t width, const std_fs::path &sf2_path)
@@ -690,6 +853,7 @@ void FLUID_AddConfigSection(const config_ptr_t &conf)
 	assert(conf);
 	Section_prop *sec = conf->AddSection_prop("fluidsynth", &fluid_init);
 	assert(sec);
+	sec->AddEarlyInitFunction(&fluid_preload);
 	init_fluid_dosbox_settings(*sec);
 }
 
@@ -27,14 +27,11 @@
 
 #if C_FLUIDSYNTH
 
-#include <atomic>
 #include <memory>
-#include <vector>
 #include <fluidsynth.h>
-#include <thread>
 
+#include "midi_render_ahead.h"
 #include "mixer.h"
-#include "rwqueue.h"
 
 class MidiHandlerFluidsynth final : public MidiHandler {
 public:
@@ -49,9 +46,9 @@ public:
 	MIDI_RC ListAll(Program *caller) override;
 
 private:
-	void MixerCallBack(uint16_t requested_frames);
-	uint16_t GetRemainingFrames();
-	void Render();
+	void ApplyMsg(const uint8_t *msg);
+	void ApplySysex(const uint8_t *sysex, const size_t len);
+	void Render(float *frames, const int num_frames);
 
 	using fluid_settings_ptr_t =
 	        std::unique_ptr<fluid_settings_t, decltype(&delete_fluid_settings)>;
@@ -62,15 +59,8 @@ private:
 	mixer_channel_t channel = nullptr;
 	std::string selected_font = "";
 
-	std::vector<float> play_buffer = {};
-	static constexpr auto num_buffers = 20;
-	RWQueue<std::vector<float>> playable{num_buffers};
-	RWQueue<std::vector<float>> backstock{num_buffers};
+	MidiRenderAhead render_ahead{"dosbox:fsynth"};
 
-	std::thread renderer = {};
-
-	uint16_t last_played_frame = 0; // relative frame-offset in the play buffer
-	std::atomic_bool keep_rendering = {};
 	bool is_open = false;
 };
 
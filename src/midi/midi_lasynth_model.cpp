@@ -23,8 +23,205 @@
 #if C_MT32EMU
 
 #include <cassert>
+#include <cinttypes>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
 
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cross.h"
 #include "fs_utils.h"
+#include "string_utils.h"
+
+// ROM index
+// ~~~~~~~~~
+// Identifying a ROM means hashing the whole file, which mt32emu does for
+// every candidate file in every ROM directory. The outcome is remembered
+// per path along with the file's size and modification time, and persisted
+// as tab-separated lines of: path, size, mtime, ROM id, and SHA1 digest.
+// Files that aren't ROMs are remembered with an empty id.
+
+struct RomIndexEntry {
+	uintmax_t size = 0;
+	int64_t mtime  = 0;
+	std::string id   = {};
+	std::string sha1 = {};
+};
+
+static struct {
+	std::mutex mutex = {};
+	std::map<std::string, RomIndexEntry> entries = {};
+	bool is_read  = false;
+	bool is_dirty = false;
+} rom_index = {};
+
+static std_fs::path get_rom_index_path()
+{
+	return std_fs::path(CROSS_GetPlatformConfigDir()) / "mt32-roms.idx";
+}
+
+static void read_rom_index()
+{
+	rom_index.is_read = true;
+
+	std::ifstream file(get_rom_index_path());
+	std::string line = {};
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string path = {}, size = {}, mtime = {};
+		RomIndexEntry entry = {};
+		if (!std::getline(fields, path, '\t') ||
+		    !std::getline(fields, size, '\t') ||
+		    !std::getline(fields, mtime, '\t') ||
+		    !std::getline(fields, entry.id, '\t') ||
+		    !std::getline(fields, entry.sha1, '\t'))
+			continue;
+		entry.size  = std::strtoumax(size.c_str(), nullptr, 10);
+		entry.mtime = std::strtoll(mtime.c_str(), nullptr, 10);
+		rom_index.entries[path] = std::move(entry);
+	}
+}
+
+void LASynthModel::SaveRomIndex()
+{
+	std::lock_guard<std::mutex> lock(rom_index.mutex);
+	if (!rom_index.is_dirty)
+		return;
+
+	const auto path = get_rom_index_path();
+	std::ofstream file(path, std::ios::trunc);
+	for (const auto &[rom_path, entry] : rom_index.entries)
+		file << rom_path << '\t' << entry.size << '\t' << entry.mtime
+		     << '\t' << entry.id << '\t' << entry.sha1 << '\n';
+	if (!file)
+		LOG_WARNING("MT32: Can't write the ROM index '%s'",
+		            path.string().c_str());
+	rom_index.is_dirty = false;
+}
+
+// Returns the indexed identity of the ROM file, identifying it first if it's
+// new or has changed since, or nothing if the file doesn't exist
+static std::optional<RomIndexEntry> identify_rom(const LASynthModel::service_t &service,
+                                                 const std::string &rom_path)
+{
+	std::error_code ec;
+	const auto size = std_fs::file_size(rom_path, ec);
+	if (ec)
+		return {};
+	const auto mtime = static_cast<int64_t>(
+	        to_time_t(std_fs::last_write_time(rom_path, ec)));
+	if (ec)
+		return {};
+
+	std::lock_guard<std::mutex> lock(rom_index.mutex);
+	if (!rom_index.is_read)
+		read_rom_index();
+
+	const auto it = rom_index.entries.find(rom_path);
+	if (it != rom_index.entries.end() && it->second.size == size &&
+	    it->second.mtime == mtime)
+		return it->second;
+
+	RomIndexEntry entry = {size, mtime, {}, {}};
+	mt32emu_rom_info info;
+	if (service->identifyROMFile(&info, rom_path.c_str(), nullptr) == MT32EMU_RC_OK) {
+		if (info.control_rom_id) {
+			entry.id   = info.control_rom_id;
+			entry.sha1 = info.control_rom_sha1_digest;
+		} else if (info.pcm_rom_id) {
+			entry.id   = info.pcm_rom_id;
+			entry.sha1 = info.pcm_rom_sha1_digest;
+		}
+	}
+	rom_index.entries[rom_path] = entry;
+	rom_index.is_dirty          = true;
+	return entry;
+}
+
+// Mapped ROMs
+// ~~~~~~~~~~~
+// ROM images are handed to mt32emu from read-only mappings of their files,
+// so every instance on the host shares the file's pages instead of reading
+// its own copy. The mappings are kept for the life of the process because
+// mt32emu may refer to the image data for as long as its context lives.
+
+struct MappedRom {
+	const uint8_t *data = nullptr;
+	size_t size         = 0;
+};
+
+static const MappedRom *map_rom(const std::string &rom_path)
+{
+	static std::mutex mutex = {};
+	static std::map<std::string, MappedRom> mapped_roms = {};
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (const auto it = mapped_roms.find(rom_path); it != mapped_roms.end())
+		return &it->second;
+
+	MappedRom rom = {};
+#if defined(WIN32)
+	const auto file = CreateFileA(rom_path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+	                              nullptr, OPEN_EXISTING,
+	                              FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+	LARGE_INTEGER size = {};
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+		                                        0, 0, nullptr);
+		if (mapping) {
+			// The view keeps the mapping and the file open
+			rom.data = static_cast<const uint8_t *>(
+			        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+		rom.size = static_cast<size_t>(size.QuadPart);
+	}
+	CloseHandle(file);
+#elif defined(HAVE_MMAP)
+	const auto fd = open(rom_path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	struct stat st = {};
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		rom.size = static_cast<size_t>(st.st_size);
+		const auto ptr = mmap(nullptr, rom.size, PROT_READ, MAP_SHARED, fd, 0);
+		if (ptr != MAP_FAILED)
+			rom.data = static_cast<const uint8_t *>(ptr);
+	}
+	close(fd); // the mapping keeps the file open
+#endif
+	if (!rom.data)
+		return nullptr;
+	return &mapped_roms.emplace(rom_path, rom).first->second;
+}
+
+// Copies the indexed digest into mt32emu's form, which spares it from
+// hashing the image again
+static const mt32emu_sha1_digest *get_digest(const std::string &rom_path,
+                                             mt32emu_sha1_digest &digest)
+{
+	std::lock_guard<std::mutex> lock(rom_index.mutex);
+	const auto it = rom_index.entries.find(rom_path);
+	if (it == rom_index.entries.end() ||
+	    it->second.sha1.size() != sizeof(digest) - 1)
+		return nullptr;
+	safe_strcpy(digest, it->second.sha1.c_str());
+	return &digest;
+}
 
 // Construct a new model and ensure both PCM and control ROM(s) are provided
 LASynthModel::LASynthModel(const std::string &rom_name,
@@ -58,22 +255,11 @@ bool LASynthModel::InDir(const service_t &service, const std::string &dir) const
 		if (!rom)
 			return false;
 
-		const std::string rom_path = dir + rom->filename;
-		if (!path_exists(rom_path))
-			return false;
-
-		mt32emu_rom_info info;
-		if (service->identifyROMFile(&info, rom_path.c_str(), nullptr) != MT32EMU_RC_OK)
+		const auto entry = identify_rom(service, dir + rom->filename);
+		if (!entry || entry->id.empty())
 			return false;
 
-		if (rom->type == ROM_TYPE::UNVERSIONED)
-			return true;
-
-		const bool found_pcm = info.pcm_rom_id &&
-		                       (rom->id == info.pcm_rom_id);
-		const bool found_ctrl = info.control_rom_id &&
-		                        (rom->id == info.control_rom_id);
-		return found_pcm || found_ctrl;
+		return rom->type == ROM_TYPE::UNVERSIONED || rom->id == entry->id;
 	};
 
 	const bool have_pcm = find_rom(pcm_full) ||
@@ -94,7 +280,13 @@ bool LASynthModel::Load(const service_t &service, const std::string &dir) const
 		if (!rom_full)
 			return false;
 		const std::string rom_path = dir + rom_full->filename;
-		const auto rcode = service->addROMFile(rom_path.c_str());
+		const auto rom = map_rom(rom_path);
+		if (!rom)
+			return service->addROMFile(rom_path.c_str()) == expected_code;
+
+		mt32emu_sha1_digest digest = {};
+		const auto rcode = service->addROMData(rom->data, rom->size,
+		                                       get_digest(rom_path, digest));
 		return rcode == expected_code;
 	};
 
@@ -104,8 +296,18 @@ bool LASynthModel::Load(const service_t &service, const std::string &dir) const
 			return false;
 		const std::string rom_1_path = dir + rom_1->filename;
 		const std::string rom_2_path = dir + rom_2->filename;
-		const auto rcode = service->mergeAndAddROMFiles(rom_1_path.c_str(),
-		                                                rom_2_path.c_str());
+		const auto part_1 = map_rom(rom_1_path);
+		const auto part_2 = map_rom(rom_2_path);
+		if (!part_1 || !part_2)
+			return service->mergeAndAddROMFiles(rom_1_path.c_str(),
+			                                    rom_2_path.c_str()) ==
+			       expected_code;
+
+		mt32emu_sha1_digest digest_1 = {};
+		mt32emu_sha1_digest digest_2 = {};
+		const auto rcode = service->mergeAndAddROMData(
+		        part_1->data, part_1->size, get_digest(rom_1_path, digest_1),
+		        part_2->data, part_2->size, get_digest(rom_2_path, digest_2));
 		return rcode == expected_code;
 	};
 
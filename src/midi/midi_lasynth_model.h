@@ -71,6 +71,11 @@ public:
 	bool InDir(const service_t &service, const std::string &dir) const;
 	bool Load(const service_t &service, const std::string &dir) const;
 
+	// ROM files are identified once and remembered by path, size, and
+	// modification time in an index kept in the configuration directory.
+	// Writes the index out if ROMs were identified since it was read.
+	static void SaveRomIndex();
+
 private:
 	size_t SetVersion();
 
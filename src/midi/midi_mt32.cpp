@@ -25,8 +25,11 @@
 #if C_MT32EMU
 
 #include <cassert>
+#include <chrono>
 #include <deque>
 #include <functional>
+#include <future>
+#include <iterator>
 #include <map>
 #include <set>
 #include <string>
@@ -39,6 +42,7 @@
 #include "midi.h"
 #include "midi_lasynth_model.h"
 #include "mixer.h"
+#include "startup.h"
 #include "string_utils.h"
 #include "support.h"
 #include "../ints/int10.h"
@@ -46,22 +50,50 @@
 // mt32emu Settings
 // ----------------
 
-// Synth granularity in frames. We keep four buffers in-flight at any given
-// time: when playback exhausts the "head" buffer, we ask MT-32 to render the
-// next buffer, asynchronously, which is then placed at the back of the queue.
-static constexpr int FRAMES_PER_BUFFER = 48;
+// Quality tiers, trading the emulation's accuracy for rendering time:
+// - Analogue circuit modes: DIGITAL_ONLY, COARSE, ACCURATE, OVERSAMPLED
+// - Analog rendering types: int16_t, FLOAT
+// - Sample rate conversion quality: FASTEST, FAST, GOOD, BEST
+// - Partials: the hardware has 32, fewer cuts off notes in dense passages
+struct QualityTier {
+	const char *name;
+	MT32Emu::AnalogOutputMode analog_mode;
+	MT32Emu::RendererType renderer_type;
+	MT32Emu::SamplerateConversionQuality rate_conversion_quality;
+	MT32Emu::Bit32u partial_count;
+};
 
-// Analogue circuit modes: DIGITAL_ONLY, COARSE, ACCURATE, OVERSAMPLED
-constexpr auto ANALOG_MODE = MT32Emu::AnalogOutputMode_ACCURATE;
+constexpr QualityTier quality_tiers[] = {
+        {"fast",
+         MT32Emu::AnalogOutputMode_DIGITAL_ONLY,
+         MT32Emu::RendererType_BIT16S,
+         MT32Emu::SamplerateConversionQuality_FASTEST,
+         24},
+        {"balanced",
+         MT32Emu::AnalogOutputMode_COARSE,
+         MT32Emu::RendererType_FLOAT,
+         MT32Emu::SamplerateConversionQuality_GOOD,
+         32},
+        {"best",
+         MT32Emu::AnalogOutputMode_ACCURATE,
+         MT32Emu::RendererType_FLOAT,
+         MT32Emu::SamplerateConversionQuality_BEST,
+         32},
+};
+constexpr int best_quality = static_cast<int>(std::size(quality_tiers)) - 1;
 
-// DAC Emulation modes: NICE, PURE, GENERATION1, and GENERATION2
-constexpr auto DAC_MODE = MT32Emu::DACInputMode_NICE;
+// In 'auto' quality, the synth is reopened one tier lower once rendering
+// has taken more than this share of real time for a few measurement windows
+// in a row. Each window covers half a second of audio.
+constexpr auto max_render_load      = 0.8;
+constexpr auto slow_windows_to_step = 3;
+constexpr auto windows_per_second   = 2;
 
-// Analog rendering types: int16_t, FLOAT
-constexpr auto RENDERING_TYPE = MT32Emu::RendererType_FLOAT;
+// SysEx kept for restoring the synth's state after stepping down
+constexpr size_t max_sysex_history_bytes = 256 * 1024;
 
-// Sample rate conversion quality: FASTEST, FAST, GOOD, BEST
-constexpr auto RATE_CONVERSION_QUALITY = MT32Emu::SamplerateConversionQuality_BEST;
+// DAC Emulation modes: NICE, PURE, GENERATION1, and GENERATION2
+constexpr auto DAC_MODE = MT32Emu::DACInputMode_NICE;
 
 // Prefer higher ramp resolution over the coarser volume steps used by the hardware
 constexpr bool USE_NICE_RAMP = true;
@@ -196,6 +228,18 @@ static void init_mt32_dosbox_settings(Section_prop &sec_prop)
 	        "  - CM32L_CONTROL.ROM and CM32L_PCM.ROM, for the 'cm32l' model.\n"
 	        "  - Unzipped MAME MT-32 and CM-32L ROMs, for the versioned models.");
 
+	const char *qualities[] = {"auto", "fast", "balanced", "best", 0};
+	str_prop = sec_prop.Add_string("mt32_quality", when_idle, "auto");
+	str_prop->Set_values(qualities);
+	str_prop->Set_help(
+	        "Emulation quality, trading accuracy for rendering time:\n"
+	        "  auto:      Start at 'best' and step down whenever rendering can't\n"
+	        "             keep up with real time (default).\n"
+	        "  fast:      Digital-only output, 16-bit rendering, fastest\n"
+	        "             resampling, and 24 partials.\n"
+	        "  balanced:  Coarse analogue circuit emulation and good resampling.\n"
+	        "  best:      Accurate analogue circuit emulation and best resampling.");
+
 	str_prop = sec_prop.Add_string("mt32_filter", when_idle, "off");
 	assert(str_prop);
 	str_prop->Set_help(
@@ -304,6 +348,18 @@ static const char *get_selected_model()
 	return section->Get_string("model");
 }
 
+// Returns the configured quality tier, or nothing for 'auto'
+static std::optional<int> get_selected_quality()
+{
+	const auto section = static_cast<Section_prop *>(control->GetSection("mt32"));
+	assert(section);
+	const std::string selected = section->Get_string("mt32_quality");
+	for (auto i = 0; i <= best_quality; ++i)
+		if (selected == quality_tiers[i].name)
+			return i;
+	return {};
+}
+
 static std::set<const LASynthModel *> has_models(const MidiHandler_mt32::service_t &service,
                                                  const std::string &dir)
 {
@@ -319,12 +375,20 @@ static std::optional<model_and_dir_t> load_model(
         const std::string &selected_model, const std::deque<std::string> &rom_dirs)
 {
 	const bool is_auto = (selected_model == "auto");
-	for (const auto &model : all_models)
-		if (is_auto || model->Matches(selected_model))
-			for (const auto &dir : rom_dirs)
-				if (model->Load(service, dir))
-					return {{model, simplify_path(dir).string()}};
-	return {};
+	std::optional<model_and_dir_t> loaded = {};
+	for (const auto &model : all_models) {
+		if (!is_auto && !model->Matches(selected_model))
+			continue;
+		for (const auto &dir : rom_dirs)
+			if (model->Load(service, dir)) {
+				loaded = {{model, simplify_path(dir).string()}};
+				break;
+			}
+		if (loaded)
+			break;
+	}
+	LASynthModel::SaveRomIndex();
+	return loaded;
 }
 
 static mt32emu_report_handler_i get_report_handler_interface()
@@ -384,8 +448,7 @@ static mt32emu_report_handler_i get_report_handler_interface()
 	return REPORT_HANDLER_I;
 }
 
-MidiHandler_mt32::MidiHandler_mt32() : keep_rendering(false)
-{}
+MidiHandler_mt32::MidiHandler_mt32() = default;
 
 MidiHandler_mt32::service_t MidiHandler_mt32::GetService()
 {
@@ -396,6 +459,38 @@ MidiHandler_mt32::service_t MidiHandler_mt32::GetService()
 	return mt32_service;
 }
 
+// Loading and verifying the ROMs is the slowest part of opening the synth,
+// so when the MT-32 is the selected MIDI device this work starts during the
+// early init pass and Open() joins it.
+struct PreloadedModel {
+	std::string model_name = {};
+	std::deque<std::string> rom_dirs = {};
+	MidiHandler_mt32::service_t service = {};
+	std::optional<model_and_dir_t> model_and_dir = {};
+};
+
+static std::future<PreloadedModel> preloaded_model = {};
+
+static void mt32_preload([[maybe_unused]] Section *sec)
+{
+	const auto midi_section = static_cast<Section_prop *>(
+	        control->GetSection("midi"));
+	assert(midi_section);
+	std::string device = midi_section->Get_string("mididevice");
+	lowcase(device);
+	if (device != "mt32" || preloaded_model.valid())
+		return;
+
+	PreloadedModel preload = {get_selected_model(), get_selected_dirs(), {}, {}};
+	preloaded_model = STARTUP_RunTask("MT-32 ROMs", [preload = std::move(preload)]() mutable {
+		preload.service       = mt32_instance.GetService();
+		preload.model_and_dir = load_model(preload.service,
+		                                   preload.model_name,
+		                                   preload.rom_dirs);
+		return std::move(preload);
+	});
+}
+
 // Calculates the maximum width available to print the rom directory, given
 // the terminal's width, indent size, and space needed for the model names:
 // [indent][max_dir_width][N columns + N delimeters]
@@ -428,6 +523,7 @@ static std::set<const LASynthModel *> populate_available_models(
 			available_models.insert(models.begin(), models.end());
 		}
 	}
+	LASynthModel::SaveRomIndex();
 	return available_models;
 }
 
@@ -563,12 +659,27 @@ bool MidiHandler_mt32::Open([[maybe_unused]] const char *conf)
 {
 	Close();
 
-	service_t mt32_service = GetService();
 	const std::string selected_model = get_selected_model();
 	const auto rom_dirs = get_selected_dirs();
 
-	// Load the selected model and print info about it
-	auto loaded_model_and_dir = load_model(mt32_service, selected_model, rom_dirs);
+	// Take the preloaded model if it was loaded with the same settings
+	service_t mt32_service = {};
+	std::optional<model_and_dir_t> loaded_model_and_dir = {};
+	if (preloaded_model.valid()) {
+		auto preload = preloaded_model.get();
+		if (preload.model_name == selected_model && preload.rom_dirs == rom_dirs) {
+			mt32_service         = std::move(preload.service);
+			loaded_model_and_dir = std::move(preload.model_and_dir);
+		}
+	}
+
+	// Otherwise load the selected model now
+	if (!mt32_service) {
+		mt32_service = GetService();
+		loaded_model_and_dir = load_model(mt32_service, selected_model, rom_dirs);
+	}
+
+	// Print info about the loaded model
 	if (!loaded_model_and_dir) {
 		LOG_MSG("MT32: Failed to find ROMs for model %s in:",
 		        selected_model.c_str());
@@ -586,8 +697,9 @@ bool MidiHandler_mt32::Open([[maybe_unused]] const char *conf)
 	        rom_info.control_rom_description,
 	        loaded_model_and_dir->second.c_str());
 
-	const auto mixer_callback = std::bind(&MidiHandler_mt32::MixerCallBack,
-	                                      this, std::placeholders::_1);
+	const auto mixer_callback = std::bind(&MidiRenderAhead::MixerCallBack,
+	                                      &render_ahead,
+	                                      std::placeholders::_1);
 
 	const auto mixer_channel = MIXER_AddChannel(mixer_callback,
 	                                            use_mixer_rate,
@@ -610,16 +722,20 @@ bool MidiHandler_mt32::Open([[maybe_unused]] const char *conf)
 		mixer_channel->SetLowPassFilter(FilterState::Off);
 	}
 
-	const auto sample_rate = mixer_channel->GetSampleRate();
+	sample_rate = mixer_channel->GetSampleRate();
+
+	const auto selected_quality = get_selected_quality();
+	is_auto_quality = !selected_quality;
+	quality         = selected_quality.value_or(best_quality);
 
-	mt32_service->setAnalogOutputMode(ANALOG_MODE);
-	mt32_service->selectRendererType(RENDERING_TYPE);
-	mt32_service->setStereoOutputSampleRate(sample_rate);
-	mt32_service->setSamplerateConversionQuality(RATE_CONVERSION_QUALITY);
-	mt32_service->setDACInputMode(DAC_MODE);
-	mt32_service->setNiceAmpRampEnabled(USE_NICE_RAMP);
-	mt32_service->setNicePanningEnabled(USE_NICE_PANNING);
-	mt32_service->setNicePartialMixingEnabled(USE_NICE_PARTIAL_MIXING);
+	window_render_ns = 0;
+	window_frames    = 0;
+	slow_windows     = 0;
+	sysex_history.clear();
+	sysex_history_bytes = 0;
+	channel_msgs.fill(0);
+
+	ApplyQuality(mt32_service);
 
 	const auto rc = mt32_service->openSynth();
 	if (rc != MT32EMU_RC_OK) {
@@ -631,11 +747,11 @@ bool MidiHandler_mt32::Open([[maybe_unused]] const char *conf)
 	model_and_dir = std::move(loaded_model_and_dir);
 
 	// Start rendering audio
-	keep_rendering = true;
-	const auto render = std::bind(&MidiHandler_mt32::Render, this);
-	renderer = std::thread(render);
-	set_thread_name(renderer, "dosbox:mt32");
-	play_buffer = playable.Dequeue(); // populate the first play buffer
+	using namespace std::placeholders;
+	render_ahead.Start(channel,
+	                   std::bind(&MidiHandler_mt32::Render, this, _1, _2),
+	                   std::bind(&MidiHandler_mt32::ApplyMsg, this, _1),
+	                   std::bind(&MidiHandler_mt32::ApplySysex, this, _1, _2));
 
 	is_open = true;
 
@@ -656,16 +772,8 @@ void MidiHandler_mt32::Close()
 	if (channel)
 		channel->Enable(false);
 
-	// Stop rendering and drain the rings
-	keep_rendering = false;
-	if (!backstock.Size())
-		backstock.Enqueue(std::move(play_buffer));
-	while (playable.Size())
-		play_buffer = playable.Dequeue();
-
-	// Wait for the rendering thread to finish
-	if (renderer.joinable())
-		renderer.join();
+	// Stop rendering
+	render_ahead.Stop();
 
 	// Stop the synthesizer
 	if (service) {
@@ -676,27 +784,16 @@ void MidiHandler_mt32::Close()
 	// Reset the members
 	channel.reset();
 	service.reset();
-	total_buffers_played = 0;
-	last_played_frame = 0;
 
 	is_open = false;
 }
 
-uint32_t MidiHandler_mt32::GetMidiEventTimestamp() const
-{
-	const uint32_t played_frames = total_buffers_played * FRAMES_PER_BUFFER;
-	return service->convertOutputToSynthTimestamp(played_frames +
-	                                              last_played_frame);
-}
-
 void MidiHandler_mt32::PlayMsg(const uint8_t *msg)
 {
 	assert(channel);
 	channel->WakeUp();
 
-	const auto msg_words = reinterpret_cast<const uint32_t *>(msg);
-	const std::lock_guard<std::mutex> lock(service_mutex);
-	service->playMsgAt(SDL_SwapLE32(*msg_words), GetMidiEventTimestamp());
+	render_ahead.QueueMsg(msg);
 }
 
 void MidiHandler_mt32::PlaySysex(uint8_t *sysex, size_t len)
@@ -704,73 +801,134 @@ void MidiHandler_mt32::PlaySysex(uint8_t *sysex, size_t len)
 	assert(channel);
 	channel->WakeUp();
 
-	assert(len <= UINT32_MAX);
-	const auto msg_len = static_cast<uint32_t>(len);
-	const std::lock_guard<std::mutex> lock(service_mutex);
-	service->playSysexAt(sysex, msg_len, GetMidiEventTimestamp());
+	render_ahead.QueueSysex(sysex, len);
 }
 
-// The callback operates at the frame-level, steadily adding samples to the
-// mixer until the requested numbers of frames is met.
-void MidiHandler_mt32::MixerCallBack(uint16_t requested_frames)
+// Sets up the synth for the current quality tier; takes effect when it's
+// opened
+void MidiHandler_mt32::ApplyQuality(const service_t &synth) const
 {
-	while (requested_frames) {
-		const auto frames_to_be_played = std::min(GetRemainingFrames(),
-		                                          requested_frames);
-		const auto sample_offset_in_buffer = play_buffer.data() +
-		                                     last_played_frame * 2;
-		channel->AddSamples_sfloat(frames_to_be_played, sample_offset_in_buffer);
-		requested_frames -= frames_to_be_played;
-		last_played_frame += frames_to_be_played;
-	}
+	const auto &tier = quality_tiers[quality];
+
+	synth->setAnalogOutputMode(tier.analog_mode);
+	synth->selectRendererType(tier.renderer_type);
+	synth->setPartialCount(tier.partial_count);
+	synth->setStereoOutputSampleRate(sample_rate);
+	synth->setSamplerateConversionQuality(tier.rate_conversion_quality);
+	synth->setDACInputMode(DAC_MODE);
+	synth->setNiceAmpRampEnabled(USE_NICE_RAMP);
+	synth->setNicePanningEnabled(USE_NICE_PANNING);
+	synth->setNicePartialMixingEnabled(USE_NICE_PARTIAL_MIXING);
 }
 
-// Returns the number of frames left to play in the buffer.
-uint16_t MidiHandler_mt32::GetRemainingFrames()
+// Plays the message on the rendering thread, at its frame. The synth takes
+// it at the start of the next render.
+void MidiHandler_mt32::ApplyMsg(const uint8_t *msg)
 {
-	// If the current buffer has some frames left, then return those ...
-	if (last_played_frame < FRAMES_PER_BUFFER)
-		return FRAMES_PER_BUFFER - last_played_frame;
+	const auto msg_words = reinterpret_cast<const uint32_t *>(msg);
+	const auto msg_word  = SDL_SwapLE32(*msg_words);
+	service->playMsg(msg_word);
+
+	// Track the channel state that's restored after stepping down
+	if (!is_auto_quality || quality == 0)
+		return;
+	const auto status       = msg[0] & 0xf0;
+	const auto midi_channel = msg[0] & 0x0f;
+	constexpr uint8_t volume_controller = 7;
+	constexpr uint8_t pan_controller    = 10;
+	if (status == 0xc0)
+		channel_msgs[midi_channel * 3 + 0] = msg_word;
+	else if (status == 0xb0 && msg[1] == volume_controller)
+		channel_msgs[midi_channel * 3 + 1] = msg_word;
+	else if (status == 0xb0 && msg[1] == pan_controller)
+		channel_msgs[midi_channel * 3 + 2] = msg_word;
+}
 
-	// Otherwise put the spent buffer in backstock and get the next buffer
-	backstock.Enqueue(std::move(play_buffer));
-	play_buffer = playable.Dequeue();
-	total_buffers_played++;
-	last_played_frame = 0; // reset the frame counter to the beginning
+void MidiHandler_mt32::ApplySysex(const uint8_t *sysex, const size_t len)
+{
+	assert(len <= UINT32_MAX);
+	const auto msg_len = static_cast<uint32_t>(len);
+	service->playSysex(sysex, msg_len);
 
-	return FRAMES_PER_BUFFER;
+	if (is_auto_quality && quality > 0 &&
+	    sysex_history_bytes + len <= max_sysex_history_bytes) {
+		sysex_history.emplace_back(sysex, sysex + len);
+		sysex_history_bytes += len;
+	}
 }
 
-// Keep the playable queue populated with freshly rendered buffers
-void MidiHandler_mt32::Render()
+void MidiHandler_mt32::Render(float *frames, const int num_frames)
 {
-	// Allocate our buffers once and reuse for the duration.
-	constexpr auto SAMPLES_PER_BUFFER = FRAMES_PER_BUFFER * 2; // L & R
-	std::vector<float> render_buffer(SAMPLES_PER_BUFFER);
-	std::vector<float> playable_buffer(SAMPLES_PER_BUFFER);
+	const auto started_at = std::chrono::steady_clock::now();
+
+	const auto len = static_cast<MT32Emu::Bit32u>(num_frames);
+	if (quality_tiers[quality].renderer_type == MT32Emu::RendererType_BIT16S) {
+		render_buffer.resize(static_cast<size_t>(num_frames) * 2);
+		service->renderBit16s(render_buffer.data(), len);
+		for (size_t i = 0; i < render_buffer.size(); ++i)
+			frames[i] = render_buffer[i] / 32768.0f;
+	} else {
+		service->renderFloat(frames, len);
+	}
 
-	// Populate the backstock using copies of the current buffer.
-	while (backstock.Size() < backstock.MaxCapacity() - 1)
-		backstock.Enqueue(playable_buffer);
+	if (is_auto_quality && quality > 0) {
+		const auto render_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		                               std::chrono::steady_clock::now() - started_at)
+		                               .count();
+		MeasureRenderLoad(render_ns, num_frames);
+	}
+}
 
-	backstock.Enqueue(std::move(playable_buffer));
-	assert(backstock.Size() == backstock.MaxCapacity());
+// Compares the time spent rendering with the duration of the audio rendered,
+// window by window, and steps the quality down when it gets too close
+void MidiHandler_mt32::MeasureRenderLoad(const int64_t render_ns, const int num_frames)
+{
+	window_render_ns += render_ns;
+	window_frames += num_frames;
+	if (window_frames < sample_rate / windows_per_second)
+		return;
 
-	while (keep_rendering.load()) {
-		{
-			const std::lock_guard<std::mutex> lock(service_mutex);
-			service->renderFloat(render_buffer.data(), FRAMES_PER_BUFFER);
-		}
-		// Grab the next buffer from backstock and populate it ...
-		playable_buffer = backstock.Dequeue();
+	const auto window_ns = window_frames * 1e9 / sample_rate;
+	const auto load      = window_render_ns / window_ns;
+	slow_windows         = (load > max_render_load) ? slow_windows + 1 : 0;
+
+	window_render_ns = 0;
+	window_frames    = 0;
+
+	if (slow_windows >= slow_windows_to_step) {
+		LOG_MSG("MT32: Rendering took %d%% of real time, stepping down to '%s' quality",
+		        static_cast<int>(load * 100),
+		        quality_tiers[quality - 1].name);
+		StepDownQuality();
+	}
+}
+
+// Reopens the synth one tier lower, on the rendering thread, and restores
+// its state from the SysEx and channel messages sent so far. Notes that
+// were sounding are cut off.
+void MidiHandler_mt32::StepDownQuality()
+{
+	assert(quality > 0);
+	--quality;
+	slow_windows = 0;
+
+	service->closeSynth();
+	ApplyQuality(service);
+	if (const auto rc = service->openSynth(); rc != MT32EMU_RC_OK) {
+		LOG_ERR("MT32: Error reopening the emulation: %i", rc);
+		return;
+	}
 
-		// Swap buffers & scale
-		std::swap(render_buffer, playable_buffer);
-		for (auto &s : playable_buffer)
-			s *= INT16_MAX;
+	for (const auto &sysex : sysex_history)
+		service->playSysexNow(sysex.data(), static_cast<uint32_t>(sysex.size()));
+	for (const auto msg : channel_msgs)
+		if (msg)
+			service->playMsgNow(msg);
 
-		// and then move it into the playable queue
-		playable.Enqueue(std::move(playable_buffer));
+	// Nothing more needs restoring at the lowest tier
+	if (quality == 0) {
+		sysex_history.clear();
+		sysex_history_bytes = 0;
 	}
 }
 
@@ -783,6 +941,7 @@ void MT32_AddConfigSection(const config_ptr_t &conf)
 	Section_prop *sec_prop = conf->AddSection_prop("mt32", &mt32_init);
 
 	assert(sec_prop);
+	sec_prop->AddEarlyInitFunction(&mt32_preload);
 	init_mt32_dosbox_settings(*sec_prop);
 
 	register_mt32_text_messages();
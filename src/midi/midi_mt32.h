@@ -26,19 +26,18 @@
 
 #if C_MT32EMU
 
-#include <atomic>
+#include <array>
+#include <cstdint>
 #include <memory>
-#include <mutex>
 #include <optional>
 #include <string>
-#include <thread>
 #include <vector>
 
 #define MT32EMU_API_TYPE 3
 #include <mt32emu/mt32emu.h>
 
+#include "midi_render_ahead.h"
 #include "mixer.h"
-#include "rwqueue.h"
 
 class LASynthModel;
 using model_and_dir_t = std::pair<const LASynthModel *, std::string>;
@@ -60,34 +59,44 @@ public:
 	void PlayMsg(const uint8_t *msg) override;
 	void PlaySysex(uint8_t *sysex, size_t len) override;
 	void PrintStats();
+	service_t GetService();
 
 private:
-	uint32_t GetMidiEventTimestamp() const;
-	service_t GetService();
-	void MixerCallBack(uint16_t len);
-	uint16_t GetRemainingFrames();
-	void Render();
+	void ApplyMsg(const uint8_t *msg);
+	void ApplySysex(const uint8_t *sysex, const size_t len);
+	void ApplyQuality(const service_t &synth) const;
+	void MeasureRenderLoad(const int64_t render_ns, const int num_frames);
+	void Render(float *frames, const int num_frames);
+	void StepDownQuality();
 
 	// Managed objects
 	mixer_channel_t channel = nullptr;
 
-	std::vector<float> play_buffer = {};
-	static constexpr auto num_buffers = 20;
-	RWQueue<std::vector<float>> playable{num_buffers};
-	RWQueue<std::vector<float>> backstock{num_buffers};
+	MidiRenderAhead render_ahead{"dosbox:mt32"};
 
-	std::mutex service_mutex = {};
 	service_t service = {};
-	std::thread renderer = {};
 	std::optional<model_and_dir_t> model_and_dir = {};
 
-	// The following two members let us determine the total number of played
-	// frames, which is used by GetMidiEventTimestamp() to calculate a total
-	// time offset.
-	uint32_t total_buffers_played = 0;
-	uint16_t last_played_frame = 0; // relative frame-offset in the play buffer
+	// Index into the quality tiers, from fast to best
+	int quality          = 0;
+	bool is_auto_quality = false;
+	int sample_rate      = 0;
+
+	// Render-time measurement for the auto quality, on the rendering thread
+	int64_t window_render_ns = 0;
+	int window_frames        = 0;
+	int slow_windows         = 0;
+
+	// Used to render 16-bit samples in the fast tier
+	std::vector<int16_t> render_buffer = {};
+
+	// What's needed to restore the synth's state after it's reopened at a
+	// lower quality: the SysEx sent (up to a limit), and each channel's
+	// last program change, volume, and pan messages
+	std::vector<std::vector<uint8_t>> sysex_history = {};
+	size_t sysex_history_bytes = 0;
+	std::array<uint32_t, 16 * 3> channel_msgs = {};
 
-	std::atomic_bool keep_rendering = {};
 	bool is_open = false;
 };
 
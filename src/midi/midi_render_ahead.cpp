@@ -0,0 +1,269 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "midi_render_ahead.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "pic.h"
+#include "support.h"
+#include "thread_control.h"
+
+// Room for the events sent between two rendered buffers, beyond which the
+// lists grow
+constexpr size_t reserved_events = 256;
+
+MidiRenderAhead::MidiRenderAhead(const char *_thread_name)
+        : thread_name(_thread_name),
+          keep_rendering(false)
+{}
+
+MidiRenderAhead::~MidiRenderAhead()
+{
+	Stop();
+}
+
+void MidiRenderAhead::Start(mixer_channel_t _channel, render_f _render,
+                            play_msg_f _play_msg, play_sysex_f _play_sysex)
+{
+	assert(!renderer.joinable());
+	assert(_channel && _render && _play_msg && _play_sysex);
+
+	channel    = std::move(_channel);
+	render     = std::move(_render);
+	play_msg   = std::move(_play_msg);
+	play_sysex = std::move(_play_sysex);
+
+	// Allocate all of the buffers once and reuse them for the duration,
+	// parking those beyond the initial depth
+	parked_buffers.reserve(max_buffers);
+	for (auto i = 0; i < max_buffers; ++i) {
+		std::vector<float> buffer(samples_per_buffer);
+		if (i < initial_buffers)
+			backstock.Enqueue(std::move(buffer));
+		else
+			parked_buffers.push_back(std::move(buffer));
+	}
+	buffers_in_use         = initial_buffers;
+	buffers_since_underrun = 0;
+	frames_played          = 0;
+	last_event_frame       = 0;
+
+	incoming.reserve(reserved_events);
+	scheduled.reserve(reserved_events);
+	next_scheduled = 0;
+
+	// Start rendering audio
+	keep_rendering = true;
+	renderer = std::thread(std::bind(&MidiRenderAhead::Render, this));
+	set_thread_name(renderer, thread_name.c_str());
+
+	play_buffer       = playable.Dequeue(); // populate the first play buffer
+	last_played_frame = 0;
+}
+
+void MidiRenderAhead::Stop()
+{
+	if (!renderer.joinable())
+		return;
+
+	// Stop rendering, and wake the renderer if it's waiting for a buffer.
+	// The playable queue can hold every buffer, so it never waits on that.
+	keep_rendering = false;
+	if (backstock.IsEmpty())
+		backstock.Enqueue(std::move(play_buffer));
+
+	// Wait for the rendering thread to finish
+	renderer.join();
+
+	// Drain the rings and release the buffers
+	while (!playable.IsEmpty())
+		playable.Dequeue();
+	while (!backstock.IsEmpty())
+		backstock.Dequeue();
+	parked_buffers.clear();
+	play_buffer.clear();
+
+	incoming.clear();
+	scheduled.clear();
+	next_scheduled = 0;
+
+	channel.reset();
+	render     = {};
+	play_msg   = {};
+	play_sysex = {};
+}
+
+// Stamps an event sent now with the frame it's played at, which is behind
+// the frame the renderer is at by no more than the depth
+int64_t MidiRenderAhead::GetEventFrame()
+{
+	assert(channel);
+
+	// The position within the current millisecond, whose frames the
+	// channel is called for at the end of it
+	const auto frames_per_ms = channel->GetSampleRate() / 1000.0;
+	const auto tick_frames = std::lround(PIC_TickIndex() * frames_per_ms);
+
+	const auto depth = static_cast<int64_t>(buffers_in_use) * frames_per_buffer;
+
+	// Keep the events in order when the depth shrinks
+	last_event_frame = std::max(frames_played + depth + tick_frames,
+	                            last_event_frame);
+	return last_event_frame;
+}
+
+void MidiRenderAhead::QueueMsg(const uint8_t *msg)
+{
+	Event event = {};
+	event.frame = GetEventFrame();
+	std::copy_n(msg, event.msg.size(), event.msg.begin());
+
+	const std::lock_guard<std::mutex> lock(incoming_mutex);
+	incoming.push_back(std::move(event));
+}
+
+void MidiRenderAhead::QueueSysex(const uint8_t *sysex, const size_t len)
+{
+	Event event = {};
+	event.frame = GetEventFrame();
+	event.sysex.assign(sysex, sysex + len);
+
+	const std::lock_guard<std::mutex> lock(incoming_mutex);
+	incoming.push_back(std::move(event));
+}
+
+// The callback operates at the frame-level, steadily adding samples to the
+// mixer until the requested numbers of frames is met.
+void MidiRenderAhead::MixerCallBack(uint16_t requested_frames)
+{
+	while (requested_frames) {
+		if (last_played_frame == frames_per_buffer)
+			NextPlayBuffer();
+
+		const auto frames_to_be_played = std::min(
+		        static_cast<int>(requested_frames),
+		        frames_per_buffer - last_played_frame);
+
+		channel->AddSamples_sfloat(static_cast<uint16_t>(frames_to_be_played),
+		                           play_buffer.data() + last_played_frame * 2);
+
+		requested_frames -= static_cast<uint16_t>(frames_to_be_played);
+		last_played_frame += frames_to_be_played;
+		frames_played += frames_to_be_played;
+	}
+}
+
+// Returns the spent buffer and gets the next one, adjusting the depth
+void MidiRenderAhead::NextPlayBuffer()
+{
+	// After a long run without underruns, park the spent buffer to
+	// render one less ahead
+	if (buffers_since_underrun >= buffers_before_shrinking &&
+	    buffers_in_use > min_buffers) {
+		parked_buffers.push_back(std::move(play_buffer));
+		--buffers_in_use;
+		buffers_since_underrun = 0;
+	} else {
+		backstock.Enqueue(std::move(play_buffer));
+	}
+
+	// If nothing's rendered yet, then we'll wait on the renderer; give it
+	// another buffer so it can get further ahead
+	if (playable.IsEmpty()) {
+		buffers_since_underrun = 0;
+		if (!parked_buffers.empty()) {
+			backstock.Enqueue(std::move(parked_buffers.back()));
+			parked_buffers.pop_back();
+			++buffers_in_use;
+			DEBUG_LOG_MSG("MIDI: %s underran, rendering %d frames ahead",
+			              thread_name.c_str(),
+			              buffers_in_use * frames_per_buffer);
+		}
+	} else {
+		++buffers_since_underrun;
+	}
+
+	play_buffer       = playable.Dequeue();
+	last_played_frame = 0;
+}
+
+void MidiRenderAhead::TakeIncomingEvents()
+{
+	// Drop the events played from the last batch
+	if (next_scheduled == scheduled.size()) {
+		scheduled.clear();
+		next_scheduled = 0;
+	}
+
+	const std::lock_guard<std::mutex> lock(incoming_mutex);
+	for (auto &event : incoming)
+		scheduled.push_back(std::move(event));
+	incoming.clear();
+}
+
+// Keeps the playable queue populated with freshly rendered buffers, playing
+// the events at their frames
+void MidiRenderAhead::Render()
+{
+	THREAD_ApplyToCurrent(ThreadClass::Midi);
+
+	int64_t rendered_frames = 0;
+
+	while (keep_rendering.load()) {
+		// Grab the next buffer from backstock ...
+		auto buffer = backstock.Dequeue();
+		if (!keep_rendering.load())
+			break;
+
+		TakeIncomingEvents();
+
+		// ... and render it, split at the events' frames
+		auto frame = 0;
+		while (frame < frames_per_buffer) {
+			const auto now = rendered_frames + frame;
+			while (next_scheduled < scheduled.size() &&
+			       scheduled[next_scheduled].frame <= now) {
+				const auto &event = scheduled[next_scheduled++];
+				if (event.sysex.empty())
+					play_msg(event.msg.data());
+				else
+					play_sysex(event.sysex.data(), event.sysex.size());
+			}
+
+			auto frames = frames_per_buffer - frame;
+			if (next_scheduled < scheduled.size()) {
+				const auto until_event = scheduled[next_scheduled].frame - now;
+				frames = static_cast<int>(std::min<int64_t>(frames, until_event));
+			}
+			render(buffer.data() + frame * 2, frames);
+			frame += frames;
+		}
+		rendered_frames += frames_per_buffer;
+
+		for (auto &s : buffer)
+			s *= INT16_MAX;
+
+		// and then move it into the playable queue
+		playable.Enqueue(std::move(buffer));
+	}
+}
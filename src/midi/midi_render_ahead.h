@@ -0,0 +1,142 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_MIDI_RENDER_AHEAD_H
+#define DOSBOX_MIDI_RENDER_AHEAD_H
+
+#include "dosbox.h"
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mixer.h"
+#include "rwqueue.h"
+
+/*  MIDI Render-Ahead
+ *  -----------------
+ *  Runs a software synthesizer on its own thread, rendering a few buffers
+ *  ahead of the mixer channel that plays them.
+ *
+ *  MIDI events are stamped with the output frame they should sound at: the
+ *  frame being played when the emulated program sent them, plus the
+ *  render-ahead depth. The rendering thread splits its buffers at those
+ *  frames, so the events keep their relative timing at a constant latency
+ *  instead of snapping to buffer boundaries.
+ *
+ *  The depth adapts to the host: each time the channel finds no rendered
+ *  buffer waiting, another buffer is put into circulation, and after a long
+ *  run without any, one is taken back out to lower the latency again. All
+ *  of the buffers are allocated up front and passed between the threads.
+ *
+ *  Use
+ *  ---
+ *  1. Call Start() with the channel and the synth's render and playback
+ *     functions, which are only called from the rendering thread.
+ *  2. Pass the MIDI messages and SysEx to QueueMsg() and QueueSysex().
+ *  3. Call MixerCallBack() from the channel's mixer callback.
+ *  4. Call Stop() before closing the synth.
+ */
+
+class MidiRenderAhead {
+public:
+	// Renders interleaved stereo frames in the [-1, 1] range
+	using render_f     = std::function<void(float *frames, const int num_frames)>;
+	using play_msg_f   = std::function<void(const uint8_t *msg)>;
+	using play_sysex_f = std::function<void(const uint8_t *sysex, const size_t len)>;
+
+	MidiRenderAhead(const char *thread_name);
+	~MidiRenderAhead();
+
+	void Start(mixer_channel_t channel, render_f render,
+	           play_msg_f play_msg, play_sysex_f play_sysex);
+	void Stop();
+
+	void QueueMsg(const uint8_t *msg);
+	void QueueSysex(const uint8_t *sysex, const size_t len);
+
+	void MixerCallBack(uint16_t requested_frames);
+
+private:
+	MidiRenderAhead(const MidiRenderAhead &)            = delete;
+	MidiRenderAhead &operator=(const MidiRenderAhead &) = delete;
+
+	struct Event {
+		int64_t frame = 0; // the output frame to play the event at
+		std::array<uint8_t, 4> msg  = {};
+		std::vector<uint8_t> sysex = {}; // used instead of msg if not empty
+	};
+
+	int64_t GetEventFrame();
+	void NextPlayBuffer();
+	void Render();
+	void TakeIncomingEvents();
+
+	// Synth granularity, in frames
+	static constexpr int frames_per_buffer  = 48;
+	static constexpr int samples_per_buffer = frames_per_buffer * 2; // L & R
+
+	// The render-ahead depth, in buffers, including the one being played
+	static constexpr int min_buffers     = 2;
+	static constexpr int initial_buffers = 6;
+	static constexpr int max_buffers     = 20;
+
+	// Played buffers without an underrun before the depth is lowered,
+	// about ten seconds' worth
+	static constexpr int buffers_before_shrinking = 10000;
+
+	const std::string thread_name;
+
+	mixer_channel_t channel = nullptr;
+	render_f render         = {};
+	play_msg_f play_msg     = {};
+	play_sysex_f play_sysex = {};
+
+	// Buffers pass from the backstock to the renderer, then through the
+	// playable queue to the channel, and back to the backstock
+	SpscQueue<std::vector<float>> playable{max_buffers};
+	SpscQueue<std::vector<float>> backstock{max_buffers};
+
+	// Only used by the emulation thread, in MixerCallBack() and the
+	// Queue functions
+	std::vector<float> play_buffer = {};
+	std::vector<std::vector<float>> parked_buffers = {}; // out of circulation
+	int buffers_in_use         = 0;
+	int buffers_since_underrun = 0;
+	int last_played_frame      = 0; // relative frame-offset in the play buffer
+	int64_t frames_played      = 0;
+	int64_t last_event_frame   = 0;
+
+	// Events go from the emulation thread to the incoming list, which the
+	// renderer moves to its own scheduled list
+	std::mutex incoming_mutex    = {};
+	std::vector<Event> incoming  = {};
+	std::vector<Event> scheduled = {};
+	size_t next_scheduled        = 0;
+
+	std::thread renderer            = {};
+	std::atomic_bool keep_rendering = {};
+};
+
+#endif
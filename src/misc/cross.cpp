@@ -26,6 +26,7 @@
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -452,6 +453,72 @@ FILE *fopen_wrap_ro_fallback(const std::string &filename, bool &is_readonly)
 	return fp;
 }
 
+int64_t read_file_at(FILE *fp, void *data, const size_t size, const int64_t pos)
+{
+	assert(fp);
+#if defined(WIN32)
+	// Positioned reads move the file pointer on Windows, which callers
+	// mustn't rely on either way
+	const auto handle = reinterpret_cast<HANDLE>(_get_osfhandle(cross_fileno(fp)));
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = static_cast<DWORD>(pos);
+	overlapped.OffsetHigh = static_cast<DWORD>(pos >> 32);
+	DWORD bytes = 0;
+	if (!ReadFile(handle, data, static_cast<DWORD>(size), &bytes, &overlapped))
+		return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+	return bytes;
+#elif HAVE_PREAD
+	return pread(cross_fileno(fp), data, size, static_cast<off_t>(pos));
+#else
+	if (fseek(fp, static_cast<long>(pos), SEEK_SET) != 0)
+		return -1;
+	const auto bytes = fread(data, 1, size, fp);
+	return ferror(fp) ? -1 : static_cast<int64_t>(bytes);
+#endif
+}
+
+bool write_file_at(FILE *fp, const void *data, const size_t size, const int64_t pos)
+{
+	assert(fp);
+#if defined(WIN32)
+	const auto handle = reinterpret_cast<HANDLE>(_get_osfhandle(cross_fileno(fp)));
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = static_cast<DWORD>(pos);
+	overlapped.OffsetHigh = static_cast<DWORD>(pos >> 32);
+	DWORD bytes = 0;
+	return WriteFile(handle, data, static_cast<DWORD>(size), &bytes, &overlapped) &&
+	       bytes == size;
+#elif HAVE_PWRITE
+	auto bytes = static_cast<const uint8_t *>(data);
+	auto remaining = size;
+	auto offset = static_cast<off_t>(pos);
+	while (remaining) {
+		const auto written = pwrite(cross_fileno(fp), bytes, remaining, offset);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		bytes += written;
+		remaining -= static_cast<size_t>(written);
+		offset += written;
+	}
+	return true;
+#else
+	if (fseek(fp, static_cast<long>(pos), SEEK_SET) != 0)
+		return false;
+	return fwrite(data, 1, size, fp) == size && fflush(fp) == 0;
+#endif
+}
+
+void advise_sequential_reads([[maybe_unused]] FILE *fp)
+{
+#if HAVE_POSIX_FADVISE
+	posix_fadvise(cross_fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#elif defined(F_RDAHEAD)
+	fcntl(cross_fileno(fp), F_RDAHEAD, 1);
+#endif
+}
+
 bool wild_match(const char *haystack, const char *needle)
 {
 	assert(haystack);
@@ -0,0 +1,398 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "dir_watcher.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+
+#include "logging.h"
+
+#if defined(__linux__)
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// inotify
+// ~~~~~~~
+struct DirWatcher::Platform {
+	struct Watched {
+		void *tag = nullptr;
+		std::string dir_path = {};
+	};
+	int fd = -1;
+	std::unordered_map<int, Watched> watched = {}; // by watch descriptor
+	std::unordered_map<void *, int> descriptors = {};
+};
+
+DirWatcher::DirWatcher() : platform(std::make_unique<Platform>())
+{
+	platform->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (platform->fd < 0)
+		LOG_WARNING("DIRWATCH: Can't watch host directories: %s",
+		            strerror(errno));
+}
+
+DirWatcher::~DirWatcher()
+{
+	if (platform->fd >= 0)
+		close(platform->fd);
+}
+
+bool DirWatcher::Watch(const std::string &dir_path, void *tag)
+{
+	if (platform->fd < 0)
+		return false;
+	const auto it = platform->descriptors.find(tag);
+	if (it != platform->descriptors.end()) {
+		if (platform->watched[it->second].dir_path == dir_path)
+			return true;
+		Unwatch(tag);
+	}
+	const int wd = inotify_add_watch(platform->fd, dir_path.c_str(),
+	                                 IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+	                                         IN_MOVED_TO | IN_ONLYDIR);
+	if (wd < 0)
+		return false;
+
+	// The same directory under another tag shares the descriptor, so
+	// only the newest tag keeps it
+	const auto previous = platform->watched.find(wd);
+	if (previous != platform->watched.end())
+		platform->descriptors.erase(previous->second.tag);
+	platform->watched[wd] = {tag, dir_path};
+	platform->descriptors[tag] = wd;
+	return true;
+}
+
+void DirWatcher::Unwatch(void *tag)
+{
+	const auto it = platform->descriptors.find(tag);
+	if (it == platform->descriptors.end())
+		return;
+	inotify_rm_watch(platform->fd, it->second);
+	platform->watched.erase(it->second);
+	platform->descriptors.erase(it);
+}
+
+bool DirWatcher::IsWatching(void *tag) const
+{
+	return platform->descriptors.count(tag) != 0;
+}
+
+std::vector<DirChange> DirWatcher::TakeChanges()
+{
+	std::vector<DirChange> changes = {};
+	if (platform->fd < 0)
+		return changes;
+
+	alignas(inotify_event) char buffer[4096];
+	ssize_t bytes = 0;
+	while ((bytes = read(platform->fd, buffer, sizeof(buffer))) > 0) {
+		for (auto pos = buffer; pos < buffer + bytes;) {
+			const auto event = reinterpret_cast<const inotify_event *>(pos);
+			pos += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				for (const auto &[wd, watched] : platform->watched)
+					changes.push_back({watched.tag, watched.dir_path, ""});
+				continue;
+			}
+			const auto it = platform->watched.find(event->wd);
+			if (it == platform->watched.end() || !event->len)
+				continue;
+			changes.push_back({it->second.tag, it->second.dir_path, event->name});
+		}
+	}
+	return changes;
+}
+
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+        defined(__OpenBSD__) || defined(__DragonFly__)
+
+#include <fcntl.h>
+#include <sys/event.h>
+#include <unistd.h>
+
+#if !defined(O_EVTONLY)
+#define O_EVTONLY O_RDONLY
+#endif
+
+// kqueue
+// ~~~~~~
+// A directory's events don't name the entries that changed, and each watch
+// keeps the directory open, so the number of watches is kept well below the
+// default file descriptor limits.
+constexpr size_t max_kqueue_watches = 64;
+
+struct DirWatcher::Platform {
+	struct Watched {
+		void *tag = nullptr;
+		std::string dir_path = {};
+	};
+	int kq = -1;
+	std::unordered_map<int, Watched> watched = {}; // by file descriptor
+	std::unordered_map<void *, int> descriptors = {};
+};
+
+DirWatcher::DirWatcher() : platform(std::make_unique<Platform>())
+{
+	platform->kq = kqueue();
+	if (platform->kq < 0)
+		LOG_WARNING("DIRWATCH: Can't watch host directories: %s",
+		            strerror(errno));
+}
+
+DirWatcher::~DirWatcher()
+{
+	for (const auto &[fd, watched] : platform->watched)
+		close(fd);
+	if (platform->kq >= 0)
+		close(platform->kq);
+}
+
+bool DirWatcher::Watch(const std::string &dir_path, void *tag)
+{
+	if (platform->kq < 0)
+		return false;
+	const auto it = platform->descriptors.find(tag);
+	if (it != platform->descriptors.end()) {
+		if (platform->watched[it->second].dir_path == dir_path)
+			return true;
+		Unwatch(tag);
+	}
+	if (platform->watched.size() >= max_kqueue_watches)
+		return false;
+
+	const int fd = open(dir_path.c_str(), O_EVTONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct kevent change;
+	EV_SET(&change, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, 0);
+	if (kevent(platform->kq, &change, 1, nullptr, 0, nullptr) < 0) {
+		close(fd);
+		return false;
+	}
+	platform->watched[fd] = {tag, dir_path};
+	platform->descriptors[tag] = fd;
+	return true;
+}
+
+void DirWatcher::Unwatch(void *tag)
+{
+	const auto it = platform->descriptors.find(tag);
+	if (it == platform->descriptors.end())
+		return;
+	// Closing the directory removes its event
+	close(it->second);
+	platform->watched.erase(it->second);
+	platform->descriptors.erase(it);
+}
+
+bool DirWatcher::IsWatching(void *tag) const
+{
+	return platform->descriptors.count(tag) != 0;
+}
+
+std::vector<DirChange> DirWatcher::TakeChanges()
+{
+	std::vector<DirChange> changes = {};
+	if (platform->kq < 0)
+		return changes;
+
+	struct kevent events[32];
+	const timespec no_wait = {0, 0};
+	int num_events = 0;
+	while ((num_events = kevent(platform->kq, nullptr, 0, events, 32, &no_wait)) > 0) {
+		for (int i = 0; i < num_events; ++i) {
+			const auto it = platform->watched.find(static_cast<int>(events[i].ident));
+			if (it != platform->watched.end())
+				changes.push_back({it->second.tag, it->second.dir_path, ""});
+		}
+	}
+	return changes;
+}
+
+#elif defined(WIN32)
+
+#include <windows.h>
+
+// ReadDirectoryChangesW
+// ~~~~~~~~~~~~~~~~~~~~~
+// All the watches signal the same event, so polling takes one check until
+// one of them completes.
+struct DirWatcher::Platform {
+	struct Watched {
+		HANDLE dir = INVALID_HANDLE_VALUE;
+		OVERLAPPED overlapped = {};
+		std::string dir_path = {};
+		alignas(DWORD) uint8_t buffer[8192] = {};
+
+		bool ReadChanges()
+		{
+			return ReadDirectoryChangesW(dir, buffer, sizeof(buffer), FALSE,
+			                             FILE_NOTIFY_CHANGE_FILE_NAME |
+			                                     FILE_NOTIFY_CHANGE_DIR_NAME,
+			                             nullptr, &overlapped, nullptr);
+		}
+
+		void Close()
+		{
+			DWORD bytes = 0;
+			CancelIoEx(dir, &overlapped);
+			GetOverlappedResult(dir, &overlapped, &bytes, TRUE);
+			CloseHandle(dir);
+		}
+	};
+	HANDLE event = nullptr;
+	std::unordered_map<void *, std::unique_ptr<Watched>> watched = {};
+};
+
+DirWatcher::DirWatcher() : platform(std::make_unique<Platform>())
+{
+	platform->event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!platform->event)
+		LOG_WARNING("DIRWATCH: Can't watch host directories: error %lu",
+		            GetLastError());
+}
+
+DirWatcher::~DirWatcher()
+{
+	for (auto &[tag, watched] : platform->watched)
+		watched->Close();
+	if (platform->event)
+		CloseHandle(platform->event);
+}
+
+bool DirWatcher::Watch(const std::string &dir_path, void *tag)
+{
+	if (!platform->event)
+		return false;
+	const auto it = platform->watched.find(tag);
+	if (it != platform->watched.end()) {
+		if (it->second->dir_path == dir_path)
+			return true;
+		Unwatch(tag);
+	}
+	auto watched = std::make_unique<Platform::Watched>();
+	watched->dir = CreateFileA(dir_path.c_str(), FILE_LIST_DIRECTORY,
+	                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                           nullptr, OPEN_EXISTING,
+	                           FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+	                           nullptr);
+	if (watched->dir == INVALID_HANDLE_VALUE)
+		return false;
+	watched->overlapped.hEvent = platform->event;
+	watched->dir_path = dir_path;
+	if (!watched->ReadChanges()) {
+		CloseHandle(watched->dir);
+		return false;
+	}
+	platform->watched[tag] = std::move(watched);
+	return true;
+}
+
+void DirWatcher::Unwatch(void *tag)
+{
+	const auto it = platform->watched.find(tag);
+	if (it == platform->watched.end())
+		return;
+	it->second->Close();
+	platform->watched.erase(it);
+}
+
+bool DirWatcher::IsWatching(void *tag) const
+{
+	return platform->watched.count(tag) != 0;
+}
+
+std::vector<DirChange> DirWatcher::TakeChanges()
+{
+	std::vector<DirChange> changes = {};
+	if (!platform->event || WaitForSingleObject(platform->event, 0) != WAIT_OBJECT_0)
+		return changes;
+	ResetEvent(platform->event);
+
+	for (auto it = platform->watched.begin(); it != platform->watched.end();) {
+		auto &watched = *it->second;
+		const auto tag = it->first;
+		DWORD bytes = 0;
+		if (!HasOverlappedIoCompleted(&watched.overlapped)) {
+			++it;
+			continue;
+		}
+		const bool result = GetOverlappedResult(watched.dir, &watched.overlapped,
+		                                        &bytes, FALSE);
+		if (result && bytes) {
+			for (auto pos = watched.buffer;;) {
+				const auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(pos);
+				char name[MAX_PATH];
+				const int len = WideCharToMultiByte(CP_ACP, 0, info->FileName,
+				                                    static_cast<int>(info->FileNameLength / sizeof(WCHAR)),
+				                                    name, sizeof(name) - 1,
+				                                    nullptr, nullptr);
+				if (len > 0)
+					changes.push_back({tag, watched.dir_path, std::string(name, len)});
+				if (!info->NextEntryOffset)
+					break;
+				pos += info->NextEntryOffset;
+			}
+		} else {
+			// The changes didn't fit in the buffer
+			changes.push_back({tag, watched.dir_path, ""});
+		}
+		if (!watched.ReadChanges()) {
+			// The directory was removed
+			CloseHandle(watched.dir);
+			it = platform->watched.erase(it);
+			continue;
+		}
+		++it;
+	}
+	return changes;
+}
+
+#else
+
+struct DirWatcher::Platform {};
+
+DirWatcher::DirWatcher() : platform(std::make_unique<Platform>()) {}
+
+DirWatcher::~DirWatcher() = default;
+
+bool DirWatcher::Watch(const std::string &, void *)
+{
+	return false;
+}
+
+void DirWatcher::Unwatch(void *) {}
+
+bool DirWatcher::IsWatching(void *) const
+{
+	return false;
+}
+
+std::vector<DirChange> DirWatcher::TakeChanges()
+{
+	return {};
+}
+
+#endif
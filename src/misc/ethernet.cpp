@@ -23,24 +23,38 @@
 #include <cstring>
 
 #include "control.h"
+#include "ethernet_pcap.h"
 #include "ethernet_slirp.h"
+#include "ethernet_tap.h"
 
-EthernetConnection *ETHERNET_OpenConnection([[maybe_unused]] const std::string &backend)
+EthernetConnection *ETHERNET_OpenConnection(const std::string &backend)
 {
 	EthernetConnection *conn = nullptr;
 #if C_SLIRP
-	// Currently only slirp is supported
-	if (backend == "slirp") {
+	if (backend == "slirp")
 		conn = new SlirpEthernetConnection;
-		assert(control);
-		const auto settings = control->GetSection("ethernet");
-		if (!conn->Initialize(settings)) {
-			LOG_WARNING("Failed to initialize the slirp Ethernet backend");
-			delete conn;
-			conn = nullptr;
-		}
-	}
 #endif
+#if C_NE2000 && defined(__linux__)
+	if (backend == "tap")
+		conn = new TapEthernetConnection;
+#endif
+#if C_PCAP
+	if (backend == "pcap")
+		conn = new PcapEthernetConnection;
+#endif
+	if (!conn) {
+		LOG_WARNING("The %s Ethernet backend isn't available in this build",
+		            backend.c_str());
+		return nullptr;
+	}
 
+	assert(control);
+	const auto settings = control->GetSection("ethernet");
+	if (!conn->Initialize(settings)) {
+		LOG_WARNING("Failed to initialize the %s Ethernet backend",
+		            backend.c_str());
+		delete conn;
+		conn = nullptr;
+	}
 	return conn;
 }
@@ -0,0 +1,115 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "ethernet_pcap.h"
+
+#if C_PCAP
+
+#include <cassert>
+#include <cstring>
+
+#include "setup.h"
+
+// Header and payload, with room for a VLAN tag
+constexpr int snapshot_length = 14 + 4 + 1500;
+
+// The kernel hands over what it has buffered after this long, so frames
+// arrive in batches without adding noticeable latency
+constexpr int read_timeout_ms = 1;
+
+PcapEthernetConnection::~PcapEthernetConnection()
+{
+	if (handle)
+		pcap_close(handle);
+}
+
+bool PcapEthernetConnection::Initialize(Section *dosbox_config)
+{
+	const auto section = static_cast<Section_prop *>(dosbox_config);
+	assert(section);
+	const std::string name = section->Get_string("host_interface");
+	if (name.empty()) {
+		LOG_WARNING("PCAP: Set 'host_interface' to the name of a host network interface");
+		return false;
+	}
+
+	char error[PCAP_ERRBUF_SIZE] = {};
+	handle = pcap_create(name.c_str(), error);
+	if (!handle) {
+		LOG_WARNING("PCAP: Can't open interface '%s': %s", name.c_str(), error);
+		return false;
+	}
+	pcap_set_snaplen(handle, snapshot_length);
+	// The guest has a MAC address of its own, so it needs to see frames
+	// sent to it as well as to the host
+	pcap_set_promisc(handle, 1);
+	pcap_set_timeout(handle, read_timeout_ms);
+	pcap_set_immediate_mode(handle, 1);
+	if (pcap_activate(handle) < 0) {
+		LOG_WARNING("PCAP: Can't capture on interface '%s': %s",
+		            name.c_str(), pcap_geterr(handle));
+		pcap_close(handle);
+		handle = nullptr;
+		return false;
+	}
+	if (pcap_datalink(handle) != DLT_EN10MB) {
+		LOG_WARNING("PCAP: Interface '%s' isn't an Ethernet interface",
+		            name.c_str());
+		pcap_close(handle);
+		handle = nullptr;
+		return false;
+	}
+	if (pcap_setnonblock(handle, 1, error) < 0)
+		LOG_WARNING("PCAP: Can't poll interface '%s': %s", name.c_str(), error);
+
+	LOG_MSG("PCAP: Capturing on interface '%s'", name.c_str());
+	return true;
+}
+
+void PcapEthernetConnection::SendPacket(const uint8_t *packet, int len)
+{
+	// sentinel
+	if (len <= 0)
+		return;
+	// Remember who the guest is, so its frames aren't looped back to it
+	if (len >= 12)
+		memcpy(guest_mac, packet + 6, sizeof(guest_mac));
+	pcap_sendpacket(handle, packet, len);
+}
+
+void PcapEthernetConnection::GetPackets(std::function<int(const uint8_t *, int)> callback)
+{
+	struct Receiver {
+		const uint8_t *guest_mac;
+		std::function<int(const uint8_t *, int)> &callback;
+	} receiver = {guest_mac, callback};
+
+	// One dispatch hands over every frame in the capture buffer
+	const auto receive = [](u_char *user, const pcap_pkthdr *header,
+	                        const u_char *bytes) {
+		const auto r = reinterpret_cast<Receiver *>(user);
+		if (header->caplen < 12 || memcmp(bytes + 6, r->guest_mac, 6) == 0)
+			return;
+		r->callback(bytes, static_cast<int>(header->caplen));
+	};
+	pcap_dispatch(handle, -1, receive, reinterpret_cast<u_char *>(&receiver));
+}
+
+#endif
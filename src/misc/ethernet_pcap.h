@@ -0,0 +1,58 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_ETHERNET_PCAP_H
+#define DOSBOX_ETHERNET_PCAP_H
+
+#include "dosbox.h"
+
+#if C_PCAP
+
+#include <pcap.h>
+
+#include "config.h"
+#include "ethernet.h"
+
+/** A libpcap-based Ethernet connection
+ * This backend captures and injects frames on a physical host interface,
+ * so the guest shares the host's network segment. It usually needs elevated
+ * privileges or a capture-enabled user, and on Windows it uses Npcap.
+ */
+class PcapEthernetConnection : public EthernetConnection {
+public:
+	PcapEthernetConnection() = default;
+	~PcapEthernetConnection();
+
+	/* We can't copy this */
+	PcapEthernetConnection(const PcapEthernetConnection &) = delete;
+	PcapEthernetConnection &operator=(const PcapEthernetConnection &) = delete;
+
+	bool Initialize(Section *config);
+	void SendPacket(const uint8_t *packet, int len);
+	void GetPackets(std::function<int(const uint8_t *, int)> callback);
+
+private:
+	pcap_t *handle = nullptr;  /*!< The capture on the host interface */
+	uint8_t guest_mac[6] = {}; /*!< Source of the guest's frames */
+};
+
+#endif
+
+#endif
@@ -26,6 +26,11 @@
 #include <map>
 #include <stdexcept>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "dosbox.h"
 #include "ethernet_slirp.h"
 #include "setup.h"
@@ -125,7 +130,6 @@ SlirpEthernetConnection::SlirpEthernetConnection()
         : EthernetConnection(),
           config(),
           timers(),
-          get_packet_callback(),
           registered_fds(),
 #ifdef WIN32
           readfds(),
@@ -148,8 +152,15 @@ SlirpEthernetConnection::SlirpEthernetConnection()
 
 SlirpEthernetConnection::~SlirpEthernetConnection()
 {
+	if (thread.joinable()) {
+		is_stopping = true;
+		WakeupSignal();
+		thread.join();
+	}
+	WakeupClose();
 	if (slirp)
 		slirp_cleanup(slirp);
+	TimersClear();
 }
 
 bool SlirpEthernetConnection::Initialize(Section *dosbox_config)
@@ -213,6 +224,12 @@ bool SlirpEthernetConnection::Initialize(Section *dosbox_config)
 		ClearPortForwards(is_udp, forwarded_udp_ports);
 		forwarded_udp_ports = SetupPortForwards(is_udp, section->Get_string("udp_port_forwards"));
 
+		if (!WakeupOpen()) {
+			LOG_MSG("SLIRP: Failed to create the wakeup pipe");
+			return false;
+		}
+		thread = std::thread([this] { Run(); });
+
 		LOG_MSG("SLIRP: Successfully initialized");
 		return true;
 	} else {
@@ -364,21 +381,32 @@ void SlirpEthernetConnection::SendPacket(const uint8_t *packet, int len)
 		            len, GetMTU());
 		return;
 	}
-	slirp_input(slirp, packet, len);
+	{
+		const std::lock_guard<std::mutex> lock(packets_mutex);
+		packets_to_slirp.emplace_back(packet, packet + len);
+	}
+	WakeupSignal();
 }
 
 void SlirpEthernetConnection::GetPackets(std::function<int(const uint8_t *, int)> callback)
 {
-	get_packet_callback = callback;
-	uint32_t timeout_ms = 0;
-	PollsClear();
-	PollsAddRegistered();
-	slirp_pollfds_fill(slirp, &timeout_ms, slirp_add_poll, this);
-	const bool poll_failed = !PollsPoll(timeout_ms);
-	slirp_pollfds_poll(slirp, poll_failed, slirp_get_revents, this);
-	TimersRun();
+	std::deque<std::vector<uint8_t>> packets = {};
+	{
+		const std::lock_guard<std::mutex> lock(packets_mutex);
+		packets.swap(packets_to_guest);
+	}
+	for (const auto &packet : packets)
+		callback(packet.data(), check_cast<int>(packet.size()));
 }
 
+// Packets beyond this wait for the guest are dropped, as a full network
+// card's buffer would drop them
+constexpr size_t max_packets_to_guest = 1024;
+
+// How long the thread polls at most, if neither libslirp nor its timers
+// need it sooner
+constexpr uint32_t max_poll_wait_ms = 1000;
+
 int SlirpEthernetConnection::ReceivePacket(const uint8_t *packet, int len)
 {
 	// sentinels
@@ -389,7 +417,36 @@ int SlirpEthernetConnection::ReceivePacket(const uint8_t *packet, int len)
 		            len, GetMRU());
 		return -1;
 	}
-	return get_packet_callback(packet, len);
+	const std::lock_guard<std::mutex> lock(packets_mutex);
+	if (packets_to_guest.size() >= max_packets_to_guest)
+		return -1;
+	packets_to_guest.emplace_back(packet, packet + len);
+	return len;
+}
+
+void SlirpEthernetConnection::Run()
+{
+	std::deque<std::vector<uint8_t>> packets = {};
+	while (!is_stopping) {
+		{
+			const std::lock_guard<std::mutex> lock(packets_mutex);
+			packets.swap(packets_to_slirp);
+		}
+		for (const auto &packet : packets)
+			slirp_input(slirp, packet.data(), check_cast<int>(packet.size()));
+		packets.clear();
+
+		// The wakeup pipe is polled along with libslirp's sockets, so
+		// packets from the guest don't wait for the timeout
+		uint32_t timeout_ms = max_poll_wait_ms;
+		PollsClear();
+		PollAdd(wakeup_fds[0], SLIRP_POLL_IN);
+		slirp_pollfds_fill(slirp, &timeout_ms, slirp_add_poll, this);
+		const bool poll_failed = !PollsPoll(TimersWaitMs(timeout_ms));
+		WakeupDrain();
+		slirp_pollfds_poll(slirp, poll_failed, slirp_get_revents, this);
+		TimersRun();
+	}
 }
 
 struct slirp_timer *SlirpEthernetConnection::TimerNew(SlirpTimerCb cb, void *cb_opaque)
@@ -404,7 +461,8 @@ struct slirp_timer *SlirpEthernetConnection::TimerNew(SlirpTimerCb cb, void *cb_
 
 void SlirpEthernetConnection::TimerFree(struct slirp_timer *timer)
 {
-	std::remove(timers.begin(), timers.end(), timer);
+	timers.erase(std::remove(timers.begin(), timers.end(), timer),
+	             timers.end());
 	delete timer;
 }
 
@@ -433,6 +491,17 @@ void SlirpEthernetConnection::TimersClear()
 	timers.clear();
 }
 
+uint32_t SlirpEthernetConnection::TimersWaitMs(const uint32_t max_ms) const
+{
+	const int64_t now = slirp_clock_get_ns(nullptr);
+	int64_t wait_ns = static_cast<int64_t>(max_ms) * 1'000'000;
+	for (const auto *timer : timers)
+		if (timer->expires_ns)
+			wait_ns = std::min(wait_ns,
+			                   std::max<int64_t>(timer->expires_ns - now, 0));
+	return static_cast<uint32_t>((wait_ns + 999'999) / 1'000'000);
+}
+
 void SlirpEthernetConnection::PollRegister(const int fd)
 {
 	// sentinel
@@ -451,14 +520,9 @@ void SlirpEthernetConnection::PollUnregister(const int fd)
 	// sentinels
 	if (fd < 0 || registered_fds.empty())
 		return;
-	std::remove(registered_fds.begin(), registered_fds.end(), fd);
-}
-
-void SlirpEthernetConnection::PollsAddRegistered()
-{
-	for (const auto fd : registered_fds)
-		if (fd >= 0)
-			PollAdd(fd, SLIRP_POLL_IN | SLIRP_POLL_OUT);
+	registered_fds.erase(std::remove(registered_fds.begin(),
+	                                 registered_fds.end(), fd),
+	                     registered_fds.end());
 }
 
 /* Begin the bulk of the platform-specific code.
@@ -472,6 +536,38 @@ void SlirpEthernetConnection::PollsAddRegistered()
 
 #ifndef WIN32
 
+bool SlirpEthernetConnection::WakeupOpen()
+{
+	if (pipe(wakeup_fds) != 0)
+		return false;
+	for (const auto fd : wakeup_fds)
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return true;
+}
+
+void SlirpEthernetConnection::WakeupClose()
+{
+	for (auto &fd : wakeup_fds) {
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+	}
+}
+
+void SlirpEthernetConnection::WakeupSignal()
+{
+	// A full pipe already wakes the thread
+	const uint8_t byte = 0;
+	[[maybe_unused]] const auto written = write(wakeup_fds[1], &byte, 1);
+}
+
+void SlirpEthernetConnection::WakeupDrain()
+{
+	uint8_t bytes[64];
+	while (read(wakeup_fds[0], bytes, sizeof(bytes)) > 0)
+		;
+}
+
 void SlirpEthernetConnection::PollsClear()
 {
 	polls.clear();
@@ -526,6 +622,48 @@ int SlirpEthernetConnection::PollGetSlirpRevents(int idx)
 
 #else
 
+bool SlirpEthernetConnection::WakeupOpen()
+{
+	// select() only takes sockets, so the socket wakes itself up
+	const SOCKET wakeup = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (wakeup == INVALID_SOCKET)
+		return false;
+	sockaddr_in address = {};
+	int address_size = sizeof(address);
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	u_long non_blocking = 1;
+	if (bind(wakeup, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+	    getsockname(wakeup, reinterpret_cast<sockaddr *>(&address), &address_size) != 0 ||
+	    connect(wakeup, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+	    ioctlsocket(wakeup, FIONBIO, &non_blocking) != 0) {
+		closesocket(wakeup);
+		return false;
+	}
+	wakeup_fds[0] = wakeup_fds[1] = check_cast<int>(wakeup);
+	return true;
+}
+
+void SlirpEthernetConnection::WakeupClose()
+{
+	if (wakeup_fds[0] >= 0)
+		closesocket(static_cast<SOCKET>(wakeup_fds[0]));
+	wakeup_fds[0] = wakeup_fds[1] = -1;
+}
+
+void SlirpEthernetConnection::WakeupSignal()
+{
+	const char byte = 0;
+	send(static_cast<SOCKET>(wakeup_fds[1]), &byte, 1, 0);
+}
+
+void SlirpEthernetConnection::WakeupDrain()
+{
+	char bytes[64];
+	while (recv(static_cast<SOCKET>(wakeup_fds[0]), bytes, sizeof(bytes), 0) > 0)
+		;
+}
+
 void SlirpEthernetConnection::PollsClear()
 {
 	FD_ZERO(&readfds);
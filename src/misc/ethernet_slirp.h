@@ -25,8 +25,11 @@
 
 #if C_SLIRP
 
+#include <atomic>
 #include <map>
 #include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <libslirp.h>
 
@@ -62,6 +65,10 @@ struct slirp_timer {
  * This backend uses a virtual Ethernet device. Only TCP, UDP and some ICMP
  * work over this interface. This is because libslirp terminates guest
  * connections during routing and passes them to sockets created in the host.
+ *
+ * Once initialized, libslirp is only used from the connection's own thread,
+ * which sleeps in poll() until a host socket, a timer or a packet from the
+ * guest needs it. Packets pass between the threads through locked queues.
  */
 class SlirpEthernetConnection : public EthernetConnection {
 public:
@@ -96,15 +103,26 @@ public:
 	void PollUnregister(int fd);
 
 private:
+	/* Services libslirp until the connection is closed */
+	void Run();
+
 	/* Runs and clears all the timers*/
 	void TimersRun();
 	void TimersClear();
 
+	/* How long until the next timer is due, at most max_ms */
+	uint32_t TimersWaitMs(uint32_t max_ms) const;
+
+	/* Wakes the thread from polling */
+	bool WakeupOpen();
+	void WakeupClose();
+	void WakeupSignal();
+	void WakeupDrain();
+
 	void ClearPortForwards(const bool is_udp, std::map<int, int> &existing_port_forwards);
 	std::map<int, int> SetupPortForwards(const bool is_udp, const std::string &port_forward_rules);
 
 	/* Builds a list of descriptors and polls them */
-	void PollsAddRegistered();
 	void PollsClear();
 	bool PollsPoll(uint32_t timeout_ms);
 
@@ -113,18 +131,17 @@ private:
 	SlirpCb slirp_callbacks = {};  /*!< Callbacks used by libslirp */
 	std::deque<struct slirp_timer *> timers = {}; /*!< Stored timers */
 
-	/** The GetPacket callback
-	 * When libslirp has a new packet for us it calls ReceivePacket,
-	 * but the EthernetConnection interface requires users to poll
-	 * for new packets using GetPackets. We temporarily store the
-	 * callback from GetPackets here for ReceivePacket.
-	 * This might seem racy, but keep in mind we control when
-	 * libslirp sends us packets via our polling system.
-	 */
-	std::function<int(const uint8_t *, int)> get_packet_callback = nullptr;
+	/* Packets on their way to and from the guest */
+	std::mutex packets_mutex = {};
+	std::deque<std::vector<uint8_t>> packets_to_slirp = {};
+	std::deque<std::vector<uint8_t>> packets_to_guest = {};
 
 	std::deque<int> registered_fds = {}; /*!< File descriptors to watch */
 
+	/* The read and write ends of the wakeup pipe, or on Windows, a
+	 * loopback UDP socket that's sent to itself */
+	int wakeup_fds[2] = {-1, -1};
+
 	// keep track of the ports fowarded
 	std::map<int, int> forwarded_tcp_ports = {};
 	std::map<int, int> forwarded_udp_ports = {};
@@ -136,6 +153,9 @@ private:
 	fd_set writefds = {};  /*!< Write descriptors for select() */
 	fd_set exceptfds = {}; /*!< Exceptional descriptors for select() */
 #endif
+
+	std::atomic<bool> is_stopping = false;
+	std::thread thread = {};
 };
 
 #endif
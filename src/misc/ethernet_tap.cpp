@@ -0,0 +1,101 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "ethernet_tap.h"
+
+#if C_NE2000 && defined(__linux__)
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "setup.h"
+#include "string_utils.h"
+
+// Header and payload, with room for a VLAN tag
+constexpr size_t max_frame_size = 14 + 4 + 1500;
+
+// Frames read per poll at most, so a flood can't stall the emulation
+constexpr int max_frames_per_poll = 256;
+
+TapEthernetConnection::~TapEthernetConnection()
+{
+	if (fd >= 0)
+		close(fd);
+}
+
+bool TapEthernetConnection::Initialize(Section *dosbox_config)
+{
+	const auto section = static_cast<Section_prop *>(dosbox_config);
+	assert(section);
+	const std::string name = section->Get_string("host_interface");
+	if (name.empty() || name.size() >= IFNAMSIZ) {
+		LOG_WARNING("TAP: Set 'host_interface' to the name of a TAP interface");
+		return false;
+	}
+
+	fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		LOG_WARNING("TAP: Can't open /dev/net/tun: %s", strerror(errno));
+		return false;
+	}
+	ifreq request = {};
+	request.ifr_flags = IFF_TAP | IFF_NO_PI;
+	safe_strcpy(request.ifr_name, name.c_str());
+	if (ioctl(fd, TUNSETIFF, &request) < 0) {
+		LOG_WARNING("TAP: Can't attach to interface '%s': %s",
+		            name.c_str(), strerror(errno));
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	buffer.resize(max_frame_size);
+	LOG_MSG("TAP: Attached to interface '%s'", request.ifr_name);
+	return true;
+}
+
+void TapEthernetConnection::SendPacket(const uint8_t *packet, int len)
+{
+	// sentinel
+	if (len <= 0)
+		return;
+	// Like a wire, a TAP device drops what it can't take
+	[[maybe_unused]] const auto written = write(fd, packet,
+	                                            static_cast<size_t>(len));
+}
+
+void TapEthernetConnection::GetPackets(std::function<int(const uint8_t *, int)> callback)
+{
+	// Each read takes one frame, so take all the pending ones at once
+	for (int i = 0; i < max_frames_per_poll; ++i) {
+		const auto len = read(fd, buffer.data(), buffer.size());
+		if (len <= 0)
+			break;
+		callback(buffer.data(), static_cast<int>(len));
+	}
+}
+
+#endif
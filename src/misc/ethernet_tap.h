@@ -0,0 +1,60 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_ETHERNET_TAP_H
+#define DOSBOX_ETHERNET_TAP_H
+
+#include "dosbox.h"
+
+#if C_NE2000 && defined(__linux__)
+
+#include <vector>
+
+#include "config.h"
+#include "ethernet.h"
+
+/** A TAP-based Ethernet connection
+ * This backend attaches the guest to a TAP interface on the host, which is
+ * usually bridged with a physical interface. The frames pass through as
+ * they are, so the guest is on the host's network with an address of its
+ * own. The interface has to exist and be usable by the user beforehand,
+ * for example after 'ip tuntap add dev tap0 mode tap user <name>'.
+ */
+class TapEthernetConnection : public EthernetConnection {
+public:
+	TapEthernetConnection() = default;
+	~TapEthernetConnection();
+
+	/* We can't copy this */
+	TapEthernetConnection(const TapEthernetConnection &) = delete;
+	TapEthernetConnection &operator=(const TapEthernetConnection &) = delete;
+
+	bool Initialize(Section *config);
+	void SendPacket(const uint8_t *packet, int len);
+	void GetPackets(std::function<int(const uint8_t *, int)> callback);
+
+private:
+	int fd = -1;                      /*!< The TAP device */
+	std::vector<uint8_t> buffer = {}; /*!< Frames are read into this */
+};
+
+#endif
+
+#endif
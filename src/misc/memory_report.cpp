@@ -0,0 +1,90 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "memory_report.h"
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "string_utils.h"
+#include "support.h"
+
+constexpr auto num_users = static_cast<size_t>(MemoryUser::NumUsers);
+
+// In the order of the MemoryUser enum
+constexpr std::array<const char *, num_users> user_names = {
+        "guest RAM", "GUS RAM", "dynamic core cache",
+        "mixer", "CD audio", "ISO sector cache"};
+
+// Adjusted from the audio and emulation threads alike
+static std::array<std::atomic<int64_t>, num_users> held_bytes = {};
+
+void MEMREPORT_Add(const MemoryUser user, const int64_t bytes)
+{
+	held_bytes[static_cast<size_t>(user)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// The resident set size of the process, or 0 when the host doesn't tell
+static int64_t resident_bytes()
+{
+#if defined(__linux__)
+	auto statm = fopen("/proc/self/statm", "r");
+	if (!statm)
+		return 0;
+	long total_pages = 0;
+	long resident_pages = 0;
+	const auto fields = fscanf(statm, "%ld %ld", &total_pages, &resident_pages);
+	fclose(statm);
+	if (fields != 2)
+		return 0;
+	return static_cast<int64_t>(resident_pages) * sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+static std::string format_mib(const int64_t bytes)
+{
+	char text[32];
+	safe_sprintf(text, "%.1f MiB", static_cast<double>(bytes) / (1024 * 1024));
+	return text;
+}
+
+void MEMREPORT_Log(const char *when)
+{
+	std::string report = {};
+	for (size_t i = 0; i < num_users; ++i) {
+		if (!report.empty())
+			report += ", ";
+		report += user_names[i];
+		report += " ";
+		report += format_mib(held_bytes[i].load(std::memory_order_relaxed));
+	}
+	const auto rss = resident_bytes();
+	if (rss)
+		report += "; resident " + format_mib(rss);
+	LOG_MSG("MEMORY: %s: %s", when, report.c_str());
+}
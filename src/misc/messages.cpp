@@ -25,12 +25,16 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <deque>
+#include <algorithm>
+#include <fstream>
 #include <map>
-
-#include "std_filesystem.h"
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
+
+#include "std_filesystem.h"
 
 #include "ansi_code_markup.h"
 #include "checks.h"
@@ -41,33 +45,61 @@
 #include "string_utils.h"
 #include "support.h"
 
-#define LINE_IN_MAXLEN 2048
-
 CHECK_NARROWING();
 
 static const char *msg_not_found = "Message not Found!\n";
 
-class Message {
-private:
-	std::string markup_msg = {};
-	std::string rendered_msg = {};
-
-	std::map<uint16_t, std::string> rendered_msg_by_codepage = {};
-
-	const char *CachedRenderString(const std::string &msg,
-	                               std::map<uint16_t, std::string> &output_msg_by_codepage)
+// Append-only storage for the message names and texts. They're never freed
+// individually, so packing them back-to-back into large blocks avoids a heap
+// allocation (and std::string's overhead) per string.
+class StringArena {
+public:
+	char *Allocate(const size_t bytes)
 	{
-		assert(msg.length());
-		const uint16_t cp = UTF8_GetCodePage();
-		if (output_msg_by_codepage[cp].empty()) {
-			if (!UTF8_RenderForDos(msg, output_msg_by_codepage[cp], cp))
-				LOG_WARNING("LANG: Problem rendering string");
-			assert(output_msg_by_codepage[cp].length());
+		// Large requests, such as whole language files, get their own block
+		if (bytes > block_size / 4)
+			return blocks.emplace_back(new char[bytes]).get();
+
+		if (used + bytes > block_size) {
+			current = blocks.emplace_back(new char[block_size]).get();
+			used    = 0;
 		}
+		char *allocation = current + used;
+		used += bytes;
+		return allocation;
+	}
 
-		return output_msg_by_codepage[cp].c_str();
+	const char *Intern(const std::string_view sv)
+	{
+		char *str = Allocate(sv.size() + 1);
+		std::copy(sv.begin(), sv.end(), str);
+		str[sv.size()] = '\0';
+		return str;
 	}
 
+private:
+	static constexpr size_t block_size = 64 * 1024;
+
+	std::vector<std::unique_ptr<char[]>> blocks = {};
+	char *current = nullptr;
+	size_t used   = block_size;
+};
+
+static StringArena arena;
+
+class Message {
+private:
+	// Points into the arena
+	const char *markup_msg = nullptr;
+
+	// Most messages are never shown, so the renderings are only allocated
+	// once needed
+	struct Rendered {
+		std::string ansi_msg = {};
+		std::map<uint16_t, std::string> msg_by_codepage = {};
+	};
+	std::unique_ptr<Rendered> rendered = {};
+
 public:
 	Message() = delete;
 	Message(const char *markup)
@@ -75,62 +107,81 @@ public:
 		Set(markup);
 	}
 
+	// The markup belongs to the arena, so a message is only ever moved
+	Message(const Message &) = delete;
+	Message &operator=(const Message &) = delete;
+	Message(Message &&) = default;
+	Message &operator=(Message &&) = default;
+
 	const char *GetRaw()
 	{
-		assert(markup_msg.length());
-		return markup_msg.c_str();
+		assert(*markup_msg);
+		return markup_msg;
 	}
 
 	const char *GetRendered()
 	{
-		assert(markup_msg.length());
-		if (rendered_msg.empty())
-			rendered_msg = convert_ansi_markup(markup_msg.c_str());
+		assert(*markup_msg);
+		if (!rendered) {
+			rendered = std::make_unique<Rendered>();
+			rendered->ansi_msg = convert_ansi_markup(markup_msg);
+		}
 
-		assert(rendered_msg.length());
+		assert(rendered->ansi_msg.length());
 		const uint16_t cp = UTF8_GetCodePage();
-		if (rendered_msg_by_codepage[cp].empty()) {
-			if (!UTF8_RenderForDos(rendered_msg,
-			                       rendered_msg_by_codepage[cp],
-			                       cp))
+		auto &msg_for_cp  = rendered->msg_by_codepage[cp];
+		if (msg_for_cp.empty()) {
+			if (!UTF8_RenderForDos(rendered->ansi_msg, msg_for_cp, cp))
 				LOG_WARNING("LANG: Problem rendering string");
-			assert(rendered_msg_by_codepage[cp].length());
+			assert(msg_for_cp.length());
 		}
 
-		return rendered_msg_by_codepage[cp].c_str();
+		return msg_for_cp.c_str();
 	}
 
 	void Set(const char *markup)
 	{
 		assert(markup);
 		markup_msg = markup;
-
-		rendered_msg.clear();
-		rendered_msg_by_codepage.clear();
+		rendered.reset();
 	}
 };
 
-static std::unordered_map<std::string, Message> messages;
-static std::deque<std::string> messages_order;
+// The keys point into the arena
+static std::unordered_map<std::string_view, Message> messages;
+static std::vector<std::string_view> messages_order;
 
-// Add the message if it doesn't exist yet
-void MSG_Add(const char *name, const char *markup_msg)
+// Add the message, already stored in the arena, if it doesn't exist yet
+static void msg_add(const std::string_view name, const char *markup_msg)
 {
 	const auto &pair = messages.try_emplace(name, markup_msg);
 	if (pair.second) // if the insertion was successful
 		messages_order.emplace_back(name);
 }
 
-// Replace existing or add if it doesn't exist
+// Add the message if it doesn't exist yet
+void MSG_Add(const char *name, const char *markup_msg)
+{
+	if (contains(messages, name))
+		return;
+	msg_add(arena.Intern(name), arena.Intern(markup_msg));
+}
+
+// Replace existing or add if it doesn't exist; both strings are already
+// stored in the arena
 static void msg_replace(const char *name, const char *markup_msg)
 {
 	auto it = messages.find(name);
 	if (it == messages.end())
-		MSG_Add(name, markup_msg);
+		msg_add(name, markup_msg);
 	else
 		it->second.Set(markup_msg);
 }
 
+// The file is read into the arena with a single read and parsed in place:
+// message names and texts are terminated where they lie in the buffer, and
+// the texts are only compacted to drop carriage returns, so no per-message
+// copies are made.
 static bool load_message_file(const std_fs::path &filename)
 {
 	if (filename.empty())
@@ -142,51 +193,57 @@ static bool load_message_file(const std_fs::path &filename)
 		return false;
 	}
 
-	FILE *mfile = fopen(filename.string().c_str(), "rt");
+	std::ifstream mfile(filename, std::ios::binary | std::ios::ate);
 	if (!mfile) {
 		LOG_MSG("LANG: Failed opening language file: %s, skipping",
 		        filename.string().c_str());
 		return false;
 	}
+	const auto file_size = static_cast<size_t>(mfile.tellg());
+	char *const buffer   = arena.Allocate(file_size + 1);
+	mfile.seekg(0);
+	mfile.read(buffer, static_cast<std::streamsize>(file_size));
+	const auto bytes_read = static_cast<size_t>(mfile.gcount());
+	buffer[bytes_read] = '\0';
+
+	static char no_name[] = "";
+	const char *name      = no_name;
+	char *message         = buffer; // start of the current message's text
+	char *writer          = buffer; // end of the current message's text
+
+	char *line = buffer;
+	char *const end = buffer + bytes_read;
+	while (line < end) {
+		char *line_end = std::find(line, end, '\n');
+		char *const next_line = line_end < end ? line_end + 1 : end;
+		// Remove characters 10 and 13 from the line's end
+		while (line_end > line && line_end[-1] == '\r')
+			--line_end;
 
-	char linein[LINE_IN_MAXLEN];
-	char name[LINE_IN_MAXLEN];
-	char message[LINE_IN_MAXLEN * 10];
-	/* Start out with empty strings */
-	name[0] = 0;
-	message[0] = 0;
-	while (fgets(linein, LINE_IN_MAXLEN, mfile) != 0) {
-		/* Parse the read line */
-		/* First remove characters 10 and 13 from the line */
-		char * parser=linein;
-		char * writer=linein;
-		while (*parser) {
-			if (*parser!=10 && *parser!=13) {
-				*writer++=*parser;
-			}
-			parser++;
-		}
-		*writer=0;
 		/* New message name */
-		if (linein[0]==':') {
-			message[0] = 0;
-			safe_strcpy(name, linein + 1);
+		if (line[0] == ':') {
+			*line_end = '\0';
+			name      = line + 1;
+			// The text follows the name, past which nothing is written
+			message = writer = next_line;
 			/* End of message marker */
-		} else if (linein[0]=='.') {
-			/* Replace/Add the message to the internal languagefile */
+		} else if (line[0] == '.') {
 			/* Remove last newline (marker is \n.\n) */
-			size_t ll = safe_strlen(message);
-			// This second if should not be needed, but better be safe.
-			if (ll && message[ll - 1] == '\n')
-				message[ll - 1] = 0;
+			if (writer > message && writer[-1] == '\n')
+				--writer;
+			*writer = '\0';
+			/* Replace/Add the message to the internal languagefile */
 			msg_replace(name, message);
+			message = writer = next_line;
 		} else {
 			/* Normal message to be added */
-			safe_strcat(message, linein);
-			safe_strcat(message, "\n");
+			for (const char *c = line; c < line_end; ++c)
+				if (*c != '\r')
+					*writer++ = *c;
+			*writer++ = '\n';
 		}
+		line = next_line;
 	}
-	fclose(mfile);
 	LOG_MSG("LANG: Loaded language file: %s", filename.string().c_str());
 	return true;
 }
@@ -0,0 +1,314 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "metrics.h"
+
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "string_utils.h"
+#include "support.h"
+
+#ifdef WIN32
+using socket_t = SOCKET;
+constexpr socket_t invalid_socket = INVALID_SOCKET;
+static void close_socket(const socket_t s)
+{
+	closesocket(s);
+}
+#else
+using socket_t = int;
+constexpr socket_t invalid_socket = -1;
+static void close_socket(const socket_t s)
+{
+	close(s);
+}
+#endif
+
+bool metrics_active = false;
+
+struct MetricInfo {
+	const char *name;
+	const char *type;
+	const char *help;
+};
+
+constexpr auto num_metrics = static_cast<size_t>(Metric::NumMetrics);
+
+// In the order of the Metric enum
+constexpr std::array<MetricInfo, num_metrics> metric_infos = {{
+        {"dosbox_cycles_total", "counter", "Emulated CPU cycles executed"},
+        {"dosbox_frames_presented_total", "counter", "Frames presented to the display"},
+        {"dosbox_frames_dropped_total", "counter", "New frames replaced before they were presented"},
+        {"dosbox_frames_skipped_total", "counter", "Frames the render pacer did not present"},
+        {"dosbox_audio_underruns_total", "counter", "Audio callbacks played as silence"},
+        {"dosbox_dynrec_cache_purges_total", "counter", "Translated blocks purged from the dynamic core's cache"},
+        {"dosbox_disk_read_bytes_total", "counter", "Bytes read from disk images"},
+        {"dosbox_cdrom_read_bytes_total", "counter", "Bytes read from CD-ROM images"},
+        {"dosbox_ne2000_packets_sent_total", "counter", "Packets sent by the NE2000"},
+        {"dosbox_ne2000_packets_received_total", "counter", "Packets received by the NE2000"},
+        {"dosbox_ipx_packets_sent_total", "counter", "IPX packets sent over the tunnel"},
+        {"dosbox_ipx_packets_received_total", "counter", "IPX packets received over the tunnel"},
+        {"dosbox_page_faults_total", "counter", "Page faults raised in the guest"},
+        {"dosbox_page_faults_nested_total", "counter", "Page faults handled in a nested emulation loop"},
+        {"dosbox_page_dir_cache_hits_total", "counter", "Page walks that reused the cached directory entry"},
+        {"dosbox_vga_bank_switches_total", "counter", "Switches of the banked SVGA memory window"},
+        {"dosbox_cycles_per_second", "gauge", "Emulated CPU cycles executed in the last second"},
+        {"dosbox_cpu_cycle_max", "gauge", "Current CPU_CycleMax, the cycles per emulated millisecond"},
+        {"dosbox_vga_bank_switches_per_frame", "gauge", "Switches of the banked SVGA memory window in the last frame"},
+}};
+
+static struct {
+	std::array<std::atomic<int64_t>, num_metrics> values = {};
+	std::thread server = {};
+	std::atomic<bool> running = false;
+	socket_t listener = invalid_socket;
+	std::string unix_path = {};
+} metrics = {};
+
+void METRICS_AddValue(const Metric metric, const int64_t amount)
+{
+	metrics.values[static_cast<size_t>(metric)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void METRICS_SetValue(const Metric metric, const int64_t value)
+{
+	metrics.values[static_cast<size_t>(metric)].store(value, std::memory_order_relaxed);
+}
+
+int64_t METRICS_Get(const Metric metric)
+{
+	return metrics.values[static_cast<size_t>(metric)].load(std::memory_order_relaxed);
+}
+
+static std::string format_metrics()
+{
+	std::string body = {};
+	char line[160];
+	for (size_t i = 0; i < num_metrics; ++i) {
+		const auto &info = metric_infos[i];
+		const auto value = METRICS_Get(static_cast<Metric>(i));
+		safe_sprintf(line,
+		             "# HELP %s %s\n# TYPE %s %s\n%s %" PRId64 "\n",
+		             info.name, info.help, info.name, info.type,
+		             info.name, value);
+		body += line;
+	}
+	return body;
+}
+
+static void send_all(const socket_t s, const std::string &data)
+{
+	size_t sent = 0;
+	while (sent < data.size()) {
+		const auto remaining = static_cast<int>(data.size() - sent);
+		const auto result = send(s, data.data() + sent, remaining, 0);
+		if (result <= 0)
+			return;
+		sent += static_cast<size_t>(result);
+	}
+}
+
+// Reads until the end of the request headers, which are otherwise ignored;
+// every path gets the metrics
+static void read_request(const socket_t s)
+{
+	char buffer[1024];
+	std::string request = {};
+	while (request.size() < 8192 && request.find("\r\n\r\n") == std::string::npos &&
+	       request.find("\n\n") == std::string::npos) {
+		const auto result = recv(s, buffer, sizeof(buffer), 0);
+		if (result <= 0)
+			return;
+		request.append(buffer, static_cast<size_t>(result));
+	}
+}
+
+static void serve_metrics()
+{
+	while (metrics.running.load(std::memory_order_acquire)) {
+		// Wake up regularly to notice when the endpoint is being stopped
+		fd_set readfds;
+		FD_ZERO(&readfds);
+		FD_SET(metrics.listener, &readfds);
+		timeval timeout = {0, 200 * 1000};
+		const auto nfds = static_cast<int>(metrics.listener) + 1;
+		if (select(nfds, &readfds, nullptr, nullptr, &timeout) <= 0)
+			continue;
+
+		const auto client = accept(metrics.listener, nullptr, nullptr);
+		if (client == invalid_socket)
+			continue;
+
+		// Don't let a stalled client hold up the next scrape for long
+#ifdef WIN32
+		const DWORD recv_timeout_ms = 1000;
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO,
+		           reinterpret_cast<const char *>(&recv_timeout_ms),
+		           sizeof(recv_timeout_ms));
+#else
+		const timeval recv_timeout = {1, 0};
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout,
+		           sizeof(recv_timeout));
+#endif
+		read_request(client);
+
+		const auto body = format_metrics();
+		char header[160];
+		safe_sprintf(header,
+		             "HTTP/1.0 200 OK\r\n"
+		             "Content-Type: text/plain; version=0.0.4\r\n"
+		             "Content-Length: %zu\r\n"
+		             "Connection: close\r\n\r\n",
+		             body.size());
+		send_all(client, header + body);
+		close_socket(client);
+	}
+}
+
+static socket_t open_tcp_listener(const std::string &port_string)
+{
+	char *end = nullptr;
+	const auto port = strtol(port_string.c_str(), &end, 10);
+	if (end == port_string.c_str() || *end != '\0' || port <= 0 || port > UINT16_MAX) {
+		LOG_WARNING("METRICS: Invalid endpoint '%s', expected a TCP port or 'unix:<path>'",
+		            port_string.c_str());
+		return invalid_socket;
+	}
+	const auto s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == invalid_socket)
+		return invalid_socket;
+
+	const int reuse = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR,
+	           reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+
+	// Only local scrapers are served; the counters are nobody else's business
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(static_cast<uint16_t>(port));
+	if (bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+	    listen(s, 4) != 0) {
+		LOG_WARNING("METRICS: Could not listen on 127.0.0.1:%ld", port);
+		close_socket(s);
+		return invalid_socket;
+	}
+	LOG_MSG("METRICS: Serving metrics on http://127.0.0.1:%ld/metrics", port);
+	return s;
+}
+
+static socket_t open_unix_listener([[maybe_unused]] const std::string &path)
+{
+#ifdef WIN32
+	LOG_WARNING("METRICS: Unix domain sockets are not supported on Windows");
+	return invalid_socket;
+#else
+	sockaddr_un address = {};
+	if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+		LOG_WARNING("METRICS: Invalid Unix socket path '%s'", path.c_str());
+		return invalid_socket;
+	}
+	const auto s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == invalid_socket)
+		return invalid_socket;
+
+	address.sun_family = AF_UNIX;
+	safe_strcpy(address.sun_path, path.c_str());
+	// A socket left behind by an earlier run would fail the bind
+	unlink(path.c_str());
+	if (bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+	    listen(s, 4) != 0) {
+		LOG_WARNING("METRICS: Could not listen on '%s'", path.c_str());
+		close_socket(s);
+		return invalid_socket;
+	}
+	metrics.unix_path = path;
+	LOG_MSG("METRICS: Serving metrics on the Unix socket '%s'", path.c_str());
+	return s;
+#endif
+}
+
+void METRICS_Start(const std::string &endpoint)
+{
+	METRICS_Stop();
+	if (endpoint.empty())
+		return;
+
+#ifdef WIN32
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+		LOG_WARNING("METRICS: Could not initialize Winsock");
+		return;
+	}
+#endif
+	metrics.listener = starts_with("unix:", endpoint)
+	                         ? open_unix_listener(endpoint.substr(5))
+	                         : open_tcp_listener(endpoint);
+	if (metrics.listener == invalid_socket) {
+#ifdef WIN32
+		WSACleanup();
+#endif
+		return;
+	}
+
+	for (auto &value : metrics.values)
+		value.store(0, std::memory_order_relaxed);
+	metrics.running = true;
+	metrics.server = std::thread(serve_metrics);
+	set_thread_name(metrics.server, "dosbox:metrics");
+	metrics_active = true;
+}
+
+void METRICS_Stop()
+{
+	if (!metrics_active)
+		return;
+	metrics_active = false;
+	metrics.running.store(false, std::memory_order_release);
+	if (metrics.server.joinable())
+		metrics.server.join();
+	close_socket(metrics.listener);
+	metrics.listener = invalid_socket;
+#ifdef WIN32
+	WSACleanup();
+#else
+	if (!metrics.unix_path.empty())
+		unlink(metrics.unix_path.c_str());
+#endif
+	metrics.unix_path.clear();
+}
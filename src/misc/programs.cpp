@@ -167,6 +167,63 @@ bool Program::SuppressWriteOut(const char *format)
 // For "\n" to "\r\n" expansion (0xA to OxD 0xA) in WriteOut* functions
 static char last_written_character = '\n';
 
+// While buffering, output is written out once this much text is collected
+constexpr size_t output_buffer_size = 16 * 1024;
+
+// Hands the text to DOS in large chunks rather than a byte at a time, so
+// long listings don't pay for a full DOS_WriteFile call per character
+static void write_to_dos_stdout(const char *text, const size_t size)
+{
+	uint8_t chunk[1024];
+	uint16_t used = 0;
+	auto write_chunk = [&]() {
+		uint16_t amount = used;
+		DOS_WriteFile(STDOUT, chunk, &amount);
+		used = 0;
+	};
+
+	dos.internal_output = true;
+	for (size_t i = 0; i < size; ++i) {
+		// Leave room for a "\r\n" pair
+		if (used + 2u > sizeof(chunk))
+			write_chunk();
+		if (text[i] == 0xA && last_written_character != 0xD)
+			chunk[used++] = 0xD;
+		last_written_character = text[i];
+		chunk[used++] = static_cast<uint8_t>(text[i]);
+	}
+	if (used)
+		write_chunk();
+	dos.internal_output = false;
+}
+
+void Program::WriteToStdout(const char *text, const size_t size)
+{
+	if (!is_output_buffered) {
+		write_to_dos_stdout(text, size);
+		return;
+	}
+	output_buffer.append(text, size);
+	if (output_buffer.size() >= output_buffer_size)
+		FlushOutput();
+}
+
+void Program::FlushOutput()
+{
+	write_to_dos_stdout(output_buffer.data(), output_buffer.size());
+	output_buffer.clear();
+}
+
+// Commands printing many lines can collect their output and write it out in
+// large chunks; the collected text is written out when buffering ends, so
+// buffering must be disabled before waiting on the user.
+void Program::BufferOutput(const bool enabled)
+{
+	if (is_output_buffered && !enabled)
+		FlushOutput();
+	is_output_buffered = enabled;
+}
+
 void Program::WriteOut(const char *format, ...)
 {
 	if (SuppressWriteOut(format))
@@ -179,19 +236,7 @@ void Program::WriteOut(const char *format, ...)
 	vsnprintf(buf,2047,format,msg);
 	va_end(msg);
 
-	uint16_t size = (uint16_t)strlen(buf);
-	dos.internal_output=true;
-	for (uint16_t i = 0; i < size; i++) {
-		uint8_t out;uint16_t s=1;
-		if (buf[i] == 0xA && last_written_character != 0xD) {
-			out = 0xD;DOS_WriteFile(STDOUT,&out,&s);
-		}
-		last_written_character = out = buf[i];
-		DOS_WriteFile(STDOUT,&out,&s);
-	}
-	dos.internal_output=false;
-
-//	DOS_WriteFile(STDOUT,(uint8_t *)buf,&size);
+	WriteToStdout(buf, strlen(buf));
 }
 
 void Program::WriteOut(const char *format, const char *arguments)
@@ -202,37 +247,14 @@ void Program::WriteOut(const char *format, const char *arguments)
 	char buf[2048];
 	sprintf(buf,format,arguments);
 
-	uint16_t size = (uint16_t)strlen(buf);
-	dos.internal_output=true;
-	for (uint16_t i = 0; i < size; i++) {
-		uint8_t out;uint16_t s=1;
-		if (buf[i] == 0xA && last_written_character != 0xD) {
-			out = 0xD;DOS_WriteFile(STDOUT,&out,&s);
-		}
-		last_written_character = out = buf[i];
-		DOS_WriteFile(STDOUT,&out,&s);
-	}
-	dos.internal_output=false;
+	WriteToStdout(buf, strlen(buf));
 }
 
 void Program::WriteOut_NoParsing(const char * format) {
 	if (SuppressWriteOut(format))
 		return;
 
-	uint16_t size = (uint16_t)strlen(format);
-	char const* buf = format;
-	dos.internal_output=true;
-	for (uint16_t i = 0; i < size; i++) {
-		uint8_t out;uint16_t s=1;
-		if (buf[i] == 0xA && last_written_character != 0xD) {
-			out = 0xD;DOS_WriteFile(STDOUT,&out,&s);
-		}
-		last_written_character = out = buf[i];
-		DOS_WriteFile(STDOUT,&out,&s);
-	}
-	dos.internal_output=false;
-
-//	DOS_WriteFile(STDOUT,(uint8_t *)format,&size);
+	WriteToStdout(format, strlen(format));
 }
 
 void Program::ResetLastWrittenChar(char c)
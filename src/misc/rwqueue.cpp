@@ -19,8 +19,11 @@
  */
 
 #include "rwqueue.h"
+#include "spsc_queue_impl.h"
 
+#include <algorithm>
 #include <cassert>
+#include <thread>
 
 template <typename T>
 RWQueue<T>::RWQueue(size_t queue_capacity) : capacity(queue_capacity)
@@ -92,12 +95,59 @@ T RWQueue<T>::Dequeue()
 	return item;
 }
 
+template <typename T>
+void RWQueue<T>::BulkEnqueue(T *items, const size_t num_items)
+{
+	size_t num_queued = 0;
+	while (num_queued < num_items) {
+		// wait until the queue has room for at least one item
+		std::unique_lock<std::mutex> lock(mutex);
+		while (queue.size() >= capacity)
+			has_room.wait(lock);
+
+		// add as many as fit, and notify the waiting threads
+		const auto num_to_queue = std::min(capacity - queue.size(),
+		                                   num_items - num_queued);
+		for (size_t i = 0; i < num_to_queue; ++i)
+			queue.emplace(queue.end(), std::move(items[num_queued++]));
+		lock.unlock();
+		has_items.notify_all();
+	}
+}
+
+template <typename T>
+size_t RWQueue<T>::BulkDequeue(T *items, const size_t max_items)
+{
+	assert(max_items > 0);
+
+	// wait until the queue has an item that we can get
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!queue.size())
+		has_items.wait(lock);
+
+	// get as many as we can, and notify the waiting threads
+	const auto num_items = std::min(queue.size(), max_items);
+	for (size_t i = 0; i < num_items; ++i) {
+		items[i] = std::move(queue.front());
+		queue.pop_front();
+	}
+	lock.unlock();
+	has_room.notify_all();
+	return num_items;
+}
+
 // Explicit template instantiations
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#include <functional>
 #include <vector>
 // Unit tests
 template class RWQueue<int>;
 template class RWQueue<std::vector<int16_t>>;
+template class SpscQueue<int>;
+template class SpscQueue<std::vector<int16_t>>;
 
 // MT-32 and FluidSynth
-template class RWQueue<std::vector<float>>;
+template class SpscQueue<std::vector<float>>;
+
+// Capture file writer
+template class RWQueue<std::function<void()>>;
@@ -28,6 +28,7 @@
 #include <string_view>
 
 #include "control.h"
+#include "startup.h"
 #include "string_utils.h"
 #include "support.h"
 #include "cross.h"
@@ -588,11 +589,35 @@ void Property::Set_values(const std::vector<std::string> & in) {
 	}
 }
 
+void Section_prop::AddProperty(Property *prop)
+{
+	properties.push_back(prop);
+	std::string key = prop->propname;
+	lowcase(key);
+	// Keep the first registration, as the linear scans did
+	property_index.emplace(std::move(key), prop);
+}
+
+Property *Section_prop::FindProperty(const std::string &propname) const
+{
+	std::string key = propname;
+	lowcase(key);
+	const auto entry = property_index.find(key);
+	return entry != property_index.end() ? entry->second : nullptr;
+}
+
+// The typed getters match names case-sensitively
+Property *Section_prop::FindExactProperty(const std::string &propname) const
+{
+	Property *prop = FindProperty(propname);
+	return (prop && prop->propname == propname) ? prop : nullptr;
+}
+
 Prop_int *Section_prop::Add_int(const std::string &_propname,
                                 Property::Changeable::Value when, int _value)
 {
 	Prop_int *test = new Prop_int(_propname, when, _value);
-	properties.push_back(test);
+	AddProperty(test);
 	return test;
 }
 
@@ -601,7 +626,7 @@ Prop_string *Section_prop::Add_string(const std::string &_propname,
                                       const char *_value)
 {
 	Prop_string *test = new Prop_string(_propname, when, _value);
-	properties.push_back(test);
+	AddProperty(test);
 	return test;
 }
 
@@ -609,7 +634,7 @@ Prop_path *Section_prop::Add_path(const std::string &_propname,
                                   Property::Changeable::Value when, const char *_value)
 {
 	Prop_path *test = new Prop_path(_propname, when, _value);
-	properties.push_back(test);
+	AddProperty(test);
 	return test;
 }
 
@@ -617,7 +642,7 @@ Prop_bool *Section_prop::Add_bool(const std::string &_propname,
                                   Property::Changeable::Value when, bool _value)
 {
 	Prop_bool *test = new Prop_bool(_propname, when, _value);
-	properties.push_back(test);
+	AddProperty(test);
 	return test;
 }
 
@@ -625,7 +650,7 @@ Prop_hex *Section_prop::Add_hex(const std::string &_propname,
                                 Property::Changeable::Value when, Hex _value)
 {
 	Prop_hex *test = new Prop_hex(_propname, when, _value);
-	properties.push_back(test);
+	AddProperty(test);
 	return test;
 }
 
@@ -634,7 +659,7 @@ PropMultiVal *Section_prop::AddMultiVal(const std::string &_propname,
                                        const std::string &sep)
 {
 	PropMultiVal *test = new PropMultiVal(_propname, when, sep);
-	properties.push_back(test);
+	AddProperty(test);
 	return test;
 }
 
@@ -643,96 +668,67 @@ PropMultiValRemain *Section_prop::AddMultiValRemain(const std::string &_propname
                                                     const std::string &sep)
 {
 	PropMultiValRemain *test = new PropMultiValRemain(_propname, when, sep);
-	properties.push_back(test);
+	AddProperty(test);
 	return test;
 }
 
 int Section_prop::Get_int(const std::string &_propname) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); tel++) {
-		if ((*tel)->propname == _propname) {
-			return ((*tel)->GetValue());
-		}
-	}
-	return 0;
+	const Property *prop = FindExactProperty(_propname);
+	if (!prop)
+		return 0;
+	return prop->GetValue();
 }
 
 bool Section_prop::Get_bool(const std::string &_propname) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); ++tel) {
-		if ((*tel)->propname == _propname) {
-			return ((*tel)->GetValue());
-		}
-	}
-	return false;
+	const Property *prop = FindExactProperty(_propname);
+	if (!prop)
+		return false;
+	return prop->GetValue();
 }
 
 double Section_prop::Get_double(const std::string &_propname) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); ++tel) {
-		if ((*tel)->propname == _propname) {
-			return ((*tel)->GetValue());
-		}
-	}
-	return 0.0;
+	const Property *prop = FindExactProperty(_propname);
+	if (!prop)
+		return 0.0;
+	return prop->GetValue();
 }
 
 Prop_path *Section_prop::Get_path(const std::string &_propname) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); ++tel) {
-		if ((*tel)->propname == _propname) {
-			Prop_path* val = dynamic_cast<Prop_path*>((*tel));
-			if (val) return val; else return NULL;
-		}
-	}
-	return NULL;
+	return dynamic_cast<Prop_path *>(FindExactProperty(_propname));
 }
 
 PropMultiVal *Section_prop::GetMultiVal(const std::string &_propname) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); ++tel) {
-		if ((*tel)->propname == _propname) {
-			PropMultiVal* val = dynamic_cast<PropMultiVal*>((*tel));
-			if(val) return val; else return NULL;
-		}
-	}
-	return NULL;
+	return dynamic_cast<PropMultiVal *>(FindExactProperty(_propname));
 }
 
 PropMultiValRemain *Section_prop::GetMultiValRemain(const std::string &_propname) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); ++tel) {
-		if ((*tel)->propname == _propname) {
-			PropMultiValRemain* val = dynamic_cast<PropMultiValRemain*>((*tel));
-			if (val) return val; else return NULL;
-		}
-	}
-	return NULL;
+	return dynamic_cast<PropMultiValRemain *>(FindExactProperty(_propname));
 }
 Property* Section_prop::Get_prop(int index){
-	for(it tel = properties.begin();tel != properties.end();++tel){
-		if (!index--) return (*tel);
-	}
-	return NULL;
+	if (index < 0 || index >= static_cast<int>(properties.size()))
+		return NULL;
+	return properties[static_cast<size_t>(index)];
 }
 
 const char *Section_prop::Get_string(const std::string &_propname) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); ++tel) {
-		if ((*tel)->propname == _propname) {
-			return ((*tel)->GetValue());
-		}
-	}
-	return "";
+	const Property *prop = FindExactProperty(_propname);
+	if (!prop)
+		return "";
+	return prop->GetValue();
 }
 Hex Section_prop::Get_hex(const std::string &_propname) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); ++tel) {
-		if ((*tel)->propname == _propname) {
-			return ((*tel)->GetValue());
-		}
-	}
-	return 0;
+	const Property *prop = FindExactProperty(_propname);
+	if (!prop)
+		return 0;
+	return prop->GetValue();
 }
 
 bool Section_prop::HandleInputline(const std::string &gegevens)
@@ -754,11 +750,8 @@ bool Section_prop::HandleInputline(const std::string &gegevens)
 	/* trim the results incase there were spaces somewhere */
 	trim(name);
 	trim(val);
-	for (auto &p : properties) {
-
-		if (strcasecmp(p->propname.c_str(), name.c_str()) != 0)
-			continue;
-
+	Property *p = FindProperty(name);
+	if (p) {
 		if (p->IsDeprecated()) {
 			LOG_WARNING("CONFIG: Deprecated option '%s'", name.c_str());
 			LOG_WARNING("CONFIG: %s", p->GetHelp());
@@ -795,12 +788,8 @@ void Section_prop::PrintData(FILE* outfile) const {
 
 string Section_prop::GetPropValue(const std::string &_property) const
 {
-	for (const_it tel = properties.begin(); tel != properties.end(); ++tel) {
-		if (!strcasecmp((*tel)->propname.c_str(), _property.c_str())) {
-			return (*tel)->GetValue().ToString();
-		}
-	}
-	return NO_SUCH_PROPERTY;
+	const Property *prop = FindProperty(_property);
+	return prop ? prop->GetValue().ToString() : NO_SUCH_PROPERTY;
 }
 
 bool Section_line::HandleInputline(const std::string &line)
@@ -910,7 +899,7 @@ Section_prop *Config::AddEarlySectionProp(const char *name,
 {
 	Section_prop *s = new Section_prop(name);
 	s->AddEarlyInitFunction(func, changeable_at_runtime);
-	sectionlist.push_back(s);
+	AddSection(s);
 	return s;
 }
 
@@ -922,7 +911,7 @@ Section_prop *Config::AddSection_prop(const char *section_name,
 	        "Only letters and digits are allowed in section name");
 	Section_prop *s = new Section_prop(section_name);
 	s->AddInitFunction(func, changeable_at_runtime);
-	sectionlist.push_back(s);
+	AddSection(s);
 	return s;
 }
 
@@ -941,7 +930,7 @@ Section_line *Config::AddSection_line(const char *section_name, SectionFunction
 	        "Only letters and digits are allowed in section name");
 	Section_line *blah = new Section_line(section_name);
 	blah->AddInitFunction(func);
-	sectionlist.push_back(blah);
+	AddSection(blah);
 	return blah;
 }
 
@@ -954,6 +943,7 @@ Config &Config::operator=(Config &&source) noexcept
 	// Move each member
 	cmdline                      = std::move(source.cmdline);
 	sectionlist                  = std::move(source.sectionlist);
+	section_index                = std::move(source.section_index);
 	_start_function              = std::move(source._start_function);
 	secure_mode                  = std::move(source.secure_mode);
 	startup_params               = std::move(source.startup_params);
@@ -971,6 +961,8 @@ Config &Config::operator=(Config &&source) noexcept
 	source.startup_params               = {};
 	source.configfiles                  = {};
 	source.configFilesCanonical         = {};
+	source.sectionlist                  = {};
+	source.section_index                = {};
 
 	return *this;
 }
@@ -983,11 +975,17 @@ Config::Config(Config &&source) noexcept
 
 void Config::Init() const
 {
-	for (const auto &sec : sectionlist)
-		sec->ExecuteEarlyInit();
+	const StartupStage init_stage("all sections");
+	{
+		const StartupStage early_stage("early init");
+		for (const auto &sec : sectionlist)
+			sec->ExecuteEarlyInit();
+	}
 
-	for (const auto &sec : sectionlist)
+	for (const auto &sec : sectionlist) {
+		const StartupStage stage(sec->GetName());
 		sec->ExecuteInit();
+	}
 }
 
 void Section::AddEarlyInitFunction(SectionFunction func, bool changeable_at_runtime)
@@ -1036,13 +1034,20 @@ Config::~Config()
 		delete (*cnt);
 }
 
+void Config::AddSection(Section *section)
+{
+	sectionlist.push_back(section);
+	std::string key = section->GetName();
+	lowcase(key);
+	section_index.emplace(std::move(key), section);
+}
+
 Section *Config::GetSection(const std::string &section_name) const
 {
-	for (auto *el : sectionlist) {
-		if (!strcasecmp(el->GetName(), section_name.c_str()))
-			return el;
-	}
-	return nullptr;
+	std::string key = section_name;
+	lowcase(key);
+	const auto entry = section_index.find(key);
+	return entry != section_index.end() ? entry->second : nullptr;
 }
 
 Section *Config::GetSectionFromProperty(const char *prop) const
@@ -0,0 +1,52 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "startup.h"
+
+#include <atomic>
+
+#include "logging.h"
+
+static std::atomic<bool> is_tracing = false;
+
+void STARTUP_EnableTrace(const bool enabled)
+{
+	is_tracing = enabled;
+}
+
+bool STARTUP_IsTracing()
+{
+	return is_tracing;
+}
+
+StartupStage::StartupStage(std::string name)
+        : stage_name(std::move(name)),
+          start_time(std::chrono::steady_clock::now())
+{}
+
+StartupStage::~StartupStage()
+{
+	if (!is_tracing)
+		return;
+
+	using namespace std::chrono;
+	const auto elapsed = duration<double, std::milli>(steady_clock::now() - start_time);
+	LOG_MSG("STARTUP: %-24s %8.2f ms", stage_name.c_str(), elapsed.count());
+}
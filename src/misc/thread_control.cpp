@@ -0,0 +1,240 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "thread_control.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <sys/qos.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "string_utils.h"
+#include "support.h"
+
+enum class ThreadPriority : uint8_t { Normal, High, Realtime };
+
+constexpr auto num_classes = static_cast<size_t>(ThreadClass::NumClasses);
+
+// In the order of the ThreadClass enum
+constexpr std::array<const char *, num_classes> class_names = {
+        "emulation", "audio", "render", "midi"};
+
+static struct {
+	std::mutex mutex = {};
+	std::array<std::vector<int>, num_classes> cores = {};
+	ThreadPriority priority = ThreadPriority::Normal;
+} thread_config = {};
+
+// Parses a core list like "2" or "0,2-3"; returns an empty list when invalid
+static std::vector<int> parse_cores(const std::string &list)
+{
+	std::vector<int> cores = {};
+	for (const auto &range : split(list, ',')) {
+		const auto parts = split(range, '-');
+		if (parts.empty() || parts.size() > 2)
+			return {};
+		char *end = nullptr;
+		const auto first = strtol(parts.front().c_str(), &end, 10);
+		if (parts.front().empty() || *end != '\0')
+			return {};
+		const auto last = strtol(parts.back().c_str(), &end, 10);
+		if (parts.back().empty() || *end != '\0')
+			return {};
+		if (first < 0 || last < first || last >= 1024)
+			return {};
+		for (auto core = first; core <= last; ++core)
+			cores.push_back(static_cast<int>(core));
+	}
+	return cores;
+}
+
+void THREAD_Configure(const std::string &affinity, const std::string &priority)
+{
+	std::lock_guard lock(thread_config.mutex);
+
+	for (auto &cores : thread_config.cores)
+		cores.clear();
+
+	// Entries take the form <class>=<cores>, like "audio=3 midi=2-3"
+	for (const auto &entry : split(affinity)) {
+		const auto parts = split(entry, '=');
+		size_t i = 0;
+		while (i < num_classes && (parts.size() != 2 || parts[0] != class_names[i]))
+			++i;
+		auto cores = i < num_classes ? parse_cores(parts[1]) : std::vector<int>{};
+		if (cores.empty()) {
+			LOG_WARNING("THREADS: Ignoring invalid thread_affinity entry '%s'",
+			            entry.c_str());
+			continue;
+		}
+		thread_config.cores[i] = std::move(cores);
+	}
+
+	if (priority == "high")
+		thread_config.priority = ThreadPriority::High;
+	else if (priority == "realtime")
+		thread_config.priority = ThreadPriority::Realtime;
+	else
+		thread_config.priority = ThreadPriority::Normal;
+}
+
+// The emulation thread is capped at a high priority; a real-time class would
+// let it starve everything else while running flat out
+static ThreadPriority priority_for(const ThreadClass thread_class)
+{
+	if (thread_class == ThreadClass::Emulation &&
+	    thread_config.priority == ThreadPriority::Realtime)
+		return ThreadPriority::High;
+	return thread_config.priority;
+}
+
+#if defined(__linux__)
+
+static bool set_affinity(const std::vector<int> &cores)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (const auto core : cores)
+		if (core < CPU_SETSIZE)
+			CPU_SET(core, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+static bool set_nice(const int nice)
+{
+	const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+	return setpriority(PRIO_PROCESS, tid, nice) == 0;
+}
+
+static bool set_priority(const ThreadClass thread_class, const ThreadPriority priority)
+{
+	constexpr int high_nice = -10;
+	const bool wants_fifo = priority == ThreadPriority::Realtime &&
+	                        (thread_class == ThreadClass::Audio ||
+	                         thread_class == ThreadClass::Midi);
+	if (wants_fifo) {
+		// Stay well below the kernel's own real-time threads
+		sched_param param = {};
+		param.sched_priority = std::min(sched_get_priority_max(SCHED_FIFO), 10);
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+			return true;
+		LOG_WARNING("THREADS: SCHED_FIFO is not permitted for the %s thread; "
+		            "raise the 'rtprio' limit in /etc/security/limits.conf",
+		            class_names[static_cast<size_t>(thread_class)]);
+	}
+	return set_nice(high_nice);
+}
+
+#elif defined(__APPLE__)
+
+static bool set_affinity(const std::vector<int> &)
+{
+	// macOS doesn't let threads be pinned to cores
+	return false;
+}
+
+static bool set_priority(const ThreadClass, const ThreadPriority priority)
+{
+	const auto qos = priority == ThreadPriority::Realtime ? QOS_CLASS_USER_INTERACTIVE
+	                                                      : QOS_CLASS_USER_INITIATED;
+	return pthread_set_qos_class_self_np(qos, 0) == 0;
+}
+
+#elif defined(WIN32)
+
+static bool set_affinity(const std::vector<int> &cores)
+{
+	DWORD_PTR mask = 0;
+	for (const auto core : cores)
+		if (core < static_cast<int>(sizeof(mask) * 8))
+			mask |= static_cast<DWORD_PTR>(1) << core;
+	return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
+// Registers the thread with the Multimedia Class Scheduler Service. The
+// library is loaded on demand, so nothing needs to link against it.
+static bool join_mmcss()
+{
+	using set_characteristics_f = HANDLE(WINAPI *)(LPCWSTR, LPDWORD);
+	static const auto avrt = LoadLibraryW(L"avrt.dll");
+	if (!avrt)
+		return false;
+	const auto set_characteristics = reinterpret_cast<set_characteristics_f>(
+	        GetProcAddress(avrt, "AvSetMmThreadCharacteristicsW"));
+	DWORD task_index = 0;
+	return set_characteristics &&
+	       set_characteristics(L"Pro Audio", &task_index) != nullptr;
+}
+
+static bool set_priority(const ThreadClass thread_class, const ThreadPriority priority)
+{
+	const bool wants_mmcss = priority == ThreadPriority::Realtime &&
+	                         (thread_class == ThreadClass::Audio ||
+	                          thread_class == ThreadClass::Midi);
+	if (wants_mmcss && join_mmcss())
+		return true;
+	const auto level = wants_mmcss ? THREAD_PRIORITY_TIME_CRITICAL
+	                 : thread_class == ThreadClass::Emulation
+	                         ? THREAD_PRIORITY_ABOVE_NORMAL
+	                         : THREAD_PRIORITY_HIGHEST;
+	return SetThreadPriority(GetCurrentThread(), level) != 0;
+}
+
+#else
+
+static bool set_affinity(const std::vector<int> &)
+{
+	return false;
+}
+
+static bool set_priority(const ThreadClass, const ThreadPriority)
+{
+	return false;
+}
+
+#endif
+
+void THREAD_ApplyToCurrent(const ThreadClass thread_class)
+{
+	std::lock_guard lock(thread_config.mutex);
+	const auto name = class_names[static_cast<size_t>(thread_class)];
+
+	const auto &cores = thread_config.cores[static_cast<size_t>(thread_class)];
+	if (!cores.empty() && !set_affinity(cores))
+		LOG_WARNING("THREADS: Could not pin the %s thread to its cores", name);
+
+	const auto priority = priority_for(thread_class);
+	if (priority != ThreadPriority::Normal && !set_priority(thread_class, priority))
+		LOG_WARNING("THREADS: Could not raise the priority of the %s thread", name);
+}
@@ -28,6 +28,9 @@
 /* Define to 1 to enable IPX networking support, requires SDL_net */
 #define C_IPX 1
 
+/* Define to 1 to enable rollback netplay, requires SDL_net */
+#define C_NETPLAY 1
+
 /* Enable some heavy debugging options */
 #define C_HEAVY_DEBUG 0
 
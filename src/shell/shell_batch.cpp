@@ -18,6 +18,7 @@
 
 #include "shell.h"
 
+#include <algorithm>
 #include <climits>
 #include <stdlib.h>
 #include <string.h>
@@ -67,61 +68,132 @@ BatchFile::~BatchFile() {
 	shell->echo = echo;
 }
 
-// TODO: Refactor this sprawling function into smaller ones without GOTOs
-bool BatchFile::ReadLine(char * line) {
-	//Open the batchfile and seek to stored postion
-	if (!DOS_OpenFile(filename.c_str(),(DOS_NOT_INHERIT|OPEN_READ),&file_handle)) {
-		LOG(LOG_MISC,LOG_ERROR)("ReadLine Can't open BatchFile %s",filename.c_str());
-		return false; // Parent deletes this BatchFile on negative return
+// Reloads the cached content if the file's size or date have changed since
+// it was last read, so the drive is only read once per unmodified file.
+bool BatchFile::Refresh()
+{
+	if (!DOS_OpenFile(filename.c_str(), (DOS_NOT_INHERIT | OPEN_READ), &file_handle))
+		return false;
+
+	uint16_t time = 0;
+	uint16_t date = 0;
+	DOS_GetFileDate(file_handle, &time, &date);
+	uint32_t size = 0;
+	DOS_SeekFile(file_handle, &size, DOS_SEEK_END);
+
+	if (!is_loaded || size != content_size || time != content_time ||
+	    date != content_date) {
+		uint32_t pos = 0;
+		DOS_SeekFile(file_handle, &pos, DOS_SEEK_SET);
+		content.resize(size);
+		uint32_t bytes_total = 0;
+		while (bytes_total < size) {
+			const auto chunk = std::min(size - bytes_total, UINT32_C(0xfff0));
+			uint16_t bytes_read = static_cast<uint16_t>(chunk);
+			if (!DOS_ReadFile(file_handle, content.data() + bytes_total, &bytes_read) ||
+			    !bytes_read)
+				break;
+			bytes_total += bytes_read;
+		}
+		content.resize(bytes_total);
+		content_size = size;
+		content_time = time;
+		content_date = date;
+		is_loaded = true;
+		labels.clear();
+		is_indexed = false;
 	}
-	DOS_SeekFile(file_handle,&(this->location),DOS_SEEK_SET);
+	DOS_CloseFile(file_handle);
+	return true;
+}
 
-	uint16_t bytes_read = 1;
-	uint8_t data = 0;
-	char val = 0;
-	char temp[CMD_MAXLINE] = "";
-	char temp_cycles_hack[CMD_MAXLINE];
-emptyline:
-	char * cmd_write=temp;
-	do {
-		bytes_read = 1;
-		DOS_ReadFile(file_handle, &data, &bytes_read);
-		val = static_cast<char>(data);
+// Copies the line starting at 'location' into 'line', keeping only the
+// permitted characters, and advances 'location' past its line feed. The
+// full character set additionally keeps backspace, escape, and tab.
+void BatchFile::NextLine(char *line, bool full_charset)
+{
+	char *line_write = line;
+	bool found_eol = false;
+	while (location < content.size() && !found_eol) {
+		const char val = static_cast<char>(content[location++]);
+		found_eol = (val == LINE_FEED);
 
-		if (bytes_read > 0) {
-			/* Inclusion criteria:
-			 *  - backspace for alien odyssey
-			 *  - tab for batch files
-			 *  - escape for ANSI
-			 * Note: the negative allowance permits high
-			 * international ASCII characters that are wrapped when
-			 * char is a signed type
-			 */
-			if (
+		/* Inclusion criteria:
+		 *  - backspace for alien odyssey
+		 *  - tab for batch files
+		 *  - escape for ANSI
+		 * Note: the negative allowance permits high
+		 * international ASCII characters that are wrapped when
+		 * char is a signed type
+		 */
+		if (
 #if (CHAR_MIN < 0) // char is signed
-			    val < 0 ||
+		    val < 0 ||
 #endif
-			    val > UNIT_SEPARATOR || val == BACKSPACE || val == ESC || val == TAB) {
-				// Only add it if room for it (and trailing zero)
-				// in the buffer, but do the check here instead
-				// at the end So we continue reading till EOL/EOF
-				if (cmd_write - temp + 1 < CMD_MAXLINE - 1) {
-					*cmd_write++ = val;
-				}
-			} else if (val != LINE_FEED && val != CARRIAGE_RETURN) {
-				DEBUG_LOG_MSG("Encountered non-standard character: Dec %03u and Hex %#04x",
-				              val, val);
-			}
+		    val > UNIT_SEPARATOR ||
+		    (full_charset && (val == BACKSPACE || val == ESC || val == TAB))) {
+			// Only add it if room for it (and trailing zero)
+			// in the buffer, but do the check here instead
+			// at the end So we continue reading till EOL/EOF
+			if (line_write - line + 1 < CMD_MAXLINE - 1)
+				*line_write++ = val;
+		} else if (val != BACKSPACE && val != CARRIAGE_RETURN && val != ESC &&
+		           val != LINE_FEED && val != TAB) {
+			DEBUG_LOG_MSG("Encountered non-standard character: Dec %03u and Hex %#04x",
+			              val, val);
 		}
-	} while (val != LINE_FEED && bytes_read);
-	*cmd_write=0;
-	if (!bytes_read && cmd_write == temp) {
-		// Close the file and delete this BatchFile on return
-		DOS_CloseFile(file_handle);
+	}
+	*line_write = 0;
+}
+
+// Records the first occurrence of each label with the offset of the line
+// that follows it, matching the top-down scan DOS performs for GOTO.
+void BatchFile::IndexLabels()
+{
+	char cmd_buffer[CMD_MAXLINE] = "";
+	const auto saved_location = location;
+	location = 0;
+	while (location < content.size()) {
+		NextLine(cmd_buffer, false);
+		char *nospace = trim(cmd_buffer);
+		if (nospace[0] != ':')
+			continue;
+		nospace++; // Skip :
+		// Strip spaces and = from it.
+		while (*nospace && (isspace(*reinterpret_cast<unsigned char *>(nospace)) ||
+		                    (*nospace == '=')))
+			nospace++;
+
+		// label is until space/=/eol
+		char *const beginlabel = nospace;
+		while (*nospace && !isspace(*reinterpret_cast<unsigned char *>(nospace)) &&
+		       (*nospace != '='))
+			nospace++;
+		*nospace = 0;
+
+		std::string label = beginlabel;
+		upcase(label);
+		labels.emplace(std::move(label), location);
+	}
+	location = saved_location;
+	is_indexed = true;
+}
+
+bool BatchFile::ReadLine(char * line) {
+	// Make sure the cached batch file is current
+	if (!Refresh()) {
+		LOG(LOG_MISC,LOG_ERROR)("ReadLine Can't open BatchFile %s",filename.c_str());
 		return false; // Parent deletes this BatchFile on negative return
 	}
-	if (!strlen(temp)) goto emptyline;
-	if (temp[0]==':') goto emptyline;
+
+	char temp[CMD_MAXLINE] = "";
+	char temp_cycles_hack[CMD_MAXLINE];
+	do {
+		if (location >= content.size())
+			return false; // Parent deletes this BatchFile on negative return
+		NextLine(temp, true);
+	} while (!strlen(temp) || temp[0] == ':');
+	char *cmd_write = nullptr;
 
 	// Lambda that copies the src to cmd_write, provided the result fits
 	// within CMD_MAXLINE while taking the existing line into consideration.
@@ -208,83 +280,26 @@ emptyline:
 		}
 	}
 	*cmd_write = 0;
-	//Store current location and close bat file
-	this->location = 0;
-	DOS_SeekFile(file_handle,&(this->location),DOS_SEEK_CUR);
-	DOS_CloseFile(file_handle);
-	return true;	
+	return true;
 }
 
-// TODO: Refactor this sprawling function into smaller ones without GOTOs
 bool BatchFile::Goto(char * where) {
-	//Open bat file and search for the where string
-	if (!DOS_OpenFile(filename.c_str(),(DOS_NOT_INHERIT|OPEN_READ),&file_handle)) {
+	if (!Refresh()) {
 		LOG(LOG_MISC,LOG_ERROR)("SHELL:Goto Can't open BatchFile %s",filename.c_str());
 		return false; // Parent deletes this BatchFile on negative return
 	}
+	if (!is_indexed)
+		IndexLabels();
 
-	char cmd_buffer[CMD_MAXLINE] = "";
-	char *cmd_write = nullptr;
-
-	/* Scan till we have a match or return false */
-	uint16_t bytes_read = 1;
-	uint8_t data = 0;
-	char val = 0;
-again:
-	cmd_write=cmd_buffer;
-	do {
-		bytes_read = 1;
-		DOS_ReadFile(file_handle, &data, &bytes_read);
-		val = static_cast<char>(data);
-		if (bytes_read > 0) {
-			// Note: the negative allowance permits high
-			// international ASCII characters that are wrapped when
-			// char is a signed type
-
-			if (
-#if (CHAR_MIN < 0) // char is signed
-			    val < 0 ||
-#endif
-			    val > UNIT_SEPARATOR) {
-				if (cmd_write - cmd_buffer + 1 < CMD_MAXLINE - 1) {
-					*cmd_write++ = val;
-				}
-			} else if (val != BACKSPACE && val != CARRIAGE_RETURN &&
-			           val != ESC && val != LINE_FEED && val != TAB) {
-				DEBUG_LOG_MSG("Encountered non-standard character: Dec %03u and Hex %#04x",
-				              val, val);
-			}
-		}
-	} while (val != LINE_FEED && bytes_read);
-	*cmd_write++ = 0;
-	char *nospace = trim(cmd_buffer);
-	if (nospace[0] == ':') {
-		nospace++; //Skip :
-		//Strip spaces and = from it.
-		while(*nospace && (isspace(*reinterpret_cast<unsigned char*>(nospace)) || (*nospace == '=')))
-			nospace++;
-
-		//label is until space/=/eol
-		char* const beginlabel = nospace;
-		while(*nospace && !isspace(*reinterpret_cast<unsigned char*>(nospace)) && (*nospace != '=')) 
-			nospace++;
-
-		*nospace = 0;
-		if (strcasecmp(beginlabel,where)==0) {
-		//Found it! Store location and continue
-			this->location = 0;
-			DOS_SeekFile(file_handle,&(this->location),DOS_SEEK_CUR);
-			DOS_CloseFile(file_handle);
-			return true;
-		}
-	   
-	}
-	if (!bytes_read) {
-		DOS_CloseFile(file_handle);
+	std::string label = where;
+	upcase(label);
+	const auto it = labels.find(label);
+	if (it == labels.end())
 		return false; // Parent deletes this BatchFile on negative return
-	}
-	goto again;
-	return false;
+
+	// Found it! Store location and continue
+	location = it->second;
+	return true;
 }
 
 void BatchFile::Shift()
@@ -879,46 +879,12 @@ void DOS_Shell::CMD_DIR(char * args) {
 		return;
 	}
 
-	std::vector<DtaResult> results;
-	// TODO OS should be asked for a number of files and appropriate
-	// vector capacity should be set
-
-	do {    /* File name and extension */
-		DtaResult result;
-		dta.GetResult(result.name,result.size,result.date,result.time,result.attr);
-
-		/* Skip non-directories if option AD is present, or skip dirs in case of A-D */
-		if (optAD && !(result.attr&DOS_ATTR_DIRECTORY) ) continue;
-		else if (optAminusD && (result.attr&DOS_ATTR_DIRECTORY) ) continue;
-
-		results.push_back(result);
-
-	} while (DOS_FindNext());
-
-	if (optON) {
-		// Sort by name
-		std::sort(results.begin(), results.end(), DtaResult::compareName);
-	} else if (optOE) {
-		// Sort by extension
-		std::sort(results.begin(), results.end(), DtaResult::compareExt);
-	} else if (optOD) {
-		// Sort by date
-		std::sort(results.begin(), results.end(), DtaResult::compareDate);
-	} else if (optOS) {
-		// Sort by size
-		std::sort(results.begin(), results.end(), DtaResult::compareSize);
-	}
-	if (reverseSort) {
-		std::reverse(results.begin(), results.end());
-	}
-
 	uint32_t byte_count = 0;
 	uint32_t file_count = 0;
 	uint32_t dir_count = 0;
 	unsigned w_count = 0;
 
-	for (auto &entry : results) {
-
+	auto print_entry = [&](DtaResult &entry) {
 		char *name = entry.name;
 		const uint32_t size = entry.size;
 		const uint16_t date = entry.date;
@@ -930,7 +896,7 @@ void DOS_Shell::CMD_DIR(char * args) {
 		// Bare format never lists .. nor . as directories.
 		if (is_root || optB) {
 			if (strcmp(".", name) == 0 || strcmp("..", name) == 0)
-				continue;
+				return;
 		}
 
 		if (is_dir) {
@@ -945,7 +911,7 @@ void DOS_Shell::CMD_DIR(char * args) {
 		if (optB) {
 			WriteOut("%s\n", name);
 			show_press_any_key();
-			continue;
+			return;
 		}
 
 		// 'Wide list' format: using several columns
@@ -960,7 +926,7 @@ void DOS_Shell::CMD_DIR(char * args) {
 			w_count += 1;
 			if ((w_count % 5) == 0)
 				show_press_any_key();
-			continue;
+			return;
 		}
 
 		// default format: one detailed entry per line
@@ -994,7 +960,52 @@ void DOS_Shell::CMD_DIR(char * args) {
 			         format_time(hour, minute, 0, 0));
 		}
 		show_press_any_key();
+	};
+
+	// Output is collected into large writes, except when pausing because
+	// the prompt needs everything before it shown first
+	BufferOutput(!optP);
+
+	// Without a sort order, the entries are printed as they are found
+	// rather than collected first, so huge directories start listing
+	// right away
+	const bool is_sorted = optON || optOE || optOD || optOS;
+	std::vector<DtaResult> results;
+
+	do {    /* File name and extension */
+		DtaResult result;
+		dta.GetResult(result.name,result.size,result.date,result.time,result.attr);
+
+		/* Skip non-directories if option AD is present, or skip dirs in case of A-D */
+		if (optAD && !(result.attr&DOS_ATTR_DIRECTORY) ) continue;
+		else if (optAminusD && (result.attr&DOS_ATTR_DIRECTORY) ) continue;
+
+		if (is_sorted)
+			results.push_back(result);
+		else
+			print_entry(result);
+
+	} while (DOS_FindNext());
+
+	if (optON) {
+		// Sort by name
+		std::sort(results.begin(), results.end(), DtaResult::compareName);
+	} else if (optOE) {
+		// Sort by extension
+		std::sort(results.begin(), results.end(), DtaResult::compareExt);
+	} else if (optOD) {
+		// Sort by date
+		std::sort(results.begin(), results.end(), DtaResult::compareDate);
+	} else if (optOS) {
+		// Sort by size
+		std::sort(results.begin(), results.end(), DtaResult::compareSize);
 	}
+	if (reverseSort) {
+		std::reverse(results.begin(), results.end());
+	}
+
+	for (auto &entry : results)
+		print_entry(entry);
 
 	// Additional newline in case last line in 'Wide list` format was
 	// not wrapped automatically.
@@ -1029,6 +1040,7 @@ void DOS_Shell::CMD_DIR(char * args) {
 		WriteOut(MSG_Get("SHELL_CMD_DIR_BYTES_FREE"), dir_count,
 		         bytes.c_str());
 	}
+	BufferOutput(false);
 	dos.dta(save_dta);
 }
 
@@ -1069,6 +1081,7 @@ void DOS_Shell::CMD_LS(char *args)
 	const size_t cols = column_widths.size();
 
 	size_t w_count = 0;
+	BufferOutput(true);
 
 	constexpr int ansi_blue = 34;
 	constexpr int ansi_green = 32;
@@ -1098,6 +1111,7 @@ void DOS_Shell::CMD_LS(char *args)
 		if (w_count % cols == 0)
 			WriteOut_NoParsing("\n");
 	}
+	BufferOutput(false);
 	dos.dta(original_dta);
 }
 
@@ -1988,7 +2002,8 @@ void DOS_Shell::CMD_LOADHIGH(char *args){
 
 void MAPPER_AutoType(std::vector<std::string> &sequence,
                      const uint32_t wait_ms,
-                     const uint32_t pacing_ms);
+                     const uint32_t pacing_ms,
+                     const bool wait_for_empty_buffer);
 void MAPPER_AutoTypeStopImmediately();
 void DOS_21Handler();
 
@@ -2068,7 +2083,7 @@ void DOS_Shell::CMD_CHOICE(char * args){
 	if (using_auto_type) {
 		std::vector<std::string> sequence{std::string{default_choice}};
 		const auto start_after_ms = static_cast<uint32_t>(default_wait_s * 1000);
-		MAPPER_AutoType(sequence, start_after_ms, 500);
+		MAPPER_AutoType(sequence, start_after_ms, 500, false);
 	}
 
 	// Begin waiting for input, but maybe break on some conditions
@@ -25,9 +25,12 @@
 #include <cstring>
 #include <iterator>
 #include <regex>
+#include <string>
+#include <unordered_map>
 
 #include "regs.h"
 #include "callback.h"
+#include "snapshot.h"
 #include "string_utils.h"
 #include "../ints/int10.h"
 
@@ -558,6 +561,9 @@ bool DOS_Shell::Execute(char * name,char * args) {
 		/* HACK: Store full commandline for mount and imgmount */
 		full_arguments.assign(line);
 
+		// Identifies the program for fast boot snapshots
+		const std::string command = std::string(fullname) + line;
+
 		/* Fill the command line */
 		CommandTail cmdtail = {};
 
@@ -639,7 +645,7 @@ bool DOS_Shell::Execute(char * name,char * args) {
 		SegSet16(es,SegValue(ss));
 		reg_bx=reg_sp;
 		SETFLAGBIT(IF,false);
-		CALLBACK_RunRealInt(0x21);
+		SNAPSHOT_ExecuteProgram(command);
 		/* Restore CS:IP and the stack */
 		reg_sp+=0x200;
 #if 0
@@ -652,6 +658,58 @@ bool DOS_Shell::Execute(char * name,char * args) {
 
 static char which_ret[DOS_PATHLENGTH+4];
 
+// Every command resolved through the PATH probes the Z: drive, whose files
+// rarely change, so the outcome of probing a PATH entry on a virtual drive
+// is remembered until they do. Maps the uppercase path and name to the
+// found name, or to an empty string if there's none.
+static std::unordered_map<std::string, std::string> virtual_path_probes = {};
+static uint32_t virtual_path_probes_generation = 0;
+
+static bool is_on_virtual_drive(const char *path)
+{
+	if (!path[0] || path[1] != ':')
+		return false;
+	const auto drive = toupper(path[0]) - 'A';
+	return drive >= 0 && drive < DOS_DRIVES && Drives[drive] &&
+	       Drives[drive]->GetType() == DosDriveType::Virtual;
+}
+
+// Checks the path, then with each executable extension; returns the one
+// found, or nullptr
+static const char *probe_executable(const char *path)
+{
+	safe_strcpy(which_ret, path);
+	if (DOS_FileExists(which_ret))
+		return which_ret;
+
+	for (const char *ext_fmt : {"%s.COM", "%s.EXE", "%s.BAT"}) {
+		safe_sprintf(which_ret, ext_fmt, path);
+		if (DOS_FileExists(which_ret))
+			return which_ret;
+	}
+	return nullptr;
+}
+
+static const char *probe_virtual_executable(const char *path)
+{
+	if (virtual_path_probes_generation != VFILE_GetGeneration()) {
+		virtual_path_probes.clear();
+		virtual_path_probes_generation = VFILE_GetGeneration();
+	}
+	std::string key = path;
+	upcase(key);
+	const auto it = virtual_path_probes.find(key);
+	if (it != virtual_path_probes.end()) {
+		if (it->second.empty())
+			return nullptr;
+		safe_strcpy(which_ret, it->second.c_str());
+		return which_ret;
+	}
+	const auto found = probe_executable(path);
+	virtual_path_probes.emplace(std::move(key), found ? found : "");
+	return found;
+}
+
 const char *DOS_Shell::Which(const char *name) const
 {
 	const size_t name_len = strlen(name);
@@ -713,15 +771,11 @@ const char *DOS_Shell::Which(const char *name) const
 			if((name_len + len + 1) >= DOS_PATHLENGTH) continue;
 
 			safe_strcat(path, name);
-			safe_strcpy(which_ret, path);
-			if (DOS_FileExists(which_ret))
-				return which_ret;
-
-			for (const char *ext_fmt : {"%s.COM", "%s.EXE", "%s.BAT"}) {
-				safe_sprintf(which_ret, ext_fmt, path);
-				if (DOS_FileExists(which_ret))
-					return which_ret;
-			}
+			const auto found = is_on_virtual_drive(path)
+			                         ? probe_virtual_executable(path)
+			                         : probe_executable(path);
+			if (found)
+				return found;
 		}
 	}
 	return 0;
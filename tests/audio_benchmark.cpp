@@ -0,0 +1,719 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*  Audio Rendering Benchmark
+ *  -------------------------
+ *  Plays a stream of timed port writes into the emulated sound devices and
+ *  renders the mixer's output offline, one millisecond tick after the other,
+ *  as fast as the host allows. It reports the rendering speed in frames per
+ *  second and a checksum of the mixed output, so optimisations can be timed
+ *  and verified as bit-exact against the previous build.
+ *
+ *  The streams are either generated for each scenario or, for the OPL, read
+ *  from a raw capture (.dro) made with the OPL capture.
+ *
+ *  Usage:
+ *    audio_benchmark [--scenario NAME] [--seconds N] [--rate HZ]
+ *                    [--dro FILE] [--expect CHECKSUM]
+ *
+ *  Scenarios: opl, gameblaster, gus, pcspeaker, tandy, and mix (all of the
+ *  above on one machine, with the mixer's reverb and chorus).
+ *
+ *  Run them all with: meson test -C build --benchmark --verbose
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define SDL_MAIN_HANDLED
+
+#include "control.h"
+#include "cpu.h"
+#include "cross.h"
+#include "inout.h"
+#include "mixer.h"
+#include "pic.h"
+#include "setup.h"
+#include "timer.h"
+#include "video.h"
+
+constexpr double pi = 3.14159265358979323846;
+
+// The spacing between consecutive writes, roughly the time a program takes
+// between two OUT instructions
+constexpr double write_gap_ms = 0.002;
+
+struct PortWrite {
+	double at_ms  = 0.0;
+	io_port_t port = 0;
+	uint8_t val    = 0;
+};
+
+using write_stream_t = std::vector<PortWrite>;
+
+// Appends writes to a stream, spacing them by the write gap from the
+// current position
+class StreamWriter {
+public:
+	StreamWriter(write_stream_t &_writes) : writes(_writes) {}
+
+	void Seek(const double ms)
+	{
+		at_ms = ms;
+	}
+
+	void Out(const io_port_t port, const uint8_t val)
+	{
+		writes.push_back({at_ms, port, val});
+		at_ms += write_gap_ms;
+	}
+
+private:
+	write_stream_t &writes;
+	double at_ms = 0.0;
+};
+
+static double note_to_hz(const int note)
+{
+	return 440.0 * std::pow(2.0, (note - 69) / 12.0);
+}
+
+// The notes of a slow chord progression, which the scenarios arpeggiate
+static int note_at(const int step, const int voice)
+{
+	constexpr int chords[4][4] = {{57, 60, 64, 69}, // A minor
+	                              {53, 57, 60, 65}, // F major
+	                              {48, 52, 55, 60}, // C major
+	                              {55, 59, 62, 67}}; // G major
+
+	const auto &chord = chords[(step / 16) % 4];
+	const auto octave = 12 * ((voice / 4) % 3 - 1);
+	return chord[(step + voice) % 4] + octave;
+}
+
+// OPL: an arpeggio on all 18 two-operator channels of the OPL3
+// ------------------------------------------------------------
+
+static void opl_write(StreamWriter &w, const int reg, const uint8_t val)
+{
+	const io_port_t port = (reg & 0x100) ? 0x38a : 0x388;
+	w.Out(port, static_cast<uint8_t>(reg & 0xff));
+	w.Out(port + 1, val);
+}
+
+static void generate_opl(StreamWriter &w, const int duration_ms)
+{
+	constexpr uint8_t operator_offsets[9] = {
+	        0x00, 0x01, 0x02, 0x08, 0x09, 0x0a, 0x10, 0x11, 0x12};
+
+	opl_write(w, 0x105, 0x01); // OPL3 mode
+	opl_write(w, 0x104, 0x00); // two-operator channels only
+	opl_write(w, 0x001, 0x20); // waveform select
+	opl_write(w, 0x0bd, 0x00); // melodic mode
+
+	// A plucked patch, panned left, right, and centre in turn
+	for (auto c = 0; c < 18; ++c) {
+		const auto bank      = static_cast<uint16_t>(c < 9 ? 0x000 : 0x100);
+		const auto modulator = bank | operator_offsets[c % 9];
+		const auto carrier   = modulator + 3;
+		const auto pan = (c % 3 == 0) ? 0x10 : (c % 3 == 1) ? 0x20 : 0x30;
+
+		opl_write(w, 0x20 + modulator, 0x21);
+		opl_write(w, 0x20 + carrier, 0x21);
+		opl_write(w, 0x40 + modulator, 0x1a);
+		opl_write(w, 0x40 + carrier, 0x00);
+		opl_write(w, 0x60 + modulator, 0xf3);
+		opl_write(w, 0x60 + carrier, 0xf4);
+		opl_write(w, 0x80 + modulator, 0x45);
+		opl_write(w, 0x80 + carrier, 0x46);
+		opl_write(w, 0xe0 + modulator, static_cast<uint8_t>(c % 4));
+		opl_write(w, 0xe0 + carrier, 0x00);
+		opl_write(w, bank | (0xc0 + c % 9), static_cast<uint8_t>(pan | 0x08));
+	}
+
+	constexpr auto step_ms = 100;
+	for (auto step = 0; step * step_ms < duration_ms; ++step) {
+		w.Seek(step * step_ms + 0.25);
+		for (auto c = 0; c < 18; ++c) {
+			const auto bank = static_cast<uint16_t>(c < 9 ? 0x000 : 0x100);
+			const auto hz = note_to_hz(note_at(step, c));
+
+			// The lowest block that fits the frequency number
+			// gives the finest pitch
+			auto block = 0;
+			auto fnum  = 0;
+			do {
+				fnum = static_cast<int>(std::lround(
+				        hz * (1 << (20 - block)) / 49716.0));
+			} while (fnum > 1023 && ++block < 7);
+
+			const auto lo = static_cast<uint8_t>(fnum & 0xff);
+			const auto hi = static_cast<uint8_t>((block << 2) | (fnum >> 8));
+
+			opl_write(w, bank | (0xb0 + c % 9), hi); // key off
+			opl_write(w, bank | (0xa0 + c % 9), lo);
+			opl_write(w, bank | (0xb0 + c % 9), static_cast<uint8_t>(hi | 0x20)); // key on
+		}
+	}
+}
+
+// Reads a raw OPL capture (version 2.0) into port writes, returning the
+// capture's length in milliseconds or zero if it can't be read
+static int read_dro(const std::string &path, StreamWriter &w)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		fprintf(stderr, "Can't open '%s'\n", path.c_str());
+		return 0;
+	}
+	const std::vector<uint8_t> data(std::istreambuf_iterator<char>(file), {});
+
+	constexpr size_t header_size = 0x1a;
+	auto read_u16 = [&](const size_t i) {
+		return static_cast<uint16_t>(data[i] | data[i + 1] << 8);
+	};
+	if (data.size() < header_size || memcmp(data.data(), "DBRAWOPL", 8) != 0 ||
+	    read_u16(0x08) != 2 || read_u16(0x0a) != 0) {
+		fprintf(stderr, "'%s' isn't a version 2.0 raw OPL capture\n",
+		        path.c_str());
+		return 0;
+	}
+	const uint8_t delay256        = data[0x17];
+	const uint8_t delay_shift8    = data[0x18];
+	const uint8_t conv_table_size = data[0x19];
+
+	const auto table = data.begin() + header_size;
+	if (data.size() < header_size + conv_table_size) {
+		fprintf(stderr, "'%s' is truncated\n", path.c_str());
+		return 0;
+	}
+
+	auto ms         = 0;
+	auto written_ms = -1;
+	for (auto i = header_size + conv_table_size; i + 1 < data.size(); i += 2) {
+		const uint8_t raw = data[i];
+		const uint8_t val = data[i + 1];
+		if (raw == delay256) {
+			ms += val + 1;
+			continue;
+		}
+		if (raw == delay_shift8) {
+			ms += (val + 1) << 8;
+			continue;
+		}
+		if ((raw & 0x7f) >= conv_table_size)
+			continue;
+
+		const auto reg = static_cast<uint16_t>(table[raw & 0x7f] |
+		                                       ((raw & 0x80) ? 0x100 : 0));
+		if (ms != written_ms) {
+			w.Seek(ms + 0.25);
+			written_ms = ms;
+		}
+		opl_write(w, reg, val);
+	}
+	return ms + 1;
+}
+
+// Game Blaster: chords and noise on the twelve channels of its two SAA-1099s
+// --------------------------------------------------------------------------
+
+static void saa_write(StreamWriter &w, const int chip, const uint8_t reg,
+                      const uint8_t val)
+{
+	const auto port = static_cast<io_port_t>(0x220 + chip * 2);
+	w.Out(port + 1, reg);
+	w.Out(port, val);
+}
+
+static void generate_gameblaster(StreamWriter &w, const int duration_ms)
+{
+	constexpr double saa_clock_hz = 7159090.0;
+
+	for (auto chip = 0; chip < 2; ++chip) {
+		saa_write(w, chip, 0x1c, 0x02); // reset the generators
+		saa_write(w, chip, 0x1c, 0x01); // enable the sound
+		saa_write(w, chip, 0x14, 0x3f); // all tones on
+		saa_write(w, chip, 0x15, chip ? 0x20 : 0x00); // noise on the last
+		saa_write(w, chip, 0x16, 0x01); // medium noise
+		for (uint8_t c = 0; c < 6; ++c) {
+			// The left and right volume, panned across the channels
+			const auto left  = static_cast<uint8_t>(4 + c * 2);
+			const auto right = static_cast<uint8_t>(14 - c * 2);
+			saa_write(w, chip, c, static_cast<uint8_t>(right << 4 | left));
+		}
+	}
+
+	std::vector<uint8_t> octaves(12, 0);
+
+	constexpr auto step_ms = 80;
+	for (auto step = 0; step * step_ms < duration_ms; ++step) {
+		w.Seek(step * step_ms + 0.25);
+		for (auto c = 0; c < 12; ++c) {
+			const auto chip    = c / 6;
+			const auto channel = static_cast<uint8_t>(c % 6);
+			const auto hz      = note_to_hz(note_at(step, c) + 12);
+
+			// The frequency is (clock / 512) * 2^octave / (511 - n)
+			auto octave = 0;
+			auto n      = 0;
+			do {
+				n = 511 - static_cast<int>(std::lround(
+				                  saa_clock_hz / 512.0 * (1 << octave) / hz));
+			} while (n < 0 && ++octave < 7);
+			n = std::clamp(n, 0, 255);
+
+			saa_write(w, chip, 0x08 + channel, static_cast<uint8_t>(n));
+
+			// Each octave register holds a pair of channels
+			octaves[c] = static_cast<uint8_t>(octave);
+			const auto pair  = c & ~1;
+			const auto value = static_cast<uint8_t>(octaves[pair + 1] << 4 |
+			                                        octaves[pair]);
+			saa_write(w, chip, 0x10 + channel / 2, value);
+		}
+	}
+}
+
+// Gravis UltraSound: looped single-cycle waveforms on fourteen voices
+// -------------------------------------------------------------------
+
+constexpr io_port_t gus_voice_select = 0x342;
+constexpr io_port_t gus_register     = 0x343;
+constexpr io_port_t gus_data_low     = 0x344;
+constexpr io_port_t gus_data_high    = 0x345;
+constexpr io_port_t gus_dram         = 0x347;
+
+constexpr int gus_voices       = 14; // which play at 44.1 kHz
+constexpr int gus_cycle_length = 256;
+
+static void gus_write_16(StreamWriter &w, const uint8_t reg, const uint16_t val)
+{
+	w.Out(gus_register, reg);
+	w.Out(gus_data_low, static_cast<uint8_t>(val & 0xff));
+	w.Out(gus_data_high, static_cast<uint8_t>(val >> 8));
+}
+
+static void gus_write_8(StreamWriter &w, const uint8_t reg, const uint8_t val)
+{
+	w.Out(gus_register, reg);
+	w.Out(gus_data_high, val);
+}
+
+// Writes the address registers, which hold the address in their low 13 and
+// high 7 bits
+static void gus_write_address(StreamWriter &w, const uint8_t msw_reg,
+                              const uint32_t address)
+{
+	gus_write_16(w, msw_reg, static_cast<uint16_t>(address >> 7));
+	gus_write_16(w,
+	             static_cast<uint8_t>(msw_reg + 1),
+	             static_cast<uint16_t>((address & 0x7f) << 9));
+}
+
+// The wave rate in 1/1024ths of a sample per frame
+static uint16_t gus_rate(const double hz)
+{
+	constexpr double gus_rate_hz = 44100.0;
+	const auto rate = hz * gus_cycle_length * 1024.0 / gus_rate_hz;
+	return static_cast<uint16_t>(std::clamp(std::lround(rate), 1L, 65535L));
+}
+
+static void generate_gus(StreamWriter &w, const int duration_ms)
+{
+	gus_write_8(w, 0x4c, 0x01); // prepare for playback
+	gus_write_8(w, 0x0e, static_cast<uint8_t>(0xc0 | (gus_voices - 1)));
+
+	// Upload a sine, saw, square, and triangle cycle, each summed from its
+	// first eight harmonics to limit the aliasing
+	auto harmonic_level = [](const int shape, const int h) {
+		switch (shape) {
+		case 0: return (h == 1) ? 1.0 : 0.0;
+		case 1: return 0.6 / h;
+		case 2: return (h % 2) ? 0.8 / h : 0.0;
+		default: return (h % 2) ? 0.8 / (h * h) : 0.0;
+		}
+	};
+	gus_write_8(w, 0x44, 0x00);
+	for (auto shape = 0; shape < 4; ++shape) {
+		for (auto i = 0; i < gus_cycle_length; ++i) {
+			const auto phase = 2.0 * pi * i / gus_cycle_length;
+			auto value       = 0.0;
+			for (auto h = 1; h <= 8; ++h)
+				value += harmonic_level(shape, h) * std::sin(h * phase);
+
+			const auto address = shape * gus_cycle_length + i;
+			const auto sample  = std::lround(std::clamp(value, -1.0, 1.0) * 120.0);
+			gus_write_16(w, 0x43, static_cast<uint16_t>(address));
+			w.Out(gus_dram, static_cast<uint8_t>(sample));
+		}
+	}
+
+	for (auto v = 0; v < gus_voices; ++v) {
+		const auto start = static_cast<uint32_t>((v % 4) * gus_cycle_length);
+		const auto end = static_cast<uint32_t>(start + gus_cycle_length - 1);
+
+		w.Out(gus_voice_select, static_cast<uint8_t>(v));
+		gus_write_8(w, 0x00, 0x03); // stopped
+		gus_write_8(w, 0x0d, 0x03); // no volume ramp
+		gus_write_address(w, 0x02, start);
+		gus_write_address(w, 0x04, end);
+		gus_write_address(w, 0x0a, start);
+		gus_write_16(w, 0x01, gus_rate(note_to_hz(note_at(0, v))));
+		gus_write_16(w, 0x09, static_cast<uint16_t>(0xd000 - v * 0x200));
+		gus_write_8(w, 0x0c, static_cast<uint8_t>((v * 15) / (gus_voices - 1)));
+		gus_write_8(w, 0x00, 0x08); // looping
+	}
+	gus_write_8(w, 0x4c, 0x03); // run, with the DAC enabled
+
+	constexpr auto step_ms = 120;
+	for (auto step = 1; step * step_ms < duration_ms; ++step) {
+		w.Seek(step * step_ms + 0.25);
+		for (auto v = 0; v < gus_voices; ++v) {
+			w.Out(gus_voice_select, static_cast<uint8_t>(v));
+			gus_write_16(w, 0x01, gus_rate(note_to_hz(note_at(step, v))));
+		}
+	}
+}
+
+// PC speaker: a square-wave melody from the PIT's third channel
+// -------------------------------------------------------------
+
+static void generate_pcspeaker(StreamWriter &w, const int duration_ms)
+{
+	constexpr double pit_hz = 1193182.0;
+
+	w.Out(0x43, 0xb6); // channel 2, both bytes, square wave
+	w.Out(0x42, 0x00);
+	w.Out(0x42, 0x10);
+	w.Out(0x61, 0x03); // gate the timer to the speaker
+
+	constexpr auto step_ms = 40;
+	for (auto step = 0; step * step_ms < duration_ms; ++step) {
+		w.Seek(step * step_ms + 0.25);
+		const auto hz = note_to_hz(note_at(step, step % 12) + 12);
+		const auto count = static_cast<uint16_t>(std::lround(pit_hz / hz));
+		w.Out(0x42, static_cast<uint8_t>(count & 0xff));
+		w.Out(0x42, static_cast<uint8_t>(count >> 8));
+
+		// Rest briefly before every fourth note
+		if (step % 4 == 3) {
+			w.Seek(step * step_ms + step_ms - 8.0);
+			w.Out(0x61, 0x00);
+			w.Seek(step * step_ms + step_ms - 2.0);
+			w.Out(0x61, 0x03);
+		}
+	}
+}
+
+// Tandy: the PSG's three tones and its noise channel
+// --------------------------------------------------
+
+static void generate_tandy(StreamWriter &w, const int duration_ms)
+{
+	constexpr io_port_t psg_port = 0xc0;
+	constexpr double psg_clock_hz = 3579545.0;
+
+	auto set_volume = [&](const int channel, const int attenuation) {
+		w.Out(psg_port,
+		      static_cast<uint8_t>(0x90 | channel << 5 | (attenuation & 0x0f)));
+	};
+
+	for (auto c = 0; c < 3; ++c)
+		set_volume(c, 2 + c * 2);
+	set_volume(3, 15);
+
+	constexpr auto step_ms = 90;
+	for (auto step = 0; step * step_ms < duration_ms; ++step) {
+		w.Seek(step * step_ms + 0.25);
+		for (auto c = 0; c < 3; ++c) {
+			const auto hz = note_to_hz(note_at(step, c * 2));
+			const auto n  = std::clamp(static_cast<int>(std::lround(
+			                                   psg_clock_hz / (32.0 * hz))),
+                                          1,
+                                          1023);
+			w.Out(psg_port, static_cast<uint8_t>(0x80 | c << 5 | (n & 0x0f)));
+			w.Out(psg_port, static_cast<uint8_t>(n >> 4));
+		}
+
+		// A burst of white noise on every other beat
+		if (step % 8 == 0 || step % 8 == 5) {
+			w.Out(psg_port, static_cast<uint8_t>(0xe4 | (step % 3)));
+			set_volume(3, 4);
+			w.Seek(step * step_ms + 30.0);
+			set_volume(3, 15);
+		}
+	}
+}
+
+// Benchmark harness
+// -----------------
+
+struct Scenario {
+	const char *name = nullptr;
+	std::vector<std::string> settings = {}; // as "section key=value"
+	std::vector<void (*)(StreamWriter &, int)> generators = {};
+};
+
+static const std::vector<Scenario> scenarios = {
+        {"opl", {"sblaster sbtype=sb16", "sblaster oplmode=opl3"}, {generate_opl}},
+        {"gameblaster",
+         {"sblaster sbtype=gb", "sblaster oplmode=none"},
+         {generate_gameblaster}},
+        {"gus",
+         {"sblaster sbtype=none", "gus gus=true", "gus gusbase=240"},
+         {generate_gus}},
+        {"pcspeaker",
+         {"sblaster sbtype=none", "speaker pcspeaker=impulse"},
+         {generate_pcspeaker}},
+        {"tandy",
+         {"sblaster sbtype=none", "speaker tandy=on"},
+         {generate_tandy}},
+        {"mix",
+         {"sblaster sbtype=sb16",
+          "sblaster oplmode=opl3",
+          "gus gus=true",
+          "gus gusbase=240",
+          "speaker pcspeaker=impulse",
+          "speaker tandy=on",
+          "mixer reverb=large",
+          "mixer chorus=normal"},
+         {generate_opl, generate_gus, generate_pcspeaker, generate_tandy}},
+};
+
+// Sets up the sound devices with their defaults, independent of the user's
+// own configuration, then with the scenario's settings
+class Machine {
+public:
+	Machine(const char *program, const Scenario &scenario, const int rate)
+	        : argv{program},
+	          com_line(1, argv)
+	{
+		control = std::make_unique<Config>(&com_line);
+
+		// Create DOSBox Staging's config directory, which is a
+		// pre-requisite that's asserted during the Init process.
+		CROSS_DetermineConfigPaths();
+
+		// This will register all the init functions, but won't run them
+		DOSBOX_Init();
+
+		std::vector<std::string> settings = {
+		        "cpu cycles=fixed 3000",
+		        "mixer nosound=true",
+		        "mixer rate=" + std::to_string(rate),
+		};
+		settings.insert(settings.end(),
+		                scenario.settings.begin(),
+		                scenario.settings.end());
+
+		for (const auto &setting : settings) {
+			const auto space   = setting.find(' ');
+			const auto name    = setting.substr(0, space);
+			const auto section = control->GetSection(name);
+			assert(section);
+			if (!section->HandleInputline(setting.substr(space + 1)))
+				fprintf(stderr, "Can't apply '%s'\n", setting.c_str());
+		}
+
+		for (const auto &name : sections)
+			control->GetSection(name)->ExecuteEarlyInit();
+		for (const auto &name : sections)
+			control->GetSection(name)->ExecuteInit();
+	}
+
+	~Machine()
+	{
+		for (auto it = sections.rbegin(); it != sections.rend(); ++it)
+			control->GetSection(*it)->ExecuteDestroy();
+		GFX_RequestExit(true);
+	}
+
+private:
+	Machine(const Machine &)            = delete;
+	Machine &operator=(const Machine &) = delete;
+
+	const char *argv[1];
+	CommandLine com_line;
+
+	const std::vector<std::string> sections = {
+	        "dosbox", "cpu", "mixer", "sblaster", "gus", "speaker"};
+};
+
+// The 64-bit FNV-1a hash of the output, in the wave capture's byte order
+class OutputChecksum {
+public:
+	void Add(const int16_t *frames, const int num_frames)
+	{
+		const auto bytes = reinterpret_cast<const uint8_t *>(frames);
+		const auto num_bytes = static_cast<size_t>(num_frames) * 2 * sizeof(int16_t);
+		for (size_t i = 0; i < num_bytes; ++i) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3;
+		}
+		total_frames += num_frames;
+	}
+
+	uint64_t hash         = 0xcbf29ce484222325;
+	int64_t total_frames = 0;
+};
+
+// Plays the writes due in each millisecond at their offsets within it,
+// which the devices see through the PIC's index, then ticks the timer to
+// mix the millisecond
+static void render(const write_stream_t &writes, const int duration_ms)
+{
+	auto next = writes.begin();
+	for (auto ms = 0; ms < duration_ms; ++ms) {
+		for (; next != writes.end() && next->at_ms < ms + 1; ++next) {
+			const auto offset = std::max(next->at_ms - ms, 0.0);
+			CPU_Cycles        = 0;
+			CPU_CycleLeft     = CPU_CycleMax -
+			                static_cast<int32_t>(offset * CPU_CycleMax);
+			IO_WriteB(next->port, next->val);
+		}
+		TIMER_AddTick();
+	}
+}
+
+static void print_usage(const char *program)
+{
+	fprintf(stderr,
+	        "Usage: %s [--scenario NAME] [--seconds N] [--rate HZ]\n"
+	        "       %*s [--dro FILE] [--expect CHECKSUM]\n\n"
+	        "Scenarios:",
+	        program,
+	        static_cast<int>(strlen(program)),
+	        "");
+	for (const auto &scenario : scenarios)
+		fprintf(stderr, " %s", scenario.name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	std::string scenario_name = "mix";
+	std::string dro_path      = {};
+	std::string expected      = {};
+	auto seconds              = 30;
+	auto rate                 = 48000;
+
+	for (auto i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const auto has_value = i + 1 < argc;
+		if (arg == "--scenario" && has_value) {
+			scenario_name = argv[++i];
+		} else if (arg == "--seconds" && has_value) {
+			seconds = std::max(atoi(argv[++i]), 1);
+		} else if (arg == "--rate" && has_value) {
+			rate = atoi(argv[++i]);
+		} else if (arg == "--dro" && has_value) {
+			dro_path      = argv[++i];
+			scenario_name = "opl";
+		} else if (arg == "--expect" && has_value) {
+			expected = argv[++i];
+		} else {
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	const auto scenario = std::find_if(scenarios.begin(),
+	                                   scenarios.end(),
+	                                   [&](const Scenario &s) {
+		                                   return scenario_name == s.name;
+	                                   });
+	if (scenario == scenarios.end()) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	// Generate or read the writes up front, so only the rendering is timed
+	write_stream_t writes = {};
+	StreamWriter writer(writes);
+	auto duration_ms = seconds * 1000;
+	if (!dro_path.empty()) {
+		const auto capture_ms = read_dro(dro_path, writer);
+		if (!capture_ms)
+			return 1;
+		duration_ms = capture_ms + 1000; // let the last notes ring out
+	} else {
+		for (const auto generate : scenario->generators) {
+			writer.Seek(0.0);
+			generate(writer, duration_ms);
+		}
+	}
+	std::stable_sort(writes.begin(),
+	                 writes.end(),
+	                 [](const PortWrite &a, const PortWrite &b) {
+		                 return a.at_ms < b.at_ms;
+	                 });
+
+	Machine machine(argv[0], *scenario, rate);
+
+	OutputChecksum checksum = {};
+	MIXER_SetOutputTap([&](const int16_t *frames, const int num_frames) {
+		checksum.Add(frames, num_frames);
+	});
+
+	const auto started_at = std::chrono::steady_clock::now();
+	render(writes, duration_ms);
+	const auto elapsed = std::chrono::duration<double>(
+	                             std::chrono::steady_clock::now() - started_at)
+	                             .count();
+
+	MIXER_SetOutputTap(nullptr);
+
+	const auto total_frames = static_cast<double>(checksum.total_frames);
+	const auto rendered_s   = total_frames / rate;
+	const auto frames_per_s = total_frames / std::max(elapsed, 1e-9);
+
+	char hash[17] = {};
+	snprintf(hash, sizeof(hash), "%016" PRIx64, checksum.hash);
+
+	printf("%s: %zu writes, %.1f s at %d Hz\n",
+	       dro_path.empty() ? scenario->name : dro_path.c_str(),
+	       writes.size(),
+	       rendered_s,
+	       rate);
+	printf("  frames:    %" PRId64 "\n", checksum.total_frames);
+	printf("  elapsed:   %.3f s\n", elapsed);
+	printf("  speed:     %.0f frames/s (%.1fx realtime)\n",
+	       frames_per_s,
+	       rendered_s / std::max(elapsed, 1e-9));
+	printf("  checksum:  %s\n", hash);
+
+	if (!expected.empty() && expected != hash) {
+		printf("  expected:  %s (MISMATCH)\n", expected.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,684 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*  Core Hot Path Benchmark
+ *  -----------------------
+ *  Times the paths the emulator spends most of its time in, each on its
+ *  own and outside of the frame loop: the CPU cores running a small
+ *  instruction mix, VGA planar writes through the graphics controller's
+ *  raster operation, mixer channels taking samples in, I/O port dispatch,
+ *  PIC event scheduling, interrupt calls from the emulator's own code, and
+ *  the drive cache's name lookups.
+ *
+ *  Each case runs in growing batches until it has run for the minimum
+ *  time, then reports the time per item. The results can be written as
+ *  JSON in Google Benchmark's format, so builds can be compared with its
+ *  compare.py tool.
+ *
+ *  The scalers are timed by running dosbox with --benchmark-render instead,
+ *  as they need the video output.
+ *
+ *  Usage:
+ *    core_benchmark [--case NAME] [--min-time SECONDS] [--json FILE]
+ *
+ *  Run them all with: meson test -C build --benchmark --verbose
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SDL_MAIN_HANDLED
+
+#include "callback.h"
+#include "control.h"
+#include "cpu.h"
+#include "cross.h"
+#include "dos_system.h"
+#include "inout.h"
+#include "mem.h"
+#include "mixer.h"
+#include "pic.h"
+#include "regs.h"
+#include "setup.h"
+#include "std_filesystem.h"
+#include "string_utils.h"
+#include "timer.h"
+#include "video.h"
+
+#include "../src/ints/int10.h"
+
+// Runs the given number of iterations and returns the number of items
+// they processed
+using batch_f = std::function<int64_t(int64_t iterations)>;
+
+struct Case {
+	const char *name   = nullptr;
+	const char *items  = nullptr; // what the items per second count
+	batch_f (*setup)() = nullptr;
+};
+
+struct Result {
+	std::string name       = {};
+	int64_t iterations     = 0;
+	double real_ns         = 0.0; // per iteration
+	double cpu_ns          = 0.0; // per iteration
+	double items_per_second = 0.0;
+	const char *items      = nullptr;
+};
+
+// CPU cores: a loop of moves, arithmetic, shifts, and memory accesses
+// --------------------------------------------------------------------
+
+constexpr uint16_t code_seg  = 0x2000;
+constexpr uint16_t data_seg  = 0x3000;
+constexpr uint16_t stack_seg = 0x4000;
+
+static void load_instruction_mix()
+{
+	constexpr uint8_t code[] = {
+	        0x89, 0xd8,             // mov ax, bx
+	        0x01, 0xc8,             // add ax, cx
+	        0x31, 0xc2,             // xor dx, ax
+	        0xd1, 0xe0,             // shl ax, 1
+	        0x88, 0x04,             // mov [si], al
+	        0x46,                   // inc si
+	        0x81, 0xe6, 0xff, 0x0f, // and si, 0fffh
+	        0x8b, 0x5c, 0x02,       // mov bx, [si+2]
+	        0x29, 0xd1,             // sub cx, dx
+	        0x50,                   // push ax
+	        0x5f,                   // pop di
+	        0xeb, 0xe8,             // jmp short to the start
+	};
+	static_assert(sizeof(code) == 0x18, "the jump goes back to the start");
+
+	const PhysPt base = code_seg << 4;
+	for (size_t i = 0; i < sizeof(code); ++i)
+		mem_writeb(base + static_cast<PhysPt>(i), code[i]);
+
+	SegSet16(cs, code_seg);
+	SegSet16(ds, data_seg);
+	SegSet16(ss, stack_seg);
+	reg_eip = 0;
+	reg_esp = 0xfffe;
+	reg_esi = 0;
+}
+
+static int64_t run_cycles(const int64_t cycles)
+{
+	CPU_Cycles    = static_cast<int32_t>(cycles);
+	CPU_CycleLeft = 0;
+	while (CPU_Cycles > 0)
+		(*cpudecoder)();
+	return cycles;
+}
+
+// A batch of up to a million cycles at a time, so CPU_Cycles doesn't
+// overflow
+static int64_t run_instruction_mix(const int64_t iterations)
+{
+	constexpr int64_t chunk = 1'000'000;
+	for (auto left = iterations; left > 0; left -= chunk)
+		run_cycles(std::min(left, chunk));
+	return iterations;
+}
+
+static batch_f setup_cpu_normal()
+{
+	load_instruction_mix();
+	cpudecoder = &CPU_Core_Normal_Run;
+	return run_instruction_mix;
+}
+
+static batch_f setup_cpu_dynrec()
+{
+#if C_DYNREC
+	// The core sets up its code cache on its first run
+	load_instruction_mix();
+	cpudecoder = &CPU_Core_Dynrec_Run;
+	return run_instruction_mix;
+#else
+	return nullptr;
+#endif
+}
+
+// VGA: read-modify-writes in mode 12h, XORing the latched planes
+// --------------------------------------------------------------
+
+static int64_t write_planes(const int64_t iterations)
+{
+	constexpr PhysPt vga_base = 0xa0000;
+	constexpr PhysPt plane_size = 640 * 480 / 8;
+
+	PhysPt offset = 0;
+	for (int64_t i = 0; i < iterations; ++i) {
+		const auto addr = vga_base + offset;
+		// The read fills the latches that the XOR combines with
+		const auto val = mem_readb(addr);
+		mem_writeb(addr, static_cast<uint8_t>(val + 1));
+		if (++offset == plane_size)
+			offset = 0;
+	}
+	return iterations;
+}
+
+static batch_f setup_vga_rasterop()
+{
+	INT10_SetVideoMode(0x12);
+
+	IO_WriteB(0x3c4, 0x02); // write to all four planes
+	IO_WriteB(0x3c5, 0x0f);
+	IO_WriteB(0x3ce, 0x03); // XOR with the latches
+	IO_WriteB(0x3cf, 0x18);
+	IO_WriteB(0x3ce, 0x05); // write mode 0, read mode 0
+	IO_WriteB(0x3cf, 0x00);
+	return write_planes;
+}
+
+// Mixer: channels taking their samples in, converted and resampled to
+// the mixer's rate
+// ---------------------------------------------------------------------
+
+constexpr int mixer_rate = 48000;
+
+static mixer_channel_t bench_channel = {};
+
+// Mixes the given number of milliseconds, which calls the channel's
+// handler to add the samples for each of them
+static int64_t mix_ticks(const int64_t iterations)
+{
+	for (int64_t i = 0; i < iterations; ++i)
+		TIMER_AddTick();
+	return iterations * mixer_rate / 1000;
+}
+
+static batch_f setup_mixer(const int rate, const bool stereo, MIXER_Handler handler)
+{
+	if (bench_channel)
+		bench_channel->Enable(false);
+
+	std::set<ChannelFeature> features = {};
+	if (stereo)
+		features.insert(ChannelFeature::Stereo);
+
+	bench_channel = MIXER_AddChannel(handler,
+	                                 rate,
+	                                 stereo ? "BENCHS16" : "BENCHM8",
+	                                 features);
+	bench_channel->Enable(true);
+	return mix_ticks;
+}
+
+static batch_f setup_mixer_s16()
+{
+	static std::vector<int16_t> samples = {};
+	samples.resize(2 * 4096);
+	for (size_t i = 0; i < samples.size(); ++i)
+		samples[i] = static_cast<int16_t>((i * 7919) & 0xffff);
+
+	return setup_mixer(22050, true, [](const uint16_t frames) {
+		auto left = frames;
+		while (left) {
+			const auto len = std::min<uint16_t>(left, 4096);
+			bench_channel->AddSamples_s16(len, samples.data());
+			left -= len;
+		}
+	});
+}
+
+static batch_f setup_mixer_m8()
+{
+	static std::vector<uint8_t> samples = {};
+	samples.resize(4096);
+	for (size_t i = 0; i < samples.size(); ++i)
+		samples[i] = static_cast<uint8_t>(i * 31);
+
+	return setup_mixer(11025, false, [](const uint16_t frames) {
+		auto left = frames;
+		while (left) {
+			const auto len = std::min<uint16_t>(left, 4096);
+			bench_channel->AddSamples_m8(len, samples.data());
+			left -= len;
+		}
+	});
+}
+
+// I/O: dispatch to a registered handler and to the VGA's status port
+// -----------------------------------------------------------------
+
+constexpr io_port_t bench_port = 0x2f0;
+
+static int64_t dispatch_bench_port(const int64_t iterations)
+{
+	for (int64_t i = 0; i < iterations; ++i)
+		IO_WriteB(bench_port, IO_ReadB(bench_port) + 1);
+	return iterations * 2;
+}
+
+static batch_f setup_io_handler()
+{
+	static uint8_t latch = 0;
+	IO_RegisterReadHandler(
+	        bench_port,
+	        [](io_port_t, io_width_t) { return latch; },
+	        io_width_t::byte);
+	IO_RegisterWriteHandler(
+	        bench_port,
+	        [](io_port_t, io_val_t val, io_width_t) {
+		        latch = static_cast<uint8_t>(val);
+	        },
+	        io_width_t::byte);
+	return dispatch_bench_port;
+}
+
+// Kept, so the reads can't be left out
+static uint8_t last_status = 0;
+
+static int64_t poll_retrace(const int64_t iterations)
+{
+	for (int64_t i = 0; i < iterations; ++i)
+		last_status = IO_ReadB(0x3da);
+	return iterations;
+}
+
+static batch_f setup_io_vga_status()
+{
+	return poll_retrace;
+}
+
+// PIC: adding events among the queued ones and removing them again
+// ----------------------------------------------------------------
+
+static void bench_event(uint32_t) {}
+
+static int64_t schedule_events(const int64_t iterations)
+{
+	constexpr uint32_t events_per_batch = 64;
+
+	int64_t items = 0;
+	for (int64_t i = 0; i < iterations; ++i) {
+		for (uint32_t e = 0; e < events_per_batch; ++e)
+			PIC_AddEvent(bench_event, 0.01 * (e % 13 + 1), e);
+		for (uint32_t e = 0; e < events_per_batch; e += 2)
+			PIC_RemoveSpecificEvents(bench_event, e);
+		PIC_RemoveEvents(bench_event);
+		items += events_per_batch;
+	}
+	return items;
+}
+
+static batch_f setup_pic_events()
+{
+	return schedule_events;
+}
+
+// Callbacks: interrupts called from C++, like the DOS console calling INT 10h,
+// to a native handler and to a guest one that only the core can run
+// ----------------------------------------------------------------------------
+
+constexpr uint8_t native_int = 0xf0;
+constexpr uint8_t guest_int  = 0xf1;
+
+static Bitu bench_callback()
+{
+	return CBRET_NONE;
+}
+
+static int64_t call_int(const uint8_t num, const int64_t iterations)
+{
+	for (int64_t i = 0; i < iterations; ++i) {
+		// Keeps the nested core loop from reaching the end of its tick,
+		// where it would hand back to the frame loop
+		CPU_Cycles    = 0;
+		CPU_CycleLeft = 1'000'000;
+		CALLBACK_RunRealInt(num);
+	}
+	return iterations;
+}
+
+static batch_f setup_callback(const uint8_t num)
+{
+	static Bitu callback = 0;
+	if (!callback) {
+		callback = CALLBACK_Allocate();
+		CALLBACK_Setup(callback, &bench_callback, CB_IRET, "bench");
+		RealSetVec(native_int, CALLBACK_RealPointer(callback));
+
+		// An IRET after the instruction mix's code
+		constexpr uint16_t iret_offset = 0x100;
+		mem_writeb((code_seg << 4) + iret_offset, 0xcf);
+		RealSetVec(guest_int, RealMake(code_seg, iret_offset));
+	}
+	SegSet16(ss, stack_seg);
+	reg_esp    = 0xfffe;
+	cpudecoder = &CPU_Core_Normal_Run;
+	return [num](const int64_t iterations) { return call_int(num, iterations); };
+}
+
+static batch_f setup_callback_native()
+{
+	return setup_callback(native_int);
+}
+
+static batch_f setup_callback_guest()
+{
+	return setup_callback(guest_int);
+}
+
+// Drive cache: short name lookups in a directory of long host names
+// -----------------------------------------------------------------
+
+constexpr int cached_files = 500;
+
+static std_fs::path cache_dir = {};
+static std::unique_ptr<DOS_Drive_Cache> drive_cache = {};
+static std::vector<std::string> lookups = {};
+
+static int64_t expand_names(const int64_t iterations)
+{
+	size_t next = 0;
+	for (int64_t i = 0; i < iterations; ++i) {
+		drive_cache->GetExpandName(lookups[next].c_str());
+		if (++next == lookups.size())
+			next = 0;
+	}
+	return iterations;
+}
+
+static batch_f setup_drive_cache()
+{
+	cache_dir = std_fs::temp_directory_path() / "dosbox_core_benchmark";
+	std::error_code ec = {};
+	std_fs::remove_all(cache_dir, ec);
+	std_fs::create_directories(cache_dir / "Long Directory Name", ec);
+	if (ec)
+		return nullptr;
+
+	for (int i = 0; i < cached_files; ++i) {
+		const auto name = "Long File Name " + std::to_string(i) + ".txt";
+		FILE *f = fopen((cache_dir / "Long Directory Name" / name).string().c_str(), "w");
+		if (f)
+			fclose(f);
+	}
+
+	auto base = cache_dir.string();
+	base += CROSS_FILESPLIT;
+	drive_cache = std::make_unique<DOS_Drive_Cache>(base.c_str());
+
+	// Most of the short names are numbered with ~N, so take them from
+	// the directory listing
+	const auto dir = base + "LONGDI~1";
+	uint16_t id = 0;
+	char path[CROSS_LEN] = {};
+	safe_strcpy(path, dir.c_str());
+	char *entry = nullptr;
+	lookups.clear();
+	if (drive_cache->FindFirst(path, "*.*", id)) {
+		while (drive_cache->FindNext(id, entry)) {
+			if (entry[0] != '.')
+				lookups.push_back(dir + CROSS_FILESPLIT + entry);
+		}
+	}
+	if (lookups.empty())
+		return nullptr;
+	return expand_names;
+}
+
+static void teardown_drive_cache()
+{
+	drive_cache.reset();
+	std::error_code ec = {};
+	std_fs::remove_all(cache_dir, ec);
+}
+
+static const std::vector<Case> cases = {
+        {"cpu_normal", "cycles", setup_cpu_normal},
+        {"cpu_dynrec", "cycles", setup_cpu_dynrec},
+        {"mixer_add_samples_s16", "frames", setup_mixer_s16},
+        {"mixer_add_samples_m8", "frames", setup_mixer_m8},
+        {"io_handler", "accesses", setup_io_handler},
+        {"io_vga_status", "accesses", setup_io_vga_status},
+        {"pic_events", "events", setup_pic_events},
+        {"callback_native_int", "calls", setup_callback_native},
+        {"callback_guest_int", "calls", setup_callback_guest},
+        {"drive_cache_lookup", "lookups", setup_drive_cache},
+        // Last, as the mode change leaves the VGA in planar mode
+        {"vga_rasterop", "bytes", setup_vga_rasterop},
+};
+
+class Machine {
+public:
+	Machine(const char *program) : argv{program}, com_line(1, argv)
+	{
+		control = std::make_unique<Config>(&com_line);
+
+		// Create DOSBox Staging's config directory, which is a
+		// pre-requisite that's asserted during the Init process.
+		CROSS_DetermineConfigPaths();
+
+		// This will register all the init functions, but won't run them
+		DOSBOX_Init();
+
+		const std::vector<std::string> settings = {
+		        "dosbox machine=svga_s3",
+		        "cpu core=normal",
+		        "cpu cycles=fixed 3000",
+		        "mixer nosound=true",
+		        "mixer rate=" + std::to_string(mixer_rate),
+		};
+		for (const auto &setting : settings) {
+			const auto space   = setting.find(' ');
+			const auto name    = setting.substr(0, space);
+			const auto section = control->GetSection(name);
+			assert(section);
+			if (!section->HandleInputline(setting.substr(space + 1)))
+				fprintf(stderr, "Can't apply '%s'\n", setting.c_str());
+		}
+
+		for (const auto &name : sections)
+			control->GetSection(name)->ExecuteEarlyInit();
+		for (const auto &name : sections)
+			control->GetSection(name)->ExecuteInit();
+	}
+
+	~Machine()
+	{
+		for (auto it = sections.rbegin(); it != sections.rend(); ++it)
+			control->GetSection(*it)->ExecuteDestroy();
+		GFX_RequestExit(true);
+	}
+
+private:
+	Machine(const Machine &)            = delete;
+	Machine &operator=(const Machine &) = delete;
+
+	const char *argv[1];
+	CommandLine com_line;
+
+	// The joystick section brings up the BIOS and the video BIOS
+	const std::vector<std::string> sections = {"dosbox", "cpu", "mixer", "joystick"};
+};
+
+static double cpu_seconds()
+{
+	return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+// Doubles the batch until one takes a tenth of the minimum time, then
+// repeats batches of that size until the minimum time has passed
+static Result measure(const Case &c, const batch_f &run, const double min_time)
+{
+	using clock = std::chrono::steady_clock;
+
+	int64_t batch = 1;
+	for (;;) {
+		const auto start = clock::now();
+		run(batch);
+		const std::chrono::duration<double> took = clock::now() - start;
+		if (took.count() >= min_time / 10 || batch >= (int64_t{1} << 40))
+			break;
+		batch *= 2;
+	}
+
+	int64_t iterations = 0;
+	int64_t items      = 0;
+	double real_s      = 0.0;
+	const auto cpu_start = cpu_seconds();
+	while (real_s < min_time) {
+		const auto start = clock::now();
+		items += run(batch);
+		const std::chrono::duration<double> took = clock::now() - start;
+		real_s += took.count();
+		iterations += batch;
+	}
+	const auto cpu_s = cpu_seconds() - cpu_start;
+
+	Result result = {};
+	result.name       = c.name;
+	result.iterations = iterations;
+	result.real_ns    = real_s * 1e9 / static_cast<double>(iterations);
+	result.cpu_ns     = cpu_s * 1e9 / static_cast<double>(iterations);
+	result.items_per_second = static_cast<double>(items) / std::max(real_s, 1e-9);
+	result.items = c.items;
+	return result;
+}
+
+static bool write_json(const char *path, const char *program,
+                       const std::vector<Result> &results)
+{
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return false;
+
+	char date[32] = {};
+	const auto now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+	fprintf(f, "{\n  \"context\": {\n");
+	fprintf(f, "    \"date\": \"%s\",\n", date);
+	fprintf(f, "    \"executable\": \"%s\",\n", program);
+	fprintf(f, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+	fprintf(f, "    \"library_build_type\": \"release\"\n");
+#else
+	fprintf(f, "    \"library_build_type\": \"debug\"\n");
+#endif
+	fprintf(f, "  },\n  \"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); ++i) {
+		const auto &r = results[i];
+		fprintf(f, "    {\n");
+		fprintf(f, "      \"name\": \"%s\",\n", r.name.c_str());
+		fprintf(f, "      \"run_name\": \"%s\",\n", r.name.c_str());
+		fprintf(f, "      \"run_type\": \"iteration\",\n");
+		fprintf(f, "      \"repetitions\": 1,\n");
+		fprintf(f, "      \"iterations\": %lld,\n", static_cast<long long>(r.iterations));
+		fprintf(f, "      \"real_time\": %.6f,\n", r.real_ns);
+		fprintf(f, "      \"cpu_time\": %.6f,\n", r.cpu_ns);
+		fprintf(f, "      \"time_unit\": \"ns\",\n");
+		fprintf(f, "      \"items_per_second\": %.3f\n", r.items_per_second);
+		fprintf(f, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	fclose(f);
+	return true;
+}
+
+static void print_usage(const char *program)
+{
+	fprintf(stderr,
+	        "Usage: %s [--case NAME] [--min-time SECONDS] [--json FILE]\n\n"
+	        "Cases:",
+	        program);
+	for (const auto &c : cases)
+		fprintf(stderr, " %s", c.name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	std::string case_name = {};
+	std::string json_path = {};
+	auto min_time         = 1.0;
+
+	for (auto i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const auto has_value = i + 1 < argc;
+		if (arg == "--case" && has_value) {
+			case_name = argv[++i];
+		} else if (arg == "--min-time" && has_value) {
+			min_time = std::max(atof(argv[++i]), 0.01);
+		} else if (arg == "--json" && has_value) {
+			json_path = argv[++i];
+		} else {
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	const auto is_known = std::any_of(cases.begin(), cases.end(), [&](const Case &c) {
+		return case_name == c.name;
+	});
+	if (!case_name.empty() && !is_known) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	Machine machine(argv[0]);
+
+	std::vector<Result> results = {};
+	for (const auto &c : cases) {
+		if (!case_name.empty() && case_name != c.name)
+			continue;
+
+		const auto run = c.setup();
+		if (!run) {
+			printf("%-24s skipped\n", c.name);
+			continue;
+		}
+		const auto result = measure(c, run, min_time);
+		printf("%-24s %12.2f ns %14.0f %s/s\n",
+		       result.name.c_str(),
+		       result.real_ns,
+		       result.items_per_second,
+		       result.items);
+		fflush(stdout);
+		results.push_back(result);
+	}
+
+	teardown_drive_cache();
+	if (bench_channel)
+		bench_channel->Enable(false);
+	cpudecoder = &CPU_Core_Normal_Run;
+
+	if (!json_path.empty() && !write_json(json_path.c_str(), argv[0], results)) {
+		fprintf(stderr, "Can't write '%s'\n", json_path.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -139,6 +139,18 @@ TEST(iohandler_containers, empty_writes)
 	write_byte_to_port(unregistered, 0);
 }
 
+TEST(iohandler_containers, freed_reads)
+{
+	constexpr uint16_t port = 0x1234;
+	IO_RegisterReadHandler(port, read_word_new, io_width_t::word);
+	word_val_new = 0x5678;
+	EXPECT_EQ(read_word_from_port(port), 0x5678);
+
+	IO_FreeReadHandler(port, io_width_t::word);
+	EXPECT_EQ(read_byte_from_port(port), 0xff);
+	EXPECT_EQ(read_word_from_port(port), 0xffff);
+}
+
 TEST(iohandler_containers, adjacent_word_read)
 {
 	constexpr uint8_t val = 0x1;
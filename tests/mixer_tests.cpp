@@ -0,0 +1,63 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "mixer.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "control.h"
+#include "setup.h"
+
+// declarations of private functions to test
+bool is_polyphase_resampler_selected(const Section_prop &section);
+
+namespace {
+
+Section_prop *add_mixer_section(const config_ptr_t &conf)
+{
+	MIXER_AddConfigSection(conf);
+	return static_cast<Section_prop *>(conf->GetSection("mixer"));
+}
+
+TEST(MixerResampler, SpeexByDefault)
+{
+	const auto conf    = std::make_unique<Config>();
+	const auto section = add_mixer_section(conf);
+	ASSERT_NE(section, nullptr);
+
+	EXPECT_FALSE(is_polyphase_resampler_selected(*section));
+}
+
+TEST(MixerResampler, PolyphaseSelectedThroughConfig)
+{
+	const auto conf    = std::make_unique<Config>();
+	const auto section = add_mixer_section(conf);
+	ASSERT_NE(section, nullptr);
+
+	EXPECT_TRUE(section->HandleInputline("resampler=polyphase"));
+	EXPECT_TRUE(is_polyphase_resampler_selected(*section));
+
+	EXPECT_TRUE(section->HandleInputline("resampler=speex"));
+	EXPECT_FALSE(is_polyphase_resampler_selected(*section));
+}
+
+} // namespace
@@ -0,0 +1,184 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "../src/libs/nuked/opl3.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+
+namespace {
+
+constexpr uint32_t opl_rate_hz = 49716;
+
+// Hashes the output of the chip, FNV-1a style
+class OutputHash {
+public:
+	void Add(const int16_t sample)
+	{
+		for (const auto byte : {sample & 0xff, (sample >> 8) & 0xff}) {
+			hash ^= static_cast<uint32_t>(byte);
+			hash *= 16777619u;
+		}
+	}
+	uint32_t Get() const
+	{
+		return hash;
+	}
+
+private:
+	uint32_t hash = 2166136261u;
+};
+
+void render(opl3_chip &chip, const int num_frames, OutputHash &hash)
+{
+	for (auto i = 0; i < num_frames; ++i) {
+		int16_t frame[2] = {};
+		OPL3_GenerateStream(&chip, frame, 1);
+		hash.Add(frame[0]);
+		hash.Add(frame[1]);
+	}
+}
+
+void set_up_channel(opl3_chip &chip, const uint16_t bank, const uint8_t ch,
+                    const uint8_t variation)
+{
+	// The offsets of the channel's modulator and carrier slots
+	constexpr uint8_t slot_offsets[9] = {0x00, 0x01, 0x02, 0x08, 0x09,
+	                                     0x0a, 0x10, 0x11, 0x12};
+	const auto mod = static_cast<uint16_t>(bank | slot_offsets[ch]);
+	const auto car = static_cast<uint16_t>(mod + 3);
+
+	const auto v = variation;
+	OPL3_WriteReg(&chip, 0x20 | mod, static_cast<uint8_t>(0xe1 ^ (v << 4)));
+	OPL3_WriteReg(&chip, 0x20 | car, static_cast<uint8_t>(0x21 + (v & 3)));
+	OPL3_WriteReg(&chip, 0x40 | mod, static_cast<uint8_t>(0x10 + v));
+	OPL3_WriteReg(&chip, 0x40 | car, static_cast<uint8_t>(0x40 * (v & 3)));
+	OPL3_WriteReg(&chip, 0x60 | mod, static_cast<uint8_t>(0xf2 - v));
+	OPL3_WriteReg(&chip, 0x60 | car, static_cast<uint8_t>(0x83 + v * 0x11));
+	OPL3_WriteReg(&chip, 0x80 | mod, static_cast<uint8_t>(0x27 + v));
+	OPL3_WriteReg(&chip, 0x80 | car, static_cast<uint8_t>(0x15 + v * 0x10));
+	OPL3_WriteReg(&chip, 0xe0 | mod, static_cast<uint8_t>(v & 7));
+	OPL3_WriteReg(&chip, 0xe0 | car, static_cast<uint8_t>((v + 3) & 7));
+
+	const auto chan = static_cast<uint16_t>(bank | ch);
+	OPL3_WriteReg(&chip, 0xc0 | chan, static_cast<uint8_t>(0x30 | (v % 8) << 1 | (v & 1)));
+	OPL3_WriteReg(&chip, 0xa0 | chan, static_cast<uint8_t>(0x41 + v * 0x17));
+}
+
+void key(opl3_chip &chip, const uint16_t bank, const uint8_t ch,
+         const uint8_t variation, const bool on)
+{
+	const auto block_fnum_hi = static_cast<uint8_t>(((variation % 7) << 2) | 1);
+	OPL3_WriteReg(&chip,
+	              static_cast<uint16_t>(0xb0 | bank | ch),
+	              static_cast<uint8_t>(block_fnum_hi | (on ? 0x20 : 0)));
+}
+
+// Plays melodic channels in both banks, four-operator pairs, and the rhythm
+// section, stepping through the whole envelope, and returns the hash of
+// the output
+uint32_t play_test_song(opl3_chip &chip)
+{
+	OutputHash hash = {};
+
+	OPL3_WriteReg(&chip, 0x105, 0x01); // OPL3 mode
+	OPL3_WriteReg(&chip, 0x104, 0x03); // 4-op on channels 0-3 and 1-4
+	OPL3_WriteReg(&chip, 0x01, 0x20);
+	OPL3_WriteReg(&chip, 0x08, 0x40);
+	OPL3_WriteReg(&chip, 0xbd, 0xc0); // deep tremolo and vibrato
+
+	for (uint8_t ch = 0; ch < 9; ++ch) {
+		set_up_channel(chip, 0x000, ch, ch);
+		set_up_channel(chip, 0x100, ch, static_cast<uint8_t>(ch + 5));
+	}
+	for (uint8_t ch = 0; ch < 9; ++ch) {
+		key(chip, 0x000, ch, ch, true);
+		render(chip, 700, hash);
+		key(chip, 0x100, ch, static_cast<uint8_t>(ch + 5), true);
+		render(chip, 300, hash);
+	}
+	render(chip, 20000, hash);
+
+	// Rhythm mode: bass drum, snare, tom, cymbal and hi-hat
+	OPL3_WriteReg(&chip, 0xbd, 0xff);
+	render(chip, 8000, hash);
+	OPL3_WriteReg(&chip, 0xbd, 0xe0);
+	render(chip, 4000, hash);
+
+	for (uint8_t ch = 0; ch < 9; ++ch) {
+		key(chip, 0x000, ch, ch, false);
+		key(chip, 0x100, ch, static_cast<uint8_t>(ch + 5), false);
+		render(chip, 500, hash);
+	}
+	render(chip, 60000, hash);
+	return hash.Get();
+}
+
+// The same for the first bank in OPL2 mode, where only the first four
+// waveforms are available and both outputs carry every channel
+uint32_t play_opl2_test_song(opl3_chip &chip)
+{
+	OutputHash hash = {};
+
+	OPL3_WriteReg(&chip, 0x01, 0x20); // waveform select
+	OPL3_WriteReg(&chip, 0xbd, 0x40);
+
+	for (uint8_t ch = 0; ch < 9; ++ch) {
+		set_up_channel(chip, 0x000, ch, static_cast<uint8_t>(ch * 2));
+	}
+	for (uint8_t ch = 0; ch < 9; ++ch) {
+		key(chip, 0x000, ch, static_cast<uint8_t>(ch * 2), true);
+		render(chip, 1000, hash);
+	}
+	render(chip, 10000, hash);
+
+	OPL3_WriteReg(&chip, 0xbd, 0x7f);
+	render(chip, 6000, hash);
+
+	for (uint8_t ch = 0; ch < 9; ++ch) {
+		key(chip, 0x000, ch, static_cast<uint8_t>(ch * 2), false);
+		render(chip, 500, hash);
+	}
+	render(chip, 30000, hash);
+	return hash.Get();
+}
+
+// The expected hashes are of the output of the unmodified Nuked OPL3 1.8
+// core, so any change to it must stay bit-exact
+
+TEST(NukedOpl3, MatchesReferenceOutput)
+{
+	auto chip = std::make_unique<opl3_chip>();
+	OPL3_Reset(chip.get(), opl_rate_hz);
+
+	EXPECT_EQ(play_test_song(*chip), 3446364635u);
+}
+
+TEST(NukedOpl3, MatchesReferenceOutputInOpl2Mode)
+{
+	auto chip = std::make_unique<opl3_chip>();
+	OPL3_Reset(chip.get(), opl_rate_hz);
+
+	EXPECT_EQ(play_opl2_test_song(*chip), 2322559014u);
+}
+
+} // namespace
@@ -0,0 +1,147 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "../src/hardware/polyphase_resampler.cpp"
+
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Generates interleaved stereo frames of a sine, with the right side at half
+// the left's amplitude
+std::vector<float> make_sine(const int rate, const double freq, const int num_frames)
+{
+	std::vector<float> frames(static_cast<size_t>(num_frames) * 2);
+	for (auto i = 0; i < num_frames; ++i) {
+		const auto s = std::sin(2.0 * pi * freq * i / rate);
+		frames[i * 2 + 0] = static_cast<float>(s);
+		frames[i * 2 + 1] = static_cast<float>(s * 0.5);
+	}
+	return frames;
+}
+
+// Resamples the frames in uneven blocks, as the mixer does
+std::vector<float> resample(PolyphaseResampler &resampler,
+                            const std::vector<float> &in)
+{
+	std::vector<float> out = {};
+
+	const auto num_frames = static_cast<int>(in.size() / 2);
+	auto pos = 0;
+	auto block = 1;
+	while (pos < num_frames) {
+		const auto n = std::min(block, num_frames - pos);
+		resampler.Process(in.data() + pos * 2, n, out);
+		pos += n;
+		block = block % 97 + 13;
+	}
+	return out;
+}
+
+// The RMS level of one side, skipping the filter's settling time
+double rms(const std::vector<float> &frames, const int side)
+{
+	const auto num_frames = frames.size() / 2;
+	const auto settle     = num_frames / 4;
+
+	auto sum = 0.0;
+	for (auto i = settle; i < num_frames; ++i)
+		sum += frames[i * 2 + side] * frames[i * 2 + side];
+	return std::sqrt(sum / static_cast<double>(num_frames - settle));
+}
+
+TEST(PolyphaseResampler, SupportsCommonDeviceRates)
+{
+	EXPECT_TRUE(PolyphaseResampler::SupportsRates(22050, 48000));
+	EXPECT_TRUE(PolyphaseResampler::SupportsRates(44100, 48000));
+	EXPECT_TRUE(PolyphaseResampler::SupportsRates(49716, 48000));
+	EXPECT_TRUE(PolyphaseResampler::SupportsRates(49716, 44100));
+
+	// Coprime rates would need too many phases
+	EXPECT_FALSE(PolyphaseResampler::SupportsRates(48001, 48000));
+	EXPECT_FALSE(PolyphaseResampler::SupportsRates(0, 48000));
+}
+
+TEST(PolyphaseResampler, ProducesFramesAtTheRatio)
+{
+	PolyphaseResampler resampler(22050, 48000);
+
+	const auto in  = make_sine(22050, 1000.0, 22050);
+	const auto out = resample(resampler, in);
+
+	// One second in gives one second out, less the skipped filter delay
+	const auto out_frames = static_cast<int>(out.size() / 2);
+	EXPECT_NEAR(out_frames, 48000, 48000 * 64 / 22050 + 2);
+}
+
+TEST(PolyphaseResampler, PassesConstantSignal)
+{
+	PolyphaseResampler resampler(44100, 48000);
+
+	const std::vector<float> in(44100 * 2, 1000.0f);
+	const auto out = resample(resampler, in);
+
+	for (auto i = out.size() / 2; i < out.size(); ++i)
+		ASSERT_NEAR(out[i], 1000.0f, 0.01f);
+}
+
+TEST(PolyphaseResampler, PassesPassbandTone)
+{
+	PolyphaseResampler resampler(22050, 48000);
+
+	const auto in  = make_sine(22050, 4000.0, 22050);
+	const auto out = resample(resampler, in);
+
+	const auto sine_rms = 1.0 / std::sqrt(2.0);
+	EXPECT_NEAR(rms(out, 0), sine_rms, 0.01);
+	EXPECT_NEAR(rms(out, 1), sine_rms * 0.5, 0.005);
+}
+
+TEST(PolyphaseResampler, RejectsToneAboveOutputNyquist)
+{
+	PolyphaseResampler resampler(49716, 22050);
+
+	// Well above the 11025 Hz Nyquist frequency of the output
+	const auto in  = make_sine(49716, 16000.0, 49716);
+	const auto out = resample(resampler, in);
+
+	// At least 70 dB down
+	EXPECT_LT(rms(out, 0), 0.7 * std::pow(10.0, -70.0 / 20.0));
+}
+
+TEST(PolyphaseResampler, ResetClearsHistory)
+{
+	PolyphaseResampler resampler(44100, 48000);
+
+	const std::vector<float> loud(4410 * 2, 10000.0f);
+	resample(resampler, loud);
+	resampler.Reset();
+
+	const std::vector<float> silence(4410 * 2, 0.0f);
+	const auto out = resample(resampler, silence);
+
+	for (const auto sample : out)
+		ASSERT_EQ(sample, 0.0f);
+}
+
+} // namespace
@@ -0,0 +1,81 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "ring_buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+TEST(RingBuffer, EnqueuesUpToCapacity)
+{
+	RingBuffer<int, 4> rb = {};
+	EXPECT_TRUE(rb.IsEmpty());
+	EXPECT_EQ(rb.MaxCapacity(), 4);
+
+	for (int i = 0; i < 4; ++i)
+		EXPECT_TRUE(rb.Enqueue(i));
+	EXPECT_TRUE(rb.IsFull());
+	EXPECT_FALSE(rb.Enqueue(4));
+	EXPECT_EQ(rb.Size(), 4);
+
+	EXPECT_EQ(rb.Front(), 0);
+	EXPECT_EQ(rb.Dequeue(), 0);
+	EXPECT_EQ(rb.Dequeue(), 1);
+	EXPECT_EQ(rb.Size(), 2);
+
+	rb.Clear();
+	EXPECT_TRUE(rb.IsEmpty());
+}
+
+TEST(RingBuffer, DequeuesBulkInOrderAcrossTheWrap)
+{
+	RingBuffer<int, 8> rb = {};
+	int next_in  = 0;
+	int next_out = 0;
+
+	for (int round = 0; round < 10; ++round) {
+		while (rb.Size() < 6)
+			rb.Enqueue(next_in++);
+
+		std::vector<int> out = {};
+		auto runs            = 0;
+
+		const auto collect = [&](const int *items, const size_t num_items) {
+			out.insert(out.end(), items, items + num_items);
+			++runs;
+		};
+		const auto n = rb.DequeueBulk(5, collect);
+
+		EXPECT_EQ(n, 5);
+		EXPECT_LE(runs, 2);
+		for (const auto item : out)
+			EXPECT_EQ(item, next_out++);
+	}
+
+	// Asking for more than is queued only takes what's there
+	const auto n = rb.DequeueBulk(100, [](const int *, const size_t) {});
+	EXPECT_EQ(n, 1);
+	EXPECT_TRUE(rb.IsEmpty());
+}
+
+} // namespace
@@ -1,7 +1,7 @@
 /*
  *  SPDX-License-Identifier: GPL-2.0-or-later
  *
- *  Copyright (C) 2021-2021  The DOSBox Staging Team
+ *  Copyright (C) 2021-2022  The DOSBox Staging Team
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -23,6 +23,11 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -238,4 +243,242 @@ TEST(RWQueue,ContainerMoveAsync)
 	EXPECT_EQ(q.Size(), 0);
 }
 
+TEST(RWQueue, BulkSerial)
+{
+	RWQueue<int> q(16);
+
+	std::array<int, 10> items = {};
+	std::iota(items.begin(), items.end(), 0);
+	q.BulkEnqueue(items.data(), items.size());
+	EXPECT_EQ(q.Size(), 10);
+
+	// Takes no more than asked for ...
+	std::array<int, 10> out = {};
+	EXPECT_EQ(q.BulkDequeue(out.data(), 4), 4);
+	EXPECT_THAT(out, ::testing::ElementsAre(0, 1, 2, 3, 0, 0, 0, 0, 0, 0));
+
+	// ... and no more than are queued
+	EXPECT_EQ(q.BulkDequeue(out.data(), out.size()), 6);
+	EXPECT_THAT(out, ::testing::ElementsAre(4, 5, 6, 7, 8, 9, 0, 0, 0, 0));
+	EXPECT_TRUE(q.IsEmpty());
+}
+
+TEST(RWQueue, BulkContainerMoves)
+{
+	RWQueue<container_t> q(4);
+
+	std::array<container_t, 3> items = {container_t(1), container_t(2),
+	                                    container_t(3)};
+	q.BulkEnqueue(items.data(), items.size());
+	for (const auto &v : items)
+		EXPECT_EQ(v.size(), 0); // check move
+
+	std::array<container_t, 3> out = {};
+	EXPECT_EQ(q.BulkDequeue(out.data(), out.size()), 3);
+	EXPECT_EQ(out[0].size(), 1);
+	EXPECT_EQ(out[1].size(), 2);
+	EXPECT_EQ(out[2].size(), 3);
+}
+
+TEST(SpscQueue, TrivialSerial)
+{
+	SpscQueue<int> q(65);
+	for (int iteration = 0; iteration != 128; ++iteration) {
+		// wrap around the ring a few times
+		EXPECT_EQ(q.MaxCapacity(), 65);
+		EXPECT_TRUE(q.IsEmpty());
+		for (int i = 0; i != 65; ++i)
+			q.Enqueue(i);
+		EXPECT_EQ(q.Size(), 65);
+		EXPECT_FALSE(q.IsEmpty());
+
+		for (int i = 0; i != 65; ++i)
+			EXPECT_EQ(q.Dequeue(), i);
+		EXPECT_TRUE(q.IsEmpty());
+	}
+}
+
+TEST(SpscQueue, TrivialZeroCapacity)
+{
+	// Zero capacity
+	EXPECT_DEBUG_DEATH({ SpscQueue<int> q(0); }, "");
+}
+
+TEST(SpscQueue, BulkSerial)
+{
+	SpscQueue<int> q(8);
+
+	// Start partway through the ring so the items wrap
+	for (int i = 0; i != 5; ++i)
+		q.Enqueue(-1);
+	for (int i = 0; i != 5; ++i)
+		q.Dequeue();
+
+	std::array<int, 8> items = {};
+	std::iota(items.begin(), items.end(), 0);
+	q.BulkEnqueue(items.data(), items.size());
+	EXPECT_EQ(q.Size(), 8);
+
+	std::array<int, 8> out = {};
+	EXPECT_EQ(q.BulkDequeue(out.data(), 3), 3);
+	EXPECT_EQ(q.BulkDequeue(out.data() + 3, out.size()), 5);
+	EXPECT_EQ(out, items);
+	EXPECT_TRUE(q.IsEmpty());
+}
+
+void spsc_consume_container(SpscQueue<container_t> *q, const size_t *max_depth)
+{
+	container_t v;
+	for (int i = 0; i != iterations; ++i) {
+		EXPECT_TRUE(q->Size() <= *max_depth);
+		v = q->Dequeue();
+		EXPECT_EQ(v[i], i);
+		EXPECT_EQ(v.size(), i + 1);
+	}
+}
+
+void spsc_produce_move_container(SpscQueue<container_t> *q, const size_t *max_depth)
+{
+	for (int i = 0; i != iterations; ++i) {
+		container_t v(i + 1);
+		v[i] = i;
+		q->Enqueue(std::move(v));
+		EXPECT_EQ(v.size(), 0); // check move
+		EXPECT_TRUE(q->Size() <= *max_depth);
+	}
+}
+
+TEST(SpscQueue, ContainerMoveAsync)
+{
+	const size_t max_depth = 8;
+	SpscQueue<container_t> q(max_depth);
+
+	std::thread writer(spsc_produce_move_container, &q, &max_depth);
+	std::thread reader(spsc_consume_container, &q, &max_depth);
+
+	writer.join();
+	reader.join();
+
+	// Make sure we've consumed all produced items and the queue is empty
+	EXPECT_EQ(q.Size(), 0);
+}
+
+// Benchmarks
+// ~~~~~~~~~~
+// Passes items between two threads through each kind of queue, one at a time
+// and in batches, checking their order and reporting the rates. These run
+// with the other tests, so they're kept short.
+
+constexpr int bench_items       = 200000;
+constexpr int bench_round_trips = 20000;
+constexpr size_t bench_capacity = 64;
+constexpr size_t bench_batch    = 16;
+
+using bench_clock = std::chrono::steady_clock;
+
+static double seconds_since(const bench_clock::time_point start)
+{
+	return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+template <typename Queue>
+static void produce_bench_items(Queue *q, const size_t batch)
+{
+	std::vector<int> items(batch);
+	for (int i = 0; i < bench_items;) {
+		const auto n = std::min(batch, static_cast<size_t>(bench_items - i));
+		if (n == 1) {
+			q->Enqueue(i++);
+			continue;
+		}
+		for (size_t j = 0; j < n; ++j)
+			items[j] = i++;
+		q->BulkEnqueue(items.data(), n);
+	}
+}
+
+// Returns the items per second passed from a producer to a consumer thread
+template <typename Queue>
+static double measure_throughput(const size_t batch)
+{
+	Queue q(bench_capacity);
+
+	const auto start = bench_clock::now();
+	std::thread writer(produce_bench_items<Queue>, &q, batch);
+
+	std::vector<int> items(batch);
+	auto in_order = true;
+	for (int expected = 0; expected < bench_items;) {
+		if (batch == 1) {
+			in_order &= (q.Dequeue() == expected++);
+			continue;
+		}
+		const auto n = q.BulkDequeue(items.data(), batch);
+		for (size_t j = 0; j < n; ++j)
+			in_order &= (items[j] == expected++);
+	}
+	writer.join();
+	const auto elapsed = seconds_since(start);
+
+	EXPECT_TRUE(in_order);
+	EXPECT_TRUE(q.IsEmpty());
+	return bench_items / elapsed;
+}
+
+template <typename Queue>
+static void echo_bench_items(Queue *requests, Queue *replies)
+{
+	for (int i = 0; i < bench_round_trips; ++i)
+		replies->Enqueue(requests->Dequeue());
+}
+
+// Returns the average time, in microseconds, for an item to go to another
+// thread and back
+template <typename Queue>
+static double measure_round_trip()
+{
+	Queue requests(1);
+	Queue replies(1);
+	std::thread echoer(echo_bench_items<Queue>, &requests, &replies);
+
+	auto in_order    = true;
+	const auto start = bench_clock::now();
+	for (int i = 0; i < bench_round_trips; ++i) {
+		requests.Enqueue(i);
+		in_order &= (replies.Dequeue() == i);
+	}
+	const auto elapsed = seconds_since(start);
+	echoer.join();
+
+	EXPECT_TRUE(in_order);
+	return elapsed / bench_round_trips * 1e6;
+}
+
+static void report(const std::string &name, const double items_per_s,
+                   const double bulk_items_per_s, const double round_trip_us)
+{
+	printf("[ BENCH    ] %-10s %7.2f M items/s, %7.2f M items/s in batches of %zu, %7.2f us round trip\n",
+	       name.c_str(),
+	       items_per_s / 1e6,
+	       bulk_items_per_s / 1e6,
+	       bench_batch,
+	       round_trip_us);
+}
+
+TEST(RWQueue, Benchmark)
+{
+	report("RWQueue",
+	       measure_throughput<RWQueue<int>>(1),
+	       measure_throughput<RWQueue<int>>(bench_batch),
+	       measure_round_trip<RWQueue<int>>());
+}
+
+TEST(SpscQueue, Benchmark)
+{
+	report("SpscQueue",
+	       measure_throughput<SpscQueue<int>>(1),
+	       measure_throughput<SpscQueue<int>>(bench_batch),
+	       measure_round_trip<SpscQueue<int>>());
+}
+
 } // namespace
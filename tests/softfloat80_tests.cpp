@@ -0,0 +1,102 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2022-2022  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "softfloat80.h"
+
+#include <cstdint>
+#include <gtest/gtest.h>
+
+namespace {
+
+constexpr uint16_t cw_extended = 0x037f;
+constexpr uint16_t cw_double   = 0x027f;
+constexpr uint16_t cw_chop     = 0x0f7f;
+
+constexpr Ext80 one   = {UINT64_C(0x8000000000000000), 0x3fff};
+constexpr Ext80 three = {UINT64_C(0xc000000000000000), 0x4000};
+
+TEST(Softfloat80, ConvertsExactly)
+{
+	EXPECT_EQ(ext80_from_double(1.0), one);
+	EXPECT_EQ(ext80_from_double(3.0), three);
+	EXPECT_EQ(ext80_from_int64(3), three);
+	EXPECT_EQ(ext80_from_int64(-1), ext80_negate(one));
+	EXPECT_EQ(ext80_to_double(ext80_from_double(0.1), 0), 0.1);
+	EXPECT_EQ(ext80_to_double(ext80_from_double(4.9e-324), 0), 4.9e-324);
+
+	// A 64-bit integer survives the round trip, unlike through a double
+	const int64_t big = INT64_C(0x7fffffffffffffff);
+	int64_t result = 0;
+	ASSERT_TRUE(ext80_to_int64(ext80_from_int64(big), 0, result));
+	EXPECT_EQ(result, big);
+}
+
+TEST(Softfloat80, KeepsExtendedPrecision)
+{
+	const auto ctrl = ext80_control(cw_extended);
+	const auto third = ext80_div(one, three, ctrl);
+	EXPECT_EQ(third.mant, UINT64_C(0xaaaaaaaaaaaaaaab));
+	EXPECT_EQ(third.sign_exp, 0x3ffd);
+
+	// 1 + 2^-60 is lost in double precision but not in extended
+	const Ext80 tiny = {UINT64_C(0x8000000000000000), 0x3fff - 60};
+	const auto sum = ext80_add(one, tiny, ctrl);
+	EXPECT_EQ(sum.mant, UINT64_C(0x8000000000000008));
+	EXPECT_EQ(ext80_sub(sum, one, ctrl), tiny);
+	EXPECT_EQ(ext80_add(one, tiny, ext80_control(cw_double)), one);
+}
+
+TEST(Softfloat80, RoundsAsControlled)
+{
+	const auto third_chopped = ext80_div(one, three, ext80_control(cw_chop));
+	EXPECT_EQ(third_chopped.mant, UINT64_C(0xaaaaaaaaaaaaaaaa));
+
+	const auto third_double = ext80_div(one, three, ext80_control(cw_double));
+	EXPECT_EQ(ext80_to_double(third_double, 0), 1.0 / 3.0);
+
+	int64_t result = 0;
+	const auto two_and_half = ext80_from_double(2.5);
+	ASSERT_TRUE(ext80_to_int64(two_and_half, 0, result));
+	EXPECT_EQ(result, 2);
+	ASSERT_TRUE(ext80_to_int64(two_and_half, 2, result));
+	EXPECT_EQ(result, 3);
+	EXPECT_EQ(ext80_round_to_int(ext80_from_double(-0.25), 0),
+	          ext80_negate(ext80_from_double(0.0)));
+}
+
+TEST(Softfloat80, HandlesSpecialValues)
+{
+	const auto ctrl = ext80_control(cw_extended);
+	const auto zero = ext80_from_double(0.0);
+	const auto inf  = ext80_div(one, zero, ctrl);
+	EXPECT_EQ(inf.sign_exp, 0x7fff);
+	EXPECT_EQ(inf.mant, UINT64_C(0x8000000000000000));
+
+	const auto nan = ext80_sub(inf, inf, ctrl);
+	EXPECT_EQ(ext80_compare(nan, nan), 2);
+	EXPECT_EQ(ext80_compare(zero, ext80_negate(zero)), 0);
+	EXPECT_EQ(ext80_compare(one, three), -1);
+
+	int64_t result = 0;
+	EXPECT_FALSE(ext80_to_int64(inf, 0, result));
+	EXPECT_FALSE(ext80_to_int64(ext80_from_double(1e19), 0, result));
+}
+
+} // namespace
@@ -31,7 +31,7 @@ void DEBUG_ShowMsg(const char *, ...) {}
 void DEBUG_HeavyWriteLogInstruction() {}
 
 #if C_DEBUG
-void LOG::operator()([[maybe_unused]] char const *buf, ...)
+void LogMessage::operator()([[maybe_unused]] char const *buf, ...)
 {
 	(void)d_type;     // Deliberately unused.
 	(void)d_severity; // Deliberately unused.